@@ -247,6 +247,7 @@ function GenerateWindowsSettings(settings, conf, target_arch, compiler)
 	settings.link.libs:Add("gdi32")
 	settings.link.libs:Add("user32")
 	settings.link.libs:Add("ws2_32")
+	settings.link.libs:Add("winmm")
 	settings.link.libs:Add("ole32")
 	settings.link.libs:Add("shell32")
 	settings.link.libs:Add("advapi32")
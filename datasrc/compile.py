@@ -99,8 +99,25 @@ if gen_network_header:
 
 	print("#ifndef GAME_GENERATED_PROTOCOL_H")
 	print("#define GAME_GENERATED_PROTOCOL_H")
+	print("#include <engine/shared/protocol.h>")
 	print(network.RawHeader)
 
+	print("static const int max_int = 0x7fffffff;")
+	print("")
+	print("inline bool NetobjInRange(int Value, int Min, int Max) { return (unsigned)Value-(unsigned)Min <= (unsigned)Max-(unsigned)Min; }")
+	print("inline bool NetobjHasFlags(int Value, int Mask) { return (Value&Mask) == Value; }")
+	print("")
+	print("// bits of a changed member in bit packed snapshots, 0 if the range is too wide for fixed bits")
+	print("inline int NetobjFieldBits(int Min, int Max)")
+	print("{")
+	print("\tunsigned Range = (unsigned)Max-(unsigned)Min;")
+	print("\tint Bits = 1; // sign")
+	print("\tfor(; Range; Range >>= 1)")
+	print("\t\tBits++;")
+	print("\treturn Bits <= 9 ? Bits : 0;")
+	print("}")
+	print("")
+
 	for e in network.Enums:
 		for l in create_enum_table(["%s_%s"%(e.name, v) for v in e.values], 'NUM_%sS'%e.name): print(l)
 		print("")
@@ -114,14 +131,14 @@ if gen_network_header:
 	for l in create_enum_table(["NETMSG_INVALID"]+[o.enum_name for o in network.Messages], "NUM_NETMSGTYPES"): print(l)
 	print("")
 
+	EmitEnum(["SOUND_%s"%i.name.value.upper() for i in content.container.sounds.items], "NUM_SOUNDS")
+	EmitEnum(["WEAPON_%s"%i.name.value.upper() for i in content.container.weapons.id.items], "NUM_WEAPONS")
+
 	for item in network.Objects + network.Messages:
 		for line in item.emit_declaration():
 			print(line)
 		print("")
 
-	EmitEnum(["SOUND_%s"%i.name.value.upper() for i in content.container.sounds.items], "NUM_SOUNDS")
-	EmitEnum(["WEAPON_%s"%i.name.value.upper() for i in content.container.weapons.id.items], "NUM_WEAPONS")
-
 	print("""
 
 class CNetObjHandler
@@ -142,6 +159,20 @@ public:
 
 	int ValidateObj(int Type, const void *pData, int Size);
 	const char *GetObjName(int Type) const;
+
+	// the item as T if it has the size of one and its members are in range, 0 otherwise
+	template<class T>
+	static const T *GetValidObj(const void *pData, int Size)
+	{
+		return Size == (int)sizeof(T) && ((const T *)pData)->Valid() ? (const T *)pData : 0;
+	}
+
+	// the bits of the members for CSnapshotDelta::SetFieldBits, returns their number
+	static int GetObjFieldBits(int Type, unsigned char *pBits, int MaxNum);
+
+	// stores the indices of the invalid items in pInvalid, which needs room for
+	// all items, and returns their number. doesn't record what failed
+	static int ValidateSnap(const class CSnapshot *pSnap, int *pInvalid);
 	int GetObjSize(int Type) const;
 	const char *FailedObjOn() const;
 	int NumObjFailures() const;
@@ -161,6 +192,7 @@ if gen_network_source:
 	lines = []
 
 	lines += ['#include <engine/shared/protocol.h>']
+	lines += ['#include <engine/shared/snapshot.h>']
 	lines += ['#include <engine/message.h>']
 	lines += ['#include "protocol.h"']
 
@@ -179,9 +211,6 @@ if gen_network_source:
 	lines += ['']
 	lines += ['']
 
-	lines += ['static const int max_int = 0x7fffffff;']
-	lines += ['']
-
 	lines += ['bool CNetObjHandler::CheckInt(const char *pErrorMsg, int Value, int Min, int Max)']
 	lines += ['{']
 	lines += ['\tif(Value < Min || Value > Max) { m_pObjFailedOn = pErrorMsg; m_NumObjFailures++; return false; }']
@@ -280,6 +309,77 @@ if gen_network_source:
 	lines += ['};']
 	lines += ['']
 
+	lines += ['static int CopyFieldBits(const int *pFrom, int Num, unsigned char *pBits, int MaxNum)']
+	lines += ['{']
+	lines += ['\tif(Num > MaxNum)']
+	lines += ['\t\tNum = MaxNum;']
+	lines += ['\tfor(int i = 0; i < Num; i++)']
+	lines += ['\t\tpBits[i] = (unsigned char)pFrom[i];']
+	lines += ['\treturn Num;']
+	lines += ['}']
+	lines += ['']
+
+	lines += ['int CNetObjHandler::GetObjFieldBits(int Type, unsigned char *pBits, int MaxNum)']
+	lines += ['{']
+	lines += ['\tswitch(Type)']
+	lines += ['\t{']
+	for item in network.Objects:
+		# members of the base come first
+		bits = []
+		base_name = item.base
+		bases = []
+		while base_name:
+			base_item = next(i for i in network.Objects if i.name == base_name)
+			bases.insert(0, base_item)
+			base_name = base_item.base
+		for o in bases + [item]:
+			for v in o.variables:
+				bits += v.emit_field_bits()
+		if not bits:
+			continue
+		lines += ['\tcase %s:' % item.enum_name]
+		lines += ['\t{']
+		lines += ['\t\tconst int aBits[] = {%s};' % ", ".join(bits)]
+		lines += ['\t\treturn CopyFieldBits(aBits, sizeof(aBits)/sizeof(aBits[0]), pBits, MaxNum);']
+		lines += ['\t}']
+	lines += ['\t}']
+	lines += ['\treturn 0;']
+	lines += ['}']
+	lines += ['']
+
+	# snapshot items are sorted by type, so the checks get picked once per run of a type
+	lines += ['template<class T>']
+	lines += ['static int ValidateRun(const CSnapshot *pSnap, int Index, int Type, int *pInvalid, int *pNumInvalid)']
+	lines += ['{']
+	lines += ['\tfor(const int Num = pSnap->NumItems(); Index < Num; Index++)']
+	lines += ['\t{']
+	lines += ['\t\tconst CSnapshotItem *pItem = pSnap->GetItem(Index);']
+	lines += ['\t\tif(pItem->Type() != Type)']
+	lines += ['\t\t\tbreak;']
+	lines += ['\t\tif(!CNetObjHandler::GetValidObj<T>(pItem->Data(), pSnap->GetItemSize(Index)))']
+	lines += ['\t\t\tpInvalid[(*pNumInvalid)++] = Index;']
+	lines += ['\t}']
+	lines += ['\treturn Index;']
+	lines += ['}']
+	lines += ['']
+
+	lines += ['int CNetObjHandler::ValidateSnap(const CSnapshot *pSnap, int *pInvalid)']
+	lines += ['{']
+	lines += ['\tint NumInvalid = 0;']
+	lines += ['\tfor(int Index = 0; Index < pSnap->NumItems();)']
+	lines += ['\t{']
+	lines += ['\t\tint Type = pSnap->GetItem(Index)->Type();']
+	lines += ['\t\tswitch(Type)']
+	lines += ['\t\t{']
+	for item in network.Objects:
+		lines += ['\t\tcase %s: Index = ValidateRun<%s>(pSnap, Index, Type, pInvalid, &NumInvalid); break;' % (item.enum_name, item.struct_name)]
+	lines += ['\t\tdefault: pInvalid[NumInvalid++] = Index++;']
+	lines += ['\t\t}']
+	lines += ['\t}']
+	lines += ['\treturn NumInvalid;']
+	lines += ['}']
+	lines += ['']
+
  #int Validate(int Type, void *pData, int Size);
 
 	if 0:
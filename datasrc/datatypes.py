@@ -227,13 +227,33 @@ class NetObject:
 			lines = ["struct %s"%self.struct_name, "{"]
 		for v in self.variables:
 			lines += ["\t"+line for line in v.emit_declaration()]
+		lines += ["\t"+line if line else "" for line in self.emit_valid()]
 		lines += ["};"]
 		return lines
+	def emit_valid(self):
+		checks = []
+		if self.base:
+			checks += ["%s::Valid()" % self.base_struct_name]
+		for v in self.variables:
+			checks += v.emit_valid()
+		lines = ["", "// whether the members are in range, without telling which one isn't"]
+		lines += ["bool Valid() const"]
+		lines += ["{"]
+		if not checks:
+			lines += ["\treturn true;"]
+		else:
+			# & instead of && leaves the compiler free to check all members without branches
+			lines += ["\treturn %s%s" % (checks[0], " &" if len(checks) > 1 else ";")]
+			for i, check in enumerate(checks[1:]):
+				lines += ["\t\t%s%s" % (check, " &" if i < len(checks)-2 else ";")]
+		lines += ["}"]
+		return lines
 	def emit_validate(self, base_item):
 		lines = ["case %s:" % self.enum_name]
 		lines += ["{"]
 		lines += ["\tconst %s *pObj = (const %s *)pData;"%(self.struct_name, self.struct_name)]
 		lines += ["\tif(sizeof(*pObj) != Size) return -1;"]
+		lines += ["\tif(pObj->Valid()) return 0;"]
 		variables = self.variables
 		if base_item:
 			variables += base_item.variables
@@ -257,6 +277,8 @@ class NetMessage(NetObject):
 		self.base_struct_name = "CNetMsg_%s" % self.base
 		self.struct_name = "CNetMsg_%s" % self.name
 		self.enum_name = "NETMSGTYPE_%s" % self.name.upper()
+	def emit_valid(self):
+		return []
 	def emit_unpack(self):
 		lines = []
 		lines += ["case %s:" % self.enum_name]
@@ -295,6 +317,10 @@ class NetVariable:
 		return []
 	def emit_validate(self):
 		return []
+	def emit_valid(self):
+		return []
+	def emit_field_bits(self):
+		return ["0"]
 	def emit_pack(self):
 		return []
 	def emit_unpack(self):
@@ -336,6 +362,10 @@ class NetIntRange(NetIntAny):
 		self.max = str(max)
 	def emit_validate(self):
 		return ["if(!CheckInt(\"%s\", pObj->%s, %s, %s)) return -1;"%(self.name, self.name, self.min, self.max)]
+	def emit_valid(self):
+		return ["NetobjInRange(%s, %s, %s)"%(self.name, self.min, self.max)]
+	def emit_field_bits(self):
+		return ["NetobjFieldBits(%s, %s)"%(self.min, self.max)]
 	def emit_unpack_check(self):
 		return ["if(!CheckInt(\"%s\", pMsg->%s, %s, %s)) break;"%(self.name, self.name, self.min, self.max)]
 
@@ -354,6 +384,10 @@ class NetFlag(NetIntAny):
 			self.mask = "0"
 	def emit_validate(self):
 		return ["if(!CheckFlag(\"%s\", pObj->%s, %s)) return -1;"%(self.name, self.name, self.mask)]
+	def emit_valid(self):
+		return ["NetobjHasFlags(%s, %s)"%(self.name, self.mask)]
+	def emit_field_bits(self):
+		return ["NetobjFieldBits(0, %s)"%self.mask]
 	def emit_unpack_check(self):
 		return ["if(!CheckFlag(\"%s\", pMsg->%s, %s)) break;"%(self.name, self.name, self.mask)]
 
@@ -381,6 +415,14 @@ class NetArray(NetVariable):
 			self.var.name = self.base_name + "[%d]"%i
 			lines += self.var.emit_validate()
 		return lines
+	def emit_valid(self):
+		lines = []
+		for i in range(self.size):
+			self.var.name = self.base_name + "[%d]"%i
+			lines += self.var.emit_valid()
+		return lines
+	def emit_field_bits(self):
+		return self.var.emit_field_bits()*self.size
 	def emit_unpack(self):
 		lines = []
 		for i in range(self.size):
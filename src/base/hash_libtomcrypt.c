@@ -9,6 +9,23 @@
 #include <stdint.h>
 #include <string.h>
 
+// SHA extensions are checked at runtime on x86, ARMv8 crypto is used when the
+// compiler targets it anyway
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA_X86 1
+#define SHA_X86_TARGET __attribute__((target("sha,sse4.1")))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SHA_X86 1
+#define SHA_X86_TARGET
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+#define SHA_ARM 1
+#include <arm_neon.h>
+#endif
+
 typedef uint32_t u32;
 typedef uint64_t u64;
 typedef SHA256_CTX sha256_state;
@@ -63,14 +80,14 @@ static u32 Sigma1(u32 x)            { return Rot(x, 6) ^ Rot(x, 11) ^ Rot(x, 25)
 static u32 Gamma0(u32 x)            { return Rot(x, 7) ^ Rot(x, 18) ^ Sh(x, 3); }
 static u32 Gamma1(u32 x)            { return Rot(x, 17) ^ Rot(x, 19) ^ Sh(x, 10); }
 
-static void sha_compress(sha256_state* md, const unsigned char* buf)
+static void sha_compress_block(u32* state, const unsigned char* buf)
 {
     u32 S[8], W[64], t0, t1, t;
 	int i;
 
     // Copy state into S
     for(i = 0; i < 8; i++)
-        S[i] = md->state[i];
+        S[i] = state[i];
 
     // Copy the state into 512-bits into W[0..15]
     for(i = 0; i < 16; i++)
@@ -98,7 +115,132 @@ static void sha_compress(sha256_state* md, const unsigned char* buf)
 
     // Feedback
     for(i = 0; i < 8; i++)
-        md->state[i] = md->state[i] + S[i];
+        state[i] = state[i] + S[i];
+}
+
+static void sha_compress_portable(u32* state, const unsigned char* buf, size_t blocks)
+{
+    for(; blocks > 0; blocks--, buf += 64)
+        sha_compress_block(state, buf);
+}
+
+#if defined(SHA_X86)
+static int sha_x86_supported(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return 0;
+    __cpuid(info, 1);
+    if(!(info[2] & (1 << 19)))
+        return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] >> 29) & 1;
+#else
+    unsigned a, b, c, d;
+    if(__get_cpuid_max(0, 0) < 7 || !__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSE4_1))
+        return 0;
+    __cpuid_count(7, 0, a, b, c, d);
+    return (b >> 29) & 1;
+#endif
+}
+
+// the state is kept as ABEF and CDGH, four rounds per message group
+SHA_X86_TARGET static void sha_compress_x86(u32* state, const unsigned char* buf, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, tmp, msg, abef, cdgh, w[4];
+    int i;
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for(; blocks > 0; blocks--, buf += 64)
+    {
+        abef = state0;
+        cdgh = state1;
+        for(i = 0; i < 4; i++)
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + 16*i)), mask);
+
+        for(i = 0; i < 16; i++)
+        {
+            msg = _mm_add_epi32(w[i&3], _mm_loadu_si128((const __m128i*)&K[4*i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+            if(i < 12)
+            {
+                tmp = _mm_add_epi32(_mm_sha256msg1_epu32(w[i&3], w[(i+1)&3]), _mm_alignr_epi8(w[(i+3)&3], w[(i+2)&3], 4));
+                w[i&3] = _mm_sha256msg2_epu32(tmp, w[(i+3)&3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+#endif
+
+#if defined(SHA_ARM)
+static void sha_compress_arm(u32* state, const unsigned char* buf, size_t blocks)
+{
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+    uint32x4_t abcd, efgh, msg, w[4];
+    int i;
+
+    for(; blocks > 0; blocks--, buf += 64)
+    {
+        abcd = state0;
+        efgh = state1;
+        for(i = 0; i < 4; i++)
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buf + 16*i)));
+
+        for(i = 0; i < 16; i++)
+        {
+            uint32x4_t prev = state0;
+            msg = vaddq_u32(w[i&3], vld1q_u32(&K[4*i]));
+            if(i < 12)
+                w[i&3] = vsha256su1q_u32(vsha256su0q_u32(w[i&3], w[(i+1)&3]), w[(i+2)&3], w[(i+3)&3]);
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, prev, msg);
+        }
+
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+#endif
+
+typedef void (*SHA_COMPRESS_FUNC)(u32* state, const unsigned char* buf, size_t blocks);
+
+static void sha_compress(sha256_state* md, const unsigned char* buf, size_t blocks)
+{
+    // every thread picks the same function, so racing on this is harmless
+    static SHA_COMPRESS_FUNC compress = 0;
+    if(!compress)
+    {
+#if defined(SHA_X86)
+        compress = sha_x86_supported() ? sha_compress_x86 : sha_compress_portable;
+#elif defined(SHA_ARM)
+        compress = sha_compress_arm;
+#else
+        compress = sha_compress_portable;
+#endif
+    }
+    compress(md->state, buf, blocks);
 }
 
 // Public interface
@@ -126,10 +268,11 @@ static void sha_process(sha256_state* md, const void* src, u32 inlen)
     {
         if(md->curlen == 0 && inlen >= block_size)
         {
-            sha_compress(md, in);
-            md->length += block_size * 8;
-            in         += block_size;
-            inlen      -= block_size;
+            u32 n = inlen - inlen % block_size;
+            sha_compress(md, in, n / block_size);
+            md->length += (u64)n * 8;
+            in         += n;
+            inlen      -= n;
         }
         else
         {
@@ -141,7 +284,7 @@ static void sha_process(sha256_state* md, const void* src, u32 inlen)
 
             if(md->curlen == block_size)
             {
-                sha_compress(md, md->buf);
+                sha_compress(md, md->buf, 1);
                 md->length += 8*block_size;
                 md->curlen = 0;
             }
@@ -165,7 +308,7 @@ static void sha_done(sha256_state* md, void* out)
     {
         while(md->curlen < 64)
             md->buf[md->curlen++] = 0;
-        sha_compress(md, md->buf);
+        sha_compress(md, md->buf, 1);
         md->curlen = 0;
     }
 
@@ -175,7 +318,7 @@ static void sha_done(sha256_state* md, void* out)
 
     // Store length
     store64(md->length, md->buf+56);
-    sha_compress(md, md->buf);
+    sha_compress(md, md->buf, 1);
 
     // Copy output
     for(i = 0; i < 8; i++)
@@ -1,5 +1,9 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE /* recvmmsg, sendmmsg */
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -14,6 +18,7 @@
 
 #if defined(CONF_FAMILY_UNIX)
 	#include <sys/time.h>
+	#include <sys/mman.h>
 	#include <unistd.h>
 
 	/* unix net includes */
@@ -30,6 +35,14 @@
 
 	#if defined(CONF_PLATFORM_MACOSX)
 		#include <Carbon/Carbon.h>
+		#include <mach/mach.h>
+	#endif
+
+	#if defined(CONF_PLATFORM_LINUX)
+		#include <sys/prctl.h>
+		#include <sys/resource.h>
+		#include <sys/syscall.h>
+		#include <sched.h>
 	#endif
 
 #elif defined(CONF_FAMILY_WINDOWS)
@@ -38,10 +51,12 @@
 	#include <winsock2.h>
 	#include <ws2tcpip.h>
 	#include <fcntl.h>
+	#include <io.h>
 	#include <direct.h>
 	#include <errno.h>
 	#include <process.h>
 	#include <wincrypt.h>
+	#include <mmsystem.h>
 #else
 	#error NOT IMPLEMENTED
 #endif
@@ -54,6 +69,39 @@
 	#include <sys/filio.h>
 #endif
 
+/* the string scans read whole aligned blocks past the terminator, which address sanitizers report */
+#if defined(__SANITIZE_ADDRESS__)
+	#define CONF_STR_SCALAR 1
+#elif defined(__has_feature)
+	#if __has_feature(address_sanitizer)
+		#define CONF_STR_SCALAR 1
+	#endif
+#endif
+
+#if defined(CONF_STR_SCALAR)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define CONF_STR_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define CONF_STR_NEON 1
+#endif
+
+#if defined(CONF_PLATFORM_LINUX) && defined(MSG_WAITFORONE)
+	#define CONF_NET_MMSG 1
+#endif
+
+/* multishot receive with provided buffers needs the headers of linux 6.0 */
+#if defined(CONF_PLATFORM_LINUX) && defined(__has_include)
+	#if __has_include(<linux/io_uring.h>)
+		#include <linux/io_uring.h>
+		#include <sys/syscall.h>
+		#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+			#define CONF_NET_URING 1
+		#endif
+	#endif
+#endif
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -74,11 +122,15 @@ void dbg_logger(DBG_LOGGER logger)
 	loggers[num_loggers++] = logger;
 }
 
+static int async_log_push(const char *line);
+static void async_log_flush_crash();
+
 void dbg_assert_imp(const char *filename, int line, int test, const char *msg)
 {
 	if(!test)
 	{
 		dbg_msg("assert", "%s(%d): %s", filename, line, msg);
+		async_log_flush_crash();
 		dbg_break();
 	}
 }
@@ -111,6 +163,8 @@ void dbg_msg(const char *sys, const char *fmt, ...)
 #endif
 	va_end(args);
 
+	if(async_log_push(str))
+		return;
 	for(i = 0; i < num_loggers; i++)
 		loggers[i](str);
 }
@@ -203,10 +257,14 @@ static void logger_win_console(const char *line)
 }
 #endif
 
+/* set while the async writer writes a batch, it flushes once at the end */
+static int loggers_batched = 0;
+
 static void logger_stdout(const char *line)
 {
 	printf("%s\n", line);
-	fflush(stdout);
+	if(!loggers_batched)
+		fflush(stdout);
 }
 
 static void logger_debugger(const char *line)
@@ -223,7 +281,8 @@ static void logger_file(const char *line)
 {
 	io_write(logfile, line, strlen(line));
 	io_write_newline(logfile);
-	io_flush(logfile);
+	if(!loggers_batched)
+		io_flush(logfile);
 }
 
 void dbg_logger_stdout()
@@ -255,6 +314,190 @@ void dbg_logger_filehandle(IOHANDLE handle)
 		dbg_logger(logger_file);
 }
 
+/* async logging. dbg_msg puts the lines into a ring of fixed size slots without
+   taking a lock, a background thread hands them to the loggers */
+enum
+{
+	ASYNC_LOG_LINE_SIZE=1024
+};
+
+typedef struct
+{
+	volatile int sequence; /* the position the slot is ready to be filled or read for */
+	char line[ASYNC_LOG_LINE_SIZE];
+} ASYNC_LOG_SLOT;
+
+static ASYNC_LOG_SLOT *async_log_slots = 0;
+static int async_log_size = 0;
+static volatile int async_log_active = 0;
+static volatile int async_log_push_pos = 0;
+static int async_log_pop_pos = 0;
+static volatile int async_log_dropped = 0;
+static int async_log_dropped_reported = 0;
+static volatile int async_log_shutdown = 0;
+static void *async_log_thread = 0;
+static SEMAPHORE async_log_activity;
+static LOCK async_log_write_lock; /* the writer thread, flushes and crashes all drain the ring */
+
+static int async_log_push(const char *line)
+{
+	int pos;
+	if(!atomic_int_load(&async_log_active))
+		return 0;
+
+	pos = atomic_int_load(&async_log_push_pos);
+	while(1)
+	{
+		ASYNC_LOG_SLOT *slot = &async_log_slots[pos&(async_log_size-1)];
+		int diff = (int)((unsigned)atomic_int_load(&slot->sequence) - (unsigned)pos);
+		if(diff == 0)
+		{
+			int prev = atomic_int_compswap(&async_log_push_pos, pos, (int)((unsigned)pos+1));
+			if(prev == pos)
+			{
+				int length = str_length(line);
+				if(length > ASYNC_LOG_LINE_SIZE-1)
+					length = ASYNC_LOG_LINE_SIZE-1;
+				mem_copy(slot->line, line, length);
+				slot->line[length] = 0;
+				atomic_int_store(&slot->sequence, (int)((unsigned)pos+1));
+				semaphore_signal(&async_log_activity);
+				return 1;
+			}
+			pos = prev;
+		}
+		else if(diff < 0)
+		{
+			/* the writer is behind, keep the memory bounded */
+			atomic_int_add(&async_log_dropped, 1);
+			return 1;
+		}
+		else
+			pos = atomic_int_load(&async_log_push_pos);
+	}
+}
+
+/* call with async_log_write_lock taken */
+static void async_log_drain()
+{
+	int i, num = 0, dropped;
+	loggers_batched = 1;
+	while(1)
+	{
+		ASYNC_LOG_SLOT *slot = &async_log_slots[async_log_pop_pos&(async_log_size-1)];
+		if(atomic_int_load(&slot->sequence) != (int)((unsigned)async_log_pop_pos+1))
+			break;
+		for(i = 0; i < num_loggers; i++)
+			loggers[i](slot->line);
+		atomic_int_store(&slot->sequence, (int)((unsigned)async_log_pop_pos+async_log_size));
+		async_log_pop_pos = (int)((unsigned)async_log_pop_pos+1);
+		num++;
+	}
+
+	dropped = atomic_int_load(&async_log_dropped);
+	if(dropped != async_log_dropped_reported)
+	{
+		char str[128];
+		char timestr[80];
+		str_timestamp_format(timestr, sizeof(timestr), FORMAT_SPACE);
+		str_format(str, sizeof(str), "[%s][dbg/logger]: dropped %d log lines, the writer can't keep up", timestr, dropped-async_log_dropped_reported);
+		async_log_dropped_reported = dropped;
+		for(i = 0; i < num_loggers; i++)
+			loggers[i](str);
+		num++;
+	}
+
+	loggers_batched = 0;
+	if(num)
+	{
+		fflush(stdout);
+		if(logfile)
+			io_flush(logfile);
+	}
+}
+
+static void async_log_thread_func(void *user)
+{
+	(void)user;
+	while(1)
+	{
+		/* one signal per line, a drain often takes care of several */
+		semaphore_wait(&async_log_activity);
+		lock_wait(async_log_write_lock);
+		async_log_drain();
+		lock_unlock(async_log_write_lock);
+		if(atomic_int_load(&async_log_shutdown))
+			break;
+	}
+}
+
+static void async_log_flush_crash()
+{
+	/* the writer thread might be the one crashing, don't wait on it forever */
+	int i;
+	if(!atomic_int_load(&async_log_active))
+		return;
+	for(i = 0; i < 100; i++)
+	{
+		if(lock_trylock(async_log_write_lock) == 0)
+		{
+			async_log_drain();
+			lock_unlock(async_log_write_lock);
+			return;
+		}
+		thread_sleep(1);
+	}
+}
+
+static void async_log_stop()
+{
+	if(!atomic_int_load(&async_log_active))
+		return;
+
+	/* write all that is left from this thread, later lines go out directly */
+	atomic_int_store(&async_log_shutdown, 1);
+	semaphore_signal(&async_log_activity);
+	thread_wait(async_log_thread);
+	thread_destroy(async_log_thread);
+	atomic_int_store(&async_log_active, 0);
+	lock_wait(async_log_write_lock);
+	async_log_drain();
+	lock_unlock(async_log_write_lock);
+}
+
+void dbg_logger_async(int num_lines)
+{
+	int i, size = 16;
+	if(atomic_int_load(&async_log_active) || async_log_slots)
+		return;
+	while(size < num_lines && size < (1<<20))
+		size <<= 1;
+
+	async_log_slots = (ASYNC_LOG_SLOT *)mem_alloc(sizeof(ASYNC_LOG_SLOT)*size, 1);
+	for(i = 0; i < size; i++)
+		async_log_slots[i].sequence = i;
+	async_log_size = size;
+	async_log_write_lock = lock_create();
+	semaphore_init(&async_log_activity);
+	async_log_thread = thread_init(async_log_thread_func, 0);
+	atomic_int_store(&async_log_active, 1);
+	atexit(async_log_stop);
+}
+
+void dbg_logger_flush()
+{
+	if(!atomic_int_load(&async_log_active))
+		return;
+	lock_wait(async_log_write_lock);
+	async_log_drain();
+	lock_unlock(async_log_write_lock);
+}
+
+int dbg_logger_dropped()
+{
+	return atomic_int_load(&async_log_dropped);
+}
+
 #if defined(CONF_FAMILY_WINDOWS)
 static DWORD old_console_mode;
 
@@ -275,31 +518,64 @@ void dbg_console_cleanup()
 #endif
 /* */
 
+/* every block starts with this, it keeps the 16 byte alignment of malloc */
 typedef struct MEMHEADER
 {
-	const char *filename;
-	int line;
-	int size;
-	struct MEMHEADER *prev;
-	struct MEMHEADER *next;
+	unsigned size;
+	int tag;
+	int pad[2];
 } MEMHEADER;
 
-typedef struct MEMTAIL
+/* one cache line per tag, so threads that allocate under different tags don't slow each other down */
+typedef struct MEMTAGSTATS
 {
-	int guard;
-} MEMTAIL;
+	volatile int64 bytes;
+	volatile int blocks;
+	char pad[64-sizeof(int64)-sizeof(int)];
+} MEMTAGSTATS;
+
+static MEMTAGSTATS mem_tags[NUM_MEMTAGS];
 
-static struct MEMHEADER *first = 0;
-static const int MEM_GUARD_VAL = 0xbaadc0de;
+#if defined(__GNUC__)
+	static void mem_tag_add(MEMTAGSTATS *stats, int64 bytes, int blocks)
+	{
+		__atomic_add_fetch(&stats->bytes, bytes, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&stats->blocks, blocks, __ATOMIC_RELAXED);
+	}
+	static int64 mem_tag_bytes(MEMTAGSTATS *stats) { return __atomic_load_n(&stats->bytes, __ATOMIC_RELAXED); }
+#elif defined(_MSC_VER)
+	static void mem_tag_add(MEMTAGSTATS *stats, int64 bytes, int blocks)
+	{
+		InterlockedExchangeAdd64(&stats->bytes, bytes);
+		InterlockedExchangeAdd((volatile LONG *)&stats->blocks, blocks);
+	}
+	static int64 mem_tag_bytes(MEMTAGSTATS *stats) { return InterlockedCompareExchange64(&stats->bytes, 0, 0); }
+#else
+	#error missing atomic implementation for this compiler
+#endif
+static const char *mem_tag_names[NUM_MEMTAGS] = {"other", "network", "snapshot", "graphics", "sound", "editor", "map"};
 
-void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment)
+void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment, int tag)
 {
-	return malloc(size);
+	MEMHEADER *header = (MEMHEADER *)malloc(sizeof(MEMHEADER)+size);
+	if(!header)
+		return 0;
+	if(tag < 0 || tag >= NUM_MEMTAGS)
+		tag = MEMTAG_OTHER;
+	header->size = size;
+	header->tag = tag;
+	mem_tag_add(&mem_tags[tag], size, 1);
+	return header+1;
 }
 
 void mem_free(void *p)
 {
-	free(p);
+	MEMHEADER *header;
+	if(!p)
+		return;
+	header = (MEMHEADER *)p-1;
+	mem_tag_add(&mem_tags[header->tag], -(int64)header->size, -1);
+	free(header);
 }
 
 void mem_copy(void *dest, const void *source, unsigned size)
@@ -317,23 +593,6 @@ void mem_zero(void *block,unsigned size)
 	memset(block, 0, size);
 }
 
-int mem_check_imp()
-{
-	MEMHEADER *header = first;
-	while(header)
-	{
-		MEMTAIL *tail = (MEMTAIL *)(((char*)(header+1))+header->size);
-		if(tail->guard != MEM_GUARD_VAL)
-		{
-			dbg_msg("mem", "Memory check failed at %s(%d): %d", header->filename, header->line, header->size);
-			return 0;
-		}
-		header = header->next;
-	}
-
-	return 1;
-}
-
 IOHANDLE io_open(const char *filename, int flags)
 {
 	if(flags == IOFLAG_READ)
@@ -361,6 +620,8 @@ IOHANDLE io_open(const char *filename, int flags)
 	}
 	if(flags == IOFLAG_WRITE)
 		return (IOHANDLE)fopen(filename, "wb");
+	if(flags == IOFLAG_APPEND)
+		return (IOHANDLE)fopen(filename, "ab");
 	return 0x0;
 }
 
@@ -371,7 +632,7 @@ unsigned io_read(IOHANDLE io, void *buffer, unsigned size)
 
 void io_read_all(IOHANDLE io, void **result, unsigned *result_len)
 {
-	unsigned char *buffer = malloc(1024);
+	unsigned char *buffer = mem_alloc(1024, 1);
 	unsigned len = 0;
 	unsigned cap = 1024;
 	unsigned read;
@@ -379,18 +640,25 @@ void io_read_all(IOHANDLE io, void **result, unsigned *result_len)
 	*result = 0;
 	*result_len = 0;
 
+	// callers release the buffer with mem_free, so grow it with mem_alloc as well
 	while((read = io_read(io, buffer + len, cap - len)) != 0)
 	{
 		len += read;
 		if(len == cap)
 		{
+			unsigned char *grown = mem_alloc(cap*2 + 1, 1);
+			mem_copy(grown, buffer, len);
+			mem_free(buffer);
+			buffer = grown;
 			cap *= 2;
-			buffer = realloc(buffer, cap);
 		}
 	}
 	if(len == cap)
 	{
-		buffer = realloc(buffer, cap + 1);
+		unsigned char *grown = mem_alloc(cap + 1, 1);
+		mem_copy(grown, buffer, len);
+		mem_free(buffer);
+		buffer = grown;
 	}
 	// ensure null termination
 	buffer[len] = 0;
@@ -406,7 +674,7 @@ char *io_read_all_str(IOHANDLE io)
 	io_read_all(io, &buffer, &len);
 	if(mem_has_null(buffer, len))
 	{
-		free(buffer);
+		mem_free(buffer);
 		return 0;
 	}
 	return buffer;
@@ -485,6 +753,63 @@ int io_flush(IOHANDLE io)
 	return 0;
 }
 
+int io_buffer(IOHANDLE io, void *buffer, unsigned size)
+{
+	return setvbuf((FILE*)io, buffer, _IOFBF, size);
+}
+
+void io_sequential(IOHANDLE io)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	posix_fadvise(fileno((FILE*)io), 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+	(void)io;
+#endif
+}
+
+void *io_mmap(IOHANDLE io, unsigned *size)
+{
+	long int length = io_length(io);
+	*size = 0;
+	if(length <= 0)
+		return 0;
+#if defined(CONF_FAMILY_WINDOWS)
+	{
+		HANDLE file = (HANDLE)_get_osfhandle(_fileno((FILE*)io));
+		HANDLE mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		void *data;
+		if(!mapping)
+			return 0;
+		data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		CloseHandle(mapping); // the view keeps the mapping alive
+		if(!data)
+			return 0;
+		*size = length;
+		return data;
+	}
+#else
+	{
+		void *data = mmap(0, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno((FILE*)io), 0);
+		if(data == MAP_FAILED)
+			return 0;
+		*size = length;
+		return data;
+	}
+#endif
+}
+
+void io_munmap(void *data, unsigned size)
+{
+	if(!data)
+		return;
+#if defined(CONF_FAMILY_WINDOWS)
+	(void)size;
+	UnmapViewOfFile(data);
+#else
+	munmap(data, size);
+#endif
+}
+
 struct THREAD_RUN
 {
 	void (*threadfunc)(void *);
@@ -571,6 +896,145 @@ void thread_sleep(int milliseconds)
 #endif
 }
 
+void thread_precise_timers()
+{
+#if defined(CONF_PLATFORM_LINUX) && defined(PR_SET_TIMERSLACK)
+	/* the default slack of 50us is added to every timed wait */
+	prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+#elif defined(CONF_FAMILY_WINDOWS)
+	timeBeginPeriod(1);
+#endif
+}
+
+void thread_set_name(const char *name)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	/* at most 15 characters */
+	char buf[16];
+	str_copy(buf, name, sizeof(buf));
+	pthread_setname_np(pthread_self(), buf);
+#elif defined(CONF_PLATFORM_MACOSX)
+	pthread_setname_np(name);
+#else
+	(void)name;
+#endif
+}
+
+int thread_current_id()
+{
+#if defined(CONF_PLATFORM_LINUX)
+	return (int)syscall(SYS_gettid);
+#elif defined(CONF_FAMILY_WINDOWS)
+	return (int)GetCurrentThreadId();
+#else
+	return 0;
+#endif
+}
+
+int thread_set_priority(int id, int priority)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	/* the nice value is per thread on linux, raising it needs CAP_SYS_NICE */
+	int nice = priority > 0 ? -5 : priority < 0 ? 5 : 0;
+	return setpriority(PRIO_PROCESS, id, nice) == 0 ? 0 : -1;
+#elif defined(CONF_FAMILY_WINDOWS)
+	int result = -1;
+	HANDLE thread = OpenThread(THREAD_SET_INFORMATION|THREAD_QUERY_INFORMATION, FALSE, (DWORD)id);
+	if(thread)
+	{
+		int value = priority > 0 ? THREAD_PRIORITY_ABOVE_NORMAL : priority < 0 ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_NORMAL;
+		result = SetThreadPriority(thread, value) ? 0 : -1;
+		CloseHandle(thread);
+	}
+	return result;
+#else
+	(void)id;
+	return priority == 0 ? 0 : -1;
+#endif
+}
+
+int cpu_list_parse(const char *list, unsigned char *cpus, int max_cpus)
+{
+	int num = 0;
+	mem_zero(cpus, max_cpus);
+	while(*list)
+	{
+		int first, last;
+		if(*list < '0' || *list > '9')
+			return -1;
+		first = last = str_toint(list);
+		while(*list >= '0' && *list <= '9')
+			list++;
+		if(*list == '-')
+		{
+			list++;
+			if(*list < '0' || *list > '9')
+				return -1;
+			last = str_toint(list);
+			while(*list >= '0' && *list <= '9')
+				list++;
+		}
+		if(*list == ',')
+			list++;
+		else if(*list)
+			return -1;
+		if(last < first || last >= max_cpus)
+			return -1;
+		for(; first <= last; first++)
+		{
+			if(!cpus[first])
+				num++;
+			cpus[first] = 1;
+		}
+	}
+	return num;
+}
+
+int thread_set_affinity(int id, const char *list)
+{
+	enum { MAX_CPUS = 256 };
+	unsigned char cpus[MAX_CPUS];
+	int num = cpu_list_parse(list, cpus, MAX_CPUS);
+	int all = num == 0;
+	int i;
+	if(num < 0)
+		return -1;
+#if defined(CONF_PLATFORM_LINUX)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for(i = 0; i < MAX_CPUS && i < CPU_SETSIZE; i++)
+			if(all || cpus[i])
+				CPU_SET(i, &set);
+		return sched_setaffinity(id, sizeof(set), &set) == 0 ? 0 : -1;
+	}
+#elif defined(CONF_FAMILY_WINDOWS)
+	{
+		int result = -1;
+		DWORD_PTR process_mask, system_mask, mask = 0;
+		HANDLE thread;
+		if(!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+			return -1;
+		for(i = 0; i < MAX_CPUS && i < (int)sizeof(mask)*8; i++)
+			if(cpus[i])
+				mask |= (DWORD_PTR)1<<i;
+		if(all)
+			mask = process_mask;
+		thread = OpenThread(THREAD_SET_INFORMATION|THREAD_QUERY_INFORMATION, FALSE, (DWORD)id);
+		if(thread)
+		{
+			result = SetThreadAffinityMask(thread, mask) ? 0 : -1;
+			CloseHandle(thread);
+		}
+		return result;
+	}
+#else
+	(void)id;
+	(void)i;
+	return all ? 0 : -1;
+#endif
+}
+
 void thread_detach(void *thread)
 {
 #if defined(CONF_FAMILY_UNIX)
@@ -582,6 +1046,18 @@ void thread_detach(void *thread)
 #endif
 }
 
+int cpu_count()
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
 void cpu_relax()
 {
 #if defined(CONF_ARCH_IA32) || defined(CONF_ARCH_AMD64)
@@ -660,20 +1136,44 @@ void lock_unlock(LOCK lock)
 #endif
 }
 
-#if !defined(CONF_PLATFORM_MACOSX)
-	#if defined(CONF_FAMILY_UNIX)
+#if defined(CONF_PLATFORM_MACOSX)
+	void semaphore_init(SEMAPHORE *sem) { *sem = dispatch_semaphore_create(0); }
+	void semaphore_wait(SEMAPHORE *sem) { dispatch_semaphore_wait(*sem, DISPATCH_TIME_FOREVER); }
+	void semaphore_signal(SEMAPHORE *sem) { dispatch_semaphore_signal(*sem); }
+	void semaphore_destroy(SEMAPHORE *sem) { dispatch_release(*sem); }
+#elif defined(CONF_FAMILY_UNIX)
 	void semaphore_init(SEMAPHORE *sem) { sem_init(sem, 0, 0); }
 	void semaphore_wait(SEMAPHORE *sem) { sem_wait(sem); }
 	void semaphore_signal(SEMAPHORE *sem) { sem_post(sem); }
 	void semaphore_destroy(SEMAPHORE *sem) { sem_destroy(sem); }
-	#elif defined(CONF_FAMILY_WINDOWS)
+#elif defined(CONF_FAMILY_WINDOWS)
 	void semaphore_init(SEMAPHORE *sem) { *sem = CreateSemaphore(0, 0, 10000, 0); }
 	void semaphore_wait(SEMAPHORE *sem) { WaitForSingleObject((HANDLE)*sem, INFINITE); }
 	void semaphore_signal(SEMAPHORE *sem) { ReleaseSemaphore((HANDLE)*sem, 1, NULL); }
 	void semaphore_destroy(SEMAPHORE *sem) { CloseHandle((HANDLE)*sem); }
-	#else
-		#error not implemented on this platform
-	#endif
+#else
+	#error not implemented on this platform
+#endif
+
+#if defined(__GNUC__)
+	int atomic_int_load(const volatile int *value) { return __atomic_load_n(value, __ATOMIC_ACQUIRE); }
+	void atomic_int_store(volatile int *value, int new_value) { __atomic_store_n(value, new_value, __ATOMIC_RELEASE); }
+	int atomic_int_add(volatile int *value, int add) { return __atomic_add_fetch(value, add, __ATOMIC_SEQ_CST); }
+	int atomic_int_compswap(volatile int *value, int comperand, int new_value) { return __sync_val_compare_and_swap(value, comperand, new_value); }
+	void *atomic_ptr_load(void *const volatile *value) { return __atomic_load_n(value, __ATOMIC_ACQUIRE); }
+	void atomic_ptr_store(void *volatile *value, void *new_value) { __atomic_store_n(value, new_value, __ATOMIC_RELEASE); }
+	void *atomic_ptr_compswap(void *volatile *value, void *comperand, void *new_value) { return __sync_val_compare_and_swap(value, comperand, new_value); }
+#elif defined(_MSC_VER)
+	/* the interlocked functions are full fences, more than load and store need */
+	int atomic_int_load(const volatile int *value) { return InterlockedCompareExchange((volatile LONG *)value, 0, 0); }
+	void atomic_int_store(volatile int *value, int new_value) { InterlockedExchange((volatile LONG *)value, new_value); }
+	int atomic_int_add(volatile int *value, int add) { return InterlockedExchangeAdd((volatile LONG *)value, add)+add; }
+	int atomic_int_compswap(volatile int *value, int comperand, int new_value) { return InterlockedCompareExchange((volatile LONG *)value, new_value, comperand); }
+	void *atomic_ptr_load(void *const volatile *value) { return InterlockedCompareExchangePointer((PVOID volatile *)value, 0, 0); }
+	void atomic_ptr_store(void *volatile *value, void *new_value) { InterlockedExchangePointer(value, new_value); }
+	void *atomic_ptr_compswap(void *volatile *value, void *comperand, void *new_value) { return InterlockedCompareExchangePointer(value, new_value, comperand); }
+#else
+	#error missing atomic implementation for this compiler
 #endif
 
 
@@ -681,9 +1181,11 @@ void lock_unlock(LOCK lock)
 int64 time_get()
 {
 #if defined(CONF_FAMILY_UNIX)
-	struct timeval val;
-	gettimeofday(&val, NULL);
-	return (int64)val.tv_sec*(int64)1000000+(int64)val.tv_usec;
+	/* monotonic, so it doesn't jump with the wall clock. the vdso reads
+	   the invariant tsc for it on linux without entering the kernel */
+	struct timespec spec;
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return (int64)spec.tv_sec*(int64)1000000000+(int64)spec.tv_nsec;
 #elif defined(CONF_FAMILY_WINDOWS)
 	static int64 last = 0;
 	int64 t;
@@ -697,14 +1199,27 @@ int64 time_get()
 #endif
 }
 
+int64 time_get_coarse()
+{
+#if defined(CONF_FAMILY_UNIX) && defined(CLOCK_MONOTONIC_COARSE)
+	/* the timestamp of the last scheduler tick, same clock as time_get */
+	struct timespec spec;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &spec);
+	return (int64)spec.tv_sec*(int64)1000000000+(int64)spec.tv_nsec;
+#else
+	return time_get();
+#endif
+}
+
 int64 time_freq()
 {
 #if defined(CONF_FAMILY_UNIX)
-	return 1000000;
+	return 1000000000;
 #elif defined(CONF_FAMILY_WINDOWS)
-	int64 t;
-	QueryPerformanceFrequency((PLARGE_INTEGER)&t);
-	return t;
+	static int64 freq = 0;
+	if(!freq)
+		QueryPerformanceFrequency((PLARGE_INTEGER)&freq);
+	return freq;
 #else
 	#error not implemented
 #endif
@@ -1009,7 +1524,7 @@ static int priv_net_close_all_sockets(NETSOCKET sock)
 	return 0;
 }
 
-static int priv_net_create_socket(int domain, int type, struct sockaddr *addr, int sockaddrlen, int use_random_port)
+static int priv_net_create_socket(int domain, int type, struct sockaddr *addr, int sockaddrlen, int use_random_port, int reuseport)
 {
 	int sock, e;
 
@@ -1038,6 +1553,27 @@ static int priv_net_create_socket(int domain, int type, struct sockaddr *addr, i
 	}
 #endif
 
+	/* share the port with other sockets, linux balances between them */
+#if defined(CONF_PLATFORM_LINUX) && defined(SO_REUSEPORT)
+	if(reuseport)
+	{
+		int enable = 1;
+		if(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&enable, sizeof(enable)) != 0)
+		{
+			dbg_msg("net", "failed to set SO_REUSEPORT (%d '%s')", errno, strerror(errno));
+			priv_net_close_socket(sock);
+			return -1;
+		}
+	}
+#else
+	if(reuseport)
+	{
+		dbg_msg("net", "sharing a port between sockets is not supported on this platform");
+		priv_net_close_socket(sock);
+		return -1;
+	}
+#endif
+
 	/* bind the socket */
 	while(1)
 	{
@@ -1078,7 +1614,7 @@ static int priv_net_create_socket(int domain, int type, struct sockaddr *addr, i
 	return sock;
 }
 
-NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port)
+static NETSOCKET priv_net_udp_create(NETADDR bindaddr, int use_random_port, int reuseport)
 {
 	NETSOCKET sock = invalid_socket;
 	NETADDR tmpbindaddr = bindaddr;
@@ -1093,7 +1629,7 @@ NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port)
 		/* bind, we should check for error */
 		tmpbindaddr.type = NETTYPE_IPV4;
 		netaddr_to_sockaddr_in(&tmpbindaddr, &addr);
-		socket = priv_net_create_socket(AF_INET, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr), use_random_port);
+		socket = priv_net_create_socket(AF_INET, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr), use_random_port, reuseport);
 		if(socket >= 0)
 		{
 			sock.type |= NETTYPE_IPV4;
@@ -1115,7 +1651,7 @@ NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port)
 		/* bind, we should check for error */
 		tmpbindaddr.type = NETTYPE_IPV6;
 		netaddr_to_sockaddr_in6(&tmpbindaddr, &addr);
-		socket = priv_net_create_socket(AF_INET6, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr), use_random_port);
+		socket = priv_net_create_socket(AF_INET6, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr), use_random_port, reuseport);
 		if(socket >= 0)
 		{
 			sock.type |= NETTYPE_IPV6;
@@ -1136,6 +1672,305 @@ NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port)
 	return sock;
 }
 
+NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port)
+{
+	return priv_net_udp_create(bindaddr, use_random_port, 0);
+}
+
+NETSOCKET net_udp_create_reuseport(NETADDR bindaddr)
+{
+	return priv_net_udp_create(bindaddr, 0, 1);
+}
+
+#if defined(CONF_NET_URING)
+enum
+{
+	NET_URING_ENTRIES = 8, /* only the two receives are ever submitted */
+	NET_URING_BUFFERS = 256,
+	NET_URING_BUFFER_SIZE = 2048,
+	NET_URING_MAX_FD = 1024,
+};
+
+/* a ring that keeps a multishot receive armed on each socket of a NETSOCKET. the kernel
+   fills the provided buffers and posts completions without us entering it, reading them
+   only touches shared memory. the ring is found by the fds of the sockets */
+typedef struct
+{
+	int fd;
+	void *ring;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct io_uring_buf_ring *buf_ring;
+	char *buffers;
+	unsigned short buf_tail;
+
+	int socks[2];
+	struct msghdr msgs[2];
+	int armed[2];
+	unsigned arms[2]; /* tells the completions of an earlier receive apart */
+} NET_URING;
+
+static NET_URING *net_urings[NET_URING_MAX_FD];
+
+static NET_URING *priv_net_uring_find(NETSOCKET sock)
+{
+	if(sock.ipv4sock >= 0 && sock.ipv4sock < NET_URING_MAX_FD && net_urings[sock.ipv4sock])
+		return net_urings[sock.ipv4sock];
+	if(sock.ipv6sock >= 0 && sock.ipv6sock < NET_URING_MAX_FD && net_urings[sock.ipv6sock])
+		return net_urings[sock.ipv6sock];
+	return 0;
+}
+
+static void priv_net_uring_free(NET_URING *r)
+{
+	/* closing the ring cancels the receives */
+	int s;
+	for(s = 0; s < 2; s++)
+		if(r->socks[s] >= 0)
+			net_urings[r->socks[s]] = 0;
+	if(r->fd >= 0)
+		close(r->fd);
+	if(r->ring)
+		munmap(r->ring, r->ring_size);
+	if(r->sqes)
+		munmap(r->sqes, r->sqes_size);
+	if(r->buf_ring)
+		munmap(r->buf_ring, NET_URING_BUFFERS*sizeof(struct io_uring_buf));
+	if(r->buffers)
+		munmap(r->buffers, NET_URING_BUFFERS*NET_URING_BUFFER_SIZE);
+	free(r);
+}
+
+static void priv_net_uring_recycle(NET_URING *r, int bid)
+{
+	struct io_uring_buf *buf = &r->buf_ring->bufs[r->buf_tail&(NET_URING_BUFFERS-1)];
+	buf->addr = (unsigned long)(r->buffers+bid*NET_URING_BUFFER_SIZE);
+	buf->len = NET_URING_BUFFER_SIZE;
+	buf->bid = bid;
+	r->buf_tail++;
+}
+
+static int priv_net_uring_arm(NET_URING *r)
+{
+	int s, num = 0;
+	unsigned tail = *r->sq_tail;
+	for(s = 0; s < 2; s++)
+	{
+		unsigned index;
+		struct io_uring_sqe *sqe;
+		if(r->socks[s] < 0 || r->armed[s])
+			continue;
+
+		index = tail&*r->sq_mask;
+		sqe = &r->sqes[index];
+		mem_zero(sqe, sizeof(*sqe));
+		sqe->opcode = IORING_OP_RECVMSG;
+		sqe->fd = r->socks[s];
+		sqe->addr = (unsigned long)&r->msgs[s];
+		sqe->len = 1;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = 0;
+		r->arms[s]++;
+		sqe->user_data = s|(r->arms[s]<<1);
+		r->sq_array[index] = index;
+		r->armed[s] = 1;
+		tail++;
+		num++;
+	}
+	if(!num)
+		return 0;
+	__atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+	return syscall(__NR_io_uring_enter, r->fd, num, 0, 0, NULL, 0) == num ? 0 : -1;
+}
+
+static int priv_net_uring_pending(NET_URING *r)
+{
+	return *r->cq_head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+/* whether the completion ends the receive that is armed now */
+static int priv_net_uring_stopped(NET_URING *r, const struct io_uring_cqe *cqe)
+{
+	int s = (int)(cqe->user_data&1);
+	return !(cqe->flags&IORING_CQE_F_MORE) && (unsigned)(cqe->user_data>>1) == r->arms[s];
+}
+
+/* takes up to num datagrams from the completions */
+static int priv_net_uring_recv(NET_URING *r, NETDATAGRAM *datagrams, int num, int maxsize)
+{
+	unsigned head = *r->cq_head;
+	unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	int received = 0;
+	int recycled = 0;
+
+	while(head != tail && received < num)
+	{
+		const struct io_uring_cqe *cqe = &r->cqes[head&*r->cq_mask];
+		int s = (int)(cqe->user_data&1);
+		head++;
+
+		/* the receive stops when the buffers run out or on errors, it's armed again below */
+		if(priv_net_uring_stopped(r, cqe))
+			r->armed[s] = 0;
+		if(cqe->res >= 0 && (cqe->flags&IORING_CQE_F_BUFFER))
+		{
+			int bid = cqe->flags>>IORING_CQE_BUFFER_SHIFT;
+			char *buf = r->buffers+bid*NET_URING_BUFFER_SIZE;
+			const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *)buf;
+			const char *payload = buf+sizeof(*out)+r->msgs[s].msg_namelen+r->msgs[s].msg_controllen;
+
+			/* like recvmmsg, cut datagrams that don't fit */
+			if(out->namelen <= r->msgs[s].msg_namelen)
+			{
+				NETDATAGRAM *d = &datagrams[received++];
+				int size = out->payloadlen < (unsigned)maxsize ? (int)out->payloadlen : maxsize;
+				sockaddr_to_netaddr((const struct sockaddr *)(buf+sizeof(*out)), &d->addr);
+				mem_copy(d->data, payload, size);
+				d->size = size;
+				network_stats.recv_bytes += size;
+				network_stats.recv_packets++;
+			}
+			priv_net_uring_recycle(r, bid);
+			recycled = 1;
+		}
+	}
+
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	if(recycled)
+	{
+		/* a receive that ran out of buffers stopped behind the completions not read yet. arm
+		   it again right away, or the socket buffer has to take everything until those are read */
+		unsigned i;
+		__atomic_store_n(&r->buf_ring->tail, r->buf_tail, __ATOMIC_RELEASE);
+		for(i = head; i != tail; i++)
+			if(priv_net_uring_stopped(r, &r->cqes[i&*r->cq_mask]))
+				r->armed[r->cqes[i&*r->cq_mask].user_data&1] = 0;
+	}
+	priv_net_uring_arm(r);
+	return received;
+}
+
+int net_udp_uring_enable(NETSOCKET sock)
+{
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	NET_URING *r;
+	size_t sq_size, cq_size;
+	int s, i;
+
+	if(priv_net_uring_find(sock))
+		return 0;
+	if((sock.ipv4sock >= NET_URING_MAX_FD) || (sock.ipv6sock >= NET_URING_MAX_FD) || (sock.ipv4sock < 0 && sock.ipv6sock < 0))
+		return -1;
+
+	r = (NET_URING *)calloc(1, sizeof(NET_URING));
+	if(!r)
+		return -1;
+	r->socks[0] = -1;
+	r->socks[1] = -1;
+	/* every completion but the last of a receive fills a buffer, so they can't overflow */
+	mem_zero(&params, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = NET_URING_BUFFERS*2;
+	r->fd = syscall(__NR_io_uring_setup, NET_URING_ENTRIES, &params);
+	if(r->fd < 0 || !(params.features&IORING_FEAT_SINGLE_MMAP))
+	{
+		priv_net_uring_free(r);
+		return -1;
+	}
+
+	/* the submission and completion rings share one mapping */
+	sq_size = params.sq_off.array+params.sq_entries*sizeof(unsigned);
+	cq_size = params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+	r->ring_size = sq_size > cq_size ? sq_size : cq_size;
+	r->ring = mmap(0, r->ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	r->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+	r->sqes = (struct io_uring_sqe *)mmap(0, r->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if(r->ring == MAP_FAILED || r->sqes == MAP_FAILED)
+	{
+		if(r->ring == MAP_FAILED)
+			r->ring = 0;
+		if(r->sqes == MAP_FAILED)
+			r->sqes = 0;
+		priv_net_uring_free(r);
+		return -1;
+	}
+	r->sq_tail = (unsigned *)((char *)r->ring+params.sq_off.tail);
+	r->sq_mask = (unsigned *)((char *)r->ring+params.sq_off.ring_mask);
+	r->sq_array = (unsigned *)((char *)r->ring+params.sq_off.array);
+	r->cq_head = (unsigned *)((char *)r->ring+params.cq_off.head);
+	r->cq_tail = (unsigned *)((char *)r->ring+params.cq_off.tail);
+	r->cq_mask = (unsigned *)((char *)r->ring+params.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((char *)r->ring+params.cq_off.cqes);
+
+	/* the buffers the kernel picks from, registering them needs linux 5.19 */
+	r->buf_ring = (struct io_uring_buf_ring *)mmap(0, NET_URING_BUFFERS*sizeof(struct io_uring_buf), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	r->buffers = (char *)mmap(0, NET_URING_BUFFERS*NET_URING_BUFFER_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(r->buf_ring == MAP_FAILED || r->buffers == MAP_FAILED)
+	{
+		if(r->buf_ring == MAP_FAILED)
+			r->buf_ring = 0;
+		if(r->buffers == MAP_FAILED)
+			r->buffers = 0;
+		priv_net_uring_free(r);
+		return -1;
+	}
+	mem_zero(&reg, sizeof(reg));
+	reg.ring_addr = (unsigned long)r->buf_ring;
+	reg.ring_entries = NET_URING_BUFFERS;
+	reg.bgid = 0;
+	if(syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+	{
+		priv_net_uring_free(r);
+		return -1;
+	}
+	for(i = 0; i < NET_URING_BUFFERS; i++)
+		priv_net_uring_recycle(r, i);
+	__atomic_store_n(&r->buf_ring->tail, r->buf_tail, __ATOMIC_RELEASE);
+
+	/* the names have room for both families, there is no control data */
+	r->socks[0] = sock.ipv4sock;
+	r->socks[1] = sock.ipv6sock;
+	for(s = 0; s < 2; s++)
+		r->msgs[s].msg_namelen = sizeof(struct sockaddr_in6);
+
+	/* a kernel without multishot receives fails the submission right away */
+	if(priv_net_uring_arm(r) != 0)
+	{
+		priv_net_uring_free(r);
+		return -1;
+	}
+	while(priv_net_uring_pending(r))
+	{
+		const struct io_uring_cqe *cqe = &r->cqes[*r->cq_head&*r->cq_mask];
+		if(cqe->res >= 0)
+			break;
+		priv_net_uring_free(r);
+		return -1;
+	}
+
+	for(s = 0; s < 2; s++)
+		if(r->socks[s] >= 0)
+			net_urings[r->socks[s]] = r;
+	return 0;
+}
+#else
+int net_udp_uring_enable(NETSOCKET sock)
+{
+	return -1;
+}
+#endif
+
 int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size)
 {
 	int d = -1;
@@ -1210,6 +2045,19 @@ int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize)
 	socklen_t fromlen;// = sizeof(sockaddrbuf);
 	int bytes = 0;
 
+#if defined(CONF_NET_URING)
+	NET_URING *r = priv_net_uring_find(sock);
+	if(r)
+	{
+		NETDATAGRAM datagram;
+		datagram.data = data;
+		if(priv_net_uring_recv(r, &datagram, 1, maxsize) != 1)
+			return -1;
+		*addr = datagram.addr;
+		return datagram.size;
+	}
+#endif
+
 	if(sock.ipv4sock >= 0)
 	{
 		fromlen = sizeof(struct sockaddr_in);
@@ -1234,8 +2082,180 @@ int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize)
 	return -1; /* error */
 }
 
+#if defined(CONF_NET_MMSG)
+enum
+{
+	NET_MMSG_MAX = 64
+};
+
+/* returns the socket a datagram to addr can be sent on with sendmmsg, -1 if it needs the regular path */
+static int priv_net_mmsg_socket(NETSOCKET sock, const NETADDR *addr)
+{
+	if(addr->type == NETTYPE_IPV4)
+		return sock.ipv4sock;
+	if(addr->type == NETTYPE_IPV6)
+		return sock.ipv6sock;
+	return -1;
+}
+#endif
+
+int net_udp_recv_batch(NETSOCKET sock, NETDATAGRAM *datagrams, int num, int maxsize)
+{
+#if defined(CONF_NET_MMSG)
+	struct mmsghdr msgs[NET_MMSG_MAX];
+	struct iovec iovecs[NET_MMSG_MAX];
+	struct sockaddr_storage addrs[NET_MMSG_MAX];
+	int socks[2];
+	int received = 0;
+	int s, i, n, count;
+
+#if defined(CONF_NET_URING)
+	NET_URING *r = priv_net_uring_find(sock);
+	if(r)
+	{
+		int received = priv_net_uring_recv(r, datagrams, num, maxsize);
+		return received > 0 ? received : 0;
+	}
+#endif
+
+	socks[0] = sock.ipv4sock;
+	socks[1] = sock.ipv6sock;
+	if(num > NET_MMSG_MAX)
+		num = NET_MMSG_MAX;
+
+	for(s = 0; s < 2 && received < num; s++)
+	{
+		if(socks[s] < 0)
+			continue;
+
+		count = num - received;
+		mem_zero(msgs, sizeof(struct mmsghdr)*count);
+		for(i = 0; i < count; i++)
+		{
+			iovecs[i].iov_base = datagrams[received+i].data;
+			iovecs[i].iov_len = maxsize;
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iovecs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		n = recvmmsg(socks[s], msgs, count, MSG_DONTWAIT, NULL);
+		if(n <= 0)
+			continue;
+
+		for(i = 0; i < n; i++)
+		{
+			sockaddr_to_netaddr((struct sockaddr *)&addrs[i], &datagrams[received+i].addr);
+			datagrams[received+i].size = (int)msgs[i].msg_len;
+			network_stats.recv_bytes += msgs[i].msg_len;
+			network_stats.recv_packets++;
+		}
+		received += n;
+	}
+	return received;
+#else
+	int i;
+	for(i = 0; i < num; i++)
+	{
+		int bytes = net_udp_recv(sock, &datagrams[i].addr, datagrams[i].data, maxsize);
+		if(bytes <= 0)
+			break;
+		datagrams[i].size = bytes;
+	}
+	return i;
+#endif
+}
+
+int net_udp_send_batch(NETSOCKET sock, const NETDATAGRAM *datagrams, int num)
+{
+#if defined(CONF_NET_MMSG)
+	struct mmsghdr msgs[NET_MMSG_MAX];
+	struct iovec iovecs[NET_MMSG_MAX];
+	union
+	{
+		struct sockaddr_in v4;
+		struct sockaddr_in6 v6;
+	} addrs[NET_MMSG_MAX];
+	int sent = 0;
+	int i = 0;
+	int fd, count, n, k;
+
+	while(i < num)
+	{
+		fd = priv_net_mmsg_socket(sock, &datagrams[i].addr);
+		if(fd < 0)
+		{
+			/* broadcasts and unknown sockets take the regular path */
+			if(net_udp_send(sock, &datagrams[i].addr, datagrams[i].data, datagrams[i].size) >= 0)
+				sent++;
+			i++;
+			continue;
+		}
+
+		count = 0;
+		mem_zero(msgs, sizeof(msgs));
+		while(i+count < num && count < NET_MMSG_MAX && priv_net_mmsg_socket(sock, &datagrams[i+count].addr) == fd)
+		{
+			const NETDATAGRAM *d = &datagrams[i+count];
+			if(d->addr.type == NETTYPE_IPV4)
+			{
+				netaddr_to_sockaddr_in(&d->addr, &addrs[count].v4);
+				msgs[count].msg_hdr.msg_namelen = sizeof(addrs[count].v4);
+			}
+			else
+			{
+				netaddr_to_sockaddr_in6(&d->addr, &addrs[count].v6);
+				msgs[count].msg_hdr.msg_namelen = sizeof(addrs[count].v6);
+			}
+			iovecs[count].iov_base = d->data;
+			iovecs[count].iov_len = d->size;
+			msgs[count].msg_hdr.msg_name = &addrs[count];
+			msgs[count].msg_hdr.msg_iov = &iovecs[count];
+			msgs[count].msg_hdr.msg_iovlen = 1;
+			network_stats.sent_bytes += d->size;
+			network_stats.sent_packets++;
+			count++;
+		}
+
+		n = sendmmsg(fd, msgs, count, 0);
+		if(n < 0)
+			n = 0;
+		sent += n;
+		i += n;
+
+		/* the datagram that stopped the batch is dropped, like a failed sendto */
+		if(n < count)
+			i++;
+
+		for(k = n+1; k < count; k++)
+		{
+			/* send the rest of the batch one by one, those didn't get a chance yet */
+			if(sendto(fd, (const char *)datagrams[i].data, datagrams[i].size, 0, (struct sockaddr *)msgs[k].msg_hdr.msg_name, msgs[k].msg_hdr.msg_namelen) >= 0)
+				sent++;
+			i++;
+		}
+	}
+	return sent;
+#else
+	int i;
+	int sent = 0;
+	for(i = 0; i < num; i++)
+	{
+		if(net_udp_send(sock, &datagrams[i].addr, datagrams[i].data, datagrams[i].size) >= 0)
+			sent++;
+	}
+	return sent;
+#endif
+}
+
 int net_udp_close(NETSOCKET sock)
 {
+#if defined(CONF_NET_URING)
+	NET_URING *r = priv_net_uring_find(sock);
+	if(r)
+		priv_net_uring_free(r);
+#endif
 	return priv_net_close_all_sockets(sock);
 }
 
@@ -1252,7 +2272,7 @@ NETSOCKET net_tcp_create(NETADDR bindaddr)
 		/* bind, we should check for error */
 		tmpbindaddr.type = NETTYPE_IPV4;
 		netaddr_to_sockaddr_in(&tmpbindaddr, &addr);
-		socket = priv_net_create_socket(AF_INET, SOCK_STREAM, (struct sockaddr *)&addr, sizeof(addr), 0);
+		socket = priv_net_create_socket(AF_INET, SOCK_STREAM, (struct sockaddr *)&addr, sizeof(addr), 0, 0);
 		if(socket >= 0)
 		{
 			sock.type |= NETTYPE_IPV4;
@@ -1268,7 +2288,7 @@ NETSOCKET net_tcp_create(NETADDR bindaddr)
 		/* bind, we should check for error */
 		tmpbindaddr.type = NETTYPE_IPV6;
 		netaddr_to_sockaddr_in6(&tmpbindaddr, &addr);
-		socket = priv_net_create_socket(AF_INET6, SOCK_STREAM, (struct sockaddr *)&addr, sizeof(addr), 0);
+		socket = priv_net_create_socket(AF_INET6, SOCK_STREAM, (struct sockaddr *)&addr, sizeof(addr), 0, 0);
 		if(socket >= 0)
 		{
 			sock.type |= NETTYPE_IPV6;
@@ -1434,15 +2454,37 @@ int net_tcp_connect_non_blocking(NETSOCKET sock, NETADDR bindaddr)
 int net_tcp_send(NETSOCKET sock, const void *data, int size)
 {
 	int bytes = -1;
+	int flags = 0;
+#if defined(MSG_NOSIGNAL)
+	/* a peer that went away fails the send instead of killing the process */
+	flags = MSG_NOSIGNAL;
+#endif
 
 	if(sock.ipv4sock >= 0)
-		bytes = send((int)sock.ipv4sock, (const char*)data, size, 0);
+		bytes = send((int)sock.ipv4sock, (const char*)data, size, flags);
 	if(sock.ipv6sock >= 0)
-		bytes = send((int)sock.ipv6sock, (const char*)data, size, 0);
+		bytes = send((int)sock.ipv6sock, (const char*)data, size, flags);
 
 	return bytes;
 }
 
+int net_tcp_shutdown(NETSOCKET sock)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	const int how = SD_BOTH;
+#else
+	const int how = SHUT_RDWR;
+#endif
+	int err = 0;
+
+	if(sock.ipv4sock >= 0)
+		err |= shutdown(sock.ipv4sock, how);
+	if(sock.ipv6sock >= 0)
+		err |= shutdown(sock.ipv6sock, how);
+
+	return err;
+}
+
 int net_tcp_recv(NETSOCKET sock, void *data, int maxsize)
 {
 	int bytes = -1;
@@ -1897,15 +2939,35 @@ void swap_endian(void *data, unsigned elem_size, unsigned num)
 }
 
 int net_socket_read_wait(NETSOCKET sock, int time)
+{
+	return net_socket_read_wait_us(sock, (int64)time*1000);
+}
+
+int net_socket_read_wait_us(NETSOCKET sock, int64 time)
 {
 	struct timeval tv;
 	fd_set readfds;
 	int sockid;
 
-	tv.tv_sec = 0;
-	tv.tv_usec = 1000*time;
+	tv.tv_sec = time/1000000;
+	tv.tv_usec = time%1000000;
 	sockid = 0;
 
+#if defined(CONF_NET_URING)
+	{
+		/* the ring becomes readable with the completions, the sockets are drained by it */
+		NET_URING *r = priv_net_uring_find(sock);
+		if(r)
+		{
+			if(priv_net_uring_pending(r))
+				return 1;
+			FD_ZERO(&readfds);
+			FD_SET(r->fd, &readfds);
+			return select(r->fd+1, &readfds, NULL, NULL, &tv) > 0;
+		}
+	}
+#endif
+
 	FD_ZERO(&readfds);
 	if(sock.ipv4sock >= 0)
 	{
@@ -1931,6 +2993,74 @@ int net_socket_read_wait(NETSOCKET sock, int time)
 	return 0;
 }
 
+int net_socket_write_wait_us(NETSOCKET sock, int64 time)
+{
+	struct timeval tv;
+	fd_set writefds;
+	int sockid = 0;
+
+	tv.tv_sec = time/1000000;
+	tv.tv_usec = time%1000000;
+
+	FD_ZERO(&writefds);
+	if(sock.ipv4sock >= 0)
+	{
+		FD_SET(sock.ipv4sock, &writefds);
+		sockid = sock.ipv4sock;
+	}
+	if(sock.ipv6sock >= 0)
+	{
+		FD_SET(sock.ipv6sock, &writefds);
+		if(sock.ipv6sock > sockid)
+			sockid = sock.ipv6sock;
+	}
+
+	return select(sockid+1, NULL, &writefds, NULL, &tv) > 0;
+}
+
+int net_socket_read_wait_any(const NETSOCKET *socks, int num, int64 time)
+{
+	struct timeval tv;
+	fd_set readfds;
+	int sockid = 0;
+	int i;
+
+	tv.tv_sec = time/1000000;
+	tv.tv_usec = time%1000000;
+
+	FD_ZERO(&readfds);
+	for(i = 0; i < num; i++)
+	{
+#if defined(CONF_NET_URING)
+		NET_URING *r = priv_net_uring_find(socks[i]);
+		if(r)
+		{
+			if(priv_net_uring_pending(r))
+				return 1;
+			FD_SET(r->fd, &readfds);
+			if(r->fd > sockid)
+				sockid = r->fd;
+			continue;
+		}
+#endif
+		if(socks[i].ipv4sock >= 0)
+		{
+			FD_SET(socks[i].ipv4sock, &readfds);
+			if(socks[i].ipv4sock > sockid)
+				sockid = socks[i].ipv4sock;
+		}
+		if(socks[i].ipv6sock >= 0)
+		{
+			FD_SET(socks[i].ipv6sock, &readfds);
+			if(socks[i].ipv6sock > sockid)
+				sockid = socks[i].ipv6sock;
+		}
+	}
+
+	/* don't care about writefds and exceptfds */
+	return select(sockid+1, &readfds, NULL, NULL, &tv) > 0;
+}
+
 int time_timestamp()
 {
 	return time(0);
@@ -2082,12 +3212,104 @@ void str_format(char *buffer, int buffer_size, const char *format, ...)
 
 
 
+/*
+	The string scans below skip whole 16 byte blocks that need no work and
+	fall back to single bytes otherwise. Blocks are only tested at aligned
+	addresses: an aligned load can't cross into the next page, so reading
+	past the terminator is safe. The scalar versions stop at the first byte
+	that fails, they never read past the terminator.
+*/
+#define STR_BLOCK_SIZE 16
+
+static int str_block_aligned(const unsigned char *str)
+{
+	return ((size_t)str&(STR_BLOCK_SIZE-1)) == 0;
+}
+
+#if defined(CONF_STR_NEON)
+static int str_neon_all(uint8x16_t mask)
+{
+	uint64x2_t words = vreinterpretq_u64_u8(mask);
+	return (vgetq_lane_u64(words, 0)&vgetq_lane_u64(words, 1)) == ~(uint64)0;
+}
+
+static int str_neon_any(uint8x16_t mask)
+{
+	uint64x2_t words = vreinterpretq_u64_u8(mask);
+	return (vgetq_lane_u64(words, 0)|vgetq_lane_u64(words, 1)) != 0;
+}
+#endif
+
+/* all bytes of the block are at least min, min > 0 */
+static int str_block_all_from(const unsigned char *block, unsigned char min)
+{
+#if defined(CONF_STR_SSE2)
+	__m128i v = _mm_load_si128((const __m128i *)block);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8((char)min)), v)) == 0xffff;
+#elif defined(CONF_STR_NEON)
+	return str_neon_all(vcgeq_u8(vld1q_u8(block), vdupq_n_u8(min)));
+#else
+	int i;
+	for(i = 0; i < STR_BLOCK_SIZE; i++)
+		if(block[i] < min)
+			return 0;
+	return 1;
+#endif
+}
+
+/* all bytes of the block are between min and 127, min > 0 */
+static int str_block_all_ascii_from(const unsigned char *block, unsigned char min)
+{
+#if defined(CONF_STR_SSE2)
+	__m128i v = _mm_load_si128((const __m128i *)block);
+	return _mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(min-1)))) == 0xffff;
+#elif defined(CONF_STR_NEON)
+	return str_neon_all(vcgtq_s8(vreinterpretq_s8_u8(vld1q_u8(block)), vdupq_n_s8((signed char)(min-1))));
+#else
+	int i;
+	for(i = 0; i < STR_BLOCK_SIZE; i++)
+		if(block[i] < min || block[i] > 127)
+			return 0;
+	return 1;
+#endif
+}
+
+/* the block contains a, b or the terminator */
+static int str_block_has(const unsigned char *block, unsigned char a, unsigned char b)
+{
+#if defined(CONF_STR_SSE2)
+	__m128i v = _mm_load_si128((const __m128i *)block);
+	__m128i match = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)a)), _mm_cmpeq_epi8(v, _mm_set1_epi8((char)b)));
+	return _mm_movemask_epi8(_mm_or_si128(match, _mm_cmpeq_epi8(v, _mm_setzero_si128()))) != 0;
+#elif defined(CONF_STR_NEON)
+	uint8x16_t v = vld1q_u8(block);
+	return str_neon_any(vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8(a)), vceqq_u8(v, vdupq_n_u8(b))), vceqq_u8(v, vdupq_n_u8(0))));
+#else
+	int i;
+	for(i = 0; i < STR_BLOCK_SIZE; i++)
+		if(block[i] == a || block[i] == b || !block[i])
+			return 1;
+	return 0;
+#endif
+}
+
+/* the same as tolower in the C locale */
+static unsigned char str_ascii_lower(unsigned char c)
+{
+	return c >= 'A' && c <= 'Z' ? c+('a'-'A') : c;
+}
+
 /* makes sure that the string only contains the characters between 32 and 127 */
 void str_sanitize_strong(char *str_in)
 {
 	unsigned char *str = (unsigned char *)str_in;
 	while(*str)
 	{
+		if(str_block_aligned(str) && str_block_all_ascii_from(str, 32))
+		{
+			str += STR_BLOCK_SIZE;
+			continue;
+		}
 		*str &= 0x7f;
 		if(*str < 32)
 			*str = 32;
@@ -2101,6 +3323,11 @@ void str_sanitize_cc(char *str_in)
 	unsigned char *str = (unsigned char *)str_in;
 	while(*str)
 	{
+		if(str_block_aligned(str) && str_block_all_from(str, 32))
+		{
+			str += STR_BLOCK_SIZE;
+			continue;
+		}
 		if(*str < 32)
 			*str = ' ';
 		str++;
@@ -2153,6 +3380,11 @@ void str_sanitize(char *str_in)
 	unsigned char *str = (unsigned char *)str_in;
 	while(*str)
 	{
+		if(str_block_aligned(str) && str_block_all_from(str, 32))
+		{
+			str += STR_BLOCK_SIZE;
+			continue;
+		}
 		if(*str < 32 && !(*str == '\r') && !(*str == '\n') && !(*str == '\t'))
 			*str = ' ';
 		str++;
@@ -2395,18 +3627,29 @@ const char *str_endswith(const char *str, const char *suffix)
 
 const char *str_find_nocase(const char *haystack, const char *needle)
 {
-	while(*haystack) /* native implementation */
+	const unsigned char *str = (const unsigned char *)haystack;
+	const unsigned char first = str_ascii_lower((unsigned char)needle[0]);
+	const unsigned char first_upper = first >= 'a' && first <= 'z' ? first-('a'-'A') : first;
+	while(*str)
 	{
-		const char *a = haystack;
-		const char *b = needle;
-		while(*a && *b && tolower(*a) == tolower(*b))
+		const unsigned char *a = str;
+		const unsigned char *b = (const unsigned char *)needle;
+
+		/* skip the blocks without the first character of the needle */
+		if(first && str_block_aligned(str) && !str_block_has(str, first, first_upper))
+		{
+			str += STR_BLOCK_SIZE;
+			continue;
+		}
+
+		while(*a && *b && str_ascii_lower(*a) == str_ascii_lower(*b))
 		{
 			a++;
 			b++;
 		}
 		if(!(*b))
-			return haystack;
-		haystack++;
+			return (const char *)str;
+		str++;
 	}
 
 	return 0;
@@ -2507,6 +3750,39 @@ int mem_has_null(const void *block, unsigned size)
 	return 0;
 }
 
+void mem_tag_stats(int tag, int64 *bytes, int *blocks)
+{
+	*bytes = mem_tag_bytes(&mem_tags[tag]);
+	*blocks = atomic_int_load(&mem_tags[tag].blocks);
+}
+
+const char *mem_tag_name(int tag)
+{
+	return mem_tag_names[tag];
+}
+
+int64 mem_resident_size()
+{
+#if defined(CONF_PLATFORM_LINUX)
+	long pages = 0;
+	FILE *file = fopen("/proc/self/statm", "r");
+	if(!file)
+		return -1;
+	if(fscanf(file, "%*s %ld", &pages) != 1)
+		pages = -1;
+	fclose(file);
+	return pages < 0 ? -1 : (int64)pages*sysconf(_SC_PAGESIZE);
+#elif defined(CONF_PLATFORM_MACOSX)
+	struct mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if(task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+		return -1;
+	return info.resident_size;
+#else
+	return -1;
+#endif
+}
+
 void net_stats(NETSTATS *stats_inout)
 {
 	*stats_inout = network_stats;
@@ -2707,7 +3983,9 @@ int str_utf8_check(const char *str)
 {
 	while(*str)
 	{
-		if((*str&0x80) == 0x0)
+		if(str_block_aligned((const unsigned char *)str) && str_block_all_ascii_from((const unsigned char *)str, 1))
+			str += STR_BLOCK_SIZE;
+		else if((*str&0x80) == 0x0)
 			str++;
 		else if((*str&0xE0) == 0xC0 && (*(str+1)&0xC0) == 0x80)
 			str += 2;
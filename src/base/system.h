@@ -80,6 +80,22 @@ GNUC_ATTRIBUTE((format(printf, 2, 3)));
 
 /* Group: Memory */
 
+/*
+	Memory tags, what the blocks of <mem_alloc_tag> count towards
+	in <mem_tag_stats>. <mem_alloc> uses MEMTAG_OTHER.
+*/
+enum
+{
+	MEMTAG_OTHER=0,
+	MEMTAG_NETWORK,
+	MEMTAG_SNAPSHOT,
+	MEMTAG_GRAPHICS,
+	MEMTAG_SOUND,
+	MEMTAG_EDITOR,
+	MEMTAG_MAP,
+	NUM_MEMTAGS
+};
+
 /*
 	Function: mem_alloc
 		Allocates memory.
@@ -99,8 +115,15 @@ GNUC_ATTRIBUTE((format(printf, 2, 3)));
 	See Also:
 		<mem_free>
 */
-void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment);
-#define mem_alloc(s,a) mem_alloc_debug(__FILE__, __LINE__, (s), (a))
+void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment, int tag);
+#define mem_alloc(s,a) mem_alloc_debug(__FILE__, __LINE__, (s), (a), MEMTAG_OTHER)
+
+/*
+	Function: mem_alloc_tag
+		Like <mem_alloc>, the block counts towards one of the
+		MEMTAG_* tags until it gets freed.
+*/
+#define mem_alloc_tag(s,a,t) mem_alloc_debug(__FILE__, __LINE__, (s), (a), (t))
 
 /*
 	Function: mem_free
@@ -197,6 +220,7 @@ enum {
 	IOFLAG_READ = 1,
 	IOFLAG_WRITE = 2,
 	IOFLAG_RANDOM = 4,
+	IOFLAG_APPEND = 8,
 
 	IOSEEK_START = 0,
 	IOSEEK_CUR = 1,
@@ -214,6 +238,7 @@ typedef struct IOINTERNAL *IOHANDLE;
 	Parameters:
 		filename - File to open.
 		flags - A set of flags. IOFLAG_READ, IOFLAG_WRITE, IOFLAG_RANDOM.
+			IOFLAG_APPEND writes to the end of the file, creating it if needed.
 
 	Returns:
 		Returns a handle to the file on success and 0 on failure.
@@ -386,6 +411,72 @@ int io_close(IOHANDLE io);
 */
 int io_flush(IOHANDLE io);
 
+/*
+	Function: io_buffer
+		Sets the buffer that reads and writes on the file go through.
+		Larger buffers mean fewer system calls for callers that read
+		or write in many small pieces.
+
+	Parameters:
+		io - Handle to the file.
+		buffer - Memory to use as buffer or 0 to allocate it internally.
+		size - Size of the buffer in bytes.
+
+	Returns:
+		Returns 0 on success.
+
+	Remarks:
+		- Must be called before the first read or write on the file.
+		- A passed buffer must stay valid until the file is closed.
+		- Some C libraries ignore size when buffer is 0, pass a buffer
+		  to be sure it is used.
+*/
+int io_buffer(IOHANDLE io, void *buffer, unsigned size);
+
+/*
+	Function: io_sequential
+		Hints that the file will be read from the start to the end,
+		letting the system read further ahead. Only a hint, reading at
+		other positions keeps working.
+
+	Parameters:
+		io - Handle to the file.
+*/
+void io_sequential(IOHANDLE io);
+
+/*
+	Function: io_mmap
+		Maps the whole file into memory. The memory is readable and
+		writable, but writes stay private to the process and don't
+		change the file.
+
+	Parameters:
+		io - Handle to the file.
+		size - Receives the size of the mapping.
+
+	Returns:
+		Returns the start of the mapped memory or 0 if the file is
+		empty or can't be mapped.
+
+	Remarks:
+		- The mapping stays valid after the file is closed and must be
+		  released with <io_munmap>.
+		- Reading the mapping after the file got truncated by someone
+		  else can crash the process, only map files that aren't
+		  rewritten while they are in use.
+*/
+void *io_mmap(IOHANDLE io, unsigned *size);
+
+/*
+	Function: io_munmap
+		Releases memory returned by <io_mmap>.
+
+	Parameters:
+		data - Start of the mapped memory.
+		size - Size of the mapping.
+*/
+void io_munmap(void *data, unsigned size);
+
 
 /*
 	Function: io_stdin
@@ -463,12 +554,85 @@ void thread_yield();
 */
 void thread_detach(void *thread);
 
+/*
+	Function: thread_precise_timers
+		Asks the system to end timed waits of the calling thread, like
+		<net_socket_read_wait_us>, as close to the timeout as it can
+		instead of coalescing them with other timers.
+*/
+void thread_precise_timers();
+
+/*
+	Function: thread_set_name
+		Names the calling thread for debuggers and tools like top.
+		Linux shows at most 15 characters.
+
+	Parameters:
+		name - Name of the thread.
+*/
+void thread_set_name(const char *name);
+
+/*
+	Function: thread_current_id
+		Returns the system's id of the calling thread, for
+		<thread_set_priority> and <thread_set_affinity> from any thread.
+*/
+int thread_current_id();
+
+/*
+	Function: thread_set_priority
+		Changes the scheduling priority of a thread.
+
+	Parameters:
+		id - Thread id from <thread_current_id>.
+		priority - Below 0 for low, 0 for normal and above 0 for high.
+
+	Returns:
+		0 on success, -1 when the system doesn't allow it. Higher
+		priorities need special rights on linux.
+*/
+int thread_set_priority(int id, int priority);
+
+/*
+	Function: cpu_list_parse
+		Reads a list of cpus like "0-3,6".
+
+	Parameters:
+		list - The list.
+		cpus - Gets 1 for each cpu in the list and 0 for the others.
+		max_cpus - Size of the cpus array.
+
+	Returns:
+		The number of cpus in the list or -1 if the list is invalid.
+*/
+int cpu_list_parse(const char *list, unsigned char *cpus, int max_cpus);
+
+/*
+	Function: thread_set_affinity
+		Limits a thread to some cpus.
+
+	Parameters:
+		id - Thread id from <thread_current_id>.
+		list - The cpus as for <cpu_list_parse>, empty for all.
+
+	Returns:
+		0 on success, -1 on an invalid list or when the system doesn't
+		support it.
+*/
+int thread_set_affinity(int id, const char *list);
+
 /*
 	Function: cpu_relax
 		Lets the cpu relax a bit.
 */
 void cpu_relax();
 
+/*
+	Function: cpu_count
+		Returns the number of processors that are online, at least 1.
+*/
+int cpu_count();
+
 /* Group: Locks */
 typedef void* LOCK;
 
@@ -482,30 +646,87 @@ void lock_unlock(LOCK lock);
 
 /* Group: Semaphores */
 
-#if !defined(CONF_PLATFORM_MACOSX)
-	#if defined(CONF_FAMILY_UNIX)
-		#include <semaphore.h>
-		typedef sem_t SEMAPHORE;
-	#elif defined(CONF_FAMILY_WINDOWS)
-		typedef void* SEMAPHORE;
-	#else
-		#error missing sempahore implementation
-	#endif
-
-	void semaphore_init(SEMAPHORE *sem);
-	void semaphore_wait(SEMAPHORE *sem);
-	void semaphore_signal(SEMAPHORE *sem);
-	void semaphore_destroy(SEMAPHORE *sem);
+#if defined(CONF_PLATFORM_MACOSX)
+	/* unnamed posix semaphores don't work on macosx */
+	#include <dispatch/dispatch.h>
+	typedef dispatch_semaphore_t SEMAPHORE;
+#elif defined(CONF_FAMILY_UNIX)
+	#include <semaphore.h>
+	typedef sem_t SEMAPHORE;
+#elif defined(CONF_FAMILY_WINDOWS)
+	typedef void* SEMAPHORE;
+#else
+	#error missing sempahore implementation
 #endif
 
+void semaphore_init(SEMAPHORE *sem);
+void semaphore_wait(SEMAPHORE *sem);
+void semaphore_signal(SEMAPHORE *sem);
+void semaphore_destroy(SEMAPHORE *sem);
+
+/* Group: Atomics */
+
+/*
+	Function: atomic_int_load
+		Reads an int that other threads write. Reads and writes after
+		it can't move in front of it (acquire).
+*/
+int atomic_int_load(const volatile int *value);
+
+/*
+	Function: atomic_int_store
+		Writes an int that other threads read. Reads and writes before
+		it can't move behind it (release).
+*/
+void atomic_int_store(volatile int *value, int new_value);
+
+/*
+	Function: atomic_int_add
+		Adds to an int as one operation with a full fence.
+
+	Returns:
+		The value after the addition.
+*/
+int atomic_int_add(volatile int *value, int add);
+
+/*
+	Function: atomic_int_compswap
+		Sets an int to new_value if it is comperand, as one operation
+		with a full fence.
+
+	Returns:
+		The value before, the swap happened if it equals comperand.
+*/
+int atomic_int_compswap(volatile int *value, int comperand, int new_value);
+
+/*
+	Function: atomic_ptr_load
+		Like <atomic_int_load> for pointers.
+*/
+void *atomic_ptr_load(void *const volatile *value);
+
+/*
+	Function: atomic_ptr_store
+		Like <atomic_int_store> for pointers.
+*/
+void atomic_ptr_store(void *volatile *value, void *new_value);
+
+/*
+	Function: atomic_ptr_compswap
+		Like <atomic_int_compswap> for pointers.
+*/
+void *atomic_ptr_compswap(void *volatile *value, void *comperand, void *new_value);
+
 /* Group: Timer */
 #ifdef __GNUC__
 /* if compiled with -pedantic-errors it will complain about long
 	not being a C90 thing.
 */
 __extension__ typedef long long int64;
+__extension__ typedef unsigned long long uint64;
 #else
 typedef long long int64;
+typedef unsigned long long uint64;
 #endif
 /*
 	Function: time_get
@@ -516,9 +737,25 @@ typedef long long int64;
 
 	Remarks:
 		To know how fast the timer is ticking, see <time_freq>.
+		The timer is monotonic, it doesn't follow changes of the
+		system clock.
 */
 int64 time_get();
 
+/*
+	Function: time_get_coarse
+		Fetches a sample from the same timer as <time_get> at a
+		resolution of a few milliseconds, but cheaper.
+
+	Returns:
+		Current value of the timer.
+
+	Remarks:
+		Meant for timestamps like last activity times that are
+		taken often and only compared against timeouts.
+*/
+int64 time_get_coarse();
+
 /*
 	Function: time_freq
 		Returns the frequency of the high resolution timer.
@@ -705,6 +942,45 @@ int net_addr_from_str(NETADDR *addr, const char *string);
 */
 NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port);
 
+/*
+	Function: net_udp_create_reuseport
+		Creates a UDP socket that can share its port with other sockets
+		created this way. The kernel spreads incoming packets over the
+		sockets by their source, so every peer sticks to one socket.
+
+	Parameters:
+		bindaddr - Address to bind the socket to.
+
+	Returns:
+		On success it returns an handle to the socket. On failure it
+		returns NETSOCKET_INVALID.
+
+	Remarks:
+		- Only available on Linux, fails everywhere else.
+*/
+NETSOCKET net_udp_create_reuseport(NETADDR bindaddr);
+
+/*
+	Function: net_udp_uring_enable
+		Receives on an UDP socket through io_uring from now on. A
+		multishot receive stays armed on the socket and fills buffers
+		shared with the kernel, so <net_udp_recv>, <net_udp_recv_batch>
+		and the waits read the datagrams without a syscall.
+
+	Parameters:
+		sock - Socket to receive on.
+
+	Returns:
+		0 on success, -1 if the kernel doesn't support it. The socket
+		keeps working as before then.
+
+	Remarks:
+		- Needs linux 6.0 or newer.
+		- Sending and the other platforms are unaffected.
+		- <net_udp_close> releases the ring.
+*/
+int net_udp_uring_enable(NETSOCKET sock);
+
 /*
 	Function: net_udp_send
 		Sends a packet over an UDP socket.
@@ -737,6 +1013,59 @@ int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size
 */
 int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize);
 
+/*
+	Struct: NETDATAGRAM
+		Describes one datagram for the batched UDP functions.
+*/
+typedef struct
+{
+	NETADDR addr;
+	void *data;
+	int size;
+} NETDATAGRAM;
+
+/*
+	Function: net_udp_recv_batch
+		Receives up to num packets over an UDP socket with as few
+		syscalls as possible.
+
+	Parameters:
+		sock - Socket to use.
+		datagrams - Array of datagrams. The data member of each entry
+			has to point to a buffer of at least maxsize bytes. On
+			return addr and size are filled in.
+		num - Number of entries in the array.
+		maxsize - Maximum size to receive per datagram.
+
+	Returns:
+		The number of datagrams received. Returns 0 if there was
+		nothing to read.
+
+	Remarks:
+		- Uses recvmmsg where available and falls back to calling
+		  <net_udp_recv> repeatedly otherwise.
+*/
+int net_udp_recv_batch(NETSOCKET sock, NETDATAGRAM *datagrams, int num, int maxsize);
+
+/*
+	Function: net_udp_send_batch
+		Sends several packets over an UDP socket with as few syscalls
+		as possible.
+
+	Parameters:
+		sock - Socket to use.
+		datagrams - Array of datagrams to send.
+		num - Number of entries in the array.
+
+	Returns:
+		The number of datagrams that were handed to the network stack.
+
+	Remarks:
+		- Uses sendmmsg where available and falls back to calling
+		  <net_udp_send> repeatedly otherwise.
+*/
+int net_udp_send_batch(NETSOCKET sock, const NETDATAGRAM *datagrams, int num);
+
 /*
 	Function: net_udp_close
 		Closes an UDP socket.
@@ -834,6 +1163,19 @@ int net_tcp_connect(NETSOCKET sock, const NETADDR *addr);
 */
 int net_tcp_send(NETSOCKET sock, const void *data, int size);
 
+/*
+	Function: net_tcp_shutdown
+		Shuts down both directions of a TCP stream without closing the
+		socket, pending and later sends and receives fail.
+
+	Parameters:
+		sock - Socket to shut down.
+
+	Returns:
+		Returns 0 on success.
+*/
+int net_tcp_shutdown(NETSOCKET sock);
+
 /*
 	Function: net_tcp_recv
 		Recvives data from a TCP stream.
@@ -1592,6 +1934,46 @@ int net_would_block();
 
 int net_socket_read_wait(NETSOCKET sock, int time);
 
+/*
+	Function: net_socket_read_wait_us
+		Waits until the socket has data to read.
+
+	Parameters:
+		sock - The socket.
+		time - Longest time to wait in microseconds.
+
+	Returns:
+		1 if the socket has data, 0 otherwise.
+*/
+int net_socket_read_wait_us(NETSOCKET sock, int64 time);
+
+/*
+	Function: net_socket_write_wait_us
+		Waits until the socket can take more data to send.
+
+	Parameters:
+		sock - The socket.
+		time - Longest time to wait in microseconds.
+
+	Returns:
+		1 if the socket can be written to, 0 otherwise.
+*/
+int net_socket_write_wait_us(NETSOCKET sock, int64 time);
+
+/*
+	Function: net_socket_read_wait_any
+		Waits until one of several sockets has data to read.
+
+	Parameters:
+		socks - The sockets.
+		num - Number of sockets.
+		time - Longest time to wait in microseconds.
+
+	Returns:
+		1 if one of the sockets has data, 0 otherwise.
+*/
+int net_socket_read_wait_any(const NETSOCKET *socks, int num, int64 time);
+
 void swap_endian(void *data, unsigned elem_size, unsigned num);
 
 
@@ -1603,6 +1985,32 @@ void dbg_logger_debugger();
 void dbg_logger_file(const char *filename);
 void dbg_logger_filehandle(IOHANDLE handle);
 
+/*
+	Function: dbg_logger_async
+		Moves the writing of the log lines to a background thread.
+		<dbg_msg> only copies the line into a queue then, lines that
+		don't fit into it are dropped and counted. What is queued gets
+		written on exit and on failed asserts.
+
+	Parameters:
+		num_lines - How many lines the queue holds, lines longer than
+		1023 bytes are cut off.
+*/
+void dbg_logger_async(int num_lines);
+
+/*
+	Function: dbg_logger_flush
+		Writes out the lines that wait for the background thread.
+*/
+void dbg_logger_flush();
+
+/*
+	Function: dbg_logger_dropped
+		Returns how many lines were dropped because the queue of the
+		background thread was full.
+*/
+int dbg_logger_dropped();
+
 #if defined(CONF_FAMILY_WINDOWS)
 void dbg_console_init();
 void dbg_console_cleanup();
@@ -1809,6 +2217,33 @@ void secure_random_fill(void *bytes, unsigned length);
 */
 int pid();
 
+/*
+	Function: mem_resident_size
+		Returns the physical memory used by the process.
+
+	Returns:
+		The resident set size in bytes, or -1 when it is not known
+		on the platform.
+*/
+int64 mem_resident_size();
+
+/*
+	Function: mem_tag_stats
+		Returns what is allocated under a memory tag right now.
+
+	Parameters:
+		tag - One of the MEMTAG_* tags.
+		bytes - Receives the allocated bytes.
+		blocks - Receives the number of allocated blocks.
+*/
+void mem_tag_stats(int tag, int64 *bytes, int *blocks);
+
+/*
+	Function: mem_tag_name
+		Returns the name of a memory tag, like "network".
+*/
+const char *mem_tag_name(int tag);
+
 /*
 	Function: bytes_be_to_uint
 		Packs 4 big endian bytes into an unsigned
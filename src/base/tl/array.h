@@ -13,8 +13,12 @@
 
 	Remarks:
 		- Grows 50% each time it needs to fit new items
-		- Use set_size() if you know how many elements
-		- Use optimize() to reduce the needed space.
+		- Use set_size() if you know how many elements, reserve() if you
+		  know how many will be added
+		- Use optimize() or shrink_to_fit() to reduce the needed space.
+		- Elements that are trivially copyable get moved around with
+		  mem_copy, others are moved one by one where the compiler
+		  supports it and copied otherwise.
 */
 template <class T, class ALLOCATOR = allocator_default<T> >
 class array : private ALLOCATOR
@@ -41,12 +45,29 @@ public:
 	*/
 	array(const array &other)
 	{
-		init();
+		list = 0x0;
+		list_size = 0;
+		num_elements = 0;
 		set_size(other.size());
-		for(int i = 0; i < size(); i++)
-			(*this)[i] = other[i];
+		copy_elements(list, other.list, num_elements);
 	}
 
+#if defined(TL_CXX11)
+	/*
+		Function: array move constructor
+			Takes over the elements, the other array is left empty.
+	*/
+	array(array &&other)
+	{
+		list = other.list;
+		list_size = other.list_size;
+		num_elements = other.num_elements;
+		other.list = 0x0;
+		other.list_size = 0;
+		other.num_elements = 0;
+	}
+#endif
+
 
 	/*
 		Function: array destructor
@@ -102,7 +123,8 @@ public:
 	*/
 	void remove_index_fast(int index)
 	{
-		list[index] = list[num_elements-1];
+		if(index != num_elements-1)
+			list[index] = tl_move(list[num_elements-1]);
 		set_size(size()-1);
 	}
 
@@ -130,9 +152,7 @@ public:
 	*/
 	void remove_index(int index)
 	{
-		for(int i = index+1; i < num_elements; i++)
-			list[i-1] = list[i];
-
+		move_elements(list+index, list+index+1, num_elements-index-1);
 		set_size(size()-1);
 	}
 
@@ -193,9 +213,7 @@ public:
 		incsize();
 		set_size(size()+1);
 
-		for(int i = num_elements-1; i > index; i--)
-			list[i] = list[i-1];
-
+		move_elements(list+index+1, list+index, num_elements-index-1);
 		list[index] = item;
 
 		return num_elements-1;
@@ -266,6 +284,46 @@ public:
 	}
 
 
+	/*
+		Function: reserve
+			Makes room for at least the number of elements wanted
+			without changing the size.
+
+		Arguments:
+			capacity - Number of elements to make room for.
+
+		Remarks:
+			- Never gives memory back, see <shrink_to_fit>
+			- Invalidates ranges
+	*/
+	void reserve(int capacity)
+	{
+		if(list_size < capacity)
+			alloc(capacity);
+	}
+
+	/*
+		Function: capacity
+			Number of elements that fit without growing.
+	*/
+	int capacity() const
+	{
+		return list_size;
+	}
+
+	/*
+		Function: shrink_to_fit
+			Gives back the room that isn't used by elements.
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	void shrink_to_fit()
+	{
+		if(list_size > num_elements)
+			alloc(num_elements);
+	}
+
 	/*
 		Function: optimize
 			Removes unnecessary data, returns how many bytes was earned.
@@ -276,7 +334,7 @@ public:
 	int optimize()
 	{
 		int before = memusage();
-		alloc(num_elements);
+		shrink_to_fit();
 		return before - memusage();
 	}
 
@@ -297,12 +355,31 @@ public:
 	*/
 	array &operator = (const array &other)
 	{
-		set_size(other.size());
-		for(int i = 0; i < size(); i++)
-			(*this)[i] = other[i];
+		if(this != &other)
+		{
+			set_size(other.size());
+			copy_elements(list, other.list, num_elements);
+		}
 		return *this;
 	}
 
+#if defined(TL_CXX11)
+	/*
+		Function: operator=(array &&)
+			Swaps the elements with the other array.
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	array &operator = (array &&other)
+	{
+		tl_swap(list, other.list);
+		tl_swap(list_size, other.list_size);
+		tl_swap(num_elements, other.num_elements);
+		return *this;
+	}
+#endif
+
 	/*
 		Function: all
 			Returns a range that contains the whole array.
@@ -321,14 +398,45 @@ protected:
 		}
 	}
 
+	static void copy_elements(T *dest, const T *source, int num)
+	{
+		if(num <= 0)
+			return;
+		if(tl_is_relocatable<T>::value)
+			mem_copy(dest, source, sizeof(T)*num);
+		else
+		{
+			for(int i = 0; i < num; i++)
+				dest[i] = source[i];
+		}
+	}
+
+	// the ranges may overlap, moved from elements are left in a valid but unspecified state
+	static void move_elements(T *dest, T *source, int num)
+	{
+		if(num <= 0 || dest == source)
+			return;
+		if(tl_is_relocatable<T>::value)
+			mem_move(dest, source, sizeof(T)*num);
+		else if(dest < source)
+		{
+			for(int i = 0; i < num; i++)
+				dest[i] = tl_move(source[i]);
+		}
+		else
+		{
+			for(int i = num-1; i >= 0; i--)
+				dest[i] = tl_move(source[i]);
+		}
+	}
+
 	void alloc(int new_len)
 	{
 		list_size = new_len;
 		T *new_list = ALLOCATOR::alloc_array(list_size);
 
 		int end = num_elements < list_size ? num_elements : list_size;
-		for(int i = 0; i < end; i++)
-			new_list[i] = list[i];
+		move_elements(new_list, list, end);
 
 		ALLOCATOR::free_array(list);
 
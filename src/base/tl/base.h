@@ -5,17 +5,41 @@
 
 #include <base/system.h>
 
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+	#define TL_CXX11 1
+	#include <type_traits>
+	#include <utility>
+#endif
+
 inline void tl_assert(bool statement)
 {
 	dbg_assert(statement, "assert!");
 }
 
+/*
+	tl_is_relocatable - true for types that can be copied or moved with mem_copy
+	tl_move - lets the value be moved from where the compiler supports it
+*/
+#if defined(TL_CXX11)
+template<class T>
+struct tl_is_relocatable { enum { value = std::is_trivially_copyable<T>::value }; };
+
+template<class T>
+inline T &&tl_move(T &a) { return std::move(a); }
+#else
+template<class T>
+struct tl_is_relocatable { enum { value = 0 }; };
+
+template<class T>
+inline T &tl_move(T &a) { return a; }
+#endif
+
 template<class T>
 inline void tl_swap(T &a, T &b)
 {
-	T c = b;
-	b = a;
-	a = c;
+	T c = tl_move(b);
+	b = tl_move(a);
+	a = tl_move(c);
 }
 
 #endif
@@ -0,0 +1,177 @@
+#ifndef BASE_TL_BITSET_H
+#define BASE_TL_BITSET_H
+
+#include "../system.h"
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+/*
+	bit_ctz64 - index of the lowest set bit, Value must not be 0
+	bit_popcount64 - number of set bits
+*/
+
+#if defined(__GNUC__)
+
+	inline int bit_ctz64(uint64 Value) { return __builtin_ctzll(Value); }
+	inline int bit_popcount64(uint64 Value) { return __builtin_popcountll(Value); }
+
+#elif defined(_MSC_VER) && defined(_M_X64)
+
+	inline int bit_ctz64(uint64 Value) { unsigned long Index; _BitScanForward64(&Index, Value); return Index; }
+	inline int bit_popcount64(uint64 Value) { return (int)__popcnt64(Value); }
+
+#else
+
+	inline int bit_ctz64(uint64 Value)
+	{
+		int Index = 0;
+		while(!(Value&1))
+		{
+			Value >>= 1;
+			Index++;
+		}
+		return Index;
+	}
+
+	inline int bit_popcount64(uint64 Value)
+	{
+		int Count = 0;
+		for(; Value; Value &= Value-1)
+			Count++;
+		return Count;
+	}
+
+#endif
+
+/*
+	Class: bitset
+		Fixed number of bits stored in 64 bit words. Bits past BITS are
+		always zero. Iterate the set bits with:
+
+		for(int i = Set.first(); i >= 0; i = Set.next(i))
+*/
+template<int BITS>
+class bitset
+{
+	enum
+	{
+		NUM_WORDS=(BITS+63)/64,
+	};
+
+	uint64 m_aWords[NUM_WORDS];
+
+	static uint64 last_word_mask() { return BITS%64 ? ((uint64)1<<(BITS%64))-1 : ~(uint64)0; }
+
+public:
+	bitset() { clear(); }
+
+	static bitset all()
+	{
+		bitset Set;
+		for(int i = 0; i < NUM_WORDS; i++)
+			Set.m_aWords[i] = ~(uint64)0;
+		Set.m_aWords[NUM_WORDS-1] &= last_word_mask();
+		return Set;
+	}
+
+	static bitset one(int Index)
+	{
+		bitset Set;
+		Set.set(Index);
+		return Set;
+	}
+
+	void clear()
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			m_aWords[i] = 0;
+	}
+
+	void set(int Index) { m_aWords[Index>>6] |= (uint64)1<<(Index&63); }
+	void reset(int Index) { m_aWords[Index>>6] &= ~((uint64)1<<(Index&63)); }
+	bool test(int Index) const { return (m_aWords[Index>>6]>>(Index&63))&1; }
+
+	bool any() const
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			if(m_aWords[i])
+				return true;
+		return false;
+	}
+
+	bool empty() const { return !any(); }
+
+	int count() const
+	{
+		int Count = 0;
+		for(int i = 0; i < NUM_WORDS; i++)
+			Count += bit_popcount64(m_aWords[i]);
+		return Count;
+	}
+
+	// the lowest set bit, -1 if there is none
+	int first() const { return find_from(0, m_aWords[0]); }
+
+	// the lowest set bit above Index, -1 if there is none
+	int next(int Index) const
+	{
+		Index++;
+		if(Index >= BITS)
+			return -1;
+		return find_from(Index>>6, m_aWords[Index>>6]&(~(uint64)0<<(Index&63)));
+	}
+
+	bitset &operator|=(const bitset &Other)
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			m_aWords[i] |= Other.m_aWords[i];
+		return *this;
+	}
+
+	bitset &operator&=(const bitset &Other)
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			m_aWords[i] &= Other.m_aWords[i];
+		return *this;
+	}
+
+	bitset &operator^=(const bitset &Other)
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			m_aWords[i] ^= Other.m_aWords[i];
+		return *this;
+	}
+
+	bitset operator|(const bitset &Other) const { bitset Set = *this; return Set |= Other; }
+	bitset operator&(const bitset &Other) const { bitset Set = *this; return Set &= Other; }
+	bitset operator^(const bitset &Other) const { bitset Set = *this; return Set ^= Other; }
+	bitset operator~() const { return *this ^ all(); }
+
+	bool operator==(const bitset &Other) const
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			if(m_aWords[i] != Other.m_aWords[i])
+				return false;
+		return true;
+	}
+
+	bool operator!=(const bitset &Other) const { return !(*this == Other); }
+
+private:
+	// Word holds the bits of word WordIndex that are still of interest
+	int find_from(int WordIndex, uint64 Word) const
+	{
+		while(true)
+		{
+			if(Word)
+				return WordIndex*64+bit_ctz64(Word);
+			if(++WordIndex >= NUM_WORDS)
+				return -1;
+			Word = m_aWords[WordIndex];
+		}
+	}
+};
+
+#endif
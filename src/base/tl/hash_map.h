@@ -0,0 +1,353 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BASE_TL_HASH_MAP_H
+#define BASE_TL_HASH_MAP_H
+
+#include "base.h"
+#include "allocator.h"
+
+/*
+	Class: hash_traits
+		Hashing and comparison of <hash_map> keys. Integers and
+		pointers are compared by value, const char * keys by the
+		string they point to.
+*/
+template<class K>
+struct hash_traits
+{
+	static unsigned hash(const K &key)
+	{
+		uint64 value = (uint64)key*(uint64)0x9E3779B97F4A7C15ull;
+		return (unsigned)(value>>32);
+	}
+	static bool equal(const K &a, const K &b) { return a == b; }
+};
+
+template<class T>
+struct hash_traits<T *>
+{
+	static unsigned hash(T *key) { return hash_traits<uint64>::hash((uint64)(size_t)key); }
+	static bool equal(T *a, T *b) { return a == b; }
+};
+
+template<>
+struct hash_traits<const char *>
+{
+	static unsigned hash(const char *key)
+	{
+		unsigned value = 2166136261u;
+		for(; *key; key++)
+			value = (value^(unsigned char)*key)*16777619u;
+		return value;
+	}
+	static bool equal(const char *a, const char *b) { return str_comp(a, b) == 0; }
+};
+
+/*
+	Class: hash_map
+		Open addressing hash map with linear probing. The hashes,
+		keys and values sit in flat arrays, a lookup mostly compares
+		neighbouring hashes before it looks at a key. Removing shifts
+		the following entries back, so there are no tombstones.
+
+	Remarks:
+		- Grows to twice the size when it gets 3/4 full
+		- Iterate the entries with:
+
+			for(int i = Map.first(); i >= 0; i = Map.next(i))
+				Map.key(i), Map.value(i)
+
+		- Pointers to values and iteration indices are invalidated
+		  by set() and remove()
+*/
+template <class K, class V, class TRAITS = hash_traits<K> >
+class hash_map
+{
+	enum
+	{
+		MIN_CAPACITY=16,
+		USED_BIT=0x80000000u,
+	};
+
+	struct entry
+	{
+		K key;
+		V value;
+	};
+
+	// the hash of every slot with USED_BIT set, 0 for empty ones
+	unsigned *hashes;
+	entry *entries;
+	int capacity;
+	int num_entries;
+
+	// not copyable
+	hash_map(const hash_map &other);
+	hash_map &operator = (const hash_map &other);
+
+	static unsigned slot_hash(const K &key) { return TRAITS::hash(key)|USED_BIT; }
+
+	int find_slot(const K &key, unsigned hash) const
+	{
+		if(!capacity)
+			return -1;
+		for(int i = hash&(capacity-1); hashes[i]; i = (i+1)&(capacity-1))
+			if(hashes[i] == hash && TRAITS::equal(entries[i].key, key))
+				return i;
+		return -1;
+	}
+
+	void grow(int new_capacity)
+	{
+		unsigned *old_hashes = hashes;
+		entry *old_entries = entries;
+		int old_capacity = capacity;
+
+		capacity = new_capacity;
+		hashes = allocator_default<unsigned>::alloc_array(capacity);
+		entries = allocator_default<entry>::alloc_array(capacity);
+		mem_zero(hashes, sizeof(unsigned)*capacity);
+
+		for(int i = 0; i < old_capacity; i++)
+		{
+			if(!old_hashes[i])
+				continue;
+			int slot = old_hashes[i]&(capacity-1);
+			while(hashes[slot])
+				slot = (slot+1)&(capacity-1);
+			hashes[slot] = old_hashes[i];
+			entries[slot].key = tl_move(old_entries[i].key);
+			entries[slot].value = tl_move(old_entries[i].value);
+		}
+
+		allocator_default<unsigned>::free_array(old_hashes);
+		allocator_default<entry>::free_array(old_entries);
+	}
+
+public:
+	hash_map()
+	{
+		hashes = 0x0;
+		entries = 0x0;
+		capacity = 0;
+		num_entries = 0;
+	}
+
+	~hash_map()
+	{
+		allocator_default<unsigned>::free_array(hashes);
+		allocator_default<entry>::free_array(entries);
+	}
+
+	/*
+		Function: size
+			Number of entries.
+	*/
+	int size() const { return num_entries; }
+
+	/*
+		Function: clear
+			Removes all entries and gives the memory back.
+	*/
+	void clear()
+	{
+		allocator_default<unsigned>::free_array(hashes);
+		allocator_default<entry>::free_array(entries);
+		hashes = 0x0;
+		entries = 0x0;
+		capacity = 0;
+		num_entries = 0;
+	}
+
+	/*
+		Function: reserve
+			Makes room for the number of entries without growing.
+	*/
+	void reserve(int num)
+	{
+		int new_capacity = capacity ? capacity : (int)MIN_CAPACITY;
+		while(new_capacity/4*3 < num)
+			new_capacity *= 2;
+		if(new_capacity != capacity)
+			grow(new_capacity);
+	}
+
+	/*
+		Function: find
+			Returns the value stored for the key, 0 if there is none.
+	*/
+	V *find(const K &key)
+	{
+		int slot = find_slot(key, slot_hash(key));
+		return slot < 0 ? 0x0 : &entries[slot].value;
+	}
+
+	const V *find(const K &key) const
+	{
+		int slot = find_slot(key, slot_hash(key));
+		return slot < 0 ? 0x0 : &entries[slot].value;
+	}
+
+	/*
+		Function: set
+			Stores the value for the key, replacing the value that
+			was there. Returns where the value is stored.
+	*/
+	V *set(const K &key, const V &value)
+	{
+		unsigned hash = slot_hash(key);
+		int slot = find_slot(key, hash);
+		if(slot >= 0)
+		{
+			entries[slot].value = value;
+			return &entries[slot].value;
+		}
+
+		reserve(num_entries+1);
+		slot = hash&(capacity-1);
+		while(hashes[slot])
+			slot = (slot+1)&(capacity-1);
+		hashes[slot] = hash;
+		entries[slot].key = key;
+		entries[slot].value = value;
+		num_entries++;
+		return &entries[slot].value;
+	}
+
+	/*
+		Function: remove
+			Removes the entry of the key, returns false if there is none.
+	*/
+	bool remove(const K &key)
+	{
+		int hole = find_slot(key, slot_hash(key));
+		if(hole < 0)
+			return false;
+
+		// move back the entries that can't be found past the hole otherwise
+		for(int i = (hole+1)&(capacity-1); hashes[i]; i = (i+1)&(capacity-1))
+		{
+			int home = hashes[i]&(capacity-1);
+			bool reachable = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+			if(reachable)
+				continue;
+			hashes[hole] = hashes[i];
+			entries[hole].key = tl_move(entries[i].key);
+			entries[hole].value = tl_move(entries[i].value);
+			hole = i;
+		}
+
+		hashes[hole] = 0;
+		entries[hole].key = K();
+		entries[hole].value = V();
+		num_entries--;
+		return true;
+	}
+
+	/*
+		Function: first
+			Index of the first entry, -1 if there is none.
+	*/
+	int first() const { return next(-1); }
+
+	/*
+		Function: next
+			Index of the entry after the index, -1 if there is none.
+	*/
+	int next(int index) const
+	{
+		for(index++; index < capacity; index++)
+			if(hashes[index])
+				return index;
+		return -1;
+	}
+
+	const K &key(int index) const { return entries[index].key; }
+	V &value(int index) { return entries[index].value; }
+	const V &value(int index) const { return entries[index].value; }
+};
+
+/*
+	Class: string_hash_map
+		<hash_map> with string keys that keeps its own copies of the
+		keys in an arena. The copies are freed all at once by clear()
+		and the destructor, a removed key keeps its room until then.
+*/
+template <class V>
+class string_hash_map : public hash_map<const char *, V>
+{
+	typedef hash_map<const char *, V> parent;
+
+	enum
+	{
+		CHUNK_SIZE=16*1024,
+	};
+
+	struct chunk
+	{
+		chunk *next;
+		int used;
+		int size;
+	};
+
+	chunk *chunks;
+
+	// not copyable
+	string_hash_map(const string_hash_map &other);
+	string_hash_map &operator = (const string_hash_map &other);
+
+	const char *store(const char *key)
+	{
+		int length = str_length(key)+1;
+		if(!chunks || chunks->size-chunks->used < length)
+		{
+			int size = length > CHUNK_SIZE ? length : (int)CHUNK_SIZE;
+			chunk *new_chunk = (chunk *)mem_alloc(sizeof(chunk)+size, 1);
+			new_chunk->next = chunks;
+			new_chunk->used = 0;
+			new_chunk->size = size;
+			chunks = new_chunk;
+		}
+		char *copy = (char *)(chunks+1)+chunks->used;
+		mem_copy(copy, key, length);
+		chunks->used += length;
+		return copy;
+	}
+
+	void free_chunks()
+	{
+		while(chunks)
+		{
+			chunk *next = chunks->next;
+			mem_free(chunks);
+			chunks = next;
+		}
+	}
+
+public:
+	string_hash_map() : chunks(0x0) {}
+	~string_hash_map() { free_chunks(); }
+
+	void clear()
+	{
+		parent::clear();
+		free_chunks();
+	}
+
+	/*
+		Function: set
+			Stores the value for a copy of the key, see <hash_map::set>.
+	*/
+	V *set(const char *key, const V &value)
+	{
+		V *existing = parent::find(key);
+		if(existing)
+		{
+			*existing = value;
+			return existing;
+		}
+		return parent::set(store(key), value);
+	}
+};
+
+#endif // BASE_TL_HASH_MAP_H
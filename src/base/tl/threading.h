@@ -115,3 +115,156 @@ public:
 		var->release();
 	}
 };
+
+/*
+	spsc_queue - bounded lock-free ring queue for exactly one producer
+	thread and one consumer thread. Items are filled and consumed in
+	place to avoid copying big payloads around. SIZE has to be a power
+	of two.
+
+	producer: T *p = q.begin_push(); if(p) { fill *p; q.end_push(); }
+	consumer: T *p = q.front(); if(p) { use *p; q.pop(); }
+*/
+template<class T, unsigned SIZE>
+class spsc_queue
+{
+	T m_aItems[SIZE];
+	volatile unsigned m_Head; // next item to consume, only written by the consumer
+	volatile unsigned m_Tail; // next item to fill, only written by the producer
+
+public:
+	spsc_queue() : m_Head(0), m_Tail(0) {}
+
+	bool empty() const { return m_Head == m_Tail; }
+	bool full() const { return m_Tail-m_Head == SIZE; }
+	unsigned size() const { return m_Tail-m_Head; }
+	unsigned capacity() const { return SIZE; }
+
+	T *begin_push()
+	{
+		if(full())
+			return 0;
+		return &m_aItems[m_Tail%SIZE];
+	}
+
+	void end_push()
+	{
+		// make the item visible before publishing the new tail
+		sync_barrier();
+		m_Tail = m_Tail+1;
+	}
+
+	T *front()
+	{
+		if(empty())
+			return 0;
+		sync_barrier();
+		return &m_aItems[m_Head%SIZE];
+	}
+
+	void pop()
+	{
+		// done reading the item before handing the slot back
+		sync_barrier();
+		m_Head = m_Head+1;
+	}
+};
+
+/*
+	mpmc_queue - bounded lock-free ring queue for any number of producer
+	and consumer threads. Items are copied in and out. Every slot carries
+	a sequence number that tells whether it is free to fill or ready to
+	consume in the current round, so producers and consumers only
+	contend on their own position. SIZE has to be a power of two.
+
+	producer: if(!q.push(Item)) { full }
+	consumer: T Item; if(q.pop(&Item)) { use Item; }
+*/
+template<class T, unsigned SIZE>
+class mpmc_queue
+{
+	enum { CACHE_LINE_SIZE=64 };
+
+	struct CSlot
+	{
+		volatile unsigned m_Sequence;
+		T m_Item;
+	};
+
+	CSlot m_aSlots[SIZE];
+	char m_aPadding0[CACHE_LINE_SIZE];
+	volatile unsigned m_PushPos;
+	char m_aPadding1[CACHE_LINE_SIZE];
+	volatile unsigned m_PopPos;
+	char m_aPadding2[CACHE_LINE_SIZE];
+
+public:
+	mpmc_queue() : m_PushPos(0), m_PopPos(0)
+	{
+		for(unsigned i = 0; i < SIZE; i++)
+			m_aSlots[i].m_Sequence = i;
+	}
+
+	// only a snapshot while other threads are pushing or popping
+	unsigned size() const { return m_PushPos-m_PopPos; }
+	unsigned capacity() const { return SIZE; }
+
+	bool push(const T &Item)
+	{
+		unsigned Pos = m_PushPos;
+		while(1)
+		{
+			CSlot *pSlot = &m_aSlots[Pos%SIZE];
+			unsigned Sequence = pSlot->m_Sequence;
+			sync_barrier();
+			int Diff = (int)(Sequence-Pos);
+			if(Diff == 0)
+			{
+				// the slot is free, claim it by moving the position on
+				unsigned Prev = atomic_compswap(&m_PushPos, Pos, Pos+1);
+				if(Prev == Pos)
+				{
+					pSlot->m_Item = Item;
+					// make the item visible before handing the slot to the consumers
+					sync_barrier();
+					pSlot->m_Sequence = Pos+1;
+					return true;
+				}
+				Pos = Prev;
+			}
+			else if(Diff < 0)
+				return false; // the consumers haven't freed the slot of the last round yet
+			else
+				Pos = m_PushPos;
+		}
+	}
+
+	bool pop(T *pItem)
+	{
+		unsigned Pos = m_PopPos;
+		while(1)
+		{
+			CSlot *pSlot = &m_aSlots[Pos%SIZE];
+			unsigned Sequence = pSlot->m_Sequence;
+			sync_barrier();
+			int Diff = (int)(Sequence-(Pos+1));
+			if(Diff == 0)
+			{
+				unsigned Prev = atomic_compswap(&m_PopPos, Pos, Pos+1);
+				if(Prev == Pos)
+				{
+					*pItem = pSlot->m_Item;
+					// done reading the item before handing the slot back for the next round
+					sync_barrier();
+					pSlot->m_Sequence = Pos+SIZE;
+					return true;
+				}
+				Pos = Prev;
+			}
+			else if(Diff < 0)
+				return false; // nothing pushed into the slot yet
+			else
+				Pos = m_PopPos;
+		}
+	}
+};
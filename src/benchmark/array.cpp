@@ -0,0 +1,63 @@
+#include "benchmark.h"
+
+#include <base/tl/array.h>
+#include <base/tl/sorted_array.h>
+
+// the patterns of the editor and the localization database
+enum
+{
+	NUM=20000,
+	NUM_SORTED=5000,
+	NUM_NESTED=2000,
+};
+
+BENCHMARK(Array, AppendCopy)
+{
+	while(State.KeepRunning())
+	{
+		array<int> Array;
+		for(int i = 0; i < NUM; i++)
+			Array.add(i);
+		array<int> Copy = Array;
+		State.Consume(Copy[NUM-1]);
+	}
+}
+
+BENCHMARK(Array, InsertFront)
+{
+	while(State.KeepRunning())
+	{
+		array<int> Array;
+		for(int i = 0; i < NUM_SORTED; i++)
+			Array.insert(i, Array.all());
+		State.Consume(Array[0]);
+	}
+}
+
+BENCHMARK(Array, SortedAdd)
+{
+	while(State.KeepRunning())
+	{
+		sorted_array<unsigned> Array;
+		for(int i = 0; i < NUM_SORTED; i++)
+			Array.add((unsigned)i*2654435761u);
+		State.Consume(Array.size());
+	}
+}
+
+BENCHMARK(Array, Nested)
+{
+	array<int> Inner;
+	for(int i = 0; i < 64; i++)
+		Inner.add(i);
+
+	while(State.KeepRunning())
+	{
+		array<array<int> > Array;
+		for(int i = 0; i < NUM_NESTED; i++)
+			Array.add(Inner);
+		for(int i = 0; i < NUM_NESTED/4; i++)
+			Array.remove_index(0);
+		State.Consume(Array[0].size());
+	}
+}
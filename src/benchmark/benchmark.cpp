@@ -0,0 +1,158 @@
+#include "benchmark.h"
+
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/algorithm.h>
+#include <base/tl/array.h>
+#include <engine/shared/jsonwriter.h>
+
+#include <stdio.h>
+
+/*
+	usage: benchmarks [-f filter] [-t milliseconds] [-r repetitions] [-json file]
+
+	-f runs the benchmarks with the filter in their name
+	-t is the least time of one repetition, 200 by default
+	-r is the number of repetitions, 5 by default
+	-json also writes the results to the file, - for stdout
+*/
+
+CBenchmark *CBenchmark::ms_pFirst = 0;
+
+CBenchmark::CBenchmark(const char *pName, FBenchmark pfnRun)
+{
+	m_pName = pName;
+	m_pfnRun = pfnRun;
+	CBenchmark **ppNext = &ms_pFirst;
+	while(*ppNext && str_comp((*ppNext)->m_pName, pName) < 0)
+		ppNext = &(*ppNext)->m_pNext;
+	m_pNext = *ppNext;
+	*ppNext = this;
+}
+
+CBenchmarkState::CBenchmarkState(int64 Iterations)
+{
+	m_Iterations = Iterations;
+	m_Remaining = Iterations;
+	m_StartTime = 0;
+	m_Duration = 0;
+	m_BytesPerIteration = 0;
+	m_Sink = 0;
+}
+
+void BenchmarkFilename(char *pBuffer, int BufferSize, const char *pName)
+{
+	str_format(pBuffer, BufferSize, "benchmark.%s-%d.tmp", pName, pid());
+}
+
+static volatile unsigned s_Sink;
+
+static double NanosecondsPerIteration(const CBenchmarkState &State)
+{
+	return State.Duration()*1e9/time_freq()/State.Iterations();
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	const char *pFilter = "";
+	const char *pJsonFile = 0;
+	int MinTime = 200;
+	int Repetitions = 5;
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		if(str_comp(argv[i], "-f") == 0 && i+1 < argc) // ignore_convention
+			pFilter = argv[++i]; // ignore_convention
+		else if(str_comp(argv[i], "-t") == 0 && i+1 < argc) // ignore_convention
+			MinTime = max(1, str_toint(argv[++i])); // ignore_convention
+		else if(str_comp(argv[i], "-r") == 0 && i+1 < argc) // ignore_convention
+			Repetitions = max(1, str_toint(argv[++i])); // ignore_convention
+		else if(str_comp(argv[i], "-json") == 0 && i+1 < argc) // ignore_convention
+			pJsonFile = argv[++i]; // ignore_convention
+		else
+		{
+			printf("usage: benchmarks [-f filter] [-t milliseconds] [-r repetitions] [-json file]\n");
+			return -1;
+		}
+	}
+
+	CJsonWriter *pJson = 0;
+	if(pJsonFile)
+	{
+		IOHANDLE File = str_comp(pJsonFile, "-") == 0 ? io_stdout() : io_open(pJsonFile, IOFLAG_WRITE);
+		if(!File)
+		{
+			printf("could not open '%s'\n", pJsonFile);
+			return -1;
+		}
+		pJson = new CJsonWriter(File);
+		pJson->BeginObject();
+		pJson->WriteAttribute("repetitions");
+		pJson->WriteIntValue(Repetitions);
+		pJson->WriteAttribute("benchmarks");
+		pJson->BeginArray();
+	}
+
+	const int64 MinTicks = (int64)MinTime*time_freq()/1000;
+	for(CBenchmark *pBenchmark = CBenchmark::ms_pFirst; pBenchmark; pBenchmark = pBenchmark->m_pNext)
+	{
+		if(!str_find_nocase(pBenchmark->m_pName, pFilter))
+			continue;
+
+		// find an iteration count that takes long enough
+		int64 Iterations = 1;
+		while(true)
+		{
+			CBenchmarkState State(Iterations);
+			pBenchmark->m_pfnRun(State);
+			s_Sink += State.Sink();
+			if(State.Duration() >= MinTicks || Iterations >= ((int64)1<<40))
+				break;
+			int64 Estimate = State.Duration() > 0 ? Iterations*MinTicks/State.Duration()*6/5 : Iterations*10;
+			Iterations = clamp(Estimate, Iterations*2, Iterations*10);
+		}
+
+		array<double> lTimes;
+		int64 BytesPerIteration = 0;
+		for(int r = 0; r < Repetitions; r++)
+		{
+			CBenchmarkState State(Iterations);
+			pBenchmark->m_pfnRun(State);
+			s_Sink += State.Sink();
+			lTimes.add(NanosecondsPerIteration(State));
+			BytesPerIteration = State.BytesPerIteration();
+		}
+		sort(lTimes.all());
+		const double Median = lTimes[lTimes.size()/2];
+		const double Min = lTimes[0];
+
+		char aThroughput[64] = "";
+		if(BytesPerIteration)
+			str_format(aThroughput, sizeof(aThroughput), "%10.1f MB/s", BytesPerIteration*1000.0/Median);
+		printf("%-32s %12.0f ns %12.0f ns min %12lld iterations %s\n", pBenchmark->m_pName, Median, Min, (long long)Iterations, aThroughput);
+		fflush(stdout);
+
+		if(pJson)
+		{
+			pJson->BeginObject();
+			pJson->WriteAttribute("name");
+			pJson->WriteStrValue(pBenchmark->m_pName);
+			pJson->WriteAttribute("iterations");
+			pJson->WriteIntValue((int)min(Iterations, (int64)0x7fffffff));
+			pJson->WriteAttribute("median_ns");
+			pJson->WriteIntValue((int)(min(Median, 2e9)+0.5));
+			pJson->WriteAttribute("min_ns");
+			pJson->WriteIntValue((int)(min(Min, 2e9)+0.5));
+			pJson->WriteAttribute("bytes");
+			pJson->WriteIntValue((int)BytesPerIteration);
+			pJson->EndObject();
+		}
+	}
+
+	if(pJson)
+	{
+		pJson->EndArray();
+		pJson->EndObject();
+		delete pJson;
+	}
+	return 0;
+}
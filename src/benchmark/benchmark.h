@@ -0,0 +1,78 @@
+#ifndef BENCHMARK_BENCHMARK_H
+#define BENCHMARK_BENCHMARK_H
+#include <base/system.h>
+
+/*
+	Micro-benchmarks with fixed inputs. The setup of a benchmark runs
+	before the timed loop:
+
+	BENCHMARK(Group, Name)
+	{
+		... setup
+		while(State.KeepRunning())
+			... the measured operation
+	}
+
+	The runner calls a benchmark with more and more iterations until one
+	run takes long enough, then repeats it with that count and reports
+	the median and fastest time per iteration.
+*/
+class CBenchmarkState
+{
+	int64 m_Iterations;
+	int64 m_Remaining;
+	int64 m_StartTime;
+	int64 m_Duration;
+	int64 m_BytesPerIteration;
+	unsigned m_Sink;
+
+public:
+	CBenchmarkState(int64 Iterations);
+
+	bool KeepRunning()
+	{
+		if(m_Remaining == m_Iterations)
+			m_StartTime = time_get();
+		if(m_Remaining-- > 0)
+			return true;
+		m_Duration = time_get()-m_StartTime;
+		return false;
+	}
+
+	// the amount of data one iteration works on, reported as throughput
+	void SetBytesPerIteration(int64 Bytes) { m_BytesPerIteration = Bytes; }
+	// keeps results alive so the compiler can't drop the work
+	void Consume(unsigned Value) { m_Sink += Value; }
+
+	int64 Iterations() const { return m_Iterations; }
+	int64 Duration() const { return m_Duration; }
+	int64 BytesPerIteration() const { return m_BytesPerIteration; }
+	unsigned Sink() const { return m_Sink; }
+};
+
+typedef void (*FBenchmark)(CBenchmarkState &State);
+
+class CBenchmark
+{
+public:
+	const char *m_pName;
+	FBenchmark m_pfnRun;
+	CBenchmark *m_pNext;
+
+	// sorted by name, the order of the static constructors is not defined
+	static CBenchmark *ms_pFirst;
+
+	CBenchmark(const char *pName, FBenchmark pfnRun);
+};
+
+#define BENCHMARK(Group, Name) \
+	static void Benchmark##Group##Name(CBenchmarkState &State); \
+	static CBenchmark s_Benchmark##Group##Name(#Group "." #Name, Benchmark##Group##Name); \
+	static void Benchmark##Group##Name(CBenchmarkState &State)
+
+// temporary files of the benchmarks, in the working directory
+void BenchmarkFilename(char *pBuffer, int BufferSize, const char *pName);
+
+// a walled map with rows of platforms for the game benchmarks, 60x40 tiles
+void InitBenchmarkMap(class CCollision *pCollision);
+#endif
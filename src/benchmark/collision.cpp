@@ -0,0 +1,79 @@
+#include "benchmark.h"
+
+#include <base/math.h>
+#include <base/vmath.h>
+#include <game/collision.h>
+#include <game/mapitems.h>
+
+void InitBenchmarkMap(CCollision *pCollision)
+{
+	enum { WIDTH=60, HEIGHT=40 };
+	static CTile s_aTiles[WIDTH*HEIGHT];
+	mem_zero(s_aTiles, sizeof(s_aTiles));
+	for(int y = 0; y < HEIGHT; y++)
+		for(int x = 0; x < WIDTH; x++)
+		{
+			if(x == 0 || y == 0 || x == WIDTH-1 || y == HEIGHT-1 || (y%8 == 0 && x%12 < 6))
+				s_aTiles[y*WIDTH+x].m_Index = TILE_SOLID;
+			else if(y%8 == 4 && x%20 == 10)
+				s_aTiles[y*WIDTH+x].m_Index = TILE_DEATH;
+		}
+	pCollision->Init(s_aTiles, WIDTH, HEIGHT);
+}
+
+enum
+{
+	NUM_SHOTS=256,
+};
+
+static vec2 RandomPos(unsigned *pSeed)
+{
+	*pSeed = *pSeed*1103515245u+12345u;
+	float x = 32.0f + (*pSeed>>16)%(58*32);
+	*pSeed = *pSeed*1103515245u+12345u;
+	float y = 32.0f + (*pSeed>>16)%(38*32);
+	return vec2(x, y);
+}
+
+BENCHMARK(Collision, IntersectLine)
+{
+	// laser and hook sized lines
+	CCollision Collision;
+	InitBenchmarkMap(&Collision);
+	vec2 aFrom[NUM_SHOTS], aTo[NUM_SHOTS];
+	unsigned Seed = 1;
+	for(int i = 0; i < NUM_SHOTS; i++)
+	{
+		aFrom[i] = RandomPos(&Seed);
+		aTo[i] = aFrom[i] + normalize(RandomPos(&Seed)-aFrom[i])*800.0f;
+	}
+
+	vec2 Col, Before;
+	while(State.KeepRunning())
+		for(int i = 0; i < NUM_SHOTS; i++)
+			State.Consume(Collision.IntersectLine(aFrom[i], aTo[i], &Col, &Before));
+}
+
+BENCHMARK(Collision, MoveBox)
+{
+	// tee sized boxes at running and falling speeds
+	CCollision Collision;
+	InitBenchmarkMap(&Collision);
+	vec2 aPos[NUM_SHOTS], aVel[NUM_SHOTS];
+	unsigned Seed = 2;
+	for(int i = 0; i < NUM_SHOTS; i++)
+	{
+		aPos[i] = RandomPos(&Seed);
+		aVel[i] = (RandomPos(&Seed)-aPos[i])*0.02f;
+	}
+
+	while(State.KeepRunning())
+		for(int i = 0; i < NUM_SHOTS; i++)
+		{
+			vec2 Pos = aPos[i];
+			vec2 Vel = aVel[i];
+			bool Death;
+			Collision.MoveBox(&Pos, &Vel, vec2(28.0f, 28.0f), 0.0f, &Death);
+			State.Consume((unsigned)Pos.x+Death);
+		}
+}
@@ -0,0 +1,104 @@
+#include "benchmark.h"
+
+#include <engine/shared/compression.h>
+#include <engine/shared/huffman.h>
+#include <engine/shared/network.h>
+
+enum
+{
+	NUM_PACKETS=64,
+};
+
+// packets like the snapshot deltas of a busy server: packed ints, most of them unchanged
+static int BuildPackets(unsigned char aaPackets[NUM_PACKETS][NET_MAX_PAYLOAD], int *pSizes)
+{
+	unsigned Seed = 1;
+	int Total = 0;
+	for(int p = 0; p < NUM_PACKETS; p++)
+	{
+		int aFields[300];
+		int NumFields = 16+p*4;
+		for(int i = 0; i < NumFields; i++)
+		{
+			Seed = Seed*1103515245u+12345u;
+			unsigned Kind = (Seed>>16)%16;
+			aFields[i] = Kind < 10 ? 0 : Kind < 14 ? (int)((Seed>>8)%64)-32 : (int)(Seed>>4)-(1<<27);
+		}
+		pSizes[p] = CVariableInt::Compress(aFields, NumFields*sizeof(int), aaPackets[p], NET_MAX_PAYLOAD);
+		Total += pSizes[p];
+	}
+	return Total;
+}
+
+BENCHMARK(Huffman, Compress)
+{
+	static unsigned char s_aaPackets[NUM_PACKETS][NET_MAX_PAYLOAD];
+	int aSizes[NUM_PACKETS];
+	int Total = BuildPackets(s_aaPackets, aSizes);
+	CHuffman Huffman;
+	Huffman.Init();
+
+	unsigned char aOut[NET_MAX_PAYLOAD*2];
+	while(State.KeepRunning())
+		for(int p = 0; p < NUM_PACKETS; p++)
+			State.Consume(Huffman.Compress(s_aaPackets[p], aSizes[p], aOut, sizeof(aOut)));
+	State.SetBytesPerIteration(Total);
+}
+
+BENCHMARK(Huffman, Decompress)
+{
+	static unsigned char s_aaPackets[NUM_PACKETS][NET_MAX_PAYLOAD];
+	static unsigned char s_aaCompressed[NUM_PACKETS][NET_MAX_PAYLOAD*2];
+	int aSizes[NUM_PACKETS], aCompressedSizes[NUM_PACKETS];
+	int Total = BuildPackets(s_aaPackets, aSizes);
+	CHuffman Huffman;
+	Huffman.Init();
+	for(int p = 0; p < NUM_PACKETS; p++)
+		aCompressedSizes[p] = Huffman.Compress(s_aaPackets[p], aSizes[p], s_aaCompressed[p], sizeof(s_aaCompressed[p]));
+
+	unsigned char aOut[NET_MAX_PAYLOAD];
+	while(State.KeepRunning())
+		for(int p = 0; p < NUM_PACKETS; p++)
+			State.Consume(Huffman.Decompress(s_aaCompressed[p], aCompressedSizes[p], aOut, sizeof(aOut)));
+	State.SetBytesPerIteration(Total);
+}
+
+enum
+{
+	NUM_INTS=4096,
+};
+
+// delta fields: mostly zero or small, a few large ones
+static void FillInts(int *pInts)
+{
+	unsigned Seed = 1;
+	for(int i = 0; i < NUM_INTS; i++)
+	{
+		Seed = Seed*1103515245u+12345u;
+		unsigned Kind = (Seed>>16)%8;
+		pInts[i] = Kind < 4 ? 0 : Kind < 7 ? (int)((Seed>>8)%128)-64 : (int)(Seed>>4)-(1<<27);
+	}
+}
+
+BENCHMARK(VariableInt, Compress)
+{
+	static int s_aInts[NUM_INTS];
+	static unsigned char s_aPacked[NUM_INTS*5+8];
+	FillInts(s_aInts);
+
+	while(State.KeepRunning())
+		State.Consume(CVariableInt::Compress(s_aInts, sizeof(s_aInts), s_aPacked, sizeof(s_aPacked)));
+	State.SetBytesPerIteration(sizeof(s_aInts));
+}
+
+BENCHMARK(VariableInt, Decompress)
+{
+	static int s_aInts[NUM_INTS], s_aOut[NUM_INTS];
+	static unsigned char s_aPacked[NUM_INTS*5+8];
+	FillInts(s_aInts);
+	int Size = CVariableInt::Compress(s_aInts, sizeof(s_aInts), s_aPacked, sizeof(s_aPacked));
+
+	while(State.KeepRunning())
+		State.Consume(CVariableInt::Decompress(s_aPacked, Size, s_aOut, sizeof(s_aOut)));
+	State.SetBytesPerIteration(sizeof(s_aInts));
+}
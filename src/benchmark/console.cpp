@@ -0,0 +1,93 @@
+#include "benchmark.h"
+
+#include <engine/config.h>
+#include <engine/console.h>
+#include <engine/kernel.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+
+static void ConCount(IConsole::IResult *pResult, void *pUser)
+{
+	*(int *)pUser += pResult->NumArguments() ? pResult->GetInteger(pResult->NumArguments()-1) : 1;
+}
+
+// lines as they come from config files and the remote console
+BENCHMARK(Console, ExecuteLine)
+{
+	static const char *s_apLines[] = {
+		"bench_plain",
+		"bench_int 5",
+		"bench_string \"a name with spaces\" 3",
+		"bench_plain; bench_int 2; bench_int 3",
+		"BENCH_INT 7",
+		"bench_string name_without_spaces 1",
+		"# a comment",
+	};
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	int Count = 0;
+	pConsole->Register("bench_plain", "", CFGFLAG_SERVER, ConCount, &Count, "");
+	pConsole->Register("bench_int", "i[number]", CFGFLAG_SERVER, ConCount, &Count, "");
+	pConsole->Register("bench_string", "s[name] i[number]", CFGFLAG_SERVER, ConCount, &Count, "");
+
+	while(State.KeepRunning())
+		for(unsigned i = 0; i < sizeof(s_apLines)/sizeof(s_apLines[0]); i++)
+			pConsole->ExecuteLine(s_apLines[i]);
+	State.Consume(Count);
+	delete pConsole;
+}
+
+// a bind with a + command, pressed and released
+BENCHMARK(Console, ExecuteLineStroked)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_CLIENT);
+	int Count = 0;
+	pConsole->Register("+bench", "", CFGFLAG_CLIENT, ConCount, &Count, "");
+	pConsole->Register("bench_string", "s[name] i[number]", CFGFLAG_CLIENT, ConCount, &Count, "");
+
+	int Stroke = 0;
+	while(State.KeepRunning())
+		pConsole->ExecuteLineStroked(Stroke ^= 1, "+bench; bench_string \"some vote\" 3");
+	State.Consume(Count);
+	delete pConsole;
+}
+
+// a generated config setting the variables over and over, like vote lists at map change
+BENCHMARK(Console, ExecuteFile)
+{
+	enum { NUM_LINES=10000 };
+	IKernel *pKernel = IKernel::Create();
+	IStorage *pStorage = CreateTestStorage();
+	IConfigManager *pConfigManager = CreateConfigManager();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	pKernel->RegisterInterface(pStorage);
+	pKernel->RegisterInterface(pConfigManager);
+	pKernel->RegisterInterface(pConsole);
+	pConfigManager->Init(CFGFLAG_SERVER);
+	pConsole->Init();
+	int Count = 0;
+	pConsole->Register("bench_plain", "", CFGFLAG_SERVER, ConCount, &Count, "");
+
+	static const char *s_apLines[] = {"sv_name \"bench\"", "sv_max_clients 16", "sv_rcon_max_tries 3", "bench_plain", "sv_spamprotection 1"};
+	char aFilename[128];
+	BenchmarkFilename(aFilename, sizeof(aFilename), "console");
+	IOHANDLE File = pStorage->OpenFile(aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(File)
+	{
+		for(int i = 0; i < NUM_LINES; i++)
+		{
+			io_write(File, s_apLines[i%5], str_length(s_apLines[i%5]));
+			io_write_newline(File);
+		}
+		io_close(File);
+	}
+
+	while(State.KeepRunning())
+		pConsole->ExecuteFile(aFilename);
+	State.Consume(Count);
+
+	pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE);
+	delete pKernel;
+	delete pConsole;
+	delete pConfigManager;
+	delete pStorage;
+}
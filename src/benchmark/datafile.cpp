@@ -0,0 +1,49 @@
+#include "benchmark.h"
+
+#include <engine/shared/datafile.h>
+#include <engine/storage.h>
+
+// a map sized file: layers of tile data and many small items
+BENCHMARK(Datafile, Load)
+{
+	char aFilename[128];
+	BenchmarkFilename(aFilename, sizeof(aFilename), "datafile");
+	IStorage *pStorage = CreateTestStorage();
+
+	CDataFileWriter Writer;
+	if(!Writer.Open(pStorage, aFilename))
+	{
+		delete pStorage;
+		while(State.KeepRunning());
+		return;
+	}
+	static int s_aTiles[200*200];
+	for(unsigned i = 0; i < sizeof(s_aTiles)/sizeof(s_aTiles[0]); i++)
+		s_aTiles[i] = (i/7)%5 == 0 ? (int)(i%64) : 0;
+	int Size = 0;
+	for(int Layer = 0; Layer < 8; Layer++)
+	{
+		int aItem[4] = {Writer.AddData(sizeof(s_aTiles), s_aTiles), Layer, 200, 200};
+		Writer.AddItem(1, Layer, sizeof(aItem), aItem);
+		Size += sizeof(s_aTiles);
+	}
+	for(int i = 0; i < 500; i++)
+	{
+		int aItem[8] = {i, i*2, i*3, i*4, i*5, i*6, i*7, i*8};
+		Writer.AddItem(2, i, sizeof(aItem), aItem);
+	}
+	Writer.Finish();
+
+	while(State.KeepRunning())
+	{
+		CDataFileReader Reader;
+		Reader.Open(pStorage, aFilename, IStorage::TYPE_ALL);
+		for(int i = 0; i < Reader.NumData(); i++)
+			State.Consume(*(int *)Reader.GetData(i));
+		Reader.Close();
+	}
+	State.SetBytesPerIteration(Size);
+
+	pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE);
+	delete pStorage;
+}
@@ -0,0 +1,52 @@
+#include "benchmark.h"
+
+#include <game/collision.h>
+#include <game/gamecore.h>
+
+// one world tick of the characters as the server does it, with inputs that change now and then
+static void BenchmarkTick(CBenchmarkState &State, int NumPlayers)
+{
+	CCollision Collision;
+	InitBenchmarkMap(&Collision);
+	CWorldCore World;
+	static CCharacterCore s_aCores[MAX_CLIENTS];
+	for(int i = 0; i < NumPlayers; i++)
+	{
+		s_aCores[i].Init(&World, &Collision);
+		s_aCores[i].Reset();
+		s_aCores[i].m_Pos = vec2(100.0f + (i%16)*100.0f, 100.0f + (i/16)*250.0f);
+		World.m_apCharacters[i] = &s_aCores[i];
+	}
+
+	unsigned Seed = 1;
+	while(State.KeepRunning())
+	{
+		for(int i = 0; i < NumPlayers; i++)
+		{
+			Seed = Seed*1103515245u+12345u;
+			CNetObj_PlayerInput *pInput = &s_aCores[i].m_Input;
+			if((Seed>>16)%16 == 0)
+			{
+				pInput->m_Direction = (int)((Seed>>8)%3)-1;
+				pInput->m_Jump = (Seed>>12)%4 == 0;
+				pInput->m_Hook = (Seed>>20)%3 != 0;
+				pInput->m_TargetX = (int)((Seed>>4)%400)-200;
+				pInput->m_TargetY = (int)((Seed>>14)%400)-200;
+			}
+			s_aCores[i].Tick(true);
+		}
+		for(int i = 0; i < NumPlayers; i++)
+		{
+			s_aCores[i].AddDragVelocity();
+			s_aCores[i].ResetDragVelocity();
+			s_aCores[i].Move();
+			s_aCores[i].Quantize();
+		}
+	}
+	for(int i = 0; i < NumPlayers; i++)
+		State.Consume((unsigned)s_aCores[i].m_Pos.x);
+}
+
+BENCHMARK(GameCore, Tick08) { BenchmarkTick(State, 8); }
+BENCHMARK(GameCore, Tick16) { BenchmarkTick(State, 16); }
+BENCHMARK(GameCore, Tick64) { BenchmarkTick(State, 64); }
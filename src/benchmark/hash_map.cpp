@@ -0,0 +1,44 @@
+#include "benchmark.h"
+
+#include <base/tl/hash_map.h>
+
+enum
+{
+	NUM=50000,
+};
+
+static unsigned Key(int i) { return (unsigned)i*2654435761u; }
+
+BENCHMARK(HashMap, Set)
+{
+	while(State.KeepRunning())
+	{
+		hash_map<unsigned, int> Map;
+		for(int i = 0; i < NUM; i++)
+			Map.set(Key(i), i);
+		State.Consume(Map.size());
+	}
+}
+
+BENCHMARK(HashMap, Find)
+{
+	hash_map<unsigned, int> Map;
+	for(int i = 0; i < NUM; i++)
+		Map.set(Key(i), i);
+
+	while(State.KeepRunning())
+		for(int i = 0; i < NUM; i++)
+			State.Consume(Map.find(Key(i)) != 0);
+}
+
+BENCHMARK(HashMap, SetRemove)
+{
+	while(State.KeepRunning())
+	{
+		hash_map<unsigned, int> Map;
+		for(int i = 0; i < NUM; i++)
+			Map.set(Key(i), i);
+		for(int i = 0; i < NUM; i++)
+			State.Consume(Map.remove(Key(i)));
+	}
+}
@@ -0,0 +1,39 @@
+#include "benchmark.h"
+
+#include <engine/shared/linereader.h>
+
+// a ban list sized file
+BENCHMARK(LineReader, Get)
+{
+	enum { NUM_LINES=50000 };
+	char aFilename[128];
+	BenchmarkFilename(aFilename, sizeof(aFilename), "linereader");
+	IOHANDLE File = io_open(aFilename, IOFLAG_WRITE);
+	if(!File)
+	{
+		while(State.KeepRunning());
+		return;
+	}
+	int Size = 0;
+	char aLine[64];
+	for(int i = 0; i < NUM_LINES; i++)
+	{
+		str_format(aLine, sizeof(aLine), "ban 10.%d.%d.%d 60 spamming\n", (i>>16)&255, (i>>8)&255, i&255);
+		io_write(File, aLine, str_length(aLine));
+		Size += str_length(aLine);
+	}
+	io_close(File);
+
+	while(State.KeepRunning())
+	{
+		File = io_open(aFilename, IOFLAG_READ);
+		CLineReader Reader;
+		Reader.Init(File);
+		while(Reader.Get())
+			State.Consume(1);
+		io_close(File);
+	}
+	State.SetBytesPerIteration(Size);
+
+	fs_remove(aFilename);
+}
@@ -0,0 +1,133 @@
+#include "benchmark.h"
+
+#include <engine/shared/snapshot.h>
+#include <generated/protocol.h>
+
+// the snapshot of a full server, every character moved since the last one
+static int BuildSnapshot(CSnapshot *pSnap, int Tick)
+{
+	CSnapshotBuilder Builder;
+	Builder.Init();
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		CNetObj_PlayerInfo *pInfo = (CNetObj_PlayerInfo *)Builder.NewItem(NETOBJTYPE_PLAYERINFO, i, sizeof(CNetObj_PlayerInfo));
+		pInfo->m_PlayerFlags = PLAYERFLAG_READY;
+		pInfo->m_Score = i+Tick/50;
+		pInfo->m_Latency = 20+i%30;
+
+		CNetObj_Character *pChar = (CNetObj_Character *)Builder.NewItem(NETOBJTYPE_CHARACTER, i, sizeof(CNetObj_Character));
+		mem_zero(pChar, sizeof(*pChar));
+		pChar->m_Tick = Tick;
+		pChar->m_X = 100+i*40+Tick*(i%7);
+		pChar->m_Y = 500+(Tick*(i%5))%300;
+		pChar->m_VelX = (i%7)*256;
+		pChar->m_VelY = (i%5)*128-256;
+		pChar->m_Angle = (Tick*13+i*50)%628;
+		pChar->m_Direction = i%3-1;
+		pChar->m_HookState = i%4;
+		pChar->m_HookX = pChar->m_X+100;
+		pChar->m_HookY = pChar->m_Y-50;
+		pChar->m_Health = 10-i%10;
+		pChar->m_Armor = i%10;
+		pChar->m_AmmoCount = 10;
+		pChar->m_Weapon = i%NUM_WEAPONS;
+	}
+	for(int i = 0; i < 32; i++)
+	{
+		CNetObj_Projectile *pProj = (CNetObj_Projectile *)Builder.NewItem(NETOBJTYPE_PROJECTILE, (Tick+i)%64, sizeof(CNetObj_Projectile));
+		pProj->m_X = 300+i*50;
+		pProj->m_Y = 400;
+		pProj->m_VelX = 1000;
+		pProj->m_VelY = -200;
+		pProj->m_Type = WEAPON_GRENADE;
+		pProj->m_StartTick = Tick-i;
+	}
+	return Builder.Finish(pSnap);
+}
+
+static void InitDelta(CSnapshotDelta *pDelta)
+{
+	CNetObjHandler NetObjHandler;
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+		pDelta->SetStaticsize(i, NetObjHandler.GetObjSize(i));
+}
+
+BENCHMARK(Snapshot, CreateDelta)
+{
+	static char s_aFrom[CSnapshot::MAX_SIZE], s_aTo[CSnapshot::MAX_SIZE], s_aDelta[CSnapshot::MAX_SIZE];
+	BuildSnapshot((CSnapshot *)s_aFrom, 100);
+	int Size = BuildSnapshot((CSnapshot *)s_aTo, 101);
+	CSnapshotDelta Delta;
+	InitDelta(&Delta);
+
+	while(State.KeepRunning())
+		State.Consume(Delta.CreateDelta((CSnapshot *)s_aFrom, (CSnapshot *)s_aTo, s_aDelta));
+	State.SetBytesPerIteration(Size);
+}
+
+BENCHMARK(Snapshot, UnpackDelta)
+{
+	static char s_aFrom[CSnapshot::MAX_SIZE], s_aTo[CSnapshot::MAX_SIZE], s_aDelta[CSnapshot::MAX_SIZE];
+	BuildSnapshot((CSnapshot *)s_aFrom, 100);
+	int Size = BuildSnapshot((CSnapshot *)s_aTo, 101);
+	CSnapshotDelta Delta;
+	InitDelta(&Delta);
+	int DeltaSize = Delta.CreateDelta((CSnapshot *)s_aFrom, (CSnapshot *)s_aTo, s_aDelta);
+
+	while(State.KeepRunning())
+		State.Consume(Delta.UnpackDelta((CSnapshot *)s_aFrom, (CSnapshot *)s_aTo, s_aDelta, DeltaSize));
+	State.SetBytesPerIteration(Size);
+}
+
+// items about the size of a character, a third of the fields changed
+enum
+{
+	NUM_DIFF_ITEMS=256,
+	DIFF_ITEM_SIZE=22,
+};
+
+static void FillItems(int *pPast, int *pCurrent)
+{
+	unsigned Seed = 1;
+	for(int i = 0; i < NUM_DIFF_ITEMS*DIFF_ITEM_SIZE; i++)
+	{
+		Seed = Seed*1103515245u+12345u;
+		pPast[i] = (int)(Seed>>8)%4096-2048;
+		pCurrent[i] = pPast[i] + (i%3 ? 0 : (int)(Seed>>20)%64-32);
+	}
+}
+
+BENCHMARK(Snapshot, DiffItem)
+{
+	static int s_aPast[NUM_DIFF_ITEMS*DIFF_ITEM_SIZE], s_aCurrent[NUM_DIFF_ITEMS*DIFF_ITEM_SIZE], s_aOut[NUM_DIFF_ITEMS*DIFF_ITEM_SIZE];
+	FillItems(s_aPast, s_aCurrent);
+
+	while(State.KeepRunning())
+		for(int i = 0; i < NUM_DIFF_ITEMS; i++)
+			State.Consume(CSnapshotDelta::DiffItem(s_aPast+i*DIFF_ITEM_SIZE, s_aCurrent+i*DIFF_ITEM_SIZE, s_aOut+i*DIFF_ITEM_SIZE, DIFF_ITEM_SIZE));
+	State.SetBytesPerIteration(sizeof(s_aCurrent));
+}
+
+BENCHMARK(Snapshot, UndiffItem)
+{
+	static int s_aPast[NUM_DIFF_ITEMS*DIFF_ITEM_SIZE], s_aCurrent[NUM_DIFF_ITEMS*DIFF_ITEM_SIZE], s_aDiff[NUM_DIFF_ITEMS*DIFF_ITEM_SIZE];
+	static int s_aOut[NUM_DIFF_ITEMS*DIFF_ITEM_SIZE];
+	FillItems(s_aPast, s_aCurrent);
+	for(int i = 0; i < NUM_DIFF_ITEMS; i++)
+		CSnapshotDelta::DiffItem(s_aPast+i*DIFF_ITEM_SIZE, s_aCurrent+i*DIFF_ITEM_SIZE, s_aDiff+i*DIFF_ITEM_SIZE, DIFF_ITEM_SIZE);
+
+	while(State.KeepRunning())
+		for(int i = 0; i < NUM_DIFF_ITEMS; i++)
+			State.Consume(CSnapshotDelta::UndiffItem(s_aPast+i*DIFF_ITEM_SIZE, s_aDiff+i*DIFF_ITEM_SIZE, s_aOut+i*DIFF_ITEM_SIZE, DIFF_ITEM_SIZE));
+	State.SetBytesPerIteration(sizeof(s_aCurrent));
+}
+
+BENCHMARK(NetObj, ValidateSnap)
+{
+	static char s_aSnap[CSnapshot::MAX_SIZE];
+	BuildSnapshot((CSnapshot *)s_aSnap, 100);
+	int aInvalid[128];
+
+	while(State.KeepRunning())
+		State.Consume(CNetObjHandler::ValidateSnap((CSnapshot *)s_aSnap, aInvalid));
+}
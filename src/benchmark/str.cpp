@@ -0,0 +1,48 @@
+#include "benchmark.h"
+
+enum
+{
+	LENGTH=4096,
+};
+
+// chat lines and names, mostly ascii
+static void FillText(char *pText)
+{
+	for(int i = 0; i < LENGTH; i++)
+		pText[i] = "The quick brown fox jumps over the lazy dog. "[i%45];
+	pText[LENGTH] = 0;
+}
+
+BENCHMARK(Str, Sanitize)
+{
+	static char s_aText[LENGTH+1], s_aCopy[LENGTH+1];
+	FillText(s_aText);
+
+	while(State.KeepRunning())
+	{
+		mem_copy(s_aCopy, s_aText, sizeof(s_aCopy));
+		str_sanitize(s_aCopy);
+	}
+	State.Consume(s_aCopy[0]);
+	State.SetBytesPerIteration(LENGTH);
+}
+
+BENCHMARK(Str, Utf8Check)
+{
+	static char s_aText[LENGTH+1];
+	FillText(s_aText);
+
+	while(State.KeepRunning())
+		State.Consume(str_utf8_check(s_aText));
+	State.SetBytesPerIteration(LENGTH);
+}
+
+BENCHMARK(Str, FindNocase)
+{
+	static char s_aText[LENGTH+1];
+	FillText(s_aText);
+
+	while(State.KeepRunning())
+		State.Consume(str_find_nocase(s_aText, "Lazy Cat") == 0);
+	State.SetBytesPerIteration(LENGTH);
+}
@@ -0,0 +1,13 @@
+#include "benchmark.h"
+
+BENCHMARK(Time, Get)
+{
+	while(State.KeepRunning())
+		State.Consume((unsigned)time_get());
+}
+
+BENCHMARK(Time, GetCoarse)
+{
+	while(State.KeepRunning())
+		State.Consume((unsigned)time_get_coarse());
+}
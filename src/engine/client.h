@@ -28,6 +28,14 @@ protected:
 
 	float m_LocalTime;
 	float m_RenderFrameTime;
+	float m_QualityLevel;
+
+	// network timing the client adapted to the connection, in ms
+	int m_SnapMargin;
+	int m_SnapJitter;
+	int m_SnapLoss;
+	int m_PredMargin;
+	int m_PredJitter;
 
 	int m_GameTickSpeed;
 public:
@@ -74,13 +82,23 @@ public:
 
 	// other time access
 	inline float RenderFrameTime() const { return m_RenderFrameTime; }
+
+	// how much of the optional detail to draw, between 0.25 and 1
+	inline float QualityLevel() const { return m_QualityLevel; }
+
+	// interpolation buffer beyond one tick and the margin inputs are sent ahead with, in ms
+	inline int SnapMargin() const { return m_SnapMargin; }
+	inline int SnapJitter() const { return m_SnapJitter; }
+	inline int SnapLoss() const { return m_SnapLoss; } // percent
+	inline int PredMargin() const { return m_PredMargin; }
+	inline int PredJitter() const { return m_PredJitter; }
 	inline float LocalTime() const { return m_LocalTime; }
 
 	// actions
 	virtual void Connect(const char *pAddress) = 0;
 	virtual void Disconnect() = 0;
 	virtual void Quit() = 0;
-	virtual const char *DemoPlayer_Play(const char *pFilename, int StorageType) = 0;
+	virtual const char *DemoPlayer_Play(const char *pFilename, int StorageType, bool Live = false) = 0;
 	virtual void DemoRecorder_Start(const char *pFilename, bool WithTimestamp) = 0;
 	virtual void DemoRecorder_HandleAutoStart() = 0;
 	virtual void DemoRecorder_Stop() = 0;
@@ -133,10 +151,13 @@ public:
 	virtual const void *SnapFindItem(int SnapID, int Type, int ID) const = 0;
 	virtual const void *SnapGetItem(int SnapID, int Index, CSnapItem *pItem) const = 0;
 	virtual void SnapInvalidateItem(int SnapID, int Index) = 0;
+	// the snapshot that the items above are read from, 0 if there is none
+	virtual const class CSnapshot *SnapGetSnapshot(int SnapID) const = 0;
 
 	virtual void *SnapNewItem(int Type, int ID, int Size) = 0;
 
 	virtual void SnapSetStaticsize(int ItemType, int Size) = 0;
+	virtual void SnapSetFieldBits(int ItemType, const unsigned char *pBits, int Num) = 0;
 
 	virtual int SendMsg(CMsgPacker *pMsg, int Flags) = 0;
 
@@ -168,7 +189,8 @@ public:
 	virtual void OnRconLine(const char *pLine) = 0;
 	virtual void OnInit() = 0;
 	virtual void OnNewSnapshot() = 0;
-	virtual void OnDemoRecSnap() = 0;
+	// adds the demo items with SnapNewItem, only needed when they changed or Full is set
+	virtual void OnDemoRecSnap(bool Full) = 0;
 	virtual void OnEnterGame() = 0;
 	virtual void OnShutdown() = 0;
 	virtual void OnRender() = 0;
@@ -4,6 +4,9 @@
 
 #include <base/tl/threading.h>
 
+#include <engine/shared/threadtopology.h>
+#include <engine/shared/tracer.h>
+
 #include "graphics_threaded.h"
 #include "backend_sdl.h"
 
@@ -25,26 +28,34 @@
 void CGraphicsBackend_Threaded::ThreadFunc(void *pUser)
 {
 	CGraphicsBackend_Threaded *pThis = (CGraphicsBackend_Threaded *)pUser;
+	CThreadTopology::Enter(CThreadTopology::CLASS_BACKEND, "graphics");
 
 	while(!pThis->m_Shutdown)
 	{
 		pThis->m_Activity.wait();
-		if(pThis->m_pBuffer)
+		if(pThis->m_QueueStart != pThis->m_QueueEnd)
 		{
 			#ifdef CONF_PLATFORM_MACOSX
 				CAutoreleasePool AutoreleasePool;
 			#endif
-			pThis->m_pProcessor->RunBuffer(pThis->m_pBuffer);
+			{
+				CTraceScope TraceScope("RunBuffer");
+				pThis->m_pProcessor->RunBuffer(pThis->m_apQueue[pThis->m_QueueStart%MAX_QUEUE]);
+			}
 			sync_barrier();
-			pThis->m_pBuffer = 0x0;
+			pThis->m_QueueStart++;
 			pThis->m_BufferDone.signal();
 		}
 	}
+
+	CThreadTopology::Leave();
 }
 
 CGraphicsBackend_Threaded::CGraphicsBackend_Threaded()
 {
-	m_pBuffer = 0x0;
+	m_QueueStart = 0;
+	m_QueueEnd = 0;
+	m_MaxPending = 1;
 	m_pProcessor = 0x0;
 	m_pThread = 0x0;
 }
@@ -67,20 +78,37 @@ void CGraphicsBackend_Threaded::StopProcessor()
 
 void CGraphicsBackend_Threaded::RunBuffer(CCommandBuffer *pBuffer)
 {
-	WaitForIdle();
-	m_pBuffer = pBuffer;
+	WaitForPending(m_MaxPending-1);
+	m_apQueue[m_QueueEnd%MAX_QUEUE] = pBuffer;
+	sync_barrier();
+	m_QueueEnd++;
 	m_Activity.signal();
 }
 
+void CGraphicsBackend_Threaded::SetMaxPending(int Num)
+{
+	m_MaxPending = clamp(Num, 1, (int)MAX_QUEUE);
+}
+
+int CGraphicsBackend_Threaded::NumPending() const
+{
+	return m_QueueEnd - m_QueueStart;
+}
+
+void CGraphicsBackend_Threaded::WaitForPending(int Num)
+{
+	while(NumPending() > Num)
+		m_BufferDone.wait();
+}
+
 bool CGraphicsBackend_Threaded::IsIdle() const
 {
-	return m_pBuffer == 0x0;
+	return NumPending() == 0;
 }
 
 void CGraphicsBackend_Threaded::WaitForIdle()
 {
-	while(m_pBuffer != 0x0)
-		m_BufferDone.wait();
+	WaitForPending(0);
 }
 
 
@@ -105,14 +133,49 @@ bool CCommandProcessorFragment_General::RunCommand(const CCommandBuffer::CComman
 
 // ------------ CCommandProcessorFragment_OpenGL
 
-int CCommandProcessorFragment_OpenGL::TexFormatToOpenGLFormat(int TexFormat)
+int CCommandProcessorFragment_OpenGL::TexFormatToOpenGLFormat(int TexFormat) const
 {
 	if(TexFormat == CCommandBuffer::TEXFORMAT_RGB) return GL_RGB;
-	if(TexFormat == CCommandBuffer::TEXFORMAT_ALPHA) return GL_ALPHA;
+	if(TexFormat == CCommandBuffer::TEXFORMAT_ALPHA) return m_CoreProfile ? GL_RED : GL_ALPHA;
 	if(TexFormat == CCommandBuffer::TEXFORMAT_RGBA) return GL_RGBA;
 	return GL_RGBA;
 }
 
+bool CCommandProcessorFragment_OpenGL::HasExtension(const char *pExtensions, const char *pName)
+{
+	if(!pExtensions)
+		return false;
+	int Length = str_length(pName);
+	for(const char *pFound = str_find(pExtensions, pName); pFound; pFound = str_find(pFound+Length, pName))
+	{
+		if((pFound == pExtensions || pFound[-1] == ' ') && (pFound[Length] == ' ' || pFound[Length] == 0))
+			return true;
+	}
+	return false;
+}
+
+int CCommandProcessorFragment_OpenGL::CompressedFormat(int StoreOglformat, bool S3TC) const
+{
+	// pick a fixed block format when possible, the generic ones leave the choice (and the quality) to the driver
+	switch(StoreOglformat)
+	{
+		case GL_RGB: return S3TC && m_TextureCompressionS3TC ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_ARB;
+		case GL_ALPHA: return GL_COMPRESSED_ALPHA_ARB;
+		case GL_RED: return GL_COMPRESSED_RED;
+		default: return S3TC && m_TextureCompressionS3TC ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_ARB;
+	}
+}
+
+void CCommandProcessorFragment_OpenGL::SetAlphaSwizzle(GLenum Target, int TexFormat) const
+{
+	// alpha textures are stored in the red channel, read them like GL_ALPHA did
+	if(m_CoreProfile && TexFormat == CCommandBuffer::TEXFORMAT_ALPHA)
+	{
+		const GLint aSwizzle[4] = {GL_ONE, GL_ONE, GL_ONE, GL_RED};
+		glTexParameteriv(Target, GL_TEXTURE_SWIZZLE_RGBA, aSwizzle);
+	}
+}
+
 unsigned char CCommandProcessorFragment_OpenGL::Sample(int w, int h, const unsigned char *pData, int u, int v, int Offset, int ScaleW, int ScaleH, int Bpp)
 {
 	int Sum = 0;
@@ -131,7 +194,7 @@ void *CCommandProcessorFragment_OpenGL::Rescale(int Width, int Height, int NewWi
 	if(Format == CCommandBuffer::TEXFORMAT_RGBA)
 		Bpp = 4;
 
-	unsigned char *pTmpData = (unsigned char *)mem_alloc(NewWidth*NewHeight*Bpp, 1);
+	unsigned char *pTmpData = (unsigned char *)mem_alloc_tag(NewWidth*NewHeight*Bpp, 1, MEMTAG_GRAPHICS);
 
 	for(int y = 0; y < NewHeight; y++)
 		for(int x = 0; x < NewWidth; x++)
@@ -141,7 +204,7 @@ void *CCommandProcessorFragment_OpenGL::Rescale(int Width, int Height, int NewWi
 	return pTmpData;
 }
 
-void CCommandProcessorFragment_OpenGL::SetState(const CCommandBuffer::CState &State)
+int CCommandProcessorFragment_OpenGL::ApplyState(const CCommandBuffer::CState &State)
 {
 	// clip
 	if(State.m_ClipEnable)
@@ -155,19 +218,18 @@ void CCommandProcessorFragment_OpenGL::SetState(const CCommandBuffer::CState &St
 
 	// texture
 	int SrcBlendMode = GL_ONE;
-	glDisable(GL_TEXTURE_2D);
-	glDisable(GL_TEXTURE_3D);
+	int Dimension = 0;
 	if(State.m_Texture >= 0 && State.m_Texture < CCommandBuffer::MAX_TEXTURES)
 	{
 		if(State.m_Dimension == 2 && (m_aTextures[State.m_Texture].m_State&CTexture::STATE_TEX2D))
 		{
-			glEnable(GL_TEXTURE_2D);
 			glBindTexture(GL_TEXTURE_2D, m_aTextures[State.m_Texture].m_Tex2D);
+			Dimension = 2;
 		}
 		else if(State.m_Dimension == 3 && (m_aTextures[State.m_Texture].m_State&CTexture::STATE_TEX3D))
 		{
-			glEnable(GL_TEXTURE_3D);
 			glBindTexture(GL_TEXTURE_3D, m_aTextures[State.m_Texture].m_Tex3D[State.m_TextureArrayIndex]);
+			Dimension = 3;
 		}
 		else
 			dbg_msg("render", "invalid texture %d %d %d\n", State.m_Texture, State.m_Dimension, m_aTextures[State.m_Texture].m_State);
@@ -230,12 +292,205 @@ void CCommandProcessorFragment_OpenGL::SetState(const CCommandBuffer::CState &St
 		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
 	}
 
+	return Dimension;
+}
+
+void CCommandProcessorFragment_OpenGL::SetState(const CCommandBuffer::CState &State)
+{
+	int Dimension = ApplyState(State);
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_TEXTURE_3D);
+	if(Dimension == 2)
+		glEnable(GL_TEXTURE_2D);
+	else if(Dimension == 3)
+		glEnable(GL_TEXTURE_3D);
+
 	// screen mapping
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	glOrtho(State.m_ScreenTL.x, State.m_ScreenBR.x, State.m_ScreenBR.y, State.m_ScreenTL.y, -1.0f, 1.0f);
 }
 
+// the tile under the fragment is looked up in the index texture, flips and
+// rotation are applied to the position inside of the tile
+static const char *s_pTilemapVertexShader =
+	"uniform float u_Scale;\n"
+	"varying vec2 v_Tile;\n"
+	"void main()\n"
+	"{\n"
+	"	v_Tile = gl_Vertex.xy / u_Scale;\n"
+	"	gl_FrontColor = gl_Color;\n"
+	"	gl_Position = ftransform();\n"
+	"}\n";
+
+static const char *s_pTilemapFragmentShader =
+	"uniform sampler3D u_Tileset;\n"
+	"uniform sampler2D u_Indices;\n"
+	"uniform vec2 u_Size;\n"
+	"uniform bool u_Textured;\n"
+	"varying vec2 v_Tile;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 Tile = clamp(floor(v_Tile), vec2(0.0), u_Size-1.0);\n"
+	"	vec4 Data = texture2D(u_Indices, (Tile+0.5)/u_Size);\n"
+	"	float Index = floor(Data.r*255.0+0.5);\n"
+	"	if(Index == 0.0)\n"
+	"		discard;\n"
+	"	vec2 Local = v_Tile - floor(v_Tile);\n"
+	"	if(Data.a > 0.5)\n"
+	"		Local = vec2(Local.y, 1.0-Local.x);\n"
+	"	if(Data.g > 0.5)\n"
+	"		Local.x = 1.0-Local.x;\n"
+	"	if(Data.b > 0.5)\n"
+	"		Local.y = 1.0-Local.y;\n"
+	"	vec4 Color = gl_Color;\n"
+	"	if(u_Textured)\n"
+	"		Color *= texture3D(u_Tileset, vec3(Local, (Index+0.5)/256.0));\n"
+	"	gl_FragColor = Color;\n"
+	"}\n";
+
+GLuint CCommandProcessorFragment_OpenGL::CompileShader(GLenum Type, const char *pHeader, const char *pSource)
+{
+	// the header carries the version and defines, the version has to come first
+	const char *apSources[2] = {pHeader, pSource};
+	GLuint Shader = m_pfnCreateShader(Type);
+	m_pfnShaderSource(Shader, 2, apSources, 0);
+	m_pfnCompileShader(Shader);
+
+	GLint Compiled = 0;
+	m_pfnGetShaderiv(Shader, GL_COMPILE_STATUS, &Compiled);
+	if(!Compiled)
+	{
+		char aLog[512];
+		m_pfnGetShaderInfoLog(Shader, sizeof(aLog), 0, aLog);
+		dbg_msg("render", "failed to compile shader: %s", aLog);
+		m_pfnDeleteShader(Shader);
+		return 0;
+	}
+	return Shader;
+}
+
+bool CCommandProcessorFragment_OpenGL::LoadShaderFunctions()
+{
+	m_pfnActiveTexture = (PFNGLACTIVETEXTUREPROC)SDL_GL_GetProcAddress("glActiveTexture");
+	m_pfnCreateShader = (PFNGLCREATESHADERPROC)SDL_GL_GetProcAddress("glCreateShader");
+	m_pfnShaderSource = (PFNGLSHADERSOURCEPROC)SDL_GL_GetProcAddress("glShaderSource");
+	m_pfnCompileShader = (PFNGLCOMPILESHADERPROC)SDL_GL_GetProcAddress("glCompileShader");
+	m_pfnGetShaderiv = (PFNGLGETSHADERIVPROC)SDL_GL_GetProcAddress("glGetShaderiv");
+	m_pfnGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)SDL_GL_GetProcAddress("glGetShaderInfoLog");
+	m_pfnDeleteShader = (PFNGLDELETESHADERPROC)SDL_GL_GetProcAddress("glDeleteShader");
+	m_pfnCreateProgram = (PFNGLCREATEPROGRAMPROC)SDL_GL_GetProcAddress("glCreateProgram");
+	m_pfnAttachShader = (PFNGLATTACHSHADERPROC)SDL_GL_GetProcAddress("glAttachShader");
+	m_pfnLinkProgram = (PFNGLLINKPROGRAMPROC)SDL_GL_GetProcAddress("glLinkProgram");
+	m_pfnGetProgramiv = (PFNGLGETPROGRAMIVPROC)SDL_GL_GetProcAddress("glGetProgramiv");
+	m_pfnUseProgram = (PFNGLUSEPROGRAMPROC)SDL_GL_GetProcAddress("glUseProgram");
+	m_pfnGetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)SDL_GL_GetProcAddress("glGetUniformLocation");
+	m_pfnUniform1i = (PFNGLUNIFORM1IPROC)SDL_GL_GetProcAddress("glUniform1i");
+	m_pfnUniform1f = (PFNGLUNIFORM1FPROC)SDL_GL_GetProcAddress("glUniform1f");
+	m_pfnUniform2f = (PFNGLUNIFORM2FPROC)SDL_GL_GetProcAddress("glUniform2f");
+	if(!m_pfnActiveTexture || !m_pfnCreateShader || !m_pfnShaderSource || !m_pfnCompileShader || !m_pfnGetShaderiv ||
+		!m_pfnGetShaderInfoLog || !m_pfnDeleteShader || !m_pfnCreateProgram || !m_pfnAttachShader || !m_pfnLinkProgram ||
+		!m_pfnGetProgramiv || !m_pfnUseProgram || !m_pfnGetUniformLocation || !m_pfnUniform1i || !m_pfnUniform1f || !m_pfnUniform2f)
+		return false;
+	return true;
+}
+
+GLuint CCommandProcessorFragment_OpenGL::CreateProgram(const char *pHeader, const char *pVertexSource, const char *pFragmentSource)
+{
+	GLuint VertexShader = CompileShader(GL_VERTEX_SHADER, pHeader, pVertexSource);
+	GLuint FragmentShader = CompileShader(GL_FRAGMENT_SHADER, pHeader, pFragmentSource);
+	if(!VertexShader || !FragmentShader)
+	{
+		if(VertexShader)
+			m_pfnDeleteShader(VertexShader);
+		if(FragmentShader)
+			m_pfnDeleteShader(FragmentShader);
+		return 0;
+	}
+
+	// the shaders are freed together with the program
+	GLuint Program = m_pfnCreateProgram();
+	m_pfnAttachShader(Program, VertexShader);
+	m_pfnAttachShader(Program, FragmentShader);
+	m_pfnLinkProgram(Program);
+	m_pfnDeleteShader(VertexShader);
+	m_pfnDeleteShader(FragmentShader);
+
+	GLint Linked = 0;
+	m_pfnGetProgramiv(Program, GL_LINK_STATUS, &Linked);
+	if(!Linked)
+	{
+		dbg_msg("render", "failed to link a shader program");
+		return 0;
+	}
+	return Program;
+}
+
+bool CCommandProcessorFragment_OpenGL::InitTilemapShader()
+{
+	if(!LoadShaderFunctions())
+		return false;
+
+	m_TilemapProgram = CreateProgram("", s_pTilemapVertexShader, s_pTilemapFragmentShader);
+	if(!m_TilemapProgram)
+		return false;
+
+	m_TilemapScaleLocation = m_pfnGetUniformLocation(m_TilemapProgram, "u_Scale");
+	m_TilemapSizeLocation = m_pfnGetUniformLocation(m_TilemapProgram, "u_Size");
+	m_TilemapTexturedLocation = m_pfnGetUniformLocation(m_TilemapProgram, "u_Textured");
+	m_pfnUseProgram(m_TilemapProgram);
+	m_pfnUniform1i(m_pfnGetUniformLocation(m_TilemapProgram, "u_Tileset"), 0);
+	m_pfnUniform1i(m_pfnGetUniformLocation(m_TilemapProgram, "u_Indices"), 1);
+	m_pfnUseProgram(0);
+	return true;
+}
+
+bool CCommandProcessorFragment_OpenGL::LoadFramebufferFunctions()
+{
+	m_pfnGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)SDL_GL_GetProcAddress("glGenFramebuffers");
+	m_pfnDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteFramebuffers");
+	m_pfnBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)SDL_GL_GetProcAddress("glBindFramebuffer");
+	m_pfnFramebufferTexture2D = (PFNGLFRAMEBUFFERTEXTURE2DPROC)SDL_GL_GetProcAddress("glFramebufferTexture2D");
+	m_pfnCheckFramebufferStatus = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)SDL_GL_GetProcAddress("glCheckFramebufferStatus");
+	return m_pfnGenFramebuffers && m_pfnDeleteFramebuffers && m_pfnBindFramebuffer && m_pfnFramebufferTexture2D && m_pfnCheckFramebufferStatus;
+}
+
+bool CCommandProcessorFragment_OpenGL::InitGpuTimers()
+{
+	PFNGLDELETEQUERIESPROC pfnDeleteQueries = (PFNGLDELETEQUERIESPROC)SDL_GL_GetProcAddress("glDeleteQueries");
+	m_pfnGenQueries = (PFNGLGENQUERIESPROC)SDL_GL_GetProcAddress("glGenQueries");
+	m_pfnQueryCounter = (PFNGLQUERYCOUNTERPROC)SDL_GL_GetProcAddress("glQueryCounter");
+	m_pfnGetQueryObjectiv = (PFNGLGETQUERYOBJECTIVPROC)SDL_GL_GetProcAddress("glGetQueryObjectiv");
+	m_pfnGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)SDL_GL_GetProcAddress("glGetQueryObjectui64v");
+	m_pfnGetInteger64v = (PFNGLGETINTEGER64VPROC)SDL_GL_GetProcAddress("glGetInteger64v");
+	if(!pfnDeleteQueries || !m_pfnGenQueries || !m_pfnQueryCounter || !m_pfnGetQueryObjectiv || !m_pfnGetQueryObjectui64v || !m_pfnGetInteger64v)
+		return false;
+
+	for(int i = 0; i < GPU_TIMER_FRAMES; i++)
+	{
+		m_pfnGenQueries(GPU_TIMER_MARKS, m_aGpuTimerFrames[i].m_aQueries);
+		m_aGpuTimerFrames[i].m_NumMarks = 0;
+		m_aGpuTimerFrames[i].m_Pending = false;
+	}
+	m_GpuTimerFrame = -1;
+	m_NextGpuTimerFrame = 0;
+	return true;
+}
+
+void CCommandProcessorFragment_OpenGL::InitTextureSizes(const CInitCommand *pCommand)
+{
+	m_pTextureMemoryUsage = pCommand->m_pTextureMemoryUsage;
+	*m_pTextureMemoryUsage = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &m_MaxTexSize);
+	glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &m_Max3DTexSize);
+	dbg_msg("render", "opengl max texture sizes: %d, %d(3D)", m_MaxTexSize, m_Max3DTexSize);
+	if(m_Max3DTexSize < IGraphics::NUMTILES_DIMENSION * IGraphics::NUMTILES_DIMENSION)
+		dbg_msg("render", "*** warning *** max 3D texture size is too low - using the fallback system");
+	m_TextureArraySize = IGraphics::NUMTILES_DIMENSION * IGraphics::NUMTILES_DIMENSION / min(m_Max3DTexSize, IGraphics::NUMTILES_DIMENSION * IGraphics::NUMTILES_DIMENSION);
+	*pCommand->m_pTextureArraySize = m_TextureArraySize;
+	*pCommand->m_pMaxTextureSize = m_MaxTexSize;
+}
+
 void CCommandProcessorFragment_OpenGL::Cmd_Init(const CInitCommand *pCommand)
 {
 	// set some default settings
@@ -249,15 +504,62 @@ void CCommandProcessorFragment_OpenGL::Cmd_Init(const CInitCommand *pCommand)
 	glEnable(GL_ALPHA_TEST);
 	glDepthMask(0);
 
-	m_pTextureMemoryUsage = pCommand->m_pTextureMemoryUsage;
-	*m_pTextureMemoryUsage = 0;
-	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &m_MaxTexSize);
-	glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &m_Max3DTexSize);
-	dbg_msg("render", "opengl max texture sizes: %d, %d(3D)", m_MaxTexSize, m_Max3DTexSize);
-	if(m_Max3DTexSize < IGraphics::NUMTILES_DIMENSION * IGraphics::NUMTILES_DIMENSION)
-		dbg_msg("render", "*** warning *** max 3D texture size is too low - using the fallback system");
-	m_TextureArraySize = IGraphics::NUMTILES_DIMENSION * IGraphics::NUMTILES_DIMENSION / min(m_Max3DTexSize, IGraphics::NUMTILES_DIMENSION * IGraphics::NUMTILES_DIMENSION);
-	*pCommand->m_pTextureArraySize = m_TextureArraySize;
+	InitTextureSizes(pCommand);
+
+	int Major = 0, Minor = 0;
+	const char *pVersion = (const char *)glGetString(GL_VERSION);
+	if(pVersion)
+	{
+		Major = str_toint(pVersion);
+		const char *pMinor = str_find(pVersion, ".");
+		Minor = pMinor ? str_toint(pMinor+1) : 0;
+	}
+	m_pfnGenBuffers = 0;
+	m_pfnDeleteBuffers = 0;
+	m_pfnBindBuffer = 0;
+	m_pfnBufferData = 0;
+	if(Major > 1 || (Major == 1 && Minor >= 5))
+	{
+		m_pfnGenBuffers = (PFNGLGENBUFFERSPROC)SDL_GL_GetProcAddress("glGenBuffers");
+		m_pfnDeleteBuffers = (PFNGLDELETEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteBuffers");
+		m_pfnBindBuffer = (PFNGLBINDBUFFERPROC)SDL_GL_GetProcAddress("glBindBuffer");
+		m_pfnBufferData = (PFNGLBUFFERDATAPROC)SDL_GL_GetProcAddress("glBufferData");
+	}
+	*pCommand->m_pVertexBuffers = m_pfnGenBuffers && m_pfnDeleteBuffers && m_pfnBindBuffer && m_pfnBufferData;
+
+	const char *pExtensions = (const char *)glGetString(GL_EXTENSIONS);
+	m_pfnGenerateMipmap = 0;
+	if(Major >= 3 || HasExtension(pExtensions, "GL_ARB_framebuffer_object"))
+		m_pfnGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)SDL_GL_GetProcAddress("glGenerateMipmap");
+	else if(HasExtension(pExtensions, "GL_EXT_framebuffer_object"))
+		m_pfnGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)SDL_GL_GetProcAddress("glGenerateMipmapEXT");
+	m_TextureCompressionS3TC = HasExtension(pExtensions, "GL_EXT_texture_compression_s3tc");
+	if(!*pCommand->m_pVertexBuffers)
+		dbg_msg("render", "vertex buffers are not supported - static geometry is streamed every frame");
+
+	// pixel buffer objects are core since OpenGL 2.1
+	m_pfnMapBuffer = 0;
+	m_pfnUnmapBuffer = 0;
+	if(*pCommand->m_pVertexBuffers && (Major > 2 || (Major == 2 && Minor >= 1) || HasExtension(pExtensions, "GL_ARB_pixel_buffer_object")))
+	{
+		m_pfnMapBuffer = (PFNGLMAPBUFFERPROC)SDL_GL_GetProcAddress("glMapBuffer");
+		m_pfnUnmapBuffer = (PFNGLUNMAPBUFFERPROC)SDL_GL_GetProcAddress("glUnmapBuffer");
+	}
+	m_PixelBuffers = m_pfnMapBuffer && m_pfnUnmapBuffer;
+	if(!m_PixelBuffers)
+		dbg_msg("render", "pixel buffers are not supported - screenshots wait for the gpu");
+
+	m_TilemapProgram = 0;
+	*pCommand->m_pTilemapShader = Major >= 2 && InitTilemapShader();
+	*pCommand->m_pRenderTargets = (Major >= 3 || HasExtension(pExtensions, "GL_ARB_framebuffer_object")) && LoadFramebufferFunctions();
+	if(!*pCommand->m_pRenderTargets)
+		dbg_msg("render", "framebuffer objects are not supported - no render targets");
+
+	m_pGpuTimesLock = pCommand->m_pGpuTimesLock;
+	m_pGpuTimes = pCommand->m_pGpuTimes;
+	*pCommand->m_pGpuTimers = (Major > 3 || (Major == 3 && Minor >= 3) || HasExtension(pExtensions, "GL_ARB_timer_query")) && InitGpuTimers();
+	if(!*pCommand->m_pGpuTimers)
+		dbg_msg("render", "timer queries are not supported - no gpu times");
 
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 }
@@ -269,6 +571,8 @@ void CCommandProcessorFragment_OpenGL::Cmd_Texture_Update(const CCommandBuffer::
 		glBindTexture(GL_TEXTURE_2D, m_aTextures[pCommand->m_Slot].m_Tex2D);
 		glTexSubImage2D(GL_TEXTURE_2D, 0, pCommand->m_X, pCommand->m_Y, pCommand->m_Width, pCommand->m_Height,
 			TexFormatToOpenGLFormat(pCommand->m_Format), GL_UNSIGNED_BYTE, pCommand->m_pData);
+		if(m_aTextures[pCommand->m_Slot].m_GenerateMipmaps)
+			m_pfnGenerateMipmap(GL_TEXTURE_2D);
 	}
 	mem_free(pCommand->m_pData);
 }
@@ -279,9 +583,15 @@ void CCommandProcessorFragment_OpenGL::Cmd_Texture_Destroy(const CCommandBuffer:
 		glDeleteTextures(1, &m_aTextures[pCommand->m_Slot].m_Tex2D);
 	if(m_aTextures[pCommand->m_Slot].m_State&CTexture::STATE_TEX3D)
 		glDeleteTextures(m_TextureArraySize, m_aTextures[pCommand->m_Slot].m_Tex3D);
+	if(m_aTextures[pCommand->m_Slot].m_Fbo)
+	{
+		m_pfnDeleteFramebuffers(1, &m_aTextures[pCommand->m_Slot].m_Fbo);
+		m_aTextures[pCommand->m_Slot].m_Fbo = 0;
+	}
 	*m_pTextureMemoryUsage -= m_aTextures[pCommand->m_Slot].m_MemSize;
 	m_aTextures[pCommand->m_Slot].m_State = CTexture::STATE_EMPTY;
 	m_aTextures[pCommand->m_Slot].m_MemSize = 0;
+	m_aTextures[pCommand->m_Slot].m_GenerateMipmaps = false;
 }
 
 void CCommandProcessorFragment_OpenGL::Cmd_Texture_Create(const CCommandBuffer::CTextureCreateCommand *pCommand)
@@ -290,6 +600,50 @@ void CCommandProcessorFragment_OpenGL::Cmd_Texture_Create(const CCommandBuffer::
 	int Height = pCommand->m_Height;
 	void *pTexData = pCommand->m_pData;
 
+	// tile indices are looked up by the tilemap shader and have to stay exact
+	if(pCommand->m_Flags&CCommandBuffer::TEXFLAG_TILEINDICES)
+	{
+		glGenTextures(1, &m_aTextures[pCommand->m_Slot].m_Tex2D);
+		m_aTextures[pCommand->m_Slot].m_State |= CTexture::STATE_TEX2D;
+		m_aTextures[pCommand->m_Slot].m_Format = pCommand->m_Format;
+		glBindTexture(GL_TEXTURE_2D, m_aTextures[pCommand->m_Slot].m_Tex2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pTexData);
+		m_aTextures[pCommand->m_Slot].m_MemSize = Width*Height*pCommand->m_PixelSize;
+		*m_pTextureMemoryUsage += m_aTextures[pCommand->m_Slot].m_MemSize;
+		mem_free(pTexData);
+		return;
+	}
+
+	// render targets get a framebuffer with the texture as color buffer
+	if(pCommand->m_Flags&CCommandBuffer::TEXFLAG_RENDERTARGET)
+	{
+		CTexture *pTexture = &m_aTextures[pCommand->m_Slot];
+		glGenTextures(1, &pTexture->m_Tex2D);
+		pTexture->m_State |= CTexture::STATE_TEX2D;
+		pTexture->m_Format = CCommandBuffer::TEXFORMAT_RGBA;
+		pTexture->m_Width = Width;
+		pTexture->m_Height = Height;
+		glBindTexture(GL_TEXTURE_2D, pTexture->m_Tex2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+		m_pfnGenFramebuffers(1, &pTexture->m_Fbo);
+		m_pfnBindFramebuffer(GL_FRAMEBUFFER, pTexture->m_Fbo);
+		m_pfnFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pTexture->m_Tex2D, 0);
+		if(m_pfnCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			dbg_msg("render", "render target %d is incomplete", pCommand->m_Slot);
+		m_pfnBindFramebuffer(GL_FRAMEBUFFER, m_RenderTarget >= 0 ? m_aTextures[m_RenderTarget].m_Fbo : 0);
+
+		pTexture->m_MemSize = Width*Height*4;
+		*m_pTextureMemoryUsage += pTexture->m_MemSize;
+		return;
+	}
+
 	// resample if needed
 	if(pCommand->m_Format == CCommandBuffer::TEXFORMAT_RGBA || pCommand->m_Format == CCommandBuffer::TEXFORMAT_RGB)
 	{
@@ -343,29 +697,29 @@ void CCommandProcessorFragment_OpenGL::Cmd_Texture_Create(const CCommandBuffer::
 	int Oglformat = TexFormatToOpenGLFormat(pCommand->m_Format);
 	int StoreOglformat = TexFormatToOpenGLFormat(pCommand->m_StoreFormat);
 
-	if(pCommand->m_Flags&CCommandBuffer::TEXFLAG_COMPRESSED)
-	{
-		switch(StoreOglformat)
-		{
-			case GL_RGB: StoreOglformat = GL_COMPRESSED_RGB_ARB; break;
-			case GL_ALPHA: StoreOglformat = GL_COMPRESSED_ALPHA_ARB; break;
-			case GL_RGBA: StoreOglformat = GL_COMPRESSED_RGBA_ARB; break;
-			default: StoreOglformat = GL_COMPRESSED_RGBA_ARB;
-		}
-	}
+	// s3tc only covers 2D textures, 3D ones keep the generic formats
+	bool Compressed = pCommand->m_Flags&CCommandBuffer::TEXFLAG_COMPRESSED;
+	int Store2DOglformat = Compressed ? CompressedFormat(StoreOglformat, true) : StoreOglformat;
+	if(Compressed)
+		StoreOglformat = CompressedFormat(StoreOglformat, false);
 
 	// 2D texture
 	if(pCommand->m_Flags&CCommandBuffer::TEXFLAG_TEXTURE2D)
 	{
-		bool Mipmaps = !(pCommand->m_Flags&CCommandBuffer::TEXFLAG_NOMIPMAPS);
+		// glGenerateMipmap does not accept compressed formats, those are left to the driver on upload.
+		// the core profile has no driver generated mipmaps, compressed textures go without there
+		bool Mipmaps = !(pCommand->m_Flags&CCommandBuffer::TEXFLAG_NOMIPMAPS) && !(m_CoreProfile && Compressed);
+		bool GenerateMipmaps = Mipmaps && m_pfnGenerateMipmap && !Compressed;
 		glGenTextures(1, &m_aTextures[pCommand->m_Slot].m_Tex2D);
 		m_aTextures[pCommand->m_Slot].m_State |= CTexture::STATE_TEX2D;
+		m_aTextures[pCommand->m_Slot].m_GenerateMipmaps = GenerateMipmaps;
 		glBindTexture(GL_TEXTURE_2D, m_aTextures[pCommand->m_Slot].m_Tex2D);
+		SetAlphaSwizzle(GL_TEXTURE_2D, pCommand->m_StoreFormat);
 		if(!Mipmaps)
 		{
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexImage2D(GL_TEXTURE_2D, 0, StoreOglformat, Width, Height, 0, Oglformat, GL_UNSIGNED_BYTE, pTexData);
+			glTexImage2D(GL_TEXTURE_2D, 0, Store2DOglformat, Width, Height, 0, Oglformat, GL_UNSIGNED_BYTE, pTexData);
 		}
 		else
 		{
@@ -374,12 +728,23 @@ void CCommandProcessorFragment_OpenGL::Cmd_Texture_Create(const CCommandBuffer::
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			else
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-			glTexImage2D(GL_TEXTURE_2D, 0, StoreOglformat, Width, Height, 0, Oglformat, GL_UNSIGNED_BYTE, pTexData);
+			if(!GenerateMipmaps)
+				glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+			glTexImage2D(GL_TEXTURE_2D, 0, Store2DOglformat, Width, Height, 0, Oglformat, GL_UNSIGNED_BYTE, pTexData);
+			if(GenerateMipmaps)
+				m_pfnGenerateMipmap(GL_TEXTURE_2D);
 		}
 
-		// calculate memory usage
-		m_aTextures[pCommand->m_Slot].m_MemSize = Width*Height*pCommand->m_PixelSize;
+		// calculate memory usage, compressed textures report their real size
+		int LevelSize = Width*Height*pCommand->m_PixelSize;
+		if(Compressed)
+		{
+			GLint IsCompressed = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_ARB, &IsCompressed);
+			if(IsCompressed)
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE_ARB, &LevelSize);
+		}
+		m_aTextures[pCommand->m_Slot].m_MemSize = LevelSize;
 		if(Mipmaps)
 		{
 			int TexWidth = Width;
@@ -388,7 +753,8 @@ void CCommandProcessorFragment_OpenGL::Cmd_Texture_Create(const CCommandBuffer::
 			{
 				TexWidth>>=1;
 				TexHeight>>=1;
-				m_aTextures[pCommand->m_Slot].m_MemSize += TexWidth*TexHeight*pCommand->m_PixelSize;
+				LevelSize>>=2;
+				m_aTextures[pCommand->m_Slot].m_MemSize += LevelSize;
 			}
 		}
 	}
@@ -402,7 +768,7 @@ void CCommandProcessorFragment_OpenGL::Cmd_Texture_Create(const CCommandBuffer::
 
 		// copy and reorder texture data
 		int MemSize = Width*Height*IGraphics::NUMTILES_DIMENSION*IGraphics::NUMTILES_DIMENSION*pCommand->m_PixelSize;
-		char *pTmpData = (char *)mem_alloc(MemSize, sizeof(void*));
+		char *pTmpData = (char *)mem_alloc_tag(MemSize, sizeof(void*), MEMTAG_GRAPHICS);
 
 		const int TileSize = (Height * Width) * pCommand->m_PixelSize;
 		const int TileRowSize = Width * pCommand->m_PixelSize;
@@ -425,6 +791,7 @@ void CCommandProcessorFragment_OpenGL::Cmd_Texture_Create(const CCommandBuffer::
 		for(int i = 0; i < m_TextureArraySize; ++i)
 		{
 			glBindTexture(GL_TEXTURE_3D, m_aTextures[pCommand->m_Slot].m_Tex3D[i]);
+			SetAlphaSwizzle(GL_TEXTURE_3D, pCommand->m_StoreFormat);
 			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			pTexData = pTmpData+i*(Width*Height*Depth*pCommand->m_PixelSize);
@@ -446,30 +813,161 @@ void CCommandProcessorFragment_OpenGL::Cmd_Clear(const CCommandBuffer::CClearCom
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
-void CCommandProcessorFragment_OpenGL::Cmd_Render(const CCommandBuffer::CRenderCommand *pCommand)
+void CCommandProcessorFragment_OpenGL::RenderVertices(const CCommandBuffer::CVertex *pVertices, int PrimType, int PrimCount)
 {
-	SetState(pCommand->m_State);
-
-	glVertexPointer(2, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)pCommand->m_pVertices);
-	glTexCoordPointer(3, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)pCommand->m_pVertices + sizeof(float)*2);
-	glColorPointer(4, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)pCommand->m_pVertices + sizeof(float)*5);
+	glVertexPointer(2, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)pVertices);
+	glTexCoordPointer(3, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)pVertices + sizeof(float)*2);
+	glColorPointer(4, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)pVertices + sizeof(float)*5);
 	glEnableClientState(GL_VERTEX_ARRAY);
 	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 	glEnableClientState(GL_COLOR_ARRAY);
 
-	switch(pCommand->m_PrimType)
+	switch(PrimType)
 	{
 	case CCommandBuffer::PRIMTYPE_QUADS:
-		glDrawArrays(GL_QUADS, 0, pCommand->m_PrimCount*4);
+		glDrawArrays(GL_QUADS, 0, PrimCount*4);
 		break;
 	case CCommandBuffer::PRIMTYPE_LINES:
-		glDrawArrays(GL_LINES, 0, pCommand->m_PrimCount*2);
+		glDrawArrays(GL_LINES, 0, PrimCount*2);
 		break;
 	default:
-		dbg_msg("render", "unknown primtype %d\n", pCommand->m_Cmd);
+		dbg_msg("render", "unknown primtype %d\n", PrimType);
 	};
 }
 
+void CCommandProcessorFragment_OpenGL::Cmd_Render(const CCommandBuffer::CRenderCommand *pCommand)
+{
+	SetState(pCommand->m_State);
+	RenderVertices(pCommand->m_pVertices, pCommand->m_PrimType, pCommand->m_PrimCount);
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_Buffer_Create(const CCommandBuffer::CBufferCreateCommand *pCommand)
+{
+	m_pfnGenBuffers(1, &m_aBuffers[pCommand->m_Slot]);
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, m_aBuffers[pCommand->m_Slot]);
+	m_pfnBufferData(GL_ARRAY_BUFFER, sizeof(CCommandBuffer::CBufferVertex)*pCommand->m_NumVertices, pCommand->m_pVertices, GL_STATIC_DRAW);
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, 0);
+	mem_free(pCommand->m_pVertices);
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_Buffer_Destroy(const CCommandBuffer::CBufferDestroyCommand *pCommand)
+{
+	m_pfnDeleteBuffers(1, &m_aBuffers[pCommand->m_Slot]);
+	m_aBuffers[pCommand->m_Slot] = 0;
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_RenderBuffer(const CCommandBuffer::CRenderBufferCommand *pCommand)
+{
+	SetState(pCommand->m_State);
+
+	// the pointers are offsets into the bound buffer, the color is the same for all vertices
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, m_aBuffers[pCommand->m_Slot]);
+	glVertexPointer(2, GL_FLOAT, sizeof(CCommandBuffer::CBufferVertex), (char*)0);
+	glTexCoordPointer(3, GL_FLOAT, sizeof(CCommandBuffer::CBufferVertex), (char*)0 + sizeof(float)*2);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glColor4f(pCommand->m_Color.r, pCommand->m_Color.g, pCommand->m_Color.b, pCommand->m_Color.a);
+
+	glDrawArrays(GL_QUADS, pCommand->m_FirstQuad*4, pCommand->m_NumQuads*4);
+
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_RenderTilemap(const CCommandBuffer::CRenderTilemapCommand *pCommand)
+{
+	SetState(pCommand->m_State);
+
+	m_pfnActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, m_aTextures[pCommand->m_IndicesSlot].m_Tex2D);
+	m_pfnActiveTexture(GL_TEXTURE0);
+
+	m_pfnUseProgram(m_TilemapProgram);
+	m_pfnUniform1f(m_TilemapScaleLocation, pCommand->m_Scale);
+	m_pfnUniform2f(m_TilemapSizeLocation, (float)pCommand->m_Width, (float)pCommand->m_Height);
+	m_pfnUniform1i(m_TilemapTexturedLocation, pCommand->m_State.m_Texture >= 0 ? 1 : 0);
+
+	const float aVertices[] = {
+		pCommand->m_TopLeft.x, pCommand->m_TopLeft.y,
+		pCommand->m_BottomRight.x, pCommand->m_TopLeft.y,
+		pCommand->m_BottomRight.x, pCommand->m_BottomRight.y,
+		pCommand->m_TopLeft.x, pCommand->m_BottomRight.y,
+	};
+	glVertexPointer(2, GL_FLOAT, 0, aVertices);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glColor4f(pCommand->m_Color.r, pCommand->m_Color.g, pCommand->m_Color.b, pCommand->m_Color.a);
+	glDrawArrays(GL_QUADS, 0, 4);
+
+	m_pfnUseProgram(0);
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_RenderInstances(const CCommandBuffer::CRenderInstancesCommand *pCommand)
+{
+	unsigned NumVertices = pCommand->m_NumInstances*4;
+	if(NumVertices > m_MaxInstanceVertices)
+	{
+		mem_free(m_pInstanceVertices);
+		m_MaxInstanceVertices = NumVertices;
+		m_pInstanceVertices = (CCommandBuffer::CVertex *)mem_alloc_tag(sizeof(CCommandBuffer::CVertex)*m_MaxInstanceVertices, 1, MEMTAG_GRAPHICS);
+	}
+
+	// corners clockwise from the top left, relative to the center
+	static const float s_aCornerX[4] = {-0.5f, 0.5f, 0.5f, -0.5f};
+	static const float s_aCornerY[4] = {-0.5f, -0.5f, 0.5f, 0.5f};
+	static const int s_aCornerU[4] = {0, 2, 2, 0};
+	static const int s_aCornerV[4] = {1, 1, 3, 3};
+
+	CCommandBuffer::CVertex *pVertex = m_pInstanceVertices;
+	for(unsigned i = 0; i < pCommand->m_NumInstances; i++)
+	{
+		const IGraphics::CQuadInstance *pInstance = &pCommand->m_pInstances[i];
+		float c = 1.0f, s = 0.0f;
+		if(pInstance->m_Rotation != 0)
+		{
+			c = cosf(pInstance->m_Rotation);
+			s = sinf(pInstance->m_Rotation);
+		}
+		for(int k = 0; k < 4; k++, pVertex++)
+		{
+			float x = s_aCornerX[k]*pInstance->m_Width;
+			float y = s_aCornerY[k]*pInstance->m_Height;
+			pVertex->m_Pos.x = pInstance->m_X + x*c - y*s;
+			pVertex->m_Pos.y = pInstance->m_Y + x*s + y*c;
+			pVertex->m_Tex.u = pInstance->m_aTexCoords[s_aCornerU[k]];
+			pVertex->m_Tex.v = pInstance->m_aTexCoords[s_aCornerV[k]];
+			pVertex->m_Tex.i = pCommand->m_TexLayer;
+			pVertex->m_Color.r = pInstance->m_R;
+			pVertex->m_Color.g = pInstance->m_G;
+			pVertex->m_Color.b = pInstance->m_B;
+			pVertex->m_Color.a = pInstance->m_A;
+		}
+	}
+
+	SetState(pCommand->m_State);
+	RenderVertices(m_pInstanceVertices, CCommandBuffer::PRIMTYPE_QUADS, pCommand->m_NumInstances);
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_RenderTarget(const CCommandBuffer::CRenderTargetCommand *pCommand)
+{
+	// the viewport of the screen is kept for when drawing returns to it
+	if(pCommand->m_Slot >= 0 && m_aTextures[pCommand->m_Slot].m_Fbo)
+	{
+		if(m_RenderTarget < 0)
+			glGetIntegerv(GL_VIEWPORT, m_aScreenViewport);
+		m_RenderTarget = pCommand->m_Slot;
+		m_pfnBindFramebuffer(GL_FRAMEBUFFER, m_aTextures[m_RenderTarget].m_Fbo);
+		glViewport(0, 0, m_aTextures[m_RenderTarget].m_Width, m_aTextures[m_RenderTarget].m_Height);
+	}
+	else if(m_RenderTarget >= 0)
+	{
+		m_RenderTarget = -1;
+		m_pfnBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(m_aScreenViewport[0], m_aScreenViewport[1], m_aScreenViewport[2], m_aScreenViewport[3]);
+	}
+}
+
 void CCommandProcessorFragment_OpenGL::Cmd_Screenshot(const CCommandBuffer::CScreenshotCommand *pCommand)
 {
 	// fetch image data
@@ -482,7 +980,7 @@ void CCommandProcessorFragment_OpenGL::Cmd_Screenshot(const CCommandBuffer::CScr
 	int y = aViewport[3] - pCommand->m_Y - 1 - (h - 1);
 
 	// we allocate one more row to use when we are flipping the texture
-	unsigned char *pPixelData = (unsigned char *)mem_alloc(w*(h+1)*3, 1);
+	unsigned char *pPixelData = (unsigned char *)mem_alloc_tag(w*(h+1)*3, 1, MEMTAG_GRAPHICS);
 	unsigned char *pTempRow = pPixelData+w*h*3;
 
 	// fetch the pixels
@@ -507,10 +1005,182 @@ void CCommandProcessorFragment_OpenGL::Cmd_Screenshot(const CCommandBuffer::CScr
 	pCommand->m_pImage->m_pData = pPixelData;
 }
 
+void CCommandProcessorFragment_OpenGL::Cmd_Readback(const CCommandBuffer::CReadbackCommand *pCommand)
+{
+	CReadback *pReadback = &m_aReadbacks[pCommand->m_Slot];
+	GLint aViewport[4] = {0,0,0,0};
+	glGetIntegerv(GL_VIEWPORT, aViewport);
+	pReadback->m_Width = aViewport[2];
+	pReadback->m_Height = aViewport[3];
+	unsigned Size = pReadback->m_Width*pReadback->m_Height*4;
+
+	// rgba rows are always aligned, reading rgba avoids a conversion in the driver
+	if(m_PixelBuffers)
+	{
+		if(!pReadback->m_Pbo)
+			m_pfnGenBuffers(1, &pReadback->m_Pbo);
+		m_pfnBindBuffer(GL_PIXEL_PACK_BUFFER, pReadback->m_Pbo);
+		if(pReadback->m_PboSize != Size)
+		{
+			m_pfnBufferData(GL_PIXEL_PACK_BUFFER, Size, 0, GL_STREAM_READ);
+			pReadback->m_PboSize = Size;
+		}
+		glReadPixels(aViewport[0], aViewport[1], pReadback->m_Width, pReadback->m_Height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		m_pfnBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	else
+	{
+		mem_free(pReadback->m_pData);
+		pReadback->m_pData = (unsigned char *)mem_alloc_tag(Size, 1, MEMTAG_GRAPHICS);
+		glReadPixels(aViewport[0], aViewport[1], pReadback->m_Width, pReadback->m_Height, GL_RGBA, GL_UNSIGNED_BYTE, pReadback->m_pData);
+	}
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_ReadbackFinish(const CCommandBuffer::CReadbackFinishCommand *pCommand)
+{
+	CReadback *pReadback = &m_aReadbacks[pCommand->m_Slot];
+	CImageInfo *pImage = pCommand->m_pImage;
+	pImage->m_Width = pReadback->m_Width;
+	pImage->m_Height = pReadback->m_Height;
+	pImage->m_Format = CImageInfo::FORMAT_RGBA;
+	pImage->m_pData = 0;
+
+	if(m_PixelBuffers)
+	{
+		m_pfnBindBuffer(GL_PIXEL_PACK_BUFFER, pReadback->m_Pbo);
+		const void *pPixels = m_pfnMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if(pPixels)
+		{
+			pImage->m_pData = mem_alloc_tag(pReadback->m_PboSize, 1, MEMTAG_GRAPHICS);
+			mem_copy(pImage->m_pData, pPixels, pReadback->m_PboSize);
+			m_pfnUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		m_pfnBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	else
+	{
+		pImage->m_pData = pReadback->m_pData;
+		pReadback->m_pData = 0;
+	}
+
+	// the main thread reads the image once it sees the flag
+	sync_barrier();
+	*pCommand->m_pDone = 1;
+}
+
+static const char *gs_apGpuGroupNames[IGraphics::NUM_GPU_GROUPS] = {"GpuOther", "GpuMap", "GpuPlayers", "GpuHud"};
+
+bool CCommandProcessorFragment_OpenGL::ResolveGpuTimerFrame(CGpuTimerFrame *pFrame)
+{
+	// the last query finishes last
+	GLint Available = 0;
+	m_pfnGetQueryObjectiv(pFrame->m_aQueries[pFrame->m_NumMarks-1], GL_QUERY_RESULT_AVAILABLE, &Available);
+	if(!Available)
+		return false;
+
+	GLuint64 aTimes[GPU_TIMER_MARKS];
+	for(int i = 0; i < pFrame->m_NumMarks; i++)
+		m_pfnGetQueryObjectui64v(pFrame->m_aQueries[i], GL_QUERY_RESULT, &aTimes[i]);
+	pFrame->m_Pending = false;
+
+	// nanoseconds to microseconds
+	IGraphics::CGpuTimes Times;
+	mem_zero(&Times, sizeof(Times));
+	Times.m_Frame = (int)((aTimes[pFrame->m_NumMarks-1]-aTimes[0])/1000);
+	for(int i = 0; i < pFrame->m_NumMarks-1; i++)
+		Times.m_aGroups[pFrame->m_aGroups[i]] += (int)((aTimes[i+1]-aTimes[i])/1000);
+	{
+		scope_lock Lock(m_pGpuTimesLock);
+		Times.m_NumFrames = m_pGpuTimes->m_NumFrames+1;
+		*m_pGpuTimes = Times;
+	}
+
+	if(CTracer::IsRecording())
+	{
+		if(!m_pGpuTrack)
+			m_pGpuTrack = CTracer::Track("gpu");
+
+		// the gpu clock runs apart from time_get(), line them up at the current time
+		GLint64 GpuNow = 0;
+		m_pfnGetInteger64v(GL_TIMESTAMP, &GpuNow);
+		const int64 Now = time_get();
+		const int64 Freq = time_freq();
+		int64 aCpuTimes[GPU_TIMER_MARKS];
+		for(int i = 0; i < pFrame->m_NumMarks; i++)
+			aCpuTimes[i] = Now - (GpuNow-(int64)aTimes[i])*Freq/1000000000;
+
+		CTracer::BeginAt(m_pGpuTrack, "GpuFrame", aCpuTimes[0]);
+		for(int i = 0; i < pFrame->m_NumMarks-1; i++)
+		{
+			CTracer::BeginAt(m_pGpuTrack, gs_apGpuGroupNames[pFrame->m_aGroups[i]], aCpuTimes[i]);
+			CTracer::EndAt(m_pGpuTrack, gs_apGpuGroupNames[pFrame->m_aGroups[i]], aCpuTimes[i+1]);
+		}
+		CTracer::EndAt(m_pGpuTrack, "GpuFrame", aCpuTimes[pFrame->m_NumMarks-1]);
+	}
+	return true;
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_GpuTimer(const CCommandBuffer::CGpuTimerCommand *pCommand)
+{
+	if(pCommand->m_Group == CCommandBuffer::GPU_TIMER_END_FRAME)
+	{
+		if(m_GpuTimerFrame < 0)
+			return;
+		CGpuTimerFrame *pFrame = &m_aGpuTimerFrames[m_GpuTimerFrame];
+		m_pfnQueryCounter(pFrame->m_aQueries[pFrame->m_NumMarks++], GL_TIMESTAMP);
+		pFrame->m_Pending = true;
+		m_GpuTimerFrame = -1;
+
+		// read back what the gpu finished, oldest frame first
+		for(int i = 0; i < GPU_TIMER_FRAMES; i++)
+		{
+			CGpuTimerFrame *pOldFrame = &m_aGpuTimerFrames[(m_NextGpuTimerFrame+i)%GPU_TIMER_FRAMES];
+			if(pOldFrame->m_Pending && !ResolveGpuTimerFrame(pOldFrame))
+				break;
+		}
+		return;
+	}
+
+	if(m_GpuTimerFrame < 0)
+	{
+		// waiting for the results of the oldest frame would stall, drop them instead
+		m_GpuTimerFrame = m_NextGpuTimerFrame;
+		m_NextGpuTimerFrame = (m_NextGpuTimerFrame+1)%GPU_TIMER_FRAMES;
+		m_aGpuTimerFrames[m_GpuTimerFrame].m_Pending = false;
+		m_aGpuTimerFrames[m_GpuTimerFrame].m_NumMarks = 0;
+	}
+
+	// keep a query for the end of the frame
+	CGpuTimerFrame *pFrame = &m_aGpuTimerFrames[m_GpuTimerFrame];
+	if(pFrame->m_NumMarks == GPU_TIMER_MARKS-1)
+		return;
+	pFrame->m_aGroups[pFrame->m_NumMarks] = pCommand->m_Group;
+	m_pfnQueryCounter(pFrame->m_aQueries[pFrame->m_NumMarks++], GL_TIMESTAMP);
+}
+
 CCommandProcessorFragment_OpenGL::CCommandProcessorFragment_OpenGL()
 {
 	mem_zero(m_aTextures, sizeof(m_aTextures));
+	mem_zero(m_aBuffers, sizeof(m_aBuffers));
+	mem_zero(m_aReadbacks, sizeof(m_aReadbacks));
+	m_PixelBuffers = false;
+	m_CoreProfile = false;
+	m_RenderTarget = -1;
 	m_pTextureMemoryUsage = 0;
+	m_pInstanceVertices = 0;
+	m_MaxInstanceVertices = 0;
+	m_GpuTimerFrame = -1;
+	m_NextGpuTimerFrame = 0;
+	m_pGpuTimesLock = 0;
+	m_pGpuTimes = 0;
+	m_pGpuTrack = 0;
+}
+
+CCommandProcessorFragment_OpenGL::~CCommandProcessorFragment_OpenGL()
+{
+	mem_free(m_pInstanceVertices);
+	for(int i = 0; i < CCommandBuffer::MAX_READBACKS; i++)
+		mem_free(m_aReadbacks[i].m_pData);
 }
 
 bool CCommandProcessorFragment_OpenGL::RunCommand(const CCommandBuffer::CCommand * pBaseCommand)
@@ -523,7 +1193,16 @@ bool CCommandProcessorFragment_OpenGL::RunCommand(const CCommandBuffer::CCommand
 	case CCommandBuffer::CMD_TEXTURE_UPDATE: Cmd_Texture_Update(static_cast<const CCommandBuffer::CTextureUpdateCommand *>(pBaseCommand)); break;
 	case CCommandBuffer::CMD_CLEAR: Cmd_Clear(static_cast<const CCommandBuffer::CClearCommand *>(pBaseCommand)); break;
 	case CCommandBuffer::CMD_RENDER: Cmd_Render(static_cast<const CCommandBuffer::CRenderCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_BUFFER_CREATE: Cmd_Buffer_Create(static_cast<const CCommandBuffer::CBufferCreateCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_BUFFER_DESTROY: Cmd_Buffer_Destroy(static_cast<const CCommandBuffer::CBufferDestroyCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_RENDER_BUFFER: Cmd_RenderBuffer(static_cast<const CCommandBuffer::CRenderBufferCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_RENDER_TILEMAP: Cmd_RenderTilemap(static_cast<const CCommandBuffer::CRenderTilemapCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_RENDER_INSTANCES: Cmd_RenderInstances(static_cast<const CCommandBuffer::CRenderInstancesCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_RENDER_TARGET: Cmd_RenderTarget(static_cast<const CCommandBuffer::CRenderTargetCommand *>(pBaseCommand)); break;
 	case CCommandBuffer::CMD_SCREENSHOT: Cmd_Screenshot(static_cast<const CCommandBuffer::CScreenshotCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_READBACK: Cmd_Readback(static_cast<const CCommandBuffer::CReadbackCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_READBACK_FINISH: Cmd_ReadbackFinish(static_cast<const CCommandBuffer::CReadbackFinishCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_GPU_TIMER: Cmd_GpuTimer(static_cast<const CCommandBuffer::CGpuTimerCommand *>(pBaseCommand)); break;
 	default: return false;
 	}
 
@@ -531,6 +1210,378 @@ bool CCommandProcessorFragment_OpenGL::RunCommand(const CCommandBuffer::CCommand
 }
 
 
+// ------------ CCommandProcessorFragment_OpenGL3
+
+// the legacy pipeline drops fully transparent fragments with the alpha test
+static const char *s_pCoreVertexShader =
+	"uniform vec4 u_Screen;\n"
+	"layout(location = 0) in vec2 a_Pos;\n"
+	"layout(location = 1) in vec3 a_Tex;\n"
+	"layout(location = 2) in vec4 a_Color;\n"
+	"out vec3 v_Tex;\n"
+	"out vec4 v_Color;\n"
+	"void main()\n"
+	"{\n"
+	"	v_Tex = a_Tex;\n"
+	"	v_Color = a_Color;\n"
+	"	gl_Position = vec4((a_Pos-u_Screen.xy)/(u_Screen.zw-u_Screen.xy)*2.0-1.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *s_pCoreFragmentShader =
+	"#if defined(TEXTURE_2D)\n"
+	"uniform sampler2D u_Texture;\n"
+	"#elif defined(TEXTURE_3D)\n"
+	"uniform sampler3D u_Texture;\n"
+	"#endif\n"
+	"in vec3 v_Tex;\n"
+	"in vec4 v_Color;\n"
+	"out vec4 f_Color;\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 Color = v_Color;\n"
+	"#if defined(TEXTURE_2D)\n"
+	"	Color *= texture(u_Texture, v_Tex.xy);\n"
+	"#elif defined(TEXTURE_3D)\n"
+	"	Color *= texture(u_Texture, v_Tex);\n"
+	"#endif\n"
+	"	if(Color.a <= 0.0)\n"
+	"		discard;\n"
+	"	f_Color = Color;\n"
+	"}\n";
+
+static const char *s_pCoreTilemapVertexShader =
+	"uniform vec4 u_Screen;\n"
+	"uniform float u_Scale;\n"
+	"layout(location = 0) in vec2 a_Pos;\n"
+	"layout(location = 2) in vec4 a_Color;\n"
+	"out vec2 v_Tile;\n"
+	"out vec4 v_Color;\n"
+	"void main()\n"
+	"{\n"
+	"	v_Tile = a_Pos / u_Scale;\n"
+	"	v_Color = a_Color;\n"
+	"	gl_Position = vec4((a_Pos-u_Screen.xy)/(u_Screen.zw-u_Screen.xy)*2.0-1.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *s_pCoreTilemapFragmentShader =
+	"uniform sampler3D u_Tileset;\n"
+	"uniform sampler2D u_Indices;\n"
+	"uniform vec2 u_Size;\n"
+	"uniform bool u_Textured;\n"
+	"in vec2 v_Tile;\n"
+	"in vec4 v_Color;\n"
+	"out vec4 f_Color;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 Tile = clamp(floor(v_Tile), vec2(0.0), u_Size-1.0);\n"
+	"	vec4 Data = texture(u_Indices, (Tile+0.5)/u_Size);\n"
+	"	float Index = floor(Data.r*255.0+0.5);\n"
+	"	if(Index == 0.0)\n"
+	"		discard;\n"
+	"	vec2 Local = v_Tile - floor(v_Tile);\n"
+	"	if(Data.a > 0.5)\n"
+	"		Local = vec2(Local.y, 1.0-Local.x);\n"
+	"	if(Data.g > 0.5)\n"
+	"		Local.x = 1.0-Local.x;\n"
+	"	if(Data.b > 0.5)\n"
+	"		Local.y = 1.0-Local.y;\n"
+	"	vec4 Color = v_Color;\n"
+	"	if(u_Textured)\n"
+	"		Color *= texture(u_Tileset, vec3(Local, (Index+0.5)/256.0));\n"
+	"	if(Color.a <= 0.0)\n"
+	"		discard;\n"
+	"	f_Color = Color;\n"
+	"}\n";
+
+static const char *gs_apCoreFunctions[] = {
+	"glGenBuffers", "glDeleteBuffers", "glBindBuffer", "glBufferData", "glMapBuffer", "glUnmapBuffer", "glMapBufferRange",
+	"glGenerateMipmap", "glGenVertexArrays", "glDeleteVertexArrays", "glBindVertexArray", "glVertexAttribPointer",
+	"glEnableVertexAttribArray", "glDisableVertexAttribArray", "glVertexAttrib4f", "glUniform4f", "glGetStringi",
+	"glActiveTexture", "glCreateShader", "glShaderSource", "glCompileShader", "glGetShaderiv", "glGetShaderInfoLog",
+	"glDeleteShader", "glCreateProgram", "glAttachShader", "glLinkProgram", "glGetProgramiv", "glUseProgram",
+	"glGetUniformLocation", "glUniform1i", "glUniform1f", "glUniform2f", "glGenQueries", "glDeleteQueries",
+	"glQueryCounter", "glGetQueryObjectiv", "glGetQueryObjectui64v", "glGetInteger64v", "glGenFramebuffers",
+	"glDeleteFramebuffers", "glBindFramebuffer", "glFramebufferTexture2D", "glCheckFramebufferStatus",
+};
+
+bool CCommandProcessorFragment_OpenGL3::IsSupported()
+{
+	for(unsigned i = 0; i < sizeof(gs_apCoreFunctions)/sizeof(gs_apCoreFunctions[0]); i++)
+	{
+		if(!SDL_GL_GetProcAddress(gs_apCoreFunctions[i]))
+		{
+			dbg_msg("render", "%s is missing", gs_apCoreFunctions[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CCommandProcessorFragment_OpenGL3::InitFunctions()
+{
+	m_pfnGenBuffers = (PFNGLGENBUFFERSPROC)SDL_GL_GetProcAddress("glGenBuffers");
+	m_pfnDeleteBuffers = (PFNGLDELETEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteBuffers");
+	m_pfnBindBuffer = (PFNGLBINDBUFFERPROC)SDL_GL_GetProcAddress("glBindBuffer");
+	m_pfnBufferData = (PFNGLBUFFERDATAPROC)SDL_GL_GetProcAddress("glBufferData");
+	m_pfnMapBuffer = (PFNGLMAPBUFFERPROC)SDL_GL_GetProcAddress("glMapBuffer");
+	m_pfnUnmapBuffer = (PFNGLUNMAPBUFFERPROC)SDL_GL_GetProcAddress("glUnmapBuffer");
+	m_pfnGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)SDL_GL_GetProcAddress("glGenerateMipmap");
+	m_pfnGenVertexArrays = (PFNGLGENVERTEXARRAYSPROC)SDL_GL_GetProcAddress("glGenVertexArrays");
+	m_pfnDeleteVertexArrays = (PFNGLDELETEVERTEXARRAYSPROC)SDL_GL_GetProcAddress("glDeleteVertexArrays");
+	m_pfnBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)SDL_GL_GetProcAddress("glBindVertexArray");
+	m_pfnVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)SDL_GL_GetProcAddress("glVertexAttribPointer");
+	m_pfnEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)SDL_GL_GetProcAddress("glEnableVertexAttribArray");
+	m_pfnDisableVertexAttribArray = (PFNGLDISABLEVERTEXATTRIBARRAYPROC)SDL_GL_GetProcAddress("glDisableVertexAttribArray");
+	m_pfnVertexAttrib4f = (PFNGLVERTEXATTRIB4FPROC)SDL_GL_GetProcAddress("glVertexAttrib4f");
+	m_pfnMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)SDL_GL_GetProcAddress("glMapBufferRange");
+	m_pfnUniform4f = (PFNGLUNIFORM4FPROC)SDL_GL_GetProcAddress("glUniform4f");
+	m_pfnGetStringi = (PFNGLGETSTRINGIPROC)SDL_GL_GetProcAddress("glGetStringi");
+	return m_pfnGenBuffers && m_pfnDeleteBuffers && m_pfnBindBuffer && m_pfnBufferData && m_pfnMapBuffer && m_pfnUnmapBuffer &&
+		m_pfnGenerateMipmap && m_pfnGenVertexArrays && m_pfnDeleteVertexArrays && m_pfnBindVertexArray && m_pfnVertexAttribPointer &&
+		m_pfnEnableVertexAttribArray && m_pfnDisableVertexAttribArray && m_pfnVertexAttrib4f && m_pfnMapBufferRange &&
+		m_pfnUniform4f && m_pfnGetStringi && LoadShaderFunctions();
+}
+
+bool CCommandProcessorFragment_OpenGL3::InitPrograms()
+{
+	// one program per texture dimension, they differ in the defines only
+	const char *apHeaders[NUM_PROGRAMS] = {
+		"#version 330 core\n",
+		"#version 330 core\n#define TEXTURE_2D\n",
+		"#version 330 core\n#define TEXTURE_3D\n",
+	};
+	for(int i = 0; i < NUM_PROGRAMS; i++)
+	{
+		m_aPrograms[i] = CreateProgram(apHeaders[i], s_pCoreVertexShader, s_pCoreFragmentShader);
+		if(!m_aPrograms[i])
+			return false;
+		m_aScreenLocations[i] = m_pfnGetUniformLocation(m_aPrograms[i], "u_Screen");
+		m_pfnUseProgram(m_aPrograms[i]);
+		m_pfnUniform1i(m_pfnGetUniformLocation(m_aPrograms[i], "u_Texture"), 0);
+	}
+
+	m_TilemapProgram = CreateProgram(apHeaders[PROGRAM_UNTEXTURED], s_pCoreTilemapVertexShader, s_pCoreTilemapFragmentShader);
+	if(!m_TilemapProgram)
+		return false;
+	m_TilemapScreenLocation = m_pfnGetUniformLocation(m_TilemapProgram, "u_Screen");
+	m_TilemapScaleLocation = m_pfnGetUniformLocation(m_TilemapProgram, "u_Scale");
+	m_TilemapSizeLocation = m_pfnGetUniformLocation(m_TilemapProgram, "u_Size");
+	m_TilemapTexturedLocation = m_pfnGetUniformLocation(m_TilemapProgram, "u_Textured");
+	m_pfnUseProgram(m_TilemapProgram);
+	m_pfnUniform1i(m_pfnGetUniformLocation(m_TilemapProgram, "u_Tileset"), 0);
+	m_pfnUniform1i(m_pfnGetUniformLocation(m_TilemapProgram, "u_Indices"), 1);
+	m_pfnUseProgram(0);
+	return true;
+}
+
+void CCommandProcessorFragment_OpenGL3::SetScreen(const CCommandBuffer::CState &State)
+{
+	// left, bottom, right and top like glOrtho
+	m_aScreen[0] = State.m_ScreenTL.x;
+	m_aScreen[1] = State.m_ScreenBR.y;
+	m_aScreen[2] = State.m_ScreenBR.x;
+	m_aScreen[3] = State.m_ScreenTL.y;
+}
+
+void CCommandProcessorFragment_OpenGL3::UseProgram(GLuint Program, GLint ScreenLocation)
+{
+	m_pfnUseProgram(Program);
+	m_pfnUniform4f(ScreenLocation, m_aScreen[0], m_aScreen[1], m_aScreen[2], m_aScreen[3]);
+}
+
+unsigned CCommandProcessorFragment_OpenGL3::StreamVertices(const void *pData, unsigned Size)
+{
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, m_StreamBuffer);
+	if(m_StreamOffset+Size > m_StreamBufferSize)
+	{
+		while(Size > m_StreamBufferSize)
+			m_StreamBufferSize *= 2;
+		m_pfnBufferData(GL_ARRAY_BUFFER, m_StreamBufferSize, 0, GL_STREAM_DRAW);
+		m_StreamOffset = 0;
+	}
+
+	// nothing the gpu may still read is written, so there is no need to wait for it
+	void *pDest = m_pfnMapBufferRange(GL_ARRAY_BUFFER, m_StreamOffset, Size, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_RANGE_BIT|GL_MAP_UNSYNCHRONIZED_BIT);
+	if(pDest)
+	{
+		mem_copy(pDest, pData, Size);
+		m_pfnUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	unsigned Offset = m_StreamOffset;
+	m_StreamOffset += Size;
+	return Offset;
+}
+
+void CCommandProcessorFragment_OpenGL3::PrepareQuadIndices(unsigned NumQuads)
+{
+	if(NumQuads <= m_MaxIndexedQuads)
+		return;
+
+	// the index buffer is part of the vertex array, which stays bound
+	m_MaxIndexedQuads = max(NumQuads, m_MaxIndexedQuads*2);
+	unsigned *pIndices = (unsigned *)mem_alloc_tag(m_MaxIndexedQuads*6*sizeof(unsigned), 1, MEMTAG_GRAPHICS);
+	for(unsigned i = 0; i < m_MaxIndexedQuads; i++)
+	{
+		pIndices[i*6+0] = i*4+0;
+		pIndices[i*6+1] = i*4+1;
+		pIndices[i*6+2] = i*4+2;
+		pIndices[i*6+3] = i*4+0;
+		pIndices[i*6+4] = i*4+2;
+		pIndices[i*6+5] = i*4+3;
+	}
+	m_pfnBufferData(GL_ELEMENT_ARRAY_BUFFER, m_MaxIndexedQuads*6*sizeof(unsigned), pIndices, GL_STATIC_DRAW);
+	mem_free(pIndices);
+}
+
+void CCommandProcessorFragment_OpenGL3::DrawQuads(unsigned NumQuads)
+{
+	PrepareQuadIndices(NumQuads);
+	glDrawElements(GL_TRIANGLES, NumQuads*6, GL_UNSIGNED_INT, 0);
+}
+
+void CCommandProcessorFragment_OpenGL3::SetState(const CCommandBuffer::CState &State)
+{
+	int Dimension = ApplyState(State);
+	int Program = Dimension == 2 ? PROGRAM_TEX2D : Dimension == 3 ? PROGRAM_TEX3D : PROGRAM_UNTEXTURED;
+	SetScreen(State);
+	UseProgram(m_aPrograms[Program], m_aScreenLocations[Program]);
+}
+
+void CCommandProcessorFragment_OpenGL3::RenderVertices(const CCommandBuffer::CVertex *pVertices, int PrimType, int PrimCount)
+{
+	if(PrimCount <= 0)
+		return;
+
+	int NumVertices = PrimCount*(PrimType == CCommandBuffer::PRIMTYPE_QUADS ? 4 : 2);
+	char *pOffset = (char*)0 + StreamVertices(pVertices, NumVertices*sizeof(CCommandBuffer::CVertex));
+	m_pfnVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, sizeof(CCommandBuffer::CVertex), pOffset);
+	m_pfnVertexAttribPointer(ATTRIB_TEX, 3, GL_FLOAT, GL_FALSE, sizeof(CCommandBuffer::CVertex), pOffset + sizeof(float)*2);
+	m_pfnVertexAttribPointer(ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(CCommandBuffer::CVertex), pOffset + sizeof(float)*5);
+	m_pfnEnableVertexAttribArray(ATTRIB_TEX);
+	m_pfnEnableVertexAttribArray(ATTRIB_COLOR);
+
+	switch(PrimType)
+	{
+	case CCommandBuffer::PRIMTYPE_QUADS:
+		DrawQuads(PrimCount);
+		break;
+	case CCommandBuffer::PRIMTYPE_LINES:
+		glDrawArrays(GL_LINES, 0, NumVertices);
+		break;
+	default:
+		dbg_msg("render", "unknown primtype %d\n", PrimType);
+	};
+}
+
+void CCommandProcessorFragment_OpenGL3::Cmd_Init(const CInitCommand *pCommand)
+{
+	m_CoreProfile = true;
+	glEnable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(0);
+
+	InitTextureSizes(pCommand);
+
+	// everything used here is core in OpenGL 3.3, IsSupported checked that it is there
+	InitFunctions();
+	*pCommand->m_pVertexBuffers = true;
+	m_PixelBuffers = true;
+	m_TextureCompressionS3TC = false;
+	GLint NumExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &NumExtensions);
+	for(int i = 0; i < NumExtensions; i++)
+	{
+		const char *pExtension = (const char *)m_pfnGetStringi(GL_EXTENSIONS, i);
+		if(pExtension && str_comp(pExtension, "GL_EXT_texture_compression_s3tc") == 0)
+			m_TextureCompressionS3TC = true;
+	}
+
+	m_TilemapProgram = 0;
+	*pCommand->m_pTilemapShader = InitPrograms();
+	*pCommand->m_pRenderTargets = LoadFramebufferFunctions();
+	if(!*pCommand->m_pTilemapShader)
+		dbg_msg("render", "*** error *** failed to build the OpenGL 3.3 shaders");
+
+	m_pGpuTimesLock = pCommand->m_pGpuTimesLock;
+	m_pGpuTimes = pCommand->m_pGpuTimes;
+	*pCommand->m_pGpuTimers = InitGpuTimers();
+
+	// one vertex array for everything, the attributes are pointed at the right buffer for each draw
+	m_pfnGenVertexArrays(1, &m_VertexArray);
+	m_pfnBindVertexArray(m_VertexArray);
+	m_pfnEnableVertexAttribArray(ATTRIB_POS);
+	m_pfnGenBuffers(1, &m_StreamBuffer);
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, m_StreamBuffer);
+	m_StreamBufferSize = STREAM_BUFFER_SIZE;
+	m_StreamOffset = 0;
+	m_pfnBufferData(GL_ARRAY_BUFFER, m_StreamBufferSize, 0, GL_STREAM_DRAW);
+	m_pfnGenBuffers(1, &m_QuadIndexBuffer);
+	m_pfnBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_QuadIndexBuffer);
+	m_MaxIndexedQuads = 0;
+	PrepareQuadIndices(STREAM_BUFFER_SIZE/(sizeof(CCommandBuffer::CVertex)*4));
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+}
+
+void CCommandProcessorFragment_OpenGL3::Cmd_RenderBuffer(const CCommandBuffer::CRenderBufferCommand *pCommand)
+{
+	SetState(pCommand->m_State);
+
+	// the color is the same for all vertices
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, m_aBuffers[pCommand->m_Slot]);
+	char *pOffset = (char*)0 + pCommand->m_FirstQuad*4*sizeof(CCommandBuffer::CBufferVertex);
+	m_pfnVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, sizeof(CCommandBuffer::CBufferVertex), pOffset);
+	m_pfnVertexAttribPointer(ATTRIB_TEX, 3, GL_FLOAT, GL_FALSE, sizeof(CCommandBuffer::CBufferVertex), pOffset + sizeof(float)*2);
+	m_pfnEnableVertexAttribArray(ATTRIB_TEX);
+	m_pfnDisableVertexAttribArray(ATTRIB_COLOR);
+	m_pfnVertexAttrib4f(ATTRIB_COLOR, pCommand->m_Color.r, pCommand->m_Color.g, pCommand->m_Color.b, pCommand->m_Color.a);
+
+	DrawQuads(pCommand->m_NumQuads);
+}
+
+void CCommandProcessorFragment_OpenGL3::Cmd_RenderTilemap(const CCommandBuffer::CRenderTilemapCommand *pCommand)
+{
+	ApplyState(pCommand->m_State);
+	SetScreen(pCommand->m_State);
+
+	m_pfnActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, m_aTextures[pCommand->m_IndicesSlot].m_Tex2D);
+	m_pfnActiveTexture(GL_TEXTURE0);
+
+	UseProgram(m_TilemapProgram, m_TilemapScreenLocation);
+	m_pfnUniform1f(m_TilemapScaleLocation, pCommand->m_Scale);
+	m_pfnUniform2f(m_TilemapSizeLocation, (float)pCommand->m_Width, (float)pCommand->m_Height);
+	m_pfnUniform1i(m_TilemapTexturedLocation, pCommand->m_State.m_Texture >= 0 ? 1 : 0);
+
+	const float aVertices[] = {
+		pCommand->m_TopLeft.x, pCommand->m_TopLeft.y,
+		pCommand->m_BottomRight.x, pCommand->m_TopLeft.y,
+		pCommand->m_BottomRight.x, pCommand->m_BottomRight.y,
+		pCommand->m_TopLeft.x, pCommand->m_BottomRight.y,
+	};
+	char *pOffset = (char*)0 + StreamVertices(aVertices, sizeof(aVertices));
+	m_pfnVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, pOffset);
+	m_pfnDisableVertexAttribArray(ATTRIB_TEX);
+	m_pfnDisableVertexAttribArray(ATTRIB_COLOR);
+	m_pfnVertexAttrib4f(ATTRIB_COLOR, pCommand->m_Color.r, pCommand->m_Color.g, pCommand->m_Color.b, pCommand->m_Color.a);
+	DrawQuads(1);
+}
+
+CCommandProcessorFragment_OpenGL3::CCommandProcessorFragment_OpenGL3()
+{
+	m_VertexArray = 0;
+	m_StreamBuffer = 0;
+	m_StreamBufferSize = 0;
+	m_StreamOffset = 0;
+	m_QuadIndexBuffer = 0;
+	m_MaxIndexedQuads = 0;
+	mem_zero(m_aPrograms, sizeof(m_aPrograms));
+	mem_zero(m_aScreen, sizeof(m_aScreen));
+}
+
+
 // ------------ CCommandProcessorFragment_SDL
 
 void CCommandProcessorFragment_SDL::Cmd_Init(const CInitCommand *pCommand)
@@ -578,6 +1629,19 @@ bool CCommandProcessorFragment_SDL::RunCommand(const CCommandBuffer::CCommand *p
 
 // ------------ CCommandProcessor_SDL_OpenGL
 
+CCommandProcessor_SDL_OpenGL::CCommandProcessor_SDL_OpenGL(bool CoreProfile)
+{
+	if(CoreProfile)
+		m_pOpenGL = new CCommandProcessorFragment_OpenGL3;
+	else
+		m_pOpenGL = new CCommandProcessorFragment_OpenGL;
+}
+
+CCommandProcessor_SDL_OpenGL::~CCommandProcessor_SDL_OpenGL()
+{
+	delete m_pOpenGL;
+}
+
 void CCommandProcessor_SDL_OpenGL::RunBuffer(CCommandBuffer *pBuffer)
 {
 	unsigned CmdIndex = 0;
@@ -587,7 +1651,7 @@ void CCommandProcessor_SDL_OpenGL::RunBuffer(CCommandBuffer *pBuffer)
 		if(pBaseCommand == 0x0)
 			break;
 
-		if(m_OpenGL.RunCommand(pBaseCommand))
+		if(m_pOpenGL->RunCommand(pBaseCommand))
 			continue;
 
 		if(m_SDL.RunCommand(pBaseCommand))
@@ -699,8 +1763,35 @@ int CGraphicsBackend_SDL_OpenGL::Init(const char *pName, int *pScreen, int *pWin
 
 	SDL_GetWindowSize(m_pWindow, pWindowWidth, pWindowHeight);
 
-	// create gl context
-	m_GLContext = SDL_GL_CreateContext(m_pWindow);
+	// create gl context, the core profile one falls back to the legacy renderer
+	bool CoreProfile = false;
+	m_GLContext = NULL;
+	if(Flags&IGraphicsBackend::INITFLAG_OPENGL_CORE)
+	{
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+#if defined(CONF_PLATFORM_MACOSX)
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
+#endif
+		m_GLContext = SDL_GL_CreateContext(m_pWindow);
+		if(m_GLContext && !CCommandProcessorFragment_OpenGL3::IsSupported())
+		{
+			SDL_GL_DeleteContext(m_GLContext);
+			m_GLContext = NULL;
+		}
+		CoreProfile = m_GLContext != NULL;
+		if(!CoreProfile)
+		{
+			dbg_msg("gfx", "unable to create OpenGL 3.3 core context: %s - using the legacy renderer", SDL_GetError());
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, 0);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
+		}
+	}
+	if(!CoreProfile)
+		m_GLContext = SDL_GL_CreateContext(m_pWindow);
 	if(m_GLContext == NULL)
 	{
 		dbg_msg("gfx", "unable to create OpenGL context: %s", SDL_GetError());
@@ -731,7 +1822,7 @@ int CGraphicsBackend_SDL_OpenGL::Init(const char *pName, int *pScreen, int *pWin
 	dbg_msg("sdl", "SDL version %d.%d.%d (dll = %d.%d.%d)", Compiled.major, Compiled.minor, Compiled.patch, Linked.major, Linked.minor, Linked.patch);
 
 	// start the command processor
-	m_pProcessor = new CCommandProcessor_SDL_OpenGL;
+	m_pProcessor = new CCommandProcessor_SDL_OpenGL(CoreProfile);
 	StartProcessor(m_pProcessor);
 
 	// issue init commands for OpenGL and SDL
@@ -743,6 +1834,14 @@ int CGraphicsBackend_SDL_OpenGL::Init(const char *pName, int *pScreen, int *pWin
 	CCommandProcessorFragment_OpenGL::CInitCommand CmdOpenGL;
 	CmdOpenGL.m_pTextureMemoryUsage = &m_TextureMemoryUsage;
 	CmdOpenGL.m_pTextureArraySize = &m_TextureArraySize;
+	CmdOpenGL.m_pVertexBuffers = &m_VertexBuffers;
+	CmdOpenGL.m_pTilemapShader = &m_TilemapShader;
+	CmdOpenGL.m_pRenderTargets = &m_RenderTargets;
+	CmdOpenGL.m_pMaxTextureSize = &m_MaxTextureSize;
+	CmdOpenGL.m_pGpuTimers = &m_GpuTimers;
+	CmdOpenGL.m_pGpuTimesLock = &m_GpuTimesLock;
+	CmdOpenGL.m_pGpuTimes = &m_GpuTimes;
+	mem_zero(&m_GpuTimes, sizeof(m_GpuTimes));
 	CmdBuffer.AddCommand(CmdOpenGL);
 	RunBuffer(&CmdBuffer);
 	WaitForIdle();
@@ -775,6 +1874,12 @@ int CGraphicsBackend_SDL_OpenGL::MemoryUsage() const
 	return m_TextureMemoryUsage;
 }
 
+void CGraphicsBackend_SDL_OpenGL::GetGpuTimes(IGraphics::CGpuTimes *pTimes) const
+{
+	scope_lock Lock(&m_GpuTimesLock);
+	*pTimes = m_GpuTimes;
+}
+
 void CGraphicsBackend_SDL_OpenGL::Minimize()
 {
 	SDL_MinimizeWindow(m_pWindow);
@@ -881,7 +1986,9 @@ int CGraphicsBackend_SDL_OpenGL::WindowActive()
 
 int CGraphicsBackend_SDL_OpenGL::WindowOpen()
 {
-	return SDL_GetWindowFlags(m_pWindow)&SDL_WINDOW_SHOWN;
+	// minimized windows stay shown
+	const Uint32 Flags = SDL_GetWindowFlags(m_pWindow);
+	return (Flags&SDL_WINDOW_SHOWN) && !(Flags&(SDL_WINDOW_HIDDEN|SDL_WINDOW_MINIMIZED));
 }
 
 
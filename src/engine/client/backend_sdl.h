@@ -53,6 +53,9 @@ public:
 	CGraphicsBackend_Threaded();
 
 	virtual void RunBuffer(CCommandBuffer *pBuffer);
+	virtual void SetMaxPending(int Num);
+	virtual int NumPending() const;
+	virtual void WaitForPending(int Num);
 	virtual bool IsIdle() const;
 	virtual void WaitForIdle();
 
@@ -61,8 +64,17 @@ protected:
 	void StopProcessor();
 
 private:
+	enum
+	{
+		MAX_QUEUE = 4,
+	};
+
+	// the main thread only advances the end and the render thread only the start
 	ICommandProcessor *m_pProcessor;
-	CCommandBuffer * volatile m_pBuffer;
+	CCommandBuffer *m_apQueue[MAX_QUEUE];
+	volatile unsigned m_QueueStart;
+	volatile unsigned m_QueueEnd;
+	int m_MaxPending;
 	volatile bool m_Shutdown;
 	semaphore m_Activity;
 	semaphore m_BufferDone;
@@ -83,6 +95,7 @@ public:
 // takes care of opengl related rendering
 class CCommandProcessorFragment_OpenGL
 {
+protected:
 	class CTexture
 	{
 	public:
@@ -100,12 +113,104 @@ class CCommandProcessorFragment_OpenGL
 		int m_State;
 		int m_Format;
 		int m_MemSize;
+		bool m_GenerateMipmaps; // regenerated after updates
+		GLuint m_Fbo; // render targets only
+		int m_Width;
+		int m_Height;
 	};
 	CTexture m_aTextures[CCommandBuffer::MAX_TEXTURES];
 	volatile int *m_pTextureMemoryUsage;
 	int m_MaxTexSize;
 	int m_Max3DTexSize;
 	int m_TextureArraySize;
+	bool m_CoreProfile; // textures avoid the formats the core profile removed
+
+	// mipmaps are generated by the driver, glGenerateMipmap is core since OpenGL 3.0
+	PFNGLGENERATEMIPMAPPROC m_pfnGenerateMipmap;
+	bool m_TextureCompressionS3TC;
+
+	// vertex buffer objects are core since OpenGL 1.5 but not exported by every gl library
+	PFNGLGENBUFFERSPROC m_pfnGenBuffers;
+	PFNGLDELETEBUFFERSPROC m_pfnDeleteBuffers;
+	PFNGLBINDBUFFERPROC m_pfnBindBuffer;
+	PFNGLBUFFERDATAPROC m_pfnBufferData;
+	GLuint m_aBuffers[CCommandBuffer::MAX_BUFFERS];
+
+	// render targets are framebuffer objects, core since OpenGL 3.0
+	PFNGLGENFRAMEBUFFERSPROC m_pfnGenFramebuffers;
+	PFNGLDELETEFRAMEBUFFERSPROC m_pfnDeleteFramebuffers;
+	PFNGLBINDFRAMEBUFFERPROC m_pfnBindFramebuffer;
+	PFNGLFRAMEBUFFERTEXTURE2DPROC m_pfnFramebufferTexture2D;
+	PFNGLCHECKFRAMEBUFFERSTATUSPROC m_pfnCheckFramebufferStatus;
+	int m_RenderTarget; // -1 for the screen
+	GLint m_aScreenViewport[4];
+
+	// the tilemap shader needs OpenGL 2.0
+	PFNGLACTIVETEXTUREPROC m_pfnActiveTexture;
+	PFNGLCREATESHADERPROC m_pfnCreateShader;
+	PFNGLSHADERSOURCEPROC m_pfnShaderSource;
+	PFNGLCOMPILESHADERPROC m_pfnCompileShader;
+	PFNGLGETSHADERIVPROC m_pfnGetShaderiv;
+	PFNGLGETSHADERINFOLOGPROC m_pfnGetShaderInfoLog;
+	PFNGLDELETESHADERPROC m_pfnDeleteShader;
+	PFNGLCREATEPROGRAMPROC m_pfnCreateProgram;
+	PFNGLATTACHSHADERPROC m_pfnAttachShader;
+	PFNGLLINKPROGRAMPROC m_pfnLinkProgram;
+	PFNGLGETPROGRAMIVPROC m_pfnGetProgramiv;
+	PFNGLUSEPROGRAMPROC m_pfnUseProgram;
+	PFNGLGETUNIFORMLOCATIONPROC m_pfnGetUniformLocation;
+	PFNGLUNIFORM1IPROC m_pfnUniform1i;
+	PFNGLUNIFORM1FPROC m_pfnUniform1f;
+	PFNGLUNIFORM2FPROC m_pfnUniform2f;
+	GLuint m_TilemapProgram;
+	GLint m_TilemapScaleLocation;
+	GLint m_TilemapSizeLocation;
+	GLint m_TilemapTexturedLocation;
+
+	// instanced quads are expanded here on the render thread
+	CCommandBuffer::CVertex *m_pInstanceVertices;
+	unsigned m_MaxInstanceVertices;
+
+	// back buffer readbacks go into pixel buffer objects if there are some, then
+	// glReadPixels returns right away and only mapping the buffer waits for the gpu
+	struct CReadback
+	{
+		GLuint m_Pbo;
+		unsigned m_PboSize;
+		int m_Width;
+		int m_Height;
+		unsigned char *m_pData; // read right away without pixel buffers
+	};
+	CReadback m_aReadbacks[CCommandBuffer::MAX_READBACKS];
+	PFNGLMAPBUFFERPROC m_pfnMapBuffer;
+	PFNGLUNMAPBUFFERPROC m_pfnUnmapBuffer;
+	bool m_PixelBuffers;
+
+	// gpu timing with timestamp queries, they need OpenGL 3.3 or GL_ARB_timer_query.
+	// every frame gets its own queries, which are read back once the gpu is done
+	enum
+	{
+		GPU_TIMER_FRAMES = 4,
+		GPU_TIMER_MARKS = 32,
+	};
+	struct CGpuTimerFrame
+	{
+		GLuint m_aQueries[GPU_TIMER_MARKS];
+		int m_aGroups[GPU_TIMER_MARKS];
+		int m_NumMarks;
+		bool m_Pending;
+	};
+	PFNGLGENQUERIESPROC m_pfnGenQueries;
+	PFNGLQUERYCOUNTERPROC m_pfnQueryCounter;
+	PFNGLGETQUERYOBJECTIVPROC m_pfnGetQueryObjectiv;
+	PFNGLGETQUERYOBJECTUI64VPROC m_pfnGetQueryObjectui64v;
+	PFNGLGETINTEGER64VPROC m_pfnGetInteger64v;
+	CGpuTimerFrame m_aGpuTimerFrames[GPU_TIMER_FRAMES];
+	int m_GpuTimerFrame; // the frame the marks go to, -1 between frames
+	int m_NextGpuTimerFrame;
+	lock *m_pGpuTimesLock;
+	IGraphics::CGpuTimes *m_pGpuTimes;
+	CTracer::CThreadBuffer *m_pGpuTrack;
 
 public:
 	enum
@@ -118,29 +223,126 @@ public:
 		CInitCommand() : CCommand(CMD_INIT) {}
 		volatile int *m_pTextureMemoryUsage;
 		int *m_pTextureArraySize;
+		bool *m_pVertexBuffers;
+		bool *m_pTilemapShader;
+		bool *m_pRenderTargets;
+		int *m_pMaxTextureSize;
+		bool *m_pGpuTimers;
+		lock *m_pGpuTimesLock;
+		IGraphics::CGpuTimes *m_pGpuTimes;
 	};
 
-private:
-	static int TexFormatToOpenGLFormat(int TexFormat);
+protected:
+	int TexFormatToOpenGLFormat(int TexFormat) const;
+	static bool HasExtension(const char *pExtensions, const char *pName);
+	int CompressedFormat(int StoreOglformat, bool S3TC) const;
+	void SetAlphaSwizzle(GLenum Target, int TexFormat) const;
 	static unsigned char Sample(int w, int h, const unsigned char *pData, int u, int v, int Offset, int ScaleW, int ScaleH, int Bpp);
 	static void *Rescale(int Width, int Height, int NewWidth, int NewHeight, int Format, const unsigned char *pData);
 
-	void SetState(const CCommandBuffer::CState &State);
-
-	void Cmd_Init(const CInitCommand *pCommand);
+	int ApplyState(const CCommandBuffer::CState &State);
+	virtual void SetState(const CCommandBuffer::CState &State);
+	virtual void RenderVertices(const CCommandBuffer::CVertex *pVertices, int PrimType, int PrimCount);
+	void InitTextureSizes(const CInitCommand *pCommand);
+	bool LoadShaderFunctions();
+	GLuint CompileShader(GLenum Type, const char *pHeader, const char *pSource);
+	GLuint CreateProgram(const char *pHeader, const char *pVertexSource, const char *pFragmentSource);
+	bool InitTilemapShader();
+	bool LoadFramebufferFunctions();
+	bool InitGpuTimers();
+	bool ResolveGpuTimerFrame(CGpuTimerFrame *pFrame);
+
+	virtual void Cmd_Init(const CInitCommand *pCommand);
 	void Cmd_Texture_Update(const CCommandBuffer::CTextureUpdateCommand *pCommand);
 	void Cmd_Texture_Destroy(const CCommandBuffer::CTextureDestroyCommand *pCommand);
 	void Cmd_Texture_Create(const CCommandBuffer::CTextureCreateCommand *pCommand);
 	void Cmd_Clear(const CCommandBuffer::CClearCommand *pCommand);
 	void Cmd_Render(const CCommandBuffer::CRenderCommand *pCommand);
+	void Cmd_Buffer_Create(const CCommandBuffer::CBufferCreateCommand *pCommand);
+	void Cmd_Buffer_Destroy(const CCommandBuffer::CBufferDestroyCommand *pCommand);
+	virtual void Cmd_RenderBuffer(const CCommandBuffer::CRenderBufferCommand *pCommand);
+	virtual void Cmd_RenderTilemap(const CCommandBuffer::CRenderTilemapCommand *pCommand);
+	void Cmd_RenderInstances(const CCommandBuffer::CRenderInstancesCommand *pCommand);
+	void Cmd_RenderTarget(const CCommandBuffer::CRenderTargetCommand *pCommand);
 	void Cmd_Screenshot(const CCommandBuffer::CScreenshotCommand *pCommand);
+	void Cmd_Readback(const CCommandBuffer::CReadbackCommand *pCommand);
+	void Cmd_ReadbackFinish(const CCommandBuffer::CReadbackFinishCommand *pCommand);
+	void Cmd_GpuTimer(const CCommandBuffer::CGpuTimerCommand *pCommand);
 
 public:
 	CCommandProcessorFragment_OpenGL();
+	virtual ~CCommandProcessorFragment_OpenGL();
 
 	bool RunCommand(const CCommandBuffer::CCommand * pBaseCommand);
 };
 
+// renders with an OpenGL 3.3 core profile context, vertices are streamed into a
+// buffer object and drawn through shaders instead of the fixed function pipeline
+class CCommandProcessorFragment_OpenGL3 : public CCommandProcessorFragment_OpenGL
+{
+	enum
+	{
+		STREAM_BUFFER_SIZE = 4*1024*1024,
+
+		ATTRIB_POS = 0,
+		ATTRIB_TEX,
+		ATTRIB_COLOR,
+
+		PROGRAM_UNTEXTURED = 0,
+		PROGRAM_TEX2D,
+		PROGRAM_TEX3D,
+		NUM_PROGRAMS
+	};
+
+	PFNGLGENVERTEXARRAYSPROC m_pfnGenVertexArrays;
+	PFNGLDELETEVERTEXARRAYSPROC m_pfnDeleteVertexArrays;
+	PFNGLBINDVERTEXARRAYPROC m_pfnBindVertexArray;
+	PFNGLVERTEXATTRIBPOINTERPROC m_pfnVertexAttribPointer;
+	PFNGLENABLEVERTEXATTRIBARRAYPROC m_pfnEnableVertexAttribArray;
+	PFNGLDISABLEVERTEXATTRIBARRAYPROC m_pfnDisableVertexAttribArray;
+	PFNGLVERTEXATTRIB4FPROC m_pfnVertexAttrib4f;
+	PFNGLMAPBUFFERRANGEPROC m_pfnMapBufferRange;
+	PFNGLUNIFORM4FPROC m_pfnUniform4f;
+	PFNGLGETSTRINGIPROC m_pfnGetStringi;
+
+	GLuint m_VertexArray;
+
+	// the stream buffer is filled front to back and orphaned once it is full,
+	// the driver then hands out new storage while the gpu still reads the old one
+	GLuint m_StreamBuffer;
+	unsigned m_StreamBufferSize;
+	unsigned m_StreamOffset;
+
+	// quads are drawn as two triangles each
+	GLuint m_QuadIndexBuffer;
+	unsigned m_MaxIndexedQuads;
+
+	GLuint m_aPrograms[NUM_PROGRAMS];
+	GLint m_aScreenLocations[NUM_PROGRAMS];
+	GLint m_TilemapScreenLocation;
+	float m_aScreen[4];
+
+	bool InitFunctions();
+	bool InitPrograms();
+	void SetScreen(const CCommandBuffer::CState &State);
+	void UseProgram(GLuint Program, GLint ScreenLocation);
+	unsigned StreamVertices(const void *pData, unsigned Size);
+	void PrepareQuadIndices(unsigned NumQuads);
+	void DrawQuads(unsigned NumQuads);
+
+	virtual void SetState(const CCommandBuffer::CState &State);
+	virtual void RenderVertices(const CCommandBuffer::CVertex *pVertices, int PrimType, int PrimCount);
+	virtual void Cmd_Init(const CInitCommand *pCommand);
+	virtual void Cmd_RenderBuffer(const CCommandBuffer::CRenderBufferCommand *pCommand);
+	virtual void Cmd_RenderTilemap(const CCommandBuffer::CRenderTilemapCommand *pCommand);
+
+public:
+	CCommandProcessorFragment_OpenGL3();
+
+	// checks the current context for the functions this fragment needs
+	static bool IsSupported();
+};
+
 // takes care of sdl related commands
 class CCommandProcessorFragment_SDL
 {
@@ -180,10 +382,12 @@ public:
 // command processor impelementation, uses the fragments to combine into one processor
 class CCommandProcessor_SDL_OpenGL : public CGraphicsBackend_Threaded::ICommandProcessor
 {
-	CCommandProcessorFragment_OpenGL m_OpenGL;
+	CCommandProcessorFragment_OpenGL *m_pOpenGL;
 	CCommandProcessorFragment_SDL m_SDL;
 	CCommandProcessorFragment_General m_General;
  public:
+	CCommandProcessor_SDL_OpenGL(bool CoreProfile);
+	virtual ~CCommandProcessor_SDL_OpenGL();
 	virtual void RunBuffer(CCommandBuffer *pBuffer);
 };
 
@@ -196,12 +400,25 @@ class CGraphicsBackend_SDL_OpenGL : public CGraphicsBackend_Threaded
 	volatile int m_TextureMemoryUsage;
 	int m_NumScreens;
 	int m_TextureArraySize;
+	bool m_VertexBuffers;
+	bool m_TilemapShader;
+	bool m_RenderTargets;
+	int m_MaxTextureSize;
+	bool m_GpuTimers;
+	mutable lock m_GpuTimesLock;
+	IGraphics::CGpuTimes m_GpuTimes;
 public:
 	virtual int Init(const char *pName, int *pScreen, int *pWindowWidth, int *pWindowHeight, int *pScreenWidth, int *pScreenHeight, int FsaaSamples, int Flags, int *pDesktopWidth, int *pDesktopHeight);
 	virtual int Shutdown();
 
 	virtual int MemoryUsage() const;
 	virtual int GetTextureArraySize() const { return m_TextureArraySize; }
+	virtual bool HasVertexBuffers() const { return m_VertexBuffers; }
+	virtual bool HasTilemapShader() const { return m_TilemapShader; }
+	virtual bool HasRenderTargets() const { return m_RenderTargets; }
+	virtual int MaxTextureSize() const { return m_MaxTextureSize; }
+	virtual bool HasGpuTimers() const { return m_GpuTimers; }
+	virtual void GetGpuTimes(IGraphics::CGpuTimes *pTimes) const;
 
 	virtual int GetNumScreens() const { return m_NumScreens; }
 
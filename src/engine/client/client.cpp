@@ -28,12 +28,16 @@
 #include <engine/shared/datafile.h>
 #include <engine/shared/demo.h>
 #include <engine/shared/filecollection.h>
+#include <engine/shared/mapcache.h>
 #include <engine/shared/mapchecker.h>
+#include <engine/shared/memheap.h>
 #include <engine/shared/network.h>
 #include <engine/shared/packer.h>
 #include <engine/shared/protocol.h>
 #include <engine/shared/ringbuffer.h>
 #include <engine/shared/snapshot.h>
+#include <engine/shared/threadtopology.h>
+#include <engine/shared/tracer.h>
 
 #include <game/version.h>
 
@@ -138,6 +142,20 @@ void CGraph::Render(IGraphics *pGraphics, IGraphics::CTextureHandle FontTexture,
 }
 
 
+void CClient::ResetNetTiming()
+{
+	// a lost snapshot is hidden by buffering one more tick
+	m_SnapTiming.Init(0, 0, MAX_NET_MARGIN, 1000/50);
+	m_PredTiming.Init(PREDICTION_MARGIN, 0, MAX_NET_MARGIN, 0);
+	m_LastSnapTick = 0;
+	m_SnapInterval = SERVER_TICK_SPEED;
+	m_SnapMargin = m_SnapTiming.Margin();
+	m_SnapJitter = 0;
+	m_SnapLoss = 0;
+	m_PredMargin = m_PredTiming.Margin();
+	m_PredJitter = 0;
+}
+
 void CSmoothTime::Init(int64 Target)
 {
 	m_Snap = time_get();
@@ -248,6 +266,8 @@ CClient::CClient() : m_DemoPlayer(&m_SnapshotDelta), m_DemoRecorder(&m_SnapshotD
 	m_pConsole = 0;
 
 	m_RenderFrameTime = 0.0001f;
+	m_QualityLevel = 1.0f;
+	ResetNetTiming();
 	m_RenderFrameTimeLow = 1.0f;
 	m_RenderFrameTimeHigh = 0.0f;
 	m_RenderFrames = 0;
@@ -259,14 +279,24 @@ CClient::CClient() : m_DemoPlayer(&m_SnapshotDelta), m_DemoRecorder(&m_SnapshotD
 
 	m_WindowMustRefocus = 0;
 	m_SnapCrcErrors = 0;
+	m_DemoRecItemsSize = 0;
+	m_DemoRecItemsBuilding = false;
 	m_AutoScreenshotRecycle = false;
 	m_AutoStatScreenshotRecycle = false;
 	m_EditorActive = false;
 
 	m_AckGameTick = -1;
 	m_CurrentRecvTick = 0;
+	m_SnapBitpacked = false;
 	m_RconAuthed = 0;
 
+	m_pNetThread = 0;
+	m_NetThreadRunning = false;
+	m_NetLock = lock_create();
+	m_NetGeneration = 0;
+	m_pNetQueue = 0;
+	m_pSnapshotQueue = 0;
+
 	// version-checking
 	m_aVersionStr[0] = '0';
 	m_aVersionStr[1] = 0;
@@ -281,6 +311,7 @@ CClient::CClient() : m_DemoPlayer(&m_SnapshotDelta), m_DemoRecorder(&m_SnapshotD
 
 	//
 	m_aCmdConnect[0] = 0;
+	m_aTraceFilename[0] = 0;
 
 	// map download
 	m_aMapdownloadFilename[0] = 0;
@@ -293,6 +324,13 @@ CClient::CClient() : m_DemoPlayer(&m_SnapshotDelta), m_DemoRecorder(&m_SnapshotD
 	m_MapdownloadCrc = 0;
 	m_MapdownloadAmount = -1;
 	m_MapdownloadTotalsize = -1;
+	m_MapdownloadResumable = false;
+	m_MapdownloadRangeRequests = false;
+	m_MapdownloadWindow = 0;
+	m_MapdownloadWindowEnd = 0;
+	m_MapdownloadRequestTime = 0;
+	m_MapdownloadBestTime = 0;
+	m_MapPrefetchFileTemp = 0;
 
 	m_CurrentInput = 0;
 
@@ -302,6 +340,7 @@ CClient::CClient() : m_DemoPlayer(&m_SnapshotDelta), m_DemoRecorder(&m_SnapshotD
 
 	mem_zero(m_aSnapshots, sizeof(m_aSnapshots));
 	m_SnapshotStorage.Init();
+	m_RecvSnapshotStorage.Init();
 	m_ReceivedSnapshots = 0;
 
 	m_VersionInfo.m_State = CVersionInfo::STATE_INIT;
@@ -332,7 +371,11 @@ int CClient::SendMsg(CMsgPacker *pMsg, int Flags)
 	}
 
 	if(!(Flags&MSGFLAG_NOSEND))
+	{
+		lock_wait(m_NetLock);
 		m_NetClient.Send(&Packet);
+		lock_unlock(m_NetLock);
+	}
 	return 0;
 }
 
@@ -348,6 +391,9 @@ void CClient::SendInfo()
 	Msg.AddString(GameClient()->NetVersion(), 128);
 	Msg.AddString(m_aServerPassword, 128);
 	Msg.AddInt(GameClient()->ClientVersion());
+	Msg.AddInt(CLIENTCAP_MAPLIST_BATCH|CLIENTCAP_SNAP_BITPACKED|(Config()->m_ClMapPrefetch ? CLIENTCAP_MAP_PREFETCH : 0)|
+		(Config()->m_ClAdaptiveMargins ? CLIENTCAP_INPUT_MARGIN : 0));
+	Msg.AddInt(m_SnapshotDelta.FieldBitsHash());
 	SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
 }
 
@@ -358,6 +404,19 @@ void CClient::SendEnterGame()
 	SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
 }
 
+void CClient::RequestMapData()
+{
+	CMsgPacker Msg(NETMSG_REQUEST_MAP_DATA, true);
+	if(m_MapdownloadRangeRequests)
+	{
+		Msg.AddInt(m_MapdownloadChunk);
+		Msg.AddInt(m_MapdownloadWindow);
+	}
+	SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+	m_MapdownloadWindowEnd = m_MapdownloadChunk+m_MapdownloadWindow;
+	m_MapdownloadRequestTime = time_get();
+}
+
 void CClient::SendReady()
 {
 	CMsgPacker Msg(NETMSG_READY, true);
@@ -383,7 +442,10 @@ void CClient::Rcon(const char *pCmd)
 
 bool CClient::ConnectionProblems() const
 {
-	return m_NetClient.GotProblems() != 0;
+	lock_wait(m_NetLock);
+	bool Problems = m_NetClient.GotProblems();
+	lock_unlock(m_NetLock);
+	return Problems;
 }
 
 int CClient::GetInputtimeMarginStabilityScore()
@@ -410,6 +472,7 @@ void CClient::SendInput()
 	Msg.AddInt(m_PredTick);
 	Msg.AddInt(Size);
 
+	m_aInputs[m_CurrentInput].m_Size = Size;
 	m_aInputs[m_CurrentInput].m_Tick = m_PredTick;
 	m_aInputs[m_CurrentInput].m_PredictedTime = m_PredictedTime.Get(Now);
 	m_aInputs[m_CurrentInput].m_Time = Now;
@@ -424,6 +487,32 @@ void CClient::SendInput()
 		PingCorrection = (int)(((Now-TagTime)*1000)/time_freq());
 	Msg.AddInt(PingCorrection);
 
+	// repeat the last inputs, each as the difference to the one after it, so the
+	// server can fill in the ones that got lost. older servers ignore them
+	int aRedundant[MAX_REDUNDANT_INPUTS];
+	int NumRedundant = 0;
+	int Newer = m_CurrentInput;
+	while(NumRedundant < min(Config()->m_ClInputRedundancy, (int)MAX_REDUNDANT_INPUTS))
+	{
+		int Index = (Newer+200-1)%200;
+		if(m_aInputs[Index].m_Tick <= 0 || m_aInputs[Index].m_Tick >= m_aInputs[Newer].m_Tick || m_PredTick-m_aInputs[Index].m_Tick > SERVER_TICK_SPEED)
+			break;
+		aRedundant[NumRedundant++] = Index;
+		Newer = Index;
+	}
+
+	Msg.AddInt(NumRedundant);
+	Newer = m_CurrentInput;
+	for(int k = 0; k < NumRedundant; k++)
+	{
+		int Index = aRedundant[k];
+		Msg.AddInt(m_aInputs[Newer].m_Tick-m_aInputs[Index].m_Tick);
+		Msg.AddInt(m_aInputs[Index].m_Size);
+		for(int i = 0; i < m_aInputs[Index].m_Size/4; i++)
+			Msg.AddInt(m_aInputs[Index].m_aData[i] - (i < m_aInputs[Newer].m_Size/4 ? m_aInputs[Newer].m_aData[i] : 0));
+		Newer = Index;
+	}
+
 	m_CurrentInput++;
 	m_CurrentInput%=200;
 
@@ -486,9 +575,13 @@ void CClient::OnEnterGame()
 	m_aSnapshots[SNAP_PREV] = 0;
 	m_SnapshotStorage.PurgeAll();
 	m_ReceivedSnapshots = 0;
-	m_SnapshotParts = 0;
 	m_PredTick = 0;
+	lock_wait(m_NetLock);
+	m_RecvSnapshotStorage.PurgeAll();
+	m_SnapshotParts = 0;
 	m_CurrentRecvTick = 0;
+	m_SnapBitpacked = false;
+	lock_unlock(m_NetLock);
 	m_CurGameTick = 0;
 	m_PrevGameTick = 0;
 	m_CurMenuTick = 0;
@@ -551,7 +644,10 @@ void CClient::Connect(const char *pAddress)
 	m_UseTempRconCommands = 0;
 	if(m_ServerAddress.port == 0)
 		m_ServerAddress.port = Port;
+	lock_wait(m_NetLock);
 	m_NetClient.Connect(&m_ServerAddress);
+	m_NetGeneration++;
+	lock_unlock(m_NetLock);
 	SetState(IClient::STATE_CONNECTING);
 
 	if(m_DemoRecorder.IsRecording())
@@ -583,23 +679,29 @@ void CClient::DisconnectWithReason(const char *pReason)
 	m_RconAuthed = 0;
 	m_UseTempRconCommands = 0;
 	m_pConsole->DeregisterTempAll();
+	lock_wait(m_NetLock);
 	m_NetClient.Disconnect(pReason);
+	m_NetGeneration++;
+	lock_unlock(m_NetLock);
 	SetState(IClient::STATE_OFFLINE);
 	m_pMap->Unload();
 
-	// disable all downloads
+	// disable all downloads, a resumable one is continued on the next connect
 	m_MapdownloadChunk = 0;
 	if(m_MapdownloadFileTemp)
 	{
 		io_close(m_MapdownloadFileTemp);
-		Storage()->RemoveFile(m_aMapdownloadFilenameTemp, IStorage::TYPE_SAVE);
+		if(!m_MapdownloadResumable)
+			Storage()->RemoveFile(m_aMapdownloadFilenameTemp, IStorage::TYPE_SAVE);
 	}
 	m_MapdownloadFileTemp = 0;
+	m_MapdownloadResumable = false;
 	m_MapdownloadSha256 = SHA256_ZEROED;
 	m_MapdownloadSha256Present = false;
 	m_MapdownloadCrc = 0;
 	m_MapdownloadTotalsize = -1;
 	m_MapdownloadAmount = 0;
+	ResetMapPrefetch();
 
 	// clear the current server info
 	mem_zero(&m_CurrentServerInfo, sizeof(m_CurrentServerInfo));
@@ -673,11 +775,28 @@ int CClient::SnapNumItems(int SnapID) const
 	return m_aSnapshots[SnapID]->m_pSnap->NumItems();
 }
 
+const CSnapshot *CClient::SnapGetSnapshot(int SnapID) const
+{
+	dbg_assert(SnapID >= 0 && SnapID < NUM_SNAPSHOT_TYPES, "invalid SnapID");
+	if(!m_aSnapshots[SnapID])
+		return 0;
+	return m_aSnapshots[SnapID]->m_pAltSnap;
+}
+
 void *CClient::SnapNewItem(int Type, int ID, int Size)
 {
 	dbg_assert(Type >= 0 && Type <=0xffff, "incorrect type");
 	dbg_assert(ID >= 0 && ID <=0xffff, "incorrect id");
-	return ID < 0 ? 0 : m_DemoRecSnapshotBuilder.NewItem(Type, ID, Size);
+	if(ID < 0)
+		return 0;
+
+	// the first new item starts over
+	if(!m_DemoRecItemsBuilding)
+	{
+		m_DemoRecSnapshotBuilder.Init();
+		m_DemoRecItemsBuilding = true;
+	}
+	return m_DemoRecSnapshotBuilder.NewItem(Type, ID, Size);
 }
 
 void CClient::SnapSetStaticsize(int ItemType, int Size)
@@ -685,6 +804,11 @@ void CClient::SnapSetStaticsize(int ItemType, int Size)
 	m_SnapshotDelta.SetStaticsize(ItemType, Size);
 }
 
+void CClient::SnapSetFieldBits(int ItemType, const unsigned char *pBits, int Num)
+{
+	m_SnapshotDelta.SetFieldBits(ItemType, pBits, Num);
+}
+
 
 void CClient::DebugRender()
 {
@@ -693,6 +817,7 @@ void CClient::DebugRender()
 
 	static NETSTATS Prev, Current;
 	static int64 LastSnap = 0;
+	static int64 s_aPrevStall[2] = {0}, s_aStall[2] = {0};
 	static float FrameTimeAvg = 0;
 	static IGraphics::CTextureHandle s_Font = Graphics()->LoadTexture("ui/debug_font.png", IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, IGraphics::TEXLOAD_NORESAMPLE);
 	char aBuffer[256];
@@ -708,6 +833,9 @@ void CClient::DebugRender()
 		LastSnap = time_get();
 		Prev = Current;
 		net_stats(&Current);
+		s_aPrevStall[0] = s_aStall[0];
+		s_aPrevStall[1] = s_aStall[1];
+		Graphics()->GetStallTimes(&s_aStall[0], &s_aStall[1]);
 	}
 
 	/*
@@ -755,9 +883,15 @@ void CClient::DebugRender()
 		}
 	}
 
-	str_format(aBuffer, sizeof(aBuffer), "pred: %d ms",
-		(int)((m_PredictedTime.Get(Now)-m_GameTime.Get(Now))*1000/(float)time_freq()));
+	str_format(aBuffer, sizeof(aBuffer), "pred: %d ms quality: %.3f (p90 %.2f ms)",
+		(int)((m_PredictedTime.Get(Now)-m_GameTime.Get(Now))*1000/(float)time_freq()),
+		m_QualityLevel, m_QualityGovernor.Percentile()*1000.0f);
 	Graphics()->QuadsText(2, 70, 16, aBuffer);
+
+	str_format(aBuffer, sizeof(aBuffer), "gfx stall: queue %.1f ms/s frame %.1f ms/s (%d buffers, %d frames)",
+		(s_aStall[0]-s_aPrevStall[0])*1000.0f/time_freq(), (s_aStall[1]-s_aPrevStall[1])*1000.0f/time_freq(),
+		Config()->m_GfxCommandBuffers, Config()->m_GfxFramesInFlight);
+	Graphics()->QuadsText(2, 82, 16, aBuffer);
 	Graphics()->QuadsEnd();
 
 	// render graphs
@@ -806,7 +940,9 @@ const char *CClient::LoadMap(const char *pName, const char *pFilename, const SHA
 
 	SetState(IClient::STATE_LOADING);
 
-	if(!m_pMap->Load(pFilename))
+	// skip hashing maps that are known and unchanged
+	const CMapCache::CEntry *pCached = m_MapCache.FindPath(pFilename);
+	if(!m_pMap->Load(pFilename, 0, pCached ? &pCached->m_Sha256 : 0, pCached ? pCached->m_Crc : 0))
 	{
 		str_format(aErrorMsg, sizeof(aErrorMsg), "map '%s' not found", pFilename);
 		return aErrorMsg;
@@ -845,6 +981,8 @@ const char *CClient::LoadMap(const char *pName, const char *pFilename, const SHA
 	str_copy(m_aCurrentMapPath, pFilename, sizeof(m_aCurrentMapPath));
 	m_CurrentMapSha256 = m_pMap->Sha256();
 	m_CurrentMapCrc = m_pMap->Crc();
+	if(!pCached)
+		m_MapCache.Add(pFilename, &m_CurrentMapSha256, m_CurrentMapCrc);
 
 	return 0x0;
 }
@@ -853,7 +991,12 @@ const char *CClient::LoadMap(const char *pName, const char *pFilename, const SHA
 static void FormatMapDownloadFilename(const char *pName, const SHA256_DIGEST *pSha256, int Crc, bool Temp, char *pBuffer, int BufferSize)
 {
 	char aSuffix[32];
-	if(Temp)
+	if(Temp && pSha256)
+	{
+		// the hash names the content, so another client can go on with it
+		str_copy(aSuffix, ".part", sizeof(aSuffix));
+	}
+	else if(Temp)
 	{
 		str_format(aSuffix, sizeof(aSuffix), ".%d.tmp", pid());
 	}
@@ -891,6 +1034,19 @@ const char *CClient::LoadMapSearch(const char *pMapName, const SHA256_DIGEST *pW
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client", aBuf);
 	SetState(IClient::STATE_LOADING);
 
+	// try the map cache
+	if(pWantedSha256)
+	{
+		const CMapCache::CEntry *pCached = m_MapCache.Find(pWantedSha256, WantedCrc);
+		if(pCached)
+		{
+			str_copy(aBuf, pCached->m_aPath, sizeof(aBuf));
+			pError = LoadMap(pMapName, aBuf, pWantedSha256, WantedCrc);
+			if(!pError)
+				return pError;
+		}
+	}
+
 	// try the normal maps folder
 	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
 	pError = LoadMap(pMapName, aBuf, pWantedSha256, WantedCrc);
@@ -921,6 +1077,48 @@ const char *CClient::LoadMapSearch(const char *pMapName, const SHA256_DIGEST *pW
 	return pError;
 }
 
+bool CClient::MapAvailable(const char *pMapName, const SHA256_DIGEST *pWantedSha256, int WantedCrc)
+{
+	if(m_MapCache.Find(pWantedSha256, WantedCrc))
+		return true;
+
+	char aBuf[IO_MAX_PATH_LENGTH];
+	FormatMapDownloadFilename(pMapName, pWantedSha256, WantedCrc, false, aBuf, sizeof(aBuf));
+	IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(File)
+	{
+		io_close(File);
+		return true;
+	}
+
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+	File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+		return false;
+	bool Found = CDataFileReader::CheckSha256(File, pWantedSha256);
+	io_close(File);
+	return Found;
+}
+
+void CClient::ResetMapPrefetch()
+{
+	if(m_MapPrefetchFileTemp)
+	{
+		io_close(m_MapPrefetchFileTemp);
+		Storage()->RemoveFile(m_aMapPrefetchFilenameTemp, IStorage::TYPE_SAVE);
+	}
+	m_MapPrefetchFileTemp = 0;
+}
+
+void CClient::RequestMapPrefetch()
+{
+	CMsgPacker Msg(NETMSG_REQUEST_MAP_PREFETCH, true);
+	Msg.AddInt(m_MapPrefetchCrc);
+	Msg.AddInt(m_MapPrefetchChunk);
+	Msg.AddInt(MAP_PREFETCH_CHUNKS_PER_REQUEST);
+	SendMsg(&Msg, MSGFLAG_VITAL);
+}
+
 int CClient::UnpackServerInfo(CUnpacker *pUnpacker, CServerInfo *pInfo, int *pToken)
 {
 	if(pToken)
@@ -1016,6 +1214,28 @@ inline void SortClients(CServerInfo *pInfo)
 		(pInfo->m_Flags&IServerBrowser::FLAG_TIMESCORE) ? CompareTime : CompareScore);
 }
 
+static void UnpackMastersrvAddr(const CMastersrvAddr *pIn, NETADDR *pOut)
+{
+	static unsigned char s_aIPV4Mapping[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
+
+	// copy address
+	mem_zero(pOut, sizeof(*pOut));
+	if(!mem_comp(s_aIPV4Mapping, pIn->m_aIp, sizeof(s_aIPV4Mapping)))
+	{
+		pOut->type = NETTYPE_IPV4;
+		pOut->ip[0] = pIn->m_aIp[12];
+		pOut->ip[1] = pIn->m_aIp[13];
+		pOut->ip[2] = pIn->m_aIp[14];
+		pOut->ip[3] = pIn->m_aIp[15];
+	}
+	else
+	{
+		pOut->type = NETTYPE_IPV6;
+		mem_copy(pOut->ip, pIn->m_aIp, sizeof(pOut->ip));
+	}
+	pOut->port = (pIn->m_aPort[0]<<8) | pIn->m_aPort[1];
+}
+
 void CClient::ProcessConnlessPacket(CNetChunk *pPacket)
 {
 	// version server
@@ -1066,11 +1286,16 @@ void CClient::ProcessConnlessPacket(CNetChunk *pPacket)
 	}
 
 	// server list from master server
-	if(pPacket->m_DataSize >= (int)sizeof(SERVERBROWSE_LIST) &&
-		mem_comp(pPacket->m_pData, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST)) == 0)
+	bool List = pPacket->m_DataSize >= (int)sizeof(SERVERBROWSE_LIST) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST)) == 0;
+	bool ListInfo = pPacket->m_DataSize == (int)(sizeof(SERVERBROWSE_LISTINFO)+sizeof(CMastersrvListInfo)) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_LISTINFO, sizeof(SERVERBROWSE_LISTINFO)) == 0;
+	bool ListDelta = pPacket->m_DataSize >= (int)(sizeof(SERVERBROWSE_LISTDELTA)+sizeof(CMastersrvListDelta)-sizeof(CMastersrvListDelta::m_aServers)) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_LISTDELTA, sizeof(SERVERBROWSE_LISTDELTA)) == 0;
+	if(List || ListInfo || ListDelta)
 	{
 		// check for valid master server address
-		bool Valid = false;
+		int MasterIndex = -1;
 		for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; ++i)
 		{
 			if(m_pMasterServer->IsValid(i))
@@ -1078,41 +1303,44 @@ void CClient::ProcessConnlessPacket(CNetChunk *pPacket)
 				NETADDR Addr = m_pMasterServer->GetAddr(i);
 				if(net_addr_comp(&pPacket->m_Address, &Addr, true) == 0)
 				{
-					Valid = true;
+					MasterIndex = i;
 					break;
 				}
 			}
 		}
-		if(!Valid)
+		if(MasterIndex == -1)
 			return;
 
-		int Size = pPacket->m_DataSize-sizeof(SERVERBROWSE_LIST);
-		int Num = Size/sizeof(CMastersrvAddr);
-		CMastersrvAddr *pAddrs = (CMastersrvAddr *)((char*)pPacket->m_pData+sizeof(SERVERBROWSE_LIST));
-		for(int i = 0; i < Num; i++)
+		if(List)
 		{
-			NETADDR Addr;
-
-			static unsigned char s_aIPV4Mapping[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
-
-			// copy address
-			if(!mem_comp(s_aIPV4Mapping, pAddrs[i].m_aIp, sizeof(s_aIPV4Mapping)))
-			{
-				mem_zero(&Addr, sizeof(Addr));
-				Addr.type = NETTYPE_IPV4;
-				Addr.ip[0] = pAddrs[i].m_aIp[12];
-				Addr.ip[1] = pAddrs[i].m_aIp[13];
-				Addr.ip[2] = pAddrs[i].m_aIp[14];
-				Addr.ip[3] = pAddrs[i].m_aIp[15];
-			}
-			else
+			int Size = pPacket->m_DataSize-sizeof(SERVERBROWSE_LIST);
+			int Num = min(Size/(int)sizeof(CMastersrvAddr), (int)(NET_MAX_PAYLOAD/sizeof(CMastersrvAddr)));
+			const CMastersrvAddr *pAddrs = (const CMastersrvAddr *)((char*)pPacket->m_pData+sizeof(SERVERBROWSE_LIST));
+			NETADDR aServers[NET_MAX_PAYLOAD/sizeof(CMastersrvAddr)];
+			for(int i = 0; i < Num; i++)
+				UnpackMastersrvAddr(&pAddrs[i], &aServers[i]);
+			m_ServerBrowser.OnMasterList(MasterIndex, aServers, Num);
+		}
+		else if(ListInfo)
+		{
+			const CMastersrvListInfo *pInfo = (const CMastersrvListInfo *)((char*)pPacket->m_pData+sizeof(SERVERBROWSE_LISTINFO));
+			m_ServerBrowser.OnMasterListInfo(MasterIndex, MastersrvUnpackInt(pInfo->m_aEpoch, 4),
+				MastersrvUnpackInt(pInfo->m_aGeneration, 4), MastersrvUnpackInt(pInfo->m_aNumPackets, 2));
+		}
+		else
+		{
+			const CMastersrvListDelta *pDelta = (const CMastersrvListDelta *)((char*)pPacket->m_pData+sizeof(SERVERBROWSE_LISTDELTA));
+			int Size = pPacket->m_DataSize-(sizeof(SERVERBROWSE_LISTDELTA)+sizeof(CMastersrvListDelta)-sizeof(pDelta->m_aServers));
+			int Num = min(Size/(int)sizeof(CMastersrvDeltaAddr), (int)MASTERSRV_DELTA_PER_PACKET);
+			NETADDR aServers[MASTERSRV_DELTA_PER_PACKET];
+			bool aAdded[MASTERSRV_DELTA_PER_PACKET];
+			for(int i = 0; i < Num; i++)
 			{
-				Addr.type = NETTYPE_IPV6;
-				mem_copy(Addr.ip, pAddrs[i].m_aIp, sizeof(Addr.ip));
+				UnpackMastersrvAddr(&pDelta->m_aServers[i].m_Addr, &aServers[i]);
+				aAdded[i] = pDelta->m_aServers[i].m_Added != 0;
 			}
-			Addr.port = (pAddrs[i].m_aPort[0]<<8) | pAddrs[i].m_aPort[1];
-
-			m_ServerBrowser.Set(Addr, CServerBrowser::SET_MASTER_ADD, -1, 0x0);
+			m_ServerBrowser.OnMasterListDelta(MasterIndex, MastersrvUnpackInt(pDelta->m_aEpoch, 4), MastersrvUnpackInt(pDelta->m_aBaseGeneration, 4),
+				MastersrvUnpackInt(pDelta->m_aGeneration, 4), MastersrvUnpackInt(pDelta->m_aNumPackets, 2), aServers, aAdded, Num);
 		}
 	}
 
@@ -1158,6 +1386,8 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 			if(Unpacker.Error())
 				return;
 			const SHA256_DIGEST *pMapSha256 = (const SHA256_DIGEST *)Unpacker.GetRaw(sizeof(*pMapSha256));
+			Unpacker.GetString(); // download url, no http client to use it
+			bool RangeRequests = Unpacker.GetInt() == 1 && !Unpacker.Error();
 			const char *pError = 0;
 
 			// check for valid standard map
@@ -1190,8 +1420,11 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 					if(m_MapdownloadFileTemp)
 					{
 						io_close(m_MapdownloadFileTemp);
-						Storage()->RemoveFile(m_aMapdownloadFilenameTemp, IStorage::TYPE_SAVE);
+						if(!m_MapdownloadResumable)
+							Storage()->RemoveFile(m_aMapdownloadFilenameTemp, IStorage::TYPE_SAVE);
 					}
+					// the download takes over, a prefetch can't be continued with it
+					ResetMapPrefetch();
 
 					// start map download
 					FormatMapDownloadFilename(pMap, pMapSha256, MapCrc, false, m_aMapdownloadFilename, sizeof(m_aMapdownloadFilename));
@@ -1202,19 +1435,46 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 					m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client/network", aBuf);
 
 					str_copy(m_aMapdownloadName, pMap, sizeof(m_aMapdownloadName));
-					m_MapdownloadFileTemp = Storage()->OpenFile(m_aMapdownloadFilenameTemp, IOFLAG_WRITE, IStorage::TYPE_SAVE);
 					m_MapdownloadChunk = 0;
-					m_MapdownloadChunkNum = MapChunkNum;
+					m_MapdownloadChunkNum = max(MapChunkNum, 1);
 					m_MapDownloadChunkSize = MapChunkSize;
 					m_MapdownloadSha256 = pMapSha256 ? *pMapSha256 : SHA256_ZEROED;
 					m_MapdownloadSha256Present = pMapSha256;
 					m_MapdownloadCrc = MapCrc;
 					m_MapdownloadTotalsize = MapSize;
 					m_MapdownloadAmount = 0;
+					m_MapdownloadResumable = pMapSha256 && RangeRequests && MapChunkSize > 0;
+					m_MapdownloadRangeRequests = RangeRequests;
+					m_MapdownloadWindow = m_MapdownloadChunkNum;
+					m_MapdownloadBestTime = 0;
+
+					// go on with what an earlier try left, it ends at a chunk unless it is cut off
+					m_MapdownloadFileTemp = 0;
+					if(m_MapdownloadResumable)
+					{
+						IOHANDLE File = Storage()->OpenFile(m_aMapdownloadFilenameTemp, IOFLAG_READ, IStorage::TYPE_SAVE);
+						if(File)
+						{
+							int Size = (int)io_length(File);
+							io_close(File);
+							if(Size > 0 && Size < MapSize && Size%MapChunkSize == 0)
+							{
+								m_MapdownloadFileTemp = Storage()->OpenFile(m_aMapdownloadFilenameTemp, IOFLAG_APPEND, IStorage::TYPE_SAVE);
+								if(m_MapdownloadFileTemp)
+								{
+									m_MapdownloadChunk = Size/MapChunkSize;
+									m_MapdownloadAmount = Size;
+									str_format(aBuf, sizeof(aBuf), "resuming download at %d bytes", Size);
+									m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client/network", aBuf);
+								}
+							}
+						}
+					}
+					if(!m_MapdownloadFileTemp)
+						m_MapdownloadFileTemp = Storage()->OpenFile(m_aMapdownloadFilenameTemp, IOFLAG_WRITE, IStorage::TYPE_SAVE);
 
 					// request first chunk package of map data
-					CMsgPacker Msg(NETMSG_REQUEST_MAP_DATA, true);
-					SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+					RequestMapData();
 
 					if(Config()->m_Debug)
 						m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client/network", "requested first chunk package");
@@ -1253,22 +1513,111 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 				const char *pError = LoadMap(m_aMapdownloadName, m_aMapdownloadFilename, m_MapdownloadSha256Present ? &m_MapdownloadSha256 : 0, m_MapdownloadCrc);
 				if(!pError)
 				{
+					if(Config()->m_ClMapCacheSize)
+						m_MapCache.Evict("downloadedmaps/", (int64)Config()->m_ClMapCacheSize*1024*1024, m_aMapdownloadFilename);
+					m_MapCache.Save();
 					m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client/network", "loading done");
 					SendReady();
 				}
 				else
 					DisconnectWithReason(pError);
 			}
-			else if(m_MapdownloadChunk%m_MapdownloadChunkNum == 0)
+			else if(m_MapdownloadChunk == m_MapdownloadWindowEnd)
 			{
+				// grow the window while its chunks arrive about as fast as the best ones, back off when they slow down
+				if(m_MapdownloadRangeRequests)
+				{
+					int64 Elapsed = (time_get()-m_MapdownloadRequestTime)/m_MapdownloadWindow;
+					if(!m_MapdownloadBestTime || Elapsed < m_MapdownloadBestTime)
+						m_MapdownloadBestTime = Elapsed;
+					if(Elapsed < m_MapdownloadBestTime*2)
+						m_MapdownloadWindow = min(m_MapdownloadWindow+1, (int)MAX_MAP_CHUNKS_PER_REQUEST);
+					else
+						m_MapdownloadWindow = max(m_MapdownloadWindow/2, 1);
+				}
+
 				// request next chunk package of map data
-				CMsgPacker Msg(NETMSG_REQUEST_MAP_DATA, true);
-				SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+				RequestMapData();
 
 				if(Config()->m_Debug)
 					m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client/network", "requested next chunk package");
 			}
 		}
+		else if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && Msg == NETMSG_MAP_PREFETCH)
+		{
+			const char *pMap = Unpacker.GetString(CUnpacker::SANITIZE_CC|CUnpacker::SKIP_START_WHITESPACES);
+			int MapCrc = Unpacker.GetInt();
+			int MapSize = Unpacker.GetInt();
+			int ChunkSize = Unpacker.GetInt();
+			const SHA256_DIGEST *pMapSha256 = (const SHA256_DIGEST *)Unpacker.GetRaw(sizeof(*pMapSha256));
+			if(Unpacker.Error() || !Config()->m_ClMapPrefetch || State() != IClient::STATE_ONLINE || m_MapdownloadFileTemp)
+				return;
+			if(m_MapPrefetchFileTemp && MapCrc == m_MapPrefetchCrc && *pMapSha256 == m_MapPrefetchSha256)
+				return;
+
+			bool Valid = m_MapChecker.IsMapValid(pMap, pMapSha256, MapCrc, MapSize) && MapSize > 0 && ChunkSize > 0 && ChunkSize <= NET_MAX_PAYLOAD;
+			for(int i = 0; pMap[i]; i++)
+			{
+				if(pMap[i] == '/' || pMap[i] == '\\')
+					Valid = false;
+			}
+			if(!Valid || MapAvailable(pMap, pMapSha256, MapCrc))
+				return;
+
+			ResetMapPrefetch();
+			FormatMapDownloadFilename(pMap, pMapSha256, MapCrc, false, m_aMapPrefetchFilename, sizeof(m_aMapPrefetchFilename));
+			str_format(m_aMapPrefetchFilenameTemp, sizeof(m_aMapPrefetchFilenameTemp), "downloadedmaps/%s_%08x.%d.prefetch.tmp", pMap, MapCrc, pid());
+			m_MapPrefetchFileTemp = Storage()->OpenFile(m_aMapPrefetchFilenameTemp, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+			if(!m_MapPrefetchFileTemp)
+				return;
+			m_MapPrefetchSha256 = *pMapSha256;
+			m_MapPrefetchCrc = MapCrc;
+			m_MapPrefetchSize = MapSize;
+			m_MapPrefetchChunkSize = ChunkSize;
+			m_MapPrefetchChunk = 0;
+			m_MapPrefetchAmount = 0;
+
+			char aBuf[256];
+			str_format(aBuf, sizeof(aBuf), "prefetching map '%s'", pMap);
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client/network", aBuf);
+			RequestMapPrefetch();
+		}
+		else if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && Msg == NETMSG_MAP_PREFETCH_DATA)
+		{
+			int MapCrc = Unpacker.GetInt();
+			int Chunk = Unpacker.GetInt();
+			if(Unpacker.Error() || !m_MapPrefetchFileTemp || MapCrc != m_MapPrefetchCrc || Chunk != m_MapPrefetchChunk)
+				return;
+			int Size = min(m_MapPrefetchChunkSize, m_MapPrefetchSize-m_MapPrefetchAmount);
+			const unsigned char *pData = Unpacker.GetRaw(Size);
+			if(Unpacker.Error())
+				return;
+
+			io_write(m_MapPrefetchFileTemp, pData, Size);
+			m_MapPrefetchChunk++;
+			m_MapPrefetchAmount += Size;
+
+			if(m_MapPrefetchAmount == m_MapPrefetchSize)
+			{
+				// keep it where the map search looks for downloaded maps, if it's the announced one
+				io_close(m_MapPrefetchFileTemp);
+				m_MapPrefetchFileTemp = 0;
+				IOHANDLE File = Storage()->OpenFile(m_aMapPrefetchFilenameTemp, IOFLAG_READ, IStorage::TYPE_SAVE);
+				bool Valid = File && CDataFileReader::CheckSha256(File, &m_MapPrefetchSha256);
+				if(File)
+					io_close(File);
+				if(Valid)
+				{
+					Storage()->RemoveFile(m_aMapPrefetchFilename, IStorage::TYPE_SAVE);
+					Storage()->RenameFile(m_aMapPrefetchFilenameTemp, m_aMapPrefetchFilename, IStorage::TYPE_SAVE);
+					m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client/network", "map prefetch complete");
+				}
+				else
+					Storage()->RemoveFile(m_aMapPrefetchFilenameTemp, IStorage::TYPE_SAVE);
+			}
+			else if(m_MapPrefetchChunk%MAP_PREFETCH_CHUNKS_PER_REQUEST == 0)
+				RequestMapPrefetch();
+		}
 		else if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && Msg == NETMSG_SERVERINFO)
 		{
 			CServerInfo Info = {0};
@@ -1284,6 +1633,12 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 		{
 			GameClient()->OnConnected();
 		}
+		else if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && Msg == NETMSG_SNAP_BITPACKED)
+		{
+			lock_wait(m_NetLock);
+			m_SnapBitpacked = true;
+			lock_unlock(m_NetLock);
+		}
 		else if(Msg == NETMSG_PING)
 		{
 			CMsgPacker Msg(NETMSG_PING_REPLY, true);
@@ -1315,6 +1670,20 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 			if(Unpacker.Error() == 0)
 				m_pConsole->DeregisterTempMap(pName);
 		}
+		else if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && (Msg == NETMSG_MAPLIST_ENTRIES_ADD || Msg == NETMSG_MAPLIST_ENTRIES_REM))
+		{
+			int Num = Unpacker.GetInt();
+			for(int i = 0; i < Num; i++)
+			{
+				const char *pName = Unpacker.GetString(CUnpacker::SANITIZE_CC);
+				if(Unpacker.Error())
+					break;
+				if(Msg == NETMSG_MAPLIST_ENTRIES_ADD)
+					m_pConsole->RegisterTempMap(pName);
+				else
+					m_pConsole->DeregisterTempMap(pName);
+			}
+		}
 		else if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && Msg == NETMSG_RCON_AUTH_ON)
 		{
 			m_RconAuthed = 1;
@@ -1352,7 +1721,14 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 				if(m_aInputs[k].m_Tick == InputPredTick)
 				{
 					Target = m_aInputs[k].m_PredictedTime + (time_get() - m_aInputs[k].m_Time);
-					Target = Target - (int64)(((TimeLeft-PREDICTION_MARGIN)/1000.0f)*time_freq());
+					int Margin = PREDICTION_MARGIN;
+					if(Config()->m_ClAdaptiveMargins)
+					{
+						m_PredTiming.AddSample(TimeLeft);
+						m_PredMargin = Margin = m_PredTiming.Margin();
+						m_PredJitter = m_PredTiming.Jitter();
+					}
+					Target = Target - (int64)(((TimeLeft-Margin)/1000.0f)*time_freq());
 					break;
 				}
 			}
@@ -1362,226 +1738,405 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 		}
 		else if(Msg == NETMSG_SNAP || Msg == NETMSG_SNAPSINGLE || Msg == NETMSG_SNAPEMPTY)
 		{
-			int NumParts = 1;
-			int Part = 0;
-			int GameTick = Unpacker.GetInt();
-			int DeltaTick = GameTick-Unpacker.GetInt();
-			int PartSize = 0;
-			int Crc = 0;
-			int CompleteSize = 0;
-			const char *pData = 0;
-
-			// we are not allowed to process snapshot yet
-			if(State() < IClient::STATE_LOADING)
-				return;
+			CScratch Scratch;
+			CSnapshot *pSnap = (CSnapshot *)Scratch.Allocate(CSnapshot::MAX_SIZE);
+			int GameTick, DeltaTick;
+			int SnapSize = UnpackSnapshot(Msg, &Unpacker, &m_SnapshotStorage, pSnap, &GameTick, &DeltaTick);
+			if(SnapSize >= 0)
+				OnSnapshot(GameTick, DeltaTick, time_get(), pSnap, SnapSize);
+		}
+	}
+	else
+	{
+		if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0)
+		{
+			// game message
+			GameClient()->OnMessage(Msg, &Unpacker);
 
-			if(Msg == NETMSG_SNAP)
-			{
-				NumParts = Unpacker.GetInt();
-				Part = Unpacker.GetInt();
-			}
+			if(m_RecordGameMessage && m_DemoRecorder.IsRecording())
+				m_DemoRecorder.RecordMessage(pPacket->m_pData, pPacket->m_DataSize);
+		}
+	}
+}
 
-			if(Msg != NETMSG_SNAPEMPTY)
-			{
-				Crc = Unpacker.GetInt();
-				PartSize = Unpacker.GetInt();
-			}
+int CClient::UnpackSnapshot(int Msg, CUnpacker *pUnpacker, CSnapshotStorage *pStorage, CSnapshot *pSnap, int *pGameTick, int *pDeltaTick)
+{
+	int NumParts = 1;
+	int Part = 0;
+	int GameTick = pUnpacker->GetInt();
+	int DeltaTick = GameTick-pUnpacker->GetInt();
+	int PartSize = 0;
+	int Crc = 0;
+	int CompleteSize = 0;
+	const char *pData = 0;
 
-			pData = (const char *)Unpacker.GetRaw(PartSize);
+	// we are not allowed to process snapshot yet
+	if(State() < IClient::STATE_LOADING)
+		return -1;
 
-			if(Unpacker.Error() || NumParts < 1 || NumParts > CSnapshot::MAX_PARTS || Part < 0 || Part >= NumParts || PartSize < 0 || PartSize > MAX_SNAPSHOT_PACKSIZE)
-				return;
+	if(Msg == NETMSG_SNAP)
+	{
+		NumParts = pUnpacker->GetInt();
+		Part = pUnpacker->GetInt();
+	}
 
-			if(GameTick >= m_CurrentRecvTick)
-			{
-				if(GameTick != m_CurrentRecvTick)
-				{
-					m_SnapshotParts = 0;
-					m_CurrentRecvTick = GameTick;
-				}
+	if(Msg != NETMSG_SNAPEMPTY)
+	{
+		Crc = pUnpacker->GetInt();
+		PartSize = pUnpacker->GetInt();
+	}
 
-				// TODO: clean this up abit
-				mem_copy((char*)m_aSnapshotIncomingData + Part*MAX_SNAPSHOT_PACKSIZE, pData, PartSize);
-				m_SnapshotParts |= 1<<Part;
+	pData = (const char *)pUnpacker->GetRaw(PartSize);
 
-				if(m_SnapshotParts == (unsigned)((1<<NumParts)-1))
-				{
-					static CSnapshot Emptysnap;
-					CSnapshot *pDeltaShot = &Emptysnap;
-					int PurgeTick;
-					void *pDeltaData;
-					int DeltaSize;
-					unsigned char aTmpBuffer2[CSnapshot::MAX_SIZE];
-					unsigned char aTmpBuffer3[CSnapshot::MAX_SIZE];
-					CSnapshot *pTmpBuffer3 = (CSnapshot*)aTmpBuffer3;	// Fix compiler warning for strict-aliasing
-					int SnapSize;
-
-					CompleteSize = (NumParts-1) * MAX_SNAPSHOT_PACKSIZE + PartSize;
-
-					// reset snapshoting
-					m_SnapshotParts = 0;
-
-					// find snapshot that we should use as delta
-					Emptysnap.Clear();
-
-					// find delta
-					if(DeltaTick >= 0)
-					{
-						int DeltashotSize = m_SnapshotStorage.Get(DeltaTick, 0, &pDeltaShot, 0);
+	if(pUnpacker->Error() || NumParts < 1 || NumParts > CSnapshot::MAX_PARTS || Part < 0 || Part >= NumParts || PartSize < 0 || PartSize > MAX_SNAPSHOT_PACKSIZE)
+		return -1;
 
-						if(DeltashotSize < 0)
-						{
-							// couldn't find the delta snapshots that the server used
-							// to compress this snapshot. force the server to resync
-							if(Config()->m_Debug)
-							{
-								char aBuf[256];
-								str_format(aBuf, sizeof(aBuf), "error, couldn't find the delta snapshot");
-								m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client", aBuf);
-							}
+	if(GameTick < m_CurrentRecvTick)
+		return -1;
 
-							// ack snapshot
-							// TODO: combine this with the input message
-							m_AckGameTick = -1;
-							return;
-						}
-					}
+	if(GameTick != m_CurrentRecvTick)
+	{
+		m_SnapshotParts = 0;
+		m_CurrentRecvTick = GameTick;
+	}
 
-					// decompress snapshot
-					pDeltaData = m_SnapshotDelta.EmptyDelta();
-					DeltaSize = sizeof(int)*3;
+	// TODO: clean this up abit
+	mem_copy((char*)m_aSnapshotIncomingData + Part*MAX_SNAPSHOT_PACKSIZE, pData, PartSize);
+	m_SnapshotParts |= 1<<Part;
 
-					if(CompleteSize)
-					{
-						int IntSize = CVariableInt::Decompress(m_aSnapshotIncomingData, CompleteSize, aTmpBuffer2, sizeof(aTmpBuffer2));
+	if(m_SnapshotParts != (unsigned)((1<<NumParts)-1))
+		return -1;
 
-						if(IntSize < 0) // failure during decompression, bail
-							return;
+	static CSnapshot Emptysnap;
+	CSnapshot *pDeltaShot = &Emptysnap;
+	void *pDeltaData;
+	int DeltaSize;
+	CScratch Scratch;
+	unsigned char *pTmpBuffer2 = (unsigned char *)Scratch.Allocate(CSnapshot::MAX_SIZE);
+	int SnapSize;
 
-						pDeltaData = aTmpBuffer2;
-						DeltaSize = IntSize;
-					}
+	CompleteSize = (NumParts-1) * MAX_SNAPSHOT_PACKSIZE + PartSize;
 
-					// unpack delta
-					SnapSize = m_SnapshotDelta.UnpackDelta(pDeltaShot, pTmpBuffer3, pDeltaData, DeltaSize);
-					if(SnapSize < 0)
-					{
-						m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client", "delta unpack failed!");
-						return;
-					}
+	// reset snapshoting
+	m_SnapshotParts = 0;
 
-					if(Msg != NETMSG_SNAPEMPTY && pTmpBuffer3->Crc() != Crc)
-					{
-						if(Config()->m_Debug)
-						{
-							char aBuf[256];
-							str_format(aBuf, sizeof(aBuf), "snapshot crc error #%d - tick=%d wantedcrc=%d gotcrc=%d compressed_size=%d delta_tick=%d",
-								m_SnapCrcErrors, GameTick, Crc, pTmpBuffer3->Crc(), CompleteSize, DeltaTick);
-							m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client", aBuf);
-						}
+	// find snapshot that we should use as delta
+	Emptysnap.Clear();
 
-						m_SnapCrcErrors++;
-						if(m_SnapCrcErrors > 10)
-						{
-							// to many errors, send reset
-							m_AckGameTick = -1;
-							SendInput();
-							m_SnapCrcErrors = 0;
-						}
-						return;
-					}
-					else
-					{
-						if(m_SnapCrcErrors)
-							m_SnapCrcErrors--;
-					}
+	// find delta
+	if(DeltaTick >= 0)
+	{
+		int DeltashotSize = pStorage->Get(DeltaTick, 0, &pDeltaShot, 0);
 
-					// purge old snapshots
-					PurgeTick = DeltaTick;
-					if(m_aSnapshots[SNAP_PREV] && m_aSnapshots[SNAP_PREV]->m_Tick < PurgeTick)
-						PurgeTick = m_aSnapshots[SNAP_PREV]->m_Tick;
-					if(m_aSnapshots[SNAP_CURRENT] && m_aSnapshots[SNAP_CURRENT]->m_Tick < PurgeTick)
-						PurgeTick = m_aSnapshots[SNAP_CURRENT]->m_Tick;
-					m_SnapshotStorage.PurgeUntil(PurgeTick);
+		if(DeltashotSize < 0)
+		{
+			// couldn't find the delta snapshots that the server used
+			// to compress this snapshot. force the server to resync
+			if(Config()->m_Debug)
+				SnapshotMsg("error, couldn't find the delta snapshot");
+
+			// ack snapshot
+			// TODO: combine this with the input message
+			m_AckGameTick = -1;
+			return -1;
+		}
+	}
 
-					// add new
-					m_SnapshotStorage.Add(GameTick, time_get(), SnapSize, pTmpBuffer3, 1);
+	// decompress snapshot
+	pDeltaData = m_SnapshotDelta.EmptyDelta();
+	DeltaSize = sizeof(int)*3;
 
-					// add snapshot to demo
-					if(m_DemoRecorder.IsRecording())
-					{
-						// build up snapshot and add local messages
-						m_DemoRecSnapshotBuilder.Init(pTmpBuffer3);
-						GameClient()->OnDemoRecSnap();
-						SnapSize = m_DemoRecSnapshotBuilder.Finish(pTmpBuffer3);
+	if(CompleteSize)
+	{
+		int IntSize;
+		if(m_SnapBitpacked)
+			IntSize = m_SnapshotDelta.UnpackBits(m_aSnapshotIncomingData, CompleteSize, pTmpBuffer2, CSnapshot::MAX_SIZE);
+		else
+			IntSize = CVariableInt::Decompress(m_aSnapshotIncomingData, CompleteSize, pTmpBuffer2, CSnapshot::MAX_SIZE);
 
-						// write snapshot
-						m_DemoRecorder.RecordSnapshot(GameTick, pTmpBuffer3, SnapSize);
-					}
+		if(IntSize < 0) // failure during decompression, bail
+			return -1;
 
-					// apply snapshot, cycle pointers
-					m_ReceivedSnapshots++;
+		pDeltaData = pTmpBuffer2;
+		DeltaSize = IntSize;
+	}
 
-					m_CurrentRecvTick = GameTick;
+	// unpack delta
+	SnapSize = m_SnapshotDelta.UnpackDelta(pDeltaShot, pSnap, pDeltaData, DeltaSize);
+	if(SnapSize < 0)
+	{
+		SnapshotMsg("delta unpack failed!");
+		return -1;
+	}
 
-					// we got two snapshots until we see us self as connected
-					if(m_ReceivedSnapshots == 2)
-					{
-						// start at 200ms and work from there
-						m_PredictedTime.Init(GameTick*time_freq()/50);
-						m_PredictedTime.SetAdjustSpeed(1, 1000.0f);
-						m_GameTime.Init((GameTick-1)*time_freq()/50);
-						m_aSnapshots[SNAP_PREV] = m_SnapshotStorage.m_pFirst;
-						m_aSnapshots[SNAP_CURRENT] = m_SnapshotStorage.m_pLast;
-						SetState(IClient::STATE_ONLINE);
-					}
+	if(Msg != NETMSG_SNAPEMPTY && pSnap->Crc() != Crc)
+	{
+		if(Config()->m_Debug)
+		{
+			char aBuf[256];
+			str_format(aBuf, sizeof(aBuf), "snapshot crc error #%d - tick=%d wantedcrc=%d gotcrc=%d compressed_size=%d delta_tick=%d",
+				m_SnapCrcErrors, GameTick, Crc, pSnap->Crc(), CompleteSize, DeltaTick);
+			SnapshotMsg(aBuf);
+		}
 
-					// adjust game time
-					if(m_ReceivedSnapshots > 2)
-					{
-						int64 Now = m_GameTime.Get(time_get());
-						int64 TickStart = GameTick*time_freq()/50;
-						int64 TimeLeft = (TickStart-Now)*1000 / time_freq();
-						m_GameTime.Update(&m_GametimeMarginGraph, (GameTick-1)*time_freq()/50, TimeLeft, 0);
-					}
+		m_SnapCrcErrors++;
+		if(m_SnapCrcErrors > 10)
+		{
+			// to many errors, send reset. the network thread leaves that to the next input
+			m_AckGameTick = -1;
+			if(!m_NetThreadRunning)
+				SendInput();
+			m_SnapCrcErrors = 0;
+		}
+		return -1;
+	}
+	else
+	{
+		if(m_SnapCrcErrors)
+			m_SnapCrcErrors--;
+	}
 
-					// ack snapshot
-					m_AckGameTick = GameTick;
-				}
+	m_CurrentRecvTick = GameTick;
+
+	// ack snapshot
+	m_AckGameTick = GameTick;
+
+	*pGameTick = GameTick;
+	*pDeltaTick = DeltaTick;
+	return SnapSize;
+}
+
+void CClient::OnSnapshot(int GameTick, int DeltaTick, int64 RecvTime, CSnapshot *pSnap, int SnapSize)
+{
+	// purge old snapshots
+	int PurgeTick = DeltaTick;
+	if(m_aSnapshots[SNAP_PREV] && m_aSnapshots[SNAP_PREV]->m_Tick < PurgeTick)
+		PurgeTick = m_aSnapshots[SNAP_PREV]->m_Tick;
+	if(m_aSnapshots[SNAP_CURRENT] && m_aSnapshots[SNAP_CURRENT]->m_Tick < PurgeTick)
+		PurgeTick = m_aSnapshots[SNAP_CURRENT]->m_Tick;
+	m_SnapshotStorage.PurgeUntil(PurgeTick);
+
+	// add new
+	m_SnapshotStorage.Add(GameTick, RecvTime, SnapSize, pSnap, 1);
+
+	// add snapshot to demo
+	if(m_DemoRecorder.IsRecording())
+	{
+		// update the demo items if they changed
+		m_DemoRecItemsBuilding = false;
+		GameClient()->OnDemoRecSnap(m_DemoRecItemsSize == 0);
+		if(m_DemoRecItemsBuilding)
+		{
+			m_DemoRecItemsSize = m_DemoRecSnapshotBuilder.Finish(m_aDemoRecItems);
+			m_DemoRecItemsBuilding = false;
+		}
+
+		// write the received snapshot with them
+		CScratch Scratch;
+		CSnapshot *pDemoSnap = (CSnapshot *)Scratch.Allocate(CSnapshot::MAX_SIZE);
+		int DemoSnapSize = m_DemoRecItemsSize ? CSnapshot::Merge(pSnap, (CSnapshot *)m_aDemoRecItems, pDemoSnap) : -1;
+		if(DemoSnapSize < 0)
+			m_DemoRecorder.RecordSnapshot(GameTick, pSnap, SnapSize);
+		else
+			m_DemoRecorder.RecordSnapshot(GameTick, pDemoSnap, DemoSnapSize);
+	}
+
+	// apply snapshot, cycle pointers
+	m_ReceivedSnapshots++;
+
+	// we got two snapshots until we see us self as connected
+	if(m_ReceivedSnapshots == 2)
+	{
+		// start at 200ms and work from there
+		m_PredictedTime.Init(GameTick*time_freq()/50);
+		m_PredictedTime.SetAdjustSpeed(1, 1000.0f);
+		m_GameTime.Init((GameTick-1)*time_freq()/50);
+		ResetNetTiming();
+		m_LastSnapTick = GameTick;
+		m_aSnapshots[SNAP_PREV] = m_SnapshotStorage.m_pFirst;
+		m_aSnapshots[SNAP_CURRENT] = m_SnapshotStorage.m_pLast;
+		SetState(IClient::STATE_ONLINE);
+	}
+
+	// adjust game time, by when the snapshot arrived rather than when it got here
+	if(m_ReceivedSnapshots > 2)
+	{
+		int64 Now = m_GameTime.Get(RecvTime);
+		int64 TickStart = GameTick*time_freq()/50;
+		int64 TimeLeft = (TickStart-Now)*1000 / time_freq();
+
+		// buffer as much more than a tick as the arrivals need, it is needed once the previous tick is rendered
+		int64 Target = (GameTick-1)*time_freq()/50;
+		if(Config()->m_ClAdaptiveMargins)
+		{
+			int Gap = GameTick - m_LastSnapTick;
+			if(Gap > 0)
+			{
+				m_SnapInterval = min(m_SnapInterval, Gap);
+				m_SnapTiming.AddLoss(Gap/m_SnapInterval - 1);
 			}
+			m_SnapTiming.AddSample((int)TimeLeft - 1000/50);
+			m_SnapMargin = m_SnapTiming.Margin();
+			m_SnapJitter = m_SnapTiming.Jitter();
+			m_SnapLoss = m_SnapTiming.LossPercent();
+			Target -= m_SnapMargin*time_freq()/1000;
 		}
+		m_LastSnapTick = max(m_LastSnapTick, GameTick);
+		m_GameTime.Update(&m_GametimeMarginGraph, Target, TimeLeft, 0);
 	}
+}
+
+void CClient::SnapshotMsg(const char *pMsg)
+{
+	// the console isn't thread safe, the network thread only logs
+	if(m_NetThreadRunning)
+		dbg_msg("client", "%s", pMsg);
 	else
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client", pMsg);
+}
+
+void CClient::NetThread(void *pUser)
+{
+	CClient *pSelf = (CClient *)pUser;
+	CThreadTopology::Enter(CThreadTopology::CLASS_NET, "client network");
+
+	while(pSelf->m_NetThreadRunning)
 	{
-		if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0)
+		lock_wait(pSelf->m_NetLock);
+		pSelf->m_NetClient.Update();
+
+		// stop receiving while the main thread is behind, the socket keeps the rest
+		CNetChunk Packet;
+		while(!pSelf->m_pNetQueue->full() && !pSelf->m_pSnapshotQueue->full() && pSelf->m_NetClient.Recv(&Packet))
 		{
-			// game message
-			GameClient()->OnMessage(Msg, &Unpacker);
+			if(Packet.m_Flags&NETSENDFLAG_CONNLESS)
+				continue;
 
-			if(m_RecordGameMessage && m_DemoRecorder.IsRecording())
-				m_DemoRecorder.RecordMessage(pPacket->m_pData, pPacket->m_DataSize);
+			CNetEntry *pEntry = pSelf->m_pNetQueue->begin_push();
+			pEntry->m_Generation = pSelf->m_NetGeneration;
+
+			CUnpacker Unpacker;
+			Unpacker.Reset(Packet.m_pData, Packet.m_DataSize);
+			int Msg = Unpacker.GetInt();
+			if(!Unpacker.Error() && (Msg&1) && ((Msg>>1) == NETMSG_SNAP || (Msg>>1) == NETMSG_SNAPSINGLE || (Msg>>1) == NETMSG_SNAPEMPTY))
+			{
+				// decode it here and keep it as delta for the next ones
+				CNetSnapshot *pSnap = pSelf->m_pSnapshotQueue->begin_push();
+				pSnap->m_Size = pSelf->UnpackSnapshot(Msg>>1, &Unpacker, &pSelf->m_RecvSnapshotStorage, (CSnapshot *)pSnap->m_aData, &pSnap->m_Tick, &pSnap->m_DeltaTick);
+				if(pSnap->m_Size < 0)
+					continue;
+				pSnap->m_RecvTime = time_get();
+				pSelf->m_RecvSnapshotStorage.PurgeUntil(pSnap->m_DeltaTick);
+				pSelf->m_RecvSnapshotStorage.Add(pSnap->m_Tick, pSnap->m_RecvTime, pSnap->m_Size, pSnap->m_aData, 0);
+				pSelf->m_pSnapshotQueue->end_push();
+
+				pEntry->m_Type = CNetEntry::TYPE_SNAPSHOT;
+			}
+			else
+			{
+				pEntry->m_Type = CNetEntry::TYPE_CHUNK;
+				pEntry->m_Flags = Packet.m_Flags;
+				pEntry->m_DataSize = Packet.m_DataSize;
+				mem_copy(pEntry->m_aData, Packet.m_pData, Packet.m_DataSize);
+			}
+			pSelf->m_pNetQueue->end_push();
 		}
+		lock_unlock(pSelf->m_NetLock);
+
+		// the client doesn't batch its sends, this only waits for the socket
+		pSelf->m_NetClient.Wait(1);
+	}
+
+	CThreadTopology::Leave();
+}
+
+void CClient::StartNetThread()
+{
+	m_pNetQueue = new spsc_queue<CNetEntry, NET_QUEUE_SIZE>;
+	m_pSnapshotQueue = new spsc_queue<CNetSnapshot, NET_SNAPSHOT_QUEUE_SIZE>;
+	m_NetThreadRunning = true;
+	m_pNetThread = thread_init(NetThread, this);
+	if(!m_pNetThread)
+	{
+		dbg_msg("client", "couldn't start the network thread");
+		m_NetThreadRunning = false;
+		delete m_pNetQueue;
+		delete m_pSnapshotQueue;
+		m_pNetQueue = 0;
+		m_pSnapshotQueue = 0;
+	}
+}
+
+void CClient::StopNetThread()
+{
+	if(!m_pNetThread)
+		return;
+
+	m_NetThreadRunning = false;
+	thread_wait(m_pNetThread);
+	thread_destroy(m_pNetThread);
+	m_pNetThread = 0;
+
+	delete m_pNetQueue;
+	delete m_pSnapshotQueue;
+	m_pNetQueue = 0;
+	m_pSnapshotQueue = 0;
+}
+
+void CClient::ProcessNetQueue()
+{
+	while(CNetEntry *pEntry = m_pNetQueue->front())
+	{
+		// skip what a previous connection left behind
+		if(pEntry->m_Generation == m_NetGeneration)
+		{
+			if(pEntry->m_Type == CNetEntry::TYPE_SNAPSHOT)
+			{
+				CNetSnapshot *pSnap = m_pSnapshotQueue->front();
+				OnSnapshot(pSnap->m_Tick, pSnap->m_DeltaTick, pSnap->m_RecvTime, (CSnapshot *)pSnap->m_aData, pSnap->m_Size);
+			}
+			else
+			{
+				CNetChunk Packet;
+				mem_zero(&Packet, sizeof(Packet));
+				Packet.m_Flags = pEntry->m_Flags;
+				Packet.m_DataSize = pEntry->m_DataSize;
+				Packet.m_pData = pEntry->m_aData;
+				ProcessServerPacket(&Packet);
+			}
+		}
+
+		if(pEntry->m_Type == CNetEntry::TYPE_SNAPSHOT)
+			m_pSnapshotQueue->pop();
+		m_pNetQueue->pop();
 	}
 }
 
 void CClient::PumpNetwork()
 {
-	m_NetClient.Update();
+	if(!m_NetThreadRunning)
+		m_NetClient.Update();
 
 	if(State() != IClient::STATE_DEMOPLAYBACK)
 	{
+		lock_wait(m_NetLock);
+		int NetState = m_NetClient.State();
+		char aError[256];
+		str_copy(aError, m_NetClient.ErrorString(), sizeof(aError));
+		lock_unlock(m_NetLock);
+
 		// check for errors
-		if(State() != IClient::STATE_OFFLINE && State() != IClient::STATE_QUITING && m_NetClient.State() == NETSTATE_OFFLINE)
+		if(State() != IClient::STATE_OFFLINE && State() != IClient::STATE_QUITING && NetState == NETSTATE_OFFLINE)
 		{
 			SetState(IClient::STATE_OFFLINE);
-			DisconnectWithReason(m_NetClient.ErrorString());
+			DisconnectWithReason(aError);
 			char aBuf[256];
-			str_format(aBuf, sizeof(aBuf), "offline error='%s'", m_NetClient.ErrorString());
+			str_format(aBuf, sizeof(aBuf), "offline error='%s'", aError);
 			m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "client", aBuf);
 		}
 
 		//
-		if(State() == IClient::STATE_CONNECTING && m_NetClient.State() == NETSTATE_ONLINE)
+		if(State() == IClient::STATE_CONNECTING && NetState == NETSTATE_ONLINE)
 		{
 			// we switched to online
 			m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "client", "connected, sending info");
@@ -1592,10 +2147,15 @@ void CClient::PumpNetwork()
 
 	// process non-connless packets
 	CNetChunk Packet;
-	while(m_NetClient.Recv(&Packet))
+	if(m_NetThreadRunning)
+		ProcessNetQueue();
+	else
 	{
-		if(!(Packet.m_Flags&NETSENDFLAG_CONNLESS))
-			ProcessServerPacket(&Packet);
+		while(m_NetClient.Recv(&Packet))
+		{
+			if(!(Packet.m_Flags&NETSENDFLAG_CONNLESS))
+				ProcessServerPacket(&Packet);
+		}
 	}
 
 	// process connless packets data
@@ -1842,11 +2402,44 @@ void CClient::InitInterfaces()
 	m_ServerBrowser.Init(&m_ContactClient, m_pGameClient->NetVersion());
 	m_Friends.Init();
 	m_Blacklist.Init();
+	m_MapCache.Init(m_pStorage, "downloadedmaps/index.txt");
+	m_MapCache.Load();
+}
+
+void CClient::UpdateQuality()
+{
+	// only the game scales its detail, a capped or unfocused client is slow on purpose
+	if(!Config()->m_GfxAdaptiveQuality || (State() != IClient::STATE_ONLINE && State() != IClient::STATE_DEMOPLAYBACK) ||
+		m_EditorActive || !m_pGraphics->WindowActive())
+	{
+		m_QualityGovernor.Reset();
+		m_QualityLevel = 1.0f;
+		return;
+	}
+
+	int TargetFps = Config()->m_GfxAdaptiveQualityFps;
+	if(!Config()->m_GfxVsync && Config()->m_GfxLimitFps)
+		TargetFps = min(TargetFps, Config()->m_GfxMaxFps);
+	if(m_QualityGovernor.AddFrame(m_RenderFrameTime, 1.0f/TargetFps) && Config()->m_Debug)
+	{
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "quality level %.3f, 90th percentile frame time %.2f ms",
+			m_QualityGovernor.Level(), m_QualityGovernor.Percentile()*1000.0f);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client", aBuf);
+	}
+	m_QualityLevel = m_QualityGovernor.Level();
 }
 
 bool CClient::LimitFps()
 {
-	if(Config()->m_GfxVsync || !Config()->m_GfxLimitFps) return false;
+	// the menus and an unfocused window don't need a high frame rate, cap them to save power
+	int CapFps = 0;
+	if(Config()->m_GfxMenuMaxFps && State() == IClient::STATE_OFFLINE && !m_EditorActive)
+		CapFps = Config()->m_GfxMenuMaxFps;
+	if(Config()->m_GfxBackgroundMaxFps && !m_pGraphics->WindowActive() && (!CapFps || Config()->m_GfxBackgroundMaxFps < CapFps))
+		CapFps = Config()->m_GfxBackgroundMaxFps;
+	const bool GameCap = !Config()->m_GfxVsync && Config()->m_GfxLimitFps;
+	if(!CapFps && !GameCap) return false;
 
 	/**
 		If desired frame time is not reached:
@@ -1872,7 +2465,31 @@ bool CClient::LimitFps()
 
 	bool SkipFrame = true;
 	double RenderDeltaTime = (Now - m_LastRenderTime) / (double)time_freq();
-	const double DesiredTime = 1.0/Config()->m_GfxMaxFps;
+	int MaxFps = GameCap ? Config()->m_GfxMaxFps : CapFps;
+	if(CapFps)
+		MaxFps = min(MaxFps, CapFps);
+	const double DesiredTime = 1.0/MaxFps;
+
+	const int64 Deadline = m_LastRenderTime + (int64)(DesiredTime*time_freq());
+
+	// low latency mode sleeps instead of skipping frames. it wakes up for
+	// the input ticks on the way and early enough for one more loop, so
+	// the input is sampled and sent right at the tick and before rendering
+	if((Config()->m_ClLowLatency || CapFps) && RenderDeltaTime < DesiredTime)
+	{
+		int64 WakeTime = Deadline - (int64)(m_LastAvgCpuFrameTime * 1.20 * time_freq());
+		const int64 InputTime = NextInputTime();
+		if(InputTime > Now && InputTime < WakeTime)
+			WakeTime = InputTime;
+		if(WakeTime > Now)
+		{
+#ifdef CONF_DEBUG
+			DbgTimeWaited += (WakeTime - Now) / (double)time_freq();
+#endif
+			m_LastCpuTime = WaitUntil(WakeTime);
+			return true;
+		}
+	}
 
 	// we can't skip another frame, so wait instead
 	if(SkipFrame && RenderDeltaTime < DesiredTime &&
@@ -1881,17 +2498,7 @@ bool CClient::LimitFps()
 #ifdef CONF_DEBUG
 		DbgTimeWaited += DesiredTime - RenderDeltaTime;
 #endif
-		const double Freq = (double)time_freq();
-		const int64 LastT = m_LastRenderTime;
-		double d = DesiredTime - RenderDeltaTime;
-		while(d > 0.00001)
-		{
-			Now = time_get();
-			RenderDeltaTime = (Now - LastT) / Freq;
-			d = DesiredTime - RenderDeltaTime;
-			cpu_relax();
-		}
-
+		Now = WaitUntil(Deadline);
 		SkipFrame = false;
 		m_LastCpuTime = Now;
 	}
@@ -1924,6 +2531,49 @@ bool CClient::LimitFps()
 	return SkipFrame;
 }
 
+int64 CClient::NextInputTime()
+{
+	if(State() != IClient::STATE_ONLINE || m_ReceivedSnapshots < 3)
+		return 0;
+
+	// the next input goes out when the predicted time reaches the start of the current prediction tick
+	int64 Now = time_get();
+	return Now + m_PredTick*time_freq()/50 - m_PredictedTime.Get(Now);
+}
+
+int64 CClient::WaitUntil(int64 Time)
+{
+	// sleep while the scheduler can't overshoot, spin the last bit
+	int64 Now = time_get();
+	while(Now < Time)
+	{
+		if(Time-Now > time_freq()*2/1000)
+			thread_sleep(1);
+		else
+			cpu_relax();
+		Now = time_get();
+	}
+	return Now;
+}
+
+int CClient::LoadHuffmanTableCallback(const char *pName, int IsDir, int StorageType, void *pUser)
+{
+	CClient *pSelf = (CClient *)pUser;
+	if(IsDir || !str_endswith_nocase(pName, ".txt"))
+		return 0;
+
+	char aFilename[IO_MAX_PATH_LENGTH];
+	str_format(aFilename, sizeof(aFilename), "huffman/%s", pName);
+	unsigned TableID = pSelf->m_NetClient.LoadHuffmanTable(pSelf->Storage(), aFilename, StorageType);
+	char aBuf[256];
+	if(TableID)
+		str_format(aBuf, sizeof(aBuf), "loaded huffman table '%s' id=%08x", pName, TableID);
+	else
+		str_format(aBuf, sizeof(aBuf), "couldn't load huffman table '%s'", pName);
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client", aBuf);
+	return 0;
+}
+
 void CClient::Run()
 {
 	m_LocalStartTime = time_get();
@@ -1985,6 +2635,12 @@ void CClient::Run()
 			dbg_msg("client", "couldn't open socket(contact)");
 			return;
 		}
+
+		// servers can pick any of these to compress the traffic with
+		Storage()->ListDirectory(IStorage::TYPE_ALL, "huffman", LoadHuffmanTableCallback, this);
+
+		if(Config()->m_ClNetThread)
+			StartNetThread();
 	}
 
 	// init font rendering
@@ -2017,8 +2673,12 @@ void CClient::Run()
 	// process pending commands
 	m_pConsole->StoreCommands(false);
 
+	CThreadTopology::Enter(CThreadTopology::CLASS_TICK, "client");
+
 	while (1)
 	{
+		CTraceScope FrameTraceScope("Frame");
+
 		//
 		VersionUpdate();
 
@@ -2107,11 +2767,15 @@ void CClient::Run()
 			
 			m_pTextRender->Update();
 
-			Update();
+			{
+				CTraceScope UpdateTraceScope("Update");
+				Update();
+			}
 
 			const bool SkipFrame = LimitFps();
 
-			if(!SkipFrame && (!Config()->m_GfxAsyncRender || m_pGraphics->IsIdle()))
+			// nothing is drawn while the window is minimized
+			if(!SkipFrame && m_pGraphics->WindowOpen() && (!Config()->m_GfxAsyncRender || m_pGraphics->IsIdle()))
 			{
 				m_RenderFrames++;
 
@@ -2124,13 +2788,18 @@ void CClient::Run()
 				if(m_RenderFrameTime > m_RenderFrameTimeHigh)
 					m_RenderFrameTimeHigh = m_RenderFrameTime;
 				m_FpsGraph.Add(1.0f/m_RenderFrameTime, 1,1,1);
+				UpdateQuality();
 
 				m_LastRenderTime = Now;
 
 				// when we are stress testing only render every 10th frame
 				if(!Config()->m_DbgStress || (m_RenderFrames%10) == 0 )
 				{
-					Render();
+					{
+						CTraceScope RenderTraceScope("Render");
+						Render();
+					}
+					CTraceScope SwapTraceScope("Swap");
 					m_pGraphics->Swap();
 				}
 			}
@@ -2153,6 +2822,17 @@ void CClient::Run()
 		// beNice
 		if(Config()->m_ClCpuThrottle)
 			thread_sleep(Config()->m_ClCpuThrottle);
+		else if(!m_pGraphics->WindowOpen())
+		{
+			// only wake up for the ticks, the network and the inputs with the
+			// snapshot acks keep going so the connection doesn't time out
+			const int64 Now = time_get();
+			int64 WakeTime = Now + time_freq()/SERVER_TICK_SPEED;
+			const int64 InputTime = NextInputTime();
+			if(InputTime > Now && InputTime < WakeTime)
+				WakeTime = InputTime;
+			WaitUntil(WakeTime);
+		}
 		else if(Config()->m_DbgStress || !m_pGraphics->WindowActive())
 			thread_sleep(5);
 
@@ -2185,12 +2865,17 @@ void CClient::Run()
 
 	GameClient()->OnShutdown();
 	Disconnect();
+	StopNetThread();
 
+	if(CTracer::IsRecording())
+		Con_TraceStop(0, this);
 	m_pGraphics->Shutdown();
 	m_pSound->Shutdown();
 	m_pTextRender->Shutdown();
 
 	m_ServerBrowser.SaveServerlist();
+	m_ServerBrowser.SaveServerCache();
+	m_MapCache.Save();
 
 	// shutdown SDL
 	{
@@ -2284,6 +2969,35 @@ void CClient::Con_Screenshot(IConsole::IResult *pResult, void *pUserData)
 	pSelf->Graphics()->TakeScreenshot(0);
 }
 
+void CClient::Con_TraceStart(IConsole::IResult *pResult, void *pUserData)
+{
+	CClient *pSelf = (CClient *)pUserData;
+	if(pResult->NumArguments())
+		str_format(pSelf->m_aTraceFilename, sizeof(pSelf->m_aTraceFilename), "dumps/%s.json", pResult->GetString(0));
+	else
+	{
+		char aDate[20];
+		str_timestamp(aDate, sizeof(aDate));
+		str_format(pSelf->m_aTraceFilename, sizeof(pSelf->m_aTraceFilename), "dumps/trace_client_%s.json", aDate);
+	}
+	CTracer::Start();
+	pSelf->m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "trace", "recording");
+}
+
+void CClient::Con_TraceStop(IConsole::IResult *pResult, void *pUserData)
+{
+	CClient *pSelf = (CClient *)pUserData;
+	if(!CTracer::IsRecording())
+		return;
+
+	char aBuf[256];
+	if(CTracer::Stop(pSelf->Storage()->OpenFile(pSelf->m_aTraceFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE)))
+		str_format(aBuf, sizeof(aBuf), "trace written to '%s'", pSelf->m_aTraceFilename);
+	else
+		str_format(aBuf, sizeof(aBuf), "failed to open '%s'", pSelf->m_aTraceFilename);
+	pSelf->m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "trace", aBuf);
+}
+
 void CClient::Con_Rcon(IConsole::IResult *pResult, void *pUserData)
 {
 	CClient *pSelf = (CClient *)pUserData;
@@ -2296,13 +3010,17 @@ void CClient::Con_RconAuth(IConsole::IResult *pResult, void *pUserData)
 	pSelf->RconAuth("", pResult->GetString(0));
 }
 
-const char *CClient::DemoPlayer_Play(const char *pFilename, int StorageType)
+const char *CClient::DemoPlayer_Play(const char *pFilename, int StorageType, bool Live)
 {
 	Disconnect();
+	lock_wait(m_NetLock);
 	m_NetClient.ResetErrorString();
+	lock_unlock(m_NetLock);
 
 	// try to start playback
 	m_DemoPlayer.SetListener(this);
+	m_DemoPlayer.SetDecodeQueue(Config()->m_ClDemoQueue*1024);
+	m_DemoPlayer.SetLive(Live);
 
 	const char *pError = m_DemoPlayer.Load(Storage(), m_pConsole, pFilename, StorageType, GameClient()->NetVersion());
 	if(pError)
@@ -2359,7 +3077,10 @@ void CClient::DemoRecorder_Start(const char *pFilename, bool WithTimestamp)
 		}
 		else
 			str_format(aFilename, sizeof(aFilename), "demos/%s.demo", pFilename);
+		// keep slow disks from stalling the frames
+		m_DemoRecorder.SetWriterQueue(Config()->m_ClDemoRecordQueue*1024);
 		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameClient()->NetVersion(), m_aCurrentMap, m_CurrentMapSha256, m_CurrentMapCrc, "client");
+		m_DemoRecItemsSize = 0;
 	}
 }
 
@@ -2521,6 +3242,8 @@ void CClient::RegisterCommands()
 	m_pConsole->Register("disconnect", "", CFGFLAG_CLIENT, Con_Disconnect, this, "Disconnect from the server");
 	m_pConsole->Register("ping", "", CFGFLAG_CLIENT, Con_Ping, this, "Ping the current server");
 	m_pConsole->Register("screenshot", "", CFGFLAG_CLIENT, Con_Screenshot, this, "Take a screenshot");
+	m_pConsole->Register("trace_start", "?s[file]", CFGFLAG_CLIENT, Con_TraceStart, this, "Start recording a trace of the client threads");
+	m_pConsole->Register("trace_stop", "", CFGFLAG_CLIENT, Con_TraceStop, this, "Stop recording the trace and write it to dumps/");
 	m_pConsole->Register("rcon", "r[command]", CFGFLAG_CLIENT, Con_Rcon, this, "Send specified command to rcon");
 	m_pConsole->Register("rcon_auth", "s[password]", CFGFLAG_CLIENT, Con_RconAuth, this, "Authenticate to rcon");
 	m_pConsole->Register("record", "?s[file]", CFGFLAG_CLIENT, Con_Record, this, "Record to the file");
@@ -2687,6 +3410,9 @@ int main(int argc, const char **argv) // ignore_convention
 			}
 		}
 	}
+
+	// the engine's job workers are running already, they get their settings now
+	CThreadTopology::Configure(pConfigManager->Values());
 #if defined(CONF_FAMILY_WINDOWS)
 	CConfig *pConfig = pConfigManager->Values();
 	bool HideConsole = false;
@@ -4,6 +4,8 @@
 #define ENGINE_CLIENT_CLIENT_H
 
 #include <base/hash.h>
+#include <engine/shared/adaptivemargin.h>
+#include <engine/shared/qualitygovernor.h>
 
 class CGraph
 {
@@ -72,6 +74,7 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	{
 		NUM_SNAPSHOT_TYPES=2,
 		PREDICTION_MARGIN=1000/50/2, // magic network prediction value
+		MAX_NET_MARGIN=250,
 	};
 
 	class CNetClient m_NetClient;
@@ -82,6 +85,7 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	class CFriends m_Friends;
 	class CBlacklist m_Blacklist;
 	class CMapChecker m_MapChecker;
+	class CMapCache m_MapCache;
 
 	char m_aServerAddressStr[256];
 	char m_aServerPassword[128];
@@ -108,6 +112,7 @@ class CClient : public IClient, public CDemoPlayer::IListener
 
 	int m_AckGameTick;
 	int m_CurrentRecvTick;
+	bool m_SnapBitpacked;
 	int m_RconAuthed;
 	int m_UseTempRconCommands;
 
@@ -125,6 +130,7 @@ class CClient : public IClient, public CDemoPlayer::IListener
 
 	//
 	char m_aCmdConnect[256];
+	char m_aTraceFilename[128];
 
 	// map download
 	char m_aMapdownloadFilename[IO_MAX_PATH_LENGTH];
@@ -139,15 +145,42 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	int m_MapdownloadCrc;
 	int m_MapdownloadAmount;
 	int m_MapdownloadTotalsize;
+	bool m_MapdownloadResumable; // the temp file is kept for the next try
+	bool m_MapdownloadRangeRequests; // the server takes the chunk and window of a request
+	int m_MapdownloadWindow;
+	int m_MapdownloadWindowEnd; // the next request is sent once this chunk is reached
+	int64 m_MapdownloadRequestTime;
+	int64 m_MapdownloadBestTime; // per chunk of the fastest window so far
+
+	// background download of the map the server announced to come next
+	enum
+	{
+		MAP_PREFETCH_CHUNKS_PER_REQUEST=4,
+	};
+	char m_aMapPrefetchFilename[IO_MAX_PATH_LENGTH];
+	char m_aMapPrefetchFilenameTemp[IO_MAX_PATH_LENGTH];
+	IOHANDLE m_MapPrefetchFileTemp;
+	SHA256_DIGEST m_MapPrefetchSha256;
+	int m_MapPrefetchCrc;
+	int m_MapPrefetchSize;
+	int m_MapPrefetchChunkSize;
+	int m_MapPrefetchChunk; // the next one expected
+	int m_MapPrefetchAmount;
 
 	// time
 	CSmoothTime m_GameTime;
 	CSmoothTime m_PredictedTime;
+	CAdaptiveMargin m_SnapTiming;
+	CAdaptiveMargin m_PredTiming;
+	int m_LastSnapTick;
+	int m_SnapInterval; // the smallest gap between snapshots, larger ones lost some
+	void ResetNetTiming();
 
 	// input
 	struct // TODO: handle input better
 	{
 		int m_aData[MAX_INPUT_SIZE]; // the input data
+		int m_Size;
 		int m_Tick; // the tick that the input is for
 		int64 m_PredictedTime; // prediction latency when we sent this input
 		int64 m_Time;
@@ -159,6 +192,7 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	CGraph m_InputtimeMarginGraph;
 	CGraph m_GametimeMarginGraph;
 	CGraph m_FpsGraph;
+	CQualityGovernor m_QualityGovernor;
 
 	// the game snapshots are modifiable by the game
 	class CSnapshotStorage m_SnapshotStorage;
@@ -167,10 +201,59 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	int m_ReceivedSnapshots;
 	char m_aSnapshotIncomingData[CSnapshot::MAX_SIZE];
 
+	// network thread, only used with cl_net_thread. it pumps the connection
+	// and decodes the snapshots while the main thread is busy with a frame,
+	// everything else is handed over to the main thread in arrival order
+	struct CNetEntry
+	{
+		enum
+		{
+			TYPE_CHUNK=0,
+			TYPE_SNAPSHOT, // the data is at the front of m_pSnapshotQueue
+		};
+
+		int m_Type;
+		int m_Generation;
+		int m_Flags;
+		int m_DataSize;
+		unsigned char m_aData[NET_MAX_PAYLOAD];
+	};
+	struct CNetSnapshot
+	{
+		int m_Tick;
+		int m_DeltaTick;
+		int64 m_RecvTime;
+		int m_Size;
+		char m_aData[CSnapshot::MAX_SIZE];
+	};
+	enum
+	{
+		NET_QUEUE_SIZE=256,
+		NET_SNAPSHOT_QUEUE_SIZE=8,
+	};
+
+	void *m_pNetThread;
+	volatile bool m_NetThreadRunning;
+	LOCK m_NetLock; // guards m_NetClient and the snapshot receive state while the thread runs
+	int m_NetGeneration; // changes with each connection, written under m_NetLock
+	spsc_queue<CNetEntry, NET_QUEUE_SIZE> *m_pNetQueue;
+	spsc_queue<CNetSnapshot, NET_SNAPSHOT_QUEUE_SIZE> *m_pSnapshotQueue;
+	class CSnapshotStorage m_RecvSnapshotStorage; // delta bases of the network thread
+
+	static void NetThread(void *pUser);
+	void StartNetThread();
+	void StopNetThread();
+	void ProcessNetQueue();
+
 	class CSnapshotStorage::CHolder m_aDemorecSnapshotHolders[NUM_SNAPSHOT_TYPES];
 	char *m_aDemorecSnapshotData[NUM_SNAPSHOT_TYPES][2][CSnapshot::MAX_SIZE];
 	class CSnapshotBuilder m_DemoRecSnapshotBuilder;
 
+	// the demo items are kept between the recorded snapshots and merged into the received ones
+	char m_aDemoRecItems[CSnapshot::MAX_SIZE];
+	int m_DemoRecItemsSize;
+	bool m_DemoRecItemsBuilding;
+
 	class CSnapshotDelta m_SnapshotDelta;
 
 	//
@@ -213,6 +296,7 @@ public:
 	void SendInfo();
 	void SendEnterGame();
 	void SendReady();
+	void RequestMapData();
 
 	virtual bool RconAuthed() const { return m_RconAuthed != 0; }
 	virtual bool UseTempRconCommands() const { return m_UseTempRconCommands != 0; }
@@ -254,8 +338,10 @@ public:
 	void SnapInvalidateItem(int SnapID, int Index);
 	const void *SnapFindItem(int SnapID, int Type, int ID) const;
 	int SnapNumItems(int SnapID) const;
+	const CSnapshot *SnapGetSnapshot(int SnapID) const;
 	void *SnapNewItem(int Type, int ID, int Size);
 	void SnapSetStaticsize(int ItemType, int Size);
+	void SnapSetFieldBits(int ItemType, const unsigned char *pBits, int Num);
 
 	void Render();
 	void DebugRender();
@@ -266,10 +352,16 @@ public:
 
 	const char *LoadMap(const char *pName, const char *pFilename, const SHA256_DIGEST *pWantedSha256, unsigned WantedCrc);
 	const char *LoadMapSearch(const char *pMapName, const SHA256_DIGEST *pWantedSha256, int WantedCrc);
+	bool MapAvailable(const char *pMapName, const SHA256_DIGEST *pWantedSha256, int WantedCrc);
+	void ResetMapPrefetch();
+	void RequestMapPrefetch();
 
 	int UnpackServerInfo(CUnpacker *pUnpacker, CServerInfo *pInfo, int *pToken);
 	void ProcessConnlessPacket(CNetChunk *pPacket);
 	void ProcessServerPacket(CNetChunk *pPacket);
+	int UnpackSnapshot(int Msg, CUnpacker *pUnpacker, CSnapshotStorage *pStorage, CSnapshot *pSnap, int *pGameTick, int *pDeltaTick);
+	void OnSnapshot(int GameTick, int DeltaTick, int64 RecvTime, CSnapshot *pSnap, int SnapSize);
+	void SnapshotMsg(const char *pMsg);
 
 	const char *GetCurrentMapName() const { return m_aCurrentMap; }
 	const char *GetCurrentMapPath() const { return m_aCurrentMapPath; }
@@ -287,7 +379,10 @@ public:
 	void RegisterInterfaces();
 	void InitInterfaces();
 
+	void UpdateQuality();
 	bool LimitFps();
+	int64 NextInputTime();
+	int64 WaitUntil(int64 Time);
 	void Run();
 
 	void ConnectOnStart(const char *pAddress);
@@ -299,6 +394,8 @@ public:
 	static void Con_Minimize(IConsole::IResult *pResult, void *pUserData);
 	static void Con_Ping(IConsole::IResult *pResult, void *pUserData);
 	static void Con_Screenshot(IConsole::IResult *pResult, void *pUserData);
+	static void Con_TraceStart(IConsole::IResult *pResult, void *pUserData);
+	static void Con_TraceStop(IConsole::IResult *pResult, void *pUserData);
 	static void Con_Rcon(IConsole::IResult *pResult, void *pUserData);
 	static void Con_RconAuth(IConsole::IResult *pResult, void *pUserData);
 	static void Con_AddFavorite(IConsole::IResult *pResult, void *pUserData);
@@ -313,8 +410,9 @@ public:
 	static void ConchainWindowVSync(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 
 	void RegisterCommands();
+	static int LoadHuffmanTableCallback(const char *pName, int IsDir, int StorageType, void *pUser);
 
-	const char *DemoPlayer_Play(const char *pFilename, int StorageType);
+	const char *DemoPlayer_Play(const char *pFilename, int StorageType, bool Live = false);
 	void DemoRecorder_Start(const char *pFilename, bool WithTimestamp);
 	void DemoRecorder_HandleAutoStart();
 	void DemoRecorder_Stop();
@@ -12,6 +12,34 @@ IContactList::IContactList()
 {
 	mem_zero(m_aContacts, sizeof(m_aContacts));
 	m_NumContacts = 0;
+	RebuildHashTable();
+}
+
+int IContactList::FindContact(unsigned NameHash, unsigned ClanHash) const
+{
+	for(unsigned Slot = HashSlot(NameHash, ClanHash); m_aHashTable[Slot] != -1; Slot = (Slot+1)&(HASH_TABLE_SIZE-1))
+	{
+		const CContactInfo *pContact = &m_aContacts[m_aHashTable[Slot]];
+		if(pContact->m_NameHash == NameHash && pContact->m_ClanHash == ClanHash)
+			return m_aHashTable[Slot];
+	}
+	return -1;
+}
+
+void IContactList::InsertHash(int Index)
+{
+	unsigned Slot = HashSlot(m_aContacts[Index].m_NameHash, m_aContacts[Index].m_ClanHash);
+	while(m_aHashTable[Slot] != -1)
+		Slot = (Slot+1)&(HASH_TABLE_SIZE-1);
+	m_aHashTable[Slot] = Index;
+}
+
+void IContactList::RebuildHashTable()
+{
+	for(int i = 0; i < HASH_TABLE_SIZE; ++i)
+		m_aHashTable[i] = -1;
+	for(int i = 0; i < m_NumContacts; ++i)
+		InsertHash(i);
 }
 
 const CContactInfo *IContactList::GetContact(int Index) const
@@ -21,36 +49,22 @@ const CContactInfo *IContactList::GetContact(int Index) const
 
 int IContactList::GetContactState(const char *pName, const char *pClan) const
 {
-	int Result = CContactInfo::CONTACT_NO;
 	unsigned NameHash = str_quickhash(pName);
 	unsigned ClanHash = str_quickhash(pClan);
-	for(int i = 0; i < m_NumContacts; ++i)
-	{
-		if(m_aContacts[i].m_ClanHash == ClanHash)
-		{
-			if(m_aContacts[i].m_aName[0] == 0)
-				Result = CContactInfo::CONTACT_CLAN;
-			else if(m_aContacts[i].m_NameHash == NameHash)
-			{
-				Result = CContactInfo::CONTACT_PLAYER;
-				break;
-			}
-		}
-	}
-	return Result;
+	int Index = FindContact(NameHash, ClanHash);
+	if(Index != -1 && m_aContacts[Index].m_aName[0])
+		return CContactInfo::CONTACT_PLAYER;
+
+	// clan contacts have an empty name
+	if(FindContact(str_quickhash(""), ClanHash) != -1)
+		return CContactInfo::CONTACT_CLAN;
+	return CContactInfo::CONTACT_NO;
 }
 
 bool IContactList::IsContact(const char *pName, const char *pClan, bool PlayersOnly) const
 {
-	unsigned NameHash = str_quickhash(pName);
 	unsigned ClanHash = str_quickhash(pClan);
-	for(int i = 0; i < m_NumContacts; ++i)
-	{
-		if(m_aContacts[i].m_ClanHash == ClanHash &&
-			((!PlayersOnly && m_aContacts[i].m_aName[0] == 0) || m_aContacts[i].m_NameHash == NameHash))
-			return true;
-	}
-	return false;
+	return FindContact(str_quickhash(pName), ClanHash) != -1 || (!PlayersOnly && FindContact(str_quickhash(""), ClanHash) != -1);
 }
 
 void IContactList::AddContact(const char *pName, const char *pClan)
@@ -61,31 +75,20 @@ void IContactList::AddContact(const char *pName, const char *pClan)
 	// make sure we don't have the friend already
 	unsigned NameHash = str_quickhash(pName);
 	unsigned ClanHash = str_quickhash(pClan);
-	for(int i = 0; i < m_NumContacts; ++i)
-	{
-		if(m_aContacts[i].m_NameHash == NameHash && m_aContacts[i].m_ClanHash == ClanHash)
-			return;
-	}
+	if(FindContact(NameHash, ClanHash) != -1)
+		return;
 
 	str_utf8_copy_num(m_aContacts[m_NumContacts].m_aName, pName, sizeof(m_aContacts[m_NumContacts].m_aName), MAX_NAME_LENGTH);
 	str_utf8_copy_num(m_aContacts[m_NumContacts].m_aClan, pClan, sizeof(m_aContacts[m_NumContacts].m_aClan), MAX_CLAN_LENGTH);
 	m_aContacts[m_NumContacts].m_NameHash = NameHash;
 	m_aContacts[m_NumContacts].m_ClanHash = ClanHash;
+	InsertHash(m_NumContacts);
 	++m_NumContacts;
 }
 
 void IContactList::RemoveContact(const char *pName, const char *pClan)
 {
-	unsigned NameHash = str_quickhash(pName);
-	unsigned ClanHash = str_quickhash(pClan);
-	for(int i = 0; i < m_NumContacts; ++i)
-	{
-		if(m_aContacts[i].m_NameHash == NameHash && m_aContacts[i].m_ClanHash == ClanHash)
-		{
-			RemoveContact(i);
-			return;
-		}
-	}
+	RemoveContact(FindContact(str_quickhash(pName), str_quickhash(pClan)));
 }
 
 void IContactList::RemoveContact(int Index)
@@ -94,6 +97,7 @@ void IContactList::RemoveContact(int Index)
 	{
 		mem_move(&m_aContacts[Index], &m_aContacts[Index+1], sizeof(CContactInfo)*(m_NumContacts-(Index+1)));
 		--m_NumContacts;
+		RebuildHashTable(); // the indices moved
 	}
 	return;
 }
@@ -13,6 +13,18 @@ private:
 	CContactInfo m_aContacts[CContactInfo::MAX_CONTACTS];
 	int m_NumContacts;
 
+	// open addressing on the (name, clan) hash pair, -1 marks a free slot
+	enum
+	{
+		HASH_TABLE_SIZE=CContactInfo::MAX_CONTACTS*2,
+	};
+	short m_aHashTable[HASH_TABLE_SIZE];
+
+	static unsigned HashSlot(unsigned NameHash, unsigned ClanHash) { return (NameHash*31+ClanHash)&(HASH_TABLE_SIZE-1); }
+	int FindContact(unsigned NameHash, unsigned ClanHash) const;
+	void InsertHash(int Index);
+	void RebuildHashTable();
+
 public:
 	IContactList();
 
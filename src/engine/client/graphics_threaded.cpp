@@ -14,6 +14,7 @@
 #include <engine/storage.h>
 #include <engine/keys.h>
 #include <engine/console.h>
+#include <engine/engine.h>
 
 #include <math.h> // cosf, sinf
 
@@ -34,29 +35,12 @@ static CVideoMode g_aFakeModes[] = {
 	{1920,1440,8,8,8}, {1920,2400,8,8,8}, {2048,1536,8,8,8}
 };
 
-void CGraphics_Threaded::FlushVertices()
+CCommandBuffer::CVertex *CGraphics_Threaded::AddRenderCommand(const CCommandBuffer::CState &State, int PrimType, int NumVerts)
 {
-	if(m_NumVertices == 0)
-		return;
-
-	int NumVerts = m_NumVertices;
-	m_NumVertices = 0;
-
 	CCommandBuffer::CRenderCommand Cmd;
-	Cmd.m_State = m_State;
-
-	if(m_Drawing == DRAWING_QUADS)
-	{
-		Cmd.m_PrimType = CCommandBuffer::PRIMTYPE_QUADS;
-		Cmd.m_PrimCount = NumVerts/4;
-	}
-	else if(m_Drawing == DRAWING_LINES)
-	{
-		Cmd.m_PrimType = CCommandBuffer::PRIMTYPE_LINES;
-		Cmd.m_PrimCount = NumVerts/2;
-	}
-	else
-		return;
+	Cmd.m_State = State;
+	Cmd.m_PrimType = PrimType;
+	Cmd.m_PrimCount = PrimType == CCommandBuffer::PRIMTYPE_QUADS ? NumVerts/4 : NumVerts/2;
 
 	Cmd.m_pVertices = (CCommandBuffer::CVertex *)m_pCommandBuffer->AllocData(sizeof(CCommandBuffer::CVertex)*NumVerts);
 	if(Cmd.m_pVertices == 0x0)
@@ -68,7 +52,7 @@ void CGraphics_Threaded::FlushVertices()
 		if(Cmd.m_pVertices == 0x0)
 		{
 			dbg_msg("graphics", "failed to allocate data for vertices");
-			return;
+			return 0;
 		}
 	}
 
@@ -82,17 +66,160 @@ void CGraphics_Threaded::FlushVertices()
 		if(Cmd.m_pVertices == 0x0)
 		{
 			dbg_msg("graphics", "failed to allocate data for vertices");
-			return;
+			return 0;
 		}
 
 		if(!m_pCommandBuffer->AddCommand(Cmd))
 		{
 			dbg_msg("graphics", "failed to allocate memory for render command");
-			return;
+			return 0;
 		}
 	}
 
-	mem_copy(Cmd.m_pVertices, m_aVertices, sizeof(CCommandBuffer::CVertex)*NumVerts);
+	m_FrameStats.m_NumDrawCalls++;
+	if(State.m_Texture != m_LastRenderTexture)
+	{
+		m_FrameStats.m_NumTextureBinds++;
+		m_LastRenderTexture = State.m_Texture;
+	}
+	return Cmd.m_pVertices;
+}
+
+static bool SameState(const CCommandBuffer::CState &a, const CCommandBuffer::CState &b)
+{
+	if(a.m_BlendMode != b.m_BlendMode || a.m_WrapModeU != b.m_WrapModeU || a.m_WrapModeV != b.m_WrapModeV ||
+		a.m_Texture != b.m_Texture || a.m_ClipEnable != b.m_ClipEnable ||
+		a.m_ScreenTL.x != b.m_ScreenTL.x || a.m_ScreenTL.y != b.m_ScreenTL.y ||
+		a.m_ScreenBR.x != b.m_ScreenBR.x || a.m_ScreenBR.y != b.m_ScreenBR.y)
+		return false;
+	if(a.m_Texture >= 0 && (a.m_Dimension != b.m_Dimension || a.m_TextureArrayIndex != b.m_TextureArrayIndex))
+		return false;
+	if(a.m_ClipEnable && (a.m_ClipX != b.m_ClipX || a.m_ClipY != b.m_ClipY || a.m_ClipW != b.m_ClipW || a.m_ClipH != b.m_ClipH))
+		return false;
+	return true;
+}
+
+void CGraphics_Threaded::BatchVertices(int PrimType, int NumVerts)
+{
+	if(m_NumBatchVertices+NumVerts > MAX_VERTICES || m_NumBatchDraws == MAX_BATCH_DRAWS)
+		FlushBatches();
+
+	// the bounds are compared between different screen mappings
+	float aBounds[4] = {-1.0f, -1.0f, 2.0f, 2.0f};
+	const float ScreenW = m_State.m_ScreenBR.x - m_State.m_ScreenTL.x;
+	const float ScreenH = m_State.m_ScreenBR.y - m_State.m_ScreenTL.y;
+	if(ScreenW != 0.0f && ScreenH != 0.0f)
+	{
+		aBounds[0] = aBounds[1] = 1e10f;
+		aBounds[2] = aBounds[3] = -1e10f;
+		for(int i = 0; i < NumVerts; i++)
+		{
+			const float x = (m_aVertices[i].m_Pos.x - m_State.m_ScreenTL.x) / ScreenW;
+			const float y = (m_aVertices[i].m_Pos.y - m_State.m_ScreenTL.y) / ScreenH;
+			aBounds[0] = min(aBounds[0], x);
+			aBounds[1] = min(aBounds[1], y);
+			aBounds[2] = max(aBounds[2], x);
+			aBounds[3] = max(aBounds[3], y);
+		}
+	}
+
+	// look for a batch this draw can be moved to without changing what is drawn on top
+	int Target = -1;
+	for(int b = m_NumBatches-1; b >= 0; b--)
+	{
+		const CBatch *pBatch = &m_aBatches[b];
+		if(pBatch->m_PrimType == PrimType && SameState(pBatch->m_State, m_State))
+		{
+			Target = b;
+			break;
+		}
+		if(pBatch->m_aBounds[0] <= aBounds[2] && aBounds[0] <= pBatch->m_aBounds[2] &&
+			pBatch->m_aBounds[1] <= aBounds[3] && aBounds[1] <= pBatch->m_aBounds[3])
+			break;
+	}
+
+	CBatch *pBatch;
+	if(Target == -1)
+	{
+		if(m_NumBatches == MAX_BATCHES)
+			FlushBatches();
+		pBatch = &m_aBatches[m_NumBatches++];
+		pBatch->m_State = m_State;
+		pBatch->m_PrimType = PrimType;
+		mem_copy(pBatch->m_aBounds, aBounds, sizeof(aBounds));
+		pBatch->m_NumVertices = 0;
+		pBatch->m_FirstDraw = -1;
+		pBatch->m_LastDraw = -1;
+	}
+	else
+	{
+		pBatch = &m_aBatches[Target];
+		pBatch->m_aBounds[0] = min(pBatch->m_aBounds[0], aBounds[0]);
+		pBatch->m_aBounds[1] = min(pBatch->m_aBounds[1], aBounds[1]);
+		pBatch->m_aBounds[2] = max(pBatch->m_aBounds[2], aBounds[2]);
+		pBatch->m_aBounds[3] = max(pBatch->m_aBounds[3], aBounds[3]);
+	}
+
+	const int Draw = m_NumBatchDraws++;
+	m_aBatchDraws[Draw].m_FirstVertex = m_NumBatchVertices;
+	m_aBatchDraws[Draw].m_NumVertices = NumVerts;
+	m_aBatchDraws[Draw].m_NextDraw = -1;
+	if(pBatch->m_LastDraw == -1)
+		pBatch->m_FirstDraw = Draw;
+	else
+		m_aBatchDraws[pBatch->m_LastDraw].m_NextDraw = Draw;
+	pBatch->m_LastDraw = Draw;
+	pBatch->m_NumVertices += NumVerts;
+
+	mem_copy(&m_aBatchVertices[m_NumBatchVertices], m_aVertices, sizeof(CCommandBuffer::CVertex)*NumVerts);
+	m_NumBatchVertices += NumVerts;
+}
+
+void CGraphics_Threaded::FlushBatches()
+{
+	for(int b = 0; b < m_NumBatches; b++)
+	{
+		const CBatch *pBatch = &m_aBatches[b];
+		CCommandBuffer::CVertex *pVertices = AddRenderCommand(pBatch->m_State, pBatch->m_PrimType, pBatch->m_NumVertices);
+		if(!pVertices)
+			continue;
+		for(int d = pBatch->m_FirstDraw; d != -1; d = m_aBatchDraws[d].m_NextDraw)
+		{
+			mem_copy(pVertices, &m_aBatchVertices[m_aBatchDraws[d].m_FirstVertex], sizeof(CCommandBuffer::CVertex)*m_aBatchDraws[d].m_NumVertices);
+			pVertices += m_aBatchDraws[d].m_NumVertices;
+		}
+	}
+
+	m_NumBatches = 0;
+	m_NumBatchDraws = 0;
+	m_NumBatchVertices = 0;
+}
+
+void CGraphics_Threaded::FlushVertices()
+{
+	if(m_NumVertices == 0)
+		return;
+
+	int NumVerts = m_NumVertices;
+	m_NumVertices = 0;
+
+	int PrimType;
+	if(m_Drawing == DRAWING_QUADS)
+		PrimType = CCommandBuffer::PRIMTYPE_QUADS;
+	else if(m_Drawing == DRAWING_LINES)
+		PrimType = CCommandBuffer::PRIMTYPE_LINES;
+	else
+		return;
+
+	if(m_pConfig->m_GfxBatchDraws)
+		BatchVertices(PrimType, NumVerts);
+	else
+	{
+		FlushBatches();
+		CCommandBuffer::CVertex *pVertices = AddRenderCommand(m_State, PrimType, NumVerts);
+		if(pVertices)
+			mem_copy(pVertices, m_aVertices, sizeof(CCommandBuffer::CVertex)*NumVerts);
+	}
 }
 
 void CGraphics_Threaded::AddVertices(int Count)
@@ -136,10 +263,29 @@ CGraphics_Threaded::CGraphics_Threaded()
 
 	m_CurrentCommandBuffer = 0;
 	m_pCommandBuffer = 0x0;
-	m_apCommandBuffers[0] = 0x0;
-	m_apCommandBuffers[1] = 0x0;
+	for(int i = 0; i < MAX_CMDBUFFERS; i++)
+		m_apCommandBuffers[i] = 0x0;
+	m_NumCommandBuffers = 2;
+	m_NumKicks = 0;
+	m_NumFrames = 0;
+	m_QueueStallTime = 0;
+	m_FrameStallTime = 0;
+	mem_zero(&m_FrameStats, sizeof(m_FrameStats));
+	mem_zero(&m_LastFrameStats, sizeof(m_LastFrameStats));
+	m_LastRenderTexture = -2;
+	m_GpuTimers = false;
+	m_GpuTimerGroup = -1;
+	for(int i = 0; i < CCommandBuffer::MAX_READBACKS; i++)
+	{
+		m_aCaptures[i].m_State = CAPTURE_FREE;
+		m_aCaptures[i].m_Image.m_pData = 0;
+	}
+	m_CaptureStart = 0;
 
 	m_NumVertices = 0;
+	m_NumBatches = 0;
+	m_NumBatchDraws = 0;
+	m_NumBatchVertices = 0;
 
 	m_ScreenWidth = -1;
 	m_ScreenHeight = -1;
@@ -267,12 +413,34 @@ void CGraphics_Threaded::LinesDraw(const CLineItem *pArray, int Num)
 
 int CGraphics_Threaded::UnloadTexture(CTextureHandle *Index)
 {
+	FlushBatches();
+
 	if(Index->Id() == m_InvalidTexture.Id())
 		return 0;
 
 	if(!Index->IsValid())
 		return 0;
 
+	// a loading texture gives its slot back once the load finished, a failed one right away
+	if(m_aTextureStandIns[Index->Id()] != -1)
+	{
+		bool Loading = false;
+		for(int i = 0; i < MAX_ASYNC_TEXTURES; i++)
+			if(m_aAsyncTextures[i].m_Used && m_aAsyncTextures[i].m_Slot == Index->Id())
+			{
+				m_aAsyncTextures[i].m_Cancelled = true;
+				Loading = true;
+			}
+		if(!Loading)
+		{
+			m_aTextureStandIns[Index->Id()] = -1;
+			m_aTextureIndices[Index->Id()] = m_FirstFreeTexture;
+			m_FirstFreeTexture = Index->Id();
+		}
+		Index->Invalidate();
+		return 0;
+	}
+
 	CCommandBuffer::CTextureDestroyCommand Cmd;
 	Cmd.m_Slot = Index->Id();
 	m_pCommandBuffer->AddCommand(Cmd);
@@ -308,6 +476,8 @@ int CGraphics_Threaded::LoadTextureRawSub(CTextureHandle TextureID, int x, int y
 	if(!TextureID.IsValid())
 		return 0;
 
+	FlushBatches();
+
 	CCommandBuffer::CTextureUpdateCommand Cmd;
 	Cmd.m_Slot = TextureID.Id();
 	Cmd.m_X = x;
@@ -320,7 +490,7 @@ int CGraphics_Threaded::LoadTextureRawSub(CTextureHandle TextureID, int x, int y
 	int MemSize = Width*Height*ImageFormatToPixelSize(Format);
 
 	// copy texture data
-	void *pTmpData = mem_alloc(MemSize, sizeof(void*));
+	void *pTmpData = mem_alloc_tag(MemSize, sizeof(void*), MEMTAG_GRAPHICS);
 	mem_copy(pTmpData, pData, MemSize);
 	Cmd.m_pData = pTmpData;
 
@@ -329,19 +499,12 @@ int CGraphics_Threaded::LoadTextureRawSub(CTextureHandle TextureID, int x, int y
 	return 0;
 }
 
-IGraphics::CTextureHandle CGraphics_Threaded::LoadTextureRaw(int Width, int Height, int Format, const void *pData, int StoreFormat, int Flags)
+void CGraphics_Threaded::CreateTexture(int Slot, int Width, int Height, int Format, const void *pData, int StoreFormat, int Flags)
 {
-	// don't waste memory on texture if we are stress testing
-	if(m_pConfig->m_DbgStress)
-		return m_InvalidTexture;
-
-	// grab texture
-	int Tex = m_FirstFreeTexture;
-	m_FirstFreeTexture = m_aTextureIndices[Tex];
-	m_aTextureIndices[Tex] = -1;
+	FlushBatches();
 
 	CCommandBuffer::CTextureCreateCommand Cmd;
-	Cmd.m_Slot = Tex;
+	Cmd.m_Slot = Slot;
 	Cmd.m_Width = Width;
 	Cmd.m_Height = Height;
 	Cmd.m_PixelSize = ImageFormatToPixelSize(Format);
@@ -370,17 +533,114 @@ IGraphics::CTextureHandle CGraphics_Threaded::LoadTextureRaw(int Width, int Heig
 
 	// copy texture data
 	int MemSize = Width*Height*Cmd.m_PixelSize;
-	void *pTmpData = mem_alloc(MemSize, sizeof(void*));
+	void *pTmpData = mem_alloc_tag(MemSize, sizeof(void*), MEMTAG_GRAPHICS);
 	mem_copy(pTmpData, pData, MemSize);
 	Cmd.m_pData = pTmpData;
 
 
 	//
 	m_pCommandBuffer->AddCommand(Cmd);
+}
+
+IGraphics::CTextureHandle CGraphics_Threaded::LoadTextureRaw(int Width, int Height, int Format, const void *pData, int StoreFormat, int Flags)
+{
+	// don't waste memory on texture if we are stress testing
+	if(m_pConfig->m_DbgStress)
+		return m_InvalidTexture;
 
+	// keep a copy around for the upload
+	if(Flags&TEXLOAD_ASYNC && m_pConfig->m_GfxAsyncTextures)
+	{
+		CAsyncTexture *pAsync = AddAsyncTexture(StoreFormat, Flags);
+		if(pAsync)
+		{
+			int MemSize = Width*Height*ImageFormatToPixelSize(Format);
+			pAsync->m_Image.m_Width = Width;
+			pAsync->m_Image.m_Height = Height;
+			pAsync->m_Image.m_Format = Format;
+			pAsync->m_Image.m_pData = mem_alloc_tag(MemSize, sizeof(void*), MEMTAG_GRAPHICS);
+			mem_copy(pAsync->m_Image.m_pData, pData, MemSize);
+			return CreateTextureHandle(pAsync->m_Slot);
+		}
+	}
+
+	// grab texture
+	int Tex = m_FirstFreeTexture;
+	m_FirstFreeTexture = m_aTextureIndices[Tex];
+	m_aTextureIndices[Tex] = -1;
+
+	CreateTexture(Tex, Width, Height, Format, pData, StoreFormat, Flags);
 	return CreateTextureHandle(Tex);
 }
 
+CGraphics_Threaded::CAsyncTexture *CGraphics_Threaded::AddAsyncTexture(int StoreFormat, int Flags)
+{
+	for(int i = 0; i < MAX_ASYNC_TEXTURES; i++)
+	{
+		CAsyncTexture *pAsync = &m_aAsyncTextures[i];
+		if(pAsync->m_Used)
+			continue;
+
+		pAsync->m_Used = true;
+		pAsync->m_Cancelled = false;
+		pAsync->m_Slot = m_FirstFreeTexture;
+		m_FirstFreeTexture = m_aTextureIndices[pAsync->m_Slot];
+		m_aTextureIndices[pAsync->m_Slot] = -1;
+		m_aTextureStandIns[pAsync->m_Slot] = m_PendingTexture.Id();
+		pAsync->m_aFilename[0] = 0;
+		pAsync->m_StoreFormat = StoreFormat;
+		pAsync->m_Flags = Flags;
+		mem_zero(&pAsync->m_Image, sizeof(pAsync->m_Image));
+		return pAsync;
+	}
+	return 0;
+}
+
+int CGraphics_Threaded::LoadTextureJob(void *pUser)
+{
+	CAsyncTexture *pAsync = (CAsyncTexture *)pUser;
+	if(!pAsync->m_pGraphics->LoadPNG(&pAsync->m_Image, pAsync->m_aFilename, pAsync->m_StorageType))
+		pAsync->m_Image.m_pData = 0;
+	return 0;
+}
+
+void CGraphics_Threaded::UploadAsyncTextures()
+{
+	// at least one texture per frame, more while they fit into the budget
+	int Budget = m_pConfig->m_GfxTextureUploadBudget*1024;
+	for(int i = 0; i < MAX_ASYNC_TEXTURES && Budget > 0; i++)
+	{
+		CAsyncTexture *pAsync = &m_aAsyncTextures[i];
+		if(!pAsync->m_Used || pAsync->m_Job.Status() != CJob::STATE_DONE)
+			continue;
+
+		CImageInfo *pImg = &pAsync->m_Image;
+		if(pAsync->m_Cancelled)
+		{
+			m_aTextureStandIns[pAsync->m_Slot] = -1;
+			m_aTextureIndices[pAsync->m_Slot] = m_FirstFreeTexture;
+			m_FirstFreeTexture = pAsync->m_Slot;
+		}
+		else if(!pImg->m_pData)
+		{
+			// the slot stays reserved and shows the invalid texture like a failed LoadTexture
+			m_aTextureStandIns[pAsync->m_Slot] = m_InvalidTexture.Id();
+		}
+		else
+		{
+			m_aTextureStandIns[pAsync->m_Slot] = -1;
+			int StoreFormat = pAsync->m_StoreFormat == CImageInfo::FORMAT_AUTO ? pImg->m_Format : pAsync->m_StoreFormat;
+			CreateTexture(pAsync->m_Slot, pImg->m_Width, pImg->m_Height, pImg->m_Format, pImg->m_pData, StoreFormat, pAsync->m_Flags);
+			Budget -= pImg->m_Width*pImg->m_Height*ImageFormatToPixelSize(pImg->m_Format);
+			if(m_pConfig->m_Debug && pAsync->m_aFilename[0])
+				dbg_msg("graphics/texture", "loaded %s", pAsync->m_aFilename);
+		}
+		mem_free(pImg->m_pData);
+		pImg->m_pData = 0;
+		pAsync->m_Used = false;
+	}
+}
+
 // simple uncompressed RGBA loaders
 IGraphics::CTextureHandle CGraphics_Threaded::LoadTexture(const char *pFilename, int StorageType, int StoreFormat, int Flags)
 {
@@ -390,6 +650,20 @@ IGraphics::CTextureHandle CGraphics_Threaded::LoadTexture(const char *pFilename,
 
 	if(l < 3)
 		return CTextureHandle();
+
+	// decode on the job pool
+	if(Flags&TEXLOAD_ASYNC && m_pConfig->m_GfxAsyncTextures && !m_pConfig->m_DbgStress)
+	{
+		CAsyncTexture *pAsync = AddAsyncTexture(StoreFormat, Flags);
+		if(pAsync)
+		{
+			str_copy(pAsync->m_aFilename, pFilename, sizeof(pAsync->m_aFilename));
+			pAsync->m_StorageType = StorageType;
+			m_pEngine->AddJob(&pAsync->m_Job, LoadTextureJob, pAsync);
+			return CreateTextureHandle(pAsync->m_Slot);
+		}
+	}
+
 	if(LoadPNG(&Img, pFilename, StorageType))
 	{
 		if (StoreFormat == CImageInfo::FORMAT_AUTO)
@@ -439,7 +713,7 @@ int CGraphics_Threaded::LoadPNG(CImageInfo *pImg, const char *pFilename, int Sto
 		return 0;
 	}
 
-	pBuffer = (unsigned char *)mem_alloc(Png.width * Png.height * Png.bpp, 1); // ignore_convention
+	pBuffer = (unsigned char *)mem_alloc_tag(Png.width * Png.height * Png.bpp, 1, MEMTAG_GRAPHICS); // ignore_convention
 	png_get_data(&Png, pBuffer); // ignore_convention
 	png_close_file(&Png); // ignore_convention
 
@@ -455,61 +729,210 @@ int CGraphics_Threaded::LoadPNG(CImageInfo *pImg, const char *pFilename, int Sto
 
 void CGraphics_Threaded::KickCommandBuffer()
 {
+	m_FrameStats.m_CommandBytes += m_pCommandBuffer->m_CmdBuffer.DataUsed();
+	m_FrameStats.m_DataBytes += m_pCommandBuffer->m_DataBuffer.DataUsed();
+
+	int64 StartTime = time_get();
 	m_pBackend->RunBuffer(m_pCommandBuffer);
+	m_QueueStallTime += time_get()-StartTime;
+	m_NumKicks++;
 
-	// swap buffer
-	m_CurrentCommandBuffer ^= 1;
+	// the next buffer is never pending as the backend accepts one less
+	m_CurrentCommandBuffer = (m_CurrentCommandBuffer+1)%m_NumCommandBuffers;
 	m_pCommandBuffer = m_apCommandBuffers[m_CurrentCommandBuffer];
 	m_pCommandBuffer->Reset();
 }
 
-void CGraphics_Threaded::ScreenshotDirect(const char *pFilename)
+void CGraphics_Threaded::LimitFramesInFlight()
 {
-	// add swap command
-	CImageInfo Image;
-	mem_zero(&Image, sizeof(Image));
+	int MaxFrames = clamp(m_pConfig->m_GfxFramesInFlight, 1, (int)MAX_FRAMES_IN_FLIGHT);
+	m_aFrameKicks[m_NumFrames%(MAX_FRAMES_IN_FLIGHT+1)] = m_NumKicks;
+	m_NumFrames++;
+	if(m_NumFrames <= (unsigned)MaxFrames)
+		return;
 
-	CCommandBuffer::CScreenshotCommand Cmd;
-	Cmd.m_pImage = &Image;
-	Cmd.m_X = 0; Cmd.m_Y = 0;
-	Cmd.m_W = -1; Cmd.m_H = -1;
-	m_pCommandBuffer->AddCommand(Cmd);
+	// wait until the buffer that ended the frame MaxFrames ago has run
+	unsigned FrameEnd = m_aFrameKicks[(m_NumFrames-1-MaxFrames)%(MAX_FRAMES_IN_FLIGHT+1)];
+	int MaxPending = m_NumKicks-FrameEnd;
+	if(m_pBackend->NumPending() <= MaxPending)
+		return;
+	int64 StartTime = time_get();
+	m_pBackend->WaitForPending(MaxPending);
+	m_FrameStallTime += time_get()-StartTime;
+}
 
-	// kick the buffer and wait for the result
-	KickCommandBuffer();
-	WaitForIdle();
+void CGraphics_Threaded::GetStallTimes(int64 *pQueueStall, int64 *pFrameStall) const
+{
+	*pQueueStall = m_QueueStallTime;
+	*pFrameStall = m_FrameStallTime;
+}
 
-	if(Image.m_pData)
+int CGraphics_Threaded::EncodeCaptureJob(void *pUser)
+{
+	CCapture *pCapture = (CCapture *)pUser;
+	CImageInfo *pImg = &pCapture->m_Image;
+	int w = pImg->m_Width;
+	int h = pImg->m_Height;
+
+	// the readback is rgba from the bottom up
+	unsigned char *pRgb = (unsigned char *)mem_alloc_tag(w*h*3, 1, MEMTAG_GRAPHICS);
+	for(int y = 0; y < h; y++)
 	{
-		// find filename
-		char aWholePath[1024];
-		png_t Png; // ignore_convention
+		const unsigned char *pSrc = (const unsigned char *)pImg->m_pData + (h-1-y)*w*4;
+		unsigned char *pDst = pRgb + y*w*3;
+		for(int x = 0; x < w; x++, pSrc += 4, pDst += 3)
+		{
+			pDst[0] = pSrc[0];
+			pDst[1] = pSrc[1];
+			pDst[2] = pSrc[2];
+		}
+	}
+	mem_free(pImg->m_pData);
+	pImg->m_pData = 0;
 
-		IOHANDLE File = m_pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE, aWholePath, sizeof(aWholePath));
+	if(pCapture->m_Format == CAPTUREFORMAT_PNG)
+	{
+		png_t Png; // ignore_convention
+		png_open_file_write(&Png, pCapture->m_aPath); // ignore_convention
+		png_set_data(&Png, w, h, 8, PNG_TRUECOLOR, pRgb); // ignore_convention
+		png_close_file(&Png); // ignore_convention
+	}
+	else
+	{
+		IOHANDLE File = io_open(pCapture->m_aPath, IOFLAG_WRITE);
 		if(File)
+		{
+			char aHeader[64];
+			str_format(aHeader, sizeof(aHeader), "P6\n%d %d\n255\n", w, h);
+			io_write(File, aHeader, str_length(aHeader));
+			io_write(File, pRgb, w*h*3);
 			io_close(File);
+		}
+	}
+	mem_free(pRgb);
+	return 0;
+}
 
-		// save png
-		char aBuf[256];
-		str_format(aBuf, sizeof(aBuf), "saved screenshot to '%s'", aWholePath);
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "client", aBuf);
-		png_open_file_write(&Png, aWholePath); // ignore_convention
-		png_set_data(&Png, Image.m_Width, Image.m_Height, 8, PNG_TRUECOLOR, (unsigned char *)Image.m_pData); // ignore_convention
-		png_close_file(&Png); // ignore_convention
+bool CGraphics_Threaded::StartCapture(const char *pFilename, int Format, bool Screenshot)
+{
+	int Slot = -1;
+	for(int i = 0; i < CCommandBuffer::MAX_READBACKS && Slot < 0; i++)
+		if(m_aCaptures[i].m_State == CAPTURE_FREE)
+			Slot = i;
+	if(Slot < 0)
+		return false;
+
+	CCommandBuffer::CReadbackCommand Cmd;
+	Cmd.m_Slot = Slot;
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+
+	CCapture *pCapture = &m_aCaptures[Slot];
+	pCapture->m_State = CAPTURE_READING;
+	pCapture->m_Frame = m_NumFrames;
+	pCapture->m_Done = 0;
+	pCapture->m_Format = Format;
+	pCapture->m_Screenshot = Screenshot;
+	m_pStorage->GetCompletePath(IStorage::TYPE_SAVE, pFilename, pCapture->m_aPath, sizeof(pCapture->m_aPath));
+	return true;
+}
+
+void CGraphics_Threaded::UpdateCaptures()
+{
+	for(int i = 0; i < CCommandBuffer::MAX_READBACKS; i++)
+	{
+		CCapture *pCapture = &m_aCaptures[i];
+		if(pCapture->m_State == CAPTURE_READING && m_NumFrames-pCapture->m_Frame >= (unsigned)READBACK_DELAY)
+		{
+			// the gpu should be done with it by now
+			CCommandBuffer::CReadbackFinishCommand Cmd;
+			Cmd.m_Slot = i;
+			Cmd.m_pImage = &pCapture->m_Image;
+			Cmd.m_pDone = &pCapture->m_Done;
+			if(!m_pCommandBuffer->AddCommand(Cmd))
+			{
+				KickCommandBuffer();
+				m_pCommandBuffer->AddCommand(Cmd);
+			}
+			pCapture->m_State = CAPTURE_MAPPING;
+		}
+		else if(pCapture->m_State == CAPTURE_MAPPING && pCapture->m_Done)
+		{
+			sync_barrier();
+			if(pCapture->m_Image.m_pData)
+			{
+				m_pEngine->AddJob(&pCapture->m_Job, EncodeCaptureJob, pCapture);
+				pCapture->m_State = CAPTURE_ENCODING;
+			}
+			else
+				pCapture->m_State = CAPTURE_FREE;
+		}
+		else if(pCapture->m_State == CAPTURE_ENCODING && pCapture->m_Job.Status() == CJob::STATE_DONE)
+		{
+			if(pCapture->m_Screenshot)
+			{
+				char aBuf[IO_MAX_PATH_LENGTH+64];
+				str_format(aBuf, sizeof(aBuf), "saved screenshot to '%s'", pCapture->m_aPath);
+				m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "client", aBuf);
+			}
+			pCapture->m_State = CAPTURE_FREE;
+		}
+	}
+}
+
+void CGraphics_Threaded::UpdateContinuousCapture()
+{
+	char aBuf[256];
+	if(!m_pConfig->m_GfxCapture)
+	{
+		if(m_CaptureStart)
+		{
+			str_format(aBuf, sizeof(aBuf), "captured %d frames to '%s', dropped %d", m_NumCapturedFrames, m_aCaptureFolder, m_NumDroppedFrames);
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "client", aBuf);
+			m_CaptureStart = 0;
+		}
+		return;
+	}
 
-		mem_free(Image.m_pData);
+	if(!m_CaptureStart)
+	{
+		char aDate[20];
+		str_timestamp(aDate, sizeof(aDate));
+		str_format(m_aCaptureFolder, sizeof(m_aCaptureFolder), "captures/%s", aDate);
+		m_pStorage->CreateFolder(m_aCaptureFolder, IStorage::TYPE_SAVE);
+		m_CaptureStart = time_get();
+		m_LastCaptureFrame = -1;
+		m_NumCapturedFrames = 0;
+		m_NumDroppedFrames = 0;
 	}
+
+	int Frame = (int)((time_get()-m_CaptureStart)*m_pConfig->m_GfxCaptureFps/time_freq());
+	if(Frame == m_LastCaptureFrame)
+		return;
+	m_LastCaptureFrame = Frame;
+
+	// the files are numbered without gaps so they can be fed to an encoder as a sequence
+	int Format = m_pConfig->m_GfxCaptureFormat;
+	str_format(aBuf, sizeof(aBuf), "%s/%06d.%s", m_aCaptureFolder, m_NumCapturedFrames, Format == CAPTUREFORMAT_PNG ? "png" : "ppm");
+	if(StartCapture(aBuf, Format, false))
+		m_NumCapturedFrames++;
+	else
+		m_NumDroppedFrames++;
 }
 
 void CGraphics_Threaded::TextureSet(CTextureHandle TextureID)
 {
 	dbg_assert(m_Drawing == 0, "called Graphics()->TextureSet within begin");
-	m_State.m_Texture = TextureID.Id();
+	m_State.m_Texture = TextureID.IsValid() && m_aTextureStandIns[TextureID.Id()] != -1 ? m_aTextureStandIns[TextureID.Id()] : TextureID.Id();
 	m_State.m_Dimension = 2;
 }
 
 void CGraphics_Threaded::Clear(float r, float g, float b)
 {
+	FlushBatches();
 	CCommandBuffer::CClearCommand Cmd;
 	Cmd.m_Color.r = r;
 	Cmd.m_Color.g = g;
@@ -710,6 +1133,25 @@ void CGraphics_Threaded::QuadsDrawFreeform(const CFreeformItem *pArray, int Num)
 	AddVertices(4*Num);
 }
 
+void CGraphics_Threaded::QuadsDrawRecorded(const CRecordedQuad *pQuads, int Num)
+{
+	dbg_assert(m_Drawing == DRAWING_QUADS, "called Graphics()->QuadsDrawRecorded without begin");
+
+	for(int i = 0; i < Num; ++i)
+	{
+		const CRecordedQuad *pQuad = &pQuads[i];
+		if(!pQuad->m_Draw)
+			continue;
+
+		WrapMode(pQuad->m_WrapU, pQuad->m_WrapV);
+		QuadsSetSubsetFree(
+			pQuad->m_aTexCoords[0], pQuad->m_aTexCoords[1], pQuad->m_aTexCoords[2], pQuad->m_aTexCoords[3],
+			pQuad->m_aTexCoords[4], pQuad->m_aTexCoords[5], pQuad->m_aTexCoords[6], pQuad->m_aTexCoords[7]);
+		SetColorVertex(pQuad->m_aColors, 4);
+		QuadsDrawFreeform(&pQuad->m_Pos, 1);
+	}
+}
+
 void CGraphics_Threaded::QuadsText(float x, float y, float Size, const char *pText)
 {
 	float StartX = x;
@@ -739,6 +1181,249 @@ void CGraphics_Threaded::QuadsText(float x, float y, float Size, const char *pTe
 	}
 }
 
+IGraphics::CBufferHandle CGraphics_Threaded::CreateQuadBuffer(const CBufferQuad *pQuads, int Num)
+{
+	// the tileset fallback system needs to switch textures between quads
+	if(Num <= 0 || m_FirstFreeBuffer < 0 || !m_pConfig->m_GfxVertexBuffers ||
+		!m_pBackend->HasVertexBuffers() || m_pBackend->GetTextureArraySize() > 1)
+		return CBufferHandle();
+
+	FlushBatches();
+
+	int Buffer = m_FirstFreeBuffer;
+	m_FirstFreeBuffer = m_aBufferIndices[Buffer];
+	m_aBufferIndices[Buffer] = -1;
+	m_aBufferDimensions[Buffer] = pQuads[0].m_TextureIndex < 0 ? 2 : 3;
+
+	CCommandBuffer::CBufferCreateCommand Cmd;
+	Cmd.m_Slot = Buffer;
+	Cmd.m_NumVertices = Num*4;
+	Cmd.m_pVertices = (CCommandBuffer::CBufferVertex *)mem_alloc_tag(sizeof(CCommandBuffer::CBufferVertex)*Cmd.m_NumVertices, sizeof(void*), MEMTAG_GRAPHICS);
+	for(int i = 0; i < Num; i++)
+	{
+		CCommandBuffer::CBufferVertex *pVertex = &Cmd.m_pVertices[i*4];
+		const CBufferQuad *pQuad = &pQuads[i];
+		pVertex[0].m_Pos.x = pQuad->m_X;
+		pVertex[0].m_Pos.y = pQuad->m_Y;
+		pVertex[1].m_Pos.x = pQuad->m_X + pQuad->m_Width;
+		pVertex[1].m_Pos.y = pQuad->m_Y;
+		pVertex[2].m_Pos.x = pQuad->m_X + pQuad->m_Width;
+		pVertex[2].m_Pos.y = pQuad->m_Y + pQuad->m_Height;
+		pVertex[3].m_Pos.x = pQuad->m_X;
+		pVertex[3].m_Pos.y = pQuad->m_Y + pQuad->m_Height;
+		for(int c = 0; c < 4; c++)
+		{
+			pVertex[c].m_Tex.u = pQuad->m_aU[c];
+			pVertex[c].m_Tex.v = pQuad->m_aV[c];
+			pVertex[c].m_Tex.i = (0.5f + pQuad->m_TextureIndex) / 256.0f;
+		}
+	}
+
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+	return CreateBufferHandle(Buffer);
+}
+
+void CGraphics_Threaded::DeleteQuadBuffer(CBufferHandle *pBuffer)
+{
+	FlushBatches();
+
+	if(!pBuffer->IsValid())
+		return;
+
+	CCommandBuffer::CBufferDestroyCommand Cmd;
+	Cmd.m_Slot = pBuffer->Id();
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+
+	m_aBufferIndices[pBuffer->Id()] = m_FirstFreeBuffer;
+	m_FirstFreeBuffer = pBuffer->Id();
+
+	pBuffer->Invalidate();
+}
+
+void CGraphics_Threaded::RenderQuadBuffer(CBufferHandle Buffer, int FirstQuad, int NumQuads, const vec4 &Color)
+{
+	dbg_assert(m_Drawing == 0, "called Graphics()->RenderQuadBuffer within begin");
+	if(!Buffer.IsValid() || NumQuads <= 0)
+		return;
+
+	FlushBatches();
+
+	CCommandBuffer::CRenderBufferCommand Cmd;
+	Cmd.m_State = m_State;
+	Cmd.m_State.m_Dimension = m_aBufferDimensions[Buffer.Id()];
+	Cmd.m_State.m_TextureArrayIndex = 0;
+	Cmd.m_Slot = Buffer.Id();
+	Cmd.m_FirstQuad = FirstQuad;
+	Cmd.m_NumQuads = NumQuads;
+	Cmd.m_Color.r = Color.r;
+	Cmd.m_Color.g = Color.g;
+	Cmd.m_Color.b = Color.b;
+	Cmd.m_Color.a = Color.a;
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+}
+
+IGraphics::CTextureHandle CGraphics_Threaded::LoadTileIndices(int Width, int Height, const unsigned char *pData)
+{
+	if(!m_pConfig->m_GfxTilemapShader || !m_pBackend->HasTilemapShader() || m_pBackend->GetTextureArraySize() > 1 ||
+		Width > m_pBackend->MaxTextureSize() || Height > m_pBackend->MaxTextureSize() || m_FirstFreeTexture < 0)
+		return CTextureHandle();
+
+	FlushBatches();
+
+	int Tex = m_FirstFreeTexture;
+	m_FirstFreeTexture = m_aTextureIndices[Tex];
+	m_aTextureIndices[Tex] = -1;
+
+	CCommandBuffer::CTextureCreateCommand Cmd;
+	Cmd.m_Slot = Tex;
+	Cmd.m_Width = Width;
+	Cmd.m_Height = Height;
+	Cmd.m_PixelSize = 4;
+	Cmd.m_Format = CCommandBuffer::TEXFORMAT_RGBA;
+	Cmd.m_StoreFormat = CCommandBuffer::TEXFORMAT_RGBA;
+	Cmd.m_Flags = CCommandBuffer::TEXFLAG_TILEINDICES;
+
+	int MemSize = Width*Height*Cmd.m_PixelSize;
+	void *pTmpData = mem_alloc_tag(MemSize, sizeof(void*), MEMTAG_GRAPHICS);
+	mem_copy(pTmpData, pData, MemSize);
+	Cmd.m_pData = pTmpData;
+
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+	return CreateTextureHandle(Tex);
+}
+
+void CGraphics_Threaded::RenderTileIndices(CTextureHandle Indices, int Width, int Height, float Scale, const vec4 &Color, bool Extend)
+{
+	dbg_assert(m_Drawing == 0, "called Graphics()->RenderTileIndices within begin");
+	if(!Indices.IsValid())
+		return;
+
+	FlushBatches();
+
+	CCommandBuffer::CRenderTilemapCommand Cmd;
+	Cmd.m_State = m_State;
+	Cmd.m_State.m_Dimension = 3;
+	Cmd.m_State.m_TextureArrayIndex = 0;
+	Cmd.m_IndicesSlot = Indices.Id();
+	Cmd.m_Width = Width;
+	Cmd.m_Height = Height;
+	Cmd.m_Scale = Scale;
+	Cmd.m_TopLeft = m_State.m_ScreenTL;
+	Cmd.m_BottomRight = m_State.m_ScreenBR;
+	if(!Extend)
+	{
+		Cmd.m_TopLeft.x = max(Cmd.m_TopLeft.x, 0.0f);
+		Cmd.m_TopLeft.y = max(Cmd.m_TopLeft.y, 0.0f);
+		Cmd.m_BottomRight.x = min(Cmd.m_BottomRight.x, Width*Scale);
+		Cmd.m_BottomRight.y = min(Cmd.m_BottomRight.y, Height*Scale);
+		if(Cmd.m_TopLeft.x >= Cmd.m_BottomRight.x || Cmd.m_TopLeft.y >= Cmd.m_BottomRight.y)
+			return;
+	}
+	Cmd.m_Color.r = Color.r;
+	Cmd.m_Color.g = Color.g;
+	Cmd.m_Color.b = Color.b;
+	Cmd.m_Color.a = Color.a;
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+}
+
+IGraphics::CTextureHandle CGraphics_Threaded::CreateRenderTarget(int Width, int Height)
+{
+	if(!m_pBackend->HasRenderTargets() || Width <= 0 || Height <= 0 ||
+		Width > m_pBackend->MaxTextureSize() || Height > m_pBackend->MaxTextureSize() || m_FirstFreeTexture < 0)
+		return CTextureHandle();
+
+	FlushBatches();
+
+	int Tex = m_FirstFreeTexture;
+	m_FirstFreeTexture = m_aTextureIndices[Tex];
+	m_aTextureIndices[Tex] = -1;
+
+	CCommandBuffer::CTextureCreateCommand Cmd;
+	Cmd.m_Slot = Tex;
+	Cmd.m_Width = Width;
+	Cmd.m_Height = Height;
+	Cmd.m_PixelSize = 4;
+	Cmd.m_Format = CCommandBuffer::TEXFORMAT_RGBA;
+	Cmd.m_StoreFormat = CCommandBuffer::TEXFORMAT_RGBA;
+	Cmd.m_Flags = CCommandBuffer::TEXFLAG_RENDERTARGET;
+	Cmd.m_pData = 0;
+
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+	return CreateTextureHandle(Tex);
+}
+
+void CGraphics_Threaded::SetRenderTarget(CTextureHandle Target)
+{
+	dbg_assert(m_Drawing == 0, "called Graphics()->SetRenderTarget within begin");
+
+	FlushBatches();
+
+	CCommandBuffer::CRenderTargetCommand Cmd;
+	Cmd.m_Slot = Target.IsValid() ? Target.Id() : -1;
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+}
+
+void CGraphics_Threaded::RenderQuadInstances(const CQuadInstance *pInstances, int Num)
+{
+	dbg_assert(m_Drawing == 0, "called Graphics()->RenderQuadInstances within begin");
+
+	FlushBatches();
+
+	while(Num > 0)
+	{
+		CCommandBuffer::CRenderInstancesCommand Cmd;
+		Cmd.m_State = m_State;
+		Cmd.m_TexLayer = m_aTexture[0].i;
+		Cmd.m_NumInstances = min(Num, (int)MAX_INSTANCES);
+		unsigned DataSize = sizeof(CQuadInstance)*Cmd.m_NumInstances;
+
+		// the data and the command have to end up in the same buffer
+		Cmd.m_pInstances = (CQuadInstance *)m_pCommandBuffer->AllocData(DataSize);
+		if(Cmd.m_pInstances == 0x0 || !m_pCommandBuffer->AddCommand(Cmd))
+		{
+			KickCommandBuffer();
+			Cmd.m_pInstances = (CQuadInstance *)m_pCommandBuffer->AllocData(DataSize);
+			if(Cmd.m_pInstances == 0x0 || !m_pCommandBuffer->AddCommand(Cmd))
+			{
+				dbg_msg("graphics", "failed to allocate data for instances");
+				return;
+			}
+		}
+		mem_copy(Cmd.m_pInstances, pInstances, DataSize);
+
+		pInstances += Cmd.m_NumInstances;
+		Num -= Cmd.m_NumInstances;
+	}
+}
+
 int CGraphics_Threaded::IssueInit()
 {
 	int Flags = 0;
@@ -748,6 +1433,7 @@ int CGraphics_Threaded::IssueInit()
 	if(m_pConfig->m_GfxHighdpi) Flags |= IGraphicsBackend::INITFLAG_HIGHDPI;
 	if(m_pConfig->m_DbgResizable) Flags |= IGraphicsBackend::INITFLAG_RESIZABLE;
 	if(m_pConfig->m_GfxUseX11XRandRWM) Flags |= IGraphicsBackend::INITFLAG_X11XRANDR;
+	if(m_pConfig->m_GfxOpenGLCore) Flags |= IGraphicsBackend::INITFLAG_OPENGL_CORE;
 
 	return m_pBackend->Init("Teeworlds", &m_pConfig->m_GfxScreen, &m_pConfig->m_GfxScreenWidth,
 			&m_pConfig->m_GfxScreenHeight, &m_ScreenWidth, &m_ScreenHeight, m_pConfig->m_GfxFsaaSamples,
@@ -795,23 +1481,39 @@ int CGraphics_Threaded::Init()
 	m_pStorage = Kernel()->RequestInterface<IStorage>();
 	m_pConfig = Kernel()->RequestInterface<IConfigManager>()->Values();
 	m_pConsole = Kernel()->RequestInterface<IConsole>();
+	m_pEngine = Kernel()->RequestInterface<IEngine>();
 
 	// init textures
 	m_FirstFreeTexture = 0;
+	for(int i = 0; i < MAX_TEXTURES; i++)
+		m_aTextureStandIns[i] = -1;
+	for(int i = 0; i < MAX_ASYNC_TEXTURES; i++)
+	{
+		m_aAsyncTextures[i].m_pGraphics = this;
+		m_aAsyncTextures[i].m_Used = false;
+	}
 	for(int i = 0; i < MAX_TEXTURES-1; i++)
 		m_aTextureIndices[i] = i+1;
 	m_aTextureIndices[MAX_TEXTURES-1] = -1;
 
+	// init static buffers
+	m_FirstFreeBuffer = 0;
+	for(int i = 0; i < MAX_BUFFERS-1; i++)
+		m_aBufferIndices[i] = i+1;
+	m_aBufferIndices[MAX_BUFFERS-1] = -1;
+
 	m_pBackend = CreateGraphicsBackend();
 	if(InitWindow() != 0)
 		return -1;
 
 	m_ScreenHiDPIScale = m_ScreenWidth / (float)m_pConfig->m_GfxScreenWidth;
 
-	// create command buffers
-	for(int i = 0; i < NUM_CMDBUFFERS; i++)
+	// create command buffers, one of them is always being filled
+	m_NumCommandBuffers = clamp(m_pConfig->m_GfxCommandBuffers, 2, (int)MAX_CMDBUFFERS);
+	for(int i = 0; i < m_NumCommandBuffers; i++)
 		m_apCommandBuffers[i] = new CCommandBuffer(128*1024, 2*1024*1024);
 	m_pCommandBuffer = m_apCommandBuffers[0];
+	m_pBackend->SetMaxPending(m_NumCommandBuffers-1);
 
 	// create null texture, will get id=0
 	unsigned char aNullTextureData[4*32*32];
@@ -852,19 +1554,37 @@ int CGraphics_Threaded::Init()
 		}
 
 	m_InvalidTexture = LoadTextureRaw(32,32,CImageInfo::FORMAT_RGBA,aNullTextureData,CImageInfo::FORMAT_RGBA,TEXLOAD_NORESAMPLE|TEXLOAD_MULTI_DIMENSION);
+
+	mem_zero(aNullTextureData, sizeof(aNullTextureData));
+	m_PendingTexture = LoadTextureRaw(32,32,CImageInfo::FORMAT_RGBA,aNullTextureData,CImageInfo::FORMAT_RGBA,TEXLOAD_NORESAMPLE|TEXLOAD_MULTI_DIMENSION);
 	return 0;
 }
 
 void CGraphics_Threaded::Shutdown()
 {
+	// the jobs write into the async textures
+	for(int i = 0; i < MAX_ASYNC_TEXTURES; i++)
+	{
+		while(m_aAsyncTextures[i].m_Job.Status() != CJob::STATE_DONE)
+			thread_sleep(1);
+		mem_free(m_aAsyncTextures[i].m_Image.m_pData);
+	}
+	for(int i = 0; i < CCommandBuffer::MAX_READBACKS; i++)
+		while(m_aCaptures[i].m_Job.Status() != CJob::STATE_DONE)
+			thread_sleep(1);
+
 	// shutdown the backend
 	m_pBackend->Shutdown();
 	delete m_pBackend;
 	m_pBackend = 0x0;
 
 	// delete the command buffers
-	for(int i = 0; i < NUM_CMDBUFFERS; i++)
+	for(int i = 0; i < m_NumCommandBuffers; i++)
 		delete m_apCommandBuffers[i];
+
+	// handed over readbacks that didn't get to the job pool
+	for(int i = 0; i < CCommandBuffer::MAX_READBACKS; i++)
+		mem_free(m_aCaptures[i].m_Image.m_pData);
 }
 
 int CGraphics_Threaded::GetNumScreens() const
@@ -921,6 +1641,8 @@ int CGraphics_Threaded::WindowOpen()
 
 void CGraphics_Threaded::ReadBackbuffer(unsigned char **ppPixels, int x, int y, int w, int h)
 {
+	FlushBatches();
+
 	if(!ppPixels)
 		return;
 
@@ -943,7 +1665,6 @@ void CGraphics_Threaded::ReadBackbuffer(unsigned char **ppPixels, int x, int y,
 
 void CGraphics_Threaded::TakeScreenshot(const char *pFilename)
 {
-	// TODO: screenshot support
 	char aDate[20];
 	str_timestamp(aDate, sizeof(aDate));
 	str_format(m_aScreenshotName, sizeof(m_aScreenshotName), "screenshots/%s_%s.png", pFilename?pFilename:"screenshot", aDate);
@@ -952,25 +1673,82 @@ void CGraphics_Threaded::TakeScreenshot(const char *pFilename)
 
 void CGraphics_Threaded::Swap()
 {
-	// TODO: screenshot support
-	if(m_DoScreenshot)
-	{
-		if(WindowActive())
-			ScreenshotDirect(m_aScreenshotName);
+	UploadAsyncTextures();
+
+	// read the finished frame, a screenshot waits while all readbacks are busy
+	FlushBatches();
+	UpdateCaptures();
+	if(m_DoScreenshot && (!WindowActive() || StartCapture(m_aScreenshotName, CAPTUREFORMAT_PNG, true)))
 		m_DoScreenshot = false;
-	}
+	if(WindowActive())
+		UpdateContinuousCapture();
 
 	// add swap command
+	if(m_GpuTimerGroup >= 0)
+		AddGpuTimerCommand(CCommandBuffer::GPU_TIMER_END_FRAME);
 	CCommandBuffer::CSwapCommand Cmd;
 	Cmd.m_Finish = m_pConfig->m_GfxFinish;
 	m_pCommandBuffer->AddCommand(Cmd);
 
 	// kick the command buffer
 	KickCommandBuffer();
+	LimitFramesInFlight();
+
+	m_LastFrameStats = m_FrameStats;
+	mem_zero(&m_FrameStats, sizeof(m_FrameStats));
+	m_LastRenderTexture = -2;
+
+	// the next frame starts right away
+	if(m_GpuTimers)
+		AddGpuTimerCommand(GPU_GROUP_OTHER);
+}
+
+void CGraphics_Threaded::AddGpuTimerCommand(int Group)
+{
+	CCommandBuffer::CGpuTimerCommand Cmd;
+	Cmd.m_Group = Group;
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+	m_GpuTimerGroup = Group;
+}
+
+void CGraphics_Threaded::SetGpuTimers(bool Enable)
+{
+	Enable = Enable && m_pBackend->HasGpuTimers();
+	if(Enable == m_GpuTimers)
+		return;
+	m_GpuTimers = Enable;
+	// an enabled timer starts with the next frame, a disabled one ends the current frame
+	if(!Enable && m_GpuTimerGroup >= 0)
+	{
+		FlushBatches();
+		AddGpuTimerCommand(CCommandBuffer::GPU_TIMER_END_FRAME);
+	}
+}
+
+void CGraphics_Threaded::GpuTimerGroup(int Group)
+{
+	if(m_GpuTimerGroup < 0 || Group == m_GpuTimerGroup)
+		return;
+	FlushBatches();
+	AddGpuTimerCommand(Group);
+}
+
+bool CGraphics_Threaded::GetGpuTimes(CGpuTimes *pTimes) const
+{
+	if(!m_pBackend->HasGpuTimers())
+		return false;
+	m_pBackend->GetGpuTimes(pTimes);
+	return true;
 }
 
 bool CGraphics_Threaded::SetVSync(bool State)
 {
+	FlushBatches();
+
 	// add vsnc command
 	bool RetOk = 0;
 	CCommandBuffer::CVSyncCommand Cmd;
@@ -987,6 +1765,7 @@ bool CGraphics_Threaded::SetVSync(bool State)
 // syncronization
 void CGraphics_Threaded::InsertSignal(semaphore *pSemaphore)
 {
+	FlushBatches();
 	CCommandBuffer::CSignalCommand Cmd;
 	Cmd.m_pSemaphore = pSemaphore;
 	m_pCommandBuffer->AddCommand(Cmd);
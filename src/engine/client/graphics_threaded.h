@@ -1,6 +1,7 @@
 #pragma once
 
 #include <engine/graphics.h>
+#include <engine/shared/jobs.h>
 
 class CCommandBuffer
 {
@@ -51,6 +52,8 @@ public:
 	enum
 	{
 		MAX_TEXTURES=1024*4,
+		MAX_BUFFERS=1024,
+		MAX_READBACKS=4,
 	};
 
 	enum
@@ -74,9 +77,17 @@ public:
 		CMD_TEXTURE_DESTROY,
 		CMD_TEXTURE_UPDATE,
 
+		// static vertex buffer commands
+		CMD_BUFFER_CREATE,
+		CMD_BUFFER_DESTROY,
+
 		// rendering
 		CMD_CLEAR,
 		CMD_RENDER,
+		CMD_RENDER_BUFFER,
+		CMD_RENDER_TILEMAP,
+		CMD_RENDER_INSTANCES,
+		CMD_RENDER_TARGET,
 
 		// swap
 		CMD_SWAP,
@@ -84,6 +95,9 @@ public:
 		// misc
 		CMD_VSYNC,
 		CMD_SCREENSHOT,
+		CMD_READBACK,
+		CMD_READBACK_FINISH,
+		CMD_GPU_TIMER,
 
 	};
 
@@ -100,6 +114,8 @@ public:
 		TEXFLAG_TEXTURE3D = 8,
 		TEXFLAG_TEXTURE2D = 16,
 		TEXTFLAG_LINEARMIPMAPS = 32,
+		TEXFLAG_TILEINDICES = 64,
+		TEXFLAG_RENDERTARGET = 128,
 	};
 
 	enum
@@ -110,6 +126,11 @@ public:
 		PRIMTYPE_QUADS,
 	};
 
+	enum
+	{
+		GPU_TIMER_END_FRAME = -1,
+	};
+
 	enum
 	{
 		BLEND_NONE = 0,
@@ -128,6 +149,13 @@ public:
 		CColor m_Color;
 	};
 
+	// vertices of static buffers, they are drawn in one color
+	struct CBufferVertex
+	{
+		CPoint m_Pos;
+		CTexCoord m_Tex;
+	};
+
 	struct CCommand
 	{
 	public:
@@ -182,6 +210,45 @@ public:
 		CVertex *m_pVertices; // you should use the command buffer data to allocate vertices for this command
 	};
 
+	struct CRenderBufferCommand : public CCommand
+	{
+		CRenderBufferCommand() : CCommand(CMD_RENDER_BUFFER) {}
+		CState m_State;
+		int m_Slot;
+		unsigned m_FirstQuad;
+		unsigned m_NumQuads;
+		CColor m_Color;
+	};
+
+	struct CRenderTilemapCommand : public CCommand
+	{
+		CRenderTilemapCommand() : CCommand(CMD_RENDER_TILEMAP) {}
+		CState m_State;
+		int m_IndicesSlot;
+		int m_Width;
+		int m_Height;
+		float m_Scale;
+		CPoint m_TopLeft; // the covered area
+		CPoint m_BottomRight;
+		CColor m_Color;
+	};
+
+	struct CRenderInstancesCommand : public CCommand
+	{
+		CRenderInstancesCommand() : CCommand(CMD_RENDER_INSTANCES) {}
+		CState m_State;
+		float m_TexLayer; // the third texture coordinate for texture arrays
+		unsigned m_NumInstances;
+		IGraphics::CQuadInstance *m_pInstances; // allocated in the command buffer data
+	};
+
+	// the following draws go into the texture of the slot, or to the screen with -1
+	struct CRenderTargetCommand : public CCommand
+	{
+		CRenderTargetCommand() : CCommand(CMD_RENDER_TARGET) {}
+		int m_Slot;
+	};
+
 	struct CScreenshotCommand : public CCommand
 	{
 		CScreenshotCommand() : CCommand(CMD_SCREENSHOT) {}
@@ -189,6 +256,22 @@ public:
 		CImageInfo *m_pImage; // processor will fill this out, the one who adds this command must free the data as well
 	};
 
+	// starts reading the back buffer into the slot, without waiting for the gpu if possible
+	struct CReadbackCommand : public CCommand
+	{
+		CReadbackCommand() : CCommand(CMD_READBACK) {}
+		int m_Slot;
+	};
+
+	// hands over what the slot read, a few frames after the readback started
+	struct CReadbackFinishCommand : public CCommand
+	{
+		CReadbackFinishCommand() : CCommand(CMD_READBACK_FINISH) {}
+		int m_Slot;
+		CImageInfo *m_pImage; // RGBA rows from the bottom up, the one who adds this command must free the data
+		volatile int *m_pDone; // set once the image is filled in
+	};
+
 	struct CSwapCommand : public CCommand
 	{
 		CSwapCommand() : CCommand(CMD_SWAP) {}
@@ -196,6 +279,13 @@ public:
 		int m_Finish;
 	};
 
+	struct CGpuTimerCommand : public CCommand
+	{
+		CGpuTimerCommand() : CCommand(CMD_GPU_TIMER) {}
+
+		int m_Group; // GPU_TIMER_END_FRAME ends the frame
+	};
+
 	struct CVSyncCommand : public CCommand
 	{
 		CVSyncCommand() : CCommand(CMD_VSYNC) {}
@@ -244,6 +334,22 @@ public:
 		int m_Slot;
 	};
 
+	struct CBufferCreateCommand : public CCommand
+	{
+		CBufferCreateCommand() : CCommand(CMD_BUFFER_CREATE) {}
+
+		int m_Slot;
+		int m_NumVertices;
+		CBufferVertex *m_pVertices; // will be freed by the command processor
+	};
+
+	struct CBufferDestroyCommand : public CCommand
+	{
+		CBufferDestroyCommand() : CCommand(CMD_BUFFER_DESTROY) {}
+
+		int m_Slot;
+	};
+
 	//
 	CCommandBuffer(unsigned CmdBufferSize, unsigned DataBufferSize)
 	: m_CmdBuffer(CmdBufferSize), m_DataBuffer(DataBufferSize)
@@ -300,6 +406,7 @@ public:
 		INITFLAG_BORDERLESS = 8,
 		INITFLAG_X11XRANDR = 16,
 		INITFLAG_HIGHDPI = 32,
+		INITFLAG_OPENGL_CORE = 64,
 	};
 
 	virtual ~IGraphicsBackend() {}
@@ -309,6 +416,10 @@ public:
 
 	virtual int MemoryUsage() const = 0;
 	virtual int GetTextureArraySize() const = 0;
+	virtual bool HasVertexBuffers() const = 0;
+	virtual bool HasTilemapShader() const = 0;
+	virtual bool HasRenderTargets() const = 0;
+	virtual int MaxTextureSize() const = 0;
 
 	virtual int GetNumScreens() const = 0;
 
@@ -323,7 +434,14 @@ public:
 	virtual int WindowActive() = 0;
 	virtual int WindowOpen() = 0;
 
+	virtual bool HasGpuTimers() const = 0;
+	virtual void GetGpuTimes(IGraphics::CGpuTimes *pTimes) const = 0;
+
+	// RunBuffer blocks while the maximum number of buffers is pending
 	virtual void RunBuffer(CCommandBuffer *pBuffer) = 0;
+	virtual void SetMaxPending(int Num) = 0;
+	virtual int NumPending() const = 0;
+	virtual void WaitForPending(int Num) = 0;
 	virtual bool IsIdle() const = 0;
 	virtual void WaitForIdle() = 0;
 };
@@ -332,10 +450,16 @@ class CGraphics_Threaded : public IEngineGraphics
 {
 	enum
 	{
-		NUM_CMDBUFFERS = 2,
+		MAX_CMDBUFFERS = 4,
+		MAX_FRAMES_IN_FLIGHT = 4,
 
 		MAX_VERTICES = 32*1024,
 		MAX_TEXTURES = 1024*4,
+		MAX_BUFFERS = 1024,
+		MAX_BATCHES = 256,
+		MAX_BATCH_DRAWS = 4096,
+		MAX_INSTANCES = 4096,
+		MAX_ASYNC_TEXTURES = 64,
 
 		DRAWING_QUADS=1,
 		DRAWING_LINES=2
@@ -344,9 +468,28 @@ class CGraphics_Threaded : public IEngineGraphics
 	CCommandBuffer::CState m_State;
 	IGraphicsBackend *m_pBackend;
 
-	CCommandBuffer *m_apCommandBuffers[NUM_CMDBUFFERS];
+	CCommandBuffer *m_apCommandBuffers[MAX_CMDBUFFERS];
 	CCommandBuffer *m_pCommandBuffer;
 	unsigned m_CurrentCommandBuffer;
+	int m_NumCommandBuffers;
+
+	// the kick count at the end of each of the last frames, used to limit
+	// how many frames the render thread may lag behind
+	unsigned m_NumKicks;
+	unsigned m_aFrameKicks[MAX_FRAMES_IN_FLIGHT+1];
+	unsigned m_NumFrames;
+	int64 m_QueueStallTime;
+	int64 m_FrameStallTime;
+
+	// counted up until the swap, m_LastRenderTexture tells texture changes apart
+	CFrameStats m_FrameStats;
+	CFrameStats m_LastFrameStats;
+	int m_LastRenderTexture;
+
+	// the group of the last timer command, -1 if timers are off or the frame ended
+	bool m_GpuTimers;
+	int m_GpuTimerGroup;
+	void AddGpuTimerCommand(int Group);
 
 	//
 	class IStorage *m_pStorage;
@@ -366,18 +509,118 @@ class CGraphics_Threaded : public IEngineGraphics
 	bool m_DoScreenshot;
 	char m_aScreenshotName[128];
 
+	// screenshots and captured frames on their way to the disk. the back buffer is read
+	// without waiting for the gpu, handed over a few frames later and encoded on the job pool
+	enum
+	{
+		READBACK_DELAY = 2,
+
+		CAPTURE_FREE = 0,
+		CAPTURE_READING,
+		CAPTURE_MAPPING,
+		CAPTURE_ENCODING,
+
+		CAPTUREFORMAT_PNG = 0,
+		CAPTUREFORMAT_PPM,
+	};
+	struct CCapture
+	{
+		CJob m_Job;
+		int m_State;
+		unsigned m_Frame; // when the readback started
+		volatile int m_Done;
+		CImageInfo m_Image;
+		int m_Format;
+		bool m_Screenshot;
+		char m_aPath[IO_MAX_PATH_LENGTH];
+	};
+	CCapture m_aCaptures[CCommandBuffer::MAX_READBACKS];
+
+	// gfx_capture, frames are dropped while all readbacks are busy
+	int64 m_CaptureStart;
+	int m_LastCaptureFrame;
+	int m_NumCapturedFrames;
+	int m_NumDroppedFrames;
+	char m_aCaptureFolder[64];
+
+	static int EncodeCaptureJob(void *pUser);
+	bool StartCapture(const char *pFilename, int Format, bool Screenshot);
+	void UpdateCaptures();
+	void UpdateContinuousCapture();
+
 	CTextureHandle m_InvalidTexture;
+	CTextureHandle m_PendingTexture; // drawn instead of textures that are still loading
 
 	int m_TextureArrayIndex;
 	int m_aTextureIndices[MAX_TEXTURES];
 	int m_FirstFreeTexture;
 	int m_TextureMemoryUsage;
 
+	// textures loaded with TEXLOAD_ASYNC keep their slot reserved until
+	// they are uploaded, a few of them per frame
+	struct CAsyncTexture
+	{
+		CJob m_Job;
+		CGraphics_Threaded *m_pGraphics;
+		bool m_Used;
+		bool m_Cancelled;
+		int m_Slot;
+		char m_aFilename[IO_MAX_PATH_LENGTH];
+		int m_StorageType;
+		int m_StoreFormat;
+		int m_Flags;
+		CImageInfo m_Image; // no data if the png failed to load
+	};
+
+	CAsyncTexture m_aAsyncTextures[MAX_ASYNC_TEXTURES];
+	int m_aTextureStandIns[MAX_TEXTURES]; // drawn instead while loading or after a failed load, -1 if none
+	class IEngine *m_pEngine;
+
+	static int LoadTextureJob(void *pUser);
+	CAsyncTexture *AddAsyncTexture(int StoreFormat, int Flags);
+	void UploadAsyncTextures();
+	void CreateTexture(int Slot, int Width, int Height, int Format, const void *pData, int StoreFormat, int Flags);
+
+	int m_aBufferIndices[MAX_BUFFERS];
+	int m_aBufferDimensions[MAX_BUFFERS];
+	int m_FirstFreeBuffer;
+
+	// draws are collected into batches of equal state until another command
+	// is issued, a draw joins an earlier batch if it doesn't overlap any
+	// batch that was started after that one
+	struct CBatch
+	{
+		CCommandBuffer::CState m_State;
+		int m_PrimType;
+		float m_aBounds[4]; // in screen space
+		int m_NumVertices;
+		int m_FirstDraw;
+		int m_LastDraw;
+	};
+
+	struct CBatchDraw
+	{
+		int m_FirstVertex;
+		int m_NumVertices;
+		int m_NextDraw;
+	};
+
+	CBatch m_aBatches[MAX_BATCHES];
+	int m_NumBatches;
+	CBatchDraw m_aBatchDraws[MAX_BATCH_DRAWS];
+	int m_NumBatchDraws;
+	CCommandBuffer::CVertex m_aBatchVertices[MAX_VERTICES];
+	int m_NumBatchVertices;
+
+	CCommandBuffer::CVertex *AddRenderCommand(const CCommandBuffer::CState &State, int PrimType, int NumVerts);
+	void BatchVertices(int PrimType, int NumVerts);
+	void FlushBatches();
 	void FlushVertices();
 	void AddVertices(int Count);
 	void Rotate4(const CCommandBuffer::CPoint &rCenter, CCommandBuffer::CVertex *pPoints);
 
 	void KickCommandBuffer();
+	void LimitFramesInFlight();
 
 	int IssueInit();
 	int InitWindow();
@@ -396,6 +639,11 @@ public:
 	virtual void WrapMode(int WrapU, int WrapV);
 
 	virtual int MemoryUsage() const;
+	virtual void GetStallTimes(int64 *pQueueStall, int64 *pFrameStall) const;
+	virtual const CFrameStats *LastFrameStats() const { return &m_LastFrameStats; }
+	virtual void SetGpuTimers(bool Enable);
+	virtual void GpuTimerGroup(int Group);
+	virtual bool GetGpuTimes(CGpuTimes *pTimes) const;
 
 	virtual void MapScreen(float TopLeftX, float TopLeftY, float BottomRightX, float BottomRightY);
 	virtual void GetScreen(float *pTopLeftX, float *pTopLeftY, float *pBottomRightX, float *pBottomRightY);
@@ -412,7 +660,6 @@ public:
 	virtual IGraphics::CTextureHandle LoadTexture(const char *pFilename, int StorageType, int StoreFormat, int Flags);
 	virtual int LoadPNG(CImageInfo *pImg, const char *pFilename, int StorageType);
 
-	void ScreenshotDirect(const char *pFilename);
 
 	virtual void TextureSet(CTextureHandle TextureID);
 
@@ -435,8 +682,20 @@ public:
 	virtual void QuadsDraw(CQuadItem *pArray, int Num);
 	virtual void QuadsDrawTL(const CQuadItem *pArray, int Num);
 	virtual void QuadsDrawFreeform(const CFreeformItem *pArray, int Num);
+	virtual void QuadsDrawRecorded(const CRecordedQuad *pQuads, int Num);
 	virtual void QuadsText(float x, float y, float Size, const char *pText);
 
+	virtual CBufferHandle CreateQuadBuffer(const CBufferQuad *pQuads, int Num);
+	virtual void DeleteQuadBuffer(CBufferHandle *pBuffer);
+	virtual void RenderQuadBuffer(CBufferHandle Buffer, int FirstQuad, int NumQuads, const vec4 &Color);
+
+	virtual CTextureHandle LoadTileIndices(int Width, int Height, const unsigned char *pData);
+	virtual void RenderTileIndices(CTextureHandle Indices, int Width, int Height, float Scale, const vec4 &Color, bool Extend);
+
+	virtual CTextureHandle CreateRenderTarget(int Width, int Height);
+	virtual void SetRenderTarget(CTextureHandle Target);
+	virtual void RenderQuadInstances(const CQuadInstance *pInstances, int Num);
+
 	virtual int GetNumScreens() const;
 	virtual void Minimize();
 	virtual void Maximize();
@@ -25,7 +25,7 @@
 	#define SDL_JOYSTICK_AXIS_MAX 32767
 #endif
 
-void CInput::AddEvent(char *pText, int Key, int Flags)
+void CInput::AddEvent(char *pText, int Key, int Flags, int64 Time)
 {
 	if(m_NumEvents != INPUT_BUFFER_SIZE)
 	{
@@ -36,6 +36,7 @@ void CInput::AddEvent(char *pText, int Key, int Flags)
 		else
 			str_copy(m_aInputEvents[m_NumEvents].m_aText, pText, sizeof(m_aInputEvents[m_NumEvents].m_aText));
 		m_aInputEvents[m_NumEvents].m_InputCount = m_InputCounter;
+		m_aInputEvents[m_NumEvents].m_Time = Time;
 		m_NumEvents++;
 	}
 }
@@ -254,6 +255,13 @@ bool CInput::MouseRelative(float *pX, float *pY)
 	return false;
 }
 
+void CInput::UpdateMotion()
+{
+	// the relative mouse state and the joystick axes follow the pumped events,
+	// the events themselves stay in the queue
+	SDL_PumpEvents();
+}
+
 void CInput::MouseModeAbsolute()
 {
 	if(m_MouseInputRelative)
@@ -346,15 +354,20 @@ int CInput::Update()
 	{
 		SDL_Event Event;
 
+		// events carry the SDL tick they were queued at
+		const int64 Now = time_get();
+		const Uint32 NowTicks = SDL_GetTicks();
+
 		while(SDL_PollEvent(&Event))
 		{
+			const int64 EventTime = Now - (int64)(Uint32)(NowTicks - Event.common.timestamp)*time_freq()/1000;
 			int Key = -1;
 			int Scancode = 0;
 			int Action = IInput::FLAG_PRESS;
 			switch (Event.type)
 			{
 				case SDL_TEXTINPUT:
-					AddEvent(Event.text.text, 0, IInput::FLAG_TEXT);
+					AddEvent(Event.text.text, 0, IInput::FLAG_TEXT, EventTime);
 					break;
 
 				// handle keys
@@ -483,7 +496,7 @@ int CInput::Update()
 					m_aInputState[Scancode] = 1;
 					m_aInputCount[Key] = m_InputCounter;
 				}
-				AddEvent(0, Key, Action);
+				AddEvent(0, Key, Action, EventTime);
 			}
 
 		}
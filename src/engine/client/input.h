@@ -25,7 +25,7 @@ class CInput : public IEngineInput
 
 	bool m_MouseDoubleClick;
 
-	void AddEvent(char *pText, int Key, int Flags);
+	void AddEvent(char *pText, int Key, int Flags, int64 Time);
 	void Clear();
 	bool IsEventValid(CEvent *pEvent) const { return pEvent->m_InputCount == m_InputCounter; }
 
@@ -62,6 +62,7 @@ public:
 	void MouseModeAbsolute();
 	int MouseDoubleClick();
 	bool MouseRelative(float *pX, float *pY);
+	void UpdateMotion();
 
 	const char *GetClipboardText();
 	void SetClipboardText(const char *pText);
@@ -1,5 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <algorithm> // sort, binary_search
+
 #include <base/math.h>
 #include <base/system.h>
 
@@ -24,6 +26,13 @@
 
 
 static const char *s_pFilename = "serverlist.json";
+static const char *s_pCacheFilename = "servercache.dat";
+static const unsigned char s_aCacheMagic[4] = {'T', 'W', 'S', 'C'};
+enum
+{
+	SERVERCACHE_VERSION=1,
+	SERVERCACHE_MAX_AGE=7*24*60*60, // in seconds
+};
 
 inline int AddrHash(const NETADDR *pAddr)
 {
@@ -49,11 +58,33 @@ void CServerBrowser::CServerlist::Clear()
 	mem_zero(m_aServerlistIp, sizeof(m_aServerlistIp));
 }
 
+static bool CompareAddr(const NETADDR &a, const NETADDR &b)
+{
+	return net_addr_comp(&a, &b, true) < 0;
+}
+
+void CServerBrowser::CMasterList::ResetPending()
+{
+	m_aFullServers.clear();
+	m_NumFullPackets = -1;
+	m_NumFullReceived = 0;
+	m_aAdded.clear();
+	m_aRemoved.clear();
+	m_NumDeltaPackets = -1;
+	m_NumDeltaReceived = 0;
+}
+
 //
 CServerBrowser::CServerBrowser()
 {
 	m_pMasterServer = 0;
 
+	for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; i++)
+	{
+		m_aMasterLists[i].m_Valid = false;
+		m_aMasterLists[i].ResetPending();
+	}
+
 	//
 	for(int i = 0; i < NUM_TYPES; ++i)
 	{
@@ -64,7 +95,25 @@ CServerBrowser::CServerBrowser()
 
 	m_pFirstReqServer = 0; // request list
 	m_pLastReqServer = 0;
+	m_pLastPriorityReqServer = 0;
 	m_NumRequests = 0;
+	m_NumPendingRequests = 0;
+
+	m_RequestWindow = INITIAL_REQUEST_WINDOW;
+	m_RequestThreshold = 0;
+	m_RequestBudget = 0;
+	m_RequestRtt = 0;
+	m_LastRequestUpdate = 0;
+	m_LastWindowDecrease = 0;
+	m_WindowResponses = 0;
+	m_WindowTimeouts = 0;
+
+	m_RefreshStartTime = 0;
+	m_NumResponses = 0;
+	m_NumTimeouts = 0;
+
+	m_pFastServers = 0;
+	m_NumFastServers = 0;
 
 	m_NeedRefresh = 0;
 	m_RefreshFlags = 0;
@@ -76,6 +125,13 @@ CServerBrowser::CServerBrowser()
 	m_ActServerlistType = 0;
 	m_BroadcastTime = 0;
 	m_MasterRefreshTime = 0;
+	m_ServerCacheLoaded = false;
+}
+
+CServerBrowser::~CServerBrowser()
+{
+	if(m_pFastServers)
+		mem_free(m_pFastServers);
 }
 
 void CServerBrowser::Init(class CNetClient *pNetClient, const char *pNetVersion)
@@ -106,7 +162,8 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 			if(!Find(IServerBrowser::TYPE_INTERNET, Addr))
 			{
 				pEntry = Add(IServerBrowser::TYPE_INTERNET, Addr);
-				QueueRequest(pEntry);
+				QueueRequest(pEntry, IsFastServer(Addr));
+				FilterAddServer(IServerBrowser::TYPE_INTERNET, pEntry);
 			}
 		}
 		break;
@@ -118,7 +175,8 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 			if(!Find(IServerBrowser::TYPE_INTERNET, Addr))
 			{
 				pEntry = Add(IServerBrowser::TYPE_INTERNET, Addr);
-				QueueRequest(pEntry);
+				QueueRequest(pEntry, true);
+				FilterAddServer(IServerBrowser::TYPE_INTERNET, pEntry);
 			}
 		}
 		break;
@@ -145,27 +203,120 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 			// set info
 			if(pEntry)
 			{
+				FilterRemoveServer(Type, pEntry);
 				SetInfo(Type, pEntry, *pInfo);
 				if(Type == IServerBrowser::TYPE_LAN)
 					pEntry->m_Info.m_Latency = min(static_cast<int>((time_get()-m_BroadcastTime)*1000/time_freq()), 999);
 				else
+				{
 					pEntry->m_Info.m_Latency = min(static_cast<int>((time_get()-pEntry->m_RequestTime)*1000/time_freq()), 999);
+					OnRequestAnswered(pEntry, time_get());
+				}
+				pEntry->m_InfoTime = time_timestamp();
 				m_InfoUpdated = true;
 				RemoveRequest(pEntry);
+				FilterAddServer(Type, pEntry);
 			}
 		}
 	}
+}
 
-	if(pEntry)
-		m_ServerBrowserFilter.Sort(m_aServerlist[m_ActServerlistType].m_ppServerlist, m_aServerlist[m_ActServerlistType].m_NumServers, CServerBrowserFilter::RESORT_FLAG_FORCE);
+void CServerBrowser::OnMasterList(int MasterIndex, const NETADDR *pServers, int Num)
+{
+	for(int i = 0; i < Num; i++)
+		Set(pServers[i], SET_MASTER_ADD, -1, 0);
+
+	CMasterList *pList = &m_aMasterLists[MasterIndex];
+	for(int i = 0; i < Num; i++)
+		pList->m_aFullServers.add(pServers[i]);
+	pList->m_NumFullReceived++;
+	MasterListComplete(pList);
+}
+
+void CServerBrowser::OnMasterListInfo(int MasterIndex, unsigned Epoch, unsigned Generation, int NumPackets)
+{
+	CMasterList *pList = &m_aMasterLists[MasterIndex];
+	pList->m_FullEpoch = Epoch;
+	pList->m_FullGeneration = Generation;
+	pList->m_NumFullPackets = NumPackets;
+	MasterListComplete(pList);
+}
+
+void CServerBrowser::OnMasterListDelta(int MasterIndex, unsigned Epoch, unsigned BaseGeneration, unsigned Generation, int NumPackets,
+	const NETADDR *pServers, const bool *pAdded, int Num)
+{
+	// only deltas to the list we have, of the generation the first packet announced
+	CMasterList *pList = &m_aMasterLists[MasterIndex];
+	if(!pList->m_Valid || Epoch != pList->m_Epoch || BaseGeneration != pList->m_Generation)
+		return;
+	if(pList->m_NumDeltaPackets == -1)
+	{
+		pList->m_NumDeltaPackets = NumPackets;
+		pList->m_DeltaGeneration = Generation;
+	}
+	else if(Generation != pList->m_DeltaGeneration)
+		return;
+
+	for(int i = 0; i < Num; i++)
+	{
+		if(pAdded[i])
+			pList->m_aAdded.add(pServers[i]);
+		else
+			pList->m_aRemoved.add(pServers[i]);
+	}
+	pList->m_NumDeltaReceived++;
+	MasterListComplete(pList);
+}
+
+void CServerBrowser::MasterListComplete(CMasterList *pList)
+{
+	if(pList->m_NumFullPackets >= 0 && pList->m_NumFullReceived == pList->m_NumFullPackets)
+	{
+		// the servers were added to the browser as their packets came in
+		pList->m_aServers = pList->m_aFullServers;
+		std::sort(pList->m_aServers.base_ptr(), pList->m_aServers.base_ptr()+pList->m_aServers.size(), CompareAddr);
+		pList->m_Valid = true;
+		pList->m_Epoch = pList->m_FullEpoch;
+		pList->m_Generation = pList->m_FullGeneration;
+		pList->ResetPending();
+	}
+	else if(pList->m_NumDeltaPackets >= 0 && pList->m_NumDeltaReceived == pList->m_NumDeltaPackets)
+	{
+		NETADDR *pBegin = pList->m_aServers.base_ptr();
+		for(int i = 0; i < pList->m_aRemoved.size(); i++)
+		{
+			NETADDR *pFound = std::lower_bound(pBegin, pBegin+pList->m_aServers.size(), pList->m_aRemoved[i], CompareAddr);
+			if(pFound != pBegin+pList->m_aServers.size() && net_addr_comp(pFound, &pList->m_aRemoved[i], true) == 0)
+				pList->m_aServers.remove_index(pFound-pBegin);
+		}
+		for(int i = 0; i < pList->m_aAdded.size(); i++)
+			pList->m_aServers.add(pList->m_aAdded[i]);
+		std::sort(pList->m_aServers.base_ptr(), pList->m_aServers.base_ptr()+pList->m_aServers.size(), CompareAddr);
+		pList->m_Generation = pList->m_DeltaGeneration;
+		pList->ResetPending();
+
+		for(int i = 0; i < pList->m_aServers.size(); i++)
+			Set(pList->m_aServers[i], SET_MASTER_ADD, -1, 0);
+	}
+}
+
+void CServerBrowser::FilterAddServer(int ServerlistType, CServerEntry *pEntry)
+{
+	// the filters only hold the active list
+	if(ServerlistType == m_ActServerlistType)
+		m_ServerBrowserFilter.AddServer(m_aServerlist[ServerlistType].m_ppServerlist, m_aServerlist[ServerlistType].m_NumServers, pEntry->m_Info.m_ServerIndex);
+}
+
+void CServerBrowser::FilterRemoveServer(int ServerlistType, CServerEntry *pEntry)
+{
+	if(ServerlistType == m_ActServerlistType)
+		m_ServerBrowserFilter.RemoveServer(m_aServerlist[ServerlistType].m_ppServerlist, m_aServerlist[ServerlistType].m_NumServers, pEntry->m_Info.m_ServerIndex);
 }
 
 void CServerBrowser::Update(bool ForceResort)
 {
 	int64 Timeout = time_freq();
 	int64 Now = time_get();
-	int Count;
-	CServerEntry *pEntry, *pNext;
 
 	// do server list requests
 	if(m_NeedRefresh && !m_pMasterServer->IsRefreshing())
@@ -178,14 +329,31 @@ void CServerBrowser::Update(bool ForceResort)
 		mem_zero(&Packet, sizeof(Packet));
 		Packet.m_ClientID = -1;
 		Packet.m_Flags = NETSENDFLAG_CONNLESS;
-		Packet.m_DataSize = sizeof(SERVERBROWSE_GETLIST);
-		Packet.m_pData = SERVERBROWSE_GETLIST;
 
 		for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; i++)
 		{
 			if(!m_pMasterServer->IsValid(i))
 				continue;
 
+			// only the changes if we got all of the last list
+			CMasterList *pList = &m_aMasterLists[i];
+			pList->ResetPending();
+			unsigned char aDeltaRequest[sizeof(SERVERBROWSE_GETLISTDELTA)+sizeof(CMastersrvListRequest)];
+			if(Config()->m_BrMasterDelta && pList->m_Valid)
+			{
+				CMastersrvListRequest *pRequest = (CMastersrvListRequest *)(aDeltaRequest+sizeof(SERVERBROWSE_GETLISTDELTA));
+				mem_copy(aDeltaRequest, SERVERBROWSE_GETLISTDELTA, sizeof(SERVERBROWSE_GETLISTDELTA));
+				MastersrvPackInt(pRequest->m_aEpoch, pList->m_Epoch, 4);
+				MastersrvPackInt(pRequest->m_aGeneration, pList->m_Generation, 4);
+				Packet.m_DataSize = sizeof(aDeltaRequest);
+				Packet.m_pData = aDeltaRequest;
+			}
+			else
+			{
+				Packet.m_DataSize = sizeof(SERVERBROWSE_GETLIST);
+				Packet.m_pData = SERVERBROWSE_GETLIST;
+			}
+
 			Packet.m_Address = m_pMasterServer->GetAddr(i);
 			m_pNetClient->Send(&Packet);
 		}
@@ -206,42 +374,7 @@ void CServerBrowser::Update(bool ForceResort)
 			m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", "using backup server list");
 	}
 
-	// do timeouts
-	pEntry = m_pFirstReqServer;
-	while(1)
-	{
-		if(!pEntry) // no more entries
-			break;
-
-		pNext = pEntry->m_pNextReq;
-
-		if(pEntry->m_RequestTime && pEntry->m_RequestTime+Timeout < Now)
-		{
-			// timeout
-			RemoveRequest(pEntry);
-		}
-
-		pEntry = pNext;
-	}
-
-	// do timeouts
-	pEntry = m_pFirstReqServer;
-	Count = 0;
-	while(1)
-	{
-		if(!pEntry) // no more entries
-			break;
-
-		// no more then 10 concurrent requests
-		if(Count == Config()->m_BrMaxRequests)
-			break;
-
-		if(pEntry->m_RequestTime == 0)
-			RequestImpl(pEntry->m_Addr, pEntry);
-
-		Count++;
-		pEntry = pEntry->m_pNextReq;
-	}
+	UpdateRequests(Now);
 
 	// update favorite
 	const NETADDR *pFavAddr = m_ServerBrowserFavorites.UpdateFavorites();
@@ -317,17 +450,39 @@ void CServerBrowser::Refresh(int RefreshFlags)
 		{
 			m_pNetClient->PurgeStoredPacket(pEntry->m_TrackID);
 		}
+		RememberFastServers();
 		m_aServerlist[IServerBrowser::TYPE_INTERNET].Clear();
 		if(m_ActServerlistType == IServerBrowser::TYPE_INTERNET)
 			m_ServerBrowserFilter.Clear();
 		m_pFirstReqServer = 0;
 		m_pLastReqServer = 0;
+		m_pLastPriorityReqServer = 0;
 		m_NumRequests = 0;
+		m_NumPendingRequests = 0;
+
+		// start slow, the round trip estimate is kept from the last refresh
+		m_RequestWindow = min((int)INITIAL_REQUEST_WINDOW, Config()->m_BrMaxRequests);
+		m_RequestThreshold = Config()->m_BrMaxRequests;
+		m_RequestBudget = 0;
+		m_LastRequestUpdate = 0;
+		m_LastWindowDecrease = 0;
+		m_WindowResponses = 0;
+		m_WindowTimeouts = 0;
+		m_RefreshStartTime = time_get();
+		m_NumResponses = 0;
+		m_NumTimeouts = 0;
 
 		m_NeedRefresh = 1;
 		for(int i = 0; i < m_ServerBrowserFavorites.m_NumFavoriteServers; i++)
 			if(m_ServerBrowserFavorites.m_aFavoriteServers[i].m_State >= CServerBrowserFavorites::FAVSTATE_ADDR)
 				Set(m_ServerBrowserFavorites.m_aFavoriteServers[i].m_Addr, SET_FAV_ADD, -1, 0);
+
+		// show the last known infos right away on the first refresh
+		if(!m_ServerCacheLoaded)
+		{
+			m_ServerCacheLoaded = true;
+			LoadServerCache();
+		}
 	}
 }
 
@@ -445,6 +600,7 @@ CServerEntry *CServerBrowser::Add(int ServerlistType, const NETADDR &Addr)
 	net_addr_str(&Addr, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aAddress), true);
 	str_copy(pEntry->m_Info.m_aName, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aName));
 	str_copy(pEntry->m_Info.m_aHostname, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aHostname));
+	pEntry->UpdateSearch();
 
 	UpdateFavoriteState(&pEntry->m_Info);
 
@@ -490,15 +646,25 @@ CServerEntry *CServerBrowser::Find(int ServerlistType, const NETADDR &Addr)
 	return (CServerEntry*)0;
 }
 
-void CServerBrowser::QueueRequest(CServerEntry *pEntry)
+void CServerBrowser::QueueRequest(CServerEntry *pEntry, bool Priority)
 {
-	// add it to the list of servers that we should request info from
-	pEntry->m_pPrevReq = m_pLastReqServer;
-	if(m_pLastReqServer)
-		m_pLastReqServer->m_pNextReq = pEntry;
+	// add it to the list of servers that we should request info from,
+	// priority requests go behind the other priority ones
+	CServerEntry *pPrev = Priority ? m_pLastPriorityReqServer : m_pLastReqServer;
+	CServerEntry *pNext = pPrev ? pPrev->m_pNextReq : (Priority ? m_pFirstReqServer : 0);
+
+	pEntry->m_pPrevReq = pPrev;
+	pEntry->m_pNextReq = pNext;
+	if(pPrev)
+		pPrev->m_pNextReq = pEntry;
 	else
 		m_pFirstReqServer = pEntry;
-	m_pLastReqServer = pEntry;
+	if(pNext)
+		pNext->m_pPrevReq = pEntry;
+	else
+		m_pLastReqServer = pEntry;
+	if(Priority)
+		m_pLastPriorityReqServer = pEntry;
 
 	m_NumRequests++;
 }
@@ -507,6 +673,9 @@ void CServerBrowser::RemoveRequest(CServerEntry *pEntry)
 {
 	if(pEntry->m_pPrevReq || pEntry->m_pNextReq || m_pFirstReqServer == pEntry)
 	{
+		if(m_pLastPriorityReqServer == pEntry)
+			m_pLastPriorityReqServer = pEntry->m_pPrevReq;
+
 		if(pEntry->m_pPrevReq)
 			pEntry->m_pPrevReq->m_pNextReq = pEntry->m_pNextReq;
 		else
@@ -520,7 +689,122 @@ void CServerBrowser::RemoveRequest(CServerEntry *pEntry)
 		pEntry->m_pPrevReq = 0;
 		pEntry->m_pNextReq = 0;
 		m_NumRequests--;
+		if(pEntry->m_RequestTime)
+			m_NumPendingRequests--;
+	}
+}
+
+void CServerBrowser::UpdateRequests(int64 Now)
+{
+	// give slow servers a few round trips, but at least a second
+	int64 Timeout = clamp(m_RequestRtt*4, time_freq(), time_freq()*3);
+
+	// do timeouts
+	for(CServerEntry *pEntry = m_pFirstReqServer, *pNext; pEntry; pEntry = pNext)
+	{
+		pNext = pEntry->m_pNextReq;
+		if(pEntry->m_RequestTime && pEntry->m_RequestTime+Timeout < Now)
+		{
+			OnRequestTimeout(Now);
+			RemoveRequest(pEntry);
+		}
+	}
+
+	// pace the sends so that a window is spread over a round trip, each
+	// update sends what the elapsed time allows in one batch
+	int MaxWindow = Config()->m_BrMaxRequests;
+	m_RequestWindow = clamp(m_RequestWindow, (float)min((int)MIN_REQUEST_WINDOW, MaxWindow), (float)MaxWindow);
+	int64 Rtt = m_RequestRtt ? max(m_RequestRtt, time_freq()/100) : time_freq()/5;
+	if(m_LastRequestUpdate)
+		m_RequestBudget += m_RequestWindow*(Now-m_LastRequestUpdate)/(float)Rtt;
+	else
+		m_RequestBudget = m_RequestWindow/4;
+	m_RequestBudget = min(m_RequestBudget, max(m_RequestWindow/4, 1.0f));
+	m_LastRequestUpdate = Now;
+
+	for(CServerEntry *pEntry = m_pFirstReqServer; pEntry && m_RequestBudget >= 1.0f && m_NumPendingRequests < (int)m_RequestWindow; pEntry = pEntry->m_pNextReq)
+	{
+		if(pEntry->m_RequestTime == 0)
+		{
+			RequestImpl(pEntry->m_Addr, pEntry);
+			m_NumPendingRequests++;
+			m_RequestBudget -= 1.0f;
+		}
+	}
+
+	// report the refresh once the masters and all servers are done
+	if(m_RefreshStartTime && !m_pFirstReqServer && !m_NeedRefresh && !m_MasterRefreshTime && !m_pMasterServer->IsRefreshing())
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "refresh done in %d ms, %d servers answered, %d timed out, request window %d, round trip %d ms",
+			(int)((Now-m_RefreshStartTime)*1000/time_freq()), m_NumResponses, m_NumTimeouts, (int)m_RequestWindow, (int)(m_RequestRtt*1000/time_freq()));
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client_srvbrowse", aBuf);
+		m_RefreshStartTime = 0;
+	}
+}
+
+void CServerBrowser::OnRequestAnswered(CServerEntry *pEntry, int64 Now)
+{
+	int64 Rtt = Now-pEntry->m_RequestTime;
+	m_RequestRtt = m_RequestRtt ? (m_RequestRtt*7+Rtt)/8 : Rtt;
+
+	// double the window per round trip below the threshold, then grow it by one
+	m_RequestWindow += m_RequestWindow < m_RequestThreshold ? 1.0f : 1.0f/m_RequestWindow;
+	m_NumResponses++;
+	m_WindowResponses++;
+}
+
+void CServerBrowser::OnRequestTimeout(int64 Now)
+{
+	m_NumTimeouts++;
+	m_WindowTimeouts++;
+
+	// some servers in the list are always offline, only back off when the
+	// loss rate is high, and at most once per round trip
+	if(m_WindowTimeouts*4 <= m_WindowResponses || Now-m_LastWindowDecrease < max(m_RequestRtt, time_freq()/10))
+		return;
+
+	m_RequestWindow = max(m_RequestWindow/2, (float)MIN_REQUEST_WINDOW);
+	m_RequestThreshold = m_RequestWindow;
+	m_LastWindowDecrease = Now;
+	m_WindowResponses = 0;
+	m_WindowTimeouts = 0;
+}
+
+static bool CompareServerAddr(const NETADDR &Addr1, const NETADDR &Addr2)
+{
+	return net_addr_comp(&Addr1, &Addr2, true) < 0;
+}
+
+bool CServerBrowser::IsFastServer(const NETADDR &Addr) const
+{
+	return m_pFastServers && std::binary_search(m_pFastServers, m_pFastServers+m_NumFastServers, Addr, CompareServerAddr);
+}
+
+void CServerBrowser::RememberFastServers()
+{
+	const CServerlist *pList = &m_aServerlist[IServerBrowser::TYPE_INTERNET];
+	NETADDR *pFastServers = (NETADDR *)mem_alloc(max(pList->m_NumServers, 1)*sizeof(NETADDR), 1);
+	int NumFastServers = 0;
+	for(int i = 0; i < pList->m_NumServers; i++)
+	{
+		const CServerEntry *pEntry = pList->m_ppServerlist[i];
+		if(pEntry->m_InfoState == CServerEntry::STATE_READY && pEntry->m_Info.m_Latency < FAST_SERVER_LATENCY)
+			pFastServers[NumFastServers++] = pEntry->m_Addr;
+	}
+
+	// keep the old ones when refreshing before anything answered
+	if(NumFastServers == 0)
+	{
+		mem_free(pFastServers);
+		return;
 	}
+
+	std::sort(pFastServers, pFastServers+NumFastServers, CompareServerAddr);
+	if(m_pFastServers)
+		mem_free(m_pFastServers);
+	m_pFastServers = pFastServers;
+	m_NumFastServers = NumFastServers;
 }
 
 void CServerBrowser::CBFTrackPacket(int TrackID, void *pCallbackUser)
@@ -583,6 +867,9 @@ void CServerBrowser::RequestImpl(const NETADDR &Addr, CServerEntry *pEntry)
 void CServerBrowser::SetInfo(int ServerlistType, CServerEntry *pEntry, const CServerInfo &Info)
 {
 	bool Fav = pEntry->m_Info.m_Favorite;
+	int ServerIndex = pEntry->m_Info.m_ServerIndex;
+	m_aServerlist[ServerlistType].m_NumPlayers -= pEntry->m_Info.m_NumPlayers;
+	m_aServerlist[ServerlistType].m_NumClients -= pEntry->m_Info.m_NumClients;
 	pEntry->m_Info = Info;
 	pEntry->m_Info.m_Flags &= FLAG_PASSWORD|FLAG_TIMESCORE;
 	if(str_comp(pEntry->m_Info.m_aGameType, "DM") == 0 || str_comp(pEntry->m_Info.m_aGameType, "TDM") == 0 || str_comp(pEntry->m_Info.m_aGameType, "CTF") == 0 ||
@@ -598,7 +885,9 @@ void CServerBrowser::SetInfo(int ServerlistType, CServerEntry *pEntry, const CSe
 		str_comp(pEntry->m_Info.m_aMap, "lms1") == 0)
 		pEntry->m_Info.m_Flags |= FLAG_PUREMAP;
 	pEntry->m_Info.m_Favorite = Fav;
+	pEntry->m_Info.m_ServerIndex = ServerIndex;
 	pEntry->m_Info.m_NetAddr = pEntry->m_Addr;
+	pEntry->UpdateSearch();
 
 	m_aServerlist[ServerlistType].m_NumPlayers += pEntry->m_Info.m_NumPlayers;
 	m_aServerlist[ServerlistType].m_NumClients += pEntry->m_Info.m_NumClients;
@@ -661,3 +950,153 @@ void CServerBrowser::SaveServerlist()
 	Writer.EndArray();
 	Writer.EndObject();
 }
+
+void CServerBrowser::LoadServerCache()
+{
+	IOHANDLE File = Storage()->OpenFile(s_pCacheFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return;
+	int FileSize = (int)io_length(File);
+	unsigned char *pFileData = (unsigned char *)mem_alloc(max(FileSize, 1), 1);
+	int ReadSize = io_read(File, pFileData, FileSize);
+	io_close(File);
+
+	CUnpacker Unpacker;
+	Unpacker.Reset(pFileData, ReadSize);
+	const unsigned char *pMagic = Unpacker.GetRaw(sizeof(s_aCacheMagic));
+	if(!pMagic || mem_comp(pMagic, s_aCacheMagic, sizeof(s_aCacheMagic)) != 0 || Unpacker.GetInt() != SERVERCACHE_VERSION)
+	{
+		mem_free(pFileData);
+		return;
+	}
+
+	int Now = time_timestamp();
+	int NumServers = Unpacker.GetInt();
+	int NumLoaded = 0;
+	for(int i = 0; i < NumServers && !Unpacker.Error(); i++)
+	{
+		CServerInfo Info;
+		mem_zero(&Info, sizeof(Info));
+		NETADDR Addr;
+		bool ValidAddr = !net_addr_from_str(&Addr, Unpacker.GetString(CUnpacker::SANITIZE_CC));
+		int InfoTime = Unpacker.GetInt();
+		Info.m_Latency = Unpacker.GetInt();
+		Info.m_Flags = Unpacker.GetInt();
+		Info.m_ServerLevel = Unpacker.GetInt();
+		Info.m_NumPlayers = Unpacker.GetInt();
+		Info.m_MaxPlayers = Unpacker.GetInt();
+		Info.m_NumClients = Unpacker.GetInt();
+		Info.m_MaxClients = Unpacker.GetInt();
+		Info.m_NumBotPlayers = Unpacker.GetInt();
+		Info.m_NumBotSpectators = Unpacker.GetInt();
+		str_copy(Info.m_aVersion, Unpacker.GetString(CUnpacker::SANITIZE_CC), sizeof(Info.m_aVersion));
+		str_copy(Info.m_aName, Unpacker.GetString(CUnpacker::SANITIZE_CC), sizeof(Info.m_aName));
+		str_copy(Info.m_aHostname, Unpacker.GetString(CUnpacker::SANITIZE_CC), sizeof(Info.m_aHostname));
+		str_copy(Info.m_aMap, Unpacker.GetString(CUnpacker::SANITIZE_CC), sizeof(Info.m_aMap));
+		str_copy(Info.m_aGameType, Unpacker.GetString(CUnpacker::SANITIZE_CC), sizeof(Info.m_aGameType));
+		if(Unpacker.Error() || Info.m_NumClients < 0 || Info.m_NumClients > MAX_CLIENTS || Info.m_NumPlayers < 0 || Info.m_NumPlayers > Info.m_NumClients)
+			break;
+		for(int c = 0; c < Info.m_NumClients; c++)
+		{
+			str_copy(Info.m_aClients[c].m_aName, Unpacker.GetString(CUnpacker::SANITIZE_CC), sizeof(Info.m_aClients[c].m_aName));
+			str_copy(Info.m_aClients[c].m_aClan, Unpacker.GetString(CUnpacker::SANITIZE_CC), sizeof(Info.m_aClients[c].m_aClan));
+			Info.m_aClients[c].m_Country = Unpacker.GetInt();
+			Info.m_aClients[c].m_Score = Unpacker.GetInt();
+			Info.m_aClients[c].m_PlayerType = Unpacker.GetInt()&CServerInfo::CClient::PLAYERFLAG_MASK;
+		}
+		if(Unpacker.Error())
+			break;
+		if(!ValidAddr || InfoTime <= 0 || Now-InfoTime > SERVERCACHE_MAX_AGE)
+			continue;
+
+		// the servers still get requested, the cached info is only shown until they answer
+		CServerEntry *pEntry = Find(IServerBrowser::TYPE_INTERNET, Addr);
+		if(pEntry)
+			FilterRemoveServer(IServerBrowser::TYPE_INTERNET, pEntry);
+		else
+		{
+			pEntry = Add(IServerBrowser::TYPE_INTERNET, Addr);
+			QueueRequest(pEntry, IsFastServer(Addr));
+		}
+		str_copy(Info.m_aAddress, pEntry->m_Info.m_aAddress, sizeof(Info.m_aAddress));
+		SetInfo(IServerBrowser::TYPE_INTERNET, pEntry, Info);
+		pEntry->m_Info.m_Latency = clamp(Info.m_Latency, 0, 999);
+		pEntry->m_InfoTime = InfoTime;
+		FilterAddServer(IServerBrowser::TYPE_INTERNET, pEntry);
+		NumLoaded++;
+	}
+	mem_free(pFileData);
+
+	if(NumLoaded)
+	{
+		m_InfoUpdated = true;
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "loaded %d cached servers", NumLoaded);
+		Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client_srvbrowse", aBuf);
+	}
+}
+
+// the packer is flushed to the file whenever it is half full, the server
+// fields or a single client always fit into the other half
+static void FlushServerCache(IOHANDLE File, CPacker *pPacker)
+{
+	if(pPacker->Size() < 1024)
+		return;
+	io_write(File, pPacker->Data(), pPacker->Size());
+	pPacker->Reset();
+}
+
+void CServerBrowser::SaveServerCache()
+{
+	IOHANDLE File = Storage()->OpenFile(s_pCacheFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return;
+
+	const CServerlist *pList = &m_aServerlist[IServerBrowser::TYPE_INTERNET];
+	int NumServers = 0;
+	for(int i = 0; i < pList->m_NumServers; i++)
+		if(pList->m_ppServerlist[i]->m_InfoTime)
+			NumServers++;
+
+	CPacker Packer;
+	Packer.Reset();
+	Packer.AddRaw(s_aCacheMagic, sizeof(s_aCacheMagic));
+	Packer.AddInt(SERVERCACHE_VERSION);
+	Packer.AddInt(NumServers);
+	for(int i = 0; i < pList->m_NumServers; i++)
+	{
+		const CServerEntry *pEntry = pList->m_ppServerlist[i];
+		if(!pEntry->m_InfoTime)
+			continue;
+
+		const CServerInfo *pInfo = &pEntry->m_Info;
+		FlushServerCache(File, &Packer);
+		Packer.AddString(pInfo->m_aAddress, 0);
+		Packer.AddInt(pEntry->m_InfoTime);
+		Packer.AddInt(pInfo->m_Latency);
+		Packer.AddInt(pInfo->m_Flags&(FLAG_PASSWORD|FLAG_TIMESCORE));
+		Packer.AddInt(pInfo->m_ServerLevel);
+		Packer.AddInt(pInfo->m_NumPlayers);
+		Packer.AddInt(pInfo->m_MaxPlayers);
+		Packer.AddInt(pInfo->m_NumClients);
+		Packer.AddInt(pInfo->m_MaxClients);
+		Packer.AddInt(pInfo->m_NumBotPlayers);
+		Packer.AddInt(pInfo->m_NumBotSpectators);
+		Packer.AddString(pInfo->m_aVersion, 0);
+		Packer.AddString(pInfo->m_aName, 0);
+		Packer.AddString(pInfo->m_aHostname, 0);
+		Packer.AddString(pInfo->m_aMap, 0);
+		Packer.AddString(pInfo->m_aGameType, 0);
+		for(int c = 0; c < pInfo->m_NumClients; c++)
+		{
+			FlushServerCache(File, &Packer);
+			Packer.AddString(pInfo->m_aClients[c].m_aName, 0);
+			Packer.AddString(pInfo->m_aClients[c].m_aClan, 0);
+			Packer.AddInt(pInfo->m_aClients[c].m_Country);
+			Packer.AddInt(pInfo->m_aClients[c].m_Score);
+			Packer.AddInt(pInfo->m_aClients[c].m_PlayerType);
+		}
+	}
+	io_write(File, Packer.Data(), Packer.Size());
+	io_close(File);
+}
@@ -3,6 +3,9 @@
 #ifndef ENGINE_CLIENT_SERVERBROWSER_H
 #define ENGINE_CLIENT_SERVERBROWSER_H
 
+#include <base/tl/array.h>
+
+#include <engine/masterserver.h>
 #include <engine/serverbrowser.h>
 #include "serverbrowser_entry.h"
 #include "serverbrowser_fav.h"
@@ -19,6 +22,7 @@ public:
 	};
 		
 	CServerBrowser();
+	~CServerBrowser();
 	void Init(class CNetClient *pClient, const char *pNetVersion);
 	void Set(const NETADDR &Addr, int SetType, int Token, const CServerInfo *pInfo);
 	void Update(bool ForceResort);	
@@ -54,10 +58,20 @@ public:
 	void RemoveFilter(int Index) { m_ServerBrowserFilter.RemoveFilter(Index); }
 
 	static void CBFTrackPacket(int TrackID, void *pUser);
+
+	// answers of the master servers, see mastersrv.h
+	void OnMasterList(int MasterIndex, const NETADDR *pServers, int Num);
+	void OnMasterListInfo(int MasterIndex, unsigned Epoch, unsigned Generation, int NumPackets);
+	void OnMasterListDelta(int MasterIndex, unsigned Epoch, unsigned BaseGeneration, unsigned Generation, int NumPackets,
+		const NETADDR *pServers, const bool *pAdded, int Num);
 	
 	void LoadServerlist();
 	void SaveServerlist();
 
+	// the last known infos, shown until the servers answer
+	void LoadServerCache();
+	void SaveServerCache();
+
 private:
 	class CNetClient *m_pNetClient;
 	class CConfig *m_pConfig;
@@ -90,9 +104,66 @@ private:
 		void Clear();
 	} m_aServerlist[NUM_TYPES];
 
+	// the list of every master as of its last complete answer, so
+	// refreshes only need to ask for the changes since then
+	class CMasterList
+	{
+	public:
+		bool m_Valid;
+		unsigned m_Epoch;
+		unsigned m_Generation;
+		array<NETADDR> m_aServers; // sorted
+
+		// the answer to the current request, either the full list or a delta
+		array<NETADDR> m_aFullServers;
+		int m_NumFullPackets; // -1 until the list info arrived
+		int m_NumFullReceived;
+		unsigned m_FullEpoch;
+		unsigned m_FullGeneration;
+		array<NETADDR> m_aAdded;
+		array<NETADDR> m_aRemoved;
+		int m_NumDeltaPackets; // -1 until the first delta packet arrived
+		int m_NumDeltaReceived;
+		unsigned m_DeltaGeneration;
+
+		void ResetPending();
+	} m_aMasterLists[IMasterServer::MAX_MASTERSERVERS];
+
+	void MasterListComplete(CMasterList *pList);
+
 	CServerEntry *m_pFirstReqServer; // request list
 	CServerEntry *m_pLastReqServer;
+	CServerEntry *m_pLastPriorityReqServer; // favorites and previously fast servers are requested first
 	int m_NumRequests;
+	int m_NumPendingRequests; // sent but not answered nor timed out
+
+	// request scheduling, the window of pending requests grows with the
+	// responses and halves on timeouts. sends are paced over the round trip
+	enum
+	{
+		MIN_REQUEST_WINDOW=4,
+		INITIAL_REQUEST_WINDOW=16,
+		FAST_SERVER_LATENCY=80, // in ms
+	};
+	float m_RequestWindow;
+	float m_RequestThreshold;
+	float m_RequestBudget;
+	int64 m_RequestRtt;
+	int64 m_LastRequestUpdate;
+	int64 m_LastWindowDecrease;
+	int m_WindowResponses; // since the last decrease
+	int m_WindowTimeouts;
+
+	// refresh stats
+	int64 m_RefreshStartTime;
+	int m_NumResponses;
+	int m_NumTimeouts;
+
+	// servers that answered fast on the last refresh, sorted
+	NETADDR *m_pFastServers;
+	int m_NumFastServers;
+	bool IsFastServer(const NETADDR &Addr) const;
+	void RememberFastServers();
 
 	int m_NeedRefresh;
 	bool m_InfoUpdated;
@@ -103,13 +174,19 @@ private:
 	int m_RefreshFlags;
 	int64 m_BroadcastTime;
 	int64 m_MasterRefreshTime;
+	bool m_ServerCacheLoaded;
 
 	CServerEntry *Add(int ServerlistType, const NETADDR &Addr);
 	CServerEntry *Find(int ServerlistType, const NETADDR &Addr);
-	void QueueRequest(CServerEntry *pEntry);
+	void QueueRequest(CServerEntry *pEntry, bool Priority);
 	void RemoveRequest(CServerEntry *pEntry);
 	void RequestImpl(const NETADDR &Addr, CServerEntry *pEntry);
+	void UpdateRequests(int64 Now);
+	void OnRequestAnswered(CServerEntry *pEntry, int64 Now);
+	void OnRequestTimeout(int64 Now);
 	void SetInfo(int ServerlistType, CServerEntry *pEntry, const CServerInfo &Info);
+	void FilterAddServer(int ServerlistType, CServerEntry *pEntry);
+	void FilterRemoveServer(int ServerlistType, CServerEntry *pEntry);
 };
 
 #endif
@@ -3,6 +3,8 @@
 #ifndef ENGINE_CLIENT_SERVERBROWSER_ENTRY_H
 #define ENGINE_CLIENT_SERVERBROWSER_ENTRY_H
 
+#include <engine/shared/textsearch.h>
+
 class CServerEntry
 {
 public:
@@ -16,10 +18,33 @@ public:
 	NETADDR m_Addr;
 	int64 m_RequestTime;
 	int m_InfoState;
+	int m_InfoTime; // timestamp of the last info, 0 if there is none
 	int m_CurrentToken;	// the token is to keep server refresh separated from each other
 	int m_TrackID;
 	class CServerInfo m_Info;
 
+	// lower cased copies of the info for the quick search
+	CSearchText<sizeof(CServerInfo::m_aName)> m_SearchName;
+	CSearchText<sizeof(CServerInfo::m_aMap)> m_SearchMap;
+	CSearchText<sizeof(CServerInfo::m_aGameType)> m_SearchGameType;
+	CSearchText<MAX_CLIENTS*(MAX_NAME_ARRAY_SIZE+MAX_CLAN_ARRAY_SIZE)> m_SearchPlayers;
+
+	void UpdateSearch()
+	{
+		m_SearchName.Clear();
+		m_SearchName.Add(m_Info.m_aName);
+		m_SearchMap.Clear();
+		m_SearchMap.Add(m_Info.m_aMap);
+		m_SearchGameType.Clear();
+		m_SearchGameType.Add(m_Info.m_aGameType);
+		m_SearchPlayers.Clear();
+		for(int i = 0; i < m_Info.m_NumClients; i++)
+		{
+			m_SearchPlayers.Add(m_Info.m_aClients[i].m_aName);
+			m_SearchPlayers.Add(m_Info.m_aClients[i].m_aClan);
+		}
+	}
+
 	CServerEntry *m_pNextIp; // ip hashed list
 
 	CServerEntry *m_pPrevReq; // request list
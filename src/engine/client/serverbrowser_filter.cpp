@@ -14,7 +14,7 @@
 
 class SortWrap
 {
-	typedef bool (CServerBrowserFilter::CServerFilter::*SortFunc)(int, int) const;
+	typedef CServerBrowserFilter::CServerFilter::FSortCompare SortFunc;
 	SortFunc m_pfnSort;
 	CServerBrowserFilter::CServerFilter *m_pThis;
 public:
@@ -103,6 +103,18 @@ void CServerBrowserFilter::CServerFilter::Filter()
 
 	// filter the servers
 	for(int i = 0; i < NumServers; i++)
+	{
+		int RelevantClientCount;
+		if(FilterServer(i, &RelevantClientCount))
+		{
+			m_pSortedServerlist[m_NumSortedServers++] = i;
+			m_NumSortedPlayers += RelevantClientCount;
+		}
+	}
+}
+
+bool CServerBrowserFilter::CServerFilter::FilterServer(int i, int *pRelevantClientCount)
+{
 	{
 		int Filtered = 0;
 
@@ -183,39 +195,36 @@ void CServerBrowserFilter::CServerFilter::Filter()
 			{
 				int MatchFound = 0;
 
-				m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit = 0;
+				CServerEntry *pEntry = m_pServerBrowserFilter->m_ppServerlist[i];
+				const CSearchQuery &Query = m_pServerBrowserFilter->m_SearchQuery;
+				pEntry->m_Info.m_QuickSearchHit = 0;
 
 				// match against server name
-				if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aName, Config()->m_BrFilterString))
+				if(pEntry->m_SearchName.Find(Query))
 				{
 					MatchFound = 1;
-					m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_SERVERNAME;
+					pEntry->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_SERVERNAME;
 				}
 
 				// match against players
-				for(int p = 0; p < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients; p++)
+				if(pEntry->m_SearchPlayers.Find(Query))
 				{
-					if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aName, Config()->m_BrFilterString) ||
-						str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aClan, Config()->m_BrFilterString))
-					{
-						MatchFound = 1;
-						m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_PLAYER;
-						break;
-					}
+					MatchFound = 1;
+					pEntry->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_PLAYER;
 				}
 
 				// match against map
-				if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aMap, Config()->m_BrFilterString))
+				if(pEntry->m_SearchMap.Find(Query))
 				{
 					MatchFound = 1;
-					m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_MAPNAME;
+					pEntry->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_MAPNAME;
 				}
 
 				// match against game type
-				if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aGameType, Config()->m_BrFilterString))
+				if(pEntry->m_SearchGameType.Find(Query))
 				{
 					MatchFound = 1;
-					m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_GAMETYPE;
+					pEntry->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_GAMETYPE;
 				}
 
 				if(!MatchFound)
@@ -236,11 +245,12 @@ void CServerBrowserFilter::CServerFilter::Filter()
 
 			if(!(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_FRIENDS) || m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState != CContactInfo::CONTACT_NO)
 			{
-				m_pSortedServerlist[m_NumSortedServers++] = i;
-				m_NumSortedPlayers += RelevantClientCount;
+				*pRelevantClientCount = RelevantClientCount;
+				return true;
 			}
 		}
 	}
+	return false;
 }
 
 int CServerBrowserFilter::CServerFilter::GetSortHash() const
@@ -261,38 +271,101 @@ int CServerBrowserFilter::CServerFilter::GetSortHash() const
 	return i;
 }
 
-void CServerBrowserFilter::CServerFilter::Sort()
+CServerBrowserFilter::CServerFilter::FSortCompare CServerBrowserFilter::CServerFilter::SortCompare() const
 {
-	// create filtered list
-	Filter();
-
-	// sort
 	switch(Config()->m_BrSort)
 	{
 	case IServerBrowser::SORT_NAME:
-		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, &CServerBrowserFilter::CServerFilter::SortCompareName));
-		break;
+		return &CServerBrowserFilter::CServerFilter::SortCompareName;
 	case IServerBrowser::SORT_PING:
-		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, &CServerBrowserFilter::CServerFilter::SortComparePing));
-		break;
+		return &CServerBrowserFilter::CServerFilter::SortComparePing;
 	case IServerBrowser::SORT_MAP:
-		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, &CServerBrowserFilter::CServerFilter::SortCompareMap));
-		break;
+		return &CServerBrowserFilter::CServerFilter::SortCompareMap;
 	case IServerBrowser::SORT_NUMPLAYERS:
 		if(!(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_BOTS))
-			std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this,
-						(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? &CServerBrowserFilter::CServerFilter::SortCompareNumPlayers : &CServerBrowserFilter::CServerFilter::SortCompareNumClients));
-		else
-			std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this,
-						(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? &CServerBrowserFilter::CServerFilter::SortCompareNumRealPlayers : &CServerBrowserFilter::CServerFilter::SortCompareNumRealClients));
-		break;
+			return (m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? &CServerBrowserFilter::CServerFilter::SortCompareNumPlayers : &CServerBrowserFilter::CServerFilter::SortCompareNumClients;
+		return (m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? &CServerBrowserFilter::CServerFilter::SortCompareNumRealPlayers : &CServerBrowserFilter::CServerFilter::SortCompareNumRealClients;
 	case IServerBrowser::SORT_GAMETYPE:
-		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, &CServerBrowserFilter::CServerFilter::SortCompareGametype));
+		return &CServerBrowserFilter::CServerFilter::SortCompareGametype;
 	}
+	return 0;
+}
+
+void CServerBrowserFilter::CServerFilter::Sort()
+{
+	// create filtered list
+	Filter();
+
+	// sort
+	FSortCompare pfnCompare = SortCompare();
+	if(pfnCompare)
+		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, pfnCompare));
 
 	m_FilterInfo.m_SortHash = GetSortHash();
 }
 
+void CServerBrowserFilter::CServerFilter::AddServer(int Index)
+{
+	int RelevantClientCount;
+	if(!FilterServer(Index, &RelevantClientCount))
+		return;
+
+	if(m_NumSortedServers == m_SortedServersCapacity)
+	{
+		m_SortedServersCapacity = max(1000, m_SortedServersCapacity+m_SortedServersCapacity/2);
+		int *pNewList = (int *)mem_alloc(m_SortedServersCapacity*sizeof(int), 1);
+		if(m_pSortedServerlist)
+		{
+			mem_copy(pNewList, m_pSortedServerlist, m_NumSortedServers*sizeof(int));
+			mem_free(m_pSortedServerlist);
+		}
+		m_pSortedServerlist = pNewList;
+	}
+
+	// binary insert, equal servers stay in list order like after the stable sort
+	FSortCompare pfnCompare = SortCompare();
+	SortWrap Less(this, pfnCompare);
+	int Low = 0;
+	int High = m_NumSortedServers;
+	while(Low < High)
+	{
+		int Mid = (Low+High)/2;
+		int Other = m_pSortedServerlist[Mid];
+		bool Before;
+		if(pfnCompare && Less(Index, Other))
+			Before = true;
+		else if(pfnCompare && Less(Other, Index))
+			Before = false;
+		else
+			Before = Index < Other;
+		if(Before)
+			High = Mid;
+		else
+			Low = Mid+1;
+	}
+
+	mem_move(m_pSortedServerlist+Low+1, m_pSortedServerlist+Low, (m_NumSortedServers-Low)*sizeof(int));
+	m_pSortedServerlist[Low] = Index;
+	m_NumSortedServers++;
+	m_NumSortedPlayers += RelevantClientCount;
+}
+
+void CServerBrowserFilter::CServerFilter::RemoveServer(int Index)
+{
+	for(int i = 0; i < m_NumSortedServers; i++)
+	{
+		if(m_pSortedServerlist[i] != Index)
+			continue;
+
+		int RelevantClientCount;
+		if(FilterServer(Index, &RelevantClientCount))
+			m_NumSortedPlayers -= RelevantClientCount;
+		mem_move(m_pSortedServerlist+i, m_pSortedServerlist+i+1, (m_NumSortedServers-i-1)*sizeof(int));
+		m_NumSortedServers--;
+		return;
+	}
+}
+
 bool CServerBrowserFilter::CServerFilter::SortCompareName(int Index1, int Index2) const
 {
 	CServerEntry *a = m_pServerBrowserFilter->m_ppServerlist[Index1];
@@ -374,10 +447,17 @@ void CServerBrowserFilter::Clear()
 	}
 }
 
+void CServerBrowserFilter::UpdateSearchQuery()
+{
+	if(str_comp(m_SearchQuery.m_aText, m_pConfig->m_BrFilterString) != 0)
+		m_SearchQuery.Set(m_pConfig->m_BrFilterString);
+}
+
 void CServerBrowserFilter::Sort(CServerEntry **ppServerlist, int NumServers, int ResortFlags)
 {
 	m_ppServerlist = ppServerlist;
 	m_NumServers = NumServers;
+	UpdateSearchQuery();
 	for(int i = 0; i < m_lFilters.size(); i++)
 	{
 		// check if we need to resort
@@ -387,6 +467,29 @@ void CServerBrowserFilter::Sort(CServerEntry **ppServerlist, int NumServers, int
 	}
 }
 
+void CServerBrowserFilter::AddServer(CServerEntry **ppServerlist, int NumServers, int Index)
+{
+	m_ppServerlist = ppServerlist;
+	m_NumServers = NumServers;
+	UpdateSearchQuery();
+	for(int i = 0; i < m_lFilters.size(); i++)
+	{
+		if(m_lFilters[i].m_FilterInfo.m_SortHash == m_lFilters[i].GetSortHash())
+			m_lFilters[i].AddServer(Index);
+	}
+}
+
+void CServerBrowserFilter::RemoveServer(CServerEntry **ppServerlist, int NumServers, int Index)
+{
+	m_ppServerlist = ppServerlist;
+	m_NumServers = NumServers;
+	for(int i = 0; i < m_lFilters.size(); i++)
+	{
+		if(m_lFilters[i].m_FilterInfo.m_SortHash == m_lFilters[i].GetSortHash())
+			m_lFilters[i].RemoveServer(Index);
+	}
+}
+
 int CServerBrowserFilter::AddFilter(const CServerFilterInfo *pFilterInfo)
 {
 	CServerFilter Filter;
@@ -5,6 +5,8 @@
 
 #include <base/tl/array.h>
 
+#include <engine/shared/textsearch.h>
+
 class CServerBrowserFilter
 {
 public:
@@ -33,10 +35,18 @@ public:
 		~CServerFilter();
 		CServerFilter& operator=(const CServerFilter& Other);
 
+		typedef bool (CServerFilter::*FSortCompare)(int Index1, int Index2) const;
+
+		bool FilterServer(int Index, int *pRelevantClientCount);
 		void Filter();
 		int GetSortHash() const;
+		FSortCompare SortCompare() const;
 		void Sort();
 
+		// keep the sorted list up to date for a single server
+		void AddServer(int Index);
+		void RemoveServer(int Index);
+
 		// sorting criterions
 		bool SortCompareName(int Index1, int Index2) const;
 		bool SortCompareMap(int Index1, int Index2) const;
@@ -54,6 +64,11 @@ public:
 	void Clear();
 	void Sort(class CServerEntry **ppServerlist, int NumServers, int ResortFlags);
 
+	// a server was added or its info changed, only the filters that are up to date take it in, the
+	// others get rebuilt on the next sort anyway. remove a server before changing its info.
+	void AddServer(class CServerEntry **ppServerlist, int NumServers, int Index);
+	void RemoveServer(class CServerEntry **ppServerlist, int NumServers, int Index);
+
 	// filter
 	int AddFilter(const class CServerFilterInfo *pFilterInfo);
 	void GetFilter(int Index, class CServerFilterInfo *pFilterInfo) const;
@@ -72,6 +87,10 @@ private:
 	char m_aNetVersion[128];
 	array<CServerFilter> m_lFilters;
 
+	// the lower cased quick search string
+	CSearchQuery m_SearchQuery;
+	void UpdateSearchQuery();
+
 	// get updated on sort
 	class CServerEntry **m_ppServerlist;
 	int m_NumServers;
@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/hash.h>
 #include <base/math.h>
 #include <base/system.h>
 
@@ -7,6 +8,7 @@
 #include <engine/storage.h>
 
 #include <engine/shared/config.h>
+#include <engine/shared/tracer.h>
 
 #include "SDL.h"
 
@@ -18,6 +20,14 @@ extern "C"
 }
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define CONF_SOUND_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define CONF_SOUND_NEON 1
+#endif
+
 enum
 {
 	NUM_SAMPLES = 512,
@@ -49,16 +59,58 @@ struct CVoice
 	int m_Vol; // 0 - 255
 	int m_Flags;
 	int m_X, m_Y;
+	int m_Gen;
+};
+
+// voice changes are queued from the game thread to the mixer, which owns
+// the voices. the game thread claims voices by storing a new generation in
+// m_aVoiceUsed, the mixer frees them only if the generation still matches,
+// so a voice that gets stolen while its sample ends stays claimed
+enum
+{
+	SOUNDCMD_PLAY=0,
+	SOUNDCMD_STOP,
+	SOUNDCMD_STOPALL,
+
+	MAX_SOUND_COMMANDS=256,
+};
+
+struct CSoundCommand
+{
+	int m_Cmd;
+	int m_Voice;
+	int m_Sample;
+	int m_Channel;
+	int m_Flags;
+	int m_X, m_Y;
+	int m_Gen;
+};
+
+// what the game thread last played on a voice
+struct CVoiceInfo
+{
+	int m_Sample; // -1 after a stop
+	int m_Channel;
+	int m_Flags;
+	int m_X, m_Y;
 };
 
 static CSample m_aSamples[NUM_SAMPLES] = {{0}};
 static CVoice m_aVoices[NUM_VOICES] = {{0}};
 static CChannel m_aChannels[NUM_CHANNELS];
 
-static LOCK m_SoundLock = 0;
+static volatile int m_aVoiceUsed[NUM_VOICES] = {0}; // generation of the sound, 0 if free
+static CVoiceInfo m_aVoiceInfos[NUM_VOICES];
+static int m_VoiceGen = 0;
 
-static int m_CenterX = 0;
-static int m_CenterY = 0;
+static CSoundCommand m_aCommands[MAX_SOUND_COMMANDS];
+static volatile int m_CommandWrite = 0; // only written by the game thread
+static volatile int m_CommandRead = 0; // only written by the mixer
+
+static LOCK m_SoundLock = 0; // only guards the sample allocation
+
+static volatile int m_CenterX = 0;
+static volatile int m_CenterY = 0;
 
 static float m_MaxDistance = 1500.0f;
 
@@ -68,10 +120,8 @@ static volatile int m_SoundVolume = 100;
 static int m_NextVoice = 0;
 static int *m_pMixBuffer = 0;	// buffer only used by the thread callback function
 static unsigned m_MaxFrames = 0;
+static volatile int m_MixTime = 0; // microseconds, only written by the mixer
 
-static IOHANDLE s_File;
-
-// TODO: there should be a faster way todo this
 static short Int2Short(int i)
 {
 	if(i > 0x7fff)
@@ -81,16 +131,174 @@ static short Int2Short(int i)
 	return i;
 }
 
+static bool CommandQueueFull()
+{
+	return ((m_CommandWrite+1)&(MAX_SOUND_COMMANDS-1)) == atomic_int_load(&m_CommandRead);
+}
+
+static bool PushCommand(const CSoundCommand *pCmd)
+{
+	if(CommandQueueFull())
+		return false;
+	int Write = m_CommandWrite;
+	int Next = (Write+1)&(MAX_SOUND_COMMANDS-1);
+	m_aCommands[Write] = *pCmd;
+	atomic_int_store(&m_CommandWrite, Next);
+	return true;
+}
+
+static void StopVoice(int Index)
+{
+	CVoice *v = &m_aVoices[Index];
+	if(!v->m_pSample)
+		return;
+	if(v->m_Flags&ISound::FLAG_LOOP)
+		v->m_pSample->m_PausedAt = v->m_Tick;
+	else
+		v->m_pSample->m_PausedAt = 0;
+	v->m_pSample = 0;
+	atomic_int_compswap(&m_aVoiceUsed[Index], v->m_Gen, 0);
+}
+
+static void ProcessCommands()
+{
+	int Read = m_CommandRead;
+	int Write = atomic_int_load(&m_CommandWrite);
+	for(; Read != Write; Read = (Read+1)&(MAX_SOUND_COMMANDS-1))
+	{
+		const CSoundCommand *pCmd = &m_aCommands[Read];
+		if(pCmd->m_Cmd == SOUNDCMD_PLAY)
+		{
+			// a stolen voice remembers where its loop was
+			CVoice *v = &m_aVoices[pCmd->m_Voice];
+			if(v->m_pSample && v->m_Flags&ISound::FLAG_LOOP)
+				v->m_pSample->m_PausedAt = v->m_Tick;
+			v->m_pSample = &m_aSamples[pCmd->m_Sample];
+			v->m_pChannel = &m_aChannels[pCmd->m_Channel];
+			if(pCmd->m_Flags&ISound::FLAG_LOOP)
+				v->m_Tick = v->m_pSample->m_PausedAt;
+			else
+				v->m_Tick = 0;
+			v->m_Vol = 255;
+			v->m_Flags = pCmd->m_Flags;
+			v->m_X = pCmd->m_X;
+			v->m_Y = pCmd->m_Y;
+			v->m_Gen = pCmd->m_Gen;
+		}
+		else
+		{
+			for(int i = 0; i < NUM_VOICES; i++)
+			{
+				if(pCmd->m_Cmd == SOUNDCMD_STOPALL || m_aVoices[i].m_pSample == &m_aSamples[pCmd->m_Sample])
+					StopVoice(i);
+			}
+		}
+	}
+	atomic_int_store(&m_CommandRead, Read);
+}
+
+// the mix kernels add the frames scaled by the channel volumes to the
+// interleaved stereo mix buffer, the volumes have to fit 16 bits
+#if defined(CONF_SOUND_SSE2)
+static inline void MixFrames4(int *pOut, __m128i In, __m128i Vol)
+{
+	__m128i Lo = _mm_mullo_epi16(In, Vol);
+	__m128i Hi = _mm_mulhi_epi16(In, Vol);
+	__m128i *pDst = (__m128i *)pOut;
+	_mm_storeu_si128(pDst, _mm_add_epi32(_mm_loadu_si128(pDst), _mm_unpacklo_epi16(Lo, Hi)));
+	_mm_storeu_si128(pDst+1, _mm_add_epi32(_mm_loadu_si128(pDst+1), _mm_unpackhi_epi16(Lo, Hi)));
+}
+#endif
+
+static void MixStereo(int *pOut, const short *pIn, unsigned Frames, int Lvol, int Rvol)
+{
+	unsigned s = 0;
+#if defined(CONF_SOUND_SSE2)
+	const __m128i Vol = _mm_set_epi16(Rvol, Lvol, Rvol, Lvol, Rvol, Lvol, Rvol, Lvol);
+	for(; s+4 <= Frames; s += 4)
+		MixFrames4(pOut+s*2, _mm_loadu_si128((const __m128i *)(pIn+s*2)), Vol);
+#elif defined(CONF_SOUND_NEON)
+	const short aVol[4] = {(short)Lvol, (short)Rvol, (short)Lvol, (short)Rvol};
+	const int16x4_t Vol = vld1_s16(aVol);
+	for(; s+4 <= Frames; s += 4)
+	{
+		int16x8_t In = vld1q_s16(pIn+s*2);
+		vst1q_s32(pOut+s*2, vmlal_s16(vld1q_s32(pOut+s*2), vget_low_s16(In), Vol));
+		vst1q_s32(pOut+s*2+4, vmlal_s16(vld1q_s32(pOut+s*2+4), vget_high_s16(In), Vol));
+	}
+#endif
+	for(; s < Frames; s++)
+	{
+		pOut[s*2] += pIn[s*2]*Lvol;
+		pOut[s*2+1] += pIn[s*2+1]*Rvol;
+	}
+}
+
+static void MixMono(int *pOut, const short *pIn, unsigned Frames, int Lvol, int Rvol)
+{
+	unsigned s = 0;
+#if defined(CONF_SOUND_SSE2)
+	const __m128i Vol = _mm_set_epi16(Rvol, Lvol, Rvol, Lvol, Rvol, Lvol, Rvol, Lvol);
+	for(; s+8 <= Frames; s += 8)
+	{
+		__m128i In = _mm_loadu_si128((const __m128i *)(pIn+s));
+		MixFrames4(pOut+s*2, _mm_unpacklo_epi16(In, In), Vol);
+		MixFrames4(pOut+s*2+8, _mm_unpackhi_epi16(In, In), Vol);
+	}
+#elif defined(CONF_SOUND_NEON)
+	const short aVol[4] = {(short)Lvol, (short)Rvol, (short)Lvol, (short)Rvol};
+	const int16x4_t Vol = vld1_s16(aVol);
+	for(; s+4 <= Frames; s += 4)
+	{
+		int16x4_t In = vld1_s16(pIn+s);
+		int16x4x2_t Dup = vzip_s16(In, In);
+		vst1q_s32(pOut+s*2, vmlal_s16(vld1q_s32(pOut+s*2), Dup.val[0], Vol));
+		vst1q_s32(pOut+s*2+4, vmlal_s16(vld1q_s32(pOut+s*2+4), Dup.val[1], Vol));
+	}
+#endif
+	for(; s < Frames; s++)
+	{
+		pOut[s*2] += pIn[s]*Lvol;
+		pOut[s*2+1] += pIn[s]*Rvol;
+	}
+}
+
+// scales the mix buffer by the master volume and saturates it to 16 bits
+static void MixOutput(short *pFinalOut, const int *pMix, unsigned Samples, int MasterVol)
+{
+	unsigned i = 0;
+#if defined(CONF_SOUND_SSE2)
+	const __m128 Scale = _mm_set1_ps(MasterVol/101.0f/256.0f);
+	for(; i+8 <= Samples; i += 8)
+	{
+		__m128i A = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(pMix+i))), Scale));
+		__m128i B = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(pMix+i+4))), Scale));
+		_mm_storeu_si128((__m128i *)(pFinalOut+i), _mm_packs_epi32(A, B));
+	}
+#elif defined(CONF_SOUND_NEON)
+	const float Scale = MasterVol/101.0f/256.0f;
+	for(; i+8 <= Samples; i += 8)
+	{
+		int32x4_t A = vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(pMix+i)), Scale));
+		int32x4_t B = vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(pMix+i+4)), Scale));
+		vst1q_s16(pFinalOut+i, vcombine_s16(vqmovn_s32(A), vqmovn_s32(B)));
+	}
+#endif
+	for(; i < Samples; i++)
+		pFinalOut[i] = Int2Short(((pMix[i]*MasterVol)/101)>>8);
+}
+
 static void Mix(short *pFinalOut, unsigned Frames)
 {
-	int MasterVol;
 	mem_zero(m_pMixBuffer, m_MaxFrames*2*sizeof(int));
 	Frames = min(Frames, m_MaxFrames);
 
-	// aquire lock while we are mixing
-	lock_wait(m_SoundLock);
+	// take in the voice changes of the game thread
+	ProcessCommands();
 
-	MasterVol = m_SoundVolume;
+	int MasterVol = m_SoundVolume;
+	int CenterX = m_CenterX;
+	int CenterY = m_CenterY;
 
 	for(unsigned i = 0; i < NUM_VOICES; i++)
 	{
@@ -98,11 +306,6 @@ static void Mix(short *pFinalOut, unsigned Frames)
 		{
 			// mix voice
 			CVoice *v = &m_aVoices[i];
-			int *pOut = m_pMixBuffer;
-
-			int Step = v->m_pSample->m_Channels; // setup input sources
-			short *pInL = &v->m_pSample->m_pData[v->m_Tick*Step];
-			short *pInR = &v->m_pSample->m_pData[v->m_Tick*Step+1];
 
 			unsigned End = v->m_pSample->m_NumFrames-v->m_Tick;
 
@@ -113,15 +316,11 @@ static void Mix(short *pFinalOut, unsigned Frames)
 			if(Frames < End)
 				End = Frames;
 
-			// check if we have a mono sound
-			if(v->m_pSample->m_Channels == 1)
-				pInR = pInL;
-
 			// volume calculation
 			if(v->m_Flags&ISound::FLAG_POS)
 			{
-				int dx = v->m_X - m_CenterX;
-				int dy = v->m_Y - m_CenterY;
+				int dx = v->m_X - CenterX;
+				int dy = v->m_Y - CenterY;
 				float Dist = sqrtf((float)dx*dx+dy*dy);
 				if(Dist >= 0.0f && Dist < m_MaxDistance)
 				{
@@ -150,15 +349,17 @@ static void Mix(short *pFinalOut, unsigned Frames)
 				}
 			}
 
-			// process all frames
-			for(unsigned s = 0; s < End; s++)
+			// voices out of hearing range or muted are virtual, they only advance
+			if(MasterVol > 0 && (Lvol > 0 || Rvol > 0))
 			{
-				*pOut++ += (*pInL)*Lvol;
-				*pOut++ += (*pInR)*Rvol;
-				pInL += Step;
-				pInR += Step;
-				v->m_Tick++;
+				Lvol = clamp(Lvol, 0, 0x7fff);
+				Rvol = clamp(Rvol, 0, 0x7fff);
+				if(v->m_pSample->m_Channels == 1)
+					MixMono(m_pMixBuffer, &v->m_pSample->m_pData[v->m_Tick], End, Lvol, Rvol);
+				else
+					MixStereo(m_pMixBuffer, &v->m_pSample->m_pData[v->m_Tick*2], End, Lvol, Rvol);
 			}
+			v->m_Tick += End;
 
 			// free voice if not used any more
 			if(v->m_Tick == v->m_pSample->m_NumFrames)
@@ -166,28 +367,15 @@ static void Mix(short *pFinalOut, unsigned Frames)
 				if(v->m_Flags&ISound::FLAG_LOOP)
 					v->m_Tick = 0;
 				else
+				{
 					v->m_pSample = 0;
+					atomic_int_compswap(&m_aVoiceUsed[i], v->m_Gen, 0);
+				}
 			}
 		}
 	}
 
-
-	// release the lock
-	lock_unlock(m_SoundLock);
-
-	{
-		// clamp accumulated values
-		// TODO: this seams slow
-		for(unsigned i = 0; i < Frames; i++)
-		{
-			int j = i<<1;
-			int vl = ((m_pMixBuffer[j]*MasterVol)/101)>>8;
-			int vr = ((m_pMixBuffer[j+1]*MasterVol)/101)>>8;
-
-			pFinalOut[j] = Int2Short(vl);
-			pFinalOut[j+1] = Int2Short(vr);
-		}
-	}
+	MixOutput(pFinalOut, m_pMixBuffer, Frames*2, MasterVol);
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
 	swap_endian(pFinalOut, sizeof(short), Frames * 2);
@@ -197,7 +385,11 @@ static void Mix(short *pFinalOut, unsigned Frames)
 static void SdlCallback(void *pUnused, Uint8 *pStream, int Len)
 {
 	(void)pUnused;
+	CTracer::SetThreadName("sound");
+	CTraceScope TraceScope("Mix");
+	int64 Start = time_get();
 	Mix((short *)pStream, Len/2/2);
+	atomic_int_add(&m_MixTime, (int)((time_get()-Start)*1000000/time_freq()));
 }
 
 
@@ -243,8 +435,11 @@ int CSound::Init()
 	else
 		dbg_msg("client/sound", "sound init successful");
 
+	if(m_pConfig->m_SndCache)
+		m_pStorage->CreateFolder("soundcache", IStorage::TYPE_SAVE);
+
 	m_MaxFrames = m_pConfig->m_SndBufferSize*2;
-	m_pMixBuffer = (int *)mem_alloc(m_MaxFrames*2*sizeof(int), 1);
+	m_pMixBuffer = (int *)mem_alloc_tag(m_MaxFrames*2*sizeof(int), 1, MEMTAG_SOUND);
 
 	SDL_PauseAudio(0);
 
@@ -262,11 +457,7 @@ int CSound::Update()
 		WantedVolume = 0;
 
 	if(WantedVolume != m_SoundVolume)
-	{
-		lock_wait(m_SoundLock);
 		m_SoundVolume = WantedVolume;
-		lock_unlock(m_SoundLock);
-	}
 
 	return 0;
 }
@@ -296,54 +487,61 @@ int CSound::AllocID()
 	return -1;
 }
 
-void CSound::RateConvert(int SampleID)
+short *CSound::RateConvert(short *pData, int *pNumFrames, int Channels, int Rate)
 {
-	CSample *pSample = &m_aSamples[SampleID];
-	int NumFrames = 0;
-	short *pNewData = 0;
-
 	// make sure that we need to convert this sound
-	if(!pSample->m_pData || pSample->m_Rate == m_MixingRate)
-		return;
+	if(Rate == m_MixingRate)
+		return pData;
 
 	// allocate new data
-	NumFrames = (int)((pSample->m_NumFrames/(float)pSample->m_Rate)*m_MixingRate);
-	pNewData = (short *)mem_alloc(NumFrames*pSample->m_Channels*sizeof(short), 1);
+	int OldFrames = *pNumFrames;
+	int NumFrames = (int)((OldFrames/(float)Rate)*m_MixingRate);
+	short *pNewData = (short *)mem_alloc_tag(max(NumFrames*Channels, 1)*sizeof(short), 1, MEMTAG_SOUND);
 
 	for(int i = 0; i < NumFrames; i++)
 	{
 		// resample TODO: this should be done better, like linear at least
 		float a = i/(float)NumFrames;
-		int f = (int)(a*pSample->m_NumFrames);
-		if(f >= pSample->m_NumFrames)
-			f = pSample->m_NumFrames-1;
+		int f = (int)(a*OldFrames);
+		if(f >= OldFrames)
+			f = OldFrames-1;
 
 		// set new data
-		if(pSample->m_Channels == 1)
-			pNewData[i] = pSample->m_pData[f];
-		else if(pSample->m_Channels == 2)
+		if(Channels == 1)
+			pNewData[i] = pData[f];
+		else if(Channels == 2)
 		{
-			pNewData[i*2] = pSample->m_pData[f*2];
-			pNewData[i*2+1] = pSample->m_pData[f*2+1];
+			pNewData[i*2] = pData[f*2];
+			pNewData[i*2+1] = pData[f*2+1];
 		}
 	}
 
 	// free old data and apply new
-	mem_free(pSample->m_pData);
-	pSample->m_pData = pNewData;
-	pSample->m_NumFrames = NumFrames;
+	mem_free(pData);
+	*pNumFrames = NumFrames;
+	return pNewData;
 }
 
-static int ReadDataOld(void *pBuffer, int Size)
+// the file being decoded, the wavpack callbacks get it as their id
+struct CWvReader
 {
-	return io_read(s_File, pBuffer, Size);
+	const unsigned char *m_pData;
+	int m_Size;
+	int m_Pos;
+};
+
+static int ReadWv(CWvReader *pReader, void *pBuffer, int Size)
+{
+	Size = clamp(Size, 0, pReader->m_Size-pReader->m_Pos);
+	mem_copy(pBuffer, pReader->m_pData+pReader->m_Pos, Size);
+	pReader->m_Pos += Size;
+	return Size;
 }
 
 #if defined(CONF_WAVPACK_OPEN_FILE_INPUT_EX)
 static int ReadData(void *pId, void *pBuffer, int Size)
 {
-	(void)pId;
-	return ReadDataOld(pBuffer, Size);
+	return ReadWv((CWvReader *)pId, pBuffer, Size);
 }
 
 static int ReturnFalse(void *pId)
@@ -354,59 +552,39 @@ static int ReturnFalse(void *pId)
 
 static unsigned int GetPos(void *pId)
 {
-	(void)pId;
-	return io_tell(s_File);
+	return ((CWvReader *)pId)->m_Pos;
 }
 
 static unsigned int GetLength(void *pId)
 {
-	(void)pId;
-	return io_length(s_File);
+	return ((CWvReader *)pId)->m_Size;
 }
 
 static int PushBackByte(void *pId, int Char)
 {
-	(void)pId;
-	return io_unread_byte(s_File, Char);
+	CWvReader *pReader = (CWvReader *)pId;
+	if(pReader->m_Pos == 0)
+		return -1;
+	pReader->m_Pos--;
+	return Char;
+}
+#else
+// the old interface has no id, decodes are serialized with m_SoundLock
+static CWvReader *s_pReader;
+
+static int ReadDataOld(void *pBuffer, int Size)
+{
+	return ReadWv(s_pReader, pBuffer, Size);
 }
 #endif
 
-ISound::CSampleHandle CSound::LoadWV(const char *pFilename)
+static short *DecodeWv(const char *pFilename, const unsigned char *pFileData, int FileSize, int *pNumFrames, int *pChannels, int *pRate)
 {
-	CSample *pSample;
-	int SampleID = -1;
 	char aError[100];
-	WavpackContext *pContext;
-
-	// don't waste memory on sound when we are stress testing
-	if(m_pConfig->m_DbgStress)
-		return CSampleHandle();
-
-	// no need to load sound when we are running with no sound
-	if(!m_SoundEnabled)
-		return CSampleHandle();
-
-	if(!m_pStorage)
-		return CSampleHandle();
-
-	lock_wait(m_SoundLock);
-	s_File = m_pStorage->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
-	if(!s_File)
-	{
-		dbg_msg("sound/wv", "failed to open file. filename='%s'", pFilename);
-		lock_unlock(m_SoundLock);
-		return CSampleHandle();
-	}
-
-	SampleID = AllocID();
-	if(SampleID < 0)
-	{
-		io_close(s_File);
-		s_File = 0;
-		lock_unlock(m_SoundLock);
-		return CSampleHandle();
-	}
-	pSample = &m_aSamples[SampleID];
+	CWvReader Reader;
+	Reader.m_pData = pFileData;
+	Reader.m_Size = FileSize;
+	Reader.m_Pos = 0;
 
 #if defined(CONF_WAVPACK_OPEN_FILE_INPUT_EX)
 	WavpackStreamReader Callback = {0};
@@ -415,79 +593,199 @@ ISound::CSampleHandle CSound::LoadWV(const char *pFilename)
 	Callback.get_pos = GetPos;
 	Callback.push_back_byte = PushBackByte;
 	Callback.read_bytes = ReadData;
-	pContext = WavpackOpenFileInputEx(&Callback, (void *)1, 0, aError, 0, 0);
+	WavpackContext *pContext = WavpackOpenFileInputEx(&Callback, &Reader, 0, aError, 0, 0);
 #else
-	pContext = WavpackOpenFileInput(ReadDataOld, aError);
+	lock_wait(m_SoundLock);
+	s_pReader = &Reader;
+	WavpackContext *pContext = WavpackOpenFileInput(ReadDataOld, aError);
 #endif
-	if (pContext)
+	short *pResult = 0;
+	if(pContext)
 	{
-		int m_aSamples = WavpackGetNumSamples(pContext);
+		int NumFrames = WavpackGetNumSamples(pContext);
 		int BitsPerSample = WavpackGetBitsPerSample(pContext);
-		unsigned int SampleRate = WavpackGetSampleRate(pContext);
-		int m_aChannels = WavpackGetNumChannels(pContext);
-		int *pData;
-		int *pSrc;
-		short *pDst;
-		int i;
+		int Channels = WavpackGetNumChannels(pContext);
 
-		pSample->m_Channels = m_aChannels;
-		pSample->m_Rate = SampleRate;
-
-		if(pSample->m_Channels > 2)
-		{
+		if(Channels > 2)
 			dbg_msg("sound/wv", "file is not mono or stereo. filename='%s'", pFilename);
-			io_close(s_File);
-			s_File = 0;
-			lock_unlock(m_SoundLock);
-			return CSampleHandle();
+		else if(BitsPerSample != 16)
+			dbg_msg("sound/wv", "bps is %d, not 16, filname='%s'", BitsPerSample, pFilename);
+		else
+		{
+			int *pData = (int *)mem_alloc_tag(max(4*NumFrames*Channels, 4), 1, MEMTAG_SOUND);
+			WavpackUnpackSamples(pContext, pData, NumFrames); // TODO: check return value
+
+			pResult = (short *)mem_alloc_tag(max(2*NumFrames*Channels, 2), 1, MEMTAG_SOUND);
+			for(int i = 0; i < NumFrames*Channels; i++)
+				pResult[i] = (short)pData[i];
+			mem_free(pData);
+
+			*pNumFrames = NumFrames;
+			*pChannels = Channels;
+			*pRate = WavpackGetSampleRate(pContext);
 		}
+	}
+	else
+		dbg_msg("sound/wv", "failed to open %s: %s", pFilename, aError);
 
-		/*
-		if(snd->rate != 44100)
-		{
-			dbg_msg("sound/wv", "file is %d Hz, not 44100 Hz. filename='%s'", snd->rate, filename);
-			return -1;
-		}*/
+#if !defined(CONF_WAVPACK_OPEN_FILE_INPUT_EX)
+	s_pReader = 0;
+	lock_unlock(m_SoundLock);
+#endif
+	return pResult;
+}
 
-		if(BitsPerSample != 16)
+// resampled sounds are cached by the hash of the file and the mixing rate
+enum
+{
+	SOUNDCACHE_VERSION=1,
+	SOUNDCACHE_HEADER_SIZE=16,
+};
+static const unsigned char s_aSoundCacheMagic[4] = {'T', 'W', 'S', 'P'};
+
+static void SoundCacheFilename(char *pBuf, int BufSize, const SHA256_DIGEST *pSha256, int Rate)
+{
+	char aSha256[SHA256_MAXSTRSIZE];
+	sha256_str(*pSha256, aSha256, sizeof(aSha256));
+	str_format(pBuf, BufSize, "soundcache/%s_%d.pcm", aSha256, Rate);
+}
+
+static short *LoadSoundCache(IStorage *pStorage, const char *pCacheFile, int *pNumFrames, int *pChannels)
+{
+	IOHANDLE File = pStorage->OpenFile(pCacheFile, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return 0;
+
+	unsigned char aHeader[SOUNDCACHE_HEADER_SIZE];
+	short *pData = 0;
+	if(io_read(File, aHeader, sizeof(aHeader)) == sizeof(aHeader) && mem_comp(aHeader, s_aSoundCacheMagic, sizeof(s_aSoundCacheMagic)) == 0 &&
+		bytes_be_to_uint(aHeader+4) == SOUNDCACHE_VERSION)
+	{
+		int Channels = bytes_be_to_uint(aHeader+8);
+		int NumFrames = bytes_be_to_uint(aHeader+12);
+		int Size = NumFrames*Channels*sizeof(short);
+		if((Channels == 1 || Channels == 2) && NumFrames > 0 && io_length(File) == (long)(sizeof(aHeader)+Size))
 		{
-			dbg_msg("sound/wv", "bps is %d, not 16, filname='%s'", BitsPerSample, pFilename);
-			io_close(s_File);
-			s_File = 0;
-			lock_unlock(m_SoundLock);
-			return CSampleHandle();
+			pData = (short *)mem_alloc_tag(Size, 1, MEMTAG_SOUND);
+			if(io_read(File, pData, Size) == (unsigned)Size)
+			{
+#if defined(CONF_ARCH_ENDIAN_BIG)
+				swap_endian(pData, sizeof(short), NumFrames*Channels);
+#endif
+				*pNumFrames = NumFrames;
+				*pChannels = Channels;
+			}
+			else
+			{
+				mem_free(pData);
+				pData = 0;
+			}
 		}
+	}
+	io_close(File);
+	return pData;
+}
 
-		pData = (int *)mem_alloc(4*m_aSamples*m_aChannels, 1);
-		WavpackUnpackSamples(pContext, pData, m_aSamples); // TODO: check return value
-		pSrc = pData;
+static void SaveSoundCache(IStorage *pStorage, const char *pCacheFile, const short *pData, int NumFrames, int Channels)
+{
+	IOHANDLE File = pStorage->OpenFile(pCacheFile, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return;
 
-		pSample->m_pData = (short *)mem_alloc(2*m_aSamples*m_aChannels, 1);
-		pDst = pSample->m_pData;
+	unsigned char aHeader[SOUNDCACHE_HEADER_SIZE];
+	mem_copy(aHeader, s_aSoundCacheMagic, sizeof(s_aSoundCacheMagic));
+	uint_to_bytes_be(aHeader+4, SOUNDCACHE_VERSION);
+	uint_to_bytes_be(aHeader+8, Channels);
+	uint_to_bytes_be(aHeader+12, NumFrames);
+	io_write(File, aHeader, sizeof(aHeader));
+#if defined(CONF_ARCH_ENDIAN_BIG)
+	short *pSwapped = (short *)mem_alloc_tag(NumFrames*Channels*sizeof(short), 1, MEMTAG_SOUND);
+	mem_copy(pSwapped, pData, NumFrames*Channels*sizeof(short));
+	swap_endian(pSwapped, sizeof(short), NumFrames*Channels);
+	io_write(File, pSwapped, NumFrames*Channels*sizeof(short));
+	mem_free(pSwapped);
+#else
+	io_write(File, pData, NumFrames*Channels*sizeof(short));
+#endif
+	io_close(File);
+}
 
-		for (i = 0; i < m_aSamples*m_aChannels; i++)
-			*pDst++ = (short)*pSrc++;
+ISound::CSampleHandle CSound::LoadWV(const char *pFilename)
+{
+	// don't waste memory on sound when we are stress testing
+	if(m_pConfig->m_DbgStress)
+		return CSampleHandle();
 
-		mem_free(pData);
+	// no need to load sound when we are running with no sound
+	if(!m_SoundEnabled)
+		return CSampleHandle();
+
+	if(!m_pStorage)
+		return CSampleHandle();
+
+	// read the whole file, it is decoded from memory
+	IOHANDLE File = m_pStorage->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+	{
+		dbg_msg("sound/wv", "failed to open file. filename='%s'", pFilename);
+		return CSampleHandle();
+	}
+	int FileSize = (int)io_length(File);
+	unsigned char *pFileData = (unsigned char *)mem_alloc_tag(max(FileSize, 1), 1, MEMTAG_SOUND);
+	FileSize = io_read(File, pFileData, FileSize);
+	io_close(File);
+
+	int NumFrames = 0;
+	int Channels = 0;
+	short *pData = 0;
+	char aCacheFile[IO_MAX_PATH_LENGTH];
+	if(m_pConfig->m_SndCache)
+	{
+		SHA256_DIGEST Sha256 = sha256(pFileData, FileSize);
+		SoundCacheFilename(aCacheFile, sizeof(aCacheFile), &Sha256, m_MixingRate);
+		pData = LoadSoundCache(m_pStorage, aCacheFile, &NumFrames, &Channels);
+	}
 
-		pSample->m_NumFrames = m_aSamples;
+	if(!pData)
+	{
+		int Rate = 0;
+		pData = DecodeWv(pFilename, pFileData, FileSize, &NumFrames, &Channels, &Rate);
+		if(pData)
+		{
+			pData = RateConvert(pData, &NumFrames, Channels, Rate);
+			if(m_pConfig->m_SndCache)
+				SaveSoundCache(m_pStorage, aCacheFile, pData, NumFrames, Channels);
+		}
+	}
+	mem_free(pFileData);
+	if(!pData)
+		return CSampleHandle();
+
+	// samples get loaded from several threads at once
+	lock_wait(m_SoundLock);
+	int SampleID = AllocID();
+	if(SampleID >= 0)
+	{
+		CSample *pSample = &m_aSamples[SampleID];
+		pSample->m_pData = pData;
+		pSample->m_NumFrames = NumFrames;
+		pSample->m_Rate = m_MixingRate;
+		pSample->m_Channels = Channels;
 		pSample->m_LoopStart = -1;
 		pSample->m_LoopEnd = -1;
 		pSample->m_PausedAt = 0;
 	}
-	else
+	lock_unlock(m_SoundLock);
+
+	if(SampleID < 0)
 	{
-		dbg_msg("sound/wv", "failed to open %s: %s", pFilename, aError);
+		mem_free(pData);
+		return CSampleHandle();
 	}
 
-	io_close(s_File);
-	s_File = NULL;
-
 	if(m_pConfig->m_Debug)
 		dbg_msg("sound/wv", "loaded %s", pFilename);
 
-	RateConvert(SampleID);
-	lock_unlock(m_SoundLock);
 	return CreateSampleHandle(SampleID);
 }
 
@@ -507,21 +805,37 @@ void CSound::SetChannelVolume(int ChannelID, float Vol)
 	m_aChannels[ChannelID].m_Vol = (int)(Vol*255.0f);
 }
 
+// how loud a sound is at the listener, ignoring the panning
+static float VoiceLoudness(int Channel, int Flags, int x, int y)
+{
+	float Vol = (float)m_aChannels[Channel].m_Vol;
+	if(Flags&ISound::FLAG_POS)
+	{
+		int dx = x - m_CenterX;
+		int dy = y - m_CenterY;
+		float Dist = sqrtf((float)dx*dx+dy*dy);
+		if(Dist >= m_MaxDistance)
+			return 0.0f;
+		Vol *= 1.0f - Dist/m_MaxDistance;
+	}
+	return Vol;
+}
+
 int CSound::Play(int ChannelID, CSampleHandle SampleID, int Flags, float x, float y)
 {
-	if(!SampleID.IsValid())
+	if(!SampleID.IsValid() || !m_SoundEnabled)
 		return -1;
 
-	int VoiceID = -1;
-	int i;
-
-	lock_wait(m_SoundLock);
+	// a claimed voice must get its command, so check for room first
+	if(CommandQueueFull())
+		return -1;
 
-	// search for voice
-	for(i = 0; i < NUM_VOICES; i++)
+	// search for voice, the mixer frees them
+	int VoiceID = -1;
+	for(int i = 0; i < NUM_VOICES; i++)
 	{
 		int id = (m_NextVoice + i) % NUM_VOICES;
-		if(!m_aVoices[id].m_pSample)
+		if(!atomic_int_load(&m_aVoiceUsed[id]))
 		{
 			VoiceID = id;
 			m_NextVoice = id+1;
@@ -529,22 +843,48 @@ int CSound::Play(int ChannelID, CSampleHandle SampleID, int Flags, float x, floa
 		}
 	}
 
-	// voice found, use it
-	if(VoiceID != -1)
+	// all voices are busy, steal the quietest one if the new sound is louder.
+	// a voice whose sound was stopped counts as silent
+	if(VoiceID == -1)
 	{
-		m_aVoices[VoiceID].m_pSample = &m_aSamples[SampleID.Id()];
-		m_aVoices[VoiceID].m_pChannel = &m_aChannels[ChannelID];
-		if(Flags & FLAG_LOOP)
-			m_aVoices[VoiceID].m_Tick = m_aSamples[SampleID.Id()].m_PausedAt;
-		else
-			m_aVoices[VoiceID].m_Tick = 0;
-		m_aVoices[VoiceID].m_Vol = 255;
-		m_aVoices[VoiceID].m_Flags = Flags;
-		m_aVoices[VoiceID].m_X = (int)x;
-		m_aVoices[VoiceID].m_Y = (int)y;
+		float Loudness = VoiceLoudness(ChannelID, Flags, (int)x, (int)y);
+		float MinLoudness = Loudness;
+		for(int i = 0; i < NUM_VOICES; i++)
+		{
+			const CVoiceInfo *pInfo = &m_aVoiceInfos[i];
+			float VoiceVol = pInfo->m_Sample == -1 ? -1.0f : VoiceLoudness(pInfo->m_Channel, pInfo->m_Flags, pInfo->m_X, pInfo->m_Y);
+			if(VoiceVol < MinLoudness)
+			{
+				MinLoudness = VoiceVol;
+				VoiceID = i;
+			}
+		}
+		if(VoiceID == -1)
+			return -1;
 	}
 
-	lock_unlock(m_SoundLock);
+	// claim the voice, even if the mixer just freed it
+	if(++m_VoiceGen == 0)
+		m_VoiceGen = 1;
+	atomic_int_store(&m_aVoiceUsed[VoiceID], m_VoiceGen);
+
+	CSoundCommand Cmd;
+	Cmd.m_Cmd = SOUNDCMD_PLAY;
+	Cmd.m_Voice = VoiceID;
+	Cmd.m_Sample = SampleID.Id();
+	Cmd.m_Channel = ChannelID;
+	Cmd.m_Flags = Flags;
+	Cmd.m_X = (int)x;
+	Cmd.m_Y = (int)y;
+	Cmd.m_Gen = m_VoiceGen;
+	PushCommand(&Cmd);
+
+	CVoiceInfo *pInfo = &m_aVoiceInfos[VoiceID];
+	pInfo->m_Sample = SampleID.Id();
+	pInfo->m_Channel = ChannelID;
+	pInfo->m_Flags = Flags;
+	pInfo->m_X = Cmd.m_X;
+	pInfo->m_Y = Cmd.m_Y;
 	return VoiceID;
 }
 
@@ -558,57 +898,53 @@ int CSound::Play(int ChannelID, CSampleHandle SampleID, int Flags)
 	return Play(ChannelID, SampleID, Flags, 0, 0);
 }
 
-void CSound::Stop(CSampleHandle SampleID)
+static void PushStopCommand(int Cmd, int SampleID)
 {
-	// TODO: a nice fade out
-	lock_wait(m_SoundLock);
-	CSample *pSample = &m_aSamples[SampleID.Id()];
+	CSoundCommand StopCmd;
+	mem_zero(&StopCmd, sizeof(StopCmd));
+	StopCmd.m_Cmd = Cmd;
+	StopCmd.m_Sample = SampleID;
+
+	// stops must not get lost, the mixer empties the queue every callback
+	while(!PushCommand(&StopCmd))
+		thread_yield();
+
 	for(int i = 0; i < NUM_VOICES; i++)
 	{
-		if(m_aVoices[i].m_pSample == pSample)
-		{
-			if(m_aVoices[i].m_Flags & FLAG_LOOP)
-				m_aVoices[i].m_pSample->m_PausedAt = m_aVoices[i].m_Tick;
-			else
-				m_aVoices[i].m_pSample->m_PausedAt = 0;
-			m_aVoices[i].m_pSample = 0;
-		}
+		if(Cmd == SOUNDCMD_STOPALL || m_aVoiceInfos[i].m_Sample == SampleID)
+			m_aVoiceInfos[i].m_Sample = -1;
 	}
-	lock_unlock(m_SoundLock);
+}
+
+void CSound::Stop(CSampleHandle SampleID)
+{
+	// TODO: a nice fade out
+	if(!SampleID.IsValid() || !m_SoundEnabled)
+		return;
+	PushStopCommand(SOUNDCMD_STOP, SampleID.Id());
 }
 
 void CSound::StopAll()
 {
 	// TODO: a nice fade out
-	lock_wait(m_SoundLock);
-	for(int i = 0; i < NUM_VOICES; i++)
-	{
-		if(m_aVoices[i].m_pSample)
-		{
-			if(m_aVoices[i].m_Flags & FLAG_LOOP)
-				m_aVoices[i].m_pSample->m_PausedAt = m_aVoices[i].m_Tick;
-			else
-				m_aVoices[i].m_pSample->m_PausedAt = 0;
-		}
-		m_aVoices[i].m_pSample = 0;
-	}
-	lock_unlock(m_SoundLock);
+	if(!m_SoundEnabled)
+		return;
+	PushStopCommand(SOUNDCMD_STOPALL, -1);
 }
 
 bool CSound::IsPlaying(CSampleHandle SampleID)
 {
-	bool Ret = false;
-	lock_wait(m_SoundLock);
-	CSample *pSample = &m_aSamples[SampleID.Id()];
 	for(int i = 0; i < NUM_VOICES; i++)
 	{
-		if(m_aVoices[i].m_pSample == pSample)
-		{
-			Ret = true;
-		}
+		if(atomic_int_load(&m_aVoiceUsed[i]) && m_aVoiceInfos[i].m_Sample == SampleID.Id())
+			return true;
 	}
-	lock_unlock(m_SoundLock);
-	return Ret;
+	return false;
+}
+
+unsigned CSound::MixTime() const
+{
+	return (unsigned)atomic_int_load(&m_MixTime);
 }
 
 IEngineSound *CreateEngineSound() { return new CSound; }
@@ -20,7 +20,7 @@ public:
 	int Shutdown();
 	int AllocID();
 
-	static void RateConvert(int SampleID);
+	static short *RateConvert(short *pData, int *pNumFrames, int Channels, int Rate);
 
 	virtual bool IsSoundEnabled() { return m_SoundEnabled != 0; }
 
@@ -36,6 +36,8 @@ public:
 	virtual void Stop(CSampleHandle SampleID);
 	virtual void StopAll();
 	virtual bool IsPlaying(CSampleHandle SampleID);
+
+	virtual unsigned MixTime() const;
 };
 
 #endif
@@ -52,6 +52,8 @@ void CGlyphMap::CAtlas::Init(int Index, int X, int Y, int Width, int Height)
 	m_Sections.add(Section);
 
 	m_IsEmpty = true;
+	m_DirtyMin = ivec2(m_Offset.x + m_Width, m_Offset.y + m_Height);
+	m_DirtyMax = m_Offset;
 }
 
 ivec2 CGlyphMap::CAtlas::Add(int Width, int Height)
@@ -154,18 +156,15 @@ void CGlyphMap::InitTexture(int Width, int Height)
 
 	int TextureSize = Width*Height;
 
-	void *pMem = mem_alloc(TextureSize, 1);
-	mem_zero(pMem, TextureSize);
-
 	for(int i = 0; i < 2; i++)
 	{
+		mem_zero(m_apAtlasData[i], TextureSize);
 		if(m_aTextures[i].IsValid())
 			m_pGraphics->UnloadTexture(&m_aTextures[i]);
 
-		m_aTextures[i] = m_pGraphics->LoadTextureRaw(Width, Height, CImageInfo::FORMAT_ALPHA, pMem, CImageInfo::FORMAT_ALPHA, IGraphics::TEXLOAD_NOMIPMAPS);
+		m_aTextures[i] = m_pGraphics->LoadTextureRaw(Width, Height, CImageInfo::FORMAT_ALPHA, m_apAtlasData[i], CImageInfo::FORMAT_ALPHA, IGraphics::TEXLOAD_NOMIPMAPS);
 	}
 	dbg_msg("textrender", "memory usage: %d", TextureSize);
-	mem_free(pMem);
 }
 
 int CGlyphMap::FitGlyph(int Width, int Height, ivec2 *pPosition)
@@ -203,19 +202,7 @@ int CGlyphMap::FitGlyph(int Width, int Height, ivec2 *pPosition)
 		}
 	}
 
-	int X = m_aAtlasPages[Atlas].m_Offset.x;
-	int Y = m_aAtlasPages[Atlas].m_Offset.y;
-	int W = m_aAtlasPages[Atlas].m_Width;
-	int H = m_aAtlasPages[Atlas].m_Height;
-
-	unsigned char *pMem = (unsigned char *)mem_alloc(W*H, 1);
-	mem_zero(pMem, W*H);
-
-	UploadGlyph(0, X, Y, W, H, pMem);
-
-	mem_free(pMem);
-
-	m_aAtlasPages[Atlas].Init(m_NumTotalPages++, X, Y, W, H);
+	ClearPage(Atlas);
 	*pPosition = m_aAtlasPages[Atlas].Add(Width, Height);
 	m_ActiveAtlasIndex = Atlas;
 
@@ -223,10 +210,199 @@ int CGlyphMap::FitGlyph(int Width, int Height, ivec2 *pPosition)
 	return Atlas;
 }
 
-void CGlyphMap::UploadGlyph(int TextureIndex, int PosX, int PosY, int Width, int Height, const unsigned char *pData)
+void CGlyphMap::ClearPage(int Index)
+{
+	CAtlas *pPage = &m_aAtlasPages[Index];
+	pPage->Init(m_NumTotalPages++, pPage->m_Offset.x, pPage->m_Offset.y, pPage->m_Width, pPage->m_Height);
+	for(int i = 0; i < 2; i++)
+		for(int y = 0; y < pPage->m_Height; y++)
+			mem_zero(m_apAtlasData[i] + (pPage->m_Offset.y+y)*TEXTURE_SIZE + pPage->m_Offset.x, pPage->m_Width);
+	pPage->m_DirtyMin = pPage->m_Offset;
+	pPage->m_DirtyMax = pPage->m_Offset + ivec2(pPage->m_Width, pPage->m_Height);
+}
+
+void CGlyphMap::UploadGlyph(int AtlasIndex, int TextureIndex, int PosX, int PosY, int Width, int Height, const unsigned char *pData)
+{
+	// only write into the atlas copy, the changed area is uploaded once in FlushUploads
+	// clip to the page so that a bleeding outline does not overwrite the neighbours
+	CAtlas *pPage = &m_aAtlasPages[AtlasIndex];
+	int X0 = max(PosX, pPage->m_Offset.x);
+	int Y0 = max(PosY, pPage->m_Offset.y);
+	int X1 = min(PosX + Width, pPage->m_Offset.x + pPage->m_Width);
+	int Y1 = min(PosY + Height, pPage->m_Offset.y + pPage->m_Height);
+	if(!pData || X0 >= X1 || Y0 >= Y1)
+		return;
+
+	for(int y = Y0; y < Y1; y++)
+		mem_copy(m_apAtlasData[TextureIndex] + y*TEXTURE_SIZE + X0, pData + (y-PosY)*Width + (X0-PosX), X1-X0);
+
+	pPage->m_DirtyMin = ivec2(min(pPage->m_DirtyMin.x, X0), min(pPage->m_DirtyMin.y, Y0));
+	pPage->m_DirtyMax = ivec2(max(pPage->m_DirtyMax.x, X1), max(pPage->m_DirtyMax.y, Y1));
+}
+
+void CGlyphMap::FlushUploads()
+{
+	for(int i = 0; i < NUM_PAGES_PER_DIM*NUM_PAGES_PER_DIM; ++i)
+	{
+		CAtlas *pPage = &m_aAtlasPages[i];
+		int Width = pPage->m_DirtyMax.x - pPage->m_DirtyMin.x;
+		int Height = pPage->m_DirtyMax.y - pPage->m_DirtyMin.y;
+		if(Width <= 0 || Height <= 0)
+			continue;
+
+		for(int t = 0; t < 2; t++)
+		{
+			for(int y = 0; y < Height; y++)
+				mem_copy(m_pUploadData + y*Width, m_apAtlasData[t] + (pPage->m_DirtyMin.y+y)*TEXTURE_SIZE + pPage->m_DirtyMin.x, Width);
+			m_pGraphics->LoadTextureRawSub(m_aTextures[t], pPage->m_DirtyMin.x, pPage->m_DirtyMin.y, Width, Height, CImageInfo::FORMAT_ALPHA, m_pUploadData);
+		}
+		pPage->m_DirtyMin = pPage->m_Offset + ivec2(pPage->m_Width, pPage->m_Height);
+		pPage->m_DirtyMax = pPage->m_Offset;
+	}
+}
+
+bool CGlyphMap::RasterizeGlyph(FT_Face Face, FT_Stroker Stroker, CRasterJob *pJob)
+{
+	mem_zero(pJob->m_apData, sizeof(pJob->m_apData));
+	FT_Set_Pixel_Sizes(Face, 0, pJob->m_FontSize);
+	if(FT_Load_Glyph(Face, pJob->m_GlyphIndex, FT_LOAD_NO_BITMAP))
+		return false;
+
+	// the glyph itself and its outline
+	for(int i = 0; i < 2; i++)
+	{
+		FT_BitmapGlyph Glyph;
+		if(FT_Get_Glyph(Face->glyph, (FT_Glyph *)&Glyph))
+			return false;
+		if(i == 1)
+		{
+			FT_Stroker_Set(Stroker, (pJob->m_OutlineThickness) * 64 + 32, FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
+			FT_Glyph_Stroke((FT_Glyph *)&Glyph, Stroker, true);
+		}
+		FT_Glyph_To_Bitmap((FT_Glyph *)&Glyph, FT_RENDER_MODE_NORMAL, 0, true);
+		const FT_Bitmap *pBitmap = &Glyph->bitmap;
+		pJob->m_aWidth[i] = pBitmap->width;
+		pJob->m_aHeight[i] = pBitmap->rows;
+		pJob->m_aLeft[i] = Glyph->left;
+		pJob->m_aTop[i] = Glyph->top;
+		if(pBitmap->width > 0 && pBitmap->rows > 0)
+		{
+			pJob->m_apData[i] = (unsigned char *)mem_alloc_tag(pBitmap->width*pBitmap->rows, 1, MEMTAG_GRAPHICS);
+			for(int y = 0; y < (int)pBitmap->rows; y++)
+				mem_copy(pJob->m_apData[i] + y*pBitmap->width, pBitmap->buffer + y*pBitmap->pitch, pBitmap->width);
+		}
+		FT_Done_Glyph((FT_Glyph)Glyph);
+	}
+	return true;
+}
+
+void CGlyphMap::FinishGlyph(CRasterJob *pJob)
+{
+	// the page might have been dropped in the meantime
+	CGlyph *pGlyph = pJob->m_pGlyph;
+	if(pGlyph->m_PageID == pJob->m_PageID && pGlyph->m_AtlasIndex >= 0 && m_aAtlasPages[pGlyph->m_AtlasIndex].m_ID == pJob->m_PageID)
+	{
+		ivec2 Position = pJob->m_Position;
+		UploadGlyph(pGlyph->m_AtlasIndex, 0, Position.x, Position.y, pJob->m_aWidth[0], pJob->m_aHeight[0], pJob->m_apData[0]);
+		ivec2 OutlinedPosition = Position + ivec2(pJob->m_aLeft[1] - pJob->m_aLeft[0], pJob->m_aTop[0] - pJob->m_aTop[1]);
+		UploadGlyph(pGlyph->m_AtlasIndex, 1, OutlinedPosition.x, OutlinedPosition.y, pJob->m_aWidth[1], pJob->m_aHeight[1], pJob->m_apData[1]);
+		pGlyph->m_Pending = false;
+	}
+
+	for(int i = 0; i < 2; i++)
+	{
+		if(pJob->m_apData[i])
+			mem_free(pJob->m_apData[i]);
+		pJob->m_apData[i] = 0;
+	}
+}
+
+bool CGlyphMap::QueueGlyph(const CRasterJob *pJob)
 {
-	m_pGraphics->LoadTextureRawSub(m_aTextures[TextureIndex], PosX, PosY,
-		Width, Height, CImageInfo::FORMAT_ALPHA, pData);
+	if(!m_pWorkerThread)
+		return false;
+
+	lock_wait(m_JobLock);
+	bool Queued = m_NumJobs < MAX_RASTER_JOBS;
+	if(Queued)
+		m_aJobs[(m_FirstJob + m_NumJobs++) % MAX_RASTER_JOBS] = *pJob;
+	lock_unlock(m_JobLock);
+	if(Queued)
+		semaphore_signal(&m_JobSignal);
+	return Queued;
+}
+
+bool CGlyphMap::CanQueueGlyph()
+{
+	if(!m_pWorkerThread)
+		return false;
+
+	lock_wait(m_JobLock);
+	bool Space = m_NumJobs < MAX_RASTER_JOBS;
+	lock_unlock(m_JobLock);
+	return Space;
+}
+
+FT_Face CGlyphMap::WorkerFace(const CRasterJob *pJob)
+{
+	for(int i = 0; i < m_NumWorkerFaces; ++i)
+	{
+		if(m_aWorkerFaces[i].m_pFontData == pJob->m_pFontData && m_aWorkerFaces[i].m_FaceIndex == pJob->m_FaceIndex)
+			return m_aWorkerFaces[i].m_Face;
+	}
+
+	// faces can't be shared between threads, open the same font data again
+	FT_Face Face;
+	if(m_NumWorkerFaces == MAX_FACES || FT_New_Memory_Face(m_WorkerLibrary, pJob->m_pFontData, pJob->m_FontDataSize, pJob->m_FaceIndex, &Face))
+		return 0;
+	m_aWorkerFaces[m_NumWorkerFaces].m_pFontData = pJob->m_pFontData;
+	m_aWorkerFaces[m_NumWorkerFaces].m_FaceIndex = pJob->m_FaceIndex;
+	m_aWorkerFaces[m_NumWorkerFaces++].m_Face = Face;
+	return Face;
+}
+
+void CGlyphMap::WorkerThread(void *pUser)
+{
+	CGlyphMap *pThis = (CGlyphMap *)pUser;
+	while(1)
+	{
+		semaphore_wait(&pThis->m_JobSignal);
+		if(pThis->m_WorkerShutdown)
+			break;
+
+		lock_wait(pThis->m_JobLock);
+		CRasterJob Job = pThis->m_aJobs[pThis->m_FirstJob];
+		pThis->m_FirstJob = (pThis->m_FirstJob + 1) % MAX_RASTER_JOBS;
+		pThis->m_NumJobs--;
+		lock_unlock(pThis->m_JobLock);
+
+		FT_Face Face = pThis->WorkerFace(&Job);
+		if(!Face || !RasterizeGlyph(Face, pThis->m_WorkerStroker, &Job))
+		{
+			for(int i = 0; i < 2; i++)
+			{
+				if(Job.m_apData[i])
+					mem_free(Job.m_apData[i]);
+				Job.m_apData[i] = 0;
+			}
+		}
+
+		lock_wait(pThis->m_JobLock);
+		pThis->m_DoneJobs.add(Job);
+		lock_unlock(pThis->m_JobLock);
+	}
+}
+
+void CGlyphMap::UpdateGlyphs()
+{
+	if(!m_pWorkerThread)
+		return;
+
+	lock_wait(m_JobLock);
+	for(int i = 0; i < m_DoneJobs.size(); ++i)
+		FinishGlyph(&m_DoneJobs[i]);
+	m_DoneJobs.clear();
+	lock_unlock(m_JobLock);
 }
 
 bool CGlyphMap::SetFaceByName(FT_Face *pFace, const char *pFamilyName)
@@ -275,12 +451,58 @@ CGlyphMap::CGlyphMap(IGraphics *pGraphics, FT_Library FtLibrary)
 	m_NumFtFaces = 0;
 	m_NumFallbackFaces = 0;
 	m_NumTotalPages = 0;
+	m_NumGlyphMisses = 0;
+
+	for(int i = 0; i < 2; i++)
+		m_apAtlasData[i] = (unsigned char *)mem_alloc_tag(TEXTURE_SIZE*TEXTURE_SIZE, 1, MEMTAG_GRAPHICS);
+	m_pUploadData = (unsigned char *)mem_alloc_tag(PAGE_SIZE*PAGE_SIZE, 1, MEMTAG_GRAPHICS);
 
 	InitTexture(TEXTURE_SIZE, TEXTURE_SIZE);
+
+	m_NumWorkerFaces = 0;
+	m_FirstJob = 0;
+	m_NumJobs = 0;
+	m_JobLock = lock_create();
+	semaphore_init(&m_JobSignal);
+	m_WorkerShutdown = false;
+	m_pWorkerThread = 0;
+	if(FT_Init_FreeType(&m_WorkerLibrary) == 0)
+	{
+		FT_Stroker_New(m_WorkerLibrary, &m_WorkerStroker);
+		m_pWorkerThread = thread_init(WorkerThread, this);
+		if(!m_pWorkerThread)
+		{
+			FT_Stroker_Done(m_WorkerStroker);
+			FT_Done_FreeType(m_WorkerLibrary);
+		}
+	}
+	if(!m_pWorkerThread)
+		dbg_msg("textrender", "failed to start the glyph rasterizer, rendering glyphs on demand");
 }
 
 CGlyphMap::~CGlyphMap()
 {
+	if(m_pWorkerThread)
+	{
+		m_WorkerShutdown = true;
+		semaphore_signal(&m_JobSignal);
+		thread_wait(m_pWorkerThread);
+		for(int i = 0; i < m_DoneJobs.size(); ++i)
+			for(int j = 0; j < 2; j++)
+				if(m_DoneJobs[i].m_apData[j])
+					mem_free(m_DoneJobs[i].m_apData[j]);
+		for(int i = 0; i < m_NumWorkerFaces; ++i)
+			FT_Done_Face(m_aWorkerFaces[i].m_Face);
+		FT_Stroker_Done(m_WorkerStroker);
+		FT_Done_FreeType(m_WorkerLibrary);
+	}
+	semaphore_destroy(&m_JobSignal);
+	lock_destroy(m_JobLock);
+
+	for(int i = 0; i < 2; i++)
+		mem_free(m_apAtlasData[i]);
+	mem_free(m_pUploadData);
+
 	for(int i = 0; i < m_Glyphs.size(); ++i)
 		delete m_Glyphs[i].m_pGlyph;
 
@@ -377,6 +599,7 @@ bool CGlyphMap::RenderGlyph(CGlyph *pGlyph, bool Render)
 			return false;
 		}
 	}
+	m_NumGlyphMisses++;
 
 	FT_Bitmap *pBitmap;
 
@@ -410,37 +633,26 @@ bool CGlyphMap::RenderGlyph(CGlyph *pGlyph, bool Render)
 	int AtlasIndex = -1;
 	int Page = -1;
 
-	if(Render && BitmapWidth > 0 && BitmapHeight > 0)
+	CRasterJob Job;
+	bool Rasterize = Render && BitmapWidth > 0 && BitmapHeight > 0;
+	if(Rasterize)
 	{
 		// find space in atlas
 		ivec2 Position = ivec2(0, 0);
 		AtlasIndex = FitGlyph(Width, Height, &Position);
 		Page = m_aAtlasPages[AtlasIndex].m_ID;
-
-		FT_BitmapGlyph Glyph;
-		FT_Get_Glyph(GlyphFace->glyph, (FT_Glyph *)&Glyph);
-		FT_Glyph_To_Bitmap((FT_Glyph *)&Glyph, FT_RENDER_MODE_NORMAL, 0, true);
-		pBitmap = &Glyph->bitmap;
-		int BitmapLeft = Glyph->left;
-		int BitmapTop = Glyph->top;
-
-		UploadGlyph(0, Position.x + Offset, Position.y + Offset, BitmapWidth, BitmapHeight, pBitmap->buffer);
-		FT_Done_Glyph((FT_Glyph)Glyph);
-
-		// create outline
-		FT_Stroker_Set(m_FtStroker, (OutlineThickness) * 64 + 32, FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
-		FT_Get_Glyph(GlyphFace->glyph, (FT_Glyph *)&Glyph);
-		FT_Glyph_Stroke((FT_Glyph *)&Glyph, m_FtStroker, true);
-		FT_Glyph_To_Bitmap((FT_Glyph *)&Glyph, FT_RENDER_MODE_NORMAL, 0, true);
-		pBitmap = &Glyph->bitmap;
-		
-		int OutlinedPositionX = Position.x + (Glyph->left - BitmapLeft) + Offset;
-		int OutlinedPositionY = Position.y + (BitmapTop - Glyph->top) + Offset;
-		UploadGlyph(1, OutlinedPositionX, OutlinedPositionY, pBitmap->width, pBitmap->rows, pBitmap->buffer);
-		FT_Done_Glyph((FT_Glyph)Glyph);
-
 		TouchPage(AtlasIndex);
 
+		Job.m_pGlyph = pGlyph;
+		Job.m_PageID = Page;
+		Job.m_Position = Position + ivec2(Offset, Offset);
+		Job.m_GlyphIndex = GlyphIndex;
+		Job.m_FontSize = FontSize;
+		Job.m_OutlineThickness = OutlineThickness;
+		Job.m_pFontData = GlyphFace->stream->base;
+		Job.m_FontDataSize = GlyphFace->stream->size;
+		Job.m_FaceIndex = GlyphFace->face_index;
+
 		float UVScale = 1.0f / TEXTURE_SIZE;
 		pGlyph->m_aUvCoords[0] = (Position.x + Spacing) * UVScale;
 		pGlyph->m_aUvCoords[1] = (Position.y + Spacing) * UVScale;
@@ -459,6 +671,19 @@ bool CGlyphMap::RenderGlyph(CGlyph *pGlyph, bool Render)
 	pGlyph->m_BearingY = (FontSize - GlyphFace->glyph->bitmap_top-OutlineThickness/2) * Scale; // ignore_convention
 	pGlyph->m_AdvanceX = (GlyphFace->glyph->advance.x>>6) * Scale; // ignore_convention
 	pGlyph->m_Rendered = Render;
+	pGlyph->m_Pending = false;
+
+	// leave the rasterization to the worker, it is done right away when its queue is full
+	if(Rasterize)
+	{
+		pGlyph->m_Pending = true;
+		if(!QueueGlyph(&Job))
+		{
+			if(!RasterizeGlyph(GlyphFace, m_FtStroker, &Job))
+				dbg_msg("textrender", "error rendering glyph %d", pGlyph->m_ID);
+			FinishGlyph(&Job);
+		}
+	}
 
 	return true;
 }
@@ -476,6 +701,7 @@ CGlyph *CGlyphMap::GetGlyph(int Chr, int FontSizeIndex, bool Render)
 	{
 		Index.m_pGlyph = new CGlyph();
 		Index.m_pGlyph->m_Rendered = false;
+		Index.m_pGlyph->m_Pending = false;
 		Index.m_pGlyph->m_ID = Chr;
 		Index.m_pGlyph->m_FontSizeIndex = FontSizeIndex;
 		if(RenderGlyph(Index.m_pGlyph, Render))
@@ -718,6 +944,9 @@ CTextRender::CTextRender()
 	m_TextSecondaryA = 0.3f;
 
 	m_pGlyphMap = 0;
+	m_paLayoutCache = 0;
+	m_LayoutCacheFrame = 0;
+	m_Batching = false;
 	m_NumVariants = 0;
 	m_CurrentVariant = -1;
 	m_paVariants = 0;
@@ -737,17 +966,25 @@ void CTextRender::Init()
 	m_pGraphics = Kernel()->RequestInterface<IGraphics>();
 	FT_Init_FreeType(&m_FTLibrary);
 	m_pGlyphMap = new CGlyphMap(m_pGraphics, m_FTLibrary);
+	m_paLayoutCache = new CLayoutCacheEntry[LAYOUT_CACHE_SIZE];
+	ClearLayoutCache();
 }
 
 void CTextRender::Update()
 {
 	if(m_pGlyphMap)
+	{
 		m_pGlyphMap->PagesAccessReset();
+		m_pGlyphMap->UpdateGlyphs();
+	}
+	m_LayoutCacheFrame++;
 }
 
 void CTextRender::Shutdown()
 {
 	delete m_pGlyphMap;
+	delete[] m_paLayoutCache;
+	m_paLayoutCache = 0;
 	if(m_paVariants)
 		mem_free(m_paVariants);
 }
@@ -764,7 +1001,7 @@ void CTextRender::LoadFonts(IStorage *pStorage, IConsole *pConsole)
 		return;
 	}
 	int FileSize = (int)io_length(File);
-	char *pFileData = (char *)mem_alloc(FileSize, 1);
+	char *pFileData = (char *)mem_alloc_tag(FileSize, 1, MEMTAG_GRAPHICS);
 	io_read(File, pFileData, FileSize);
 	io_close(File);
 
@@ -794,7 +1031,7 @@ void CTextRender::LoadFonts(IStorage *pStorage, IConsole *pConsole)
 			if(File)
 			{
 				long FileSize = io_length(File);
-				m_apFontData[i] = mem_alloc(FileSize, 1);
+				m_apFontData[i] = mem_alloc_tag(FileSize, 1, MEMTAG_GRAPHICS);
 				io_read(File, m_apFontData[i], FileSize);
 				io_close(File);
 				if(LoadFontCollection(aFilename, m_apFontData[i], FileSize))
@@ -830,7 +1067,7 @@ void CTextRender::LoadFonts(IStorage *pStorage, IConsole *pConsole)
 	{
 		m_NumVariants = rVariant.u.object.length;
 		json_object_entry *Entries = rVariant.u.object.values;
-		m_paVariants = (CFontLanguageVariant *)mem_alloc(sizeof(CFontLanguageVariant)*m_NumVariants, 1);
+		m_paVariants = (CFontLanguageVariant *)mem_alloc_tag(sizeof(CFontLanguageVariant)*m_NumVariants, 1, MEMTAG_GRAPHICS);
 		for(int i = 0; i < m_NumVariants; ++i)
 		{
 			char aFileName[128];
@@ -869,6 +1106,22 @@ void CTextRender::SetFontLanguageVariant(const char *pLanguageFile)
 	}
 
 	m_pGlyphMap->SetVariantFaceByName(pFamilyName);
+
+	// the glyph metrics depend on the faces
+	ClearLayoutCache();
+}
+
+void CTextRender::PrewarmGlyphs(const char *pText, float FontSize)
+{
+	float ScreenX0, ScreenY0, ScreenX1, ScreenY1;
+	Graphics()->GetScreen(&ScreenX0, &ScreenY0, &ScreenX1, &ScreenY1);
+	int PixelSize = (int)(FontSize * Graphics()->ScreenHeight()/(ScreenY1-ScreenY0));
+	int FontSizeIndex = m_pGlyphMap->GetFontSizeIndex(PixelSize);
+
+	// only what fits into the queue, this must not stall
+	const char *pCur = pText;
+	for(int Chr = str_utf8_decode(&pCur); Chr > 0 && m_pGlyphMap->CanQueueGlyph(); Chr = str_utf8_decode(&pCur))
+		m_pGlyphMap->GetGlyph(Chr, FontSizeIndex, true);
 }
 
 void CTextRender::TextColor(float r, float g, float b, float a)
@@ -897,6 +1150,46 @@ float CTextRender::TextWidth(float FontSize, const char *pText, int Length)
 	return s_Cursor.m_Width;
 }
 
+unsigned CTextRender::LayoutHash(const char *pText, int Length)
+{
+	// fnv-1a
+	unsigned Hash = 2166136261u;
+	for(int i = 0; i < Length; i++)
+		Hash = (Hash ^ (unsigned char)pText[i]) * 16777619u;
+	return Hash;
+}
+
+CTextRender::CLayoutCacheEntry *CTextRender::FindLayout(unsigned Hash, const char *pText, int Length, const CTextCursor *pCursor, int MaxLines, vec2 ScreenScale, bool *pFound)
+{
+	// returns the matching entry or the one to replace
+	CLayoutCacheEntry *pOldest = 0;
+	for(int i = 0; i < LAYOUT_CACHE_PROBES; i++)
+	{
+		CLayoutCacheEntry *pEntry = &m_paLayoutCache[(Hash + i) % LAYOUT_CACHE_SIZE];
+		if(pEntry->m_Hash == Hash && pEntry->m_Length == Length && pEntry->m_FontSize == pCursor->m_FontSize &&
+			pEntry->m_MaxWidth == pCursor->m_MaxWidth && pEntry->m_MaxLines == MaxLines && pEntry->m_Flags == pCursor->m_Flags &&
+			pEntry->m_LineSpacing == pCursor->m_LineSpacing && pEntry->m_ScreenScale == ScreenScale && mem_comp(pEntry->m_aText, pText, Length) == 0)
+		{
+			*pFound = true;
+			return pEntry;
+		}
+		if(!pOldest || pEntry->m_Length < 0 || (pOldest->m_Length >= 0 && pEntry->m_LastUse < pOldest->m_LastUse))
+			pOldest = pEntry;
+	}
+	*pFound = false;
+	return pOldest;
+}
+
+void CTextRender::ClearLayoutCache()
+{
+	for(int i = 0; i < LAYOUT_CACHE_SIZE; i++)
+	{
+		m_paLayoutCache[i].m_Length = -1;
+		m_paLayoutCache[i].m_LastUse = 0;
+		m_paLayoutCache[i].m_Glyphs.clear();
+	}
+}
+
 void CTextRender::TextDeferred(CTextCursor *pCursor, const char *pText, int Length)
 {
 	if(pCursor->m_Truncated || pCursor->m_SkipTextRender)
@@ -931,6 +1224,51 @@ void CTextRender::TextDeferred(CTextCursor *pCursor, const char *pText, int Leng
 	if(Length < 0)
 		Length = str_length(pText);
 
+	// reuse the layout of a text that starts on a fresh cursor
+	CLayoutCacheEntry *pLayout = 0;
+	if(Length < MAX_LAYOUT_TEXT && pCursor->m_Glyphs.size() == 0 && pCursor->m_LineCount == 1 && pCursor->m_Width == 0 &&
+		pCursor->m_Advance == vec2(0, 0) && pCursor->m_NextLineAdvanceY == 0 && pCursor->m_StartOfLine)
+	{
+		bool Found;
+		unsigned Hash = LayoutHash(pText, Length);
+		pLayout = FindLayout(Hash, pText, Length, pCursor, MaxLines, ScreenScale, &Found);
+		pLayout->m_LastUse = m_LayoutCacheFrame;
+		if(Found)
+		{
+			pCursor->m_Width = pLayout->m_Width;
+			pCursor->m_Height = pLayout->m_Height;
+			pCursor->m_Truncated = pLayout->m_Truncated;
+			pCursor->m_LineCount = pLayout->m_LineCount;
+			pCursor->m_CharCount = pLayout->m_CharCount;
+			pCursor->m_Advance = pLayout->m_Advance;
+			pCursor->m_NextLineAdvanceY = pLayout->m_NextLineAdvanceY;
+			pCursor->m_StartOfLine = pLayout->m_StartOfLine;
+			pCursor->m_PageCountWhenDrawn = pLayout->m_PageCount;
+			pCursor->m_Glyphs = pLayout->m_Glyphs;
+
+			// the colors are not part of the key
+			const vec4 TextColor = vec4(m_TextR, m_TextG, m_TextB, m_TextA);
+			const vec4 SecondaryColor = vec4(m_TextSecondaryR, m_TextSecondaryG, m_TextSecondaryB, m_TextSecondaryA);
+			for(int i = 0; i < pCursor->m_Glyphs.size(); ++i)
+			{
+				pCursor->m_Glyphs[i].m_TextColor = TextColor;
+				pCursor->m_Glyphs[i].m_SecondaryColor = SecondaryColor;
+			}
+			TextRefreshGlyphs(pCursor);
+			return;
+		}
+
+		pLayout->m_Hash = Hash;
+		pLayout->m_Length = -1;
+		mem_copy(pLayout->m_aText, pText, Length);
+		pLayout->m_FontSize = pCursor->m_FontSize;
+		pLayout->m_MaxWidth = pCursor->m_MaxWidth;
+		pLayout->m_MaxLines = MaxLines;
+		pLayout->m_Flags = pCursor->m_Flags;
+		pLayout->m_LineSpacing = pCursor->m_LineSpacing;
+		pLayout->m_ScreenScale = ScreenScale;
+	}
+
 	const char *pCur = (char *)pText;
 	const char *pEnd = (char *)pText + Length;
 
@@ -1056,6 +1394,21 @@ void CTextRender::TextDeferred(CTextCursor *pCursor, const char *pText, int Leng
 	}
 
 	TextRefreshGlyphs(pCursor);
+
+	if(pLayout)
+	{
+		pLayout->m_Length = Length;
+		pLayout->m_Width = pCursor->m_Width;
+		pLayout->m_Height = pCursor->m_Height;
+		pLayout->m_Truncated = pCursor->m_Truncated;
+		pLayout->m_LineCount = pCursor->m_LineCount;
+		pLayout->m_CharCount = pCursor->m_CharCount;
+		pLayout->m_Advance = pCursor->m_Advance;
+		pLayout->m_NextLineAdvanceY = pCursor->m_NextLineAdvanceY;
+		pLayout->m_StartOfLine = pCursor->m_StartOfLine;
+		pLayout->m_PageCount = pCursor->m_PageCountWhenDrawn;
+		pLayout->m_Glyphs = pCursor->m_Glyphs;
+	}
 }
 
 void CTextRender::TextNewline(CTextCursor *pCursor)
@@ -1143,8 +1496,12 @@ void CTextRender::DrawText(CTextCursor *pCursor, vec2 Offset, int Texture, bool
 	vec2 AlignOffset = vec2(AlignBox.x, AlignBox.y);
 
 	vec4 LastColor = vec4(-1, -1, -1, -1);
-	Graphics()->TextureSet(m_pGlyphMap->GetTexture(Texture));
-	Graphics()->QuadsBegin();
+	m_pGlyphMap->FlushUploads();
+	if(!m_Batching)
+	{
+		Graphics()->TextureSet(m_pGlyphMap->GetTexture(Texture));
+		Graphics()->QuadsBegin();
+	}
 
 	int Line = -1;
 	vec2 LineOffset = vec2(0, 0);
@@ -1170,6 +1527,8 @@ void CTextRender::DrawText(CTextCursor *pCursor, vec2 Offset, int Texture, bool
 			continue;
 
 		m_pGlyphMap->TouchPage(pGlyph->m_AtlasIndex);
+		if(pGlyph->m_Pending)
+			continue;
 
 		vec4 Color;
 		if(IsSecondary)
@@ -1183,6 +1542,21 @@ void CTextRender::DrawText(CTextCursor *pCursor, vec2 Offset, int Texture, bool
 			Color = rScaled.m_TextColor;
 		}
 
+		float AnchorX = (int)((Anchor.x + LineOffset.x) * ScreenScale.x) / ScreenScale.x; 
+		float AnchorY = (int)((Anchor.y + LineOffset.y) * ScreenScale.y) / ScreenScale.y; 
+		vec2 QuadPosition = vec2(AnchorX, AnchorY) + rScaled.m_Advance + vec2(pGlyph->m_BearingX, pGlyph->m_BearingY) * rScaled.m_Size + Offset / ScreenScale;
+		IGraphics::CQuadItem QuadItem = IGraphics::CQuadItem(QuadPosition.x, QuadPosition.y, pGlyph->m_Width * rScaled.m_Size, pGlyph->m_Height * rScaled.m_Size);
+
+		if(m_Batching)
+		{
+			CBatchQuad Batched;
+			Batched.m_Quad = QuadItem;
+			Batched.m_Color = vec4(Color.r, Color.g, Color.b, Color.a * Alpha);
+			mem_copy(Batched.m_aUvCoords, pGlyph->m_aUvCoords, sizeof(Batched.m_aUvCoords));
+			m_aBatchQuads[Texture].add(Batched);
+			continue;
+		}
+
 		if(Color != LastColor)
 		{
 			Graphics()->SetColor(Color.r, Color.g, Color.b, Color.a * Alpha);
@@ -1190,14 +1564,46 @@ void CTextRender::DrawText(CTextCursor *pCursor, vec2 Offset, int Texture, bool
 		}
 
 		Graphics()->QuadsSetSubset(pGlyph->m_aUvCoords[0], pGlyph->m_aUvCoords[1], pGlyph->m_aUvCoords[2], pGlyph->m_aUvCoords[3]);
-		
-		float AnchorX = (int)((Anchor.x + LineOffset.x) * ScreenScale.x) / ScreenScale.x; 
-		float AnchorY = (int)((Anchor.y + LineOffset.y) * ScreenScale.y) / ScreenScale.y; 
-		vec2 QuadPosition = vec2(AnchorX, AnchorY) + rScaled.m_Advance + vec2(pGlyph->m_BearingX, pGlyph->m_BearingY) * rScaled.m_Size + Offset / ScreenScale;
-		IGraphics::CQuadItem QuadItem = IGraphics::CQuadItem(QuadPosition.x, QuadPosition.y, pGlyph->m_Width * rScaled.m_Size, pGlyph->m_Height * rScaled.m_Size);
 		Graphics()->QuadsDrawTL(&QuadItem, 1);
 	}
-	Graphics()->QuadsEnd();
+	if(!m_Batching)
+		Graphics()->QuadsEnd();
+}
+
+void CTextRender::BeginBatch()
+{
+	m_Batching = true;
+	for(int t = 0; t < 2; t++)
+		m_aBatchQuads[t].set_size(0);
+}
+
+void CTextRender::EndBatch()
+{
+	m_Batching = false;
+
+	// outlines first, so no outline covers a glyph
+	for(int t = 1; t >= 0; t--)
+	{
+		if(!m_aBatchQuads[t].size())
+			continue;
+
+		Graphics()->TextureSet(m_pGlyphMap->GetTexture(t));
+		Graphics()->QuadsBegin();
+		vec4 LastColor = vec4(-1, -1, -1, -1);
+		for(int i = 0; i < m_aBatchQuads[t].size(); i++)
+		{
+			const CBatchQuad &Batched = m_aBatchQuads[t][i];
+			if(Batched.m_Color != LastColor)
+			{
+				Graphics()->SetColor(Batched.m_Color.r, Batched.m_Color.g, Batched.m_Color.b, Batched.m_Color.a);
+				LastColor = Batched.m_Color;
+			}
+			Graphics()->QuadsSetSubset(Batched.m_aUvCoords[0], Batched.m_aUvCoords[1], Batched.m_aUvCoords[2], Batched.m_aUvCoords[3]);
+			Graphics()->QuadsDrawTL(&Batched.m_Quad, 1);
+		}
+		Graphics()->QuadsEnd();
+		m_aBatchQuads[t].set_size(0);
+	}
 }
 
 void CTextRender::TextPlain(CTextCursor *pCursor, const char *pText, int Length)
@@ -36,6 +36,7 @@ struct CGlyph
 	FT_Face m_Face;
 
 	bool m_Rendered;
+	bool m_Pending; // rasterized in the background, not in the atlas yet
 	float m_Width;
 	float m_Height;
 	float m_BearingX;
@@ -81,20 +82,61 @@ class CGlyphMap
 		int m_Access;
 		bool m_IsEmpty;
 
+		// area that changed since the last upload
+		ivec2 m_DirtyMin;
+		ivec2 m_DirtyMax;
+
 		CAtlas() { m_LastFrameAccess = 0; m_Access = 0; }
 		int TrySection(int Index, int Width, int Height);
 		void Init(int Index, int X, int Y, int Width, int Height);
 		ivec2 Add(int Width, int Height);
 	};
 
+	enum
+	{
+		MAX_RASTER_JOBS = 512,
+	};
+
+	// a glyph and its outline rasterized into the atlas at m_Position
+	struct CRasterJob
+	{
+		CGlyph *m_pGlyph;
+		int m_PageID;
+		ivec2 m_Position;
+		int m_GlyphIndex;
+		int m_FontSize;
+		int m_OutlineThickness;
+
+		// the worker renders with its own copy of the face
+		const FT_Byte *m_pFontData;
+		FT_Long m_FontDataSize;
+		FT_Long m_FaceIndex;
+
+		unsigned char *m_apData[2];
+		int m_aWidth[2];
+		int m_aHeight[2];
+		int m_aLeft[2];
+		int m_aTop[2];
+	};
+
+	struct CWorkerFace
+	{
+		const FT_Byte *m_pFontData;
+		FT_Long m_FaceIndex;
+		FT_Face m_Face;
+	};
+
 	IGraphics *m_pGraphics;
 	FT_Stroker m_FtStroker;
+	unsigned char *m_apAtlasData[2];
+	unsigned char *m_pUploadData;
 	IGraphics::CTextureHandle m_aTextures[2];
 	CAtlas m_aAtlasPages[NUM_PAGES_PER_DIM*NUM_PAGES_PER_DIM];
 	int m_ActiveAtlasIndex;
 	sorted_array<CGlyphIndex> m_Glyphs;
 
 	int m_NumTotalPages;
+	unsigned m_NumGlyphMisses;
 
 	FT_Face m_DefaultFace;
 	FT_Face m_VariantFace;
@@ -104,11 +146,32 @@ class CGlyphMap
 	FT_Face m_aFtFaces[MAX_FACES];
 	int m_NumFtFaces;
 
+	// background rasterizer, owns its own freetype library
+	void *m_pWorkerThread;
+	volatile bool m_WorkerShutdown;
+	FT_Library m_WorkerLibrary;
+	FT_Stroker m_WorkerStroker;
+	CWorkerFace m_aWorkerFaces[MAX_FACES];
+	int m_NumWorkerFaces;
+	LOCK m_JobLock;
+	SEMAPHORE m_JobSignal;
+	CRasterJob m_aJobs[MAX_RASTER_JOBS];
+	int m_FirstJob;
+	int m_NumJobs;
+	array<CRasterJob> m_DoneJobs;
+
+	static void WorkerThread(void *pUser);
+	FT_Face WorkerFace(const CRasterJob *pJob);
+	static bool RasterizeGlyph(FT_Face Face, FT_Stroker Stroker, CRasterJob *pJob);
+	void FinishGlyph(CRasterJob *pJob);
+
 	int AdjustOutlineThicknessToFontSize(int OutlineThickness, int FontSize);
 
 	void InitTexture(int Width, int Height);
 	int FitGlyph(int Width, int Height, ivec2 *Position);
-	void UploadGlyph(int TextureIndex, int PosX, int PosY, int Width, int Height, const unsigned char *pData);
+	bool QueueGlyph(const CRasterJob *pJob);
+	void UploadGlyph(int AtlasIndex, int TextureIndex, int PosX, int PosY, int Width, int Height, const unsigned char *pData);
+	void ClearPage(int Index);
 	bool SetFaceByName(FT_Face *pFace, const char *pFamilyName);
 	int GetCharGlyph(int Chr, FT_Face *pFace);
 public:
@@ -128,8 +191,15 @@ public:
 	vec2 Kerning(CGlyph *pLeft, CGlyph *pRight, int PixelSize);
 
 	int NumTotalPages() const { return m_NumTotalPages; }
+	unsigned NumGlyphMisses() const { return m_NumGlyphMisses; }
 	void TouchPage(int Index);
 	void PagesAccessReset();
+
+	// takes the glyphs finished by the worker, call once per frame
+	void UpdateGlyphs();
+	// uploads the changed parts of the atlas pages
+	void FlushUploads();
+	bool CanQueueGlyph();
 };
 
 struct CFontLanguageVariant
@@ -179,10 +249,59 @@ class CTextRender : public IEngineTextRender
 		return Chr >= 0x0020 && Chr <= 0x218F;
 	}
 
+	// laid out texts, keyed by the text and everything that affects the layout.
+	// the glyphs are looked up again when drawing if atlas pages were dropped.
+	enum
+	{
+		LAYOUT_CACHE_SIZE = 512,
+		LAYOUT_CACHE_PROBES = 8,
+		MAX_LAYOUT_TEXT = 256,
+	};
+	struct CLayoutCacheEntry
+	{
+		unsigned m_Hash;
+		int m_Length; // -1 when unused
+		char m_aText[MAX_LAYOUT_TEXT];
+		float m_FontSize;
+		float m_MaxWidth;
+		int m_MaxLines;
+		int m_Flags;
+		float m_LineSpacing;
+		vec2 m_ScreenScale;
+		int m_LastUse;
+
+		// the state of the cursor after the layout
+		float m_Width;
+		float m_Height;
+		bool m_Truncated;
+		int m_LineCount;
+		int m_CharCount;
+		vec2 m_Advance;
+		float m_NextLineAdvanceY;
+		bool m_StartOfLine;
+		int m_PageCount;
+		array<CScaledGlyph> m_Glyphs;
+	};
+	CLayoutCacheEntry *m_paLayoutCache;
+	int m_LayoutCacheFrame;
+
+	static unsigned LayoutHash(const char *pText, int Length);
+	CLayoutCacheEntry *FindLayout(unsigned Hash, const char *pText, int Length, const CTextCursor *pCursor, int MaxLines, vec2 ScreenScale, bool *pFound);
+	void ClearLayoutCache();
+
 	CWordWidthHint MakeWord(CTextCursor *pCursor, const char *pText, const char *pEnd, 
 						int FontSizeIndex, float Size, int PixelSize, vec2 ScreenScale);
 	void TextRefreshGlyphs(CTextCursor *pCursor);
 
+	struct CBatchQuad
+	{
+		IGraphics::CQuadItem m_Quad;
+		vec4 m_Color;
+		float m_aUvCoords[4];
+	};
+	bool m_Batching;
+	array<CBatchQuad> m_aBatchQuads[2];
+
 	void DrawText(CTextCursor *pCursor, vec2 Offset, int Texture, bool IsSecondary, float Alpha, int StartGlyph, int NumGlyphs);
 
 public:
@@ -195,6 +314,7 @@ public:
 
 	void LoadFonts(IStorage *pStorage, IConsole *pConsole);
 	void SetFontLanguageVariant(const char *pLanguageFile);
+	void PrewarmGlyphs(const char *pText, float FontSize);
 
 	void TextColor(float r, float g, float b, float a);
 	void TextSecondaryColor(float r, float g, float b, float a);
@@ -214,7 +334,12 @@ public:
 	void DrawTextOutlined(CTextCursor *pCursor, float Alpha, int StartGlyph, int NumGlyphs);
 	void DrawTextShadowed(CTextCursor *pCursor, vec2 ShadowOffset, float Alpha, int StartGlyph, int NumGlyphs);
 
+	void BeginBatch();
+	void EndBatch();
+
 	vec2 CaretPosition(CTextCursor *pCursor, int NumChars);
+
+	unsigned NumGlyphCacheMisses() const { return m_pGlyphMap->NumGlyphMisses(); }
 };
 
 #endif
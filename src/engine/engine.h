@@ -21,6 +21,7 @@ class IEngine : public IInterface
 
 protected:
 	class CJobPool m_JobPool;
+	class CJobPool *m_pJobPool; // m_JobPool or the one of another engine
 
 public:
 	virtual void Init() = 0;
@@ -28,8 +29,12 @@ public:
 	virtual void QueryNetLogHandles(IOHANDLE *pHDLSend, IOHANDLE *pHDLRecv) = 0;
 	virtual void HostLookup(CHostLookup *pLookup, const char *pHostname, int Nettype) = 0;
 	virtual void AddJob(CJob *pJob, JOBFUNC pfnFunc, void *pData) = 0;
+
+	// for short parallel work, long running jobs go through AddJob
+	CJobPool *JobPool() { return m_pJobPool; }
 };
 
-extern IEngine *CreateEngine(const char *pAppname);
+// an engine with a shared job pool leaves the logging setup to the one that owns it
+extern IEngine *CreateEngine(const char *pAppname, CJobPool *pSharedJobPool = 0);
 
 #endif
@@ -63,6 +63,8 @@ public:
 		TEXLOAD_NOMIPMAPS - Prevents the texture from generating mipmaps
 		TEXLOAD_ARRAY_256 - Texture will be loaded as 3D texture with 16*16 subtiles
 		TEXLOAD_MULTI_DIMENSION - Texture will be loaded as 2D and 3D texture
+		TEXLOAD_ASYNC - The png is decoded in the background and the upload is spread over
+			the next frames, the texture is drawn transparent until then
 	*/
 	enum
 	{
@@ -71,6 +73,7 @@ public:
 		TEXLOAD_ARRAY_256 = 4,
 		TEXLOAD_MULTI_DIMENSION = 8,
 		TEXLOAD_LINEARMIPMAPS = 16,
+		TEXLOAD_ASYNC = 32,
 
 		NUMTILES_DIMENSION = 16,			// number of tiles in each dimension within a texture
 	};
@@ -96,6 +99,20 @@ public:
 		void Invalidate() { m_Id = -1; }
 	};
 
+	class CBufferHandle
+	{
+		friend class IGraphics;
+		int m_Id;
+	public:
+		CBufferHandle()
+		: m_Id(-1)
+		{}
+
+		bool IsValid() const { return Id() >= 0; }
+		int Id() const { return m_Id; }
+		void Invalidate() { m_Id = -1; }
+	};
+
 	int ScreenWidth() const { return m_ScreenWidth; }
 	int ScreenHeight() const { return m_ScreenHeight; }
 	float ScreenAspect() const { return (float)ScreenWidth()/(float)ScreenHeight(); }
@@ -120,6 +137,40 @@ public:
 	virtual void WrapClamp() = 0;
 	virtual void WrapMode(int WrapU, int WrapV) = 0;
 	virtual int MemoryUsage() const = 0;
+	// accumulated time the main thread waited on the render thread, for a full
+	// command buffer queue and for the frames in flight limit
+	virtual void GetStallTimes(int64 *pQueueStall, int64 *pFrameStall) const = 0;
+
+	// what the last swapped frame handed to the render thread
+	struct CFrameStats
+	{
+		int m_CommandBytes;
+		int m_DataBytes;
+		int m_NumDrawCalls;
+		int m_NumTextureBinds;
+	};
+	virtual const CFrameStats *LastFrameStats() const = 0;
+
+	// gpu time of the commands issued after a GpuTimerGroup call goes to that group
+	enum
+	{
+		GPU_GROUP_OTHER=0,
+		GPU_GROUP_MAP,
+		GPU_GROUP_PLAYERS,
+		GPU_GROUP_HUD,
+		NUM_GPU_GROUPS
+	};
+	struct CGpuTimes
+	{
+		int m_NumFrames; // counts the measured frames
+		int m_Frame; // microseconds from the first to the last command of the frame
+		int m_aGroups[NUM_GPU_GROUPS];
+	};
+	// the timer queries are read back a few frames later, without stalling
+	virtual void SetGpuTimers(bool Enable) = 0;
+	virtual void GpuTimerGroup(int Group) = 0;
+	// false if the driver can't time the gpu
+	virtual bool GetGpuTimes(CGpuTimes *pTimes) const = 0;
 
 	virtual int LoadPNG(CImageInfo *pImg, const char *pFilename, int StorageType) = 0;
 
@@ -177,6 +228,108 @@ public:
 	inline void SetColor(const vec4 &Color) { SetColor(Color.r, Color.g, Color.b, Color.a); }
 	virtual void SetColor4(const vec4 &TopLeft, const vec4 &TopRight, const vec4 &BottomLeft, const vec4 &BottomRight) = 0;
 
+	// a quad with everything needed to draw it, filled without the graphics state
+	// so other threads can record them. Quads without m_Draw are left out, that way
+	// recorders can write to fixed slots.
+	struct CRecordedQuad
+	{
+		bool m_Draw;
+		int m_WrapU;
+		int m_WrapV;
+		float m_aTexCoords[8];
+		CColorVertex m_aColors[4];
+		CFreeformItem m_Pos;
+	};
+	// draws the quads in order, between QuadsBegin and QuadsEnd
+	virtual void QuadsDrawRecorded(const CRecordedQuad *pQuads, int Num) = 0;
+
+	/*
+		Struct: CBufferQuad
+			An axis aligned quad of a static buffer with free texture
+			coordinates, the corners go clockwise from the top left.
+	*/
+	struct CBufferQuad
+	{
+		float m_X, m_Y, m_Width, m_Height;
+		float m_aU[4], m_aV[4];
+		int m_TextureIndex;
+	};
+
+	/*
+		Function: CreateQuadBuffer
+			Uploads static quads to the graphics card. Returns an invalid
+			handle when the backend can't keep them, the caller then has
+			to keep drawing the quads itself.
+	*/
+	virtual CBufferHandle CreateQuadBuffer(const CBufferQuad *pQuads, int Num) = 0;
+	virtual void DeleteQuadBuffer(CBufferHandle *pBuffer) = 0;
+
+	/*
+		Function: RenderQuadBuffer
+			Draws a range of quads from a buffer in one color with the
+			current texture, blend mode, clipping and screen mapping.
+			Must not be called between QuadsBegin and QuadsEnd.
+	*/
+	virtual void RenderQuadBuffer(CBufferHandle Buffer, int FirstQuad, int NumQuads, const vec4 &Color) = 0;
+
+	/*
+		Function: LoadTileIndices
+			Uploads the tiles of a tile layer for <RenderTileIndices>, four
+			bytes per tile: the index, then 255 for each of vertical flip,
+			horizontal flip and rotation. Returns an invalid handle when
+			the backend can't draw tile layers with a shader. Unload the
+			texture with <UnloadTexture>.
+	*/
+	virtual CTextureHandle LoadTileIndices(int Width, int Height, const unsigned char *pData) = 0;
+
+	/*
+		Function: RenderTileIndices
+			Draws a whole tile layer in one quad with the current texture as
+			tileset. The layer is extended over its borders like
+			TILERENDERFLAG_EXTEND does when Extend is set.
+	*/
+	virtual void RenderTileIndices(CTextureHandle Indices, int Width, int Height, float Scale, const vec4 &Color, bool Extend) = 0;
+
+	/*
+		Function: CreateRenderTarget
+			Creates an RGBA texture that can be drawn to with <SetRenderTarget>.
+			Returns an invalid handle when the backend can't render offscreen.
+			Unload the texture with <UnloadTexture>.
+	*/
+	virtual CTextureHandle CreateRenderTarget(int Width, int Height) = 0;
+
+	/*
+		Function: SetRenderTarget
+			Draws into the texture instead of the screen until it is called
+			with an invalid handle. The rows of the texture go from the
+			bottom up and its colors have premultiplied alpha.
+	*/
+	virtual void SetRenderTarget(CTextureHandle Target) = 0;
+
+	/*
+		Struct: CQuadInstance
+			A quad centered on its position, rotated around its center.
+			The texture coordinates are the top left and bottom right
+			corners as set by QuadsSetSubset.
+	*/
+	struct CQuadInstance
+	{
+		float m_X, m_Y, m_Width, m_Height;
+		float m_Rotation;
+		float m_aTexCoords[4];
+		float m_R, m_G, m_B, m_A;
+	};
+
+	/*
+		Function: RenderQuadInstances
+			Draws quads that only differ in position, size, rotation,
+			texture coordinates and color in one go with the current
+			texture, blend mode, clipping and screen mapping. The quads
+			are built by the render thread. Must not be called between
+			QuadsBegin and QuadsEnd.
+	*/
+	virtual void RenderQuadInstances(const CQuadInstance *pInstances, int Num) = 0;
+
 	virtual void ReadBackbuffer(unsigned char **ppPixels, int x, int y, int w, int h) = 0;
 	virtual void TakeScreenshot(const char *pFilename) = 0;
 	virtual int GetVideoModes(CVideoMode *pModes, int MaxModes, int Screen) = 0;
@@ -197,6 +350,13 @@ protected:
 		Tex.m_Id = Index;
 		return Tex;
 	}
+
+	inline CBufferHandle CreateBufferHandle(int Index)
+	{
+		CBufferHandle Buffer;
+		Buffer.m_Id = Index;
+		return Buffer;
+	}
 };
 
 class IEngineGraphics : public IGraphics
@@ -20,6 +20,7 @@ public:
 		int m_Key;
 		char m_aText[32];
 		int m_InputCount;
+		int64 m_Time; // when the system saw the event, in time_get() time
 	};
 
 protected:
@@ -79,6 +80,8 @@ public:
 	virtual void MouseModeAbsolute() = 0;
 	virtual int MouseDoubleClick() = 0;
 	virtual bool MouseRelative(float *pX, float *pY) = 0;
+	// takes in the mouse and joystick motion since the last update, the other events wait for Update
+	virtual void UpdateMotion() = 0;
 
 	// clipboard
 	virtual const char* GetClipboardText() = 0;
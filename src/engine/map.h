@@ -24,11 +24,12 @@ class IEngineMap : public IMap
 {
 	MACRO_INTERFACE("enginemap", 0)
 public:
-	virtual bool Load(const char *pMapName, class IStorage *pStorage=0) = 0;
+	virtual bool Load(const char *pMapName, class IStorage *pStorage=0, const SHA256_DIGEST *pKnownSha256=0, unsigned KnownCrc=0) = 0;
 	virtual bool IsLoaded() = 0;
 	virtual void Unload() = 0;
 	virtual SHA256_DIGEST Sha256() = 0;
 	virtual unsigned Crc() = 0;
+	virtual int Version() = 0; // of the datafile format
 };
 
 extern IEngineMap *CreateEngineMap();
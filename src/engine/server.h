@@ -5,6 +5,8 @@
 #include "kernel.h"
 #include "message.h"
 
+#include <engine/shared/protocol.h>
+
 class IServer : public IInterface
 {
 	MACRO_INTERFACE("server", 0)
@@ -34,6 +36,8 @@ public:
 	virtual int GetClientVersion(int ClientID) const = 0;
 
 	virtual int SendMsg(CMsgPacker *pMsg, int Flags, int ClientID) = 0;
+	// sends the message to every client in the mask, packed and queued only once
+	virtual int SendMsgMask(CMsgPacker *pMsg, int Flags, const CClientMask &ClientMask) = 0;
 
 	template<class T>
 	int SendPackMsg(T *pMsg, int Flags, int ClientID)
@@ -44,6 +48,15 @@ public:
 		return SendMsg(&Packer, Flags, ClientID);
 	}
 
+	template<class T>
+	int SendPackMsgMask(T *pMsg, int Flags, const CClientMask &ClientMask)
+	{
+		CMsgPacker Packer(pMsg->MsgID(), false);
+		if(pMsg->Pack(&Packer))
+			return -1;
+		return SendMsgMask(&Packer, Flags, ClientMask);
+	}
+
 	virtual void SetClientName(int ClientID, char const *pName) = 0;
 	virtual void SetClientClan(int ClientID, char const *pClan) = 0;
 	virtual void SetClientCountry(int ClientID, int Country) = 0;
@@ -52,8 +65,11 @@ public:
 	virtual int SnapNewID() = 0;
 	virtual void SnapFreeID(int ID) = 0;
 	virtual void *SnapNewItem(int Type, int ID, int Size) = 0;
+	// items that look the same for all clients in the mask and go into the demo, only valid during IGameServer::OnSnapShared
+	virtual void *SnapNewSharedItem(int Type, int ID, int Size, const CClientMask &ClientMask) = 0;
 
 	virtual void SnapSetStaticsize(int ItemType, int Size) = 0;
+	virtual void SnapSetFieldBits(int ItemType, const unsigned char *pBits, int Num) = 0;
 
 	enum
 	{
@@ -65,9 +81,17 @@ public:
 	virtual bool IsBanned(int ClientID) = 0;
 	virtual void Kick(int ClientID, const char *pReason) = 0;
 	virtual void ChangeMap(const char *pMap) = 0;
+	// gets a map ready on a thread, so changing to it later doesn't stall the game
+	virtual void PreloadMap(const char *pMap) = 0;
 
 	virtual void DemoRecorder_HandleAutoStart() = 0;
 	virtual bool DemoRecorder_IsRecording() = 0;
+
+	// the server info is cached, call this when something it shows changed
+	virtual void ExpireServerInfo() = 0;
+
+	// timing histograms of the main loop, the game adds its own phases
+	virtual class CProfiler *Profiler() = 0;
 };
 
 class IGameServer : public IInterface
@@ -81,9 +105,20 @@ public:
 
 	virtual void OnTick() = 0;
 	virtual void OnPreSnap() = 0;
+	virtual void OnSnapShared() = 0;
 	virtual void OnSnap(int ClientID) = 0;
 	virtual void OnPostSnap() = 0;
 
+	enum
+	{
+		SNAP_PRIORITY_ALWAYS=0x7fffffff,
+	};
+	// how important a changed item is for the client when its bandwidth is low, higher is more important.
+	// items below SNAP_PRIORITY_ALWAYS can be sent later. called from the snapshot threads
+	virtual int OnSnapItemPriority(int ClientID, int Type, int ID, const void *pData, int Size) const = 0;
+	// checks the finished snapshot of a client in debug builds. called from the snapshot threads
+	virtual void OnSnapValidate(int ClientID, const class CSnapshot *pSnap) const = 0;
+
 	virtual void OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID) = 0;
 
 	virtual void OnClientConnected(int ClientID, bool AsSpec) = 0;
@@ -45,7 +45,7 @@ void CRegister::RegisterSendFwcheckresponse(NETADDR *pAddr, TOKEN Token)
 
 void CRegister::RegisterSendHeartbeat(NETADDR Addr)
 {
-	static unsigned char aData[sizeof(SERVERBROWSE_HEARTBEAT) + 2];
+	unsigned char aData[sizeof(SERVERBROWSE_HEARTBEAT) + 2];
 	unsigned short Port = m_pConfig->m_SvPort;
 	CNetChunk Packet;
 
@@ -1,8 +1,11 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 
+#include <algorithm>
+
 #include <base/math.h>
 #include <base/system.h>
+#include <base/tl/array.h>
 
 #include <engine/config.h>
 #include <engine/console.h>
@@ -18,12 +21,17 @@
 #include <engine/shared/demo.h>
 #include <engine/shared/econ.h>
 #include <engine/shared/filecollection.h>
+#include <engine/shared/jobs.h>
+#include <engine/shared/jsonwriter.h>
 #include <engine/shared/mapchecker.h>
 #include <engine/shared/netban.h>
 #include <engine/shared/network.h>
 #include <engine/shared/packer.h>
 #include <engine/shared/protocol.h>
 #include <engine/shared/snapshot.h>
+#include <engine/shared/threadtopology.h>
+
+#include <game/version.h>
 
 #include <mastersrv/mastersrv.h>
 
@@ -35,6 +43,33 @@
 	#include <windows.h>
 #endif
 
+// snapshot builder that SnapNewItem writes to on the current thread
+#if defined(CONF_FAMILY_WINDOWS) && defined(_MSC_VER)
+	static __declspec(thread) CSnapshotBuilder *gs_pSnapBuilder = 0;
+#else
+	static __thread CSnapshotBuilder *gs_pSnapBuilder = 0;
+#endif
+
+// adds the time until it goes out of scope to a cost of a client
+class CClientCostScope
+{
+	int64 *m_pCost;
+	int64 m_Start;
+
+public:
+	CClientCostScope(int64 *pCost) : m_pCost(pCost), m_Start(time_get()) {}
+	~CClientCostScope() { *m_pCost += time_get()-m_Start; }
+
+	// accounts the time from here on to another cost
+	void SetCost(int64 *pCost)
+	{
+		int64 Now = time_get();
+		*m_pCost += Now-m_Start;
+		m_pCost = pCost;
+		m_Start = Now;
+	}
+};
+
 /*static const char *StrLtrim(const char *pStr)
 {
 	while(*pStr && *pStr >= 0 && *pStr <= 32)
@@ -255,17 +290,33 @@ void CServerBan::ConBanExt(IConsole::IResult *pResult, void *pUser)
 void CServer::CClient::Reset()
 {
 	// reset input
-	for(int i = 0; i < 200; i++)
-		m_aInputs[i].m_GameTick = -1;
-	m_CurrentInput = 0;
+	m_Inputs.Reset();
 	mem_zero(&m_LatestInput, sizeof(m_LatestInput));
+	m_NewInput = false;
 
 	m_Snapshots.PurgeAll();
 	m_LastAckedSnapshot = -1;
 	m_LastInputTick = -1;
 	m_SnapRate = CClient::SNAPRATE_INIT;
+	for(int i = 0; i < SNAP_HISTORY; i++)
+		m_aSentSnapTick[i] = -1;
+	m_SentSnapPos = 0;
+	m_NumSentSnaps = 0;
+	m_SentBytes = 0;
+	m_AckedBytes = 0;
+	m_ThroughputStart = time_get();
+	m_SnapBudget = 0;
+	m_NumDeferredItems = 0;
+	m_SnapInterval = 1;
+	m_NextSnapTick = 0;
+	m_MinLatency = -1;
+	m_BaseLatency = -1;
+	m_LastResends = 0;
+	mem_zero(&m_NetStats, sizeof(m_NetStats));
+	mem_zero(&m_NetRates, sizeof(m_NetRates));
 	m_Score = 0;
 	m_MapChunk = 0;
+	m_MapChunksPerRequest = 0;
 }
 
 CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
@@ -276,16 +327,60 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 
 	m_CurrentGameTick = 0;
 	m_RunServer = true;
+	m_RconReentryGuard = 0;
 
 	m_pCurrentMapData = 0;
 	m_CurrentMapSize = 0;
+	m_aPreloadMap[0] = 0;
+	m_pPreloadThread = 0;
+	m_PreloadDone = false;
+	m_PreloadSucceeded = false;
+	m_PreloadedMap.m_pData = 0;
+	m_pMapChunkMsgs = 0;
+	m_MapChunkMsgSize = 0;
+	m_NumMapChunks = 0;
 
 	m_NumMapEntries = 0;
 	m_pFirstMapEntry = 0;
 	m_pLastMapEntry = 0;
 	m_pMapListHeap = 0;
+	m_paRemovedMapNames = 0;
+	m_NumRemovedMapNames = 0;
+	m_MaxRemovedMapNames = 0;
 
 	m_MapReload = false;
+	m_Hibernating = false;
+	m_Overloaded = false;
+	m_NumLateTicks = 0;
+	m_NumLoadTicks = 0;
+	m_MaxTickLateness = 0;
+
+	m_SharedSnapshotBuilder.Init();
+	m_SnappingShared = false;
+	m_NumSnapWorkers = 0;
+	m_pSnapResults = 0;
+	m_pWorldSnap = 0;
+	m_WorldSnapSize = 0;
+	m_NumDeltaCache = 0;
+	m_DeltaCacheLock = 0;
+
+	m_ServerInfoSizeNoPlayers = 0;
+	m_ServerInfoNeedsUpdate = true;
+
+	m_aProfilePhases[PROFILE_FRAME] = m_Profiler.AddPhase("server.frame");
+	m_aProfilePhases[PROFILE_TICK] = m_Profiler.AddPhase("server.tick");
+	m_aProfilePhases[PROFILE_SNAPSHOT] = m_Profiler.AddPhase("server.snapshot");
+	m_aProfilePhases[PROFILE_RCON_UPDATE] = m_Profiler.AddPhase("server.rcon_update");
+	m_aProfilePhases[PROFILE_REGISTER] = m_Profiler.AddPhase("server.register");
+	m_aProfilePhases[PROFILE_NETWORK] = m_Profiler.AddPhase("server.network");
+	m_aProfilePhases[PROFILE_TICK_LATENESS] = m_Profiler.AddPhase("server.tick_lateness");
+	m_LastProfileReport = 0;
+	m_LastNetStatsUpdate = 0;
+	m_LastNetStatsDump = 0;
+	m_LastMetricsUpdate = 0;
+	for(int i = 0; i < NUM_METRICS; i++)
+		m_aMetrics[i] = -1;
+	m_aTraceFilename[0] = 0;
 
 	m_RconClientID = IServer::RCON_CID_SERV;
 	m_RconAuthLevel = AUTHED_ADMIN;
@@ -305,6 +400,7 @@ void CServer::SetClientName(int ClientID, const char *pName)
 	const char *pDefaultName = "(1)";
 	pName = str_utf8_skip_whitespaces(pName);
 	str_utf8_copy_num(m_aClients[ClientID].m_aName, *pName ? pName : pDefaultName, sizeof(m_aClients[ClientID].m_aName), MAX_NAME_LENGTH);
+	ExpireServerInfo();
 }
 
 void CServer::SetClientClan(int ClientID, const char *pClan)
@@ -313,6 +409,7 @@ void CServer::SetClientClan(int ClientID, const char *pClan)
 		return;
 
 	str_utf8_copy_num(m_aClients[ClientID].m_aClan, pClan, sizeof(m_aClients[ClientID].m_aClan), MAX_CLAN_LENGTH);
+	ExpireServerInfo();
 }
 
 void CServer::SetClientCountry(int ClientID, int Country)
@@ -320,6 +417,8 @@ void CServer::SetClientCountry(int ClientID, int Country)
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY)
 		return;
 
+	if(m_aClients[ClientID].m_Country != Country)
+		ExpireServerInfo();
 	m_aClients[ClientID].m_Country = Country;
 }
 
@@ -327,6 +426,8 @@ void CServer::SetClientScore(int ClientID, int Score)
 {
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY)
 		return;
+	if(m_aClients[ClientID].m_Score != Score)
+		ExpireServerInfo();
 	m_aClients[ClientID].m_Score = Score;
 }
 
@@ -374,7 +475,7 @@ int CServer::Init()
 		m_aClients[i].m_aName[0] = 0;
 		m_aClients[i].m_aClan[0] = 0;
 		m_aClients[i].m_Country = -1;
-		m_aClients[i].m_Snapshots.Init();
+		m_aClients[i].m_Snapshots.Init(&m_SnapshotPool);
 	}
 
 	m_CurrentGameTick = 0;
@@ -492,18 +593,38 @@ void CServer::InitRconPasswordIfUnset()
 
 int CServer::SendMsg(CMsgPacker *pMsg, int Flags, int ClientID)
 {
-	CNetChunk Packet;
 	if(!pMsg)
 		return -1;
 
+	if(ClientID == -1)
+	{
+		// broadcast
+		CClientMask Mask;
+		for(int i = 0; i < MAX_CLIENTS; i++)
+			if(m_aClients[i].m_State == CClient::STATE_INGAME)
+				Mask.set(i);
+		return SendMsgMask(pMsg, Flags, Mask);
+	}
+
 	// drop invalid packet
-	if(ClientID != -1 && (ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State == CClient::STATE_EMPTY || m_aClients[ClientID].m_Quitting))
+	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State == CClient::STATE_EMPTY || m_aClients[ClientID].m_Quitting)
 		return 0;
+	return SendMsgMask(pMsg, Flags, CClientMask::one(ClientID));
+}
+
+int CServer::SendMsgMask(CMsgPacker *pMsg, int Flags, const CClientMask &ClientMask)
+{
+	if(!pMsg)
+		return -1;
+	return SendPackedMsg(pMsg->Data(), pMsg->Size(), Flags, ClientMask);
+}
 
+int CServer::SendPackedMsg(const void *pData, int Size, int Flags, const CClientMask &Receivers)
+{
+	CNetChunk Packet;
 	mem_zero(&Packet, sizeof(CNetChunk));
-	Packet.m_ClientID = ClientID;
-	Packet.m_pData = pMsg->Data();
-	Packet.m_DataSize = pMsg->Size();
+	Packet.m_pData = pData;
+	Packet.m_DataSize = Size;
 
 	if(Flags&MSGFLAG_VITAL)
 		Packet.m_Flags |= NETSENDFLAG_VITAL;
@@ -512,47 +633,516 @@ int CServer::SendMsg(CMsgPacker *pMsg, int Flags, int ClientID)
 
 	// write message to demo recorder
 	if(!(Flags&MSGFLAG_NORECORD))
-		m_DemoRecorder.RecordMessage(pMsg->Data(), pMsg->Size());
+		m_DemoRecorder.RecordMessage(pData, Size);
 
-	if(!(Flags&MSGFLAG_NOSEND))
+	if(Flags&MSGFLAG_NOSEND)
+		return 0;
+
+	// drop invalid receivers
+	CClientMask ClientMask = Receivers;
+	int NumReceivers = 0;
+	for(int i = ClientMask.first(); i >= 0; i = ClientMask.next(i))
 	{
-		if(ClientID == -1)
+		if(m_aClients[i].m_State == CClient::STATE_EMPTY || m_aClients[i].m_Quitting)
+			ClientMask.reset(i);
+		else
 		{
-			// broadcast
-			int i;
-			for(i = 0; i < MAX_CLIENTS; i++)
-				if(m_aClients[i].m_State == CClient::STATE_INGAME && !m_aClients[i].m_Quitting)
-				{
-					Packet.m_ClientID = i;
-					m_NetServer.Send(&Packet);
-				}
+			Packet.m_ClientID = i;
+			NumReceivers++;
+		}
+	}
+	if(!NumReceivers)
+		return 0;
+
+	// a single receiver doesn't need the mask
+	if(NumReceivers == 1)
+		m_NetServer.Send(&Packet);
+	else
+		m_NetServer.SendMask(&Packet, ClientMask);
+	return 0;
+}
+
+void CServer::CreateClientSnapshot(int ClientID, CSnapshotBuilder *pBuilder, CSnapshotDelta *pDelta, CSnapResult *pResult)
+{
+	CClient *pClient = &m_aClients[ClientID];
+	CClientCostScope Cost(&pClient->m_aCostTotals[CClient::COST_SNAPSHOTS]);
+	CScratch Scratch;
+	CSnapshot *pData = (CSnapshot *)Scratch.Allocate(CSnapshot::MAX_SIZE);
+	char *pDeltaData = (char *)Scratch.Allocate(CSnapshot::MAX_SIZE);
+	CSnapshot EmptySnap;
+	CSnapshot *pDeltashot = &EmptySnap;
+	int SnapshotSize;
+	int DeltashotSize;
+	int DeltaSize;
+
+	if(pClient->m_Relay)
+	{
+		// relays get the world, the same for all of them
+		mem_copy(pData, m_pWorldSnap, m_WorldSnapSize);
+		SnapshotSize = m_WorldSnapSize;
+		pBuilder->Init(pData);
+	}
+	else
+	{
+		gs_pSnapBuilder = pBuilder;
+		pBuilder->Init();
+
+		GameServer()->OnSnap(ClientID);
+
+		// add the shared items this client can see
+		for(int i = 0; i < m_SharedSnapshotBuilder.NumItems(); i++)
+		{
+			if(!m_aSharedItemMasks[i].test(ClientID))
+				continue;
+			const CSnapshotItem *pItem = m_SharedSnapshotBuilder.GetItem(i);
+			int Size = m_SharedSnapshotBuilder.GetItemSize(i);
+			void *pData = pBuilder->NewItem(pItem->Type(), pItem->ID(), Size);
+			if(!pData)
+				break;
+			mem_copy(pData, pItem->Data(), Size);
+		}
+
+		// finish snapshot
+		SnapshotSize = pBuilder->Finish(pData);
+		gs_pSnapBuilder = 0;
+#if defined(CONF_DEBUG)
+		GameServer()->OnSnapValidate(ClientID, pData);
+#endif
+	}
+
+	// remove old snapshos
+	// keep 3 seconds worth of snapshots
+	pClient->m_Snapshots.PurgeUntil(m_CurrentGameTick-SERVER_TICK_SPEED*3);
+
+	// find snapshot that we can perform delta against
+	EmptySnap.Clear();
+	pResult->m_DeltaTick = -1;
+
+	const CSnapshotHash *pDeltashotHash = 0;
+	DeltashotSize = pClient->m_Snapshots.Get(pClient->m_LastAckedSnapshot, 0, &pDeltashot, 0, &pDeltashotHash);
+	if(DeltashotSize >= 0)
+		pResult->m_DeltaTick = pClient->m_LastAckedSnapshot;
+	else
+	{
+		// no acked package found, force client to recover rate
+		if(pClient->m_SnapRate == CClient::SNAPRATE_FULL)
+			pClient->m_SnapRate = CClient::SNAPRATE_RECOVER;
+		pDeltashot = 0;
+	}
+
+	// hold back the less important changes when the link can't take them all.
+	// the result data isn't used yet and serves as scratch space
+	if(pClient->m_SnapBudget)
+		SnapshotSize = ApplySnapBudget(ClientID, pBuilder, pData, SnapshotSize, pDeltashot, pDeltashotHash, pResult->m_aData);
+	pResult->m_Crc = pData->Crc();
+
+	// save it the snapshot
+	pClient->m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0);
+
+	// reuse the delta of a client that got the same snapshot against the same base
+	CSnapshot *pStored = pClient->m_Snapshots.m_pLast->m_pSnap;
+	const CSnapResult *pCached = FindCachedDelta(pResult->m_DeltaTick, pResult->m_Crc, pStored, SnapshotSize, pDeltashot, DeltashotSize, pClient->m_SnapBitpacked);
+	if(pCached)
+	{
+		pResult->m_Size = pCached->m_Size;
+		pResult->m_pData = pCached->m_pData;
+		return;
+	}
+
+	// create delta and compress it
+	DeltaSize = pDelta->CreateDelta(pDeltashot ? pDeltashot : &EmptySnap, pData, pDeltaData, pDeltashotHash);
+	if(DeltaSize && pClient->m_SnapBitpacked)
+		pResult->m_Size = pDelta->PackBits(pDeltaData, DeltaSize, pResult->m_aData, sizeof(pResult->m_aData));
+	else if(DeltaSize)
+		pResult->m_Size = CVariableInt::Compress(pDeltaData, DeltaSize, pResult->m_aData, sizeof(pResult->m_aData));
+	else
+		pResult->m_Size = 0;
+	pResult->m_pData = pResult->m_aData;
+
+	lock_wait(m_DeltaCacheLock);
+	CDeltaCacheEntry *pEntry = &m_aDeltaCache[m_NumDeltaCache];
+	pEntry->m_DeltaTick = pResult->m_DeltaTick;
+	pEntry->m_Crc = pResult->m_Crc;
+	pEntry->m_SnapshotSize = SnapshotSize;
+	pEntry->m_DeltashotSize = DeltashotSize;
+	pEntry->m_Bitpacked = pClient->m_SnapBitpacked;
+	pEntry->m_pSnapshot = pStored;
+	pEntry->m_pDeltashot = pDeltashot;
+	pEntry->m_pResult = pResult;
+	m_NumDeltaCache++;
+	lock_unlock(m_DeltaCacheLock);
+}
+
+const CServer::CSnapResult *CServer::FindCachedDelta(int DeltaTick, int Crc, const CSnapshot *pSnapshot, int SnapshotSize, const CSnapshot *pDeltashot, int DeltashotSize, bool Bitpacked)
+{
+	// entries below the count are complete and don't change anymore
+	lock_wait(m_DeltaCacheLock);
+	int NumEntries = m_NumDeltaCache;
+	lock_unlock(m_DeltaCacheLock);
+
+	for(int i = 0; i < NumEntries; i++)
+	{
+		const CDeltaCacheEntry *pEntry = &m_aDeltaCache[i];
+		if(pEntry->m_DeltaTick != DeltaTick || pEntry->m_Crc != Crc ||
+			pEntry->m_SnapshotSize != SnapshotSize || pEntry->m_DeltashotSize != DeltashotSize || pEntry->m_Bitpacked != Bitpacked)
+			continue;
+
+		// the crc is only a sum, make sure both snapshots really match.
+		// pooled snapshots that match are the same stored copy
+		if(pEntry->m_pSnapshot != pSnapshot && mem_comp(pEntry->m_pSnapshot, pSnapshot, SnapshotSize) != 0)
+			continue;
+		if(pDeltashot && pEntry->m_pDeltashot != pDeltashot && mem_comp(pEntry->m_pDeltashot, pDeltashot, DeltashotSize) != 0)
+			continue;
+		return pEntry->m_pResult;
+	}
+	return 0;
+}
+
+// bytes of an int after CVariableInt packing
+static int PackedIntSize(int Value)
+{
+	unsigned v = Value < 0 ? ~(unsigned)Value : (unsigned)Value;
+	int Size = 1;
+	for(v >>= 6; v; v >>= 7)
+		Size++;
+	return Size;
+}
+
+struct CBudgetItem
+{
+	int m_Index;
+	int m_Priority;
+	int m_Cost;
+
+	bool operator<(const CBudgetItem &Other) const
+	{
+		if(m_Priority != Other.m_Priority)
+			return m_Priority > Other.m_Priority;
+		return m_Index < Other.m_Index;
+	}
+};
+
+int CServer::ApplySnapBudget(int ClientID, CSnapshotBuilder *pBuilder, CSnapshot *pData, int SnapshotSize, const CSnapshot *pDeltashot, const CSnapshotHash *pDeltashotHash, char *pScratch)
+{
+	CClient *pClient = &m_aClients[ClientID];
+	CScratch Scratch;
+	CBudgetItem *pItems = (CBudgetItem *)Scratch.Allocate(sizeof(CBudgetItem)*CSnapshotBuilder::MAX_ITEMS);
+	int *pBaseIndex = (int *)Scratch.Allocate(sizeof(int)*CSnapshotBuilder::MAX_ITEMS);
+	int NumItems = 0;
+	int Cost = 0;
+
+	// estimate what every changed item adds to the delta
+	const int NumSnapItems = pData->NumItems();
+	for(int i = 0; i < NumSnapItems; i++)
+	{
+		const CSnapshotItem *pItem = pData->GetItem(i);
+		const int Size = pData->GetItemSize(i);
+		const int *pCur = (const int *)pItem->Data();
+		int BaseIndex = -1;
+		if(pDeltashot)
+			BaseIndex = pDeltashotHash ? pDeltashotHash->Find(pItem->Key()) : pDeltashot->GetItemIndex(pItem->Key());
+		if(BaseIndex >= 0 && pDeltashot->GetItemSize(BaseIndex) != Size)
+			BaseIndex = -1;
+		pBaseIndex[i] = BaseIndex;
+
+		int ItemCost = 2;
+		if(BaseIndex >= 0)
+		{
+			const int *pPast = (const int *)pDeltashot->GetItem(BaseIndex)->Data();
+			if(mem_comp(pPast, pCur, Size) == 0)
+				continue;
+			for(int k = 0; k < Size/4; k++)
+				ItemCost += PackedIntSize(pCur[k]-pPast[k]);
+		}
+		else
+		{
+			for(int k = 0; k < Size/4; k++)
+				ItemCost += PackedIntSize(pCur[k]);
+		}
+
+		int Priority = GameServer()->OnSnapItemPriority(ClientID, pItem->Type(), pItem->ID(), pCur, Size);
+		Cost += ItemCost;
+		if(Priority == IGameServer::SNAP_PRIORITY_ALWAYS)
+			continue;
+		pItems[NumItems].m_Index = i;
+		pItems[NumItems].m_Priority = Priority;
+		pItems[NumItems].m_Cost = ItemCost;
+		NumItems++;
+	}
+
+	pClient->m_NumDeferredItems = 0;
+	if(Cost <= pClient->m_SnapBudget || !NumItems)
+		return SnapshotSize;
+
+	// take the most important changes until the budget is used up, the rest
+	// keeps the state the client already has
+	std::sort(pItems, pItems+NumItems);
+	for(int i = 0; i < NumItems; i++)
+		Cost -= pItems[i].m_Cost;
+	bool aDeferred[CSnapshotBuilder::MAX_ITEMS] = {0};
+	int Taken = 0;
+	for(; Taken < NumItems && Cost+pItems[Taken].m_Cost <= pClient->m_SnapBudget; Taken++)
+		Cost += pItems[Taken].m_Cost;
+	for(int i = Taken; i < NumItems; i++)
+		aDeferred[pItems[i].m_Index] = true;
+
+	mem_copy(pScratch, pData, SnapshotSize);
+	const CSnapshot *pFull = (const CSnapshot *)pScratch;
+	pBuilder->Init();
+	int NumDeferred = 0;
+	for(int i = 0; i < NumSnapItems; i++)
+	{
+		const CSnapshotItem *pItem = pFull->GetItem(i);
+		const void *pItemData = pItem->Data();
+		if(aDeferred[i])
+		{
+			NumDeferred++;
+			// new items appear once there is room for them
+			if(pBaseIndex[i] < 0)
+				continue;
+			pItemData = pDeltashot->GetItem(pBaseIndex[i])->Data();
+		}
+		const int Size = pFull->GetItemSize(i);
+		void *pNew = pBuilder->NewItem(pItem->Type(), pItem->ID(), Size);
+		if(!pNew)
+			break;
+		mem_copy(pNew, pItemData, Size);
+	}
+	pClient->m_NumDeferredItems = NumDeferred;
+	return pBuilder->Finish(pData);
+}
+
+void CServer::OnSnapshotAcked(int ClientID)
+{
+	// only the snapshots that made it count, not the lost ones before them
+	CClient *pClient = &m_aClients[ClientID];
+	for(int i = 0; i < CClient::SNAP_HISTORY; i++)
+	{
+		if(pClient->m_aSentSnapTick[i] == pClient->m_LastAckedSnapshot)
+		{
+			pClient->m_AckedBytes += pClient->m_aSentSnapSize[i];
+			pClient->m_aSentSnapTick[i] = -1;
+			break;
+		}
+	}
+}
+
+void CServer::UpdateSnapBudget(int ClientID)
+{
+	CClient *pClient = &m_aClients[ClientID];
+	if(!Config()->m_SvSnapBudget)
+		pClient->m_SnapBudget = 0;
+	else if(pClient->m_NumSentSnaps && pClient->m_SentBytes > MIN_SNAP_BUDGET*pClient->m_NumSentSnaps)
+	{
+		if(pClient->m_AckedBytes < pClient->m_SentBytes*9/10)
+		{
+			// the link falls behind, send a bit less than what got through
+			pClient->m_SnapBudget = max((int)MIN_SNAP_BUDGET, pClient->m_AckedBytes*9/10/pClient->m_NumSentSnaps);
+		}
+		else if(pClient->m_SnapBudget)
+		{
+			// everything got through, try more
+			pClient->m_SnapBudget += pClient->m_SnapBudget/4;
+			if(pClient->m_SnapBudget > 2*pClient->m_SentBytes/pClient->m_NumSentSnaps)
+				pClient->m_SnapBudget = 0;
 		}
+	}
+}
+
+void CServer::UpdateSnapRate(int ClientID)
+{
+	CClient *pClient = &m_aClients[ClientID];
+	unsigned Resends = m_NetServer.ClientResends(ClientID);
+	int NumResends = Resends >= pClient->m_LastResends ? Resends-pClient->m_LastResends : Resends;
+	pClient->m_LastResends = Resends;
+
+	if(!Config()->m_SvSnapAdaptive)
+	{
+		pClient->m_SnapInterval = 1;
+		return;
+	}
+
+	// the lowest latency of a second is the one right after a snapshot arrived, so it
+	// doesn't grow with the interval. the base follows it up slowly to allow for route changes
+	bool Congested = false;
+	if(pClient->m_MinLatency >= 0)
+	{
+		if(pClient->m_BaseLatency < 0 || pClient->m_MinLatency < pClient->m_BaseLatency)
+			pClient->m_BaseLatency = pClient->m_MinLatency;
 		else
-			m_NetServer.Send(&Packet);
+		{
+			Congested = pClient->m_MinLatency - pClient->m_BaseLatency > Config()->m_SvSnapMaxDelay;
+			pClient->m_BaseLatency += (pClient->m_MinLatency - pClient->m_BaseLatency + 7) / 8;
+		}
+	}
+	if(NumResends > Config()->m_SvSnapMaxResends)
+		Congested = true;
+	// the item budget can't shrink any further
+	if(pClient->m_SnapBudget == MIN_SNAP_BUDGET)
+		Congested = true;
+
+	int MaxInterval = max(1, SERVER_TICK_SPEED/Config()->m_SvSnapMinRate);
+	if(Congested)
+		pClient->m_SnapInterval = min(pClient->m_SnapInterval*2, MaxInterval);
+	else if(pClient->m_SnapInterval > 1)
+		pClient->m_SnapInterval--;
+	pClient->m_SnapInterval = min(pClient->m_SnapInterval, MaxInterval);
+	pClient->m_MinLatency = -1;
+}
+
+void CServer::UpdateLinkState(int ClientID)
+{
+	CClient *pClient = &m_aClients[ClientID];
+	int64 Now = time_get();
+	if(Now-pClient->m_ThroughputStart < time_freq())
+		return;
+
+	UpdateSnapBudget(ClientID);
+	UpdateSnapRate(ClientID);
+
+	pClient->m_NumSentSnaps = 0;
+	pClient->m_SentBytes = 0;
+	pClient->m_AckedBytes = 0;
+	pClient->m_ThroughputStart = Now;
+}
+
+void CServer::SendClientSnapshot(int ClientID, const CSnapResult *pResult)
+{
+	CClient *pClient = &m_aClients[ClientID];
+	CClientCostScope Cost(&pClient->m_aCostTotals[CClient::COST_SNAPSHOTS]);
+	pClient->m_aSentSnapTick[pClient->m_SentSnapPos] = m_CurrentGameTick;
+	pClient->m_aSentSnapSize[pClient->m_SentSnapPos] = pResult->m_Size;
+	pClient->m_SentSnapPos = (pClient->m_SentSnapPos+1)%CClient::SNAP_HISTORY;
+	pClient->m_NumSentSnaps++;
+	pClient->m_SentBytes += pResult->m_Size;
+	m_Metrics.Inc(m_aMetrics[METRIC_SNAPSHOT_BYTES], pResult->m_Size);
+	UpdateLinkState(ClientID);
+
+	if(pResult->m_Size)
+	{
+		const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
+		int NumPackets = (pResult->m_Size+MaxSize-1)/MaxSize;
+
+		for(int n = 0, Left = pResult->m_Size; Left > 0; n++)
+		{
+			int Chunk = Left < MaxSize ? Left : MaxSize;
+			Left -= Chunk;
+
+			if(NumPackets == 1)
+			{
+				CMsgPacker Msg(NETMSG_SNAPSINGLE, true);
+				Msg.AddInt(m_CurrentGameTick);
+				Msg.AddInt(m_CurrentGameTick-pResult->m_DeltaTick);
+				Msg.AddInt(pResult->m_Crc);
+				Msg.AddInt(Chunk);
+				Msg.AddRaw(&pResult->m_pData[n*MaxSize], Chunk);
+				SendMsg(&Msg, 0, ClientID);
+			}
+			else
+			{
+				CMsgPacker Msg(NETMSG_SNAP, true);
+				Msg.AddInt(m_CurrentGameTick);
+				Msg.AddInt(m_CurrentGameTick-pResult->m_DeltaTick);
+				Msg.AddInt(NumPackets);
+				Msg.AddInt(n);
+				Msg.AddInt(pResult->m_Crc);
+				Msg.AddInt(Chunk);
+				Msg.AddRaw(&pResult->m_pData[n*MaxSize], Chunk);
+				SendMsg(&Msg, 0, ClientID);
+			}
+		}
+	}
+	else
+	{
+		CMsgPacker Msg(NETMSG_SNAPEMPTY, true);
+		Msg.AddInt(m_CurrentGameTick);
+		Msg.AddInt(m_CurrentGameTick-pResult->m_DeltaTick);
+		SendMsg(&Msg, 0, ClientID);
+	}
+}
+
+int CServer::SnapWorkerThread(void *pUser)
+{
+	CSnapWorker *pWorker = (CSnapWorker *)pUser;
+	CServer *pThis = pWorker->m_pServer;
+	CTraceScope TraceScope("SnapWorker");
+	for(int i = 0; i < pWorker->m_NumClients; i++)
+	{
+		int ClientID = pWorker->m_aClients[i];
+		pThis->CreateClientSnapshot(ClientID, &pWorker->m_Builder, &pWorker->m_Delta, &pThis->m_pSnapResults[ClientID]);
 	}
 	return 0;
 }
 
-void CServer::DoSnapshot()
+void CServer::StartSnapWorkers(int NumThreads)
 {
-	GameServer()->OnPreSnap();
+	m_pSnapResults = new CSnapResult[MAX_CLIENTS];
+	m_pWorldSnap = (CSnapshot *)mem_alloc(CSnapshot::MAX_SIZE, 1);
+	m_DeltaCacheLock = lock_create();
+
+	m_NumSnapWorkers = clamp(NumThreads, 0, (int)MAX_SNAP_THREADS);
+	if(!m_NumSnapWorkers)
+		return;
 
-	// create snapshot for demo recording
-	if(m_DemoRecorder.IsRecording())
+	for(int i = 0; i < m_NumSnapWorkers; i++)
 	{
-		char aData[CSnapshot::MAX_SIZE];
-		int SnapshotSize;
+		m_apSnapWorkers[i] = new CSnapWorker;
+		m_apSnapWorkers[i]->m_pServer = this;
+		m_apSnapWorkers[i]->m_NumClients = 0;
+	}
+	m_SnapJobPool.Init(m_NumSnapWorkers);
+}
 
-		// build snap and possibly add some messages
-		m_SnapshotBuilder.Init();
-		GameServer()->OnSnap(-1);
-		SnapshotSize = m_SnapshotBuilder.Finish(aData);
+void CServer::StopSnapWorkers()
+{
+	for(int i = 0; i < m_NumSnapWorkers; i++)
+	{
+		delete m_apSnapWorkers[i];
+		m_apSnapWorkers[i] = 0;
+	}
+	m_NumSnapWorkers = 0;
+	delete[] m_pSnapResults;
+	m_pSnapResults = 0;
+	if(m_pWorldSnap)
+		mem_free(m_pWorldSnap);
+	m_pWorldSnap = 0;
+	if(m_DeltaCacheLock)
+		lock_destroy(m_DeltaCacheLock);
+	m_DeltaCacheLock = 0;
+}
 
-		// write snapshot
-		m_DemoRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
+void CServer::ApplyInputs()
+{
+	// all inputs that arrived since the last tick, in one go
+	for(int c = 0; c < MAX_CLIENTS; c++)
+	{
+		CClient *pClient = &m_aClients[c];
+		if(pClient->m_State != CClient::STATE_INGAME)
+		{
+			pClient->m_NewInput = false;
+			continue;
+		}
+
+		if(pClient->m_NewInput)
+		{
+			GameServer()->OnClientDirectInput(c, pClient->m_LatestInput.m_aData);
+			pClient->m_NewInput = false;
+		}
+
+		const int *pInput = pClient->m_Inputs.Get(Tick());
+		if(pInput)
+			GameServer()->OnClientPredictedInput(c, (void *)pInput);
 	}
+}
+
+void CServer::DoSnapshot()
+{
+	GameServer()->OnPreSnap();
 
-	// create snapshots for all clients
+	// collect the clients that get a snapshot this tick
+	int aClients[MAX_CLIENTS];
+	int NumClients = 0;
+	int NumRelays = 0;
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
 		// client must be ingame to receive snapshots
@@ -567,102 +1157,97 @@ void CServer::DoSnapshot()
 		if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_INIT && (Tick()%10) != 0)
 			continue;
 
-		{
-			char aData[CSnapshot::MAX_SIZE];
-			CSnapshot *pData = (CSnapshot*)aData;	// Fix compiler warning for strict-aliasing
-			char aDeltaData[CSnapshot::MAX_SIZE];
-			char aCompData[CSnapshot::MAX_SIZE];
-			int SnapshotSize;
-			int Crc;
-			static CSnapshot EmptySnap;
-			CSnapshot *pDeltashot = &EmptySnap;
-			int DeltashotSize;
-			int DeltaTick = -1;
-			int DeltaSize;
-
-			m_SnapshotBuilder.Init();
+		// this client's link can't take every snapshot
+		if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_FULL && Tick() < m_aClients[i].m_NextSnapTick)
+			continue;
 
-			GameServer()->OnSnap(i);
+		// spectators are the first to get fewer snapshots while the server can't keep up
+		if(m_Overloaded && (Tick()%OVERLOAD_SNAP_INTERVAL) != 0 && GameServer()->IsClientSpectator(i))
+			continue;
+		m_aClients[i].m_NextSnapTick = Tick()+m_aClients[i].m_SnapInterval;
 
-			// finish snapshot
-			SnapshotSize = m_SnapshotBuilder.Finish(pData);
-			Crc = pData->Crc();
+		aClients[NumClients++] = i;
+		if(m_aClients[i].m_Relay)
+			NumRelays++;
+	}
 
-			// remove old snapshos
-			// keep 3 seconds worth of snapshots
-			m_aClients[i].m_Snapshots.PurgeUntil(m_CurrentGameTick-SERVER_TICK_SPEED*3);
+	m_NumDeltaCache = 0;
 
-			// save it the snapshot
-			m_aClients[i].m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0);
+	// build the items that are the same for several clients once
+	m_SharedSnapshotBuilder.Init();
+	if(NumClients || m_DemoRecorder.IsRecording())
+	{
+		m_SnappingShared = true;
+		GameServer()->OnSnapShared();
+		m_SnappingShared = false;
+	}
 
-			// find snapshot that we can perform delta against
-			EmptySnap.Clear();
+	// create the world snapshot for demo recording and relays, the demo can do with fewer while overloaded
+	bool RecordDemo = m_DemoRecorder.IsRecording() && (!m_Overloaded || (Tick()%OVERLOAD_SNAP_INTERVAL) == 0);
+	if(RecordDemo || NumRelays)
+	{
+		// build snap and possibly add some messages
+		m_SnapshotBuilder.Init();
+		GameServer()->OnSnap(-1);
 
-			{
-				DeltashotSize = m_aClients[i].m_Snapshots.Get(m_aClients[i].m_LastAckedSnapshot, 0, &pDeltashot, 0);
-				if(DeltashotSize >= 0)
-					DeltaTick = m_aClients[i].m_LastAckedSnapshot;
-				else
-				{
-					// no acked package found, force client to recover rate
-					if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_FULL)
-						m_aClients[i].m_SnapRate = CClient::SNAPRATE_RECOVER;
-				}
-			}
+		// the demo gets all shared items, unless it has its own version of them
+		for(int i = 0; i < m_SharedSnapshotBuilder.NumItems(); i++)
+		{
+			const CSnapshotItem *pItem = m_SharedSnapshotBuilder.GetItem(i);
+			if(m_SnapshotBuilder.GetItemData(pItem->Key()))
+				continue;
+			int Size = m_SharedSnapshotBuilder.GetItemSize(i);
+			void *pData = m_SnapshotBuilder.NewItem(pItem->Type(), pItem->ID(), Size);
+			if(!pData)
+				break;
+			mem_copy(pData, pItem->Data(), Size);
+		}
+		m_WorldSnapSize = m_SnapshotBuilder.Finish(m_pWorldSnap);
 
-			// create delta
-			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
+		// write snapshot
+		if(RecordDemo)
+			m_DemoRecorder.RecordSnapshot(Tick(), m_pWorldSnap, m_WorldSnapSize);
+	}
 
-			if(DeltaSize)
+	if(m_NumSnapWorkers && NumClients > 1)
+	{
+		// share the clients between the workers and this thread
+		int NumShares = min(m_NumSnapWorkers+1, NumClients);
+		for(int w = 0; w < NumShares-1; w++)
+			m_apSnapWorkers[w]->m_NumClients = 0;
+		for(int i = 0; i < NumClients; i++)
+		{
+			if(i%NumShares < NumShares-1)
 			{
-				// compress it
-				int SnapshotSize;
-				const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
-				int NumPackets;
+				CSnapWorker *pWorker = m_apSnapWorkers[i%NumShares];
+				pWorker->m_aClients[pWorker->m_NumClients++] = aClients[i];
+			}
+		}
+		for(int w = 0; w < NumShares-1; w++)
+			m_SnapJobPool.Add(&m_apSnapWorkers[w]->m_Job, SnapWorkerThread, m_apSnapWorkers[w], CJobPool::PRIORITY_HIGH, &m_SnapJobGroup);
 
-				SnapshotSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData, sizeof(aCompData));
-				NumPackets = (SnapshotSize+MaxSize-1)/MaxSize;
+		for(int i = NumShares-1; i < NumClients; i += NumShares)
+			CreateClientSnapshot(aClients[i], &m_SnapshotBuilder, &m_SnapshotDelta, &m_pSnapResults[aClients[i]]);
 
-				for(int n = 0, Left = SnapshotSize; Left > 0; n++)
-				{
-					int Chunk = Left < MaxSize ? Left : MaxSize;
-					Left -= Chunk;
+		m_SnapJobPool.Wait(&m_SnapJobGroup);
 
-					if(NumPackets == 1)
-					{
-						CMsgPacker Msg(NETMSG_SNAPSINGLE, true);
-						Msg.AddInt(m_CurrentGameTick);
-						Msg.AddInt(m_CurrentGameTick-DeltaTick);
-						Msg.AddInt(Crc);
-						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
-						SendMsg(&Msg, MSGFLAG_FLUSH, i);
-					}
-					else
-					{
-						CMsgPacker Msg(NETMSG_SNAP, true);
-						Msg.AddInt(m_CurrentGameTick);
-						Msg.AddInt(m_CurrentGameTick-DeltaTick);
-						Msg.AddInt(NumPackets);
-						Msg.AddInt(n);
-						Msg.AddInt(Crc);
-						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
-						SendMsg(&Msg, MSGFLAG_FLUSH, i);
-					}
-				}
-			}
-			else
-			{
-				CMsgPacker Msg(NETMSG_SNAPEMPTY, true);
-				Msg.AddInt(m_CurrentGameTick);
-				Msg.AddInt(m_CurrentGameTick-DeltaTick);
-				SendMsg(&Msg, MSGFLAG_FLUSH, i);
-			}
+		// sending isn't thread safe, do it in client order
+		for(int i = 0; i < NumClients; i++)
+			SendClientSnapshot(aClients[i], &m_pSnapResults[aClients[i]]);
+	}
+	else
+	{
+		for(int i = 0; i < NumClients; i++)
+		{
+			CreateClientSnapshot(aClients[i], &m_SnapshotBuilder, &m_SnapshotDelta, &m_pSnapResults[aClients[i]]);
+			SendClientSnapshot(aClients[i], &m_pSnapResults[aClients[i]]);
 		}
 	}
 
 	GameServer()->OnPostSnap();
+
+	// the snapshot parts were queued with the messages of the tick, send them all at once
+	m_NetServer.Flush();
 }
 
 
@@ -677,15 +1262,23 @@ int CServer::NewClientCallback(int ClientID, void *pUser)
 	}
 
 	pThis->m_aClients[ClientID].m_State = CClient::STATE_AUTH;
+	pThis->ExpireServerInfo();
 	pThis->m_aClients[ClientID].m_aName[0] = 0;
 	pThis->m_aClients[ClientID].m_aClan[0] = 0;
 	pThis->m_aClients[ClientID].m_Country = -1;
+	pThis->m_aClients[ClientID].m_Capabilities = 0;
+	pThis->m_aClients[ClientID].m_SnapBitpacked = false;
+	pThis->m_aClients[ClientID].m_Relay = false;
 	pThis->m_aClients[ClientID].m_Authed = AUTHED_NO;
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 	pThis->m_aClients[ClientID].m_pMapListEntryToSend = 0;
+	pThis->m_aClients[ClientID].m_MapListSubscribed = false;
 	pThis->m_aClients[ClientID].m_NoRconNote = false;
 	pThis->m_aClients[ClientID].m_Quitting = false;
+	mem_zero(pThis->m_aClients[ClientID].m_aCostTotals, sizeof(pThis->m_aClients[ClientID].m_aCostTotals));
+	mem_zero(pThis->m_aClients[ClientID].m_aCostLast, sizeof(pThis->m_aClients[ClientID].m_aCostLast));
+	mem_zero(pThis->m_aClients[ClientID].m_aCostRates, sizeof(pThis->m_aClients[ClientID].m_aCostRates));
 	pThis->m_aClients[ClientID].Reset();
 
 	return 0;
@@ -709,6 +1302,7 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser)
 	}
 
 	pThis->m_aClients[ClientID].m_State = CClient::STATE_EMPTY;
+	pThis->ExpireServerInfo();
 	pThis->m_aClients[ClientID].m_aName[0] = 0;
 	pThis->m_aClients[ClientID].m_aClan[0] = 0;
 	pThis->m_aClients[ClientID].m_Country = -1;
@@ -716,24 +1310,100 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser)
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 	pThis->m_aClients[ClientID].m_pMapListEntryToSend = 0;
+	pThis->m_aClients[ClientID].m_MapListSubscribed = false;
 	pThis->m_aClients[ClientID].m_NoRconNote = false;
 	pThis->m_aClients[ClientID].m_Quitting = false;
 	pThis->m_aClients[ClientID].m_Snapshots.PurgeAll();
 	return 0;
 }
 
+void CServer::PackMapChunks()
+{
+	CMsgPacker Header(NETMSG_MAP_DATA, true);
+	m_MapChunkMsgSize = Header.Size() + MAP_CHUNK_SIZE;
+	m_NumMapChunks = (m_CurrentMapSize + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+	if(m_pMapChunkMsgs)
+		mem_free(m_pMapChunkMsgs);
+	m_pMapChunkMsgs = (unsigned char *)mem_alloc_tag(max(m_NumMapChunks*m_MapChunkMsgSize, 1), 1, MEMTAG_MAP);
+	for(int i = 0; i < m_NumMapChunks; i++)
+	{
+		int Offset = i*MAP_CHUNK_SIZE;
+		unsigned char *pMsg = m_pMapChunkMsgs + i*m_MapChunkMsgSize;
+		mem_copy(pMsg, Header.Data(), Header.Size());
+		mem_copy(pMsg + Header.Size(), m_pCurrentMapData + Offset, min((int)MAP_CHUNK_SIZE, m_CurrentMapSize-Offset));
+	}
+}
+
+int CServer::MapChunksPerRequest(int ClientID)
+{
+	// keep about as much data in flight as the connection delivers per round trip.
+	// the client counts the chunks, so a download keeps the window it started with
+	int Window = Config()->m_SvMapDownloadSpeed;
+	CNetConnStats Stats;
+	m_NetServer.ClientStats(ClientID, &Stats);
+	if(Config()->m_SvMapDownloadAdaptive && Stats.m_Rtt > MAP_WINDOW_RTT)
+		Window = Window*Stats.m_Rtt/MAP_WINDOW_RTT;
+	// a big window on a lossy link only gets more resends
+	if(Config()->m_SvMapDownloadAdaptive && Stats.m_Resends*10 > Stats.m_SentPackets)
+		Window /= 2;
+	return clamp(Window, 1, (int)MAX_MAP_CHUNKS_PER_REQUEST);
+}
+
 void CServer::SendMap(int ClientID)
 {
+	m_aClients[ClientID].m_MapChunksPerRequest = MapChunksPerRequest(ClientID);
+
 	CMsgPacker Msg(NETMSG_MAP_CHANGE, true);
 	Msg.AddString(GetMapName(), 0);
 	Msg.AddInt(m_CurrentMapCrc);
 	Msg.AddInt(m_CurrentMapSize);
-	Msg.AddInt(m_MapChunksPerRequest);
+	Msg.AddInt(m_aClients[ClientID].m_MapChunksPerRequest);
 	Msg.AddInt(MAP_CHUNK_SIZE);
 	Msg.AddRaw(&m_CurrentMapSha256, sizeof(m_CurrentMapSha256));
+	// old clients stop reading before these. the url can be empty, clients
+	// that know about it can get the map from there instead
+	Msg.AddString(Config()->m_SvMapDownloadUrl, 0);
+	Msg.AddInt(1); // requests can name the first chunk and the window, to resume downloads
 	SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID);
 }
 
+void CServer::SendMapPrefetch(int ClientID)
+{
+	if(!(m_aClients[ClientID].m_Capabilities&CLIENTCAP_MAP_PREFETCH))
+		return;
+
+	CMsgPacker Msg(NETMSG_MAP_PREFETCH, true);
+	Msg.AddString(m_aPreloadMap, 0);
+	Msg.AddInt(m_PreloadedMap.m_Crc);
+	Msg.AddInt(m_PreloadedMap.m_Size);
+	Msg.AddInt(MAP_PREFETCH_CHUNK_SIZE);
+	Msg.AddRaw(&m_PreloadedMap.m_Sha256, sizeof(m_PreloadedMap.m_Sha256));
+	SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, ClientID);
+}
+
+void CServer::SendMapData(int ClientID)
+{
+	// the chunks are packed once per map, the network copies them into its resend buffer
+	for(int i = 0; i < m_aClients[ClientID].m_MapChunksPerRequest && m_aClients[ClientID].m_MapChunk >= 0; ++i)
+	{
+		int Chunk = m_aClients[ClientID].m_MapChunk;
+		if(Chunk >= m_NumMapChunks-1)
+			m_aClients[ClientID].m_MapChunk = -1;
+		else
+			m_aClients[ClientID].m_MapChunk++;
+
+		int Size = Chunk == m_NumMapChunks-1 ? m_CurrentMapSize-Chunk*MAP_CHUNK_SIZE + m_MapChunkMsgSize-MAP_CHUNK_SIZE : m_MapChunkMsgSize;
+		SendPackedMsg(m_pMapChunkMsgs + Chunk*m_MapChunkMsgSize, Size, MSGFLAG_VITAL|MSGFLAG_FLUSH|MSGFLAG_NORECORD, CClientMask::one(ClientID));
+
+		if(Config()->m_Debug)
+		{
+			char aBuf[64];
+			str_format(aBuf, sizeof(aBuf), "sending chunk %d with size %d", Chunk, Size-(m_MapChunkMsgSize-MAP_CHUNK_SIZE));
+			Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
+		}
+	}
+}
+
 void CServer::SendConnectionReady(int ClientID)
 {
 	CMsgPacker Msg(NETMSG_CON_READY, true);
@@ -750,11 +1420,10 @@ void CServer::SendRconLine(int ClientID, const char *pLine)
 void CServer::SendRconLineAuthed(const char *pLine, void *pUser, bool Highlighted)
 {
 	CServer *pThis = (CServer *)pUser;
-	static volatile int ReentryGuard = 0;
 	int i;
 
-	if(ReentryGuard) return;
-	ReentryGuard++;
+	if(pThis->m_RconReentryGuard) return;
+	pThis->m_RconReentryGuard++;
 
 	for(i = 0; i < MAX_CLIENTS; i++)
 	{
@@ -762,7 +1431,7 @@ void CServer::SendRconLineAuthed(const char *pLine, void *pUser, bool Highlighte
 			pThis->SendRconLine(i, pLine);
 	}
 
-	ReentryGuard--;
+	pThis->m_RconReentryGuard--;
 }
 
 void CServer::SendRconCmdAdd(const IConsole::CCommandInfo *pCommandInfo, int ClientID)
@@ -785,8 +1454,9 @@ void CServer::UpdateClientRconCommands()
 {
 	for(int ClientID = Tick() % MAX_RCONCMD_RATIO; ClientID < MAX_CLIENTS; ClientID += MAX_RCONCMD_RATIO)
 	{
-		if(m_aClients[ClientID].m_State != CClient::STATE_EMPTY && m_aClients[ClientID].m_Authed)
+		if(m_aClients[ClientID].m_State != CClient::STATE_EMPTY && m_aClients[ClientID].m_Authed && m_aClients[ClientID].m_pRconCmdToSend)
 		{
+			CClientCostScope Cost(&m_aClients[ClientID].m_aCostTotals[CClient::COST_RCON]);
 			int ConsoleAccessLevel = m_aClients[ClientID].m_Authed == AUTHED_ADMIN ? IConsole::ACCESS_LEVEL_ADMIN : IConsole::ACCESS_LEVEL_MOD;
 			for(int i = 0; i < MAX_RCONCMD_SEND && m_aClients[ClientID].m_pRconCmdToSend; ++i)
 			{
@@ -804,24 +1474,85 @@ void CServer::SendMapListEntryAdd(const CMapListEntry *pMapListEntry, int Client
 	SendMsg(&Msg, MSGFLAG_VITAL, ClientID);
 }
 
-void CServer::SendMapListEntryRem(const CMapListEntry *pMapListEntry, int ClientID)
+void CServer::SendMapListEntryRem(const char *pName, int ClientID)
 {
 	CMsgPacker Msg(NETMSG_MAPLIST_ENTRY_REM, true);
-	Msg.AddString(pMapListEntry->m_aName, 256);
+	Msg.AddString(pName, 256);
+	SendMsg(&Msg, MSGFLAG_VITAL, ClientID);
+}
+
+void CServer::SendMapListAddBatch(int ClientID)
+{
+	// count the entries fitting into the batch first, the count leads the message
+	int Num = 0;
+	int Size = 0;
+	for(const CMapListEntry *pEntry = m_aClients[ClientID].m_pMapListEntryToSend; pEntry && (Num == 0 || Size < MAPLIST_BATCH_SIZE); pEntry = pEntry->m_pNext)
+	{
+		Size += str_length(pEntry->m_aName)+1;
+		Num++;
+	}
+
+	CMsgPacker Msg(NETMSG_MAPLIST_ENTRIES_ADD, true);
+	Msg.AddInt(Num);
+	for(int i = 0; i < Num; i++)
+	{
+		Msg.AddString(m_aClients[ClientID].m_pMapListEntryToSend->m_aName, 256);
+		m_aClients[ClientID].m_pMapListEntryToSend = m_aClients[ClientID].m_pMapListEntryToSend->m_pNext;
+	}
+	SendMsg(&Msg, MSGFLAG_VITAL, ClientID);
+}
+
+void CServer::SendMapListRemBatch(int ClientID)
+{
+	int First = m_aClients[ClientID].m_MapListRemovedToSend;
+	int Num = 0;
+	int Size = 0;
+	while(First+Num < m_NumRemovedMapNames && (Num == 0 || Size < MAPLIST_BATCH_SIZE))
+		Size += str_length(m_paRemovedMapNames[First+Num++])+1;
+
+	CMsgPacker Msg(NETMSG_MAPLIST_ENTRIES_REM, true);
+	Msg.AddInt(Num);
+	for(int i = 0; i < Num; i++)
+		Msg.AddString(m_paRemovedMapNames[First+i], 256);
 	SendMsg(&Msg, MSGFLAG_VITAL, ClientID);
+	m_aClients[ClientID].m_MapListRemovedToSend += Num;
 }
 
+void CServer::SubscribeMapList(int ClientID)
+{
+	// the full list is sent, earlier removals do not concern the client
+	m_aClients[ClientID].m_MapListSubscribed = true;
+	m_aClients[ClientID].m_pMapListEntryToSend = m_pFirstMapEntry;
+	m_aClients[ClientID].m_MapListRemovedToSend = m_NumRemovedMapNames;
+}
 
 void CServer::UpdateClientMapListEntries()
 {
 	for(int ClientID = Tick() % MAX_RCONCMD_RATIO; ClientID < MAX_CLIENTS; ClientID += MAX_RCONCMD_RATIO)
 	{
-		if(m_aClients[ClientID].m_State != CClient::STATE_EMPTY && m_aClients[ClientID].m_Authed)
+		CClient *pClient = &m_aClients[ClientID];
+		if(pClient->m_State == CClient::STATE_EMPTY || !pClient->m_Authed || !pClient->m_MapListSubscribed)
+			continue;
+		CClientCostScope Cost(&pClient->m_aCostTotals[CClient::COST_MAPLIST]);
+
+		// removals go first so a name removed and added again ends up registered
+		if(pClient->m_Capabilities&CLIENTCAP_MAPLIST_BATCH)
+		{
+			int i = 0;
+			for(; i < MAX_MAPLIST_BATCH_SEND && pClient->m_MapListRemovedToSend < m_NumRemovedMapNames; ++i)
+				SendMapListRemBatch(ClientID);
+			for(; i < MAX_MAPLIST_BATCH_SEND && pClient->m_pMapListEntryToSend; ++i)
+				SendMapListAddBatch(ClientID);
+		}
+		else
 		{
-			for(int i = 0; i < MAX_MAPLISTENTRY_SEND && m_aClients[ClientID].m_pMapListEntryToSend; ++i)
+			int i = 0;
+			for(; i < MAX_MAPLISTENTRY_SEND && pClient->m_MapListRemovedToSend < m_NumRemovedMapNames; ++i)
+				SendMapListEntryRem(m_paRemovedMapNames[pClient->m_MapListRemovedToSend++], ClientID);
+			for(; i < MAX_MAPLISTENTRY_SEND && pClient->m_pMapListEntryToSend; ++i)
 			{
-				SendMapListEntryAdd(m_aClients[ClientID].m_pMapListEntryToSend, ClientID);
-				m_aClients[ClientID].m_pMapListEntryToSend = m_aClients[ClientID].m_pMapListEntryToSend->m_pNext;
+				SendMapListEntryAdd(pClient->m_pMapListEntryToSend, ClientID);
+				pClient->m_pMapListEntryToSend = pClient->m_pMapListEntryToSend->m_pNext;
 			}
 		}
 	}
@@ -830,6 +1561,7 @@ void CServer::UpdateClientMapListEntries()
 void CServer::ProcessClientPacket(CNetChunk *pPacket)
 {
 	int ClientID = pPacket->m_ClientID;
+	CClientCostScope Cost(&m_aClients[ClientID].m_aCostTotals[CClient::COST_MESSAGES]);
 	CUnpacker Unpacker;
 	Unpacker.Reset(pPacket->m_pData, pPacket->m_DataSize);
 
@@ -859,16 +1591,42 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				}
 
 				const char *pPassword = Unpacker.GetString(CUnpacker::SANITIZE_CC);
-				if(Config()->m_Password[0] != 0 && str_comp(Config()->m_Password, pPassword) != 0)
+				m_aClients[ClientID].m_Version = Unpacker.GetInt();
+				// older clients end the message here
+				m_aClients[ClientID].m_Capabilities = Unpacker.GetInt();
+				if(Unpacker.Error())
+					m_aClients[ClientID].m_Capabilities = 0;
+
+				// relays log in with their own password and join as spectators
+				m_aClients[ClientID].m_Relay = (m_aClients[ClientID].m_Capabilities&CLIENTCAP_RELAY) &&
+					Config()->m_SvRelayPassword[0] && str_comp(Config()->m_SvRelayPassword, pPassword) == 0;
+				if(!m_aClients[ClientID].m_Relay && Config()->m_Password[0] != 0 && str_comp(Config()->m_Password, pPassword) != 0)
 				{
 					// wrong password
 					m_NetServer.Drop(ClientID, "Wrong password");
 					return;
 				}
+				if(m_aClients[ClientID].m_Capabilities&CLIENTCAP_SNAP_BITPACKED)
+				{
+					// only if the client packs the items the same way
+					unsigned FieldBitsHash = (unsigned)Unpacker.GetInt();
+					if(!Unpacker.Error() && FieldBitsHash == m_SnapshotDelta.FieldBitsHash() && Config()->m_SvSnapBitpack)
+					{
+						m_aClients[ClientID].m_SnapBitpacked = true;
+						CMsgPacker Msg(NETMSG_SNAP_BITPACKED, true);
+						SendMsg(&Msg, MSGFLAG_VITAL, ClientID);
+					}
+				}
 
-				m_aClients[ClientID].m_Version = Unpacker.GetInt();
-
-				m_aClients[ClientID].m_State = CClient::STATE_CONNECTING;
+				m_aClients[ClientID].m_State = m_aClients[ClientID].m_Relay ? CClient::STATE_CONNECTING_AS_SPEC : CClient::STATE_CONNECTING;
+				if(m_aClients[ClientID].m_Relay)
+				{
+					char aAddrStr[NETADDR_MAXSTRSIZE];
+					net_addr_str(m_NetServer.ClientAddr(ClientID), aAddrStr, sizeof(aAddrStr), true);
+					char aBuf[128];
+					str_format(aBuf, sizeof(aBuf), "relay connected. ClientID=%d addr=%s", ClientID, aAddrStr);
+					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+				}
 				SendMap(ClientID);
 			}
 		}
@@ -876,34 +1634,15 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 		{
 			if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && (m_aClients[ClientID].m_State == CClient::STATE_CONNECTING || m_aClients[ClientID].m_State == CClient::STATE_CONNECTING_AS_SPEC))
 			{
-				int ChunkSize = MAP_CHUNK_SIZE;
-
-				// send map chunks
-				for(int i = 0; i < m_MapChunksPerRequest && m_aClients[ClientID].m_MapChunk >= 0; ++i)
+				// newer clients say where to go on, older ones rely on the count of the server
+				int Chunk = Unpacker.GetInt();
+				int NumChunks = Unpacker.GetInt();
+				if(!Unpacker.Error() && Chunk >= 0 && Chunk < m_NumMapChunks)
 				{
-					int Chunk = m_aClients[ClientID].m_MapChunk;
-					int Offset = Chunk * ChunkSize;
-
-					// check for last part
-					if(Offset+ChunkSize >= m_CurrentMapSize)
-					{
-						ChunkSize = m_CurrentMapSize-Offset;
-						m_aClients[ClientID].m_MapChunk = -1;
-					}
-					else
-						m_aClients[ClientID].m_MapChunk++;
-
-					CMsgPacker Msg(NETMSG_MAP_DATA, true);
-					Msg.AddRaw(&m_pCurrentMapData[Offset], ChunkSize);
-					SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID);
-
-					if(Config()->m_Debug)
-					{
-						char aBuf[64];
-						str_format(aBuf, sizeof(aBuf), "sending chunk %d with size %d", Chunk, ChunkSize);
-						Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
-					}
+					m_aClients[ClientID].m_MapChunk = Chunk;
+					m_aClients[ClientID].m_MapChunksPerRequest = clamp(NumChunks, 1, (int)MAX_MAP_CHUNKS_PER_REQUEST);
 				}
+				SendMapData(ClientID);
 			}
 		}
 		else if(Msg == NETMSG_READY)
@@ -934,13 +1673,38 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				str_format(aBuf, sizeof(aBuf), "player has entered the game. ClientID=%d addr=%s", ClientID, aAddrStr);
 				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 				m_aClients[ClientID].m_State = CClient::STATE_INGAME;
+				ExpireServerInfo();
 				SendServerInfo(ClientID);
 				GameServer()->OnClientEnter(ClientID);
+				if(MapPrefetchReady())
+					SendMapPrefetch(ClientID);
+			}
+		}
+		else if(Msg == NETMSG_REQUEST_MAP_PREFETCH)
+		{
+			unsigned Crc = (unsigned)Unpacker.GetInt();
+			int Chunk = Unpacker.GetInt();
+			int NumChunks = Unpacker.GetInt();
+			if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && !Unpacker.Error() && m_aClients[ClientID].m_State == CClient::STATE_INGAME &&
+				MapPrefetchReady() && Crc == m_PreloadedMap.m_Crc)
+			{
+				// not flushed, the chunks go out with the snapshots
+				NumChunks = clamp(NumChunks, 1, (int)MAX_MAP_PREFETCH_CHUNKS_PER_REQUEST);
+				for(int i = 0; i < NumChunks; i++, Chunk++)
+				{
+					int Offset = Chunk*MAP_PREFETCH_CHUNK_SIZE;
+					if(Chunk < 0 || Offset >= m_PreloadedMap.m_Size)
+						break;
+					CMsgPacker Msg(NETMSG_MAP_PREFETCH_DATA, true);
+					Msg.AddInt(m_PreloadedMap.m_Crc);
+					Msg.AddInt(Chunk);
+					Msg.AddRaw(m_PreloadedMap.m_pData+Offset, min((int)MAP_PREFETCH_CHUNK_SIZE, m_PreloadedMap.m_Size-Offset));
+					SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, ClientID);
+				}
 			}
 		}
 		else if(Msg == NETMSG_INPUT)
 		{
-			CClient::CInput *pInput;
 			int64 TagTime;
 			int64 Now = time_get();
 
@@ -949,17 +1713,34 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 			int Size = Unpacker.GetInt();
 
 			// check for errors
-			if(Unpacker.Error() || Size/4 > MAX_INPUT_SIZE)
+			if(Unpacker.Error() || Size < 0 || Size/4 > MAX_INPUT_SIZE)
 				return;
 
 			if(m_aClients[ClientID].m_LastAckedSnapshot > 0)
+			{
 				m_aClients[ClientID].m_SnapRate = CClient::SNAPRATE_FULL;
+				OnSnapshotAcked(ClientID);
+			}
+
+			int aData[MAX_INPUT_SIZE];
+			for(int i = 0; i < Size/4; i++)
+				aData[i] = Unpacker.GetInt();
+
+			// buffer the input for its tick, it is applied when the tick starts
+			CInputBuffer *pInputs = &m_aClients[ClientID].m_Inputs;
+			int TimeLeft = ((TickStartTime(IntendedTick)-Now)*1000) / time_freq();
+			int Added = pInputs->Add(Tick(), IntendedTick, TimeLeft, aData, Size/4);
+			if(Added != CInputBuffer::ADD_ONTIME)
+				m_Metrics.Inc(m_aMetrics[Added == CInputBuffer::ADD_LATE ? METRIC_INPUTS_LATE : METRIC_INPUTS_DROPPED], 1);
 
 			// add message to report the input timing
 			// skip packets that are old
 			if(IntendedTick > m_aClients[ClientID].m_LastInputTick)
 			{
-				int TimeLeft = ((TickStartTime(IntendedTick)-Now)*1000) / time_freq();
+				// ask for the buffer depth as headroom, so jitter doesn't make the inputs late.
+				// clients that adapt their margin to the jitter get the plain timing
+				if(Config()->m_SvInputBuffer && !(m_aClients[ClientID].m_Capabilities&CLIENTCAP_INPUT_MARGIN))
+					TimeLeft -= pInputs->Depth()*1000/SERVER_TICK_SPEED;
 
 				CMsgPacker Msg(NETMSG_INPUTTIMING, true);
 				Msg.AddInt(IntendedTick);
@@ -969,34 +1750,49 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 
 			m_aClients[ClientID].m_LastInputTick = IntendedTick;
 
-			pInput = &m_aClients[ClientID].m_aInputs[m_aClients[ClientID].m_CurrentInput];
-
-			if(IntendedTick <= Tick())
-				IntendedTick = Tick()+1;
-
-			pInput->m_GameTick = IntendedTick;
-
-			for(int i = 0; i < Size/4; i++)
-				pInput->m_aData[i] = Unpacker.GetInt();
-
 			int PingCorrection = clamp(Unpacker.GetInt(), 0, 50);
 			if(m_aClients[ClientID].m_Snapshots.Get(m_aClients[ClientID].m_LastAckedSnapshot, &TagTime, 0, 0) >= 0)
 			{
 				m_aClients[ClientID].m_Latency = (int)(((Now-TagTime)*1000)/time_freq());
 				m_aClients[ClientID].m_Latency = max(0, m_aClients[ClientID].m_Latency - PingCorrection);
+				if(m_aClients[ClientID].m_MinLatency < 0 || m_aClients[ClientID].m_Latency < m_aClients[ClientID].m_MinLatency)
+					m_aClients[ClientID].m_MinLatency = m_aClients[ClientID].m_Latency;
 			}
 
-			mem_copy(m_aClients[ClientID].m_LatestInput.m_aData, pInput->m_aData, MAX_INPUT_SIZE*sizeof(int));
-
-			m_aClients[ClientID].m_CurrentInput++;
-			m_aClients[ClientID].m_CurrentInput %= 200;
+			// earlier inputs repeated in case their packets got lost, each relative to the one after it
+			int NumRedundant = Unpacker.GetIntOrDefault(0);
+			int aRedundant[MAX_INPUT_SIZE];
+			int aNewer[MAX_INPUT_SIZE];
+			const int *pNewer = aData;
+			int NewerSize = Size/4;
+			int NewerTick = IntendedTick;
+			for(int k = 0; k < min(NumRedundant, (int)MAX_REDUNDANT_INPUTS); k++)
+			{
+				int RedundantTick = NewerTick - Unpacker.GetInt();
+				int RedundantSize = Unpacker.GetInt();
+				if(Unpacker.Error() || RedundantTick >= NewerTick || RedundantSize < 0 || RedundantSize/4 > MAX_INPUT_SIZE)
+					break;
+				for(int i = 0; i < RedundantSize/4; i++)
+					aRedundant[i] = Unpacker.GetInt() + (i < NewerSize ? pNewer[i] : 0);
+				if(Unpacker.Error())
+					break;
+				if(pInputs->Fill(Tick(), RedundantTick, aRedundant, RedundantSize/4))
+					m_Metrics.Inc(m_aMetrics[METRIC_INPUTS_RECOVERED], 1);
+
+				// the next one is relative to this one
+				mem_copy(aNewer, aRedundant, RedundantSize/4*sizeof(int));
+				pNewer = aNewer;
+				NewerSize = RedundantSize/4;
+				NewerTick = RedundantTick;
+			}
 
-			// call the mod with the fresh input data
-			if(m_aClients[ClientID].m_State == CClient::STATE_INGAME)
-				GameServer()->OnClientDirectInput(ClientID, m_aClients[ClientID].m_LatestInput.m_aData);
+			mem_zero(m_aClients[ClientID].m_LatestInput.m_aData, sizeof(m_aClients[ClientID].m_LatestInput.m_aData));
+			mem_copy(m_aClients[ClientID].m_LatestInput.m_aData, aData, Size/4*sizeof(int));
+			m_aClients[ClientID].m_NewInput = true;
 		}
 		else if(Msg == NETMSG_RCON_CMD)
 		{
+			Cost.SetCost(&m_aClients[ClientID].m_aCostTotals[CClient::COST_RCON]);
 			const char *pCmd = Unpacker.GetString();
 
 			if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && Unpacker.Error() == 0 && m_aClients[ClientID].m_Authed)
@@ -1015,6 +1811,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 		}
 		else if(Msg == NETMSG_RCON_AUTH)
 		{
+			Cost.SetCost(&m_aClients[ClientID].m_aCostTotals[CClient::COST_RCON]);
 			const char *pPw = Unpacker.GetString(CUnpacker::SANITIZE_CC);
 
 			if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && Unpacker.Error() == 0)
@@ -1035,7 +1832,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 					m_aClients[ClientID].m_Authed = AUTHED_ADMIN;
 					m_aClients[ClientID].m_pRconCmdToSend = Console()->FirstCommandInfo(IConsole::ACCESS_LEVEL_ADMIN, CFGFLAG_SERVER);
 					if(m_aClients[ClientID].m_Version >= MIN_MAPLIST_CLIENTVERSION)
-						m_aClients[ClientID].m_pMapListEntryToSend = m_pFirstMapEntry;
+						SubscribeMapList(ClientID);
 					SendRconLine(ClientID, "Admin authentication successful. Full remote console access granted.");
 					char aAddrStr[NETADDR_MAXSTRSIZE];
 					net_addr_str(m_NetServer.ClientAddr(ClientID), aAddrStr, sizeof(aAddrStr), true);
@@ -1053,7 +1850,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 					SendRconLine(ClientID, "Moderator authentication successful. Limited remote console access granted.");
 					const IConsole::CCommandInfo *pInfo = Console()->GetCommandInfo("sv_map", CFGFLAG_SERVER, false);
 					if(pInfo && pInfo->GetAccessLevel() == IConsole::ACCESS_LEVEL_MOD && m_aClients[ClientID].m_Version >= MIN_MAPLIST_CLIENTVERSION)
-						m_aClients[ClientID].m_pMapListEntryToSend = m_pFirstMapEntry;
+						SubscribeMapList(ClientID);
 					char aAddrStr[NETADDR_MAXSTRSIZE];
 					net_addr_str(m_NetServer.ClientAddr(ClientID), aAddrStr, sizeof(aAddrStr), true);
 					char aBuf[256];
@@ -1115,7 +1912,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 	}
 }
 
-void CServer::GenerateServerInfo(CPacker *pPacker, int Token)
+void CServer::UpdateServerInfo()
 {
 	// count the players
 	int PlayerCount = 0, ClientCount = 0;
@@ -1130,13 +1927,8 @@ void CServer::GenerateServerInfo(CPacker *pPacker, int Token)
 		}
 	}
 
-	if(Token != -1)
-	{
-		pPacker->Reset();
-		pPacker->AddRaw(SERVERBROWSE_INFO, sizeof(SERVERBROWSE_INFO));
-		pPacker->AddInt(Token);
-	}
-
+	CPacker *pPacker = &m_ServerInfo;
+	pPacker->Reset();
 	pPacker->AddString(GameServer()->Version(), 32);
 	pPacker->AddString(Config()->m_SvName, 64);
 	pPacker->AddString(Config()->m_SvHostname, 128);
@@ -1158,21 +1950,37 @@ void CServer::GenerateServerInfo(CPacker *pPacker, int Token)
 	pPacker->AddInt(Config()->m_SvPlayerSlots); // max players
 	pPacker->AddInt(ClientCount); // num clients
 	pPacker->AddInt(max(ClientCount, Config()->m_SvMaxClients)); // max clients
+	m_ServerInfoSizeNoPlayers = pPacker->Size();
 
-	if(Token != -1)
+	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
-		for(int i = 0; i < MAX_CLIENTS; i++)
+		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
 		{
-			if(m_aClients[i].m_State != CClient::STATE_EMPTY)
-			{
-				pPacker->AddString(ClientName(i), 0); // client name
-				pPacker->AddString(ClientClan(i), 0); // client clan
-				pPacker->AddInt(m_aClients[i].m_Country); // client country
-				pPacker->AddInt(m_aClients[i].m_Score); // client score
-				pPacker->AddInt(GameServer()->IsClientPlayer(i)?0:1); // flag spectator=1, bot=2 (player=0)
-			}
+			pPacker->AddString(ClientName(i), 0); // client name
+			pPacker->AddString(ClientClan(i), 0); // client clan
+			pPacker->AddInt(m_aClients[i].m_Country); // client country
+			pPacker->AddInt(m_aClients[i].m_Score); // client score
+			pPacker->AddInt(GameServer()->IsClientPlayer(i)?0:1); // flag spectator=1, bot=2 (player=0)
 		}
 	}
+
+	m_ServerInfoNeedsUpdate = false;
+}
+
+void CServer::GenerateServerInfo(CPacker *pPacker, int Token)
+{
+	if(m_ServerInfoNeedsUpdate)
+		UpdateServerInfo();
+
+	if(Token != -1)
+	{
+		pPacker->Reset();
+		pPacker->AddRaw(SERVERBROWSE_INFO, sizeof(SERVERBROWSE_INFO));
+		pPacker->AddInt(Token);
+		pPacker->AddRaw(m_ServerInfo.Data(), m_ServerInfo.Size());
+	}
+	else
+		pPacker->AddRaw(m_ServerInfo.Data(), m_ServerInfoSizeNoPlayers);
 }
 
 void CServer::SendServerInfo(int ClientID)
@@ -1180,13 +1988,7 @@ void CServer::SendServerInfo(int ClientID)
 	CMsgPacker Msg(NETMSG_SERVERINFO, true);
 	GenerateServerInfo(&Msg, -1);
 	if(ClientID == -1)
-	{
-		for(int i = 0; i < MAX_CLIENTS; i++)
-		{
-			if(m_aClients[i].m_State != CClient::STATE_EMPTY)
-				SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, i);
-		}
-	}
+		SendMsgMask(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, CClientMask::all());
 	else if(ClientID >= 0 && ClientID < MAX_CLIENTS && m_aClients[ClientID].m_State != CClient::STATE_EMPTY)
 		SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID);
 }
@@ -1206,7 +2008,8 @@ void CServer::PumpNetwork()
 		{
 			if(m_Register.RegisterProcessPacket(&Packet, ResponseToken))
 				continue;
-			if(Packet.m_DataSize >= int(sizeof(SERVERBROWSE_GETINFO)) &&
+			// browsers ask again, an overloaded server leaves them be
+			if(!m_Overloaded && Packet.m_DataSize >= int(sizeof(SERVERBROWSE_GETINFO)) &&
 				mem_comp(Packet.m_pData, SERVERBROWSE_GETINFO, sizeof(SERVERBROWSE_GETINFO)) == 0)
 			{
 				CUnpacker Unpacker;
@@ -1254,20 +2057,157 @@ void CServer::ChangeMap(const char *pMap)
 	m_MapReload = str_comp(Config()->m_SvMap, m_aCurrentMap) != 0;
 }
 
-int CServer::LoadMap(const char *pMapName)
+bool CServer::PrepareMap(const char *pMapName, CPreparedMap *pMap)
 {
+	pMap->m_pData = 0;
+	pMap->m_Size = 0;
+	pMap->m_aError[0] = 0;
+
 	char aBuf[IO_MAX_PATH_LENGTH];
 	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
 
 	// check for valid standard map
 	if(!m_MapChecker.ReadAndValidateMap(Storage(), aBuf, IStorage::TYPE_ALL))
 	{
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
+		str_copy(pMap->m_aError, "invalid standard map", sizeof(pMap->m_aError));
+		return false;
+	}
+
+	int Version;
+	{
+		CDataFileReader Reader;
+		if(!Reader.Open(Storage(), aBuf, IStorage::TYPE_ALL, true))
+			return false;
+		pMap->m_FileSha256 = Reader.Sha256();
+		pMap->m_FileCrc = Reader.Crc();
+		Version = Reader.Version();
+	}
+	IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+		return false;
+	pMap->m_FileSize = (int)io_length(File);
+	io_close(File);
+
+	// clients only understand the zlib datafile format, offer them a converted copy of newer maps
+	char aDownload[IO_MAX_PATH_LENGTH];
+	str_copy(aDownload, aBuf, sizeof(aDownload));
+	pMap->m_Sha256 = pMap->m_FileSha256;
+	pMap->m_Crc = pMap->m_FileCrc;
+	if(Version > 4)
+	{
+		str_format(aDownload, sizeof(aDownload), "dumps/map_%08x_download.map", pMap->m_FileCrc);
+		if(!CDataFileWriter::Resave(Storage(), aBuf, IStorage::TYPE_ALL, aDownload, CDataFileWriter::FORMAT_ZLIB))
+		{
+			str_copy(pMap->m_aError, "failed to convert the map for downloads", sizeof(pMap->m_aError));
+			return false;
+		}
+
+		CDataFileReader Download;
+		if(!Download.Open(Storage(), aDownload, IStorage::TYPE_SAVE))
+		{
+			Storage()->RemoveFile(aDownload, IStorage::TYPE_SAVE);
+			return false;
+		}
+		pMap->m_Sha256 = Download.Sha256();
+		pMap->m_Crc = Download.Crc();
+	}
+
+	// load complete map into memory for download
+	File = Storage()->OpenFile(aDownload, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(File)
+	{
+		pMap->m_Size = (int)io_length(File);
+		pMap->m_pData = (unsigned char *)mem_alloc_tag(max(pMap->m_Size, 1), 1, MEMTAG_MAP);
+		io_read(File, pMap->m_pData, pMap->m_Size);
+		io_close(File);
+	}
+	if(str_comp(aDownload, aBuf) != 0)
+		Storage()->RemoveFile(aDownload, IStorage::TYPE_SAVE);
+	return pMap->m_pData != 0;
+}
+
+void CServer::PreloadThread(void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	CTracer::SetThreadName("map preload");
+	CTraceScope TraceScope("PreloadMap");
+	pThis->m_PreloadSucceeded = pThis->PrepareMap(pThis->m_aPreloadMap, &pThis->m_PreloadedMap);
+	pThis->m_PreloadDone = true;
+}
+
+void CServer::FinishPreload()
+{
+	if(m_pPreloadThread)
+	{
+		thread_wait(m_pPreloadThread);
+		m_pPreloadThread = 0;
+	}
+}
+
+void CServer::PreloadMap(const char *pMap)
+{
+	// the current map is loaded already
+	if(!pMap[0] || str_comp(pMap, m_aCurrentMap) == 0 || str_comp(pMap, m_aPreloadMap) == 0)
+		return;
+
+	FinishPreload();
+	if(m_PreloadedMap.m_pData)
+	{
+		mem_free(m_PreloadedMap.m_pData);
+		m_PreloadedMap.m_pData = 0;
+	}
+
+	str_copy(m_aPreloadMap, pMap, sizeof(m_aPreloadMap));
+	m_PreloadDone = false;
+	m_PreloadSucceeded = false;
+	m_pPreloadThread = thread_init(PreloadThread, this);
+	if(!m_pPreloadThread)
+		m_aPreloadMap[0] = 0;
+}
+
+int CServer::LoadMap(const char *pMapName)
+{
+	char aBuf[IO_MAX_PATH_LENGTH];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+
+	// take the preloaded map if it's this one and the file didn't change since
+	CPreparedMap Map;
+	bool Prepared = false;
+	FinishPreload();
+	if(m_aPreloadMap[0] && str_comp(m_aPreloadMap, pMapName) == 0 && m_PreloadSucceeded)
+	{
+		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
+		if(File)
+		{
+			if((int)io_length(File) == m_PreloadedMap.m_FileSize)
+			{
+				Map = m_PreloadedMap;
+				m_PreloadedMap.m_pData = 0;
+				Prepared = true;
+			}
+			io_close(File);
+		}
+	}
+	m_aPreloadMap[0] = 0;
+	if(m_PreloadedMap.m_pData)
+	{
+		mem_free(m_PreloadedMap.m_pData);
+		m_PreloadedMap.m_pData = 0;
+	}
+
+	if(!Prepared && !PrepareMap(pMapName, &Map))
+	{
+		if(Map.m_aError[0])
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", Map.m_aError);
 		return 0;
 	}
 
-	if(!m_pMap->Load(aBuf))
+	// the map got hashed while preparing it
+	if(!m_pMap->Load(aBuf, 0, &Map.m_FileSha256, Map.m_FileCrc))
+	{
+		mem_free(Map.m_pData);
 		return 0;
+	}
 
 	// stop recording when we change map
 	m_DemoRecorder.Stop();
@@ -1275,9 +2215,8 @@ int CServer::LoadMap(const char *pMapName)
 	// reinit snapshot ids
 	m_IDPool.TimeoutIDs();
 
-	// get the sha256 and crc of the map
-	m_CurrentMapSha256 = m_pMap->Sha256();
-	m_CurrentMapCrc = m_pMap->Crc();
+	m_CurrentMapSha256 = Map.m_Sha256;
+	m_CurrentMapCrc = Map.m_Crc;
 	char aSha256[SHA256_MAXSTRSIZE];
 	sha256_str(m_CurrentMapSha256, aSha256, sizeof(aSha256));
 	char aBufMsg[256];
@@ -1288,16 +2227,12 @@ int CServer::LoadMap(const char *pMapName)
 
 	str_copy(m_aCurrentMap, pMapName, sizeof(m_aCurrentMap));
 
-	// load complete map into memory for download
-	{
-		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
-		m_CurrentMapSize = (int)io_length(File);
-		if(m_pCurrentMapData)
-			mem_free(m_pCurrentMapData);
-		m_pCurrentMapData = (unsigned char *)mem_alloc(m_CurrentMapSize, 1);
-		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
-		io_close(File);
-	}
+	if(m_pCurrentMapData)
+		mem_free(m_pCurrentMapData);
+	m_pCurrentMapData = Map.m_pData;
+	m_CurrentMapSize = Map.m_Size;
+	PackMapChunks();
+	ExpireServerInfo();
 	return 1;
 }
 
@@ -1315,184 +2250,876 @@ void CServer::InitInterfaces(CConfig *pConfig, IConsole *pConsole, IGameServer *
 	m_pStorage = pStorage;
 }
 
-int CServer::Run()
+void CServer::UpdateProfiler()
 {
-	//
-	m_PrintCBIndex = Console()->RegisterPrintCallback(Config()->m_ConsoleOutputLevel, SendRconLineAuthed, this);
+	m_Profiler.SetEnabled(Config()->m_SvProfile);
+	if(!m_Profiler.IsEnabled())
+		return;
 
-	// list maps
-	m_pMapListHeap = new CHeap();
-	CSubdirCallbackUserdata Userdata;
-	Userdata.m_pServer = this;
-	str_copy(Userdata.m_aName, "", sizeof(Userdata.m_aName));
-	m_pStorage->ListDirectory(IStorage::TYPE_ALL, "maps/", MapListEntryCallback, &Userdata);
+	int64 Now = time_get();
+	m_Profiler.Update(Now);
 
-	// load map
-	if(!LoadMap(Config()->m_SvMap))
+	// stream the stats to the external console
+	if(Config()->m_EcProfileInterval && Now-m_LastProfileReport > Config()->m_EcProfileInterval*time_freq())
 	{
-		dbg_msg("server", "failed to load map. mapname='%s'", Config()->m_SvMap);
-		return -1;
+		m_LastProfileReport = Now;
+		char aBuf[256];
+		for(int i = 0; i < m_Profiler.NumPhases(); i++)
+		{
+			m_Profiler.FormatStats(i, aBuf, sizeof(aBuf));
+			m_Econ.Send(-1, aBuf);
+		}
 	}
-	m_MapChunksPerRequest = Config()->m_SvMapDownloadSpeed;
+}
 
-	// start server
-	NETADDR BindAddr;
-	if(Config()->m_Bindaddr[0] && net_host_lookup(Config()->m_Bindaddr, &BindAddr, NETTYPE_ALL) == 0)
-	{
-		// sweet!
-		BindAddr.type = NETTYPE_ALL;
-		BindAddr.port = Config()->m_SvPort;
-	}
-	else
+void CServer::UpdateNetStats()
+{
+	int64 Now = time_get();
+	if(Now-m_LastNetStatsUpdate < time_freq())
+		return;
+	int64 Elapsed = m_LastNetStatsUpdate ? Now-m_LastNetStatsUpdate : time_freq();
+	m_LastNetStatsUpdate = Now;
+
+	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
-		mem_zero(&BindAddr, sizeof(BindAddr));
-		BindAddr.type = NETTYPE_ALL;
-		BindAddr.port = Config()->m_SvPort;
+		CClient *pClient = &m_aClients[i];
+		if(pClient->m_State == CClient::STATE_EMPTY)
+			continue;
+
+		CNetConnStats Stats;
+		m_NetServer.ClientStats(i, &Stats);
+		const CNetConnStats *pLast = &pClient->m_NetStats;
+		// the counters start over with a new connection
+		bool Restarted = Stats.m_SentPackets < pLast->m_SentPackets || Stats.m_RecvPackets < pLast->m_RecvPackets;
+		CNetConnStats *pRates = &pClient->m_NetRates;
+		pRates->m_SentPackets = (unsigned)((Restarted ? Stats.m_SentPackets : Stats.m_SentPackets-pLast->m_SentPackets)*time_freq()/Elapsed);
+		pRates->m_SentBytes = (unsigned)((Restarted ? Stats.m_SentBytes : Stats.m_SentBytes-pLast->m_SentBytes)*time_freq()/Elapsed);
+		pRates->m_RecvPackets = (unsigned)((Restarted ? Stats.m_RecvPackets : Stats.m_RecvPackets-pLast->m_RecvPackets)*time_freq()/Elapsed);
+		pRates->m_RecvBytes = (unsigned)((Restarted ? Stats.m_RecvBytes : Stats.m_RecvBytes-pLast->m_RecvBytes)*time_freq()/Elapsed);
+		pRates->m_Resends = (unsigned)((Restarted ? Stats.m_Resends : Stats.m_Resends-pLast->m_Resends)*time_freq()/Elapsed);
+		pRates->m_QueuedChunks = Stats.m_QueuedChunks;
+		pRates->m_QueuedBytes = Stats.m_QueuedBytes;
+		pRates->m_Rtt = Stats.m_Rtt;
+		m_Metrics.Inc(m_aMetrics[METRIC_SENT_BYTES], Restarted ? Stats.m_SentBytes : Stats.m_SentBytes-pLast->m_SentBytes);
+		m_Metrics.Inc(m_aMetrics[METRIC_RECV_BYTES], Restarted ? Stats.m_RecvBytes : Stats.m_RecvBytes-pLast->m_RecvBytes);
+		m_Metrics.Inc(m_aMetrics[METRIC_RESENDS], Restarted ? Stats.m_Resends : Stats.m_Resends-pLast->m_Resends);
+		pClient->m_NetStats = Stats;
+
+		for(int c = 0; c < CClient::NUM_COSTS; c++)
+		{
+			pClient->m_aCostRates[c] = (int)((pClient->m_aCostTotals[c]-pClient->m_aCostLast[c])*1000000/Elapsed);
+			pClient->m_aCostLast[c] = pClient->m_aCostTotals[c];
+		}
 	}
 
-	if(!m_NetServer.Open(BindAddr, Config(), Console(), Kernel()->RequestInterface<IEngine>(), &m_ServerBan,
-		Config()->m_SvMaxClients, Config()->m_SvMaxClientsPerIP, NewClientCallback, DelClientCallback, this))
+	if(Config()->m_SvNetStatsInterval && Now-m_LastNetStatsDump > Config()->m_SvNetStatsInterval*time_freq())
 	{
-		dbg_msg("server", "couldn't open socket. port %d might already be in use", Config()->m_SvPort);
-		return -1;
+		m_LastNetStatsDump = Now;
+		if(!DumpNetStats("dumps/net_stats.json"))
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_stats", "failed to open 'dumps/net_stats.json'");
 	}
+}
 
-	m_Econ.Init(Config(), Console(), &m_ServerBan);
+void CServer::InitMetrics()
+{
+	if(!Config()->m_SvMetricsPort)
+		return;
+
+	NETADDR BindAddr;
+	if(!Config()->m_SvMetricsBindaddr[0] || net_host_lookup(Config()->m_SvMetricsBindaddr, &BindAddr, NETTYPE_ALL) != 0)
+		mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = NETTYPE_ALL;
+	BindAddr.port = Config()->m_SvMetricsPort;
+
+	static const double s_aTickBounds[] = {0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1};
+	m_aMetrics[METRIC_TICK_DURATION] = m_Metrics.Add("teeworlds_tick_duration_seconds", "Time spent on game ticks", CMetrics::TYPE_HISTOGRAM, s_aTickBounds, sizeof(s_aTickBounds)/sizeof(s_aTickBounds[0]));
+	static const double s_aLatenessBounds[] = {0.0001, 0.00025, 0.0005, 0.001, 0.002, 0.005, 0.01};
+	m_aMetrics[METRIC_TICK_LATENESS] = m_Metrics.Add("teeworlds_tick_lateness_seconds", "Time between the scheduled and the actual start of game ticks", CMetrics::TYPE_HISTOGRAM, s_aLatenessBounds, sizeof(s_aLatenessBounds)/sizeof(s_aLatenessBounds[0]));
+	m_aMetrics[METRIC_CLIENTS] = m_Metrics.Add("teeworlds_clients", "Connected clients", CMetrics::TYPE_GAUGE);
+	m_aMetrics[METRIC_PLAYERS] = m_Metrics.Add("teeworlds_players", "Clients in game", CMetrics::TYPE_GAUGE);
+	m_aMetrics[METRIC_SNAPSHOT_BYTES] = m_Metrics.Add("teeworlds_snapshot_bytes_total", "Snapshot delta bytes sent", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_SENT_BYTES] = m_Metrics.Add("teeworlds_net_sent_bytes_total", "Bytes sent to clients before compression", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_RECV_BYTES] = m_Metrics.Add("teeworlds_net_recv_bytes_total", "Bytes received from clients", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_RESENDS] = m_Metrics.Add("teeworlds_net_resends_total", "Vital chunks sent again", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_CONNLESS_RECV] = m_Metrics.Add("teeworlds_connless_recv_packets_total", "Connectionless packets received", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_CONNLESS_SENT] = m_Metrics.Add("teeworlds_connless_sent_packets_total", "Connectionless packets sent", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_JOB_QUEUE] = m_Metrics.Add("teeworlds_job_queue_depth", "Jobs waiting in the job pool", CMetrics::TYPE_GAUGE);
+	m_aMetrics[METRIC_MEMORY] = m_Metrics.Add("teeworlds_resident_memory_bytes", "Physical memory used by the process", CMetrics::TYPE_GAUGE);
+	m_aMetrics[METRIC_OVERLOADED] = m_Metrics.Add("teeworlds_overloaded", "1 while sustained tick overruns make the server shed load", CMetrics::TYPE_GAUGE);
+	m_aMetrics[METRIC_INPUTS_LATE] = m_Metrics.Add("teeworlds_inputs_late_total", "Client inputs that arrived after their tick started", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_INPUTS_DROPPED] = m_Metrics.Add("teeworlds_inputs_dropped_total", "Client inputs that had no free tick left", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_INPUTS_RECOVERED] = m_Metrics.Add("teeworlds_inputs_recovered_total", "Lost client inputs filled in from their repeated copies", CMetrics::TYPE_COUNTER);
+	m_aMetrics[METRIC_CLIENT_MESSAGES] = m_Metrics.AddSeries("teeworlds_client_messages_seconds_total", "Time spent on the messages of a client", CMetrics::TYPE_COUNTER, "client_id");
+	m_aMetrics[METRIC_CLIENT_RCON] = m_Metrics.AddSeries("teeworlds_client_rcon_seconds_total", "Time spent on the rcon commands of a client", CMetrics::TYPE_COUNTER, "client_id");
+	m_aMetrics[METRIC_CLIENT_MAPLIST] = m_Metrics.AddSeries("teeworlds_client_maplist_seconds_total", "Time spent sending the map list to a client", CMetrics::TYPE_COUNTER, "client_id");
+	m_aMetrics[METRIC_CLIENT_SNAPSHOTS] = m_Metrics.AddSeries("teeworlds_client_snapshots_seconds_total", "Time spent creating and sending the snapshots of a client", CMetrics::TYPE_COUNTER, "client_id");
+	m_aMetrics[METRIC_CLIENT_SENT_BYTES] = m_Metrics.AddSeries("teeworlds_client_sent_bytes_total", "Bytes sent to a client before compression", CMetrics::TYPE_COUNTER, "client_id");
+	m_aMetrics[METRIC_CLIENT_RECV_BYTES] = m_Metrics.AddSeries("teeworlds_client_recv_bytes_total", "Bytes received from a client", CMetrics::TYPE_COUNTER, "client_id");
 
 	char aBuf[256];
-	str_format(aBuf, sizeof(aBuf), "server name is '%s'", Config()->m_SvName);
-	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	if(m_Metrics.Open(BindAddr))
+		str_format(aBuf, sizeof(aBuf), "serving metrics on %s:%d", Config()->m_SvMetricsBindaddr, Config()->m_SvMetricsPort);
+	else
+		str_format(aBuf, sizeof(aBuf), "couldn't open the metrics port %d", Config()->m_SvMetricsPort);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "metrics", aBuf);
+}
 
-	GameServer()->OnInit();
-	str_format(aBuf, sizeof(aBuf), "netversion %s", GameServer()->NetVersion());
-	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-	if(str_comp(GameServer()->NetVersionHashUsed(), GameServer()->NetVersionHashReal()))
-	{
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "WARNING: netversion hash differs");
-	}
-	str_format(aBuf, sizeof(aBuf), "game version %s", GameServer()->Version());
-	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+void CServer::InitDemoStream()
+{
+	if(!Config()->m_SvDemoStreamPort)
+		return;
 
-	// process pending commands
-	m_pConsole->StoreCommands(false);
+	NETADDR BindAddr;
+	if(!Config()->m_SvDemoStreamBindaddr[0] || net_host_lookup(Config()->m_SvDemoStreamBindaddr, &BindAddr, NETTYPE_ALL) != 0)
+		mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = NETTYPE_ALL;
+	BindAddr.port = Config()->m_SvDemoStreamPort;
 
-	if(m_GeneratedRconPassword)
+	char aBuf[256];
+	if(m_DemoStream.Open(BindAddr))
 	{
-		dbg_msg("server", "+-------------------------+");
-		dbg_msg("server", "| rcon password: '%s' |", Config()->m_SvRconPassword);
-		dbg_msg("server", "+-------------------------+");
+		m_DemoRecorder.SetStream(&m_DemoStream);
+		str_format(aBuf, sizeof(aBuf), "serving the demo stream on %s:%d", Config()->m_SvDemoStreamBindaddr, Config()->m_SvDemoStreamPort);
 	}
+	else
+		str_format(aBuf, sizeof(aBuf), "couldn't open the demo stream port %d", Config()->m_SvDemoStreamPort);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_stream", aBuf);
+}
 
-	// start game
-	{
-		m_GameStartTime = time_get();
+void CServer::UpdateMetrics()
+{
+	// the listener only sees published values, once a second is plenty
+	int64 Now = time_get();
+	if(!m_Metrics.IsOpen() || Now-m_LastMetricsUpdate < time_freq())
+		return;
+	m_LastMetricsUpdate = Now;
 
-		while(m_RunServer)
+	int NumClients = 0;
+	int NumPlayers = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		const CClient *pClient = &m_aClients[i];
+		if(pClient->m_State == CClient::STATE_EMPTY)
 		{
-			// load new map
-			if(m_MapReload || m_CurrentGameTick >= 0x6FFFFFFF) //	force reload to make sure the ticks stay within a valid range
-			{
-				m_MapReload = false;
+			for(int m = METRIC_CLIENT_MESSAGES; m <= METRIC_CLIENT_RECV_BYTES; m++)
+				m_Metrics.RemoveSeries(m_aMetrics[m], i);
+			continue;
+		}
+		NumClients++;
+		if(pClient->m_State == CClient::STATE_INGAME)
+			NumPlayers++;
+
+		for(int c = 0; c < CClient::NUM_COSTS; c++)
+			m_Metrics.SetSeries(m_aMetrics[METRIC_CLIENT_MESSAGES+c], i, pClient->m_aCostTotals[c]/(double)time_freq());
+		m_Metrics.SetSeries(m_aMetrics[METRIC_CLIENT_SENT_BYTES], i, pClient->m_NetStats.m_SentBytes);
+		m_Metrics.SetSeries(m_aMetrics[METRIC_CLIENT_RECV_BYTES], i, pClient->m_NetStats.m_RecvBytes);
+	}
+	m_Metrics.Set(m_aMetrics[METRIC_CLIENTS], NumClients);
+	m_Metrics.Set(m_aMetrics[METRIC_PLAYERS], NumPlayers);
+	m_Metrics.Set(m_aMetrics[METRIC_CONNLESS_RECV], m_NetServer.NumConnlessRecv());
+	m_Metrics.Set(m_aMetrics[METRIC_CONNLESS_SENT], m_NetServer.NumConnlessSent());
+	m_Metrics.Set(m_aMetrics[METRIC_JOB_QUEUE], Kernel()->RequestInterface<IEngine>()->JobPool()->NumQueuedJobs());
+	m_Metrics.Set(m_aMetrics[METRIC_MEMORY], (double)mem_resident_size());
+	m_Metrics.Set(m_aMetrics[METRIC_OVERLOADED], m_Overloaded ? 1 : 0);
+	m_Metrics.Publish();
+}
+
+void CServer::FormatNetStats(int ClientID, char *pBuf, int BufSize) const
+{
+	const CNetConnStats *pRates = &m_aClients[ClientID].m_NetRates;
+	const CInputBuffer *pInputs = &m_aClients[ClientID].m_Inputs;
+	str_format(pBuf, BufSize, "id=%d rtt=%dms out=%u B/s (%u pkt/s) in=%u B/s (%u pkt/s) resends=%u/s queued=%d chunks (%d B) snap_interval=%d snap_budget=%d input_jitter=%dms input_depth=%d inputs_late=%d inputs_dropped=%d inputs_recovered=%d",
+		ClientID, pRates->m_Rtt, pRates->m_SentBytes, pRates->m_SentPackets, pRates->m_RecvBytes, pRates->m_RecvPackets, pRates->m_Resends,
+		pRates->m_QueuedChunks, pRates->m_QueuedBytes, m_aClients[ClientID].m_SnapInterval, m_aClients[ClientID].m_SnapBudget,
+		pInputs->Jitter(), pInputs->Depth(), pInputs->NumLate(), pInputs->NumDropped(), pInputs->NumRecovered());
+}
+
+bool CServer::DumpNetStats(const char *pFilename)
+{
+	IOHANDLE File = Storage()->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	CJsonWriter Writer(File);
+	Writer.BeginObject();
+	Writer.WriteAttribute("time");
+	Writer.WriteIntValue(time_timestamp());
+	Writer.WriteAttribute("tick");
+	Writer.WriteIntValue(m_CurrentGameTick);
+	Writer.WriteAttribute("clients");
+	Writer.BeginArray();
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		const CClient *pClient = &m_aClients[i];
+		if(pClient->m_State == CClient::STATE_EMPTY)
+			continue;
 
-				// load map
-				if(LoadMap(Config()->m_SvMap))
-				{
-					// new map loaded
-					bool aSpecs[MAX_CLIENTS];
-					for(int c = 0; c < MAX_CLIENTS; c++)
-						aSpecs[c] = GameServer()->IsClientSpectator(c);
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(m_NetServer.ClientAddr(i), aAddrStr, sizeof(aAddrStr), true);
+		const CNetConnStats *pRates = &pClient->m_NetRates;
+		const CNetConnStats *pTotals = &pClient->m_NetStats;
+
+		Writer.BeginObject();
+		Writer.WriteAttribute("id");
+		Writer.WriteIntValue(i);
+		Writer.WriteAttribute("addr");
+		Writer.WriteStrValue(aAddrStr);
+		Writer.WriteAttribute("name");
+		Writer.WriteStrValue(pClient->m_aName);
+		Writer.WriteAttribute("ingame");
+		Writer.WriteBoolValue(pClient->m_State == CClient::STATE_INGAME);
+		Writer.WriteAttribute("rtt_ms");
+		Writer.WriteIntValue(pRates->m_Rtt);
+		Writer.WriteAttribute("sent_bytes_per_sec");
+		Writer.WriteIntValue(pRates->m_SentBytes);
+		Writer.WriteAttribute("sent_packets_per_sec");
+		Writer.WriteIntValue(pRates->m_SentPackets);
+		Writer.WriteAttribute("recv_bytes_per_sec");
+		Writer.WriteIntValue(pRates->m_RecvBytes);
+		Writer.WriteAttribute("recv_packets_per_sec");
+		Writer.WriteIntValue(pRates->m_RecvPackets);
+		Writer.WriteAttribute("resends_per_sec");
+		Writer.WriteIntValue(pRates->m_Resends);
+		Writer.WriteAttribute("cpu_us_per_sec");
+		Writer.WriteIntValue(pClient->m_aCostRates[CClient::COST_MESSAGES]+pClient->m_aCostRates[CClient::COST_RCON]+
+			pClient->m_aCostRates[CClient::COST_MAPLIST]+pClient->m_aCostRates[CClient::COST_SNAPSHOTS]);
+		Writer.WriteAttribute("queued_chunks");
+		Writer.WriteIntValue(pRates->m_QueuedChunks);
+		Writer.WriteAttribute("queued_bytes");
+		Writer.WriteIntValue(pRates->m_QueuedBytes);
+		Writer.WriteAttribute("snap_interval");
+		Writer.WriteIntValue(pClient->m_SnapInterval);
+		Writer.WriteAttribute("snap_budget");
+		Writer.WriteIntValue(pClient->m_SnapBudget);
+		Writer.WriteAttribute("input_jitter_ms");
+		Writer.WriteIntValue(pClient->m_Inputs.Jitter());
+		Writer.WriteAttribute("input_depth");
+		Writer.WriteIntValue(pClient->m_Inputs.Depth());
+		Writer.WriteAttribute("inputs_late");
+		Writer.WriteIntValue(pClient->m_Inputs.NumLate());
+		Writer.WriteAttribute("inputs_dropped");
+		Writer.WriteIntValue(pClient->m_Inputs.NumDropped());
+		Writer.WriteAttribute("inputs_recovered");
+		Writer.WriteIntValue(pClient->m_Inputs.NumRecovered());
+		// totals wrap around after 4 GiB
+		Writer.WriteAttribute("sent_bytes");
+		Writer.WriteIntValue((int)(pTotals->m_SentBytes&0x7fffffff));
+		Writer.WriteAttribute("recv_bytes");
+		Writer.WriteIntValue((int)(pTotals->m_RecvBytes&0x7fffffff));
+		Writer.WriteAttribute("resends");
+		Writer.WriteIntValue((int)(pTotals->m_Resends&0x7fffffff));
+		Writer.EndObject();
+	}
+	Writer.EndArray();
+	Writer.EndObject();
+	return true;
+}
 
-					GameServer()->OnShutdown();
+static void AddCaptureConfigLine(array<char> *pLines, const char *pLine)
+{
+	for(; *pLine; pLine++)
+		pLines->add(*pLine);
+	pLines->add('\n');
+}
 
-					for(int c = 0; c < MAX_CLIENTS; c++)
-					{
-						if(m_aClients[c].m_State <= CClient::STATE_AUTH)
-							continue;
+bool CServer::OpenNetReplay()
+{
+	if(!m_NetReplay.Open(Storage(), Config()->m_SvReplay))
+	{
+		dbg_msg("server", "couldn't open the capture '%s'", Config()->m_SvReplay);
+		return false;
+	}
 
-						SendMap(c);
-						m_aClients[c].Reset();
-						m_aClients[c].m_State = aSpecs[c] ? CClient::STATE_CONNECTING_AS_SPEC : CClient::STATE_CONNECTING;
-					}
+	// the addresses and the registration stay with this server
+	static const char *s_apLocalOptions[] = {"sv_port", "bindaddr", "sv_register", "sv_external_port"};
+	char aLine[1024];
+	for(const char *pLine = m_NetReplay.Config(); *pLine;)
+	{
+		int Length = str_span(pLine, "\n");
+		str_truncate(aLine, sizeof(aLine), pLine, Length);
+		pLine += Length + (pLine[Length] ? 1 : 0);
+
+		bool Local = false;
+		for(unsigned i = 0; i < sizeof(s_apLocalOptions)/sizeof(s_apLocalOptions[0]); i++)
+			if(str_startswith(aLine, s_apLocalOptions[i]) && aLine[str_length(s_apLocalOptions[i])] == ' ')
+				Local = true;
+		if(!Local)
+			Console()->ExecuteLine(aLine);
+	}
+	str_copy(Config()->m_SvMap, m_NetReplay.Map(), sizeof(Config()->m_SvMap));
+	return true;
+}
 
-					m_GameStartTime = time_get();
-					m_CurrentGameTick = 0;
-					Kernel()->ReregisterInterface(GameServer());
-					GameServer()->OnInit();
-				}
-				else
-				{
-					str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", Config()->m_SvMap);
-					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-					str_copy(Config()->m_SvMap, m_aCurrentMap, sizeof(Config()->m_SvMap));
-				}
-			}
+void CServer::StartNetCapture()
+{
+	// the saved config that differs from the defaults, like save_config writes it
+	array<char> Lines;
+	char aLine[1024];
+	char aEscapeBuf[1024];
+	#define MACRO_CONFIG_INT(Name,ScriptName,def,min,max,flags,desc) if(((flags)&CFGFLAG_SAVE)&&((flags)&CFGFLAG_SERVER)&&(Config()->m_##Name!=int(def))){ str_format(aLine, sizeof(aLine), "%s %i", #ScriptName, Config()->m_##Name); AddCaptureConfigLine(&Lines, aLine); }
+	#define MACRO_CONFIG_STR(Name,ScriptName,len,def,flags,desc) if(((flags)&CFGFLAG_SAVE)&&((flags)&CFGFLAG_SERVER)&&(str_comp(Config()->m_##Name,def))){ EscapeParam(aEscapeBuf, Config()->m_##Name, sizeof(aEscapeBuf)); str_format(aLine, sizeof(aLine), "%s \"%s\"", #ScriptName, aEscapeBuf); AddCaptureConfigLine(&Lines, aLine); }
+	#define MACRO_CONFIG_UTF8STR(Name,ScriptName,size,len,def,flags,desc) MACRO_CONFIG_STR(Name,ScriptName,size,def,flags,desc)
 
-			int64 Now = time_get();
-			bool NewTicks = false;
-			bool ShouldSnap = false;
-			while(Now > TickStartTime(m_CurrentGameTick+1))
-			{
-				m_CurrentGameTick++;
-				NewTicks = true;
-				if((m_CurrentGameTick%2) == 0)
-					ShouldSnap = true;
+	#include <engine/shared/config_variables.h>
 
-				// apply new input
-				for(int c = 0; c < MAX_CLIENTS; c++)
-				{
-					if(m_aClients[c].m_State == CClient::STATE_EMPTY)
-						continue;
-					for(int i = 0; i < 200; i++)
-					{
-						if(m_aClients[c].m_aInputs[i].m_GameTick == Tick())
-						{
-							if(m_aClients[c].m_State == CClient::STATE_INGAME)
-								GameServer()->OnClientPredictedInput(c, m_aClients[c].m_aInputs[i].m_aData);
-							break;
-						}
-					}
-				}
+	#undef MACRO_CONFIG_INT
+	#undef MACRO_CONFIG_STR
+	#undef MACRO_CONFIG_UTF8STR
+	Lines.add(0);
+
+	char aBuf[256];
+	if(m_NetCapture.Open(Storage(), Config()->m_SvCapture, m_aCurrentMap, m_CurrentMapSha256, Lines.base_ptr()))
+	{
+		m_NetServer.StartCapture(&m_NetCapture);
+		str_format(aBuf, sizeof(aBuf), "capturing the received datagrams to '%s'", Config()->m_SvCapture);
+	}
+	else
+		str_format(aBuf, sizeof(aBuf), "couldn't open the capture '%s'", Config()->m_SvCapture);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+}
+
+bool CServer::Start()
+{
+	// the thread that waits for the ticks has to wake up on time
+	thread_precise_timers();
+
+	//
+	m_PrintCBIndex = Console()->RegisterPrintCallback(Config()->m_ConsoleOutputLevel, SendRconLineAuthed, this);
+
+	// list maps, unless reload_maplist already did on startup
+	if(!m_pMapListHeap)
+	{
+		m_pMapListHeap = new CHeap();
+		ListMaps();
+	}
+
+	if(Config()->m_SvReplay[0] && !OpenNetReplay())
+		return false;
+
+	// before the map, its recording can start with it
+	InitDemoStream();
+
+	// load map
+	if(!LoadMap(Config()->m_SvMap))
+	{
+		dbg_msg("server", "failed to load map. mapname='%s'", Config()->m_SvMap);
+		return false;
+	}
+	if(m_NetReplay.IsOpen() && sha256_comp(m_NetReplay.MapSha256(), m_CurrentMapSha256) != 0)
+	{
+		dbg_msg("server", "the capture was recorded on another version of the map '%s'", m_aCurrentMap);
+		return false;
+	}
+
+	// start server
+	NETADDR BindAddr;
+	if(Config()->m_Bindaddr[0] && net_host_lookup(Config()->m_Bindaddr, &BindAddr, NETTYPE_ALL) == 0)
+	{
+		// sweet!
+		BindAddr.type = NETTYPE_ALL;
+		BindAddr.port = Config()->m_SvPort;
+	}
+	else
+	{
+		mem_zero(&BindAddr, sizeof(BindAddr));
+		BindAddr.type = NETTYPE_ALL;
+		BindAddr.port = Config()->m_SvPort;
+	}
+
+	if(!m_NetServer.Open(BindAddr, Config(), Console(), Kernel()->RequestInterface<IEngine>(), &m_ServerBan,
+		Config()->m_SvMaxClients, Config()->m_SvMaxClientsPerIP, NewClientCallback, DelClientCallback, this))
+	{
+		dbg_msg("server", "couldn't open socket. port %d might already be in use", Config()->m_SvPort);
+		return false;
+	}
+	if(Config()->m_SvHuffmanTable[0])
+	{
+		unsigned TableID = m_NetServer.LoadHuffmanTable(Storage(), Config()->m_SvHuffmanTable, IStorage::TYPE_ALL);
+		char aBuf[256];
+		if(TableID && m_NetServer.UseHuffmanTable(TableID))
+			str_format(aBuf, sizeof(aBuf), "using huffman table '%s' id=%08x", Config()->m_SvHuffmanTable, TableID);
+		else
+			str_format(aBuf, sizeof(aBuf), "couldn't load huffman table '%s'", Config()->m_SvHuffmanTable);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	}
+	m_NetServer.SetBatching(Config()->m_SvNetBatch);
+	if(m_NetReplay.IsOpen())
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "replaying the capture '%s' at speed %d", Config()->m_SvReplay, Config()->m_SvReplaySpeed);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+		m_NetServer.SetReplay(&m_NetReplay, Config()->m_SvReplaySpeed);
+	}
+	else if(Config()->m_SvCapture[0])
+		StartNetCapture();
+	// the replay is read on the main thread, it has to tell when it's done
+	if(Config()->m_SvNetThread && !m_NetReplay.IsOpen() && !m_NetServer.StartThread())
+		dbg_msg("server", "couldn't start the network thread, handling the socket on the main thread");
+
+	m_Econ.Init(Config(), Console(), &m_ServerBan);
+	InitMetrics();
+
+	StartSnapWorkers(Config()->m_SvSnapThreads);
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "server name is '%s'", Config()->m_SvName);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+
+	GameServer()->OnInit();
+	str_format(aBuf, sizeof(aBuf), "netversion %s", GameServer()->NetVersion());
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	if(str_comp(GameServer()->NetVersionHashUsed(), GameServer()->NetVersionHashReal()))
+	{
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "WARNING: netversion hash differs");
+	}
+	str_format(aBuf, sizeof(aBuf), "game version %s", GameServer()->Version());
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+
+	// process pending commands
+	m_pConsole->StoreCommands(false);
+
+	if(m_GeneratedRconPassword)
+	{
+		dbg_msg("server", "+-------------------------+");
+		dbg_msg("server", "| rcon password: '%s' |", Config()->m_SvRconPassword);
+		dbg_msg("server", "+-------------------------+");
+	}
 
-				GameServer()->OnTick();
+	m_GameStartTime = time_get();
+	return true;
+}
+
+void CServer::Frame()
+{
+	// clients can download the next map once it's ready
+	if(m_pPreloadThread && m_PreloadDone)
+	{
+		FinishPreload();
+		if(MapPrefetchReady())
+		{
+			for(int c = 0; c < MAX_CLIENTS; c++)
+			{
+				if(m_aClients[c].m_State == CClient::STATE_INGAME)
+					SendMapPrefetch(c);
 			}
+		}
+	}
+
+	// load new map
+	if(m_MapReload || m_CurrentGameTick >= 0x6FFFFFFF) //	force reload to make sure the ticks stay within a valid range
+	{
+		m_MapReload = false;
+
+		// load map
+		if(LoadMap(Config()->m_SvMap))
+		{
+			// new map loaded
+			bool aSpecs[MAX_CLIENTS];
+			for(int c = 0; c < MAX_CLIENTS; c++)
+				aSpecs[c] = GameServer()->IsClientSpectator(c);
+
+			GameServer()->OnShutdown();
 
-			// snap game
-			if(NewTicks)
+			for(int c = 0; c < MAX_CLIENTS; c++)
 			{
-				if(Config()->m_SvHighBandwidth || ShouldSnap)
-					DoSnapshot();
+				if(m_aClients[c].m_State <= CClient::STATE_AUTH)
+					continue;
 
-				UpdateClientRconCommands();
-				UpdateClientMapListEntries();
+				SendMap(c);
+				m_aClients[c].Reset();
+				m_aClients[c].m_State = aSpecs[c] ? CClient::STATE_CONNECTING_AS_SPEC : CClient::STATE_CONNECTING;
 			}
 
-			// master server stuff
-			m_Register.RegisterUpdate(m_NetServer.NetType());
+			m_GameStartTime = time_get();
+			m_CurrentGameTick = 0;
+			Kernel()->ReregisterInterface(GameServer());
+			GameServer()->OnInit();
+		}
+		else
+		{
+			char aBuf[256];
+			str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", Config()->m_SvMap);
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+			str_copy(Config()->m_SvMap, m_aCurrentMap, sizeof(Config()->m_SvMap));
+		}
+	}
+
+	UpdateHibernation();
+	UpdateProfiler();
+	UpdateNetStats();
+	UpdateMetrics();
+	int64 FrameStart = m_Profiler.IsEnabled() ? time_get() : 0;
 
-			PumpNetwork();
+	int64 Now = time_get();
+	bool NewTicks = false;
+	bool ShouldSnap = false;
 
-			// wait for incoming data
-			m_NetServer.Wait(clamp(int((TickStartTime(m_CurrentGameTick+1)-time_get())*1000/time_freq()), 1, 1000/SERVER_TICK_SPEED/2));
+	// running a long backlog back to back only makes the next ticks late too, drop it
+	// hibernation doesn't tick at all, the start time is moved on wakeup instead
+	if(Config()->m_SvLoadShedding && !m_Hibernating && Now-TickStartTime(m_CurrentGameTick+1) > time_freq()*MAX_TICK_BACKLOG/SERVER_TICK_SPEED)
+	{
+		int Skipped = (int)((Now-TickStartTime(m_CurrentGameTick+1))*SERVER_TICK_SPEED/time_freq());
+		m_GameStartTime += time_freq()*Skipped/SERVER_TICK_SPEED;
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "server fell behind, skipped %d ticks. tick=%d", Skipped, m_CurrentGameTick);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	}
+
+	while(!m_Hibernating && Now > TickStartTime(m_CurrentGameTick+1))
+	{
+		// ticks that start more than a tick late are catching up
+		int64 Lateness = Now-TickStartTime(m_CurrentGameTick+1);
+		if(Lateness > time_freq()/SERVER_TICK_SPEED)
+			m_NumLateTicks++;
+		m_MaxTickLateness = max(m_MaxTickLateness, Lateness);
+		m_NumLoadTicks++;
+
+		CProfileScope TickScope(&m_Profiler, m_aProfilePhases[PROFILE_TICK]);
+		CTraceScope TickTraceScope("Tick");
+		int64 TickStart = m_Metrics.IsOpen() || m_Profiler.IsEnabled() ? time_get() : 0;
+		if(TickStart)
+		{
+			int64 Lateness = TickStart-TickStartTime(m_CurrentGameTick+1);
+			if(m_Profiler.IsEnabled())
+				m_Profiler.Add(m_aProfilePhases[PROFILE_TICK_LATENESS], Lateness);
+			m_Metrics.Observe(m_aMetrics[METRIC_TICK_LATENESS], Lateness/(double)time_freq());
 		}
+
+		m_CurrentGameTick++;
+		NewTicks = true;
+		if((m_CurrentGameTick%2) == 0)
+			ShouldSnap = true;
+
+		ApplyInputs();
+		GameServer()->OnTick();
+		if(m_Metrics.IsOpen())
+			m_Metrics.Observe(m_aMetrics[METRIC_TICK_DURATION], (time_get()-TickStart)/(double)time_freq());
+	}
+	UpdateLoad();
+
+	// snap game
+	if(NewTicks)
+	{
+		if(Config()->m_SvHighBandwidth || ShouldSnap)
+		{
+			CProfileScope SnapshotScope(&m_Profiler, m_aProfilePhases[PROFILE_SNAPSHOT]);
+			CTraceScope SnapshotTraceScope("DoSnapshot");
+			DoSnapshot();
+		}
+
+		CProfileScope RconScope(&m_Profiler, m_aProfilePhases[PROFILE_RCON_UPDATE]);
+		CTraceScope RconTraceScope("RconUpdate");
+		UpdateClientRconCommands();
+		if(!m_Overloaded)
+			UpdateClientMapListEntries();
+	}
+
+	// master server stuff
+	{
+		CProfileScope RegisterScope(&m_Profiler, m_aProfilePhases[PROFILE_REGISTER]);
+		CTraceScope RegisterTraceScope("RegisterUpdate");
+		m_Register.RegisterUpdate(m_NetServer.NetType());
+	}
+
+	{
+		CProfileScope NetworkScope(&m_Profiler, m_aProfilePhases[PROFILE_NETWORK]);
+		CTraceScope NetworkTraceScope("PumpNetwork");
+		PumpNetwork();
 	}
+
+	if(m_NetServer.ReplayFinished())
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "replay finished");
+		m_RunServer = false;
+	}
+
+	// the frame ends before waiting
+	if(m_Profiler.IsEnabled())
+		m_Profiler.Add(m_aProfilePhases[PROFILE_FRAME], time_get()-FrameStart);
+}
+
+void CServer::UpdateLoad()
+{
+	if(m_NumLoadTicks < SERVER_TICK_SPEED)
+		return;
+
+	// overload starts with a second of many late ticks and ends with one without any
+	bool Overloaded = m_Overloaded;
+	if(!Config()->m_SvLoadShedding)
+		Overloaded = false;
+	else if(m_NumLateTicks >= OVERLOAD_LATE_TICKS)
+		Overloaded = true;
+	else if(m_NumLateTicks == 0)
+		Overloaded = false;
+
+	if(Overloaded != m_Overloaded)
+	{
+		char aBuf[256];
+		int NumClients = 0;
+		for(int c = 0; c < MAX_CLIENTS; c++)
+			if(m_aClients[c].m_State != CClient::STATE_EMPTY)
+				NumClients++;
+		if(Overloaded)
+			str_format(aBuf, sizeof(aBuf), "tick overload, shedding load. late_ticks=%d/%d max_lateness=%dms clients=%d",
+				m_NumLateTicks, m_NumLoadTicks, (int)(m_MaxTickLateness*1000/time_freq()), NumClients);
+		else
+			str_copy(aBuf, "tick load back to normal", sizeof(aBuf));
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+		m_Overloaded = Overloaded;
+	}
+
+	m_NumLateTicks = 0;
+	m_NumLoadTicks = 0;
+	m_MaxTickLateness = 0;
+}
+
+void CServer::UpdateHibernation()
+{
+	bool Empty = Config()->m_SvHibernate && !m_DemoRecorder.IsRecording() && !m_NetReplay.IsOpen();
+	for(int c = 0; c < MAX_CLIENTS && Empty; c++)
+		if(m_aClients[c].m_State != CClient::STATE_EMPTY)
+			Empty = false;
+	if(Empty == m_Hibernating)
+		return;
+
+	m_Hibernating = Empty;
+	if(!m_Hibernating)
+	{
+		// go on from the tick it stopped at instead of catching up on the time slept
+		m_GameStartTime = time_get() - time_freq()*m_CurrentGameTick/SERVER_TICK_SPEED;
+	}
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", m_Hibernating ? "hibernating" : "waking up");
+}
+
+int64 CServer::WakeupTime()
+{
+	if(m_Hibernating)
+		return time_get() + time_freq();
+
+	// wake up at least every half tick for the work that doesn't come in as packets
+	int64 SpinStart = TickStartTime(m_CurrentGameTick+1) - Config()->m_SvTickSpin*time_freq()/1000000;
+	return min(SpinStart, time_get() + time_freq()/SERVER_TICK_SPEED/2);
+}
+
+void CServer::WaitForTick()
+{
+	int64 Wakeup = WakeupTime();
+	if(m_NetServer.WaitUntil(Wakeup))
+		return;
+
+	// the system might wake us up too late for the tick, poll the socket until it is due instead
+	int64 Deadline = TickStartTime(m_CurrentGameTick+1);
+	if(m_Hibernating || Wakeup < Deadline - Config()->m_SvTickSpin*time_freq()/1000000)
+		return;
+	while(time_get() < Deadline && !m_NetServer.WaitUntil(0))
+		thread_yield();
+}
+
+int CServer::Run()
+{
+	if(!Start())
+		return -1;
+
+	CThreadTopology::Enter(CThreadTopology::CLASS_TICK, "server");
+	while(m_RunServer)
+	{
+		Frame();
+
+		WaitForTick();
+	}
+
+	Stop();
+	return 0;
+}
+
+void CServer::Stop()
+{
 	// disconnect all clients on shutdown
+	if(CTracer::IsRecording())
+		ConTraceStop(0, this);
 	m_NetServer.Close();
+	m_NetCapture.Close();
+	m_NetReplay.Close();
 	m_Econ.Shutdown();
+	m_Metrics.Close();
+	m_DemoStream.Close();
+	StopSnapWorkers();
 
 	GameServer()->OnShutdown();
 	m_pMap->Unload();
 
+	FinishPreload();
+	if(m_PreloadedMap.m_pData)
+	{
+		mem_free(m_PreloadedMap.m_pData);
+		m_PreloadedMap.m_pData = 0;
+	}
 	if(m_pCurrentMapData)
 	{
 		mem_free(m_pCurrentMapData);
 		m_pCurrentMapData = 0;
 	}
+	if(m_pMapChunkMsgs)
+	{
+		mem_free(m_pMapChunkMsgs);
+		m_pMapChunkMsgs = 0;
+	}
 	if(m_pMapListHeap)
 	{
 		delete m_pMapListHeap;
 		m_pMapListHeap = 0;
 	}
-	return 0;
+	if(m_paRemovedMapNames)
+	{
+		mem_free(m_paRemovedMapNames);
+		m_paRemovedMapNames = 0;
+	}
+}
+
+void CServer::ListMaps()
+{
+	CSubdirCallbackUserdata Userdata;
+	Userdata.m_pServer = this;
+	str_copy(Userdata.m_aName, "", sizeof(Userdata.m_aName));
+	m_pStorage->ListDirectory(IStorage::TYPE_ALL, "maps/", MapListEntryCallback, &Userdata);
+}
+
+static bool CompareMapListEntries(const CServer::CMapListEntry *pA, const CServer::CMapListEntry *pB)
+{
+	return str_comp(pA->m_aName, pB->m_aName) < 0;
+}
+
+static bool FindMapListEntry(const CServer::CMapListEntry **ppSorted, int Num, const CServer::CMapListEntry *pEntry)
+{
+	return std::binary_search(ppSorted, ppSorted+Num, pEntry, CompareMapListEntries);
+}
+
+void CServer::ReloadMapList()
+{
+	// keep the old list around and rescan the maps into a new one
+	CHeap *pOldHeap = m_pMapListHeap;
+	CMapListEntry *pOldFirst = m_pFirstMapEntry;
+	int NumOld = m_NumMapEntries;
+	m_pMapListHeap = new CHeap();
+	m_pFirstMapEntry = 0;
+	m_pLastMapEntry = 0;
+	m_NumMapEntries = 0;
+	ListMaps();
+	CHeap *pScannedHeap = m_pMapListHeap;
+	CMapListEntry *pScannedFirst = m_pFirstMapEntry;
+	int NumScanned = m_NumMapEntries;
+
+	const CMapListEntry **ppOld = (const CMapListEntry **)mem_alloc(sizeof(CMapListEntry *)*(NumOld+1), 1);
+	const CMapListEntry **ppOldSorted = (const CMapListEntry **)mem_alloc(sizeof(CMapListEntry *)*(NumOld+1), 1);
+	const CMapListEntry **ppScannedSorted = (const CMapListEntry **)mem_alloc(sizeof(CMapListEntry *)*(NumScanned+1), 1);
+	CMapListEntry **ppRetained = (CMapListEntry **)mem_alloc(sizeof(CMapListEntry *)*(NumOld+1), 1);
+	int i = 0;
+	for(const CMapListEntry *pEntry = pOldFirst; pEntry; pEntry = pEntry->m_pNext, i++)
+		ppOld[i] = ppOldSorted[i] = pEntry;
+	i = 0;
+	for(const CMapListEntry *pEntry = pScannedFirst; pEntry; pEntry = pEntry->m_pNext, i++)
+		ppScannedSorted[i] = pEntry;
+	std::sort(ppOldSorted, ppOldSorted+NumOld, CompareMapListEntries);
+	std::sort(ppScannedSorted, ppScannedSorted+NumScanned, CompareMapListEntries);
+
+	// retained maps keep their order, new ones are appended so clients only need the tail
+	m_pMapListHeap = new CHeap();
+	m_pFirstMapEntry = 0;
+	m_pLastMapEntry = 0;
+	m_NumMapEntries = 0;
+	int NumRemoved = 0;
+	for(i = 0; i < NumOld; i++)
+	{
+		ppRetained[i] = 0;
+		if(FindMapListEntry(ppScannedSorted, NumScanned, ppOld[i]))
+			ppRetained[i] = AddMapListEntry(ppOld[i]->m_aName);
+		else
+			NumRemoved++;
+	}
+	CMapListEntry *pFirstAdded = 0;
+	for(const CMapListEntry *pEntry = pScannedFirst; pEntry; pEntry = pEntry->m_pNext)
+	{
+		if(FindMapListEntry(ppOldSorted, NumOld, pEntry))
+			continue;
+		CMapListEntry *pAdded = AddMapListEntry(pEntry->m_aName);
+		if(!pFirstAdded)
+			pFirstAdded = pAdded;
+	}
+
+	// queue the removals, the queue starts over once every client got it
+	bool RemovalsPending = false;
+	for(int ClientID = 0; ClientID < MAX_CLIENTS; ClientID++)
+		if(m_aClients[ClientID].m_MapListSubscribed && m_aClients[ClientID].m_MapListRemovedToSend < m_NumRemovedMapNames)
+			RemovalsPending = true;
+	if(!RemovalsPending)
+	{
+		m_NumRemovedMapNames = 0;
+		for(int ClientID = 0; ClientID < MAX_CLIENTS; ClientID++)
+			m_aClients[ClientID].m_MapListRemovedToSend = 0;
+	}
+	if(m_NumRemovedMapNames+NumRemoved > m_MaxRemovedMapNames)
+	{
+		int NewMax = max(m_MaxRemovedMapNames*2, m_NumRemovedMapNames+NumRemoved);
+		char (*paNames)[IConsole::TEMPMAP_NAME_LENGTH] = (char (*)[IConsole::TEMPMAP_NAME_LENGTH])mem_alloc(sizeof(*paNames)*NewMax, 1);
+		if(m_paRemovedMapNames)
+		{
+			mem_copy(paNames, m_paRemovedMapNames, sizeof(*paNames)*m_NumRemovedMapNames);
+			mem_free(m_paRemovedMapNames);
+		}
+		m_paRemovedMapNames = paNames;
+		m_MaxRemovedMapNames = NewMax;
+	}
+	for(i = 0; i < NumOld; i++)
+		if(!ppRetained[i])
+			str_copy(m_paRemovedMapNames[m_NumRemovedMapNames++], ppOld[i]->m_aName, sizeof(m_paRemovedMapNames[0]));
+
+	// move the cursors of the subscribed clients over to the new list
+	for(int ClientID = 0; ClientID < MAX_CLIENTS; ClientID++)
+	{
+		CClient *pClient = &m_aClients[ClientID];
+		if(!pClient->m_MapListSubscribed)
+			continue;
+		CMapListEntry *pCursor = pFirstAdded;
+		if(pClient->m_pMapListEntryToSend)
+		{
+			for(i = 0; i < NumOld && ppOld[i] != pClient->m_pMapListEntryToSend; i++);
+			for(; i < NumOld; i++)
+			{
+				if(ppRetained[i])
+				{
+					pCursor = ppRetained[i];
+					break;
+				}
+			}
+		}
+		pClient->m_pMapListEntryToSend = pCursor;
+	}
+
+	char aBuf[128];
+	str_format(aBuf, sizeof(aBuf), "map list reloaded. maps=%d added=%d removed=%d", m_NumMapEntries, m_NumMapEntries-(NumOld-NumRemoved), NumRemoved);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+
+	mem_free(ppOld);
+	mem_free(ppOldSorted);
+	mem_free(ppScannedSorted);
+	mem_free(ppRetained);
+	delete pOldHeap;
+	delete pScannedHeap;
+}
+
+CServer::CMapListEntry *CServer::AddMapListEntry(const char *pName)
+{
+	CMapListEntry *pEntry = (CMapListEntry *)m_pMapListHeap->Allocate(sizeof(CMapListEntry));
+	m_NumMapEntries++;
+	pEntry->m_pNext = 0;
+	pEntry->m_pPrev = m_pLastMapEntry;
+	if(pEntry->m_pPrev)
+		pEntry->m_pPrev->m_pNext = pEntry;
+	m_pLastMapEntry = pEntry;
+	if(!m_pFirstMapEntry)
+		m_pFirstMapEntry = pEntry;
+	str_copy(pEntry->m_aName, pName, sizeof(pEntry->m_aName));
+	return pEntry;
 }
 
 int CServer::MapListEntryCallback(const char *pFilename, int IsDir, int DirType, void *pUser)
@@ -1526,17 +3153,9 @@ int CServer::MapListEntryCallback(const char *pFilename, int IsDir, int DirType,
 			return 0;
 	}
 
-	CMapListEntry *pEntry = (CMapListEntry *)pThis->m_pMapListHeap->Allocate(sizeof(CMapListEntry));
-	pThis->m_NumMapEntries++;
-	pEntry->m_pNext = 0;
-	pEntry->m_pPrev = pThis->m_pLastMapEntry;
-	if(pEntry->m_pPrev)
-		pEntry->m_pPrev->m_pNext = pEntry;
-	pThis->m_pLastMapEntry = pEntry;
-	if(!pThis->m_pFirstMapEntry)
-		pThis->m_pFirstMapEntry = pEntry;
-
-	str_truncate(pEntry->m_aName, sizeof(pEntry->m_aName), aFilename, pSuffix-aFilename);
+	char aName[IConsole::TEMPMAP_NAME_LENGTH];
+	str_truncate(aName, sizeof(aName), aFilename, pSuffix-aFilename);
+	pThis->AddMapListEntry(aName);
 
 	return 0;
 }
@@ -1592,6 +3211,7 @@ void CServer::DemoRecorder_HandleAutoStart()
 		char aDate[20];
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/%s_%s.demo", "auto/autorecord", aDate);
+		m_DemoRecorder.SetWriterQueue(Config()->m_SvDemoQueue*1024);
 		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameServer()->NetVersion(), m_aCurrentMap, m_CurrentMapSha256, m_CurrentMapCrc, "server");
 		if(Config()->m_SvAutoDemoMax)
 		{
@@ -1619,6 +3239,7 @@ void CServer::ConRecord(IConsole::IResult *pResult, void *pUser)
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/demo_%s.demo", aDate);
 	}
+	pServer->m_DemoRecorder.SetWriterQueue(pServer->Config()->m_SvDemoQueue*1024);
 	pServer->m_DemoRecorder.Start(pServer->Storage(), pServer->Console(), aFilename, pServer->GameServer()->NetVersion(), pServer->m_aCurrentMap, pServer->m_CurrentMapSha256, pServer->m_CurrentMapCrc, "server");
 }
 
@@ -1632,6 +3253,131 @@ void CServer::ConMapReload(IConsole::IResult *pResult, void *pUser)
 	((CServer *)pUser)->m_MapReload = true;
 }
 
+void CServer::ConReloadMapList(IConsole::IResult *pResult, void *pUser)
+{
+	((CServer *)pUser)->ReloadMapList();
+}
+
+void CServer::ConProfile(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	if(!pThis->m_Profiler.IsEnabled())
+	{
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profile", "profiler is disabled, enable it with sv_profile 1");
+		return;
+	}
+
+	char aBuf[256];
+	for(int i = 0; i < pThis->m_Profiler.NumPhases(); i++)
+	{
+		pThis->m_Profiler.FormatStats(i, aBuf, sizeof(aBuf));
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profile", aBuf);
+	}
+}
+
+void CServer::ConProfileReset(IConsole::IResult *pResult, void *pUser)
+{
+	static_cast<CServer *>(pUser)->m_Profiler.Reset();
+}
+
+void CServer::ConConnlessStats(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	const CNetConnlessLimiter *pLimiter = pThis->m_NetServer.ConnlessLimiter();
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "accepted=%u dropped_source=%u dropped_global=%u",
+		pLimiter->NumAccepted(), pLimiter->NumDroppedSource(), pLimiter->NumDroppedGlobal());
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "connless", aBuf);
+}
+
+void CServer::ConNetStats(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	char aBuf[512];
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(pThis->m_aClients[i].m_State == CClient::STATE_EMPTY)
+			continue;
+		pThis->FormatNetStats(i, aBuf, sizeof(aBuf));
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_stats", aBuf);
+	}
+
+	if(pResult->NumArguments())
+	{
+		char aFilename[128];
+		str_format(aFilename, sizeof(aFilename), "dumps/%s.json", pResult->GetString(0));
+		if(pThis->DumpNetStats(aFilename))
+			str_format(aBuf, sizeof(aBuf), "stats written to '%s'", aFilename);
+		else
+			str_format(aBuf, sizeof(aBuf), "failed to open '%s'", aFilename);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_stats", aBuf);
+	}
+}
+
+void CServer::ConStatusPerf(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+
+	// most expensive clients first
+	int aOrder[MAX_CLIENTS];
+	int aTotal[MAX_CLIENTS];
+	int Num = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		const CClient *pClient = &pThis->m_aClients[i];
+		if(pClient->m_State == CClient::STATE_EMPTY)
+			continue;
+		aTotal[i] = 0;
+		for(int c = 0; c < CClient::NUM_COSTS; c++)
+			aTotal[i] += pClient->m_aCostRates[c];
+		int j = Num++;
+		for(; j > 0 && aTotal[aOrder[j-1]] < aTotal[i]; j--)
+			aOrder[j] = aOrder[j-1];
+		aOrder[j] = i;
+	}
+
+	char aBuf[256];
+	for(int k = 0; k < Num; k++)
+	{
+		int i = aOrder[k];
+		const CClient *pClient = &pThis->m_aClients[i];
+		str_format(aBuf, sizeof(aBuf), "id=%d name='%s' cpu=%dus/s (messages=%d rcon=%d maplist=%d snapshots=%d) out=%u B/s in=%u B/s",
+			i, pClient->m_aName, aTotal[i], pClient->m_aCostRates[CClient::COST_MESSAGES], pClient->m_aCostRates[CClient::COST_RCON],
+			pClient->m_aCostRates[CClient::COST_MAPLIST], pClient->m_aCostRates[CClient::COST_SNAPSHOTS],
+			pClient->m_NetRates.m_SentBytes, pClient->m_NetRates.m_RecvBytes);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "status_perf", aBuf);
+	}
+}
+
+void CServer::ConTraceStart(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	if(pResult->NumArguments())
+		str_format(pThis->m_aTraceFilename, sizeof(pThis->m_aTraceFilename), "dumps/%s.json", pResult->GetString(0));
+	else
+	{
+		char aDate[20];
+		str_timestamp(aDate, sizeof(aDate));
+		str_format(pThis->m_aTraceFilename, sizeof(pThis->m_aTraceFilename), "dumps/trace_server_%s.json", aDate);
+	}
+	CTracer::Start();
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "trace", "recording");
+}
+
+void CServer::ConTraceStop(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	if(!CTracer::IsRecording())
+		return;
+
+	char aBuf[256];
+	if(CTracer::Stop(pThis->Storage()->OpenFile(pThis->m_aTraceFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE)))
+		str_format(aBuf, sizeof(aBuf), "trace written to '%s'", pThis->m_aTraceFilename);
+	else
+		str_format(aBuf, sizeof(aBuf), "failed to open '%s'", pThis->m_aTraceFilename);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "trace", aBuf);
+}
+
 void CServer::ConLogout(IConsole::IResult *pResult, void *pUser)
 {
 	CServer *pServer = (CServer *)pUser;
@@ -1646,6 +3392,7 @@ void CServer::ConLogout(IConsole::IResult *pResult, void *pUser)
 		pServer->m_aClients[pServer->m_RconClientID].m_AuthTries = 0;
 		pServer->m_aClients[pServer->m_RconClientID].m_pRconCmdToSend = 0;
 		pServer->m_aClients[pServer->m_RconClientID].m_pMapListEntryToSend = 0;
+		pServer->m_aClients[pServer->m_RconClientID].m_MapListSubscribed = false;
 		pServer->SendRconLine(pServer->m_RconClientID, "Logout successful.");
 		char aBuf[32];
 		str_format(aBuf, sizeof(aBuf), "ClientID=%d logged out", pServer->m_RconClientID);
@@ -1660,6 +3407,7 @@ void CServer::ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserD
 	if(pResult->NumArguments())
 	{
 		str_clean_whitespaces(pSelf->Config()->m_SvName);
+		pSelf->ExpireServerInfo();
 		pSelf->SendServerInfo(-1);
 	}
 }
@@ -1764,9 +3512,21 @@ void CServer::RegisterCommands()
 	Console()->Register("stoprecord", "", CFGFLAG_SERVER, ConStopRecord, this, "Stop recording");
 
 	Console()->Register("reload", "", CFGFLAG_SERVER, ConMapReload, this, "Reload the map");
+	Console()->Register("reload_maplist", "", CFGFLAG_SERVER, ConReloadMapList, this, "Rescan the maps folder and send the changes to the clients");
+
+	Console()->Register("profile", "", CFGFLAG_SERVER, ConProfile, this, "List the timings of the server loop phases");
+	Console()->Register("profile_reset", "", CFGFLAG_SERVER, ConProfileReset, this, "Clear the timings of the server loop phases");
+	Console()->Register("connless_stats", "", CFGFLAG_SERVER, ConConnlessStats, this, "Show how many packets without a connection were accepted and dropped");
+	Console()->Register("net_stats", "?s[file]", CFGFLAG_SERVER, ConNetStats, this, "Show the network stats of each client, optionally write them to dumps/<file>.json");
+	Console()->Register("status_perf", "", CFGFLAG_SERVER, ConStatusPerf, this, "List the clients by the server time and bandwidth they used in the last second");
+	Console()->Register("trace_start", "?s[file]", CFGFLAG_SERVER, ConTraceStart, this, "Start recording a trace of the server threads");
+	Console()->Register("trace_stop", "", CFGFLAG_SERVER, ConTraceStop, this, "Stop recording the trace and write it to dumps/");
 
 	Console()->Chain("sv_name", ConchainSpecialInfoupdate, this);
 	Console()->Chain("password", ConchainSpecialInfoupdate, this);
+	Console()->Chain("sv_hostname", ConchainSpecialInfoupdate, this);
+	Console()->Chain("sv_skill_level", ConchainSpecialInfoupdate, this);
+	Console()->Chain("sv_player_slots", ConchainSpecialInfoupdate, this);
 
 	Console()->Chain("sv_player_slots", ConchainPlayerSlotsUpdate, this);
 	Console()->Chain("sv_max_clients", ConchainMaxclientsUpdate, this);
@@ -1798,51 +3558,71 @@ void *CServer::SnapNewItem(int Type, int ID, int Size)
 {
 	dbg_assert(Type >= 0 && Type <=0xffff, "incorrect type");
 	dbg_assert(ID >= 0 && ID <=0xffff, "incorrect id");
-	return ID < 0 ? 0 : m_SnapshotBuilder.NewItem(Type, ID, Size);
+	if(ID < 0)
+		return 0;
+	return gs_pSnapBuilder ? gs_pSnapBuilder->NewItem(Type, ID, Size) : m_SnapshotBuilder.NewItem(Type, ID, Size);
+}
+
+void *CServer::SnapNewSharedItem(int Type, int ID, int Size, const CClientMask &ClientMask)
+{
+	dbg_assert(Type >= 0 && Type <=0xffff, "incorrect type");
+	dbg_assert(ID >= 0 && ID <=0xffff, "incorrect id");
+	dbg_assert(m_SnappingShared, "shared items can only be added in OnSnapShared");
+	// nobody would get this item
+	if(ClientMask.empty() && !m_DemoRecorder.IsRecording())
+		return 0;
+	void *pData = m_SharedSnapshotBuilder.NewItem(Type, ID, Size);
+	if(pData)
+		m_aSharedItemMasks[m_SharedSnapshotBuilder.NumItems()-1] = ClientMask;
+	return pData;
 }
 
 void CServer::SnapSetStaticsize(int ItemType, int Size)
 {
 	m_SnapshotDelta.SetStaticsize(ItemType, Size);
+	for(int i = 0; i < m_NumSnapWorkers; i++)
+		m_apSnapWorkers[i]->m_Delta.SetStaticsize(ItemType, Size);
+}
+
+void CServer::SnapSetFieldBits(int ItemType, const unsigned char *pBits, int Num)
+{
+	m_SnapshotDelta.SetFieldBits(ItemType, pBits, Num);
+	for(int i = 0; i < m_NumSnapWorkers; i++)
+		m_apSnapWorkers[i]->m_Delta.SetFieldBits(ItemType, pBits, Num);
 }
 
 static CServer *CreateServer() { return new CServer(); }
 
-int main(int argc, const char **argv) // ignore_convention
-{
-#if defined(CONF_FAMILY_WINDOWS)
-	for(int i = 1; i < argc; i++) // ignore_convention
-	{
-		if(str_comp("-s", argv[i]) == 0 || str_comp("--silent", argv[i]) == 0) // ignore_convention
-		{
-			ShowWindow(GetConsoleWindow(), SW_HIDE);
-			break;
-		}
-	}
-#endif
+// the components of one server, several of them can share a process
+static const int MAX_SERVER_INSTANCES = 64;
 
-	bool UseDefaultConfig = false;
-	for(int i = 1; i < argc; i++) // ignore_convention
-	{
-		if(str_comp("-d", argv[i]) == 0 || str_comp("--default", argv[i]) == 0) // ignore_convention
-		{
-			UseDefaultConfig = true;
-			break;
-		}
-	}
+struct CServerInstance
+{
+	CServer *m_pServer;
+	IKernel *m_pKernel;
+	IEngine *m_pEngine;
+	IEngineMap *m_pEngineMap;
+	IGameServer *m_pGameServer;
+	IConsole *m_pConsole;
+	IEngineMasterServer *m_pEngineMasterServer;
+	IStorage *m_pStorage;
+	IConfigManager *m_pConfigManager;
+	bool m_Stopped;
 
-	if(secure_random_init() != 0)
-	{
-		dbg_msg("secure", "could not initialize secure RNG");
-		return -1;
-	}
+	// the socket the host waits on, if the instance doesn't read it on another thread
+	NETSOCKET m_Socket;
+	bool m_Waitable;
+};
 
+// pConfigFile is executed after the command line, so it can set the instance's own port and map
+static bool CreateInstance(CServerInstance *pInstance, int argc, const char **argv, bool UseDefaultConfig, const char *pConfigFile, CJobPool *pSharedJobPool) // ignore_convention
+{
 	CServer *pServer = CreateServer();
 	IKernel *pKernel = IKernel::Create();
 
 	// create the components
 	int FlagMask = CFGFLAG_SERVER|CFGFLAG_ECON;
-	IEngine *pEngine = CreateEngine("Teeworlds_Server");
+	IEngine *pEngine = CreateEngine("Teeworlds_Server", pSharedJobPool);
 	IEngineMap *pEngineMap = CreateEngineMap();
 	IGameServer *pGameServer = CreateGameServer();
 	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER|CFGFLAG_ECON);
@@ -1850,6 +3630,18 @@ int main(int argc, const char **argv) // ignore_convention
 	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_SERVER, argc, argv); // ignore_convention
 	IConfigManager *pConfigManager = CreateConfigManager();
 
+	pInstance->m_pServer = pServer;
+	pInstance->m_pKernel = pKernel;
+	pInstance->m_pEngine = pEngine;
+	pInstance->m_pEngineMap = pEngineMap;
+	pInstance->m_pGameServer = pGameServer;
+	pInstance->m_pConsole = pConsole;
+	pInstance->m_pEngineMasterServer = pEngineMasterServer;
+	pInstance->m_pStorage = pStorage;
+	pInstance->m_pConfigManager = pConfigManager;
+	pInstance->m_Stopped = false;
+	pInstance->m_Waitable = false;
+
 	pServer->InitRegister(&pServer->m_NetServer, pEngineMasterServer, pConfigManager->Values(), pConsole);
 
 	{
@@ -1867,7 +3659,7 @@ int main(int argc, const char **argv) // ignore_convention
 		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IMasterServer*>(pEngineMasterServer));
 
 		if(RegisterFail)
-			return -1;
+			return false;
 	}
 
 	pEngine->Init();
@@ -1888,29 +3680,204 @@ int main(int argc, const char **argv) // ignore_convention
 		// parse the command line arguments
 		if(argc > 1) // ignore_convention
 			pConsole->ParseArguments(argc-1, &argv[1]); // ignore_convention
+
+		if(pConfigFile)
+			pConsole->ExecuteFile(pConfigFile);
 	}
 
 	// restore empty config strings to their defaults
 	pConfigManager->RestoreStrings();
 
-	pEngine->InitLogfile();
+	// the threads of the process get the settings of the first instance
+	CThreadTopology::Configure(pConfigManager->Values());
+
+	// the loggers are the same for the whole process
+	if(!pSharedJobPool)
+		pEngine->InitLogfile();
 
 	pServer->InitRconPasswordIfUnset();
+	return true;
+}
+
+static void DestroyInstance(CServerInstance *pInstance)
+{
+	delete pInstance->m_pServer;
+	delete pInstance->m_pKernel;
+	delete pInstance->m_pEngine;
+	delete pInstance->m_pEngineMap;
+	delete pInstance->m_pGameServer;
+	delete pInstance->m_pConsole;
+	delete pInstance->m_pEngineMasterServer;
+	delete pInstance->m_pStorage;
+	delete pInstance->m_pConfigManager;
+}
 
-	// run the server
-	dbg_msg("server", "starting...");
-	int Ret = pServer->Run();
-
-	// free
-	delete pServer;
-	delete pKernel;
-	delete pEngine;
-	delete pEngineMap;
-	delete pGameServer;
-	delete pConsole;
-	delete pEngineMasterServer;
-	delete pStorage;
-	delete pConfigManager;
+struct CInstanceFrames
+{
+	CServerInstance *m_pInstances;
+	const int *m_pIndices;
+};
+
+static void InstanceFrames(int Begin, int End, void *pUser)
+{
+	CInstanceFrames *pFrames = (CInstanceFrames *)pUser;
+	for(int i = Begin; i < End; i++)
+		pFrames->m_pInstances[pFrames->m_pIndices[i]].m_pServer->Frame();
+}
+
+// drives all the instances from one loop, their frames run in parallel on the job pool
+static void RunInstances(CServerInstance *pInstances, int NumInstances, CJobPool *pJobPool)
+{
+	CThreadTopology::Enter(CThreadTopology::CLASS_TICK, "server");
+	while(1)
+	{
+		// stop the instances that were shut down, the others get a frame if they have something to do
+		int aDue[MAX_SERVER_INSTANCES];
+		int NumDue = 0;
+		int NumRunning = 0;
+		for(int i = 0; i < NumInstances; i++)
+		{
+			CServerInstance *pInstance = &pInstances[i];
+			if(pInstance->m_Stopped)
+				continue;
+			if(!pInstance->m_pServer->IsRunning())
+			{
+				pInstance->m_pServer->Stop();
+				pInstance->m_Stopped = true;
+				continue;
+			}
+
+			NumRunning++;
+			if(!pInstance->m_Waitable || pInstance->m_pServer->TickPending() || net_socket_read_wait(pInstance->m_Socket, 0))
+				aDue[NumDue++] = i;
+		}
+		if(!NumRunning)
+			break;
+
+		// a frame that waits for its own parallel work can run other frames meanwhile, they don't share anything
+		CInstanceFrames Frames;
+		Frames.m_pInstances = pInstances;
+		Frames.m_pIndices = aDue;
+		pJobPool->ParallelFor(0, NumDue, 1, InstanceFrames, &Frames);
+
+		NETSOCKET aSockets[MAX_SERVER_INSTANCES];
+		int NumSockets = 0;
+		int64 Wakeup = time_get() + time_freq();
+		for(int i = 0; i < NumInstances; i++)
+		{
+			CServerInstance *pInstance = &pInstances[i];
+			if(pInstance->m_Stopped)
+				continue;
+			Wakeup = min(Wakeup, pInstance->m_pServer->WakeupTime());
+			pInstance->m_Waitable = pInstance->m_pServer->PrepareWait(&pInstance->m_Socket);
+			if(pInstance->m_Waitable)
+				aSockets[NumSockets++] = pInstance->m_Socket;
+		}
+
+		// wait for incoming data, a network thread only fills a queue so look at it every millisecond
+		if(NumSockets == NumRunning)
+			net_socket_read_wait_any(aSockets, NumSockets, max(Wakeup-time_get(), int64(0))*1000000/time_freq());
+		else
+			thread_sleep(1);
+	}
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		if(str_comp("-s", argv[i]) == 0 || str_comp("--silent", argv[i]) == 0) // ignore_convention
+		{
+			ShowWindow(GetConsoleWindow(), SW_HIDE);
+			break;
+		}
+	}
+#endif
+
+	// take the instances out of the arguments, the rest applies to all of them
+	bool UseDefaultConfig = false;
+	const char *apInstanceConfigs[MAX_SERVER_INSTANCES];
+	int NumInstances = 0;
+	const char **ppArgs = (const char **)mem_alloc(sizeof(const char *)*(argc+1), 1); // ignore_convention
+	int NumArgs = 0;
+	for(int i = 0; i < argc; i++) // ignore_convention
+	{
+		if(i > 0 && (str_comp("-d", argv[i]) == 0 || str_comp("--default", argv[i]) == 0)) // ignore_convention
+			UseDefaultConfig = true;
+
+		if(i > 0 && i+1 < argc && str_comp("--instance", argv[i]) == 0) // ignore_convention
+		{
+			if(NumInstances == MAX_SERVER_INSTANCES)
+			{
+				dbg_msg("server", "too many instances, at most %d are possible", (int)MAX_SERVER_INSTANCES);
+				mem_free(ppArgs);
+				return -1;
+			}
+			apInstanceConfigs[NumInstances++] = argv[++i]; // ignore_convention
+			continue;
+		}
+		ppArgs[NumArgs++] = argv[i]; // ignore_convention
+	}
+	ppArgs[NumArgs] = 0;
+
+	if(secure_random_init() != 0)
+	{
+		dbg_msg("secure", "could not initialize secure RNG");
+		mem_free(ppArgs);
+		return -1;
+	}
+
+	int Ret = 0;
+	if(!NumInstances)
+	{
+		CServerInstance Instance;
+		if(CreateInstance(&Instance, NumArgs, ppArgs, UseDefaultConfig, 0, 0))
+		{
+			// run the server
+			dbg_msg("server", "starting...");
+			Ret = Instance.m_pServer->Run();
+		}
+		else
+			Ret = -1;
+
+		// free
+		DestroyInstance(&Instance);
+	}
+	else
+	{
+		// the first instance owns the job pool and the loggers
+		CServerInstance *pInstances = new CServerInstance[NumInstances];
+		int NumCreated = 0;
+		for(; NumCreated < NumInstances && Ret == 0; NumCreated++)
+		{
+			CJobPool *pSharedJobPool = NumCreated ? pInstances[0].m_pEngine->JobPool() : 0;
+			dbg_msg("server", "starting instance %d with '%s'...", NumCreated, apInstanceConfigs[NumCreated]);
+			if(!CreateInstance(&pInstances[NumCreated], NumArgs, ppArgs, UseDefaultConfig, apInstanceConfigs[NumCreated], pSharedJobPool) ||
+				!pInstances[NumCreated].m_pServer->Start())
+			{
+				// the earlier ones are started already, stop them as well
+				dbg_msg("server", "instance %d failed to start", NumCreated);
+				pInstances[NumCreated].m_Stopped = true;
+				Ret = -1;
+			}
+		}
+
+		if(Ret == 0)
+			RunInstances(pInstances, NumInstances, pInstances[0].m_pEngine->JobPool());
+		for(int i = 0; i < NumCreated; i++)
+		{
+			if(!pInstances[i].m_Stopped)
+				pInstances[i].m_pServer->Stop();
+		}
+
+		// the first engine goes last, the others use its job pool
+		for(int i = NumCreated-1; i >= 0; i--)
+			DestroyInstance(&pInstances[i]);
+		delete [] pInstances;
+	}
 
+	CScratch::ReleaseThread();
+	mem_free(ppArgs);
 	return Ret;
 }
@@ -5,6 +5,12 @@
 
 #include <engine/server.h>
 #include <engine/shared/memheap.h>
+#include <engine/shared/demostream.h>
+#include <engine/shared/inputbuffer.h>
+#include <engine/shared/metrics.h>
+#include <engine/shared/netcapture.h>
+#include <engine/shared/profiler.h>
+#include <engine/shared/tracer.h>
 
 class CSnapIDPool
 {
@@ -79,8 +85,12 @@ public:
 
 		MAX_RCONCMD_SEND=16,
 		MAX_MAPLISTENTRY_SEND = 32,
+		MAX_MAPLIST_BATCH_SEND = 2,
+		MAPLIST_BATCH_SIZE = 1024,
 		MIN_MAPLIST_CLIENTVERSION=0x0703,	// todo 0.8: remove me
 		MAX_RCONCMD_RATIO=8,
+
+		MAX_SNAP_THREADS=16,
 	};
 
 	struct CMapListEntry;
@@ -107,7 +117,6 @@ public:
 		{
 		public:
 			int m_aData[MAX_INPUT_SIZE];
-			int m_GameTick; // the tick that was chosen for the input
 		};
 
 		// connection state info
@@ -119,56 +128,210 @@ public:
 		int m_LastInputTick;
 		CSnapshotStorage m_Snapshots;
 
+		// bytes per snapshot the link was able to take, measured from the acked snapshots
+		enum
+		{
+			SNAP_HISTORY=32,
+		};
+		int m_aSentSnapTick[SNAP_HISTORY];
+		int m_aSentSnapSize[SNAP_HISTORY];
+		int m_SentSnapPos;
+		int m_NumSentSnaps;
+		int m_SentBytes;
+		int m_AckedBytes;
+		int64 m_ThroughputStart;
+		int m_SnapBudget; // 0 = unlimited
+		int m_NumDeferredItems;
+
+		// snapshot interval in ticks while the client runs at full rate, adapted to its link
+		int m_SnapInterval;
+		int m_NextSnapTick;
+		int m_MinLatency; // lowest ack latency in the current second, -1 = none yet
+		int m_BaseLatency; // slowly rising minimum ack latency, -1 = none yet
+		unsigned m_LastResends;
+
+		// connection counters at the last update and the rates per second since the one before
+		CNetConnStats m_NetStats;
+		CNetConnStats m_NetRates;
+
+		// server time spent on the client in ticks, totals and the rates per second of the last update
+		enum
+		{
+			COST_MESSAGES=0,
+			COST_RCON,
+			COST_MAPLIST,
+			COST_SNAPSHOTS,
+			NUM_COSTS
+		};
+		int64 m_aCostTotals[NUM_COSTS];
+		int64 m_aCostLast[NUM_COSTS];
+		int m_aCostRates[NUM_COSTS]; // microseconds per second
+
 		CInput m_LatestInput;
-		CInput m_aInputs[200]; // TODO: handle input better
-		int m_CurrentInput;
+		bool m_NewInput; // m_LatestInput wasn't applied yet
+		CInputBuffer m_Inputs;
 
 		char m_aName[MAX_NAME_ARRAY_SIZE];
 		char m_aClan[MAX_CLAN_ARRAY_SIZE];
 		int m_Version;
+		int m_Capabilities;
+		bool m_SnapBitpacked;
+		bool m_Relay; // a spectator that gets the world snapshot to serve it further, see tools/relay
 		int m_Country;
 		int m_Score;
 		int m_Authed;
 		int m_AuthTries;
 
 		int m_MapChunk;
+		int m_MapChunksPerRequest;
 		bool m_NoRconNote;
 		bool m_Quitting;
 		const IConsole::CCommandInfo *m_pRconCmdToSend;
 		const CMapListEntry *m_pMapListEntryToSend;
+		bool m_MapListSubscribed; // gets the map list and its changes
+		int m_MapListRemovedToSend; // next of the removed map names to send
 
 		void Reset();
 	};
 
+	// the snapshot histories of all clients, identical snapshots are only stored once
+	CSnapshotPool m_SnapshotPool;
 	CClient m_aClients[MAX_CLIENTS];
 
+	// packed server info after the token, the in-game info is the part before the player list
+	CPacker m_ServerInfo;
+	int m_ServerInfoSizeNoPlayers;
+	bool m_ServerInfoNeedsUpdate;
+
 	CSnapshotDelta m_SnapshotDelta;
 	CSnapshotBuilder m_SnapshotBuilder;
+
+	// items built once per tick for all clients, with the clients that see them
+	CSnapshotBuilder m_SharedSnapshotBuilder;
+	CClientMask m_aSharedItemMasks[CSnapshotBuilder::MAX_ITEMS];
+	bool m_SnappingShared;
+
+	// the snapshot of the whole world as demos record it, built once per tick for demos and relays
+	CSnapshot *m_pWorldSnap;
+	int m_WorldSnapSize;
+
+	// compressed snapshot delta for one client, ready to be sent
+	class CSnapResult
+	{
+	public:
+		int m_Crc;
+		int m_DeltaTick;
+		int m_Size;
+		const char *m_pData; // m_aData, or the data of a client with the same delta
+		char m_aData[CSnapshot::MAX_SIZE];
+	};
+
+	// clients that ack the same base and get the same snapshot share a delta,
+	// the cache lives for one tick and is append only
+	class CDeltaCacheEntry
+	{
+	public:
+		int m_DeltaTick;
+		int m_Crc;
+		int m_SnapshotSize;
+		int m_DeltashotSize;
+		bool m_Bitpacked;
+		const CSnapshot *m_pSnapshot;
+		const CSnapshot *m_pDeltashot;
+		const CSnapResult *m_pResult;
+	};
+
+	// per thread state for building client snapshots in parallel
+	class CSnapWorker
+	{
+	public:
+		CJob m_Job;
+		CServer *m_pServer;
+		CSnapshotBuilder m_Builder;
+		CSnapshotDelta m_Delta;
+		int m_aClients[MAX_CLIENTS];
+		int m_NumClients;
+	};
+
+	CJobPool m_SnapJobPool;
+	CJobGroup m_SnapJobGroup;
+	CSnapWorker *m_apSnapWorkers[MAX_SNAP_THREADS];
+	int m_NumSnapWorkers;
+	CSnapResult *m_pSnapResults;
+	CDeltaCacheEntry m_aDeltaCache[MAX_CLIENTS];
+	int m_NumDeltaCache;
+	LOCK m_DeltaCacheLock;
+
 	CSnapIDPool m_IDPool;
 	CNetServer m_NetServer;
 	CEcon m_Econ;
+	// sv_capture and sv_replay, only looked at on start
+	CNetCaptureWriter m_NetCapture;
+	CNetCaptureReader m_NetReplay;
 	CServerBan m_ServerBan;
 
 	IEngineMap *m_pMap;
 
 	int64 m_GameStartTime;
+	bool m_Hibernating; // empty, the game doesn't tick until someone connects
+
+	// sustained tick overruns shed optional work, see UpdateLoad
+	enum
+	{
+		OVERLOAD_LATE_TICKS=SERVER_TICK_SPEED/5, // late ticks per second that count as overload
+		OVERLOAD_SNAP_INTERVAL=5, // ticks between snapshots to spectators and demos while overloaded
+		MAX_TICK_BACKLOG=SERVER_TICK_SPEED, // ticks to catch up on before the rest is dropped
+	};
+	bool m_Overloaded;
+	int m_NumLateTicks;
+	int m_NumLoadTicks;
+	int64 m_MaxTickLateness;
 	bool m_RunServer;
 	bool m_MapReload;
 	int m_RconClientID;
 	int m_RconAuthLevel;
 	int m_PrintCBIndex;
+	int m_RconReentryGuard;
 
 	// map
 	enum
 	{
 		MAP_CHUNK_SIZE=NET_MAX_PAYLOAD-NET_MAX_CHUNKHEADERSIZE-4, // msg type
+		MAP_WINDOW_RTT=50, // ms, sv_map_download_speed is the window up to this round trip time
+		MAP_PREFETCH_CHUNK_SIZE=MAP_CHUNK_SIZE-10, // crc and chunk index
+		MAX_MAP_PREFETCH_CHUNKS_PER_REQUEST=4,
 	};
 	char m_aCurrentMap[64];
 	SHA256_DIGEST m_CurrentMapSha256;
 	unsigned m_CurrentMapCrc;
 	unsigned char *m_pCurrentMapData;
 	int m_CurrentMapSize;
-	int m_MapChunksPerRequest;
+
+	// a map with its download, ready to be switched to
+	struct CPreparedMap
+	{
+		SHA256_DIGEST m_FileSha256;
+		unsigned m_FileCrc;
+		int m_FileSize;
+		SHA256_DIGEST m_Sha256; // of the download
+		unsigned m_Crc;
+		unsigned char *m_pData;
+		int m_Size;
+		char m_aError[128];
+	};
+
+	// the next map, prepared on a thread while the current one is still played
+	char m_aPreloadMap[64];
+	void *m_pPreloadThread;
+	volatile bool m_PreloadDone; // the thread is about to end
+	bool m_PreloadSucceeded;
+	CPreparedMap m_PreloadedMap;
+
+	// every chunk of the current map packed as NETMSG_MAP_DATA, shared by all downloads.
+	// chunk i starts at i*m_MapChunkMsgSize, only the last one can be shorter
+	unsigned char *m_pMapChunkMsgs;
+	int m_MapChunkMsgSize;
+	int m_NumMapChunks;
 
 	//maplist
 	struct CMapListEntry
@@ -189,6 +352,11 @@ public:
 	CMapListEntry *m_pFirstMapEntry;
 	int m_NumMapEntries;
 
+	// maps removed by reloads, until every subscribed client got them
+	char (*m_paRemovedMapNames)[IConsole::TEMPMAP_NAME_LENGTH];
+	int m_NumRemovedMapNames;
+	int m_MaxRemovedMapNames;
+
 	int m_RconPasswordSet;
 	int m_GeneratedRconPassword;
 
@@ -196,6 +364,61 @@ public:
 	CRegister m_Register;
 	CMapChecker m_MapChecker;
 
+	enum
+	{
+		PROFILE_FRAME=0,
+		PROFILE_TICK,
+		PROFILE_SNAPSHOT,
+		PROFILE_RCON_UPDATE,
+		PROFILE_REGISTER,
+		PROFILE_NETWORK,
+		PROFILE_TICK_LATENESS,
+		NUM_PROFILE_PHASES
+	};
+	enum
+	{
+		MIN_SNAP_BUDGET=256,
+	};
+
+	CProfiler m_Profiler;
+	int m_aProfilePhases[NUM_PROFILE_PHASES];
+	int64 m_LastProfileReport;
+	char m_aTraceFilename[128];
+	int64 m_LastNetStatsUpdate;
+	int64 m_LastNetStatsDump;
+
+	enum
+	{
+		METRIC_TICK_DURATION=0,
+		METRIC_TICK_LATENESS,
+		METRIC_CLIENTS,
+		METRIC_PLAYERS,
+		METRIC_SNAPSHOT_BYTES,
+		METRIC_SENT_BYTES,
+		METRIC_RECV_BYTES,
+		METRIC_RESENDS,
+		METRIC_CONNLESS_RECV,
+		METRIC_CONNLESS_SENT,
+		METRIC_JOB_QUEUE,
+		METRIC_MEMORY,
+		METRIC_OVERLOADED,
+		METRIC_INPUTS_LATE,
+		METRIC_INPUTS_DROPPED,
+		METRIC_INPUTS_RECOVERED,
+		METRIC_CLIENT_MESSAGES,
+		METRIC_CLIENT_RCON,
+		METRIC_CLIENT_MAPLIST,
+		METRIC_CLIENT_SNAPSHOTS,
+		METRIC_CLIENT_SENT_BYTES,
+		METRIC_CLIENT_RECV_BYTES,
+		NUM_METRICS
+	};
+	CMetrics m_Metrics;
+	int m_aMetrics[NUM_METRICS];
+	int64 m_LastMetricsUpdate;
+
+	CDemoStream m_DemoStream;
+
 	CServer();
 
 	virtual void SetClientName(int ClientID, const char *pName);
@@ -208,6 +431,15 @@ public:
 	void DemoRecorder_HandleAutoStart();
 	bool DemoRecorder_IsRecording();
 
+	CProfiler *Profiler() { return &m_Profiler; }
+	void UpdateProfiler();
+	void UpdateNetStats();
+	void InitMetrics();
+	void UpdateMetrics();
+	void InitDemoStream();
+	void FormatNetStats(int ClientID, char *pBuf, int BufSize) const;
+	bool DumpNetStats(const char *pFilename);
+
 	int64 TickStartTime(int Tick);
 
 	int Init();
@@ -226,13 +458,30 @@ public:
 	bool ClientIngame(int ClientID) const;
 
 	virtual int SendMsg(CMsgPacker *pMsg, int Flags, int ClientID);
-
+	virtual int SendMsgMask(CMsgPacker *pMsg, int Flags, const CClientMask &ClientMask);
+	int SendPackedMsg(const void *pData, int Size, int Flags, const CClientMask &Receivers);
+
+	void CreateClientSnapshot(int ClientID, CSnapshotBuilder *pBuilder, CSnapshotDelta *pDelta, CSnapResult *pResult);
+	const CSnapResult *FindCachedDelta(int DeltaTick, int Crc, const CSnapshot *pSnapshot, int SnapshotSize, const CSnapshot *pDeltashot, int DeltashotSize, bool Bitpacked);
+	void SendClientSnapshot(int ClientID, const CSnapResult *pResult);
+	int ApplySnapBudget(int ClientID, CSnapshotBuilder *pBuilder, CSnapshot *pData, int SnapshotSize, const CSnapshot *pDeltashot, const CSnapshotHash *pDeltashotHash, char *pScratch);
+	void OnSnapshotAcked(int ClientID);
+	void UpdateSnapBudget(int ClientID);
+	void UpdateSnapRate(int ClientID);
+	void UpdateLinkState(int ClientID);
+	static int SnapWorkerThread(void *pUser);
+	void StartSnapWorkers(int NumThreads);
+	void StopSnapWorkers();
 	void DoSnapshot();
+	void ApplyInputs();
 
 	static int NewClientCallback(int ClientID, void *pUser);
 	static int DelClientCallback(int ClientID, const char *pReason, void *pUser);
 
+	void PackMapChunks();
+	int MapChunksPerRequest(int ClientID);
 	void SendMap(int ClientID);
+	void SendMapData(int ClientID);
 	void SendConnectionReady(int ClientID);
 	void SendRconLine(int ClientID, const char *pLine);
 	static void SendRconLineAuthed(const char *pLine, void *pUser, bool Highlighted);
@@ -241,25 +490,59 @@ public:
 	void SendRconCmdRem(const IConsole::CCommandInfo *pCommandInfo, int ClientID);
 	void UpdateClientRconCommands();
 	void SendMapListEntryAdd(const CMapListEntry *pMapListEntry, int ClientID);
-	void SendMapListEntryRem(const CMapListEntry *pMapListEntry, int ClientID);
+	void SendMapListEntryRem(const char *pName, int ClientID);
+	void SendMapListAddBatch(int ClientID);
+	void SendMapListRemBatch(int ClientID);
+	void SubscribeMapList(int ClientID);
 	void UpdateClientMapListEntries();
+	void ListMaps();
+	void ReloadMapList();
+	CMapListEntry *AddMapListEntry(const char *pName);
 
 	void ProcessClientPacket(CNetChunk *pPacket);
 
 	void SendServerInfo(int ClientID);
 	void GenerateServerInfo(CPacker *pPacker, int Token);
+	void UpdateServerInfo();
+	virtual void ExpireServerInfo() { m_ServerInfoNeedsUpdate = true; }
 
 	void PumpNetwork();
 
 	virtual void ChangeMap(const char *pMap);
+	virtual void PreloadMap(const char *pMap);
 	const char *GetMapName();
+	// only uses the storage and the map checker, so it can run on any thread
+	bool PrepareMap(const char *pMapName, CPreparedMap *pMap);
+	static void PreloadThread(void *pUser);
+	void FinishPreload();
+	bool MapPrefetchReady() { return m_aPreloadMap[0] && !m_pPreloadThread && m_PreloadSucceeded && Config()->m_SvMapPrefetch; }
+	void SendMapPrefetch(int ClientID);
 	int LoadMap(const char *pMapName);
+	// sv_replay sets the server up like the captured one before the map gets loaded
+	bool OpenNetReplay();
+	void StartNetCapture();
 
 	void InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, CConfig *pConfig, IConsole *pConsole);
 	void InitInterfaces(CConfig *pConfig, IConsole *pConsole, IGameServer *pGameServer, IEngineMap *pMap, IStorage *pStorage);
 	int Run();
 
+	// the parts of Run, for a host that drives several servers from one loop
+	bool Start();
+	void Frame();
+	void Stop();
+	bool IsRunning() const { return m_RunServer; }
+	// time_get() to stop waiting at, sv_tick_spin before the next tick and at most half a tick away.
+	// a hibernating server only wakes up for packets and once a second
+	int64 WakeupTime();
+	// waits for incoming data or the next tick, spinning through the last sv_tick_spin microseconds
+	void WaitForTick();
+	void UpdateHibernation();
+	void UpdateLoad();
+	bool TickPending() { return !m_Hibernating && time_get() > TickStartTime(m_CurrentGameTick+1); }
+	bool PrepareWait(NETSOCKET *pSocket) { return m_NetServer.PrepareWait(pSocket); }
+
 	static int MapListEntryCallback(const char *pFilename, int IsDir, int DirType, void *pUser);
+	static void ConReloadMapList(IConsole::IResult *pResult, void *pUser);
 
 	static void ConKick(IConsole::IResult *pResult, void *pUser);
 	static void ConStatus(IConsole::IResult *pResult, void *pUser);
@@ -267,6 +550,13 @@ public:
 	static void ConRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConStopRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConMapReload(IConsole::IResult *pResult, void *pUser);
+	static void ConProfile(IConsole::IResult *pResult, void *pUser);
+	static void ConProfileReset(IConsole::IResult *pResult, void *pUser);
+	static void ConConnlessStats(IConsole::IResult *pResult, void *pUser);
+	static void ConNetStats(IConsole::IResult *pResult, void *pUser);
+	static void ConStatusPerf(IConsole::IResult *pResult, void *pUser);
+	static void ConTraceStart(IConsole::IResult *pResult, void *pUser);
+	static void ConTraceStop(IConsole::IResult *pResult, void *pUser);
 	static void ConSaveConfig(IConsole::IResult *pResult, void *pUser);
 	static void ConLogout(IConsole::IResult *pResult, void *pUser);
 	static void ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
@@ -284,7 +574,9 @@ public:
 	virtual int SnapNewID();
 	virtual void SnapFreeID(int ID);
 	virtual void *SnapNewItem(int Type, int ID, int Size);
+	virtual void *SnapNewSharedItem(int Type, int ID, int Size, const CClientMask &ClientMask);
 	void SnapSetStaticsize(int ItemType, int Size);
+	void SnapSetFieldBits(int ItemType, const unsigned char *pBits, int Num);
 };
 
 #endif
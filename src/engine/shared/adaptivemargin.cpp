@@ -0,0 +1,59 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include "adaptivemargin.h"
+
+void CAdaptiveMargin::Init(int Margin, int MinMargin, int MaxMargin, int LossMargin)
+{
+	m_NumSamples = 0;
+	m_NumLost = 0;
+	m_MinMargin = MinMargin;
+	m_MaxMargin = MaxMargin;
+	m_LossMargin = LossMargin;
+	m_Margin = Margin;
+	m_Jitter = 0;
+	m_LossPercent = 0;
+}
+
+void CAdaptiveMargin::AddLoss(int Num)
+{
+	m_NumLost += Num;
+}
+
+bool CAdaptiveMargin::AddSample(int TimeLeft)
+{
+	// how much earlier than the margin it arrived, negative when later
+	m_aOffsets[m_NumSamples++] = TimeLeft - m_Margin;
+	if(m_NumSamples < WINDOW)
+		return false;
+	m_NumSamples = 0;
+
+	// only the earliest half has to be in order
+	for(int i = 0; i <= WINDOW/2; i++)
+		for(int j = i+1; j < WINDOW; j++)
+			if(m_aOffsets[j] < m_aOffsets[i])
+			{
+				int Tmp = m_aOffsets[i];
+				m_aOffsets[i] = m_aOffsets[j];
+				m_aOffsets[j] = Tmp;
+			}
+
+	const int Latest = m_aOffsets[LATE_SAMPLES];
+	m_Jitter = m_aOffsets[WINDOW/2] - Latest;
+	m_LossPercent = m_NumLost*100/(WINDOW+m_NumLost);
+	m_NumLost = 0;
+
+	// the clock follows the arrivals, so the margin is independent of the one they were timed with
+	int Needed = SAFETY - Latest;
+	if(m_LossPercent > LOSS_PERCENT)
+		Needed += m_LossMargin;
+	Needed = clamp(Needed, m_MinMargin, m_MaxMargin);
+
+	int Old = m_Margin;
+	if(Needed > m_Margin)
+		m_Margin = Needed;
+	else if(Needed < m_Margin)
+		m_Margin -= max((m_Margin-Needed)/4, 1);
+	return m_Margin != Old;
+}
@@ -0,0 +1,58 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_ADAPTIVEMARGIN_H
+#define ENGINE_SHARED_ADAPTIVEMARGIN_H
+
+/*
+	Class: CAdaptiveMargin
+		The time in ms that packets should arrive ahead of when they are
+		needed, like snapshots before their tick is rendered or inputs
+		before their tick runs. The arrival times are collected in
+		windows of WINDOW samples, relative to the margin they were
+		timed with. After each window the margin grows at once to cover
+		all but the latest few arrivals, but only shrinks by a part of
+		the excess, so a quiet moment doesn't undo it. Windows with
+		losses add a loss margin on top.
+*/
+class CAdaptiveMargin
+{
+public:
+	enum
+	{
+		WINDOW=32,
+		LATE_SAMPLES=2, // arrivals per window that may still be late
+		SAFETY=2, // ms the latest covered arrival stays ahead
+		LOSS_PERCENT=5, // windows with more losses use the loss margin
+	};
+
+private:
+	int m_aOffsets[WINDOW];
+	int m_NumSamples;
+	int m_NumLost;
+
+	int m_MinMargin;
+	int m_MaxMargin;
+	int m_LossMargin;
+
+	int m_Margin;
+	int m_Jitter;
+	int m_LossPercent;
+
+public:
+	CAdaptiveMargin() { Init(0, 0, 0, 0); }
+
+	void Init(int Margin, int MinMargin, int MaxMargin, int LossMargin);
+
+	// TimeLeft is how many ms the packet arrived before it was needed with the current margin.
+	// returns true when the margin changed
+	bool AddSample(int TimeLeft);
+	void AddLoss(int Num);
+
+	int Margin() const { return m_Margin; }
+
+	// spread between the median and the latest covered arrival of the last window, in ms
+	int Jitter() const { return m_Jitter; }
+	int LossPercent() const { return m_LossPercent; }
+};
+
+#endif
@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 
 #include "compression.h"
@@ -60,12 +61,88 @@ const unsigned char *CVariableInt::Unpack(const unsigned char *pSrc, int *pInOut
 }
 
 
+// the bulk coders below take runs of one byte ints 8 at a time and longer ints
+// without branching on their length. near the ends of the buffers they fall back to Pack and Unpack
+static inline uint64 LoadWord(const unsigned char *pSrc)
+{
+	return (uint64)pSrc[0] | ((uint64)pSrc[1]<<8) | ((uint64)pSrc[2]<<16) | ((uint64)pSrc[3]<<24) |
+		((uint64)pSrc[4]<<32) | ((uint64)pSrc[5]<<40) | ((uint64)pSrc[6]<<48) | ((uint64)pSrc[7]<<56);
+}
+
+static inline void StoreWord(unsigned char *pDst, uint64 Word)
+{
+	for(int i = 0; i < 8; i++)
+		pDst[i] = (unsigned char)(Word>>(i*8));
+}
+
+// packs like Pack, returns the length and the bytes in the low end of the word
+static inline unsigned PackWord(int i, uint64 *pWord)
+{
+	unsigned Sign = (unsigned)i>>31;
+	unsigned Value = (unsigned)i ^ -Sign; // if(i<0) i = ~i
+	unsigned Length = 1 + (Value >= 1u<<6) + (Value >= 1u<<13) + (Value >= 1u<<20) + (Value >= 1u<<27);
+
+	// spread the data over the bytes and set the extend bits of all but the last
+	uint64 Word = (Value&0x3f) | (Sign<<6) | (uint64)((Value>>6)&0x7f)<<8 | (uint64)((Value>>13)&0x7f)<<16 |
+		(uint64)((Value>>20)&0x7f)<<24 | (uint64)(Value>>27)<<32;
+	*pWord = Word | (0x80808080ull & ((1ull<<((Length-1)*8))-1));
+	return Length;
+}
+
+// unpacks like Unpack from at least 5 readable bytes
+static inline unsigned UnpackWord(uint64 Word, int *pOut)
+{
+	// the data bits that the first 1 to 5 bytes of an int hold
+	static const unsigned s_aDataMask[6] = {0, 0x3f, 0x1fff, 0xfffff, 0x7ffffff, 0xffffffff};
+
+	// the extend bits of the first 4 bytes, the 5th byte always ends the int
+	unsigned Extend = (unsigned)(Word>>7)&0x01010101;
+	unsigned Ext1 = Extend&1;
+	unsigned Ext2 = Ext1&(Extend>>8);
+	unsigned Ext3 = Ext2&(Extend>>16);
+	unsigned Ext4 = Ext3&(Extend>>24);
+	unsigned Length = 1+Ext1+Ext2+Ext3+Ext4;
+
+	unsigned Value = (unsigned)(Word&0x3f) | ((unsigned)(Word>>8)&0x7f)<<6 | ((unsigned)(Word>>16)&0x7f)<<13 |
+		((unsigned)(Word>>24)&0x7f)<<20 | ((unsigned)(Word>>32)&0x7f)<<27;
+	*pOut = (int)((Value&s_aDataMask[Length]) ^ -((unsigned)(Word>>6)&1));
+	return Length;
+}
+
 long CVariableInt::Decompress(const void *pSrc_, int SrcSize, void *pDst_, int DstSize)
 {
 	const unsigned char *pSrc = (unsigned char *)pSrc_;
 	const unsigned char *pEnd = pSrc + SrcSize;
 	int *pDst = (int *)pDst_;
 	int *pDstEnd = pDst + DstSize/4;
+	while(pEnd - pSrc >= 8 && pDstEnd - pDst >= 8)
+	{
+		uint64 Word = LoadWord(pSrc);
+
+		// a run of 8 one byte ints, the common case in snapshot deltas
+		if(!(Word&0x8080808080808080ull))
+		{
+			for(int i = 0; i < 8; i++)
+			{
+				unsigned Byte = (unsigned)(Word>>(i*8));
+				pDst[i] = (int)((Byte&0x3f) ^ -((Byte>>6)&1));
+			}
+			pSrc += 8;
+			pDst += 8;
+			continue;
+		}
+
+		if(!(Word&0x80))
+		{
+			unsigned Byte = (unsigned)Word;
+			*pDst = (int)((Byte&0x3f) ^ -((Byte>>6)&1));
+			pSrc++;
+		}
+		else
+			pSrc += UnpackWord(Word, pDst);
+		pDst++;
+	}
+
 	while(pSrc < pEnd)
 	{
 		if(pDst >= pDstEnd)
@@ -82,6 +159,38 @@ long CVariableInt::Compress(const void *pSrc_, int SrcSize, void *pDst_, int Dst
 	unsigned char *pDst = (unsigned char *)pDst_;
 	unsigned char *pDstEnd = pDst + DstSize;
 	SrcSize /= 4;
+
+	while(SrcSize >= 8 && pDstEnd - pDst >= 8*5+8)
+	{
+		// a run of 8 ints in -64..63 takes one byte each
+		unsigned Large = 0;
+		for(int i = 0; i < 8; i++)
+			Large |= (unsigned)pSrc[i]+64;
+		if(Large < 128)
+		{
+			for(int i = 0; i < 8; i++)
+				pDst[i] = (unsigned char)(((pSrc[i]>>25)&0x40) | ((pSrc[i]^(pSrc[i]>>31))&0x3f));
+			pDst += 8;
+		}
+		else
+		{
+			for(int i = 0; i < 8; i++)
+			{
+				if((unsigned)pSrc[i]+64 < 128)
+					*pDst++ = (unsigned char)(((pSrc[i]>>25)&0x40) | ((pSrc[i]^(pSrc[i]>>31))&0x3f));
+				else
+				{
+					uint64 Word;
+					unsigned Length = PackWord(pSrc[i], &Word);
+					StoreWord(pDst, Word);
+					pDst += Length;
+				}
+			}
+		}
+		SrcSize -= 8;
+		pSrc += 8;
+	}
+
 	while(SrcSize)
 	{
 		if(pDstEnd - pDst < 6)
@@ -93,3 +202,169 @@ long CVariableInt::Compress(const void *pSrc_, int SrcSize, void *pDst_, int Dst
 	return (long)(pDst-(unsigned char *)pDst_);
 }
 
+
+// sequences of a token with 4 bit literal and match lengths, longer lengths continue in
+// bytes of 255, the literals, the 16 bit match offset. the last sequence is only literals
+enum
+{
+	LZ_MIN_MATCH=4,
+	LZ_LAST_LITERALS=5, // the block ends with at least this many literals
+	LZ_MATCH_LIMIT=12, // no match starts within this many bytes of the end
+	LZ_MAX_OFFSET=65535,
+	LZ_HASH_BITS=12,
+};
+
+static inline unsigned LzLoad32(const unsigned char *p)
+{
+	return (unsigned)p[0] | ((unsigned)p[1]<<8) | ((unsigned)p[2]<<16) | ((unsigned)p[3]<<24);
+}
+
+static inline unsigned char *LzPutLength(unsigned char *pDst, int Length)
+{
+	for(; Length >= 255; Length -= 255)
+		*pDst++ = 255;
+	*pDst++ = (unsigned char)Length;
+	return pDst;
+}
+
+int CLz4Block::Compress(const void *pSrc_, int SrcSize, void *pDst_, int DstSize)
+{
+	const unsigned char *pSrc = (const unsigned char *)pSrc_;
+	const unsigned char *pEnd = pSrc + SrcSize;
+	const unsigned char *pAnchor = pSrc;
+	unsigned char *pDst = (unsigned char *)pDst_;
+	unsigned char *pDstEnd = pDst + DstSize;
+
+	if(SrcSize > LZ_MATCH_LIMIT)
+	{
+		int aTable[1<<LZ_HASH_BITS];
+		for(int i = 0; i < (1<<LZ_HASH_BITS); i++)
+			aTable[i] = -LZ_MAX_OFFSET-1;
+
+		const unsigned char *pMatchLimit = pEnd - LZ_MATCH_LIMIT;
+		const unsigned char *pCur = pSrc;
+		while(pCur < pMatchLimit)
+		{
+			unsigned Sequence = LzLoad32(pCur);
+			unsigned Hash = (Sequence*2654435761u)>>(32-LZ_HASH_BITS);
+			int Pos = (int)(pCur - pSrc);
+			int Ref = aTable[Hash];
+			aTable[Hash] = Pos;
+			if(Pos - Ref > LZ_MAX_OFFSET || LzLoad32(pSrc + Ref) != Sequence)
+			{
+				pCur++;
+				continue;
+			}
+
+			// extend the match, it must leave the last literals
+			const unsigned char *pMatch = pSrc + Ref;
+			int MatchLength = LZ_MIN_MATCH;
+			while(pCur + MatchLength < pEnd - LZ_LAST_LITERALS && pCur[MatchLength] == pMatch[MatchLength])
+				MatchLength++;
+
+			int LiteralLength = (int)(pCur - pAnchor);
+			if(pDstEnd - pDst < 1 + LiteralLength/255 + 1 + LiteralLength + 2 + (MatchLength-LZ_MIN_MATCH)/255 + 1)
+				return -1;
+
+			unsigned char *pToken = pDst++;
+			int LiteralCode = min(LiteralLength, 15);
+			int MatchCode = min(MatchLength-LZ_MIN_MATCH, 15);
+			*pToken = (unsigned char)((LiteralCode<<4) | MatchCode);
+			if(LiteralCode == 15)
+				pDst = LzPutLength(pDst, LiteralLength-15);
+			mem_copy(pDst, pAnchor, LiteralLength);
+			pDst += LiteralLength;
+			*pDst++ = (unsigned char)(Pos-Ref);
+			*pDst++ = (unsigned char)((Pos-Ref)>>8);
+			if(MatchCode == 15)
+				pDst = LzPutLength(pDst, MatchLength-LZ_MIN_MATCH-15);
+
+			pCur += MatchLength;
+			pAnchor = pCur;
+		}
+	}
+
+	// the remaining bytes as literals
+	int LiteralLength = (int)(pEnd - pAnchor);
+	if(pDstEnd - pDst < 1 + LiteralLength/255 + 1 + LiteralLength)
+		return -1;
+	int LiteralCode = min(LiteralLength, 15);
+	*pDst++ = (unsigned char)(LiteralCode<<4);
+	if(LiteralCode == 15)
+		pDst = LzPutLength(pDst, LiteralLength-15);
+	mem_copy(pDst, pAnchor, LiteralLength);
+	pDst += LiteralLength;
+	return (int)(pDst - (unsigned char *)pDst_);
+}
+
+int CLz4Block::Decompress(const void *pSrc_, int SrcSize, void *pDst_, int DstSize)
+{
+	const unsigned char *pSrc = (const unsigned char *)pSrc_;
+	const unsigned char *pEnd = pSrc + SrcSize;
+	unsigned char *pDstStart = (unsigned char *)pDst_;
+	unsigned char *pDst = pDstStart;
+	unsigned char *pDstEnd = pDst + DstSize;
+
+	while(pSrc < pEnd)
+	{
+		unsigned Token = *pSrc++;
+
+		// literals
+		int LiteralLength = Token>>4;
+		if(LiteralLength == 15)
+		{
+			unsigned Byte;
+			do
+			{
+				if(pSrc >= pEnd)
+					return -1;
+				Byte = *pSrc++;
+				LiteralLength += Byte;
+			}
+			while(Byte == 255);
+		}
+		if(LiteralLength > pEnd - pSrc || LiteralLength > pDstEnd - pDst)
+			return -1;
+		mem_copy(pDst, pSrc, LiteralLength);
+		pSrc += LiteralLength;
+		pDst += LiteralLength;
+		if(pSrc == pEnd)
+			break; // the last sequence has no match
+
+		// match
+		if(pEnd - pSrc < 2)
+			return -1;
+		int Offset = pSrc[0] | (pSrc[1]<<8);
+		pSrc += 2;
+		if(Offset == 0 || Offset > pDst - pDstStart)
+			return -1;
+		int MatchLength = Token&15;
+		if(MatchLength == 15)
+		{
+			unsigned Byte;
+			do
+			{
+				if(pSrc >= pEnd)
+					return -1;
+				Byte = *pSrc++;
+				MatchLength += Byte;
+			}
+			while(Byte == 255);
+		}
+		MatchLength += LZ_MIN_MATCH;
+		if(MatchLength > pDstEnd - pDst)
+			return -1;
+
+		// the match can overlap what it writes
+		const unsigned char *pMatch = pDst - Offset;
+		if(Offset >= MatchLength)
+			mem_copy(pDst, pMatch, MatchLength);
+		else
+		{
+			for(int i = 0; i < MatchLength; i++)
+				pDst[i] = pMatch[i];
+		}
+		pDst += MatchLength;
+	}
+	return (int)(pDst - pDstStart);
+}
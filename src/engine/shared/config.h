@@ -20,6 +20,9 @@ public:
 	#undef MACRO_CONFIG_UTF8STR
 };
 
+// escapes \ and " for a parameter in quotes
+void EscapeParam(char *pDst, const char *pSrc, int size);
+
 enum
 {
 	CFGFLAG_SAVE=1,
@@ -29,6 +32,7 @@ enum
 	CFGFLAG_MASTER=16,
 	CFGFLAG_ECON=32,
 	CFGFLAG_BASICACCESS=64,
+	CFGFLAG_VERSION=128,
 };
 
 class CConfigManager : public IConfigManager
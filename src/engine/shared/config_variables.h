@@ -14,18 +14,28 @@ MACRO_CONFIG_INT(PlayerCountry, player_country, -1, -1, 1000, CFGFLAG_SAVE|CFGFL
 MACRO_CONFIG_STR(Password, password, 32, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Password to the server")
 MACRO_CONFIG_STR(Logfile, logfile, 128, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Filename to log all output to")
 MACRO_CONFIG_INT(LogfileTimestamp, logfile_timestamp, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Add a time stamp to the log file's name")
+MACRO_CONFIG_INT(LogAsync, log_async, 0, 0, 65536, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Number of log lines that can wait for a background thread writing them, more get dropped (0 = write them directly)")
 MACRO_CONFIG_INT(ConsoleOutputLevel, console_output_level, 0, 0, 2, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Adjusts the amount of information in the console")
 MACRO_CONFIG_INT(ShowConsoleWindow, show_console_window, 1, 0, 3, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Show console window (0 = never, 1 = debug, 2 = release, 3 = always")
 
 MACRO_CONFIG_INT(ClCpuThrottle, cl_cpu_throttle, 0, 0, 100, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Throttles the main thread")
+MACRO_CONFIG_INT(ClLowLatency, cl_low_latency, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Sleep between limited frames and sample and send the input right at the server ticks (with gfx_limitfps)")
+MACRO_CONFIG_INT(ClAdaptiveMargins, cl_adaptive_margins, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Adapt the interpolation buffer and the prediction margin to the jitter and loss of the connection")
+MACRO_CONFIG_INT(ClInputRedundancy, cl_input_redundancy, 2, 0, 3, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Number of earlier inputs repeated in each input packet, to hide packet loss")
+MACRO_CONFIG_INT(ClNetThread, cl_net_thread, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Receive and decode snapshots on a dedicated network thread (takes effect on restart)")
 MACRO_CONFIG_INT(ClEditor, cl_editor, 0, 0, 1, CFGFLAG_CLIENT, "View the editor")
+MACRO_CONFIG_INT(ClSkinsBudget, cl_skins_budget, 64, 0, 1024, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Video memory in MiB for skin parts, which load on first use and unload when unused for a while (0 = load all at startup)")
 MACRO_CONFIG_INT(ClLoadCountryFlags, cl_load_country_flags, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Load and show country flags")
 
 MACRO_CONFIG_INT(ClAutoDemoRecord, cl_auto_demo_record, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Automatically record demos")
 MACRO_CONFIG_INT(ClAutoDemoMax, cl_auto_demo_max, 10, 0, 1000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum number of automatically recorded demos (0 = no limit)")
+MACRO_CONFIG_INT(ClDemoRecordQueue, cl_demo_record_queue, 512, 0, 65536, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Size in KiB of the queue for a thread compressing and writing recorded demos (0 = on the main thread)")
+MACRO_CONFIG_INT(ClDemoQueue, cl_demo_queue, 1024, 0, 65536, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Size in KiB of the queue for a thread decoding demos ahead of the playback (0 = on the main thread)")
 MACRO_CONFIG_INT(ClAutoScreenshot, cl_auto_screenshot, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Automatically take game over screenshot")
 MACRO_CONFIG_INT(ClAutoStatScreenshot, cl_auto_statscreenshot, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Automatically take screenshot of game statistics")
 MACRO_CONFIG_INT(ClAutoScreenshotMax, cl_auto_screenshot_max, 10, 0, 1000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum number of automatically created screenshots (0 = no limit)")
+MACRO_CONFIG_INT(ClMapPrefetch, cl_map_prefetch, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Download the map the server announces to come next in the background")
+MACRO_CONFIG_INT(ClMapCacheSize, cl_map_cache_size, 256, 0, 65536, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Disk space in MiB for downloaded maps, the least recently used ones are removed (0 = no limit)")
 
 MACRO_CONFIG_INT(ClShowServerBroadcast, cl_show_server_broadcast, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Show server broadcast")
 MACRO_CONFIG_INT(ClColoredBroadcast, cl_colored_broadcast, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Enable colored server broadcasts")
@@ -36,7 +46,8 @@ MACRO_CONFIG_STR(BrFilterString, br_filter_string, 25, "", CFGFLAG_SAVE|CFGFLAG_
 
 MACRO_CONFIG_INT(BrSort, br_sort, 4, 0, 256, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Sort criterion for the server browser")
 MACRO_CONFIG_INT(BrSortOrder, br_sort_order, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Sort order in the server browser")
-MACRO_CONFIG_INT(BrMaxRequests, br_max_requests, 25, 0, 1000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Number of requests to use when refreshing server browser")
+MACRO_CONFIG_INT(BrMaxRequests, br_max_requests, 100, 0, 1000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum number of concurrent requests when refreshing server browser, fewer are used on lossy connections")
+MACRO_CONFIG_INT(BrMasterDelta, br_master_delta, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Ask the master servers only for the servers that changed since the last refresh")
 
 MACRO_CONFIG_INT(BrDemoSort, br_demo_sort, 0, 0, 2, CFGFLAG_SAVE|CFGFLAG_CLIENT, "")
 MACRO_CONFIG_INT(BrDemoSortOrder, br_demo_sort_order, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "")
@@ -49,6 +60,7 @@ MACRO_CONFIG_INT(SndMusic, snd_enable_music, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIEN
 MACRO_CONFIG_INT(SndVolume, snd_volume, 100, 0, 100, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Sound volume")
 MACRO_CONFIG_INT(SndNonactiveMute, snd_nonactive_mute, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Mute the application when not active")
 MACRO_CONFIG_INT(SndAsyncLoading, snd_async_loading, 1, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Load sound files threaded")
+MACRO_CONFIG_INT(SndCache, snd_cache, 1, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Cache decoded and resampled sounds on disk")
 
 MACRO_CONFIG_INT(GfxScreen, gfx_screen, 0, 0, 0, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Screen index")
 MACRO_CONFIG_INT(GfxScreenWidth, gfx_screen_width, 0, 0, 0, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Screen resolution width")
@@ -63,15 +75,31 @@ MACRO_CONFIG_INT(GfxHighdpi, gfx_highdpi, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT,
 MACRO_CONFIG_INT(GfxTextureCompression, gfx_texture_compression, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Use texture compression")
 MACRO_CONFIG_INT(GfxHighDetail, gfx_high_detail, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "High detail")
 MACRO_CONFIG_INT(GfxTextureQuality, gfx_texture_quality, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Don't scale textures down")
+MACRO_CONFIG_INT(GfxAsyncTextures, gfx_async_textures, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Load map textures in the background")
+MACRO_CONFIG_INT(GfxTextureUploadBudget, gfx_texture_upload_budget, 4096, 1, 65536, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Kilobytes of background loaded textures to upload per frame")
+MACRO_CONFIG_INT(GfxVertexBuffers, gfx_vertex_buffers, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Keep static map geometry on the graphics card (takes effect on map load)")
+MACRO_CONFIG_INT(GfxTilemapShader, gfx_tilemap_shader, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Draw tile layers with a shader instead of one quad per tile (takes effect on map load)")
+MACRO_CONFIG_INT(GfxOpenGLCore, gfx_opengl_core, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Render with an OpenGL 3.3 core profile context if available (requires restart)")
+MACRO_CONFIG_INT(GfxBatchDraws, gfx_batch_draws, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Merge draws of the same state that don't overlap in between")
 MACRO_CONFIG_INT(GfxFsaaSamples, gfx_fsaa_samples, 0, 0, 16, CFGFLAG_SAVE|CFGFLAG_CLIENT, "FSAA Samples")
+MACRO_CONFIG_INT(GfxCapture, gfx_capture, 0, 0, 1, CFGFLAG_CLIENT, "Write the rendered frames to captures/ while enabled")
+MACRO_CONFIG_INT(GfxCaptureFps, gfx_capture_fps, 30, 1, 240, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Frames per second written by gfx_capture")
+MACRO_CONFIG_INT(GfxCaptureFormat, gfx_capture_format, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Format of the frames written by gfx_capture (0=png, 1=ppm)")
 MACRO_CONFIG_INT(GfxFinish, gfx_finish, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Wait till the gpu finished the current frame before starting the new one")
+MACRO_CONFIG_INT(GfxCommandBuffers, gfx_command_buffers, 2, 2, 4, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Number of command buffers, the render thread may lag one less behind (requires restart)")
+MACRO_CONFIG_INT(GfxFramesInFlight, gfx_frames_in_flight, 2, 1, 4, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum number of frames the render thread may lag behind")
 MACRO_CONFIG_INT(GfxAsyncRender, gfx_asyncrender, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Do rendering async from the the update")
 MACRO_CONFIG_INT(GfxMaxFps, gfx_maxfps, 144, 30, 2000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum fps (when limit fps is enabled)")
 MACRO_CONFIG_INT(GfxLimitFps, gfx_limitfps, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Limit fps")
+MACRO_CONFIG_INT(GfxMenuMaxFps, gfx_menu_maxfps, 60, 0, 2000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum fps in the menus (0 = same as in game)")
+MACRO_CONFIG_INT(GfxAdaptiveQuality, gfx_adaptive_quality, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Reduce particles, effects and detail layers when the game can't hold gfx_adaptive_quality_fps")
+MACRO_CONFIG_INT(GfxAdaptiveQualityFps, gfx_adaptive_quality_fps, 60, 30, 1000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Frame rate the adaptive quality tries to hold")
+MACRO_CONFIG_INT(GfxBackgroundMaxFps, gfx_background_maxfps, 30, 0, 2000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum fps while the window is not focused (0 = same as focused)")
 MACRO_CONFIG_INT(GfxUseX11XRandRWM, gfx_use_x11xrandr_wm, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Let SDL use the X11 XRandR window manager")
 
 MACRO_CONFIG_INT(InpGrab, inp_grab, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Disable OS mouse settings such as mouse acceleration, use raw mouse input mode")
 MACRO_CONFIG_INT(InpMousesens, inp_mousesens, 100, 1, 100000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Ingame mouse sensitivity")
+MACRO_CONFIG_INT(InpAimOnSend, inp_aim_on_send, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Read the mouse again right before the input is sent to the server")
 
 MACRO_CONFIG_INT(JoystickEnable , joystick_enable, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Enable joystick")
 MACRO_CONFIG_STR(JoystickGUID, joystick_guid, 34, "", CFGFLAG_SAVE|CFGFLAG_CLIENT, "Joystick GUID which uniquely identifies the active joystick")
@@ -84,20 +112,60 @@ MACRO_CONFIG_INT(JoystickTolerance, joystick_tolerance, 5, 0, 50, CFGFLAG_SAVE|C
 MACRO_CONFIG_STR(SvName, sv_name, 128, "unnamed server", CFGFLAG_SAVE|CFGFLAG_SERVER, "Server name")
 MACRO_CONFIG_STR(SvHostname, sv_hostname, 128, "", CFGFLAG_SAVE|CFGFLAG_SERVER, "Server hostname")
 MACRO_CONFIG_STR(Bindaddr, bindaddr, 128, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER|CFGFLAG_MASTER, "Address to bind the client/server to")
+MACRO_CONFIG_INT(MsMaxServers, ms_max_servers, 16384, 1, 65535, CFGFLAG_MASTER, "Maximum number of servers the master server keeps track of")
+MACRO_CONFIG_INT(MsListThreads, ms_list_threads, 2, 0, 16, CFGFLAG_MASTER, "Number of threads answering list and count requests (0 = answer on the main thread)")
+MACRO_CONFIG_INT(MsNetSockets, ms_net_sockets, 1, 1, 8, CFGFLAG_MASTER, "Number of sockets sharing the master server port, the extra ones are read on their own threads (Linux only)")
+MACRO_CONFIG_INT(VsNetSockets, vs_net_sockets, 1, 1, 8, CFGFLAG_VERSION, "Number of sockets sharing the version server port, the extra ones are read on their own threads (Linux only)")
+MACRO_CONFIG_INT(VsRate, vs_rate, 2, 0, 1000, CFGFLAG_VERSION, "Requests per second answered for each address (0 = unlimited)")
+MACRO_CONFIG_INT(VsBurst, vs_burst, 8, 1, 1000, CFGFLAG_VERSION, "Requests an address may send at once")
 MACRO_CONFIG_INT(SvPort, sv_port, 8303, 0, 0, CFGFLAG_SAVE|CFGFLAG_SERVER, "Port to use for the server")
 MACRO_CONFIG_INT(SvExternalPort, sv_external_port, 0, 0, 0, CFGFLAG_SAVE|CFGFLAG_SERVER, "External port to report to the master servers")
 MACRO_CONFIG_STR(SvMap, sv_map, 128, "dm1", CFGFLAG_SAVE|CFGFLAG_SERVER, "Map to use on the server")
 MACRO_CONFIG_INT(SvMaxClients, sv_max_clients, 8, 1, MAX_CLIENTS, CFGFLAG_SAVE|CFGFLAG_SERVER, "Maximum number of clients that are allowed on a server")
 MACRO_CONFIG_INT(SvMaxClientsPerIP, sv_max_clients_per_ip, 4, 1, MAX_CLIENTS, CFGFLAG_SAVE|CFGFLAG_SERVER, "Maximum number of clients with the same IP that can connect to the server")
 MACRO_CONFIG_INT(SvMapDownloadSpeed, sv_map_download_speed, 8, 1, 16, CFGFLAG_SAVE|CFGFLAG_SERVER, "Number of map data packages a client gets on each request")
+MACRO_CONFIG_INT(SvMapDownloadAdaptive, sv_map_download_adaptive, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Send more map data packages per request to clients with a high ping")
+MACRO_CONFIG_INT(SvMapPrefetch, sv_map_prefetch, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Let clients download the next map in the background once it is preloaded")
+MACRO_CONFIG_STR(SvMapDownloadUrl, sv_map_download_url, 128, "", CFGFLAG_SAVE|CFGFLAG_SERVER, "Web address that serves the current map, told to clients that can download from it")
 MACRO_CONFIG_INT(SvHighBandwidth, sv_high_bandwidth, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Use high bandwidth mode. Doubles the bandwidth required for the server. LAN use only")
+MACRO_CONFIG_INT(SvNetBatch, sv_net_batch, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Receive and send UDP packets in batches to save syscalls")
+MACRO_CONFIG_INT(SvNetThread, sv_net_thread, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Handle the server socket on a dedicated network thread")
+MACRO_CONFIG_STR(SvCapture, sv_capture, 128, "", CFGFLAG_SERVER, "File to record the received datagrams to on start, for sv_replay")
+MACRO_CONFIG_STR(SvReplay, sv_replay, 128, "", CFGFLAG_SERVER, "Capture to feed to the server on start instead of the socket, the server stops at its end")
+MACRO_CONFIG_INT(SvReplaySpeed, sv_replay_speed, 1, 0, 1000, CFGFLAG_SERVER, "Pace of sv_replay as a multiple of the recorded one (0 = as fast as possible)")
+MACRO_CONFIG_STR(SvHuffmanTable, sv_huffman_table, 128, "", CFGFLAG_SAVE|CFGFLAG_SERVER, "Trained huffman table to compress the traffic of clients that have it too")
+MACRO_CONFIG_INT(SvNetSockets, sv_net_sockets, 1, 1, 8, CFGFLAG_SAVE|CFGFLAG_SERVER, "Number of sockets sharing the server port, the extra ones are read on their own threads (Linux only)")
+MACRO_CONFIG_INT(SvNetIoUring, sv_net_io_uring, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Receive on the server socket through io_uring where the kernel supports it (Linux 6.0+)")
+MACRO_CONFIG_INT(SvConnlessRate, sv_connless_rate, 20, 0, 10000, CFGFLAG_SAVE|CFGFLAG_SERVER, "Packets per second accepted from each address without a connection (0 = unlimited)")
+MACRO_CONFIG_INT(SvConnlessBurst, sv_connless_burst, 40, 1, 10000, CFGFLAG_SAVE|CFGFLAG_SERVER, "Packets an address without a connection may send at once")
+MACRO_CONFIG_INT(SvConnlessGlobalRate, sv_connless_global_rate, 2000, 0, 100000, CFGFLAG_SAVE|CFGFLAG_SERVER, "Packets per second accepted from all addresses without a connection together (0 = unlimited)")
+MACRO_CONFIG_INT(SvConnlessGlobalBurst, sv_connless_global_burst, 4000, 1, 100000, CFGFLAG_SAVE|CFGFLAG_SERVER, "Packets all addresses without a connection may send at once")
+MACRO_CONFIG_INT(SvSnapThreads, sv_snap_threads, 0, 0, 16, CFGFLAG_SAVE|CFGFLAG_SERVER, "Number of extra threads building client snapshots (0 = build them on the main thread)")
+MACRO_CONFIG_INT(SvInputBuffer, sv_input_buffer, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Ask clients to send their inputs ahead by the jitter of their arrival times, so fewer arrive late")
+MACRO_CONFIG_INT(SvSnapBudget, sv_snap_budget, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Hold back less important snapshot items for clients whose link can't take the full snapshots")
+MACRO_CONFIG_INT(SvSnapAdaptive, sv_snap_adaptive, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Lower the snapshot rate of clients whose link shows delay, resends or can't keep up")
+MACRO_CONFIG_INT(SvSnapMinRate, sv_snap_min_rate, 10, 1, 50, CFGFLAG_SAVE|CFGFLAG_SERVER, "Lowest snapshot rate per second an adaptive client is dropped to")
+MACRO_CONFIG_INT(SvSnapMaxDelay, sv_snap_max_delay, 60, 0, 1000, CFGFLAG_SAVE|CFGFLAG_SERVER, "Ack latency in ms above a client's base latency at which its snapshot rate is lowered")
+MACRO_CONFIG_INT(SvSnapBitpack, sv_snap_bitpack, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Pack the snapshots of clients that support it with the bits of the protocol's field ranges")
+MACRO_CONFIG_INT(SvSnapMaxResends, sv_snap_max_resends, 4, 0, 1000, CFGFLAG_SAVE|CFGFLAG_SERVER, "Resent chunks per second at which a client's snapshot rate is lowered")
+MACRO_CONFIG_INT(SvMetricsPort, sv_metrics_port, 0, 0, 65535, CFGFLAG_SAVE|CFGFLAG_SERVER, "Port to serve the server metrics on over HTTP in the Prometheus text format (0 = off)")
+MACRO_CONFIG_STR(SvMetricsBindaddr, sv_metrics_bindaddr, 128, "localhost", CFGFLAG_SAVE|CFGFLAG_SERVER, "Address to bind the metrics listener to")
+MACRO_CONFIG_INT(SvDemoStreamPort, sv_demo_stream_port, 0, 0, 65535, CFGFLAG_SAVE|CFGFLAG_SERVER, "Port to serve the demo being recorded on over HTTP while it grows, /live starts at its latest keyframe (0 = off)")
+MACRO_CONFIG_STR(SvDemoStreamBindaddr, sv_demo_stream_bindaddr, 128, "localhost", CFGFLAG_SAVE|CFGFLAG_SERVER, "Address to bind the demo stream listener to")
+MACRO_CONFIG_INT(SvNetStatsInterval, sv_net_stats_interval, 0, 0, 3600, CFGFLAG_SAVE|CFGFLAG_SERVER, "Seconds between writing the network stats of all clients to dumps/net_stats.json (0 = never)")
+MACRO_CONFIG_INT(SvHibernate, sv_hibernate, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Stop ticking the game while no client is connected, the server then only wakes up for packets")
+MACRO_CONFIG_INT(SvLoadShedding, sv_load_shedding, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Drop a long tick backlog and skip optional work while ticks keep running late")
+MACRO_CONFIG_INT(SvTickSpin, sv_tick_spin, 0, 0, 2000, CFGFLAG_SAVE|CFGFLAG_SERVER, "Microseconds before each tick to poll instead of sleeping, trades CPU time for punctual ticks")
+MACRO_CONFIG_INT(SvProfile, sv_profile, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Keep timing histograms of the server loop phases (see 'profile')")
 MACRO_CONFIG_INT(SvRegister, sv_register, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Register server with master server for public listing")
 MACRO_CONFIG_STR(SvRconPassword, sv_rcon_password, 32, "", CFGFLAG_SAVE|CFGFLAG_SERVER, "Remote console password (full access)")
 MACRO_CONFIG_STR(SvRconModPassword, sv_rcon_mod_password, 32, "", CFGFLAG_SAVE|CFGFLAG_SERVER, "Remote console password for moderators (limited access)")
+MACRO_CONFIG_STR(SvRelayPassword, sv_relay_password, 32, "", CFGFLAG_SAVE|CFGFLAG_SERVER, "Password for relays that serve the game to more spectators (empty = no relays)")
 MACRO_CONFIG_INT(SvRconMaxTries, sv_rcon_max_tries, 3, 0, 100, CFGFLAG_SAVE|CFGFLAG_SERVER, "Maximum number of tries for remote console authentication")
 MACRO_CONFIG_INT(SvRconBantime, sv_rcon_bantime, 5, 0, 1440, CFGFLAG_SAVE|CFGFLAG_SERVER, "The time a client gets banned if remote console authentication fails. 0 makes it just use kick")
 MACRO_CONFIG_INT(SvAutoDemoRecord, sv_auto_demo_record, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER, "Automatically record demos")
 MACRO_CONFIG_INT(SvAutoDemoMax, sv_auto_demo_max, 10, 0, 1000, CFGFLAG_SAVE|CFGFLAG_SERVER, "Maximum number of automatically recorded demos (0 = no limit)")
+MACRO_CONFIG_INT(SvDemoQueue, sv_demo_queue, 0, 0, 65536, CFGFLAG_SAVE|CFGFLAG_SERVER, "Size in KiB of the queue for a thread compressing and writing recorded demos (0 = on the main thread)")
 
 MACRO_CONFIG_STR(EcBindaddr, ec_bindaddr, 128, "localhost", CFGFLAG_SAVE|CFGFLAG_ECON, "Address to bind the external console to. Anything but 'localhost' is dangerous")
 MACRO_CONFIG_INT(EcPort, ec_port, 0, 0, 0, CFGFLAG_SAVE|CFGFLAG_ECON, "Port to use for the external console")
@@ -105,6 +173,18 @@ MACRO_CONFIG_STR(EcPassword, ec_password, 32, "", CFGFLAG_SAVE|CFGFLAG_ECON, "Ex
 MACRO_CONFIG_INT(EcBantime, ec_bantime, 0, 0, 1440, CFGFLAG_SAVE|CFGFLAG_ECON, "The time a client gets banned if econ authentication fails. 0 just closes the connection")
 MACRO_CONFIG_INT(EcAuthTimeout, ec_auth_timeout, 30, 1, 120, CFGFLAG_SAVE|CFGFLAG_ECON, "Time in seconds before the the econ authentification times out")
 MACRO_CONFIG_INT(EcOutputLevel, ec_output_level, 1, 0, 2, CFGFLAG_SAVE|CFGFLAG_ECON, "Adjusts the amount of information in the external console")
+MACRO_CONFIG_INT(EcOutputBacklog, ec_output_backlog, 64, 4, 4096, CFGFLAG_SAVE|CFGFLAG_ECON, "Output in KiB kept for an external console client that does not read fast enough")
+MACRO_CONFIG_INT(EcOutputOverflow, ec_output_overflow, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_ECON, "What to do when the output backlog is full (0 = drop lines, 1 = disconnect the client)")
+MACRO_CONFIG_INT(EcProfileInterval, ec_profile_interval, 0, 0, 3600, CFGFLAG_SAVE|CFGFLAG_ECON, "Seconds between sending the profiler stats to the external console (0 = never, needs sv_profile)")
+
+MACRO_CONFIG_INT(ThreadTickPriority, thread_tick_priority, 0, -1, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Priority of the main thread that runs the ticks and frames (-1 = low, 0 = normal, 1 = high, takes effect on restart)")
+MACRO_CONFIG_STR(ThreadTickCpus, thread_tick_cpus, 64, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "CPUs the main thread that runs the ticks and frames run on, like 0-3,6 (empty = all, takes effect on restart)")
+MACRO_CONFIG_INT(ThreadNetPriority, thread_net_priority, 0, -1, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Priority of the network threads (-1 = low, 0 = normal, 1 = high, takes effect on restart)")
+MACRO_CONFIG_STR(ThreadNetCpus, thread_net_cpus, 64, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "CPUs the network threads run on, like 0-3,6 (empty = all, takes effect on restart)")
+MACRO_CONFIG_INT(ThreadJobsPriority, thread_jobs_priority, 0, -1, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Priority of the job pool workers (-1 = low, 0 = normal, 1 = high, takes effect on restart)")
+MACRO_CONFIG_STR(ThreadJobsCpus, thread_jobs_cpus, 64, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "CPUs the job pool workers run on, like 0-3,6 (empty = all, takes effect on restart)")
+MACRO_CONFIG_INT(ThreadBackendPriority, thread_backend_priority, 0, -1, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Priority of the graphics backend thread (-1 = low, 0 = normal, 1 = high, takes effect on restart)")
+MACRO_CONFIG_STR(ThreadBackendCpus, thread_backend_cpus, 64, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "CPUs the graphics backend thread run on, like 0-3,6 (empty = all, takes effect on restart)")
 
 MACRO_CONFIG_INT(NetTcpAbortOnClose, net_tcp_abort_on_close, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER|CFGFLAG_ECON, "Aborts tcp connection on close")
 
@@ -341,11 +341,60 @@ bool CConsole::LineIsValid(const char *pStr)
 	return true;
 }
 
+unsigned CConsole::LineHash(const char *pStr, int Length, int Stroke)
+{
+	unsigned Hash = 2166136261u^Stroke;
+	for(int i = 0; i < Length; i++)
+		Hash = (Hash^(unsigned char)pStr[i])*16777619u;
+	return Hash;
+}
+
+CConsole::CLineCacheEntry *CConsole::FindCachedLine(const char *pStr, int Length, int Stroke, unsigned Hash)
+{
+	CLineCacheEntry *pEntry = &m_paLineCache[Hash%LINE_CACHE_SIZE];
+	if(pEntry->m_pCommand && pEntry->m_Generation == m_CommandGeneration && pEntry->m_Hash == Hash &&
+		pEntry->m_Stroke == Stroke && pEntry->m_Length == Length && mem_comp(pEntry->m_aLine, pStr, Length) == 0)
+		return pEntry;
+	return 0;
+}
+
+void CConsole::CacheLine(const char *pStr, int Length, int Stroke, unsigned Hash, CCommand *pCommand, const CResult *pResult)
+{
+	CLineCacheEntry *pEntry = &m_paLineCache[Hash%LINE_CACHE_SIZE];
+	if(pEntry->m_Busy || Length > CONSOLE_MAX_STR_LENGTH)
+		return;
+	if(pEntry->m_SeenHash != Hash)
+	{
+		// config files are mostly executed once, keep them from flushing the binds
+		pEntry->m_SeenHash = Hash;
+		return;
+	}
+
+	pEntry->m_Hash = Hash;
+	pEntry->m_Generation = m_CommandGeneration;
+	pEntry->m_Stroke = Stroke;
+	pEntry->m_Length = Length;
+	pEntry->m_pCommand = pCommand;
+	mem_copy(pEntry->m_aLine, pStr, Length);
+	pEntry->m_Result = *pResult;
+}
+
+void CConsole::ExecuteCommand(CCommand *pCommand, CResult *pResult)
+{
+	if(m_StoreCommands && pCommand->m_Flags&CFGFLAG_STORE)
+	{
+		m_ExecutionQueue.AddEntry();
+		m_ExecutionQueue.m_pLast->m_pCommand = pCommand;
+		m_ExecutionQueue.m_pLast->m_Result = *pResult;
+	}
+	else
+		pCommand->m_pfnCallback(pResult, pCommand->m_pUserData);
+}
+
 void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 {
 	while(pStr && *pStr)
 	{
-		CResult Result;
 		const char *pEnd = pStr;
 		const char *pNextPart = 0;
 		int InString = 0;
@@ -373,7 +422,30 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 			pEnd++;
 		}
 
-		if(ParseStart(&Result, pStr, (pEnd-pStr) + 1) != 0)
+		// skip parsing lines that were run the same way before
+		int Length = pEnd-pStr;
+		unsigned Hash = LineHash(pStr, Length, Stroke);
+		CLineCacheEntry *pCached = FindCachedLine(pStr, Length, Stroke, Hash);
+		if(pCached)
+		{
+			if(pCached->m_pCommand->GetAccessLevel() >= m_AccessLevel)
+			{
+				pCached->m_Busy++;
+				ExecuteCommand(pCached->m_pCommand, &pCached->m_Result);
+				pCached->m_Busy--;
+			}
+			else if(Stroke)
+			{
+				char aBuf[256];
+				str_format(aBuf, sizeof(aBuf), "Access for command %s denied.", pCached->m_Result.m_pCommand);
+				Print(OUTPUT_LEVEL_STANDARD, "console", aBuf);
+			}
+			pStr = pNextPart;
+			continue;
+		}
+
+		CResult Result;
+		if(ParseStart(&Result, pStr, Length + 1) != 0)
 			return;
 
 		if(!*Result.m_pCommand)
@@ -401,14 +473,11 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 						str_format(aBuf, sizeof(aBuf), "Invalid arguments... Usage: %s %s", pCommand->m_pName, pCommand->m_pParams);
 						Print(OUTPUT_LEVEL_STANDARD, "console", aBuf);
 					}
-					else if(m_StoreCommands && pCommand->m_Flags&CFGFLAG_STORE)
+					else
 					{
-						m_ExecutionQueue.AddEntry();
-						m_ExecutionQueue.m_pLast->m_pCommand = pCommand;
-						m_ExecutionQueue.m_pLast->m_Result = Result;
+						CacheLine(pStr, Length, Stroke, Hash, pCommand, &Result);
+						ExecuteCommand(pCommand, &Result);
 					}
-					else
-						pCommand->m_pfnCallback(&Result, pCommand->m_pUserData);
 				}
 			}
 			else if(Stroke)
@@ -457,9 +526,42 @@ int CConsole::PossibleMaps(const char *pStr, FPossibleCallback pfnCallback, void
 	return Index;
 }
 
+unsigned CConsole::CommandHash(const char *pName)
+{
+	// fnv-1a over the lower case name, matching str_comp_nocase
+	unsigned Hash = 2166136261u;
+	for(; *pName; pName++)
+	{
+		unsigned char c = *pName;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a'-'A';
+		Hash = (Hash^c)*16777619u;
+	}
+	return Hash%COMMAND_HASH_SIZE;
+}
+
+void CConsole::AddCommandHash(CCommand *pCommand)
+{
+	unsigned Hash = CommandHash(pCommand->m_pName);
+	pCommand->m_pNextHash = m_apCommandHash[Hash];
+	m_apCommandHash[Hash] = pCommand;
+}
+
+void CConsole::RemoveCommandHash(CCommand *pCommand)
+{
+	for(CCommand **ppCommand = &m_apCommandHash[CommandHash(pCommand->m_pName)]; *ppCommand; ppCommand = &(*ppCommand)->m_pNextHash)
+	{
+		if(*ppCommand == pCommand)
+		{
+			*ppCommand = pCommand->m_pNextHash;
+			break;
+		}
+	}
+}
+
 CConsole::CCommand *CConsole::FindCommand(const char *pName, int FlagMask)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask && str_comp_nocase(pCommand->m_pName, pName) == 0)
 		{
@@ -808,6 +910,15 @@ CConsole::CConsole(int FlagMask)
 	m_pLastMapEntry = 0;
 	m_ExecutionQueue.Reset();
 	m_pFirstCommand = 0;
+	mem_zero(m_apCommandHash, sizeof(m_apCommandHash));
+	m_paLineCache = new CLineCacheEntry[LINE_CACHE_SIZE];
+	for(int i = 0; i < LINE_CACHE_SIZE; i++)
+	{
+		m_paLineCache[i].m_SeenHash = 0;
+		m_paLineCache[i].m_Busy = 0;
+		m_paLineCache[i].m_pCommand = 0;
+	}
+	m_CommandGeneration = 0;
 	m_pFirstExec = 0;
 	mem_zero(m_aPrintCB, sizeof(m_aPrintCB));
 	m_NumPrintCB = 0;
@@ -845,6 +956,7 @@ CConsole::~CConsole()
 		delete m_pTempMapListHeap;
 		m_pTempMapListHeap = 0;
 	}
+	delete[] m_paLineCache;
 }
 
 void CConsole::Init()
@@ -855,20 +967,26 @@ void CConsole::Init()
 	// TODO: this should disappear
 	#define MACRO_CONFIG_INT(Name,ScriptName,Def,Min,Max,Flags,Desc) \
 	{ \
-		static CIntVariableData Data = { this, &m_pConfig->m_##Name, Min, Max }; \
-		Register(#ScriptName, "?i", Flags, IntVariableCommand, &Data, Desc); \
+		CIntVariableData *pData = (CIntVariableData *)m_VariableData.Allocate(sizeof(CIntVariableData)); \
+		CIntVariableData Data = { this, &m_pConfig->m_##Name, Min, Max }; \
+		*pData = Data; \
+		Register(#ScriptName, "?i", Flags, IntVariableCommand, pData, Desc); \
 	}
 
 	#define MACRO_CONFIG_STR(Name,ScriptName,Len,Def,Flags,Desc) \
 	{ \
-		static CStrVariableData Data = { this, m_pConfig->m_##Name, Len, Len }; \
-		Register(#ScriptName, "?r", Flags, StrVariableCommand, &Data, Desc); \
+		CStrVariableData *pData = (CStrVariableData *)m_VariableData.Allocate(sizeof(CStrVariableData)); \
+		CStrVariableData Data = { this, m_pConfig->m_##Name, Len, Len }; \
+		*pData = Data; \
+		Register(#ScriptName, "?r", Flags, StrVariableCommand, pData, Desc); \
 	}
 
 	#define MACRO_CONFIG_UTF8STR(Name,ScriptName,Size,Len,Def,Flags,Desc) \
 	{ \
-		static CStrVariableData Data = { this, m_pConfig->m_##Name, Size, Len }; \
-		Register(#ScriptName, "?r", Flags, StrVariableCommand, &Data, Desc); \
+		CStrVariableData *pData = (CStrVariableData *)m_VariableData.Allocate(sizeof(CStrVariableData)); \
+		CStrVariableData Data = { this, m_pConfig->m_##Name, Size, Len }; \
+		*pData = Data; \
+		Register(#ScriptName, "?r", Flags, StrVariableCommand, pData, Desc); \
 	}
 
 	#include "config_variables.h"
@@ -946,9 +1064,13 @@ void CConsole::Register(const char *pName, const char *pParams,
 
 	pCommand->m_Flags = Flags;
 	pCommand->m_Temp = false;
+	m_CommandGeneration++;
 
 	if(DoAdd)
+	{
 		AddCommandSorted(pCommand);
+		AddCommandHash(pCommand);
+	}
 }
 
 void CConsole::RegisterTemp(const char *pName, const char *pParams,	int Flags, const char *pHelp)
@@ -981,8 +1103,10 @@ void CConsole::RegisterTemp(const char *pName, const char *pParams,	int Flags, c
 	pCommand->m_pUserData = 0;
 	pCommand->m_Flags = Flags;
 	pCommand->m_Temp = true;
+	m_CommandGeneration++;
 
 	AddCommandSorted(pCommand);
+	AddCommandHash(pCommand);
 }
 
 void CConsole::DeregisterTemp(const char *pName)
@@ -1012,6 +1136,8 @@ void CConsole::DeregisterTemp(const char *pName)
 	// add to recycle list
 	if(pRemoved)
 	{
+		RemoveCommandHash(pRemoved);
+		m_CommandGeneration++;
 		pRemoved->m_pNext = m_pRecycleList;
 		m_pRecycleList = pRemoved;
 	}
@@ -1033,6 +1159,20 @@ void CConsole::DeregisterTempAll()
 		}
 	}
 
+	m_CommandGeneration++;
+
+	// remove temp entries from the hash
+	for(int i = 0; i < COMMAND_HASH_SIZE; i++)
+	{
+		for(CCommand **ppCommand = &m_apCommandHash[i]; *ppCommand;)
+		{
+			if((*ppCommand)->m_Temp)
+				*ppCommand = (*ppCommand)->m_pNextHash;
+			else
+				ppCommand = &(*ppCommand)->m_pNextHash;
+		}
+	}
+
 	m_TempCommands.Reset();
 	m_pRecycleList = 0;
 }
@@ -1068,12 +1208,12 @@ void CConsole::DeregisterTempMap(const char *pName)
 
 		CMapListEntryTemp *pDst = (CMapListEntryTemp *)pNewTempMapListHeap->Allocate(sizeof(CMapListEntryTemp));
 		pDst->m_pNext = 0;
-		pDst->m_pPrev = m_pLastMapEntry;
+		pDst->m_pPrev = pNewLastEntry;
 		if(pDst->m_pPrev)
 			pDst->m_pPrev->m_pNext = pDst;
-		m_pLastMapEntry = pDst;
-		if(!m_pFirstMapEntry)
-			m_pFirstMapEntry = pDst;
+		pNewLastEntry = pDst;
+		if(!pNewFirstEntry)
+			pNewFirstEntry = pDst;
 
 		str_copy(pDst->m_aName, pSrc->m_aName, TEMPMAP_NAME_LENGTH);
 	}
@@ -1137,7 +1277,7 @@ void CConsole::StoreCommands(bool Store)
 
 const IConsole::CCommandInfo *CConsole::GetCommandInfo(const char *pName, int FlagMask, bool Temp)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask && pCommand->m_Temp == Temp)
 		{
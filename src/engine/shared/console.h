@@ -14,6 +14,7 @@ class CConsole : public IConsole
 	public:
 		CCommand(bool BasicAccess) : CCommandInfo(BasicAccess) {}
 		CCommand *m_pNext;
+		CCommand *m_pNextHash;
 		int m_Flags;
 		bool m_Temp;
 		FCommandCallback m_pfnCallback;
@@ -53,6 +54,7 @@ class CConsole : public IConsole
 
 	CCommand *m_pRecycleList;
 	CHeap m_TempCommands;
+	CHeap m_VariableData; // what the config variable commands point to, one set per console
 
 	static void Con_Chain(IResult *pResult, void *pUserData);
 	static void Con_Echo(IResult *pResult, void *pUserData);
@@ -106,7 +108,12 @@ class CConsole : public IConsole
 				m_pArgsStart = m_aStringStorage+(Other.m_pArgsStart-Other.m_aStringStorage);
 				m_pCommand = m_aStringStorage+(Other.m_pCommand-Other.m_aStringStorage);
 				for(unsigned i = 0; i < Other.m_NumArgs; ++i)
-					m_apArgs[i] = m_aStringStorage+(Other.m_apArgs[i]-Other.m_aStringStorage);
+				{
+					// the stroke argument points to a constant string
+					const char *pArg = Other.m_apArgs[i];
+					bool InStorage = pArg >= Other.m_aStringStorage && pArg < Other.m_aStringStorage+sizeof(Other.m_aStringStorage);
+					m_apArgs[i] = InStorage ? m_aStringStorage+(pArg-Other.m_aStringStorage) : pArg;
+				}
 			}
 			return *this;
 		}
@@ -163,9 +170,47 @@ class CConsole : public IConsole
 		}
 	} m_ExecutionQueue;
 
+	enum
+	{
+		COMMAND_HASH_SIZE = 1024,
+	};
+
+	// commands by case insensitive name hash, besides the sorted list
+	CCommand *m_apCommandHash[COMMAND_HASH_SIZE];
+
+	static unsigned CommandHash(const char *pName);
+	void AddCommandHash(CCommand *pCommand);
+	void RemoveCommandHash(CCommand *pCommand);
 	void AddCommandSorted(CCommand *pCommand);
 	CCommand *FindCommand(const char *pName, int FlagMask);
 
+	enum
+	{
+		LINE_CACHE_SIZE = 64,
+	};
+
+	// parsed form of command lines that were executed more than once, like binds and
+	// votes. entries are dropped by changing m_CommandGeneration on (de)registration
+	struct CLineCacheEntry
+	{
+		unsigned m_Hash;
+		unsigned m_SeenHash; // a line is only cached the second time it is executed
+		int m_Generation;
+		int m_Stroke;
+		int m_Length;
+		int m_Busy; // executing, must not be replaced
+		CCommand *m_pCommand;
+		char m_aLine[CONSOLE_MAX_STR_LENGTH+1];
+		CResult m_Result;
+	};
+	CLineCacheEntry *m_paLineCache;
+	int m_CommandGeneration;
+
+	static unsigned LineHash(const char *pStr, int Length, int Stroke);
+	CLineCacheEntry *FindCachedLine(const char *pStr, int Length, int Stroke, unsigned Hash);
+	void CacheLine(const char *pStr, int Length, int Stroke, unsigned Hash, CCommand *pCommand, const CResult *pResult);
+	void ExecuteCommand(CCommand *pCommand, CResult *pResult);
+
 	struct CMapListEntryTemp {
 		CMapListEntryTemp *m_pPrev;
 		CMapListEntryTemp *m_pNext;
@@ -6,10 +6,20 @@
 #include <base/math.h>
 #include <base/system.h>
 #include <engine/storage.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/jobs.h>
 #include <zlib.h>
 
 static const int DEBUG=0;
 
+// how the data blocks of version 5 files are stored, version 4 always uses zlib
+enum
+{
+	DATACODEC_ZLIB=0,
+	DATACODEC_LZ4,
+	DATACODEC_NONE,
+};
+
 struct CDatafileItemType
 {
 	int m_Type;
@@ -52,6 +62,7 @@ struct CDatafileInfo
 	int *m_pItemOffsets;
 	int *m_pDataOffsets;
 	int *m_pDataSizes;
+	int *m_pDataCodecs;
 
 	char *m_pItemStart;
 	char *m_pDataStart;
@@ -68,9 +79,23 @@ struct CDatafile
 	char **m_ppDataPtrs;
 	int *m_pDataSizes;
 	char *m_pData;
+	char *m_pMapped; // whole file if it is memory mapped
+	unsigned m_MappedSize;
+	int *m_pItemSlots; // open addressing from type and id to the item index+1, 0 marks a free slot
+	unsigned m_ItemSlotMask;
+
+	bool IsMapped(const char *pData) const { return m_pMapped && pData >= m_pMapped && pData <= m_pMapped+m_MappedSize; }
+	void FreeData(int Index)
+	{
+		// uncompressed data of a mapped file points into the file
+		if(!IsMapped(m_ppDataPtrs[Index]))
+			mem_free(m_ppDataPtrs[Index]);
+		m_ppDataPtrs[Index] = 0x0;
+		m_pDataSizes[Index] = 0;
+	}
 };
 
-bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType)
+bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType, bool Mapped, const SHA256_DIGEST *pKnownSha256, unsigned KnownCrc)
 {
 	dbg_msg("datafile", "loading. filename='%s'", pFilename);
 
@@ -81,11 +106,23 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		return false;
 	}
 
+	unsigned MappedSize = 0;
+	char *pMapped = Mapped ? (char *)io_mmap(File, &MappedSize) : 0;
+	if(!pMapped)
+		io_sequential(File);
 
 	// take the hashes of the file and store them
 	SHA256_CTX Sha256Ctx;
 	sha256_init(&Sha256Ctx);
 	unsigned Crc = crc32(0L, 0x0, 0);
+	if(pKnownSha256)
+		Crc = KnownCrc;
+	else if(pMapped)
+	{
+		sha256_update(&Sha256Ctx, pMapped, MappedSize);
+		Crc = crc32(Crc, (const Bytef *)pMapped, MappedSize); // ignore_convention
+	}
+	else
 	{
 		enum
 		{
@@ -108,12 +145,19 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 
 	// TODO: change this header
 	CDatafileHeader Header;
-	io_read(File, &Header, sizeof(Header));
+	if(pMapped)
+	{
+		mem_zero(&Header, sizeof(Header));
+		mem_copy(&Header, pMapped, min((unsigned)sizeof(Header), MappedSize));
+	}
+	else
+		io_read(File, &Header, sizeof(Header));
 	if(Header.m_aID[0] != 'A' || Header.m_aID[1] != 'T' || Header.m_aID[2] != 'A' || Header.m_aID[3] != 'D')
 	{
 		if(Header.m_aID[0] != 'D' || Header.m_aID[1] != 'A' || Header.m_aID[2] != 'T' || Header.m_aID[3] != 'A')
 		{
 			dbg_msg("datafile", "wrong signature. %x %x %x %x", Header.m_aID[0], Header.m_aID[1], Header.m_aID[2], Header.m_aID[3]);
+			io_munmap(pMapped, MappedSize);
 			io_close(File);
 			return 0;
 		}
@@ -122,9 +166,10 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 #if defined(CONF_ARCH_ENDIAN_BIG)
 	swap_endian(&Header, sizeof(int), sizeof(Header)/sizeof(int));
 #endif
-	if(Header.m_Version != 3 && Header.m_Version != 4)
+	if(Header.m_Version < 3 || Header.m_Version > 5)
 	{
 		dbg_msg("datafile", "wrong version. version=%x", Header.m_Version);
+		io_munmap(pMapped, MappedSize);
 		io_close(File);
 		return 0;
 	}
@@ -133,39 +178,51 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	int64 Size = 0;
 	Size += Header.m_NumItemTypes*sizeof(CDatafileItemType);
 	Size += (Header.m_NumItems+Header.m_NumRawData)*sizeof(int);
-	if(Header.m_Version == 4)
+	if(Header.m_Version >= 4)
 		Size += Header.m_NumRawData*sizeof(int); // v4 has uncompressed data sizes aswell
+	if(Header.m_Version >= 5)
+		Size += Header.m_NumRawData*sizeof(int); // v5 has the codec of each data block
 	Size += Header.m_ItemSize;
 
-	int64 AllocSize = Size;
+	int64 AllocSize = pMapped ? 0 : Size; // a mapped file is used in place
 	AllocSize += sizeof(CDatafile); // add space for info structure
 	AllocSize += Header.m_NumRawData*sizeof(void*); // add space for data pointers
 	AllocSize += Header.m_NumRawData*sizeof(int); // add space for data sizes
 	if(Size > (int64(1)<<31) || Header.m_NumItemTypes < 0 || Header.m_NumItems < 0 || Header.m_NumRawData < 0 || Header.m_ItemSize < 0)
 	{
+		io_munmap(pMapped, MappedSize);
 		io_close(File);
 		dbg_msg("datafile", "unable to load file, invalid file information");
 		return false;
 	}
 
-	CDatafile *pTmpDataFile = (CDatafile*)mem_alloc(AllocSize, 1);
+	CDatafile *pTmpDataFile = (CDatafile*)mem_alloc_tag(AllocSize, 1, MEMTAG_MAP);
 	pTmpDataFile->m_Header = Header;
 	pTmpDataFile->m_DataStartOffset = sizeof(CDatafileHeader) + Size;
 	pTmpDataFile->m_ppDataPtrs = (char **)(pTmpDataFile+1);
 	pTmpDataFile->m_pDataSizes = (int *)(pTmpDataFile->m_ppDataPtrs + Header.m_NumRawData);
-	pTmpDataFile->m_pData = (char *)(pTmpDataFile->m_pDataSizes + Header.m_NumRawData);
+	pTmpDataFile->m_pData = pMapped ? pMapped + sizeof(CDatafileHeader) : (char *)(pTmpDataFile->m_pDataSizes + Header.m_NumRawData);
+	pTmpDataFile->m_pMapped = pMapped;
+	pTmpDataFile->m_MappedSize = MappedSize;
 	pTmpDataFile->m_File = File;
-	pTmpDataFile->m_Sha256 = sha256_finish(&Sha256Ctx);
+	pTmpDataFile->m_Sha256 = pKnownSha256 ? *pKnownSha256 : sha256_finish(&Sha256Ctx);
 	pTmpDataFile->m_Crc = Crc;
+	pTmpDataFile->m_pItemSlots = 0;
+	pTmpDataFile->m_ItemSlotMask = 0;
 
 	// clear the data pointers and sizes
 	mem_zero(pTmpDataFile->m_ppDataPtrs, Header.m_NumRawData*sizeof(void*));
 	mem_zero(pTmpDataFile->m_pDataSizes, Header.m_NumRawData*sizeof(int));
 
 	// read types, offsets, sizes and item data
-	unsigned ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
+	unsigned ReadSize;
+	if(pMapped)
+		ReadSize = min((int64)MappedSize - (int64)sizeof(CDatafileHeader), Size);
+	else
+		ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
 	if(ReadSize != Size)
 	{
+		io_munmap(pMapped, MappedSize);
 		io_close(pTmpDataFile->m_File);
 		mem_free(pTmpDataFile);
 		pTmpDataFile = 0;
@@ -193,12 +250,18 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	m_pDataFile->m_Info.m_pDataOffsets = (int *)&m_pDataFile->m_Info.m_pItemOffsets[m_pDataFile->m_Header.m_NumItems];
 	m_pDataFile->m_Info.m_pDataSizes = (int *)&m_pDataFile->m_Info.m_pDataOffsets[m_pDataFile->m_Header.m_NumRawData];
 
-	if(Header.m_Version == 4)
+	m_pDataFile->m_Info.m_pDataCodecs = (int *)&m_pDataFile->m_Info.m_pDataSizes[m_pDataFile->m_Header.m_NumRawData];
+
+	if(Header.m_Version == 5)
+		m_pDataFile->m_Info.m_pItemStart = (char *)&m_pDataFile->m_Info.m_pDataCodecs[m_pDataFile->m_Header.m_NumRawData];
+	else if(Header.m_Version == 4)
 		m_pDataFile->m_Info.m_pItemStart = (char *)&m_pDataFile->m_Info.m_pDataSizes[m_pDataFile->m_Header.m_NumRawData];
 	else
 		m_pDataFile->m_Info.m_pItemStart = (char *)&m_pDataFile->m_Info.m_pDataOffsets[m_pDataFile->m_Header.m_NumRawData];
 	m_pDataFile->m_Info.m_pDataStart = m_pDataFile->m_Info.m_pItemStart + m_pDataFile->m_Header.m_ItemSize;
 
+	BuildItemIndex();
+
 	dbg_msg("datafile", "loading done. datafile='%s'", pFilename);
 
 	if(DEBUG)
@@ -276,66 +339,154 @@ int CDataFileReader::GetDataSize(int Index) const
 	return m_pDataFile->m_pDataSizes[Index];
 }
 
-void *CDataFileReader::GetDataImpl(int Index, int Swap)
+char *CDataFileReader::ReadFileData(int Index)
 {
-	if(!m_pDataFile) { return 0; }
+	int DataSize = GetFileDataSize(Index);
+	if(m_pDataFile->m_pMapped)
+	{
+		int64 Offset = (int64)m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index];
+		if(DataSize < 0 || Offset < 0 || Offset+DataSize > m_pDataFile->m_MappedSize)
+		{
+			dbg_msg("datafile", "data index=%d is outside of the file", Index);
+			return 0;
+		}
+		return m_pDataFile->m_pMapped+Offset;
+	}
 
-	if(Index < 0 || Index >= m_pDataFile->m_Header.m_NumRawData)
-		return 0;
+	char *pData = (char *)mem_alloc_tag(DataSize, 1, MEMTAG_MAP);
+	io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
+	io_read(m_pDataFile->m_File, pData, DataSize);
+	return pData;
+}
 
-	// load it if needed
-	if(!m_pDataFile->m_ppDataPtrs[Index])
-	{
-		// fetch the data size
-		int DataSize = GetFileDataSize(Index);
+void CDataFileReader::LoadData(int Index, char *pFileData, int Swap)
+{
+	// fetch the data size
+	int DataSize = GetFileDataSize(Index);
 #if defined(CONF_ARCH_ENDIAN_BIG)
-		int SwapSize = DataSize;
+	int SwapSize = DataSize;
 #endif
 
-		if(m_pDataFile->m_Header.m_Version == 4)
+	int Codec = DATACODEC_NONE;
+	if(m_pDataFile->m_Header.m_Version == 4)
+		Codec = DATACODEC_ZLIB;
+	else if(m_pDataFile->m_Header.m_Version == 5)
+		Codec = m_pDataFile->m_Info.m_pDataCodecs[Index];
+
+	if(Codec != DATACODEC_NONE)
+	{
+		// v4 and v5 have compressed data
+		unsigned long UncompressedSize = m_pDataFile->m_Info.m_pDataSizes[Index];
+		unsigned long s;
+
+		dbg_msg("datafile", "loading data index=%d size=%d uncompressed=%lu codec=%d", Index, DataSize, UncompressedSize, Codec);
+		m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc_tag(UncompressedSize, 1, MEMTAG_MAP);
+		m_pDataFile->m_pDataSizes[Index] = UncompressedSize;
+
+		// decompress the data, TODO: check for errors
+		s = UncompressedSize;
+		if(Codec == DATACODEC_LZ4)
 		{
-			// v4 has compressed data
-			void *pTemp = (char *)mem_alloc(DataSize, 1);
-			unsigned long UncompressedSize = m_pDataFile->m_Info.m_pDataSizes[Index];
-			unsigned long s;
-
-			dbg_msg("datafile", "loading data index=%d size=%d uncompressed=%lu", Index, DataSize, UncompressedSize);
-			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(UncompressedSize, 1);
-			m_pDataFile->m_pDataSizes[Index] = UncompressedSize;
-
-			// read the compressed data
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, pTemp, DataSize);
-
-			// decompress the data, TODO: check for errors
-			s = UncompressedSize;
-			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (Bytef*)pTemp, DataSize); // ignore_convention
+			int Result = CLz4Block::Decompress(pFileData, DataSize, m_pDataFile->m_ppDataPtrs[Index], UncompressedSize);
+			if(Result != (int)UncompressedSize)
+				dbg_msg("datafile", "failed to decompress data index=%d", Index);
+			s = max(Result, 0);
+		}
+		else
+			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (Bytef*)pFileData, DataSize); // ignore_convention
 #if defined(CONF_ARCH_ENDIAN_BIG)
-			SwapSize = s;
+		SwapSize = s;
 #endif
 
-			// clean up the temporary buffers
-			mem_free(pTemp);
-		}
-		else
-		{
-			// load the data
-			dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
-			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(DataSize, 1);
-			m_pDataFile->m_pDataSizes[Index] = DataSize;
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
-		}
+		// clean up the temporary buffers
+		if(!m_pDataFile->IsMapped(pFileData))
+			mem_free(pFileData);
+	}
+	else
+	{
+		// the stored data is used as is, in place if the file is mapped
+		dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
+		m_pDataFile->m_ppDataPtrs[Index] = pFileData;
+		m_pDataFile->m_pDataSizes[Index] = DataSize;
+	}
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
-		if(Swap && SwapSize)
-			swap_endian(m_pDataFile->m_ppDataPtrs[Index], sizeof(int), SwapSize/sizeof(int));
+	if(Swap && SwapSize)
+		swap_endian(m_pDataFile->m_ppDataPtrs[Index], sizeof(int), SwapSize/sizeof(int));
 #endif
+}
+
+void *CDataFileReader::GetDataImpl(int Index, int Swap)
+{
+	if(!m_pDataFile) { return 0; }
+
+	if(Index < 0 || Index >= m_pDataFile->m_Header.m_NumRawData)
+		return 0;
+
+	// load it if needed
+	if(!m_pDataFile->m_ppDataPtrs[Index])
+	{
+		char *pFileData = ReadFileData(Index);
+		if(!pFileData)
+			return 0;
+		LoadData(Index, pFileData, Swap);
 	}
 
 	return m_pDataFile->m_ppDataPtrs[Index];
 }
 
+struct CPrefetchData
+{
+	CDataFileReader *m_pReader;
+	int *m_pIndices;
+	char **m_ppFileData;
+	int m_Swap;
+};
+
+void CDataFileReader::PrefetchRange(int Begin, int End, void *pUser)
+{
+	CPrefetchData *pData = (CPrefetchData *)pUser;
+	for(int i = Begin; i < End; i++)
+		pData->m_pReader->LoadData(pData->m_pIndices[i], pData->m_ppFileData[i], pData->m_Swap);
+}
+
+void CDataFileReader::Prefetch(CJobPool *pPool, const int *pIndices, int NumIndices, int Swap)
+{
+	if(!m_pDataFile)
+		return;
+	if(!pIndices)
+		NumIndices = m_pDataFile->m_Header.m_NumRawData;
+
+	CPrefetchData Data;
+	Data.m_pReader = this;
+	Data.m_pIndices = (int *)mem_alloc_tag(NumIndices*sizeof(int), 1, MEMTAG_MAP);
+	Data.m_ppFileData = (char **)mem_alloc_tag(NumIndices*sizeof(char *), 1, MEMTAG_MAP);
+	Data.m_Swap = Swap;
+
+	// the file is read here, only the decompression runs in parallel
+	int Num = 0;
+	for(int i = 0; i < NumIndices; i++)
+	{
+		int Index = pIndices ? pIndices[i] : i;
+		if(Index < 0 || Index >= m_pDataFile->m_Header.m_NumRawData || m_pDataFile->m_ppDataPtrs[Index])
+			continue;
+		char *pFileData = ReadFileData(Index);
+		if(!pFileData)
+			continue;
+
+		// keep listed twice from being loaded twice
+		m_pDataFile->m_ppDataPtrs[Index] = pFileData;
+		Data.m_pIndices[Num] = Index;
+		Data.m_ppFileData[Num] = pFileData;
+		Num++;
+	}
+
+	pPool->ParallelFor(0, Num, 1, PrefetchRange, &Data, CJobPool::PRIORITY_HIGH);
+
+	mem_free(Data.m_pIndices);
+	mem_free(Data.m_ppFileData);
+}
+
 void *CDataFileReader::GetData(int Index)
 {
 	return GetDataImpl(Index, 0);
@@ -364,9 +515,7 @@ void CDataFileReader::UnloadData(int Index)
 	if(Index < 0 || Index >= m_pDataFile->m_Header.m_NumRawData)
 		return;
 
-	mem_free(m_pDataFile->m_ppDataPtrs[Index]);
-	m_pDataFile->m_ppDataPtrs[Index] = 0x0;
-	m_pDataFile->m_pDataSizes[Index] = 0;
+	m_pDataFile->FreeData(Index);
 }
 
 int CDataFileReader::GetFileItemSize(int Index) const
@@ -407,6 +556,52 @@ void *CDataFileReader::GetItem(int Index, int *pType, int *pID)
 	return (void *)(i+1);
 }
 
+static unsigned HashItemKey(unsigned Key)
+{
+	return (Key*2654435761u)>>8;
+}
+
+void CDataFileReader::BuildItemIndex()
+{
+	unsigned NumSlots = 1;
+	while(NumSlots < (unsigned)m_pDataFile->m_Header.m_NumItems*2)
+		NumSlots <<= 1;
+	m_pDataFile->m_pItemSlots = (int *)mem_alloc_tag(NumSlots*sizeof(int), 1, MEMTAG_MAP);
+	m_pDataFile->m_ItemSlotMask = NumSlots-1;
+	mem_zero(m_pDataFile->m_pItemSlots, NumSlots*sizeof(int));
+
+	// only the items in the range of their type can be found, like with a search through it
+	for(int t = 0; t < m_pDataFile->m_Header.m_NumItemTypes; t++)
+	{
+		const CDatafileItemType *pType = &m_pDataFile->m_Info.m_pItemTypes[t];
+		int Start = clamp(pType->m_Start, 0, m_pDataFile->m_Header.m_NumItems);
+		int End = Start+clamp(pType->m_Num, 0, m_pDataFile->m_Header.m_NumItems-Start);
+		for(int i = Start; i < End; i++)
+		{
+			int Type, ID;
+			GetItem(i, &Type, &ID);
+			if(Type != (pType->m_Type&0xffff))
+				continue;
+			unsigned Slot = HashItemKey((Type<<16)|ID)&m_pDataFile->m_ItemSlotMask;
+			bool Found = false;
+			while(m_pDataFile->m_pItemSlots[Slot])
+			{
+				int SlotType, SlotID;
+				GetItem(m_pDataFile->m_pItemSlots[Slot]-1, &SlotType, &SlotID);
+				if(SlotType == Type && SlotID == ID)
+				{
+					Found = true;
+					break;
+				}
+				Slot = (Slot+1)&m_pDataFile->m_ItemSlotMask;
+			}
+			// the first one wins
+			if(!Found)
+				m_pDataFile->m_pItemSlots[Slot] = i+1;
+		}
+	}
+}
+
 void CDataFileReader::GetType(int Type, int *pStart, int *pNum)
 {
 	*pStart = 0;
@@ -430,14 +625,15 @@ void *CDataFileReader::FindItem(int Type, int ID)
 {
 	if(!m_pDataFile) return 0;
 
-	int Start, Num;
-	GetType(Type, &Start, &Num);
-	for(int i = 0; i < Num; i++)
+	Type &= 0xffff;
+	unsigned Slot = HashItemKey((Type<<16)|(ID&0xffff))&m_pDataFile->m_ItemSlotMask;
+	while(m_pDataFile->m_pItemSlots[Slot])
 	{
-		int ItemID;
-		void *pItem = GetItem(Start+i,0, &ItemID);
-		if(ID == ItemID)
+		int ItemType, ItemID;
+		void *pItem = GetItem(m_pDataFile->m_pItemSlots[Slot]-1, &ItemType, &ItemID);
+		if(ItemType == Type && ItemID == ID)
 			return pItem;
+		Slot = (Slot+1)&m_pDataFile->m_ItemSlotMask;
 	}
 	return 0;
 }
@@ -456,17 +652,22 @@ bool CDataFileReader::Close()
 	// free the data that is loaded
 	int i;
 	for(i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
-	{
-		mem_free(m_pDataFile->m_ppDataPtrs[i]);
-		m_pDataFile->m_pDataSizes[i] = 0;
-	}
+		m_pDataFile->FreeData(i);
 
+	io_munmap(m_pDataFile->m_pMapped, m_pDataFile->m_MappedSize);
 	io_close(m_pDataFile->m_File);
+	mem_free(m_pDataFile->m_pItemSlots);
 	mem_free(m_pDataFile);
 	m_pDataFile = 0;
 	return true;
 }
 
+int CDataFileReader::Version() const
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_Header.m_Version;
+}
+
 SHA256_DIGEST CDataFileReader::Sha256() const
 {
 	if(!m_pDataFile) return SHA256_ZEROED;
@@ -504,9 +705,11 @@ bool CDataFileReader::CheckSha256(IOHANDLE Handle, const void *pSha256)
 CDataFileWriter::CDataFileWriter()
 {
 	m_File = 0;
-	m_pItemTypes = static_cast<CItemTypeInfo *>(mem_alloc(sizeof(CItemTypeInfo) * MAX_ITEM_TYPES, 1));
-	m_pItems = static_cast<CItemInfo *>(mem_alloc(sizeof(CItemInfo) * MAX_ITEMS, 1));
-	m_pDatas = static_cast<CDataInfo *>(mem_alloc(sizeof(CDataInfo) * MAX_DATAS, 1));
+	m_pPool = 0;
+	m_Format = FORMAT_ZLIB;
+	m_pItemTypes = static_cast<CItemTypeInfo *>(mem_alloc_tag(sizeof(CItemTypeInfo) * MAX_ITEM_TYPES, 1, MEMTAG_MAP));
+	m_pItems = static_cast<CItemInfo *>(mem_alloc_tag(sizeof(CItemInfo) * MAX_ITEMS, 1, MEMTAG_MAP));
+	m_pDatas = static_cast<CDataInfo *>(mem_alloc_tag(sizeof(CDataInfo) * MAX_DATAS, 1, MEMTAG_MAP));
 }
 
 CDataFileWriter::~CDataFileWriter()
@@ -519,13 +722,15 @@ CDataFileWriter::~CDataFileWriter()
 	m_pDatas = 0;
 }
 
-bool CDataFileWriter::Open(class IStorage *pStorage, const char *pFilename)
+bool CDataFileWriter::Open(class IStorage *pStorage, const char *pFilename, CJobPool *pPool, int Format)
 {
 	dbg_assert(!m_File, "a file already exists");
 	m_File = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
 	if(!m_File)
 		return false;
 
+	m_pPool = pPool;
+	m_Format = Format;
 	m_NumItems = 0;
 	m_NumDatas = 0;
 	m_NumItemTypes = 0;
@@ -553,7 +758,7 @@ int CDataFileWriter::AddItem(int Type, int ID, int Size, const void *pData)
 	m_pItems[m_NumItems].m_Size = Size;
 
 	// copy data
-	m_pItems[m_NumItems].m_pData = mem_alloc(Size, 1);
+	m_pItems[m_NumItems].m_pData = mem_alloc_tag(Size, 1, MEMTAG_MAP);
 	mem_copy(m_pItems[m_NumItems].m_pData, pData, Size);
 
 	if(!m_pItemTypes[Type].m_Num) // count item types
@@ -576,28 +781,73 @@ int CDataFileWriter::AddItem(int Type, int ID, int Size, const void *pData)
 	return m_NumItems-1;
 }
 
-int CDataFileWriter::AddData(int Size, const void *pData)
+void CDataFileWriter::CompressData(CDataInfo *pInfo, const void *pData)
 {
-	if(!m_File) return 0;
-
-	dbg_assert(m_NumDatas < 1024, "too much data");
+	if(pInfo->m_Codec == DATACODEC_LZ4)
+	{
+		// blocks that don't get smaller are stored as they are
+		int Bound = CLz4Block::CompressBound(pInfo->m_UncompressedSize);
+		void *pCompData = mem_alloc_tag(Bound, 1, MEMTAG_MAP);
+		int Size = CLz4Block::Compress(pData, pInfo->m_UncompressedSize, pCompData, Bound);
+		if(Size < 0 || Size >= pInfo->m_UncompressedSize)
+		{
+			pInfo->m_Codec = DATACODEC_NONE;
+			mem_copy(pCompData, pData, pInfo->m_UncompressedSize);
+			Size = pInfo->m_UncompressedSize;
+		}
+		pInfo->m_CompressedSize = Size;
+		pInfo->m_pCompressedData = mem_alloc_tag(max(Size, 1), 1, MEMTAG_MAP);
+		mem_copy(pInfo->m_pCompressedData, pCompData, Size);
+		mem_free(pCompData);
+		return;
+	}
 
-	CDataInfo *pInfo = &m_pDatas[m_NumDatas];
-	unsigned long s = compressBound(Size);
-	void *pCompData = mem_alloc(s, 1); // temporary buffer that we use during compression
+	unsigned long s = compressBound(pInfo->m_UncompressedSize);
+	void *pCompData = mem_alloc_tag(s, 1, MEMTAG_MAP); // temporary buffer that we use during compression
 
-	int Result = compress((Bytef*)pCompData, &s, (Bytef*)pData, Size); // ignore_convention
+	int Result = compress((Bytef*)pCompData, &s, (Bytef*)pData, pInfo->m_UncompressedSize); // ignore_convention
 	if(Result != Z_OK)
 	{
 		dbg_msg("datafile", "compression error %d", Result);
 		dbg_assert(0, "zlib error");
 	}
 
-	pInfo->m_UncompressedSize = Size;
 	pInfo->m_CompressedSize = (int)s;
-	pInfo->m_pCompressedData = mem_alloc(pInfo->m_CompressedSize, 1);
+	pInfo->m_pCompressedData = mem_alloc_tag(pInfo->m_CompressedSize, 1, MEMTAG_MAP);
 	mem_copy(pInfo->m_pCompressedData, pCompData, pInfo->m_CompressedSize);
 	mem_free(pCompData);
+}
+
+void CDataFileWriter::CompressRange(int Begin, int End, void *pUser)
+{
+	CDataInfo *pDatas = (CDataInfo *)pUser;
+	for(int i = Begin; i < End; i++)
+	{
+		CompressData(&pDatas[i], pDatas[i].m_pUncompressedData);
+		mem_free(pDatas[i].m_pUncompressedData);
+		pDatas[i].m_pUncompressedData = 0;
+	}
+}
+
+int CDataFileWriter::AddData(int Size, const void *pData)
+{
+	if(!m_File) return 0;
+
+	dbg_assert(m_NumDatas < 1024, "too much data");
+
+	CDataInfo *pInfo = &m_pDatas[m_NumDatas];
+	pInfo->m_UncompressedSize = Size;
+	pInfo->m_CompressedSize = 0;
+	pInfo->m_pCompressedData = 0;
+	pInfo->m_pUncompressedData = 0;
+	pInfo->m_Codec = m_Format == FORMAT_FAST ? DATACODEC_LZ4 : DATACODEC_ZLIB;
+	if(m_pPool)
+	{
+		pInfo->m_pUncompressedData = mem_alloc_tag(max(Size, 1), 1, MEMTAG_MAP);
+		mem_copy(pInfo->m_pUncompressedData, pData, Size);
+	}
+	else
+		CompressData(pInfo, pData);
 
 	m_NumDatas++;
 	return m_NumDatas-1;
@@ -608,7 +858,7 @@ int CDataFileWriter::AddDataSwapped(int Size, const void *pData)
 	dbg_assert(Size%sizeof(int) == 0, "incorrect boundary");
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
-	void *pSwapped = mem_alloc(Size, 1); // temporary buffer that we use during compression
+	void *pSwapped = mem_alloc_tag(Size, 1, MEMTAG_MAP); // temporary buffer that we use during compression
 	mem_copy(pSwapped, pData, Size);
 	swap_endian(pSwapped, sizeof(int), Size/sizeof(int));
 	int Index = AddData(Size, pSwapped);
@@ -633,6 +883,10 @@ int CDataFileWriter::Finish()
 	if(DEBUG)
 		dbg_msg("datafile", "writing");
 
+	// compress the data that was added, each block on its own so the output stays the same
+	if(m_pPool)
+		m_pPool->ParallelFor(0, m_NumDatas, 1, CompressRange, m_pDatas);
+
 	// calculate sizes
 	for(int i = 0; i < m_NumItems; i++)
 	{
@@ -649,6 +903,8 @@ int CDataFileWriter::Finish()
 	TypesSize = m_NumItemTypes*sizeof(CDatafileItemType);
 	HeaderSize = sizeof(CDatafileHeader);
 	OffsetSize = (m_NumItems + m_NumDatas + m_NumDatas) * sizeof(int); // ItemOffsets, DataOffsets, DataUncompressedSizes
+	if(m_Format == FORMAT_FAST)
+		OffsetSize += m_NumDatas * sizeof(int); // DataCodecs
 	FileSize = HeaderSize + TypesSize + OffsetSize + ItemSize + DataSize;
 	SwapSize = FileSize - DataSize;
 
@@ -663,7 +919,7 @@ int CDataFileWriter::Finish()
 		Header.m_aID[1] = 'A';
 		Header.m_aID[2] = 'T';
 		Header.m_aID[3] = 'A';
-		Header.m_Version = 4;
+		Header.m_Version = m_Format == FORMAT_FAST ? 5 : 4;
 		Header.m_Size = FileSize - 16;
 		Header.m_Swaplen = SwapSize - 16;
 		Header.m_NumItemTypes = m_NumItemTypes;
@@ -750,6 +1006,16 @@ int CDataFileWriter::Finish()
 		io_write(m_File, &UncompressedSize, sizeof(UncompressedSize));
 	}
 
+	// write data codecs
+	for(int i = 0; m_Format == FORMAT_FAST && i < m_NumDatas; i++)
+	{
+		int Codec = m_pDatas[i].m_Codec;
+#if defined(CONF_ARCH_ENDIAN_BIG)
+		swap_endian(&Codec, sizeof(int), sizeof(Codec)/sizeof(int));
+#endif
+		io_write(m_File, &Codec, sizeof(Codec));
+	}
+
 	// write m_pItems
 	for(int i = 0; i < 0xffff; i++)
 	{
@@ -799,3 +1065,34 @@ int CDataFileWriter::Finish()
 		dbg_msg("datafile", "done");
 	return 1;
 }
+
+bool CDataFileWriter::Resave(class IStorage *pStorage, const char *pSrcFilename, int SrcStorageType, const char *pDstFilename, int Format, CJobPool *pPool)
+{
+	CDataFileReader Reader;
+	if(!Reader.Open(pStorage, pSrcFilename, SrcStorageType))
+		return false;
+	CDataFileWriter Writer;
+	if(!Writer.Open(pStorage, pDstFilename, pPool, Format))
+		return false;
+
+	// add all items
+	for(int Index = 0; Index < Reader.NumItems(); Index++)
+	{
+		int Type, ID;
+		void *pPtr = Reader.GetItem(Index, &Type, &ID);
+		Writer.AddItem(Type, ID, Reader.GetItemSize(Index), pPtr);
+	}
+
+	// add all data, decompressing it in parallel as well
+	if(pPool)
+		Reader.Prefetch(pPool, 0, 0, 0);
+	for(int Index = 0; Index < Reader.NumData(); Index++)
+	{
+		void *pPtr = Reader.GetData(Index);
+		Writer.AddData(Reader.GetDataSize(Index), pPtr);
+		Reader.UnloadData(Index);
+	}
+
+	Reader.Close();
+	return Writer.Finish() != 0;
+}
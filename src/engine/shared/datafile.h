@@ -10,21 +10,29 @@
 class CDataFileReader
 {
 	struct CDatafile *m_pDataFile;
+	char *ReadFileData(int Index);
+	void LoadData(int Index, char *pFileData, int Swap);
+	static void PrefetchRange(int Begin, int End, void *pUser);
 	void *GetDataImpl(int Index, int Swap);
 	int GetFileDataSize(int Index) const;
 	int GetFileItemSize(int Index) const;
+	void BuildItemIndex();
 public:
 	CDataFileReader() : m_pDataFile(0) {}
 	~CDataFileReader() { Close(); }
 
 	bool IsOpen() const { return m_pDataFile != 0; }
 
-	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType);
+	// a mapped file is used in place instead of being read, it must not be rewritten while it is open
+	// pass the hashes of a file that is known to be unchanged to skip hashing it
+	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType, bool Mapped = false, const SHA256_DIGEST *pKnownSha256 = 0, unsigned KnownCrc = 0);
 	bool Close();
 
 	void *GetData(int Index);
 	void *GetDataSwapped(int Index); // makes sure that the data is 32bit LE ints when saved
 	int GetDataSize(int Index) const;
+	// loads the listed data, or all of it if pIndices is 0, and decompresses it on the pool
+	void Prefetch(class CJobPool *pPool, const int *pIndices, int NumIndices, int Swap);
 	void ReplaceData(int Index, char *pData, int Size);
 	void UnloadData(int Index);
 	void *GetItem(int Index, int *pType, int *pID);
@@ -35,6 +43,7 @@ public:
 	int NumData() const;
 	void Unload();
 
+	int Version() const;
 	SHA256_DIGEST Sha256() const;
 	unsigned Crc() const;
 
@@ -49,6 +58,8 @@ class CDataFileWriter
 		int m_UncompressedSize;
 		int m_CompressedSize;
 		void *m_pCompressedData;
+		void *m_pUncompressedData; // copy kept until Finish compresses it
+		int m_Codec;
 	};
 
 	struct CItemInfo
@@ -76,6 +87,8 @@ class CDataFileWriter
 	};
 
 	IOHANDLE m_File;
+	class CJobPool *m_pPool;
+	int m_Format;
 	int m_NumItems;
 	int m_NumDatas;
 	int m_NumItemTypes;
@@ -83,14 +96,27 @@ class CDataFileWriter
 	CItemInfo *m_pItems;
 	CDataInfo *m_pDatas;
 
+	static void CompressData(CDataInfo *pInfo, const void *pData);
+	static void CompressRange(int Begin, int End, void *pUser);
+
 public:
+	enum
+	{
+		FORMAT_ZLIB=0, // version 4, readable by all clients
+		FORMAT_FAST, // version 5, blocks use a codec that decompresses faster
+	};
+
 	CDataFileWriter();
 	~CDataFileWriter();
-	bool Open(class IStorage *pStorage, const char *Filename);
+	// with a pool the data is compressed in parallel by Finish instead of by AddData
+	bool Open(class IStorage *pStorage, const char *Filename, class CJobPool *pPool = 0, int Format = FORMAT_ZLIB);
 	int AddData(int Size, const void *pData);
 	int AddDataSwapped(int Size, const void *pData);
 	int AddItem(int Type, int ID, int Size, const void *pData);
 	int Finish();
+
+	// copies the items and data of a datafile to a new file in the given format
+	static bool Resave(class IStorage *pStorage, const char *pSrcFilename, int SrcStorageType, const char *pDstFilename, int Format, class CJobPool *pPool = 0);
 };
 
 
@@ -9,12 +9,15 @@
 #include "compression.h"
 #include "datafile.h"
 #include "demo.h"
+#include "demostream.h"
 #include "memheap.h"
 #include "network.h"
 #include "snapshot.h"
 
 static const unsigned char gs_aHeaderMarker[7] = {'T', 'W', 'D', 'E', 'M', 'O', 0};
-static const unsigned char gs_ActVersion = 4;
+static const unsigned char gs_ActVersion = 5;
+static const unsigned char gs_OldVersion = 4; // without the keyframe index
+static const unsigned char gs_aIndexMarker[4] = {'T', 'W', 'I', 'X'};
 static const int gs_LengthOffset = 152;
 static const int gs_NumMarkersOffset = 176;
 
@@ -23,13 +26,25 @@ CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta)
 	m_File = 0;
 	m_LastTickMarker = -1;
 	m_pSnapshotDelta = pSnapshotDelta;
+	m_pWriteDelta = pSnapshotDelta;
+	m_WriterQueueSize = 0;
+	m_pWriterThread = 0;
+	m_pQueueMemory = 0;
+	m_pIndex = 0;
+	m_IndexSize = 0;
+	m_IndexCapacity = 0;
+	m_pStream = 0;
 	m_Huffman.Init();
 }
 
+CDemoRecorder::~CDemoRecorder()
+{
+	mem_free(m_pIndex);
+}
+
 // Record
 int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetVersion, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc, const char *pType)
 {
-	CDemoHeader Header;
 	if(m_File)
 		return -1;
 
@@ -70,16 +85,28 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 		return -1;
 	}
 
+	int Result = Start(pStorage, pConsole, pFilename, pNetVersion, pMap, Crc, pType, MapFile, io_length(MapFile));
+	io_close(MapFile);
+	return Result;
+}
+
+int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetVersion, const char *pMap, unsigned Crc, const char *pType, IOHANDLE MapFile, unsigned MapSize)
+{
+	CDemoHeader Header;
+	if(m_File)
+		return -1;
+
+	m_pConsole = pConsole;
+
 	IOHANDLE DemoFile = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
 	if(!DemoFile)
 	{
-		io_close(MapFile);
-		MapFile = 0;
 		char aBuf[256];
 		str_format(aBuf, sizeof(aBuf), "Unable to open '%s' for recording", pFilename);
 		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
 		return -1;
 	}
+	io_buffer(DemoFile, m_aFileBuffer, sizeof(m_aFileBuffer));
 
 	// write header
 	mem_zero(&Header, sizeof(Header));
@@ -87,7 +114,6 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	Header.m_Version = gs_ActVersion;
 	str_copy(Header.m_aNetversion, pNetVersion, sizeof(Header.m_aNetversion));
 	str_copy(Header.m_aMapName, pMap, sizeof(Header.m_aMapName));
-	unsigned MapSize = io_length(MapFile);
 	uint_to_bytes_be(Header.m_aMapSize, MapSize);
 	uint_to_bytes_be(Header.m_aMapCrc, Crc);
 	str_copy(Header.m_aType, pType, sizeof(Header.m_aType));
@@ -99,24 +125,50 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 
 	// write map data
 	unsigned char aChunk[1024*64];
-	while(1)
+	for(unsigned Copied = 0; Copied < MapSize;)
 	{
-		int Bytes = io_read(MapFile, &aChunk, sizeof(aChunk));
+		int Bytes = io_read(MapFile, &aChunk, min(MapSize-Copied, (unsigned)sizeof(aChunk)));
 		if(Bytes <= 0)
 			break;
 		io_write(DemoFile, &aChunk, Bytes);
+		Copied += Bytes;
 	}
-	io_close(MapFile);
 
 	m_LastKeyFrame = -1;
 	m_LastTickMarker = -1;
+	m_LastWrittenTickMarker = -1;
+	m_IndexSize = 0;
+	m_KeyFramePos = io_tell(DemoFile);
 	m_FirstTick = -1;
 	m_NumTimelineMarkers = 0;
 
+	if(m_WriterQueueSize)
+	{
+		// the writer creates the deltas with its own copy, the item sizes are known by now
+		int QueueSize = max(m_WriterQueueSize, (int)CSnapshot::MAX_SIZE*4);
+		m_pQueueMemory = mem_alloc(QueueSize, 1);
+		m_Queue.Init(m_pQueueMemory, QueueSize);
+		m_pWriteDelta = new CSnapshotDelta(*m_pSnapshotDelta);
+		m_QueueLock = lock_create();
+		semaphore_init(&m_QueuedChunks);
+		semaphore_init(&m_QueueSpace);
+		m_WaitingForSpace = false;
+		m_NumStalls = 0;
+	}
+
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "Recording to '%s'", pFilename);
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
 	m_File = DemoFile;
+	if(m_pStream)
+	{
+		char aPath[IO_MAX_PATH_LENGTH];
+		pStorage->GetCompletePath(IStorage::TYPE_SAVE, pFilename, aPath, sizeof(aPath));
+		io_flush(m_File);
+		m_pStream->Begin(aPath, m_KeyFramePos);
+	}
+	if(m_pQueueMemory)
+		m_pWriterThread = thread_init(WriterThread, this);
 
 	return 0;
 }
@@ -131,6 +183,11 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 		7 = Not set
 		5-6	= Type
 		0-4	= Size
+
+	Index (since version 5)
+		a 0 byte ends the chunks, then follow the keyframes as 4 byte
+		tick and 4 byte file position, and a footer of the position of
+		the 0 byte, the number of keyframes, the last tick and "TWIX"
 */
 
 enum
@@ -146,12 +203,25 @@ enum
 	CHUNKTYPE_MESSAGE = 2,
 	CHUNKTYPE_DELTA = 3,
 
-	CHUNKFLAG_BIGSIZE = 0x10
+	CHUNKFLAG_BIGSIZE = 0x10,
+
+	CHUNK_END = 0,
+	INDEX_ENTRY_SIZE = 8,
+	INDEX_FOOTER_SIZE = 16,
 };
 
+void CDemoRecorder::Error(const char *pMsg)
+{
+	// the console isn't safe to use from the writer thread, the queue exists as long as it runs
+	if(m_pQueueMemory)
+		dbg_msg("demo_recorder", "%s", pMsg);
+	else
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", pMsg);
+}
+
 void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 {
-	if(m_LastTickMarker == -1 || Tick-m_LastTickMarker > 63 || Keyframe)
+	if(m_LastWrittenTickMarker == -1 || Tick-m_LastWrittenTickMarker > 63 || Keyframe)
 	{
 		unsigned char aChunk[5];
 		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER;
@@ -165,13 +235,11 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 	else
 	{
 		unsigned char aChunk[1];
-		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | (Tick-m_LastTickMarker);
+		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | (Tick-m_LastWrittenTickMarker);
 		io_write(m_File, aChunk, sizeof(aChunk));
 	}
 
-	m_LastTickMarker = Tick;
-	if(m_FirstTick < 0)
-		m_FirstTick = Tick;
+	m_LastWrittenTickMarker = Tick;
 }
 
 void CDemoRecorder::Write(int Type, const void *pData, int Size)
@@ -190,13 +258,13 @@ void CDemoRecorder::Write(int Type, const void *pData, int Size)
 	Size = CVariableInt::Compress(aBuffer2, Size, aBuffer, sizeof(aBuffer)); // buffer2 -> buffer
 	if(Size < 0)
 	{
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", "error during intpack compression");
+		Error("error during intpack compression");
 		return;
 	}
 	Size = m_Huffman.Compress(aBuffer, Size, aBuffer2, sizeof(aBuffer2)); // buffer -> buffer2
 	if(Size < 0)
 	{
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", "error during network compression");
+		Error("error during network compression");
 		return;
 	}
 
@@ -227,18 +295,39 @@ void CDemoRecorder::Write(int Type, const void *pData, int Size)
 	io_write(m_File, aBuffer2, Size);
 }
 
-void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+void CDemoRecorder::AddIndexEntry(int Tick)
 {
-	char aTmpData[CSnapshot::MAX_SIZE];
+	// remember where the keyframe starts
+	if(m_IndexSize+INDEX_ENTRY_SIZE > m_IndexCapacity)
+	{
+		m_IndexCapacity = max(m_IndexCapacity*2, 1024);
+		unsigned char *pIndex = (unsigned char *)mem_alloc(m_IndexCapacity, 1);
+		if(m_pIndex)
+			mem_copy(pIndex, m_pIndex, m_IndexSize);
+		mem_free(m_pIndex);
+		m_pIndex = pIndex;
+	}
+	m_KeyFramePos = io_tell(m_File);
+	uint_to_bytes_be(m_pIndex+m_IndexSize, Tick);
+	uint_to_bytes_be(m_pIndex+m_IndexSize+4, m_KeyFramePos);
+	m_IndexSize += INDEX_ENTRY_SIZE;
+}
+
+void CDemoRecorder::WriteSnapshot(int Tick, const void *pData, int Size)
+{
+	CScratch Scratch;
+	char *pTmpData = (char *)Scratch.Allocate(CSnapshot::MAX_SIZE);
 
 	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > SERVER_TICK_SPEED*5)
 	{
+		AddIndexEntry(Tick);
+
 		// write full tickmarker
 		WriteTickMarker(Tick, 1);
 
 		// write snapshot
-		int SnapSize = ((CSnapshot*)pData)->Serialize(aTmpData);
-		Write(CHUNKTYPE_SNAPSHOT, aTmpData, SnapSize);
+		int SnapSize = ((CSnapshot*)pData)->Serialize(pTmpData);
+		Write(CHUNKTYPE_SNAPSHOT, pTmpData, SnapSize);
 
 		m_LastKeyFrame = Tick;
 		mem_copy(m_aLastSnapshotData, pData, Size);
@@ -249,19 +338,139 @@ void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
 		WriteTickMarker(Tick, 0);
 
 		// create delta
-		int DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &aTmpData);
+		int DeltaSize = m_pWriteDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, pTmpData);
 		if(DeltaSize)
 		{
 			// record delta
-			Write(CHUNKTYPE_DELTA, aTmpData, DeltaSize);
+			Write(CHUNKTYPE_DELTA, pTmpData, DeltaSize);
 			mem_copy(m_aLastSnapshotData, pData, Size);
 		}
 	}
+
+	// the file ends with whole chunks here, viewers of the stream can have them
+	if(m_pStream)
+	{
+		io_flush(m_File);
+		m_pStream->Publish(m_KeyFramePos, io_tell(m_File));
+	}
+}
+
+void CDemoRecorder::WriteIndex()
+{
+	unsigned char aFooter[INDEX_FOOTER_SIZE];
+	uint_to_bytes_be(aFooter, io_tell(m_File));
+	uint_to_bytes_be(aFooter+4, m_IndexSize/INDEX_ENTRY_SIZE);
+	uint_to_bytes_be(aFooter+8, m_LastWrittenTickMarker);
+	mem_copy(aFooter+12, gs_aIndexMarker, sizeof(gs_aIndexMarker));
+
+	unsigned char End = CHUNK_END;
+	io_write(m_File, &End, sizeof(End));
+	io_write(m_File, m_pIndex, m_IndexSize);
+	io_write(m_File, aFooter, sizeof(aFooter));
+}
+
+void CDemoRecorder::Queue(int Type, int Tick, const void *pData, int Size)
+{
+	// wait for the writer to catch up when the queue is full, dropping chunks would break the deltas
+	lock_wait(m_QueueLock);
+	CQueuedChunk *pChunk = (CQueuedChunk *)m_Queue.Allocate(sizeof(CQueuedChunk)+Size);
+	while(!pChunk)
+	{
+		m_WaitingForSpace = true;
+		m_NumStalls++;
+		lock_unlock(m_QueueLock);
+		semaphore_wait(&m_QueueSpace);
+		lock_wait(m_QueueLock);
+		pChunk = (CQueuedChunk *)m_Queue.Allocate(sizeof(CQueuedChunk)+Size);
+	}
+	lock_unlock(m_QueueLock);
+
+	// the writer doesn't look at it before it's signaled
+	pChunk->m_Type = Type;
+	pChunk->m_Tick = Tick;
+	pChunk->m_Size = Size;
+	mem_copy(pChunk+1, pData, Size);
+	semaphore_signal(&m_QueuedChunks);
+}
+
+void CDemoRecorder::WriterThread(void *pUser)
+{
+	CDemoRecorder *pSelf = (CDemoRecorder *)pUser;
+	while(1)
+	{
+		semaphore_wait(&pSelf->m_QueuedChunks);
+		lock_wait(pSelf->m_QueueLock);
+		CQueuedChunk *pChunk = (CQueuedChunk *)pSelf->m_Queue.First();
+		lock_unlock(pSelf->m_QueueLock);
+
+		// the signal without a chunk comes after all others
+		if(!pChunk)
+			break;
+
+		// the chunk stays allocated while it's used
+		if(pChunk->m_Type == CHUNKTYPE_SNAPSHOT)
+			pSelf->WriteSnapshot(pChunk->m_Tick, pChunk+1, pChunk->m_Size);
+		else
+			pSelf->Write(pChunk->m_Type, pChunk+1, pChunk->m_Size);
+
+		lock_wait(pSelf->m_QueueLock);
+		pSelf->m_Queue.PopFirst();
+		if(pSelf->m_WaitingForSpace)
+		{
+			pSelf->m_WaitingForSpace = false;
+			semaphore_signal(&pSelf->m_QueueSpace);
+		}
+		lock_unlock(pSelf->m_QueueLock);
+	}
+}
+
+void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+{
+	if(!m_File)
+		return;
+
+	m_LastTickMarker = Tick;
+	if(m_FirstTick < 0)
+		m_FirstTick = Tick;
+
+	if(m_pWriterThread)
+		Queue(CHUNKTYPE_SNAPSHOT, Tick, pData, Size);
+	else
+		WriteSnapshot(Tick, pData, Size);
+}
+
+void CDemoRecorder::RecordChunk(const void *pHeader, int HeaderSize, const void *pData, int Size, int Type, int Tick)
+{
+	if(!m_File)
+		return;
+	dbg_assert(!m_pWriterThread, "raw chunks can't be recorded with the writer thread");
+
+	if(Type&CHUNKTYPEFLAG_TICKMARKER)
+	{
+		if(Type&CHUNKTICKFLAG_KEYFRAME)
+		{
+			AddIndexEntry(Tick);
+			m_LastKeyFrame = Tick;
+		}
+		m_LastTickMarker = Tick;
+		m_LastWrittenTickMarker = Tick;
+		if(m_FirstTick < 0)
+			m_FirstTick = Tick;
+	}
+
+	io_write(m_File, pHeader, HeaderSize);
+	io_write(m_File, pData, Size);
 }
 
 void CDemoRecorder::RecordMessage(const void *pData, int Size)
 {
-	Write(CHUNKTYPE_MESSAGE, pData, Size);
+	if(!m_File)
+		return;
+
+	if(m_pWriterThread)
+		Queue(CHUNKTYPE_MESSAGE, 0, pData, Size);
+	else
+		Write(CHUNKTYPE_MESSAGE, pData, Size);
 }
 
 int CDemoRecorder::Stop()
@@ -269,6 +478,39 @@ int CDemoRecorder::Stop()
 	if(!m_File)
 		return -1;
 
+	if(m_pWriterThread)
+	{
+		// let the writer finish the queue
+		semaphore_signal(&m_QueuedChunks);
+		thread_wait(m_pWriterThread);
+		thread_destroy(m_pWriterThread);
+		m_pWriterThread = 0;
+
+		if(m_NumStalls)
+		{
+			char aBuf[128];
+			str_format(aBuf, sizeof(aBuf), "recording waited %d times for the writer, consider a larger demo queue", m_NumStalls);
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", aBuf);
+		}
+
+		semaphore_destroy(&m_QueueSpace);
+		semaphore_destroy(&m_QueuedChunks);
+		lock_destroy(m_QueueLock);
+		delete m_pWriteDelta;
+		m_pWriteDelta = m_pSnapshotDelta;
+		mem_free(m_pQueueMemory);
+		m_pQueueMemory = 0;
+	}
+
+	// viewers of the stream get the chunks up to the end marker, the index is for the file
+	long EndPos = io_tell(m_File)+1;
+	WriteIndex();
+	if(m_pStream)
+	{
+		io_flush(m_File);
+		m_pStream->End(EndPos);
+	}
+
 	// add the demo length to the header
 	io_seek(m_File, gs_LengthOffset, IOSEEK_START);
 	unsigned char aLength[4];
@@ -296,20 +538,25 @@ int CDemoRecorder::Stop()
 
 void CDemoRecorder::AddDemoMarker()
 {
-	if(m_LastTickMarker < 0 || m_NumTimelineMarkers >= MAX_TIMELINE_MARKERS)
-		return;
+	if(m_LastTickMarker >= 0 && AddDemoMarker(m_LastTickMarker))
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Added timeline marker");
+}
+
+bool CDemoRecorder::AddDemoMarker(int Tick)
+{
+	if(m_NumTimelineMarkers >= MAX_TIMELINE_MARKERS)
+		return false;
 
 	// not more than 1 marker in a second
 	if(m_NumTimelineMarkers > 0)
 	{
-		int Diff = m_LastTickMarker - m_aTimelineMarkers[m_NumTimelineMarkers-1];
+		int Diff = Tick - m_aTimelineMarkers[m_NumTimelineMarkers-1];
 		if(Diff < SERVER_TICK_SPEED*1.0f)
-			return;
+			return false;
 	}
 
-	m_aTimelineMarkers[m_NumTimelineMarkers++] = m_LastTickMarker;
-
-	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Added timeline marker");
+	m_aTimelineMarkers[m_NumTimelineMarkers++] = Tick;
+	return true;
 }
 
 
@@ -320,9 +567,18 @@ CDemoPlayer::CDemoPlayer(class CSnapshotDelta *pSnapshotDelta)
 	m_File = 0;
 	m_aErrorMsg[0] = 0;
 	m_pKeyFrames = 0;
+	m_pListener = 0;
 
 	m_pSnapshotDelta = pSnapshotDelta;
 	m_LastSnapshotDataSize = -1;
+
+	m_pDecoder = 0;
+	m_pDecodeDelta = 0;
+	m_DecodeQueueSize = 0;
+	m_SaveMaps = true;
+	m_Live = false;
+	m_pDecoderThread = 0;
+	m_pQueueMemory = 0;
 }
 
 void CDemoPlayer::SetListener(IListener *pListener)
@@ -331,16 +587,22 @@ void CDemoPlayer::SetListener(IListener *pListener)
 }
 
 
-int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
+int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick, unsigned char *pHeader, int *pHeaderSize)
 {
-	unsigned char Chunk = 0;
+	unsigned char aHeader[5];
+	int HeaderSize = 1;
 
 	*pSize = 0;
 	*pType = 0;
 
-	if(io_read(m_File, &Chunk, sizeof(Chunk)) != sizeof(Chunk))
+	if(io_read(m_File, aHeader, 1) != 1)
 		return -1;
 
+	// the keyframe index follows
+	unsigned char Chunk = aHeader[0];
+	if(Chunk == CHUNK_END)
+		return 1;
+
 	if(Chunk&CHUNKTYPEFLAG_TICKMARKER)
 	{
 		// decode tick marker
@@ -349,10 +611,10 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 
 		if(Tickdelta == 0)
 		{
-			unsigned char aTickData[4];
-			if(io_read(m_File, aTickData, sizeof(aTickData)) != sizeof(aTickData))
+			if(io_read(m_File, aHeader+1, 4) != 4)
 				return -1;
-			*pTick = bytes_be_to_uint(aTickData);
+			HeaderSize += 4;
+			*pTick = bytes_be_to_uint(aHeader+1);
 		}
 		else
 		{
@@ -367,23 +629,71 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 
 		if(*pSize == 30)
 		{
-			unsigned char aSizeData[1];
-			if(io_read(m_File, aSizeData, sizeof(aSizeData)) != sizeof(aSizeData))
+			if(io_read(m_File, aHeader+1, 1) != 1)
 				return -1;
-			*pSize = aSizeData[0];
+			HeaderSize += 1;
+			*pSize = aHeader[1];
 		}
 		else if(*pSize == 31)
 		{
-			unsigned char aSizeData[2];
-			if(io_read(m_File, aSizeData, sizeof(aSizeData)) != sizeof(aSizeData))
+			if(io_read(m_File, aHeader+1, 2) != 2)
 				return -1;
-			*pSize = (aSizeData[1]<<8) | aSizeData[0];
+			HeaderSize += 2;
+			*pSize = (aHeader[2]<<8) | aHeader[1];
 		}
 	}
 
+	if(pHeader)
+	{
+		mem_copy(pHeader, aHeader, HeaderSize);
+		*pHeaderSize = HeaderSize;
+	}
 	return 0;
 }
 
+bool CDemoPlayer::ReadIndex()
+{
+	long StartPos = io_tell(m_File);
+	long Length = io_length(m_File);
+	bool Valid = false;
+
+	unsigned char aFooter[INDEX_FOOTER_SIZE];
+	if(Length-StartPos >= INDEX_FOOTER_SIZE+1 && io_seek(m_File, -INDEX_FOOTER_SIZE, IOSEEK_END) == 0 &&
+		io_read(m_File, aFooter, sizeof(aFooter)) == sizeof(aFooter) && mem_comp(aFooter+12, gs_aIndexMarker, sizeof(gs_aIndexMarker)) == 0)
+	{
+		// the index has to fill the rest of the file exactly
+		long EndPos = bytes_be_to_uint(aFooter);
+		unsigned NumKeyFrames = bytes_be_to_uint(aFooter+4);
+		if(EndPos >= StartPos && NumKeyFrames <= (unsigned)(Length-EndPos)/INDEX_ENTRY_SIZE &&
+			EndPos+1+NumKeyFrames*INDEX_ENTRY_SIZE+INDEX_FOOTER_SIZE == Length)
+		{
+			unsigned char *pIndex = (unsigned char *)mem_alloc(NumKeyFrames*INDEX_ENTRY_SIZE+1, 1);
+			io_seek(m_File, EndPos+1, IOSEEK_START);
+			if(io_read(m_File, pIndex, NumKeyFrames*INDEX_ENTRY_SIZE) == NumKeyFrames*INDEX_ENTRY_SIZE)
+			{
+				m_pKeyFrames = (CKeyFrame*)mem_alloc(NumKeyFrames*sizeof(CKeyFrame)+1, 1);
+				for(unsigned i = 0; i < NumKeyFrames; i++)
+				{
+					m_pKeyFrames[i].m_Tick = bytes_be_to_uint(pIndex+i*INDEX_ENTRY_SIZE);
+					m_pKeyFrames[i].m_Filepos = bytes_be_to_uint(pIndex+i*INDEX_ENTRY_SIZE+4);
+				}
+				m_Info.m_SeekablePoints = NumKeyFrames;
+				if(NumKeyFrames)
+				{
+					// the first tick marker always is a keyframe
+					m_Info.m_Info.m_FirstTick = m_pKeyFrames[0].m_Tick;
+					m_Info.m_Info.m_LastTick = bytes_be_to_uint(aFooter+8);
+				}
+				Valid = true;
+			}
+			mem_free(pIndex);
+		}
+	}
+
+	io_seek(m_File, StartPos, IOSEEK_START);
+	return Valid;
+}
+
 void CDemoPlayer::ScanFile()
 {
 	CHeap Heap;
@@ -438,115 +748,318 @@ void CDemoPlayer::ScanFile()
 	io_seek(m_File, StartPos, IOSEEK_START);
 }
 
-void CDemoPlayer::DoTick()
+enum
 {
-	static char aCompressedData[CSnapshot::MAX_SIZE];
-	static char aDecompressed[CSnapshot::MAX_SIZE];
-	static char aData[CSnapshot::MAX_SIZE];
-	static char aNewSnap[CSnapshot::MAX_SIZE];
-	bool GotSnapshot = false;
+	DECODED_SNAPSHOT=0,
+	DECODED_SKIPPED_SNAPSHOT, // a delta without a snapshot to apply it to or a broken one, the data is the error
+	DECODED_MESSAGE,
+	DECODED_TICKMARKER,
+	DECODED_EOF,
+	DECODED_ERROR, // the data is the error
+	DECODED_WAIT, // a live demo isn't written further yet, the file is back at the start of the chunk
+};
 
-	// update ticks
-	m_Info.m_PreviousTick = m_Info.m_Info.m_CurrentTick;
-	m_Info.m_Info.m_CurrentTick = m_Info.m_NextTick;
-	int ChunkTick = m_Info.m_Info.m_CurrentTick;
+const void *CDemoPlayer::DecodeError(CDecodedChunk *pChunk, const char *pMsg)
+{
+	str_copy(m_pDecoder->m_aError, pMsg, sizeof(m_pDecoder->m_aError));
+	pChunk->m_Type = DECODED_ERROR;
+	pChunk->m_Size = str_length(m_pDecoder->m_aError)+1;
+	return m_pDecoder->m_aError;
+}
 
+const void *CDemoPlayer::DecodeChunk(CDecodedChunk *pChunk)
+{
+	CDecoder *pDecoder = m_pDecoder;
 	while(1)
 	{
-		int DataSize = 0;
+		pChunk->m_Size = 0;
+
+		// the tick only changes with a complete header
+		long ChunkPos = io_tell(m_File);
 		int ChunkType, ChunkSize;
-		if(ReadChunkHeader(&ChunkType, &ChunkSize, &ChunkTick))
+		int Result = ReadChunkHeader(&ChunkType, &ChunkSize, &pDecoder->m_Tick);
+		if(Result < 0 && m_Live)
 		{
-			// stop on error or eof
-			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "end of file");
-			if(m_Info.m_PreviousTick == -1)
-			{
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", "empty demo");
-				Stop();
-			}
-			else
-				Pause();
-			break;
+			io_seek(m_File, ChunkPos, IOSEEK_START);
+			pChunk->m_Type = DECODED_WAIT;
+			return 0;
 		}
+		if(Result)
+		{
+			pChunk->m_Type = DECODED_EOF;
+			return 0;
+		}
+		pChunk->m_Tick = pDecoder->m_Tick;
 
 		// read the chunk
+		int DataSize = 0;
 		if(ChunkSize)
 		{
-			if(io_read(m_File, aCompressedData, ChunkSize) != (unsigned)ChunkSize)
+			if(io_read(m_File, pDecoder->m_aCompressed, ChunkSize) != (unsigned)ChunkSize)
 			{
-				// stop on error or eof
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error reading chunk");
-				Stop();
-				break;
+				if(m_Live)
+				{
+					io_seek(m_File, ChunkPos, IOSEEK_START);
+					pChunk->m_Type = DECODED_WAIT;
+					return 0;
+				}
+				return DecodeError(pChunk, "error reading chunk");
 			}
 
-			DataSize = m_Huffman.Decompress(aCompressedData, ChunkSize, aDecompressed, sizeof(aDecompressed));
+			DataSize = m_Huffman.Decompress(pDecoder->m_aCompressed, ChunkSize, pDecoder->m_aDecompressed, sizeof(pDecoder->m_aDecompressed));
 			if(DataSize < 0)
-			{
-				// stop on error or eof
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during network decompression");
-				Stop();
-				break;
-			}
+				return DecodeError(pChunk, "error during network decompression");
 
-			DataSize = CVariableInt::Decompress(aDecompressed, DataSize, aData, sizeof(aData));
+			DataSize = CVariableInt::Decompress(pDecoder->m_aDecompressed, DataSize, pDecoder->m_aData, sizeof(pDecoder->m_aData));
 			if(DataSize < 0)
-			{
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during intpack decompression");
-				Stop();
-				break;
-			}
+				return DecodeError(pChunk, "error during intpack decompression");
 		}
 
 		if(ChunkType == CHUNKTYPE_DELTA)
 		{
-			// process delta snapshot
-			GotSnapshot = true;
-
 			// only unpack the delta if we have a valid snapshot
-			if(m_LastSnapshotDataSize == -1)
-				continue;
-
-			DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)aNewSnap, aData, DataSize);
-			if(DataSize >= 0)
-			{
-				if(m_pListener)
-					m_pListener->OnDemoPlayerSnapshot(aNewSnap, DataSize);
+			pChunk->m_Type = DECODED_SKIPPED_SNAPSHOT;
+			if(pDecoder->m_SnapshotSize == -1)
+				return 0;
 
-				m_LastSnapshotDataSize = DataSize;
-				mem_copy(m_aLastSnapshotData, aNewSnap, DataSize);
-			}
-			else
+			DataSize = m_pDecodeDelta->UnpackDelta((CSnapshot*)pDecoder->m_aSnapshot, (CSnapshot*)pDecoder->m_aNewSnapshot, pDecoder->m_aData, DataSize);
+			if(DataSize < 0)
 			{
-				char aBuf[64];
-				str_format(aBuf, sizeof(aBuf), "error during unpacking of delta, err=%d", DataSize);
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", aBuf);
+				str_format(pDecoder->m_aError, sizeof(pDecoder->m_aError), "error during unpacking of delta, err=%d", DataSize);
+				pChunk->m_Size = str_length(pDecoder->m_aError)+1;
+				return pDecoder->m_aError;
 			}
 		}
 		else if(ChunkType == CHUNKTYPE_SNAPSHOT)
 		{
-			// process full snapshot
 			CSnapshotBuilder Builder;
-			GotSnapshot = true;
-
-			if(Builder.UnserializeSnap(aData, DataSize))
-				DataSize = Builder.Finish(aNewSnap);
+			if(Builder.UnserializeSnap(pDecoder->m_aData, DataSize))
+				DataSize = Builder.Finish(pDecoder->m_aNewSnapshot);
 			else
 				DataSize = -1;
 
-			if(DataSize >= 0)
+			if(DataSize < 0)
 			{
-				m_LastSnapshotDataSize = DataSize;
-				mem_copy(m_aLastSnapshotData, aNewSnap, DataSize);
-				if(m_pListener)
-					m_pListener->OnDemoPlayerSnapshot(aNewSnap, DataSize);
+				pChunk->m_Type = DECODED_SKIPPED_SNAPSHOT;
+				str_format(pDecoder->m_aError, sizeof(pDecoder->m_aError), "error during unpacking of snapshot, err=%d", DataSize);
+				pChunk->m_Size = str_length(pDecoder->m_aError)+1;
+				return pDecoder->m_aError;
 			}
-			else
+		}
+		else if(ChunkType&CHUNKTYPEFLAG_TICKMARKER)
+		{
+			pChunk->m_Type = DECODED_TICKMARKER;
+			return 0;
+		}
+		else if(ChunkType == CHUNKTYPE_MESSAGE)
+		{
+			pChunk->m_Type = DECODED_MESSAGE;
+			pChunk->m_Size = DataSize;
+			return pDecoder->m_aData;
+		}
+		else
+			continue;
+
+		// a new snapshot
+		mem_copy(pDecoder->m_aSnapshot, pDecoder->m_aNewSnapshot, DataSize);
+		pDecoder->m_SnapshotSize = DataSize;
+		pChunk->m_Type = DECODED_SNAPSHOT;
+		pChunk->m_Size = DataSize;
+		return pDecoder->m_aSnapshot;
+	}
+}
+
+bool CDemoPlayer::QueueChunk(const CDecodedChunk *pChunk, const void *pData)
+{
+	// wait for the playback to catch up when the queue is full
+	lock_wait(m_QueueLock);
+	CDecodedChunk *pQueued = (CDecodedChunk *)m_Queue.Allocate(sizeof(CDecodedChunk)+pChunk->m_Size);
+	while(!pQueued)
+	{
+		if(m_StopDecoder)
+		{
+			lock_unlock(m_QueueLock);
+			return false;
+		}
+		m_WaitingForSpace = true;
+		lock_unlock(m_QueueLock);
+		semaphore_wait(&m_QueueSpace);
+		lock_wait(m_QueueLock);
+		pQueued = (CDecodedChunk *)m_Queue.Allocate(sizeof(CDecodedChunk)+pChunk->m_Size);
+	}
+
+	// what the playback can go ahead with
+	if(pChunk->m_Type == DECODED_TICKMARKER)
+		m_DecodedTick = pChunk->m_Tick;
+	else if(pChunk->m_Type == DECODED_EOF || pChunk->m_Type == DECODED_ERROR)
+		m_DecodedAll = true;
+	lock_unlock(m_QueueLock);
+
+	// the playback doesn't look at it before it's signaled
+	*pQueued = *pChunk;
+	if(pChunk->m_Size)
+		mem_copy(pQueued+1, pData, pChunk->m_Size);
+	semaphore_signal(&m_DecodedChunks);
+	return true;
+}
+
+void CDemoPlayer::DecoderThread(void *pUser)
+{
+	CDemoPlayer *pSelf = (CDemoPlayer *)pUser;
+	while(1)
+	{
+		CDecodedChunk Chunk;
+		const void *pData = pSelf->DecodeChunk(&Chunk);
+		if(Chunk.m_Type == DECODED_WAIT)
+		{
+			lock_wait(pSelf->m_QueueLock);
+			bool Stop = pSelf->m_StopDecoder;
+			lock_unlock(pSelf->m_QueueLock);
+			if(Stop)
+				break;
+			thread_sleep(10);
+			continue;
+		}
+		if(!pSelf->QueueChunk(&Chunk, pData) || Chunk.m_Type == DECODED_EOF || Chunk.m_Type == DECODED_ERROR)
+			break;
+	}
+}
+
+const CDemoPlayer::CDecodedChunk *CDemoPlayer::NextChunk(const void **ppData)
+{
+	if(!m_pDecoderThread)
+	{
+		*ppData = DecodeChunk(&m_DirectChunk);
+		return &m_DirectChunk;
+	}
+
+	semaphore_wait(&m_DecodedChunks);
+	lock_wait(m_QueueLock);
+	CDecodedChunk *pChunk = (CDecodedChunk *)m_Queue.First();
+	lock_unlock(m_QueueLock);
+
+	// the decoder is done after the end, it stays in the queue for the next time
+	if(pChunk->m_Type == DECODED_EOF || pChunk->m_Type == DECODED_ERROR)
+		semaphore_signal(&m_DecodedChunks);
+	*ppData = pChunk+1;
+	return pChunk;
+}
+
+void CDemoPlayer::ReleaseChunk()
+{
+	if(!m_pDecoderThread)
+		return;
+
+	lock_wait(m_QueueLock);
+	m_Queue.PopFirst();
+	if(m_WaitingForSpace)
+	{
+		m_WaitingForSpace = false;
+		semaphore_signal(&m_QueueSpace);
+	}
+	lock_unlock(m_QueueLock);
+}
+
+void CDemoPlayer::StartDecoder()
+{
+	// decoding starts at the current file position
+	m_pDecoder->m_SnapshotSize = -1;
+	m_pDecoder->m_Tick = -1;
+	m_DecodedTick = -1;
+	m_DecodedAll = false;
+	// waiting for a live demo to grow mustn't block the playback
+	if(!m_DecodeQueueSize && !m_Live)
+		return;
+
+	int QueueSize = max(m_DecodeQueueSize, (int)CSnapshot::MAX_SIZE*4);
+	m_pQueueMemory = mem_alloc(QueueSize, 1);
+	m_Queue.Init(m_pQueueMemory, QueueSize);
+	m_QueueLock = lock_create();
+	semaphore_init(&m_DecodedChunks);
+	semaphore_init(&m_QueueSpace);
+	m_WaitingForSpace = false;
+	m_StopDecoder = false;
+	m_pDecoderThread = thread_init(DecoderThread, this);
+}
+
+void CDemoPlayer::StopDecoder()
+{
+	if(!m_pDecoderThread)
+		return;
+
+	// wake the decoder if it waits for space
+	lock_wait(m_QueueLock);
+	m_StopDecoder = true;
+	lock_unlock(m_QueueLock);
+	semaphore_signal(&m_QueueSpace);
+	thread_wait(m_pDecoderThread);
+	thread_destroy(m_pDecoderThread);
+	m_pDecoderThread = 0;
+
+	semaphore_destroy(&m_QueueSpace);
+	semaphore_destroy(&m_DecodedChunks);
+	lock_destroy(m_QueueLock);
+	mem_free(m_pQueueMemory);
+	m_pQueueMemory = 0;
+}
+
+bool CDemoPlayer::NextTickDecoded()
+{
+	// a tick is complete with the marker of the one after it
+	if(!m_pDecoderThread)
+		return true;
+	lock_wait(m_QueueLock);
+	bool Decoded = m_DecodedAll || m_DecodedTick > m_Info.m_NextTick;
+	lock_unlock(m_QueueLock);
+	return Decoded;
+}
+
+void CDemoPlayer::DoTick()
+{
+	bool GotSnapshot = false;
+
+	// update ticks
+	m_Info.m_PreviousTick = m_Info.m_Info.m_CurrentTick;
+	m_Info.m_Info.m_CurrentTick = m_Info.m_NextTick;
+
+	while(1)
+	{
+		const void *pData;
+		const CDecodedChunk *pChunk = NextChunk(&pData);
+		if(pChunk->m_Type == DECODED_EOF)
+		{
+			// stop on eof
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "end of file");
+			if(m_Info.m_PreviousTick == -1)
 			{
-				char aBuf[64];
-				str_format(aBuf, sizeof(aBuf), "error during unpacking of snapshot, err=%d", DataSize);
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", aBuf);
+				m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", "empty demo");
+				Stop();
 			}
+			else
+				Pause();
+			break;
+		}
+		else if(pChunk->m_Type == DECODED_ERROR)
+		{
+			// stop on error
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", (const char *)pData);
+			Stop();
+			break;
+		}
+
+		if(pChunk->m_Type == DECODED_SNAPSHOT)
+		{
+			GotSnapshot = true;
+			m_LastSnapshotDataSize = pChunk->m_Size;
+			mem_copy(m_aLastSnapshotData, pData, pChunk->m_Size);
+			if(m_pListener)
+				m_pListener->OnDemoPlayerSnapshot(m_aLastSnapshotData, m_LastSnapshotDataSize);
+		}
+		else if(pChunk->m_Type == DECODED_SKIPPED_SNAPSHOT)
+		{
+			GotSnapshot = true;
+			if(pChunk->m_Size)
+				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", (const char *)pData);
 		}
 		else
 		{
@@ -558,16 +1071,20 @@ void CDemoPlayer::DoTick()
 			}
 
 			// check the remaining types
-			if(ChunkType&CHUNKTYPEFLAG_TICKMARKER)
+			if(pChunk->m_Type == DECODED_TICKMARKER)
 			{
-				m_Info.m_NextTick = ChunkTick;
+				m_Info.m_NextTick = pChunk->m_Tick;
+				if(m_Live && m_Info.m_NextTick > m_Info.m_Info.m_LastTick)
+					m_Info.m_Info.m_LastTick = m_Info.m_NextTick;
+				ReleaseChunk();
 				break;
 			}
-			else if(ChunkType == CHUNKTYPE_MESSAGE && m_pListener && m_LastSnapshotDataSize != -1)
+			else if(pChunk->m_Type == DECODED_MESSAGE && m_pListener && m_LastSnapshotDataSize != -1)
 			{
-				m_pListener->OnDemoPlayerMessage(aData, DataSize);
+				m_pListener->OnDemoPlayerMessage((void *)pData, pChunk->m_Size);
 			}
 		}
+		ReleaseChunk();
 	}
 }
 
@@ -592,6 +1109,8 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", m_aErrorMsg);
 		return m_aErrorMsg;
 	}
+	io_buffer(m_File, m_aFileBuffer, sizeof(m_aFileBuffer));
+	io_sequential(m_File);
 
 	// store the filename
 	str_copy(m_aFilename, pFilename, sizeof(m_aFilename));
@@ -618,7 +1137,7 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		return m_aErrorMsg;
 	}
 
-	if(m_Info.m_Header.m_Version != gs_ActVersion)
+	if(m_Info.m_Header.m_Version < gs_OldVersion || m_Info.m_Header.m_Version > gs_ActVersion)
 	{
 		str_format(m_aErrorMsg, sizeof(m_aErrorMsg), "demo version %d is not supported", m_Info.m_Header.m_Version);
 		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", m_aErrorMsg);
@@ -652,9 +1171,11 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 	unsigned Crc = bytes_be_to_uint(m_Info.m_Header.m_aMapCrc);
 	char aMapFilename[128];
 	str_format(aMapFilename, sizeof(aMapFilename), "downloadedmaps/%s_%08x.map", m_Info.m_Header.m_aMapName, Crc);
-	IOHANDLE MapFile = pStorage->OpenFile(aMapFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	IOHANDLE MapFile = m_SaveMaps ? pStorage->OpenFile(aMapFilename, IOFLAG_READ, IStorage::TYPE_ALL) : 0;
 
-	if(MapFile)
+	if(!m_SaveMaps)
+		io_skip(m_File, MapSize);
+	else if(MapFile)
 	{
 		io_skip(m_File, MapSize);
 		io_close(MapFile);
@@ -681,8 +1202,19 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		m_Info.m_Info.m_aTimelineMarkers[i] = bytes_be_to_uint(m_Info.m_Header.m_aTimelineMarkers[i]);
 	}
 
-	// scan the file for interesting points
-	ScanFile();
+	// scan the file for interesting points, unless the index at its end has them.
+	// it's missing in old demos and if the recording didn't stop properly
+	if(m_Info.m_Header.m_Version < gs_ActVersion || !ReadIndex())
+		ScanFile();
+
+	// a live demo is followed from its latest keyframe
+	if(m_Live && m_Info.m_SeekablePoints)
+		io_seek(m_File, m_pKeyFrames[m_Info.m_SeekablePoints-1].m_Filepos, IOSEEK_START);
+
+	// the decoder thread unpacks the deltas with its own copy
+	m_pDecoder = (CDecoder *)mem_alloc(sizeof(CDecoder), 1);
+	m_pDecodeDelta = m_DecodeQueueSize ? new CSnapshotDelta(*m_pSnapshotDelta) : m_pSnapshotDelta;
+	StartDecoder();
 
 	// ready for playback
 	return 0;
@@ -724,8 +1256,10 @@ int CDemoPlayer::SetPos(float Percent)
 	while(Keyframe && m_pKeyFrames[Keyframe].m_Tick > WantedTick)
 		Keyframe--;
 
-	// seek to the correct keyframe
+	// seek to the correct keyframe, the decoder runs ahead from there
+	StopDecoder();
 	io_seek(m_File, m_pKeyFrames[Keyframe].m_Filepos, IOSEEK_START);
+	StartDecoder();
 
 	m_Info.m_NextTick = -1;
 	m_Info.m_Info.m_CurrentTick = -1;
@@ -740,6 +1274,102 @@ int CDemoPlayer::SetPos(float Percent)
 	return 0;
 }
 
+const char *CDemoPlayer::Cut(class IStorage *pStorage, const char *pFilename, int StartTick, int EndTick)
+{
+	if(!m_File)
+		return "no demo loaded";
+
+	StartTick = max(StartTick, m_Info.m_Info.m_FirstTick);
+	EndTick = min(EndTick, m_Info.m_Info.m_LastTick);
+	if(!m_Info.m_SeekablePoints || StartTick > EndTick)
+	{
+		str_format(m_aErrorMsg, sizeof(m_aErrorMsg), "nothing to cut");
+		return m_aErrorMsg;
+	}
+
+	// the keyframe at or before the start
+	int Keyframe = 0;
+	while(Keyframe+1 < m_Info.m_SeekablePoints && m_pKeyFrames[Keyframe+1].m_Tick <= StartTick)
+		Keyframe++;
+
+	StopDecoder();
+	io_seek(m_File, m_pKeyFrames[Keyframe].m_Filepos, IOSEEK_START);
+	m_pDecoder->m_SnapshotSize = -1;
+	m_pDecoder->m_Tick = -1;
+
+	// decode up to the first tick of the cut and its snapshot
+	CDecodedChunk Chunk;
+	int FirstTick = -1;
+	long CopyPos = -1;
+	while(1)
+	{
+		long Pos = io_tell(m_File);
+		DecodeChunk(&Chunk);
+		if(Chunk.m_Type == DECODED_EOF || Chunk.m_Type == DECODED_ERROR || Chunk.m_Type == DECODED_WAIT)
+			break;
+		if(FirstTick != -1)
+		{
+			// copy the rest of the tick if it had no new snapshot
+			if(Chunk.m_Type == DECODED_SNAPSHOT)
+				CopyPos = io_tell(m_File);
+			else
+				CopyPos = Pos;
+			break;
+		}
+		if(Chunk.m_Type == DECODED_TICKMARKER && Chunk.m_Tick >= StartTick)
+			FirstTick = Chunk.m_Tick;
+	}
+
+	m_aErrorMsg[0] = 0;
+	if(CopyPos == -1 || m_pDecoder->m_SnapshotSize == -1 || FirstTick > EndTick)
+		str_format(m_aErrorMsg, sizeof(m_aErrorMsg), "no snapshot to start the cut with");
+	else
+	{
+		CDemoRecorder Recorder(m_pSnapshotDelta);
+		io_seek(m_File, sizeof(CDemoHeader), IOSEEK_START);
+		if(Recorder.Start(pStorage, m_pConsole, pFilename, m_Info.m_Header.m_aNetversion, m_Info.m_Header.m_aMapName,
+			bytes_be_to_uint(m_Info.m_Header.m_aMapCrc), m_Info.m_Header.m_aType, m_File, bytes_be_to_uint(m_Info.m_Header.m_aMapSize)) != 0)
+			str_format(m_aErrorMsg, sizeof(m_aErrorMsg), "could not open '%s'", pFilename);
+		else
+		{
+			// a fresh keyframe, the deltas after it are relative to the same snapshot
+			Recorder.RecordSnapshot(FirstTick, m_pDecoder->m_aSnapshot, m_pDecoder->m_SnapshotSize);
+
+			// then the chunks as they are, up to the first tick after the end
+			io_seek(m_File, CopyPos, IOSEEK_START);
+			int Tick = FirstTick;
+			while(1)
+			{
+				unsigned char aHeader[5];
+				int HeaderSize, Type, Size;
+				if(ReadChunkHeader(&Type, &Size, &Tick, aHeader, &HeaderSize))
+					break;
+				if((Type&CHUNKTYPEFLAG_TICKMARKER) && Tick > EndTick)
+					break;
+				if(Size && io_read(m_File, m_pDecoder->m_aCompressed, Size) != (unsigned)Size)
+					break;
+				Recorder.RecordChunk(aHeader, HeaderSize, m_pDecoder->m_aCompressed, Size, Type, Tick);
+			}
+
+			for(int i = 0; i < m_Info.m_Info.m_NumTimelineMarkers; i++)
+			{
+				if(m_Info.m_Info.m_aTimelineMarkers[i] >= FirstTick && m_Info.m_Info.m_aTimelineMarkers[i] <= EndTick)
+					Recorder.AddDemoMarker(m_Info.m_Info.m_aTimelineMarkers[i]);
+			}
+			Recorder.Stop();
+		}
+	}
+
+	// the playback starts over
+	io_seek(m_File, m_pKeyFrames[0].m_Filepos, IOSEEK_START);
+	StartDecoder();
+	m_Info.m_NextTick = -1;
+	m_Info.m_Info.m_CurrentTick = -1;
+	m_Info.m_PreviousTick = -1;
+	m_LastSnapshotDataSize = -1;
+	return m_aErrorMsg[0] ? m_aErrorMsg : 0;
+}
+
 void CDemoPlayer::SetSpeed(float Speed)
 {
 	m_Info.m_Info.m_Speed = Speed;
@@ -765,6 +1395,13 @@ int CDemoPlayer::Update()
 		if(CurtickStart > m_Info.m_CurrentTime)
 			break;
 
+		// a live demo holds at its end until the next tick is written
+		if(m_Live && !NextTickDecoded())
+		{
+			m_Info.m_CurrentTime = CurtickStart;
+			break;
+		}
+
 		// do one more tick
 		DoTick();
 
@@ -798,6 +1435,12 @@ int CDemoPlayer::Stop()
 		return -1;
 
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", "Stopped playback");
+	StopDecoder();
+	if(m_pDecodeDelta != m_pSnapshotDelta)
+		delete m_pDecodeDelta;
+	m_pDecodeDelta = 0;
+	mem_free(m_pDecoder);
+	m_pDecoder = 0;
 	io_close(m_File);
 	m_File = 0;
 	mem_free(m_pKeyFrames);
@@ -835,7 +1478,7 @@ bool CDemoPlayer::GetDemoInfo(class IStorage *pStorage, const char *pFilename, i
 		return false;
 
 	io_read(File, pDemoHeader, sizeof(CDemoHeader));
-	bool Valid = mem_comp(pDemoHeader->m_aMarker, gs_aHeaderMarker, sizeof(gs_aHeaderMarker)) == 0 && pDemoHeader->m_Version == gs_ActVersion;
+	bool Valid = mem_comp(pDemoHeader->m_aMarker, gs_aHeaderMarker, sizeof(gs_aHeaderMarker)) == 0 && pDemoHeader->m_Version >= gs_OldVersion && pDemoHeader->m_Version <= gs_ActVersion;
 	io_close(File);
 	return Valid;
 }
@@ -7,32 +7,99 @@
 #include <engine/shared/protocol.h>
 
 #include "huffman.h"
+#include "ringbuffer.h"
 #include "snapshot.h"
 
+// chunks passed between the demo threads, the oldest is at the front
+class CDemoQueue : public CRingBufferBase
+{
+public:
+	void Init(void *pMemory, int Size) { CRingBufferBase::Init(pMemory, Size, 0); }
+	void *Allocate(int Size) { return CRingBufferBase::Allocate(Size); }
+	void *First() { return CRingBufferBase::First(); }
+	int PopFirst() { return CRingBufferBase::PopFirst(); }
+};
+
 class CDemoRecorder : public IDemoRecorder
 {
+	// raw chunks waiting for the writer thread
+	struct CQueuedChunk
+	{
+		int m_Type;
+		int m_Tick;
+		int m_Size;
+	};
+
+	enum
+	{
+		FILE_BUFFER_SIZE=64*1024,
+	};
+
 	class IConsole *m_pConsole;
 	CHuffman m_Huffman;
 	IOHANDLE m_File;
+	unsigned char m_aFileBuffer[FILE_BUFFER_SIZE]; // chunks are small, collect them before writing
 	int m_LastTickMarker;
-	int m_LastKeyFrame;
 	int m_FirstTick;
-	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
 	class CSnapshotDelta *m_pSnapshotDelta;
 	int m_NumTimelineMarkers;
 	int m_aTimelineMarkers[MAX_TIMELINE_MARKERS];
 
+	// owned by the thread that writes, the writer thread if there is one
+	int m_LastKeyFrame;
+	int m_LastWrittenTickMarker;
+	unsigned char *m_pIndex; // tick and file position of the keyframes, for the index at the end
+	int m_IndexSize;
+	int m_IndexCapacity;
+	long m_KeyFramePos;
+	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
+	class CSnapshotDelta *m_pWriteDelta;
+
+	int m_WriterQueueSize;
+	void *m_pWriterThread;
+	void *m_pQueueMemory;
+	CDemoQueue m_Queue;
+	LOCK m_QueueLock;
+	SEMAPHORE m_QueuedChunks; // signaled per queued chunk and once to stop
+	SEMAPHORE m_QueueSpace;
+	bool m_WaitingForSpace;
+	int m_NumStalls;
+
+	class CDemoStream *m_pStream;
+
+	static void WriterThread(void *pUser);
+	void Queue(int Type, int Tick, const void *pData, int Size);
+	void Error(const char *pMsg);
+
 	void WriteTickMarker(int Tick, int Keyframe);
 	void Write(int Type, const void *pData, int Size);
+	void WriteSnapshot(int Tick, const void *pData, int Size);
+	void AddIndexEntry(int Tick);
+	void WriteIndex();
 public:
 	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta);
+	~CDemoRecorder();
+
+	// bytes of raw chunks a thread compressing and writing them can fall behind,
+	// recording blocks when they are used up. 0 writes on the recording thread.
+	// takes effect on the next Start
+	void SetWriterQueue(int Size) { m_WriterQueueSize = Size; }
+
+	// publishes the recording to viewers of the stream, the file gets flushed every tick for it.
+	// takes effect on the next Start
+	void SetStream(class CDemoStream *pStream) { m_pStream = pStream; }
 
 	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, SHA256_DIGEST MapSha256, unsigned MapCrc, const char *pType);
+	// takes MapSize bytes from the current position of MapFile as the map
+	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, unsigned MapCrc, const char *pType, IOHANDLE MapFile, unsigned MapSize);
 	int Stop();
 	void AddDemoMarker();
+	bool AddDemoMarker(int Tick);
 
 	void RecordSnapshot(int Tick, const void *pData, int Size);
 	void RecordMessage(const void *pData, int Size);
+	// copies a chunk of another demo as it is, the tick has to follow the last recorded one
+	void RecordChunk(const void *pHeader, int HeaderSize, const void *pData, int Size, int Type, int Tick);
 
 	bool IsRecording() const { return m_File != 0; }
 
@@ -85,9 +152,36 @@ private:
 		CKeyFrameSearch *m_pNext;
 	};
 
+	// a chunk after decompression, deltas are applied already
+	struct CDecodedChunk
+	{
+		int m_Type;
+		int m_Tick;
+		int m_Size;
+	};
+
+	// owned by the thread that decodes, the decoder thread if there is one
+	struct CDecoder
+	{
+		unsigned char m_aCompressed[CSnapshot::MAX_SIZE];
+		char m_aDecompressed[CSnapshot::MAX_SIZE];
+		char m_aData[CSnapshot::MAX_SIZE];
+		char m_aSnapshot[CSnapshot::MAX_SIZE];
+		char m_aNewSnapshot[CSnapshot::MAX_SIZE];
+		char m_aError[128];
+		int m_SnapshotSize;
+		int m_Tick;
+	};
+
+	enum
+	{
+		FILE_BUFFER_SIZE=64*1024,
+	};
+
 	class IConsole *m_pConsole;
 	CHuffman m_Huffman;
 	IOHANDLE m_File;
+	unsigned char m_aFileBuffer[FILE_BUFFER_SIZE]; // chunks are small, read ahead of them
 	char m_aFilename[256];
 	char m_aErrorMsg[256];
 	CKeyFrame *m_pKeyFrames;
@@ -98,10 +192,39 @@ private:
 	int m_LastSnapshotDataSize;
 	class CSnapshotDelta *m_pSnapshotDelta;
 
-	int ReadChunkHeader(int *pType, int *pSize, int *pTick);
+	CDecoder *m_pDecoder;
+	class CSnapshotDelta *m_pDecodeDelta;
+	CDecodedChunk m_DirectChunk;
+
+	int m_DecodeQueueSize;
+	bool m_SaveMaps;
+	bool m_Live;
+	void *m_pDecoderThread;
+	void *m_pQueueMemory;
+	CDemoQueue m_Queue;
+	LOCK m_QueueLock;
+	SEMAPHORE m_DecodedChunks; // signaled per queued chunk
+	SEMAPHORE m_QueueSpace;
+	bool m_WaitingForSpace;
+	bool m_StopDecoder;
+	int m_DecodedTick; // the last queued tick marker
+	bool m_DecodedAll;
+
+	static void DecoderThread(void *pUser);
+	const void *DecodeChunk(CDecodedChunk *pChunk);
+	const void *DecodeError(CDecodedChunk *pChunk, const char *pMsg);
+	bool QueueChunk(const CDecodedChunk *pChunk, const void *pData);
+	const CDecodedChunk *NextChunk(const void **ppData);
+	void ReleaseChunk();
+	void StartDecoder();
+	void StopDecoder();
+	bool NextTickDecoded();
+
+	// returns 1 at the end of the chunks and -1 at the end of the file. the header takes up to 5 bytes
+	int ReadChunkHeader(int *pType, int *pSize, int *pTick, unsigned char *pHeader = 0, int *pHeaderSize = 0);
 	void DoTick();
+	bool ReadIndex();
 	void ScanFile();
-	int NextFrame();
 
 public:
 
@@ -109,13 +232,29 @@ public:
 
 	void SetListener(IListener *pListner);
 
+	// bytes of decoded chunks a thread can decode ahead of the playback,
+	// 0 decodes on the playing thread. takes effect on the next Load
+	void SetDecodeQueue(int Size) { m_DecodeQueueSize = Size; }
+
+	// whether Load stores the map of the demo in downloadedmaps
+	void SetSaveMaps(bool Save) { m_SaveMaps = Save; }
+
+	// plays a demo that is still being written, like one from a demo stream. the playback
+	// starts at its last keyframe and waits at the end of the file for more. takes effect on the next Load
+	void SetLive(bool Live) { m_Live = Live; }
+
 	const char *Load(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, int StorageType, const char *pNetversion);
 	int Play();
+	// plays the next tick without waiting for its time
+	int NextFrame();
 	void Pause();
 	void Unpause();
 	int Stop();
 	void SetSpeed(float Speed);
 	int SetPos(float Percent);
+	// writes the ticks from StartTick to EndTick to a new demo. it starts with a fresh keyframe,
+	// the chunks after it are copied as they are. the playback starts over afterwards
+	const char *Cut(class IStorage *pStorage, const char *pFilename, int StartTick, int EndTick);
 	const CInfo *BaseInfo() const { return &m_Info.m_Info; }
 	void GetDemoName(char *pBuffer, int BufferSize) const;
 	bool GetDemoInfo(class IStorage *pStorage, const char *pFilename, int StorageType, CDemoHeader *pDemoHeader) const;
@@ -0,0 +1,274 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include "demostream.h"
+
+CDemoStream::CDemoStream()
+{
+	m_Lock = lock_create();
+	m_aPath[0] = 0;
+	m_Recording = 0;
+	m_Active = false;
+	m_HeaderSize = 0;
+	m_KeyFramePos = 0;
+	m_Size = 0;
+	for(int i = 0; i < MAX_VIEWERS; i++)
+		m_aViewers[i].m_pThread = 0;
+	m_Socket.type = NETTYPE_INVALID;
+	m_Socket.ipv4sock = -1;
+	m_Socket.ipv6sock = -1;
+	m_pThread = 0;
+	m_Shutdown = false;
+}
+
+CDemoStream::~CDemoStream()
+{
+	Close();
+	lock_destroy(m_Lock);
+}
+
+void CDemoStream::Begin(const char *pPath, long HeaderSize)
+{
+	lock_wait(m_Lock);
+	str_copy(m_aPath, pPath, sizeof(m_aPath));
+	m_Recording++;
+	m_Active = true;
+	m_HeaderSize = HeaderSize;
+	m_KeyFramePos = HeaderSize;
+	m_Size = HeaderSize;
+	lock_unlock(m_Lock);
+}
+
+void CDemoStream::Publish(long KeyFramePos, long Size)
+{
+	lock_wait(m_Lock);
+	m_KeyFramePos = KeyFramePos;
+	m_Size = Size;
+	lock_unlock(m_Lock);
+}
+
+void CDemoStream::End(long Size)
+{
+	lock_wait(m_Lock);
+	m_Active = false;
+	m_Size = Size;
+	lock_unlock(m_Lock);
+}
+
+bool CDemoStream::Send(NETSOCKET Socket, const void *pData, int Size)
+{
+	// the socket doesn't block, waits are short to notice the shutdown
+	int64 Deadline = time_get()+time_freq()*SEND_TIMEOUT;
+	for(int Sent = 0; Sent < Size;)
+	{
+		if(m_Shutdown || time_get() > Deadline)
+			return false;
+		int Bytes = net_tcp_send(Socket, (const char *)pData+Sent, Size-Sent);
+		if(Bytes > 0)
+		{
+			Sent += Bytes;
+			Deadline = time_get()+time_freq()*SEND_TIMEOUT;
+		}
+		else if(Bytes < 0 && net_would_block())
+			net_socket_write_wait_us(Socket, POLL_INTERVAL*1000);
+		else
+			return false;
+	}
+	return true;
+}
+
+bool CDemoStream::SendChunk(NETSOCKET Socket, const void *pData, int Size)
+{
+	char aSize[16];
+	str_format(aSize, sizeof(aSize), "%x\r\n", Size);
+	return Send(Socket, aSize, str_length(aSize)) && Send(Socket, pData, Size) && Send(Socket, "\r\n", 2);
+}
+
+void CDemoStream::Serve(NETSOCKET Socket)
+{
+	// read the request head
+	char aRequest[1024];
+	int Received = 0;
+	int64 Deadline = time_get()+time_freq();
+	while(Received < (int)sizeof(aRequest)-1 && time_get() < Deadline && !m_Shutdown)
+	{
+		if(net_socket_read_wait(Socket, 100) <= 0)
+			continue;
+		int Bytes = net_tcp_recv(Socket, aRequest+Received, sizeof(aRequest)-1-Received);
+		if(Bytes < 0 && net_would_block())
+			continue;
+		if(Bytes <= 0)
+			break;
+		Received += Bytes;
+		aRequest[Received] = 0;
+		if(str_find(aRequest, "\r\n\r\n") || str_find(aRequest, "\n\n"))
+			break;
+	}
+	aRequest[Received] = 0;
+
+	char aPath[IO_MAX_PATH_LENGTH];
+	lock_wait(m_Lock);
+	str_copy(aPath, m_aPath, sizeof(aPath));
+	int Recording = m_Recording;
+	bool Active = m_Active;
+	long HeaderSize = m_HeaderSize;
+	long KeyFramePos = m_KeyFramePos;
+	lock_unlock(m_Lock);
+
+	const bool Live = str_startswith(aRequest, "GET /live ") != 0;
+	IOHANDLE File = 0;
+	const char *pHeader;
+	if(!Live && !str_startswith(aRequest, "GET / "))
+		pHeader = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	else if(!Active || !(File = io_open(aPath, IOFLAG_READ)))
+		pHeader = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	else
+		pHeader = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nTransfer-Encoding: chunked\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n";
+	if(!Send(Socket, pHeader, str_length(pHeader)) || !File)
+	{
+		if(File)
+			io_close(File);
+		return;
+	}
+
+	// the header and the map first, then the chunks from where the viewer starts
+	char *pBuf = (char *)mem_alloc(SEND_SIZE, 1);
+	long Pos = 0;
+	long SkipTo = Live ? KeyFramePos : HeaderSize;
+	bool Ok = true;
+	while(Ok && !m_Shutdown)
+	{
+		lock_wait(m_Lock);
+		bool Current = m_Recording == Recording;
+		Active = m_Active;
+		long Size = m_Size;
+		lock_unlock(m_Lock);
+		if(!Current)
+			break;
+
+		if(Pos == HeaderSize)
+			Pos = SkipTo;
+		long End = Pos < HeaderSize ? HeaderSize : Size;
+		if(Pos < End)
+		{
+			// the file is only ever appended to where it's read, a fresh seek drops what stdio saw of its end
+			int Bytes = (int)min(End-Pos, (long)SEND_SIZE);
+			io_seek(File, Pos, IOSEEK_START);
+			if(io_read(File, pBuf, Bytes) != (unsigned)Bytes)
+				break;
+			Ok = SendChunk(Socket, pBuf, Bytes);
+			Pos += Bytes;
+		}
+		else if(!Active)
+		{
+			Send(Socket, "0\r\n\r\n", 5);
+			break;
+		}
+		else
+			thread_sleep(POLL_INTERVAL);
+	}
+	mem_free(pBuf);
+	io_close(File);
+}
+
+void CDemoStream::ViewerThread(void *pUser)
+{
+	CViewer *pViewer = (CViewer *)pUser;
+	pViewer->m_pStream->Serve(pViewer->m_Socket);
+	// ends the response, the listener closes the socket
+	net_tcp_shutdown(pViewer->m_Socket);
+	pViewer->m_Done = true;
+}
+
+void CDemoStream::StopViewer(CViewer *pViewer)
+{
+	// wakes up a wait on the socket, the thread ends within a poll interval after the shutdown
+	net_tcp_shutdown(pViewer->m_Socket);
+	thread_wait(pViewer->m_pThread);
+	pViewer->m_pThread = 0;
+	net_tcp_close(pViewer->m_Socket);
+}
+
+void CDemoStream::ListenerThread(void *pUser)
+{
+	CDemoStream *pThis = (CDemoStream *)pUser;
+	while(!pThis->m_Shutdown)
+	{
+		for(int i = 0; i < MAX_VIEWERS; i++)
+		{
+			if(pThis->m_aViewers[i].m_pThread && pThis->m_aViewers[i].m_Done)
+				pThis->StopViewer(&pThis->m_aViewers[i]);
+		}
+
+		if(net_socket_read_wait(pThis->m_Socket, 100) <= 0)
+			continue;
+
+		NETSOCKET Socket;
+		NETADDR Addr;
+		if(net_tcp_accept(pThis->m_Socket, &Socket, &Addr) <= 0)
+			continue;
+
+		// a viewer stays for the whole recording, each gets a thread
+		CViewer *pViewer = 0;
+		for(int i = 0; i < MAX_VIEWERS && !pViewer; i++)
+		{
+			if(!pThis->m_aViewers[i].m_pThread)
+				pViewer = &pThis->m_aViewers[i];
+		}
+		void *pThread = 0;
+		if(pViewer)
+		{
+			net_set_non_blocking(Socket);
+			pViewer->m_pStream = pThis;
+			pViewer->m_Socket = Socket;
+			pViewer->m_Done = false;
+			pThread = pViewer->m_pThread = thread_init(ViewerThread, pViewer);
+		}
+		if(!pThread)
+		{
+			static const char s_aBusy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+			net_tcp_send(Socket, s_aBusy, sizeof(s_aBusy)-1);
+			net_tcp_close(Socket);
+		}
+	}
+}
+
+bool CDemoStream::Open(NETADDR BindAddr)
+{
+	if(m_pThread)
+		return true;
+
+	m_Socket = net_tcp_create(BindAddr);
+	if(!m_Socket.type)
+		return false;
+	if(net_tcp_listen(m_Socket, 8))
+	{
+		net_tcp_close(m_Socket);
+		m_Socket.type = NETTYPE_INVALID;
+		return false;
+	}
+	net_set_non_blocking(m_Socket);
+
+	m_Shutdown = false;
+	m_pThread = thread_init(ListenerThread, this);
+	return m_pThread != 0;
+}
+
+void CDemoStream::Close()
+{
+	if(!m_pThread)
+		return;
+
+	m_Shutdown = true;
+	thread_wait(m_pThread);
+	m_pThread = 0;
+	net_tcp_close(m_Socket);
+	m_Socket.type = NETTYPE_INVALID;
+
+	for(int i = 0; i < MAX_VIEWERS; i++)
+	{
+		if(m_aViewers[i].m_pThread)
+			StopViewer(&m_aViewers[i]);
+	}
+}
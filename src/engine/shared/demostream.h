@@ -0,0 +1,70 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_DEMOSTREAM_H
+#define ENGINE_SHARED_DEMOSTREAM_H
+
+#include <base/system.h>
+
+/*
+	Class: CDemoStream
+		Serves the demo that is being recorded over HTTP while it grows.
+		"GET /" sends it from the start, "GET /live" sends the header and
+		the map followed by the chunks from the latest keyframe on, which
+		is a demo by itself. Both follow the recording in chunked transfer
+		encoding until it stops. The recorder publishes how far the file
+		is written, each viewer reads the file on a thread of its own.
+		Viewers that stop reading are dropped instead of blocking it.
+*/
+class CDemoStream
+{
+	enum
+	{
+		MAX_VIEWERS=16,
+		SEND_SIZE=16*1024,
+		POLL_INTERVAL=20, // ms
+		SEND_TIMEOUT=5, // seconds a viewer may take no data
+	};
+
+	struct CViewer
+	{
+		CDemoStream *m_pStream;
+		NETSOCKET m_Socket;
+		void *m_pThread; // 0 = free slot
+		volatile bool m_Done;
+	};
+
+	LOCK m_Lock;
+	char m_aPath[IO_MAX_PATH_LENGTH];
+	int m_Recording; // counts the recordings, the viewers of an earlier one stop
+	bool m_Active;
+	long m_HeaderSize; // the header and the map
+	long m_KeyFramePos;
+	long m_Size; // how much of the file is written
+	CViewer m_aViewers[MAX_VIEWERS]; // only touched by the listener thread and Close
+
+	NETSOCKET m_Socket;
+	void *m_pThread;
+	volatile bool m_Shutdown;
+
+	static void ListenerThread(void *pUser);
+	static void ViewerThread(void *pUser);
+	void Serve(NETSOCKET Socket);
+	void StopViewer(CViewer *pViewer);
+	bool Send(NETSOCKET Socket, const void *pData, int Size);
+	bool SendChunk(NETSOCKET Socket, const void *pData, int Size);
+
+public:
+	CDemoStream();
+	~CDemoStream();
+
+	// called by the recorder, Publish from the thread that writes
+	void Begin(const char *pPath, long HeaderSize);
+	void Publish(long KeyFramePos, long Size);
+	void End(long Size);
+
+	bool Open(NETADDR BindAddr);
+	void Close();
+	bool IsOpen() const { return m_pThread != 0; }
+};
+
+#endif
@@ -52,6 +52,16 @@ void CEcon::ConchainEconOutputLevelUpdate(IConsole::IResult *pResult, void *pUse
 	}
 }
 
+void CEcon::ConchainEconBacklogUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	pfnCallback(pResult, pCallbackUserData);
+	if(pResult->NumArguments() == 1)
+	{
+		CEcon *pThis = static_cast<CEcon *>(pUserData);
+		pThis->m_NetConsole.SetBacklog(pThis->m_pConfig->m_EcOutputBacklog*1024, pThis->m_pConfig->m_EcOutputOverflow);
+	}
+}
+
 void CEcon::ConchainEconLingerUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	pfnCallback(pResult, pCallbackUserData);
@@ -119,9 +129,12 @@ bool CEcon::Open()
 		str_format(aBuf, sizeof(aBuf), "bound to %s:%d", m_pConfig->m_EcBindaddr, m_pConfig->m_EcPort);
 		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD,"econ", aBuf);
 		m_NetConsole.SetLingerState(m_pConfig->m_NetTcpAbortOnClose);
+		m_NetConsole.SetBacklog(m_pConfig->m_EcOutputBacklog*1024, m_pConfig->m_EcOutputOverflow);
 
 		Console()->Chain("ec_output_level", ConchainEconOutputLevelUpdate, this);
 		Console()->Chain("net_tcp_abort_on_close", ConchainEconLingerUpdate, this);
+		Console()->Chain("ec_output_backlog", ConchainEconBacklogUpdate, this);
+		Console()->Chain("ec_output_overflow", ConchainEconBacklogUpdate, this);
 		m_PrintCBIndex = Console()->RegisterPrintCallback(m_pConfig->m_EcOutputLevel, SendLineCB, this);
 
 		Console()->Register("logout", "", CFGFLAG_ECON, ConLogout, this, "Logout of econ");
@@ -190,6 +203,9 @@ void CEcon::Update()
 			time_get() > m_aClients[i].m_TimeConnected + m_pConfig->m_EcAuthTimeout * time_freq())
 			m_NetConsole.Drop(i, "authentication timeout");
 	}
+
+	// write the output of this update without blocking on slow clients
+	m_NetConsole.Flush();
 }
 
 void CEcon::Send(int ClientID, const char *pLine)
@@ -2,18 +2,24 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <stdlib.h> // srand
 
+#include <base/math.h>
 #include <base/system.h>
 
 #include <engine/console.h>
 #include <engine/engine.h>
 #include <engine/storage.h>
 #include <engine/shared/config.h>
+#include <engine/shared/hostcache.h>
 #include <engine/shared/network.h>
 
+// the one of the engine that owns the job pool, the others share it like the pool
+static CHostCache *s_pHostCache = 0;
 
 static int HostLookupThread(void *pUser)
 {
 	CHostLookup *pLookup = (CHostLookup *)pUser;
+	if(s_pHostCache)
+		return s_pHostCache->Lookup(pLookup->m_aHostname, &pLookup->m_Addr, pLookup->m_Nettype);
 	return net_host_lookup(pLookup->m_aHostname, &pLookup->m_Addr, pLookup->m_Nettype);
 }
 
@@ -27,6 +33,8 @@ public:
 	IOHANDLE m_DataLogSent;
 	IOHANDLE m_DataLogRecv;
 	const char *m_pAppname;
+	CHostCache m_HostCache;
+	bool m_OwnsHostCache;
 
 	static void Con_DbgLognetwork(IConsole::IResult *pResult, void *pUserData)
 	{
@@ -48,8 +56,45 @@ public:
 		}
 	}
 
-	CEngine(const char *pAppname)
+	static void Con_StorageRescan(IConsole::IResult *pResult, void *pUserData)
 	{
+		CEngine *pEngine = static_cast<CEngine *>(pUserData);
+		pEngine->m_pStorage->Rescan();
+	}
+
+	static void Con_MemStats(IConsole::IResult *pResult, void *pUserData)
+	{
+		CEngine *pEngine = static_cast<CEngine *>(pUserData);
+		char aBuf[128];
+		for(int i = 0; i < NUM_MEMTAGS; i++)
+		{
+			int64 Bytes;
+			int Blocks;
+			mem_tag_stats(i, &Bytes, &Blocks);
+			str_format(aBuf, sizeof(aBuf), "%s: %lld KiB in %d blocks", mem_tag_name(i), Bytes/1024, Blocks);
+			pEngine->m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "memory", aBuf);
+		}
+		int64 Resident = mem_resident_size();
+		if(Resident >= 0)
+		{
+			str_format(aBuf, sizeof(aBuf), "resident: %lld KiB", Resident/1024);
+			pEngine->m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "memory", aBuf);
+		}
+	}
+
+	CEngine(const char *pAppname, CJobPool *pSharedJobPool)
+	{
+		m_DataLogSent = 0;
+		m_DataLogRecv = 0;
+		m_Logging = false;
+		m_pAppname = pAppname;
+		m_OwnsHostCache = false;
+		if(pSharedJobPool)
+		{
+			m_pJobPool = pSharedJobPool;
+			return;
+		}
+
 		srand(time_get());
 		dbg_logger_stdout();
 		dbg_logger_debugger();
@@ -64,18 +109,17 @@ public:
 		dbg_msg("engine", "unknown endian");
 	#endif
 
-		
-		m_JobPool.Init(1);
-
-		m_DataLogSent = 0;
-		m_DataLogRecv = 0;
-		m_Logging = false;
-		m_pAppname = pAppname;
+		// the calling thread helps out in Wait, so leave it a core
+		m_JobPool.Init(max(cpu_count()-1, 1));
+		m_pJobPool = &m_JobPool;
+		m_OwnsHostCache = true;
 	}
 
 	~CEngine()
 	{
 		StopLogging();
+		if(m_OwnsHostCache && s_pHostCache == &m_HostCache)
+			s_pHostCache = 0;
 	}
 
 	void Init()
@@ -87,11 +131,24 @@ public:
 		if(!m_pConsole || !m_pStorage)
 			return;
 
+		if(m_OwnsHostCache)
+		{
+			m_HostCache.Init(m_pStorage, "hosts.cfg");
+			m_HostCache.Load();
+			s_pHostCache = &m_HostCache;
+		}
+
 		m_pConsole->Register("dbg_lognetwork", "", CFGFLAG_SERVER|CFGFLAG_CLIENT, Con_DbgLognetwork, this, "Log the network");
+		m_pConsole->Register("mem_stats", "", CFGFLAG_SERVER|CFGFLAG_CLIENT, Con_MemStats, this, "List the memory allocated by each subsystem");
+		m_pConsole->Register("storage_rescan", "", CFGFLAG_SERVER|CFGFLAG_CLIENT, Con_StorageRescan, this, "Forget the directory listings kept by index_paths in storage.cfg");
 	}
 
 	void InitLogfile()
 	{
+		// write the log from a background thread, disk stalls shouldn't show up in the ticks
+		if(m_pConfig->m_LogAsync)
+			dbg_logger_async(m_pConfig->m_LogAsync);
+
 		// open logfile if needed
 		if(m_pConfig->m_Logfile[0])
 		{
@@ -165,8 +222,8 @@ public:
 	{
 		if(m_pConfig->m_Debug)
 			dbg_msg("engine", "job added");
-		m_JobPool.Add(pJob, pfnFunc, pData);
+		m_pJobPool->Add(pJob, pfnFunc, pData, CJobPool::PRIORITY_BACKGROUND); // lookups and loading block, keep them out of waits
 	}
 };
 
-IEngine *CreateEngine(const char *pAppname) { return new CEngine(pAppname); }
+IEngine *CreateEngine(const char *pAppname, CJobPool *pSharedJobPool) { return new CEngine(pAppname, pSharedJobPool); }
@@ -0,0 +1,168 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <stdio.h>	// sscanf
+
+#include <engine/storage.h>
+
+#include "hostcache.h"
+#include "linereader.h"
+
+CHostCache::CHostCache()
+{
+	m_Lock = lock_create();
+	m_NumEntries = 0;
+	m_aFile[0] = 0;
+	m_pStorage = 0;
+}
+
+CHostCache::~CHostCache()
+{
+	lock_destroy(m_Lock);
+}
+
+void CHostCache::Init(IStorage *pStorage, const char *pFile)
+{
+	lock_wait(m_Lock);
+	m_pStorage = pStorage;
+	str_copy(m_aFile, pFile, sizeof(m_aFile));
+	m_NumEntries = 0;
+	lock_unlock(m_Lock);
+}
+
+int CHostCache::FindIndex(const char *pHostname, int Nettype) const
+{
+	for(int i = 0; i < m_NumEntries; i++)
+		if(m_aEntries[i].m_Nettype == Nettype && str_comp(m_aEntries[i].m_aHostname, pHostname) == 0)
+			return i;
+	return -1;
+}
+
+bool CHostCache::Load()
+{
+	if(!m_pStorage)
+		return false;
+	IOHANDLE File = m_pStorage->OpenFile(m_aFile, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	lock_wait(m_Lock);
+	m_NumEntries = 0;
+	CLineReader LineReader;
+	LineReader.Init(File);
+	while(m_NumEntries < MAX_ENTRIES)
+	{
+		const char *pLine = LineReader.Get();
+		if(!pLine)
+			break;
+
+		// hostname nettype address resolved
+		CEntry *pEntry = &m_aEntries[m_NumEntries];
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		long long Resolved;
+		if(sscanf(pLine, "%127s %d %47s %lld", pEntry->m_aHostname, &pEntry->m_Nettype, aAddrStr, &Resolved) != 4 ||
+			net_addr_from_str(&pEntry->m_Addr, aAddrStr) != 0)
+			continue;
+		pEntry->m_Resolved = Resolved;
+		m_NumEntries++;
+	}
+	lock_unlock(m_Lock);
+
+	io_close(File);
+	return true;
+}
+
+bool CHostCache::SaveLocked()
+{
+	if(!m_pStorage)
+		return false;
+	IOHANDLE File = m_pStorage->OpenFile(m_aFile, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	for(int i = 0; i < m_NumEntries; i++)
+	{
+		const CEntry *pEntry = &m_aEntries[i];
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&pEntry->m_Addr, aAddrStr, sizeof(aAddrStr), true);
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "%s %d %s %lld", pEntry->m_aHostname, pEntry->m_Nettype, aAddrStr, (long long)pEntry->m_Resolved);
+		io_write(File, aBuf, str_length(aBuf));
+		io_write_newline(File);
+	}
+
+	io_close(File);
+	return true;
+}
+
+bool CHostCache::Save()
+{
+	lock_wait(m_Lock);
+	bool Result = SaveLocked();
+	lock_unlock(m_Lock);
+	return Result;
+}
+
+bool CHostCache::Find(const char *pHostname, int Nettype, NETADDR *pAddr, bool *pFresh)
+{
+	lock_wait(m_Lock);
+	int Index = FindIndex(pHostname, Nettype);
+	if(Index >= 0)
+	{
+		*pAddr = m_aEntries[Index].m_Addr;
+		int64 Age = time_timestamp()-m_aEntries[Index].m_Resolved;
+		*pFresh = Age >= 0 && Age < TTL;
+	}
+	lock_unlock(m_Lock);
+	return Index >= 0;
+}
+
+void CHostCache::Add(const char *pHostname, int Nettype, const NETADDR *pAddr, int64 Resolved)
+{
+	lock_wait(m_Lock);
+
+	// replace the entry of the host, or forget the one resolved longest ago when full
+	int Index = FindIndex(pHostname, Nettype);
+	if(Index < 0 && m_NumEntries < MAX_ENTRIES)
+		Index = m_NumEntries++;
+	else if(Index < 0)
+	{
+		Index = 0;
+		for(int i = 1; i < m_NumEntries; i++)
+			if(m_aEntries[i].m_Resolved < m_aEntries[Index].m_Resolved)
+				Index = i;
+	}
+	CEntry *pEntry = &m_aEntries[Index];
+	str_copy(pEntry->m_aHostname, pHostname, sizeof(pEntry->m_aHostname));
+	pEntry->m_Nettype = Nettype;
+	pEntry->m_Addr = *pAddr;
+	pEntry->m_Resolved = Resolved;
+
+	lock_unlock(m_Lock);
+}
+
+int CHostCache::Lookup(const char *pHostname, NETADDR *pAddr, int Nettype)
+{
+	NETADDR Known;
+	bool Fresh;
+	bool Found = Find(pHostname, Nettype, &Known, &Fresh);
+	if(Found && Fresh)
+	{
+		*pAddr = Known;
+		return 0;
+	}
+
+	if(net_host_lookup(pHostname, pAddr, Nettype) == 0)
+	{
+		Add(pHostname, Nettype, pAddr, time_timestamp());
+		Save();
+		return 0;
+	}
+	if(!Found)
+		return -1;
+
+	char aAddrStr[NETADDR_MAXSTRSIZE];
+	net_addr_str(&Known, aAddrStr, sizeof(aAddrStr), false);
+	dbg_msg("engine", "failed to resolve '%s', using the last known address %s", pHostname, aAddrStr);
+	*pAddr = Known;
+	return 0;
+}
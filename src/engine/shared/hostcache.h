@@ -0,0 +1,57 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_HOSTCACHE_H
+#define ENGINE_SHARED_HOSTCACHE_H
+
+#include <base/system.h>
+
+// resolved addresses of the master and version servers, kept in the save storage so a
+// restart doesn't wait on dns. an address younger than TTL is used without resolving,
+// an older one still stands in when resolving fails. lookups run on the job threads,
+// so everything is behind a lock
+class CHostCache
+{
+public:
+	enum
+	{
+		MAX_ENTRIES=64,
+		TTL=30*60, // seconds
+	};
+
+	struct CEntry
+	{
+		char m_aHostname[128];
+		int m_Nettype;
+		NETADDR m_Addr;
+		int64 m_Resolved;
+	};
+
+private:
+	LOCK m_Lock;
+	CEntry m_aEntries[MAX_ENTRIES];
+	int m_NumEntries;
+	char m_aFile[IO_MAX_PATH_LENGTH];
+	class IStorage *m_pStorage;
+
+	int FindIndex(const char *pHostname, int Nettype) const;
+	bool SaveLocked();
+
+public:
+	CHostCache();
+	~CHostCache();
+
+	void Init(class IStorage *pStorage, const char *pFile);
+	bool Load();
+	bool Save();
+
+	// returns whether the host has an address, pFresh tells whether it is younger than TTL
+	bool Find(const char *pHostname, int Nettype, NETADDR *pAddr, bool *pFresh);
+	void Add(const char *pHostname, int Nettype, const NETADDR *pAddr, int64 Resolved);
+
+	// like net_host_lookup, but answers from the cache while it can
+	int Lookup(const char *pHostname, NETADDR *pAddr, int Nettype);
+
+	int NumEntries() const { return m_NumEntries; }
+};
+
+#endif
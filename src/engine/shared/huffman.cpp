@@ -145,10 +145,251 @@ void CHuffman::Init(const unsigned *pFrequencies)
 			m_apDecodeLut[i] = pNode;
 	}
 
+	ConstructMultiLut();
+}
+
+void CHuffman::ConstructMultiLut()
+{
+	for(int i = 0; i < HUFFMAN_MULTI_LUTSIZE; i++)
+	{
+		CMultiSymbol *pEntry = &m_aMultiLut[i];
+		unsigned Bits = i;
+		unsigned Used = 0;
+		while(pEntry->m_NumSymbols < HUFFMAN_MULTI_SYMBOLS)
+		{
+			// walk the tree as long as the code fits into the bits left in the index
+			CNode *pNode = m_pStartNode;
+			unsigned Depth = 0;
+			while(!pNode->m_NumBits && Used+Depth < HUFFMAN_MULTI_LUTBITS)
+			{
+				pNode = &m_aNodes[pNode->m_aLeafs[(Bits>>Depth)&1]];
+				Depth++;
+			}
+
+			// the eof symbol ends the stream, leave it to the single symbol path
+			if(!pNode->m_NumBits || pNode == &m_aNodes[HUFFMAN_EOF_SYMBOL])
+				break;
+
+			pEntry->m_aSymbols[pEntry->m_NumSymbols++] = pNode->m_Symbol;
+			Bits >>= Depth;
+			Used += Depth;
+		}
+		pEntry->m_NumBits = Used;
+	}
+}
+
+bool CHuffman::Usable() const
+{
+	for(int i = 0; i < HUFFMAN_MAX_SYMBOLS; i++)
+		if(m_aNodes[i].m_NumBits > HUFFMAN_MAX_CODELENGTH)
+			return false;
+	return true;
+}
+
+bool CHuffman::ParseTable(const char *pText, unsigned *pFrequencies)
+{
+	int Num = 0;
+	while(*pText)
+	{
+		if(*pText == '#')
+		{
+			while(*pText && *pText != '\n')
+				pText++;
+		}
+		else if(*pText >= '0' && *pText <= '9')
+		{
+			// keep the sum of all frequencies in range of the tree construction
+			unsigned Value = 0;
+			while(*pText >= '0' && *pText <= '9')
+			{
+				Value = Value*10 + (*pText++ - '0');
+				if(Value > (1<<22))
+					return false;
+			}
+			if(Num == 256)
+				return false;
+			pFrequencies[Num++] = Value;
+		}
+		else if(*pText == ' ' || *pText == '\t' || *pText == '\r' || *pText == '\n' || *pText == ',')
+			pText++;
+		else
+			return false;
+	}
+	return Num == 256;
+}
+
+unsigned CHuffman::TableID(const unsigned *pFrequencies)
+{
+	unsigned Hash = 2166136261u;
+	for(int i = 0; i < 256; i++)
+		for(int b = 0; b < 4; b++)
+			Hash = (Hash^((pFrequencies[i]>>(b*8))&0xff))*16777619u;
+	return Hash ? Hash : 1;
 }
 
 //***************************************************************
 int CHuffman::Compress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+{
+	// setup buffer pointers
+	const unsigned char *pSrc = (const unsigned char *)pInput;
+	const unsigned char *pSrcEnd = pSrc + InputSize;
+	unsigned char *pDst = (unsigned char *)pOutput;
+	unsigned char *pDstEnd = pDst + OutputSize;
+
+	// codes are at most 24 bits long, so the buffer never holds more than 32+24 bits
+	uint64 Bits = 0;
+	unsigned Bitcount = 0;
+
+	while(pSrc != pSrcEnd)
+	{
+		const CNode *pNode = &m_aNodes[*pSrc++];
+		Bits |= (uint64)pNode->m_Bits << Bitcount;
+		Bitcount += pNode->m_NumBits;
+
+		// write out 32 bits at once
+		if(Bitcount >= 32)
+		{
+			// the output must not fill up, same as with the byte wise writes
+			if(pDstEnd - pDst <= 4)
+				return -1;
+			pDst[0] = (unsigned char)Bits;
+			pDst[1] = (unsigned char)(Bits>>8);
+			pDst[2] = (unsigned char)(Bits>>16);
+			pDst[3] = (unsigned char)(Bits>>24);
+			pDst += 4;
+			Bits >>= 32;
+			Bitcount -= 32;
+		}
+	}
+
+	// write EOF symbol
+	Bits |= (uint64)m_aNodes[HUFFMAN_EOF_SYMBOL].m_Bits << Bitcount;
+	Bitcount += m_aNodes[HUFFMAN_EOF_SYMBOL].m_NumBits;
+	while(Bitcount >= 8)
+	{
+		*pDst++ = (unsigned char)Bits;
+		if(pDst == pDstEnd)
+			return -1;
+		Bits >>= 8;
+		Bitcount -= 8;
+	}
+
+	// write out the last bits
+	*pDst++ = (unsigned char)Bits;
+
+	// return the size of the output
+	return (int)(pDst - (const unsigned char *)pOutput);
+}
+
+static inline uint64 LoadBits(const unsigned char *pSrc)
+{
+	return (uint64)pSrc[0] | ((uint64)pSrc[1]<<8) | ((uint64)pSrc[2]<<16) | ((uint64)pSrc[3]<<24) |
+		((uint64)pSrc[4]<<32) | ((uint64)pSrc[5]<<40) | ((uint64)pSrc[6]<<48) | ((uint64)pSrc[7]<<56);
+}
+
+//***************************************************************
+int CHuffman::Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+{
+	// setup buffer pointers
+	unsigned char *pDst = (unsigned char *)pOutput;
+	const unsigned char *pSrc = (const unsigned char *)pInput;
+	unsigned char *pDstEnd = pDst + OutputSize;
+	const unsigned char *pSrcEnd = pSrc + InputSize;
+
+	uint64 Bits = 0;
+	unsigned Bitcount = 0;
+
+	CNode *pEof = &m_aNodes[HUFFMAN_EOF_SYMBOL];
+
+	while(1)
+	{
+		// fill with new bits, a whole word at once while the input lasts. the bits
+		// above Bitcount are the next ones of the input already, setting them again is fine
+		if(Bitcount < 56)
+		{
+			if(pSrcEnd - pSrc >= 8)
+			{
+				Bits |= LoadBits(pSrc) << Bitcount;
+				pSrc += (63-Bitcount)>>3;
+				Bitcount |= 56;
+			}
+			else
+			{
+				while(Bitcount <= 56 && pSrc != pSrcEnd)
+				{
+					Bits |= (uint64)(*pSrc++) << Bitcount;
+					Bitcount += 8;
+				}
+			}
+		}
+
+		// decode several short symbols at once. this writes all slots of the
+		// entry, so there must be room for them
+		const CMultiSymbol *pMulti = &m_aMultiLut[Bits&HUFFMAN_MULTI_LUTMASK];
+		if(pMulti->m_NumSymbols && pMulti->m_NumBits <= Bitcount && pDstEnd - pDst >= HUFFMAN_MULTI_SYMBOLS)
+		{
+			for(int i = 0; i < HUFFMAN_MULTI_SYMBOLS; i++)
+				pDst[i] = pMulti->m_aSymbols[i];
+			pDst += pMulti->m_NumSymbols;
+			Bits >>= pMulti->m_NumBits;
+			Bitcount -= pMulti->m_NumBits;
+			continue;
+		}
+
+		// one symbol, long codes, the eof symbol and the end of the output
+		CNode *pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
+		if(!pNode)
+			return -1;
+
+		// check if we hit a symbol already
+		if(pNode->m_NumBits)
+		{
+			// remove the bits for that symbol
+			Bits >>= pNode->m_NumBits;
+			Bitcount -= pNode->m_NumBits;
+		}
+		else
+		{
+			// remove the bits that the lut checked up for us
+			Bits >>= HUFFMAN_LUTBITS;
+			Bitcount -= HUFFMAN_LUTBITS;
+
+			// walk the tree bit by bit
+			while(1)
+			{
+				// traverse tree
+				pNode = &m_aNodes[pNode->m_aLeafs[Bits&1]];
+
+				// remove bit
+				Bitcount--;
+				Bits >>= 1;
+
+				// check if we hit a symbol
+				if(pNode->m_NumBits)
+					break;
+
+				// no more bits, decoding error
+				if(Bitcount == 0)
+					return -1;
+			}
+		}
+
+		// check for eof
+		if(pNode == pEof)
+			break;
+
+		// output character
+		if(pDst == pDstEnd)
+			return -1;
+		*pDst++ = pNode->m_Symbol;
+	}
+
+	// return the size of the decompressed buffer
+	return (int)(pDst - (const unsigned char *)pOutput);
+}
+
+//***************************************************************
+int CHuffman::CompressSimple(const void *pInput, int InputSize, void *pOutput, int OutputSize)
 {
 	// this macro loads a symbol for a byte into bits and bitcount
 #define HUFFMAN_MACRO_LOADSYMBOL(Sym) \
@@ -215,7 +456,7 @@ int CHuffman::Compress(const void *pInput, int InputSize, void *pOutput, int Out
 }
 
 //***************************************************************
-int CHuffman::Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+int CHuffman::DecompressSimple(const void *pInput, int InputSize, void *pOutput, int OutputSize)
 {
 	// setup buffer pointers
 	unsigned char *pDst = (unsigned char *)pOutput;
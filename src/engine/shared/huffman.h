@@ -16,7 +16,16 @@ class CHuffman
 
 		HUFFMAN_LUTBITS = 10,
 		HUFFMAN_LUTSIZE = (1<<HUFFMAN_LUTBITS),
-		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1)
+		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1),
+
+		// the multi symbol lut decodes up to this many short codes in one lookup
+		HUFFMAN_MULTI_LUTBITS = 12,
+		HUFFMAN_MULTI_LUTSIZE = (1<<HUFFMAN_MULTI_LUTBITS),
+		HUFFMAN_MULTI_LUTMASK = (HUFFMAN_MULTI_LUTSIZE-1),
+		HUFFMAN_MULTI_SYMBOLS = 6,
+
+		// the bit buffers of the coder only take codes up to this length
+		HUFFMAN_MAX_CODELENGTH = 24,
 	};
 
 	struct CNode
@@ -32,13 +41,23 @@ class CHuffman
 		unsigned char m_Symbol;
 	};
 
+	struct CMultiSymbol
+	{
+		unsigned char m_aSymbols[HUFFMAN_MULTI_SYMBOLS];
+		// 0 if the first code is longer than the lut or the eof symbol
+		unsigned char m_NumSymbols;
+		unsigned char m_NumBits;
+	};
+
 	CNode m_aNodes[HUFFMAN_MAX_NODES];
 	CNode *m_apDecodeLut[HUFFMAN_LUTSIZE];
+	CMultiSymbol m_aMultiLut[HUFFMAN_MULTI_LUTSIZE];
 	CNode *m_pStartNode;
 	int m_NumNodes;
 
 	void Setbits_r(CNode *pNode, int Bits, unsigned Depth);
 	void ConstructTree(const unsigned *pFrequencies);
+	void ConstructMultiLut();
 
 public:
 	/*
@@ -87,5 +106,37 @@ public:
 	*/
 	int Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize);
 
+	/*
+		Function: CompressSimple, DecompressSimple
+			The byte at a time coder that Compress and Decompress replace,
+			they produce and take exactly the same data. Kept for testing.
+	*/
+	int CompressSimple(const void *pInput, int InputSize, void *pOutput, int OutputSize);
+	int DecompressSimple(const void *pInput, int InputSize, void *pOutput, int OutputSize);
+
+	/*
+		Function: Usable
+			Checks that the tree from the frequencies passed to Init
+			has no code that is too long for the coder.
+	*/
+	bool Usable() const;
+
+	/*
+		Function: ParseTable
+			Reads 256 frequencies from text, separated by whitespace or
+			commas. A # comments out the rest of the line.
+
+		Returns:
+			Returns false if the text doesn't hold exactly 256 numbers or
+			one of them is too big.
+	*/
+	static bool ParseTable(const char *pText, unsigned *pFrequencies);
+
+	/*
+		Function: TableID
+			Returns a hash of the 256 frequencies that identifies the
+			table towards the other side of a connection. Never 0.
+	*/
+	static unsigned TableID(const unsigned *pFrequencies);
 };
 #endif // __HUFFMAN_HEADER__
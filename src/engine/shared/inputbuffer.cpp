@@ -0,0 +1,96 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <math.h>
+
+#include <base/math.h>
+#include <base/system.h>
+
+#include "inputbuffer.h"
+
+void CInputBuffer::Reset()
+{
+	for(int i = 0; i < SIZE; i++)
+		m_aTicks[i] = -1;
+	m_LastIntendedTick = -1;
+	m_MeanMargin = 0.0f;
+	m_Deviation = 0.0f;
+	m_HasMargin = false;
+	m_Depth = 0;
+	m_NumLate = 0;
+	m_NumDropped = 0;
+	m_NumRecovered = 0;
+}
+
+void CInputBuffer::Store(int Tick, const int *pData, int Size)
+{
+	int Slot = Tick&(SIZE-1);
+	m_aTicks[Slot] = Tick;
+	Size = clamp(Size, 0, (int)MAX_INPUT_SIZE);
+	mem_copy(m_aaData[Slot], pData, Size*sizeof(int));
+	mem_zero(m_aaData[Slot]+Size, (MAX_INPUT_SIZE-Size)*sizeof(int));
+}
+
+int CInputBuffer::Add(int CurrentTick, int IntendedTick, int TimeLeft, const int *pData, int Size)
+{
+	// resent inputs don't say anything about the timing
+	if(IntendedTick > m_LastIntendedTick)
+	{
+		m_LastIntendedTick = IntendedTick;
+		if(!m_HasMargin)
+		{
+			m_MeanMargin = TimeLeft;
+			m_HasMargin = true;
+		}
+		else
+		{
+			// the same smoothing as for the tcp round trip time variance
+			float Error = TimeLeft - m_MeanMargin;
+			m_MeanMargin += Error/8;
+			m_Deviation += (absolute(Error) - m_Deviation)/4;
+		}
+
+		// two deviations of headroom catch most of the spread, a millisecond of it is noise
+		const float TickTime = 1000.0f/SERVER_TICK_SPEED;
+		m_Depth = clamp((int)ceilf((2*m_Deviation - 1.0f)/TickTime), 0, (int)MAX_DEPTH);
+	}
+
+	int Result = ADD_ONTIME;
+	int Tick = IntendedTick;
+	if(Tick <= CurrentTick)
+	{
+		Result = ADD_LATE;
+		Tick = CurrentTick+1;
+		m_NumLate++;
+
+		// the next tick already has its own input
+		if(m_aTicks[Tick&(SIZE-1)] == Tick)
+		{
+			m_NumDropped++;
+			return ADD_DROPPED;
+		}
+	}
+	else if(Tick - CurrentTick >= SIZE)
+	{
+		m_NumDropped++;
+		return ADD_DROPPED;
+	}
+
+	Store(Tick, pData, Size);
+	return Result;
+}
+
+bool CInputBuffer::Fill(int CurrentTick, int Tick, const int *pData, int Size)
+{
+	if(Tick <= CurrentTick || Tick - CurrentTick >= SIZE || m_aTicks[Tick&(SIZE-1)] == Tick)
+		return false;
+
+	Store(Tick, pData, Size);
+	m_NumRecovered++;
+	return true;
+}
+
+const int *CInputBuffer::Get(int Tick) const
+{
+	int Slot = Tick&(SIZE-1);
+	return m_aTicks[Slot] == Tick ? m_aaData[Slot] : 0;
+}
@@ -0,0 +1,71 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_INPUTBUFFER_H
+#define ENGINE_SHARED_INPUTBUFFER_H
+
+#include <base/math.h>
+
+#include "protocol.h"
+
+/*
+	Class: CInputBuffer
+		The inputs of a client by the tick they are applied on. Inputs
+		that arrive late move to the next tick, or are dropped when that
+		one already has an input. The spread of the arrival times sets the
+		depth, the ticks of headroom the client is asked to send its
+		inputs ahead with, so jitter doesn't make them late.
+*/
+class CInputBuffer
+{
+public:
+	enum
+	{
+		SIZE=128, // ticks ahead an input may be sent, power of two
+		MAX_DEPTH=5,
+
+		ADD_ONTIME=0,
+		ADD_LATE,
+		ADD_DROPPED,
+	};
+
+private:
+	int m_aTicks[SIZE];
+	int m_aaData[SIZE][MAX_INPUT_SIZE];
+	int m_LastIntendedTick;
+
+	// smoothed arrival margin and its mean deviation, in ms
+	float m_MeanMargin;
+	float m_Deviation;
+	bool m_HasMargin;
+	int m_Depth;
+
+	int m_NumLate;
+	int m_NumDropped;
+	int m_NumRecovered;
+
+	void Store(int Tick, const int *pData, int Size);
+
+public:
+	CInputBuffer() { Reset(); }
+
+	void Reset();
+
+	// TimeLeft is the time in ms until the intended tick starts, negative when late.
+	// returns one of ADD_*
+	int Add(int CurrentTick, int IntendedTick, int TimeLeft, const int *pData, int Size);
+
+	// stores a repeated earlier input if its tick is still ahead and has no input yet.
+	// returns true when it filled a gap
+	bool Fill(int CurrentTick, int Tick, const int *pData, int Size);
+
+	// the input to apply on the tick, 0 if there is none
+	const int *Get(int Tick) const;
+
+	int Depth() const { return m_Depth; }
+	int Jitter() const { return round_to_int(m_Deviation); }
+	int NumLate() const { return m_NumLate; }
+	int NumDropped() const { return m_NumDropped; }
+	int NumRecovered() const { return m_NumRecovered; }
+};
+
+#endif
@@ -1,89 +1,321 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
+#include <base/tl/threading.h>
 #include "jobs.h"
+#include "memheap.h"
+#include "threadtopology.h"
+#include "tracer.h"
+
+// the worker that runs on the current thread, jobs it adds go to its own queues
+#if defined(CONF_FAMILY_WINDOWS) && defined(_MSC_VER)
+	static __declspec(thread) void *gs_pCurrentWorker = 0;
+#else
+	static __thread void *gs_pCurrentWorker = 0;
+#endif
+
+CJobGroup::CJobGroup()
+{
+	m_Lock = lock_create();
+	semaphore_init(&m_Done);
+	m_NumPending = 0;
+	m_Waiting = false;
+}
+
+CJobGroup::~CJobGroup()
+{
+	semaphore_destroy(&m_Done);
+	lock_destroy(m_Lock);
+}
+
+bool CJobGroup::Done()
+{
+	lock_wait(m_Lock);
+	bool Done = m_NumPending == 0;
+	lock_unlock(m_Lock);
+	return Done;
+}
 
 CJobPool::CJobPool()
 {
 	// empty the pool
 	m_NumThreads = 0;
 	m_Shutdown = false;
-	m_Lock = lock_create();
-	m_pFirstJob = 0;
-	m_pLastJob = 0;
+	semaphore_init(&m_Activity);
+	for(int p = 0; p < NUM_PRIORITIES; p++)
+		InitQueue(&m_aShared[p]);
 }
 
 CJobPool::~CJobPool()
 {
 	m_Shutdown = true;
+	for(int i = 0; i < m_NumThreads; i++)
+		semaphore_signal(&m_Activity);
 	for(int i = 0; i < m_NumThreads; i++)
 	{
-		thread_wait(m_apThreads[i]);
-		thread_destroy(m_apThreads[i]);
+		thread_wait(m_aWorkers[i].m_pThread);
+		thread_destroy(m_aWorkers[i].m_pThread);
+		for(int p = 0; p < NUM_PRIORITIES; p++)
+			lock_destroy(m_aWorkers[i].m_aQueues[p].m_Lock);
 	}
-	lock_destroy(m_Lock);
+	for(int p = 0; p < NUM_PRIORITIES; p++)
+		lock_destroy(m_aShared[p].m_Lock);
+	semaphore_destroy(&m_Activity);
 }
 
-void CJobPool::WorkerThread(void *pUser)
+void CJobPool::InitQueue(CQueue *pQueue)
+{
+	pQueue->m_Lock = lock_create();
+	pQueue->m_pFirst = 0;
+	pQueue->m_pLast = 0;
+	pQueue->m_Size = 0;
+}
+
+void CJobPool::PushBack(CQueue *pQueue, CJob *pJob)
+{
+	lock_wait(pQueue->m_Lock);
+	pJob->m_pPrev = pQueue->m_pLast;
+	pJob->m_pNext = 0;
+	if(pQueue->m_pLast)
+		pQueue->m_pLast->m_pNext = pJob;
+	else
+		pQueue->m_pFirst = pJob;
+	pQueue->m_pLast = pJob;
+	pQueue->m_Size++;
+	lock_unlock(pQueue->m_Lock);
+}
+
+CJob *CJobPool::PopBack(CQueue *pQueue)
 {
-	CJobPool *pPool = (CJobPool *)pUser;
+	if(!pQueue->m_Size)
+		return 0;
 
-	while(!pPool->m_Shutdown)
+	lock_wait(pQueue->m_Lock);
+	CJob *pJob = pQueue->m_pLast;
+	if(pJob)
 	{
-		CJob *pJob = 0;
+		pQueue->m_pLast = pJob->m_pPrev;
+		if(pQueue->m_pLast)
+			pQueue->m_pLast->m_pNext = 0;
+		else
+			pQueue->m_pFirst = 0;
+		pQueue->m_Size--;
+	}
+	lock_unlock(pQueue->m_Lock);
+	return pJob;
+}
+
+CJob *CJobPool::PopFront(CQueue *pQueue)
+{
+	if(!pQueue->m_Size)
+		return 0;
 
-		// fetch job from queue
-		lock_wait(pPool->m_Lock);
-		if(pPool->m_pFirstJob)
+	lock_wait(pQueue->m_Lock);
+	CJob *pJob = pQueue->m_pFirst;
+	if(pJob)
+	{
+		pQueue->m_pFirst = pJob->m_pNext;
+		if(pQueue->m_pFirst)
+			pQueue->m_pFirst->m_pPrev = 0;
+		else
+			pQueue->m_pLast = 0;
+		pQueue->m_Size--;
+	}
+	lock_unlock(pQueue->m_Lock);
+	return pJob;
+}
+
+CJobPool::CWorker *CJobPool::CurrentWorker() const
+{
+	CWorker *pWorker = (CWorker *)gs_pCurrentWorker;
+	return pWorker && pWorker->m_pPool == this ? pWorker : 0;
+}
+
+CJob *CJobPool::Take(CWorker *pSelf, int LowestPriority)
+{
+	// higher priorities first. own jobs, then the ones added from outside, then steal
+	int Start = pSelf ? (int)(pSelf-m_aWorkers) : 0;
+	for(int p = PRIORITY_HIGH; p <= LowestPriority; p++)
+	{
+		CJob *pJob = 0;
+		if(pSelf && (pJob = PopBack(&pSelf->m_aQueues[p])))
+			return pJob;
+		if((pJob = PopFront(&m_aShared[p])))
+			return pJob;
+		for(int i = 1; i <= m_NumThreads; i++)
 		{
-			pJob = pPool->m_pFirstJob;
-			pPool->m_pFirstJob = pPool->m_pFirstJob->m_pNext;
-			if(pPool->m_pFirstJob)
-				pPool->m_pFirstJob->m_pPrev = 0;
-			else
-				pPool->m_pLastJob = 0;
+			CWorker *pVictim = &m_aWorkers[(Start+i)%m_NumThreads];
+			if(pVictim != pSelf && (pJob = PopFront(&pVictim->m_aQueues[p])))
+				return pJob;
 		}
-		lock_unlock(pPool->m_Lock);
+	}
+	return 0;
+}
+
+void CJobPool::Run(CJob *pJob)
+{
+	CJobGroup *pGroup = pJob->m_pGroup;
+	pJob->m_Status = CJob::STATE_RUNNING;
+	pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
+
+	// the job can be reused as soon as it's done, don't touch it after that
+	sync_barrier();
+	pJob->m_Status = CJob::STATE_DONE;
 
-		// do the job if we have one
+	if(pGroup)
+	{
+		lock_wait(pGroup->m_Lock);
+		if(--pGroup->m_NumPending == 0 && pGroup->m_Waiting)
+			semaphore_signal(&pGroup->m_Done);
+		lock_unlock(pGroup->m_Lock);
+	}
+}
+
+void CJobPool::WorkerThread(void *pUser)
+{
+	CWorker *pSelf = (CWorker *)pUser;
+	CJobPool *pPool = pSelf->m_pPool;
+	CThreadTopology::Enter(CThreadTopology::CLASS_JOBS, "job worker");
+	gs_pCurrentWorker = pSelf;
+
+	while(1)
+	{
+		// there is a signal per added job, jobs that Wait took leave one over
+		semaphore_wait(&pPool->m_Activity);
+		if(pPool->m_Shutdown)
+			break;
+
+		CJob *pJob = pPool->Take(pSelf, PRIORITY_BACKGROUND);
 		if(pJob)
-		{
-			pJob->m_Status = CJob::STATE_RUNNING;
-			pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
-			pJob->m_Status = CJob::STATE_DONE;
-		}
-		else
-			thread_sleep(10);
+			Run(pJob);
 	}
 
+	CThreadTopology::Leave();
+	CScratch::ReleaseThread();
 }
 
 int CJobPool::Init(int NumThreads)
 {
 	// start threads
-	m_NumThreads = NumThreads > MAX_THREADS ? MAX_THREADS : NumThreads;
+	int Num = clamp(NumThreads, 0, (int)MAX_THREADS);
+	for(int i = 0; i < Num; i++)
+	{
+		m_aWorkers[i].m_pPool = this;
+		for(int p = 0; p < NUM_PRIORITIES; p++)
+			InitQueue(&m_aWorkers[i].m_aQueues[p]);
+	}
+	m_NumThreads = Num;
 	for(int i = 0; i < m_NumThreads; i++)
-		m_apThreads[i] = thread_init(WorkerThread, this);
+		m_aWorkers[i].m_pThread = thread_init(WorkerThread, &m_aWorkers[i]);
 	return 0;
 }
 
-int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData)
+int CJobPool::NumQueuedJobs() const
+{
+	int Num = 0;
+	for(int p = 0; p < NUM_PRIORITIES; p++)
+	{
+		Num += m_aShared[p].m_Size;
+		for(int i = 0; i < m_NumThreads; i++)
+			Num += m_aWorkers[i].m_aQueues[p].m_Size;
+	}
+	return Num;
+}
+
+int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData, int Priority, CJobGroup *pGroup)
 {
 	mem_zero(pJob, sizeof(CJob));
 	pJob->m_pfnFunc = pfnFunc;
 	pJob->m_pFuncData = pData;
+	pJob->m_pGroup = pGroup;
+	Priority = clamp(Priority, (int)PRIORITY_HIGH, (int)PRIORITY_BACKGROUND);
 
-	lock_wait(m_Lock);
+	if(pGroup)
+	{
+		lock_wait(pGroup->m_Lock);
+		pGroup->m_NumPending++;
+		lock_unlock(pGroup->m_Lock);
+	}
+
+	// jobs added by a job stay with its worker until someone steals them
+	CWorker *pSelf = CurrentWorker();
+	PushBack(pSelf ? &pSelf->m_aQueues[Priority] : &m_aShared[Priority], pJob);
+	semaphore_signal(&m_Activity);
+	return 0;
+}
 
-	// add job to queue
-	pJob->m_pPrev = m_pLastJob;
-	if(m_pLastJob)
-		m_pLastJob->m_pNext = pJob;
-	m_pLastJob = pJob;
-	if(!m_pFirstJob)
-		m_pFirstJob = pJob;
+void CJobPool::Wait(CJobGroup *pGroup)
+{
+	CWorker *pSelf = CurrentWorker();
+	while(1)
+	{
+		// the last job holds the lock until it's completely done with the group
+		lock_wait(pGroup->m_Lock);
+		bool Pending = pGroup->m_NumPending != 0;
+		if(!Pending)
+			pGroup->m_Waiting = false;
+		lock_unlock(pGroup->m_Lock);
+		if(!Pending)
+			break;
 
-	lock_unlock(m_Lock);
+		// help out instead of sleeping, this also keeps nested waits from running out of workers
+		CJob *pJob = Take(pSelf, PRIORITY_NORMAL);
+		if(pJob)
+		{
+			Run(pJob);
+			continue;
+		}
+
+		// the rest runs on the workers, sleep until the last one is done
+		lock_wait(pGroup->m_Lock);
+		Pending = pGroup->m_NumPending != 0;
+		pGroup->m_Waiting = Pending;
+		lock_unlock(pGroup->m_Lock);
+		if(Pending)
+			semaphore_wait(&pGroup->m_Done);
+	}
+}
+
+struct CParallelRange
+{
+	CJob m_Job;
+	PARALLELFUNC m_pfnFunc;
+	void *m_pUser;
+	int m_Begin;
+	int m_End;
+};
+
+static int ParallelRangeJob(void *pData)
+{
+	CParallelRange *pRange = (CParallelRange *)pData;
+	pRange->m_pfnFunc(pRange->m_Begin, pRange->m_End, pRange->m_pUser);
 	return 0;
 }
 
+void CJobPool::ParallelFor(int Begin, int End, int Grain, PARALLELFUNC pfnFunc, void *pUser, int Priority)
+{
+	if(End <= Begin)
+		return;
+
+	// a few ranges per thread, so that stealing evens out ranges that take longer
+	Grain = max(Grain, 1);
+	int NumRanges = min((End-Begin)/Grain, min((m_NumThreads+1)*PARALLEL_JOBS_PER_THREAD, (int)MAX_PARALLEL_JOBS));
+	if(NumRanges <= 1 || !m_NumThreads)
+	{
+		pfnFunc(Begin, End, pUser);
+		return;
+	}
+
+	CParallelRange aRanges[MAX_PARALLEL_JOBS];
+	CJobGroup Group;
+	for(int i = 0; i < NumRanges; i++)
+	{
+		aRanges[i].m_pfnFunc = pfnFunc;
+		aRanges[i].m_pUser = pUser;
+		aRanges[i].m_Begin = Begin + (int)((int64)(End-Begin)*i/NumRanges);
+		aRanges[i].m_End = Begin + (int)((int64)(End-Begin)*(i+1)/NumRanges);
+		Add(&aRanges[i].m_Job, ParallelRangeJob, &aRanges[i], Priority, &Group);
+	}
+	Wait(&Group);
+}
@@ -2,16 +2,37 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef ENGINE_SHARED_JOBS_H
 #define ENGINE_SHARED_JOBS_H
+#include <base/system.h>
+
 typedef int (*JOBFUNC)(void *pData);
+typedef void (*PARALLELFUNC)(int Begin, int End, void *pUser);
 
 class CJobPool;
 
+// counts the jobs added with it that aren't done yet, CJobPool::Wait blocks on it
+class CJobGroup
+{
+	friend class CJobPool;
+
+	LOCK m_Lock;
+	SEMAPHORE m_Done;
+	int m_NumPending;
+	bool m_Waiting;
+
+public:
+	CJobGroup();
+	~CJobGroup();
+
+	bool Done();
+};
+
 class CJob
 {
 	friend class CJobPool;
 
 	CJob *m_pPrev;
 	CJob *m_pNext;
+	CJobGroup *m_pGroup;
 
 	volatile int m_Status;
 	volatile int m_Result;
@@ -38,18 +59,53 @@ public:
 
 class CJobPool
 {
+public:
 	enum
 	{
-		MAX_THREADS=32
+		PRIORITY_HIGH=0,
+		PRIORITY_NORMAL,
+		PRIORITY_BACKGROUND, // can block for long, only runs on the workers and not in Wait
+		NUM_PRIORITIES,
 	};
+
+private:
+	enum
+	{
+		MAX_THREADS=32,
+		MAX_PARALLEL_JOBS=64,
+		PARALLEL_JOBS_PER_THREAD=4,
+	};
+
+	// the owner takes its newest job from the back, the others steal the oldest from the front
+	struct CQueue
+	{
+		LOCK m_Lock;
+		CJob *m_pFirst;
+		CJob *m_pLast;
+		volatile int m_Size; // read without the lock to skip empty queues
+	};
+
+	struct CWorker
+	{
+		CJobPool *m_pPool;
+		void *m_pThread;
+		CQueue m_aQueues[NUM_PRIORITIES];
+	};
+
 	int m_NumThreads;
-	void *m_apThreads[MAX_THREADS];
+	CWorker m_aWorkers[MAX_THREADS];
+	CQueue m_aShared[NUM_PRIORITIES]; // jobs added from threads outside of the pool
 	volatile bool m_Shutdown;
+	SEMAPHORE m_Activity; // signaled once per added job
 
-	LOCK m_Lock;
-	CJob *m_pFirstJob;
-	CJob *m_pLastJob;
+	static void InitQueue(CQueue *pQueue);
+	static void PushBack(CQueue *pQueue, CJob *pJob);
+	static CJob *PopBack(CQueue *pQueue);
+	static CJob *PopFront(CQueue *pQueue);
 
+	CWorker *CurrentWorker() const;
+	CJob *Take(CWorker *pSelf, int LowestPriority);
+	static void Run(CJob *pJob);
 	static void WorkerThread(void *pUser);
 
 public:
@@ -57,6 +113,17 @@ public:
 	~CJobPool();
 
 	int Init(int NumThreads);
-	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData);
+	int NumThreads() const { return m_NumThreads; }
+
+	// jobs waiting to be run, read without locking so only an estimate
+	int NumQueuedJobs() const;
+
+	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData, int Priority=PRIORITY_NORMAL, CJobGroup *pGroup=0);
+
+	// runs other jobs while the ones of the group aren't done, sleeps when there are none left
+	void Wait(CJobGroup *pGroup);
+
+	// calls pfnFunc on ranges of at least Grain indices in parallel and returns when all are done
+	void ParallelFor(int Begin, int End, int Grain, PARALLELFUNC pfnFunc, void *pUser, int Priority=PRIORITY_NORMAL);
 };
 #endif
@@ -21,14 +21,40 @@ static char EscapeJsonChar(char c)
 CJsonWriter::CJsonWriter(IOHANDLE IO)
 {
 	m_IO = IO;
+	m_BufferSize = FILE_BUFFER_SIZE;
+	m_pBuffer = (char *)mem_alloc(m_BufferSize, 1);
+	m_BufferUsed = 0;
 	m_NumStates = 0; // no root created yet
 	m_Indentation = 0;
 }
 
+CJsonWriter::CJsonWriter()
+{
+	m_IO = 0;
+	m_BufferSize = MEMORY_BUFFER_SIZE;
+	m_pBuffer = (char *)mem_alloc(m_BufferSize, 1);
+	m_BufferUsed = 0;
+	m_NumStates = 0;
+	m_Indentation = 0;
+}
+
 CJsonWriter::~CJsonWriter()
 {
-	io_write_newline(m_IO);
-	io_close(m_IO);
+	if(m_IO)
+	{
+		WriteNewline();
+		WriteBuffer();
+		io_close(m_IO);
+	}
+	mem_free(m_pBuffer);
+}
+
+void CJsonWriter::Flush()
+{
+	if(!m_IO)
+		return;
+	WriteBuffer();
+	io_flush(m_IO);
 }
 
 void CJsonWriter::BeginObject()
@@ -116,9 +142,54 @@ bool CJsonWriter::CanWriteDatatype()
 		|| TopState()->m_Kind == STATE_ATTRIBUTE;
 }
 
+void CJsonWriter::WriteBuffer()
+{
+	if(m_BufferUsed)
+		io_write(m_IO, m_pBuffer, m_BufferUsed);
+	m_BufferUsed = 0;
+}
+
+void CJsonWriter::WriteRaw(const char *pData, int Size)
+{
+	if(m_BufferUsed+Size > m_BufferSize)
+	{
+		if(m_IO)
+		{
+			WriteBuffer();
+			if(Size > m_BufferSize)
+			{
+				io_write(m_IO, pData, Size);
+				return;
+			}
+		}
+		else
+		{
+			int NewSize = m_BufferSize;
+			while(m_BufferUsed+Size > NewSize)
+				NewSize *= 2;
+			char *pNewBuffer = (char *)mem_alloc(NewSize, 1);
+			mem_copy(pNewBuffer, m_pBuffer, m_BufferUsed);
+			mem_free(m_pBuffer);
+			m_pBuffer = pNewBuffer;
+			m_BufferSize = NewSize;
+		}
+	}
+	mem_copy(m_pBuffer+m_BufferUsed, pData, Size);
+	m_BufferUsed += Size;
+}
+
 inline void CJsonWriter::WriteInternal(const char *pStr)
 {
-	io_write(m_IO, pStr, str_length(pStr));
+	WriteRaw(pStr, str_length(pStr));
+}
+
+void CJsonWriter::WriteNewline()
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	WriteRaw("\r\n", 2);
+#else
+	WriteRaw("\n", 1);
+#endif
 }
 
 void CJsonWriter::WriteInternalEscaped(const char *pStr)
@@ -136,7 +207,7 @@ void CJsonWriter::WriteInternalEscaped(const char *pStr)
 		{
 			if(i - UnwrittenFrom > 0)
 			{
-				io_write(m_IO, pStr + UnwrittenFrom, i - UnwrittenFrom);
+				WriteRaw(pStr + UnwrittenFrom, i - UnwrittenFrom);
 			}
 
 			if(SimpleEscape)
@@ -144,7 +215,7 @@ void CJsonWriter::WriteInternalEscaped(const char *pStr)
 				char aStr[2];
 				aStr[0] = '\\';
 				aStr[1] = SimpleEscape;
-				io_write(m_IO, aStr, sizeof(aStr));
+				WriteRaw(aStr, sizeof(aStr));
 			}
 			else
 			{
@@ -157,7 +228,7 @@ void CJsonWriter::WriteInternalEscaped(const char *pStr)
 	}
 	if(Length - UnwrittenFrom > 0)
 	{
-		io_write(m_IO, pStr + UnwrittenFrom, Length - UnwrittenFrom);
+		WriteRaw(pStr + UnwrittenFrom, Length - UnwrittenFrom);
 	}
 	WriteInternal("\"");
 }
@@ -171,7 +242,7 @@ void CJsonWriter::WriteIndent(bool EndElement)
 		WriteInternal(",");
 
 	if(NotRootOrAttribute || EndElement)
-		io_write_newline(m_IO);
+		WriteNewline();
 
 	if(NotRootOrAttribute)
 		for(int i = 0; i < m_Indentation; i++)
@@ -15,6 +15,9 @@ class CJsonWriter
 		STATE_ATTRIBUTE,
 
 		MAX_DEPTH=16,
+
+		FILE_BUFFER_SIZE=64*1024,
+		MEMORY_BUFFER_SIZE=1024,
 	};
 
 	class CState
@@ -32,12 +35,20 @@ class CJsonWriter
 
 	IOHANDLE m_IO;
 
+	// tokens are collected here, a file gets them when it is full
+	char *m_pBuffer;
+	int m_BufferSize;
+	int m_BufferUsed;
+
 	CState m_aStates[MAX_DEPTH];
 	int m_NumStates;
 	int m_Indentation;
 
 	bool CanWriteDatatype();
+	void WriteRaw(const char *pData, int Size);
+	void WriteBuffer();
 	inline void WriteInternal(const char *pStr);
+	void WriteNewline();
 	void WriteInternalEscaped(const char *pStr);
 	void WriteIndent(bool EndElement);
 	void PushState(unsigned char NewState);
@@ -49,8 +60,18 @@ public:
 	// Create a new writer object without writing anything to the file yet.
 	// The file will automatically be closed by the destructor.
 	CJsonWriter(IOHANDLE IO);
+	// Create a new writer object that writes to memory, see Output.
+	CJsonWriter();
 	~CJsonWriter();
 
+	// Write everything buffered so far to the file.
+	void Flush();
+
+	// The output of a writer without file, without the line break
+	// that ends files.
+	const char *Output() const { return m_pBuffer; }
+	int OutputSize() const { return m_BufferUsed; }
+
 	// The root is created by beginning the first datatype (object, array, value).
 	// The writer must not be used after ending the root, which must be unique.
 
@@ -1,17 +1,71 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
 #include "linereader.h"
 
+CLineReader::CLineReader()
+{
+	m_pMapped = 0;
+	m_MappedSize = 0;
+	m_MappedPos = 0;
+}
+
+CLineReader::~CLineReader()
+{
+	io_munmap(m_pMapped, m_MappedSize);
+}
+
 void CLineReader::Init(IOHANDLE io)
 {
 	m_BufferMaxSize = sizeof(m_aBuffer);
 	m_BufferSize = 0;
 	m_BufferPos = 0;
 	m_IO = io;
+
+	io_munmap(m_pMapped, m_MappedSize);
+	m_pMapped = 0;
+	m_MappedSize = 0;
+	m_MappedPos = 0;
+
+	// one mapping instead of many small reads, only for files read from the start
+	if(io_tell(io) == 0 && io_length(io) > (long int)sizeof(m_aBuffer))
+		m_pMapped = (char *)io_mmap(io, &m_MappedSize);
+}
+
+char *CLineReader::GetMapped()
+{
+	if(m_MappedPos >= m_MappedSize)
+		return 0x0;
+
+	char *pLine = m_pMapped+m_MappedPos;
+	char *pEnd = m_pMapped+m_MappedSize;
+	char *pBreak = pLine;
+	while(pBreak < pEnd && *pBreak != '\n' && *pBreak != '\r')
+		pBreak++;
+
+	if(pBreak == pEnd)
+	{
+		// there is no room to terminate the last line in the mapping
+		unsigned Size = min((unsigned)(pEnd-pLine), (unsigned)sizeof(m_aBuffer)-1);
+		mem_copy(m_aBuffer, pLine, Size);
+		m_aBuffer[Size] = 0;
+		m_MappedPos = m_MappedSize;
+		return m_aBuffer;
+	}
+
+	if(*pBreak == '\r' && pBreak+1 < pEnd && pBreak[1] == '\n')
+		*pBreak++ = 0;
+	*pBreak++ = 0;
+	m_MappedPos = pBreak-m_pMapped;
+	return pLine;
 }
 
 char *CLineReader::Get()
 {
+	if(m_pMapped)
+		return GetMapped();
+
 	unsigned LineStart = m_BufferPos;
 	bool CRLFBreak = false;
 
@@ -40,7 +94,7 @@ char *CLineReader::Get()
 			{
 				if(Left)
 				{
-					m_aBuffer[Left] = 0; // return the last line
+					m_aBuffer[CRLFBreak ? Left-1 : Left] = 0; // return the last line, without a '\r' at the end of the file
 					m_BufferPos = Left;
 					m_BufferSize = Left;
 					return m_aBuffer;
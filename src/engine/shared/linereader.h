@@ -5,6 +5,7 @@
 #include <base/system.h>
 
 // buffered stream for reading lines, should perhaps be something smaller
+// files larger than the buffer are mapped and their lines are returned in place
 class CLineReader
 {
 	char m_aBuffer[4*1024];
@@ -12,7 +13,21 @@ class CLineReader
 	unsigned m_BufferSize;
 	unsigned m_BufferMaxSize;
 	IOHANDLE m_IO;
+
+	char *m_pMapped;
+	unsigned m_MappedSize;
+	unsigned m_MappedPos;
+
+	char *GetMapped();
+
+	// not copyable
+	CLineReader(const CLineReader &Other);
+	CLineReader &operator=(const CLineReader &Other);
+
 public:
+	CLineReader();
+	~CLineReader();
+
 	void Init(IOHANDLE IoHandle);
 	char *Get();
 };
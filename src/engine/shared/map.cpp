@@ -1,6 +1,8 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
+#include <engine/engine.h>
 #include <engine/map.h>
 #include <engine/storage.h>
 #include <game/mapitems.h>
@@ -25,23 +27,58 @@ public:
 		m_DataFile.Close();
 	}
 
-	virtual bool Load(const char *pMapName, IStorage *pStorage)
+	virtual bool Load(const char *pMapName, IStorage *pStorage, const SHA256_DIGEST *pKnownSha256, unsigned KnownCrc)
 	{
 		if(!pStorage)
 			pStorage = Kernel()->RequestInterface<IStorage>();
 		if(!pStorage)
 			return false;
-		if(!m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL))
+		if(!m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL, true, pKnownSha256, KnownCrc))
 			return false;
 		// check version
 		CMapItemVersion *pItem = (CMapItemVersion *)m_DataFile.FindItem(MAPITEMTYPE_VERSION, 0);
 		if(!pItem || pItem->m_Version != CMapItemVersion::CURRENT_VERSION)
 			return false;
 
-		// replace compressed tile layers with uncompressed ones
 		int GroupsStart, GroupsNum, LayersStart, LayersNum;
 		m_DataFile.GetType(MAPITEMTYPE_GROUP, &GroupsStart, &GroupsNum);
 		m_DataFile.GetType(MAPITEMTYPE_LAYER, &LayersStart, &LayersNum);
+
+		// decompress all data at once instead of on first use, quads are the only data that gets swapped
+		IEngine *pEngine = Kernel()->RequestInterface<IEngine>();
+		if(pEngine)
+		{
+			int NumData = m_DataFile.NumData();
+			bool *pIsQuads = static_cast<bool *>(mem_alloc_tag(max(NumData, 1)*sizeof(bool), 1, MEMTAG_MAP));
+			mem_zero(pIsQuads, max(NumData, 1)*sizeof(bool));
+			for(int l = 0; l < LayersNum; l++)
+			{
+				CMapItemLayer *pLayer = static_cast<CMapItemLayer *>(m_DataFile.GetItem(LayersStart + l, 0, 0));
+				if(pLayer->m_Type == LAYERTYPE_QUADS)
+				{
+					int Data = reinterpret_cast<CMapItemLayerQuads *>(pLayer)->m_Data;
+					if(Data >= 0 && Data < NumData)
+						pIsQuads[Data] = true;
+				}
+			}
+
+			// the other data from the front, the quads from the back
+			int *pIndices = static_cast<int *>(mem_alloc_tag(max(NumData, 1)*sizeof(int), 1, MEMTAG_MAP));
+			int NumOthers = 0, QuadsStart = NumData;
+			for(int i = 0; i < NumData; i++)
+			{
+				if(pIsQuads[i])
+					pIndices[--QuadsStart] = i;
+				else
+					pIndices[NumOthers++] = i;
+			}
+			m_DataFile.Prefetch(pEngine->JobPool(), pIndices, NumOthers, 0);
+			m_DataFile.Prefetch(pEngine->JobPool(), pIndices+QuadsStart, NumData-QuadsStart, 1);
+			mem_free(pIndices);
+			mem_free(pIsQuads);
+		}
+
+		// replace compressed tile layers with uncompressed ones
 		for(int g = 0; g < GroupsNum; g++)
 		{
 			CMapItemGroup *pGroup = static_cast<CMapItemGroup *>(m_DataFile.GetItem(GroupsStart + g, 0, 0));
@@ -63,7 +100,7 @@ public:
 							dbg_msg("engine", "map layer too big (%d * %d * %u causes an integer overflow)", pTilemap->m_Width, pTilemap->m_Height, unsigned(sizeof(CTile)));
 							return false;
 						}
-						CTile *pTiles = static_cast<CTile *>(mem_alloc(TilemapSize, 1));
+						CTile *pTiles = static_cast<CTile *>(mem_alloc_tag(TilemapSize, 1, MEMTAG_MAP));
 						if(!pTiles)
 							return false;
 
@@ -105,6 +142,11 @@ public:
 	{
 		return m_DataFile.Crc();
 	}
+
+	virtual int Version()
+	{
+		return m_DataFile.Version();
+	}
 };
 
 extern IEngineMap *CreateEngineMap() { return new CMap; }
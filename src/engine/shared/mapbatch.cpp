@@ -0,0 +1,128 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/tl/algorithm.h>
+
+#include <engine/storage.h>
+
+#include "jsonwriter.h"
+#include "mapbatch.h"
+
+CMapBatch::CMapBatch()
+{
+	m_pStorage = 0;
+	m_pfnProcess = 0;
+	m_pProcessUser = 0;
+	m_pFolder = "";
+	m_Time = 0;
+}
+
+int CMapBatch::ListCallback(const char *pName, int IsDir, int StorageType, void *pUser)
+{
+	CMapBatch *pSelf = (CMapBatch *)pUser;
+	if(IsDir || !str_endswith(pName, ".map") || str_length(pName) >= (int)sizeof(pSelf->m_lMaps[0].m_aName))
+		return 0;
+
+	// the first storage path with the name wins, like when opening it
+	for(int i = 0; i < pSelf->m_lMaps.size(); i++)
+		if(str_comp(pSelf->m_lMaps[i].m_aName, pName) == 0)
+			return 0;
+
+	CMap Map;
+	mem_zero(&Map, sizeof(Map));
+	str_copy(Map.m_aName, pName, sizeof(Map.m_aName));
+	str_format(Map.m_aPath, sizeof(Map.m_aPath), "%s/%s", pSelf->m_pFolder, pName);
+	Map.m_StorageType = StorageType;
+	pSelf->m_lMaps.add(Map);
+	return 0;
+}
+
+int CMapBatch::ProcessJob(void *pData)
+{
+	CMap *pMap = (CMap *)pData;
+	int64 Start = time_get();
+	pMap->m_Success = pMap->m_pBatch->m_pfnProcess(pMap, pMap->m_pBatch->m_pProcessUser);
+	pMap->m_Time = (time_get()-Start)*1000000/time_freq();
+	if(!pMap->m_Success)
+		dbg_msg("mapbatch", "failed to process '%s'", pMap->m_aPath);
+	return 0;
+}
+
+int CMapBatch::Run(IStorage *pStorage, CJobPool *pPool, const char *pFolder, int StorageType, FProcessMap pfnProcess, void *pUser)
+{
+	int64 Start = time_get();
+	m_pStorage = pStorage;
+	m_pfnProcess = pfnProcess;
+	m_pProcessUser = pUser;
+	m_pFolder = pFolder;
+	m_lMaps.clear();
+	pStorage->ListDirectory(StorageType, pFolder, ListCallback, this);
+	sort(m_lMaps.all());
+
+	// the array doesn't change anymore, the jobs can point into it
+	CJobGroup Group;
+	for(int i = 0; i < m_lMaps.size(); i++)
+	{
+		m_lMaps[i].m_pBatch = this;
+		pPool->Add(&m_lMaps[i].m_Job, ProcessJob, &m_lMaps[i], CJobPool::PRIORITY_NORMAL, &Group);
+	}
+	pPool->Wait(&Group);
+
+	int Failed = 0;
+	for(int i = 0; i < m_lMaps.size(); i++)
+		if(!m_lMaps[i].m_Success)
+			Failed++;
+	m_Time = (time_get()-Start)*1000000/time_freq();
+	return Failed;
+}
+
+bool CMapBatch::WriteSummary(const char *pFilename, int StorageType) const
+{
+	IOHANDLE File = m_pStorage->OpenFile(pFilename, IOFLAG_WRITE, StorageType);
+	if(!File)
+		return false;
+
+	int Failed = 0, Skipped = 0;
+	CJsonWriter Writer(File);
+	Writer.BeginObject();
+	Writer.WriteAttribute("maps");
+	Writer.BeginArray();
+	for(int i = 0; i < m_lMaps.size(); i++)
+	{
+		const CMap *pMap = &m_lMaps[i];
+		char aBuf[SHA256_MAXSTRSIZE];
+		Writer.BeginObject();
+		Writer.WriteAttribute("name");
+		Writer.WriteStrValue(pMap->m_aName);
+		Writer.WriteAttribute("success");
+		Writer.WriteBoolValue(pMap->m_Success);
+		Writer.WriteAttribute("skipped");
+		Writer.WriteBoolValue(pMap->m_Skipped);
+		Writer.WriteAttribute("sha256");
+		sha256_str(pMap->m_Sha256, aBuf, sizeof(aBuf));
+		Writer.WriteStrValue(aBuf);
+		Writer.WriteAttribute("crc");
+		str_format(aBuf, sizeof(aBuf), "%08x", pMap->m_Crc);
+		Writer.WriteStrValue(aBuf);
+		Writer.WriteAttribute("size");
+		Writer.WriteIntValue(pMap->m_Size);
+		Writer.WriteAttribute("output_size");
+		Writer.WriteIntValue(pMap->m_OutputSize);
+		Writer.WriteAttribute("time_us");
+		Writer.WriteIntValue((int)pMap->m_Time);
+		Writer.EndObject();
+
+		if(!pMap->m_Success)
+			Failed++;
+		if(pMap->m_Skipped)
+			Skipped++;
+	}
+	Writer.EndArray();
+	Writer.WriteAttribute("failed");
+	Writer.WriteIntValue(Failed);
+	Writer.WriteAttribute("skipped");
+	Writer.WriteIntValue(Skipped);
+	Writer.WriteAttribute("time_ms");
+	Writer.WriteIntValue((int)(m_Time/1000));
+	Writer.EndObject();
+	return true;
+}
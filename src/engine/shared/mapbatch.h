@@ -0,0 +1,69 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_MAPBATCH_H
+#define ENGINE_SHARED_MAPBATCH_H
+
+#include <base/hash.h>
+#include <base/system.h>
+#include <base/tl/array.h>
+
+#include "jobs.h"
+
+/*
+	Class: CMapBatch
+		Runs a function on all maps of a folder in parallel on a job
+		pool, all of them share the storage. The results are kept per
+		map in name order and can be written as a JSON summary.
+*/
+class CMapBatch
+{
+public:
+	class CMap
+	{
+	public:
+		char m_aName[128]; // file name in the folder
+		char m_aPath[IO_MAX_PATH_LENGTH];
+		int m_StorageType;
+
+		// filled in by the process function
+		bool m_Success;
+		bool m_Skipped;
+		SHA256_DIGEST m_Sha256;
+		unsigned m_Crc;
+		unsigned m_Size;
+		unsigned m_OutputSize;
+		int64 m_Time; // microseconds, filled in by the batch
+
+		CJob m_Job;
+		CMapBatch *m_pBatch;
+
+		bool operator<(const CMap &Other) const { return str_comp(m_aName, Other.m_aName) < 0; }
+	};
+
+	// processes one map on a thread of the pool, returns false on errors
+	typedef bool (*FProcessMap)(CMap *pMap, void *pUser);
+
+private:
+	class IStorage *m_pStorage;
+	array<CMap> m_lMaps;
+	FProcessMap m_pfnProcess;
+	void *m_pProcessUser;
+	const char *m_pFolder;
+	int64 m_Time;
+
+	static int ListCallback(const char *pName, int IsDir, int StorageType, void *pUser);
+	static int ProcessJob(void *pData);
+
+public:
+	CMapBatch();
+
+	// returns the number of maps that failed
+	int Run(class IStorage *pStorage, class CJobPool *pPool, const char *pFolder, int StorageType, FProcessMap pfnProcess, void *pUser);
+
+	int NumMaps() const { return m_lMaps.size(); }
+	const CMap *GetMap(int Index) const { return &m_lMaps[Index]; }
+
+	bool WriteSummary(const char *pFilename, int StorageType) const;
+};
+
+#endif
@@ -0,0 +1,221 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <stdio.h>	// sscanf
+
+#include <base/math.h>
+
+#include <engine/storage.h>
+
+#include "linereader.h"
+#include "mapcache.h"
+
+CMapCache::CMapCache()
+{
+	m_pEntries = 0;
+	m_NumEntries = 0;
+	m_MaxEntries = 0;
+	m_aIndexFile[0] = 0;
+	m_Changed = false;
+	m_pStorage = 0;
+}
+
+CMapCache::~CMapCache()
+{
+	mem_free(m_pEntries);
+}
+
+void CMapCache::Init(IStorage *pStorage, const char *pIndexFile, int MaxEntries)
+{
+	m_pStorage = pStorage;
+	str_copy(m_aIndexFile, pIndexFile, sizeof(m_aIndexFile));
+	mem_free(m_pEntries);
+	m_MaxEntries = max(MaxEntries, 1);
+	m_pEntries = (CEntry *)mem_alloc(m_MaxEntries*sizeof(CEntry), 1);
+	m_NumEntries = 0;
+	m_Changed = false;
+}
+
+bool CMapCache::GetFileInfo(const char *pPath, unsigned *pSize, int64 *pModified) const
+{
+	time_t Created, Modified;
+	if(!m_pStorage->GetFileTime(pPath, IStorage::TYPE_SAVE, &Created, &Modified))
+		return false;
+	IOHANDLE File = m_pStorage->OpenFile(pPath, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+	*pSize = io_length(File);
+	*pModified = Modified;
+	io_close(File);
+	return true;
+}
+
+bool CMapCache::IsValid(const CEntry *pEntry) const
+{
+	unsigned Size;
+	int64 Modified;
+	return GetFileInfo(pEntry->m_aPath, &Size, &Modified) && Size == pEntry->m_Size && Modified == pEntry->m_Modified;
+}
+
+void CMapCache::RemoveEntry(int Index)
+{
+	m_pEntries[Index] = m_pEntries[--m_NumEntries];
+	m_Changed = true;
+}
+
+int CMapCache::Oldest(const char *pFolder, const char *pKeepPath) const
+{
+	int Oldest = -1;
+	for(int i = 0; i < m_NumEntries; i++)
+	{
+		if((pFolder && !str_startswith(m_pEntries[i].m_aPath, pFolder)) || (pKeepPath && str_comp(m_pEntries[i].m_aPath, pKeepPath) == 0))
+			continue;
+		if(Oldest < 0 || m_pEntries[i].m_LastUsed < m_pEntries[Oldest].m_LastUsed)
+			Oldest = i;
+	}
+	return Oldest;
+}
+
+bool CMapCache::Load()
+{
+	m_NumEntries = 0;
+	m_Changed = false;
+	IOHANDLE File = m_pStorage->OpenFile(m_aIndexFile, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	CLineReader LineReader;
+	LineReader.Init(File);
+	while(m_NumEntries < m_MaxEntries)
+	{
+		const char *pLine = LineReader.Get();
+		if(!pLine)
+			break;
+
+		// sha256 crc size modified lastused path, the path is the rest of the line
+		CEntry *pEntry = &m_pEntries[m_NumEntries];
+		char aSha256[SHA256_MAXSTRSIZE];
+		long long Modified, LastUsed;
+		int PathStart = 0;
+		if(sscanf(pLine, "%64s %x %u %lld %lld %n", aSha256, &pEntry->m_Crc, &pEntry->m_Size, &Modified, &LastUsed, &PathStart) != 5 ||
+			!PathStart || !pLine[PathStart] || sha256_from_str(&pEntry->m_Sha256, aSha256))
+			continue;
+		pEntry->m_Modified = Modified;
+		pEntry->m_LastUsed = LastUsed;
+		str_copy(pEntry->m_aPath, pLine+PathStart, sizeof(pEntry->m_aPath));
+		m_NumEntries++;
+	}
+
+	io_close(File);
+	return true;
+}
+
+bool CMapCache::Save()
+{
+	if(!m_Changed)
+		return true;
+	IOHANDLE File = m_pStorage->OpenFile(m_aIndexFile, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	for(int i = 0; i < m_NumEntries; i++)
+	{
+		const CEntry *pEntry = &m_pEntries[i];
+		char aSha256[SHA256_MAXSTRSIZE];
+		sha256_str(pEntry->m_Sha256, aSha256, sizeof(aSha256));
+		char aBuf[IO_MAX_PATH_LENGTH+256];
+		str_format(aBuf, sizeof(aBuf), "%s %08x %u %lld %lld %s", aSha256, pEntry->m_Crc, pEntry->m_Size,
+			(long long)pEntry->m_Modified, (long long)pEntry->m_LastUsed, pEntry->m_aPath);
+		io_write(File, aBuf, str_length(aBuf));
+		io_write_newline(File);
+	}
+
+	io_close(File);
+	m_Changed = false;
+	return true;
+}
+
+const CMapCache::CEntry *CMapCache::Find(const SHA256_DIGEST *pSha256, unsigned Crc)
+{
+	for(int i = 0; i < m_NumEntries; i++)
+	{
+		CEntry *pEntry = &m_pEntries[i];
+		if(pEntry->m_Crc != Crc || sha256_comp(pEntry->m_Sha256, *pSha256))
+			continue;
+		if(!IsValid(pEntry))
+		{
+			RemoveEntry(i--);
+			continue;
+		}
+		pEntry->m_LastUsed = time_timestamp();
+		m_Changed = true;
+		return pEntry;
+	}
+	return 0;
+}
+
+const CMapCache::CEntry *CMapCache::FindPath(const char *pPath)
+{
+	for(int i = 0; i < m_NumEntries; i++)
+	{
+		CEntry *pEntry = &m_pEntries[i];
+		if(str_comp(pEntry->m_aPath, pPath) != 0)
+			continue;
+		if(!IsValid(pEntry))
+		{
+			RemoveEntry(i);
+			return 0;
+		}
+		pEntry->m_LastUsed = time_timestamp();
+		m_Changed = true;
+		return pEntry;
+	}
+	return 0;
+}
+
+void CMapCache::Add(const char *pPath, const SHA256_DIGEST *pSha256, unsigned Crc)
+{
+	CEntry Entry;
+	if(!GetFileInfo(pPath, &Entry.m_Size, &Entry.m_Modified))
+		return;
+	Entry.m_Sha256 = *pSha256;
+	Entry.m_Crc = Crc;
+	Entry.m_LastUsed = time_timestamp();
+	str_copy(Entry.m_aPath, pPath, sizeof(Entry.m_aPath));
+
+	// replace the entry for the same file, or forget the least recently used one when full
+	int Index = m_NumEntries;
+	for(int i = 0; i < m_NumEntries; i++)
+		if(str_comp(m_pEntries[i].m_aPath, pPath) == 0)
+			Index = i;
+	if(Index == m_MaxEntries)
+		Index = Oldest(0, 0);
+	else if(Index == m_NumEntries)
+		m_NumEntries++;
+	m_pEntries[Index] = Entry;
+	m_Changed = true;
+}
+
+void CMapCache::Evict(const char *pFolder, int64 Budget, const char *pKeepPath)
+{
+	int64 Total = TotalSize(pFolder);
+	while(Total > Budget)
+	{
+		int Index = Oldest(pFolder, pKeepPath);
+		if(Index < 0)
+			break;
+
+		dbg_msg("mapcache", "removing '%s'", m_pEntries[Index].m_aPath);
+		m_pStorage->RemoveFile(m_pEntries[Index].m_aPath, IStorage::TYPE_SAVE);
+		Total -= m_pEntries[Index].m_Size;
+		RemoveEntry(Index);
+	}
+}
+
+int64 CMapCache::TotalSize(const char *pFolder) const
+{
+	int64 Total = 0;
+	for(int i = 0; i < m_NumEntries; i++)
+		if(str_startswith(m_pEntries[i].m_aPath, pFolder))
+			Total += m_pEntries[i].m_Size;
+	return Total;
+}
@@ -0,0 +1,64 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_MAPCACHE_H
+#define ENGINE_SHARED_MAPCACHE_H
+
+#include <base/hash.h>
+#include <base/system.h>
+
+// index of maps in the save storage by their hashes, so known maps can be found and
+// loaded without hashing them again. an entry is only trusted while the size and
+// modification time of its file are unchanged
+class CMapCache
+{
+public:
+	enum
+	{
+		DEFAULT_MAX_ENTRIES=512,
+	};
+
+	struct CEntry
+	{
+		SHA256_DIGEST m_Sha256;
+		unsigned m_Crc;
+		unsigned m_Size;
+		int64 m_Modified;
+		int64 m_LastUsed;
+		char m_aPath[IO_MAX_PATH_LENGTH];
+	};
+
+private:
+	CEntry *m_pEntries;
+	int m_NumEntries;
+	int m_MaxEntries;
+	char m_aIndexFile[IO_MAX_PATH_LENGTH];
+	bool m_Changed;
+	class IStorage *m_pStorage;
+
+	bool GetFileInfo(const char *pPath, unsigned *pSize, int64 *pModified) const;
+	bool IsValid(const CEntry *pEntry) const;
+	void RemoveEntry(int Index);
+	int Oldest(const char *pFolder, const char *pKeepPath) const;
+
+public:
+	CMapCache();
+	~CMapCache();
+
+	void Init(class IStorage *pStorage, const char *pIndexFile, int MaxEntries=DEFAULT_MAX_ENTRIES);
+	bool Load();
+	bool Save();
+
+	// return a still valid entry and mark it as used, stale entries are dropped
+	const CEntry *Find(const SHA256_DIGEST *pSha256, unsigned Crc);
+	const CEntry *FindPath(const char *pPath);
+	void Add(const char *pPath, const SHA256_DIGEST *pSha256, unsigned Crc);
+
+	// delete the least recently used files in pFolder until the ones in it take at most
+	// Budget bytes, pKeepPath is never removed
+	void Evict(const char *pFolder, int64 Budget, const char *pKeepPath);
+
+	int NumEntries() const { return m_NumEntries; }
+	int64 TotalSize(const char *pFolder) const;
+};
+
+#endif
@@ -1,14 +1,34 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include "memheap.h"
 
+#if defined(CONF_FAMILY_WINDOWS) && defined(_MSC_VER)
+	static __declspec(thread) CHeap *gs_pScratchHeap = 0;
+#else
+	static __thread CHeap *gs_pScratchHeap = 0;
+#endif
+
 
 // allocates a new chunk to be used
-void CHeap::NewChunk()
+void CHeap::NewChunk(unsigned int Size)
 {
-	// allocate memory
-	char *pMem = (char*)mem_alloc(sizeof(CChunk)+CHUNK_SIZE, 1);
+	// reuse a chunk that was given back
+	if(Size <= CHUNK_SIZE && m_pFree)
+	{
+		CChunk *pChunk = m_pFree;
+		m_pFree = pChunk->m_pNext;
+		pChunk->m_pCurrent = pChunk->m_pMemory;
+		pChunk->m_pNext = m_pCurrent;
+		m_pCurrent = pChunk;
+		return;
+	}
+
+	// allocate memory, allocations larger than a chunk get one of their own
+	if(Size < CHUNK_SIZE)
+		Size = CHUNK_SIZE;
+	char *pMem = (char*)mem_alloc(sizeof(CChunk)+Size, ALIGNMENT);
 	if(!pMem)
 		return;
 
@@ -17,7 +37,7 @@ void CHeap::NewChunk()
 	CChunk *pChunk = (CChunk*)pMem;
 	pChunk->m_pMemory = (char*)(pChunk+1);
 	pChunk->m_pCurrent = pChunk->m_pMemory;
-	pChunk->m_pEnd = pChunk->m_pMemory + CHUNK_SIZE;
+	pChunk->m_pEnd = pChunk->m_pMemory + Size;
 	pChunk->m_pNext = m_pCurrent;
 
 	m_pCurrent = pChunk;
@@ -27,12 +47,12 @@ void CHeap::NewChunk()
 void *CHeap::AllocateFromChunk(unsigned int Size)
 {
 	// check if we need can fit the allocation
-	if(m_pCurrent->m_pCurrent + Size > m_pCurrent->m_pEnd)
+	if(!m_pCurrent || Size > (unsigned)(m_pCurrent->m_pEnd - m_pCurrent->m_pCurrent))
 		return (void*)0x0;
 
-	// get memory and move the pointer forward
+	// get memory and move the pointer forward, keeping the next allocation aligned
 	char *pMem = m_pCurrent->m_pCurrent;
-	m_pCurrent->m_pCurrent += Size;
+	m_pCurrent->m_pCurrent += min((unsigned)(m_pCurrent->m_pEnd - pMem), (Size+ALIGNMENT-1)&~(ALIGNMENT-1));
 	return pMem;
 }
 
@@ -40,7 +60,8 @@ void *CHeap::AllocateFromChunk(unsigned int Size)
 CHeap::CHeap()
 {
 	m_pCurrent = 0x0;
-	NewChunk();
+	m_pFree = 0x0;
+	NewChunk(CHUNK_SIZE);
 }
 
 CHeap::~CHeap()
@@ -51,12 +72,14 @@ CHeap::~CHeap()
 void CHeap::Reset()
 {
 	Clear();
-	NewChunk();
+	NewChunk(CHUNK_SIZE);
 }
 
 // destroys the heap
 void CHeap::Clear()
 {
+	ReleaseFree();
+
 	CChunk *pChunk = m_pCurrent;
 
 	while(pChunk)
@@ -77,7 +100,7 @@ void *CHeap::Allocate(unsigned int Size)
 	if(!pMem)
 	{
 		// allocate new chunk and add it to the heap
-		NewChunk();
+		NewChunk(Size);
 
 		// try to allocate again
 		pMem = (char *)AllocateFromChunk(Size);
@@ -85,3 +108,61 @@ void *CHeap::Allocate(unsigned int Size)
 
 	return pMem;
 }
+
+CHeap::CMark CHeap::Mark() const
+{
+	CMark Mark;
+	Mark.m_pChunk = m_pCurrent;
+	Mark.m_pCurrent = m_pCurrent ? m_pCurrent->m_pCurrent : 0x0;
+	return Mark;
+}
+
+void CHeap::Rewind(const CMark &Mark)
+{
+	while(m_pCurrent && m_pCurrent != Mark.m_pChunk)
+	{
+		CChunk *pChunk = m_pCurrent;
+		m_pCurrent = pChunk->m_pNext;
+
+		// only keep chunks of the normal size, the large ones were for single allocations
+		if(pChunk->m_pEnd - pChunk->m_pMemory == CHUNK_SIZE)
+		{
+			pChunk->m_pNext = m_pFree;
+			m_pFree = pChunk;
+		}
+		else
+			mem_free(pChunk);
+	}
+
+	if(m_pCurrent)
+		m_pCurrent->m_pCurrent = Mark.m_pCurrent;
+}
+
+void CHeap::ReleaseFree()
+{
+	while(m_pFree)
+	{
+		CChunk *pNext = m_pFree->m_pNext;
+		mem_free(m_pFree);
+		m_pFree = pNext;
+	}
+}
+
+CScratch::CScratch()
+{
+	if(!gs_pScratchHeap)
+		gs_pScratchHeap = new CHeap();
+	m_pHeap = gs_pScratchHeap;
+	m_Mark = m_pHeap->Mark();
+}
+
+CScratch::~CScratch()
+{
+	m_pHeap->Rewind(m_Mark);
+}
+
+void CScratch::ReleaseThread()
+{
+	delete gs_pScratchHeap;
+	gs_pScratchHeap = 0;
+}
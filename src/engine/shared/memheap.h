@@ -16,19 +16,63 @@ class CHeap
 	{
 		// how large each chunk should be
 		CHUNK_SIZE = 1024*64,
+		// allocations start at multiples of this
+		ALIGNMENT = 16,
 	};
 
 	CChunk *m_pCurrent;
+	CChunk *m_pFree; // chunks given back by Rewind, used again before new ones get allocated
 
 
 	void Clear();
-	void NewChunk();
+	void NewChunk(unsigned int Size);
 	void *AllocateFromChunk(unsigned int Size);
 
 public:
+	class CMark
+	{
+		friend class CHeap;
+		CChunk *m_pChunk;
+		char *m_pCurrent;
+	};
+
 	CHeap();
 	~CHeap();
 	void Reset();
 	void *Allocate(unsigned int Size);
+
+	// the current end of the heap, see Rewind
+	CMark Mark() const;
+	// gives back everything allocated after the mark, the chunks are kept for later allocations
+	void Rewind(const CMark &Mark);
+	// frees the chunks kept by Rewind
+	void ReleaseFree();
+};
+
+/*
+	Class: CScratch
+		Temporary memory of the current thread for hot paths like
+		snapshot building, instead of big stack buffers or
+		mem_alloc/mem_free pairs. Everything allocated through a
+		scratch scope is given back when it ends, the memory stays
+		with the thread for the next scope. Scopes can nest but must
+		not be passed to other threads.
+*/
+class CScratch
+{
+	CHeap *m_pHeap;
+	CHeap::CMark m_Mark;
+
+	// not copyable
+	CScratch(const CScratch &Other);
+	CScratch &operator=(const CScratch &Other);
+
+public:
+	CScratch();
+	~CScratch();
+	void *Allocate(unsigned int Size) { return m_pHeap->Allocate(Size); }
+
+	// frees the scratch memory of the current thread, call it without open scopes before the thread ends
+	static void ReleaseThread();
 };
 #endif
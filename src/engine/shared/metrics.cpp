@@ -0,0 +1,209 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include "metrics.h"
+
+CMetrics::CMetrics()
+{
+	m_NumMetrics = 0;
+	m_NumPublished = 0;
+	m_Lock = lock_create();
+	m_Socket.type = NETTYPE_INVALID;
+	m_Socket.ipv4sock = -1;
+	m_Socket.ipv6sock = -1;
+	m_pThread = 0;
+	m_Shutdown = false;
+}
+
+CMetrics::~CMetrics()
+{
+	Close();
+	lock_destroy(m_Lock);
+}
+
+int CMetrics::Add(const char *pName, const char *pHelp, int Type, const double *pBounds, int NumBounds)
+{
+	if(m_NumMetrics == MAX_METRICS || NumBounds > MAX_BUCKETS)
+		return -1;
+
+	CMetric *pMetric = &m_aLive[m_NumMetrics];
+	mem_zero(pMetric, sizeof(*pMetric));
+	pMetric->m_pName = pName;
+	pMetric->m_pHelp = pHelp;
+	pMetric->m_Type = Type;
+	pMetric->m_NumBuckets = Type == TYPE_HISTOGRAM ? NumBounds : 0;
+	for(int i = 0; i < pMetric->m_NumBuckets; i++)
+		pMetric->m_aBounds[i] = pBounds[i];
+	return m_NumMetrics++;
+}
+
+int CMetrics::AddSeries(const char *pName, const char *pHelp, int Type, const char *pLabel)
+{
+	if(Type == TYPE_HISTOGRAM)
+		return -1;
+	int Metric = Add(pName, pHelp, Type);
+	if(Metric >= 0)
+		m_aLive[Metric].m_pLabel = pLabel;
+	return Metric;
+}
+
+void CMetrics::Observe(int Metric, double Value)
+{
+	if(Metric < 0)
+		return;
+	CMetric *pMetric = &m_aLive[Metric];
+	int Bucket = 0;
+	while(Bucket < pMetric->m_NumBuckets && Value > pMetric->m_aBounds[Bucket])
+		Bucket++;
+	pMetric->m_aCounts[Bucket]++;
+	pMetric->m_Value += Value;
+}
+
+void CMetrics::Publish()
+{
+	lock_wait(m_Lock);
+	mem_copy(m_aPublished, m_aLive, sizeof(CMetric)*m_NumMetrics);
+	m_NumPublished = m_NumMetrics;
+	lock_unlock(m_Lock);
+}
+
+int CMetrics::Format(char *pBuf, int BufSize)
+{
+	int Length = 0;
+	pBuf[0] = 0;
+	lock_wait(m_Lock);
+	for(int m = 0; m < m_NumPublished && Length < BufSize-1; m++)
+	{
+		const CMetric *pMetric = &m_aPublished[m];
+		static const char *s_apTypes[] = {"counter", "gauge", "histogram"};
+		str_format(pBuf+Length, BufSize-Length, "# HELP %s %s\n# TYPE %s %s\n", pMetric->m_pName, pMetric->m_pHelp, pMetric->m_pName, s_apTypes[pMetric->m_Type]);
+		Length += str_length(pBuf+Length);
+
+		if(pMetric->m_pLabel)
+		{
+			for(int s = pMetric->m_SeriesMask.first(); s >= 0 && Length < BufSize-1; s = pMetric->m_SeriesMask.next(s))
+			{
+				str_format(pBuf+Length, BufSize-Length, "%s{%s=\"%d\"} %.15g\n", pMetric->m_pName, pMetric->m_pLabel, s, pMetric->m_aSeries[s]);
+				Length += str_length(pBuf+Length);
+			}
+			continue;
+		}
+
+		if(pMetric->m_Type != TYPE_HISTOGRAM)
+		{
+			str_format(pBuf+Length, BufSize-Length, "%s %.15g\n", pMetric->m_pName, pMetric->m_Value);
+			Length += str_length(pBuf+Length);
+			continue;
+		}
+
+		// buckets are cumulative
+		int64 Count = 0;
+		for(int b = 0; b <= pMetric->m_NumBuckets && Length < BufSize-1; b++)
+		{
+			Count += pMetric->m_aCounts[b];
+			if(b < pMetric->m_NumBuckets)
+				str_format(pBuf+Length, BufSize-Length, "%s_bucket{le=\"%g\"} %lld\n", pMetric->m_pName, pMetric->m_aBounds[b], Count);
+			else
+				str_format(pBuf+Length, BufSize-Length, "%s_bucket{le=\"+Inf\"} %lld\n", pMetric->m_pName, Count);
+			Length += str_length(pBuf+Length);
+		}
+		str_format(pBuf+Length, BufSize-Length, "%s_sum %.15g\n%s_count %lld\n", pMetric->m_pName, pMetric->m_Value, pMetric->m_pName, Count);
+		Length += str_length(pBuf+Length);
+	}
+	lock_unlock(m_Lock);
+	return Length;
+}
+
+void CMetrics::HandleRequest(NETSOCKET Socket)
+{
+	// read the request head, the path does not matter
+	char aRequest[1024];
+	int Received = 0;
+	int64 Deadline = time_get()+time_freq();
+	while(Received < (int)sizeof(aRequest)-1 && time_get() < Deadline)
+	{
+		if(net_socket_read_wait(Socket, 100) <= 0)
+			continue;
+		int Bytes = net_tcp_recv(Socket, aRequest+Received, sizeof(aRequest)-1-Received);
+		if(Bytes <= 0)
+			break;
+		Received += Bytes;
+		aRequest[Received] = 0;
+		if(str_find(aRequest, "\r\n\r\n") || str_find(aRequest, "\n\n"))
+			break;
+	}
+	aRequest[Received] = 0;
+
+	// room for a line of each series of a few labeled metrics
+	enum { MAX_RESPONSE=64*1024+MAX_SERIES*1024 };
+	char *pResponse = (char *)mem_alloc(MAX_RESPONSE, 1);
+	const char *pHeader;
+	int Length = 0;
+	if(str_startswith(aRequest, "GET "))
+	{
+		pHeader = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+		Length = Format(pResponse, MAX_RESPONSE);
+	}
+	else
+		pHeader = "HTTP/1.0 400 Bad Request\r\nConnection: close\r\n\r\n";
+
+	net_tcp_send(Socket, pHeader, str_length(pHeader));
+	for(int Sent = 0; Sent < Length;)
+	{
+		int Bytes = net_tcp_send(Socket, pResponse+Sent, Length-Sent);
+		if(Bytes <= 0)
+			break;
+		Sent += Bytes;
+	}
+	mem_free(pResponse);
+}
+
+void CMetrics::ListenerThread(void *pUser)
+{
+	CMetrics *pThis = (CMetrics *)pUser;
+	while(!pThis->m_Shutdown)
+	{
+		if(net_socket_read_wait(pThis->m_Socket, 100) <= 0)
+			continue;
+
+		NETSOCKET Socket;
+		NETADDR Addr;
+		if(net_tcp_accept(pThis->m_Socket, &Socket, &Addr) <= 0)
+			continue;
+		net_set_blocking(Socket);
+		pThis->HandleRequest(Socket);
+		net_tcp_close(Socket);
+	}
+}
+
+bool CMetrics::Open(NETADDR BindAddr)
+{
+	if(m_pThread)
+		return true;
+
+	m_Socket = net_tcp_create(BindAddr);
+	if(!m_Socket.type)
+		return false;
+	if(net_tcp_listen(m_Socket, 8))
+	{
+		net_tcp_close(m_Socket);
+		m_Socket.type = NETTYPE_INVALID;
+		return false;
+	}
+	net_set_non_blocking(m_Socket);
+
+	m_Shutdown = false;
+	m_pThread = thread_init(ListenerThread, this);
+	return m_pThread != 0;
+}
+
+void CMetrics::Close()
+{
+	if(!m_pThread)
+		return;
+
+	m_Shutdown = true;
+	thread_wait(m_pThread);
+	m_pThread = 0;
+	net_tcp_close(m_Socket);
+	m_Socket.type = NETTYPE_INVALID;
+}
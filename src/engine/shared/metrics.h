@@ -0,0 +1,97 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_METRICS_H
+#define ENGINE_SHARED_METRICS_H
+
+#include <base/system.h>
+
+#include "protocol.h"
+
+/*
+	Class: CMetrics
+		Counters, gauges and histograms served in the Prometheus text
+		format over HTTP. The owning thread updates the live values
+		without locking and publishes a copy of them with <Publish>,
+		the listener thread only ever formats the published copy.
+*/
+class CMetrics
+{
+public:
+	enum
+	{
+		TYPE_COUNTER=0,
+		TYPE_GAUGE,
+		TYPE_HISTOGRAM,
+
+		MAX_METRICS=32,
+		MAX_BUCKETS=12,
+		MAX_SERIES=MAX_CLIENTS,
+	};
+
+private:
+	struct CMetric
+	{
+		const char *m_pName;
+		const char *m_pHelp;
+		int m_Type;
+		double m_Value; // the sum of the observations for histograms
+		int m_NumBuckets;
+		double m_aBounds[MAX_BUCKETS];
+		int64 m_aCounts[MAX_BUCKETS+1]; // the last one counts all observations
+		const char *m_pLabel; // for metrics with a series per label value
+		CClientMask m_SeriesMask;
+		double m_aSeries[MAX_SERIES];
+	};
+
+	CMetric m_aLive[MAX_METRICS];
+	CMetric m_aPublished[MAX_METRICS];
+	int m_NumMetrics;
+	int m_NumPublished;
+	LOCK m_Lock;
+
+	NETSOCKET m_Socket;
+	void *m_pThread;
+	volatile bool m_Shutdown;
+
+	static void ListenerThread(void *pUser);
+	void HandleRequest(NETSOCKET Socket);
+
+public:
+	CMetrics();
+	~CMetrics();
+
+	/*
+		Function: Add
+			Adds a metric and returns its id. The name and help text
+			have to stay valid. Histograms take their ascending bucket
+			bounds, at most MAX_BUCKETS. Returns -1 when full.
+	*/
+	int Add(const char *pName, const char *pHelp, int Type, const double *pBounds=0, int NumBounds=0);
+
+	/*
+		Function: AddSeries
+			Adds a counter or gauge with a series for each value of
+			the label, from 0 to MAX_SERIES-1 like the client ids.
+			Only the series that were set are listed.
+	*/
+	int AddSeries(const char *pName, const char *pHelp, int Type, const char *pLabel);
+
+	void Set(int Metric, double Value) { if(Metric >= 0) m_aLive[Metric].m_Value = Value; }
+	void Inc(int Metric, double Value=1.0) { if(Metric >= 0) m_aLive[Metric].m_Value += Value; }
+	void Observe(int Metric, double Value);
+
+	void SetSeries(int Metric, int Series, double Value) { if(Metric >= 0) { m_aLive[Metric].m_aSeries[Series] = Value; m_aLive[Metric].m_SeriesMask.set(Series); } }
+	void RemoveSeries(int Metric, int Series) { if(Metric >= 0) m_aLive[Metric].m_SeriesMask.reset(Series); }
+
+	// makes the current values visible to the listener
+	void Publish();
+
+	// the published values in the text exposition format, returns the length
+	int Format(char *pBuf, int BufSize);
+
+	bool Open(NETADDR BindAddr);
+	void Close();
+	bool IsOpen() const { return m_pThread != 0; }
+};
+
+#endif
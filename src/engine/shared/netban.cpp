@@ -3,6 +3,7 @@
 #include <engine/console.h>
 #include <engine/storage.h>
 #include <engine/shared/config.h>
+#include <engine/shared/linereader.h>
 
 #include "netban.h"
 
@@ -29,26 +30,368 @@ CNetBan::CNetHash::CNetHash(const CNetRange *pRange)
 	m_Hash &= 0xFF;
 }
 
-int CNetBan::CNetHash::MakeHashArray(const NETADDR *pAddr, CNetHash aHash[17])
+
+CNetPrefixTrie::CNetPrefixTrie()
+{
+	m_pNodes = 0;
+	m_MaxNodes = 0;
+	m_pValues = 0;
+	m_MaxValues = 0;
+	Clear();
+}
+
+CNetPrefixTrie::~CNetPrefixTrie()
+{
+	if(m_pNodes)
+		mem_free(m_pNodes);
+	if(m_pValues)
+		mem_free(m_pValues);
+}
+
+void CNetPrefixTrie::Clear()
+{
+	// keep the memory, just chain everything into the free lists
+	m_NumNodes = 0;
+	m_FirstFreeNode = -1;
+	for(int i = m_MaxNodes-1; i >= 0; --i)
+	{
+		m_pNodes[i].m_aChild[0] = m_FirstFreeNode;
+		m_FirstFreeNode = i;
+	}
+	m_FirstFreeValue = -1;
+	for(int i = m_MaxValues-1; i >= 0; --i)
+	{
+		m_pValues[i].m_Next = m_FirstFreeValue;
+		m_FirstFreeValue = i;
+	}
+	m_aRoot[0] = m_aRoot[1] = -1;
+}
+
+int CNetPrefixTrie::NewNode(const unsigned char *pKey, int Length)
 {
-	int Length = pAddr->type==NETTYPE_IPV4 ? 4 : 16;
-	aHash[0].m_Hash = 0;
-	aHash[0].m_HashIndex = 0;
-	for(int i = 1, Sum = 0; i <= Length; ++i)
+	if(m_FirstFreeNode < 0)
 	{
-		Sum += pAddr->ip[i-1];
-		aHash[i].m_Hash = Sum&0xFF;
-		aHash[i].m_HashIndex = i%Length;
+		// nodes are referenced by index, so the array can move
+		int NewMax = max(m_MaxNodes*2, 256);
+		CNode *pNodes = (CNode *)mem_alloc_tag(NewMax*sizeof(CNode), 1, MEMTAG_NETWORK);
+		if(m_pNodes)
+		{
+			mem_copy(pNodes, m_pNodes, m_MaxNodes*sizeof(CNode));
+			mem_free(m_pNodes);
+		}
+		m_pNodes = pNodes;
+		for(int i = NewMax-1; i >= m_MaxNodes; --i)
+		{
+			m_pNodes[i].m_aChild[0] = m_FirstFreeNode;
+			m_FirstFreeNode = i;
+		}
+		m_MaxNodes = NewMax;
 	}
-	return Length;
+
+	int Node = m_FirstFreeNode;
+	CNode *pNode = &m_pNodes[Node];
+	m_FirstFreeNode = pNode->m_aChild[0];
+
+	// only keep the prefix bits
+	mem_zero(pNode->m_aKey, sizeof(pNode->m_aKey));
+	mem_copy(pNode->m_aKey, pKey, (Length+7)/8);
+	if(Length&7)
+		pNode->m_aKey[Length>>3] &= 0xff<<(8-(Length&7));
+	pNode->m_Length = Length;
+	pNode->m_aChild[0] = pNode->m_aChild[1] = -1;
+	pNode->m_FirstValue = -1;
+	++m_NumNodes;
+	return Node;
+}
+
+void CNetPrefixTrie::FreeNode(int Node)
+{
+	m_pNodes[Node].m_aChild[0] = m_FirstFreeNode;
+	m_FirstFreeNode = Node;
+	--m_NumNodes;
+}
+
+void CNetPrefixTrie::AddValue(int Node, void *pData, int Tag)
+{
+	if(m_FirstFreeValue < 0)
+	{
+		int NewMax = max(m_MaxValues*2, 256);
+		CValue *pValues = (CValue *)mem_alloc_tag(NewMax*sizeof(CValue), 1, MEMTAG_NETWORK);
+		if(m_pValues)
+		{
+			mem_copy(pValues, m_pValues, m_MaxValues*sizeof(CValue));
+			mem_free(m_pValues);
+		}
+		m_pValues = pValues;
+		for(int i = NewMax-1; i >= m_MaxValues; --i)
+		{
+			m_pValues[i].m_Next = m_FirstFreeValue;
+			m_FirstFreeValue = i;
+		}
+		m_MaxValues = NewMax;
+	}
+
+	int Value = m_FirstFreeValue;
+	m_FirstFreeValue = m_pValues[Value].m_Next;
+	m_pValues[Value].m_pData = pData;
+	m_pValues[Value].m_Tag = Tag;
+	m_pValues[Value].m_Next = m_pNodes[Node].m_FirstValue;
+	m_pNodes[Node].m_FirstValue = Value;
+}
+
+int CNetPrefixTrie::CommonLength(const unsigned char *pKey1, const unsigned char *pKey2, int MaxLength)
+{
+	int Length = 0;
+	for(int i = 0; Length < MaxLength; ++i, Length += 8)
+	{
+		unsigned char Diff = pKey1[i]^pKey2[i];
+		if(Diff)
+		{
+			while(!(Diff&0x80))
+			{
+				Diff <<= 1;
+				++Length;
+			}
+			break;
+		}
+	}
+	return min(Length, MaxLength);
+}
+
+void CNetPrefixTrie::Insert(const NETADDR *pPrefix, int Length, void *pData, int Tag)
+{
+	const unsigned char *pKey = pPrefix->ip;
+	const int RootIndex = Root(pPrefix);
+	Length = clamp(Length, 0, MaxLength(pPrefix));
+
+	// NewNode can move the node array, so links are kept as parent index and side
+	int Parent = -1, Side = 0;
+	int Node = m_aRoot[RootIndex];
+	while(Node >= 0)
+	{
+		int NodeLength = m_pNodes[Node].m_Length;
+		int Common = CommonLength(m_pNodes[Node].m_aKey, pKey, min(NodeLength, Length));
+		if(Common == NodeLength)
+		{
+			if(NodeLength == Length)
+			{
+				AddValue(Node, pData, Tag);
+				return;
+			}
+			Parent = Node;
+			Side = Bit(pKey, NodeLength);
+			Node = m_pNodes[Node].m_aChild[Side];
+			continue;
+		}
+
+		// the prefix leaves the path inside this node, split it
+		int Split = NewNode(pKey, Common);
+		m_pNodes[Split].m_aChild[Bit(m_pNodes[Node].m_aKey, Common)] = Node;
+		if(Common == Length)
+			AddValue(Split, pData, Tag);
+		else
+		{
+			int Leaf = NewNode(pKey, Length);
+			AddValue(Leaf, pData, Tag);
+			m_pNodes[Split].m_aChild[Bit(pKey, Common)] = Leaf;
+		}
+		Node = Split;
+		break;
+	}
+
+	if(Node < 0)
+	{
+		Node = NewNode(pKey, Length);
+		AddValue(Node, pData, Tag);
+	}
+	if(Parent < 0)
+		m_aRoot[RootIndex] = Node;
+	else
+		m_pNodes[Parent].m_aChild[Side] = Node;
+}
+
+int CNetPrefixTrie::RemoveImpl(int Node, const unsigned char *pKey, int Length, void *pData, bool *pRemoved)
+{
+	if(Node < 0)
+		return Node;
+
+	CNode *pNode = &m_pNodes[Node];
+	if(pNode->m_Length > Length || CommonLength(pNode->m_aKey, pKey, pNode->m_Length) < pNode->m_Length)
+		return Node;
+
+	if(pNode->m_Length == Length)
+	{
+		for(int *pLink = &pNode->m_FirstValue; *pLink >= 0; pLink = &m_pValues[*pLink].m_Next)
+		{
+			int Value = *pLink;
+			if(m_pValues[Value].m_pData == pData)
+			{
+				*pLink = m_pValues[Value].m_Next;
+				m_pValues[Value].m_Next = m_FirstFreeValue;
+				m_FirstFreeValue = Value;
+				*pRemoved = true;
+				break;
+			}
+		}
+	}
+	else
+	{
+		int Side = Bit(pKey, pNode->m_Length);
+		pNode->m_aChild[Side] = RemoveImpl(pNode->m_aChild[Side], pKey, Length, pData, pRemoved);
+	}
+
+	// nodes without data are only needed to join two subtrees
+	if(pNode->m_FirstValue < 0 && (pNode->m_aChild[0] < 0 || pNode->m_aChild[1] < 0))
+	{
+		int Child = pNode->m_aChild[0] >= 0 ? pNode->m_aChild[0] : pNode->m_aChild[1];
+		FreeNode(Node);
+		return Child;
+	}
+	return Node;
+}
+
+bool CNetPrefixTrie::Remove(const NETADDR *pPrefix, int Length, void *pData)
+{
+	bool Removed = false;
+	int RootIndex = Root(pPrefix);
+	m_aRoot[RootIndex] = RemoveImpl(m_aRoot[RootIndex], pPrefix->ip, clamp(Length, 0, MaxLength(pPrefix)), pData, &Removed);
+	return Removed;
+}
+
+void CNetPrefixTrie::InsertRange(const CNetRange *pRange, void *pData, int Tag)
+{
+	NETADDR aPrefixes[MAX_RANGE_PREFIXES];
+	int aLengths[MAX_RANGE_PREFIXES];
+	int Num = RangeToPrefixes(pRange, aPrefixes, aLengths, MAX_RANGE_PREFIXES);
+	for(int i = 0; i < Num; ++i)
+		Insert(&aPrefixes[i], aLengths[i], pData, Tag);
+}
+
+void CNetPrefixTrie::RemoveRange(const CNetRange *pRange, void *pData)
+{
+	NETADDR aPrefixes[MAX_RANGE_PREFIXES];
+	int aLengths[MAX_RANGE_PREFIXES];
+	int Num = RangeToPrefixes(pRange, aPrefixes, aLengths, MAX_RANGE_PREFIXES);
+	for(int i = 0; i < Num; ++i)
+		Remove(&aPrefixes[i], aLengths[i], pData);
+}
+
+void *CNetPrefixTrie::Lookup(const NETADDR *pAddr, int *pTag) const
+{
+	const int Length = MaxLength(pAddr);
+	const CValue *pBest = 0;
+	int Node = m_aRoot[Root(pAddr)];
+	while(Node >= 0)
+	{
+		const CNode *pNode = &m_pNodes[Node];
+		if(CommonLength(pNode->m_aKey, pAddr->ip, pNode->m_Length) < pNode->m_Length)
+			break;
+		if(pNode->m_FirstValue >= 0)
+			pBest = &m_pValues[pNode->m_FirstValue];
+		if(pNode->m_Length >= Length)
+			break;
+		Node = pNode->m_aChild[Bit(pAddr->ip, pNode->m_Length)];
+	}
+
+	if(!pBest)
+		return 0;
+	if(pTag)
+		*pTag = pBest->m_Tag;
+	return pBest->m_pData;
+}
+
+int CNetPrefixTrie::RangeToPrefixes(const CNetRange *pRange, NETADDR *paPrefixes, int *paLengths, int MaxPrefixes)
+{
+	if(pRange->m_LB.type != pRange->m_UB.type)
+		return 0;
+
+	const int Length = MaxLength(&pRange->m_LB);
+	const int Size = Length/8;
+	if(mem_comp(pRange->m_LB.ip, pRange->m_UB.ip, Size) > 0)
+		return 0;
+
+	// take the largest aligned block at the lower bound that still fits, then move past it
+	NETADDR Current = pRange->m_LB;
+	Current.port = 0;
+	int Num = 0;
+	while(Num < MaxPrefixes)
+	{
+		int HostBits = 0;
+		while(HostBits < Length && !Bit(Current.ip, Length-1-HostBits))
+			++HostBits;
+
+		NETADDR Last;
+		while(1)
+		{
+			Last = Current;
+			for(int i = 0; i < HostBits; ++i)
+				Last.ip[(Length-1-i)>>3] |= 1<<(i&7);
+			if(mem_comp(Last.ip, pRange->m_UB.ip, Size) <= 0)
+				break;
+			--HostBits;
+		}
+
+		paPrefixes[Num] = Current;
+		paLengths[Num] = Length-HostBits;
+		++Num;
+
+		if(mem_comp(Last.ip, pRange->m_UB.ip, Size) == 0)
+			break;
+
+		// the block ended below the upper bound, so this can't overflow
+		Current = Last;
+		for(int i = Size-1; i >= 0 && ++Current.ip[i] == 0; --i);
+	}
+	return Num;
+}
+
+
+template<class T, int HashCount>
+CNetBan::CBanPool<T, HashCount>::CBanPool()
+{
+	mem_zero(m_paaHashList, sizeof(m_paaHashList));
+	mem_zero(m_apBanChunks, sizeof(m_apBanChunks));
+	m_NumBanChunks = 0;
+	m_pTrie = 0;
+	m_pFirstFree = 0;
+	m_pFirstUsed = 0;
+	m_CountUsed = 0;
 }
 
+template<class T, int HashCount>
+CNetBan::CBanPool<T, HashCount>::~CBanPool()
+{
+	for(int i = 0; i < m_NumBanChunks; ++i)
+		mem_free(m_apBanChunks[i]);
+}
+
+template<class T, int HashCount>
+void CNetBan::CBanPool<T, HashCount>::AddChunk()
+{
+	CBan<T> *pChunk = (CBan<T> *)mem_alloc_tag(BAN_CHUNK_SIZE*sizeof(CBan<T>), 1, MEMTAG_NETWORK);
+	mem_zero(pChunk, BAN_CHUNK_SIZE*sizeof(CBan<T>));
+	m_apBanChunks[m_NumBanChunks++] = pChunk;
+
+	// put the new bans in front of the free list
+	for(int i = 0; i < BAN_CHUNK_SIZE; ++i)
+	{
+		pChunk[i].m_pPrev = i > 0 ? &pChunk[i-1] : 0;
+		pChunk[i].m_pNext = i < BAN_CHUNK_SIZE-1 ? &pChunk[i+1] : m_pFirstFree;
+	}
+	if(m_pFirstFree)
+		m_pFirstFree->m_pPrev = &pChunk[BAN_CHUNK_SIZE-1];
+	m_pFirstFree = &pChunk[0];
+}
 
 template<class T, int HashCount>
 typename CNetBan::CBan<T> *CNetBan::CBanPool<T, HashCount>::Add(const T *pData, const CBanInfo *pInfo,  const CNetHash *pNetHash)
 {
 	if(!m_pFirstFree)
-		return 0;
+	{
+		if(m_NumBanChunks == MAX_BAN_CHUNKS)
+			return 0;
+		AddChunk();
+	}
 
 	// create new ban
 	CBan<T> *pBan = m_pFirstFree;
@@ -69,6 +412,9 @@ typename CNetBan::CBan<T> *CNetBan::CBanPool<T, HashCount>::Add(const T *pData,
 	pBan->m_pHashNext = m_paaHashList[pNetHash->m_HashIndex][pNetHash->m_Hash];
 	m_paaHashList[pNetHash->m_HashIndex][pNetHash->m_Hash] = pBan;
 
+	if(m_pTrie)
+		TrieInsert(m_pTrie, pBan);
+
 	// insert it into the used list
 	if(m_pFirstUsed)
 	{
@@ -124,6 +470,9 @@ int CNetBan::CBanPool<T, HashCount>::Remove(CBan<T> *pBan)
 		m_paaHashList[pBan->m_NetHash.m_HashIndex][pBan->m_NetHash.m_Hash] = pBan->m_pHashNext;
 	pBan->m_pHashNext = pBan->m_pHashPrev = 0;
 
+	if(m_pTrie)
+		TrieRemove(m_pTrie, pBan);
+
 	// remove from used list
 	if(pBan->m_pNext)
 		pBan->m_pNext->m_pPrev = pBan->m_pPrev;
@@ -196,20 +545,22 @@ void CNetBan::CBanPool<T, HashCount>::Update(CBan<CDataType> *pBan, const CBanIn
 template<class T, int HashCount>
 void CNetBan::CBanPool<T, HashCount>::Reset()
 {
-	mem_zero(m_paaHashList, sizeof(m_paaHashList));
-	mem_zero(m_aBans, sizeof(m_aBans));
-	m_pFirstUsed = 0;
-	m_CountUsed = 0;
-
-	for(int i = 1; i < MAX_BANS-1; ++i)
+	if(m_pTrie)
 	{
-		m_aBans[i].m_pNext = &m_aBans[i+1];
-		m_aBans[i].m_pPrev = &m_aBans[i-1];
+		for(CBan<T> *pBan = m_pFirstUsed; pBan; pBan = pBan->m_pNext)
+			TrieRemove(m_pTrie, pBan);
 	}
 
-	m_aBans[0].m_pNext = &m_aBans[1];
-	m_aBans[MAX_BANS-1].m_pPrev = &m_aBans[MAX_BANS-2];
-	m_pFirstFree = &m_aBans[0];
+	// give the memory of large imports back
+	for(int i = 0; i < m_NumBanChunks; ++i)
+		mem_free(m_apBanChunks[i]);
+	mem_zero(m_apBanChunks, sizeof(m_apBanChunks));
+	m_NumBanChunks = 0;
+
+	mem_zero(m_paaHashList, sizeof(m_paaHashList));
+	m_pFirstUsed = 0;
+	m_pFirstFree = 0;
+	m_CountUsed = 0;
 }
 
 template<class T, int HashCount>
@@ -281,10 +632,13 @@ void CNetBan::MakeBanInfo(CBan<T> *pBan, char *pBuf, unsigned BuffSize, int Type
 template<class T>
 int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, const char *pReason)
 {
+	scope_lock Lock(&m_PoolLock);
+
 	// do not ban localhost
 	if(!IsBannable(pData))
 	{
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban failed (localhost)");
+		if(!m_Quiet)
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban failed (localhost)");
 		return -1;
 	}
 
@@ -304,9 +658,12 @@ int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, c
 	{
 		// adjust the ban
 		pBanPool->Update(pBan, &Info);
-		char aBuf[128];
-		MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_LIST);
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		if(!m_Quiet)
+		{
+			char aBuf[128];
+			MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_LIST);
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		}
 		return 1;
 	}
 
@@ -314,12 +671,15 @@ int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, c
 	pBan = pBanPool->Add(pData, &Info, &NetHash);
 	if(pBan)
 	{
-		char aBuf[128];
-		MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_BANADD);
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		if(!m_Quiet)
+		{
+			char aBuf[128];
+			MakeBanInfo(pBan, aBuf, sizeof(aBuf), MSGTYPE_BANADD);
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		}
 		return 0;
 	}
-	else
+	else if(!m_Quiet)
 		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban failed (full banlist)");
 	return -1;
 }
@@ -327,6 +687,8 @@ int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, c
 template<class T>
 int CNetBan::Unban(T *pBanPool, const typename T::CDataType *pData)
 {
+	scope_lock Lock(&m_PoolLock);
+
 	CNetHash NetHash(pData);
 	CBan<typename T::CDataType> *pBan = pBanPool->Find(pData, &NetHash);
 	if(pBan)
@@ -346,8 +708,11 @@ void CNetBan::Init(IConsole *pConsole, IStorage *pStorage)
 {
 	m_pConsole = pConsole;
 	m_pStorage = pStorage;
+	m_BanAddrPool.SetTrie(&m_BanTrie);
+	m_BanRangePool.SetTrie(&m_BanTrie);
 	m_BanAddrPool.Reset();
 	m_BanRangePool.Reset();
+	m_Quiet = false;
 
 	net_host_lookup("localhost", &m_LocalhostIPV4, NETTYPE_IPV4);
 	net_host_lookup("localhost", &m_LocalhostIPV6, NETTYPE_IPV6);
@@ -357,10 +722,13 @@ void CNetBan::Init(IConsole *pConsole, IStorage *pStorage)
 	Console()->Register("unban_all", "", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConUnbanAll, this, "Unban all entries");
 	Console()->Register("bans", "", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBans, this, "Show banlist");
 	Console()->Register("bans_save", "s[file]", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBansSave, this, "Save banlist in a file");
+	Console()->Register("bans_load", "s[file]", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBansLoad, this, "Load bans from a file, one ip, range or ip/prefix per line");
 }
 
 void CNetBan::Update()
 {
+	scope_lock Lock(&m_PoolLock);
+
 	int Now = time_timestamp();
 
 	// remove expired bans
@@ -409,6 +777,8 @@ int CNetBan::UnbanByRange(const CNetRange *pRange)
 
 int CNetBan::UnbanByIndex(int Index)
 {
+	scope_lock Lock(&m_PoolLock);
+
 	int Result;
 	char aBuf[256];
 	CBanAddr *pBan = m_BanAddrPool.Get(Index);
@@ -440,6 +810,8 @@ int CNetBan::UnbanByIndex(int Index)
 
 void CNetBan::UnbanAll()
 {
+	scope_lock Lock(&m_PoolLock);
+
 	m_BanAddrPool.Reset();
 	m_BanRangePool.Reset();
 }
@@ -457,94 +829,100 @@ bool CNetBan::IsBannable(const T *pData)
 
 bool CNetBan::IsBanned(const NETADDR *pAddr, char *pBuf, unsigned BufferSize, int *pLastInfoQuery)
 {
-	CNetHash aHash[17];
-	int Length = CNetHash::MakeHashArray(pAddr, aHash);
+	scope_lock Lock(&m_PoolLock);
 
-	// check ban addresses
-	CBanAddr *pBan = m_BanAddrPool.Find(pAddr, &aHash[Length]);
-	if(pBan)
+	// address bans are stored as full length prefixes, so they win over ranges
+	int Tag;
+	void *pBan = m_BanTrie.Lookup(pAddr, &Tag);
+	if(!pBan)
+		return false;
+
+	if(Tag == TRIE_TAG_ADDR)
+		MakeBanInfo(static_cast<CBanAddr *>(pBan), pBuf, BufferSize, MSGTYPE_PLAYER, pLastInfoQuery);
+	else
+		MakeBanInfo(static_cast<CBanRange *>(pBan), pBuf, BufferSize, MSGTYPE_PLAYER, pLastInfoQuery);
+	return true;
+}
+
+int CNetBan::ParseAddrOrRange(const char *pStr, NETADDR *pAddr, CNetRange *pRange)
+{
+	char aBuf[256];
+	str_copy(aBuf, pStr, sizeof(aBuf));
+
+	char *pSeparator = (char *)str_find(aBuf, "-");
+	if(pSeparator && pSeparator[1] != '\0')
 	{
-		MakeBanInfo(pBan, pBuf, BufferSize, MSGTYPE_PLAYER, pLastInfoQuery);
-		return true;
+		*pSeparator = '\0';
+		if(net_addr_from_str(&pRange->m_LB, aBuf) != 0 || net_addr_from_str(&pRange->m_UB, pSeparator+1) != 0)
+			return -1;
+		return 1;
 	}
 
-	// check ban ranges
-	for(int i = Length-1; i >= 0; --i)
+	pSeparator = (char *)str_find(aBuf, "/");
+	if(pSeparator)
 	{
-		for(CBanRange *pBan = m_BanRangePool.First(&aHash[i]); pBan; pBan = pBan->m_pHashNext)
+		*pSeparator = '\0';
+		if(str_is_number(pSeparator+1) != 0 || net_addr_from_str(pAddr, aBuf) != 0)
+			return -1;
+		int Size = pAddr->type == NETTYPE_IPV4 ? NETADDR_SIZE_IPV4 : NETADDR_SIZE_IPV6;
+		int Length = str_toint(pSeparator+1);
+		if(Length < 0 || Length > Size*8)
+			return -1;
+		if(Length == Size*8)
+			return 0;
+
+		// the host part spans the range
+		pRange->m_LB = *pAddr;
+		pRange->m_UB = *pAddr;
+		for(int i = Length; i < Size*8; ++i)
 		{
-			if(NetMatch(&pBan->m_Data, pAddr, i, Length))
-			{
-				MakeBanInfo(pBan, pBuf, BufferSize, MSGTYPE_PLAYER, pLastInfoQuery);
-				return true;
-			}
+			pRange->m_LB.ip[i>>3] &= ~(0x80>>(i&7));
+			pRange->m_UB.ip[i>>3] |= 0x80>>(i&7);
 		}
+		return 1;
 	}
 
-	return false;
+	return net_addr_from_str(pAddr, aBuf) == 0 ? 0 : -1;
 }
 
 void CNetBan::ConBan(IConsole::IResult *pResult, void *pUser)
 {
 	CNetBan *pThis = static_cast<CNetBan *>(pUser);
 
-	char aBuf[256];
-	str_copy(aBuf, pResult->GetString(0), sizeof(aBuf));
-	const char *pSeparator = str_find(aBuf, "-");
-
 	const int Minutes = pResult->NumArguments() > 1 ? clamp(pResult->GetInteger(1), 0, 31*24*60) : 30;
 	const char *pReason = pResult->NumArguments() > 2 ? pResult->GetString(2) : "No reason given";
 
-	if(pSeparator == NULL || pSeparator[1] == '\0')
-	{
-		NETADDR Addr;
-		if(net_addr_from_str(&Addr, aBuf) == 0)
-			pThis->BanAddr(&Addr, Minutes*60, pReason);
-		else
-			pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban error (invalid network address)");
-	}
+	NETADDR Addr;
+	CNetRange Range;
+	int Type = ParseAddrOrRange(pResult->GetString(0), &Addr, &Range);
+	if(Type == 0)
+		pThis->BanAddr(&Addr, Minutes*60, pReason);
+	else if(Type == 1)
+		pThis->BanRange(&Range, Minutes*60, pReason);
 	else
-	{
-		aBuf[pSeparator-&aBuf[0]] = '\0';
-
-		CNetRange Range;
-		if(net_addr_from_str(&Range.m_LB, aBuf) == 0 && net_addr_from_str(&Range.m_UB, pSeparator+1) == 0)
-			pThis->BanRange(&Range, Minutes*60, pReason);
-		else
-			pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban error (invalid range)");
-	}
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban error (invalid network address or range)");
 }
 
 void CNetBan::ConUnban(IConsole::IResult *pResult, void *pUser)
 {
 	CNetBan *pThis = static_cast<CNetBan *>(pUser);
 
-	char aBuf[256];
-	str_copy(aBuf, pResult->GetString(0), sizeof(aBuf));
-	const char *pSeparator = str_find(aBuf, "-");
-
-	if(!str_is_number(aBuf))
-	{
-		pThis->UnbanByIndex(str_toint(aBuf));
-	}
-	else if(pSeparator == NULL || pSeparator[1] == '\0')
+	const char *pStr = pResult->GetString(0);
+	if(!str_is_number(pStr))
 	{
-		NETADDR Addr;
-		if(net_addr_from_str(&Addr, aBuf) == 0)
-			pThis->UnbanByAddr(&Addr);
-		else
-			pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "unban error (invalid network address)");
+		pThis->UnbanByIndex(str_toint(pStr));
+		return;
 	}
-	else
-	{
-		aBuf[pSeparator-&aBuf[0]] = '\0';
 
-		CNetRange Range;
-		if(net_addr_from_str(&Range.m_LB, aBuf) == 0 && net_addr_from_str(&Range.m_UB, pSeparator+1) == 0)
-			pThis->UnbanByRange(&Range);
-		else
-			pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "unban error (invalid range)");
-	}
+	NETADDR Addr;
+	CNetRange Range;
+	int Type = ParseAddrOrRange(pStr, &Addr, &Range);
+	if(Type == 0)
+		pThis->UnbanByAddr(&Addr);
+	else if(Type == 1)
+		pThis->UnbanByRange(&Range);
+	else
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "unban error (invalid network address or range)");
 }
 
 void CNetBan::ConUnbanAll(IConsole::IResult *pResult, void *pUser)
@@ -606,7 +984,7 @@ void CNetBan::ConBansSave(IConsole::IResult *pResult, void *pUser)
 		int Min = pBan->m_Info.m_Expires>-1 ? (pBan->m_Info.m_Expires-Now+59)/60 : -1;
 		net_addr_str(&pBan->m_Data.m_LB, aAddrStr1, sizeof(aAddrStr1), false);
 		net_addr_str(&pBan->m_Data.m_UB, aAddrStr2, sizeof(aAddrStr2), false);
-		str_format(aBuf, sizeof(aBuf), "ban_range %s %s %i %s", aAddrStr1, aAddrStr2, Min, pBan->m_Info.m_aReason);
+		str_format(aBuf, sizeof(aBuf), "ban %s-%s %i %s", aAddrStr1, aAddrStr2, Min, pBan->m_Info.m_aReason);
 		io_write(File, aBuf, str_length(aBuf));
 		io_write_newline(File);
 	}
@@ -616,7 +994,78 @@ void CNetBan::ConBansSave(IConsole::IResult *pResult, void *pUser)
 	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
 }
 
+void CNetBan::ConBansLoad(IConsole::IResult *pResult, void *pUser)
+{
+	CNetBan *pThis = static_cast<CNetBan *>(pUser);
+	char aBuf[256];
+	const char *pFilename = pResult->GetString(0);
+
+	IOHANDLE File = pThis->Storage()->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+	{
+		str_format(aBuf, sizeof(aBuf), "failed to load banlist from '%s'", pFilename);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		return;
+	}
+
+	// lines as written by bans_save, or plain blocklists with one entry per line
+	int NumAdded = 0, NumUpdated = 0, NumFailed = 0;
+	CLineReader LineReader;
+	LineReader.Init(File);
+	pThis->m_Quiet = true;
+	char *pLine;
+	while((pLine = LineReader.Get()))
+	{
+		pLine = str_skip_whitespaces(pLine);
+		if(str_startswith(pLine, "ban "))
+			pLine = str_skip_whitespaces(pLine+4);
+		if(pLine[0] == 0 || pLine[0] == '#')
+			continue;
+
+		// <ip|range|ip/prefix> [minutes] [reason], no minutes means permanent
+		char *pMinutes = str_skip_to_whitespace(pLine);
+		if(*pMinutes)
+			*pMinutes++ = 0;
+		pMinutes = str_skip_whitespaces(pMinutes);
+		int Minutes = -1;
+		const char *pReason = "No reason given";
+		if(pMinutes[0] && pMinutes[0] != '#')
+		{
+			char *pRest = str_skip_to_whitespace(pMinutes);
+			if(*pRest)
+				*pRest++ = 0;
+			Minutes = str_toint(pMinutes);
+			pRest = str_skip_whitespaces(pRest);
+			if(pRest[0] && pRest[0] != '#')
+				pReason = pRest;
+		}
+
+		NETADDR Addr;
+		CNetRange Range;
+		int Result = -1;
+		int Type = ParseAddrOrRange(pLine, &Addr, &Range);
+		if(Type == 0)
+			Result = pThis->BanAddr(&Addr, Minutes > 0 ? Minutes*60 : 0, pReason);
+		else if(Type == 1)
+			Result = pThis->BanRange(&Range, Minutes > 0 ? Minutes*60 : 0, pReason);
+
+		if(Result == 0)
+			++NumAdded;
+		else if(Result == 1)
+			++NumUpdated;
+		else
+			++NumFailed;
+	}
+	pThis->m_Quiet = false;
+	io_close(File);
+
+	str_format(aBuf, sizeof(aBuf), "loaded banlist from '%s': %d added, %d updated, %d failed", pFilename, NumAdded, NumUpdated, NumFailed);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+}
+
 // explicitly instantiate template for src/engine/server/server.cpp
+template class CNetBan::CBanPool<NETADDR, 1>;
+template class CNetBan::CBanPool<CNetRange, 16>;
 template void CNetBan::MakeBanInfo<CNetRange>(CBan<CNetRange> *pBan, char *pBuf, unsigned BufferSize, int Type, int *pLastInfoQuery);
 template void CNetBan::MakeBanInfo<NETADDR>(CBan<NETADDR> *pBan, char *pBuf, unsigned BufferSize, int Type, int *pLastInfoQuery);
 template int CNetBan::Ban<CNetBan::CBanPool<NETADDR, 1> >(CNetBan::CBanPool<NETADDR, 1> *pBanPool, const NETADDR *pData, int Seconds, const char *pReason);
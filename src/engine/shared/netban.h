@@ -2,6 +2,7 @@
 #define ENGINE_SHARED_NETBAN_H
 
 #include <base/system.h>
+#include <base/tl/threading.h>
 
 
 inline int NetComp(const NETADDR *pAddr1, const NETADDR *pAddr2)
@@ -24,6 +25,68 @@ inline int NetComp(const CNetRange *pRange1, const CNetRange *pRange2)
 }
 
 
+// path compressed binary trie over address prefixes, separate for ipv4 and ipv6.
+// lookups walk at most one node per prefix bit and find the longest matching prefix
+class CNetPrefixTrie
+{
+	struct CNode
+	{
+		unsigned char m_aKey[NETADDR_SIZE_IPV6];
+		int m_Length; // in bits
+		int m_aChild[2];
+		int m_FirstValue;
+	};
+
+	struct CValue
+	{
+		void *m_pData;
+		int m_Tag;
+		int m_Next;
+	};
+
+	CNode *m_pNodes;
+	int m_NumNodes;
+	int m_MaxNodes;
+	int m_FirstFreeNode;
+	CValue *m_pValues;
+	int m_MaxValues;
+	int m_FirstFreeValue;
+	int m_aRoot[2];
+
+	int NewNode(const unsigned char *pKey, int Length);
+	void FreeNode(int Node);
+	void AddValue(int Node, void *pData, int Tag);
+	int RemoveImpl(int Node, const unsigned char *pKey, int Length, void *pData, bool *pRemoved);
+
+	static int Root(const NETADDR *pAddr) { return pAddr->type == NETTYPE_IPV4 ? 0 : 1; }
+	static int MaxLength(const NETADDR *pAddr) { return pAddr->type == NETTYPE_IPV4 ? NETADDR_SIZE_IPV4*8 : NETADDR_SIZE_IPV6*8; }
+	static int Bit(const unsigned char *pKey, int Index) { return (pKey[Index>>3]>>(7-(Index&7)))&1; }
+	static int CommonLength(const unsigned char *pKey1, const unsigned char *pKey2, int MaxLength);
+
+public:
+	enum
+	{
+		MAX_RANGE_PREFIXES=NETADDR_SIZE_IPV6*8*2,
+	};
+
+	CNetPrefixTrie();
+	~CNetPrefixTrie();
+
+	void Clear();
+	// the same data can be inserted for several prefixes, and several data for one prefix
+	void Insert(const NETADDR *pPrefix, int Length, void *pData, int Tag);
+	bool Remove(const NETADDR *pPrefix, int Length, void *pData);
+	void InsertRange(const CNetRange *pRange, void *pData, int Tag);
+	void RemoveRange(const CNetRange *pRange, void *pData);
+	// data of the longest prefix that contains the address, 0 if none
+	void *Lookup(const NETADDR *pAddr, int *pTag = 0) const;
+	int NumNodes() const { return m_NumNodes; }
+
+	// splits an inclusive address range into the fewest prefixes covering exactly it
+	static int RangeToPrefixes(const CNetRange *pRange, NETADDR *paPrefixes, int *paLengths, int MaxPrefixes);
+};
+
+
 class CNetBan
 {
 protected:
@@ -69,8 +132,6 @@ protected:
 		CNetHash() {}	
 		CNetHash(const NETADDR *pAddr);
 		CNetHash(const CNetRange *pRange);
-
-		static int MakeHashArray(const NETADDR *pAddr, CNetHash aHash[17]);
 	};
 
 	struct CBanInfo
@@ -100,11 +161,27 @@ protected:
 		CBan *m_pPrev;
 	};
 
+	enum
+	{
+		TRIE_TAG_ADDR=0,
+		TRIE_TAG_RANGE,
+	};
+
+	static void TrieInsert(CNetPrefixTrie *pTrie, CBan<NETADDR> *pBan) { pTrie->Insert(&pBan->m_Data, pBan->m_Data.type==NETTYPE_IPV4 ? NETADDR_SIZE_IPV4*8 : NETADDR_SIZE_IPV6*8, pBan, TRIE_TAG_ADDR); }
+	static void TrieInsert(CNetPrefixTrie *pTrie, CBan<CNetRange> *pBan) { pTrie->InsertRange(&pBan->m_Data, pBan, TRIE_TAG_RANGE); }
+	static void TrieRemove(CNetPrefixTrie *pTrie, CBan<NETADDR> *pBan) { pTrie->Remove(&pBan->m_Data, pBan->m_Data.type==NETTYPE_IPV4 ? NETADDR_SIZE_IPV4*8 : NETADDR_SIZE_IPV6*8, pBan); }
+	static void TrieRemove(CNetPrefixTrie *pTrie, CBan<CNetRange> *pBan) { pTrie->RemoveRange(&pBan->m_Data, pBan); }
+
 	template<class T, int HashCount> class CBanPool
 	{
 	public:
 		typedef T CDataType;
 
+		CBanPool();
+		~CBanPool();
+
+		// every ban is also kept in the trie for the lookups by address
+		void SetTrie(CNetPrefixTrie *pTrie) { m_pTrie = pTrie; }
 		CBan<CDataType> *Add(const CDataType *pData, const CBanInfo *pInfo, const CNetHash *pNetHash);
 		int Remove(CBan<CDataType> *pBan);
 		void Update(CBan<CDataType> *pBan, const CBanInfo *pInfo);
@@ -130,11 +207,18 @@ protected:
 	private:
 		enum
 		{
-			MAX_BANS=1024,
+			MAX_BANS=64*1024,
+			BAN_CHUNK_SIZE=1024,
+			MAX_BAN_CHUNKS=MAX_BANS/BAN_CHUNK_SIZE,
 		};
 
+		void AddChunk();
+
 		CBan<CDataType> *m_paaHashList[HashCount][256];
-		CBan<CDataType> m_aBans[MAX_BANS];
+		// allocated on demand, the bans must not move as the trie points to them
+		CBan<CDataType> *m_apBanChunks[MAX_BAN_CHUNKS];
+		int m_NumBanChunks;
+		CNetPrefixTrie *m_pTrie;
 		CBan<CDataType> *m_pFirstFree;
 		CBan<CDataType> *m_pFirstUsed;
 		int m_CountUsed;
@@ -149,11 +233,19 @@ protected:
 	template<class T> int Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, const char *pReason);
 	template<class T> int Unban(T *pBanPool, const typename T::CDataType *pData);
 
+	// 0 for an address, 1 for a range (also from a.b.c.d/n), -1 on error
+	static int ParseAddrOrRange(const char *pStr, NETADDR *pAddr, CNetRange *pRange);
+
 	class IConsole *m_pConsole;
 	class IStorage *m_pStorage;
 	CBanAddrPool m_BanAddrPool;
 	CBanRangePool m_BanRangePool;
+	CNetPrefixTrie m_BanTrie;
 	NETADDR m_LocalhostIPV4, m_LocalhostIPV6;
+	bool m_Quiet;
+
+	// guards the pools, IsBanned can be called from the network thread
+	lock m_PoolLock;
 
 public:
 	enum
@@ -185,6 +277,7 @@ public:
 	static void ConUnbanAll(class IConsole::IResult *pResult, void *pUser);
 	static void ConBans(class IConsole::IResult *pResult, void *pUser);
 	static void ConBansSave(class IConsole::IResult *pResult, void *pUser);
+	static void ConBansLoad(class IConsole::IResult *pResult, void *pUser);
 };
 
 #endif
@@ -0,0 +1,213 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <engine/storage.h>
+
+#include "netcapture.h"
+
+static const unsigned char gs_aCaptureMagic[8] = {'T', 'W', 'N', 'E', 'T', 'C', 'A', 'P'};
+static const unsigned gs_CaptureVersion = 1;
+
+static void WriteUint64(IOHANDLE File, uint64 Value)
+{
+	unsigned char aBuf[8];
+	uint_to_bytes_be(aBuf, (unsigned)(Value>>32));
+	uint_to_bytes_be(aBuf+4, (unsigned)Value);
+	io_write(File, aBuf, sizeof(aBuf));
+}
+
+static bool ReadUint64(IOHANDLE File, uint64 *pValue)
+{
+	unsigned char aBuf[8];
+	if(io_read(File, aBuf, sizeof(aBuf)) != sizeof(aBuf))
+		return false;
+	*pValue = ((uint64)bytes_be_to_uint(aBuf)<<32) | bytes_be_to_uint(aBuf+4);
+	return true;
+}
+
+static void WriteUint(IOHANDLE File, unsigned Value)
+{
+	unsigned char aBuf[4];
+	uint_to_bytes_be(aBuf, Value);
+	io_write(File, aBuf, sizeof(aBuf));
+}
+
+static bool ReadUint(IOHANDLE File, unsigned *pValue)
+{
+	unsigned char aBuf[4];
+	if(io_read(File, aBuf, sizeof(aBuf)) != sizeof(aBuf))
+		return false;
+	*pValue = bytes_be_to_uint(aBuf);
+	return true;
+}
+
+CNetCapture::CNetCapture()
+{
+	m_File = 0;
+	m_pConfig = 0;
+	Reset();
+}
+
+CNetCapture::~CNetCapture()
+{
+	Reset();
+}
+
+void CNetCapture::Reset()
+{
+	if(m_File)
+		io_close(m_File);
+	m_File = 0;
+	if(m_pConfig)
+		mem_free(m_pConfig);
+	m_pConfig = 0;
+	m_aMap[0] = 0;
+	mem_zero(&m_MapSha256, sizeof(m_MapSha256));
+}
+
+bool CNetCaptureWriter::Open(IStorage *pStorage, const char *pFilename, const char *pMap, SHA256_DIGEST MapSha256, const char *pConfig)
+{
+	Close();
+	m_File = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!m_File)
+		return false;
+
+	str_copy(m_aMap, pMap, sizeof(m_aMap));
+	m_MapSha256 = MapSha256;
+	int ConfigSize = str_length(pConfig);
+	m_pConfig = (char *)mem_alloc(ConfigSize+1, 1);
+	mem_copy(m_pConfig, pConfig, ConfigSize+1);
+
+	io_write(m_File, gs_aCaptureMagic, sizeof(gs_aCaptureMagic));
+	WriteUint(m_File, gs_CaptureVersion);
+	char aMap[sizeof(m_aMap)] = {0};
+	str_copy(aMap, m_aMap, sizeof(aMap));
+	io_write(m_File, aMap, sizeof(aMap));
+	io_write(m_File, m_MapSha256.data, sizeof(m_MapSha256.data));
+	WriteUint(m_File, ConfigSize);
+	io_write(m_File, m_pConfig, ConfigSize);
+
+	m_StartTime = time_get();
+	return true;
+}
+
+void CNetCaptureWriter::Close()
+{
+	if(m_File)
+		io_flush(m_File);
+	Reset();
+}
+
+void CNetCaptureWriter::WriteRecordHeader(int Type)
+{
+	unsigned char Byte = Type;
+	io_write(m_File, &Byte, 1);
+	// split off the seconds, the elapsed ticks times a million overflow after a few hours
+	int64 Elapsed = time_get()-m_StartTime;
+	int64 Freq = time_freq();
+	WriteUint64(m_File, Elapsed/Freq*1000000 + Elapsed%Freq*1000000/Freq);
+}
+
+void CNetCaptureWriter::WriteDatagram(const NETADDR *pAddr, const void *pData, int Size)
+{
+	if(!m_File || Size <= 0 || Size > NET_MAX_PACKETSIZE)
+		return;
+
+	WriteRecordHeader(RECORD_DATAGRAM);
+	unsigned char aAddr[1+NETADDR_SIZE_IPV6+2];
+	aAddr[0] = pAddr->type;
+	mem_copy(aAddr+1, pAddr->ip, NETADDR_SIZE_IPV6);
+	aAddr[1+NETADDR_SIZE_IPV6] = pAddr->port>>8;
+	aAddr[2+NETADDR_SIZE_IPV6] = pAddr->port&0xff;
+	io_write(m_File, aAddr, sizeof(aAddr));
+	WriteUint(m_File, Size);
+	io_write(m_File, pData, Size);
+}
+
+void CNetCaptureWriter::WriteSeed(int64 Seed)
+{
+	if(!m_File)
+		return;
+
+	WriteRecordHeader(RECORD_SEED);
+	WriteUint64(m_File, Seed);
+}
+
+bool CNetCaptureReader::Open(IStorage *pStorage, const char *pFilename)
+{
+	Close();
+	m_File = pStorage->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!m_File)
+		return false;
+
+	// the config can't be longer than the file
+	unsigned FileSize = (unsigned)io_length(m_File);
+	unsigned char aMagic[sizeof(gs_aCaptureMagic)];
+	unsigned Version, ConfigSize;
+	if(io_read(m_File, aMagic, sizeof(aMagic)) != sizeof(aMagic) || mem_comp(aMagic, gs_aCaptureMagic, sizeof(aMagic)) != 0 ||
+		!ReadUint(m_File, &Version) || Version != gs_CaptureVersion ||
+		io_read(m_File, m_aMap, sizeof(m_aMap)) != sizeof(m_aMap) ||
+		io_read(m_File, m_MapSha256.data, sizeof(m_MapSha256.data)) != sizeof(m_MapSha256.data) ||
+		!ReadUint(m_File, &ConfigSize) || ConfigSize > FileSize)
+	{
+		Close();
+		return false;
+	}
+	m_aMap[sizeof(m_aMap)-1] = 0;
+
+	m_pConfig = (char *)mem_alloc(ConfigSize+1, 1);
+	if(io_read(m_File, m_pConfig, ConfigSize) != ConfigSize)
+	{
+		Close();
+		return false;
+	}
+	m_pConfig[ConfigSize] = 0;
+	return true;
+}
+
+void CNetCaptureReader::Close()
+{
+	m_RecordValid = false;
+	Reset();
+}
+
+const CNetCapture::CRecord *CNetCaptureReader::Peek()
+{
+	if(m_RecordValid)
+		return &m_Record;
+	if(!m_File)
+		return 0;
+
+	// a cut off record ends the capture like the end of the file
+	unsigned char Type;
+	uint64 Time;
+	if(io_read(m_File, &Type, 1) != 1 || !ReadUint64(m_File, &Time))
+		return 0;
+	m_Record.m_Type = Type;
+	m_Record.m_Time = Time;
+
+	if(Type == RECORD_DATAGRAM)
+	{
+		unsigned char aAddr[1+NETADDR_SIZE_IPV6+2];
+		unsigned Size;
+		if(io_read(m_File, aAddr, sizeof(aAddr)) != sizeof(aAddr) || !ReadUint(m_File, &Size) || Size > NET_MAX_PACKETSIZE ||
+			io_read(m_File, m_Record.m_aData, Size) != Size)
+			return 0;
+		mem_zero(&m_Record.m_Addr, sizeof(m_Record.m_Addr));
+		m_Record.m_Addr.type = aAddr[0];
+		mem_copy(m_Record.m_Addr.ip, aAddr+1, NETADDR_SIZE_IPV6);
+		m_Record.m_Addr.port = (aAddr[1+NETADDR_SIZE_IPV6]<<8) | aAddr[2+NETADDR_SIZE_IPV6];
+		m_Record.m_Size = Size;
+	}
+	else if(Type == RECORD_SEED)
+	{
+		uint64 Seed;
+		if(!ReadUint64(m_File, &Seed))
+			return 0;
+		m_Record.m_Seed = (int64)Seed;
+	}
+	else
+		return 0;
+
+	m_RecordValid = true;
+	return &m_Record;
+}
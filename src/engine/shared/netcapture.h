@@ -0,0 +1,94 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_NETCAPTURE_H
+#define ENGINE_SHARED_NETCAPTURE_H
+
+#include <base/hash.h>
+#include <base/system.h>
+
+#include "network.h"
+
+/*
+	Captures of the datagrams a server received, for feeding them to
+	it again. The header holds the map and the config lines needed to
+	set the server up the same way, followed by the records in the
+	order the server saw them:
+
+	datagram - time, address and data of a received datagram
+	seed - the token manager switched to a new seed, replays use it
+		instead of a random one so the recorded tokens stay valid
+
+	All numbers are big endian, times in microseconds since the start.
+*/
+class CNetCapture
+{
+public:
+	enum
+	{
+		RECORD_DATAGRAM=1,
+		RECORD_SEED,
+	};
+
+	struct CRecord
+	{
+		int m_Type;
+		int64 m_Time;
+		NETADDR m_Addr;
+		int64 m_Seed;
+		int m_Size;
+		unsigned char m_aData[NET_MAX_PACKETSIZE];
+	};
+
+protected:
+	IOHANDLE m_File;
+	char m_aMap[64];
+	SHA256_DIGEST m_MapSha256;
+	char *m_pConfig;
+
+	CNetCapture();
+	~CNetCapture();
+	void Reset();
+
+public:
+	bool IsOpen() const { return m_File != 0; }
+	const char *Map() const { return m_aMap; }
+	SHA256_DIGEST MapSha256() const { return m_MapSha256; }
+	// config lines separated by line breaks
+	const char *Config() const { return m_pConfig ? m_pConfig : ""; }
+};
+
+class CNetCaptureWriter : public CNetCapture
+{
+	int64 m_StartTime;
+
+	void WriteRecordHeader(int Type);
+
+public:
+	CNetCaptureWriter() : m_StartTime(0) {}
+	~CNetCaptureWriter() { Close(); }
+
+	bool Open(class IStorage *pStorage, const char *pFilename, const char *pMap, SHA256_DIGEST MapSha256, const char *pConfig);
+	void Close();
+
+	void WriteDatagram(const NETADDR *pAddr, const void *pData, int Size);
+	void WriteSeed(int64 Seed);
+};
+
+class CNetCaptureReader : public CNetCapture
+{
+	CRecord m_Record;
+	bool m_RecordValid;
+
+public:
+	CNetCaptureReader() : m_RecordValid(false) {}
+	~CNetCaptureReader() { Close(); }
+
+	bool Open(class IStorage *pStorage, const char *pFilename);
+	void Close();
+
+	// the next record without taking it, 0 at the end of the capture
+	const CRecord *Peek();
+	void Pop() { m_RecordValid = false; }
+};
+
+#endif
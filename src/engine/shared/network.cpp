@@ -4,11 +4,15 @@
 #include <base/system.h>
 
 #include <engine/engine.h>
+#include <engine/storage.h>
 
 #include "config.h"
 #include "console.h"
 #include "network.h"
 #include "huffman.h"
+#include "netcapture.h"
+#include "threadtopology.h"
+#include "tracer.h"
 
 
 static void ConchainDbgLognetwork(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
@@ -28,6 +32,7 @@ void CNetRecvUnpacker::Start(const NETADDR *pAddr, CNetConnection *pConnection,
 	m_pConnection = pConnection;
 	m_ClientID = ClientID;
 	m_CurrentChunk = 0;
+	m_pCurrentData = m_Data.m_pChunkData;
 	m_Valid = true;
 }
 
@@ -42,12 +47,10 @@ int CNetRecvUnpacker::FetchChunk(CNetChunk *pChunk)
 	}
 
 	CNetChunkHeader Header;
-	unsigned char *pEnd = m_Data.m_aChunkData + m_Data.m_DataSize;
+	const unsigned char *pEnd = m_Data.m_pChunkData + m_Data.m_DataSize;
 
 	while(1)
 	{
-		unsigned char *pData = m_Data.m_aChunkData;
-
 		// check for old data to unpack
 		if(!m_Valid || m_CurrentChunk >= m_Data.m_NumChunks)
 		{
@@ -55,15 +58,8 @@ int CNetRecvUnpacker::FetchChunk(CNetChunk *pChunk)
 			return 0;
 		}
 
-		// TODO: add checking here so we don't read too far
-		for(int i = 0; i < m_CurrentChunk; i++)
-		{
-			pData = Header.Unpack(pData);
-			pData += Header.m_Size;
-		}
-
-		// unpack the header
-		pData = Header.Unpack(pData);
+		// unpack the header, the chunk data is handed out in place
+		const unsigned char *pData = Header.Unpack(m_pCurrentData);
 		m_CurrentChunk++;
 
 		if(pData+Header.m_Size > pEnd)
@@ -71,6 +67,7 @@ int CNetRecvUnpacker::FetchChunk(CNetChunk *pChunk)
 			Clear();
 			return 0;
 		}
+		m_pCurrentData = pData+Header.m_Size;
 
 		// handle sequence stuff
 		if(m_pConnection && (Header.m_Flags&NET_CHUNKFLAG_VITAL))
@@ -112,12 +109,26 @@ CNetBase::CNetBase()
 	m_pEngine = 0;
 	m_DataLogSent = 0;
 	m_DataLogRecv = 0;
+	m_pBatchData = 0;
+	m_RecvBatchSize = 0;
+	m_RecvBatchCurrent = 0;
+	m_SendBatchSize = 0;
+	mem_zero(m_apRecvShards, sizeof(m_apRecvShards));
+	m_NumRecvShards = 0;
+	m_NextRecvSource = 0;
+	m_pCapture = 0;
+	m_pReplay = 0;
+	m_ReplayStartTime = 0;
+	m_ReplaySpeed = 0;
+	m_NumHuffmanTables = 0;
+	m_TableID = 0;
 }
 
 CNetBase::~CNetBase()
 {
 	if(m_Socket.type != NETTYPE_INVALID)
 		Shutdown();
+	SetBatching(false);
 }
 
 void CNetBase::Init(NETSOCKET Socket, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine)
@@ -127,45 +138,356 @@ void CNetBase::Init(NETSOCKET Socket, CConfig *pConfig, IConsole *pConsole, IEng
 	m_pEngine = pEngine;
 	m_Huffman.Init();
 	mem_zero(m_aRequestTokenBuf, sizeof(m_aRequestTokenBuf));
+	m_NumHuffmanTables = 0;
+	m_TableID = 0;
 	if(pEngine)
 		pConsole->Chain("dbg_lognetwork", ConchainDbgLognetwork, this);
 }
 
 void CNetBase::Shutdown()
 {
+	CloseRecvShards();
+	FlushSendBatch();
 	net_udp_close(m_Socket);
 	net_invalidate_socket(&m_Socket);
 }
 
 void CNetBase::Wait(int Time)
 {
-	net_socket_read_wait(m_Socket, Time);
+	WaitUntil(time_get() + Time*time_freq()/1000);
 }
 
-// packs the data tight and sends it
-void CNetBase::SendPacketConnless(const NETADDR *pAddr, TOKEN Token, TOKEN ResponseToken, const void *pData, int DataSize)
+bool CNetBase::WaitUntil(int64 Deadline)
 {
-	unsigned char aBuffer[NET_MAX_PACKETSIZE];
+	// everything queued so far has to be on the wire before we go to sleep
+	FlushSendBatch();
+	if(m_pReplay)
+	{
+		// nothing comes from the sockets, sleep until the next datagram is due
+		int64 DueTime;
+		while(!ReplayPending(&DueTime))
+		{
+			int64 Left = min(Deadline, DueTime)-time_get();
+			if(Left <= 0 && DueTime > Deadline)
+				return false;
+			if(Left >= time_freq()/1000)
+				thread_sleep(1);
+			else
+				thread_yield();
+		}
+		return true;
+	}
+	while(true)
+	{
+		int64 Left = max(Deadline-time_get(), int64(0))*1000000/time_freq();
+		if(!m_NumRecvShards)
+			return net_socket_read_wait_us(m_Socket, Left) != 0;
+
+		// the shards are read on their own threads, look at their queues in between
+		if(RecvShardsPending() || net_socket_read_wait_us(m_Socket, min(Left, int64(1000))))
+			return true;
+		if(!Left)
+			return false;
+	}
+}
 
-	dbg_assert(DataSize <= NET_MAX_PAYLOAD, "packet data size too high");
+bool CNetBase::PrepareWait(NETSOCKET *pSocket)
+{
+	FlushSendBatch();
+	*pSocket = m_Socket;
+	return !m_NumRecvShards && !m_pReplay;
+}
+
+bool CNetBase::OpenRecvShards(NETADDR BindAddr, int Num)
+{
+	Num = min(Num, (int)NET_MAX_RECV_SHARDS);
+	while(m_NumRecvShards < Num)
+	{
+		CRecvShard *pShard = new CRecvShard;
+		pShard->m_Socket = net_udp_create_reuseport(BindAddr);
+		if(!pShard->m_Socket.type)
+		{
+			delete pShard;
+			return false;
+		}
+
+		pShard->m_EntryPending = false;
+		pShard->m_Running = true;
+		pShard->m_pThread = thread_init(RecvShardThread, pShard);
+		if(!pShard->m_pThread)
+		{
+			net_udp_close(pShard->m_Socket);
+			delete pShard;
+			return false;
+		}
+		m_apRecvShards[m_NumRecvShards++] = pShard;
+	}
+	return true;
+}
+
+void CNetBase::CloseRecvShards()
+{
+	for(int i = 0; i < m_NumRecvShards; i++)
+		m_apRecvShards[i]->m_Running = false;
+	for(int i = 0; i < m_NumRecvShards; i++)
+	{
+		thread_wait(m_apRecvShards[i]->m_pThread);
+		net_udp_close(m_apRecvShards[i]->m_Socket);
+		delete m_apRecvShards[i];
+		m_apRecvShards[i] = 0;
+	}
+	m_NumRecvShards = 0;
+	m_NextRecvSource = 0;
+}
+
+void CNetBase::RecvShardThread(void *pUser)
+{
+	CRecvShard *pShard = (CRecvShard *)pUser;
+	CThreadTopology::Enter(CThreadTopology::CLASS_NET, "network shard");
+
+	while(pShard->m_Running)
+	{
+		CRecvShard::CDatagram *pDatagram = pShard->m_Queue.begin_push();
+		if(!pDatagram)
+		{
+			// the reader is behind, the packets can wait in the socket buffer
+			thread_sleep(1);
+			continue;
+		}
+
+		int Size = net_udp_recv(pShard->m_Socket, &pDatagram->m_Addr, pDatagram->m_aData, NET_MAX_PACKETSIZE);
+		if(Size <= 0)
+		{
+			// wake up now and then to notice the shutdown
+			net_socket_read_wait(pShard->m_Socket, 100);
+			continue;
+		}
+		pDatagram->m_Size = Size;
+		pShard->m_Queue.end_push();
+	}
+
+	CThreadTopology::Leave();
+}
+
+bool CNetBase::RecvShardsPending() const
+{
+	for(int i = 0; i < m_NumRecvShards; i++)
+		if(m_apRecvShards[i]->m_Queue.size() > (m_apRecvShards[i]->m_EntryPending ? 1u : 0u))
+			return true;
+	return false;
+}
+
+void CNetBase::CaptureSeed(int64 Seed)
+{
+	if(m_pCapture)
+		m_pCapture->WriteSeed(Seed);
+}
+
+void CNetBase::SetReplay(CNetCaptureReader *pReplay, int Speed)
+{
+	m_pReplay = pReplay;
+	m_ReplayStartTime = time_get();
+	m_ReplaySpeed = Speed;
+}
+
+bool CNetBase::ReplayFinished()
+{
+	return m_pReplay && !m_pReplay->Peek();
+}
+
+bool CNetBase::ReplayPending(int64 *pDueTime)
+{
+	*pDueTime = time_get()+time_freq();
+	const CNetCapture::CRecord *pRecord = m_pReplay->Peek();
+	if(!pRecord)
+		return false;
+	if(pRecord->m_Type != CNetCapture::RECORD_DATAGRAM || !m_ReplaySpeed)
+		return true;
+	*pDueTime = m_ReplayStartTime + pRecord->m_Time*time_freq()/1000000/m_ReplaySpeed;
+	return *pDueTime <= time_get();
+}
+
+bool CNetBase::ReplaySeed(int64 *pSeed)
+{
+	const CNetCapture::CRecord *pRecord = m_pReplay ? m_pReplay->Peek() : 0;
+	if(!pRecord || pRecord->m_Type != CNetCapture::RECORD_SEED)
+		return false;
+	*pSeed = pRecord->m_Seed;
+	m_pReplay->Pop();
+	return true;
+}
+
+int CNetBase::RecvReplayDatagram(NETADDR *pAddr, unsigned char *pBuffer, unsigned char **ppData)
+{
+	// a seed waits for the token manager, the datagrams after it need the new one
+	int64 DueTime;
+	if(!ReplayPending(&DueTime))
+		return 0;
+	const CNetCapture::CRecord *pRecord = m_pReplay->Peek();
+	if(pRecord->m_Type != CNetCapture::RECORD_DATAGRAM)
+		return 0;
+
+	int Size = pRecord->m_Size;
+	*pAddr = pRecord->m_Addr;
+	mem_copy(pBuffer, pRecord->m_aData, Size);
+	*ppData = pBuffer;
+	m_pReplay->Pop();
+	return Size;
+}
+
+int CNetBase::RecvDatagram(NETADDR *pAddr, unsigned char *pBuffer, unsigned char **ppData)
+{
+	if(m_pReplay)
+		return RecvReplayDatagram(pAddr, pBuffer, ppData);
+
+	// the packet handed out last time is done with
+	for(int i = 0; i < m_NumRecvShards; i++)
+	{
+		if(m_apRecvShards[i]->m_EntryPending)
+		{
+			m_apRecvShards[i]->m_Queue.pop();
+			m_apRecvShards[i]->m_EntryPending = false;
+		}
+	}
+
+	// take turns between the own socket and the shards so none of them starves
+	for(int n = 0; n <= m_NumRecvShards; n++)
+	{
+		int Source = m_NextRecvSource;
+		m_NextRecvSource = (m_NextRecvSource+1)%(m_NumRecvShards+1);
+
+		if(Source > 0)
+		{
+			CRecvShard *pShard = m_apRecvShards[Source-1];
+			CRecvShard::CDatagram *pDatagram = pShard->m_Queue.front();
+			if(!pDatagram)
+				continue;
+			pShard->m_EntryPending = true;
+			*pAddr = pDatagram->m_Addr;
+			*ppData = pDatagram->m_aData;
+			return pDatagram->m_Size;
+		}
+
+		if(Batching())
+		{
+			// refill the batch once everything in it has been handled
+			if(m_RecvBatchCurrent >= m_RecvBatchSize)
+			{
+				m_RecvBatchCurrent = 0;
+				m_RecvBatchSize = max(net_udp_recv_batch(m_Socket, m_aRecvBatch, NET_BATCH_SIZE, NET_MAX_PACKETSIZE), 0);
+				if(m_RecvBatchSize == 0)
+					continue;
+			}
+
+			const NETDATAGRAM *pDatagram = &m_aRecvBatch[m_RecvBatchCurrent++];
+			*pAddr = pDatagram->addr;
+			*ppData = (unsigned char *)pDatagram->data;
+			return pDatagram->size;
+		}
+
+		int Size = net_udp_recv(m_Socket, pAddr, pBuffer, NET_MAX_PACKETSIZE);
+		if(Size > 0)
+		{
+			*ppData = pBuffer;
+			return Size;
+		}
+	}
+
+	// no more packets for now
+	return 0;
+}
+
+void CNetBase::SetBatching(bool Enable)
+{
+	if(Enable == Batching())
+		return;
+
+	if(Enable)
+	{
+		m_pBatchData = (unsigned char *)mem_alloc_tag(NET_BATCH_SIZE*2*NET_MAX_PACKETSIZE, 1, MEMTAG_NETWORK);
+		for(int i = 0; i < NET_BATCH_SIZE; i++)
+		{
+			m_aRecvBatch[i].data = m_pBatchData + i*NET_MAX_PACKETSIZE;
+			m_aSendBatch[i].data = m_pBatchData + (NET_BATCH_SIZE+i)*NET_MAX_PACKETSIZE;
+		}
+	}
+	else
+	{
+		FlushSendBatch();
+		mem_free(m_pBatchData);
+		m_pBatchData = 0;
+	}
+	m_RecvBatchSize = 0;
+	m_RecvBatchCurrent = 0;
+	m_SendBatchSize = 0;
+}
+
+void CNetBase::FlushSendBatch()
+{
+	if(m_SendBatchSize == 0)
+		return;
+
+	net_udp_send_batch(m_Socket, m_aSendBatch, m_SendBatchSize);
+	m_SendBatchSize = 0;
+}
+
+void CNetBase::SendDatagram(const NETADDR *pAddr, const void *pData, int DataSize)
+{
+	if(m_pReplay)
+		return;
+
+	if(!Batching())
+	{
+		net_udp_send(m_Socket, pAddr, pData, DataSize);
+		return;
+	}
+
+	if(m_SendBatchSize == NET_BATCH_SIZE)
+		FlushSendBatch();
+
+	NETDATAGRAM *pDatagram = &m_aSendBatch[m_SendBatchSize++];
+	pDatagram->addr = *pAddr;
+	mem_copy(pDatagram->data, pData, DataSize);
+	pDatagram->size = DataSize;
+}
+
+void CNetBase::PackConnlessHeader(unsigned char *pBuffer, TOKEN Token, TOKEN ResponseToken)
+{
 	dbg_assert((Token&~NET_TOKEN_MASK) == 0, "token out of range");
 	dbg_assert((ResponseToken&~NET_TOKEN_MASK) == 0, "resp token out of range");
 
 	int i = 0;
-	aBuffer[i++] = ((NET_PACKETFLAG_CONNLESS<<2)&0xfc) | (NET_PACKETVERSION&0x03); // connless flag and version
-	aBuffer[i++] = (Token>>24)&0xff; // token
-	aBuffer[i++] = (Token>>16)&0xff;
-	aBuffer[i++] = (Token>>8)&0xff;
-	aBuffer[i++] = (Token)&0xff;
-	aBuffer[i++] = (ResponseToken>>24)&0xff; // response token
-	aBuffer[i++] = (ResponseToken>>16)&0xff;
-	aBuffer[i++] = (ResponseToken>>8)&0xff;
-	aBuffer[i++] = (ResponseToken)&0xff;
+	pBuffer[i++] = ((NET_PACKETFLAG_CONNLESS<<2)&0xfc) | (NET_PACKETVERSION&0x03); // connless flag and version
+	pBuffer[i++] = (Token>>24)&0xff; // token
+	pBuffer[i++] = (Token>>16)&0xff;
+	pBuffer[i++] = (Token>>8)&0xff;
+	pBuffer[i++] = (Token)&0xff;
+	pBuffer[i++] = (ResponseToken>>24)&0xff; // response token
+	pBuffer[i++] = (ResponseToken>>16)&0xff;
+	pBuffer[i++] = (ResponseToken>>8)&0xff;
+	pBuffer[i++] = (ResponseToken)&0xff;
 
 	dbg_assert(i == NET_PACKETHEADERSIZE_CONNLESS, "inconsistency");
+}
 
-	mem_copy(&aBuffer[i], pData, DataSize);
-	net_udp_send(m_Socket, pAddr, aBuffer, i+DataSize);
+// packs the data tight and sends it
+void CNetBase::SendPacketConnless(const NETADDR *pAddr, TOKEN Token, TOKEN ResponseToken, const void *pData, int DataSize)
+{
+	unsigned char aBuffer[NET_MAX_PACKETSIZE];
+
+	dbg_assert(DataSize <= NET_MAX_PAYLOAD, "packet data size too high");
+
+	PackConnlessHeader(aBuffer, Token, ResponseToken);
+	mem_copy(&aBuffer[NET_PACKETHEADERSIZE_CONNLESS], pData, DataSize);
+	SendDatagram(pAddr, aBuffer, NET_PACKETHEADERSIZE_CONNLESS+DataSize);
+}
+
+void CNetBase::SendPrepackedConnless(const NETADDR *pAddr, TOKEN Token, TOKEN ResponseToken, unsigned char *pPacket, int PacketSize)
+{
+	dbg_assert(PacketSize > NET_PACKETHEADERSIZE_CONNLESS && PacketSize <= NET_PACKETHEADERSIZE_CONNLESS+NET_MAX_PAYLOAD, "packet size out of range");
+
+	PackConnlessHeader(pPacket, Token, ResponseToken);
+	SendDatagram(pAddr, pPacket, PacketSize);
 }
 
 void CNetBase::SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket)
@@ -188,7 +510,15 @@ void CNetBase::SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket)
 
 	// compress if not ctrl msg
 	if(!(pPacket->m_Flags&NET_PACKETFLAG_CONTROL))
-		CompressedSize = m_Huffman.Compress(pPacket->m_aChunkData, pPacket->m_DataSize, &aBuffer[NET_PACKETHEADERSIZE], NET_MAX_PAYLOAD);
+	{
+		if(pPacket->m_Flags&NET_PACKETFLAG_HUFFMANTABLE && m_TableID)
+			CompressedSize = m_TableHuffman.Compress(pPacket->m_aChunkData, pPacket->m_DataSize, &aBuffer[NET_PACKETHEADERSIZE], NET_MAX_PAYLOAD);
+		else
+		{
+			pPacket->m_Flags &= ~NET_PACKETFLAG_HUFFMANTABLE;
+			CompressedSize = m_Huffman.Compress(pPacket->m_aChunkData, pPacket->m_DataSize, &aBuffer[NET_PACKETHEADERSIZE], NET_MAX_PAYLOAD);
+		}
+	}
 
 	// check if the compression was enabled, successful and good enough
 	if(CompressedSize > 0 && CompressedSize < pPacket->m_DataSize)
@@ -201,7 +531,7 @@ void CNetBase::SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket)
 		// use uncompressed data
 		FinalSize = pPacket->m_DataSize;
 		mem_copy(&aBuffer[NET_PACKETHEADERSIZE], pPacket->m_aChunkData, pPacket->m_DataSize);
-		pPacket->m_Flags &= ~NET_PACKETFLAG_COMPRESSION;
+		pPacket->m_Flags &= ~(NET_PACKETFLAG_COMPRESSION|NET_PACKETFLAG_HUFFMANTABLE);
 	}
 
 	// set header and send the packet if all things are good
@@ -220,7 +550,7 @@ void CNetBase::SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket)
 
 		dbg_assert(i == NET_PACKETHEADERSIZE, "inconsistency");
 
-		net_udp_send(m_Socket, pAddr, aBuffer, FinalSize);
+		SendDatagram(pAddr, aBuffer, FinalSize);
 
 		// log raw socket data
 		if(m_DataLogSent)
@@ -237,11 +567,14 @@ void CNetBase::SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket)
 // TODO: rename this function
 int CNetBase::UnpackPacket(NETADDR *pAddr, unsigned char *pBuffer, CNetPacketConstruct *pPacket)
 {
-	int Size = net_udp_recv(m_Socket, pAddr, pBuffer, NET_MAX_PACKETSIZE);
+	int Size = RecvDatagram(pAddr, pBuffer, &pBuffer);
 	// no more packets for now
 	if(Size <= 0)
 		return 1;
 
+	if(m_pCapture)
+		m_pCapture->WriteDatagram(pAddr, pBuffer, Size);
+
 	// log the data
 	if(m_DataLogRecv)
 	{
@@ -287,7 +620,7 @@ int CNetBase::UnpackPacket(NETADDR *pAddr, unsigned char *pBuffer, CNetPacketCon
 			// TTTTTTTT TTTTTTTT TTTTTTTT TTTTTTTT
 		pPacket->m_ResponseToken = (pBuffer[5]<<24) | (pBuffer[6]<<16) | (pBuffer[7]<<8) | pBuffer[8];
 			// RRRRRRRR RRRRRRRR RRRRRRRR RRRRRRRR
-		mem_copy(pPacket->m_aChunkData, &pBuffer[NET_PACKETHEADERSIZE_CONNLESS], pPacket->m_DataSize);
+		pPacket->m_pChunkData = &pBuffer[NET_PACKETHEADERSIZE_CONNLESS];
 	}
 	else
 	{
@@ -309,9 +642,23 @@ int CNetBase::UnpackPacket(NETADDR *pAddr, unsigned char *pBuffer, CNetPacketCon
 		pPacket->m_ResponseToken = NET_TOKEN_NONE;
 
 		if(pPacket->m_Flags&NET_PACKETFLAG_COMPRESSION)
-			pPacket->m_DataSize = m_Huffman.Decompress(&pBuffer[NET_PACKETHEADERSIZE], pPacket->m_DataSize, pPacket->m_aChunkData, sizeof(pPacket->m_aChunkData));
+		{
+			CHuffman *pHuffman = &m_Huffman;
+			if(pPacket->m_Flags&NET_PACKETFLAG_HUFFMANTABLE)
+			{
+				if(!m_TableID)
+				{
+					if(m_pConfig->m_Debug)
+						dbg_msg("network", "packet compressed with an unknown table");
+					return -1;
+				}
+				pHuffman = &m_TableHuffman;
+			}
+			pPacket->m_DataSize = pHuffman->Decompress(&pBuffer[NET_PACKETHEADERSIZE], pPacket->m_DataSize, pPacket->m_aChunkData, sizeof(pPacket->m_aChunkData));
+			pPacket->m_pChunkData = pPacket->m_aChunkData;
+		}
 		else
-			mem_copy(pPacket->m_aChunkData, &pBuffer[NET_PACKETHEADERSIZE], pPacket->m_DataSize);
+			pPacket->m_pChunkData = &pBuffer[NET_PACKETHEADERSIZE];
 	}
 
 	// check for errors
@@ -327,11 +674,11 @@ int CNetBase::UnpackPacket(NETADDR *pAddr, unsigned char *pBuffer, CNetPacketCon
 	{
 		if(pPacket->m_DataSize >= 5) // control byte + token
 		{
-			if(pPacket->m_aChunkData[0] == NET_CTRLMSG_CONNECT
-				|| pPacket->m_aChunkData[0] == NET_CTRLMSG_TOKEN)
+			if(pPacket->m_pChunkData[0] == NET_CTRLMSG_CONNECT
+				|| pPacket->m_pChunkData[0] == NET_CTRLMSG_TOKEN)
 			{
-				pPacket->m_ResponseToken = (pPacket->m_aChunkData[1]<<24) | (pPacket->m_aChunkData[2]<<16)
-					| (pPacket->m_aChunkData[3]<<8) | pPacket->m_aChunkData[4];
+				pPacket->m_ResponseToken = (pPacket->m_pChunkData[1]<<24) | (pPacket->m_pChunkData[2]<<16)
+					| (pPacket->m_pChunkData[3]<<8) | pPacket->m_pChunkData[4];
 			}
 		}
 	}
@@ -342,7 +689,7 @@ int CNetBase::UnpackPacket(NETADDR *pAddr, unsigned char *pBuffer, CNetPacketCon
 		int Type = 1;
 		io_write(m_DataLogRecv, &Type, sizeof(Type));
 		io_write(m_DataLogRecv, &pPacket->m_DataSize, sizeof(pPacket->m_DataSize));
-		io_write(m_DataLogRecv, pPacket->m_aChunkData, pPacket->m_DataSize);
+		io_write(m_DataLogRecv, pPacket->m_pChunkData, pPacket->m_DataSize);
 		io_flush(m_DataLogRecv);
 	}
 
@@ -377,9 +724,119 @@ void CNetBase::SendControlMsgWithToken(const NETADDR *pAddr, TOKEN Token, int Ac
 	m_aRequestTokenBuf[1] = (MyToken>>16)&0xff;
 	m_aRequestTokenBuf[2] = (MyToken>>8)&0xff;
 	m_aRequestTokenBuf[3] = (MyToken)&0xff;
+
+	// the rest is padding, old peers leave it empty
+	mem_zero(&m_aRequestTokenBuf[4], sizeof(m_aRequestTokenBuf)-4);
+	if(ControlMsg == NET_CTRLMSG_CONNECT)
+		PackHuffmanOffer(&m_aRequestTokenBuf[4], sizeof(m_aRequestTokenBuf)-4);
 	SendControlMsg(pAddr, Token, 0, ControlMsg, m_aRequestTokenBuf, Extended ? sizeof(m_aRequestTokenBuf) : 4);
 }
 
+static const unsigned char gs_aHuffmanMagic[4] = {'h', 'u', 'f', 'f'};
+
+unsigned CNetBase::AddHuffmanTable(const unsigned *pFrequencies)
+{
+	unsigned ID = CHuffman::TableID(pFrequencies);
+	for(int i = 0; i < m_NumHuffmanTables; i++)
+		if(m_aHuffmanTables[i].m_ID == ID)
+			return ID;
+	if(m_NumHuffmanTables == NET_MAX_HUFFMAN_TABLES)
+		return 0;
+
+	CHuffman *pHuffman = new CHuffman;
+	pHuffman->Init(pFrequencies);
+	bool Usable = pHuffman->Usable();
+	delete pHuffman;
+	if(!Usable)
+		return 0;
+
+	m_aHuffmanTables[m_NumHuffmanTables].m_ID = ID;
+	mem_copy(m_aHuffmanTables[m_NumHuffmanTables].m_aFrequencies, pFrequencies, sizeof(m_aHuffmanTables[m_NumHuffmanTables].m_aFrequencies));
+	m_NumHuffmanTables++;
+	return ID;
+}
+
+unsigned CNetBase::LoadHuffmanTable(IStorage *pStorage, const char *pFilename, int StorageType)
+{
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType);
+	if(!File)
+		return 0;
+
+	// 256 numbers of at most 7 digits with separators and some comments
+	char aText[8*1024];
+	int Size = io_read(File, aText, sizeof(aText)-1);
+	io_close(File);
+	aText[Size] = 0;
+
+	unsigned aFrequencies[256];
+	if(!CHuffman::ParseTable(aText, aFrequencies))
+		return 0;
+	return AddHuffmanTable(aFrequencies);
+}
+
+bool CNetBase::UseHuffmanTable(unsigned ID)
+{
+	if(ID == m_TableID)
+		return true;
+
+	for(int i = 0; i < m_NumHuffmanTables; i++)
+	{
+		if(m_aHuffmanTables[i].m_ID == ID)
+		{
+			m_TableHuffman.Init(m_aHuffmanTables[i].m_aFrequencies);
+			m_TableID = ID;
+			return true;
+		}
+	}
+	return false;
+}
+
+int CNetBase::PackHuffmanOffer(unsigned char *pData, int Size) const
+{
+	if(!m_NumHuffmanTables || Size < (int)sizeof(gs_aHuffmanMagic)+1+m_NumHuffmanTables*4)
+		return 0;
+
+	int i = 0;
+	mem_copy(pData, gs_aHuffmanMagic, sizeof(gs_aHuffmanMagic));
+	i += sizeof(gs_aHuffmanMagic);
+	pData[i++] = m_NumHuffmanTables;
+	for(int t = 0; t < m_NumHuffmanTables; t++)
+	{
+		uint_to_bytes_be(&pData[i], m_aHuffmanTables[t].m_ID);
+		i += 4;
+	}
+	return i;
+}
+
+bool CNetBase::HuffmanTableOffered(const unsigned char *pData, int Size, unsigned ID)
+{
+	if(Size < (int)sizeof(gs_aHuffmanMagic)+1 || mem_comp(pData, gs_aHuffmanMagic, sizeof(gs_aHuffmanMagic)) != 0)
+		return false;
+
+	int Num = pData[sizeof(gs_aHuffmanMagic)];
+	const unsigned char *pIDs = &pData[sizeof(gs_aHuffmanMagic)+1];
+	if(Num > NET_MAX_HUFFMAN_TABLES || Size < (int)sizeof(gs_aHuffmanMagic)+1+Num*4)
+		return false;
+	for(int i = 0; i < Num; i++)
+		if(bytes_be_to_uint(&pIDs[i*4]) == ID)
+			return true;
+	return false;
+}
+
+int CNetBase::PackHuffmanChoice(unsigned char *pData, unsigned ID)
+{
+	mem_copy(pData, gs_aHuffmanMagic, sizeof(gs_aHuffmanMagic));
+	uint_to_bytes_be(&pData[sizeof(gs_aHuffmanMagic)], ID);
+	return sizeof(gs_aHuffmanMagic)+4;
+}
+
+unsigned CNetBase::UnpackHuffmanChoice(const unsigned char *pData, int Size)
+{
+	if(Size < (int)sizeof(gs_aHuffmanMagic)+4 || mem_comp(pData, gs_aHuffmanMagic, sizeof(gs_aHuffmanMagic)) != 0)
+		return 0;
+	return bytes_be_to_uint(&pData[sizeof(gs_aHuffmanMagic)]);
+}
+
 unsigned char *CNetChunkHeader::Pack(unsigned char *pData)
 {
 	pData[0] = ((m_Flags&0x03)<<6) | ((m_Size>>6)&0x3F);
@@ -393,7 +850,7 @@ unsigned char *CNetChunkHeader::Pack(unsigned char *pData)
 	return pData + 2;
 }
 
-unsigned char *CNetChunkHeader::Unpack(unsigned char *pData)
+const unsigned char *CNetChunkHeader::Unpack(const unsigned char *pData)
 {
 	m_Flags = (pData[0]>>6)&0x03;
 	m_Size = ((pData[0]&0x3F)<<6) | (pData[1]&0x3F);
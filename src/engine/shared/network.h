@@ -3,6 +3,9 @@
 #ifndef ENGINE_SHARED_NETWORK_H
 #define ENGINE_SHARED_NETWORK_H
 
+#include <base/tl/threading.h>
+
+#include "protocol.h"
 #include "ringbuffer.h"
 #include "huffman.h"
 
@@ -82,13 +85,25 @@ enum
 	NET_PACKETFLAG_RESEND=2,
 	NET_PACKETFLAG_COMPRESSION=4,
 	NET_PACKETFLAG_CONNLESS=8,
+	NET_PACKETFLAG_HUFFMANTABLE=16, // compressed with the trained table agreed on in the handshake
 
 	NET_MAX_PACKET_CHUNKS=256,
 
+	// batched socket io
+	NET_BATCH_SIZE = 32,
+
+	// extra sockets sharing the port
+	NET_MAX_RECV_SHARDS = 7,
+	NET_SHARD_QUEUE_SIZE = 256,
+
+	// trained huffman tables, offered in the padding of the connect message
+	NET_MAX_HUFFMAN_TABLES = 8,
+
 	// token
 	NET_SEEDTIME = 16,
 
-	NET_TOKENCACHE_SIZE = 64,
+	NET_TOKENCACHE_SIZE = 2048,
+	NET_TOKENCACHE_HASHSIZE = 1024,
 	NET_TOKENCACHE_ADDRESSEXPIRY = NET_SEEDTIME,
 	NET_TOKENCACHE_PACKETEXPIRY = 5,
 };
@@ -106,7 +121,7 @@ enum
 	NET_TOKENREQUEST_DATASIZE = 512,
 
 	//
-	NET_MAX_CLIENTS = 64,
+	NET_MAX_CLIENTS = MAX_CLIENTS,
 	NET_MAX_CONSOLE_CLIENTS = 4,
 	
 	NET_MAX_SEQUENCE = 1<<10,
@@ -158,7 +173,7 @@ public:
 	int m_Sequence;
 
 	unsigned char *Pack(unsigned char *pData);
-	unsigned char *Unpack(unsigned char *pData);
+	const unsigned char *Unpack(const unsigned char *pData);
 };
 
 class CNetChunkResend
@@ -171,6 +186,10 @@ public:
 	int m_Sequence;
 	int64 m_LastSendTime;
 	int64 m_FirstSendTime;
+
+	// ordered by last send time
+	CNetChunkResend *m_pTimeoutNext;
+	CNetChunkResend *m_pTimeoutPrev;
 };
 
 class CNetPacketConstruct
@@ -183,6 +202,9 @@ public:
 	int m_NumChunks;
 	int m_DataSize;
 	unsigned char m_aChunkData[NET_MAX_PAYLOAD];
+	// payload of a received packet, points into the receive buffer unless it had to
+	// be decompressed into m_aChunkData. valid until the next packet is read
+	const unsigned char *m_pChunkData;
 };
 
 
@@ -207,6 +229,59 @@ class CNetBase
 	CHuffman m_Huffman;
 	unsigned char m_aRequestTokenBuf[NET_TOKENREQUEST_DATASIZE];
 
+	// trained tables this side knows, and the one used for NET_PACKETFLAG_HUFFMANTABLE
+	struct CHuffmanTable
+	{
+		unsigned m_ID;
+		unsigned m_aFrequencies[256];
+	};
+	CHuffmanTable m_aHuffmanTables[NET_MAX_HUFFMAN_TABLES];
+	int m_NumHuffmanTables;
+	CHuffman m_TableHuffman;
+	unsigned m_TableID;
+
+	// batched socket io, the datagram buffers live in m_pBatchData
+	unsigned char *m_pBatchData;
+	NETDATAGRAM m_aRecvBatch[NET_BATCH_SIZE];
+	int m_RecvBatchSize;
+	int m_RecvBatchCurrent;
+	NETDATAGRAM m_aSendBatch[NET_BATCH_SIZE];
+	int m_SendBatchSize;
+
+	// more sockets bound to the same port, each read on its own thread. the
+	// kernel keeps every peer on one of them, so its packets stay in order
+	struct CRecvShard
+	{
+		struct CDatagram
+		{
+			NETADDR m_Addr;
+			int m_Size;
+			unsigned char m_aData[NET_MAX_PACKETSIZE];
+		};
+
+		NETSOCKET m_Socket;
+		void *m_pThread;
+		volatile bool m_Running;
+		bool m_EntryPending; // the front of m_Queue is being read and gets popped with the next packet
+		spsc_queue<CDatagram, NET_SHARD_QUEUE_SIZE> m_Queue;
+	};
+	CRecvShard *m_apRecvShards[NET_MAX_RECV_SHARDS];
+	int m_NumRecvShards;
+	int m_NextRecvSource;
+
+	// inbound datagrams written to a capture, or read from one instead of the sockets
+	class CNetCaptureWriter *m_pCapture;
+	class CNetCaptureReader *m_pReplay;
+	int64 m_ReplayStartTime;
+	int m_ReplaySpeed;
+
+	static void RecvShardThread(void *pUser);
+	int RecvReplayDatagram(NETADDR *pAddr, unsigned char *pBuffer, unsigned char **ppData);
+	bool ReplayPending(int64 *pDueTime);
+	int RecvDatagram(NETADDR *pAddr, unsigned char *pBuffer, unsigned char **ppData);
+	bool RecvShardsPending() const;
+	void SendDatagram(const NETADDR *pAddr, const void *pData, int DataSize);
+
 public:
 	CNetBase();
 	~CNetBase();
@@ -218,10 +293,50 @@ public:
 	void Shutdown();
 	void UpdateLogHandles();
 	void Wait(int Time);
+	// waits for incoming data until the time_get() deadline, true if there is some
+	bool WaitUntil(int64 Deadline);
+
+	// flushes the sends like Wait and returns the socket to wait on for the caller,
+	// false if receive shards read from other sockets as well
+	bool PrepareWait(NETSOCKET *pSocket);
+
+	void SetBatching(bool Enable);
+	bool Batching() const { return m_pBatchData != 0; }
+	void FlushSendBatch();
+
+	// returns the id of the table, 0 if it's full or the frequencies make no usable tree
+	unsigned AddHuffmanTable(const unsigned *pFrequencies);
+	unsigned LoadHuffmanTable(class IStorage *pStorage, const char *pFilename, int StorageType);
+	bool UseHuffmanTable(unsigned ID);
+	unsigned HuffmanTableID() const { return m_TableID; }
+	// the connect message lists the known tables after the token, the accept names the chosen one
+	int PackHuffmanOffer(unsigned char *pData, int Size) const;
+	static bool HuffmanTableOffered(const unsigned char *pData, int Size, unsigned ID);
+	static int PackHuffmanChoice(unsigned char *pData, unsigned ID);
+	static unsigned UnpackHuffmanChoice(const unsigned char *pData, int Size);
+
+	// the socket has to be created with net_udp_create_reuseport
+	bool OpenRecvShards(NETADDR BindAddr, int Num);
+	void CloseRecvShards();
+	int NumRecvShards() const { return m_NumRecvShards; }
+
+	// the capture gets every datagram received from now on, 0 stops it
+	void SetCapture(class CNetCaptureWriter *pCapture) { m_pCapture = pCapture; }
+	void CaptureSeed(int64 Seed);
+	// hands out the datagrams of the capture instead of reading the sockets and drops
+	// everything sent. Speed multiplies the recorded pace, 0 is as fast as possible
+	void SetReplay(class CNetCaptureReader *pReplay, int Speed);
+	bool Replaying() const { return m_pReplay != 0; }
+	bool ReplayFinished();
+	// the seed the capture switched to before the datagrams that come next
+	bool ReplaySeed(int64 *pSeed);
 
 	void SendControlMsg(const NETADDR *pAddr, TOKEN Token, int Ack, int ControlMsg, const void *pExtra, int ExtraSize);
 	void SendControlMsgWithToken(const NETADDR *pAddr, TOKEN Token, int Ack, int ControlMsg, TOKEN MyToken, bool Extended);
 	void SendPacketConnless(const NETADDR *pAddr, TOKEN Token, TOKEN ResponseToken, const void *pData, int DataSize);
+	// pPacket is a connless packet packed ahead of time, only the tokens in its header get written
+	void SendPrepackedConnless(const NETADDR *pAddr, TOKEN Token, TOKEN ResponseToken, unsigned char *pPacket, int PacketSize);
+	static void PackConnlessHeader(unsigned char *pBuffer, TOKEN Token, TOKEN ResponseToken);
 	void SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket);
 	int UnpackPacket(NETADDR *pAddr, unsigned char *pBuffer, CNetPacketConstruct *pPacket);
 };
@@ -233,6 +348,7 @@ public:
 	void Update();
 
 	void GenerateSeed();
+	void SetSeed(int64 Seed);
 
 	int ProcessMessage(const NETADDR *pAddr, const CNetPacketConstruct *pPacket);
 
@@ -291,7 +407,15 @@ private:
 		const int m_TrackID;
 		FSendCallback m_pfnCallback;
 		void *m_pCallbackUser;
+
+		// expiry order, token request order, address hash and track id hash
 		CConnlessPacketInfo *m_pNext;
+		CConnlessPacketInfo *m_pPrev;
+		CConnlessPacketInfo *m_pFetchNext;
+		CConnlessPacketInfo *m_pFetchPrev;
+		CConnlessPacketInfo *m_pHashNext;
+		CConnlessPacketInfo *m_pHashPrev;
+		CConnlessPacketInfo *m_pTrackNext;
 	};
 
 	struct CAddressInfo
@@ -299,19 +423,52 @@ private:
 		NETADDR m_Addr;
 		TOKEN m_Token;
 		int64 m_Expiry;
+
+		// expiry order or free list, and address hash
+		CAddressInfo *m_pNext;
+		CAddressInfo *m_pPrev;
+		CAddressInfo *m_pHashNext;
+		CAddressInfo *m_pHashPrev;
 	};
 
-	TStaticRingBuffer<CAddressInfo,
-	                  NET_TOKENCACHE_SIZE * sizeof(CAddressInfo),
-	                  CRingBufferBase::FLAG_RECYCLE> m_TokenCache;
+	static unsigned AddrHash(const NETADDR *pAddr, bool Port);
+	void RemoveAddrInfo(CAddressInfo *pInfo);
+	void RemovePacket(CConnlessPacketInfo *pInfo);
+	void Clear();
+
+	// every timer of a kind has the same duration, so the lists kept in the
+	// order the timers were (re)armed are sorted by deadline as well
+	CAddressInfo m_aAddrInfos[NET_TOKENCACHE_SIZE];
+	CAddressInfo *m_apAddrHash[NET_TOKENCACHE_HASHSIZE];
+	CAddressInfo *m_pFirstFreeAddr;
+	CAddressInfo *m_pFirstAddr;
+	CAddressInfo *m_pLastAddr;
+
+	CConnlessPacketInfo *m_apPacketHash[NET_TOKENCACHE_HASHSIZE]; // by address without port
+	CConnlessPacketInfo *m_apTrackHash[NET_TOKENCACHE_HASHSIZE];
+	CConnlessPacketInfo *m_pFirstPacket;
+	CConnlessPacketInfo *m_pLastPacket;
+	CConnlessPacketInfo *m_pFirstFetch;
+	CConnlessPacketInfo *m_pLastFetch;
 
-	CConnlessPacketInfo *m_pConnlessPacketList; // TODO: enhance this, dynamic linked lists
-	                                            // are bad for performance
 	CNetBase *m_pNetBase;
 	const CNetTokenManager *m_pTokenManager;
 };
 
 
+// counters of a connection since it was established
+struct CNetConnStats
+{
+	unsigned m_SentPackets;
+	unsigned m_SentBytes; // before compression, with the packet header
+	unsigned m_RecvPackets;
+	unsigned m_RecvBytes;
+	unsigned m_Resends;
+	int m_QueuedChunks; // vital chunks waiting for an ack
+	int m_QueuedBytes;
+	int m_Rtt; // smoothed ack round trip in ms, -1 until measured
+};
+
 class CNetConnection
 {
 	// TODO: is this needed because this needs to be aware of
@@ -326,8 +483,13 @@ private:
 
 	int m_RemoteClosed;
 	bool m_BlockCloseMsg;
+	bool m_UseHuffmanTable;
 
+	// unacked vital chunks in sequence order, and the same chunks in the order they
+	// were last sent so a resend doesn't have to look at the ones sent just now
 	TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> m_Buffer;
+	CNetChunkResend *m_pFirstTimeout;
+	CNetChunkResend *m_pLastTimeout;
 
 	int64 m_LastUpdateTime;
 	int64 m_LastRecvTime;
@@ -341,7 +503,9 @@ private:
 	TOKEN m_PeerToken;
 	NETADDR m_PeerAddr;
 
-	NETSTATS m_Stats;
+	// read from the server thread while the network thread counts, stale values are fine
+	CNetConnStats m_Stats;
+	int64 m_SmoothRtt;
 	CNetBase *m_pNetBase;
 
 	//
@@ -353,6 +517,9 @@ private:
 	int QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence);
 	void SendControl(int ControlMsg, const void *pExtra, int ExtraSize);
 	void SendControlWithToken(int ControlMsg);
+	void SendAccept();
+	void LinkTimeout(CNetChunkResend *pResend);
+	void UnlinkTimeout(CNetChunkResend *pResend);
 	void ResendChunk(CNetChunkResend *pResend);
 	void Resend();
 
@@ -387,6 +554,8 @@ public:
 	// Needed for GotProblems in NetClient
 	int64 LastRecvTime() const { return m_LastRecvTime; }
 	int64 ConnectTime() const { return m_LastUpdateTime; }
+	unsigned NumResends() const { return m_Stats.m_Resends; }
+	const CNetConnStats *Stats() const { return &m_Stats; }
 
 	int AckSequence() const { return m_Ack; }
 	// The backroom is ack-NET_MAX_SEQUENCE/2. Used for knowing if we acked a packet or not
@@ -409,8 +578,24 @@ private:
 	bool m_LineEndingDetected;
 	char m_aLineEnding[3];
 
+	// lines waiting to be written, flushed without blocking once per update
+	char *m_pSendBuffer;
+	int m_SendBufferSize;
+	int m_SendBufferLength;
+	int m_SendBacklog;
+	int m_OverflowPolicy;
+	int m_DroppedLines;
+
+	void Append(const char *pData, int Length);
+
 public:
-	void Init(NETSOCKET Socket, const NETADDR *pAddr);
+	enum
+	{
+		OVERFLOW_DROP_LINES=0,
+		OVERFLOW_DISCONNECT,
+	};
+
+	void Init(NETSOCKET Socket, const NETADDR *pAddr, int Backlog, int OverflowPolicy);
 	void Disconnect(const char *pReason);
 
 	int State() const { return m_State; }
@@ -420,7 +605,9 @@ public:
 	void Reset();
 	int Update();
 	int Send(const char *pLine);
+	int Flush();
 	int Recv(char *pLine, int MaxLength);
+	void SetBacklog(int Backlog, int OverflowPolicy) { m_SendBacklog = Backlog; m_OverflowPolicy = OverflowPolicy; }
 };
 
 class CNetRecvUnpacker
@@ -431,6 +618,7 @@ public:
 	NETADDR m_Addr;
 	CNetConnection *m_pConnection;
 	int m_CurrentChunk;
+	const unsigned char *m_pCurrentData;
 	int m_ClientID;
 	CNetPacketConstruct m_Data;
 	unsigned char m_aBuffer[NET_MAX_PACKETSIZE];
@@ -443,14 +631,96 @@ public:
 };
 
 // server side
+// token buckets for packets from addresses without a connection, checked before
+// anything else looks at them. the buckets are kept as their next conforming time
+class CNetConnlessLimiter
+{
+	enum
+	{
+		NUM_SETS=256,
+		SET_SIZE=4,
+	};
+
+	struct CSource
+	{
+		NETADDR m_Addr;
+		int64 m_NextTime;
+	};
+
+	CSource m_aSources[NUM_SETS*SET_SIZE];
+	int64 m_GlobalNextTime;
+
+	int m_SourceRate;
+	int m_SourceBurst;
+	int m_GlobalRate;
+	int m_GlobalBurst;
+
+	// read from the tick thread while the network thread counts, a stale value is fine
+	volatile unsigned m_NumAccepted;
+	volatile unsigned m_NumDroppedSource;
+	volatile unsigned m_NumDroppedGlobal;
+
+	static bool Conform(int64 NextTime, int64 Now, int Rate, int Burst, int64 *pNewNextTime);
+
+public:
+	void Init();
+	// packets per second and how many of them may come at once, a rate of 0 disables the bucket
+	void SetLimits(int SourceRate, int SourceBurst, int GlobalRate, int GlobalBurst);
+	bool Allow(const NETADDR *pAddr, int64 Now);
+
+	unsigned NumAccepted() const { return m_NumAccepted; }
+	unsigned NumDroppedSource() const { return m_NumDroppedSource; }
+	unsigned NumDroppedGlobal() const { return m_NumDroppedGlobal; }
+};
+
 class CNetServer : public CNetBase
 {
 	struct CSlot
 	{
 	public:
 		CNetConnection m_Connection;
+		int m_Generation; // unique per connection, later connections get higher ones
+	};
+
+	// handoff between the network thread and the tick thread
+	struct CThreadEntry
+	{
+		enum
+		{
+			// network thread -> tick thread
+			TYPE_CHUNK=0,
+			TYPE_NEWCLIENT,
+			TYPE_DELCLIENT,
+			TYPE_BAN,
+			TYPE_STATS,
+
+			// tick thread -> network thread
+			TYPE_SEND,
+			TYPE_SEND_MASK,
+			TYPE_DROP,
+			TYPE_ADDTOKEN,
+			TYPE_FLUSH,
+		};
+
+		int m_Type;
+		int m_ClientID;
+		int m_Generation;
+		CClientMask m_ClientMask; // the receivers of TYPE_SEND_MASK
+		TOKEN m_Token;
+		NETADDR m_Address;
+		int m_Flags;
+		int m_DataSize;
+		unsigned char m_aData[NET_MAX_PAYLOAD];
 	};
 
+	enum
+	{
+		NET_THREAD_QUEUE_SIZE=1024,
+		NET_THREAD_QUEUE_RESERVE=NET_MAX_CLIENTS*4, // space for connection events, which can't be deferred
+		NET_THREAD_STATS_INTERVAL=100, // ms between the connection stats handed to the tick thread
+	};
+	typedef spsc_queue<CThreadEntry, NET_THREAD_QUEUE_SIZE> CThreadQueue;
+
 	class CNetBan *m_pNetBan;
 	CSlot m_aSlots[NET_MAX_CLIENTS];
 	int m_NumClients;
@@ -465,6 +735,38 @@ class CNetServer : public CNetBase
 
 	CNetTokenManager m_TokenManager;
 	CNetTokenCache m_TokenCache;
+	CNetConnlessLimiter m_ConnlessLimiter;
+
+	// connless packets that passed Recv and Send
+	unsigned m_NumConnlessRecv;
+	unsigned m_NumConnlessSent;
+
+	// network thread, only used if StartThread() was called
+	void *m_pThread;
+	volatile bool m_ThreadRunning;
+	CThreadQueue *m_pInQueue;
+	CThreadQueue *m_pOutQueue;
+	bool m_InEntryPending; // the front of m_pInQueue is handed out and gets popped on the next Recv
+	int m_aTickGeneration[NET_MAX_CLIENTS];
+	NETADDR m_aTickAddr[NET_MAX_CLIENTS];
+	CNetConnStats m_aTickStats[NET_MAX_CLIENTS];
+	int64 m_LastStatsPush; // by the network thread
+	int m_LastGeneration; // handed out by the network thread
+	int m_LastTickGeneration; // the latest connection the tick thread knows about
+
+	static void NetThread(void *pUser);
+	CThreadEntry *BeginPush(CThreadQueue *pQueue);
+	void PushStats();
+	void ProcessOutQueue();
+
+	void OnNewClient(int ClientID);
+	void OnDelClient(int ClientID, const char *pReason);
+
+	int RecvImpl(CNetChunk *pChunk, TOKEN *pResponseToken);
+	int SendImpl(CNetChunk *pChunk, TOKEN Token);
+	int UpdateImpl();
+	void DropImpl(int ClientID, const char *pReason);
+	void FlushImpl();
 
 public:
 	//
@@ -475,15 +777,35 @@ public:
 	// the token parameter is only used for connless packets
 	int Recv(CNetChunk *pChunk, TOKEN *pResponseToken = 0);
 	int Send(CNetChunk *pChunk, TOKEN Token = NET_TOKEN_NONE);
+	// queues the same chunk for every client in the mask, the chunk's client id is ignored
+	int SendMask(CNetChunk *pChunk, const CClientMask &Receivers);
+	// sends the chunks queued for all clients, packed into as few packets as possible
+	void Flush();
 	int Update();
-	void AddToken(const NETADDR *pAddr, TOKEN Token) { m_TokenCache.AddToken(pAddr, Token, 0); }
+	void AddToken(const NETADDR *pAddr, TOKEN Token);
+	void Wait(int Time);
+	bool WaitUntil(int64 Deadline);
+	// false while the network thread owns the socket
+	bool PrepareWait(NETSOCKET *pSocket) { return !Threaded() && CNetBase::PrepareWait(pSocket); }
+	// has to be called before StartThread, starts with a new token seed so the capture knows it
+	void StartCapture(class CNetCaptureWriter *pCapture);
+
+	// moves socket handling onto its own thread, Recv/Send then only talk to it through queues
+	bool StartThread();
+	void StopThread();
+	bool Threaded() const { return m_pThread != 0; }
 
 	//
 	void Drop(int ClientID, const char *pReason);
 
 	// status requests
-	const NETADDR *ClientAddr(int ClientID) const { return m_aSlots[ClientID].m_Connection.PeerAddress(); }
+	const NETADDR *ClientAddr(int ClientID) const { return Threaded() ? &m_aTickAddr[ClientID] : m_aSlots[ClientID].m_Connection.PeerAddress(); }
+	unsigned ClientResends(int ClientID) const { return Threaded() ? m_aTickStats[ClientID].m_Resends : m_aSlots[ClientID].m_Connection.NumResends(); }
+	void ClientStats(int ClientID, CNetConnStats *pStats) const { *pStats = Threaded() ? m_aTickStats[ClientID] : *m_aSlots[ClientID].m_Connection.Stats(); }
 	class CNetBan *NetBan() const { return m_pNetBan; }
+	const CNetConnlessLimiter *ConnlessLimiter() const { return &m_ConnlessLimiter; }
+	unsigned NumConnlessRecv() const { return m_NumConnlessRecv; }
+	unsigned NumConnlessSent() const { return m_NumConnlessSent; }
 
 	//
 	void SetMaxClients(int MaxClients);
@@ -507,6 +829,9 @@ class CNetConsole
 
 	CNetRecvUnpacker m_RecvUnpacker;
 
+	int m_SendBacklog;
+	int m_OverflowPolicy;
+
 public:
 	//
 	bool Open(NETADDR BindAddr, class CNetBan *pNetBan, NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_DELCLIENT pfnDelClient, void *pUser);
@@ -516,7 +841,10 @@ public:
 	int Recv(char *pLine, int MaxLength, int *pClientID = 0);
 	int Send(int ClientID, const char *pLine);
 	int Update();
+	void Flush();
 	void SetLingerState(int State);
+	// bytes of output kept per client when it does not read fast enough, and what to do beyond
+	void SetBacklog(int Backlog, int OverflowPolicy);
 
 	//
 	int AcceptClient(NETSOCKET Socket, const NETADDR *pAddr);
@@ -542,7 +870,8 @@ class CNetClient : public CNetBase
 
 public:
 	// openness
-	bool Open(NETADDR BindAddr, class CConfig *pConfig, class IConsole *pConsole, class IEngine *pEngine, int Flags);
+	// more than one socket shares the port like sv_net_sockets does on the server
+	bool Open(NETADDR BindAddr, class CConfig *pConfig, class IConsole *pConsole, class IEngine *pEngine, int Flags, int NumSockets = 1);
 	void Close();
 
 	// connection state
@@ -554,6 +883,9 @@ public:
 	int Send(CNetChunk *pChunk, TOKEN Token = NET_TOKEN_NONE, CSendCBData *pCallbackData = 0);
 	void PurgeStoredPacket(int TrackID);
 
+	// the token answers to pAddr carry, SendPacketConnless with it can then be used from other threads
+	TOKEN ResponseToken(const NETADDR *pAddr) const { return m_TokenManager.GenerateToken(pAddr); }
+
 	// pumping
 	int Update();
 	int Flush();
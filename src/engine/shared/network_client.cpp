@@ -5,11 +5,19 @@
 #include "network.h"
 
 
-bool CNetClient::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine, int Flags)
+bool CNetClient::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine, int Flags, int NumSockets)
 {
 	// open socket
 	NETSOCKET Socket;
-	Socket = net_udp_create(BindAddr, (Flags&NETCREATE_FLAG_RANDOMPORT) ? 1 : 0);
+	if(Flags&NETCREATE_FLAG_RANDOMPORT)
+		NumSockets = 1;
+	Socket = NumSockets > 1 ? net_udp_create_reuseport(BindAddr) : net_udp_create(BindAddr, (Flags&NETCREATE_FLAG_RANDOMPORT) ? 1 : 0);
+	if(!Socket.type && NumSockets > 1)
+	{
+		dbg_msg("netclient", "couldn't share the port, using a single socket");
+		NumSockets = 1;
+		Socket = net_udp_create(BindAddr, 0);
+	}
 	if(!Socket.type)
 		return false;
 
@@ -20,6 +28,9 @@ bool CNetClient::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IE
 	Init(Socket, pConfig, pConsole, pEngine);
 	m_Connection.Init(this, false);
 
+	if(NumSockets > 1 && !OpenRecvShards(BindAddr, NumSockets-1))
+		dbg_msg("netclient", "couldn't open all sockets, using %d", NumRecvShards()+1);
+
 	m_TokenManager.Init(this);
 	m_TokenCache.Init(this, &m_TokenManager);
 
@@ -97,7 +108,7 @@ int CNetClient::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 
 				if(m_RecvUnpacker.m_Data.m_Flags&NET_PACKETFLAG_CONTROL)
 				{
-					if(m_RecvUnpacker.m_Data.m_aChunkData[0] == NET_CTRLMSG_TOKEN)
+					if(m_RecvUnpacker.m_Data.m_pChunkData[0] == NET_CTRLMSG_TOKEN)
 						m_TokenCache.AddToken(&Addr, m_RecvUnpacker.m_Data.m_ResponseToken, NET_TOKENFLAG_ALLOWBROADCAST|NET_TOKENFLAG_RESPONSEONLY);
 				}
 				else if(m_RecvUnpacker.m_Data.m_Flags&NET_PACKETFLAG_CONNLESS && Accept != -1)
@@ -106,7 +117,7 @@ int CNetClient::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 					pChunk->m_ClientID = -1;
 					pChunk->m_Address = Addr;
 					pChunk->m_DataSize = m_RecvUnpacker.m_Data.m_DataSize;
-					pChunk->m_pData = m_RecvUnpacker.m_Data.m_aChunkData;
+					pChunk->m_pData = m_RecvUnpacker.m_Data.m_pChunkData;
 
 					if(pResponseToken)
 						*pResponseToken = m_RecvUnpacker.m_Data.m_ResponseToken;
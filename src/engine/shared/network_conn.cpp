@@ -9,6 +9,8 @@
 void CNetConnection::ResetStats()
 {
 	mem_zero(&m_Stats, sizeof(m_Stats));
+	m_Stats.m_Rtt = -1;
+	m_SmoothRtt = -1;
 }
 
 void CNetConnection::Reset()
@@ -17,6 +19,7 @@ void CNetConnection::Reset()
 	m_Ack = 0;
 	m_PeerAck = 0;
 	m_RemoteClosed = 0;
+	m_UseHuffmanTable = false;
 
 	m_State = NET_CONNSTATE_OFFLINE;
 	m_LastSendTime = 0;
@@ -27,6 +30,9 @@ void CNetConnection::Reset()
 	mem_zero(&m_PeerAddr, sizeof(m_PeerAddr));
 
 	m_Buffer.Init();
+	m_pFirstTimeout = 0;
+	m_pLastTimeout = 0;
+	ResetStats();
 
 	mem_zero(&m_Construct, sizeof(m_Construct));
 }
@@ -57,7 +63,6 @@ void CNetConnection::SetError(const char *pString)
 void CNetConnection::Init(CNetBase *pNetBase, bool BlockCloseMsg)
 {
 	Reset();
-	ResetStats();
 
 	m_pNetBase = pNetBase;
 	m_BlockCloseMsg = BlockCloseMsg;
@@ -66,6 +71,7 @@ void CNetConnection::Init(CNetBase *pNetBase, bool BlockCloseMsg)
 
 void CNetConnection::AckChunks(int Ack)
 {
+	int64 Now = 0;
 	while(1)
 	{
 		CNetChunkResend *pResend = m_Buffer.First();
@@ -73,7 +79,21 @@ void CNetConnection::AckChunks(int Ack)
 			break;
 
 		if(IsSeqInBackroom(pResend->m_Sequence, Ack))
+		{
+			// resent chunks don't tell which send got acked
+			if(pResend->m_LastSendTime == pResend->m_FirstSendTime)
+			{
+				if(!Now)
+					Now = time_get();
+				int64 Rtt = Now-pResend->m_FirstSendTime;
+				m_SmoothRtt = m_SmoothRtt < 0 ? Rtt : m_SmoothRtt+(Rtt-m_SmoothRtt)/8;
+				m_Stats.m_Rtt = (int)(m_SmoothRtt*1000/time_freq());
+			}
+			m_Stats.m_QueuedChunks--;
+			m_Stats.m_QueuedBytes -= pResend->m_DataSize;
+			UnlinkTimeout(pResend);
 			m_Buffer.PopFirst();
+		}
 		else
 			break;
 	}
@@ -91,12 +111,16 @@ int CNetConnection::Flush()
 		return 0;
 
 	// send of the packets
+	if(m_UseHuffmanTable)
+		m_Construct.m_Flags |= NET_PACKETFLAG_HUFFMANTABLE;
 	m_Construct.m_Ack = m_Ack;
 	m_Construct.m_Token = m_PeerToken;
 	m_pNetBase->SendPacket(&m_PeerAddr, &m_Construct);
+	m_Stats.m_SentPackets++;
+	m_Stats.m_SentBytes += NET_PACKETHEADERSIZE+m_Construct.m_DataSize;
 
 	// update send times
-	m_LastSendTime = time_get();
+	m_LastSendTime = time_get_coarse();
 
 	// clear construct so we can start building a new package
 	mem_zero(&m_Construct, sizeof(m_Construct));
@@ -140,6 +164,9 @@ int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int
 			pResend->m_FirstSendTime = time_get();
 			pResend->m_LastSendTime = pResend->m_FirstSendTime;
 			mem_copy(pResend->m_pData, pData, DataSize);
+			LinkTimeout(pResend);
+			m_Stats.m_QueuedChunks++;
+			m_Stats.m_QueuedBytes += DataSize;
 		}
 		else
 		{
@@ -162,8 +189,10 @@ int CNetConnection::QueueChunk(int Flags, int DataSize, const void *pData)
 void CNetConnection::SendControl(int ControlMsg, const void *pExtra, int ExtraSize)
 {
 	// send the control message
-	m_LastSendTime = time_get();
+	m_LastSendTime = time_get_coarse();
 	m_pNetBase->SendControlMsg(&m_PeerAddr, m_PeerToken, m_Ack, ControlMsg, pExtra, ExtraSize);
+	m_Stats.m_SentPackets++;
+	m_Stats.m_SentBytes += NET_PACKETHEADERSIZE+1+ExtraSize;
 }
 
 void CNetConnection::SendPacketConnless(const char *pData, int DataSize)
@@ -173,20 +202,69 @@ void CNetConnection::SendPacketConnless(const char *pData, int DataSize)
 
 void CNetConnection::SendControlWithToken(int ControlMsg)
 {
-	m_LastSendTime = time_get();
+	m_LastSendTime = time_get_coarse();
 	m_pNetBase->SendControlMsgWithToken(&m_PeerAddr, m_PeerToken, 0, ControlMsg, m_Token, true);
+	m_Stats.m_SentPackets++;
+	m_Stats.m_SentBytes += NET_PACKETHEADERSIZE+1+NET_TOKENREQUEST_DATASIZE;
+}
+
+void CNetConnection::SendAccept()
+{
+	// only peers that offered the table get to know about it
+	unsigned char aChoice[16];
+	if(m_UseHuffmanTable)
+		SendControl(NET_CTRLMSG_ACCEPT, aChoice, CNetBase::PackHuffmanChoice(aChoice, m_pNetBase->HuffmanTableID()));
+	else
+		SendControl(NET_CTRLMSG_ACCEPT, 0, 0);
+}
+
+void CNetConnection::LinkTimeout(CNetChunkResend *pResend)
+{
+	pResend->m_pTimeoutNext = 0;
+	pResend->m_pTimeoutPrev = m_pLastTimeout;
+	if(m_pLastTimeout)
+		m_pLastTimeout->m_pTimeoutNext = pResend;
+	else
+		m_pFirstTimeout = pResend;
+	m_pLastTimeout = pResend;
+}
+
+void CNetConnection::UnlinkTimeout(CNetChunkResend *pResend)
+{
+	if(pResend->m_pTimeoutNext)
+		pResend->m_pTimeoutNext->m_pTimeoutPrev = pResend->m_pTimeoutPrev;
+	else
+		m_pLastTimeout = pResend->m_pTimeoutPrev;
+	if(pResend->m_pTimeoutPrev)
+		pResend->m_pTimeoutPrev->m_pTimeoutNext = pResend->m_pTimeoutNext;
+	else
+		m_pFirstTimeout = pResend->m_pTimeoutNext;
 }
 
 void CNetConnection::ResendChunk(CNetChunkResend *pResend)
 {
 	QueueChunkEx(pResend->m_Flags|NET_CHUNKFLAG_RESEND, pResend->m_DataSize, pResend->m_pData, pResend->m_Sequence);
 	pResend->m_LastSendTime = time_get();
+	m_Stats.m_Resends++;
+
+	// sent last now
+	UnlinkTimeout(pResend);
+	LinkTimeout(pResend);
 }
 
 void CNetConnection::Resend()
 {
-	for(CNetChunkResend *pResend = m_Buffer.First(); pResend; pResend = m_Buffer.Next(pResend))
+	// the peer asks again with every packet until the gap is filled, chunks sent
+	// less than a round trip ago can't have arrived yet and are skipped
+	int64 Threshold = time_get() - max(m_SmoothRtt, (int64)0);
+	CNetChunkResend *pLast = m_pLastTimeout;
+	while(m_pFirstTimeout && m_pFirstTimeout->m_LastSendTime <= Threshold)
+	{
+		CNetChunkResend *pResend = m_pFirstTimeout;
 		ResendChunk(pResend);
+		if(pResend == pLast)
+			break;
+	}
 }
 
 int CNetConnection::Connect(NETADDR *pAddr)
@@ -196,7 +274,7 @@ int CNetConnection::Connect(NETADDR *pAddr)
 
 	// init connection
 	Reset();
-	m_LastRecvTime = time_get();
+	m_LastRecvTime = time_get_coarse();
 	m_PeerAddr = *pAddr;
 	m_PeerToken = NET_TOKEN_NONE;
 	SetToken(GenerateToken(pAddr));
@@ -245,11 +323,14 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr)
 	}
 	m_PeerAck = pPacket->m_Ack;
 
-	int64 Now = time_get();
+	int64 Now = time_get_coarse();
 
 	if(pPacket->m_Token == NET_TOKEN_NONE || pPacket->m_Token != m_Token)
 		return 0;
 
+	m_Stats.m_RecvPackets++;
+	m_Stats.m_RecvBytes += NET_PACKETHEADERSIZE+pPacket->m_DataSize;
+
 	// check if resend is requested
 	if(pPacket->m_Flags&NET_PACKETFLAG_RESEND)
 		Resend();
@@ -260,7 +341,7 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr)
 	//
 	if(pPacket->m_Flags&NET_PACKETFLAG_CONTROL)
 	{
-		int CtrlMsg = pPacket->m_aChunkData[0];
+		int CtrlMsg = pPacket->m_pChunkData[0];
 
 		if(CtrlMsg == NET_CTRLMSG_CLOSE)
 		{
@@ -274,9 +355,9 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr)
 				{
 					// make sure to sanitize the error string form the other party
 					if(pPacket->m_DataSize < 128)
-						str_copy(Str, (char *)&pPacket->m_aChunkData[1], pPacket->m_DataSize);
+						str_copy(Str, (char *)&pPacket->m_pChunkData[1], pPacket->m_DataSize);
 					else
-						str_copy(Str, (char *)&pPacket->m_aChunkData[1], sizeof(Str));
+						str_copy(Str, (char *)&pPacket->m_pChunkData[1], sizeof(Str));
 					str_sanitize_strong(Str);
 				}
 
@@ -324,7 +405,10 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr)
 						m_LastSendTime = Now;
 						m_LastRecvTime = Now;
 						m_LastUpdateTime = Now;
-						SendControl(NET_CTRLMSG_ACCEPT, 0, 0);
+						// the offer follows the token in the padding of the connect message
+						m_UseHuffmanTable = m_pNetBase->HuffmanTableID() && pPacket->m_DataSize > 5 &&
+							CNetBase::HuffmanTableOffered(&pPacket->m_pChunkData[5], pPacket->m_DataSize-5, m_pNetBase->HuffmanTableID());
+						SendAccept();
 						if(Config()->m_Debug)
 							dbg_msg("connection", "got connection, sending accept");
 					}
@@ -334,6 +418,9 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr)
 					// connection made
 					if(CtrlMsg == NET_CTRLMSG_ACCEPT)
 					{
+						// an old server sends no table, nor does one that doesn't share ours
+						unsigned TableID = CNetBase::UnpackHuffmanChoice(&pPacket->m_pChunkData[1], pPacket->m_DataSize-1);
+						m_UseHuffmanTable = TableID && m_pNetBase->UseHuffmanTable(TableID);
 						m_LastRecvTime = Now;
 						m_State = NET_CONNSTATE_ONLINE;
 						if(Config()->m_Debug)
@@ -365,7 +452,7 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr)
 
 int CNetConnection::Update()
 {
-	int64 Now = time_get();
+	int64 Now = time_get_coarse();
 
 	if(State() == NET_CONNSTATE_OFFLINE || State() == NET_CONNSTATE_ERROR)
 		return 0;
@@ -387,10 +474,8 @@ int CNetConnection::Update()
 	// fix resends
 	if(m_Buffer.First())
 	{
-		CNetChunkResend *pResend = m_Buffer.First();
-
 		// check if we have some really old stuff laying around and abort if not acked
-		if(Now-pResend->m_FirstSendTime > time_freq()*10)
+		if(Now-m_Buffer.First()->m_FirstSendTime > time_freq()*10)
 		{
 			m_State = NET_CONNSTATE_ERROR;
 			SetError("Too weak connection (not acked for 10 seconds)");
@@ -398,38 +483,38 @@ int CNetConnection::Update()
 		else
 		{
 			// resend packet if we haven't got it acked in 1 second
-			if(Now-pResend->m_LastSendTime > time_freq())
-				ResendChunk(pResend);
+			if(Now-m_pFirstTimeout->m_LastSendTime > time_freq())
+				ResendChunk(m_pFirstTimeout);
 		}
 	}
 
 	// send keep alives if nothing has happend for 250ms
 	if(State() == NET_CONNSTATE_ONLINE)
 	{
-		if(time_get()-m_LastSendTime > time_freq()/2) // flush connection after 500ms if needed
+		if(Now-m_LastSendTime > time_freq()/2) // flush connection after 500ms if needed
 		{
 			int NumFlushedChunks = Flush();
 			if(NumFlushedChunks && Config()->m_Debug)
 				dbg_msg("connection", "flushed connection due to timeout. %d chunks.", NumFlushedChunks);
 		}
 
-		if(time_get()-m_LastSendTime > time_freq())
+		if(Now-m_LastSendTime > time_freq())
 			SendControl(NET_CTRLMSG_KEEPALIVE, 0, 0);
 	}
 	else if(State() == NET_CONNSTATE_TOKEN)
 	{
-		if(time_get()-m_LastSendTime > time_freq()/2) // send a new token request every 500ms
+		if(Now-m_LastSendTime > time_freq()/2) // send a new token request every 500ms
 			SendControlWithToken(NET_CTRLMSG_TOKEN);
 	}
 	else if(State() == NET_CONNSTATE_CONNECT)
 	{
-		if(time_get()-m_LastSendTime > time_freq()/2) // send a new connect every 500ms
+		if(Now-m_LastSendTime > time_freq()/2) // send a new connect every 500ms
 			SendControlWithToken(NET_CTRLMSG_CONNECT);
 	}
 	else if(State() == NET_CONNSTATE_PENDING)
 	{
-		if(time_get()-m_LastSendTime > time_freq()/2) // send a new connect/accept every 500ms
-			SendControl(NET_CTRLMSG_ACCEPT, 0, 0);
+		if(Now-m_LastSendTime > time_freq()/2) // send a new connect/accept every 500ms
+			SendAccept();
 	}
 
 	return 0;
@@ -16,6 +16,8 @@ bool CNetConsole::Open(NETADDR BindAddr, CNetBan *pNetBan, NETFUNC_NEWCLIENT pfn
 	m_Socket.ipv4sock = -1;
 	m_Socket.ipv6sock = -1;
 	m_pNetBan = pNetBan;
+	m_SendBacklog = 64*1024;
+	m_OverflowPolicy = CConsoleNetConnection::OVERFLOW_DROP_LINES;
 
 	// open socket
 	m_Socket = net_tcp_create(BindAddr);
@@ -77,7 +79,7 @@ int CNetConsole::AcceptClient(NETSOCKET Socket, const NETADDR *pAddr)
 	// accept client
 	if(!aError[0] && FreeSlot != -1)
 	{
-		m_aSlots[FreeSlot].m_Connection.Init(Socket, pAddr);
+		m_aSlots[FreeSlot].m_Connection.Init(Socket, pAddr, m_SendBacklog, m_OverflowPolicy);
 		if(m_pfnNewClient)
 			m_pfnNewClient(FreeSlot, m_UserPtr);
 		return 0;
@@ -150,6 +152,25 @@ int CNetConsole::Send(int ClientID, const char *pLine)
 		return -1;
 }
 
+void CNetConsole::Flush()
+{
+	for(int i = 0; i < NET_MAX_CONSOLE_CLIENTS; i++)
+	{
+		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ONLINE)
+			m_aSlots[i].m_Connection.Flush();
+		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR)
+			Drop(i, m_aSlots[i].m_Connection.ErrorString());
+	}
+}
+
+void CNetConsole::SetBacklog(int Backlog, int OverflowPolicy)
+{
+	m_SendBacklog = Backlog;
+	m_OverflowPolicy = OverflowPolicy;
+	for(int i = 0; i < NET_MAX_CONSOLE_CLIENTS; i++)
+		m_aSlots[i].m_Connection.SetBacklog(Backlog, OverflowPolicy);
+}
+
 void CNetConsole::SetLingerState(int State)
 {
 	net_tcp_set_linger(m_Socket, State);
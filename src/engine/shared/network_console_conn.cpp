@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include "network.h"
 
@@ -15,6 +16,13 @@ void CConsoleNetConnection::Reset()
 	m_aBuffer[0] = 0;
 	m_BufferOffset = 0;
 
+	if(m_pSendBuffer)
+		mem_free(m_pSendBuffer);
+	m_pSendBuffer = 0;
+	m_SendBufferSize = 0;
+	m_SendBufferLength = 0;
+	m_DroppedLines = 0;
+
 	m_LineEndingDetected = false;
 	#if defined(CONF_FAMILY_WINDOWS)
 		m_aLineEnding[0] = '\r';
@@ -27,9 +35,10 @@ void CConsoleNetConnection::Reset()
 	#endif
 }
 
-void CConsoleNetConnection::Init(NETSOCKET Socket, const NETADDR *pAddr)
+void CConsoleNetConnection::Init(NETSOCKET Socket, const NETADDR *pAddr, int Backlog, int OverflowPolicy)
 {
 	Reset();
+	SetBacklog(Backlog, OverflowPolicy);
 
 	m_Socket = Socket;
 	net_set_non_blocking(m_Socket);
@@ -45,6 +54,8 @@ void CConsoleNetConnection::Disconnect(const char *pReason)
 
 	if(pReason && pReason[0])
 		Send(pReason);
+	if(State() == NET_CONNSTATE_ONLINE)
+		Flush();
 
 	net_tcp_close(m_Socket);
 
@@ -151,6 +162,27 @@ int CConsoleNetConnection::Recv(char *pLine, int MaxLength)
 	return 0;
 }
 
+void CConsoleNetConnection::Append(const char *pData, int Length)
+{
+	if(m_SendBufferLength+Length > m_SendBufferSize)
+	{
+		int NewSize = max(m_SendBufferSize*2, 4096);
+		while(NewSize < m_SendBufferLength+Length)
+			NewSize *= 2;
+		NewSize = min(NewSize, max(m_SendBacklog, m_SendBufferLength+Length));
+		char *pNewBuffer = (char *)mem_alloc_tag(NewSize, 1, MEMTAG_NETWORK);
+		if(m_pSendBuffer)
+		{
+			mem_copy(pNewBuffer, m_pSendBuffer, m_SendBufferLength);
+			mem_free(m_pSendBuffer);
+		}
+		m_pSendBuffer = pNewBuffer;
+		m_SendBufferSize = NewSize;
+	}
+	mem_copy(m_pSendBuffer+m_SendBufferLength, pData, Length);
+	m_SendBufferLength += Length;
+}
+
 int CConsoleNetConnection::Send(const char *pLine)
 {
 	if(State() != NET_CONNSTATE_ONLINE)
@@ -159,28 +191,63 @@ int CConsoleNetConnection::Send(const char *pLine)
 	char aBuf[1024];
 	str_copy(aBuf, pLine, (int)(sizeof(aBuf))-2);
 	int Length = str_length(aBuf);
-	aBuf[Length] = m_aLineEnding[0];
-	aBuf[Length+1] = m_aLineEnding[1];
-	aBuf[Length+2] = m_aLineEnding[2];
-	Length += 3;
-	const char *pData = aBuf;
+	int EndingLength = str_length(m_aLineEnding);
+	mem_copy(aBuf+Length, m_aLineEnding, EndingLength);
+	Length += EndingLength;
+
+	// the client does not keep up with the output
+	char aDropped[64];
+	int DroppedLength = 0;
+	if(m_DroppedLines)
+	{
+		str_format(aDropped, sizeof(aDropped), "[%d lines dropped]%s", m_DroppedLines, m_aLineEnding);
+		DroppedLength = str_length(aDropped);
+	}
+	if(m_SendBufferLength+DroppedLength+Length > m_SendBacklog)
+	{
+		if(m_OverflowPolicy == OVERFLOW_DISCONNECT)
+		{
+			m_State = NET_CONNSTATE_ERROR;
+			str_copy(m_aErrorString, "too slow to receive the output", sizeof(m_aErrorString));
+			return -1;
+		}
+		m_DroppedLines++;
+		return 0;
+	}
 
-	while(true)
+	if(DroppedLength)
 	{
-		int Send = net_tcp_send(m_Socket, pData, Length);
-		if(Send < 0)
+		Append(aDropped, DroppedLength);
+		m_DroppedLines = 0;
+	}
+	Append(aBuf, Length);
+	return 0;
+}
+
+int CConsoleNetConnection::Flush()
+{
+	if(State() != NET_CONNSTATE_ONLINE || !m_SendBufferLength)
+		return 0;
+
+	int Sent = 0;
+	while(Sent < m_SendBufferLength)
+	{
+		int Bytes = net_tcp_send(m_Socket, m_pSendBuffer+Sent, m_SendBufferLength-Sent);
+		if(Bytes < 0)
 		{
+			if(net_would_block())
+				break;
 			m_State = NET_CONNSTATE_ERROR;
 			str_copy(m_aErrorString, "failed to send packet", sizeof(m_aErrorString));
 			return -1;
 		}
-
-		if(Send >= Length)
+		if(Bytes == 0)
 			break;
-
-		pData += Send;
-		Length -= Send;
+		Sent += Bytes;
 	}
 
-	return 0;
+	m_SendBufferLength -= Sent;
+	if(m_SendBufferLength)
+		mem_move(m_pSendBuffer, m_pSendBuffer+Sent, m_SendBufferLength);
+	return Sent;
 }
@@ -0,0 +1,95 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include "network.h"
+
+static unsigned AddrHash(const NETADDR *pAddr)
+{
+	// the port is left out, one host gets one bucket
+	int Size = pAddr->type == NETTYPE_IPV4 ? 4 : 16;
+	unsigned Hash = 2166136261u;
+	for(int i = 0; i < Size; i++)
+		Hash = (Hash^pAddr->ip[i])*16777619u;
+	return Hash;
+}
+
+void CNetConnlessLimiter::Init()
+{
+	mem_zero(m_aSources, sizeof(m_aSources));
+	m_GlobalNextTime = 0;
+	m_SourceRate = 0;
+	m_SourceBurst = 1;
+	m_GlobalRate = 0;
+	m_GlobalBurst = 1;
+	m_NumAccepted = 0;
+	m_NumDroppedSource = 0;
+	m_NumDroppedGlobal = 0;
+}
+
+void CNetConnlessLimiter::SetLimits(int SourceRate, int SourceBurst, int GlobalRate, int GlobalBurst)
+{
+	m_SourceRate = SourceRate;
+	m_SourceBurst = max(SourceBurst, 1);
+	m_GlobalRate = GlobalRate;
+	m_GlobalBurst = max(GlobalBurst, 1);
+}
+
+bool CNetConnlessLimiter::Conform(int64 NextTime, int64 Now, int Rate, int Burst, int64 *pNewNextTime)
+{
+	// a full bucket lies in the past, every packet pushes it one interval into the future
+	int64 Interval = time_freq()/Rate;
+	if(NextTime-Now > Interval*(Burst-1))
+		return false;
+	*pNewNextTime = max(NextTime, Now)+Interval;
+	return true;
+}
+
+bool CNetConnlessLimiter::Allow(const NETADDR *pAddr, int64 Now)
+{
+	CSource *pSource = 0;
+	int64 SourceNextTime = 0;
+	if(m_SourceRate)
+	{
+		CSource *pSet = &m_aSources[(AddrHash(pAddr)%NUM_SETS)*SET_SIZE];
+		for(int i = 0; i < SET_SIZE; i++)
+		{
+			if(pSet[i].m_NextTime && net_addr_comp(&pSet[i].m_Addr, pAddr, false) == 0)
+			{
+				pSource = &pSet[i];
+				break;
+			}
+		}
+		if(!pSource)
+		{
+			// take over the source that waited longest, its bucket is the fullest
+			pSource = &pSet[0];
+			for(int i = 1; i < SET_SIZE; i++)
+				if(pSet[i].m_NextTime < pSource->m_NextTime)
+					pSource = &pSet[i];
+			pSource->m_Addr = *pAddr;
+			pSource->m_NextTime = 0;
+		}
+
+		if(!Conform(pSource->m_NextTime, Now, m_SourceRate, m_SourceBurst, &SourceNextTime))
+		{
+			m_NumDroppedSource++;
+			return false;
+		}
+	}
+
+	int64 GlobalNextTime = 0;
+	if(m_GlobalRate && !Conform(m_GlobalNextTime, Now, m_GlobalRate, m_GlobalBurst, &GlobalNextTime))
+	{
+		m_NumDroppedGlobal++;
+		return false;
+	}
+
+	if(pSource)
+		pSource->m_NextTime = SourceNextTime;
+	if(m_GlobalRate)
+		m_GlobalNextTime = GlobalNextTime;
+	m_NumAccepted++;
+	return true;
+}
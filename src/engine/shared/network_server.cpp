@@ -5,8 +5,11 @@
 
 #include <engine/console.h>
 
+#include "config.h"
 #include "netban.h"
 #include "network.h"
+#include "threadtopology.h"
+#include "tracer.h"
 
 
 bool CNetServer::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine, CNetBan *pNetBan,
@@ -15,17 +18,34 @@ bool CNetServer::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IE
 	// zero out the whole structure
 	mem_zero(this, sizeof(*this));
 
-	// open socket
-	NETSOCKET Socket = net_udp_create(BindAddr, 0);
+	// open socket, it joins a group sharing the port if there are going to be shards
+	int NumSockets = BindAddr.port ? pConfig->m_SvNetSockets : 1;
+	NETSOCKET Socket = NumSockets > 1 ? net_udp_create_reuseport(BindAddr) : net_udp_create(BindAddr, 0);
+	if(!Socket.type && NumSockets > 1)
+	{
+		dbg_msg("netserver", "couldn't share the port, using a single socket");
+		NumSockets = 1;
+		Socket = net_udp_create(BindAddr, 0);
+	}
 	if(!Socket.type)
 		return false;
 
+	// the kernel fills shared buffers, reading them takes no syscalls
+	if(pConfig->m_SvNetIoUring && net_udp_uring_enable(Socket) == 0)
+		dbg_msg("netserver", "receiving through io_uring");
+
 	// init
 	m_pNetBan = pNetBan;
 	Init(Socket, pConfig, pConsole, pEngine);
 
+	// the shards have to exist before any client connects, the kernel maps
+	// peers to sockets by the number of sockets in the group
+	if(NumSockets > 1 && !OpenRecvShards(BindAddr, NumSockets-1))
+		dbg_msg("netserver", "couldn't open all sockets, using %d", NumRecvShards()+1);
+
 	m_TokenManager.Init(this);
 	m_TokenCache.Init(this, &m_TokenManager);
+	m_ConnlessLimiter.Init();
 
 	m_NumClients = 0;
 	SetMaxClients(MaxClients);
@@ -41,8 +61,16 @@ bool CNetServer::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IE
 	return true;
 }
 
+void CNetServer::StartCapture(CNetCaptureWriter *pCapture)
+{
+	SetCapture(pCapture);
+	m_TokenManager.GenerateSeed();
+}
+
 void CNetServer::Close()
 {
+	StopThread();
+
 	for(int i = 0; i < NET_MAX_CLIENTS; i++)
 		Drop(i, "Server shutdown");
 
@@ -50,18 +78,87 @@ void CNetServer::Close()
 }
 
 void CNetServer::Drop(int ClientID, const char *pReason)
+{
+	if(!Threaded())
+	{
+		DropImpl(ClientID, pReason);
+		return;
+	}
+
+	if(ClientID < 0 || ClientID >= NET_MAX_CLIENTS || !m_aTickGeneration[ClientID])
+		return;
+
+	CThreadEntry *pEntry = BeginPush(m_pOutQueue);
+	pEntry->m_Type = CThreadEntry::TYPE_DROP;
+	pEntry->m_ClientID = ClientID;
+	pEntry->m_Generation = m_aTickGeneration[ClientID];
+	str_copy((char *)pEntry->m_aData, pReason ? pReason : "", sizeof(pEntry->m_aData));
+	m_pOutQueue->end_push();
+
+	// ignore everything that is still queued for this client, the
+	// disconnect callback follows once the network thread handled the drop
+	m_aTickGeneration[ClientID] = 0;
+}
+
+void CNetServer::DropImpl(int ClientID, const char *pReason)
 {
 	if(ClientID < 0 || ClientID >= NET_MAX_CLIENTS || m_aSlots[ClientID].m_Connection.State() == NET_CONNSTATE_OFFLINE)
 		return;
 
-	if(m_pfnDelClient)
-		m_pfnDelClient(ClientID, pReason, m_UserPtr);
+	OnDelClient(ClientID, pReason);
 
 	m_aSlots[ClientID].m_Connection.Disconnect(pReason);
 	m_NumClients--;
 }
 
+void CNetServer::OnNewClient(int ClientID)
+{
+	m_LastGeneration++;
+	if(m_LastGeneration <= 0)
+		m_LastGeneration = 1;
+	m_aSlots[ClientID].m_Generation = m_LastGeneration;
+
+	if(!Threaded())
+	{
+		if(m_pfnNewClient)
+			m_pfnNewClient(ClientID, m_UserPtr);
+		return;
+	}
+
+	CThreadEntry *pEntry = BeginPush(m_pInQueue);
+	pEntry->m_Type = CThreadEntry::TYPE_NEWCLIENT;
+	pEntry->m_ClientID = ClientID;
+	pEntry->m_Generation = m_aSlots[ClientID].m_Generation;
+	pEntry->m_Address = *m_aSlots[ClientID].m_Connection.PeerAddress();
+	m_pInQueue->end_push();
+}
+
+void CNetServer::OnDelClient(int ClientID, const char *pReason)
+{
+	if(!Threaded())
+	{
+		if(m_pfnDelClient)
+			m_pfnDelClient(ClientID, pReason, m_UserPtr);
+		return;
+	}
+
+	CThreadEntry *pEntry = BeginPush(m_pInQueue);
+	pEntry->m_Type = CThreadEntry::TYPE_DELCLIENT;
+	pEntry->m_ClientID = ClientID;
+	pEntry->m_Generation = m_aSlots[ClientID].m_Generation;
+	str_copy((char *)pEntry->m_aData, pReason ? pReason : "", sizeof(pEntry->m_aData));
+	m_pInQueue->end_push();
+}
+
 int CNetServer::Update()
+{
+	// the network thread takes care of timeouts and resends
+	if(Threaded())
+		return 0;
+	return UpdateImpl();
+}
+
+int CNetServer::UpdateImpl()
 {
 	int64 Now = time_get();
 	for(int i = 0; i < NET_MAX_CLIENTS; i++)
@@ -74,24 +171,119 @@ int CNetServer::Update()
 		{
 			if(Now - m_aSlots[i].m_Connection.ConnectTime() < time_freq() && NetBan())
 			{
-				if(NetBan()->BanAddr(ClientAddr(i), 60, "Stressing network") == -1)
-					Drop(i, m_aSlots[i].m_Connection.ErrorString());
+				if(Threaded())
+				{
+					// banning drops clients through the server, leave that to the tick thread
+					CThreadEntry *pEntry = BeginPush(m_pInQueue);
+					pEntry->m_Type = CThreadEntry::TYPE_BAN;
+					pEntry->m_Address = *m_aSlots[i].m_Connection.PeerAddress();
+					m_pInQueue->end_push();
+					DropImpl(i, m_aSlots[i].m_Connection.ErrorString());
+				}
+				else if(NetBan()->BanAddr(ClientAddr(i), 60, "Stressing network") == -1)
+					DropImpl(i, m_aSlots[i].m_Connection.ErrorString());
 			}
 			else
-				Drop(i, m_aSlots[i].m_Connection.ErrorString());
+				DropImpl(i, m_aSlots[i].m_Connection.ErrorString());
 		}
 	}
 
 	m_TokenManager.Update();
 	m_TokenCache.Update();
+	m_ConnlessLimiter.SetLimits(Config()->m_SvConnlessRate, Config()->m_SvConnlessBurst, Config()->m_SvConnlessGlobalRate, Config()->m_SvConnlessGlobalBurst);
 
 	return 0;
 }
 
+void CNetServer::AddToken(const NETADDR *pAddr, TOKEN Token)
+{
+	if(!Threaded())
+	{
+		m_TokenCache.AddToken(pAddr, Token, 0);
+		return;
+	}
+
+	CThreadEntry *pEntry = BeginPush(m_pOutQueue);
+	pEntry->m_Type = CThreadEntry::TYPE_ADDTOKEN;
+	pEntry->m_Address = *pAddr;
+	pEntry->m_Token = Token;
+	m_pOutQueue->end_push();
+}
+
+int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
+{
+	if(!Threaded())
+	{
+		int Result = RecvImpl(pChunk, pResponseToken);
+		if(Result && pChunk->m_Flags&NETSENDFLAG_CONNLESS)
+			m_NumConnlessRecv++;
+		return Result;
+	}
+
+	while(1)
+	{
+		// the previously returned chunk points into the queue, release it now
+		if(m_InEntryPending)
+		{
+			m_pInQueue->pop();
+			m_InEntryPending = false;
+		}
+
+		CThreadEntry *pEntry = m_pInQueue->front();
+		if(!pEntry)
+			return 0;
+
+		switch(pEntry->m_Type)
+		{
+		case CThreadEntry::TYPE_CHUNK:
+			// skip data of clients that were dropped in the meantime
+			if(pEntry->m_ClientID >= 0 && pEntry->m_Generation != m_aTickGeneration[pEntry->m_ClientID])
+				break;
+
+			pChunk->m_ClientID = pEntry->m_ClientID;
+			pChunk->m_Address = pEntry->m_Address;
+			pChunk->m_Flags = pEntry->m_Flags;
+			pChunk->m_DataSize = pEntry->m_DataSize;
+			pChunk->m_pData = pEntry->m_aData;
+			if(pResponseToken)
+				*pResponseToken = pEntry->m_Token;
+			if(pChunk->m_Flags&NETSENDFLAG_CONNLESS)
+				m_NumConnlessRecv++;
+			m_InEntryPending = true;
+			return 1;
+		case CThreadEntry::TYPE_NEWCLIENT:
+			m_aTickGeneration[pEntry->m_ClientID] = pEntry->m_Generation;
+			m_aTickAddr[pEntry->m_ClientID] = pEntry->m_Address;
+			mem_zero(&m_aTickStats[pEntry->m_ClientID], sizeof(m_aTickStats[pEntry->m_ClientID]));
+			m_LastTickGeneration = pEntry->m_Generation;
+			if(m_pfnNewClient)
+				m_pfnNewClient(pEntry->m_ClientID, m_UserPtr);
+			break;
+		case CThreadEntry::TYPE_DELCLIENT:
+			// a drop requested by the tick thread already invalidated the generation
+			if(m_aTickGeneration[pEntry->m_ClientID] == pEntry->m_Generation)
+				m_aTickGeneration[pEntry->m_ClientID] = 0;
+			if(m_pfnDelClient)
+				m_pfnDelClient(pEntry->m_ClientID, (const char *)pEntry->m_aData, m_UserPtr);
+			break;
+		case CThreadEntry::TYPE_BAN:
+			if(NetBan())
+				NetBan()->BanAddr(&pEntry->m_Address, 60, "Stressing network");
+			break;
+		case CThreadEntry::TYPE_STATS:
+			if(pEntry->m_Generation == m_aTickGeneration[pEntry->m_ClientID])
+				mem_copy(&m_aTickStats[pEntry->m_ClientID], pEntry->m_aData, sizeof(CNetConnStats));
+			break;
+		}
+
+		m_pInQueue->pop();
+	}
+}
+
 /*
 	TODO: chopp up this function into smaller working parts
 */
-int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
+int CNetServer::RecvImpl(CNetChunk *pChunk, TOKEN *pResponseToken)
 {
 	while(1)
 	{
@@ -143,7 +335,7 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 								pChunk->m_Address = *m_aSlots[i].m_Connection.PeerAddress();
 								pChunk->m_ClientID = i;
 								pChunk->m_DataSize = m_RecvUnpacker.m_Data.m_DataSize;
-								pChunk->m_pData = m_RecvUnpacker.m_Data.m_aChunkData;
+								pChunk->m_pData = m_RecvUnpacker.m_Data.m_pChunkData;
 								if(pResponseToken)
 									*pResponseToken = NET_TOKEN_NONE;
 								return 1;
@@ -157,13 +349,17 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 			if(Found)
 				continue;
 
+			// drop floods before the token checks and the game see them
+			if(!m_ConnlessLimiter.Allow(&Addr, time_get()))
+				continue;
+
 			int Accept = m_TokenManager.ProcessMessage(&Addr, &m_RecvUnpacker.m_Data);
 			if(Accept <= 0)
 				continue;
 
 			if(m_RecvUnpacker.m_Data.m_Flags&NET_PACKETFLAG_CONTROL)
 			{
-				if(m_RecvUnpacker.m_Data.m_aChunkData[0] == NET_CTRLMSG_CONNECT)
+				if(m_RecvUnpacker.m_Data.m_pChunkData[0] == NET_CTRLMSG_CONNECT)
 				{
 					// check if there are free slots
 					if(m_NumClients >= m_MaxClients)
@@ -205,13 +401,12 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 							m_NumClients++;
 							m_aSlots[i].m_Connection.SetToken(m_RecvUnpacker.m_Data.m_Token);
 							m_aSlots[i].m_Connection.Feed(&m_RecvUnpacker.m_Data, &Addr);
-							if(m_pfnNewClient)
-								m_pfnNewClient(i, m_UserPtr);
+							OnNewClient(i);
 							break;
 						}
 					}
 				}
-				else if(m_RecvUnpacker.m_Data.m_aChunkData[0] == NET_CTRLMSG_TOKEN)
+				else if(m_RecvUnpacker.m_Data.m_pChunkData[0] == NET_CTRLMSG_TOKEN)
 					m_TokenCache.AddToken(&Addr, m_RecvUnpacker.m_Data.m_ResponseToken, NET_TOKENFLAG_RESPONSEONLY);
 			}
 			else if(m_RecvUnpacker.m_Data.m_Flags&NET_PACKETFLAG_CONNLESS)
@@ -220,7 +415,7 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 				pChunk->m_ClientID = -1;
 				pChunk->m_Address = Addr;
 				pChunk->m_DataSize = m_RecvUnpacker.m_Data.m_DataSize;
-				pChunk->m_pData = m_RecvUnpacker.m_Data.m_aChunkData;
+				pChunk->m_pData = m_RecvUnpacker.m_Data.m_pChunkData;
 				if(pResponseToken)
 					*pResponseToken = m_RecvUnpacker.m_Data.m_ResponseToken;
 				return 1;
@@ -231,6 +426,97 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 }
 
 int CNetServer::Send(CNetChunk *pChunk, TOKEN Token)
+{
+	if(pChunk->m_Flags&NETSENDFLAG_CONNLESS)
+		m_NumConnlessSent++;
+	if(!Threaded())
+		return SendImpl(pChunk, Token);
+
+	if(pChunk->m_Flags&NETSENDFLAG_CONNLESS)
+	{
+		if(pChunk->m_DataSize >= NET_MAX_PAYLOAD)
+		{
+			dbg_msg("netserver", "packet payload too big. %d. dropping packet", pChunk->m_DataSize);
+			return -1;
+		}
+	}
+	else
+	{
+		if(pChunk->m_DataSize+NET_MAX_CHUNKHEADERSIZE >= NET_MAX_PAYLOAD)
+		{
+			dbg_msg("netclient", "chunk payload too big. %d. dropping chunk", pChunk->m_DataSize);
+			return -1;
+		}
+	}
+
+	int Generation = 0;
+	if(pChunk->m_ClientID >= 0)
+	{
+		dbg_assert(pChunk->m_ClientID < NET_MAX_CLIENTS, "errornous client id");
+		// the client is gone already, nothing to send
+		Generation = m_aTickGeneration[pChunk->m_ClientID];
+		if(!Generation)
+			return 0;
+	}
+
+	CThreadEntry *pEntry = BeginPush(m_pOutQueue);
+	pEntry->m_Type = CThreadEntry::TYPE_SEND;
+	pEntry->m_ClientID = pChunk->m_ClientID;
+	pEntry->m_Generation = Generation;
+	pEntry->m_Token = Token;
+	pEntry->m_Address = pChunk->m_Address;
+	pEntry->m_Flags = pChunk->m_Flags;
+	pEntry->m_DataSize = pChunk->m_DataSize;
+	mem_copy(pEntry->m_aData, pChunk->m_pData, pChunk->m_DataSize);
+	m_pOutQueue->end_push();
+	return 0;
+}
+
+int CNetServer::SendMask(CNetChunk *pChunk, const CClientMask &Receivers)
+{
+	if(!Threaded())
+	{
+		CNetChunk Chunk = *pChunk;
+		for(int i = Receivers.first(); i >= 0; i = Receivers.next(i))
+		{
+			if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE)
+				continue;
+			Chunk.m_ClientID = i;
+			SendImpl(&Chunk, NET_TOKEN_NONE);
+		}
+		return 0;
+	}
+
+	if(pChunk->m_DataSize+NET_MAX_CHUNKHEADERSIZE >= NET_MAX_PAYLOAD)
+	{
+		dbg_msg("netclient", "chunk payload too big. %d. dropping chunk", pChunk->m_DataSize);
+		return -1;
+	}
+
+	// leave out the clients that are gone already
+	CClientMask ClientMask = Receivers;
+	for(int i = ClientMask.first(); i >= 0; i = ClientMask.next(i))
+		if(!m_aTickGeneration[i])
+			ClientMask.reset(i);
+	if(ClientMask.empty())
+		return 0;
+
+	// one entry for all receivers. a slot that got a new connection since
+	// has a higher generation than the ones the tick thread knew about
+	CThreadEntry *pEntry = BeginPush(m_pOutQueue);
+	pEntry->m_Type = CThreadEntry::TYPE_SEND_MASK;
+	pEntry->m_ClientID = -1;
+	pEntry->m_Generation = m_LastTickGeneration;
+	pEntry->m_ClientMask = ClientMask;
+	pEntry->m_Token = NET_TOKEN_NONE;
+	pEntry->m_Flags = pChunk->m_Flags;
+	pEntry->m_DataSize = pChunk->m_DataSize;
+	mem_copy(pEntry->m_aData, pChunk->m_pData, pChunk->m_DataSize);
+	m_pOutQueue->end_push();
+	return 0;
+}
+
+int CNetServer::SendImpl(CNetChunk *pChunk, TOKEN Token)
 {
 	if(pChunk->m_Flags&NETSENDFLAG_CONNLESS)
 	{
@@ -299,12 +585,38 @@ int CNetServer::Send(CNetChunk *pChunk, TOKEN Token)
 		}
 		else
 		{
-			Drop(pChunk->m_ClientID, "Error sending data");
+			DropImpl(pChunk->m_ClientID, "Error sending data");
 		}
 	}
 	return 0;
 }
 
+void CNetServer::Flush()
+{
+	if(!Threaded())
+	{
+		FlushImpl();
+		return;
+	}
+
+	CThreadEntry *pEntry = BeginPush(m_pOutQueue);
+	pEntry->m_Type = CThreadEntry::TYPE_FLUSH;
+	pEntry->m_ClientID = -1;
+	pEntry->m_Generation = 0;
+	pEntry->m_DataSize = 0;
+	m_pOutQueue->end_push();
+}
+
+void CNetServer::FlushImpl()
+{
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE)
+			m_aSlots[i].m_Connection.Flush();
+	}
+	FlushSendBatch();
+}
+
 void CNetServer::SetMaxClients(int MaxClients)
 {
 	m_MaxClients = clamp(MaxClients, 1, int(NET_MAX_CLIENTS));
@@ -314,3 +626,215 @@ void CNetServer::SetMaxClientsPerIP(int MaxClientsPerIP)
 {
 	m_MaxClientsPerIP = clamp(MaxClientsPerIP, 1, int(NET_MAX_CLIENTS));
 }
+
+void CNetServer::Wait(int Time)
+{
+	WaitUntil(time_get() + Time*time_freq()/1000);
+}
+
+bool CNetServer::WaitUntil(int64 Deadline)
+{
+	if(!Threaded())
+		return CNetBase::WaitUntil(Deadline);
+
+	// the network thread owns the socket, wait for it to hand over data instead
+	while(m_pInQueue->empty())
+	{
+		int64 Left = Deadline-time_get();
+		if(Left <= 0)
+			return false;
+		if(Left >= time_freq()/1000)
+			thread_sleep(1);
+		else
+			thread_yield();
+	}
+	return true;
+}
+
+bool CNetServer::StartThread()
+{
+	if(Threaded())
+		return true;
+
+	m_pInQueue = new CThreadQueue;
+	m_pOutQueue = new CThreadQueue;
+	m_InEntryPending = false;
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		m_aTickAddr[i] = *m_aSlots[i].m_Connection.PeerAddress();
+		m_aTickStats[i] = *m_aSlots[i].m_Connection.Stats();
+		m_aTickGeneration[i] = m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE ? 0 : m_aSlots[i].m_Generation;
+	}
+	m_LastTickGeneration = m_LastGeneration;
+	m_LastStatsPush = time_get();
+
+	m_ThreadRunning = true;
+	m_pThread = thread_init(NetThread, this);
+	if(!m_pThread)
+	{
+		m_ThreadRunning = false;
+		delete m_pInQueue;
+		delete m_pOutQueue;
+		m_pInQueue = 0;
+		m_pOutQueue = 0;
+		return false;
+	}
+	return true;
+}
+
+void CNetServer::StopThread()
+{
+	if(!Threaded())
+		return;
+
+	m_ThreadRunning = false;
+	thread_wait(m_pThread);
+
+	// deliver outstanding connection events, incoming data is discarded
+	CNetChunk Chunk;
+	while(Recv(&Chunk, 0))
+		;
+	m_pThread = 0;
+
+	// the tick thread owns the socket again, send what is left
+	ProcessOutQueue();
+	FlushSendBatch();
+
+	delete m_pInQueue;
+	delete m_pOutQueue;
+	m_pInQueue = 0;
+	m_pOutQueue = 0;
+}
+
+CNetServer::CThreadEntry *CNetServer::BeginPush(CThreadQueue *pQueue)
+{
+	// the queues are bounded, block the producer until the other side catches up
+	CThreadEntry *pEntry;
+	while(!(pEntry = pQueue->begin_push()))
+		thread_yield();
+	return pEntry;
+}
+
+void CNetServer::ProcessOutQueue()
+{
+	while(CThreadEntry *pEntry = m_pOutQueue->front())
+	{
+		// skip entries that were meant for a previous client in the slot
+		bool Valid = pEntry->m_ClientID < 0 || (m_aSlots[pEntry->m_ClientID].m_Generation == pEntry->m_Generation &&
+			m_aSlots[pEntry->m_ClientID].m_Connection.State() != NET_CONNSTATE_OFFLINE);
+
+		switch(pEntry->m_Type)
+		{
+		case CThreadEntry::TYPE_SEND:
+			if(Valid)
+			{
+				CNetChunk Chunk;
+				Chunk.m_ClientID = pEntry->m_ClientID;
+				Chunk.m_Address = pEntry->m_Address;
+				Chunk.m_Flags = pEntry->m_Flags;
+				Chunk.m_DataSize = pEntry->m_DataSize;
+				Chunk.m_pData = pEntry->m_aData;
+				SendImpl(&Chunk, pEntry->m_Token);
+			}
+			break;
+		case CThreadEntry::TYPE_SEND_MASK:
+			{
+				CNetChunk Chunk;
+				mem_zero(&Chunk, sizeof(Chunk));
+				Chunk.m_Flags = pEntry->m_Flags;
+				Chunk.m_DataSize = pEntry->m_DataSize;
+				Chunk.m_pData = pEntry->m_aData;
+				for(int i = pEntry->m_ClientMask.first(); i >= 0; i = pEntry->m_ClientMask.next(i))
+				{
+					if(m_aSlots[i].m_Generation > pEntry->m_Generation ||
+						m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE)
+						continue;
+					Chunk.m_ClientID = i;
+					SendImpl(&Chunk, NET_TOKEN_NONE);
+				}
+			}
+			break;
+		case CThreadEntry::TYPE_DROP:
+			if(Valid)
+				DropImpl(pEntry->m_ClientID, (const char *)pEntry->m_aData);
+			break;
+		case CThreadEntry::TYPE_ADDTOKEN:
+			m_TokenCache.AddToken(&pEntry->m_Address, pEntry->m_Token, 0);
+			break;
+		case CThreadEntry::TYPE_FLUSH:
+			FlushImpl();
+			break;
+		}
+
+		m_pOutQueue->pop();
+	}
+}
+
+void CNetServer::PushStats()
+{
+	// the counters change with every packet, the tick thread only reads copies of them
+	int64 Now = time_get();
+	if(Now-m_LastStatsPush < time_freq()*NET_THREAD_STATS_INTERVAL/1000)
+		return;
+	m_LastStatsPush = Now;
+
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE)
+			continue;
+		// they can wait for the next round, the reserve is for connection events
+		if(m_pInQueue->size()+NET_THREAD_QUEUE_RESERVE >= m_pInQueue->capacity())
+			break;
+
+		CThreadEntry *pEntry = m_pInQueue->begin_push();
+		pEntry->m_Type = CThreadEntry::TYPE_STATS;
+		pEntry->m_ClientID = i;
+		pEntry->m_Generation = m_aSlots[i].m_Generation;
+		pEntry->m_DataSize = sizeof(CNetConnStats);
+		mem_copy(pEntry->m_aData, m_aSlots[i].m_Connection.Stats(), sizeof(CNetConnStats));
+		m_pInQueue->end_push();
+	}
+}
+
+void CNetServer::NetThread(void *pUser)
+{
+	CNetServer *pThis = (CNetServer *)pUser;
+	CThreadTopology::Enter(CThreadTopology::CLASS_NET, "network");
+
+	while(pThis->m_ThreadRunning)
+	{
+		CTracer::Begin("NetUpdate");
+		pThis->ProcessOutQueue();
+		pThis->UpdateImpl();
+		pThis->PushStats();
+
+		// hand complete chunks over to the tick thread, keeping room for connection events
+		while(pThis->m_pInQueue->size()+NET_THREAD_QUEUE_RESERVE < pThis->m_pInQueue->capacity())
+		{
+			CNetChunk Chunk;
+			TOKEN ResponseToken = NET_TOKEN_NONE;
+			if(!pThis->RecvImpl(&Chunk, &ResponseToken))
+				break;
+
+			CThreadEntry *pEntry = pThis->m_pInQueue->begin_push();
+			pEntry->m_Type = CThreadEntry::TYPE_CHUNK;
+			pEntry->m_ClientID = Chunk.m_ClientID;
+			pEntry->m_Generation = Chunk.m_ClientID >= 0 ? pThis->m_aSlots[Chunk.m_ClientID].m_Generation : 0;
+			pEntry->m_Token = ResponseToken;
+			pEntry->m_Address = Chunk.m_Address;
+			pEntry->m_Flags = Chunk.m_Flags;
+			pEntry->m_DataSize = Chunk.m_DataSize;
+			mem_copy(pEntry->m_aData, Chunk.m_pData, Chunk.m_DataSize);
+			pThis->m_pInQueue->end_push();
+		}
+
+		pThis->FlushSendBatch();
+		CTracer::End("NetUpdate");
+
+		// wake up for incoming packets, outgoing ones are picked up at least every millisecond
+		if(pThis->m_pOutQueue->empty())
+			pThis->CNetBase::Wait(1);
+	}
+
+	CThreadTopology::Leave();
+}
@@ -28,6 +28,15 @@ void CNetTokenManager::Init(CNetBase *pNetBase, int SeedTime)
 
 void CNetTokenManager::Update()
 {
+	// a replay switches seeds where the capture did
+	if(m_pNetBase->Replaying())
+	{
+		int64 Seed;
+		while(m_pNetBase->ReplaySeed(&Seed))
+			SetSeed(Seed);
+		return;
+	}
+
 	if(time_get() > m_NextSeedTime)
 		GenerateSeed();
 }
@@ -41,7 +50,7 @@ int CNetTokenManager::ProcessMessage(const NETADDR *pAddr, const CNetPacketConst
 
 	bool Verified = pPacket->m_Token != NET_TOKEN_NONE;
 	bool TokenMessage = (pPacket->m_Flags & NET_PACKETFLAG_CONTROL)
-		&& pPacket->m_aChunkData[0] == NET_CTRLMSG_TOKEN;
+		&& pPacket->m_pChunkData[0] == NET_CTRLMSG_TOKEN;
 
 	if(pPacket->m_Flags&NET_PACKETFLAG_CONNLESS)
 		return (Verified && !BroadcastResponse) ? 1 : 0; // connless packets without token are not allowed
@@ -68,11 +77,18 @@ int CNetTokenManager::ProcessMessage(const NETADDR *pAddr, const CNetPacketConst
 }
 
 void CNetTokenManager::GenerateSeed()
+{
+	int64 Seed;
+	secure_random_fill(&Seed, sizeof(Seed));
+	SetSeed(Seed);
+	m_pNetBase->CaptureSeed(Seed);
+}
+
+void CNetTokenManager::SetSeed(int64 Seed)
 {
 	static const NETADDR NullAddr = { 0 };
 	m_PrevSeed = m_Seed;
-
-	secure_random_fill(&m_Seed, sizeof(m_Seed));
+	m_Seed = Seed;
 
 	m_PrevGlobalToken = m_GlobalToken;
 	m_GlobalToken = GenerateToken(&NullAddr);
@@ -136,110 +152,191 @@ bool CNetTokenManager::CheckToken(const NETADDR *pAddr, TOKEN Token, TOKEN Respo
 }
 
 
+template<class T> static void ListAppend(T **ppFirst, T **ppLast, T *pItem, T *T::*pNext, T *T::*pPrev)
+{
+	pItem->*pNext = 0;
+	pItem->*pPrev = *ppLast;
+	if(*ppLast)
+		(*ppLast)->*pNext = pItem;
+	else
+		*ppFirst = pItem;
+	*ppLast = pItem;
+}
+
+template<class T> static void ListRemove(T **ppFirst, T **ppLast, T *pItem, T *T::*pNext, T *T::*pPrev)
+{
+	if(pItem->*pNext)
+		(pItem->*pNext)->*pPrev = pItem->*pPrev;
+	else
+		*ppLast = pItem->*pPrev;
+	if(pItem->*pPrev)
+		(pItem->*pPrev)->*pNext = pItem->*pNext;
+	else
+		*ppFirst = pItem->*pNext;
+	pItem->*pNext = pItem->*pPrev = 0;
+}
+
+template<class T> static void HashInsert(T **ppBucket, T *pItem)
+{
+	pItem->m_pHashPrev = 0;
+	pItem->m_pHashNext = *ppBucket;
+	if(*ppBucket)
+		(*ppBucket)->m_pHashPrev = pItem;
+	*ppBucket = pItem;
+}
+
+template<class T> static void HashRemove(T **ppBucket, T *pItem)
+{
+	if(pItem->m_pHashNext)
+		pItem->m_pHashNext->m_pHashPrev = pItem->m_pHashPrev;
+	if(pItem->m_pHashPrev)
+		pItem->m_pHashPrev->m_pHashNext = pItem->m_pHashNext;
+	else
+		*ppBucket = pItem->m_pHashNext;
+	pItem->m_pHashNext = pItem->m_pHashPrev = 0;
+}
+
 CNetTokenCache::CNetTokenCache()
 {
+	m_pNetBase = 0;
 	m_pTokenManager = 0;
-	m_pConnlessPacketList = 0;
+	m_pFirstPacket = 0;
+	Clear();
 }
 
 CNetTokenCache::~CNetTokenCache()
 {
-	// delete the linked list
-	while(m_pConnlessPacketList)
+	Clear();
+}
+
+void CNetTokenCache::Clear()
+{
+	while(m_pFirstPacket)
 	{
-		CConnlessPacketInfo *pTemp = m_pConnlessPacketList->m_pNext;
-		delete m_pConnlessPacketList;
-		m_pConnlessPacketList = pTemp;
+		CConnlessPacketInfo *pNext = m_pFirstPacket->m_pNext;
+		delete m_pFirstPacket;
+		m_pFirstPacket = pNext;
+	}
+	m_pLastPacket = 0;
+	m_pFirstFetch = m_pLastFetch = 0;
+	mem_zero(m_apPacketHash, sizeof(m_apPacketHash));
+	mem_zero(m_apTrackHash, sizeof(m_apTrackHash));
+
+	mem_zero(m_apAddrHash, sizeof(m_apAddrHash));
+	m_pFirstAddr = m_pLastAddr = 0;
+	m_pFirstFreeAddr = 0;
+	for(int i = NET_TOKENCACHE_SIZE-1; i >= 0; i--)
+	{
+		m_aAddrInfos[i].m_pNext = m_pFirstFreeAddr;
+		m_pFirstFreeAddr = &m_aAddrInfos[i];
 	}
-	m_pConnlessPacketList = 0;
 }
 
 void CNetTokenCache::Init(CNetBase *pNetBase, const CNetTokenManager *pTokenManager)
 {
-	// call the destructor to clear the linked list
-	this->~CNetTokenCache();
-
-	m_TokenCache.Init();
+	Clear();
 	m_pNetBase = pNetBase;
 	m_pTokenManager = pTokenManager;
 }
 
+unsigned CNetTokenCache::AddrHash(const NETADDR *pAddr, bool Port)
+{
+	int Size = pAddr->type == NETTYPE_IPV4 ? NETADDR_SIZE_IPV4 : NETADDR_SIZE_IPV6;
+	unsigned Hash = (2166136261u^pAddr->type)*16777619u;
+	for(int i = 0; i < Size; i++)
+		Hash = (Hash^pAddr->ip[i])*16777619u;
+	if(Port)
+	{
+		Hash = (Hash^(pAddr->port&0xff))*16777619u;
+		Hash = (Hash^(pAddr->port>>8))*16777619u;
+	}
+	return Hash%NET_TOKENCACHE_HASHSIZE;
+}
+
+void CNetTokenCache::RemoveAddrInfo(CAddressInfo *pInfo)
+{
+	HashRemove(&m_apAddrHash[AddrHash(&pInfo->m_Addr, true)], pInfo);
+	ListRemove(&m_pFirstAddr, &m_pLastAddr, pInfo, &CAddressInfo::m_pNext, &CAddressInfo::m_pPrev);
+	pInfo->m_pNext = m_pFirstFreeAddr;
+	m_pFirstFreeAddr = pInfo;
+}
+
+void CNetTokenCache::RemovePacket(CConnlessPacketInfo *pInfo)
+{
+	HashRemove(&m_apPacketHash[AddrHash(&pInfo->m_Addr, false)], pInfo);
+	ListRemove(&m_pFirstPacket, &m_pLastPacket, pInfo, &CConnlessPacketInfo::m_pNext, &CConnlessPacketInfo::m_pPrev);
+	ListRemove(&m_pFirstFetch, &m_pLastFetch, pInfo, &CConnlessPacketInfo::m_pFetchNext, &CConnlessPacketInfo::m_pFetchPrev);
+	for(CConnlessPacketInfo **ppTrack = &m_apTrackHash[(unsigned)pInfo->m_TrackID%NET_TOKENCACHE_HASHSIZE]; *ppTrack; ppTrack = &(*ppTrack)->m_pTrackNext)
+	{
+		if(*ppTrack == pInfo)
+		{
+			*ppTrack = pInfo->m_pTrackNext;
+			break;
+		}
+	}
+	delete pInfo;
+}
+
 void CNetTokenCache::SendPacketConnless(const NETADDR *pAddr, const void *pData, int DataSize, CSendCBData *pCallbackData)
 {
 	TOKEN Token = GetToken(pAddr);
 	if(Token != NET_TOKEN_NONE)
 	{
 		m_pNetBase->SendPacketConnless(pAddr, Token, m_pTokenManager->GenerateToken(pAddr), pData, DataSize);
+		if(pCallbackData)
+			pCallbackData->m_TrackID = -1;
 	}
 	else
 	{
 		FetchToken(pAddr);
 
 		// store the packet for future sending
-		CConnlessPacketInfo **ppInfo = &m_pConnlessPacketList;
-		while(*ppInfo)
-			ppInfo = &(*ppInfo)->m_pNext;
-		*ppInfo = new CConnlessPacketInfo();
-		mem_copy((*ppInfo)->m_aData, pData, DataSize);
-		(*ppInfo)->m_Addr = *pAddr;
-		(*ppInfo)->m_DataSize = DataSize;
+		CConnlessPacketInfo *pInfo = new CConnlessPacketInfo();
+		mem_copy(pInfo->m_aData, pData, DataSize);
+		pInfo->m_Addr = *pAddr;
+		pInfo->m_DataSize = DataSize;
 		int64 Now = time_get();
-		(*ppInfo)->m_Expiry = Now + time_freq() * NET_TOKENCACHE_PACKETEXPIRY;
-		(*ppInfo)->m_LastTokenRequest = Now;
-		(*ppInfo)->m_pNext = 0;
+		pInfo->m_Expiry = Now + time_freq() * NET_TOKENCACHE_PACKETEXPIRY;
+		pInfo->m_LastTokenRequest = Now;
 		if(pCallbackData)
 		{
-			(*ppInfo)->m_pfnCallback = pCallbackData->m_pfnCallback;
-			(*ppInfo)->m_pCallbackUser = pCallbackData->m_pCallbackUser;
-			pCallbackData->m_TrackID = (*ppInfo)->m_TrackID;
+			pInfo->m_pfnCallback = pCallbackData->m_pfnCallback;
+			pInfo->m_pCallbackUser = pCallbackData->m_pCallbackUser;
+			pCallbackData->m_TrackID = pInfo->m_TrackID;
 		}
 		else
 		{
-			(*ppInfo)->m_pfnCallback = 0;
-			(*ppInfo)->m_pCallbackUser = 0;
+			pInfo->m_pfnCallback = 0;
+			pInfo->m_pCallbackUser = 0;
 		}
+
+		ListAppend(&m_pFirstPacket, &m_pLastPacket, pInfo, &CConnlessPacketInfo::m_pNext, &CConnlessPacketInfo::m_pPrev);
+		ListAppend(&m_pFirstFetch, &m_pLastFetch, pInfo, &CConnlessPacketInfo::m_pFetchNext, &CConnlessPacketInfo::m_pFetchPrev);
+		HashInsert(&m_apPacketHash[AddrHash(pAddr, false)], pInfo);
+		CConnlessPacketInfo **ppTrack = &m_apTrackHash[(unsigned)pInfo->m_TrackID%NET_TOKENCACHE_HASHSIZE];
+		pInfo->m_pTrackNext = *ppTrack;
+		*ppTrack = pInfo;
 	}
 }
 
 void CNetTokenCache::PurgeStoredPacket(int TrackID)
 {
-	CConnlessPacketInfo *pPrevInfo = 0;
-	CConnlessPacketInfo *pInfo = m_pConnlessPacketList;
-	while(pInfo)
+	for(CConnlessPacketInfo *pInfo = m_apTrackHash[(unsigned)TrackID%NET_TOKENCACHE_HASHSIZE]; pInfo; pInfo = pInfo->m_pTrackNext)
 	{
 		if(pInfo->m_TrackID == TrackID)
 		{
-			// purge desired packet
-			CConnlessPacketInfo *pNext = pInfo->m_pNext;
-			if(pPrevInfo)
-				pPrevInfo->m_pNext = pNext;
-			if(pInfo == m_pConnlessPacketList)
-				m_pConnlessPacketList = pNext;
-			delete pInfo;
-
+			RemovePacket(pInfo);
 			break;
 		}
-		else
-		{
-			if(pPrevInfo)
-				pPrevInfo = pPrevInfo->m_pNext;
-			else
-				pPrevInfo = pInfo;
-			pInfo = pInfo->m_pNext;
-		}
 	}
 }
 
 TOKEN CNetTokenCache::GetToken(const NETADDR *pAddr)
 {
-	// traverse the list in the reverse direction
-	// newest caches are the best
-	CAddressInfo *pInfo = m_TokenCache.Last();
-	while(pInfo)
+	for(CAddressInfo *pInfo = m_apAddrHash[AddrHash(pAddr, true)]; pInfo; pInfo = pInfo->m_pHashNext)
 	{
 		if(net_addr_comp(&pInfo->m_Addr, pAddr, true) == 0)
 			return pInfo->m_Token;
-		pInfo = m_TokenCache.Prev(pInfo);
 	}
 	return NET_TOKEN_NONE;
 }
@@ -254,47 +351,66 @@ void CNetTokenCache::AddToken(const NETADDR *pAddr, TOKEN Token, int TokenFLag)
 	if(Token == NET_TOKEN_NONE)
 		return;
 
-	// search the list of packets to be sent
-	// for this address
-	CConnlessPacketInfo *pPrevInfo = 0;
-	CConnlessPacketInfo *pInfo = m_pConnlessPacketList;
+	// send the packets stored for this address, broadcasts are all kept
+	// under the null address
+	NETADDR NullAddr = { 0 };
+	NullAddr.type = 7;	// cover broadcasts
 	bool Found = false;
-	while(pInfo)
+	for(int Pass = 0; Pass < 2; Pass++)
 	{
-		NETADDR NullAddr = { 0 };
-		NullAddr.type = 7;	// cover broadcasts
-		if(net_addr_comp(&pInfo->m_Addr, pAddr, true) == 0 || ((TokenFLag&NET_TOKENFLAG_ALLOWBROADCAST) && net_addr_comp(&pInfo->m_Addr, &NullAddr, false) == 0))
+		const NETADDR *pMatch = Pass == 0 ? pAddr : &NullAddr;
+		if(Pass == 1 && !(TokenFLag&NET_TOKENFLAG_ALLOWBROADCAST))
+			break;
+
+		CConnlessPacketInfo *pInfo = m_apPacketHash[AddrHash(pMatch, false)];
+		while(pInfo)
 		{
-			// notify the user that the packet gets delivered
-			if(pInfo->m_pfnCallback)
-				pInfo->m_pfnCallback(pInfo->m_TrackID, pInfo->m_pCallbackUser);
-			m_pNetBase->SendPacketConnless(&(pInfo->m_Addr), Token, m_pTokenManager->GenerateToken(pAddr), pInfo->m_aData, pInfo->m_DataSize);
-			CConnlessPacketInfo *pNext = pInfo->m_pNext;
-			if(pPrevInfo)
-				pPrevInfo->m_pNext = pNext;
-			if(pInfo == m_pConnlessPacketList)
-				m_pConnlessPacketList = pNext;
-			delete pInfo;
+			CConnlessPacketInfo *pNext = pInfo->m_pHashNext;
+			if(net_addr_comp(&pInfo->m_Addr, pMatch, Pass == 0) == 0)
+			{
+				// notify the user that the packet gets delivered
+				if(pInfo->m_pfnCallback)
+					pInfo->m_pfnCallback(pInfo->m_TrackID, pInfo->m_pCallbackUser);
+				m_pNetBase->SendPacketConnless(&(pInfo->m_Addr), Token, m_pTokenManager->GenerateToken(pAddr), pInfo->m_aData, pInfo->m_DataSize);
+				RemovePacket(pInfo);
+				Found = true;
+			}
 			pInfo = pNext;
 		}
-		else
-		{
-			if(pPrevInfo)
-				pPrevInfo = pPrevInfo->m_pNext;
-			else
-				pPrevInfo = pInfo;
-			pInfo = pInfo->m_pNext;
-		}
 	}
 
 	// add the token
 	if(Found || !(TokenFLag&NET_TOKENFLAG_RESPONSEONLY))
 	{
-		CAddressInfo Info;
-		Info.m_Addr = *pAddr;
-		Info.m_Token = Token;
-		Info.m_Expiry = time_get() + time_freq() * NET_TOKENCACHE_ADDRESSEXPIRY;
-		(*m_TokenCache.Allocate(sizeof(Info))) = Info;
+		CAddressInfo *pInfo = 0;
+		unsigned Hash = AddrHash(pAddr, true);
+		for(CAddressInfo *p = m_apAddrHash[Hash]; p; p = p->m_pHashNext)
+		{
+			if(net_addr_comp(&p->m_Addr, pAddr, true) == 0)
+			{
+				pInfo = p;
+				break;
+			}
+		}
+
+		if(pInfo)
+		{
+			// rearm the expiry
+			ListRemove(&m_pFirstAddr, &m_pLastAddr, pInfo, &CAddressInfo::m_pNext, &CAddressInfo::m_pPrev);
+		}
+		else
+		{
+			// recycle the entry closest to expiry when full
+			if(!m_pFirstFreeAddr)
+				RemoveAddrInfo(m_pFirstAddr);
+			pInfo = m_pFirstFreeAddr;
+			m_pFirstFreeAddr = pInfo->m_pNext;
+			pInfo->m_Addr = *pAddr;
+			HashInsert(&m_apAddrHash[Hash], pInfo);
+		}
+		pInfo->m_Token = Token;
+		pInfo->m_Expiry = time_get() + time_freq() * NET_TOKENCACHE_ADDRESSEXPIRY;
+		ListAppend(&m_pFirstAddr, &m_pLastAddr, pInfo, &CAddressInfo::m_pNext, &CAddressInfo::m_pPrev);
 	}
 }
 
@@ -303,28 +419,20 @@ void CNetTokenCache::Update()
 	int64 Now = time_get();
 
 	// drop expired address info
-	CAddressInfo *pAddrInfo;
-	while((pAddrInfo = m_TokenCache.First()) && (pAddrInfo->m_Expiry <= Now))
-		m_TokenCache.PopFirst();
+	while(m_pFirstAddr && m_pFirstAddr->m_Expiry <= Now)
+		RemoveAddrInfo(m_pFirstAddr);
 
 	// try to fetch the token again for stored packets
-	CConnlessPacketInfo * pEntry = m_pConnlessPacketList;
-	while(pEntry)
+	while(m_pFirstFetch && m_pFirstFetch->m_LastTokenRequest + 2*time_freq() <= Now)
 	{
-		if(pEntry->m_LastTokenRequest + 2*time_freq() <= Now)
-		{
-			FetchToken(&pEntry->m_Addr);
-			pEntry->m_LastTokenRequest = Now;
-		}
-		pEntry = pEntry->m_pNext;
+		CConnlessPacketInfo *pEntry = m_pFirstFetch;
+		FetchToken(&pEntry->m_Addr);
+		pEntry->m_LastTokenRequest = Now;
+		ListRemove(&m_pFirstFetch, &m_pLastFetch, pEntry, &CConnlessPacketInfo::m_pFetchNext, &CConnlessPacketInfo::m_pFetchPrev);
+		ListAppend(&m_pFirstFetch, &m_pLastFetch, pEntry, &CConnlessPacketInfo::m_pFetchNext, &CConnlessPacketInfo::m_pFetchPrev);
 	}
 
 	// drop expired packets
-	while(m_pConnlessPacketList && m_pConnlessPacketList->m_Expiry <= Now)
-	{
-		CConnlessPacketInfo *pNewList = m_pConnlessPacketList->m_pNext;
-		delete m_pConnlessPacketList;
-		m_pConnlessPacketList = pNewList;
-	}
+	while(m_pFirstPacket && m_pFirstPacket->m_Expiry <= Now)
+		RemovePacket(m_pFirstPacket);
 }
-
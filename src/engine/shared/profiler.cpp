@@ -0,0 +1,131 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include "profiler.h"
+
+CProfiler::CProfiler()
+{
+	m_NumPhases = 0;
+	m_Window = 0;
+	m_WindowStart = 0;
+	m_Freq = time_freq();
+	m_Enabled = false;
+}
+
+int CProfiler::Bucket(int64 Microseconds)
+{
+	if(Microseconds < 8)
+		return Microseconds < 0 ? 0 : (int)Microseconds;
+
+	int Msb = 3;
+	while(Msb < 62 && (Microseconds >> (Msb+1)))
+		Msb++;
+	int Bucket = 8 + (Msb-3)*8 + (int)((Microseconds >> (Msb-3)) & 7);
+	return Bucket < NUM_BUCKETS ? Bucket : NUM_BUCKETS-1;
+}
+
+int64 CProfiler::BucketValue(int Bucket)
+{
+	if(Bucket < 8)
+		return Bucket;
+	int Msb = (Bucket-8)/8 + 3;
+	return (int64)(8 + (Bucket-8)%8) << (Msb-3);
+}
+
+int CProfiler::AddPhase(const char *pName)
+{
+	for(int i = 0; i < m_NumPhases; i++)
+		if(str_comp(m_aPhases[i].m_pName, pName) == 0)
+			return i;
+	if(m_NumPhases == MAX_PHASES)
+		return -1;
+
+	CPhase *pPhase = &m_aPhases[m_NumPhases];
+	mem_zero(pPhase, sizeof(*pPhase));
+	pPhase->m_pName = pName;
+	return m_NumPhases++;
+}
+
+void CProfiler::SetEnabled(bool Enabled)
+{
+	if(Enabled && !m_Enabled)
+		Reset();
+	m_Enabled = Enabled;
+}
+
+void CProfiler::ClearWindow(int Window)
+{
+	for(int i = 0; i < m_NumPhases; i++)
+	{
+		mem_zero(m_aPhases[i].m_aaBuckets[Window], sizeof(m_aPhases[i].m_aaBuckets[Window]));
+		m_aPhases[i].m_aNumSamples[Window] = 0;
+		m_aPhases[i].m_aMax[Window] = 0;
+	}
+}
+
+void CProfiler::Update(int64 Now)
+{
+	if(Now - m_WindowStart < WINDOW_SECONDS*m_Freq)
+		return;
+	m_Window ^= 1;
+	m_WindowStart = Now;
+	ClearWindow(m_Window);
+}
+
+void CProfiler::Reset()
+{
+	ClearWindow(0);
+	ClearWindow(1);
+	m_WindowStart = time_get();
+}
+
+void CProfiler::GetStats(int Phase, CStats *pStats) const
+{
+	const CPhase *pPhase = &m_aPhases[Phase];
+	pStats->m_NumSamples = pPhase->m_aNumSamples[0] + pPhase->m_aNumSamples[1];
+	pStats->m_Max = max(pPhase->m_aMax[0], pPhase->m_aMax[1]);
+	pStats->m_P50 = 0;
+	pStats->m_P99 = 0;
+	if(!pStats->m_NumSamples)
+		return;
+
+	// the smallest bucket that has the wanted part of the samples below it
+	const int P50Rank = (pStats->m_NumSamples+1)/2;
+	const int P99Rank = pStats->m_NumSamples - pStats->m_NumSamples/100;
+	int Count = 0;
+	bool FoundP50 = false;
+	for(int b = 0; b < NUM_BUCKETS; b++)
+	{
+		Count += pPhase->m_aaBuckets[0][b] + pPhase->m_aaBuckets[1][b];
+		if(!FoundP50 && Count >= P50Rank)
+		{
+			pStats->m_P50 = BucketValue(b);
+			FoundP50 = true;
+		}
+		if(Count >= P99Rank)
+		{
+			pStats->m_P99 = BucketValue(b);
+			break;
+		}
+	}
+
+	// the buckets only know the lower bound
+	pStats->m_P50 = min(pStats->m_P50, pStats->m_Max);
+	pStats->m_P99 = min(pStats->m_P99, pStats->m_Max);
+}
+
+void CProfiler::GetHistogram(int Phase, unsigned *pCounts) const
+{
+	const CPhase *pPhase = &m_aPhases[Phase];
+	for(int b = 0; b < NUM_BUCKETS; b++)
+		pCounts[b] = pPhase->m_aaBuckets[0][b] + pPhase->m_aaBuckets[1][b];
+}
+
+void CProfiler::FormatStats(int Phase, char *pBuf, int BufSize) const
+{
+	CStats Stats;
+	GetStats(Phase, &Stats);
+	str_format(pBuf, BufSize, "%s: samples=%d p50=%.3fms p99=%.3fms max=%.3fms", m_aPhases[Phase].m_pName, Stats.m_NumSamples,
+		Stats.m_P50/1000.0f, Stats.m_P99/1000.0f, Stats.m_Max/1000.0f);
+}
@@ -0,0 +1,119 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_PROFILER_H
+#define ENGINE_SHARED_PROFILER_H
+
+#include <base/system.h>
+
+/*
+	Class: CProfiler
+		Keeps histograms of how long named phases of the main loop take.
+		Durations are binned logarithmically, eight bins per power of two
+		microseconds. The samples of the last two windows are reported,
+		so the numbers cover between one and two window lengths.
+*/
+class CProfiler
+{
+public:
+	enum
+	{
+		MAX_PHASES=48,
+		NUM_BUCKETS=8*24,
+		WINDOW_SECONDS=5,
+	};
+
+	struct CStats
+	{
+		int m_NumSamples;
+		int64 m_P50; // microseconds
+		int64 m_P99;
+		int64 m_Max;
+	};
+
+private:
+	struct CPhase
+	{
+		const char *m_pName;
+		unsigned m_aaBuckets[2][NUM_BUCKETS];
+		int m_aNumSamples[2];
+		int64 m_aMax[2];
+	};
+
+	CPhase m_aPhases[MAX_PHASES];
+	int m_NumPhases;
+	int m_Window;
+	int64 m_WindowStart;
+	int64 m_Freq;
+	bool m_Enabled;
+
+	void ClearWindow(int Window);
+
+public:
+	CProfiler();
+
+	static int Bucket(int64 Microseconds);
+	static int64 BucketValue(int Bucket);
+
+	/*
+		Function: AddPhase
+			Returns the id of the phase with the given name, the phase is
+			created if it does not exist yet. The name has to stay valid.
+			Returns -1 when there are too many phases.
+	*/
+	int AddPhase(const char *pName);
+	int NumPhases() const { return m_NumPhases; }
+	const char *PhaseName(int Phase) const { return m_aPhases[Phase].m_pName; }
+
+	bool IsEnabled() const { return m_Enabled; }
+	void SetEnabled(bool Enabled);
+
+	// adds a sample in time_get() units
+	void Add(int Phase, int64 Duration)
+	{
+		if(Phase < 0)
+			return;
+		int64 Microseconds = Duration*1000000/m_Freq;
+		CPhase *pPhase = &m_aPhases[Phase];
+		pPhase->m_aaBuckets[m_Window][Bucket(Microseconds)]++;
+		pPhase->m_aNumSamples[m_Window]++;
+		if(Microseconds > pPhase->m_aMax[m_Window])
+			pPhase->m_aMax[m_Window] = Microseconds;
+	}
+
+	// starts a new window once the current one is full
+	void Update(int64 Now);
+	void Reset();
+
+	void GetStats(int Phase, CStats *pStats) const;
+	// the samples of both windows per bucket, NUM_BUCKETS entries
+	void GetHistogram(int Phase, unsigned *pCounts) const;
+	void FormatStats(int Phase, char *pBuf, int BufSize) const;
+};
+
+/*
+	Class: CProfileScope
+		Adds the time until the end of the scope to a phase. Costs a
+		single branch when the profiler is disabled.
+*/
+class CProfileScope
+{
+	CProfiler *m_pProfiler;
+	int m_Phase;
+	int64 m_Start;
+
+public:
+	CProfileScope(CProfiler *pProfiler, int Phase)
+	{
+		m_pProfiler = pProfiler && pProfiler->IsEnabled() ? pProfiler : 0;
+		m_Phase = Phase;
+		m_Start = m_pProfiler ? time_get() : 0;
+	}
+
+	~CProfileScope()
+	{
+		if(m_pProfiler)
+			m_pProfiler->Add(m_Phase, time_get()-m_Start);
+	}
+};
+
+#endif
@@ -4,6 +4,7 @@
 #define ENGINE_SHARED_PROTOCOL_H
 
 #include <base/system.h>
+#include <base/tl/bitset.h>
 
 /*
 	Connection diagram - How the initialization works.
@@ -73,8 +74,30 @@ enum
 
 	NETMSG_MAPLIST_ENTRY_ADD,// todo 0.8: move up
 	NETMSG_MAPLIST_ENTRY_REM,
+	NETMSG_MAPLIST_ENTRIES_ADD,	// number of names followed by the names, for clients with CLIENTCAP_MAPLIST_BATCH
+	NETMSG_MAPLIST_ENTRIES_REM,
+	NETMSG_SNAP_BITPACKED,	// the following snapshots are packed with CSnapshotDelta::PackBits, for clients with CLIENTCAP_SNAP_BITPACKED
+	NETMSG_MAP_PREFETCH,	// the map the server likely changes to next, for clients with CLIENTCAP_MAP_PREFETCH
+	NETMSG_REQUEST_MAP_PREFETCH,// crc of that map, first chunk and number of chunks
+	NETMSG_MAP_PREFETCH_DATA,// crc of that map, chunk index and a chunk of it
 };
 
+// features a client announces with an int after its version in NETMSG_INFO
+enum
+{
+	CLIENTCAP_MAPLIST_BATCH=1,
+	CLIENTCAP_SNAP_BITPACKED=2, // followed by the CSnapshotDelta::FieldBitsHash of the client
+	CLIENTCAP_MAP_PREFETCH=4,
+	CLIENTCAP_RELAY=8, // logs in with sv_relay_password to get the snapshots of the whole world
+	CLIENTCAP_INPUT_MARGIN=16, // adapts the input timing margin to the jitter itself
+};
+
+// the number of client slots, set with the MAX_CLIENTS cmake option. clients
+// have to be built with at least as many slots as the servers they join
+#ifndef CONF_MAX_CLIENTS
+#define CONF_MAX_CLIENTS 64
+#endif
+
 // this should be revised
 enum
 {
@@ -84,11 +107,13 @@ enum
 	SERVERINFO_LEVEL_MIN=0,
 	SERVERINFO_LEVEL_MAX=2,
 
-	MAX_CLIENTS=64,
+	MAX_CLIENTS=CONF_MAX_CLIENTS,
 	MAX_PLAYERS=16,
 
 	MAX_INPUT_SIZE=128,
+	MAX_REDUNDANT_INPUTS=3, // earlier inputs repeated after the ping correction of NETMSG_INPUT
 	MAX_SNAPSHOT_PACKSIZE=900,
+	MAX_MAP_CHUNKS_PER_REQUEST=16, // keeps the window of a map download within the resend buffer
 
 	MAX_NAME_LENGTH=16,
 	MAX_NAME_ARRAY_SIZE=MAX_NAME_LENGTH*UTF8_BYTE_LENGTH+1,
@@ -105,4 +130,7 @@ enum
 	MSGFLAG_NOSEND=16
 };
 
+// a set of client ids, one bit per slot
+typedef bitset<MAX_CLIENTS> CClientMask;
+
 #endif
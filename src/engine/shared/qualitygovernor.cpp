@@ -0,0 +1,55 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include "qualitygovernor.h"
+
+const float CQualityGovernor::ms_MinLevel = 0.25f;
+const float CQualityGovernor::ms_LevelStep = 0.125f;
+
+void CQualityGovernor::Reset()
+{
+	m_NumFrames = 0;
+	m_GoodWindows = 0;
+	m_Level = 1.0f;
+	m_Percentile = 0.0f;
+}
+
+bool CQualityGovernor::AddFrame(float FrameTime, float TargetTime)
+{
+	m_aFrameTimes[m_NumFrames++] = FrameTime;
+	if(m_NumFrames < WINDOW_FRAMES)
+		return false;
+	m_NumFrames = 0;
+
+	// only the slowest tenth has to be in order
+	const int Rank = WINDOW_FRAMES*9/10;
+	for(int i = WINDOW_FRAMES-1; i >= Rank; i--)
+		for(int j = 0; j < i; j++)
+			if(m_aFrameTimes[j] > m_aFrameTimes[i])
+			{
+				float Tmp = m_aFrameTimes[i];
+				m_aFrameTimes[i] = m_aFrameTimes[j];
+				m_aFrameTimes[j] = Tmp;
+			}
+	m_Percentile = m_aFrameTimes[Rank];
+
+	const float OldLevel = m_Level;
+	if(m_Percentile > TargetTime*1.1f)
+	{
+		m_Level = max(m_Level-ms_LevelStep, ms_MinLevel);
+		m_GoodWindows = 0;
+	}
+	else if(m_Percentile < TargetTime*0.75f)
+	{
+		if(++m_GoodWindows >= RAISE_WINDOWS)
+		{
+			m_Level = min(m_Level+ms_LevelStep, 1.0f);
+			m_GoodWindows = 0;
+		}
+	}
+	else
+		m_GoodWindows = 0;
+
+	return m_Level != OldLevel;
+}
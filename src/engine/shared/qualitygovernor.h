@@ -0,0 +1,48 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_QUALITYGOVERNOR_H
+#define ENGINE_SHARED_QUALITYGOVERNOR_H
+
+/*
+	Class: CQualityGovernor
+		Scales the visual quality to hold a target frame time. The frame
+		times are collected in windows of WINDOW_FRAMES frames. After a
+		window whose 90th percentile misses the target the level steps
+		down, it only steps up again after RAISE_WINDOWS windows in a row
+		well below the target, so it doesn't flicker between two levels.
+*/
+class CQualityGovernor
+{
+public:
+	enum
+	{
+		WINDOW_FRAMES=64,
+		RAISE_WINDOWS=4,
+	};
+
+	static const float ms_MinLevel;
+	static const float ms_LevelStep;
+
+private:
+	float m_aFrameTimes[WINDOW_FRAMES];
+	int m_NumFrames;
+	int m_GoodWindows;
+	float m_Level;
+	float m_Percentile;
+
+public:
+	CQualityGovernor() { Reset(); }
+
+	void Reset();
+
+	// adds the duration of a frame in seconds, returns true when the level changed
+	bool AddFrame(float FrameTime, float TargetTime);
+
+	// between ms_MinLevel and 1 (full quality)
+	float Level() const { return m_Level; }
+
+	// the 90th percentile frame time of the last window in seconds
+	float Percentile() const { return m_Percentile; }
+};
+
+#endif
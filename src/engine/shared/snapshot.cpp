@@ -1,10 +1,19 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/tl/base.h>
 #include <base/tl/algorithm.h>
 #include "snapshot.h"
 #include "compression.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define CONF_SNAPSHOT_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define CONF_SNAPSHOT_NEON 1
+#endif
+
 // CSnapshot
 
 const CSnapshotItem *CSnapshot::GetItem(int Index) const
@@ -38,6 +47,56 @@ void CSnapshot::InvalidateItem(int Index)
 	((CSnapshotItem *)(DataStart() + Offsets()[Index]))->Invalidate();
 }
 
+int CSnapshot::Merge(const CSnapshot *pFirst, const CSnapshot *pSecond, void *pDstData)
+{
+	// the keys of both are sorted, walk them side by side. the first pass counts
+	int NumItems = 0;
+	int DataSize = 0;
+	for(int Pass = 0; Pass < 2; Pass++)
+	{
+		CSnapshot *pSnap = (CSnapshot *)pDstData;
+		if(Pass == 1)
+		{
+			if(sizeof(CSnapshot) + NumItems*sizeof(int)*2 + DataSize > MAX_SIZE || NumItems > CSnapshotBuilder::MAX_ITEMS)
+				return -1;
+			pSnap->m_DataSize = DataSize;
+			pSnap->m_NumItems = NumItems;
+			NumItems = 0;
+			DataSize = 0;
+		}
+
+		int a = 0, b = 0;
+		while(a < pFirst->m_NumItems || b < pSecond->m_NumItems)
+		{
+			const CSnapshot *pFrom = pFirst;
+			int Index = a;
+			if(a == pFirst->m_NumItems || (b < pSecond->m_NumItems && pSecond->SortedKeys()[b] < pFirst->SortedKeys()[a]))
+			{
+				pFrom = pSecond;
+				Index = b++;
+			}
+			else
+			{
+				if(b < pSecond->m_NumItems && pSecond->SortedKeys()[b] == pFirst->SortedKeys()[a])
+					b++;
+				a++;
+			}
+
+			int ItemSize = pFrom->GetItemSize(Index) + sizeof(CSnapshotItem);
+			if(Pass == 1)
+			{
+				pSnap->SortedKeys()[NumItems] = pFrom->SortedKeys()[Index];
+				pSnap->Offsets()[NumItems] = DataSize;
+				mem_copy(pSnap->DataStart()+DataSize, pFrom->GetItem(Index), ItemSize);
+			}
+			NumItems++;
+			DataSize += ItemSize;
+		}
+	}
+
+	return sizeof(CSnapshot) + NumItems*sizeof(int)*2 + DataSize;
+}
+
 int CSnapshot::Serialize(char *pDstData)
 {
 	int *pData = (int*)pDstData;
@@ -79,51 +138,61 @@ void CSnapshot::DebugDump() const
 }
 
 
-// CSnapshotDelta
+// CSnapshotHash
 
-struct CItemList
+static unsigned HashKey(int Key)
 {
-	int m_Num;
-	int m_aKeys[64];
-	int m_aIndex[64];
-};
+	return ((unsigned)Key*2654435761u)>>16;
+}
 
-enum
+int CSnapshotHash::TotalSize(int NumItems)
 {
-	HASHLIST_SIZE = 256,
-};
+	int NumSlots = 1;
+	while(NumSlots < NumItems*2)
+		NumSlots <<= 1;
+	return sizeof(CSnapshotHash) + NumSlots*2*sizeof(int);
+}
 
-static void GenerateHash(CItemList *pHashlist, const CSnapshot *pSnapshot)
+void CSnapshotHash::Build(const CSnapshot *pSnapshot)
 {
-	for(int i = 0; i < HASHLIST_SIZE; i++)
-		pHashlist[i].m_Num = 0;
+	int NumSlots = 1;
+	while(NumSlots < pSnapshot->NumItems()*2)
+		NumSlots <<= 1;
+	dbg_assert(NumSlots <= MAX_SLOTS, "too many items to hash");
+	m_Mask = NumSlots-1;
+
+	int *pSlots = Slots();
+	for(int i = 0; i < NumSlots; i++)
+		pSlots[i*2+1] = -1;
 
 	for(int i = 0; i < pSnapshot->NumItems(); i++)
 	{
 		int Key = pSnapshot->GetItem(i)->Key();
-		int HashID = ((Key>>12)&0xf0) | (Key&0xf);
-		if(pHashlist[HashID].m_Num != 64)
-		{
-			pHashlist[HashID].m_aIndex[pHashlist[HashID].m_Num] = i;
-			pHashlist[HashID].m_aKeys[pHashlist[HashID].m_Num] = Key;
-			pHashlist[HashID].m_Num++;
-		}
+		unsigned Slot = HashKey(Key)&m_Mask;
+		while(pSlots[Slot*2+1] != -1)
+			Slot = (Slot+1)&m_Mask;
+		pSlots[Slot*2] = Key;
+		pSlots[Slot*2+1] = i;
 	}
 }
 
-static int GetItemIndexHashed(int Key, const CItemList *pHashlist)
+int CSnapshotHash::Find(int Key) const
 {
-		int HashID = ((Key>>12)&0xf0) | (Key&0xf);
-		for(int i = 0; i < pHashlist[HashID].m_Num; i++)
-		{
-			if(pHashlist[HashID].m_aKeys[i] == Key)
-				return pHashlist[HashID].m_aIndex[i];
+	const int *pSlots = Slots();
+	unsigned Slot = HashKey(Key)&m_Mask;
+	while(pSlots[Slot*2+1] != -1)
+	{
+		if(pSlots[Slot*2] == Key)
+			return pSlots[Slot*2+1];
+		Slot = (Slot+1)&m_Mask;
 	}
-
 	return -1;
 }
 
-static int DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size)
+
+// CSnapshotDelta
+
+int CSnapshotDelta::DiffItemScalar(const int *pPast, const int *pCurrent, int *pOut, int Size)
 {
 	int Needed = 0;
 	while(Size)
@@ -139,19 +208,20 @@ static int DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size)
 	return Needed;
 }
 
-void CSnapshotDelta::UndiffItem(const int *pPast, const int *pDiff, int *pOut, int Size)
+int CSnapshotDelta::UndiffItemScalar(const int *pPast, const int *pDiff, int *pOut, int Size)
 {
+	int Bits = 0;
 	while(Size)
 	{
 		*pOut = *pPast+*pDiff;
 
 		if(*pDiff == 0)
-			m_aSnapshotDataRate[m_SnapshotCurrent] += 1;
+			Bits += 1;
 		else
 		{
 			unsigned char aBuf[16];
 			unsigned char *pEnd = CVariableInt::Pack(aBuf, *pDiff);
-			m_aSnapshotDataRate[m_SnapshotCurrent] += (int)(pEnd - (unsigned char*)aBuf) * 8;
+			Bits += (int)(pEnd - (unsigned char*)aBuf) * 8;
 		}
 
 		pOut++;
@@ -159,11 +229,111 @@ void CSnapshotDelta::UndiffItem(const int *pPast, const int *pDiff, int *pOut, i
 		pDiff++;
 		Size--;
 	}
+	return Bits;
+}
+
+#if defined(CONF_SNAPSHOT_SSE2)
+int CSnapshotDelta::DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size)
+{
+	__m128i Needed = _mm_setzero_si128();
+	int i = 0;
+	for(; i+4 <= Size; i += 4)
+	{
+		__m128i Diff = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(pCurrent+i)), _mm_loadu_si128((const __m128i *)(pPast+i)));
+		_mm_storeu_si128((__m128i *)(pOut+i), Diff);
+		Needed = _mm_or_si128(Needed, Diff);
+	}
+	Needed = _mm_or_si128(Needed, _mm_srli_si128(Needed, 8));
+	Needed = _mm_or_si128(Needed, _mm_srli_si128(Needed, 4));
+	return _mm_cvtsi128_si32(Needed) | DiffItemScalar(pPast+i, pCurrent+i, pOut+i, Size-i);
+}
+
+int CSnapshotDelta::UndiffItem(const int *pPast, const int *pDiff, int *pOut, int Size)
+{
+	// the packed size is 1 byte plus one for each threshold the magnitude reaches
+	const __m128i Limit1 = _mm_set1_epi32((1<<6)-1);
+	const __m128i Limit2 = _mm_set1_epi32((1<<13)-1);
+	const __m128i Limit3 = _mm_set1_epi32((1<<20)-1);
+	const __m128i Limit4 = _mm_set1_epi32((1<<27)-1);
+	__m128i Extra = _mm_setzero_si128();
+	__m128i Zeros = _mm_setzero_si128();
+	int i = 0;
+	for(; i+4 <= Size; i += 4)
+	{
+		__m128i Diff = _mm_loadu_si128((const __m128i *)(pDiff+i));
+		_mm_storeu_si128((__m128i *)(pOut+i), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(pPast+i)), Diff));
+
+		__m128i Magnitude = _mm_xor_si128(Diff, _mm_srai_epi32(Diff, 31));
+		Extra = _mm_sub_epi32(Extra, _mm_cmpgt_epi32(Magnitude, Limit1));
+		Extra = _mm_sub_epi32(Extra, _mm_cmpgt_epi32(Magnitude, Limit2));
+		Extra = _mm_sub_epi32(Extra, _mm_cmpgt_epi32(Magnitude, Limit3));
+		Extra = _mm_sub_epi32(Extra, _mm_cmpgt_epi32(Magnitude, Limit4));
+		Zeros = _mm_sub_epi32(Zeros, _mm_cmpeq_epi32(Diff, _mm_setzero_si128()));
+	}
+	// a zero field costs 1 bit instead of 8
+	__m128i Sum = _mm_sub_epi32(_mm_slli_epi32(Extra, 3), _mm_sub_epi32(_mm_slli_epi32(Zeros, 3), Zeros));
+	Sum = _mm_add_epi32(Sum, _mm_srli_si128(Sum, 8));
+	Sum = _mm_add_epi32(Sum, _mm_srli_si128(Sum, 4));
+	return i*8 + _mm_cvtsi128_si32(Sum) + UndiffItemScalar(pPast+i, pDiff+i, pOut+i, Size-i);
+}
+#elif defined(CONF_SNAPSHOT_NEON)
+int CSnapshotDelta::DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size)
+{
+	uint32x4_t Needed = vdupq_n_u32(0);
+	int i = 0;
+	for(; i+4 <= Size; i += 4)
+	{
+		int32x4_t Diff = vsubq_s32(vld1q_s32(pCurrent+i), vld1q_s32(pPast+i));
+		vst1q_s32(pOut+i, Diff);
+		Needed = vorrq_u32(Needed, vreinterpretq_u32_s32(Diff));
+	}
+	uint32x2_t Half = vorr_u32(vget_low_u32(Needed), vget_high_u32(Needed));
+	return (int)(vget_lane_u32(Half, 0) | vget_lane_u32(Half, 1)) | DiffItemScalar(pPast+i, pCurrent+i, pOut+i, Size-i);
+}
+
+int CSnapshotDelta::UndiffItem(const int *pPast, const int *pDiff, int *pOut, int Size)
+{
+	// the packed size is 1 byte plus one for each threshold the magnitude reaches
+	const int32x4_t Limit1 = vdupq_n_s32((1<<6)-1);
+	const int32x4_t Limit2 = vdupq_n_s32((1<<13)-1);
+	const int32x4_t Limit3 = vdupq_n_s32((1<<20)-1);
+	const int32x4_t Limit4 = vdupq_n_s32((1<<27)-1);
+	int32x4_t Extra = vdupq_n_s32(0);
+	int32x4_t Zeros = vdupq_n_s32(0);
+	int i = 0;
+	for(; i+4 <= Size; i += 4)
+	{
+		int32x4_t Diff = vld1q_s32(pDiff+i);
+		vst1q_s32(pOut+i, vaddq_s32(vld1q_s32(pPast+i), Diff));
+
+		int32x4_t Magnitude = veorq_s32(Diff, vshrq_n_s32(Diff, 31));
+		Extra = vsubq_s32(Extra, vreinterpretq_s32_u32(vcgtq_s32(Magnitude, Limit1)));
+		Extra = vsubq_s32(Extra, vreinterpretq_s32_u32(vcgtq_s32(Magnitude, Limit2)));
+		Extra = vsubq_s32(Extra, vreinterpretq_s32_u32(vcgtq_s32(Magnitude, Limit3)));
+		Extra = vsubq_s32(Extra, vreinterpretq_s32_u32(vcgtq_s32(Magnitude, Limit4)));
+		Zeros = vsubq_s32(Zeros, vreinterpretq_s32_u32(vceqq_s32(Diff, vdupq_n_s32(0))));
+	}
+	// a zero field costs 1 bit instead of 8
+	int32x4_t Sum = vsubq_s32(vshlq_n_s32(Extra, 3), vsubq_s32(vshlq_n_s32(Zeros, 3), Zeros));
+	int32x2_t Half = vadd_s32(vget_low_s32(Sum), vget_high_s32(Sum));
+	return i*8 + vget_lane_s32(Half, 0) + vget_lane_s32(Half, 1) + UndiffItemScalar(pPast+i, pDiff+i, pOut+i, Size-i);
+}
+#else
+int CSnapshotDelta::DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size)
+{
+	return DiffItemScalar(pPast, pCurrent, pOut, Size);
 }
 
+int CSnapshotDelta::UndiffItem(const int *pPast, const int *pDiff, int *pOut, int Size)
+{
+	return UndiffItemScalar(pPast, pDiff, pOut, Size);
+}
+#endif
+
 CSnapshotDelta::CSnapshotDelta()
 {
 	mem_zero(m_aItemSizes, sizeof(m_aItemSizes));
+	mem_zero(m_aaFieldBits, sizeof(m_aaFieldBits));
 	mem_zero(m_aSnapshotDataRate, sizeof(m_aSnapshotDataRate));
 	mem_zero(m_aSnapshotDataUpdates, sizeof(m_aSnapshotDataUpdates));
 	m_SnapshotCurrent = 0;
@@ -177,13 +347,33 @@ void CSnapshotDelta::SetStaticsize(int ItemType, int Size)
 	m_aItemSizes[ItemType] = Size;
 }
 
+void CSnapshotDelta::SetFieldBits(int ItemType, const unsigned char *pBits, int Num)
+{
+	if(ItemType < 0 || ItemType >= MAX_NETOBJSIZES)
+		return;
+	mem_zero(m_aaFieldBits[ItemType], sizeof(m_aaFieldBits[ItemType]));
+	mem_copy(m_aaFieldBits[ItemType], pBits, min(Num, (int)MAX_FIELDS));
+}
+
+unsigned CSnapshotDelta::FieldBitsHash() const
+{
+	// fnv-1a
+	unsigned Hash = 2166136261u;
+	for(int i = 0; i < MAX_NETOBJSIZES; i++)
+	{
+		Hash = (Hash^(unsigned short)m_aItemSizes[i])*16777619u;
+		for(int f = 0; f < MAX_FIELDS; f++)
+			Hash = (Hash^m_aaFieldBits[i][f])*16777619u;
+	}
+	return Hash;
+}
+
 CSnapshotDelta::CData *CSnapshotDelta::EmptyDelta()
 {
 	return &m_Empty;
 }
 
-// TODO: OPT: this should be made much faster
-int CSnapshotDelta::CreateDelta(const CSnapshot *pFrom, CSnapshot *pTo, void *pDstData)
+int CSnapshotDelta::CreateDelta(const CSnapshot *pFrom, CSnapshot *pTo, void *pDstData, const CSnapshotHash *pFromHash)
 {
 	CData *pDelta = (CData *)pDstData;
 	int *pData = (int *)pDelta->m_pData;
@@ -197,24 +387,18 @@ int CSnapshotDelta::CreateDelta(const CSnapshot *pFrom, CSnapshot *pTo, void *pD
 	pDelta->m_NumUpdateItems = 0;
 	pDelta->m_NumTempItems = 0;
 
-	CItemList Hashlist[HASHLIST_SIZE];
-	GenerateHash(Hashlist, pTo);
-
-	// pack deleted stuff
-	for(i = 0; i < pFrom->NumItems(); i++)
+	// hash the base unless the caller has it cached
+	int aHashData[CSnapshotHash::MAX_SIZE/sizeof(int)];
+	if(!pFromHash)
 	{
-		pFromItem = pFrom->GetItem(i);
-		if(GetItemIndexHashed(pFromItem->Key(), Hashlist) == -1)
-		{
-			// deleted
-			pDelta->m_NumDeletedItems++;
-			*pData = pFromItem->Key();
-			pData++;
-		}
+		CSnapshotHash *pHash = (CSnapshotHash *)aHashData;
+		pHash->Build(pFrom);
+		pFromHash = pHash;
 	}
 
-	GenerateHash(Hashlist, pFrom);
 	int aPastIndecies[1024];
+	bool aFromKept[1024];
+	mem_zero(aFromKept, sizeof(bool)*pFrom->NumItems());
 
 	// fetch previous indices
 	// we do this as a separate pass because it helps the cache
@@ -222,7 +406,22 @@ int CSnapshotDelta::CreateDelta(const CSnapshot *pFrom, CSnapshot *pTo, void *pD
 	for(i = 0; i < NumItems; i++)
 	{
 		pCurItem = pTo->GetItem(i); // O(1) .. O(n)
-		aPastIndecies[i] = GetItemIndexHashed(pCurItem->Key(), Hashlist); // O(n) .. O(n^n)
+		aPastIndecies[i] = pFromHash->Find(pCurItem->Key());
+		if(aPastIndecies[i] != -1)
+			aFromKept[aPastIndecies[i]] = true;
+	}
+
+	// pack deleted stuff
+	for(i = 0; i < pFrom->NumItems(); i++)
+	{
+		if(!aFromKept[i])
+		{
+			// deleted
+			pFromItem = pFrom->GetItem(i);
+			pDelta->m_NumDeletedItems++;
+			*pData = pFromItem->Key();
+			pData++;
+		}
 	}
 
 	for(i = 0; i < NumItems; i++)
@@ -386,7 +585,7 @@ int CSnapshotDelta::UnpackDelta(const CSnapshot *pFrom, CSnapshot *pTo, const vo
 		if(FromIndex != -1)
 		{
 			// we got an update so we need to apply the diff
-			UndiffItem(pFrom->GetItem(FromIndex)->Data(), pData, pNewData, ItemSize/4);
+			m_aSnapshotDataRate[m_SnapshotCurrent] += UndiffItem(pFrom->GetItem(FromIndex)->Data(), pData, pNewData, ItemSize/4);
 			m_aSnapshotDataUpdates[m_SnapshotCurrent]++;
 		}
 		else // no previous, just copy the pData
@@ -403,13 +602,455 @@ int CSnapshotDelta::UnpackDelta(const CSnapshot *pFrom, CSnapshot *pTo, const vo
 	return Builder.Finish(pTo);
 }
 
+// bits are written from the lowest one up
+class CBitWriter
+{
+	unsigned char *m_pDst;
+	unsigned char *m_pEnd;
+	uint64 m_Bits;
+	int m_NumBits;
+	bool m_Error;
+
+public:
+	CBitWriter(void *pDst, int Size) : m_pDst((unsigned char *)pDst), m_pEnd((unsigned char *)pDst+Size), m_Bits(0), m_NumBits(0), m_Error(false) {}
+
+	void Write(unsigned Value, int NumBits)
+	{
+		if(NumBits < 32)
+			Value &= (1u<<NumBits)-1;
+		m_Bits |= (uint64)Value<<m_NumBits;
+		m_NumBits += NumBits;
+		while(m_NumBits >= 8)
+		{
+			if(m_pDst == m_pEnd)
+			{
+				m_Error = true;
+				return;
+			}
+			*m_pDst++ = (unsigned char)m_Bits;
+			m_Bits >>= 8;
+			m_NumBits -= 8;
+		}
+	}
+
+	// exp-golomb code, small values take few bits
+	void WriteUnsigned(unsigned Value)
+	{
+		uint64 v = (uint64)Value+1;
+		int n = 0;
+		while(v>>(n+1))
+			n++;
+		Write(0, n);
+		Write(1, 1);
+		Write((unsigned)v, n);
+	}
+
+	void WriteSigned(int Value) { WriteUnsigned(((unsigned)Value<<1)^(unsigned)(Value>>31)); }
+
+	// returns the end of the data, 0 if it didn't fit
+	unsigned char *Finish()
+	{
+		if(m_NumBits)
+			Write(0, 8-m_NumBits);
+		return m_Error ? 0 : m_pDst;
+	}
+};
+
+class CBitReader
+{
+	const unsigned char *m_pSrc;
+	const unsigned char *m_pEnd;
+	uint64 m_Bits;
+	int m_NumBits;
+	bool m_Error;
+
+public:
+	CBitReader(const void *pSrc, int Size) : m_pSrc((const unsigned char *)pSrc), m_pEnd((const unsigned char *)pSrc+Size), m_Bits(0), m_NumBits(0), m_Error(false) {}
+
+	bool Error() const { return m_Error; }
+
+	unsigned Read(int NumBits)
+	{
+		while(m_NumBits < NumBits)
+		{
+			if(m_pSrc == m_pEnd)
+			{
+				m_Error = true;
+				return 0;
+			}
+			m_Bits |= (uint64)*m_pSrc++<<m_NumBits;
+			m_NumBits += 8;
+		}
+		unsigned Value = (unsigned)(m_Bits&(((uint64)1<<NumBits)-1));
+		m_Bits >>= NumBits;
+		m_NumBits -= NumBits;
+		return Value;
+	}
+
+	unsigned ReadUnsigned()
+	{
+		int n = 0;
+		while(!Read(1))
+		{
+			if(m_Error || ++n > 32)
+			{
+				m_Error = true;
+				return 0;
+			}
+		}
+		return (unsigned)((((uint64)1<<n)|Read(n))-1);
+	}
+
+	int ReadSigned()
+	{
+		unsigned v = ReadUnsigned();
+		return (int)(v>>1)^-(int)(v&1);
+	}
+};
+
+// a changed field takes a bit for "changed" and then its bits. values that don't fit
+// write the smallest value of the width and follow with an exp-golomb code
+static void WriteField(CBitWriter *pWriter, int Value, int NumBits)
+{
+	if(!Value)
+	{
+		pWriter->Write(0, 1);
+		return;
+	}
+	pWriter->Write(1, 1);
+	if(NumBits <= 0 || NumBits >= 32)
+	{
+		pWriter->WriteSigned(Value);
+		return;
+	}
+	int Limit = (1<<(NumBits-1))-1;
+	if(Value >= -Limit && Value <= Limit)
+		pWriter->Write((unsigned)Value, NumBits);
+	else
+	{
+		pWriter->Write(1u<<(NumBits-1), NumBits);
+		pWriter->WriteSigned(Value);
+	}
+}
+
+static int ReadField(CBitReader *pReader, int NumBits)
+{
+	if(!pReader->Read(1))
+		return 0;
+	if(NumBits <= 0 || NumBits >= 32)
+		return pReader->ReadSigned();
+	unsigned Bits = pReader->Read(NumBits);
+	if(Bits == 1u<<(NumBits-1))
+		return pReader->ReadSigned();
+	// sign extend
+	return (int)(Bits<<(32-NumBits))>>(32-NumBits);
+}
+
+int CSnapshotDelta::PackBits(const void *pDelta, int DeltaSize, void *pDst, int DstSize) const
+{
+	if(DstSize < 1)
+		return -1;
+	unsigned char *pPacking = (unsigned char *)pDst;
+	const CData *pData = (const CData *)pDelta;
+	const int *pInt = pData->m_pData;
+	const int *pEnd = (const int *)((const char *)pDelta+DeltaSize);
+	CBitWriter Writer(pPacking+1, DstSize-1);
+
+	Writer.WriteUnsigned(pData->m_NumDeletedItems);
+	Writer.WriteUnsigned(pData->m_NumUpdateItems);
+	Writer.WriteUnsigned(pData->m_NumTempItems);
+	if(pData->m_NumDeletedItems < 0 || pData->m_NumUpdateItems < 0 || pInt+pData->m_NumDeletedItems > pEnd)
+		return -1;
+
+	// keys come sorted, so their differences are small
+	int PrevKey = 0;
+	for(int i = 0; i < pData->m_NumDeletedItems; i++)
+	{
+		Writer.WriteSigned((int)((unsigned)*pInt-(unsigned)PrevKey));
+		PrevKey = *pInt++;
+	}
+
+	int PrevType = 0;
+	int PrevID = -1;
+	for(int i = 0; i < pData->m_NumUpdateItems; i++)
+	{
+		if(pInt+2 > pEnd)
+			return -1;
+		int Type = *pInt++;
+		int ID = *pInt++;
+		Writer.WriteSigned((int)((unsigned)Type-(unsigned)PrevType));
+		Writer.WriteSigned(Type == PrevType ? (int)((unsigned)ID-(unsigned)PrevID-1) : ID);
+		PrevType = Type;
+		PrevID = ID;
+
+		const bool Static = Type >= 0 && Type < MAX_NETOBJSIZES && m_aItemSizes[Type];
+		int NumFields;
+		if(Static)
+			NumFields = m_aItemSizes[Type]/4;
+		else
+		{
+			if(pInt+1 > pEnd || *pInt < 0)
+				return -1;
+			NumFields = *pInt++;
+			Writer.WriteUnsigned(NumFields);
+		}
+		if(pInt+NumFields > pEnd)
+			return -1;
+
+		const unsigned char *pBits = Type >= 0 && Type < MAX_NETOBJSIZES ? m_aaFieldBits[Type] : 0;
+		for(int f = 0; f < NumFields; f++)
+			WriteField(&Writer, pInt[f], pBits && f < MAX_FIELDS ? pBits[f] : 0);
+		pInt += NumFields;
+	}
+
+	unsigned char *pPackedEnd = Writer.Finish();
+	if(pPackedEnd)
+	{
+		pPacking[0] = PACKING_BITS;
+		return pPackedEnd-pPacking;
+	}
+
+	pPacking[0] = PACKING_VARINT;
+	long Size = CVariableInt::Compress(pDelta, DeltaSize, pPacking+1, DstSize-1);
+	return Size < 0 ? -1 : Size+1;
+}
+
+int CSnapshotDelta::UnpackBits(const void *pSrc, int SrcSize, void *pDelta, int DeltaSize) const
+{
+	if(SrcSize < 1)
+		return -1;
+	const unsigned char *pPacking = (const unsigned char *)pSrc;
+	if(pPacking[0] == PACKING_VARINT)
+		return CVariableInt::Decompress(pPacking+1, SrcSize-1, pDelta, DeltaSize);
+	if(pPacking[0] != PACKING_BITS || DeltaSize < (int)sizeof(int)*3)
+		return -1;
+
+	CData *pData = (CData *)pDelta;
+	int *pInt = pData->m_pData;
+	const int *pEnd = (const int *)((char *)pDelta+DeltaSize);
+	CBitReader Reader(pPacking+1, SrcSize-1);
+
+	pData->m_NumDeletedItems = (int)Reader.ReadUnsigned();
+	pData->m_NumUpdateItems = (int)Reader.ReadUnsigned();
+	pData->m_NumTempItems = (int)Reader.ReadUnsigned();
+	if(Reader.Error() || pData->m_NumDeletedItems < 0 || pData->m_NumUpdateItems < 0 || pData->m_NumDeletedItems > pEnd-pInt)
+		return -1;
+
+	int PrevKey = 0;
+	for(int i = 0; i < pData->m_NumDeletedItems; i++)
+	{
+		PrevKey = (int)((unsigned)PrevKey+(unsigned)Reader.ReadSigned());
+		*pInt++ = PrevKey;
+	}
+
+	int PrevType = 0;
+	int PrevID = -1;
+	for(int i = 0; i < pData->m_NumUpdateItems; i++)
+	{
+		int Type = (int)((unsigned)PrevType+(unsigned)Reader.ReadSigned());
+		int ID = Reader.ReadSigned();
+		if(Type == PrevType)
+			ID = (int)((unsigned)ID+(unsigned)PrevID+1);
+		PrevType = Type;
+		PrevID = ID;
+		if(Reader.Error() || pEnd-pInt < 3)
+			return -1;
+		*pInt++ = Type;
+		*pInt++ = ID;
+
+		const bool Static = Type >= 0 && Type < MAX_NETOBJSIZES && m_aItemSizes[Type];
+		int NumFields;
+		if(Static)
+			NumFields = m_aItemSizes[Type]/4;
+		else
+		{
+			NumFields = (int)Reader.ReadUnsigned();
+			*pInt++ = NumFields;
+		}
+		if(Reader.Error() || NumFields < 0 || NumFields > pEnd-pInt)
+			return -1;
+
+		const unsigned char *pBits = Type >= 0 && Type < MAX_NETOBJSIZES ? m_aaFieldBits[Type] : 0;
+		for(int f = 0; f < NumFields; f++)
+			*pInt++ = ReadField(&Reader, pBits && f < MAX_FIELDS ? pBits[f] : 0);
+		if(Reader.Error())
+			return -1;
+	}
+
+	return (char *)pInt-(char *)pDelta;
+}
+
+
+// CSnapshotBlocks
+
+void CSnapshotBlocks::Init()
+{
+	for(int i = 0; i < NUM_BLOCK_CLASSES; i++)
+		m_apFreeBlocks[i] = 0;
+	m_AllocatedSize = 0;
+	m_HighWaterMark = 0;
+}
+
+void *CSnapshotBlocks::Alloc(int Size, int *pClass)
+{
+	int Class = 0;
+	while((MIN_BLOCK_SIZE<<Class) < Size)
+		Class++;
+	dbg_assert(Class < NUM_BLOCK_CLASSES, "snapshot block too big");
+
+	// reuse a block of the same size if we have one
+	void *pBlock = m_apFreeBlocks[Class];
+	if(pBlock)
+		m_apFreeBlocks[Class] = *(void **)pBlock;
+	else
+	{
+		pBlock = mem_alloc_tag(MIN_BLOCK_SIZE<<Class, 1, MEMTAG_SNAPSHOT);
+		m_AllocatedSize += MIN_BLOCK_SIZE<<Class;
+		if(m_AllocatedSize > m_HighWaterMark)
+			m_HighWaterMark = m_AllocatedSize;
+	}
+	*pClass = Class;
+	return pBlock;
+}
+
+void CSnapshotBlocks::Free(void *pBlock, int Class)
+{
+	*(void **)pBlock = m_apFreeBlocks[Class];
+	m_apFreeBlocks[Class] = pBlock;
+}
+
+void CSnapshotBlocks::ReleaseFree()
+{
+	for(int i = 0; i < NUM_BLOCK_CLASSES; i++)
+	{
+		while(m_apFreeBlocks[i])
+		{
+			void *pNext = *(void **)m_apFreeBlocks[i];
+			mem_free(m_apFreeBlocks[i]);
+			m_AllocatedSize -= MIN_BLOCK_SIZE<<i;
+			m_apFreeBlocks[i] = pNext;
+		}
+	}
+}
+
+// CSnapshotPool
+
+CSnapshotPool::CSnapshotPool()
+{
+	mem_zero(m_apBuckets, sizeof(m_apBuckets));
+	m_Blocks.Init();
+	m_NumEntries = 0;
+	m_Lock = lock_create();
+}
+
+CSnapshotPool::~CSnapshotPool()
+{
+	for(int i = 0; i < NUM_BUCKETS; i++)
+	{
+		while(m_apBuckets[i])
+		{
+			CEntry *pNext = m_apBuckets[i]->m_pNext;
+			FreeEntry(m_apBuckets[i]);
+			m_apBuckets[i] = pNext;
+		}
+	}
+	m_Blocks.ReleaseFree();
+	lock_destroy(m_Lock);
+}
+
+void CSnapshotPool::FreeEntry(CEntry *pEntry)
+{
+	if(pEntry->m_pHash)
+		m_Blocks.Free(pEntry->m_pHash, pEntry->m_HashBlockClass);
+	m_Blocks.Free(pEntry, pEntry->m_BlockClass);
+}
+
+CSnapshot *CSnapshotPool::Acquire(const CSnapshot *pSnap, int DataSize)
+{
+	int Crc = pSnap->Crc();
+	CEntry **ppBucket = &m_apBuckets[(unsigned)Crc%NUM_BUCKETS];
+
+	lock_wait(m_Lock);
+
+	// the crc is only a sum, compare the data too
+	for(CEntry *pEntry = *ppBucket; pEntry; pEntry = pEntry->m_pNext)
+	{
+		if(pEntry->m_Crc == Crc && pEntry->m_Size == DataSize && mem_comp(pEntry->Snap(), pSnap, DataSize) == 0)
+		{
+			pEntry->m_Refs++;
+			lock_unlock(m_Lock);
+			return pEntry->Snap();
+		}
+	}
+
+	int BlockClass;
+	CEntry *pEntry = (CEntry *)m_Blocks.Alloc(sizeof(CEntry)+DataSize, &BlockClass);
+	pEntry->m_pHash = 0;
+	pEntry->m_Refs = 1;
+	pEntry->m_Crc = Crc;
+	pEntry->m_Size = DataSize;
+	pEntry->m_BlockClass = BlockClass;
+	mem_copy(pEntry->Snap(), pSnap, DataSize);
+	pEntry->m_pNext = *ppBucket;
+	*ppBucket = pEntry;
+	m_NumEntries++;
+
+	lock_unlock(m_Lock);
+	return pEntry->Snap();
+}
+
+void CSnapshotPool::Release(CSnapshot *pSnap)
+{
+	CEntry *pEntry = GetEntry(pSnap);
+
+	lock_wait(m_Lock);
+	if(--pEntry->m_Refs == 0)
+	{
+		CEntry **ppEntry = &m_apBuckets[(unsigned)pEntry->m_Crc%NUM_BUCKETS];
+		while(*ppEntry != pEntry)
+			ppEntry = &(*ppEntry)->m_pNext;
+		*ppEntry = pEntry->m_pNext;
+		FreeEntry(pEntry);
+
+		// no more snapshots in the pool, give the memory back
+		if(--m_NumEntries == 0)
+			m_Blocks.ReleaseFree();
+	}
+	lock_unlock(m_Lock);
+}
+
+const CSnapshotHash *CSnapshotPool::GetHash(CSnapshot *pSnap)
+{
+	CEntry *pEntry = GetEntry(pSnap);
+
+	lock_wait(m_Lock);
+	if(!pEntry->m_pHash)
+	{
+		pEntry->m_pHash = (CSnapshotHash *)m_Blocks.Alloc(CSnapshotHash::TotalSize(pSnap->NumItems()), &pEntry->m_HashBlockClass);
+		pEntry->m_pHash->Build(pSnap);
+	}
+	const CSnapshotHash *pHash = pEntry->m_pHash;
+	lock_unlock(m_Lock);
+	return pHash;
+}
 
 // CSnapshotStorage
 
-void CSnapshotStorage::Init()
+void CSnapshotStorage::Init(CSnapshotPool *pPool)
 {
 	m_pFirst = 0;
 	m_pLast = 0;
+	m_pPool = pPool;
+	m_Blocks.Init();
+}
+
+void CSnapshotStorage::FreeHolder(CHolder *pHolder)
+{
+	if(m_pPool)
+		m_pPool->Release(pHolder->m_pSnap);
+	if(pHolder->m_pHash)
+		m_Blocks.Free(pHolder->m_pHash, pHolder->m_HashBlockClass);
+	m_Blocks.Free(pHolder, pHolder->m_BlockClass);
 }
 
 void CSnapshotStorage::PurgeAll()
@@ -420,13 +1061,14 @@ void CSnapshotStorage::PurgeAll()
 	while(pHolder)
 	{
 		pNext = pHolder->m_pNext;
-		mem_free(pHolder);
+		FreeHolder(pHolder);
 		pHolder = pNext;
 	}
 
-	// no more snapshots in storage
+	// no more snapshots in storage, give the memory back
 	m_pFirst = 0;
 	m_pLast = 0;
+	m_Blocks.ReleaseFree();
 }
 
 void CSnapshotStorage::PurgeUntil(int Tick)
@@ -439,7 +1081,7 @@ void CSnapshotStorage::PurgeUntil(int Tick)
 		pNext = pHolder->m_pNext;
 		if(pHolder->m_Tick >= Tick)
 			return; // no more to remove
-		mem_free(pHolder);
+		FreeHolder(pHolder);
 
 		// did we come to the end of the list?
 		if (!pNext)
@@ -458,24 +1100,34 @@ void CSnapshotStorage::PurgeUntil(int Tick)
 
 void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt)
 {
-	// allocate memory for holder + snapshot_data
-	int TotalSize = sizeof(CHolder)+DataSize;
+	// allocate memory for holder + snapshot_data, pooled snapshots live in the pool
+	int TotalSize = sizeof(CHolder);
+	if(!m_pPool)
+		TotalSize += DataSize;
 
 	if(CreateAlt)
 		TotalSize += DataSize;
 
-	CHolder *pHolder = (CHolder *)mem_alloc(TotalSize, 1);
+	int BlockClass;
+	CHolder *pHolder = (CHolder *)m_Blocks.Alloc(TotalSize, &BlockClass);
 
 	// set data
+	pHolder->m_BlockClass = BlockClass;
+	pHolder->m_pHash = 0;
 	pHolder->m_Tick = Tick;
 	pHolder->m_Tagtime = Tagtime;
 	pHolder->m_SnapSize = DataSize;
-	pHolder->m_pSnap = (CSnapshot*)(pHolder+1);
-	mem_copy(pHolder->m_pSnap, pData, DataSize);
+	if(m_pPool)
+		pHolder->m_pSnap = m_pPool->Acquire((const CSnapshot *)pData, DataSize);
+	else
+	{
+		pHolder->m_pSnap = (CSnapshot*)(pHolder+1);
+		mem_copy(pHolder->m_pSnap, pData, DataSize);
+	}
 
 	if(CreateAlt) // create alternative if wanted
 	{
-		pHolder->m_pAltSnap = (CSnapshot*)(((char *)pHolder->m_pSnap) + DataSize);
+		pHolder->m_pAltSnap = (CSnapshot*)(((char *)(pHolder+1)) + (m_pPool ? 0 : DataSize));
 		mem_copy(pHolder->m_pAltSnap, pData, DataSize);
 	}
 	else
@@ -492,7 +1144,7 @@ void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, i
 	m_pLast = pHolder;
 }
 
-int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData)
+int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData, const CSnapshotHash **ppHash)
 {
 	CHolder *pHolder = m_pFirst;
 
@@ -506,6 +1158,20 @@ int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapsh
 				*ppData = pHolder->m_pSnap;
 			if(ppAltData)
 				*ppAltData = pHolder->m_pAltSnap;
+			if(ppHash)
+			{
+				if(m_pPool)
+					*ppHash = m_pPool->GetHash(pHolder->m_pSnap);
+				else
+				{
+					if(!pHolder->m_pHash)
+					{
+						pHolder->m_pHash = (CSnapshotHash *)m_Blocks.Alloc(CSnapshotHash::TotalSize(pHolder->m_pSnap->NumItems()), &pHolder->m_HashBlockClass);
+						pHolder->m_pHash->Build(pHolder->m_pSnap);
+					}
+					*ppHash = pHolder->m_pHash;
+				}
+			}
 			return pHolder->m_SnapSize;
 		}
 
@@ -517,10 +1183,31 @@ int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapsh
 
 // CSnapshotBuilder
 
+void CSnapshotBuilder::ClearKeys()
+{
+	mem_zero(m_aKeySlots, sizeof(m_aKeySlots));
+}
+
+void CSnapshotBuilder::AddKey(int Index)
+{
+	unsigned Slot = HashKey(GetItem(Index)->Key())&(KEY_SLOTS-1);
+	while(m_aKeySlots[Slot])
+		Slot = (Slot+1)&(KEY_SLOTS-1);
+	m_aKeySlots[Slot] = Index+1;
+}
+
+void CSnapshotBuilder::BuildKeys()
+{
+	ClearKeys();
+	for(int i = 0; i < m_NumItems; i++)
+		AddKey(i);
+}
+
 void CSnapshotBuilder::Init()
 {
 	m_DataSize = 0;
 	m_NumItems = 0;
+	ClearKeys();
 }
 
 void CSnapshotBuilder::Init(const CSnapshot *pSnapshot)
@@ -531,8 +1218,7 @@ void CSnapshotBuilder::Init(const CSnapshot *pSnapshot)
 		dbg_assert(m_DataSize + sizeof(CSnapshot) + m_NumItems * sizeof(int)*2 < CSnapshot::MAX_SIZE, "too much data");
 		dbg_assert(m_NumItems < MAX_ITEMS, "too many items");
 		dbg_msg("snapshot", "invalid snapshot"); // remove me
-		m_DataSize = 0;
-		m_NumItems = 0;
+		Init();
 		return;
 	}
 
@@ -540,12 +1226,12 @@ void CSnapshotBuilder::Init(const CSnapshot *pSnapshot)
 	m_NumItems = pSnapshot->m_NumItems;
 	mem_copy(m_aOffsets, pSnapshot->Offsets(), sizeof(int)*m_NumItems);
 	mem_copy(m_aData, pSnapshot->DataStart(), m_DataSize);
+	BuildKeys();
 }
 
 bool CSnapshotBuilder::UnserializeSnap(const char *pSrcData, int SrcSize)
 {
-	m_DataSize = 0;
-	m_NumItems = 0;
+	Init();
 
 	const int *pData = (const int*)pSrcData;
 	if(SrcSize < (int)sizeof(int)*2)
@@ -573,6 +1259,7 @@ bool CSnapshotBuilder::UnserializeSnap(const char *pSrcData, int SrcSize)
 	m_NumItems = NumItems;
 	mem_copy(m_aOffsets, pOffsets, sizeof(int)*m_NumItems);
 	mem_copy(m_aData, pOffsets+m_NumItems, m_DataSize);
+	BuildKeys();
 	return true;
 }
 
@@ -581,13 +1268,23 @@ CSnapshotItem *CSnapshotBuilder::GetItem(int Index)
 	return (CSnapshotItem *)&(m_aData[m_aOffsets[Index]]);
 }
 
+int CSnapshotBuilder::GetItemSize(int Index) const
+{
+	if(Index == m_NumItems-1)
+		return (m_DataSize - m_aOffsets[Index]) - sizeof(CSnapshotItem);
+	return (m_aOffsets[Index+1] - m_aOffsets[Index]) - sizeof(CSnapshotItem);
+}
+
 int *CSnapshotBuilder::GetItemData(int Key)
 {
-	int i;
-	for(i = 0; i < m_NumItems; i++)
+	// items with the same key are found in the order they were added
+	unsigned Slot = HashKey(Key)&(KEY_SLOTS-1);
+	while(m_aKeySlots[Slot])
 	{
-		if(GetItem(i)->Key() == Key)
-			return GetItem(i)->Data();
+		CSnapshotItem *pItem = GetItem(m_aKeySlots[Slot]-1);
+		if(pItem->Key() == Key)
+			return pItem->Data();
+		Slot = (Slot+1)&(KEY_SLOTS-1);
 	}
 	return 0;
 }
@@ -624,6 +1321,7 @@ int CSnapshotBuilder::Finish(void *pSnapdata)
 
 	// bubble sort by keys
 	bool Sorting = true;
+	bool Sorted = false;
 	while(Sorting)
 	{
 		Sorting = false;
@@ -633,6 +1331,7 @@ int CSnapshotBuilder::Finish(void *pSnapdata)
 			if(pSnap->SortedKeys()[i-1] > pSnap->SortedKeys()[i])
 			{
 				Sorting = true;
+				Sorted = true;
 				tl_swap(pSnap->SortedKeys()[i], pSnap->SortedKeys()[i-1]);
 				tl_swap(m_aOffsets[i], m_aOffsets[i-1]);
 				tl_swap(aItemSizes[i], aItemSizes[i-1]);
@@ -649,6 +1348,10 @@ int CSnapshotBuilder::Finish(void *pSnapdata)
 		OffsetCur += aItemSizes[i];
 	}
 
+	// the sort moved the items around
+	if(Sorted)
+		BuildKeys();
+
 	return sizeof(CSnapshot) + KeySize + OffsetSize + m_DataSize;
 }
 
@@ -669,6 +1372,7 @@ void *CSnapshotBuilder::NewItem(int Type, int ID, int Size)
 	pObj->SetKey(Type, ID);
 	m_aOffsets[m_NumItems] = m_DataSize;
 	m_DataSize += sizeof(CSnapshotItem) + Size;
+	AddKey(m_NumItems);
 	m_NumItems++;
 
 	return pObj->Data();
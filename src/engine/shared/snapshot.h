@@ -50,11 +50,38 @@ public:
 
 	int Serialize(char *pDstData);
 
+	// both snapshots' items in one, on equal keys only the item of the first.
+	// returns the size or -1 if it doesn't fit
+	static int Merge(const CSnapshot *pFirst, const CSnapshot *pSecond, void *pDstData);
+
 	int Crc() const;
 	void DebugDump() const;
 };
 
 
+// CSnapshotHash
+
+// maps the item keys of a snapshot to their index, using open addressing
+class CSnapshotHash
+{
+	int m_Mask;
+
+	int *Slots() { return (int *)(this+1); } // key and index per slot
+	const int *Slots() const { return (const int *)(this+1); }
+
+public:
+	enum
+	{
+		MAX_SLOTS = 2048,
+		MAX_SIZE = sizeof(int) + MAX_SLOTS*2*sizeof(int)
+	};
+
+	static int TotalSize(int NumItems);
+	void Build(const CSnapshot *pSnapshot);
+	int Find(int Key) const;
+};
+
+
 // CSnapshotDelta
 
 class CSnapshotDelta
@@ -69,27 +96,128 @@ public:
 		int m_pData[1];
 	};
 
+	enum
+	{
+		MAX_FIELDS=64,
+
+		// first byte of PackBits data
+		PACKING_VARINT=0,
+		PACKING_BITS,
+	};
+
 private:
 	enum
 	{
 		MAX_NETOBJSIZES=64
 	};
 	short m_aItemSizes[MAX_NETOBJSIZES];
+	unsigned char m_aaFieldBits[MAX_NETOBJSIZES][MAX_FIELDS];
 	int m_aSnapshotDataRate[0xffff];
 	int m_aSnapshotDataUpdates[0xffff];
 	int m_SnapshotCurrent;
 	CData m_Empty;
 
-	void UndiffItem(const int *pPast, const int *pDiff, int *pOut, int Size);
-
 public:
+	// item kernels, vectorized where the target has SSE2 or NEON
+	// DiffItem returns non-zero if any field changed, UndiffItem returns the
+	// bits the diff takes when packed, counting unchanged fields as one bit
+	static int DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size);
+	static int UndiffItem(const int *pPast, const int *pDiff, int *pOut, int Size);
+	static int DiffItemScalar(const int *pPast, const int *pCurrent, int *pOut, int Size);
+	static int UndiffItemScalar(const int *pPast, const int *pDiff, int *pOut, int Size);
+
 	CSnapshotDelta();
 	int GetDataRate(int Index) const { return m_aSnapshotDataRate[Index]; }
 	int GetDataUpdates(int Index) const { return m_aSnapshotDataUpdates[Index]; }
 	void SetStaticsize(int ItemType, int Size);
+	// the bits a changed field of the item type takes, 0 for fields that can have any value
+	void SetFieldBits(int ItemType, const unsigned char *pBits, int Num);
+	// both sides have to use the same sizes and bits to bit pack
+	unsigned FieldBitsHash() const;
 	CData *EmptyDelta();
-	int CreateDelta(const class CSnapshot *pFrom, class CSnapshot *pTo, void *pData);
+	int CreateDelta(const class CSnapshot *pFrom, class CSnapshot *pTo, void *pData, const CSnapshotHash *pFromHash = 0);
 	int UnpackDelta(const class CSnapshot *pFrom, class CSnapshot *pTo, const void *pData, int DataSize);
+
+	// packs a delta from CreateDelta with the field bits instead of CVariableInt, falls
+	// back to CVariableInt when the bits don't fit. return the size, -1 on errors
+	int PackBits(const void *pDelta, int DeltaSize, void *pDst, int DstSize) const;
+	int UnpackBits(const void *pSrc, int SrcSize, void *pDelta, int DeltaSize) const;
+};
+
+
+// CSnapshotBlocks
+
+// blocks are pooled in power of two sizes, so the owner stops
+// allocating once it has seen its largest history
+class CSnapshotBlocks
+{
+	enum
+	{
+		MIN_BLOCK_SIZE=64,
+		NUM_BLOCK_CLASSES=13,
+	};
+
+	void *m_apFreeBlocks[NUM_BLOCK_CLASSES];
+	int m_AllocatedSize;
+	int m_HighWaterMark;
+
+public:
+	void Init();
+	void *Alloc(int Size, int *pClass);
+	void Free(void *pBlock, int Class);
+	void ReleaseFree();
+
+	// memory taken from the system, now and at most
+	int AllocatedSize() const { return m_AllocatedSize; }
+	int HighWaterMark() const { return m_HighWaterMark; }
+};
+
+
+// CSnapshotPool
+
+// refcounted snapshots shared between storages, identical snapshots are stored once.
+// safe to use from several threads
+class CSnapshotPool
+{
+	class CEntry
+	{
+	public:
+		CEntry *m_pNext;
+		CSnapshotHash *m_pHash;
+		int m_Refs;
+		int m_Crc;
+		int m_Size;
+		int m_BlockClass;
+		int m_HashBlockClass;
+
+		CSnapshot *Snap() { return (CSnapshot *)(this+1); }
+	};
+
+	enum
+	{
+		NUM_BUCKETS=256,
+	};
+
+	CEntry *m_apBuckets[NUM_BUCKETS];
+	CSnapshotBlocks m_Blocks;
+	int m_NumEntries;
+	LOCK m_Lock;
+
+	static CEntry *GetEntry(const CSnapshot *pSnap) { return (CEntry *)pSnap - 1; }
+	void FreeEntry(CEntry *pEntry);
+
+public:
+	CSnapshotPool();
+	~CSnapshotPool();
+
+	// returns the stored copy of the snapshot with a new reference to it
+	CSnapshot *Acquire(const CSnapshot *pSnap, int DataSize);
+	void Release(CSnapshot *pSnap);
+	const CSnapshotHash *GetHash(CSnapshot *pSnap);
+
+	int NumEntries() const { return m_NumEntries; }
+	int AllocatedSize() const { return m_Blocks.AllocatedSize(); }
+	int HighWaterMark() const { return m_Blocks.HighWaterMark(); }
 };
 
 
@@ -110,32 +238,56 @@ public:
 		int m_SnapSize;
 		CSnapshot *m_pSnap;
 		CSnapshot *m_pAltSnap;
+		CSnapshotHash *m_pHash; // built the first time the snapshot is a delta base
+
+		int m_BlockClass;
+		int m_HashBlockClass;
 	};
 
+private:
+	CSnapshotBlocks m_Blocks;
+	CSnapshotPool *m_pPool; // holders only reference their snapshot when set
+
+	void FreeHolder(CHolder *pHolder);
 
+public:
 	CHolder *m_pFirst;
 	CHolder *m_pLast;
 
-	void Init();
+	void Init(CSnapshotPool *pPool = 0);
 	void PurgeAll();
 	void PurgeUntil(int Tick);
 	void Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt);
-	int Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData);
+	int Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData, const CSnapshotHash **ppHash = 0);
+
+	// memory taken from the system, now and at most
+	int AllocatedSize() const { return m_Blocks.AllocatedSize(); }
+	int HighWaterMark() const { return m_Blocks.HighWaterMark(); }
 };
 
 class CSnapshotBuilder
 {
+public:
 	enum
 	{
-		MAX_ITEMS = 1024
+		MAX_ITEMS = 1024,
+		KEY_SLOTS = MAX_ITEMS*2
 	};
 
+private:
 	char m_aData[CSnapshot::MAX_SIZE];
 	int m_DataSize;
 
 	int m_aOffsets[MAX_ITEMS];
 	int m_NumItems;
 
+	// open addressing from the item keys to their index+1, 0 marks a free slot
+	short m_aKeySlots[KEY_SLOTS];
+
+	void ClearKeys();
+	void AddKey(int Index);
+	void BuildKeys();
+
 public:
 	void Init();
 	void Init(const CSnapshot *pSnapshot);
@@ -144,7 +296,9 @@ public:
 	void *NewItem(int Type, int ID, int Size);
 
 	CSnapshotItem *GetItem(int Index);
+	int GetItemSize(int Index) const;
 	int *GetItemData(int Key);
+	int NumItems() const { return m_NumItems; }
 
 	int Finish(void *pSnapdata);
 };
@@ -1,6 +1,9 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <algorithm>
+
 #include <base/hash_ctxt.h>
+#include <base/math.h>
 #include <base/system.h>
 #include <engine/storage.h>
 #include "linereader.h"
@@ -17,6 +20,27 @@ public:
 		MAX_PATHS = 16
 	};
 
+	// a directory of one storage path as it was when it got listed first
+	struct CListing
+	{
+		struct CEntry
+		{
+			const char *m_pName;
+			int m_NameOffset;
+			int m_IsDir;
+			time_t m_TimeCreated;
+			time_t m_TimeModified;
+		};
+
+		int m_Type;
+		unsigned m_Hash;
+		char m_aPath[IO_MAX_PATH_LENGTH];
+		CEntry *m_pEntries; // sorted by name
+		int m_NumEntries;
+		char *m_pNames;
+		CListing *m_pNext;
+	};
+
 	char m_aaStoragePaths[MAX_PATHS][IO_MAX_PATH_LENGTH];
 	int m_NumPaths;
 	char m_aDataDir[IO_MAX_PATH_LENGTH];
@@ -24,6 +48,12 @@ public:
 	char m_aCurrentDir[IO_MAX_PATH_LENGTH];
 	char m_aAppDir[IO_MAX_PATH_LENGTH];
 
+	bool m_Indexed;
+	CListing *m_pFirstListing;
+	CListing *m_pFirstRetired; // invalidated while a callback ran, freed afterwards
+	int m_ListingDepth;
+	LOCK m_IndexLock; // the loaders open files from the job pool
+
 	CStorage()
 	{
 		mem_zero(m_aaStoragePaths, sizeof(m_aaStoragePaths));
@@ -32,6 +62,17 @@ public:
 		m_aUserDir[0] = 0;
 		m_aCurrentDir[0] = 0;
 		m_aAppDir[0] = 0;
+		m_Indexed = false;
+		m_pFirstListing = 0;
+		m_pFirstRetired = 0;
+		m_ListingDepth = 0;
+		m_IndexLock = lock_create();
+	}
+
+	~CStorage()
+	{
+		Rescan();
+		lock_destroy(m_IndexLock);
 	}
 
 	int Init(const char *pApplicationName, int StorageType, int NumArgs, const char **ppArguments)
@@ -68,6 +109,7 @@ public:
 				{
 					fs_makedir(GetPath(TYPE_SAVE, "screenshots", aPath, sizeof(aPath)));
 					fs_makedir(GetPath(TYPE_SAVE, "screenshots/auto", aPath, sizeof(aPath)));
+					fs_makedir(GetPath(TYPE_SAVE, "captures", aPath, sizeof(aPath)));
 					fs_makedir(GetPath(TYPE_SAVE, "maps", aPath, sizeof(aPath)));
 					fs_makedir(GetPath(TYPE_SAVE, "downloadedmaps", aPath, sizeof(aPath)));
 					fs_makedir(GetPath(TYPE_SAVE, "skins", aPath, sizeof(aPath)));
@@ -116,6 +158,10 @@ public:
 			{
 				AddPath(pLineWithoutPrefix);
 			}
+			else if((pLineWithoutPrefix = str_startswith(pLine, "index_paths ")))
+			{
+				SetIndexed(str_toint(pLineWithoutPrefix) != 0);
+			}
 		}
 
 		io_close(File);
@@ -291,8 +337,265 @@ public:
 		dbg_msg("storage", "warning no data directory found");
 	}
 
+	static bool CompareEntries(const CListing::CEntry &a, const CListing::CEntry &b)
+	{
+#if defined(CONF_FAMILY_WINDOWS)
+		return str_comp_nocase(a.m_pName, b.m_pName) < 0;
+#else
+		return str_comp(a.m_pName, b.m_pName) < 0;
+#endif
+	}
+
+	// the key of a directory, so "maps", "./maps/" and "maps//" share one listing
+	static void NormalizeDir(const char *pDir, char *pBuffer, int BufferSize)
+	{
+		int Length = 0;
+		while(*pDir)
+		{
+			// skip empty and "." components
+			if(*pDir == '/')
+			{
+				pDir++;
+				continue;
+			}
+			if(pDir[0] == '.' && (pDir[1] == '/' || !pDir[1]))
+			{
+				pDir++;
+				continue;
+			}
+			if(Length && Length < BufferSize-1)
+				pBuffer[Length++] = '/';
+			for(; *pDir && *pDir != '/'; pDir++)
+				if(Length < BufferSize-1)
+					pBuffer[Length++] = *pDir;
+		}
+		pBuffer[Length] = 0;
+	}
+
+	struct CCollectData
+	{
+		CListing::CEntry *m_pEntries;
+		int m_NumEntries;
+		int m_MaxEntries;
+		char *m_pNames;
+		int m_NamesSize;
+		int m_MaxNamesSize;
+	};
+
+	static int CollectCallback(const CFsFileInfo *pInfo, int IsDir, int Type, void *pUser)
+	{
+		CCollectData *pData = static_cast<CCollectData *>(pUser);
+		int NameSize = str_length(pInfo->m_pName)+1;
+		if(pData->m_NumEntries == pData->m_MaxEntries)
+		{
+			pData->m_MaxEntries = max(pData->m_MaxEntries*2, 64);
+			CListing::CEntry *pEntries = (CListing::CEntry *)mem_alloc(pData->m_MaxEntries*sizeof(CListing::CEntry), 1);
+			mem_copy(pEntries, pData->m_pEntries, pData->m_NumEntries*sizeof(CListing::CEntry));
+			mem_free(pData->m_pEntries);
+			pData->m_pEntries = pEntries;
+		}
+		if(pData->m_NamesSize+NameSize > pData->m_MaxNamesSize)
+		{
+			pData->m_MaxNamesSize = max(pData->m_MaxNamesSize*2, pData->m_NamesSize+NameSize+1024);
+			char *pNames = (char *)mem_alloc(pData->m_MaxNamesSize, 1);
+			mem_copy(pNames, pData->m_pNames, pData->m_NamesSize);
+			mem_free(pData->m_pNames);
+			pData->m_pNames = pNames;
+		}
+
+		// the name buffer can still move, so only keep the offset for now
+		CListing::CEntry *pEntry = &pData->m_pEntries[pData->m_NumEntries++];
+		pEntry->m_pName = 0;
+		pEntry->m_NameOffset = pData->m_NamesSize;
+		pEntry->m_IsDir = IsDir;
+		pEntry->m_TimeCreated = pInfo->m_TimeCreated;
+		pEntry->m_TimeModified = pInfo->m_TimeModified;
+		mem_copy(pData->m_pNames+pData->m_NamesSize, pInfo->m_pName, NameSize);
+		pData->m_NamesSize += NameSize;
+		return 0;
+	}
+
+	CListing *GetListing(int Type, const char *pPath)
+	{
+		char aDir[IO_MAX_PATH_LENGTH];
+		NormalizeDir(pPath, aDir, sizeof(aDir));
+		unsigned Hash = str_quickhash(aDir);
+		for(CListing *pListing = m_pFirstListing; pListing; pListing = pListing->m_pNext)
+		{
+			if(pListing->m_Type == Type && pListing->m_Hash == Hash && !str_comp(pListing->m_aPath, aDir))
+				return pListing;
+		}
+
+		CCollectData Data;
+		mem_zero(&Data, sizeof(Data));
+		char aBuffer[IO_MAX_PATH_LENGTH];
+		fs_listdir_fileinfo(GetPath(Type, pPath, aBuffer, sizeof(aBuffer)), CollectCallback, Type, &Data);
+		for(int i = 0; i < Data.m_NumEntries; i++)
+			Data.m_pEntries[i].m_pName = Data.m_pNames + Data.m_pEntries[i].m_NameOffset;
+		std::sort(Data.m_pEntries, Data.m_pEntries+Data.m_NumEntries, CompareEntries);
+
+		CListing *pListing = (CListing *)mem_alloc(sizeof(CListing), 1);
+		pListing->m_Type = Type;
+		pListing->m_Hash = Hash;
+		str_copy(pListing->m_aPath, aDir, sizeof(pListing->m_aPath));
+		pListing->m_pEntries = Data.m_pEntries;
+		pListing->m_NumEntries = Data.m_NumEntries;
+		pListing->m_pNames = Data.m_pNames;
+		pListing->m_pNext = m_pFirstListing;
+		m_pFirstListing = pListing;
+		return pListing;
+	}
+
+	bool IsListed(int Type, const char *pFilename)
+	{
+		char aDir[IO_MAX_PATH_LENGTH];
+		str_copy(aDir, pFilename, sizeof(aDir));
+		const char *pName = pFilename;
+		int Slash = -1;
+		for(int i = 0; aDir[i]; i++)
+			if(aDir[i] == '/' || aDir[i] == '\\')
+				Slash = i;
+		if(Slash >= 0)
+		{
+			aDir[Slash] = 0;
+			pName = pFilename+Slash+1;
+		}
+		else
+			aDir[0] = 0;
+
+		lock_wait(m_IndexLock);
+		CListing *pListing = GetListing(Type, aDir);
+		CListing::CEntry Wanted;
+		Wanted.m_pName = pName;
+		CListing::CEntry *pEnd = pListing->m_pEntries+pListing->m_NumEntries;
+		CListing::CEntry *pFound = std::lower_bound(pListing->m_pEntries, pEnd, Wanted, CompareEntries);
+		bool Listed = pFound != pEnd && !CompareEntries(Wanted, *pFound) && !pFound->m_IsDir;
+		lock_unlock(m_IndexLock);
+		return Listed;
+	}
+
+	static void FreeListing(CListing *pListing)
+	{
+		mem_free(pListing->m_pEntries);
+		mem_free(pListing->m_pNames);
+		mem_free(pListing);
+	}
+
+	void RetireListing(CListing *pListing)
+	{
+		if(m_ListingDepth)
+		{
+			pListing->m_pNext = m_pFirstRetired;
+			m_pFirstRetired = pListing;
+		}
+		else
+			FreeListing(pListing);
+	}
+
+	void EndListing()
+	{
+		lock_wait(m_IndexLock);
+		if(--m_ListingDepth == 0)
+		{
+			while(m_pFirstRetired)
+			{
+				CListing *pNext = m_pFirstRetired->m_pNext;
+				FreeListing(m_pFirstRetired);
+				m_pFirstRetired = pNext;
+			}
+		}
+		lock_unlock(m_IndexLock);
+	}
+
+	// drop the listing of the directory that contains pFilename after changing it
+	void InvalidateParent(int Type, const char *pFilename)
+	{
+		if(!m_pFirstListing)
+			return;
+		char aDir[IO_MAX_PATH_LENGTH];
+		str_copy(aDir, pFilename, sizeof(aDir));
+		int Slash = 0;
+		for(int i = 0; aDir[i]; i++)
+			if(aDir[i] == '/' || aDir[i] == '\\')
+				Slash = i;
+		aDir[Slash] = 0;
+		char aKey[IO_MAX_PATH_LENGTH];
+		NormalizeDir(aDir, aKey, sizeof(aKey));
+
+		lock_wait(m_IndexLock);
+		for(CListing **ppListing = &m_pFirstListing; *ppListing; )
+		{
+			CListing *pListing = *ppListing;
+			if(pListing->m_Type == Type && !str_comp(pListing->m_aPath, aKey))
+			{
+				*ppListing = pListing->m_pNext;
+				RetireListing(pListing);
+			}
+			else
+				ppListing = &pListing->m_pNext;
+		}
+		lock_unlock(m_IndexLock);
+	}
+
+	virtual void SetIndexed(bool Indexed)
+	{
+		if(!Indexed)
+			Rescan();
+		m_Indexed = Indexed;
+	}
+
+	virtual void Rescan()
+	{
+		lock_wait(m_IndexLock);
+		while(m_pFirstListing)
+		{
+			CListing *pNext = m_pFirstListing->m_pNext;
+			RetireListing(m_pFirstListing);
+			m_pFirstListing = pNext;
+		}
+		lock_unlock(m_IndexLock);
+	}
+
+	void ListIndexed(int Type, const char *pPath, FS_LISTDIR_CALLBACK pfnCallback, FS_LISTDIR_CALLBACK_FILEINFO pfnInfoCallback, void *pUser)
+	{
+		lock_wait(m_IndexLock);
+		m_ListingDepth++;
+		CListing *pListing = GetListing(Type, pPath);
+		lock_unlock(m_IndexLock);
+		for(int i = 0; i < pListing->m_NumEntries; i++)
+		{
+			const CListing::CEntry *pEntry = &pListing->m_pEntries[i];
+			int Stop;
+			if(pfnInfoCallback)
+			{
+				CFsFileInfo Info;
+				Info.m_pName = pEntry->m_pName;
+				Info.m_TimeCreated = pEntry->m_TimeCreated;
+				Info.m_TimeModified = pEntry->m_TimeModified;
+				Stop = pfnInfoCallback(&Info, pEntry->m_IsDir, Type, pUser);
+			}
+			else
+				Stop = pfnCallback(pEntry->m_pName, pEntry->m_IsDir, Type, pUser);
+			if(Stop)
+				break;
+		}
+		EndListing();
+	}
+
 	virtual void ListDirectory(int Type, const char *pPath, FS_LISTDIR_CALLBACK pfnCallback, void *pUser)
 	{
+		if(m_Indexed)
+		{
+			if(Type == TYPE_ALL)
+			{
+				for(int i = 0; i < m_NumPaths; ++i)
+					ListIndexed(i, pPath, pfnCallback, 0, pUser);
+			}
+			else if(Type >= 0 && Type < m_NumPaths)
+				ListIndexed(Type, pPath, pfnCallback, 0, pUser);
+			return;
+		}
+
 		char aBuffer[IO_MAX_PATH_LENGTH];
 		if(Type == TYPE_ALL)
 		{
@@ -309,6 +612,18 @@ public:
 
 	virtual void ListDirectoryFileInfo(int Type, const char *pPath, FS_LISTDIR_CALLBACK_FILEINFO pfnCallback, void *pUser)
 	{
+		if(m_Indexed)
+		{
+			if(Type == TYPE_ALL)
+			{
+				for(int i = 0; i < m_NumPaths; ++i)
+					ListIndexed(i, pPath, 0, pfnCallback, pUser);
+			}
+			else if(Type >= 0 && Type < m_NumPaths)
+				ListIndexed(Type, pPath, 0, pfnCallback, pUser);
+			return;
+		}
+
 		char aBuffer[IO_MAX_PATH_LENGTH];
 		if(Type == TYPE_ALL)
 		{
@@ -355,8 +670,9 @@ public:
 		}
 
 		// open file
-		if(Flags&IOFLAG_WRITE)
+		if(Flags&(IOFLAG_WRITE|IOFLAG_APPEND))
 		{
+			InvalidateParent(TYPE_SAVE, pFilename);
 			return io_open(GetPath(TYPE_SAVE, pFilename, pBuffer, BufferSize), Flags);
 		}
 		else
@@ -374,6 +690,9 @@ public:
 
 			for(int i = LB; i < UB; ++i)
 			{
+				// the index knows which paths can't have the file
+				if(m_Indexed && !IsListed(i, pFilename))
+					continue;
 				Handle = io_open(GetPath(i, pFilename, pBuffer, BufferSize), Flags);
 				if(Handle)
 				{
@@ -441,11 +760,10 @@ public:
 				return 0;
 
 			// search within the folder
-			char aBuf[IO_MAX_PATH_LENGTH];
 			char aPath[IO_MAX_PATH_LENGTH];
 			str_format(aPath, sizeof(aPath), "%s/%s", Data.m_pPath, pName);
 			Data.m_pPath = aPath;
-			fs_listdir(Data.m_pStorage->GetPath(Type, aPath, aBuf, sizeof(aBuf)), FindFileCallback, Type, &Data);
+			Data.m_pStorage->ListDirectory(Type, aPath, FindFileCallback, &Data);
 			if(Data.m_pBuffer[0])
 				return 1;
 		}
@@ -480,14 +798,12 @@ public:
 
 		pCBData->m_pBuffer[0] = 0;
 
-		char aBuf[IO_MAX_PATH_LENGTH];
-
 		if(Type == TYPE_ALL)
 		{
 			// search within all available directories
 			for(int i = 0; i < m_NumPaths; ++i)
 			{
-				fs_listdir(GetPath(i, pCBData->m_pPath, aBuf, sizeof(aBuf)), FindFileCallback, i, pCBData);
+				ListDirectory(i, pCBData->m_pPath, FindFileCallback, pCBData);
 				if(pCBData->m_pBuffer[0])
 					return true;
 			}
@@ -495,7 +811,7 @@ public:
 		else if(Type >= 0 && Type < m_NumPaths)
 		{
 			// search within wanted directory
-			fs_listdir(GetPath(Type, pCBData->m_pPath, aBuf, sizeof(aBuf)), FindFileCallback, Type, pCBData);
+			ListDirectory(Type, pCBData->m_pPath, FindFileCallback, pCBData);
 		}
 
 		return pCBData->m_pBuffer[0] != 0;
@@ -537,6 +853,7 @@ public:
 			return false;
 
 		char aBuffer[IO_MAX_PATH_LENGTH];
+		InvalidateParent(Type, pFilename);
 		return !fs_remove(GetPath(Type, pFilename, aBuffer, sizeof(aBuffer)));
 	}
 
@@ -546,6 +863,8 @@ public:
 			return false;
 		char aOldBuffer[IO_MAX_PATH_LENGTH];
 		char aNewBuffer[IO_MAX_PATH_LENGTH];
+		InvalidateParent(Type, pOldFilename);
+		InvalidateParent(Type, pNewFilename);
 		return !fs_rename(GetPath(Type, pOldFilename, aOldBuffer, sizeof(aOldBuffer)), GetPath(Type, pNewFilename, aNewBuffer, sizeof (aNewBuffer)));
 	}
 
@@ -555,6 +874,7 @@ public:
 			return false;
 
 		char aBuffer[IO_MAX_PATH_LENGTH];
+		InvalidateParent(Type, pFoldername);
 		return !fs_makedir(GetPath(Type, pFoldername, aBuffer, sizeof(aBuffer)));
 	}
 
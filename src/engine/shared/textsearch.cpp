@@ -0,0 +1,57 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include "textsearch.h"
+
+static inline char SearchLower(char c)
+{
+	return c >= 'A' && c <= 'Z' ? c-'A'+'a' : c;
+}
+
+static inline uint64 SearchMaskBit(unsigned Hash)
+{
+	return (uint64)1 << ((Hash*2654435761u) >> 26);
+}
+
+// the lower cased characters and character pairs of a string, the string is lower cased in place
+static uint64 SearchMask(char *pStr, int Length)
+{
+	uint64 Mask = 0;
+	for(int i = 0; i < Length; i++)
+	{
+		unsigned char c = pStr[i] = SearchLower(pStr[i]);
+		Mask |= SearchMaskBit(c);
+		if(i > 0)
+			Mask |= SearchMaskBit(0x10000|((unsigned char)pStr[i-1]<<8)|c);
+	}
+	return Mask;
+}
+
+void CSearchQuery::Set(const char *pText)
+{
+	str_copy(m_aText, pText, sizeof(m_aText));
+	m_Mask = SearchMask(m_aText, str_length(m_aText));
+}
+
+int SearchTextAdd(char *pText, int Size, int Length, const char *pStr, uint64 *pMask)
+{
+	// separate the strings so that no match spans two of them
+	if(Length > 0 && Length < Size-1)
+	{
+		pText[Length++] = '\n';
+		pText[Length] = 0;
+	}
+	if(Length >= Size-1)
+		return Length;
+
+	str_copy(pText+Length, pStr, Size-Length);
+	int Added = str_length(pText+Length);
+	*pMask |= SearchMask(pText+Length, Added);
+	return Length+Added;
+}
+
+bool SearchTextFind(const char *pText, uint64 Mask, const CSearchQuery &Query)
+{
+	if((Query.m_Mask&Mask) != Query.m_Mask)
+		return false;
+	return str_find(pText, Query.m_aText) != 0;
+}
@@ -0,0 +1,51 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_TEXTSEARCH_H
+#define ENGINE_SHARED_TEXTSEARCH_H
+
+#include <base/system.h>
+
+/*
+	Class: CSearchQuery
+		A lower cased search string along with the mask of the
+		characters and character pairs it contains.
+*/
+class CSearchQuery
+{
+public:
+	char m_aText[128];
+	uint64 m_Mask;
+
+	CSearchQuery() { Set(""); }
+	void Set(const char *pText);
+};
+
+// lower cases pStr into pText at Length and returns the new length, see <CSearchText>
+int SearchTextAdd(char *pText, int Size, int Length, const char *pStr, uint64 *pMask);
+bool SearchTextFind(const char *pText, uint64 Mask, const CSearchQuery &Query);
+
+/*
+	Class: CSearchText
+		Lower cased copies of one or more strings with a bloom mask of
+		the characters and character pairs they contain. Queries whose
+		mask is not part of it get rejected without looking at the
+		text, the others are searched in the copy. Matches never span
+		two of the added strings. Case folding is the same as
+		str_find_nocase. A zeroed instance is empty.
+*/
+template<int SIZE>
+class CSearchText
+{
+	char m_aText[SIZE];
+	int m_Length;
+	uint64 m_Mask;
+
+public:
+	CSearchText() { Clear(); }
+	void Clear() { m_aText[0] = 0; m_Length = 0; m_Mask = 0; }
+	void Add(const char *pStr) { m_Length = SearchTextAdd(m_aText, SIZE, m_Length, pStr, &m_Mask); }
+	bool Find(const CSearchQuery &Query) const { return SearchTextFind(m_aText, m_Mask, Query); }
+	const char *Text() const { return m_aText; }
+};
+
+#endif
@@ -0,0 +1,94 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <base/tl/threading.h>
+
+#include "config.h"
+#include "threadtopology.h"
+#include "tracer.h"
+
+CThreadTopology::CClassSettings CThreadTopology::ms_aClasses[NUM_CLASSES];
+CThreadTopology::CThread CThreadTopology::ms_aThreads[MAX_THREADS];
+int CThreadTopology::ms_NumThreads = 0;
+bool CThreadTopology::ms_Configured = false;
+
+// created before main, the threads may enter at the same time
+static lock gs_ThreadsLock;
+
+const char *CThreadTopology::ClassName(int Class)
+{
+	static const char *s_apNames[NUM_CLASSES] = {"tick", "net", "jobs", "backend"};
+	return s_apNames[Class];
+}
+
+void CThreadTopology::Apply(const CThread *pThread)
+{
+	// the defaults are left alone, a process started with nice keeps it
+	const CClassSettings *pSettings = &ms_aClasses[pThread->m_Class];
+	const char *pPriorityResult = "";
+	const char *pCpusResult = "";
+	if(pSettings->m_Priority && thread_set_priority(pThread->m_ID, pSettings->m_Priority) != 0)
+		pPriorityResult = " (failed)";
+	if(pSettings->m_aCpus[0] && thread_set_affinity(pThread->m_ID, pSettings->m_aCpus) != 0)
+		pCpusResult = " (failed)";
+
+	static const char *s_apPriorities[] = {"low", "normal", "high"};
+	dbg_msg("threads", "'%s' (%s): priority %s%s, cpus %s%s", pThread->m_pName, ClassName(pThread->m_Class),
+		s_apPriorities[pSettings->m_Priority+1], pPriorityResult, pSettings->m_aCpus[0] ? pSettings->m_aCpus : "all", pCpusResult);
+}
+
+void CThreadTopology::Configure(const CConfig *pConfig)
+{
+	scope_lock Lock(&gs_ThreadsLock);
+	if(ms_Configured)
+		return;
+
+	const int aPriorities[NUM_CLASSES] = {pConfig->m_ThreadTickPriority, pConfig->m_ThreadNetPriority, pConfig->m_ThreadJobsPriority, pConfig->m_ThreadBackendPriority};
+	const char *apCpus[NUM_CLASSES] = {pConfig->m_ThreadTickCpus, pConfig->m_ThreadNetCpus, pConfig->m_ThreadJobsCpus, pConfig->m_ThreadBackendCpus};
+	for(int i = 0; i < NUM_CLASSES; i++)
+	{
+		ms_aClasses[i].m_Priority = aPriorities[i];
+		str_copy(ms_aClasses[i].m_aCpus, apCpus[i], sizeof(ms_aClasses[i].m_aCpus));
+	}
+	ms_Configured = true;
+
+	for(int i = 0; i < ms_NumThreads; i++)
+		Apply(&ms_aThreads[i]);
+}
+
+void CThreadTopology::Enter(int Class, const char *pName)
+{
+	CTracer::SetThreadName(pName);
+	thread_set_name(pName);
+
+	scope_lock Lock(&gs_ThreadsLock);
+	int ID = thread_current_id();
+	CThread *pThread = 0;
+	for(int i = 0; i < ms_NumThreads && !pThread; i++)
+		if(ms_aThreads[i].m_ID == ID)
+			pThread = &ms_aThreads[i];
+	if(!pThread)
+	{
+		if(ms_NumThreads == MAX_THREADS)
+			return;
+		pThread = &ms_aThreads[ms_NumThreads++];
+	}
+	pThread->m_ID = ID;
+	pThread->m_Class = Class;
+	pThread->m_pName = pName;
+
+	if(ms_Configured)
+		Apply(pThread);
+}
+
+void CThreadTopology::Leave()
+{
+	scope_lock Lock(&gs_ThreadsLock);
+	int ID = thread_current_id();
+	for(int i = 0; i < ms_NumThreads; i++)
+		if(ms_aThreads[i].m_ID == ID)
+		{
+			ms_aThreads[i] = ms_aThreads[--ms_NumThreads];
+			break;
+		}
+}
@@ -0,0 +1,62 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_THREADTOPOLOGY_H
+#define ENGINE_SHARED_THREADTOPOLOGY_H
+
+/*
+	Class: CThreadTopology
+		Names the engine threads and gives each class of them the
+		priority and cpus from the thread_* settings. Threads announce
+		themselves with Enter when they start. The ones that started
+		before the config was read get their settings when Configure
+		runs, the later ones at once. Every thread is reported in the
+		log with what it got.
+*/
+class CThreadTopology
+{
+public:
+	enum
+	{
+		CLASS_TICK=0,
+		CLASS_NET,
+		CLASS_JOBS,
+		CLASS_BACKEND,
+		NUM_CLASSES,
+
+		MAX_THREADS=128,
+		MAX_CPU_LIST_LENGTH=64,
+	};
+
+private:
+	struct CClassSettings
+	{
+		int m_Priority;
+		char m_aCpus[MAX_CPU_LIST_LENGTH];
+	};
+
+	struct CThread
+	{
+		int m_ID;
+		int m_Class;
+		const char *m_pName;
+	};
+
+	static CClassSettings ms_aClasses[NUM_CLASSES];
+	static CThread ms_aThreads[MAX_THREADS];
+	static int ms_NumThreads;
+	static bool ms_Configured;
+
+	static void Apply(const CThread *pThread);
+
+public:
+	static const char *ClassName(int Class);
+
+	// takes the settings from the config, the first call wins
+	static void Configure(const class CConfig *pConfig);
+
+	// names the calling thread, the name has to stay valid
+	static void Enter(int Class, const char *pName);
+	static void Leave();
+};
+
+#endif
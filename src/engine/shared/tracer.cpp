@@ -0,0 +1,149 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/tl/threading.h>
+
+#include "jsonwriter.h"
+#include "tracer.h"
+
+#if defined(CONF_FAMILY_WINDOWS) && defined(_MSC_VER)
+	static __declspec(thread) CTracer::CThreadBuffer *gs_pThreadBuffer = 0;
+	static __declspec(thread) const char *gs_pThreadName = 0;
+#else
+	static __thread CTracer::CThreadBuffer *gs_pThreadBuffer = 0;
+	static __thread const char *gs_pThreadName = 0;
+#endif
+
+volatile bool CTracer::ms_Recording = false;
+int64 CTracer::ms_StartTime = 0;
+CTracer::CThreadBuffer *CTracer::ms_apThreads[MAX_THREADS] = {0};
+int CTracer::ms_NumThreads = 0;
+LOCK CTracer::ms_ThreadsLock = 0;
+
+CTracer::CThreadBuffer *CTracer::NewBuffer(const char *pName)
+{
+	// the buffer stays for later recordings
+	CThreadBuffer *pBuffer = 0;
+	lock_wait(ms_ThreadsLock);
+	if(ms_NumThreads < MAX_THREADS)
+	{
+		pBuffer = (CThreadBuffer *)mem_alloc(sizeof(CThreadBuffer), 1);
+		pBuffer->m_pName = pName;
+		pBuffer->m_NumEvents = 0;
+		ms_apThreads[ms_NumThreads++] = pBuffer;
+	}
+	lock_unlock(ms_ThreadsLock);
+	return pBuffer;
+}
+
+CTracer::CThreadBuffer *CTracer::ThreadBuffer()
+{
+	// first event of this thread
+	if(!gs_pThreadBuffer)
+		gs_pThreadBuffer = NewBuffer(gs_pThreadName);
+	return gs_pThreadBuffer;
+}
+
+void CTracer::Add(CThreadBuffer *pBuffer, const char *pName, bool Begin, int64 Time)
+{
+	if(!pBuffer || pBuffer->m_NumEvents == MAX_THREAD_EVENTS)
+		return;
+
+	CEvent *pEvent = &pBuffer->m_aEvents[pBuffer->m_NumEvents];
+	pEvent->m_pName = pName;
+	pEvent->m_Time = Time;
+	pEvent->m_Begin = Begin;
+	// the writer only reads events below the count
+	sync_barrier();
+	pBuffer->m_NumEvents++;
+}
+
+void CTracer::Start()
+{
+	if(!ms_ThreadsLock)
+		ms_ThreadsLock = lock_create();
+
+	lock_wait(ms_ThreadsLock);
+	for(int i = 0; i < ms_NumThreads; i++)
+		ms_apThreads[i]->m_NumEvents = 0;
+	lock_unlock(ms_ThreadsLock);
+
+	ms_StartTime = time_get();
+	sync_barrier();
+	ms_Recording = true;
+}
+
+bool CTracer::Stop(IOHANDLE File)
+{
+	ms_Recording = false;
+	if(!File)
+		return false;
+
+	const int64 Freq = time_freq();
+	CJsonWriter Writer(File);
+	Writer.BeginObject();
+	Writer.WriteAttribute("displayTimeUnit");
+	Writer.WriteStrValue("ms");
+	Writer.WriteAttribute("traceEvents");
+	Writer.BeginArray();
+
+	lock_wait(ms_ThreadsLock);
+	for(int t = 0; t < ms_NumThreads; t++)
+	{
+		const CThreadBuffer *pBuffer = ms_apThreads[t];
+		const int NumEvents = pBuffer->m_NumEvents;
+		if(!NumEvents)
+			continue;
+
+		if(pBuffer->m_pName)
+		{
+			Writer.BeginObject();
+			Writer.WriteAttribute("name");
+			Writer.WriteStrValue("thread_name");
+			Writer.WriteAttribute("ph");
+			Writer.WriteStrValue("M");
+			Writer.WriteAttribute("pid");
+			Writer.WriteIntValue(0);
+			Writer.WriteAttribute("tid");
+			Writer.WriteIntValue(t);
+			Writer.WriteAttribute("args");
+			Writer.BeginObject();
+			Writer.WriteAttribute("name");
+			Writer.WriteStrValue(pBuffer->m_pName);
+			Writer.EndObject();
+			Writer.EndObject();
+		}
+
+		for(int i = 0; i < NumEvents; i++)
+		{
+			const CEvent *pEvent = &pBuffer->m_aEvents[i];
+			// microseconds, an int lasts for about half an hour. tracks can
+			// have events from shortly before the start
+			int64 Time = max((pEvent->m_Time-ms_StartTime)*1000000/Freq, (int64)0);
+			Writer.BeginObject();
+			Writer.WriteAttribute("name");
+			Writer.WriteStrValue(pEvent->m_pName);
+			Writer.WriteAttribute("ph");
+			Writer.WriteStrValue(pEvent->m_Begin ? "B" : "E");
+			Writer.WriteAttribute("ts");
+			Writer.WriteIntValue((int)min(Time, (int64)0x7fffffff));
+			Writer.WriteAttribute("pid");
+			Writer.WriteIntValue(0);
+			Writer.WriteAttribute("tid");
+			Writer.WriteIntValue(t);
+			Writer.EndObject();
+		}
+	}
+	lock_unlock(ms_ThreadsLock);
+
+	Writer.EndArray();
+	Writer.EndObject();
+	return true;
+}
+
+void CTracer::SetThreadName(const char *pName)
+{
+	gs_pThreadName = pName;
+	if(gs_pThreadBuffer)
+		gs_pThreadBuffer->m_pName = pName;
+}
@@ -0,0 +1,92 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_TRACER_H
+#define ENGINE_SHARED_TRACER_H
+
+#include <base/system.h>
+
+/*
+	Class: CTracer
+		Records begin and end events of named sections from any thread
+		and writes them in the Chrome trace event format, which can be
+		opened in chrome://tracing or Perfetto.
+
+		Every thread writes into its own buffer, so recording needs no
+		lock once a thread has logged its first event. Names have to be
+		string literals or otherwise stay valid until the trace is written.
+*/
+class CTracer
+{
+public:
+	enum
+	{
+		MAX_THREADS=64,
+		MAX_THREAD_EVENTS=1<<16,
+	};
+
+	struct CEvent
+	{
+		const char *m_pName;
+		int64 m_Time;
+		bool m_Begin;
+	};
+
+	struct CThreadBuffer
+	{
+		const char *m_pName;
+		volatile int m_NumEvents;
+		CEvent m_aEvents[MAX_THREAD_EVENTS];
+	};
+
+private:
+	static volatile bool ms_Recording;
+	static int64 ms_StartTime;
+	static CThreadBuffer *ms_apThreads[MAX_THREADS];
+	static int ms_NumThreads;
+	static LOCK ms_ThreadsLock;
+
+	static CThreadBuffer *NewBuffer(const char *pName);
+	static CThreadBuffer *ThreadBuffer();
+	static void Add(CThreadBuffer *pBuffer, const char *pName, bool Begin, int64 Time);
+
+public:
+	static bool IsRecording() { return ms_Recording; }
+
+	// drops the events of earlier recordings
+	static void Start();
+
+	// stops recording and writes the events to the file, which gets closed
+	static bool Stop(IOHANDLE File);
+
+	/*
+		Function: SetThreadName
+			Names the calling thread in the trace. Can be called before
+			the recording starts.
+	*/
+	static void SetThreadName(const char *pName);
+
+	static void Begin(const char *pName) { if(ms_Recording) Add(ThreadBuffer(), pName, true, time_get()); }
+	static void End(const char *pName) { if(ms_Recording) Add(ThreadBuffer(), pName, false, time_get()); }
+
+	/*
+		Function: Track
+			Returns a buffer for events that happen somewhere else than on
+			the calling thread, like the gpu work the render thread reads
+			back. Only one thread may add events to a track, in the order
+			of their times. Call while recording, 0 when out of buffers.
+	*/
+	static CThreadBuffer *Track(const char *pName) { return NewBuffer(pName); }
+	static void BeginAt(CThreadBuffer *pTrack, const char *pName, int64 Time) { if(ms_Recording) Add(pTrack, pName, true, Time); }
+	static void EndAt(CThreadBuffer *pTrack, const char *pName, int64 Time) { if(ms_Recording) Add(pTrack, pName, false, Time); }
+};
+
+class CTraceScope
+{
+	const char *m_pName;
+
+public:
+	CTraceScope(const char *pName) : m_pName(pName) { CTracer::Begin(m_pName); }
+	~CTraceScope() { CTracer::End(m_pName); }
+};
+
+#endif
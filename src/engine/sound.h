@@ -43,6 +43,9 @@ public:
 	virtual void StopAll() = 0;
 	virtual bool IsPlaying(CSampleHandle Sound) = 0;
 
+	// microseconds the mixer thread spent so far, wraps around
+	virtual unsigned MixTime() const = 0;
+
 protected:
 	inline CSampleHandle CreateSampleHandle(int Index)
 	{
@@ -190,6 +190,8 @@ class ITextRender : public IInterface
 public:
 	virtual void LoadFonts(IStorage *pStorage, IConsole *pConsole) = 0;
 	virtual void SetFontLanguageVariant(const char *pLanguageFile) = 0;
+	// queues the glyphs of the text for background rasterization at the size the current screen mapping gives
+	virtual void PrewarmGlyphs(const char *pText, float FontSize) = 0;
 
 	virtual void TextColor(float r, float g, float b, float a) = 0;
 	virtual void TextSecondaryColor(float r, float g, float b, float a) = 0;
@@ -214,8 +216,16 @@ public:
 	virtual void DrawTextOutlined(CTextCursor *pCursor, float Alpha = 1.0f, int StartGlyph = 0, int NumGlyphs = -1) = 0;
 	virtual void DrawTextShadowed(CTextCursor *pCursor, vec2 ShadowOffset, float Alpha = 1.0f, int StartGlyph = 0, int NumGlyphs = -1) = 0;
 
+	// the quads of the text drawn between these go out in one batch per font texture at EndBatch,
+	// all outlines below all glyphs. The screen mapping must stay the same in between.
+	virtual void BeginBatch() = 0;
+	virtual void EndBatch() = 0;
+
 	// QoL APIs
 	virtual vec2 CaretPosition(CTextCursor *pCursor, int NumChars) = 0;
+
+	// glyphs that weren't in the atlas when they were needed, counted since the start
+	virtual unsigned NumGlyphCacheMisses() const = 0;
 };
 
 class IEngineTextRender : public ITextRender
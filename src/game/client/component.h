@@ -36,6 +36,7 @@ public:
 	virtual void OnStateChange(int NewState, int OldState) {}
 	virtual void OnConsoleInit() {}
 	virtual int GetInitAmount() const { return 0; } // Amount of progress reported by this component during OnInit
+	virtual void OnLoad() {} // Runs on the job pool before OnInit, only for reading and decoding files. No graphics, sound or console calls
 	virtual void OnInit() {}
 	virtual void OnShutdown() {}
 	virtual void OnReset() {}
@@ -124,6 +124,11 @@ void CBroadcast::OnReset()
 	m_NumSegments = -1;
 }
 
+void CBroadcast::OnConsoleInit()
+{
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_BROADCAST, this);
+}
+
 void CBroadcast::OnMessage(int MsgType, void* pRawMsg)
 {
 	// process server broadcast message
@@ -42,6 +42,7 @@ public:
 	bool IsMuteServerBroadcast() const { return m_MuteServerBroadcast; }
 
 	virtual void OnReset();
+	virtual void OnConsoleInit();
 	virtual void OnMessage(int MsgType, void *pRawMsg);
 	virtual void OnRender();
 };
@@ -73,6 +73,7 @@ void CChat::OnReset()
 	}
 
 	m_CurrentLineWidth = -1.0f;
+	m_CurrentScreenHeight = 0;
 
 	// init chat commands (must be in alphabetical order)
 	if(Client()->State() < IClient::STATE_ONLINE)
@@ -213,6 +214,10 @@ void CChat::OnConsoleInit()
 	Console()->Register("whisper", "i[target] r[text]", CFGFLAG_CLIENT, ConWhisper, this, "Whisper to a client in chat");
 	Console()->Register("chat", "s[text] ?i[whisper-target]", CFGFLAG_CLIENT, ConChat, this, "Enable chat with all/team/whisper mode");
 	Console()->Register("+show_chat", "", CFGFLAG_CLIENT, ConShowChat, this, "Show chat");
+
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_CHAT, this);
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_COMMANDINFO, this);
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_COMMANDINFOREMOVE, this);
 }
 
 void CChat::ClearChatBuffer()
@@ -760,6 +765,64 @@ const char* CChat::GetCommandName(int Mode) const
 	}
 }
 
+vec4 CChat::NameColor(const CLine *pLine) const
+{
+	if(pLine->m_ClientID < 0)
+		return vec4(1.0f, 1.0f, 0.5f, 1); // system
+	if(pLine->m_Mode == CHAT_WHISPER)
+		return vec4(0.4f, 1.0f, 1.0f, 1);
+	if(pLine->m_Mode == CHAT_TEAM)
+		return vec4(0.45f, 0.9f, 0.45f, 1);
+	if(pLine->m_NameColor == TEAM_RED)
+		return vec4(1.0f, 0.5f, 0.5f, 1);
+	if(pLine->m_NameColor == TEAM_BLUE)
+		return vec4(0.7f, 0.7f, 1.0f, 1);
+	if(pLine->m_NameColor == TEAM_SPECTATORS)
+		return vec4(0.75f, 0.5f, 0.75f, 1);
+	return vec4(0.8f, 0.8f, 0.8f, 1);
+}
+
+int CChat::LayoutLine(const CLine *pLine, CTextCursor *pCursor, float FontSize, float Blend, float HighlightBlend)
+{
+	const vec4 ShadowWhisper(0.09f, 0.f, 0.26f, Blend * 0.9f);
+	const vec4 ShadowBlack(0, 0, 0, Blend * 0.9f);
+	const vec4 ShadowColor = pLine->m_Mode == CHAT_WHISPER ? ShadowWhisper : ShadowBlack;
+	const vec4 ColorHighlightOutline(0.0f, 0.4f, 1.0f,
+		mix(pLine->m_Mode == CHAT_TEAM ? 0.6f : 0.5f, 1.0f, HighlightBlend));
+
+	// room for the whisper icon and the client id
+	if(pLine->m_Mode == CHAT_WHISPER)
+		TextRender()->TextAdvance(pCursor, 12.5f);
+
+	int NumNameGlyphs = 0;
+	if(pLine->m_ClientID >= 0)
+	{
+		TextRender()->TextAdvance(pCursor, RenderTools()->GetClientIdRectSize(FontSize));
+		TextRender()->TextColor(NameColor(pLine));
+		TextRender()->TextSecondaryColor(ShadowColor);
+		TextRender()->TextDeferred(pCursor, pLine->m_aName, -1);
+		TextRender()->TextDeferred(pCursor, ": ", -1);
+		NumNameGlyphs = pCursor->GlyphCount();
+	}
+
+	pCursor->m_StartOfLine = true;
+
+	vec4 TextColorLine;
+	if(pLine->m_ClientID < 0)
+		TextColorLine = NameColor(pLine);
+	else if(pLine->m_Mode == CHAT_WHISPER)
+		TextColorLine = vec4(0.4f, 1.0f, 1.0f, 1);
+	else if(pLine->m_Mode == CHAT_TEAM)
+		TextColorLine = vec4(0.6f, 1.0f, 0.6f, 1);
+	else
+		TextColorLine = vec4(1.0f, 1.0f, 1.0f, 1);
+
+	TextRender()->TextColor(TextColorLine);
+	TextRender()->TextSecondaryColor(pLine->m_Highlighted ? ColorHighlightOutline : ShadowColor);
+	TextRender()->TextDeferred(pCursor, pLine->m_aText, -1);
+	return NumNameGlyphs;
+}
+
 void CChat::OnRender()
 {
 	if(Client()->State() < IClient::STATE_ONLINE)
@@ -1027,13 +1090,15 @@ void CChat::OnRender()
 			HeightLimit = ReducedHeightLimit;
 	}
 
-	if(m_CurrentLineWidth != LineWidth)
+	// the glyph size depends on the resolution
+	if(m_CurrentLineWidth != LineWidth || m_CurrentScreenHeight != Graphics()->ScreenHeight())
 	{
 		for(int i = 0; i < MAX_LINES; i++)
 		{
 			m_aLines[i].m_Size.y = -1.0f;
 		}
 		m_CurrentLineWidth = LineWidth;
+		m_CurrentScreenHeight = Graphics()->ScreenHeight();
 	}
 
 	float Begin = x;
@@ -1053,30 +1118,20 @@ void CChat::OnRender()
 
 		if(pLine->m_Size.y < 0.0f)
 		{
-			s_ChatCursor.MoveTo(Begin, 0.0f);
-			s_ChatCursor.Reset();
-			s_ChatCursor.m_Flags = TEXTFLAG_WORD_WRAP | TEXTFLAG_NO_RENDER;
-			if(pLine->m_Mode == CHAT_WHISPER)
-			{
-				TextRender()->TextAdvance(&s_ChatCursor, 12.5f);
-			}
-
-			if(pLine->m_ClientID >= 0)
-			{
-				float ClientIDWidth = RenderTools()->GetClientIdRectSize(FontSize);
-				TextRender()->TextAdvance(&s_ChatCursor, ClientIDWidth);
-				TextRender()->TextDeferred(&s_ChatCursor, pLine->m_aName, -1);
-				TextRender()->TextDeferred(&s_ChatCursor, ": ", -1);
-			}
-
-			TextRender()->TextDeferred(&s_ChatCursor, pLine->m_aText, -1);
-			pLine->m_Size.y = s_ChatCursor.LineCount() * FontSize;
-			pLine->m_Size.x = s_ChatCursor.Width();
+			// keep the layout around, it's drawn as is until the line changes or fades
+			CTextCursor *pCursor = &pLine->m_TextCursor;
+			pCursor->m_FontSize = FontSize;
+			pCursor->m_Flags = TEXTFLAG_WORD_WRAP;
+			pCursor->m_MaxWidth = LineWidth;
+			pCursor->m_MaxLines = -1;
+			pCursor->MoveTo(Begin, 0.0f);
+			pCursor->Reset();
+			pLine->m_NumNameGlyphs = LayoutLine(pLine, pCursor, FontSize, 1.0f, 0.0f);
+			pLine->m_Size.y = pCursor->LineCount() * FontSize;
+			pLine->m_Size.x = pCursor->Width();
 		}
 	}
 
-	s_ChatCursor.m_Flags = TEXTFLAG_WORD_WRAP;
-
 	if(m_Show)
 	{
 		CUIRect Rect;
@@ -1147,7 +1202,7 @@ void CChat::OnRender()
 
 	for(int i = StartLine; i < MAX_LINES; i++)
 	{
-		const CLine *pLine = &m_aLines[((m_CurrentLine-i)+MAX_LINES)%MAX_LINES];
+		CLine *pLine = &m_aLines[((m_CurrentLine-i)+MAX_LINES)%MAX_LINES];
 
 		if(pLine->m_aText[0] == 0)
 			break;
@@ -1172,26 +1227,10 @@ void CChat::OnRender()
 		float Delta = (Now - pLine->m_Time) / (float)TimeFreq;
 		const float HighlightBlend = 1.0f - clamp(Delta - HlTimeFull, 0.0f, HlTimeFade) / HlTimeFade;
 
-		// reset the cursor
-		s_ChatCursor.MoveTo(Begin, y);
-		s_ChatCursor.Reset();
-
 		const vec2 ShadowOffset(0.8f, 1.5f);
 		const vec4 ShadowWhisper(0.09f, 0.f, 0.26f, Blend * 0.9f);
-		const vec4 ShadowBlack(0, 0, 0, Blend * 0.9f);
-		const vec4 ShadowColor = pLine->m_Mode == CHAT_WHISPER ? ShadowWhisper : ShadowBlack;
-		const vec4 ColorSystem(1.0f, 1.0f, 0.5f, 1);
 		const vec4 ColorWhisper(0.4f, 1.0f, 1.0f, 1);
-		const vec4 ColorRed(1.0f, 0.5f, 0.5f, 1);
-		const vec4 ColorBlue(0.7f, 0.7f, 1.0f, 1);
-		const vec4 ColorSpec(0.75f, 0.5f, 0.75f, 1);
-		const vec4 ColorAllPre(0.8f, 0.8f, 0.8f, 1);
-		const vec4 ColorAllText(1.0f, 1.0f, 1.0f, 1);
-		const vec4 ColorTeamPre(0.45f, 0.9f, 0.45f, 1);
-		const vec4 ColorTeamText(0.6f, 1.0f, 0.6f, 1);
 		const vec4 ColorHighlightBg(0.0f, 0.27f, 0.9f, 0.5f * HighlightBlend);
-		const vec4 ColorHighlightOutline(0.0f, 0.4f, 1.0f,
-			mix(pLine->m_Mode == CHAT_TEAM ? 0.6f : 0.5f, 1.0f, HighlightBlend));
 
 		if(pLine->m_Highlighted && ColorHighlightBg.a > 0.001f)
 		{
@@ -1251,27 +1290,8 @@ void CChat::OnRender()
 
 			Graphics()->QuadsEnd();
 			Graphics()->WrapNormal();
-			TextRender()->TextAdvance(&s_ChatCursor, 12.5f);
 		}
 
-		// render name
-		vec4 TextColorName;
-		if(pLine->m_ClientID < 0)
-			TextColorName = ColorSystem;
-		else if(pLine->m_Mode == CHAT_WHISPER)
-			TextColorName = ColorWhisper;
-		else if(pLine->m_Mode == CHAT_TEAM)
-			TextColorName = ColorTeamPre;
-		else if(pLine->m_NameColor == TEAM_RED)
-			TextColorName = ColorRed;
-		else if(pLine->m_NameColor == TEAM_BLUE)
-			TextColorName = ColorBlue;
-		else if(pLine->m_NameColor == TEAM_SPECTATORS)
-			TextColorName = ColorSpec;
-		else
-			TextColorName = ColorAllPre;
-
-		int NumNameGlyphs = 0;
 		if(pLine->m_ClientID >= 0)
 		{
 			int NameCID = pLine->m_ClientID;
@@ -1279,44 +1299,31 @@ void CChat::OnRender()
 				NameCID = pLine->m_TargetID;
 
 			vec4 IdTextColor = vec4(0.1f*Blend, 0.1f*Blend, 0.1f*Blend, 1.0f*Blend);
-			vec4 BgIdColor = TextColorName;
+			vec4 BgIdColor = NameColor(pLine);
 			BgIdColor.a = 0.5f*Blend;
-			float ClientIDWidth = RenderTools()->DrawClientID(TextRender(), FontSize, s_ChatCursor.AdvancePosition(), NameCID, BgIdColor, IdTextColor);
-			TextRender()->TextAdvance(&s_ChatCursor, ClientIDWidth);
-			TextRender()->TextColor(TextColorName);
-			TextRender()->TextSecondaryColor(ShadowColor);
-			TextRender()->TextDeferred(&s_ChatCursor, pLine->m_aName, -1);
-			TextRender()->TextDeferred(&s_ChatCursor, ": ", -1);
-			NumNameGlyphs = s_ChatCursor.GlyphCount();
+			vec2 IdPosition(Begin + (pLine->m_Mode == CHAT_WHISPER ? 12.5f : 0.0f), y);
+			RenderTools()->DrawClientID(TextRender(), FontSize, IdPosition, NameCID, BgIdColor, IdTextColor);
 		}
 
-		s_ChatCursor.m_StartOfLine = true;
-
-		// render line
-		vec4 TextColorLine;
-		if(pLine->m_ClientID < 0)
-			TextColorLine = ColorSystem;
-		else if(pLine->m_Mode == CHAT_WHISPER)
-			TextColorLine = ColorWhisper;
-		else if(pLine->m_Mode == CHAT_TEAM)
-			TextColorLine = ColorTeamText;
-		else
-			TextColorLine = ColorAllText;
+		// the layout of the size pass has the colors of a line that isn't fading,
+		// only lines that do are laid out again
+		CTextCursor *pCursor = &pLine->m_TextCursor;
+		int NumNameGlyphs = pLine->m_NumNameGlyphs;
+		if(Blend < 1.0f || (pLine->m_Highlighted && HighlightBlend > 0.0f))
+		{
+			pCursor = &s_ChatCursor;
+			pCursor->Reset();
+			NumNameGlyphs = LayoutLine(pLine, pCursor, FontSize, Blend, HighlightBlend);
+		}
+		pCursor->MoveTo(Begin, y);
 
-		TextRender()->TextColor(TextColorLine);
 		if(pLine->m_Highlighted)
 		{
-			TextRender()->TextSecondaryColor(ColorHighlightOutline);
-			TextRender()->TextDeferred(&s_ChatCursor, pLine->m_aText, -1);
-			TextRender()->DrawTextShadowed(&s_ChatCursor, ShadowOffset, Blend, 0, NumNameGlyphs);
-			TextRender()->DrawTextOutlined(&s_ChatCursor, Blend, NumNameGlyphs, -1);
+			TextRender()->DrawTextShadowed(pCursor, ShadowOffset, Blend, 0, NumNameGlyphs);
+			TextRender()->DrawTextOutlined(pCursor, Blend, NumNameGlyphs, -1);
 		}
 		else
-		{
-			TextRender()->TextSecondaryColor(ShadowColor);
-			TextRender()->TextDeferred(&s_ChatCursor, pLine->m_aText, -1);
-			TextRender()->DrawTextShadowed(&s_ChatCursor, ShadowOffset, Blend);
-		}
+			TextRender()->DrawTextShadowed(pCursor, ShadowOffset, Blend);
 	}
 
 	TextRender()->TextColor(1.0f, 1.0f, 1.0f, 1.0f);
@@ -4,6 +4,7 @@
 #define GAME_CLIENT_COMPONENTS_CHAT_H
 #include <base/system.h>
 #include <base/tl/array.h>
+#include <engine/textrender.h>
 #include <engine/shared/ringbuffer.h>
 #include <game/client/component.h>
 #include <game/client/lineinput.h>
@@ -31,6 +32,9 @@ class CChat : public CComponent
 		char m_aName[MAX_NAME_ARRAY_SIZE];
 		char m_aText[MAX_LINE_LENGTH];
 		bool m_Highlighted;
+		// laid out with the size, in the colors of a line that isn't fading
+		CTextCursor m_TextCursor;
+		int m_NumNameGlyphs;
 	};
 
 	CLine m_aLines[MAX_LINES];
@@ -61,6 +65,7 @@ class CChat : public CComponent
 	bool m_ReverseCompletion;
 	bool m_FirstMap;
 	float m_CurrentLineWidth;
+	int m_CurrentScreenHeight;
 
 	int m_ChatBufferMode;
 	char m_ChatBuffer[MAX_LINE_LENGTH];
@@ -106,6 +111,9 @@ class CChat : public CComponent
 	static void Com_Befriend(IConsole::IResult *pResult, void *pContext);
 
 	void ClearInput();
+	vec4 NameColor(const CLine *pLine) const;
+	// lays out the name and the text of the line, returns the number of name glyphs
+	int LayoutLine(const CLine *pLine, CTextCursor *pCursor, float FontSize, float Blend, float HighlightBlend);
 
 	static void ConSay(IConsole::IResult *pResult, void *pUserData);
 	static void ConSayTeam(IConsole::IResult *pResult, void *pUserData);
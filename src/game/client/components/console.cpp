@@ -8,6 +8,7 @@
 
 #include <engine/shared/ringbuffer.h>
 #include <engine/shared/config.h>
+#include <engine/shared/textsearch.h>
 #include <engine/graphics.h>
 #include <engine/textrender.h>
 #include <engine/storage.h>
@@ -36,6 +37,8 @@ enum
 	CONSOLE_CLOSING,
 };
 
+static const float CONSOLE_FONT_SIZE = 10.0f;
+
 CGameConsole::CInstance::CInstance(int Type)
 {
 	m_pHistoryEntry = 0x0;
@@ -61,18 +64,120 @@ CGameConsole::CInstance::CInstance(int Type)
 	m_CompletionRenderOffset = 0.0f;
 
 	m_IsCommand = false;
+
+	m_NextEntryID = 0;
+	m_LayoutWidth = -1.0f;
+	m_LayoutGeneration = 0;
+	m_Searching = false;
+	m_SearchMatchID = -1;
+	m_ShowSearchMatch = false;
 }
 
 void CGameConsole::CInstance::Init(CGameConsole *pGameConsole)
 {
 	m_pGameConsole = pGameConsole;
 	m_Input.Init(m_pGameConsole->Input());
+	m_SearchInput.Init(m_pGameConsole->Input());
 };
 
 void CGameConsole::CInstance::ClearBacklog()
 {
 	m_Backlog.Init();
 	m_BacklogActPage = 0;
+	m_SearchMatchID = -1;
+}
+
+void CGameConsole::CInstance::SetLayoutWidth(float Width)
+{
+	if(Width == m_LayoutWidth)
+		return;
+
+	m_LayoutWidth = Width;
+	m_LayoutGeneration++;
+	for(CBacklogEntry *pEntry = m_Backlog.First(); pEntry; pEntry = m_Backlog.Next(pEntry))
+		pEntry->m_YOffset = -1.0f;
+}
+
+float CGameConsole::CInstance::LineHeight(CBacklogEntry *pEntry)
+{
+	if(pEntry->m_YOffset < 0.0f)
+	{
+		static CTextCursor s_Cursor;
+		s_Cursor.Reset();
+		s_Cursor.m_FontSize = CONSOLE_FONT_SIZE;
+		s_Cursor.m_MaxWidth = m_LayoutWidth;
+		s_Cursor.m_MaxLines = -1;
+		m_pGameConsole->TextRender()->TextDeferred(&s_Cursor, pEntry->m_aText, -1);
+		pEntry->m_YOffset = s_Cursor.BaseLineY()+1.0f;
+	}
+	return pEntry->m_YOffset;
+}
+
+// returns the newest entry of the page, the page gets clamped to the last one.
+// with a StopID the page is the one of that entry instead
+CGameConsole::CInstance::CBacklogEntry *CGameConsole::CInstance::PageStart(int *pPage, int StopID, float PageHeight)
+{
+	CBacklogEntry *pStart = m_Backlog.Last();
+	int Page = 0;
+	float OffsetY = 0.0f;
+	for(CBacklogEntry *pEntry = pStart; pEntry; )
+	{
+		if(StopID >= 0 ? pEntry->m_ID == StopID : Page == *pPage)
+			break;
+
+		const float Height = LineHeight(pEntry);
+		if(OffsetY > 0.0f && OffsetY+Height >= PageHeight)
+		{
+			// the line starts the next page
+			Page++;
+			pStart = pEntry;
+			OffsetY = 0.0f;
+			continue;
+		}
+		OffsetY += Height;
+		pEntry = m_Backlog.Prev(pEntry);
+	}
+	*pPage = Page;
+	return pStart;
+}
+
+void CGameConsole::CInstance::Search(int Direction, bool Restart)
+{
+	CBacklogEntry *pEntry = m_Backlog.Last();
+	if(!Restart && m_SearchMatchID >= 0)
+	{
+		// continue next to the current match
+		while(pEntry && pEntry->m_ID > m_SearchMatchID)
+			pEntry = m_Backlog.Prev(pEntry);
+		if(pEntry)
+			pEntry = Direction < 0 ? m_Backlog.Prev(pEntry) : m_Backlog.Next(pEntry);
+	}
+
+	if(m_SearchQuery.m_aText[0])
+	{
+		for(; pEntry; pEntry = Direction < 0 ? m_Backlog.Prev(pEntry) : m_Backlog.Next(pEntry))
+		{
+			if((m_SearchQuery.m_Mask&pEntry->m_SearchMask) == m_SearchQuery.m_Mask && str_find_nocase(pEntry->m_aText, m_SearchQuery.m_aText))
+			{
+				m_SearchMatchID = pEntry->m_ID;
+				m_ShowSearchMatch = true;
+				return;
+			}
+		}
+	}
+
+	// keep the last match when there are no more
+	if(Restart || !m_SearchQuery.m_aText[0])
+	{
+		m_SearchMatchID = -1;
+		m_BacklogActPage = 0;
+	}
+}
+
+void CGameConsole::CInstance::StopSearch()
+{
+	m_Searching = false;
+	m_SearchMatchID = -1;
 }
 
 void CGameConsole::CInstance::ClearHistory()
@@ -124,6 +229,46 @@ void CGameConsole::CInstance::PossibleMapsCompleteCallback(int Index, const char
 void CGameConsole::CInstance::OnInput(IInput::CEvent Event)
 {
 	bool Handled = false;
+	IInput *pInput = m_pGameConsole->Input();
+
+	if((Event.m_Flags&IInput::FLAG_PRESS) && Event.m_Key == KEY_F && (pInput->KeyIsPressed(KEY_LCTRL) || pInput->KeyIsPressed(KEY_RCTRL)))
+	{
+		if(m_Searching)
+			StopSearch();
+		else
+		{
+			m_Searching = true;
+			m_SearchInput.Clear();
+			m_SearchQuery.Set("");
+		}
+		return;
+	}
+
+	if((Event.m_Flags&IInput::FLAG_PRESS) && Event.m_Key == KEY_PAGEUP)
+	{
+		++m_BacklogActPage;
+		return;
+	}
+	if((Event.m_Flags&IInput::FLAG_PRESS) && Event.m_Key == KEY_PAGEDOWN)
+	{
+		--m_BacklogActPage;
+		if(m_BacklogActPage < 0)
+			m_BacklogActPage = 0;
+		return;
+	}
+
+	if(m_Searching)
+	{
+		// enter goes to the next older match, shift+enter to the next newer one
+		if((Event.m_Flags&IInput::FLAG_PRESS) && (Event.m_Key == KEY_RETURN || Event.m_Key == KEY_KP_ENTER))
+			Search(pInput->KeyIsPressed(KEY_LSHIFT) || pInput->KeyIsPressed(KEY_RSHIFT) ? 1 : -1, false);
+		else if(m_SearchInput.ProcessInput(Event) && str_comp_nocase(m_SearchInput.GetString(), m_SearchQuery.m_aText) != 0)
+		{
+			m_SearchQuery.Set(m_SearchInput.GetString());
+			Search(-1, true);
+		}
+		return;
+	}
 
 	if(Event.m_Flags&IInput::FLAG_PRESS)
 	{
@@ -201,16 +346,6 @@ void CGameConsole::CInstance::OnInput(IInput::CEvent Event)
 					m_CompletionMapChosen = -1;
 			}
 		}
-		else if(Event.m_Key == KEY_PAGEUP)
-		{
-			++m_BacklogActPage;
-		}
-		else if(Event.m_Key == KEY_PAGEDOWN)
-		{
-			--m_BacklogActPage;
-			if(m_BacklogActPage < 0)
-				m_BacklogActPage = 0;
-		}
 	}
 
 	if(!Handled)
@@ -262,10 +397,16 @@ void CGameConsole::CInstance::PrintLine(const char *pLine, bool Highlighted)
 		Len = 255;
 
 	CBacklogEntry *pEntry = m_Backlog.Allocate(sizeof(CBacklogEntry)+Len);
+	pEntry->m_ID = m_NextEntryID++;
 	pEntry->m_YOffset = -1.0f;
 	pEntry->m_Highlighted = Highlighted;
 	mem_copy(pEntry->m_aText, pLine, Len);
 	pEntry->m_aText[Len] = 0;
+
+	// index the line for the search
+	char aLower[256];
+	pEntry->m_SearchMask = 0;
+	SearchTextAdd(aLower, sizeof(aLower), 0, pEntry->m_aText, &pEntry->m_SearchMask);
 }
 
 CGameConsole::CGameConsole()
@@ -447,7 +588,7 @@ void CGameConsole::OnRender()
 	CInstance *pConsole = CurrentConsole();
 
 	{
-		float FontSize = 10.0f;
+		float FontSize = CONSOLE_FONT_SIZE;
 		float RowHeight = FontSize*1.25f;
 		float x = 3;
 		float y = ConsoleHeight - RowHeight - 5.0f;
@@ -486,14 +627,20 @@ void CGameConsole::OnRender()
 			else
 				pPrompt = "NOT CONNECTED> ";
 		}
+		const CLineInput *pInput = &pConsole->m_Input;
+		if(pConsole->m_Searching)
+		{
+			pPrompt = pConsole->m_SearchQuery.m_aText[0] && pConsole->m_SearchMatchID < 0 ? "search (no match)> " : "search> ";
+			pInput = &pConsole->m_SearchInput;
+		}
 		TextRender()->TextOutlined(&s_Cursor, pPrompt, -1);
 
 		x = s_Cursor.AdvancePosition().x;
 
 		//hide rcon password
 		char aInputString[256];
-		str_copy(aInputString, pConsole->m_Input.GetString(), sizeof(aInputString));
-		if(m_ConsoleType == CONSOLETYPE_REMOTE && (Client()->State() == IClient::STATE_ONLINE || Client()->State() == IClient::STATE_LOADING) && !Client()->RconAuthed())
+		str_copy(aInputString, pInput->GetString(), sizeof(aInputString));
+		if(!pConsole->m_Searching && m_ConsoleType == CONSOLETYPE_REMOTE && (Client()->State() == IClient::STATE_ONLINE || Client()->State() == IClient::STATE_LOADING) && !Client()->RconAuthed())
 		{
 			for(int i = 0; i < pConsole->m_Input.GetLength(); ++i)
 				aInputString[i] = '*';
@@ -513,14 +660,14 @@ void CGameConsole::OnRender()
 		s_MarkerCursor.m_FontSize = FontSize;
 		TextRender()->TextDeferred(&s_MarkerCursor, "|", -1);
 		s_MarkerCursor.m_Align = TEXTALIGN_CENTER;
-		vec2 MarkerPosition = TextRender()->CaretPosition(&s_Cursor, pConsole->m_Input.GetCursorOffset());
+		vec2 MarkerPosition = TextRender()->CaretPosition(&s_Cursor, pInput->GetCursorOffset());
 		s_MarkerCursor.MoveTo(MarkerPosition);
 
 		TextRender()->DrawTextOutlined(&s_Cursor);
 		TextRender()->DrawTextOutlined(&s_MarkerCursor);
 
 		// render possible commands
-		if(m_ConsoleType == CONSOLETYPE_LOCAL || Client()->RconAuthed())
+		if(!pConsole->m_Searching && (m_ConsoleType == CONSOLETYPE_LOCAL || Client()->RconAuthed()))
 		{
 			if(pConsole->m_Input.GetString()[0] != 0)
 			{
@@ -546,55 +693,34 @@ void CGameConsole::OnRender()
 
 		//	render log (actual page, wrap lines)
 
-		CInstance::CBacklogEntry *pEntry = pConsole->m_Backlog.Last();
+		pConsole->SetLayoutWidth(Screen.w-10);
+		const float PageHeight = y-RowHeight;
+		const int StopID = pConsole->m_ShowSearchMatch ? pConsole->m_SearchMatchID : -1;
+		pConsole->m_ShowSearchMatch = false;
+		CInstance::CBacklogEntry *pEntry = pConsole->PageStart(&pConsole->m_BacklogActPage, StopID, PageHeight);
 		float OffsetY = 0.0f;
-		float LineOffset = 1.0f;
-		s_Cursor.m_MaxWidth = Screen.w-10;
-		for(int Page = 0; Page <= pConsole->m_BacklogActPage; ++Page, OffsetY = 0.0f)
+		for(int i = 0; pEntry && i < CInstance::MAX_PAGE_LINES; i++, pEntry = pConsole->m_Backlog.Prev(pEntry))
 		{
-			while(pEntry)
-			{
-				s_Cursor.Reset();
-				if(pEntry->m_Highlighted)
-					TextRender()->TextColor(1,0.75,0.75,1);
-				TextRender()->TextDeferred(&s_Cursor, pEntry->m_aText, -1);
-				TextRender()->TextColor(1,1,1,1);
-
-				// get y offset (calculate it if we haven't yet)
-				if(pEntry->m_YOffset < 0.0f)
-				{
-					pEntry->m_YOffset = s_Cursor.BaseLineY()+LineOffset;
-				}
-				OffsetY += pEntry->m_YOffset;
-
-				//	next page when lines reach the top
-				if(y-OffsetY <= RowHeight)
-					break;
-
-				//	just render output from actual backlog page (render bottom up)
-				if(Page == pConsole->m_BacklogActPage)
-				{
-					s_Cursor.MoveTo(0.0f, y-OffsetY);
-					TextRender()->DrawTextOutlined(&s_Cursor);
-				}
-				pEntry = pConsole->m_Backlog.Prev(pEntry);
-			}
-
-			//	actual backlog page number is too high, render last available page (current checked one, render top down)
-			if(!pEntry && Page < pConsole->m_BacklogActPage)
-			{
-				pConsole->m_BacklogActPage = Page;
-				pEntry = pConsole->m_Backlog.First();
-				while(OffsetY > 0.0f && pEntry)
-				{
-					s_Cursor.Reset();
-					s_Cursor.MoveTo(0.0f, y-OffsetY);
-					TextRender()->TextOutlined(&s_Cursor, pEntry->m_aText, -1);
-					OffsetY -= pEntry->m_YOffset;
-					pEntry = pConsole->m_Backlog.Next(pEntry);
-				}
+			OffsetY += pConsole->LineHeight(pEntry);
+			if(i > 0 && OffsetY >= PageHeight)
 				break;
-			}
+
+			// the layout stays valid as long as the line is at the same place on the page
+			const bool Match = pEntry->m_ID == pConsole->m_SearchMatchID;
+			CTextCursor *pCursor = &pConsole->m_aLineCursors[i];
+			pCursor->Reset(((int64)pConsole->m_LayoutGeneration<<33)|((int64)pEntry->m_ID<<1)|(Match ? 1 : 0));
+			pCursor->m_FontSize = FontSize;
+			pCursor->m_MaxWidth = pConsole->m_LayoutWidth;
+			pCursor->m_MaxLines = -1;
+			if(Match)
+				TextRender()->TextColor(1,1,0.5f,1);
+			else if(pEntry->m_Highlighted)
+				TextRender()->TextColor(1,0.75,0.75,1);
+			TextRender()->TextDeferred(pCursor, pEntry->m_aText, -1);
+			TextRender()->TextColor(1,1,1,1);
+
+			pCursor->MoveTo(0.0f, y-OffsetY);
+			TextRender()->DrawTextOutlined(pCursor);
 		}
 
 		s_Cursor.Reset();
@@ -622,7 +748,9 @@ bool CGameConsole::OnInput(IInput::CEvent Event)
 	if((Event.m_Key >= KEY_F1 && Event.m_Key <= KEY_F12) || (Event.m_Key >= KEY_F13 && Event.m_Key <= KEY_F24))
 		return false;
 
-	if(Event.m_Key == KEY_ESCAPE && (Event.m_Flags&IInput::FLAG_PRESS))
+	if(Event.m_Key == KEY_ESCAPE && (Event.m_Flags&IInput::FLAG_PRESS) && CurrentConsole()->m_Searching)
+		CurrentConsole()->StopSearch();
+	else if(Event.m_Key == KEY_ESCAPE && (Event.m_Flags&IInput::FLAG_PRESS))
 		Toggle(m_ConsoleType);
 	else
 		CurrentConsole()->OnInput(Event);
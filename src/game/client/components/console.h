@@ -3,6 +3,8 @@
 #ifndef GAME_CLIENT_COMPONENTS_CONSOLE_H
 #define GAME_CLIENT_COMPONENTS_CONSOLE_H
 #include <engine/shared/ringbuffer.h>
+#include <engine/shared/textsearch.h>
+#include <engine/textrender.h>
 #include <game/client/component.h>
 #include <game/client/lineinput.h>
 
@@ -11,13 +13,34 @@ class CGameConsole : public CComponent
 	class CInstance
 	{
 	public:
+		enum
+		{
+			MAX_PAGE_LINES=128,
+		};
+
 		struct CBacklogEntry
 		{
-			float m_YOffset;
+			int m_ID;
+			float m_YOffset; // the height of the line, -1 if not measured yet
+			uint64 m_SearchMask; // see CSearchQuery
 			bool m_Highlighted;
 			char m_aText[1];
 		};
-		TStaticRingBuffer<CBacklogEntry, 64*1024, CRingBufferBase::FLAG_RECYCLE> m_Backlog;
+		TStaticRingBuffer<CBacklogEntry, 1024*1024, CRingBufferBase::FLAG_RECYCLE> m_Backlog;
+		int m_NextEntryID;
+
+		// the lines are measured once per width, only the ones of the shown
+		// page are laid out and their layouts are kept while they stay there
+		float m_LayoutWidth;
+		int m_LayoutGeneration;
+		CTextCursor m_aLineCursors[MAX_PAGE_LINES];
+
+		// backlog search, started with ctrl+f
+		bool m_Searching;
+		CLineInput m_SearchInput;
+		CSearchQuery m_SearchQuery;
+		int m_SearchMatchID; // -1 if there is none
+		bool m_ShowSearchMatch;
 		TStaticRingBuffer<char, 64*1024, CRingBufferBase::FLAG_RECYCLE> m_History;
 		char *m_pHistoryEntry;
 
@@ -47,6 +70,11 @@ class CGameConsole : public CComponent
 		void Init(CGameConsole *pGameConsole);
 
 		void ClearBacklog();
+		void SetLayoutWidth(float Width);
+		float LineHeight(CBacklogEntry *pEntry);
+		CBacklogEntry *PageStart(int *pPage, int StopID, float PageHeight);
+		void Search(int Direction, bool Restart);
+		void StopSearch();
 		void ClearHistory();
 		void Reset() { m_CompletionRenderOffset = 0; }
 
@@ -95,6 +95,8 @@ void CControls::OnConsoleInit()
 
 	{ static CInputSet s_Set = {this, &m_InputData.m_NextWeapon, 0}; Console()->Register("+nextweapon", "", CFGFLAG_CLIENT, ConKeyInputNextPrevWeapon, (void *)&s_Set, "Switch to next weapon"); }
 	{ static CInputSet s_Set = {this, &m_InputData.m_PrevWeapon, 0}; Console()->Register("+prevweapon", "", CFGFLAG_CLIENT, ConKeyInputNextPrevWeapon, (void *)&s_Set, "Switch to previous weapon"); }
+
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_WEAPONPICKUP, this);
 }
 
 void CControls::OnMessage(int Msg, void *pRawMsg)
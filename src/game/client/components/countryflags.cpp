@@ -4,6 +4,7 @@
 #include <base/system.h>
 
 #include <engine/console.h>
+#include <engine/engine.h>
 #include <engine/graphics.h>
 #include <engine/storage.h>
 #include <engine/textrender.h>
@@ -14,14 +15,95 @@
 #include "countryflags.h"
 
 
-void CCountryFlags::LoadCountryflagsIndexfile()
+static const char *s_apIndices[] = {"custom", "ISO 3166-1"};
+
+void CCountryFlags::DecodeFlags(int Begin, int End, void *pUser)
 {
+	CCountryFlags *pSelf = (CCountryFlags *)pUser;
+	for(int i = Begin; i < End; i++)
+	{
+		CLoadedFlag *pLoaded = &pSelf->m_aLoadedFlags[i];
+		if(!pSelf->Graphics()->LoadPNG(&pLoaded->m_Image, pLoaded->m_aFilename, IStorage::TYPE_ALL))
+			pLoaded->m_Image.m_pData = 0;
+	}
+}
+
+CImageInfo *CCountryFlags::FindLoadedFlag(const char *pFilename)
+{
+	for(int i = 0; i < m_aLoadedFlags.size(); i++)
+		if(!str_comp(m_aLoadedFlags[i].m_aFilename, pFilename))
+			return &m_aLoadedFlags[i].m_Image;
+	return 0;
+}
+
+void CCountryFlags::PackFlags(const array<const CImageInfo *> &rImages)
+{
+	// uniform power of two cells, image i belongs to the i-th unsorted flag
+	int CellWidth = 1, CellHeight = 1;
+	for(int i = 0; i < rImages.size(); i++)
+	{
+		while(CellWidth < rImages[i]->m_Width)
+			CellWidth <<= 1;
+		while(CellHeight < rImages[i]->m_Height)
+			CellHeight <<= 1;
+	}
+	int Width = CellWidth, Height;
+	while(1)
+	{
+		int Columns = Width/CellWidth;
+		int Rows = (rImages.size()+Columns-1)/Columns;
+		Height = CellHeight;
+		while(Height < Rows*CellHeight)
+			Height <<= 1;
+		if(Width >= Height)
+			break;
+		Width <<= 1;
+	}
+
+	unsigned char *pAtlas = (unsigned char *)mem_alloc(Width*Height*4, 1);
+	mem_zero(pAtlas, Width*Height*4);
+	for(int i = 0; i < rImages.size(); i++)
+	{
+		const CImageInfo *pInfo = rImages[i];
+		const unsigned char *pSrc = (const unsigned char *)pInfo->m_pData;
+		const int SrcBpp = pInfo->m_Format == CImageInfo::FORMAT_RGB ? 3 : 4;
+		const int x = (i%(Width/CellWidth))*CellWidth;
+		const int y = (i/(Width/CellWidth))*CellHeight;
+		for(int py = 0; py < pInfo->m_Height; py++)
+			for(int px = 0; px < pInfo->m_Width; px++)
+			{
+				const unsigned char *pPixel = pSrc+(py*pInfo->m_Width+px)*SrcBpp;
+				unsigned char *pDst = pAtlas+((y+py)*Width+x+px)*4;
+				pDst[0] = pPixel[0];
+				pDst[1] = pPixel[1];
+				pDst[2] = pPixel[2];
+				pDst[3] = SrcBpp == 4 ? pPixel[3] : 255;
+			}
+
+		CSubTexture *pTexture = &m_aCountryFlags[i].m_Texture;
+		pTexture->m_aRect[0] = x/(float)Width;
+		pTexture->m_aRect[1] = y/(float)Height;
+		pTexture->m_aRect[2] = (x+pInfo->m_Width)/(float)Width;
+		pTexture->m_aRect[3] = (y+pInfo->m_Height)/(float)Height;
+	}
+	m_AtlasTexture = Graphics()->LoadTextureRaw(Width, Height, CImageInfo::FORMAT_RGBA, pAtlas, CImageInfo::FORMAT_RGBA, 0);
+	mem_free(pAtlas);
+	for(int i = 0; i < rImages.size(); i++)
+		m_aCountryFlags[i].m_Texture.m_Texture = m_AtlasTexture;
+}
+
+void CCountryFlags::OnLoad()
+{
+	m_pIndexData = 0;
+	m_aIndexError[0] = 0;
+	m_aLoadedFlags.clear();
+
 	// read file data into buffer
 	const char *pFilename = "countryflags/index.json";
 	IOHANDLE File = Storage()->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
 	if(!File)
 	{
-		Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "countryflags", "couldn't open index file");
+		str_copy(m_aIndexError, "couldn't open index file", sizeof(m_aIndexError));
 		return;
 	}
 	int FileSize = (int)io_length(File);
@@ -33,27 +115,58 @@ void CCountryFlags::LoadCountryflagsIndexfile()
 	json_settings JsonSettings;
 	mem_zero(&JsonSettings, sizeof(JsonSettings));
 	char aError[256];
-	json_value *pJsonData = json_parse_ex(&JsonSettings, pFileData, FileSize, aError);
+	m_pIndexData = json_parse_ex(&JsonSettings, pFileData, FileSize, aError);
 	mem_free(pFileData);
 
+	if(m_pIndexData == 0)
+	{
+		str_format(m_aIndexError, sizeof(m_aIndexError), "%s: %s", pFilename, aError);
+		return;
+	}
+	if(!Config()->m_ClLoadCountryFlags)
+		return;
+
+	// decode the graphics of the valid entries
+	const json_value &rInit = (*m_pIndexData)["country codes"];
+	if(rInit.type == json_object)
+	{
+		for(unsigned Index = 0; Index < sizeof(s_apIndices)/sizeof(s_apIndices[0]); ++Index)
+		{
+			const json_value &rStart = rInit[s_apIndices[Index]];
+			if(rStart.type != json_array)
+				continue;
+			for(unsigned i = 0; i < rStart.u.array.length; ++i)
+			{
+				int CountryCode = (json_int_t)rStart[i]["code"];
+				if(CountryCode < CODE_LB || CountryCode > CODE_UB)
+					continue;
+				CLoadedFlag Loaded;
+				str_format(Loaded.m_aFilename, sizeof(Loaded.m_aFilename), "countryflags/%s.png", (const char *)rStart[i]["id"]);
+				Loaded.m_Image.m_pData = 0;
+				m_aLoadedFlags.add(Loaded);
+			}
+		}
+	}
+	m_pClient->Engine()->JobPool()->ParallelFor(0, m_aLoadedFlags.size(), 1, DecodeFlags, this);
+}
+
+void CCountryFlags::LoadCountryflagsIndexfile()
+{
+	json_value *pJsonData = m_pIndexData;
 	if(pJsonData == 0)
 	{
-		Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, pFilename, aError);
+		Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "countryflags", m_aIndexError);
 		return;
 	}
 
 	// extract data
+	array<const CImageInfo *> apImages;
 	const json_value &rInit = (*pJsonData)["country codes"];
 	if(rInit.type == json_object)
 	{
-		enum
+		for(unsigned Index = 0; Index < sizeof(s_apIndices)/sizeof(s_apIndices[0]); ++Index)
 		{
-			NUM_INDICES = 2,
-		};
-		const char *paIndices[NUM_INDICES] = {"custom", "ISO 3166-1"};
-		for(int Index = 0; Index < NUM_INDICES; ++Index)
-		{
-			const json_value &rStart = rInit[(const char *)paIndices[Index]];
+			const json_value &rStart = rInit[s_apIndices[Index]];
 			if(rStart.type == json_array)
 			{
 				for(unsigned i = 0; i < rStart.u.array.length; ++i)
@@ -76,18 +189,17 @@ void CCountryFlags::LoadCountryflagsIndexfile()
 					str_copy(CountryFlag.m_aCountryCodeString, pCountryName, sizeof(CountryFlag.m_aCountryCodeString));
 					if(Config()->m_ClLoadCountryFlags)
 					{
-						// load the graphic file
-						CImageInfo Info;
+						// the graphic decoded by OnLoad, packed into the atlas below
 						str_format(aBuf, sizeof(aBuf), "countryflags/%s.png", pCountryName);
-						if(!Graphics()->LoadPNG(&Info, aBuf, IStorage::TYPE_ALL))
+						CImageInfo *pInfo = FindLoadedFlag(aBuf);
+						if(!pInfo || !pInfo->m_pData)
 						{
 							char aMsg[64];
 							str_format(aMsg, sizeof(aMsg), "failed to load '%s'", aBuf);
 							Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "countryflags", aMsg);
 							continue;
 						}
-						CountryFlag.m_Texture = Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
-						mem_free(Info.m_pData);
+						apImages.add(pInfo);
 					}
 					// blocked?
 					CountryFlag.m_Blocked = false;
@@ -107,8 +219,16 @@ void CCountryFlags::LoadCountryflagsIndexfile()
 		}
 	}
 
+	// flags without a graphic were skipped, so the images line up with the flags
+	if(apImages.size())
+		PackFlags(apImages);
+
 	// clean up
 	json_value_free(pJsonData);
+	m_pIndexData = 0;
+	for(int i = 0; i < m_aLoadedFlags.size(); i++)
+		mem_free(m_aLoadedFlags[i].m_Image.m_pData);
+	m_aLoadedFlags.clear();
 	m_aCountryFlags.sort_range();
 
 	// find index of default item
@@ -181,8 +301,9 @@ void CCountryFlags::Render(int CountryCode, const vec4 *pColor, float x, float y
 		pFlag = GetByCountryCode(-1);
 	if(pFlag->m_Texture.IsValid())
 	{
-		Graphics()->TextureSet(pFlag->m_Texture);
+		Graphics()->TextureSet(pFlag->m_Texture.m_Texture);
 		Graphics()->QuadsBegin();
+		Graphics()->QuadsSetSubset(pFlag->m_Texture.m_aRect[0], pFlag->m_Texture.m_aRect[1], pFlag->m_Texture.m_aRect[2], pFlag->m_Texture.m_aRect[3]);
 		Graphics()->SetColor(pColor->r*pColor->a, pColor->g*pColor->a, pColor->b*pColor->a, pColor->a);
 		IGraphics::CQuadItem QuadItem(x, y, w, h);
 		Graphics()->QuadsDrawTL(&QuadItem, 1);
@@ -5,6 +5,7 @@
 #include <base/vmath.h>
 #include <base/tl/sorted_array.h>
 #include <game/client/component.h>
+#include <game/client/render.h>
 
 class CCountryFlags : public CComponent
 {
@@ -14,12 +15,13 @@ public:
 		int m_CountryCode;
 		char m_aCountryCodeString[8];
 		bool m_Blocked;
-		IGraphics::CTextureHandle m_Texture;
+		CSubTexture m_Texture; // the flag's part of the atlas
 
 		bool operator<(const CCountryFlag &Other) const { return str_comp(m_aCountryCodeString, Other.m_aCountryCodeString) < 0; }
 	};
 
 	int GetInitAmount() const;
+	void OnLoad();
 	void OnInit();
 
 	int Num() const;
@@ -37,6 +39,22 @@ private:
 	sorted_array<CCountryFlag> m_aCountryFlags;
 	int m_CodeIndexLUT[CODE_RANGE];
 
+	// parsed and decoded by OnLoad, uploaded by OnInit
+	struct CLoadedFlag
+	{
+		char m_aFilename[64];
+		CImageInfo m_Image; // no data if it failed to load
+	};
+	struct _json_value *m_pIndexData;
+	char m_aIndexError[256];
+	array<CLoadedFlag> m_aLoadedFlags;
+
+	// all flags share one texture, so rows of flags get drawn in one batch
+	IGraphics::CTextureHandle m_AtlasTexture;
+
+	static void DecodeFlags(int Begin, int End, void *pUser);
+	CImageInfo *FindLoadedFlag(const char *pFilename);
+	void PackFlags(const array<const CImageInfo *> &rImages);
 	void LoadCountryflagsIndexfile();
 };
 #endif
@@ -2,6 +2,7 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <engine/shared/config.h>
 #include <engine/graphics.h>
+#include <engine/sound.h>
 #include <engine/textrender.h>
 
 #include <generated/protocol.h>
@@ -17,6 +18,38 @@
 //#include "camera.h"
 #include "debughud.h"
 
+CDebugHud::CDebugHud()
+{
+	m_FramePhase = -1;
+	m_StallPhase = -1;
+	m_MixPhase = -1;
+	m_GpuFramePhase = -1;
+	for(int i = 0; i < IGraphics::NUM_GPU_GROUPS; i++)
+		m_aGpuGroupPhases[i] = -1;
+	m_LastGpuFrame = 0;
+	m_LastStallTime = 0;
+	m_LastMixTime = 0;
+	m_LastGlyphMisses = 0;
+	m_GlyphMissesPerFrame = 0.0f;
+	mem_zero(m_aSnapMarginHistory, sizeof(m_aSnapMarginHistory));
+	mem_zero(m_aPredMarginHistory, sizeof(m_aPredMarginHistory));
+	m_NetTimingIndex = 0;
+	m_NetTimingTick = 0;
+}
+
+void CDebugHud::OnInit()
+{
+	CProfiler *pProfiler = &m_pClient->m_RenderProfiler;
+	m_FramePhase = pProfiler->AddPhase("frame");
+	m_StallPhase = pProfiler->AddPhase("gfx stall");
+	m_MixPhase = pProfiler->AddPhase("sound mix");
+	m_GpuFramePhase = pProfiler->AddPhase("gpu frame");
+	m_aGpuGroupPhases[IGraphics::GPU_GROUP_MAP] = pProfiler->AddPhase("gpu map");
+	m_aGpuGroupPhases[IGraphics::GPU_GROUP_PLAYERS] = pProfiler->AddPhase("gpu players");
+	m_aGpuGroupPhases[IGraphics::GPU_GROUP_HUD] = pProfiler->AddPhase("gpu hud");
+	m_aGpuGroupPhases[IGraphics::GPU_GROUP_OTHER] = pProfiler->AddPhase("gpu other");
+}
+
 void CDebugHud::RenderNetCorrections()
 {
 	if(!Config()->m_Debug || Config()->m_DbgGraphs || !m_pClient->m_Snap.m_pLocalCharacter || !m_pClient->m_Snap.m_pLocalPrevCharacter)
@@ -165,8 +198,221 @@ void CDebugHud::RenderTuning()
 	TextRender()->TextColor(1,1,1,1);
 }
 
+void CDebugHud::RenderNetTiming()
+{
+	if(Client()->State() != IClient::STATE_ONLINE)
+		return;
+
+	// keep sampling while hidden so the graph is filled once it is shown
+	if(Client()->GameTick() != m_NetTimingTick)
+	{
+		m_NetTimingTick = Client()->GameTick();
+		m_NetTimingIndex = (m_NetTimingIndex+1)%NET_TIMING_HISTORY;
+		m_aSnapMarginHistory[m_NetTimingIndex] = Client()->SnapMargin();
+		m_aPredMarginHistory[m_NetTimingIndex] = Client()->PredMargin();
+	}
+
+	if(!Config()->m_DbgNetTiming)
+		return;
+
+	float Width = 300*Graphics()->ScreenAspect();
+	Graphics()->MapScreen(0, 0, Width, 300);
+
+	// the scale grows in steps of 50ms to fit the largest margin
+	int MaxMargin = 50;
+	for(int i = 0; i < NET_TIMING_HISTORY; i++)
+		MaxMargin = max(MaxMargin, max(m_aSnapMarginHistory[i], m_aPredMarginHistory[i]));
+	MaxMargin = (MaxMargin+49)/50*50;
+
+	const float w = NET_TIMING_HISTORY*0.5f, h = 50.0f;
+	const float x = Width-w-5.0f, y = 150.0f;
+	Graphics()->TextureClear();
+	Graphics()->BlendNormal();
+	Graphics()->QuadsBegin();
+	Graphics()->SetColor(0.0f, 0.0f, 0.0f, 0.5f);
+	IGraphics::CQuadItem Background(x, y-h, w, h);
+	Graphics()->QuadsDrawTL(&Background, 1);
+	Graphics()->QuadsEnd();
+
+	Graphics()->LinesBegin();
+	IGraphics::CLineItem aLines[NET_TIMING_HISTORY-1];
+	const int *apHistories[] = {m_aSnapMarginHistory, m_aPredMarginHistory};
+	const vec3 aColors[] = {vec3(0.3f, 1.0f, 0.3f), vec3(0.4f, 0.8f, 1.0f)};
+	for(int g = 0; g < 2; g++)
+	{
+		for(int i = 0; i < NET_TIMING_HISTORY-1; i++)
+		{
+			// oldest sample on the left
+			int a = apHistories[g][(m_NetTimingIndex+1+i)%NET_TIMING_HISTORY];
+			int b = apHistories[g][(m_NetTimingIndex+2+i)%NET_TIMING_HISTORY];
+			aLines[i] = IGraphics::CLineItem(x+i*0.5f, y-h*a/MaxMargin, x+(i+1)*0.5f, y-h*b/MaxMargin);
+		}
+		Graphics()->SetColor(aColors[g].r, aColors[g].g, aColors[g].b, 1.0f);
+		Graphics()->LinesDraw(aLines, NET_TIMING_HISTORY-1);
+	}
+	Graphics()->LinesEnd();
+
+	char aBuf[128];
+	static CTextCursor s_Cursor(5.0f);
+	s_Cursor.MoveTo(x, y-h-24.0f);
+	s_Cursor.m_MaxLines = -1;
+	s_Cursor.m_LineSpacing = 1.0f;
+	s_Cursor.Reset();
+	TextRender()->TextColor(aColors[0].r, aColors[0].g, aColors[0].b, 1.0f);
+	str_format(aBuf, sizeof(aBuf), "snap margin %dms  jitter %dms  loss %d%%", Client()->SnapMargin(), Client()->SnapJitter(), Client()->SnapLoss());
+	TextRender()->TextDeferred(&s_Cursor, aBuf, -1);
+	TextRender()->TextNewline(&s_Cursor);
+	TextRender()->TextColor(aColors[1].r, aColors[1].g, aColors[1].b, 1.0f);
+	str_format(aBuf, sizeof(aBuf), "pred margin %dms  jitter %dms", Client()->PredMargin(), Client()->PredJitter());
+	TextRender()->TextDeferred(&s_Cursor, aBuf, -1);
+	TextRender()->TextNewline(&s_Cursor);
+	TextRender()->TextColor(1.0f, 1.0f, 1.0f, 1.0f);
+	str_format(aBuf, sizeof(aBuf), "%dms", MaxMargin);
+	TextRender()->TextDeferred(&s_Cursor, aBuf, -1);
+	TextRender()->DrawTextOutlined(&s_Cursor);
+}
+
+void CDebugHud::RenderProfiler()
+{
+	CProfiler *pProfiler = &m_pClient->m_RenderProfiler;
+	if(!pProfiler->IsEnabled())
+		return;
+
+	// the parts of the frame that aren't component renders
+	int64 QueueStall, FrameStall;
+	Graphics()->GetStallTimes(&QueueStall, &FrameStall);
+	unsigned MixTime = Sound()->MixTime();
+	unsigned GlyphMisses = TextRender()->NumGlyphCacheMisses();
+	pProfiler->Add(m_FramePhase, (int64)(Client()->RenderFrameTime()*time_freq()));
+	if(m_LastStallTime)
+	{
+		pProfiler->Add(m_StallPhase, QueueStall+FrameStall-m_LastStallTime);
+		pProfiler->Add(m_MixPhase, (int64)(MixTime-m_LastMixTime)*time_freq()/1000000);
+		m_GlyphMissesPerFrame = m_GlyphMissesPerFrame*0.95f + (GlyphMisses-m_LastGlyphMisses)*0.05f;
+	}
+	m_LastStallTime = QueueStall+FrameStall;
+
+	// the gpu times come a few frames late and not for every frame
+	IGraphics::CGpuTimes GpuTimes;
+	if(Graphics()->GetGpuTimes(&GpuTimes) && GpuTimes.m_NumFrames != m_LastGpuFrame)
+	{
+		m_LastGpuFrame = GpuTimes.m_NumFrames;
+		pProfiler->Add(m_GpuFramePhase, (int64)GpuTimes.m_Frame*time_freq()/1000000);
+		for(int i = 0; i < IGraphics::NUM_GPU_GROUPS; i++)
+			pProfiler->Add(m_aGpuGroupPhases[i], (int64)GpuTimes.m_aGroups[i]*time_freq()/1000000);
+	}
+	m_LastMixTime = MixTime;
+	m_LastGlyphMisses = GlyphMisses;
+
+	float Width = 300*Graphics()->ScreenAspect();
+	Graphics()->MapScreen(0, 0, Width, 300);
+
+	static CTextCursor s_CursorLabels(5.0f);
+	s_CursorLabels.MoveTo(5.0f, 40.0f);
+	s_CursorLabels.m_MaxLines = -1;
+	s_CursorLabels.m_LineSpacing = 1.0f;
+	s_CursorLabels.Reset(0);
+
+	static CTextCursor s_CursorValues(5.0f);
+	s_CursorValues.MoveTo(150.0f, 40.0f);
+	s_CursorValues.m_MaxLines = -1;
+	s_CursorValues.m_LineSpacing = 1.0f;
+	s_CursorValues.m_Align = TEXTALIGN_TR;
+	s_CursorValues.Reset();
+
+	char aBuf[128];
+	TextRender()->TextDeferred(&s_CursorLabels, "ms", -1);
+	TextRender()->TextNewline(&s_CursorLabels);
+	TextRender()->TextDeferred(&s_CursorValues, "p50     p99     max", -1);
+	TextRender()->TextNewline(&s_CursorValues);
+	for(int i = 0; i < pProfiler->NumPhases(); i++)
+	{
+		CProfiler::CStats Stats;
+		pProfiler->GetStats(i, &Stats);
+		if(!Stats.m_NumSamples)
+			continue;
+		TextRender()->TextDeferred(&s_CursorLabels, pProfiler->PhaseName(i), -1);
+		TextRender()->TextNewline(&s_CursorLabels);
+		str_format(aBuf, sizeof(aBuf), "%.2f  %.2f  %.2f", Stats.m_P50/1000.0f, Stats.m_P99/1000.0f, Stats.m_Max/1000.0f);
+		TextRender()->TextDeferred(&s_CursorValues, aBuf, -1);
+		TextRender()->TextNewline(&s_CursorValues);
+	}
+
+	const IGraphics::CFrameStats *pFrameStats = Graphics()->LastFrameStats();
+	TextRender()->TextNewline(&s_CursorLabels);
+	TextRender()->TextNewline(&s_CursorValues);
+	const char *paStrings[] = {"commands", "vertex data", "draw calls", "texture binds", "glyph misses"};
+	for(unsigned i = 0; i < sizeof(paStrings)/sizeof(paStrings[0]); i++)
+	{
+		TextRender()->TextDeferred(&s_CursorLabels, paStrings[i], -1);
+		TextRender()->TextNewline(&s_CursorLabels);
+	}
+	str_format(aBuf, sizeof(aBuf), "%.1f KiB", pFrameStats->m_CommandBytes/1024.0f);
+	TextRender()->TextDeferred(&s_CursorValues, aBuf, -1);
+	TextRender()->TextNewline(&s_CursorValues);
+	str_format(aBuf, sizeof(aBuf), "%.1f KiB", pFrameStats->m_DataBytes/1024.0f);
+	TextRender()->TextDeferred(&s_CursorValues, aBuf, -1);
+	TextRender()->TextNewline(&s_CursorValues);
+	str_format(aBuf, sizeof(aBuf), "%d", pFrameStats->m_NumDrawCalls);
+	TextRender()->TextDeferred(&s_CursorValues, aBuf, -1);
+	TextRender()->TextNewline(&s_CursorValues);
+	str_format(aBuf, sizeof(aBuf), "%d", pFrameStats->m_NumTextureBinds);
+	TextRender()->TextDeferred(&s_CursorValues, aBuf, -1);
+	TextRender()->TextNewline(&s_CursorValues);
+	str_format(aBuf, sizeof(aBuf), "%.1f/frame", m_GlyphMissesPerFrame);
+	TextRender()->TextDeferred(&s_CursorValues, aBuf, -1);
+
+	TextRender()->DrawTextOutlined(&s_CursorLabels);
+	TextRender()->DrawTextOutlined(&s_CursorValues);
+
+	// frame time histogram from 1ms to 128ms, one bar per bucket
+	const int FirstBucket = CProfiler::Bucket(1000);
+	const int LastBucket = CProfiler::Bucket(128000);
+	const int NumBars = LastBucket-FirstBucket+1;
+	unsigned aCounts[CProfiler::NUM_BUCKETS];
+	pProfiler->GetHistogram(m_FramePhase, aCounts);
+	// everything outside of the range goes to the first and last bar
+	for(int i = 0; i < FirstBucket; i++)
+		aCounts[FirstBucket] += aCounts[i];
+	for(int i = LastBucket+1; i < CProfiler::NUM_BUCKETS; i++)
+		aCounts[LastBucket] += aCounts[i];
+	unsigned MaxCount = 1;
+	for(int i = FirstBucket; i <= LastBucket; i++)
+		MaxCount = max(MaxCount, aCounts[i]);
+
+	const float x = 5.0f, y = 250.0f, h = 40.0f, BarWidth = 3.0f;
+	Graphics()->TextureClear();
+	Graphics()->BlendNormal();
+	Graphics()->QuadsBegin();
+	Graphics()->SetColor(0.0f, 0.0f, 0.0f, 0.5f);
+	IGraphics::CQuadItem Background(x, y-h, NumBars*BarWidth, h);
+	Graphics()->QuadsDrawTL(&Background, 1);
+	IGraphics::CQuadItem aBars[CProfiler::NUM_BUCKETS];
+	int NumQuads = 0;
+	for(int i = FirstBucket; i <= LastBucket; i++)
+	{
+		float BarHeight = h*aCounts[i]/MaxCount;
+		if(BarHeight > 0.0f)
+			aBars[NumQuads++] = IGraphics::CQuadItem(x+(i-FirstBucket)*BarWidth, y-BarHeight, BarWidth-0.5f, BarHeight);
+	}
+	Graphics()->SetColor(0.4f, 0.8f, 1.0f, 0.8f);
+	Graphics()->QuadsDrawTL(aBars, NumQuads);
+	Graphics()->QuadsEnd();
+
+	static CTextCursor s_CursorAxis(5.0f);
+	for(int Ms = 1; Ms <= 128; Ms *= 4)
+	{
+		s_CursorAxis.MoveTo(x+(CProfiler::Bucket(Ms*1000)-FirstBucket)*BarWidth, y);
+		s_CursorAxis.Reset();
+		str_format(aBuf, sizeof(aBuf), "%dms", Ms);
+		TextRender()->TextOutlined(&s_CursorAxis, aBuf, -1);
+	}
+}
+
 void CDebugHud::OnRender()
 {
 	RenderTuning();
 	RenderNetCorrections();
+	RenderNetTiming();
+	RenderProfiler();
 }
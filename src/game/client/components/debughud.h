@@ -2,13 +2,39 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef GAME_CLIENT_COMPONENTS_DEBUGHUD_H
 #define GAME_CLIENT_COMPONENTS_DEBUGHUD_H
+#include <engine/graphics.h>
 #include <game/client/component.h>
 
 class CDebugHud : public CComponent
 {
+	int m_FramePhase;
+	int m_StallPhase;
+	int m_MixPhase;
+	int m_GpuFramePhase;
+	int m_aGpuGroupPhases[IGraphics::NUM_GPU_GROUPS];
+	int m_LastGpuFrame;
+	int64 m_LastStallTime;
+	unsigned m_LastMixTime;
+	unsigned m_LastGlyphMisses;
+	float m_GlyphMissesPerFrame;
+
+	// history of the adaptive margins, one sample per game tick
+	enum
+	{
+		NET_TIMING_HISTORY=256,
+	};
+	int m_aSnapMarginHistory[NET_TIMING_HISTORY];
+	int m_aPredMarginHistory[NET_TIMING_HISTORY];
+	int m_NetTimingIndex;
+	int m_NetTimingTick;
+
 	void RenderNetCorrections();
+	void RenderNetTiming();
 	void RenderTuning();
+	void RenderProfiler();
 public:
+	CDebugHud();
+	virtual void OnInit();
 	virtual void OnRender();
 };
 
@@ -26,6 +26,16 @@ CEffects::CEffects()
 	m_DamageTakenTick = 0;
 }
 
+int CEffects::NumParticles(int Num) const
+{
+	return max(1, round_to_int(Num*Client()->QualityLevel()));
+}
+
+bool CEffects::SkipTrail() const
+{
+	return random_float() > Client()->QualityLevel();
+}
+
 void CEffects::AirJump(vec2 Pos)
 {
 	CParticle p;
@@ -83,7 +93,7 @@ void CEffects::DamageIndicator(vec2 Pos, int Amount)
 
 void CEffects::PowerupShine(vec2 Pos, vec2 size)
 {
-	if(!m_Add50hz)
+	if(!m_Add50hz || SkipTrail())
 		return;
 
 	CParticle p;
@@ -104,7 +114,7 @@ void CEffects::PowerupShine(vec2 Pos, vec2 size)
 
 void CEffects::SmokeTrail(vec2 Pos, vec2 Vel)
 {
-	if(!m_Add50hz)
+	if(!m_Add50hz || SkipTrail())
 		return;
 
 	CParticle p;
@@ -123,7 +133,7 @@ void CEffects::SmokeTrail(vec2 Pos, vec2 Vel)
 
 void CEffects::SkidTrail(vec2 Pos, vec2 Vel)
 {
-	if(!m_Add100hz)
+	if(!m_Add100hz || SkipTrail())
 		return;
 
 	CParticle p;
@@ -142,7 +152,7 @@ void CEffects::SkidTrail(vec2 Pos, vec2 Vel)
 
 void CEffects::BulletTrail(vec2 Pos)
 {
-	if(!m_Add100hz)
+	if(!m_Add100hz || SkipTrail())
 		return;
 
 	CParticle p;
@@ -158,7 +168,8 @@ void CEffects::BulletTrail(vec2 Pos)
 
 void CEffects::PlayerSpawn(vec2 Pos)
 {
-	for(int i = 0; i < 32; i++)
+	const int Num = NumParticles(32);
+	for(int i = 0; i < Num; i++)
 	{
 		CParticle p;
 		p.SetDefault();
@@ -204,7 +215,8 @@ void CEffects::PlayerDeath(vec2 Pos, int ClientID)
 		}
 	}
 
-	for(int i = 0; i < 64; i++)
+	const int Num = NumParticles(64);
+	for(int i = 0; i < Num; i++)
 	{
 		CParticle p;
 		p.SetDefault();
@@ -250,7 +262,8 @@ void CEffects::Explosion(vec2 Pos)
 	m_pClient->m_pParticles->Add(CParticles::GROUP_EXPLOSIONS, &p);
 
 	// add the smoke
-	for(int i = 0; i < 24; i++)
+	const int Num = NumParticles(24);
+	for(int i = 0; i < Num; i++)
 	{
 		CParticle p;
 		p.SetDefault();
@@ -11,6 +11,10 @@ class CEffects : public CComponent
 
 	int m_DamageTaken;
 	float m_DamageTakenTick;
+
+	// the optional particles scale with the quality level of the client
+	int NumParticles(int Num) const;
+	bool SkipTrail() const;
 public:
 	CEffects();
 
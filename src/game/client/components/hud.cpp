@@ -950,6 +950,12 @@ void CHud::RenderLocalTime(float x)
 	TextRender()->TextOutlined(&s_Cursor, aTimeStr, -1);
 }
 
+void CHud::OnConsoleInit()
+{
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_KILLMSG, this);
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_CHECKPOINT, this);
+}
+
 void CHud::OnMessage(int MsgType, void *pRawMsg)
 {
 	if(MsgType == NETMSGTYPE_SV_CHECKPOINT)
@@ -41,6 +41,7 @@ public:
 	CHud();
 
 	virtual void OnReset();
+	virtual void OnConsoleInit();
 	virtual void OnMessage(int MsgType, void *pRawMsg);
 	virtual void OnRender();
 };
@@ -29,6 +29,12 @@ void CInfoMessages::AddInfoMsg(int Type, CInfoMsg NewMsg)
 	m_aInfoMsgs[m_InfoMsgCurrent] = NewMsg;
 }
 
+void CInfoMessages::OnConsoleInit()
+{
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_KILLMSG, this);
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_RACEFINISH, this);
+}
+
 void CInfoMessages::OnMessage(int MsgType, void *pRawMsg)
 {
 	// hint TextRender to render text, deferred, with correct fontsize
@@ -77,7 +83,7 @@ void CInfoMessages::OnMessage(int MsgType, void *pRawMsg)
 				const CSkins::CSkin *pDummy = m_pClient->m_pSkins->Get(Skin);
 				for(int p = 0; p < NUM_SKINPARTS; p++)
 				{
-					Kill.m_Player2RenderInfo.m_aTextures[p] = pDummy->m_apParts[p]->m_OrgTexture;
+					Kill.m_Player2RenderInfo.m_aTextures[p] = m_pClient->m_pSkins->GetOrgTexture(pDummy->m_apParts[p]);
 					if(IsTeamplay)
 					{
 						int ColorVal = m_pClient->m_pSkins->GetTeamColor(0, 0x000000, KillerTeam, p);
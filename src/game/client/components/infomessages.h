@@ -55,6 +55,7 @@ class CInfoMessages : public CComponent
 public:
 	virtual void OnReset();
 	virtual void OnRender();
+	virtual void OnConsoleInit();
 	virtual void OnMessage(int MsgType, void *pRawMsg);
 };
 
@@ -16,7 +16,7 @@
 #include "items.h"
 
 
-void CItems::RenderProjectile(const CNetObj_Projectile *pCurrent, int ItemID)
+bool CItems::RenderProjectile(const CNetObj_Projectile *pCurrent, int ItemID, IGraphics::CQuadInstance *pInstance)
 {
 	// get positions
 	float Curvature = 0;
@@ -47,7 +47,7 @@ void CItems::RenderProjectile(const CNetObj_Projectile *pCurrent, int ItemID)
 	else
 		Ct = (Client()->PrevGameTick()-pCurrent->m_StartTick)/(float)SERVER_TICK_SPEED + s_LastGameTickTime;
 	if(Ct < 0)
-		return; // projectile haven't been shot yet
+		return false; // projectile haven't been shot yet
 
 	vec2 StartPos(pCurrent->m_X, pCurrent->m_Y);
 	vec2 StartVel(pCurrent->m_VelX/100.0f, pCurrent->m_VelY/100.0f);
@@ -55,10 +55,7 @@ void CItems::RenderProjectile(const CNetObj_Projectile *pCurrent, int ItemID)
 	vec2 PrevPos = CalcPos(StartPos, StartVel, Curvature, Speed, Ct-0.001f);
 
 
-	Graphics()->TextureSet(g_pData->m_aImages[IMAGE_GAME].m_Id);
-	Graphics()->QuadsBegin();
-
-	RenderTools()->SelectSprite(g_pData->m_Weapons.m_aId[clamp(pCurrent->m_Type, 0, NUM_WEAPONS-1)].m_pSpriteProj);
+	RenderTools()->GetSpriteTexCoords(g_pData->m_Weapons.m_aId[clamp(pCurrent->m_Type, 0, NUM_WEAPONS-1)].m_pSpriteProj, 0, pInstance->m_aTexCoords);
 	vec2 Vel = Pos-PrevPos;
 	//vec2 pos = mix(vec2(prev->x, prev->y), vec2(current->x, current->y), Client()->IntraGameTick());
 
@@ -71,7 +68,7 @@ void CItems::RenderProjectile(const CNetObj_Projectile *pCurrent, int ItemID)
 		static float s_Time = 0.0f;
 		static float s_LastLocalTime = Now;
 		s_Time += (Now - s_LastLocalTime) * m_pClient->GetAnimationPlaybackSpeed();
-		Graphics()->QuadsSetRotation(s_Time*pi*2*2 + ItemID);
+		pInstance->m_Rotation = s_Time*pi*2*2 + ItemID;
 		s_LastLocalTime = Now;
 	}
 	else
@@ -79,16 +76,24 @@ void CItems::RenderProjectile(const CNetObj_Projectile *pCurrent, int ItemID)
 		m_pClient->m_pEffects->BulletTrail(Pos);
 
 		if(length(Vel) > 0.00001f)
-			Graphics()->QuadsSetRotation(angle(Vel));
+			pInstance->m_Rotation = angle(Vel);
 		else
-			Graphics()->QuadsSetRotation(0);
+			pInstance->m_Rotation = 0;
 
 	}
 
-	IGraphics::CQuadItem QuadItem(Pos.x, Pos.y, 32, 32);
-	Graphics()->QuadsDraw(&QuadItem, 1);
-	Graphics()->QuadsSetRotation(0);
-	Graphics()->QuadsEnd();
+	pInstance->m_X = Pos.x;
+	pInstance->m_Y = Pos.y;
+	pInstance->m_Width = 32;
+	pInstance->m_Height = 32;
+	pInstance->m_R = pInstance->m_G = pInstance->m_B = pInstance->m_A = 1.0f;
+	return true;
+}
+
+void CItems::RenderProjectiles(const IGraphics::CQuadInstance *pInstances, int Num)
+{
+	Graphics()->TextureSet(g_pData->m_aImages[IMAGE_GAME].m_Id);
+	Graphics()->RenderQuadInstances(pInstances, Num);
 }
 
 void CItems::RenderPickup(const CNetObj_Pickup *pPrev, const CNetObj_Pickup *pCurrent)
@@ -265,44 +270,38 @@ void CItems::OnRender()
 	if(Client()->State() < IClient::STATE_ONLINE)
 		return;
 
-	int Num = Client()->SnapNumItems(IClient::SNAP_CURRENT);
+	// projectiles are collected and drawn together
+	IGraphics::CQuadInstance aProjectiles[MAX_PROJECTILES];
+	int NumProjectiles = 0;
+
+	int Num;
+	const CGameClient::CSnapState::CItemView *pViews = m_pClient->ItemViews(CGameClient::ITEMVIEW_PROJECTILE, &Num);
 	for(int i = 0; i < Num; i++)
 	{
-		IClient::CSnapItem Item;
-		const void *pData = Client()->SnapGetItem(IClient::SNAP_CURRENT, i, &Item);
-
-		if(Item.m_Type == NETOBJTYPE_PROJECTILE)
+		if(NumProjectiles == MAX_PROJECTILES)
 		{
-			RenderProjectile((const CNetObj_Projectile *)pData, Item.m_ID);
-		}
-		else if(Item.m_Type == NETOBJTYPE_PICKUP)
-		{
-			const void *pPrev = Client()->SnapFindItem(IClient::SNAP_PREV, Item.m_Type, Item.m_ID);
-			if(pPrev)
-				RenderPickup((const CNetObj_Pickup *)pPrev, (const CNetObj_Pickup *)pData);
-		}
-		else if(Item.m_Type == NETOBJTYPE_LASER)
-		{
-			RenderLaser((const CNetObj_Laser *)pData);
+			RenderProjectiles(aProjectiles, NumProjectiles);
+			NumProjectiles = 0;
 		}
+		if(RenderProjectile((const CNetObj_Projectile *)pViews[i].m_pCur, pViews[i].m_ID, &aProjectiles[NumProjectiles]))
+			NumProjectiles++;
 	}
+	RenderProjectiles(aProjectiles, NumProjectiles);
+
+	pViews = m_pClient->ItemViews(CGameClient::ITEMVIEW_PICKUP, &Num);
+	for(int i = 0; i < Num; i++)
+		RenderPickup((const CNetObj_Pickup *)pViews[i].m_pPrev, (const CNetObj_Pickup *)pViews[i].m_pCur);
+
+	pViews = m_pClient->ItemViews(CGameClient::ITEMVIEW_LASER, &Num);
+	for(int i = 0; i < Num; i++)
+		RenderLaser((const CNetObj_Laser *)pViews[i].m_pCur);
 
 	// render flag
+	pViews = m_pClient->ItemViews(CGameClient::ITEMVIEW_FLAG, &Num);
 	for(int i = 0; i < Num; i++)
 	{
-		IClient::CSnapItem Item;
-		const void *pData = Client()->SnapGetItem(IClient::SNAP_CURRENT, i, &Item);
-
-		if(Item.m_Type == NETOBJTYPE_FLAG)
-		{
-			const void *pPrev = Client()->SnapFindItem(IClient::SNAP_PREV, Item.m_Type, Item.m_ID);
-			if(pPrev)
-			{
-				const void *pPrevGameDataFlag = Client()->SnapFindItem(IClient::SNAP_PREV, NETOBJTYPE_GAMEDATAFLAG, m_pClient->m_Snap.m_GameDataFlagSnapID);
-				RenderFlag(static_cast<const CNetObj_Flag *>(pPrev), static_cast<const CNetObj_Flag *>(pData),
-							static_cast<const CNetObj_GameDataFlag *>(pPrevGameDataFlag), m_pClient->m_Snap.m_pGameDataFlag);
-			}
-		}
+		RenderFlag(static_cast<const CNetObj_Flag *>(pViews[i].m_pPrev), static_cast<const CNetObj_Flag *>(pViews[i].m_pCur),
+					m_pClient->m_Snap.m_pPrevGameDataFlag, m_pClient->m_Snap.m_pGameDataFlag);
 	}
 }
 
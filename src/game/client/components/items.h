@@ -2,11 +2,19 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef GAME_CLIENT_COMPONENTS_ITEMS_H
 #define GAME_CLIENT_COMPONENTS_ITEMS_H
+#include <engine/graphics.h>
 #include <game/client/component.h>
 
 class CItems : public CComponent
 {
-	void RenderProjectile(const CNetObj_Projectile *pCurrent, int ItemID);
+	enum
+	{
+		MAX_PROJECTILES=256,
+	};
+
+	// fills in the instance, returns false if the projectile isn't visible yet
+	bool RenderProjectile(const CNetObj_Projectile *pCurrent, int ItemID, IGraphics::CQuadInstance *pInstance);
+	void RenderProjectiles(const IGraphics::CQuadInstance *pInstances, int Num);
 	void RenderPickup(const CNetObj_Pickup *pPrev, const CNetObj_Pickup *pCurrent);
 	void RenderFlag(const CNetObj_Flag *pPrev, const CNetObj_Flag *pCurrent, const CNetObj_GameDataFlag *pPrevGameDataFlag, const CNetObj_GameDataFlag *pCurGameDataFlag);
 	void RenderLaser(const struct CNetObj_Laser *pCurrent);
@@ -3,6 +3,7 @@
 #include <engine/graphics.h>
 #include <engine/map.h>
 #include <engine/storage.h>
+#include <engine/shared/config.h>
 #include <game/client/component.h>
 #include <game/mapitems.h>
 
@@ -13,18 +14,97 @@ CMapImages::CMapImages()
 	m_Info[MAP_TYPE_GAME].m_Count = 0;
 	m_Info[MAP_TYPE_MENU].m_Count = 0;
 
+	for(int i = 0; i < MAX_CACHED_TEXTURES; i++)
+		m_aCache[i].m_Used = false;
+	m_CacheUseCounter = 0;
+
 	m_EasterIsLoaded = false;
 }
 
+int CMapImages::FindCachedTexture(const SHA256_DIGEST *pKey, int Width, int Height, int Format, int Flags) const
+{
+	for(int i = 0; i < MAX_CACHED_TEXTURES; i++)
+	{
+		const CCachedTexture *pEntry = &m_aCache[i];
+		if(pEntry->m_Used && pEntry->m_Width == Width && pEntry->m_Height == Height && pEntry->m_Format == Format &&
+			pEntry->m_Flags == Flags && sha256_comp(pEntry->m_Key, *pKey) == 0)
+			return i;
+	}
+	return -1;
+}
+
+int CMapImages::AddCachedTexture(IGraphics::CTextureHandle Texture, const SHA256_DIGEST *pKey, int Width, int Height, int Format, int Flags, int Size)
+{
+	// take a free slot, or the least recently used texture no map refers to
+	int Slot = -1;
+	for(int i = 0; i < MAX_CACHED_TEXTURES; i++)
+	{
+		if(!m_aCache[i].m_Used)
+		{
+			Slot = i;
+			break;
+		}
+		if(m_aCache[i].m_Refs == 0 && (Slot == -1 || m_aCache[i].m_LastUse < m_aCache[Slot].m_LastUse))
+			Slot = i;
+	}
+	if(Slot == -1)
+		return -1;
+
+	CCachedTexture *pEntry = &m_aCache[Slot];
+	if(pEntry->m_Used)
+		Graphics()->UnloadTexture(&pEntry->m_Texture);
+	pEntry->m_Texture = Texture;
+	pEntry->m_Key = *pKey;
+	pEntry->m_Width = Width;
+	pEntry->m_Height = Height;
+	pEntry->m_Format = Format;
+	pEntry->m_Flags = Flags;
+	pEntry->m_Size = Size;
+	pEntry->m_Refs = 0;
+	pEntry->m_LastUse = m_CacheUseCounter;
+	pEntry->m_Used = true;
+	return Slot;
+}
+
+void CMapImages::EvictCachedTextures()
+{
+	const int64 Budget = (int64)Config()->m_ClMapTextureCache*1024*1024;
+	int64 Unused = 0;
+	for(int i = 0; i < MAX_CACHED_TEXTURES; i++)
+		if(m_aCache[i].m_Used && m_aCache[i].m_Refs == 0)
+			Unused += m_aCache[i].m_Size;
+
+	// drop the least recently used textures of earlier maps until the rest fits
+	while(Unused > Budget)
+	{
+		int Oldest = -1;
+		for(int i = 0; i < MAX_CACHED_TEXTURES; i++)
+			if(m_aCache[i].m_Used && m_aCache[i].m_Refs == 0 && (Oldest == -1 || m_aCache[i].m_LastUse < m_aCache[Oldest].m_LastUse))
+				Oldest = i;
+		if(Oldest == -1)
+			break;
+		Graphics()->UnloadTexture(&m_aCache[Oldest].m_Texture);
+		m_aCache[Oldest].m_Used = false;
+		Unused -= m_aCache[Oldest].m_Size;
+	}
+}
+
 void CMapImages::LoadMapImages(IMap *pMap, class CLayers *pLayers, int MapType)
 {
 	if(MapType < 0 || MapType >= NUM_MAP_TYPES)
 		return;
 
-	// unload all textures
+	// release the textures of the previous map, they stay cached for the next one
 	for(int i = 0; i < m_Info[MapType].m_Count; i++)
-		Graphics()->UnloadTexture(&(m_Info[MapType].m_aTextures[i]));
+	{
+		int CacheIndex = m_Info[MapType].m_aCacheIndices[i];
+		if(CacheIndex >= 0)
+			m_aCache[CacheIndex].m_Refs--;
+		else
+			Graphics()->UnloadTexture(&(m_Info[MapType].m_aTextures[i]));
+	}
 	m_Info[MapType].m_Count = 0;
+	m_CacheUseCounter++;
 
 	int Start;
 	pMap->GetType(MAPITEMTYPE_IMAGE, &Start, &m_Info[MapType].m_Count);
@@ -33,7 +113,7 @@ void CMapImages::LoadMapImages(IMap *pMap, class CLayers *pLayers, int MapType)
 	// load new textures
 	for(int i = 0; i < m_Info[MapType].m_Count; i++)
 	{
-		int TextureFlags = 0;
+		int TextureFlags = IGraphics::TEXLOAD_ASYNC;
 		bool FoundQuadLayer = false;
 		bool FoundTileLayer = false;
 		for(int k = 0; k < pLayers->NumLayers(); k++)
@@ -45,24 +125,63 @@ void CMapImages::LoadMapImages(IMap *pMap, class CLayers *pLayers, int MapType)
 				FoundTileLayer = true;
 		}
 		if(FoundTileLayer)
-			TextureFlags = FoundQuadLayer ? IGraphics::TEXLOAD_MULTI_DIMENSION : IGraphics::TEXLOAD_ARRAY_256;
+			TextureFlags |= FoundQuadLayer ? IGraphics::TEXLOAD_MULTI_DIMENSION : IGraphics::TEXLOAD_ARRAY_256;
 
 		CMapItemImage *pImg = (CMapItemImage *)pMap->GetItem(Start+i, 0, 0);
-		if(pImg->m_External || (pImg->m_Version > 1 && pImg->m_Format != CImageInfo::FORMAT_RGB && pImg->m_Format != CImageInfo::FORMAT_RGBA))
+		IGraphics::CTextureHandle Texture;
+		SHA256_DIGEST Key;
+		int Width, Height, Format, Size;
+		bool External = pImg->m_External || (pImg->m_Version > 1 && pImg->m_Format != CImageInfo::FORMAT_RGB && pImg->m_Format != CImageInfo::FORMAT_RGBA);
+		char aPath[IO_MAX_PATH_LENGTH];
+		void *pData = 0;
+		if(External)
 		{
-			char Buf[IO_MAX_PATH_LENGTH];
+			// external images are keyed by their path
 			char *pName = (char *)pMap->GetData(pImg->m_ImageName);
-			str_format(Buf, sizeof(Buf), "mapres/%s.png", pName);
-			m_Info[MapType].m_aTextures[i] = Graphics()->LoadTexture(Buf, IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, TextureFlags);
+			str_format(aPath, sizeof(aPath), "mapres/%s.png", pName);
+			Key = sha256(aPath, str_length(aPath));
+			Width = Height = Format = -1;
+			Size = EXTERNAL_TEXTURE_SIZE;
 		}
 		else
 		{
-			void *pData = pMap->GetData(pImg->m_ImageData);
-			m_Info[MapType].m_aTextures[i] = Graphics()->LoadTextureRaw(pImg->m_Width, pImg->m_Height, pImg->m_Version == 1 ? CImageInfo::FORMAT_RGBA : pImg->m_Format, pData, CImageInfo::FORMAT_RGBA, TextureFlags);
+			// embedded images are keyed by their pixels, maps often embed the same tilesets
+			Width = pImg->m_Width;
+			Height = pImg->m_Height;
+			Format = pImg->m_Version == 1 ? CImageInfo::FORMAT_RGBA : pImg->m_Format;
+			pData = pMap->GetData(pImg->m_ImageData);
+			Key = sha256(pData, Width*Height*(Format == CImageInfo::FORMAT_RGB ? 3 : 4));
+			Size = Width*Height*4;
+		}
+		if(TextureFlags&IGraphics::TEXLOAD_MULTI_DIMENSION)
+			Size *= 2;
+
+		int CacheIndex = FindCachedTexture(&Key, Width, Height, Format, TextureFlags);
+		if(CacheIndex >= 0)
+			Texture = m_aCache[CacheIndex].m_Texture;
+		else
+		{
+			if(External)
+				Texture = Graphics()->LoadTexture(aPath, IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, TextureFlags);
+			else
+				Texture = Graphics()->LoadTextureRaw(Width, Height, Format, pData, CImageInfo::FORMAT_RGBA, TextureFlags);
+			if(Texture.IsValid())
+				CacheIndex = AddCachedTexture(Texture, &Key, Width, Height, Format, TextureFlags, Size);
+		}
+		if(!External)
 			pMap->UnloadData(pImg->m_ImageData);
+
+		if(CacheIndex >= 0)
+		{
+			m_aCache[CacheIndex].m_Refs++;
+			m_aCache[CacheIndex].m_LastUse = m_CacheUseCounter;
 		}
+		m_Info[MapType].m_aTextures[i] = Texture;
+		m_Info[MapType].m_aCacheIndices[i] = CacheIndex;
 	}
 
+	EvictCachedTextures();
+
 	// easter time, preload easter tileset
 	if(m_pClient->IsEaster())
 		GetEasterTexture();
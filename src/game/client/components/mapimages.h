@@ -2,6 +2,7 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef GAME_CLIENT_COMPONENTS_MAPIMAGES_H
 #define GAME_CLIENT_COMPONENTS_MAPIMAGES_H
+#include <base/hash.h>
 #include <game/client/component.h>
 
 class CMapImages : public CComponent
@@ -12,14 +13,39 @@ class CMapImages : public CComponent
 
 		MAP_TYPE_GAME=0,
 		MAP_TYPE_MENU,
-		NUM_MAP_TYPES
+		NUM_MAP_TYPES,
+
+		MAX_CACHED_TEXTURES=MAX_TEXTURES*NUM_MAP_TYPES*2,
+		EXTERNAL_TEXTURE_SIZE=1024*1024*4 // typical mapres size, external images are not decoded here
 	};
 	struct
 	{
 		IGraphics::CTextureHandle m_aTextures[MAX_TEXTURES];
+		int m_aCacheIndices[MAX_TEXTURES];
 		int m_Count;
 	} m_Info[NUM_MAP_TYPES];
 
+	// textures keyed by their pixel data (or mapres path), kept across map changes
+	struct CCachedTexture
+	{
+		IGraphics::CTextureHandle m_Texture;
+		SHA256_DIGEST m_Key;
+		int m_Width;
+		int m_Height;
+		int m_Format;
+		int m_Flags;
+		int m_Size;
+		int m_Refs;
+		unsigned m_LastUse;
+		bool m_Used;
+	};
+	CCachedTexture m_aCache[MAX_CACHED_TEXTURES];
+	unsigned m_CacheUseCounter;
+
+	int FindCachedTexture(const SHA256_DIGEST *pKey, int Width, int Height, int Format, int Flags) const;
+	int AddCachedTexture(IGraphics::CTextureHandle Texture, const SHA256_DIGEST *pKey, int Width, int Height, int Format, int Flags, int Size);
+	void EvictCachedTextures();
+
 	IGraphics::CTextureHandle m_EasterTexture;
 	bool m_EasterIsLoaded;
 
@@ -5,8 +5,10 @@
 #include <engine/graphics.h>
 #include <engine/keys.h>
 #include <engine/demo.h>
+#include <engine/engine.h>
 #include <engine/serverbrowser.h>
 #include <engine/shared/config.h>
+#include <engine/shared/jobs.h>
 #include <engine/storage.h>
 
 #include <game/layers.h>
@@ -19,12 +21,23 @@
 #include "menus.h"
 #include "maplayers.h"
 
+// detail layers are dropped below this quality level of the client
+static const float DETAIL_QUALITY_LEVEL = 0.5f;
+
 CMapLayers::CMapLayers(int Type)
 {
 	m_Type = Type;
 	m_pMenuMap = 0;
 	m_pMenuLayers = 0;
 	m_OnlineStartTime = 0;
+	m_pBufferLayers = 0;
+	m_pRecordQuads = 0;
+	m_pRecordBounds = 0;
+	mem_zero(m_aEnvelopeCache, sizeof(m_aEnvelopeCache));
+	m_EnvelopeCacheFrame = 1;
+	m_BackgroundTargetWidth = 0;
+	m_BackgroundTargetHeight = 0;
+	m_LastBackgroundUpdate = 0;
 }
 
 void CMapLayers::OnStateChange(int NewState, int OldState)
@@ -112,6 +125,7 @@ void CMapLayers::OnInit()
 
 void CMapLayers::OnMapLoad()
 {
+	ClearLayerBuffers();
 	if(Layers())
 	{
 		LoadEnvPoints(Layers(), m_lEnvPoints);
@@ -124,6 +138,9 @@ void CMapLayers::OnMapLoad()
 
 void CMapLayers::OnShutdown()
 {
+	ClearLayerBuffers();
+	Graphics()->UnloadTexture(&m_BackgroundTarget);
+
 	if(m_pEggTiles)
 	{
 		mem_free(m_pEggTiles);
@@ -193,56 +210,329 @@ void CMapLayers::LoadEnvPoints(const CLayers *pLayers, array<CEnvPoint>& lEnvPoi
 void CMapLayers::EnvelopeEval(float TimeOffset, int Env, float *pChannels, void *pUser)
 {
 	CMapLayers *pThis = (CMapLayers *)pUser;
-	pChannels[0] = 0;
-	pChannels[1] = 0;
-	pChannels[2] = 0;
-	pChannels[3] = 0;
 
-	CEnvPoint *pPoints = 0;
-	CLayers *pLayers = 0;
-	if(pThis->Client()->State() == IClient::STATE_ONLINE || pThis->Client()->State() == IClient::STATE_DEMOPLAYBACK)
+	unsigned Offset;
+	mem_copy(&Offset, &TimeOffset, sizeof(Offset));
+	CEnvelopeCacheEntry *pEntry = &pThis->m_aEnvelopeCache[(Env*31u + Offset*2654435761u) & (ENVCACHE_SIZE-1)];
+	if(pEntry->m_Frame != pThis->m_EnvelopeCacheFrame || pEntry->m_Env != Env || pEntry->m_TimeOffset != TimeOffset)
+	{
+		pThis->EvalEnvelope(TimeOffset, Env, pEntry->m_aChannels);
+		pEntry->m_Frame = pThis->m_EnvelopeCacheFrame;
+		pEntry->m_Env = Env;
+		pEntry->m_TimeOffset = TimeOffset;
+	}
+	mem_copy(pChannels, pEntry->m_aChannels, sizeof(pEntry->m_aChannels));
+}
+
+void CMapLayers::EnvelopeEvalUncached(float TimeOffset, int Env, float *pChannels, void *pUser)
+{
+	((CMapLayers *)pUser)->EvalEnvelope(TimeOffset, Env, pChannels);
+}
+
+void CMapLayers::EnvelopeSource(CLayers **ppLayers, CEnvPoint **ppPoints)
+{
+	if(Client()->State() == IClient::STATE_ONLINE || Client()->State() == IClient::STATE_DEMOPLAYBACK)
 	{
-		pLayers = pThis->Layers();
-		pPoints = pThis->m_lEnvPoints.base_ptr();
+		*ppLayers = Layers();
+		*ppPoints = m_lEnvPoints.base_ptr();
 	}
 	else
 	{
-		pLayers = pThis->m_pMenuLayers;
-		pPoints = pThis->m_lEnvPointsMenu.base_ptr();
+		*ppLayers = m_pMenuLayers;
+		*ppPoints = m_lEnvPointsMenu.base_ptr();
 	}
+}
+
+void CMapLayers::UpdateEnvelopeTimes()
+{
+	CLayers *pLayers;
+	CEnvPoint *pPoints;
+	EnvelopeSource(&pLayers, &pPoints);
 
 	int Start, Num;
 	pLayers->Map()->GetType(MAPITEMTYPE_ENVELOPE, &Start, &Num);
+	m_lEnvelopeTimes.set_size(Num);
+
+	static float s_Time = 0.0f;
+	for(int Env = 0; Env < Num; Env++)
+	{
+		const CMapItemEnvelope *pItem = (CMapItemEnvelope *)pLayers->Map()->GetItem(Start+Env, 0, 0);
+		CEnvPoint *pItemPoints = pPoints + pItem->m_StartPoint;
+
+		float EnvalopTicks = (pItemPoints[pItem->m_NumPoints-1].m_Time - pItemPoints[0].m_Time)/1000.0f * Client()->GameTickSpeed();
+		if(Client()->State() == IClient::STATE_ONLINE || Client()->State() == IClient::STATE_DEMOPLAYBACK)
+		{
+			if(m_pClient->m_Snap.m_pGameData && !m_pClient->IsWorldPaused())
+			{
+				if(pItem->m_Version < 2 || pItem->m_Synchronized)
+				{
+					float PrevAnimationTick = fmod(Client()->PrevGameTick() - m_pClient->m_Snap.m_pGameData->m_GameStartTick, EnvalopTicks);
+					float CurAnimationTick = fmod(Client()->GameTick() - m_pClient->m_Snap.m_pGameData->m_GameStartTick, EnvalopTicks);
+					if(PrevAnimationTick > CurAnimationTick)
+						CurAnimationTick += EnvalopTicks;
+					s_Time = mix(PrevAnimationTick, CurAnimationTick, Client()->IntraGameTick()) / Client()->GameTickSpeed();
+				}
+				else
+					s_Time = Client()->LocalTime() - m_OnlineStartTime;
+			}
+		}
+		else
+		{
+			s_Time = Client()->LocalTime();
+		}
+		m_lEnvelopeTimes[Env] = s_Time;
+	}
+}
+
+void CMapLayers::EvalEnvelope(float TimeOffset, int Env, float *pChannels)
+{
+	pChannels[0] = 0;
+	pChannels[1] = 0;
+	pChannels[2] = 0;
+	pChannels[3] = 0;
 
-	if(Env >= Num)
+	if(Env >= m_lEnvelopeTimes.size())
 		return;
 
+	CLayers *pLayers;
+	CEnvPoint *pPoints;
+	EnvelopeSource(&pLayers, &pPoints);
+
+	int Start, Num;
+	pLayers->Map()->GetType(MAPITEMTYPE_ENVELOPE, &Start, &Num);
 	const CMapItemEnvelope *pItem = (CMapItemEnvelope *)pLayers->Map()->GetItem(Start+Env, 0, 0);
-	CEnvPoint *pItemPoints = pPoints + pItem->m_StartPoint;
+	CRenderTools::RenderEvalEnvelope(pPoints + pItem->m_StartPoint, pItem->m_NumPoints, 4, m_lEnvelopeTimes[Env] + TimeOffset, pChannels);
+}
 
-	static float s_Time = 0.0f;
-	float EnvalopTicks = (pItemPoints[pItem->m_NumPoints-1].m_Time - pItemPoints[0].m_Time)/1000.0f * pThis->Client()->GameTickSpeed();
-	if(pThis->Client()->State() == IClient::STATE_ONLINE || pThis->Client()->State() == IClient::STATE_DEMOPLAYBACK)
+void CMapLayers::RecordQuadsRange(int Begin, int End, void *pUser)
+{
+	CMapLayers *pThis = (CMapLayers *)pUser;
+	CRenderTools::RecordQuads(pThis->m_pRecordQuads, Begin, End, EnvelopeEvalUncached, pThis, pThis->m_pRecordBounds,
+		pThis->m_aRecordScreen, &pThis->m_lRecordedQuads[Begin]);
+}
+
+void CMapLayers::RenderQuadLayer(CQuad *pQuads, int NumQuads, const CQuadBounds *pBounds)
+{
+	if(NumQuads <= 0)
+		return;
+
+	// the quads are recorded on the job pool and drawn in their order
+	Graphics()->GetScreen(&m_aRecordScreen[0], &m_aRecordScreen[1], &m_aRecordScreen[2], &m_aRecordScreen[3]);
+	m_pRecordQuads = pQuads;
+	m_pRecordBounds = pBounds;
+	if(m_lRecordedQuads.size() < NumQuads)
+		m_lRecordedQuads.set_size(NumQuads);
+	m_pClient->Engine()->JobPool()->ParallelFor(0, NumQuads, QUADS_PER_JOB, RecordQuadsRange, this, CJobPool::PRIORITY_HIGH);
+
+	Graphics()->QuadsBegin();
+	Graphics()->QuadsDrawRecorded(m_lRecordedQuads.base_ptr(), NumQuads);
+	Graphics()->QuadsEnd();
+	Graphics()->WrapNormal();
+}
+
+void CMapLayers::ClearLayerBuffers()
+{
+	for(int i = 0; i < m_lLayerBuffers.size(); i++)
+	{
+		Graphics()->UnloadTexture(&m_lLayerBuffers[i].m_Indices);
+		Graphics()->DeleteQuadBuffer(&m_lLayerBuffers[i].m_Buffer);
+		if(m_lLayerBuffers[i].m_pChunks)
+			mem_free(m_lLayerBuffers[i].m_pChunks);
+		if(m_lLayerBuffers[i].m_pQuadBounds)
+			mem_free(m_lLayerBuffers[i].m_pQuadBounds);
+	}
+	m_lLayerBuffers.clear();
+	m_pBufferLayers = 0;
+}
+
+CMapLayers::CLayerBuffer *CMapLayers::FindLayerBuffer(const CLayers *pLayers, int Layer)
+{
+	if(pLayers != m_pBufferLayers)
+	{
+		ClearLayerBuffers();
+		m_pBufferLayers = pLayers;
+		CLayerBuffer Empty;
+		mem_zero(&Empty, sizeof(Empty));
+		Empty.m_Indices.Invalidate();
+		Empty.m_Buffer.Invalidate();
+		for(int i = 0; i < pLayers->NumLayers(); i++)
+			m_lLayerBuffers.add(Empty);
+	}
+	return &m_lLayerBuffers[Layer];
+}
+
+const CMapLayers::CLayerBuffer *CMapLayers::GetLayerBuffer(const CLayers *pLayers, int Layer)
+{
+	CLayerBuffer *pBuffer = FindLayerBuffer(pLayers, Layer);
+	if(pBuffer->m_Built)
+		return pBuffer->m_Indices.IsValid() || pBuffer->m_Buffer.IsValid() ? pBuffer : 0;
+	pBuffer->m_Built = true;
+
+	CMapItemLayerTilemap *pTMap = (CMapItemLayerTilemap *)pLayers->GetLayer(Layer);
+	CTile *pTiles = (CTile *)pLayers->Map()->GetData(pTMap->m_Data);
+
+	// the tilemap shader needs no geometry at all
+	unsigned char *pIndices = (unsigned char *)mem_alloc(pTMap->m_Width*pTMap->m_Height*4, 1);
+	for(int i = 0; i < pTMap->m_Width*pTMap->m_Height; i++)
+	{
+		pIndices[i*4+0] = pTiles[i].m_Index;
+		pIndices[i*4+1] = pTiles[i].m_Flags&TILEFLAG_VFLIP ? 255 : 0;
+		pIndices[i*4+2] = pTiles[i].m_Flags&TILEFLAG_HFLIP ? 255 : 0;
+		pIndices[i*4+3] = pTiles[i].m_Flags&TILEFLAG_ROTATE ? 255 : 0;
+	}
+	pBuffer->m_Indices = Graphics()->LoadTileIndices(pTMap->m_Width, pTMap->m_Height, pIndices);
+	mem_free(pIndices);
+	if(pBuffer->m_Indices.IsValid())
 	{
-		if(pThis->m_pClient->m_Snap.m_pGameData && !pThis->m_pClient->IsWorldPaused())
+		pBuffer->m_Width = pTMap->m_Width;
+		pBuffer->m_Height = pTMap->m_Height;
+		return pBuffer;
+	}
+	int NumQuads = 0;
+	for(int i = 0; i < pTMap->m_Width*pTMap->m_Height; i++)
+		if(pTiles[i].m_Index)
+			NumQuads++;
+	if(!NumQuads)
+		return 0;
+
+	pBuffer->m_NumChunksX = (pTMap->m_Width+CHUNK_SIZE-1)/CHUNK_SIZE;
+	pBuffer->m_NumChunksY = (pTMap->m_Height+CHUNK_SIZE-1)/CHUNK_SIZE;
+	pBuffer->m_pChunks = (CTileChunk *)mem_alloc(sizeof(CTileChunk)*pBuffer->m_NumChunksX*pBuffer->m_NumChunksY, 1);
+	IGraphics::CBufferQuad *pQuads = (IGraphics::CBufferQuad *)mem_alloc(sizeof(IGraphics::CBufferQuad)*NumQuads, 1);
+
+	NumQuads = 0;
+	for(int cy = 0; cy < pBuffer->m_NumChunksY; cy++)
+		for(int cx = 0; cx < pBuffer->m_NumChunksX; cx++)
 		{
-			if(pItem->m_Version < 2 || pItem->m_Synchronized)
+			CTileChunk *pChunk = &pBuffer->m_pChunks[cy*pBuffer->m_NumChunksX+cx];
+			pChunk->m_FirstQuad = NumQuads;
+			for(int Pass = 0; Pass < 2; Pass++)
 			{
-				float PrevAnimationTick = fmod(pThis->Client()->PrevGameTick() - pThis->m_pClient->m_Snap.m_pGameData->m_GameStartTick, EnvalopTicks);
-				float CurAnimationTick = fmod(pThis->Client()->GameTick() - pThis->m_pClient->m_Snap.m_pGameData->m_GameStartTick, EnvalopTicks);
-				if(PrevAnimationTick > CurAnimationTick)
-					CurAnimationTick += EnvalopTicks;
-				s_Time = mix(PrevAnimationTick, CurAnimationTick, pThis->Client()->IntraGameTick()) / pThis->Client()->GameTickSpeed();
+				const int Start = NumQuads;
+				for(int y = cy*CHUNK_SIZE; y < min((cy+1)*CHUNK_SIZE, pTMap->m_Height); y++)
+					for(int x = cx*CHUNK_SIZE; x < min((cx+1)*CHUNK_SIZE, pTMap->m_Width); x++)
+					{
+						const CTile *pTile = &pTiles[y*pTMap->m_Width+x];
+						if(!pTile->m_Index || (Pass == 1) != ((pTile->m_Flags&TILEFLAG_OPAQUE) != 0))
+							continue;
+
+						IGraphics::CBufferQuad *pQuad = &pQuads[NumQuads++];
+						pQuad->m_X = x*32.0f;
+						pQuad->m_Y = y*32.0f;
+						pQuad->m_Width = 32.0f;
+						pQuad->m_Height = 32.0f;
+						CRenderTools::TileTexCoords(pTile->m_Flags, pQuad->m_aU, pQuad->m_aV);
+						pQuad->m_TextureIndex = pTile->m_Index;
+					}
+				if(Pass == 0)
+					pChunk->m_NumTransparent = NumQuads-Start;
+				else
+					pChunk->m_NumOpaque = NumQuads-Start;
 			}
-			else
-				s_Time = pThis->Client()->LocalTime() - pThis->m_OnlineStartTime;
 		}
+
+	pBuffer->m_Buffer = Graphics()->CreateQuadBuffer(pQuads, NumQuads);
+	mem_free(pQuads);
+	if(!pBuffer->m_Buffer.IsValid())
+	{
+		mem_free(pBuffer->m_pChunks);
+		pBuffer->m_pChunks = 0;
+		return 0;
 	}
-	else
+	return pBuffer;
+}
+
+const CQuadBounds *CMapLayers::GetQuadBounds(const CLayers *pLayers, int Layer)
+{
+	CLayerBuffer *pBuffer = FindLayerBuffer(pLayers, Layer);
+	if(pBuffer->m_Built)
+		return pBuffer->m_pQuadBounds;
+	pBuffer->m_Built = true;
+
+	CMapItemLayerQuads *pQLayer = (CMapItemLayerQuads *)pLayers->GetLayer(Layer);
+	if(pQLayer->m_NumQuads <= 0)
+		return 0;
+	const CQuad *pQuads = (const CQuad *)pLayers->Map()->GetDataSwapped(pQLayer->m_Data);
+	const CEnvPoint *pPoints = pLayers == m_pMenuLayers ? m_lEnvPointsMenu.base_ptr() : m_lEnvPoints.base_ptr();
+	int EnvStart, NumEnvs;
+	pLayers->Map()->GetType(MAPITEMTYPE_ENVELOPE, &EnvStart, &NumEnvs);
+
+	pBuffer->m_pQuadBounds = (CQuadBounds *)mem_alloc(sizeof(CQuadBounds)*pQLayer->m_NumQuads, 1);
+	for(int i = 0; i < pQLayer->m_NumQuads; i++)
+	{
+		const CQuad *pQuad = &pQuads[i];
+		if(pQuad->m_PosEnv >= 0 && pQuad->m_PosEnv < NumEnvs)
+		{
+			const CMapItemEnvelope *pItem = (CMapItemEnvelope *)pLayers->Map()->GetItem(EnvStart+pQuad->m_PosEnv, 0, 0);
+			float aMin[3], aMax[3];
+			CRenderTools::EnvelopeRange(&pPoints[pItem->m_StartPoint], pItem->m_NumPoints, aMin, aMax);
+			CRenderTools::QuadBounds(pQuad, aMin, aMax, &pBuffer->m_pQuadBounds[i]);
+		}
+		else
+			CRenderTools::QuadBounds(pQuad, 0, 0, &pBuffer->m_pQuadBounds[i]);
+	}
+	return pBuffer->m_pQuadBounds;
+}
+
+void CMapLayers::RenderLayerBuffer(const CLayerBuffer *pBuffer, vec4 Color, int RenderFlags, int ColorEnv, int ColorEnvOffset)
+{
+	float ScreenX0, ScreenY0, ScreenX1, ScreenY1;
+	Graphics()->GetScreen(&ScreenX0, &ScreenY0, &ScreenX1, &ScreenY1);
+
+	float aChannels[4] = {1, 1, 1, 1};
+	if(ColorEnv >= 0)
+		EnvelopeEval(ColorEnvOffset/1000.0f, ColorEnv, aChannels, this);
+
+	// same opaque test and premultiplied color as RenderTilemap
+	const float Alpha = Color.a*aChannels[3];
+	const bool Opaque = Alpha > 254.0f/255.0f;
+	if(RenderFlags&LAYERRENDERFLAG_OPAQUE && !Opaque)
+		return;
+	vec4 QuadColor(Color.r*aChannels[0]*Alpha, Color.g*aChannels[1]*Alpha, Color.b*aChannels[2]*Alpha, Alpha);
+
+	// the shader draws opaque tiles with blending, that gives the same result
+	if(pBuffer->m_Indices.IsValid())
 	{
-		s_Time = pThis->Client()->LocalTime();
+		if(RenderFlags&LAYERRENDERFLAG_TRANSPARENT)
+			Graphics()->RenderTileIndices(pBuffer->m_Indices, pBuffer->m_Width, pBuffer->m_Height, 32.0f, QuadColor, true);
+		return;
 	}
-	CRenderTools::RenderEvalEnvelope(pItemPoints, pItem->m_NumPoints, 4, s_Time + TimeOffset, pChannels);
+
+	const float ChunkSize = CHUNK_SIZE*32.0f;
+	int StartX = clamp((int)(ScreenX0/ChunkSize), 0, pBuffer->m_NumChunksX);
+	int StartY = clamp((int)(ScreenY0/ChunkSize), 0, pBuffer->m_NumChunksY);
+	int EndX = clamp((int)(ScreenX1/ChunkSize)+1, 0, pBuffer->m_NumChunksX);
+	int EndY = clamp((int)(ScreenY1/ChunkSize)+1, 0, pBuffer->m_NumChunksY);
+
+	// neighbouring chunks are merged into one draw call where the ranges touch
+	int First = 0;
+	int Num = 0;
+	for(int y = StartY; y < EndY; y++)
+		for(int x = StartX; x < EndX; x++)
+		{
+			const CTileChunk *pChunk = &pBuffer->m_pChunks[y*pBuffer->m_NumChunksX+x];
+			int ChunkFirst = pChunk->m_FirstQuad;
+			int ChunkNum = pChunk->m_NumTransparent;
+			if(RenderFlags&LAYERRENDERFLAG_OPAQUE)
+			{
+				ChunkFirst += pChunk->m_NumTransparent;
+				ChunkNum = pChunk->m_NumOpaque;
+			}
+			else if(!Opaque)
+				ChunkNum += pChunk->m_NumOpaque;
+
+			if(!ChunkNum)
+				continue;
+			if(Num && First+Num == ChunkFirst)
+				Num += ChunkNum;
+			else
+			{
+				Graphics()->RenderQuadBuffer(pBuffer->m_Buffer, First, Num, QuadColor);
+				First = ChunkFirst;
+				Num = ChunkNum;
+			}
+		}
+	Graphics()->RenderQuadBuffer(pBuffer->m_Buffer, First, Num, QuadColor);
 }
 
 void CMapLayers::OnRender()
@@ -256,6 +546,62 @@ void CMapLayers::OnRender()
 	if(!pLayers)
 		return;
 
+	if(pLayers == m_pMenuLayers && Config()->m_ClMenuBackgroundFps && RenderCachedBackground(pLayers))
+		return;
+
+	RenderLayers(pLayers);
+}
+
+bool CMapLayers::RenderCachedBackground(CLayers *pLayers)
+{
+	const int Width = Graphics()->ScreenWidth();
+	const int Height = Graphics()->ScreenHeight();
+	if(!m_BackgroundTarget.IsValid() || m_BackgroundTargetWidth != Width || m_BackgroundTargetHeight != Height)
+	{
+		Graphics()->UnloadTexture(&m_BackgroundTarget);
+		m_BackgroundTarget = Graphics()->CreateRenderTarget(Width, Height);
+		if(!m_BackgroundTarget.IsValid())
+			return false;
+		m_BackgroundTargetWidth = Width;
+		m_BackgroundTargetHeight = Height;
+		m_LastBackgroundUpdate = 0;
+	}
+
+	// the menu map moves slowly, redraw it at a reduced rate only
+	const int64 Now = time_get();
+	if(!m_LastBackgroundUpdate || Now-m_LastBackgroundUpdate >= time_freq()/Config()->m_ClMenuBackgroundFps)
+	{
+		m_LastBackgroundUpdate = Now;
+		Graphics()->SetRenderTarget(m_BackgroundTarget);
+		Graphics()->Clear(0.0f, 0.0f, 0.0f);
+		RenderLayers(pLayers);
+		Graphics()->SetRenderTarget(IGraphics::CTextureHandle());
+	}
+
+	CUIRect Screen;
+	Graphics()->GetScreen(&Screen.x, &Screen.y, &Screen.w, &Screen.h);
+
+	// the rows of the target go bottom-up, draw it flipped
+	Graphics()->MapScreen(0.0f, 0.0f, Width, Height);
+	Graphics()->BlendNone();
+	Graphics()->TextureSet(m_BackgroundTarget);
+	Graphics()->QuadsBegin();
+	Graphics()->QuadsSetSubset(0.0f, 1.0f, 1.0f, 0.0f);
+	IGraphics::CQuadItem QuadItem(0.0f, 0.0f, Width, Height);
+	Graphics()->QuadsDrawTL(&QuadItem, 1);
+	Graphics()->QuadsEnd();
+	Graphics()->BlendNormal();
+
+	Graphics()->MapScreen(Screen.x, Screen.y, Screen.w, Screen.h);
+	return true;
+}
+
+void CMapLayers::RenderLayers(CLayers *pLayers)
+{
+	// envelopes are evaluated at most once per key and call
+	m_EnvelopeCacheFrame++;
+	UpdateEnvelopeTimes();
+
 	CUIRect Screen;
 	Graphics()->GetScreen(&Screen.x, &Screen.y, &Screen.w, &Screen.h);
 
@@ -316,8 +662,9 @@ void CMapLayers::OnRender()
 			if(!Render)
 				continue;
 
-			// skip rendering if detail layers is not wanted
-			if(!(pLayer->m_Flags&LAYERFLAG_DETAIL && !Config()->m_GfxHighDetail && !IsGameLayer && (Client()->State() == IClient::STATE_ONLINE || Client()->State() == IClient::STATE_DEMOPLAYBACK)))
+			// skip rendering if detail layers is not wanted or the client can't keep up
+			const bool HighDetail = Config()->m_GfxHighDetail && Client()->QualityLevel() >= DETAIL_QUALITY_LEVEL;
+			if(!(pLayer->m_Flags&LAYERFLAG_DETAIL && !HighDetail && !IsGameLayer && (Client()->State() == IClient::STATE_ONLINE || Client()->State() == IClient::STATE_DEMOPLAYBACK)))
 			{
 				if(pLayer->m_Type == LAYERTYPE_TILES && Input()->KeyIsPressed(KEY_LCTRL) && Input()->KeyIsPressed(KEY_LSHIFT) && UI()->KeyPress(KEY_KP_0))
 				{
@@ -351,13 +698,31 @@ void CMapLayers::OnRender()
 							Graphics()->TextureSet(m_pClient->m_pMapimages->Get(pTMap->m_Image));
 
 						CTile *pTiles = (CTile *)pLayers->Map()->GetData(pTMap->m_Data);
-						Graphics()->BlendNone();
 						vec4 Color = vec4(pTMap->m_Color.r/255.0f, pTMap->m_Color.g/255.0f, pTMap->m_Color.b/255.0f, pTMap->m_Color.a/255.0f);
-						RenderTools()->RenderTilemap(pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f, Color, TILERENDERFLAG_EXTEND|LAYERRENDERFLAG_OPAQUE,
-														EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
-						Graphics()->BlendNormal();
-						RenderTools()->RenderTilemap(pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f, Color, TILERENDERFLAG_EXTEND|LAYERRENDERFLAG_TRANSPARENT,
-														EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+						const CLayerBuffer *pBuffer = GetLayerBuffer(pLayers, pGroup->m_StartLayer+l);
+						if(pBuffer && pBuffer->m_Indices.IsValid())
+						{
+							// the shader covers the extended border as well
+							Graphics()->BlendNormal();
+							RenderLayerBuffer(pBuffer, Color, LAYERRENDERFLAG_TRANSPARENT, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+						}
+						else
+						{
+							int ExtendFlags = TILERENDERFLAG_EXTEND;
+							Graphics()->BlendNone();
+							if(pBuffer)
+							{
+								RenderLayerBuffer(pBuffer, Color, LAYERRENDERFLAG_OPAQUE, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+								ExtendFlags |= TILERENDERFLAG_BORDER;
+							}
+							RenderTools()->RenderTilemap(pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f, Color, ExtendFlags|LAYERRENDERFLAG_OPAQUE,
+															EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+							Graphics()->BlendNormal();
+							if(pBuffer)
+								RenderLayerBuffer(pBuffer, Color, LAYERRENDERFLAG_TRANSPARENT, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+							RenderTools()->RenderTilemap(pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f, Color, ExtendFlags|LAYERRENDERFLAG_TRANSPARENT,
+															EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+						}
 					}
 					else if(pLayer->m_Type == LAYERTYPE_QUADS)
 					{
@@ -369,10 +734,8 @@ void CMapLayers::OnRender()
 
 						CQuad *pQuads = (CQuad *)pLayers->Map()->GetDataSwapped(pQLayer->m_Data);
 
-						//Graphics()->BlendNone();
-						//RenderTools()->RenderQuads(pQuads, pQLayer->m_NumQuads, LAYERRENDERFLAG_OPAQUE, EnvelopeEval, this);
 						Graphics()->BlendNormal();
-						RenderTools()->RenderQuads(pQuads, pQLayer->m_NumQuads, LAYERRENDERFLAG_TRANSPARENT, EnvelopeEval, this);
+						RenderQuadLayer(pQuads, pQLayer->m_NumQuads, GetQuadBounds(pLayers, pGroup->m_StartLayer+l));
 					}
 				}
 			}
@@ -418,6 +781,8 @@ void CMapLayers::BackgroundMapUpdate()
 	if(m_Type == TYPE_BACKGROUND && m_pMenuMap)
 	{
 		// unload map
+		ClearLayerBuffers();
+		m_LastBackgroundUpdate = 0;
 		m_pMenuMap->Unload();
 		if(Config()->m_ClShowMenuMap)
 			LoadBackgroundMap();
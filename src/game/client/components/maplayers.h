@@ -16,17 +16,104 @@ class CMapLayers : public CComponent
 	array<CEnvPoint> m_lEnvPoints;
 	array<CEnvPoint> m_lEnvPointsMenu;
 
+	enum
+	{
+		CHUNK_SIZE=32, // in tiles
+	};
+
+	// a chunk's quads start with the transparent tiles, the opaque ones follow
+	struct CTileChunk
+	{
+		int m_FirstQuad;
+		int m_NumTransparent;
+		int m_NumOpaque;
+	};
+
+	// tile layers have either the tile indices for the tilemap shader or a
+	// vertex buffer, quad layers have the bounds of their quads
+	struct CLayerBuffer
+	{
+		bool m_Built;
+		IGraphics::CTextureHandle m_Indices;
+		IGraphics::CBufferHandle m_Buffer;
+		int m_NumChunksX;
+		int m_NumChunksY;
+		int m_Width;
+		int m_Height;
+		CTileChunk *m_pChunks;
+		CQuadBounds *m_pQuadBounds;
+	};
+
+	// static data of the layers, built when they are first drawn
+	const CLayers *m_pBufferLayers;
+	array<CLayerBuffer> m_lLayerBuffers;
+
+	enum
+	{
+		ENVCACHE_SIZE=256, // a power of two
+	};
+
+	// envelope values evaluated during the current OnRender call, most quads
+	// and tile layers share a few envelopes and offsets
+	struct CEnvelopeCacheEntry
+	{
+		int m_Frame;
+		int m_Env;
+		float m_TimeOffset;
+		float m_aChannels[4];
+	};
+
+	CEnvelopeCacheEntry m_aEnvelopeCache[ENVCACHE_SIZE];
+	int m_EnvelopeCacheFrame;
+
 	CTile* m_pEggTiles;
 	int m_EggLayerWidth;
 	int m_EggLayerHeight;
 
+	// the time of every envelope for the current OnRender call, so that
+	// evaluating them doesn't change anything and works from any thread
+	array<float> m_lEnvelopeTimes;
+
+	enum
+	{
+		QUADS_PER_JOB=128,
+	};
+
+	// the quad layer that is being recorded
+	const CQuad *m_pRecordQuads;
+	const CQuadBounds *m_pRecordBounds;
+	float m_aRecordScreen[4];
+	array<IGraphics::CRecordedQuad> m_lRecordedQuads;
+
+	// the menu map, redrawn at cl_menu_background_fps
+	IGraphics::CTextureHandle m_BackgroundTarget;
+	int m_BackgroundTargetWidth;
+	int m_BackgroundTargetHeight;
+	int64 m_LastBackgroundUpdate;
+
 	static void EnvelopeEval(float TimeOffset, int Env, float *pChannels, void *pUser);
+	static void EnvelopeEvalUncached(float TimeOffset, int Env, float *pChannels, void *pUser);
+	void EnvelopeSource(CLayers **ppLayers, CEnvPoint **ppPoints);
+	void UpdateEnvelopeTimes();
+	void EvalEnvelope(float TimeOffset, int Env, float *pChannels);
+
+	static void RecordQuadsRange(int Begin, int End, void *pUser);
+	void RenderQuadLayer(CQuad *pQuads, int NumQuads, const CQuadBounds *pBounds);
 
 	void LoadEnvPoints(const CLayers *pLayers, array<CEnvPoint>& lEnvPoints);
 	void LoadBackgroundMap();
 
 	void PlaceEasterEggs(const CLayers *pLayers);
 
+	void ClearLayerBuffers();
+	CLayerBuffer *FindLayerBuffer(const CLayers *pLayers, int Layer);
+	const CLayerBuffer *GetLayerBuffer(const CLayers *pLayers, int Layer);
+	const CQuadBounds *GetQuadBounds(const CLayers *pLayers, int Layer);
+	void RenderLayerBuffer(const CLayerBuffer *pBuffer, vec4 Color, int RenderFlags, int ColorEnv, int ColorEnvOffset);
+
+	void RenderLayers(CLayers *pLayers);
+	bool RenderCachedBackground(CLayers *pLayers);
+
 public:
 	enum
 	{
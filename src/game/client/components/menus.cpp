@@ -88,6 +88,7 @@ CMenus::CMenus()
 	m_DownArrowPressed = false;
 
 	m_aDemoLoadingFile[0] = 0;
+	m_DemoLoadingLive = false;
 	m_DemoLoadingPopupRendered = false;
 
 	m_LastInput = time_get();
@@ -1825,10 +1826,11 @@ void CMenus::Render()
 			{
 				m_Popup = POPUP_NONE;
 				m_DemoLoadingPopupRendered = false;
-				const char *pError = Client()->DemoPlayer_Play(m_aDemoLoadingFile, m_DemoLoadingStorageType);
+				const char *pError = Client()->DemoPlayer_Play(m_aDemoLoadingFile, m_DemoLoadingStorageType, m_DemoLoadingLive);
 				if(pError)
 					PopupMessage(Localize("Error loading demo"), pError, Localize("Ok"));
 				m_aDemoLoadingFile[0] = 0;
+				m_DemoLoadingLive = false;
 			}
 			else
 			{
@@ -1871,8 +1873,9 @@ void CMenus::Render()
 					Item.m_Rect.w = Item.m_Rect.h*2;
 					Item.m_Rect.x += (OldWidth-Item.m_Rect.w)/ 2.0f;
 
-					Graphics()->TextureSet(pEntry->m_Texture);
+					Graphics()->TextureSet(pEntry->m_Texture.m_Texture);
 					Graphics()->QuadsBegin();
+					Graphics()->QuadsSetSubset(pEntry->m_Texture.m_aRect[0], pEntry->m_Texture.m_aRect[1], pEntry->m_Texture.m_aRect[2], pEntry->m_Texture.m_aRect[3]);
 					Graphics()->SetColor(1.0f, 1.0f, 1.0f, 1.0f);
 					IGraphics::CQuadItem QuadItem(Item.m_Rect.x, Item.m_Rect.y, Item.m_Rect.w, Item.m_Rect.h);
 					Graphics()->QuadsDrawTL(&QuadItem, 1);
@@ -2150,6 +2153,7 @@ void CMenus::OnConsoleInit()
 	CUIElementBase::Init(this);
 
 	Console()->Register("play", "r[file]", CFGFLAG_CLIENT|CFGFLAG_STORE, Con_Play, this, "Play the file specified");
+	Console()->Register("play_live", "r[file]", CFGFLAG_CLIENT|CFGFLAG_STORE, Con_PlayLive, this, "Play a demo that is still being written from its latest keyframe and follow it");
 }
 
 void CMenus::OnShutdown()
@@ -5,6 +5,7 @@
 
 #include <base/vmath.h>
 #include <base/tl/sorted_array.h>
+#include <base/tl/string.h>
 
 #include <engine/graphics.h>
 #include <engine/demo.h>
@@ -229,6 +230,7 @@ private:
 		void AddRect(CUIRect Rect);
 		void ScrollHere(int Option = CScrollRegion::SCROLLHERE_KEEP_IN_VIEW);
 		bool IsRectClipped(const CUIRect& Rect) const;
+		int NumClippedRows(float Top, float RowHeight, int NumRows) const;
 		bool IsScrollbarShown() const;
 		bool IsAnimating() const;
 	};
@@ -456,6 +458,7 @@ private:
 	// for demo loading popup
 	char m_aDemoLoadingFile[IO_MAX_PATH_LENGTH];
 	int m_DemoLoadingStorageType;
+	bool m_DemoLoadingLive;
 	bool m_DemoLoadingPopupRendered;
 
 	// for password popup
@@ -889,5 +892,6 @@ public:
 	virtual bool OnCursorMove(float x, float y, int CursorType);
 
 	static void Con_Play(IConsole::IResult *pResult, void *pUserData);
+	static void Con_PlayLive(IConsole::IResult *pResult, void *pUserData);
 };
 #endif
@@ -1003,31 +1003,50 @@ void CMenus::RenderServerbrowserServerList(CUIRect View)
 
 		if(pFilter->Extended())
 		{
-			for (int ServerIndex = 0; ServerIndex < pFilter->NumSortedServers(); ServerIndex++)
-			{
-				const CServerInfo *pItem = pFilter->SortedGet(ServerIndex);
+			const int NumFilterServers = pFilter->NumSortedServers();
 
-				// select server if address changed and match found
-				bool IsSelected = m_aSelectedFilters[BrowserType] == FilterIndex && m_aSelectedServers[BrowserType] == ServerIndex;
-				if(m_AddressSelection&ADDR_SELECTION_CHANGE)
+			// resolve a changed address first, the matching row can be anywhere in the list
+			bool AddressNotFound = false;
+			if(m_AddressSelection&ADDR_SELECTION_CHANGE)
+			{
+				AddressNotFound = true;
+				for(int ServerIndex = 0; ServerIndex < NumFilterServers; ServerIndex++)
 				{
-					if (!str_comp(pItem->m_aAddress, pAddress))
+					if(str_comp(pFilter->SortedGet(ServerIndex)->m_aAddress, pAddress))
+						continue;
+					if(m_aSelectedFilters[BrowserType] != FilterIndex || m_aSelectedServers[BrowserType] != ServerIndex)
 					{
-						if(!IsSelected)
-						{
-							m_ShowServerDetails = true;
-							m_aSelectedFilters[BrowserType] = FilterIndex;
-							m_aSelectedServers[BrowserType] = ServerIndex;
-							IsSelected = true;
-						}
-						m_AddressSelection &= ~(ADDR_SELECTION_CHANGE|ADDR_SELECTION_RESET_SERVER_IF_NOT_FOUND);
+						m_ShowServerDetails = true;
+						m_aSelectedFilters[BrowserType] = FilterIndex;
+						m_aSelectedServers[BrowserType] = ServerIndex;
 					}
-					else
+					m_AddressSelection &= ~(ADDR_SELECTION_CHANGE|ADDR_SELECTION_RESET_SERVER_IF_NOT_FOUND);
+					AddressNotFound = false;
+					break;
+				}
+			}
+			const int SelectedServer = !AddressNotFound && m_aSelectedFilters[BrowserType] == FilterIndex ? m_aSelectedServers[BrowserType] : -1;
+
+			for(int ServerIndex = 0; ServerIndex < NumFilterServers; ServerIndex++)
+			{
+				// skip the clipped rows in one step, all rows but the selected one have the same height
+				const bool IsSelected = ServerIndex == SelectedServer;
+				if(!IsSelected)
+				{
+					const int RunEnd = SelectedServer > ServerIndex ? SelectedServer : NumFilterServers;
+					const int NumClipped = s_ScrollRegion.NumClippedRows(View.y, HeaderHeight, RunEnd - ServerIndex);
+					if(NumClipped > 0)
 					{
-						IsSelected = false;
+						CUIRect Rows;
+						View.HSplitTop(HeaderHeight * NumClipped, &Rows, &View);
+						s_ScrollRegion.AddRect(Rows);
+						ServerIndex += NumClipped - 1;
+						continue;
 					}
 				}
 
+				const CServerInfo *pItem = pFilter->SortedGet(ServerIndex);
+
 				const bool ShowServerInfo = !m_SidebarActive && m_ShowServerDetails && IsSelected;
 				const float ItemHeight = HeaderHeight * (ShowServerInfo ? 6.0f : 1.0f);
 
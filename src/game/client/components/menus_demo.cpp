@@ -786,3 +786,10 @@ void CMenus::Con_Play(IConsole::IResult *pResult, void *pUserData)
 	pSelf->m_DemoLoadingStorageType = IStorage::TYPE_ALL;
 	pSelf->m_Popup = POPUP_LOADING_DEMO;
 }
+
+void CMenus::Con_PlayLive(IConsole::IResult *pResult, void *pUserData)
+{
+	CMenus *pSelf = (CMenus *)pUserData;
+	Con_Play(pResult, pUserData);
+	pSelf->m_DemoLoadingLive = true;
+}
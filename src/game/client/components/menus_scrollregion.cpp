@@ -224,6 +224,17 @@ bool CMenus::CScrollRegion::IsRectClipped(const CUIRect& Rect) const
 		|| (m_ClipRect.y + m_ClipRect.h) < Rect.y);
 }
 
+// the number of rows from the top of a run of equally high rows that are clipped
+// and can be skipped, it might be one less than the exact number
+int CMenus::CScrollRegion::NumClippedRows(float Top, float RowHeight, int NumRows) const
+{
+	if(Top > m_ClipRect.y + m_ClipRect.h)
+		return NumRows;
+	if(RowHeight <= 0.0f)
+		return 0;
+	return clamp((int)((m_ClipRect.y - Top) / RowHeight) - 1, 0, NumRows);
+}
+
 bool CMenus::CScrollRegion::IsScrollbarShown() const
 {
 	return m_ContentH > m_ClipRect.h;
@@ -352,12 +352,12 @@ void CMenus::RenderSkinSelection(CUIRect MainView)
 			{
 				if(s->m_aUseCustomColors[p])
 				{
-					Info.m_aTextures[p] = s->m_apParts[p]->m_ColorTexture;
+					Info.m_aTextures[p] = m_pClient->m_pSkins->GetColorTexture(s->m_apParts[p]);
 					Info.m_aColors[p] = m_pClient->m_pSkins->GetColorV4(s->m_aPartColors[p], p==SKINPART_MARKING);
 				}
 				else
 				{
-					Info.m_aTextures[p] = s->m_apParts[p]->m_OrgTexture;
+					Info.m_aTextures[p] = m_pClient->m_pSkins->GetOrgTexture(s->m_apParts[p]);
 					Info.m_aColors[p] = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 				}
 			}
@@ -453,17 +453,17 @@ void CMenus::RenderSkinPartSelection(CUIRect MainView)
 				if(*CSkins::ms_apUCCVariables[j])
 				{
 					if(m_TeePartSelected == j)
-						Info.m_aTextures[j] = s->m_ColorTexture;
+						Info.m_aTextures[j] = m_pClient->m_pSkins->GetColorTexture(s);
 					else
-						Info.m_aTextures[j] = pSkinPart->m_ColorTexture;
+						Info.m_aTextures[j] = m_pClient->m_pSkins->GetColorTexture(pSkinPart);
 					Info.m_aColors[j] = m_pClient->m_pSkins->GetColorV4(*CSkins::ms_apColorVariables[j], j==SKINPART_MARKING);
 				}
 				else
 				{
 					if(m_TeePartSelected == j)
-						Info.m_aTextures[j] = s->m_OrgTexture;
+						Info.m_aTextures[j] = m_pClient->m_pSkins->GetOrgTexture(s);
 					else
-						Info.m_aTextures[j] = pSkinPart->m_OrgTexture;
+						Info.m_aTextures[j] = m_pClient->m_pSkins->GetOrgTexture(pSkinPart);
 					Info.m_aColors[j] = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 				}
 			}
@@ -1257,12 +1257,12 @@ void CMenus::RenderSettingsPlayer(CUIRect MainView)
 			const CSkins::CSkinPart *pSkinPart = m_pClient->m_pSkins->GetSkinPart(p, SkinPart);
 			if(aUCCVars[p])
 			{
-				OwnSkinInfo.m_aTextures[p] = pSkinPart->m_ColorTexture;
+				OwnSkinInfo.m_aTextures[p] = m_pClient->m_pSkins->GetColorTexture(pSkinPart);
 				OwnSkinInfo.m_aColors[p] = m_pClient->m_pSkins->GetColorV4(aColorVars[p], p==SKINPART_MARKING);
 			}
 			else
 			{
-				OwnSkinInfo.m_aTextures[p] = pSkinPart->m_OrgTexture;
+				OwnSkinInfo.m_aTextures[p] = m_pClient->m_pSkins->GetOrgTexture(pSkinPart);
 				OwnSkinInfo.m_aColors[p] = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 			}
 		}
@@ -1309,12 +1309,12 @@ void CMenus::RenderSettingsPlayer(CUIRect MainView)
 			const CSkins::CSkinPart *pSkinPart = m_pClient->m_pSkins->GetSkinPart(p, SkinPart);
 			if(aUCCVars[p])
 			{
-				TeamSkinInfo.m_aTextures[p] = pSkinPart->m_ColorTexture;
+				TeamSkinInfo.m_aTextures[p] = m_pClient->m_pSkins->GetColorTexture(pSkinPart);
 				TeamSkinInfo.m_aColors[p] = m_pClient->m_pSkins->GetColorV4(aColorVars[p], p==SKINPART_MARKING);
 			}
 			else
 			{
-				TeamSkinInfo.m_aTextures[p] = pSkinPart->m_OrgTexture;
+				TeamSkinInfo.m_aTextures[p] = m_pClient->m_pSkins->GetOrgTexture(pSkinPart);
 				TeamSkinInfo.m_aColors[p] = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 			}
 		}
@@ -65,6 +65,11 @@ void CMotd::OnRender()
 	TextRender()->TextOutlined(&m_ServerMotdCursor, m_aServerMotd, -1);
 }
 
+void CMotd::OnConsoleInit()
+{
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_MOTD, this);
+}
+
 void CMotd::OnMessage(int MsgType, void *pRawMsg)
 {
 	if(Client()->State() == IClient::STATE_DEMOPLAYBACK)
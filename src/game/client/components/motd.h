@@ -18,6 +18,7 @@ public:
 
 	virtual void OnRender();
 	virtual void OnStateChange(int NewState, int OldState);
+	virtual void OnConsoleInit();
 	virtual void OnMessage(int MsgType, void *pRawMsg);
 	virtual bool OnInput(IInput::CEvent Event);
 };
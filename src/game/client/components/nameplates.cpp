@@ -14,7 +14,7 @@ void CNamePlates::RenderNameplate(
 	const CNetObj_Character *pPrevChar,
 	const CNetObj_Character *pPlayerChar,
 	int ClientID
-	) const
+	)
 {
 	bool Predicted = m_pClient->ShouldUsePredicted() && m_pClient->ShouldUsePredictedChar(ClientID);
 	vec2 Position = m_pClient->GetCharPos(ClientID, Predicted);
@@ -25,45 +25,43 @@ void CNamePlates::RenderNameplate(
 	float a = 1;
 	if(Config()->m_ClNameplatesAlways == 0)
 		a = clamp(1-powf(distance(m_pClient->m_pControls->m_TargetPos, Position)/200.0f,16.0f), 0.0f, 1.0f);
+	if(a <= 0.001f)
+		return;
 
-	char aName[64];
-	str_format(aName, sizeof(aName), "%s", Config()->m_ClShowsocial ? m_pClient->m_aClients[ClientID].m_aName: "");
+	const char *pName = Config()->m_ClShowsocial ? m_pClient->m_aClients[ClientID].m_aName : "";
 
-	TextRender()->TextSecondaryColor(0.0f, 0.0f, 0.0f, 0.5f);
-	TextRender()->TextColor(1.0f, 1.0f, 1.0f, 1.0f);
+	int Team = -1;
 	if(Config()->m_ClNameplatesTeamcolors && m_pClient->m_GameInfo.m_GameFlags&GAMEFLAG_TEAMS)
-	{
-		if(m_pClient->m_aClients[ClientID].m_Team == TEAM_RED)
-			TextRender()->TextColor(1.0f, 0.5f, 0.5f, a);
-		else if(m_pClient->m_aClients[ClientID].m_Team == TEAM_BLUE)
-			TextRender()->TextColor(0.7f, 0.7f, 1.0f, a);
-	}
+		Team = m_pClient->m_aClients[ClientID].m_Team;
 
 	const vec4 IdTextColor(0.1f, 0.1f, 0.1f, a);
 	vec4 BgIdColor(1.0f, 1.0f, 1.0f, a * 0.5f);
-	if(Config()->m_ClNameplatesTeamcolors && m_pClient->m_GameInfo.m_GameFlags&GAMEFLAG_TEAMS)
-	{
-		if(m_pClient->m_aClients[ClientID].m_Team == TEAM_RED)
-			BgIdColor = vec4(1.0f, 0.5f, 0.5f, a * 0.5f);
-		else if(m_pClient->m_aClients[ClientID].m_Team == TEAM_BLUE)
-			BgIdColor = vec4(0.7f, 0.7f, 1.0f, a * 0.5f);
-	}
-	
-	// TODO: cache nameplates
-	static CTextCursor s_Cursor;
-	s_Cursor.m_FontSize = FontSize;
-	s_Cursor.Reset();
-	TextRender()->TextDeferred(&s_Cursor, aName, -1);
+	if(Team == TEAM_RED)
+		BgIdColor = vec4(1.0f, 0.5f, 0.5f, a * 0.5f);
+	else if(Team == TEAM_BLUE)
+		BgIdColor = vec4(0.7f, 0.7f, 1.0f, a * 0.5f);
 
-	float tw = s_Cursor.Width() + RenderTools()->GetClientIdRectSize(FontSize);
+	// the layout is kept until the name, its color or its size change
+	int Style = (Team == TEAM_RED ? 1 : Team == TEAM_BLUE ? 2 : 0) | (Config()->m_ClNameplatesSize&0x7f)<<2 | (Graphics()->ScreenHeight()&0xfff)<<9;
+	CTextCursor *pCursor = &m_aNameCursors[ClientID];
+	pCursor->m_FontSize = FontSize;
+	pCursor->Reset((int64)str_quickhash(pName)<<21 | Style);
+	TextRender()->TextSecondaryColor(0.0f, 0.0f, 0.0f, 0.5f);
+	if(Team == TEAM_RED)
+		TextRender()->TextColor(1.0f, 0.5f, 0.5f, 1.0f);
+	else if(Team == TEAM_BLUE)
+		TextRender()->TextColor(0.7f, 0.7f, 1.0f, 1.0f);
+	else
+		TextRender()->TextColor(1.0f, 1.0f, 1.0f, 1.0f);
+	TextRender()->TextDeferred(pCursor, pName, -1);
 
-	if(a > 0.001f)
-	{
-		vec2 CursorPosition = vec2(Position.x-tw/2.0f, Position.y-FontSize-38.0f);
-		CursorPosition.x += RenderTools()->DrawClientID(TextRender(), s_Cursor.m_FontSize, CursorPosition, ClientID, BgIdColor, IdTextColor);
-		s_Cursor.MoveTo(CursorPosition.x, CursorPosition.y);
-		TextRender()->DrawTextOutlined(&s_Cursor, a);
-	}
+	float tw = pCursor->Width() + RenderTools()->GetClientIdRectSize(FontSize);
+
+	vec2 CursorPosition = vec2(Position.x-tw/2.0f, Position.y-FontSize-38.0f);
+	CursorPosition.x += RenderTools()->DrawClientID(TextRender(), FontSize, CursorPosition, ClientID, BgIdColor, IdTextColor);
+	pCursor->MoveTo(CursorPosition.x, CursorPosition.y);
+	// team colored names fade twice, like when the fade was part of their color
+	TextRender()->DrawTextOutlined(pCursor, Team == TEAM_RED || Team == TEAM_BLUE ? a*a : a);
 
 	TextRender()->TextColor(CUI::ms_DefaultTextColor);
 	TextRender()->TextSecondaryColor(CUI::ms_DefaultTextOutlineColor);
@@ -74,6 +72,8 @@ void CNamePlates::OnRender()
 	if(!Config()->m_ClNameplates || Client()->State() < IClient::STATE_ONLINE)
 		return;
 
+	// all plates go out in one batch per font texture
+	TextRender()->BeginBatch();
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
 		// only render active characters
@@ -85,4 +85,5 @@ void CNamePlates::OnRender()
 				i);
 		}
 	}
+	TextRender()->EndBatch();
 }
@@ -6,11 +6,13 @@
 
 class CNamePlates : public CComponent
 {
+	CTextCursor m_aNameCursors[MAX_CLIENTS];
+
 	void RenderNameplate(
 		const CNetObj_Character *pPrevChar,
 		const CNetObj_Character *pPlayerChar,
 		int ClientID
-	) const;
+	);
 
 public:
 	virtual void OnRender();
@@ -9,6 +9,11 @@
 
 #include "particles.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define CONF_PARTICLES_SSE 1
+#endif
+
 CParticles::CParticles()
 {
 	OnReset();
@@ -21,45 +26,97 @@ CParticles::CParticles()
 void CParticles::OnReset()
 {
 	// reset particles
-	for(int i = 0; i < MAX_PARTICLES; i++)
-	{
-		m_aParticles[i].m_PrevPart = i-1;
-		m_aParticles[i].m_NextPart = i+1;
-	}
-
-	m_aParticles[0].m_PrevPart = 0;
-	m_aParticles[MAX_PARTICLES-1].m_NextPart = -1;
-	m_FirstFree = 0;
-
-	for(int i = 0; i < NUM_GROUPS; i++)
-		m_aFirstPart[i] = -1;
+	for(int g = 0; g < NUM_GROUPS; g++)
+		m_aGroups[g].m_Num = 0;
+	m_NumParticles = 0;
 }
 
 void CParticles::Add(int Group, CParticle *pPart)
 {
 	if(m_pClient->IsWorldPaused() || m_pClient->IsDemoPlaybackPaused())
 		return;
-	if (m_FirstFree == -1)
+	// the budget shrinks with the quality level of the client
+	if(m_NumParticles >= MAX_PARTICLES*Client()->QualityLevel())
+		return;
+
+	// append to the group
+	CGroup *pGroup = &m_aGroups[Group];
+	int i = pGroup->m_Num++;
+	m_NumParticles++;
+	pGroup->m_aPosX[i] = pPart->m_Pos.x;
+	pGroup->m_aPosY[i] = pPart->m_Pos.y;
+	pGroup->m_aVelX[i] = pPart->m_Vel.x;
+	pGroup->m_aVelY[i] = pPart->m_Vel.y;
+	pGroup->m_aGravity[i] = pPart->m_Gravity;
+	pGroup->m_aFriction[i] = pPart->m_Friction;
+	pGroup->m_aLife[i] = 0;
+	pGroup->m_aLifeSpan[i] = pPart->m_LifeSpan;
+	pGroup->m_aRot[i] = pPart->m_Rot;
+	pGroup->m_aRotspeed[i] = pPart->m_Rotspeed;
+	pGroup->m_aStartSize[i] = pPart->m_StartSize;
+	pGroup->m_aEndSize[i] = pPart->m_EndSize;
+	pGroup->m_aColor[i] = pPart->m_Color;
+	pGroup->m_aSpr[i] = pPart->m_Spr;
+}
+
+void CParticles::Remove(CGroup *pGroup, int Index)
+{
+	int Last = --pGroup->m_Num;
+	m_NumParticles--;
+	if(Index == Last)
 		return;
 
-	// remove from the free list
-	int Id = m_FirstFree;
-	m_FirstFree = m_aParticles[Id].m_NextPart;
-	if(m_FirstFree != -1)
-		m_aParticles[m_FirstFree].m_PrevPart = -1;
+	pGroup->m_aPosX[Index] = pGroup->m_aPosX[Last];
+	pGroup->m_aPosY[Index] = pGroup->m_aPosY[Last];
+	pGroup->m_aVelX[Index] = pGroup->m_aVelX[Last];
+	pGroup->m_aVelY[Index] = pGroup->m_aVelY[Last];
+	pGroup->m_aGravity[Index] = pGroup->m_aGravity[Last];
+	pGroup->m_aFriction[Index] = pGroup->m_aFriction[Last];
+	pGroup->m_aLife[Index] = pGroup->m_aLife[Last];
+	pGroup->m_aLifeSpan[Index] = pGroup->m_aLifeSpan[Last];
+	pGroup->m_aRot[Index] = pGroup->m_aRot[Last];
+	pGroup->m_aRotspeed[Index] = pGroup->m_aRotspeed[Last];
+	pGroup->m_aStartSize[Index] = pGroup->m_aStartSize[Last];
+	pGroup->m_aEndSize[Index] = pGroup->m_aEndSize[Last];
+	pGroup->m_aColor[Index] = pGroup->m_aColor[Last];
+	pGroup->m_aSpr[Index] = pGroup->m_aSpr[Last];
+}
 
-	// copy data
-	m_aParticles[Id] = *pPart;
+void CParticles::Integrate(CGroup *pGroup, float TimePassed, int FrictionCount)
+{
+	int i = 0;
+#if defined(CONF_PARTICLES_SSE)
+	const __m128 Time = _mm_set1_ps(TimePassed);
+	for(; i+4 <= pGroup->m_Num; i += 4)
+	{
+		__m128 VelX = _mm_loadu_ps(&pGroup->m_aVelX[i]);
+		__m128 VelY = _mm_add_ps(_mm_loadu_ps(&pGroup->m_aVelY[i]), _mm_mul_ps(_mm_loadu_ps(&pGroup->m_aGravity[i]), Time));
+		__m128 Friction = _mm_loadu_ps(&pGroup->m_aFriction[i]);
+		for(int f = 0; f < FrictionCount; f++)
+		{
+			VelX = _mm_mul_ps(VelX, Friction);
+			VelY = _mm_mul_ps(VelY, Friction);
+		}
+		_mm_storeu_ps(&pGroup->m_aVelX[i], VelX);
+		_mm_storeu_ps(&pGroup->m_aVelY[i], VelY);
+		_mm_storeu_ps(&pGroup->m_aLife[i], _mm_add_ps(_mm_loadu_ps(&pGroup->m_aLife[i]), Time));
+		_mm_storeu_ps(&pGroup->m_aRot[i], _mm_add_ps(_mm_loadu_ps(&pGroup->m_aRot[i]), _mm_mul_ps(_mm_loadu_ps(&pGroup->m_aRotspeed[i]), Time)));
+	}
+#endif
+	for(; i < pGroup->m_Num; i++)
+	{
+		//m_aParticles[i].vel += flow_get(m_aParticles[i].pos)*time_passed * m_aParticles[i].flow_affected;
+		pGroup->m_aVelY[i] += pGroup->m_aGravity[i]*TimePassed;
 
-	// insert to the group list
-	m_aParticles[Id].m_PrevPart = -1;
-	m_aParticles[Id].m_NextPart = m_aFirstPart[Group];
-	if(m_aFirstPart[Group] != -1)
-		m_aParticles[m_aFirstPart[Group]].m_PrevPart = Id;
-	m_aFirstPart[Group] = Id;
+		for(int f = 0; f < FrictionCount; f++) // apply friction
+		{
+			pGroup->m_aVelX[i] *= pGroup->m_aFriction[i];
+			pGroup->m_aVelY[i] *= pGroup->m_aFriction[i];
+		}
 
-	// set some parameters
-	m_aParticles[Id].m_Life = 0;
+		pGroup->m_aLife[i] += TimePassed;
+		pGroup->m_aRot[i] += TimePassed * pGroup->m_aRotspeed[i];
+	}
 }
 
 void CParticles::Update(float TimePassed)
@@ -82,45 +139,38 @@ void CParticles::Update(float TimePassed)
 
 	for(int g = 0; g < NUM_GROUPS; g++)
 	{
-		int i = m_aFirstPart[g];
-		while(i != -1)
-		{
-			int Next = m_aParticles[i].m_NextPart;
-			//m_aParticles[i].vel += flow_get(m_aParticles[i].pos)*time_passed * m_aParticles[i].flow_affected;
-			m_aParticles[i].m_Vel.y += m_aParticles[i].m_Gravity*TimePassed;
-
-			for(int f = 0; f < FrictionCount; f++) // apply friction
-				m_aParticles[i].m_Vel *= m_aParticles[i].m_Friction;
-
-			// move the point
-			vec2 Vel = m_aParticles[i].m_Vel*TimePassed;
-			Collision()->MovePoint(&m_aParticles[i].m_Pos, &Vel, 0.1f+0.9f*random_float(), NULL);
-			m_aParticles[i].m_Vel = Vel* (1.0f/TimePassed);
-
-			m_aParticles[i].m_Life += TimePassed;
-			m_aParticles[i].m_Rot += TimePassed * m_aParticles[i].m_Rotspeed;
+		CGroup *pGroup = &m_aGroups[g];
+		Integrate(pGroup, TimePassed, FrictionCount);
 
-			// check particle death
-			if(m_aParticles[i].m_Life > m_aParticles[i].m_LifeSpan)
+		// move the points, only the ones that hit something bounce off
+		for(int i = 0; i < pGroup->m_Num; i++)
+		{
+			float x = pGroup->m_aPosX[i];
+			float y = pGroup->m_aPosY[i];
+			float DeltaX = pGroup->m_aVelX[i]*TimePassed;
+			float DeltaY = pGroup->m_aVelY[i]*TimePassed;
+			if(!Collision()->CheckPoint(x+DeltaX, y+DeltaY))
 			{
-				// remove it from the group list
-				if(m_aParticles[i].m_PrevPart != -1)
-					m_aParticles[m_aParticles[i].m_PrevPart].m_NextPart = m_aParticles[i].m_NextPart;
-				else
-					m_aFirstPart[g] = m_aParticles[i].m_NextPart;
-
-				if(m_aParticles[i].m_NextPart != -1)
-					m_aParticles[m_aParticles[i].m_NextPart].m_PrevPart = m_aParticles[i].m_PrevPart;
-
-				// insert to the free list
-				if(m_FirstFree != -1)
-					m_aParticles[m_FirstFree].m_PrevPart = i;
-				m_aParticles[i].m_PrevPart = -1;
-				m_aParticles[i].m_NextPart = m_FirstFree;
-				m_FirstFree = i;
+				pGroup->m_aPosX[i] = x+DeltaX;
+				pGroup->m_aPosY[i] = y+DeltaY;
+				continue;
 			}
 
-			i = Next;
+			// same as CCollision::MovePoint
+			float Elasticity = 0.1f+0.9f*random_float();
+			bool HitX = Collision()->CheckPoint(x+DeltaX, y);
+			bool HitY = Collision()->CheckPoint(x, y+DeltaY);
+			if(HitX || !HitY)
+				pGroup->m_aVelX[i] *= -Elasticity;
+			if(HitY || !HitX)
+				pGroup->m_aVelY[i] *= -Elasticity;
+		}
+
+		// check particle death, backwards so the replacement was already checked
+		for(int i = pGroup->m_Num-1; i >= 0; i--)
+		{
+			if(pGroup->m_aLife[i] > pGroup->m_aLifeSpan[i])
+				Remove(pGroup, i);
 		}
 	}
 }
@@ -138,32 +188,28 @@ void CParticles::OnRender()
 
 void CParticles::RenderGroup(int Group)
 {
+	const CGroup *pGroup = &m_aGroups[Group];
+	for(int i = 0; i < pGroup->m_Num; i++)
+	{
+		float a = pGroup->m_aLife[i] / pGroup->m_aLifeSpan[i];
+		float Size = mix(pGroup->m_aStartSize[i], pGroup->m_aEndSize[i], a);
+
+		IGraphics::CQuadInstance *pInstance = &m_aInstances[i];
+		pInstance->m_X = pGroup->m_aPosX[i];
+		pInstance->m_Y = pGroup->m_aPosY[i];
+		pInstance->m_Width = Size;
+		pInstance->m_Height = Size;
+		pInstance->m_Rotation = pGroup->m_aRot[i];
+		RenderTools()->GetSpriteTexCoords(pGroup->m_aSpr[i], 0, pInstance->m_aTexCoords);
+		pInstance->m_R = pGroup->m_aColor[i].r;
+		pInstance->m_G = pGroup->m_aColor[i].g;
+		pInstance->m_B = pGroup->m_aColor[i].b;
+		pInstance->m_A = pGroup->m_aColor[i].a; // pow(a, 0.75f) *
+	}
+
 	Graphics()->BlendNormal();
 	//gfx_blend_additive();
 	Graphics()->TextureSet(g_pData->m_aImages[IMAGE_PARTICLES].m_Id);
-	Graphics()->QuadsBegin();
-
-	int i = m_aFirstPart[Group];
-	while(i != -1)
-	{
-		RenderTools()->SelectSprite(m_aParticles[i].m_Spr);
-		float a = m_aParticles[i].m_Life / m_aParticles[i].m_LifeSpan;
-		vec2 p = m_aParticles[i].m_Pos;
-		float Size = mix(m_aParticles[i].m_StartSize, m_aParticles[i].m_EndSize, a);
-
-		Graphics()->QuadsSetRotation(m_aParticles[i].m_Rot);
-
-		Graphics()->SetColor(
-			m_aParticles[i].m_Color.r,
-			m_aParticles[i].m_Color.g,
-			m_aParticles[i].m_Color.b,
-			m_aParticles[i].m_Color.a); // pow(a, 0.75f) *
-
-		IGraphics::CQuadItem QuadItem(p.x, p.y, Size, Size);
-		Graphics()->QuadsDraw(&QuadItem, 1);
-
-		i = m_aParticles[i].m_NextPart;
-	}
-	Graphics()->QuadsEnd();
+	Graphics()->RenderQuadInstances(m_aInstances, pGroup->m_Num);
 	Graphics()->BlendNormal();
 }
@@ -3,6 +3,7 @@
 #ifndef GAME_CLIENT_COMPONENTS_PARTICLES_H
 #define GAME_CLIENT_COMPONENTS_PARTICLES_H
 #include <base/vmath.h>
+#include <engine/graphics.h>
 #include <game/client/component.h>
 
 // particles
@@ -41,11 +42,6 @@ struct CParticle
 	float m_Friction;
 
 	vec4 m_Color;
-
-	// set by the particle system
-	float m_Life;
-	int m_PrevPart;
-	int m_NextPart;
 };
 
 class CParticles : public CComponent
@@ -74,10 +70,33 @@ private:
 		MAX_PARTICLES=1024*8,
 	};
 
-	CParticle m_aParticles[MAX_PARTICLES];
-	int m_FirstFree;
-	int m_aFirstPart[NUM_GROUPS];
+	// the particles of a group are packed in a structure of arrays, a dead
+	// particle is replaced by the last one of its group
+	struct CGroup
+	{
+		int m_Num;
+		float m_aPosX[MAX_PARTICLES];
+		float m_aPosY[MAX_PARTICLES];
+		float m_aVelX[MAX_PARTICLES];
+		float m_aVelY[MAX_PARTICLES];
+		float m_aGravity[MAX_PARTICLES];
+		float m_aFriction[MAX_PARTICLES];
+		float m_aLife[MAX_PARTICLES];
+		float m_aLifeSpan[MAX_PARTICLES];
+		float m_aRot[MAX_PARTICLES];
+		float m_aRotspeed[MAX_PARTICLES];
+		float m_aStartSize[MAX_PARTICLES];
+		float m_aEndSize[MAX_PARTICLES];
+		vec4 m_aColor[MAX_PARTICLES];
+		int m_aSpr[MAX_PARTICLES];
+	};
+
+	CGroup m_aGroups[NUM_GROUPS];
+	int m_NumParticles; // of all groups together, at most MAX_PARTICLES
+	IGraphics::CQuadInstance m_aInstances[MAX_PARTICLES];
 
+	void Remove(CGroup *pGroup, int Index);
+	static void Integrate(CGroup *pGroup, float TimePassed, int FrictionCount);
 	void RenderGroup(int Group);
 	void Update(float TimePassed);
 
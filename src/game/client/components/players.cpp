@@ -434,7 +434,7 @@ void CPlayers::OnRender()
 		if(!m_pClient->m_Snap.m_aCharacters[i].m_Active)
 			continue;
 
-		s_apInfo[i] = (const CNetObj_PlayerInfo *)Client()->SnapFindItem(IClient::SNAP_CURRENT, NETOBJTYPE_PLAYERINFO, i);
+		s_apInfo[i] = m_pClient->m_Snap.m_paPlayerInfos[i];
 		s_aRenderInfo[i] = m_pClient->m_aClients[i].m_RenderInfo;
 
 		if(m_pClient->m_Snap.m_aCharacters[i].m_Cur.m_Weapon == WEAPON_NINJA)
@@ -448,18 +448,18 @@ void CPlayers::OnRender()
 				{
 					if(IsTeamplay)
 					{
-						s_aRenderInfo[i].m_aTextures[p] = pNinja->m_apParts[p]->m_ColorTexture;
+						s_aRenderInfo[i].m_aTextures[p] = m_pClient->m_pSkins->GetColorTexture(pNinja->m_apParts[p]);
 						int ColorVal = m_pClient->m_pSkins->GetTeamColor(true, pNinja->m_aPartColors[p], m_pClient->m_aClients[i].m_Team, p);
 						s_aRenderInfo[i].m_aColors[p] = m_pClient->m_pSkins->GetColorV4(ColorVal, p==SKINPART_MARKING);
 					}
 					else if(pNinja->m_aUseCustomColors[p])
 					{
-						s_aRenderInfo[i].m_aTextures[p] = pNinja->m_apParts[p]->m_ColorTexture;
+						s_aRenderInfo[i].m_aTextures[p] = m_pClient->m_pSkins->GetColorTexture(pNinja->m_apParts[p]);
 						s_aRenderInfo[i].m_aColors[p] = m_pClient->m_pSkins->GetColorV4(pNinja->m_aPartColors[p], p==SKINPART_MARKING);
 					}
 					else
 					{
-						s_aRenderInfo[i].m_aTextures[p] = pNinja->m_apParts[p]->m_OrgTexture;
+						s_aRenderInfo[i].m_aTextures[p] = m_pClient->m_pSkins->GetOrgTexture(pNinja->m_apParts[p]);
 						s_aRenderInfo[i].m_aColors[p] = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 					}
 				}
@@ -200,6 +200,23 @@ float CScoreboard::RenderSpectators(float x, float y, float w)
 	return RectHeight;
 }
 
+int64 CScoreboard::CellVersion(unsigned Data, int RowStyle)
+{
+	return (int64)Data<<28 | RowStyle;
+}
+
+void CScoreboard::RenderCell(CTextCursor *pCursor, int64 Version, const char *pText, float x, float y, int Align, float MaxWidth, float FontSize)
+{
+	// only laid out again when the version changed
+	pCursor->m_FontSize = FontSize;
+	pCursor->m_MaxLines = 1;
+	pCursor->m_MaxWidth = MaxWidth;
+	pCursor->m_Align = Align;
+	pCursor->Reset(Version);
+	pCursor->MoveTo(x, y);
+	TextRender()->TextOutlined(pCursor, pText, -1);
+}
+
 float CScoreboard::RenderScoreboard(float x, float y, float w, int Team, const char *pTitle, int Align)
 {
 	if(Team == TEAM_SPECTATORS)
@@ -522,6 +539,10 @@ float CScoreboard::RenderScoreboard(float x, float y, float w, int Team, const c
 		}
 	}
 
+	// everything besides the data of a row that changes its text layout
+	const int TableStyle = (Config()->m_ClShowUserId ? 1 : 0) | (ReadyMode ? 2 : 0) | (Race ? 4 : 0) | (m_pClient->RacePrecision()&7)<<3 |
+		(Graphics()->ScreenHeight()&0xfff)<<6;
+
 	s_Cursor.m_MaxLines = 1;
 	s_Cursor.m_FontSize = FontSize;
 	for(int i = 0 ; i < NumRenderScoreIDs ; i++)
@@ -537,6 +558,9 @@ float CScoreboard::RenderScoreboard(float x, float y, float w, int Team, const c
 			vec3 TextColor = vec3(1.0f, 1.0f, 1.0f);
 			vec4 OutlineColor(0.0f, 0.0f, 0.0f, 0.3f);
 			const bool HighlightedLine = m_pClient->m_LocalClientID == pInfo->m_ClientID || (Snap.m_SpecInfo.m_Active && pInfo->m_ClientID == Snap.m_SpecInfo.m_SpectatorID);
+			const bool Watching = RenderDead && (pInfo->m_pPlayerInfo->m_PlayerFlags&PLAYERFLAG_WATCHING);
+			const int RowStyle = TableStyle<<3 | (HighlightedLine ? 1 : 0) | (RenderDead ? 2 : 0) | (Watching ? 4 : 0);
+			CTextCursor *pCells = m_aaRowCursors[pInfo->m_ClientID];
 
 			// background so it's easy to find the local player or the followed one in spectator mode
 			if(HighlightedLine)
@@ -557,13 +581,9 @@ float CScoreboard::RenderScoreboard(float x, float y, float w, int Team, const c
 
 			// ping
 			TextRender()->TextColor(TextColor.r, TextColor.g, TextColor.b, 0.5f*ColorAlpha);
-			str_format(aBuf, sizeof(aBuf), "%d", clamp(pInfo->m_pPlayerInfo->m_Latency, 0, 999));
-
-			s_Cursor.Reset();
-			s_Cursor.MoveTo(PingOffset+PingLength, y+Spacing);
-			s_Cursor.m_Align = TEXTALIGN_RIGHT;
-			s_Cursor.m_MaxWidth = PingLength;
-			TextRender()->TextOutlined(&s_Cursor, aBuf, -1);
+			int Latency = clamp(pInfo->m_pPlayerInfo->m_Latency, 0, 999);
+			str_format(aBuf, sizeof(aBuf), "%d", Latency);
+			RenderCell(&pCells[CELL_PING], CellVersion(Latency, RowStyle), aBuf, PingOffset+PingLength, y+Spacing, TEXTALIGN_RIGHT, PingLength, FontSize);
 			TextRender()->TextColor(TextColor.r, TextColor.g, TextColor.b, ColorAlpha);
 
 			// country flag
@@ -611,7 +631,7 @@ float CScoreboard::RenderScoreboard(float x, float y, float w, int Team, const c
 			}
 
 			// TODO: make an eye icon or something
-			if(RenderDead && pInfo->m_pPlayerInfo->m_PlayerFlags&PLAYERFLAG_WATCHING)
+			if(Watching)
 				TextRender()->TextColor(1.0f, 1.0f, 0.0f, ColorAlpha);
 
 			// id
@@ -619,68 +639,55 @@ float CScoreboard::RenderScoreboard(float x, float y, float w, int Team, const c
 				RenderTools()->DrawClientID(TextRender(), FontSize, vec2(NameOffset+TeeLength-IdSize+Spacing, y+Spacing), pInfo->m_ClientID);
 
 			// name
-			s_Cursor.Reset();
-			s_Cursor.MoveTo(NameOffset+TeeLength, y+Spacing);
-			s_Cursor.m_Align = TEXTALIGN_LEFT;
-			s_Cursor.m_MaxWidth = NameLength-TeeLength;
-			TextRender()->TextOutlined(&s_Cursor, m_pClient->m_aClients[pInfo->m_ClientID].m_aName, str_length(m_pClient->m_aClients[pInfo->m_ClientID].m_aName));
-			
+			const char *pName = m_pClient->m_aClients[pInfo->m_ClientID].m_aName;
+			RenderCell(&pCells[CELL_NAME], CellVersion(str_quickhash(pName), RowStyle), pName, NameOffset+TeeLength, y+Spacing, TEXTALIGN_LEFT, NameLength-TeeLength, FontSize);
+
 			// ready / watching
 			if(ReadyMode && (pInfo->m_pPlayerInfo->m_PlayerFlags&PLAYERFLAG_READY))
 			{
 				if(HighlightedLine)
 					TextRender()->TextSecondaryColor(0.0f, 0.1f, 0.0f, 0.5f);
 				TextRender()->TextColor(0.1f, 1.0f, 0.1f, ColorAlpha);
-				s_Cursor.MoveTo(s_Cursor.BoundingBox().Right(), y+Spacing);
-				s_Cursor.Reset();
-				TextRender()->TextOutlined(&s_Cursor, "\xE2\x9C\x93", str_length("\xE2\x9C\x93"));
+				RenderCell(&pCells[CELL_READY], CellVersion(0, RowStyle), "\xE2\x9C\x93", pCells[CELL_NAME].BoundingBox().Right(), y+Spacing, TEXTALIGN_LEFT, -1.0f, FontSize);
 			}
 			TextRender()->TextColor(TextColor.r, TextColor.g, TextColor.b, ColorAlpha);
 			TextRender()->TextSecondaryColor(OutlineColor.r, OutlineColor.g, OutlineColor.b, OutlineColor.a);
 
 			// clan
-			s_Cursor.Reset();
-			s_Cursor.MoveTo(ClanOffset+ClanLength/2, y+Spacing);
-			s_Cursor.m_Align = TEXTALIGN_CENTER;
-			s_Cursor.m_MaxWidth = ClanLength;
-			TextRender()->TextOutlined(&s_Cursor, m_pClient->m_aClients[pInfo->m_ClientID].m_aClan, -1);
+			const char *pClan = m_pClient->m_aClients[pInfo->m_ClientID].m_aClan;
+			RenderCell(&pCells[CELL_CLAN], CellVersion(str_quickhash(pClan), RowStyle), pClan, ClanOffset+ClanLength/2, y+Spacing, TEXTALIGN_CENTER, ClanLength, FontSize);
 
 			if(!Race)
 			{
 				// K
 				TextRender()->TextColor(TextColor.r, TextColor.g, TextColor.b, 0.5f*ColorAlpha);
-				str_format(aBuf, sizeof(aBuf), "%d", clamp(m_pClient->m_pStats->GetPlayerStats(pInfo->m_ClientID)->m_Frags, 0, 999));
-				s_Cursor.Reset();
-				s_Cursor.MoveTo(KillOffset+KillLength/2, y+Spacing);
-				s_Cursor.m_MaxWidth = KillLength;
-				TextRender()->TextOutlined(&s_Cursor, aBuf, -1);
+				int Frags = clamp(m_pClient->m_pStats->GetPlayerStats(pInfo->m_ClientID)->m_Frags, 0, 999);
+				str_format(aBuf, sizeof(aBuf), "%d", Frags);
+				RenderCell(&pCells[CELL_KILLS], CellVersion(Frags, RowStyle), aBuf, KillOffset+KillLength/2, y+Spacing, TEXTALIGN_CENTER, KillLength, FontSize);
 
 				// D
-				str_format(aBuf, sizeof(aBuf), "%d", clamp(m_pClient->m_pStats->GetPlayerStats(pInfo->m_ClientID)->m_Deaths, 0, 999));
-				s_Cursor.Reset();
-				s_Cursor.MoveTo(DeathOffset+DeathLength/2, y+Spacing);
-				s_Cursor.m_MaxWidth = DeathLength;
-				TextRender()->TextOutlined(&s_Cursor, aBuf, -1);
+				int Deaths = clamp(m_pClient->m_pStats->GetPlayerStats(pInfo->m_ClientID)->m_Deaths, 0, 999);
+				str_format(aBuf, sizeof(aBuf), "%d", Deaths);
+				RenderCell(&pCells[CELL_DEATHS], CellVersion(Deaths, RowStyle), aBuf, DeathOffset+DeathLength/2, y+Spacing, TEXTALIGN_CENTER, DeathLength, FontSize);
 			}
 
 			// score
+			int Score = pInfo->m_pPlayerInfo->m_Score;
 			if(Race)
 			{
 				aBuf[0] = 0;
-				if(pInfo->m_pPlayerInfo->m_Score >= 0)
-					FormatTime(aBuf, sizeof(aBuf), pInfo->m_pPlayerInfo->m_Score, m_pClient->RacePrecision());
+				if(Score >= 0)
+					FormatTime(aBuf, sizeof(aBuf), Score, m_pClient->RacePrecision());
 			}
 			else
 			{
-				str_format(aBuf, sizeof(aBuf), "%d", clamp(pInfo->m_pPlayerInfo->m_Score, -999, 9999));
+				Score = clamp(Score, -999, 9999);
+				str_format(aBuf, sizeof(aBuf), "%d", Score);
 			}
 
-			s_Cursor.Reset();
-			s_Cursor.m_Align = Race ? TEXTALIGN_RIGHT : TEXTALIGN_CENTER;
-			s_Cursor.MoveTo(ScoreOffset+(Race ? ScoreLength-3.f : ScoreLength/2), y+Spacing);
-			s_Cursor.m_MaxWidth = ScoreLength;
 			TextRender()->TextColor(TextColor.r, TextColor.g, TextColor.b, ColorAlpha);
-			TextRender()->TextOutlined(&s_Cursor, aBuf, -1);
+			RenderCell(&pCells[CELL_SCORE], CellVersion(Score, RowStyle), aBuf, ScoreOffset+(Race ? ScoreLength-3.f : ScoreLength/2), y+Spacing,
+				Race ? TEXTALIGN_RIGHT : TEXTALIGN_CENTER, ScoreLength, FontSize);
 
 			y += LineHeight;
 		}
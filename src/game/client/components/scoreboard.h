@@ -3,10 +3,28 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef GAME_CLIENT_COMPONENTS_SCOREBOARD_H
 #define GAME_CLIENT_COMPONENTS_SCOREBOARD_H
+#include <engine/textrender.h>
 #include <game/client/component.h>
 
 class CScoreboard : public CComponent
 {
+	enum
+	{
+		CELL_PING=0,
+		CELL_NAME,
+		CELL_READY,
+		CELL_CLAN,
+		CELL_KILLS,
+		CELL_DEATHS,
+		CELL_SCORE,
+		NUM_CELLS,
+	};
+
+	// text of the player rows, laid out again only when what a cell shows changes
+	CTextCursor m_aaRowCursors[MAX_CLIENTS][NUM_CELLS];
+
+	static int64 CellVersion(unsigned Data, int RowStyle);
+	void RenderCell(CTextCursor *pCursor, int64 Version, const char *pText, float x, float y, int Align, float MaxWidth, float FontSize);
 	void RenderGoals(float x, float y, float w);
 	float RenderSpectators(float x, float y, float w);
 	float RenderScoreboard(float x, float y, float w, int Team, const char *pTitle, int Align);
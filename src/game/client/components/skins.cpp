@@ -6,6 +6,7 @@
 #include <base/system.h>
 #include <base/math.h>
 
+#include <engine/engine.h>
 #include <engine/graphics.h>
 #include <engine/storage.h>
 #include <engine/external/json-parser/json.h>
@@ -25,36 +26,69 @@ int *CSkins::ms_apColorVariables[NUM_SKINPARTS] = {0};
 
 const float MIN_EYE_BODY_COLOR_DIST = 80.f; // between body and eyes (LAB color space)
 
+static void PartName(char *pBuf, int Size, const char *pFilename)
+{
+	str_utf8_copy_num(pBuf, pFilename, min(str_length(pFilename) - 3, Size), MAX_SKIN_LENGTH);
+}
+
 int CSkins::SkinPartScan(const char *pName, int IsDir, int DirType, void *pUser)
 {
 	CSkins *pSelf = (CSkins *)pUser;
 	if(IsDir || !str_endswith(pName, ".png"))
 		return 0;
 
+	// without a budget everything is loaded at startup, otherwise just the standard parts
+	CLoadedPart Loaded;
+	Loaded.m_Part = pSelf->m_ScanningPart;
+	Loaded.m_DirType = DirType;
+	str_copy(Loaded.m_aName, pName, sizeof(Loaded.m_aName));
+	Loaded.m_Decode = !pSelf->Config()->m_ClSkinsBudget || !str_comp(pName, "standard.png");
+	Loaded.m_Image.m_pData = 0;
+	Loaded.m_pGrayData = 0;
+	Loaded.m_BloodColor = vec3(1.0f, 1.0f, 1.0f);
+	pSelf->m_aLoadedParts.add(Loaded);
+	return 0;
+}
+
+void CSkins::DecodeSkinPart(IGraphics *pGraphics, CLoadedPart *pLoaded)
+{
 	char aBuf[IO_MAX_PATH_LENGTH];
-	str_format(aBuf, sizeof(aBuf), "skins/%s/%s", CSkins::ms_apSkinPartNames[pSelf->m_ScanningPart], pName);
-	CImageInfo Info;
-	if(!pSelf->Graphics()->LoadPNG(&Info, aBuf, DirType))
+	str_format(aBuf, sizeof(aBuf), "skins/%s/%s", CSkins::ms_apSkinPartNames[pLoaded->m_Part], pLoaded->m_aName);
+	CImageInfo *pInfo = &pLoaded->m_Image;
+	if(!pGraphics->LoadPNG(pInfo, aBuf, pLoaded->m_DirType))
 	{
-		str_format(aBuf, sizeof(aBuf), "failed to load skin part '%s'", pName);
-		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
-		return 0;
+		pInfo->m_pData = 0;
+		return;
 	}
 
-	CSkinPart Part;
-	Part.m_OrgTexture = pSelf->Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
-	Part.m_BloodColor = vec3(1.0f, 1.0f, 1.0f);
+	// the atlases are rgba
+	int NumPixels = pInfo->m_Width*pInfo->m_Height;
+	if(pInfo->m_Format == CImageInfo::FORMAT_RGB)
+	{
+		unsigned char *pRgb = (unsigned char *)pInfo->m_pData;
+		unsigned char *pRgba = (unsigned char *)mem_alloc(NumPixels*4, 1);
+		for(int i = 0; i < NumPixels; i++)
+		{
+			pRgba[i*4] = pRgb[i*3];
+			pRgba[i*4+1] = pRgb[i*3+1];
+			pRgba[i*4+2] = pRgb[i*3+2];
+			pRgba[i*4+3] = 255;
+		}
+		mem_free(pRgb);
+		pInfo->m_pData = pRgba;
+		pInfo->m_Format = CImageInfo::FORMAT_RGBA;
+	}
 
-	unsigned char *d = (unsigned char *)Info.m_pData;
-	int Pitch = Info.m_Width*4;
+	unsigned char *d = (unsigned char *)pInfo->m_pData;
+	int Pitch = pInfo->m_Width*4;
 
 	// dig out blood color
-	if(pSelf->m_ScanningPart == SKINPART_BODY)
+	if(pLoaded->m_Part == SKINPART_BODY)
 	{
-		int PartX = Info.m_Width/2;
+		int PartX = pInfo->m_Width/2;
 		int PartY = 0;
-		int PartWidth = Info.m_Width/2;
-		int PartHeight = Info.m_Height/2;
+		int PartWidth = pInfo->m_Width/2;
+		int PartHeight = pInfo->m_Height/2;
 
 		int aColors[3] = {0};
 		for(int y = PartY; y < PartY+PartHeight; y++)
@@ -68,39 +102,240 @@ int CSkins::SkinPartScan(const char *pName, int IsDir, int DirType, void *pUser)
 				}
 			}
 
-		Part.m_BloodColor = normalize(vec3(aColors[0], aColors[1], aColors[2]));
+		pLoaded->m_BloodColor = normalize(vec3(aColors[0], aColors[1], aColors[2]));
 	}
 
 	// create colorless version
-	int Step = Info.m_Format == CImageInfo::FORMAT_RGBA ? 4 : 3;
+	pLoaded->m_pGrayData = (unsigned char *)mem_alloc(NumPixels*4, 1);
+	mem_copy(pLoaded->m_pGrayData, d, NumPixels*4);
+	d = pLoaded->m_pGrayData;
 
 	// make the texture gray scale
-	for(int i = 0; i < Info.m_Width*Info.m_Height; i++)
+	for(int i = 0; i < NumPixels; i++)
 	{
-		int v = (d[i*Step]+d[i*Step+1]+d[i*Step+2])/3;
-		d[i*Step] = v;
-		d[i*Step+1] = v;
-		d[i*Step+2] = v;
+		int v = (d[i*4]+d[i*4+1]+d[i*4+2])/3;
+		d[i*4] = v;
+		d[i*4+1] = v;
+		d[i*4+2] = v;
 	}
+}
+
+void CSkins::DecodeSkinParts(int Begin, int End, void *pUser)
+{
+	CSkins *pSelf = (CSkins *)pUser;
+	for(int i = Begin; i < End; i++)
+		if(pSelf->m_aLoadedParts[i].m_Decode)
+			DecodeSkinPart(pSelf->Graphics(), &pSelf->m_aLoadedParts[i]);
+}
 
-	Part.m_ColorTexture = pSelf->Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
-	mem_free(Info.m_pData);
+int CSkins::PartLoadJob(void *pData)
+{
+	CPartLoad *pLoad = (CPartLoad *)pData;
+	DecodeSkinPart(pLoad->m_pGraphics, &pLoad->m_Loaded);
+	return 0;
+}
 
-	// set skin part data
-	Part.m_Flags = 0;
-	if(pName[0] == 'x' && pName[1] == '_')
-		Part.m_Flags |= SKINFLAG_SPECIAL;
-	if(DirType != IStorage::TYPE_SAVE)
-		Part.m_Flags |= SKINFLAG_STANDARD;
-	str_utf8_copy_num(Part.m_aName, pName, min(str_length(pName) - 3, int(sizeof(Part.m_aName))), MAX_SKIN_LENGTH);
-	if(pSelf->Config()->m_Debug)
+bool CSkins::AllocCell(int Size, CAtlasCell *pCell)
+{
+	// cells are aligned to their size, so the mipmaps of different parts never mix
+	for(int p = 0; p < m_apAtlasPages.size(); p++)
 	{
-		str_format(aBuf, sizeof(aBuf), "load skin part %s", Part.m_aName);
-		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
+		CAtlasPage *pPage = m_apAtlasPages[p];
+		for(int y = 0; y < ATLAS_GRID; y += Size)
+			for(int x = 0; x < ATLAS_GRID; x += Size)
+			{
+				bool Free = true;
+				for(int cy = y; cy < y+Size && Free; cy++)
+					for(int cx = x; cx < x+Size && Free; cx++)
+						Free = !pPage->m_aUsed[cy*ATLAS_GRID+cx];
+				if(!Free)
+					continue;
+
+				for(int cy = y; cy < y+Size; cy++)
+					for(int cx = x; cx < x+Size; cx++)
+						pPage->m_aUsed[cy*ATLAS_GRID+cx] = 1;
+				pCell->m_Page = p;
+				pCell->m_X = x;
+				pCell->m_Y = y;
+				pCell->m_Size = Size;
+				return true;
+			}
 	}
-	pSelf->m_aaSkinParts[pSelf->m_ScanningPart].add(Part);
+	return false;
+}
 
-	return 0;
+void CSkins::FreeCell(const CAtlasCell *pCell)
+{
+	CAtlasPage *pPage = m_apAtlasPages[pCell->m_Page];
+	for(int cy = pCell->m_Y; cy < pCell->m_Y+pCell->m_Size; cy++)
+		mem_zero(&pPage->m_aUsed[cy*ATLAS_GRID+pCell->m_X], pCell->m_Size);
+}
+
+void CSkins::UnloadPart(CSkinPart *pPart)
+{
+	CSubTexture *apTextures[2] = {&pPart->m_OrgTexture, &pPart->m_ColorTexture};
+	for(int k = 0; k < 2; k++)
+	{
+		if(pPart->m_aCells[k].m_Page < 0)
+		{
+			Graphics()->UnloadTexture(&apTextures[k]->m_Texture);
+			m_SeparateMemory -= pPart->m_aCells[k].m_Size;
+		}
+		else
+			FreeCell(&pPart->m_aCells[k]);
+		*apTextures[k] = CSubTexture();
+	}
+	pPart->m_State = PART_UNLOADED;
+	m_Generation++;
+}
+
+bool CSkins::UnloadIdlePart()
+{
+	if(!Config()->m_ClSkinsBudget)
+		return false;
+
+	// the least recently used part that wasn't shown for a while, the standard ones stay
+	CSkinPart *pOldest = 0;
+	for(int p = 0; p < NUM_SKINPARTS; p++)
+		for(int i = 0; i < m_aaSkinParts[p].size(); i++)
+		{
+			CSkinPart *pPart = &m_aaSkinParts[p][i];
+			if(pPart->m_State != PART_LOADED || pPart == m_DummySkin.m_apParts[p] || m_FrameTime-pPart->m_LastUse < PART_UNLOAD_TIME*time_freq())
+				continue;
+			if(!pOldest || pPart->m_LastUse < pOldest->m_LastUse)
+				pOldest = pPart;
+		}
+	if(!pOldest)
+		return false;
+	UnloadPart(pOldest);
+	return true;
+}
+
+void CSkins::UploadPart(CSkinPart *pPart, CLoadedPart *pLoaded)
+{
+	const int64 Budget = (int64)Config()->m_ClSkinsBudget*1024*1024;
+	const CImageInfo *pInfo = &pLoaded->m_Image;
+	const unsigned char *apData[2] = {(unsigned char *)pInfo->m_pData, pLoaded->m_pGrayData};
+	CSubTexture *apTextures[2] = {&pPart->m_OrgTexture, &pPart->m_ColorTexture};
+	int Size = max(pInfo->m_Width, pInfo->m_Height);
+	if(Size <= ATLAS_SIZE/2)
+	{
+		int CellSize = ATLAS_CELL_SIZE;
+		while(CellSize < Size)
+			CellSize <<= 1;
+		unsigned char *pCellData = (unsigned char *)mem_alloc(CellSize*CellSize*4, 1);
+		for(int k = 0; k < 2; k++)
+		{
+			CAtlasCell *pCell = &pPart->m_aCells[k];
+			while(!AllocCell(CellSize/ATLAS_CELL_SIZE, pCell))
+			{
+				// another atlas only when it fits the budget or there is nothing to unload
+				if(Budget && MemoryUsage()+ATLAS_MEMORY > Budget && UnloadIdlePart())
+					continue;
+				CAtlasPage *pPage = new CAtlasPage;
+				mem_zero(pPage->m_aUsed, sizeof(pPage->m_aUsed));
+				unsigned char *pBlank = (unsigned char *)mem_alloc(ATLAS_SIZE*ATLAS_SIZE*4, 1);
+				mem_zero(pBlank, ATLAS_SIZE*ATLAS_SIZE*4);
+				pPage->m_Texture = Graphics()->LoadTextureRaw(ATLAS_SIZE, ATLAS_SIZE, CImageInfo::FORMAT_RGBA, pBlank, CImageInfo::FORMAT_RGBA, IGraphics::TEXLOAD_NORESAMPLE);
+				mem_free(pBlank);
+				m_apAtlasPages.add(pPage);
+			}
+
+			// the whole cell is uploaded, the mipmaps would pick up the previous part otherwise
+			mem_zero(pCellData, CellSize*CellSize*4);
+			for(int y = 0; y < pInfo->m_Height; y++)
+				mem_copy(pCellData+y*CellSize*4, apData[k]+y*pInfo->m_Width*4, pInfo->m_Width*4);
+			int x = pCell->m_X*ATLAS_CELL_SIZE;
+			int y = pCell->m_Y*ATLAS_CELL_SIZE;
+			Graphics()->LoadTextureRawSub(m_apAtlasPages[pCell->m_Page]->m_Texture, x, y, CellSize, CellSize, CImageInfo::FORMAT_RGBA, pCellData);
+
+			apTextures[k]->m_Texture = m_apAtlasPages[pCell->m_Page]->m_Texture;
+			apTextures[k]->m_aRect[0] = x/(float)ATLAS_SIZE;
+			apTextures[k]->m_aRect[1] = y/(float)ATLAS_SIZE;
+			apTextures[k]->m_aRect[2] = (x+pInfo->m_Width)/(float)ATLAS_SIZE;
+			apTextures[k]->m_aRect[3] = (y+pInfo->m_Height)/(float)ATLAS_SIZE;
+		}
+		mem_free(pCellData);
+	}
+	else
+	{
+		int MemSize = pInfo->m_Width*pInfo->m_Height*4;
+		while(Budget && MemoryUsage()+2*MemSize > Budget && UnloadIdlePart())
+			;
+		for(int k = 0; k < 2; k++)
+		{
+			pPart->m_aCells[k].m_Page = -1;
+			pPart->m_aCells[k].m_Size = MemSize;
+			*apTextures[k] = CSubTexture();
+			apTextures[k]->m_Texture = Graphics()->LoadTextureRaw(pInfo->m_Width, pInfo->m_Height, CImageInfo::FORMAT_RGBA, apData[k], CImageInfo::FORMAT_RGBA, 0);
+			m_SeparateMemory += MemSize;
+		}
+	}
+
+	pPart->m_BloodColor = pLoaded->m_BloodColor;
+	pPart->m_State = PART_LOADED;
+	pPart->m_LastUse = m_FrameTime;
+	mem_free(pLoaded->m_Image.m_pData);
+	mem_free(pLoaded->m_pGrayData);
+	pLoaded->m_Image.m_pData = 0;
+	pLoaded->m_pGrayData = 0;
+	m_Generation++;
+}
+
+const CSkins::CSkinPart *CSkins::UsePart(const CSkinPart *pConstPart)
+{
+	// the parts are handed out const, only the loading state changes here
+	CSkinPart *pPart = const_cast<CSkinPart *>(pConstPart);
+	pPart->m_LastUse = m_FrameTime;
+	if(pPart->m_State == PART_UNLOADED)
+	{
+		CPartLoad *pLoad = new CPartLoad;
+		pLoad->m_pGraphics = Graphics();
+		pLoad->m_pPart = pPart;
+		CLoadedPart *pLoaded = &pLoad->m_Loaded;
+		pLoaded->m_Part = pPart->m_Type;
+		pLoaded->m_DirType = pPart->m_DirType;
+		str_copy(pLoaded->m_aName, pPart->m_aFilename, sizeof(pLoaded->m_aName));
+		pLoaded->m_Decode = true;
+		pLoaded->m_Image.m_pData = 0;
+		pLoaded->m_pGrayData = 0;
+		pLoaded->m_BloodColor = vec3(1.0f, 1.0f, 1.0f);
+		pPart->m_State = PART_LOADING;
+		m_apPartLoads.add(pLoad);
+		m_pClient->Engine()->JobPool()->Add(&pLoad->m_Job, PartLoadJob, pLoad, CJobPool::PRIORITY_NORMAL, &m_PartLoadGroup);
+	}
+
+	if(pPart->m_State == PART_LOADED)
+		return pPart;
+	const CSkinPart *pStandIn = m_DummySkin.m_apParts[pPart->m_Type];
+	return pStandIn->m_State == PART_LOADED ? pStandIn : pPart;
+}
+
+const CSubTexture &CSkins::GetOrgTexture(const CSkinPart *pPart)
+{
+	return UsePart(pPart)->m_OrgTexture;
+}
+
+const CSubTexture &CSkins::GetColorTexture(const CSkinPart *pPart)
+{
+	return UsePart(pPart)->m_ColorTexture;
+}
+
+void CSkins::MarkUsed(const CSkinPart *pPart)
+{
+	const_cast<CSkinPart *>(pPart)->m_LastUse = m_FrameTime;
+}
+
+static void InitSkinPart(CSkins::CSkinPart *pPart, int Type, const char *pName)
+{
+	pPart->m_Flags = CSkins::SKINFLAG_STANDARD;
+	str_copy(pPart->m_aName, pName, sizeof(pPart->m_aName));
+	pPart->m_BloodColor = vec3(1.0f, 1.0f, 1.0f);
+	pPart->m_Type = Type;
+	pPart->m_DirType = IStorage::TYPE_ALL;
+	pPart->m_aFilename[0] = 0;
+	pPart->m_State = CSkins::PART_FAILED;
+	pPart->m_LastUse = 0;
 }
 
 int CSkins::SkinScan(const char *pName, int IsDir, int DirType, void *pUser)
@@ -215,6 +450,25 @@ int CSkins::GetInitAmount() const
 	return NUM_SKINPARTS*5 + 8;
 }
 
+void CSkins::OnLoad()
+{
+	// list the parts in order, then decode the ones needed right away on the job pool
+	m_aLoadedParts.clear();
+	for(int p = 0; p < NUM_SKINPARTS; p++)
+	{
+		char aBuf[64];
+		str_format(aBuf, sizeof(aBuf), "skins/%s", ms_apSkinPartNames[p]);
+		m_ScanningPart = p;
+		Storage()->ListDirectory(IStorage::TYPE_ALL, aBuf, SkinPartScan, this);
+	}
+	m_pClient->Engine()->JobPool()->ParallelFor(0, m_aLoadedParts.size(), 1, DecodeSkinParts, this);
+
+	m_XmasHatImage.m_pData = 0;
+	Graphics()->LoadPNG(&m_XmasHatImage, "skins/xmas_hat.png", IStorage::TYPE_ALL);
+	m_BotImage.m_pData = 0;
+	Graphics()->LoadPNG(&m_BotImage, "skins/bot.png", IStorage::TYPE_ALL);
+}
+
 void CSkins::OnInit()
 {
 	ms_apSkinVariables[SKINPART_BODY] = Config()->m_PlayerSkinBody;
@@ -236,6 +490,8 @@ void CSkins::OnInit()
 	ms_apColorVariables[SKINPART_FEET] = &Config()->m_PlayerColorFeet;
 	ms_apColorVariables[SKINPART_EYES] = &Config()->m_PlayerColorEyes;
 
+	m_Generation = 0;
+	m_FrameTime = time_get();
 	for(int p = 0; p < NUM_SKINPARTS; p++)
 	{
 		m_aaSkinParts[p].clear();
@@ -244,31 +500,72 @@ void CSkins::OnInit()
 		if(p == SKINPART_MARKING || p == SKINPART_DECORATION)
 		{
 			CSkinPart NoneSkinPart;
-			NoneSkinPart.m_Flags = SKINFLAG_STANDARD;
-			str_copy(NoneSkinPart.m_aName, "", sizeof(NoneSkinPart.m_aName));
-			NoneSkinPart.m_BloodColor = vec3(1.0f, 1.0f, 1.0f);
+			InitSkinPart(&NoneSkinPart, p, "");
 			m_aaSkinParts[p].add(NoneSkinPart);
 		}
 
-		// load skin parts
-		char aBuf[64];
-		str_format(aBuf, sizeof(aBuf), "skins/%s", ms_apSkinPartNames[p]);
-		m_ScanningPart = p;
-		Storage()->ListDirectory(IStorage::TYPE_ALL, aBuf, SkinPartScan, this);
+		// add the listed skin parts, their textures get loaded once they are used
+		for(int i = 0; i < m_aLoadedParts.size(); i++)
+		{
+			const CLoadedPart *pLoaded = &m_aLoadedParts[i];
+			if(pLoaded->m_Part != p)
+				continue;
+			if(pLoaded->m_Decode && !pLoaded->m_Image.m_pData)
+			{
+				char aBuf[IO_MAX_PATH_LENGTH];
+				str_format(aBuf, sizeof(aBuf), "failed to load skin part '%s'", pLoaded->m_aName);
+				Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
+				continue;
+			}
+
+			CSkinPart Part;
+			char aName[MAX_SKIN_ARRAY_SIZE];
+			PartName(aName, sizeof(aName), pLoaded->m_aName);
+			InitSkinPart(&Part, p, aName);
+			Part.m_Flags = 0;
+			if(pLoaded->m_aName[0] == 'x' && pLoaded->m_aName[1] == '_')
+				Part.m_Flags |= SKINFLAG_SPECIAL;
+			if(pLoaded->m_DirType != IStorage::TYPE_SAVE)
+				Part.m_Flags |= SKINFLAG_STANDARD;
+			Part.m_DirType = pLoaded->m_DirType;
+			str_copy(Part.m_aFilename, pLoaded->m_aName, sizeof(Part.m_aFilename));
+			Part.m_State = PART_UNLOADED;
+			if(Config()->m_Debug)
+			{
+				char aBuf[IO_MAX_PATH_LENGTH];
+				str_format(aBuf, sizeof(aBuf), "load skin part %s", Part.m_aName);
+				Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
+			}
+			m_aaSkinParts[p].add(Part);
+		}
 
 		// add dummy skin part
 		if(!m_aaSkinParts[p].size())
 		{
 			CSkinPart DummySkinPart;
-			DummySkinPart.m_Flags = SKINFLAG_STANDARD;
-			str_copy(DummySkinPart.m_aName, "dummy", sizeof(DummySkinPart.m_aName));
-			DummySkinPart.m_BloodColor = vec3(1.0f, 1.0f, 1.0f);
+			InitSkinPart(&DummySkinPart, p, "dummy");
 			m_aaSkinParts[p].add(DummySkinPart);
 		}
 
 		m_pClient->m_pMenus->RenderLoading(5);
 	}
 
+	// upload the parts decoded by OnLoad, now that they don't move anymore
+	for(int i = 0; i < m_aLoadedParts.size(); i++)
+	{
+		CLoadedPart *pLoaded = &m_aLoadedParts[i];
+		if(!pLoaded->m_Image.m_pData)
+			continue;
+		sorted_array<CSkinPart> &rParts = m_aaSkinParts[pLoaded->m_Part];
+		for(int j = 0; j < rParts.size(); j++)
+			if(rParts[j].m_DirType == pLoaded->m_DirType && !str_comp(rParts[j].m_aFilename, pLoaded->m_aName))
+			{
+				UploadPart(&rParts[j], pLoaded);
+				break;
+			}
+	}
+	m_aLoadedParts.clear();
+
 	// create dummy skin
 	m_DummySkin.m_Flags = SKINFLAG_STANDARD;
 	str_copy(m_DummySkin.m_aName, "dummy", sizeof(m_DummySkin.m_aName));
@@ -299,8 +596,8 @@ void CSkins::OnInit()
 	{
 		// add xmas hat
 		const char *pFileName = "skins/xmas_hat.png";
-		CImageInfo Info;
-		if(!Graphics()->LoadPNG(&Info, pFileName, IStorage::TYPE_ALL) || Info.m_Width != 128 || Info.m_Height != 512)
+		const CImageInfo &Info = m_XmasHatImage;
+		if(!Info.m_pData || Info.m_Width != 128 || Info.m_Height != 512)
 		{
 			char aBuf[128];
 			str_format(aBuf, sizeof(aBuf), "failed to load xmas hat '%s'", pFileName);
@@ -313,14 +610,16 @@ void CSkins::OnInit()
 			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "game", aBuf);
 			m_XmasHatTexture = Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
 		}
+		mem_free(m_XmasHatImage.m_pData);
+		m_XmasHatImage.m_pData = 0;
 	}
 	m_pClient->m_pMenus->RenderLoading(1);
 
 	{
 		// add bot decoration
 		const char *pFileName = "skins/bot.png";
-		CImageInfo Info;
-		if(!Graphics()->LoadPNG(&Info, pFileName, IStorage::TYPE_ALL) || Info.m_Width != 384 || Info.m_Height != 160)
+		const CImageInfo &Info = m_BotImage;
+		if(!Info.m_pData || Info.m_Width != 384 || Info.m_Height != 160)
 		{
 			char aBuf[128];
 			str_format(aBuf, sizeof(aBuf), "failed to load bot '%s'", pFileName);
@@ -333,10 +632,53 @@ void CSkins::OnInit()
 			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "game", aBuf);
 			m_BotTexture = Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
 		}
+		mem_free(m_BotImage.m_pData);
+		m_BotImage.m_pData = 0;
 	}
 	m_pClient->m_pMenus->RenderLoading(1);
 }
 
+void CSkins::OnShutdown()
+{
+	m_pClient->Engine()->JobPool()->Wait(&m_PartLoadGroup);
+	for(int i = 0; i < m_apPartLoads.size(); i++)
+	{
+		mem_free(m_apPartLoads[i]->m_Loaded.m_Image.m_pData);
+		mem_free(m_apPartLoads[i]->m_Loaded.m_pGrayData);
+		delete m_apPartLoads[i];
+	}
+	m_apPartLoads.clear();
+}
+
+void CSkins::OnRender()
+{
+	m_FrameTime = time_get();
+
+	// upload the parts that are done decoding
+	for(int i = 0; i < m_apPartLoads.size(); )
+	{
+		CPartLoad *pLoad = m_apPartLoads[i];
+		if(pLoad->m_Job.Status() != CJob::STATE_DONE)
+		{
+			i++;
+			continue;
+		}
+
+		if(pLoad->m_Loaded.m_Image.m_pData)
+			UploadPart(pLoad->m_pPart, &pLoad->m_Loaded);
+		else
+		{
+			char aBuf[IO_MAX_PATH_LENGTH];
+			str_format(aBuf, sizeof(aBuf), "failed to load skin part '%s'", pLoad->m_Loaded.m_aName);
+			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
+			pLoad->m_pPart->m_State = PART_FAILED;
+			m_Generation++;
+		}
+		delete pLoad;
+		m_apPartLoads.remove_index_fast(i);
+	}
+}
+
 void CSkins::AddSkin(const char *pSkinName)
 {
 	CSkin Skin = m_DummySkin;
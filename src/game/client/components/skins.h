@@ -4,6 +4,7 @@
 #define GAME_CLIENT_COMPONENTS_SKINS_H
 #include <base/vmath.h>
 #include <base/tl/sorted_array.h>
+#include <engine/shared/jobs.h>
 #include <game/client/component.h>
 
 // todo: fix duplicate skins (different paths)
@@ -23,14 +24,39 @@ public:
 		HAT_OFFSET_SIDE=2,
 	};
 
+	enum
+	{
+		PART_UNLOADED=0,
+		PART_LOADING,
+		PART_LOADED,
+		PART_FAILED, // also parts without a file
+	};
+
+	// a square of atlas grid cells, a page of -1 is a texture of its own
+	struct CAtlasCell
+	{
+		int m_Page;
+		int m_X;
+		int m_Y;
+		int m_Size; // memory of the texture for ones of their own
+	};
+
 	struct CSkinPart
 	{
 		int m_Flags;
 		char m_aName[MAX_SKIN_ARRAY_SIZE];
-		IGraphics::CTextureHandle m_OrgTexture;
-		IGraphics::CTextureHandle m_ColorTexture;
+		CSubTexture m_OrgTexture;
+		CSubTexture m_ColorTexture;
 		vec3 m_BloodColor;
 
+		// the textures are loaded on first use, see GetOrgTexture and GetColorTexture
+		int m_Type;
+		int m_DirType;
+		char m_aFilename[IO_MAX_PATH_LENGTH];
+		int m_State;
+		int64 m_LastUse;
+		CAtlasCell m_aCells[2]; // original and colorless
+
 		bool operator<(const CSkinPart &Other) { return str_comp_nocase(m_aName, Other.m_aName) < 0; }
 	};
 
@@ -56,7 +82,10 @@ public:
 	IGraphics::CTextureHandle m_BotTexture;
 
 	int GetInitAmount() const;
+	void OnLoad();
 	void OnInit();
+	void OnShutdown();
+	void OnRender();
 
 	void AddSkin(const char *pSkinName);
 	void RemoveSkin(const CSkin *pSkin);
@@ -67,6 +96,14 @@ public:
 	int Find(const char *pName, bool AllowSpecialSkin);
 	const CSkinPart *GetSkinPart(int Part, int Index);
 	int FindSkinPart(int Part, const char *pName, bool AllowSpecialPart);
+
+	// load the part on first use and return the standard part until it is ready
+	const CSubTexture &GetOrgTexture(const CSkinPart *pPart);
+	const CSubTexture &GetColorTexture(const CSkinPart *pPart);
+	// keeps a part that is shown from being unloaded
+	void MarkUsed(const CSkinPart *pPart);
+	// changes when part textures got loaded or unloaded
+	int Generation() const { return m_Generation; }
 	void RandomizeSkin();
 
 	vec3 GetColorV3(int v) const;
@@ -79,10 +116,68 @@ public:
 	void SaveSkinfile(const char *pSaveSkinName);
 
 private:
+	enum
+	{
+		ATLAS_SIZE=2048,
+		ATLAS_CELL_SIZE=32,
+		ATLAS_GRID=ATLAS_SIZE/ATLAS_CELL_SIZE,
+		ATLAS_MEMORY=ATLAS_SIZE*ATLAS_SIZE*4/3*4, // with mipmaps
+
+		PART_UNLOAD_TIME=30, // seconds a part has to be unused before it gets unloaded
+	};
+
+	struct CAtlasPage
+	{
+		IGraphics::CTextureHandle m_Texture;
+		unsigned char m_aUsed[ATLAS_GRID*ATLAS_GRID];
+	};
+
+	// a part decoded on the job pool
+	struct CLoadedPart
+	{
+		int m_Part;
+		int m_DirType;
+		char m_aName[IO_MAX_PATH_LENGTH];
+		bool m_Decode;
+		CImageInfo m_Image; // no data if it failed to load
+		unsigned char *m_pGrayData;
+		vec3 m_BloodColor;
+	};
+
+	struct CPartLoad
+	{
+		CJob m_Job;
+		IGraphics *m_pGraphics;
+		CSkinPart *m_pPart;
+		CLoadedPart m_Loaded;
+	};
+
 	int m_ScanningPart;
 	sorted_array<CSkinPart> m_aaSkinParts[NUM_SKINPARTS];
 	sorted_array<CSkin> m_aSkins;
 	CSkin m_DummySkin;
+	array<CLoadedPart> m_aLoadedParts;
+	CImageInfo m_XmasHatImage;
+	CImageInfo m_BotImage;
+
+	array<CAtlasPage *> m_apAtlasPages;
+	int m_SeparateMemory;
+	array<CPartLoad *> m_apPartLoads;
+	CJobGroup m_PartLoadGroup;
+	int m_Generation;
+	int64 m_FrameTime;
+
+	static void DecodeSkinPart(IGraphics *pGraphics, CLoadedPart *pLoaded);
+	static void DecodeSkinParts(int Begin, int End, void *pUser);
+	static int PartLoadJob(void *pData);
+
+	int64 MemoryUsage() const { return (int64)m_apAtlasPages.size()*ATLAS_MEMORY + m_SeparateMemory; }
+	const CSkinPart *UsePart(const CSkinPart *pPart);
+	bool AllocCell(int Size, CAtlasCell *pCell);
+	void FreeCell(const CAtlasCell *pCell);
+	bool UnloadIdlePart();
+	void UnloadPart(CSkinPart *pPart);
+	void UploadPart(CSkinPart *pPart, CLoadedPart *pLoaded);
 
 	static int SkinPartScan(const char *pName, int IsDir, int DirType, void *pUser);
 	static int SkinScan(const char *pName, int IsDir, int DirType, void *pUser);
@@ -16,21 +16,29 @@ struct CUserData
 	bool m_Render;
 } g_UserData;
 
-static int LoadSoundsThread(void *pUser)
+static void LoadSoundsRange(int Begin, int End, void *pUser)
 {
 	CUserData *pData = static_cast<CUserData *>(pUser);
 
-	for(int s = 0; s < g_pData->m_NumSounds; s++)
+	for(int s = Begin; s < End; s++)
 	{
 		for(int i = 0; i < g_pData->m_aSounds[s].m_NumSounds; i++)
 		{
 			ISound::CSampleHandle Id = pData->m_pGameClient->Sound()->LoadWV(g_pData->m_aSounds[s].m_aSounds[i].m_pFilename);
 			g_pData->m_aSounds[s].m_aSounds[i].m_Id = Id;
 		}
-
-		if(pData->m_Render)
-			pData->m_pGameClient->m_pMenus->RenderLoading(1);
 	}
+}
+
+static int LoadSoundsThread(void *pUser)
+{
+	CUserData *pData = static_cast<CUserData *>(pUser);
+
+	// the sets are decoded in parallel, rendering has to stay on this thread
+	pData->m_pGameClient->Engine()->JobPool()->ParallelFor(0, g_pData->m_NumSounds, 1, LoadSoundsRange, pData);
+
+	if(pData->m_Render)
+		pData->m_pGameClient->m_pMenus->RenderLoading(g_pData->m_NumSounds);
 
 	return 0;
 }
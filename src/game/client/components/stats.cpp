@@ -76,6 +76,8 @@ void CStats::ConKeyStats(IConsole::IResult *pResult, void *pUserData)
 void CStats::OnConsoleInit()
 {
 	Console()->Register("+stats", "", CFGFLAG_CLIENT, ConKeyStats, this, "Show stats");
+
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_KILLMSG, this);
 }
 
 void CStats::OnMessage(int MsgType, void *pRawMsg)
@@ -176,6 +176,12 @@ void CVoting::OnStateChange(int NewState, int OldState)
 void CVoting::OnConsoleInit()
 {
 	Console()->Register("vote", "r['yes'|'no']", CFGFLAG_CLIENT, ConVote, this, "Vote yes/no");
+
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_VOTECLEAROPTIONS, this);
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_VOTEOPTIONADD, this);
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_VOTEOPTIONREMOVE, this);
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_VOTESET, this);
+	m_pClient->SubscribeMessage(NETMSGTYPE_SV_VOTESTATUS, this);
 }
 
 void CVoting::OnMessage(int MsgType, void *pRawMsg)
@@ -12,6 +12,8 @@
 #include <engine/serverbrowser.h>
 #include <engine/shared/demo.h>
 #include <engine/shared/config.h>
+#include <engine/shared/memheap.h>
+#include <engine/shared/snapshot.h>
 
 #include <generated/protocol.h>
 #include <generated/client_data.h>
@@ -123,7 +125,18 @@ static CMapLayers gs_MapLayersBackGround(CMapLayers::TYPE_BACKGROUND);
 static CMapLayers gs_MapLayersForeGround(CMapLayers::TYPE_FOREGROUND);
 
 CGameClient::CStack::CStack() { m_Num = 0; }
-void CGameClient::CStack::Add(class CComponent *pComponent) { m_paComponents[m_Num++] = pComponent; }
+void CGameClient::CStack::Add(class CComponent *pComponent, const char *pName)
+{
+	m_apNames[m_Num] = pName;
+	m_paComponents[m_Num++] = pComponent;
+}
+
+void CGameClient::SubscribeMessage(int MsgID, CComponent *pComponent)
+{
+	dbg_assert(MsgID >= 0 && MsgID < NUM_NETMSGTYPES, "invalid message type");
+	dbg_assert(m_aNumMessageSubscribers[MsgID] < MAX_MESSAGE_SUBSCRIBERS, "too many subscribers for message type");
+	m_aapMessageSubscribers[MsgID][m_aNumMessageSubscribers[MsgID]++] = pComponent;
+}
 
 const char *CGameClient::Version() const { return GAME_VERSION; }
 const char *CGameClient::NetVersion() const { return GAME_NETVERSION; }
@@ -256,41 +269,57 @@ void CGameClient::OnConsoleInit()
 	m_pStats = &::gs_Stats;
 
 	// make a list of all the systems, make sure to add them in the corrent render order
-	m_All.Add(m_pSkins);
+	m_All.Add(m_pSkins, "skins");
 	m_All.Add(m_pCountryFlags);
 	m_All.Add(m_pMapimages);
-	m_All.Add(m_pEffects); // doesn't render anything, just updates effects
-	m_All.Add(m_pParticles); // doesn't render anything, just updates all the particles
+	m_All.Add(m_pEffects, "effects"); // doesn't render anything, just updates effects
+	m_All.Add(m_pParticles, "particles"); // doesn't render anything, just updates all the particles
 	m_All.Add(m_pBinds);
 	m_All.Add(&m_pBinds->m_SpecialBinds);
-	m_All.Add(m_pControls);
-	m_All.Add(m_pCamera);
-	m_All.Add(m_pSounds);
+	m_All.Add(m_pControls, "controls");
+	m_All.Add(m_pCamera, "camera");
+	m_All.Add(m_pSounds, "sounds");
 	m_All.Add(m_pVoting);
 
-	m_All.Add(&gs_MapLayersBackGround); // first to render
-	m_All.Add(&m_pParticles->m_RenderTrail);
-	m_All.Add(m_pItems);
-	m_All.Add(&gs_Players);
-	m_All.Add(&gs_MapLayersForeGround);
-	m_All.Add(&m_pParticles->m_RenderExplosions);
-	m_All.Add(&gs_NamePlates);
-	m_All.Add(&m_pParticles->m_RenderGeneral);
-	m_All.Add(m_pDamageind);
-	m_All.Add(&gs_Hud);
-	m_All.Add(&gs_Spectator);
-	m_All.Add(&gs_Emoticon);
-	m_All.Add(&gs_InfoMessages);
-	m_All.Add(m_pChat);
-	m_All.Add(&gs_Broadcast);
-	m_All.Add(&gs_DebugHud);
-	m_All.Add(&gs_Notifications);
-	m_All.Add(&gs_Scoreboard);
-	m_All.Add(m_pStats);
-	m_All.Add(m_pMotd);
-	m_All.Add(m_pMenus);
+	m_All.Add(&gs_MapLayersBackGround, "map background"); // first to render
+	m_All.Add(&m_pParticles->m_RenderTrail, "trails");
+	m_All.Add(m_pItems, "items");
+	m_All.Add(&gs_Players, "players");
+	m_All.Add(&gs_MapLayersForeGround, "map foreground");
+	m_All.Add(&m_pParticles->m_RenderExplosions, "explosions");
+	m_All.Add(&gs_NamePlates, "nameplates");
+	m_All.Add(&m_pParticles->m_RenderGeneral, "general particles");
+	m_All.Add(m_pDamageind, "damage indicators");
+	m_All.Add(&gs_Hud, "hud");
+	m_All.Add(&gs_Spectator, "spectator");
+	m_All.Add(&gs_Emoticon, "emoticon");
+	m_All.Add(&gs_InfoMessages, "info messages");
+	m_All.Add(m_pChat, "chat");
+	m_All.Add(&gs_Broadcast, "broadcast");
+	m_All.Add(&gs_DebugHud, "debug hud");
+	m_All.Add(&gs_Notifications, "notifications");
+	m_All.Add(&gs_Scoreboard, "scoreboard");
+	m_All.Add(m_pStats, "stats");
+	m_All.Add(m_pMotd, "motd");
+	m_All.Add(m_pMenus, "menus");
 	m_All.Add(&m_pMenus->m_Binder);
-	m_All.Add(m_pGameConsole);
+	m_All.Add(m_pGameConsole, "console");
+
+	int GpuGroup = IGraphics::GPU_GROUP_OTHER;
+	for(int i = 0; i < m_All.m_Num; i++)
+	{
+		m_aRenderPhases[i] = m_All.m_apNames[i] ? m_RenderProfiler.AddPhase(m_All.m_apNames[i]) : -1;
+
+		// everything from the hud on is drawn over the world
+		if(m_All.m_paComponents[i] == &gs_Hud)
+			GpuGroup = IGraphics::GPU_GROUP_HUD;
+		if(m_All.m_paComponents[i] == &gs_MapLayersBackGround || m_All.m_paComponents[i] == &gs_MapLayersForeGround)
+			m_aGpuGroups[i] = IGraphics::GPU_GROUP_MAP;
+		else if(m_All.m_paComponents[i] == &gs_Players)
+			m_aGpuGroups[i] = IGraphics::GPU_GROUP_PLAYERS;
+		else
+			m_aGpuGroups[i] = GpuGroup;
+	}
 
 	// build the input stack
 	m_Input.Add(&m_pMenus->m_Binder); // this will take over all input when we want to bind a key
@@ -337,7 +366,8 @@ void CGameClient::OnConsoleInit()
 	for(int i = 0; i < m_All.m_Num; i++)
 		m_All.m_paComponents[i]->m_pClient = this;
 
-	// let all the other components register their console commands
+	// let all the other components register their console commands and messages
+	mem_zero(m_aNumMessageSubscribers, sizeof(m_aNumMessageSubscribers));
 	for(int i = 0; i < m_All.m_Num; i++)
 		m_All.m_paComponents[i]->OnConsoleInit();
 
@@ -345,6 +375,12 @@ void CGameClient::OnConsoleInit()
 	m_SuppressEvents = false;
 }
 
+static int LoadComponentJob(void *pUser)
+{
+	static_cast<CComponent *>(pUser)->OnLoad();
+	return 0;
+}
+
 void CGameClient::OnInit()
 {
 	m_pGraphics = Kernel()->RequestInterface<IGraphics>();
@@ -368,6 +404,11 @@ void CGameClient::OnInit()
 	static const int OLD_NUM_NETOBJTYPES = 23;
 	for(int i = 0; i < OLD_NUM_NETOBJTYPES; i++)
 		Client()->SnapSetStaticsize(i, m_NetObjHandler.GetObjSize(i));
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+	{
+		unsigned char aBits[CSnapshotDelta::MAX_FIELDS];
+		Client()->SnapSetFieldBits(i, aBits, CNetObjHandler::GetObjFieldBits(i, aBits, CSnapshotDelta::MAX_FIELDS));
+	}
 
 	// determine total work for loading all components
 	int TotalWorkAmount = g_pData->m_NumImages + 4 + 1 + 1 + 2; // +4=load init, +1=font, +1=localization, +2=editor
@@ -377,17 +418,39 @@ void CGameClient::OnInit()
 	m_pMenus->InitLoading(TotalWorkAmount);
 	m_pMenus->RenderLoading(4);
 
+	// decode the component files in the background while the fonts load
+	CJobGroup LoadGroup;
+	CJob *pLoadJobs = new CJob[m_All.m_Num];
+	for(int i = 0; i < m_All.m_Num; i++)
+		Engine()->JobPool()->Add(&pLoadJobs[i], LoadComponentJob, m_All.m_paComponents[i], CJobPool::PRIORITY_NORMAL, &LoadGroup);
+
 	m_pTextRender->LoadFonts(Storage(), Console());
 	m_pTextRender->SetFontLanguageVariant(Config()->m_ClLanguagefile);
+	{
+		// rasterize the common characters in the background while loading
+		static const float s_aPrewarmSizes[] = {10.0f, 12.0f, 14.0f};
+		char aCharset[128];
+		int Length = 0;
+		for(int Chr = 0x20; Chr < 0x7f; Chr++)
+			aCharset[Length++] = Chr;
+		aCharset[Length] = 0;
+		const CUIRect *pScreen = UI()->Screen();
+		Graphics()->MapScreen(pScreen->x, pScreen->y, pScreen->w, pScreen->h);
+		for(unsigned i = 0; i < sizeof(s_aPrewarmSizes)/sizeof(s_aPrewarmSizes[0]); i++)
+			m_pTextRender->PrewarmGlyphs(aCharset, s_aPrewarmSizes[i]);
+	}
 	m_pMenus->RenderLoading(1);
 
 	// set the language
 	g_Localization.Load(Config()->m_ClLanguagefile, Storage(), Console());
 	m_pMenus->RenderLoading(1);
 
-	// init all components
+	// init all components, the uploads stay on this thread
+	Engine()->JobPool()->Wait(&LoadGroup);
+	delete[] pLoadJobs;
 	for(int i = m_All.m_Num-1; i >= 0; --i)
 		m_All.m_paComponents[i]->OnInit(); // this will call RenderLoading again
+	m_SkinGeneration = m_pSkins->Generation();
 
 	// load textures
 	for(int i = 0; i < g_pData->m_NumImages; i++)
@@ -415,7 +478,7 @@ void CGameClient::OnInit()
 	Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "gameclient", aBuf);
 }
 
-void CGameClient::OnUpdate()
+void CGameClient::UpdateCursor()
 {
 	// handle mouse and joystick movement, prefer mouse movement
 	float x = 0.0f, y = 0.0f;
@@ -428,6 +491,11 @@ void CGameClient::OnUpdate()
 				break;
 		}
 	}
+}
+
+void CGameClient::OnUpdate()
+{
+	UpdateCursor();
 
 	// handle key presses
 	for(int i = 0; i < Input()->NumEvents(); i++)
@@ -446,6 +514,12 @@ void CGameClient::OnUpdate()
 
 int CGameClient::OnSnapInput(int *pData)
 {
+	// aim with the motion up to now instead of the one at the start of the frame
+	if(Config()->m_InpAimOnSend)
+	{
+		Input()->UpdateMotion();
+		UpdateCursor();
+	}
 	return m_pControls->SnapInput(pData);
 }
 
@@ -472,6 +546,7 @@ void CGameClient::OnReset()
 	{
 		// clear out the invalid pointers
 		m_LastNewPredictedTick = -1;
+		m_PredictionCacheStart = -1;
 		mem_zero(&m_Snap, sizeof(m_Snap));
 
 		for(int ClientID = 0; ClientID < MAX_CLIENTS; ClientID++)
@@ -495,6 +570,7 @@ void CGameClient::OnReset()
 		m_LastGameStartTick = -1;
 		m_LastFlagCarrierRed = FLAG_MISSING;
 		m_LastFlagCarrierBlue = FLAG_MISSING;
+		m_DemoRecItemsChanged = true;
 	}
 }
 
@@ -604,16 +680,43 @@ void CGameClient::OnRender()
 	// update the local character and spectate position
 	UpdatePositions();
 
+	// refresh skin textures that were (un)loaded since the last frame
+	UpdateSkinParts();
+
 	StartRendering();
 
 	// render all systems
+	m_RenderProfiler.SetEnabled(Config()->m_DbgProfileHud);
+	if(m_RenderProfiler.IsEnabled())
+		m_RenderProfiler.Update(time_get());
+	Graphics()->SetGpuTimers(Config()->m_DbgProfileHud);
 	for(int i = 0; i < m_All.m_Num; i++)
+	{
+		CProfileScope RenderScope(&m_RenderProfiler, m_aRenderPhases[i]);
+		Graphics()->GpuTimerGroup(m_aGpuGroups[i]);
 		m_All.m_paComponents[i]->OnRender();
+	}
+	Graphics()->GpuTimerGroup(IGraphics::GPU_GROUP_OTHER);
 
 	// clear all events/input for this frame
 	Input()->Clear();
 }
 
+void CGameClient::UpdateSkinParts()
+{
+	bool Changed = m_pSkins->Generation() != m_SkinGeneration;
+	m_SkinGeneration = m_pSkins->Generation();
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(!m_aClients[i].m_Active)
+			continue;
+		if(Changed)
+			m_aClients[i].UpdateRenderInfo(this, i, true);
+		for(int p = 0; p < NUM_SKINPARTS; p++)
+			m_pSkins->MarkUsed(m_pSkins->GetSkinPart(p, m_aClients[i].m_SkinPartIDs[p]));
+	}
+}
+
 void CGameClient::OnRelease()
 {
 	// release all systems
@@ -643,6 +746,7 @@ void CGameClient::OnMessage(int MsgId, CUnpacker *pUnpacker)
 
 		// apply new tuning
 		m_Tuning = NewTuning;
+		m_DemoRecItemsChanged = true;
 		return;
 	}
 	else if(MsgId == NETMSGTYPE_SV_VOTEOPTIONLISTADD)
@@ -802,9 +906,13 @@ void CGameClient::OnMessage(int MsgId, CUnpacker *pUnpacker)
 		return;
 	}
 
-	// TODO: this should be done smarter
-	for(int i = 0; i < m_All.m_Num; i++)
-		m_All.m_paComponents[i]->OnMessage(MsgId, pRawMsg);
+	for(int i = 0; i < m_aNumMessageSubscribers[MsgId]; i++)
+		m_aapMessageSubscribers[MsgId][i]->OnMessage(MsgId, pRawMsg);
+
+	// the demo items are rebuilt when the messages they come from arrive
+	if(MsgId == NETMSGTYPE_SV_CLIENTINFO || MsgId == NETMSGTYPE_SV_CLIENTDROP || MsgId == NETMSGTYPE_SV_SKINCHANGE ||
+		MsgId == NETMSGTYPE_SV_GAMEINFO || MsgId == NETMSGTYPE_SV_TEAM)
+		m_DemoRecItemsChanged = true;
 
 	if(MsgId == NETMSGTYPE_SV_CLIENTINFO && Client()->State() != IClient::STATE_DEMOPLAYBACK)
 	{
@@ -1129,28 +1237,85 @@ bool CompareTime(const CNetObj_PlayerInfo *Pl1, const CNetObj_PlayerInfo *Pl2)
 	return Pl1->m_Score > Pl2->m_Score;
 }
 
+void CGameClient::BuildItemViews()
+{
+	int aTypes[MAX_ITEM_VIEWS];
+	CSnapState::CItemView aViews[MAX_ITEM_VIEWS];
+	int NumViews = 0;
+
+	int Num = Client()->SnapNumItems(IClient::SNAP_CURRENT);
+	for(int i = 0; i < Num && NumViews < MAX_ITEM_VIEWS; i++)
+	{
+		IClient::CSnapItem Item;
+		const void *pData = Client()->SnapGetItem(IClient::SNAP_CURRENT, i, &Item);
+
+		int Type;
+		if(Item.m_Type == NETOBJTYPE_PROJECTILE)
+			Type = ITEMVIEW_PROJECTILE;
+		else if(Item.m_Type == NETOBJTYPE_PICKUP)
+			Type = ITEMVIEW_PICKUP;
+		else if(Item.m_Type == NETOBJTYPE_LASER)
+			Type = ITEMVIEW_LASER;
+		else if(Item.m_Type == NETOBJTYPE_FLAG)
+			Type = ITEMVIEW_FLAG;
+		else
+			continue;
+
+		const void *pPrev = 0;
+		if(Type == ITEMVIEW_PICKUP || Type == ITEMVIEW_FLAG)
+		{
+			// these interpolate, skip them until they were in the previous snapshot too
+			pPrev = Client()->SnapFindItem(IClient::SNAP_PREV, Item.m_Type, Item.m_ID);
+			if(!pPrev)
+				continue;
+		}
+
+		aTypes[NumViews] = Type;
+		aViews[NumViews].m_ID = Item.m_ID;
+		aViews[NumViews].m_pPrev = pPrev;
+		aViews[NumViews].m_pCur = pData;
+		NumViews++;
+	}
+
+	// counting sort by type, keeping the snapshot order inside each type
+	for(int i = 0; i < NumViews; i++)
+		m_Snap.m_aItemViewNum[aTypes[i]]++;
+	for(int t = 1; t < NUM_ITEMVIEWS; t++)
+		m_Snap.m_aItemViewStart[t] = m_Snap.m_aItemViewStart[t-1] + m_Snap.m_aItemViewNum[t-1];
+
+	int aNext[NUM_ITEMVIEWS];
+	mem_copy(aNext, m_Snap.m_aItemViewStart, sizeof(aNext));
+	for(int i = 0; i < NumViews; i++)
+		m_Snap.m_aItemViews[aNext[aTypes[i]]++] = aViews[i];
+
+	if(m_Snap.m_pGameDataFlag)
+		m_Snap.m_pPrevGameDataFlag = (const CNetObj_GameDataFlag *)Client()->SnapFindItem(IClient::SNAP_PREV, NETOBJTYPE_GAMEDATAFLAG, m_Snap.m_GameDataFlagSnapID);
+}
+
 void CGameClient::OnNewSnapshot()
 {
 	// clear out the invalid pointers
 	mem_zero(&m_Snap, sizeof(m_Snap));
 
 	// secure snapshot
+	if(const CSnapshot *pSnap = Client()->SnapGetSnapshot(IClient::SNAP_CURRENT))
 	{
-		int Num = Client()->SnapNumItems(IClient::SNAP_CURRENT);
-		for(int Index = 0; Index < Num; Index++)
+		CScratch Scratch;
+		int *pInvalid = (int *)Scratch.Allocate(pSnap->NumItems()*sizeof(int));
+		int NumInvalid = m_NetObjHandler.ValidateSnap(pSnap, pInvalid);
+		for(int i = 0; i < NumInvalid; i++)
 		{
-			IClient::CSnapItem Item;
-			const void *pData = Client()->SnapGetItem(IClient::SNAP_CURRENT, Index, &Item);
-			if(m_NetObjHandler.ValidateObj(Item.m_Type, pData, Item.m_DataSize) != 0)
+			int Index = pInvalid[i];
+			if(Config()->m_Debug)
 			{
-				if(Config()->m_Debug)
-				{
-					char aBuf[256];
-					str_format(aBuf, sizeof(aBuf), "invalidated index=%d type=%d (%s) size=%d id=%d", Index, Item.m_Type, m_NetObjHandler.GetObjName(Item.m_Type), Item.m_DataSize, Item.m_ID);
-					Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
-				}
-				Client()->SnapInvalidateItem(IClient::SNAP_CURRENT, Index);
+				IClient::CSnapItem Item;
+				const void *pData = Client()->SnapGetItem(IClient::SNAP_CURRENT, Index, &Item);
+				m_NetObjHandler.ValidateObj(Item.m_Type, pData, Item.m_DataSize);
+				char aBuf[256];
+				str_format(aBuf, sizeof(aBuf), "invalidated index=%d type=%d (%s) size=%d id=%d failed on '%s'", Index, Item.m_Type, m_NetObjHandler.GetObjName(Item.m_Type), Item.m_DataSize, Item.m_ID, m_NetObjHandler.FailedObjOn());
+				Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
 			}
+			Client()->SnapInvalidateItem(IClient::SNAP_CURRENT, Index);
 		}
 	}
 
@@ -1376,6 +1541,8 @@ void CGameClient::OnNewSnapshot()
 		}
 	}
 
+	BuildItemViews();
+
 	// setup local pointers
 	if(m_LocalClientID >= 0)
 	{
@@ -1472,8 +1639,12 @@ void CGameClient::OnNewSnapshot()
 		m_ServerMode = SERVERMODE_PUREMOD;
 }
 
-void CGameClient::OnDemoRecSnap()
+void CGameClient::OnDemoRecSnap(bool Full)
 {
+	if(!Full && !m_DemoRecItemsChanged)
+		return;
+	m_DemoRecItemsChanged = false;
+
 	// add client info
 	for(int i = 0; i < MAX_CLIENTS; ++i)
 	{
@@ -1543,6 +1714,7 @@ void CGameClient::OnPredict()
 			m_aClients[i].m_Predicted.Read(&m_Snap.m_aCharacters[i].m_Cur);
 		}
 
+		m_PredictionCacheStart = -1;
 		return;
 	}
 
@@ -1550,22 +1722,41 @@ void CGameClient::OnPredict()
 	CWorldCore World;
 	World.m_Tuning = m_Tuning;
 
+	// continue the last prediction if the snapshot confirms it and the
+	// inputs since are unchanged, otherwise start over from the snapshot
+	int GameTick = Client()->GameTick();
+	int PredTick = Client()->PredGameTick();
+	bool Resume = CanResumePrediction(GameTick, PredTick);
+	if(!Resume)
+	{
+		m_PredictionCacheStart = GameTick;
+		m_PredictionLocalID = m_LocalClientID;
+		m_PredictionTuning = m_Tuning;
+	}
+
 	// search for players
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
+		m_aPredictionActive[i] = m_Snap.m_aCharacters[i].m_Active;
 		if(!m_Snap.m_aCharacters[i].m_Active)
 			continue;
 
 		m_aClients[i].m_Predicted.Init(&World, Collision());
 		World.m_apCharacters[i] = &m_aClients[i].m_Predicted;
-		m_aClients[i].m_Predicted.Read(&m_Snap.m_aCharacters[i].m_Cur);
+		if(!Resume)
+			m_aClients[i].m_Predicted.Read(&m_Snap.m_aCharacters[i].m_Cur);
 	}
 
+	if(!Resume)
+		CachePrediction(GameTick, &World, 0);
+
 	// predict
-	for(int Tick = Client()->GameTick() + 1;
-		Tick <= Client()->PredGameTick();
+	for(int Tick = (Resume ? m_PredictedTick : GameTick) + 1;
+		Tick <= PredTick;
 		Tick++)
 	{
+		const int *pInput = Client()->GetInput(Tick);
+
 		// first calculate where everyone should move
 		for(int c = 0; c < MAX_CLIENTS; c++)
 		{
@@ -1575,7 +1766,7 @@ void CGameClient::OnPredict()
 			// Before running the last iteration, store our predictions. We use
 			// `Prev` because we haven't run the last iteration yet, so our
 			// data is from the previous tick.
-			if(Tick == Client()->PredGameTick())
+			if(Tick == PredTick)
 				m_aClients[c].m_PrevPredicted = *World.m_apCharacters[c];
 
 			mem_zero(&World.m_apCharacters[c]->m_Input, sizeof(World.m_apCharacters[c]->m_Input));
@@ -1583,7 +1774,6 @@ void CGameClient::OnPredict()
 			if(m_LocalClientID == c)
 			{
 				// apply player input
-				const int *pInput = Client()->GetInput(Tick);
 				if(pInput)
 					World.m_apCharacters[c]->m_Input = *((const CNetObj_PlayerInput*)pInput);
 
@@ -1608,6 +1798,8 @@ void CGameClient::OnPredict()
 			World.m_apCharacters[c]->Quantize();
 		}
 
+		CachePrediction(Tick, &World, pInput);
+
 		// check if we want to trigger effects
 		if(Tick > m_LastNewPredictedTick)
 		{
@@ -1629,7 +1821,51 @@ void CGameClient::OnPredict()
 		}
 	}
 
-	m_PredictedTick = Client()->PredGameTick();
+	m_PredictedTick = PredTick;
+}
+
+bool CGameClient::CanResumePrediction(int GameTick, int PredTick) const
+{
+	if(m_PredictionCacheStart < 0 || m_PredictionLocalID != m_LocalClientID ||
+		GameTick < m_PredictionCacheStart || GameTick > m_PredictedTick ||
+		GameTick <= m_PredictedTick-PREDICTION_CACHE_SIZE || PredTick < m_PredictedTick ||
+		mem_comp(&m_PredictionTuning, &m_Tuning, sizeof(CTuningParams)) != 0)
+		return false;
+
+	// the snapshot has to match what was predicted for its tick
+	const CPredictionTick *pConfirmed = &m_aPredictionCache[GameTick%PREDICTION_CACHE_SIZE];
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(m_aPredictionActive[i] != m_Snap.m_aCharacters[i].m_Active)
+			return false;
+		if(m_Snap.m_aCharacters[i].m_Active &&
+			mem_comp(&pConfirmed->m_aCores[i], static_cast<const CNetObj_CharacterCore *>(&m_Snap.m_aCharacters[i].m_Cur), sizeof(CNetObj_CharacterCore)) != 0)
+			return false;
+	}
+
+	// and the ticks after it have to get the same inputs again
+	for(int Tick = GameTick+1; Tick <= m_PredictedTick; Tick++)
+	{
+		const CPredictionTick *pCached = &m_aPredictionCache[Tick%PREDICTION_CACHE_SIZE];
+		const int *pInput = Client()->GetInput(Tick);
+		if((pInput != 0) != pCached->m_HasInput ||
+			(pInput && mem_comp(pInput, &pCached->m_Input, sizeof(CNetObj_PlayerInput)) != 0))
+			return false;
+	}
+	return true;
+}
+
+void CGameClient::CachePrediction(int Tick, const CWorldCore *pWorld, const int *pInput)
+{
+	CPredictionTick *pCached = &m_aPredictionCache[Tick%PREDICTION_CACHE_SIZE];
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(pWorld->m_apCharacters[i])
+			pWorld->m_apCharacters[i]->Write(&pCached->m_aCores[i]);
+	}
+	pCached->m_HasInput = pInput != 0;
+	if(pInput)
+		mem_copy(&pCached->m_Input, pInput, sizeof(pCached->m_Input));
 }
 
 
@@ -1772,12 +2008,12 @@ void CGameClient::CClientData::UpdateRenderInfo(CGameClient *pGameClient, int Cl
 			const CSkins::CSkinPart *pSkinPart = pGameClient->m_pSkins->GetSkinPart(p, m_SkinPartIDs[p]);
 			if(m_aUseCustomColors[p])
 			{
-				m_SkinInfo.m_aTextures[p] = pSkinPart->m_ColorTexture;
+				m_SkinInfo.m_aTextures[p] = pGameClient->m_pSkins->GetColorTexture(pSkinPart);
 				m_SkinInfo.m_aColors[p] = pGameClient->m_pSkins->GetColorV4(m_aSkinPartColors[p], p==SKINPART_MARKING);
 			}
 			else
 			{
-				m_SkinInfo.m_aTextures[p] = pSkinPart->m_OrgTexture;
+				m_SkinInfo.m_aTextures[p] = pGameClient->m_pSkins->GetOrgTexture(pSkinPart);
 				m_SkinInfo.m_aColors[p] = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 			}
 		}
@@ -1790,7 +2026,7 @@ void CGameClient::CClientData::UpdateRenderInfo(CGameClient *pGameClient, int Cl
 	{
 		for(int p = 0; p < NUM_SKINPARTS; p++)
 		{
-			m_RenderInfo.m_aTextures[p] = pGameClient->m_pSkins->GetSkinPart(p, m_SkinPartIDs[p])->m_ColorTexture;
+			m_RenderInfo.m_aTextures[p] = pGameClient->m_pSkins->GetColorTexture(pGameClient->m_pSkins->GetSkinPart(p, m_SkinPartIDs[p]));
 			int ColorVal = pGameClient->m_pSkins->GetTeamColor(m_aUseCustomColors[p], m_aSkinPartColors[p], m_Team, p);
 			m_RenderInfo.m_aColors[p] = pGameClient->m_pSkins->GetColorV4(ColorVal, p==SKINPART_MARKING);
 		}
@@ -1813,7 +2049,7 @@ void CGameClient::CClientData::Reset(CGameClient *pGameClient, int ClientID)
 	for(int p = 0; p < NUM_SKINPARTS; p++)
 	{
 		m_SkinPartIDs[p] = 0;
-		m_SkinInfo.m_aTextures[p] = pGameClient->m_pSkins->GetSkinPart(p, 0)->m_ColorTexture;
+		m_SkinInfo.m_aTextures[p] = pGameClient->m_pSkins->GetColorTexture(pGameClient->m_pSkins->GetSkinPart(p, 0));
 		m_SkinInfo.m_aColors[p] = vec4(1.0f, 1.0f, 1.0f , 1.0f);
 	}
 	UpdateRenderInfo(pGameClient, ClientID, false);
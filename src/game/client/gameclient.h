@@ -6,6 +6,7 @@
 #include <base/vmath.h>
 #include <engine/client.h>
 #include <engine/console.h>
+#include <engine/shared/profiler.h>
 #include <game/layers.h>
 #include <game/gamecore.h>
 #include "render.h"
@@ -21,14 +22,25 @@ class CGameClient : public IGameClient
 		};
 
 		CStack();
-		void Add(class CComponent *pComponent);
+		// components with a name get a phase in the render profiler
+		void Add(class CComponent *pComponent, const char *pName = 0);
 
 		class CComponent *m_paComponents[MAX_COMPONENTS];
+		const char *m_apNames[MAX_COMPONENTS];
 		int m_Num;
 	};
 
 	CStack m_All;
 	CStack m_Input;
+
+	enum
+	{
+		MAX_MESSAGE_SUBSCRIBERS = 4,
+	};
+
+	// components that handle each NETMSGTYPE, in m_All order
+	class CComponent *m_aapMessageSubscribers[NUM_NETMSGTYPES][MAX_MESSAGE_SUBSCRIBERS];
+	int m_aNumMessageSubscribers[NUM_NETMSGTYPES];
 	CNetObjHandler m_NetObjHandler;
 
 	class IEngine *m_pEngine;
@@ -52,16 +64,45 @@ class CGameClient : public IGameClient
 	CUI m_UI;
 
 	void ProcessEvents();
+	void BuildItemViews();
 	void ProcessTriggeredEvents(int Events, vec2 Pos);
 	void UpdatePositions();
+	void UpdateCursor();
 
 	int m_PredictedTick;
 	int m_LastNewPredictedTick;
 
+	// the predicted cores of each tick and the input they were predicted
+	// with, a snapshot that confirms them lets the prediction continue
+	// instead of starting over from it
+	enum
+	{
+		PREDICTION_CACHE_SIZE=64,
+	};
+	struct CPredictionTick
+	{
+		CNetObj_CharacterCore m_aCores[MAX_CLIENTS];
+		CNetObj_PlayerInput m_Input;
+		bool m_HasInput;
+	};
+	CPredictionTick m_aPredictionCache[PREDICTION_CACHE_SIZE];
+	int m_PredictionCacheStart; // first cached tick, -1 when there is none
+	int m_PredictionLocalID;
+	bool m_aPredictionActive[MAX_CLIENTS];
+	CTuningParams m_PredictionTuning;
+
+	bool CanResumePrediction(int GameTick, int PredTick) const;
+	void CachePrediction(int Tick, const CWorldCore *pWorld, const int *pInput);
+
 	int m_LastGameStartTick;
 	int m_LastFlagCarrierRed;
 	int m_LastFlagCarrierBlue;
 
+	bool m_DemoRecItemsChanged; // the items OnDemoRecSnap adds differ from the recorded ones
+
+	int m_SkinGeneration;
+	void UpdateSkinParts();
+
 	static void ConTeam(IConsole::IResult *pResult, void *pUserData);
 	static void ConKill(IConsole::IResult *pResult, void *pUserData);
 	static void ConReadyChange(IConsole::IResult *pResult, void *pUserData);
@@ -102,6 +143,11 @@ public:
 
 	bool m_SuppressEvents;
 
+	// OnRender times of the components, see dbg_profile_hud
+	CProfiler m_RenderProfiler;
+	int m_aRenderPhases[CStack::MAX_COMPONENTS];
+	int m_aGpuGroups[CStack::MAX_COMPONENTS];
+
 	// TODO: move this
 	CTuningParams m_Tuning;
 
@@ -146,6 +192,17 @@ public:
 		int m_ClientID;
 	};
 
+	enum
+	{
+		ITEMVIEW_PROJECTILE=0,
+		ITEMVIEW_PICKUP,
+		ITEMVIEW_LASER,
+		ITEMVIEW_FLAG,
+		NUM_ITEMVIEWS,
+
+		MAX_ITEM_VIEWS=1024, // max items in a snapshot
+	};
+
 	// snap pointers
 	struct CSnapState
 	{
@@ -158,6 +215,7 @@ public:
 		const CNetObj_GameData *m_pGameData;
 		const CNetObj_GameDataTeam *m_pGameDataTeam;
 		const CNetObj_GameDataFlag *m_pGameDataFlag;
+		const CNetObj_GameDataFlag *m_pPrevGameDataFlag;
 		const CNetObj_GameDataRace *m_pGameDataRace;
 		int m_GameDataFlagSnapID;
 
@@ -192,6 +250,18 @@ public:
 		};
 
 		CCharacterInfo m_aCharacters[MAX_CLIENTS];
+
+		// world items bucketed by type once per snapshot, see ItemViews
+		struct CItemView
+		{
+			int m_ID;
+			const void *m_pPrev; // only resolved for pickups and flags, always set for those
+			const void *m_pCur;
+		};
+
+		CItemView m_aItemViews[MAX_ITEM_VIEWS];
+		int m_aItemViewStart[NUM_ITEMVIEWS];
+		int m_aItemViewNum[NUM_ITEMVIEWS];
 	};
 
 	CSnapState m_Snap;
@@ -275,7 +345,7 @@ public:
 	virtual void OnStateChange(int NewState, int OldState);
 	virtual void OnMessage(int MsgId, CUnpacker *pUnpacker);
 	virtual void OnNewSnapshot();
-	virtual void OnDemoRecSnap();
+	virtual void OnDemoRecSnap(bool Full);
 	virtual void OnPredict();
 	virtual void OnActivateEditor();
 	virtual int OnSnapInput(int *pData);
@@ -296,6 +366,11 @@ public:
 
 	bool IsXmas() const;
 	bool IsEaster() const;
+	// world items of one ITEMVIEW_* type from the current snapshot, in snapshot order
+	const CSnapState::CItemView *ItemViews(int Type, int *pNum) const { *pNum = m_Snap.m_aItemViewNum[Type]; return &m_Snap.m_aItemViews[m_Snap.m_aItemViewStart[Type]]; }
+	// route a message type to a component's OnMessage, call from OnConsoleInit
+	void SubscribeMessage(int MsgID, class CComponent *pComponent);
+
 	int RacePrecision() const { return m_Snap.m_pGameDataRace ? m_Snap.m_pGameDataRace->m_Precision : 3; }
 	bool IsWorldPaused() const { return m_Snap.m_pGameData && (m_Snap.m_pGameData->m_GameStateFlags&(GAMESTATEFLAG_PAUSED|GAMESTATEFLAG_ROUNDOVER|GAMESTATEFLAG_GAMEOVER)); }
 	bool IsDemoPlaybackPaused() const;
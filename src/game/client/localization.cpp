@@ -2,8 +2,8 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 
 #include "localization.h"
-#include <base/tl/algorithm.h>
 
+#include <base/math.h>
 #include <engine/external/json-parser/json.h>
 #include <engine/console.h>
 #include <engine/storage.h>
@@ -37,13 +37,24 @@ CLocalizationDatabase::CLocalizationDatabase()
 	m_CurrentVersion = 0;
 }
 
+void CLocalizationDatabase::Clear()
+{
+	m_StringPool.clear();
+	m_Strings.clear();
+}
+
 void CLocalizationDatabase::AddString(const char *pOrgStr, const char *pNewStr, const char *pContext)
 {
-	CString s;
-	s.m_Hash = str_quickhash(pOrgStr);
-	s.m_ContextHash = str_quickhash(pContext);
-	s.m_Replacement = *pNewStr ? pNewStr : pOrgStr;
-	m_Strings.add(s);
+	const char *pStr = *pNewStr ? pNewStr : pOrgStr;
+	int Size = str_length(pStr)+1;
+	int Offset = m_StringPool.size();
+	if(m_StringPool.capacity() < Offset+Size)
+		m_StringPool.reserve(max(Offset+Size, m_StringPool.capacity()*2));
+	m_StringPool.set_size(Offset+Size);
+	mem_copy(m_StringPool.base_ptr()+Offset, pStr, Size);
+
+	uint64 Key = ((uint64)str_quickhash(pOrgStr)<<32)|str_quickhash(pContext);
+	m_Strings.set(Key, Offset);
 }
 
 bool CLocalizationDatabase::Load(const char *pFilename, IStorage *pStorage, IConsole *pConsole)
@@ -51,7 +62,7 @@ bool CLocalizationDatabase::Load(const char *pFilename, IStorage *pStorage, ICon
 	// empty string means unload
 	if(pFilename[0] == 0)
 	{
-		m_Strings.clear();
+		Clear();
 		m_CurrentVersion = 0;
 		return true;
 	}
@@ -69,7 +80,7 @@ bool CLocalizationDatabase::Load(const char *pFilename, IStorage *pStorage, ICon
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "loaded '%s'", pFilename);
 	pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "localization", aBuf);
-	m_Strings.clear();
+	Clear();
 
 	// parse json data
 	json_settings JsonSettings;
@@ -88,6 +99,9 @@ bool CLocalizationDatabase::Load(const char *pFilename, IStorage *pStorage, ICon
 	const json_value &rStart = (*pJsonData)["translated strings"];
 	if(rStart.type == json_array)
 	{
+		// the replacements are shorter than the file, so the pool is allocated once
+		m_StringPool.reserve(FileSize);
+		m_Strings.reserve(rStart.u.array.length);
 		for(unsigned i = 0; i < rStart.u.array.length; ++i)
 		{
 			bool Valid = true;
@@ -124,25 +138,8 @@ bool CLocalizationDatabase::Load(const char *pFilename, IStorage *pStorage, ICon
 
 const char *CLocalizationDatabase::FindString(unsigned Hash, unsigned ContextHash) const
 {
-	CString String;
-	String.m_Hash = Hash;
-	String.m_ContextHash = ContextHash;
-	sorted_array<CString>::range r = ::find_binary(m_Strings.all(), String);
-	if(r.empty())
-		return 0;
-
-	unsigned DefaultHash = str_quickhash("");
-	unsigned DefaultIndex = 0;
-	for(unsigned i = 0; i < r.size() && r.index(i).m_Hash == Hash; ++i)
-	{
-		const CString &rStr = r.index(i);
-		if(rStr.m_ContextHash == ContextHash)
-			return rStr.m_Replacement;
-		else if(rStr.m_ContextHash == DefaultHash)
-			DefaultIndex = i;
-	}
-	
-    return r.index(DefaultIndex).m_Replacement;
+	const int *pOffset = m_Strings.find(((uint64)Hash<<32)|ContextHash);
+	return pOffset ? m_StringPool.base_ptr()+*pOffset : 0;
 }
 
 CLocalizationDatabase g_Localization;
@@ -2,32 +2,23 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef GAME_LOCALIZATION_H
 #define GAME_LOCALIZATION_H
-#include <base/tl/string.h>
-#include <base/tl/sorted_array.h>
+#include <base/tl/array.h>
+#include <base/tl/hash_map.h>
 
 class CLocalizationDatabase
 {
-	class CString
-	{
-	public:
-		unsigned m_Hash;
-		unsigned m_ContextHash;
-
-		// TODO: do this as an const char * and put everything on a incremental heap
-		string m_Replacement;
-
-		bool operator <(const CString &Other) const { return m_Hash < Other.m_Hash || (m_Hash == Other.m_Hash && m_ContextHash < Other.m_ContextHash); }
-		bool operator <=(const CString &Other) const { return m_Hash < Other.m_Hash || (m_Hash == Other.m_Hash && m_ContextHash <= Other.m_ContextHash); }
-		bool operator ==(const CString &Other) const { return m_Hash == Other.m_Hash && m_ContextHash == Other.m_ContextHash; }
-	};
-
-	sorted_array<CString> m_Strings;
+	// the replacements one after another, with their terminators
+	array<char> m_StringPool;
+	// pool offsets by string hash in the upper and context hash in the lower half
+	hash_map<uint64, int> m_Strings;
 	int m_VersionCounter;
 	int m_CurrentVersion;
 
 public:
 	CLocalizationDatabase();
 
+	void Clear();
+
 	bool Load(const char *pFilename, class IStorage *pStorage, class IConsole *pConsole);
 
 	int Version() const { return m_CurrentVersion; }
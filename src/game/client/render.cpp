@@ -23,7 +23,7 @@ void CRenderTools::Init(CConfig *pConfig, IGraphics *pGraphics, CUI *pUI)
 	m_pUI = pUI;
 }
 
-void CRenderTools::SelectSprite(CDataSprite *pSpr, int Flags, int sx, int sy)
+void CRenderTools::GetSpriteTexCoords(CDataSprite *pSpr, int Flags, float *pTexCoords, int sx, int sy)
 {
 	int x = pSpr->m_X+sx;
 	int y = pSpr->m_Y+sy;
@@ -32,10 +32,6 @@ void CRenderTools::SelectSprite(CDataSprite *pSpr, int Flags, int sx, int sy)
 	int cx = pSpr->m_pSet->m_Gridx;
 	int cy = pSpr->m_pSet->m_Gridy;
 
-	float f = sqrtf(h*h + w*w);
-	gs_SpriteWScale = w/f;
-	gs_SpriteHScale = h/f;
-
 	float x1 = x/(float)cx + 0.5f/(float)(cx*32);
 	float x2 = (x+w)/(float)cx - 0.5f/(float)(cx*32);
 	float y1 = y/(float)cy + 0.5f/(float)(cy*32);
@@ -57,7 +53,30 @@ void CRenderTools::SelectSprite(CDataSprite *pSpr, int Flags, int sx, int sy)
 		x2 = Temp;
 	}
 
-	Graphics()->QuadsSetSubset(x1, y1, x2, y2);
+	pTexCoords[0] = x1;
+	pTexCoords[1] = y1;
+	pTexCoords[2] = x2;
+	pTexCoords[3] = y2;
+}
+
+void CRenderTools::GetSpriteTexCoords(int Id, int Flags, float *pTexCoords)
+{
+	if(Id < 0 || Id >= g_pData->m_NumSprites)
+		return;
+	GetSpriteTexCoords(&g_pData->m_aSprites[Id], Flags, pTexCoords);
+}
+
+void CRenderTools::SelectSprite(CDataSprite *pSpr, int Flags, int sx, int sy)
+{
+	int w = pSpr->m_W;
+	int h = pSpr->m_H;
+	float f = sqrtf(h*h + w*w);
+	gs_SpriteWScale = w/f;
+	gs_SpriteHScale = h/f;
+
+	float aTexCoords[4];
+	GetSpriteTexCoords(pSpr, Flags, aTexCoords, sx, sy);
+	Graphics()->QuadsSetSubset(aTexCoords[0], aTexCoords[1], aTexCoords[2], aTexCoords[3]);
 }
 
 void CRenderTools::SelectSprite(int Id, int Flags, int sx, int sy)
@@ -67,6 +86,25 @@ void CRenderTools::SelectSprite(int Id, int Flags, int sx, int sy)
 	SelectSprite(&g_pData->m_aSprites[Id], Flags, sx, sy);
 }
 
+void CRenderTools::SelectSprite(int Id, const CSubTexture &Texture, int Flags)
+{
+	if(Id < 0 || Id >= g_pData->m_NumSprites)
+		return;
+	CDataSprite *pSpr = &g_pData->m_aSprites[Id];
+	int w = pSpr->m_W;
+	int h = pSpr->m_H;
+	float f = sqrtf(h*h + w*w);
+	gs_SpriteWScale = w/f;
+	gs_SpriteHScale = h/f;
+
+	float aTexCoords[4];
+	GetSpriteTexCoords(pSpr, Flags, aTexCoords);
+	const float *pRect = Texture.m_aRect;
+	for(int i = 0; i < 4; i++)
+		aTexCoords[i] = pRect[i&1] + aTexCoords[i]*(pRect[2+(i&1)]-pRect[i&1]);
+	Graphics()->QuadsSetSubset(aTexCoords[0], aTexCoords[1], aTexCoords[2], aTexCoords[3]);
+}
+
 void CRenderTools::DrawSprite(float x, float y, float Size)
 {
 	IGraphics::CQuadItem QuadItem(x, y, Size*gs_SpriteWScale, Size*gs_SpriteHScale);
@@ -389,29 +427,29 @@ void CRenderTools::RenderTee(CAnimState *pAnim, const CTeeRenderInfo *pInfo, int
 				// draw decoration
 				if(pInfo->m_aTextures[SKINPART_DECORATION].IsValid())
 				{
-					Graphics()->TextureSet(pInfo->m_aTextures[2]);
+					Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_DECORATION].m_Texture);
 					Graphics()->QuadsBegin();
 					Graphics()->QuadsSetRotation(pAnim->GetBody()->m_Angle*pi*2);
 					Graphics()->SetColor(pInfo->m_aColors[SKINPART_DECORATION].r, pInfo->m_aColors[SKINPART_DECORATION].g, pInfo->m_aColors[SKINPART_DECORATION].b, pInfo->m_aColors[SKINPART_DECORATION].a);
-					SelectSprite(OutLine?SPRITE_TEE_DECORATION_OUTLINE:SPRITE_TEE_DECORATION, 0, 0, 0);
+					SelectSprite(OutLine?SPRITE_TEE_DECORATION_OUTLINE:SPRITE_TEE_DECORATION, pInfo->m_aTextures[SKINPART_DECORATION]);
 					Item = BodyItem;
 					Graphics()->QuadsDraw(&Item, 1);
 					Graphics()->QuadsEnd();
 				}
 
 				// draw body (behind marking)
-				Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_BODY]);
+				Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_BODY].m_Texture);
 				Graphics()->QuadsBegin();
 				Graphics()->QuadsSetRotation(pAnim->GetBody()->m_Angle*pi*2);
 				if(OutLine)
 				{
 					Graphics()->SetColor(1.0f, 1.0f, 1.0f, 1.0f);
-					SelectSprite(SPRITE_TEE_BODY_OUTLINE, 0, 0, 0);
+					SelectSprite(SPRITE_TEE_BODY_OUTLINE, pInfo->m_aTextures[SKINPART_BODY]);
 				}
 				else
 				{
 					Graphics()->SetColor(pInfo->m_aColors[SKINPART_BODY].r, pInfo->m_aColors[SKINPART_BODY].g, pInfo->m_aColors[SKINPART_BODY].b, pInfo->m_aColors[SKINPART_BODY].a);
-					SelectSprite(SPRITE_TEE_BODY, 0, 0, 0);
+					SelectSprite(SPRITE_TEE_BODY, pInfo->m_aTextures[SKINPART_BODY]);
 				}
 				Item = BodyItem;
 				Graphics()->QuadsDraw(&Item, 1);
@@ -420,12 +458,12 @@ void CRenderTools::RenderTee(CAnimState *pAnim, const CTeeRenderInfo *pInfo, int
 				// draw marking
 				if(pInfo->m_aTextures[SKINPART_MARKING].IsValid() && !OutLine)
 				{
-					Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_MARKING]);
+					Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_MARKING].m_Texture);
 					Graphics()->QuadsBegin();
 					Graphics()->QuadsSetRotation(pAnim->GetBody()->m_Angle*pi*2);
 					Graphics()->SetColor(pInfo->m_aColors[SKINPART_MARKING].r*pInfo->m_aColors[SKINPART_MARKING].a, pInfo->m_aColors[SKINPART_MARKING].g*pInfo->m_aColors[SKINPART_MARKING].a,
 						pInfo->m_aColors[SKINPART_MARKING].b*pInfo->m_aColors[SKINPART_MARKING].a, pInfo->m_aColors[SKINPART_MARKING].a);
-					SelectSprite(SPRITE_TEE_MARKING, 0, 0, 0);
+					SelectSprite(SPRITE_TEE_MARKING, pInfo->m_aTextures[SKINPART_MARKING]);
 					Item = BodyItem;
 					Graphics()->QuadsDraw(&Item, 1);
 					Graphics()->QuadsEnd();
@@ -434,13 +472,13 @@ void CRenderTools::RenderTee(CAnimState *pAnim, const CTeeRenderInfo *pInfo, int
 				// draw body (in front of marking)
 				if(!OutLine)
 				{
-					Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_BODY]);
+					Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_BODY].m_Texture);
 					Graphics()->QuadsBegin();
 					Graphics()->QuadsSetRotation(pAnim->GetBody()->m_Angle*pi*2);
 					Graphics()->SetColor(1.0f, 1.0f, 1.0f, 1.0f);
 					for(int t = 0; t < 2; t++)
 					{
-						SelectSprite(t==0?SPRITE_TEE_BODY_SHADOW:SPRITE_TEE_BODY_UPPER_OUTLINE, 0, 0, 0);
+						SelectSprite(t==0?SPRITE_TEE_BODY_SHADOW:SPRITE_TEE_BODY_UPPER_OUTLINE, pInfo->m_aTextures[SKINPART_BODY]);
 						Item = BodyItem;
 						Graphics()->QuadsDraw(&Item, 1);
 					}
@@ -448,7 +486,7 @@ void CRenderTools::RenderTee(CAnimState *pAnim, const CTeeRenderInfo *pInfo, int
 				}
 
 				// draw eyes
-				Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_EYES]);
+				Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_EYES].m_Texture);
 				Graphics()->QuadsBegin();
 				Graphics()->QuadsSetRotation(pAnim->GetBody()->m_Angle*pi*2);
 				if(IsBot)
@@ -463,19 +501,19 @@ void CRenderTools::RenderTee(CAnimState *pAnim, const CTeeRenderInfo *pInfo, int
 					switch (Emote)
 					{
 						case EMOTE_PAIN:
-							SelectSprite(SPRITE_TEE_EYES_PAIN, 0, 0, 0);
+							SelectSprite(SPRITE_TEE_EYES_PAIN, pInfo->m_aTextures[SKINPART_EYES]);
 							break;
 						case EMOTE_HAPPY:
-							SelectSprite(SPRITE_TEE_EYES_HAPPY, 0, 0, 0);
+							SelectSprite(SPRITE_TEE_EYES_HAPPY, pInfo->m_aTextures[SKINPART_EYES]);
 							break;
 						case EMOTE_SURPRISE:
-							SelectSprite(SPRITE_TEE_EYES_SURPRISE, 0, 0, 0);
+							SelectSprite(SPRITE_TEE_EYES_SURPRISE, pInfo->m_aTextures[SKINPART_EYES]);
 							break;
 						case EMOTE_ANGRY:
-							SelectSprite(SPRITE_TEE_EYES_ANGRY, 0, 0, 0);
+							SelectSprite(SPRITE_TEE_EYES_ANGRY, pInfo->m_aTextures[SKINPART_EYES]);
 							break;
 						default:
-							SelectSprite(SPRITE_TEE_EYES_NORMAL, 0, 0, 0);
+							SelectSprite(SPRITE_TEE_EYES_NORMAL, pInfo->m_aTextures[SKINPART_EYES]);
 							break;
 					}
 
@@ -516,7 +554,7 @@ void CRenderTools::RenderTee(CAnimState *pAnim, const CTeeRenderInfo *pInfo, int
 			}
 
 			// draw feet
-			Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_FEET]);
+			Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_FEET].m_Texture);
 			Graphics()->QuadsBegin();
 			CAnimKeyframe *pFoot = f ? pAnim->GetFrontFoot() : pAnim->GetBackFoot();
 
@@ -528,7 +566,7 @@ void CRenderTools::RenderTee(CAnimState *pAnim, const CTeeRenderInfo *pInfo, int
 			if(OutLine)
 			{
 				Graphics()->SetColor(1.0f, 1.0f, 1.0f, 1.0f);
-				SelectSprite(SPRITE_TEE_FOOT_OUTLINE, 0, 0, 0);
+				SelectSprite(SPRITE_TEE_FOOT_OUTLINE, pInfo->m_aTextures[SKINPART_FEET]);
 			}
 			else
 			{
@@ -537,7 +575,7 @@ void CRenderTools::RenderTee(CAnimState *pAnim, const CTeeRenderInfo *pInfo, int
 				if(Indicate)
 					cs = 0.5f;
 				Graphics()->SetColor(pInfo->m_aColors[SKINPART_FEET].r*cs, pInfo->m_aColors[SKINPART_FEET].g*cs, pInfo->m_aColors[SKINPART_FEET].b*cs, pInfo->m_aColors[SKINPART_FEET].a);
-				SelectSprite(SPRITE_TEE_FOOT, 0, 0, 0);
+				SelectSprite(SPRITE_TEE_FOOT, pInfo->m_aTextures[SKINPART_FEET]);
 			}
 
 			IGraphics::CQuadItem QuadItem(Position.x+pFoot->m_X*AnimScale, Position.y+pFoot->m_Y*AnimScale, w, h);
@@ -573,14 +611,14 @@ void CRenderTools::RenderTeeHand(const CTeeRenderInfo *pInfo, vec2 CenterPos, ve
 	IGraphics::CQuadItem QuadOutline(HandPos.x, HandPos.y, 2*BaseSize, 2*BaseSize);
 	IGraphics::CQuadItem QuadHand = QuadOutline;
 
-	Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_HANDS]);
+	Graphics()->TextureSet(pInfo->m_aTextures[SKINPART_HANDS].m_Texture);
 	Graphics()->QuadsBegin();
 	Graphics()->SetColor(Color.r, Color.g, Color.b, Color.a);
 	Graphics()->QuadsSetRotation(Angle);
 
-	SelectSprite(SPRITE_TEE_HAND_OUTLINE, 0, 0, 0);
+	SelectSprite(SPRITE_TEE_HAND_OUTLINE, pInfo->m_aTextures[SKINPART_HANDS]);
 	Graphics()->QuadsDraw(&QuadOutline, 1);
-	SelectSprite(SPRITE_TEE_HAND, 0, 0, 0);
+	SelectSprite(SPRITE_TEE_HAND, pInfo->m_aTextures[SKINPART_HANDS]);
 	Graphics()->QuadsDraw(&QuadHand, 1);
 
 	Graphics()->QuadsSetRotation(0);
@@ -20,6 +20,17 @@ enum
 	LAYERRENDERFLAG_TRANSPARENT = 2,
 
 	TILERENDERFLAG_EXTEND = 4,
+	TILERENDERFLAG_BORDER = 8, // only the extended tiles outside of the layer
+};
+
+// a texture and the rectangle of it that holds the image, skin parts share atlas textures
+struct CSubTexture
+{
+	IGraphics::CTextureHandle m_Texture;
+	float m_aRect[4]; // top left u, v and bottom right u, v
+
+	CSubTexture() { m_aRect[0] = m_aRect[1] = 0.0f; m_aRect[2] = m_aRect[3] = 1.0f; }
+	bool IsValid() const { return m_Texture.IsValid(); }
 };
 
 class CTeeRenderInfo
@@ -33,7 +44,7 @@ public:
 		m_GotAirJump = 1;
 	};
 
-	IGraphics::CTextureHandle m_aTextures[NUM_SKINPARTS];
+	CSubTexture m_aTextures[NUM_SKINPARTS];
 	IGraphics::CTextureHandle m_HatTexture;
 	IGraphics::CTextureHandle m_BotTexture;
 	int m_HatSpriteIndex;
@@ -46,6 +57,12 @@ public:
 typedef void (*ENVELOPE_EVAL)(float TimeOffset, int Env, float *pChannels, void *pUser);
 class CTextCursor;
 
+// the area a quad can cover, including its position envelope
+struct CQuadBounds
+{
+	float m_MinX, m_MinY, m_MaxX, m_MaxY;
+};
+
 class CRenderTools
 {
 	void DrawRoundRectExt(float x, float y, float w, float h, float r, int Corners);
@@ -64,6 +81,11 @@ public:
 
 	void SelectSprite(struct CDataSprite *pSprite, int Flags=0, int sx=0, int sy=0);
 	void SelectSprite(int id, int Flags=0, int sx=0, int sy=0);
+	// selects the sprite within the rectangle of the texture
+	void SelectSprite(int Id, const CSubTexture &Texture, int Flags=0);
+	// the subset SelectSprite would set, for IGraphics::CQuadInstance
+	void GetSpriteTexCoords(struct CDataSprite *pSprite, int Flags, float *pTexCoords, int sx=0, int sy=0);
+	void GetSpriteTexCoords(int Id, int Flags, float *pTexCoords);
 
 	void DrawSprite(float x, float y, float size);
 
@@ -80,7 +102,17 @@ public:
 
 	// map render methods (gc_render_map.cpp)
 	static void RenderEvalEnvelope(CEnvPoint *pPoints, int NumPoints, int Channels, float Time, float *pResult);
-	void RenderQuads(CQuad *pQuads, int NumQuads, int Flags, ENVELOPE_EVAL pfnEval, void *pUser);
+	// quads outside of the screen are skipped when their bounds are given
+	void RenderQuads(CQuad *pQuads, int NumQuads, int Flags, ENVELOPE_EVAL pfnEval, void *pUser, const CQuadBounds *pBounds=0);
+	// fills pOut with the quads Begin..End as RenderQuads would draw them with the given
+	// screen, safe to call from other threads if pfnEval is
+	static void RecordQuads(const CQuad *pQuads, int Begin, int End, ENVELOPE_EVAL pfnEval, void *pUser, const CQuadBounds *pBounds,
+		const float *pScreen, IGraphics::CRecordedQuad *pOut);
+	// the offsets and rotation a position envelope can reach, three channels each
+	static void EnvelopeRange(const CEnvPoint *pPoints, int NumPoints, float *pMin, float *pMax);
+	// pEnvMin and pEnvMax are the range of the quad's position envelope, 0 for none
+	static void QuadBounds(const CQuad *pQuad, const float *pEnvMin, const float *pEnvMax, CQuadBounds *pOut);
+	static void TileTexCoords(int Flags, float *pU, float *pV);
 	void RenderTilemap(CTile *pTiles, int w, int h, float Scale, vec4 Color, int RenderFlags, ENVELOPE_EVAL pfnEval, void *pUser, int ColorEnv, int ColorEnvOffset);
 
 	// helpers
@@ -147,9 +147,22 @@ void CRenderTools::RenderEvalEnvelope(CEnvPoint *pPoints, int NumPoints, int Cha
 
 	Time = fmod(Time, pPoints[NumPoints-1].m_Time/1000.0f)*1000.0f;
 
-	for(int i = 0; i < NumPoints-1; i++)
+	// the point times are sorted, find the first segment ending at or after the time
+	int Low = 0;
+	int High = NumPoints-1;
+	while(Low < High)
 	{
-		if(Time >= pPoints[i].m_Time && Time <= pPoints[i+1].m_Time)
+		int Mid = (Low+High)/2;
+		if(pPoints[Mid+1].m_Time < Time)
+			Low = Mid+1;
+		else
+			High = Mid;
+	}
+
+	if(Low < NumPoints-1)
+	{
+		int i = Low;
+		if(Time >= pPoints[i].m_Time)
 		{
 			float Delta = pPoints[i+1].m_Time-pPoints[i].m_Time;
 			float a = (Time-pPoints[i].m_Time)/Delta;
@@ -216,7 +229,7 @@ void CRenderTools::RenderEvalEnvelope(CEnvPoint *pPoints, int NumPoints, int Cha
 	return;
 }
 
-static void Rotate(CPoint *pCenter, CPoint *pPoint, float Rotation)
+static void Rotate(const CPoint *pCenter, CPoint *pPoint, float Rotation)
 {
 	int x = pPoint->x - pCenter->x;
 	int y = pPoint->y - pCenter->y;
@@ -224,13 +237,19 @@ static void Rotate(CPoint *pCenter, CPoint *pPoint, float Rotation)
 	pPoint->y = (int)(x * sinf(Rotation) + y * cosf(Rotation) + pCenter->y);
 }
 
-void CRenderTools::RenderQuads(CQuad *pQuads, int NumQuads, int RenderFlags, ENVELOPE_EVAL pfnEval, void *pUser)
+void CRenderTools::RecordQuads(const CQuad *pQuads, int Begin, int End, ENVELOPE_EVAL pfnEval, void *pUser, const CQuadBounds *pBounds,
+	const float *pScreen, IGraphics::CRecordedQuad *pOut)
 {
-	Graphics()->QuadsBegin();
 	float Conv = 1/255.0f;
-	for(int i = 0; i < NumQuads; i++)
+	for(int i = Begin; i < End; i++)
 	{
-		CQuad *q = &pQuads[i];
+		const CQuad *q = &pQuads[i];
+		IGraphics::CRecordedQuad *pQuad = &pOut[i-Begin];
+
+		pQuad->m_Draw = !pBounds || !(pBounds[i].m_MaxX < pScreen[0] || pBounds[i].m_MinX > pScreen[2] ||
+			pBounds[i].m_MaxY < pScreen[1] || pBounds[i].m_MinY > pScreen[3]);
+		if(!pQuad->m_Draw)
+			continue;
 
 		float r=1, g=1, b=1, a=1;
 
@@ -254,11 +273,10 @@ void CRenderTools::RenderQuads(CQuad *pQuads, int NumQuads, int RenderFlags, ENV
 		if(!Opaque && !(RenderFlags&LAYERRENDERFLAG_TRANSPARENT))
 			continue;
 		*/
-		vec2 aTexCoords[4];
 		for(int k = 0; k < 4; k++)
 		{
-			aTexCoords[k].x = fx2f(q->m_aTexcoords[k].x);
-			aTexCoords[k].y = fx2f(q->m_aTexcoords[k].y);
+			pQuad->m_aTexCoords[k*2] = fx2f(q->m_aTexcoords[k].x);
+			pQuad->m_aTexCoords[k*2+1] = fx2f(q->m_aTexcoords[k].y);
 		}
 
 		// Check if we want to repeat the texture
@@ -266,20 +284,13 @@ void CRenderTools::RenderQuads(CQuad *pQuads, int NumQuads, int RenderFlags, ENV
 		bool RepeatU = false, RepeatV = false;
 		for(int k = 0; k < 4; k++)
 		{
-			if(aTexCoords[k].x < 0.0f || aTexCoords[k].x > 1.0f)
+			if(pQuad->m_aTexCoords[k*2] < 0.0f || pQuad->m_aTexCoords[k*2] > 1.0f)
 				RepeatU = true;
-			if(aTexCoords[k].y < 0.0f || aTexCoords[k].y > 1.0f)
+			if(pQuad->m_aTexCoords[k*2+1] < 0.0f || pQuad->m_aTexCoords[k*2+1] > 1.0f)
 				RepeatV = true;
 		}
-		Graphics()->WrapMode(
-			RepeatU ? IGraphics::WRAP_REPEAT : IGraphics::WRAP_CLAMP,
-			RepeatV ? IGraphics::WRAP_REPEAT : IGraphics::WRAP_CLAMP);
-
-		Graphics()->QuadsSetSubsetFree(
-			aTexCoords[0].x, aTexCoords[0].y,
-			aTexCoords[1].x, aTexCoords[1].y,
-			aTexCoords[2].x, aTexCoords[2].y,
-			aTexCoords[3].x, aTexCoords[3].y);
+		pQuad->m_WrapU = RepeatU ? IGraphics::WRAP_REPEAT : IGraphics::WRAP_CLAMP;
+		pQuad->m_WrapV = RepeatV ? IGraphics::WRAP_REPEAT : IGraphics::WRAP_CLAMP;
 
 		float OffsetX = 0;
 		float OffsetY = 0;
@@ -295,41 +306,148 @@ void CRenderTools::RenderQuads(CQuad *pQuads, int NumQuads, int RenderFlags, ENV
 			Rot = aChannels[2]/360.0f*pi*2;
 		}
 
-		IGraphics::CColorVertex Array[4] = {
-			IGraphics::CColorVertex(0, q->m_aColors[0].r*Conv*r*q->m_aColors[0].a*Conv*a, q->m_aColors[0].g*Conv*g*q->m_aColors[0].a*Conv*a, q->m_aColors[0].b*Conv*b*q->m_aColors[0].a*Conv*a, q->m_aColors[0].a*Conv*a),
-			IGraphics::CColorVertex(1, q->m_aColors[1].r*Conv*r*q->m_aColors[1].a*Conv*a, q->m_aColors[1].g*Conv*g*q->m_aColors[1].a*Conv*a, q->m_aColors[1].b*Conv*b*q->m_aColors[1].a*Conv*a, q->m_aColors[1].a*Conv*a),
-			IGraphics::CColorVertex(2, q->m_aColors[2].r*Conv*r*q->m_aColors[2].a*Conv*a, q->m_aColors[2].g*Conv*g*q->m_aColors[2].a*Conv*a, q->m_aColors[2].b*Conv*b*q->m_aColors[2].a*Conv*a, q->m_aColors[2].a*Conv*a),
-			IGraphics::CColorVertex(3, q->m_aColors[3].r*Conv*r*q->m_aColors[3].a*Conv*a, q->m_aColors[3].g*Conv*g*q->m_aColors[3].a*Conv*a, q->m_aColors[3].b*Conv*b*q->m_aColors[3].a*Conv*a, q->m_aColors[3].a*Conv*a)};
-		Graphics()->SetColorVertex(Array, 4);
-
-		CPoint *pPoints = q->m_aPoints;
+		for(int k = 0; k < 4; k++)
+		{
+			float Alpha = q->m_aColors[k].a*Conv*a;
+			pQuad->m_aColors[k] = IGraphics::CColorVertex(k, q->m_aColors[k].r*Conv*r*Alpha, q->m_aColors[k].g*Conv*g*Alpha, q->m_aColors[k].b*Conv*b*Alpha, Alpha);
+		}
 
-		if(Rot != 0)
+		CPoint aPoints[4];
+		for(int k = 0; k < 4; k++)
 		{
-			static CPoint aRotated[4];
-			aRotated[0] = q->m_aPoints[0];
-			aRotated[1] = q->m_aPoints[1];
-			aRotated[2] = q->m_aPoints[2];
-			aRotated[3] = q->m_aPoints[3];
-			pPoints = aRotated;
-
-			Rotate(&q->m_aPoints[4], &aRotated[0], Rot);
-			Rotate(&q->m_aPoints[4], &aRotated[1], Rot);
-			Rotate(&q->m_aPoints[4], &aRotated[2], Rot);
-			Rotate(&q->m_aPoints[4], &aRotated[3], Rot);
+			aPoints[k] = q->m_aPoints[k];
+			if(Rot != 0)
+				Rotate(&q->m_aPoints[4], &aPoints[k], Rot);
 		}
 
-		IGraphics::CFreeformItem Freeform(
-			fx2f(pPoints[0].x)+OffsetX, fx2f(pPoints[0].y)+OffsetY,
-			fx2f(pPoints[1].x)+OffsetX, fx2f(pPoints[1].y)+OffsetY,
-			fx2f(pPoints[2].x)+OffsetX, fx2f(pPoints[2].y)+OffsetY,
-			fx2f(pPoints[3].x)+OffsetX, fx2f(pPoints[3].y)+OffsetY);
-		Graphics()->QuadsDrawFreeform(&Freeform, 1);
+		pQuad->m_Pos = IGraphics::CFreeformItem(
+			fx2f(aPoints[0].x)+OffsetX, fx2f(aPoints[0].y)+OffsetY,
+			fx2f(aPoints[1].x)+OffsetX, fx2f(aPoints[1].y)+OffsetY,
+			fx2f(aPoints[2].x)+OffsetX, fx2f(aPoints[2].y)+OffsetY,
+			fx2f(aPoints[3].x)+OffsetX, fx2f(aPoints[3].y)+OffsetY);
+	}
+}
+
+void CRenderTools::RenderQuads(CQuad *pQuads, int NumQuads, int RenderFlags, ENVELOPE_EVAL pfnEval, void *pUser, const CQuadBounds *pBounds)
+{
+	float aScreen[4];
+	Graphics()->GetScreen(&aScreen[0], &aScreen[1], &aScreen[2], &aScreen[3]);
+
+	// record a few at a time to keep them on the stack
+	enum { NUM_RECORDED=64 };
+	IGraphics::CRecordedQuad aRecorded[NUM_RECORDED];
+
+	Graphics()->QuadsBegin();
+	for(int i = 0; i < NumQuads; i += NUM_RECORDED)
+	{
+		int Num = min(NumQuads-i, (int)NUM_RECORDED);
+		RecordQuads(pQuads, i, i+Num, pfnEval, pUser, pBounds, aScreen, aRecorded);
+		Graphics()->QuadsDrawRecorded(aRecorded, Num);
 	}
 	Graphics()->QuadsEnd();
 	Graphics()->WrapNormal();
 }
 
+void CRenderTools::EnvelopeRange(const CEnvPoint *pPoints, int NumPoints, float *pMin, float *pMax)
+{
+	// bezier curves stay within their control points
+	for(int c = 0; c < 3; c++)
+		pMin[c] = pMax[c] = 0;
+	for(int p = 0; p < NumPoints; p++)
+	{
+		for(int c = 0; c < 3; c++)
+		{
+			float Value = fx2f(pPoints[p].m_aValues[c]);
+			float In = Value + fx2f(pPoints[p].m_aInTangentdy[c]);
+			float Out = Value + fx2f(pPoints[p].m_aOutTangentdy[c]);
+			pMin[c] = min(pMin[c], min(Value, min(In, Out)));
+			pMax[c] = max(pMax[c], max(Value, max(In, Out)));
+		}
+	}
+}
+
+void CRenderTools::QuadBounds(const CQuad *pQuad, const float *pEnvMin, const float *pEnvMax, CQuadBounds *pOut)
+{
+	if(pEnvMin && (pEnvMin[2] != 0 || pEnvMax[2] != 0))
+	{
+		// rotated around the pivot
+		float Radius = 0;
+		for(int k = 0; k < 4; k++)
+			Radius = max(Radius, distance(vec2(fx2f(pQuad->m_aPoints[k].x), fx2f(pQuad->m_aPoints[k].y)),
+				vec2(fx2f(pQuad->m_aPoints[4].x), fx2f(pQuad->m_aPoints[4].y))));
+		pOut->m_MinX = fx2f(pQuad->m_aPoints[4].x) - Radius;
+		pOut->m_MinY = fx2f(pQuad->m_aPoints[4].y) - Radius;
+		pOut->m_MaxX = fx2f(pQuad->m_aPoints[4].x) + Radius;
+		pOut->m_MaxY = fx2f(pQuad->m_aPoints[4].y) + Radius;
+	}
+	else
+	{
+		pOut->m_MinX = pOut->m_MaxX = fx2f(pQuad->m_aPoints[0].x);
+		pOut->m_MinY = pOut->m_MaxY = fx2f(pQuad->m_aPoints[0].y);
+		for(int k = 1; k < 4; k++)
+		{
+			pOut->m_MinX = min(pOut->m_MinX, fx2f(pQuad->m_aPoints[k].x));
+			pOut->m_MinY = min(pOut->m_MinY, fx2f(pQuad->m_aPoints[k].y));
+			pOut->m_MaxX = max(pOut->m_MaxX, fx2f(pQuad->m_aPoints[k].x));
+			pOut->m_MaxY = max(pOut->m_MaxY, fx2f(pQuad->m_aPoints[k].y));
+		}
+	}
+	if(pEnvMin)
+	{
+		pOut->m_MinX += pEnvMin[0];
+		pOut->m_MinY += pEnvMin[1];
+		pOut->m_MaxX += pEnvMax[0];
+		pOut->m_MaxY += pEnvMax[1];
+	}
+}
+
+void CRenderTools::TileTexCoords(int Flags, float *pU, float *pV)
+{
+	float x0 = 0;
+	float y0 = 0;
+	float x1 = 1;
+	float y1 = 0;
+	float x2 = 1;
+	float y2 = 1;
+	float x3 = 0;
+	float y3 = 1;
+
+	if(Flags&TILEFLAG_VFLIP)
+	{
+		x0 = x2;
+		x1 = x3;
+		x2 = x3;
+		x3 = x0;
+	}
+
+	if(Flags&TILEFLAG_HFLIP)
+	{
+		y0 = y3;
+		y2 = y1;
+		y3 = y1;
+		y1 = y0;
+	}
+
+	if(Flags&TILEFLAG_ROTATE)
+	{
+		float Tmp = x0;
+		x0 = x3;
+		x3 = x2;
+		x2 = x1;
+		x1 = Tmp;
+		Tmp = y0;
+		y0 = y3;
+		y3 = y2;
+		y2 = y1;
+		y1 = Tmp;
+	}
+
+	pU[0] = x0; pV[0] = y0;
+	pU[1] = x1; pV[1] = y1;
+	pU[2] = x2; pV[2] = y2;
+	pU[3] = x3; pV[3] = y3;
+}
+
 void CRenderTools::RenderTilemap(CTile *pTiles, int w, int h, float Scale, vec4 Color, int RenderFlags,
 									ENVELOPE_EVAL pfnEval, void *pUser, int ColorEnv, int ColorEnvOffset)
 {
@@ -359,6 +477,13 @@ void CRenderTools::RenderTilemap(CTile *pTiles, int w, int h, float Scale, vec4
 	for(int y = StartY; y < EndY; y++)
 		for(int x = StartX; x < EndX; x++)
 		{
+			// the inside is drawn from a static buffer
+			if(RenderFlags&TILERENDERFLAG_BORDER && x >= 0 && x < w && y >= 0 && y < h)
+			{
+				x = w-1;
+				continue;
+			}
+
 			int mx = x;
 			int my = y;
 
@@ -406,46 +531,9 @@ void CRenderTools::RenderTilemap(CTile *pTiles, int w, int h, float Scale, vec4
 
 				if(Render)
 				{
-					float x0 = 0;
-					float y0 = 0;
-					float x1 = 1;
-					float y1 = 0;
-					float x2 = 1;
-					float y2 = 1;
-					float x3 = 0;
-					float y3 = 1;
-
-					if(Flags&TILEFLAG_VFLIP)
-					{
-						x0 = x2;
-						x1 = x3;
-						x2 = x3;
-						x3 = x0;
-					}
-
-					if(Flags&TILEFLAG_HFLIP)
-					{
-						y0 = y3;
-						y2 = y1;
-						y3 = y1;
-						y1 = y0;
-					}
-
-					if(Flags&TILEFLAG_ROTATE)
-					{
-						float Tmp = x0;
-						x0 = x3;
-						x3 = x2;
-						x2 = x1;
-						x1 = Tmp;
-						Tmp = y0;
-						y0 = y3;
-						y3 = y2;
-						y2 = y1;
-						y1 = Tmp;
-					}
-
-					Graphics()->QuadsSetSubsetFree(x0, y0, x1, y1, x2, y2, x3, y3, Index);
+					float aU[4], aV[4];
+					TileTexCoords(Flags, aU, aV);
+					Graphics()->QuadsSetSubsetFree(aU[0], aV[0], aU[1], aV[1], aU[2], aV[2], aU[3], aV[3], Index);
 					IGraphics::CQuadItem QuadItem(x*Scale, y*Scale, Scale, Scale);
 					Graphics()->QuadsDrawTL(&QuadItem, 1);
 				}
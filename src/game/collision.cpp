@@ -18,14 +18,31 @@ CCollision::CCollision()
 	m_Width = 0;
 	m_Height = 0;
 	m_pLayers = 0;
+	for(int i = 0; i < NUM_FLAGS; i++)
+		m_apFlagBits[i] = 0;
+	m_pBlockBits = 0;
+	m_Stride = 0;
+	m_BlockStride = 0;
+}
+
+CCollision::~CCollision()
+{
+	mem_free(m_apFlagBits[0]);
+	mem_free(m_pBlockBits);
 }
 
 void CCollision::Init(class CLayers *pLayers)
 {
 	m_pLayers = pLayers;
-	m_Width = m_pLayers->GameLayer()->m_Width;
-	m_Height = m_pLayers->GameLayer()->m_Height;
-	m_pTiles = static_cast<CTile *>(m_pLayers->Map()->GetData(m_pLayers->GameLayer()->m_Data));
+	Init(static_cast<CTile *>(m_pLayers->Map()->GetData(m_pLayers->GameLayer()->m_Data)),
+		m_pLayers->GameLayer()->m_Width, m_pLayers->GameLayer()->m_Height);
+}
+
+void CCollision::Init(class CTile *pTiles, int Width, int Height)
+{
+	m_Width = Width;
+	m_Height = Height;
+	m_pTiles = pTiles;
 
 	for(int i = 0; i < m_Width*m_Height; i++)
 	{
@@ -49,41 +66,150 @@ void CCollision::Init(class CLayers *pLayers)
 			m_pTiles[i].m_Index = 0;
 		}
 	}
+
+	// pack the flags into bits, all planes share one allocation
+	mem_free(m_apFlagBits[0]);
+	mem_free(m_pBlockBits);
+	m_Stride = (m_Width+31)/32;
+	m_BlockStride = (((m_Width+(1<<BLOCK_SHIFT)-1)>>BLOCK_SHIFT)+31)/32;
+	const int BlockRows = (m_Height+(1<<BLOCK_SHIFT)-1)>>BLOCK_SHIFT;
+	m_apFlagBits[0] = (unsigned *)mem_alloc_tag(NUM_FLAGS*m_Stride*m_Height*sizeof(unsigned), 1, MEMTAG_MAP);
+	mem_zero(m_apFlagBits[0], NUM_FLAGS*m_Stride*m_Height*sizeof(unsigned));
+	for(int f = 1; f < NUM_FLAGS; f++)
+		m_apFlagBits[f] = m_apFlagBits[0] + f*m_Stride*m_Height;
+	m_pBlockBits = (unsigned *)mem_alloc_tag(m_BlockStride*BlockRows*sizeof(unsigned), 1, MEMTAG_MAP);
+	mem_zero(m_pBlockBits, m_BlockStride*BlockRows*sizeof(unsigned));
+
+	for(int y = 0; y < m_Height; y++)
+		for(int x = 0; x < m_Width; x++)
+		{
+			int Index = m_pTiles[y*m_Width+x].m_Index;
+			if(Index > 128 || !Index)
+				continue;
+			for(int f = 0; f < NUM_FLAGS; f++)
+				if(Index&(1<<f))
+					m_apFlagBits[f][y*m_Stride+x/32] |= 1u<<(x%32);
+			if(Index&(COLFLAG_SOLID|COLFLAG_DEATH))
+			{
+				int BlockX = x>>BLOCK_SHIFT;
+				m_pBlockBits[(y>>BLOCK_SHIFT)*m_BlockStride+BlockX/32] |= 1u<<(BlockX%32);
+			}
+		}
 }
 
 int CCollision::GetTile(int x, int y) const
 {
-	int Nx = clamp(x/32, 0, m_Width-1);
-	int Ny = clamp(y/32, 0, m_Height-1);
+	return GetTileAt(x/32, y/32);
+}
+
+int CCollision::GetTileAt(int TileX, int TileY) const
+{
+	int Nx = clamp(TileX, 0, m_Width-1);
+	int Ny = clamp(TileY, 0, m_Height-1);
 
-	return m_pTiles[Ny*m_Width+Nx].m_Index > 128 ? 0 : m_pTiles[Ny*m_Width+Nx].m_Index;
+	int Word = Ny*m_Stride+Nx/32;
+	int Bit = Nx%32;
+	return ((m_apFlagBits[0][Word]>>Bit)&1) | (((m_apFlagBits[1][Word]>>Bit)&1)<<1) | (((m_apFlagBits[2][Word]>>Bit)&1)<<2);
 }
 
 bool CCollision::IsTile(int x, int y, int Flag) const
 {
+	if(Flag == COLFLAG_SOLID)
+	{
+		int Nx = clamp(x/32, 0, m_Width-1);
+		int Ny = clamp(y/32, 0, m_Height-1);
+		return (m_apFlagBits[0][Ny*m_Stride+Nx/32]>>(Nx%32))&1;
+	}
 	return GetTile(x, y)&Flag;
 }
 
-// TODO: rewrite this smarter!
+bool CCollision::IsRegionFree(vec2 Min, vec2 Max, int Flag) const
+{
+	// same rounding and clamping as CheckPoint
+	int MinX = clamp(round_to_int(Min.x)/32, 0, m_Width-1);
+	int MinY = clamp(round_to_int(Min.y)/32, 0, m_Height-1);
+	int MaxX = clamp(round_to_int(Max.x)/32, 0, m_Width-1);
+	int MaxY = clamp(round_to_int(Max.y)/32, 0, m_Height-1);
+
+	// skip blocks without solid and death tiles
+	bool Empty = true;
+	for(int By = MinY>>BLOCK_SHIFT; Empty && By <= MaxY>>BLOCK_SHIFT; By++)
+		for(int Bx = MinX>>BLOCK_SHIFT; Bx <= MaxX>>BLOCK_SHIFT; Bx++)
+			if((m_pBlockBits[By*m_BlockStride+Bx/32]>>(Bx%32))&1)
+			{
+				Empty = false;
+				break;
+			}
+	if(Empty)
+		return true;
+
+	for(int y = MinY; y <= MaxY; y++)
+		for(int x = MinX; x <= MaxX; x++)
+			if(GetTileAt(x, y)&Flag)
+				return false;
+	return true;
+}
+
 int CCollision::IntersectLine(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision) const
 {
+	// the line is tested at one point per pixel. instead of testing all of them,
+	// walk the tiles the line crosses and only test the points near solid ones
 	const int End = distance(Pos0, Pos1)+1;
 	const float InverseEnd = 1.0f/End;
-	vec2 Last = Pos0;
+	const vec2 Dir = Pos1-Pos0;
 
-	for(int i = 0; i <= End; i++)
+	// CheckPoint rounds, so tile x covers [x*32-0.5, x*32+31.5)
+	int TileX = (int)floorf((Pos0.x+0.5f)/32.0f);
+	int TileY = (int)floorf((Pos0.y+0.5f)/32.0f);
+	const int StepX = Dir.x < 0 ? -1 : 1;
+	const int StepY = Dir.y < 0 ? -1 : 1;
+	const float DeltaX = Dir.x != 0 ? absolute(32.0f/Dir.x) : 2.0f;
+	const float DeltaY = Dir.y != 0 ? absolute(32.0f/Dir.y) : 2.0f;
+	float NextX = Dir.x != 0 ? ((TileX+(StepX > 0))*32.0f-0.5f-Pos0.x)/Dir.x : 2.0f;
+	float NextY = Dir.y != 0 ? ((TileY+(StepY > 0))*32.0f-0.5f-Pos0.y)/Dir.y : 2.0f;
+
+	float TileStart = 0.0f;
+	int Tested = -1;
+	while(1)
 	{
-		vec2 Pos = mix(Pos0, Pos1, i*InverseEnd);
-		if(CheckPoint(Pos.x, Pos.y))
+		const float TileEnd = min(min(NextX, NextY), 1.0f);
+		if(GetTileAt(TileX, TileY)&COLFLAG_SOLID)
 		{
-			if(pOutCollision)
-				*pOutCollision = Pos;
-			if(pOutBeforeCollision)
-				*pOutBeforeCollision = Last;
-			return GetCollisionAt(Pos.x, Pos.y);
+			// test the points in this tile, with a point of margin for rounding
+			int i = max(Tested+1, (int)(TileStart*End)-1);
+			const int Last = min(End, (int)(TileEnd*End)+1);
+			for(; i <= Last; i++)
+			{
+				vec2 Pos = mix(Pos0, Pos1, i*InverseEnd);
+				if(CheckPoint(Pos.x, Pos.y))
+				{
+					if(pOutCollision)
+						*pOutCollision = Pos;
+					if(pOutBeforeCollision)
+						*pOutBeforeCollision = i > 0 ? mix(Pos0, Pos1, (i-1)*InverseEnd) : Pos0;
+					return GetCollisionAt(Pos.x, Pos.y);
+				}
+			}
+			Tested = Last;
+		}
+
+		if(TileEnd >= 1.0f)
+			break;
+
+		// step into the next tile
+		TileStart = TileEnd;
+		if(NextX < NextY)
+		{
+			TileX += StepX;
+			NextX += DeltaX;
+		}
+		else
+		{
+			TileY += StepY;
+			NextY += DeltaY;
 		}
-		Last = Pos;
 	}
+
 	if(pOutCollision)
 		*pOutCollision = Pos1;
 	if(pOutBeforeCollision)
@@ -144,6 +270,43 @@ bool CCollision::TestBox(vec2 Pos, vec2 Size, int Flag) const
 	return false;
 }
 
+int CCollision::StepsInSameTiles(vec2 Pos, vec2 Step, vec2 Size)
+{
+	// counts the steps the corners of the box can do before they might reach
+	// another tile. tile x covers [x*32-0.5, x*32+31.5) because of the rounding,
+	// the margin covers the error of summing the steps up
+	const float Margin = 0.25f;
+	int Steps = 1<<30;
+	for(int Axis = 0; Axis < 2; Axis++)
+	{
+		float Delta = Axis == 0 ? Step.x : Step.y;
+		if(Delta == 0)
+			continue;
+
+		for(int Side = -1; Side <= 1; Side += 2)
+		{
+			float Edge = (Axis == 0 ? Pos.x : Pos.y) + Side*(Axis == 0 ? Size.x : Size.y)*0.5f;
+			float TileStart = floorf((Edge+0.5f)/32.0f)*32.0f-0.5f;
+			float Left = Delta > 0 ? TileStart+32.0f-Edge : Edge-TileStart;
+			float Num = (Left-Margin)/absolute(Delta);
+			if(Num < Steps)
+				Steps = (int)Num-1;
+		}
+	}
+	return max(Steps, 0);
+}
+
+bool CCollision::IsSweepFree(vec2 Pos, vec2 Step, int Steps, vec2 Size, int Flag) const
+{
+	// the axes that move get a pixel of margin for the error of summing the
+	// steps up, the others are tested exactly like TestBox does
+	vec2 End = Pos + Step*(float)Steps;
+	vec2 HalfSize = Size*0.5f + vec2(Step.x != 0 ? 1.0f : 0.0f, Step.y != 0 ? 1.0f : 0.0f);
+	vec2 Min = vec2(min(Pos.x, End.x), min(Pos.y, End.y)) - HalfSize;
+	vec2 Max = vec2(max(Pos.x, End.x), max(Pos.y, End.y)) + HalfSize;
+	return IsRegionFree(Min, Max, Flag);
+}
+
 void CCollision::MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity, bool *pDeath) const
 {
 	// do the move
@@ -159,9 +322,22 @@ void CCollision::MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elas
 	if(Distance > 0.00001f)
 	{
 		const float Fraction = 1.0f/(Max+1);
+		const int Flag = pDeath ? COLFLAG_SOLID|COLFLAG_DEATH : COLFLAG_SOLID;
+
+		// nothing to hit on the way, only do the steps
+		if(IsSweepFree(Pos, Vel*Fraction, Max+1, Size, Flag))
+		{
+			for(int i = 0; i <= Max; i++)
+				Pos = Pos + Vel*Fraction;
+			*pInoutPos = Pos;
+			*pInoutVel = Vel;
+			return;
+		}
+
 		for(int i = 0; i <= Max; i++)
 		{
 			vec2 NewPos = Pos + Vel*Fraction; // TODO: this row is not nice
+			bool Hit = false;
 
 			//You hit a deathtile, congrats to that :)
 			//Deathtiles are a bit smaller
@@ -173,6 +349,7 @@ void CCollision::MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elas
 			if(TestBox(vec2(NewPos.x, NewPos.y), Size))
 			{
 				int Hits = 0;
+				Hit = true;
 
 				if(TestBox(vec2(Pos.x, NewPos.y), Size))
 				{
@@ -200,6 +377,27 @@ void CCollision::MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elas
 			}
 
 			Pos = NewPos;
+
+			// find how far the box gets before it can touch anything: the rest of
+			// the move, a tile of it, or until a corner reaches another tile.
+			// the tests give the same results for the steps before that
+			if(!Hit && i < Max)
+			{
+				const vec2 Step = Vel*Fraction;
+				int Free = Max-i;
+				if(!IsSweepFree(Pos, Step, Free, Size, Flag))
+				{
+					Free = min(Free, (int)(32.0f/max(absolute(Step.x), absolute(Step.y))));
+					if(!IsSweepFree(Pos, Step, Free, Size, Flag))
+					{
+						Free = StepsInSameTiles(Pos, Step, Size);
+						if(pDeath)
+							Free = min(Free, StepsInSameTiles(Pos, Step, Size*(2.0f/3.0f)));
+					}
+				}
+				for(; Free > 0 && i < Max; Free--, i++)
+					Pos = Pos + Step;
+			}
 		}
 	}
 
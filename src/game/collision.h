@@ -12,8 +12,24 @@ class CCollision
 	int m_Height;
 	class CLayers *m_pLayers;
 
+	// one bit per tile for each flag, rows are padded to whole words.
+	// the block bits mark blocks of tiles that have any solid or death tile
+	enum
+	{
+		NUM_FLAGS=3,
+		BLOCK_SHIFT=3, // blocks of 8x8 tiles
+	};
+	unsigned *m_apFlagBits[NUM_FLAGS];
+	unsigned *m_pBlockBits;
+	int m_Stride;
+	int m_BlockStride;
+
 	bool IsTile(int x, int y, int Flag=COLFLAG_SOLID) const;
 	int GetTile(int x, int y) const;
+	int GetTileAt(int TileX, int TileY) const;
+	bool IsRegionFree(vec2 Min, vec2 Max, int Flag) const;
+	static int StepsInSameTiles(vec2 Pos, vec2 Step, vec2 Size);
+	bool IsSweepFree(vec2 Pos, vec2 Step, int Steps, vec2 Size, int Flag) const;
 
 public:
 	enum
@@ -24,7 +40,9 @@ public:
 	};
 
 	CCollision();
+	~CCollision();
 	void Init(class CLayers *pLayers);
+	void Init(class CTile *pTiles, int Width, int Height);
 	bool CheckPoint(float x, float y, int Flag=COLFLAG_SOLID) const { return IsTile(round_to_int(x), round_to_int(y), Flag); }
 	bool CheckPoint(vec2 Pos, int Flag=COLFLAG_SOLID) const { return CheckPoint(Pos.x, Pos.y, Flag); }
 	int GetCollisionAt(float x, float y) const { return GetTile(round_to_int(x), round_to_int(y)); }
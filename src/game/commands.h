@@ -42,8 +42,20 @@ public:
     typedef void (*FRemoveCommandHook)(const CCommand *pCommand, void *pContext);
 
 private:
+    enum
+    {
+        HASH_SIZE = 256,
+    };
+
     array<CCommand> m_aCommands;
 
+    // exact lookup by name hash, chained through m_aHashNext (both hold command indices)
+    int m_aHashHead[HASH_SIZE];
+    array<int> m_aHashNext;
+
+    // command indices ordered by case insensitive name, prefix matches are a contiguous range
+    array<int> m_aSorted;
+
     IConsole *m_pConsole;
     void *m_pHookContext;
     FNewCommandHook m_pfnNewCommandHook;
@@ -53,9 +65,48 @@ public:
     CCommandManager()
     {
         m_pConsole = 0;
-        m_aCommands.clear();
+        ClearCommands();
     }
 
+private:
+    static unsigned NameHash(const char *pName)
+    {
+        unsigned Hash = 2166136261u;
+        for(; *pName; pName++)
+            Hash = (Hash^(unsigned char)*pName)*16777619u;
+        return Hash%HASH_SIZE;
+    }
+
+    void RebuildIndex()
+    {
+        for(int i = 0; i < HASH_SIZE; i++)
+            m_aHashHead[i] = -1;
+        m_aHashNext.set_size(m_aCommands.size());
+        for(int i = 0; i < m_aCommands.size(); i++)
+        {
+            unsigned Hash = NameHash(m_aCommands[i].m_aName);
+            m_aHashNext[i] = m_aHashHead[Hash];
+            m_aHashHead[Hash] = i;
+        }
+    }
+
+    // first position in m_aSorted whose name is not less than pName
+    int LowerBound(const char *pName, int Length) const
+    {
+        int Low = 0, High = m_aSorted.size();
+        while(Low < High)
+        {
+            int Mid = (Low+High)/2;
+            if(str_comp_nocase_num(m_aCommands[m_aSorted[Mid]].m_aName, pName, Length) < 0)
+                Low = Mid+1;
+            else
+                High = Mid;
+        }
+        return Low;
+    }
+
+public:
+
     void Init(IConsole *pConsole, void *pHookContext = 0, FNewCommandHook pfnNewCommandHook = 0, FRemoveCommandHook pfnRemoveCommandHook = 0)
     {
         m_pConsole = pConsole;
@@ -64,13 +115,19 @@ public:
         m_pfnRemoveCommandHook = pfnRemoveCommandHook;
     }
 
-    const CCommand *GetCommand(const char *pCommand)
+    int FindCommand(const char *pCommand) const
     {
-        for(int i = 0; i < m_aCommands.size(); i++)
+        for(int i = m_aHashHead[NameHash(pCommand)]; i >= 0; i = m_aHashNext[i])
             if(!str_comp(m_aCommands[i].m_aName, pCommand))
-                return &m_aCommands[i];
+                return i;
 
-        return 0;
+        return -1;
+    }
+
+    const CCommand *GetCommand(const char *pCommand)
+    {
+        int Index = FindCommand(pCommand);
+        return Index >= 0 ? &m_aCommands[Index] : 0;
     }
 
     const CCommand *GetCommand(int Index)
@@ -91,6 +148,16 @@ public:
             return 1;
 
         int Index = m_aCommands.add(CCommand(pCommand, pHelpText, pArgsFormat, pfnCallback, pContext));
+        unsigned Hash = NameHash(m_aCommands[Index].m_aName);
+        m_aHashNext.add(m_aHashHead[Hash]);
+        m_aHashHead[Hash] = Index;
+
+        int Pos = LowerBound(m_aCommands[Index].m_aName, sizeof(m_aCommands[Index].m_aName));
+        m_aSorted.add(Index);
+        for(int i = m_aSorted.size()-1; i > Pos; i--)
+            m_aSorted[i] = m_aSorted[i-1];
+        m_aSorted[Pos] = Index;
+
         if(m_pfnNewCommandHook)
             m_pfnNewCommandHook(&m_aCommands[Index], m_pHookContext);
 
@@ -99,24 +166,30 @@ public:
 
     int RemoveCommand(const char *pCommand)
     {
-        for(int i = 0; i < m_aCommands.size(); i++)
-        {
-            if(!str_comp(m_aCommands[i].m_aName, pCommand))
-            {
-                if(m_pfnRemoveCommandHook)
-                    m_pfnRemoveCommandHook(&m_aCommands[i], m_pHookContext);
+        int Index = FindCommand(pCommand);
+        if(Index < 0)
+            return 1;
 
-                m_aCommands.remove_index(i);
-                return 0;
-            }
-        }
+        if(m_pfnRemoveCommandHook)
+            m_pfnRemoveCommandHook(&m_aCommands[Index], m_pHookContext);
 
-        return 1;
+        // keep the registration order for listing, the indices after it shift down
+        m_aCommands.remove_index(Index);
+        for(int i = 0, j = 0; i < m_aSorted.size(); i++)
+        {
+            if(m_aSorted[i] != Index)
+                m_aSorted[j++] = m_aSorted[i] > Index ? m_aSorted[i]-1 : m_aSorted[i];
+        }
+        m_aSorted.set_size(m_aCommands.size());
+        RebuildIndex();
+        return 0;
     }
 
     void ClearCommands()
     {
         m_aCommands.clear();
+        m_aSorted.clear();
+        RebuildIndex();
     }
 
     int CommandCount() const
@@ -124,6 +197,23 @@ public:
         return m_aCommands.size();
     }
 
+    // commands whose name starts with pPrefix (case insensitive), in name order:
+    // returns the count, the command indices are SortedCommand(*pFirst) onwards
+    int FindPrefix(const char *pPrefix, int *pFirst) const
+    {
+        int Length = str_length(pPrefix);
+        *pFirst = LowerBound(pPrefix, Length);
+        int End = *pFirst;
+        while(End < m_aSorted.size() && !str_comp_nocase_num(m_aCommands[m_aSorted[End]].m_aName, pPrefix, Length))
+            End++;
+        return End - *pFirst;
+    }
+
+    int SortedCommand(int Pos) const
+    {
+        return m_aSorted[Pos];
+    }
+
     struct SCommandContext
     {
         const char *m_pCommand;
@@ -153,19 +243,23 @@ public:
             return 0;
         }
 
-        int Filtered = 0;
+        for(int i = 0; i < aFilter.size(); i++)
+            aFilter[i] = true;
+
         if(Exact)
         {
-            for(int i = 0; i < m_aCommands.size(); i++)
-                Filtered += (aFilter[i] = str_comp(m_aCommands[i].m_aName, pStr));
-        }
-        else
-        {
-            for(int i = 0; i < m_aCommands.size(); i++)
-                Filtered += (aFilter[i] = str_find_nocase(m_aCommands[i].m_aName, pStr) != m_aCommands[i].m_aName);
+            int Index = FindCommand(pStr);
+            if(Index < 0)
+                return aFilter.size();
+            aFilter[Index] = false;
+            return aFilter.size()-1;
         }
 
-        return Filtered;
+        int First;
+        int Count = FindPrefix(pStr, &First);
+        for(int i = 0; i < Count; i++)
+            aFilter[m_aSorted[First+i]] = false;
+        return aFilter.size()-Count;
     }
 };
 
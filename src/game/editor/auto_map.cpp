@@ -1,5 +1,7 @@
 #include <engine/console.h>
+#include <engine/engine.h>
 #include <engine/storage.h>
+#include <engine/shared/jobs.h>
 
 #include "auto_map.h"
 #include "editor.h"
@@ -98,10 +100,55 @@ void CTilesetMapper::Load(const json_value &rElement)
 			NewRuleSet.m_aRules.add(NewRule);
 		}
 
+		CompileRuleSet(&NewRuleSet);
 		m_aRuleSets.add(NewRuleSet);
 	}
 }
 
+void CTilesetMapper::CompileRuleSet(CRuleSet *pRuleSet)
+{
+	pRuleSet->m_aWindow.clear();
+	pRuleSet->m_Radius = 0;
+	uint64 WindowMask = 0;
+
+	for(int i = 0; i < pRuleSet->m_aRules.size(); i++)
+	{
+		CRule *pRule = &pRuleSet->m_aRules[i];
+		pRule->m_FullMask = 0;
+		pRule->m_EmptyMask = 0;
+		pRule->m_aSlowConditions.clear();
+
+		for(int j = 0; j < pRule->m_aConditions.size(); j++)
+		{
+			const CRuleCondition *pCondition = &pRule->m_aConditions[j];
+			pRuleSet->m_Radius = max(pRuleSet->m_Radius, max(absolute(pCondition->m_X), absolute(pCondition->m_Y)));
+
+			bool InWindow = absolute(pCondition->m_X) <= WINDOW_RADIUS && absolute(pCondition->m_Y) <= WINDOW_RADIUS;
+			if(!InWindow || (pCondition->m_Value != CRuleCondition::EMPTY && pCondition->m_Value != CRuleCondition::FULL))
+			{
+				pRule->m_aSlowConditions.add(*pCondition);
+				continue;
+			}
+
+			uint64 Bit = WindowBit(pCondition->m_X, pCondition->m_Y);
+			if(pCondition->m_Value == CRuleCondition::FULL)
+				pRule->m_FullMask |= Bit;
+			else
+				pRule->m_EmptyMask |= Bit;
+
+			if(!(WindowMask&Bit))
+			{
+				CWindowCell Cell;
+				Cell.m_X = pCondition->m_X;
+				Cell.m_Y = pCondition->m_Y;
+				Cell.m_Bit = Bit;
+				pRuleSet->m_aWindow.add(Cell);
+				WindowMask |= Bit;
+			}
+		}
+	}
+}
+
 const char* CTilesetMapper::GetRuleSetName(int Index) const
 {
 	if(Index < 0 || Index >= m_aRuleSets.size())
@@ -110,84 +157,169 @@ const char* CTilesetMapper::GetRuleSetName(int Index) const
 	return m_aRuleSets[Index].m_aName;
 }
 
-void CTilesetMapper::Proceed(CLayerTiles *pLayer, int ConfigID, RECTi Area)
+// random chances depend on the run's seed and the tile only, rows can be mapped in any order
+static float TileRandom(unsigned Seed, int x, int y, int Rule)
 {
-	if(pLayer->m_Readonly || ConfigID < 0 || ConfigID >= m_aRuleSets.size())
-		return;
-
-	CRuleSet *pConf = &m_aRuleSets[ConfigID];
+	unsigned Hash = Seed ^ (x*73856093u) ^ (y*19349663u) ^ (Rule*83492791u);
+	Hash ^= Hash>>16;
+	Hash *= 0x7feb352du;
+	Hash ^= Hash>>15;
+	Hash *= 0x846ca68bu;
+	Hash ^= Hash>>16;
+	return (Hash>>8)/16777216.0f;
+}
 
-	if(!pConf->m_aRules.size())
-		return;
+struct CTilesetMapper::CRun
+{
+	const CRuleSet *m_pConf;
+	CLayerTiles *m_pLayer;
+	RECTi m_Area;
+	unsigned m_Seed;
 
-	pLayer->Clamp(&Area);
-	
-	int BaseTile = pConf->m_BaseTile;
+	// the indices before mapping, the area grown by the reach of the rules
+	unsigned char *m_pIndices;
+	RECTi m_Copy;
+};
 
-	// auto map !
-	int MaxIndex = pLayer->m_Width*pLayer->m_Height;
-	for(int y = Area.y; y < Area.y + Area.h; y++)
+void CTilesetMapper::ProceedRows(int Begin, int End, void *pUser)
+{
+	const CRun *pRun = (const CRun *)pUser;
+	const CRuleSet *pConf = pRun->m_pConf;
+	CLayerTiles *pLayer = pRun->m_pLayer;
+	const RECTi Area = pRun->m_Area;
+	const RECTi Copy = pRun->m_Copy;
+	const unsigned char *pIndices = pRun->m_pIndices;
+	int Width = pLayer->m_Width;
+	int Height = pLayer->m_Height;
+	const uint64 CenterBit = WindowBit(0, 0);
+
+	for(int y = Begin; y < End; y++)
 		for(int x = Area.x; x < Area.x + Area.w; x++)
 		{
-			CTile *pTile = &(pLayer->m_pTiles[y*pLayer->m_Width+x]);
-			if(pTile->m_Index == 0)
+			if(pIndices[(y-Copy.y)*Copy.w+x-Copy.x] == 0)
 				continue;
 
-			pTile->m_Index = BaseTile;
+			// the tile itself is read as mapped so far, the others as they were.
+			// neighbours beyond the border repeat the border
+			int Index = pConf->m_BaseTile;
+			int Flags = 0;
+			bool Matched = false;
+
+			uint64 Full = 0;
+			for(int c = 0; c < pConf->m_aWindow.size(); c++)
+			{
+				const CWindowCell *pCell = &pConf->m_aWindow[c];
+				int CheckX = clamp(x+pCell->m_X, 0, Width-1);
+				int CheckY = clamp(y+pCell->m_Y, 0, Height-1);
+				int Check = CheckX == x && CheckY == y ? Index : pIndices[(CheckY-Copy.y)*Copy.w+CheckX-Copy.x];
+				if(Check > 0)
+					Full |= pCell->m_Bit;
+			}
 
 			for(int i = 0; i < pConf->m_aRules.size(); ++i)
 			{
+				const CRule *pRule = &pConf->m_aRules[i];
+				if((Full&pRule->m_FullMask) != pRule->m_FullMask || (Full&pRule->m_EmptyMask))
+					continue;
+
 				bool RespectRules = true;
-				for(int j = 0; j < pConf->m_aRules[i].m_aConditions.size() && RespectRules; ++j)
+				for(int j = 0; j < pRule->m_aSlowConditions.size() && RespectRules; ++j)
 				{
-					CRuleCondition *pCondition = &pConf->m_aRules[i].m_aConditions[j];
-					int CheckIndex = clamp((y+pCondition->m_Y), 0, pLayer->m_Height-1)*pLayer->m_Width+clamp((x+pCondition->m_X), 0, pLayer->m_Width-1);
-
-					if(CheckIndex < 0 || CheckIndex >= MaxIndex)
-						RespectRules = false;
+					const CRuleCondition *pCondition = &pRule->m_aSlowConditions[j];
+					int CheckX = clamp(x+pCondition->m_X, 0, Width-1);
+					int CheckY = clamp(y+pCondition->m_Y, 0, Height-1);
+					int Check = CheckX == x && CheckY == y ? Index : pIndices[(CheckY-Copy.y)*Copy.w+CheckX-Copy.x];
+
+					if(pCondition->m_Value == CRuleCondition::EMPTY)
+						RespectRules = Check == 0;
+					else if(pCondition->m_Value == CRuleCondition::FULL)
+						RespectRules = Check > 0;
 					else
-					{
- 						if(pCondition->m_Value == CRuleCondition::EMPTY || pCondition->m_Value == CRuleCondition::FULL)
-						{
-							if(pLayer->m_pTiles[CheckIndex].m_Index > 0 && pCondition->m_Value == CRuleCondition::EMPTY)
-								RespectRules = false;
-
-							if(pLayer->m_pTiles[CheckIndex].m_Index == 0 && pCondition->m_Value == CRuleCondition::FULL)
-								RespectRules = false;
-						}
-						else
-						{
-							if(pLayer->m_pTiles[CheckIndex].m_Index != pCondition->m_Value)
-								RespectRules = false;
-						}
-					}
+						RespectRules = Check == pCondition->m_Value;
 				}
 
-				if(RespectRules && (pConf->m_aRules[i].m_Random <= 1 || (int)(random_float() * pConf->m_aRules[i].m_Random) == 1))
+				if(RespectRules && (pRule->m_Random <= 1 || (int)(TileRandom(pRun->m_Seed, x, y, i) * pRule->m_Random) == 1))
 				{
-					pTile->m_Index = pConf->m_aRules[i].m_Index;
-					pTile->m_Flags = 0;
+					Index = pRule->m_Index;
+					Flags = 0;
+					Matched = true;
+
+					// a rule may empty the tile for the ones after it
+					Full = Index > 0 ? Full|CenterBit : Full&~CenterBit;
 
 					// rotate
-					if(pConf->m_aRules[i].m_Rotation == 90)
-						pTile->m_Flags ^= TILEFLAG_ROTATE;
-					else if(pConf->m_aRules[i].m_Rotation == 180)
-						pTile->m_Flags ^= (TILEFLAG_HFLIP|TILEFLAG_VFLIP);
-					else if(pConf->m_aRules[i].m_Rotation == 270)
-						pTile->m_Flags ^= (TILEFLAG_HFLIP|TILEFLAG_VFLIP|TILEFLAG_ROTATE);
+					if(pRule->m_Rotation == 90)
+						Flags ^= TILEFLAG_ROTATE;
+					else if(pRule->m_Rotation == 180)
+						Flags ^= (TILEFLAG_HFLIP|TILEFLAG_VFLIP);
+					else if(pRule->m_Rotation == 270)
+						Flags ^= (TILEFLAG_HFLIP|TILEFLAG_VFLIP|TILEFLAG_ROTATE);
 
 					// flip
-					if(pConf->m_aRules[i].m_HFlip)
-						pTile->m_Flags ^= pTile->m_Flags&TILEFLAG_ROTATE ? TILEFLAG_HFLIP : TILEFLAG_VFLIP;
-					if(pConf->m_aRules[i].m_VFlip)
-						pTile->m_Flags ^= pTile->m_Flags&TILEFLAG_ROTATE ? TILEFLAG_VFLIP : TILEFLAG_HFLIP;
+					if(pRule->m_HFlip)
+						Flags ^= Flags&TILEFLAG_ROTATE ? TILEFLAG_HFLIP : TILEFLAG_VFLIP;
+					if(pRule->m_VFlip)
+						Flags ^= Flags&TILEFLAG_ROTATE ? TILEFLAG_VFLIP : TILEFLAG_HFLIP;
 				}
 			}
+
+			CTile *pTile = &pLayer->m_pTiles[y*Width+x];
+			pTile->m_Index = Index;
+			if(Matched)
+				pTile->m_Flags = Flags;
 		}
+}
+
+void CTilesetMapper::Proceed(CLayerTiles *pLayer, int ConfigID, RECTi Area)
+{
+	if(pLayer->m_Readonly || ConfigID < 0 || ConfigID >= m_aRuleSets.size())
+		return;
+
+	CRuleSet *pConf = &m_aRuleSets[ConfigID];
+
+	if(!pConf->m_aRules.size())
+		return;
+
+	pLayer->Clamp(&Area);
+	if(Area.w <= 0 || Area.h <= 0)
+		return;
+
+	m_pEditor->m_History.RecordTiles(pLayer, Area);
+
+	// rules read a copy of the layer, so that every row can be mapped on its own
+	CRun Run;
+	Run.m_pConf = pConf;
+	Run.m_pLayer = pLayer;
+	Run.m_Area = Area;
+	Run.m_Seed = random_int();
+	RECTi Copy = {Area.x-pConf->m_Radius, Area.y-pConf->m_Radius, Area.w+pConf->m_Radius*2, Area.h+pConf->m_Radius*2};
+	pLayer->Clamp(&Copy);
+	Run.m_Copy = Copy;
+	Run.m_pIndices = (unsigned char *)mem_alloc_tag(Copy.w*Copy.h, 1, MEMTAG_EDITOR);
+	for(int y = 0; y < Copy.h; y++)
+		for(int x = 0; x < Copy.w; x++)
+			Run.m_pIndices[y*Copy.w+x] = pLayer->m_pTiles[(Copy.y+y)*pLayer->m_Width+Copy.x+x].m_Index;
+
+	// auto map !
+	m_pEditor->Engine()->JobPool()->ParallelFor(Area.y, Area.y+Area.h, 16, ProceedRows, &Run, CJobPool::PRIORITY_HIGH);
+
+	mem_free(Run.m_pIndices);
+	pLayer->TilesChanged(Area);
 
 	m_pEditor->m_Map.m_Modified = true;
 }
 
+void CTilesetMapper::ProceedChanged(CLayerTiles *pLayer, int ConfigID, RECTi Changed)
+{
+	if(ConfigID < 0 || ConfigID >= m_aRuleSets.size())
+		return;
+
+	// a tile sees the changed ones when they are within the reach of its conditions
+	int Radius = m_aRuleSets[ConfigID].m_Radius;
+	RECTi Area = {Changed.x-Radius, Changed.y-Radius, Changed.w+Radius*2, Changed.h+Radius*2};
+	Proceed(pLayer, ConfigID, Area);
+}
+
 void CDoodadsMapper::Load(const json_value &rElement)
 {
 	for(unsigned i = 0; i < rElement.u.array.length; ++i)
@@ -651,6 +783,7 @@ void CDoodadsMapper::Proceed(CLayerTiles *pLayer, int ConfigID, int Amount)
 		return;
 
 	int MaxIndex = pLayer->m_Width*pLayer->m_Height;
+	m_pEditor->m_History.RecordTiles(pLayer);
 
 	// clear tiles
 	for(int i = 0 ; i < MaxIndex; i++)
@@ -688,6 +821,7 @@ void CDoodadsMapper::Proceed(CLayerTiles *pLayer, int ConfigID, int Amount)
 			PlaceDoodads(pLayer, pRule, &m_LeftWallIDs, Amount, 1);
 		}
 	}
+	pLayer->TilesChanged();
 
 	m_pEditor->m_Map.m_Modified = true;
 }
@@ -32,6 +32,8 @@ public:
 	virtual void Load(const json_value &rElement) = 0;
 	virtual void Proceed(class CLayerTiles *pLayer, int ConfigID, RECTi Area) {}
 	virtual void Proceed(class CLayerTiles *pLayer, int ConfigID, int Ammount) {} // for convenience purposes
+	// remaps what an edit of the tiles in Changed can affect
+	virtual void ProceedChanged(class CLayerTiles *pLayer, int ConfigID, RECTi Changed) {}
 
 	virtual int RuleSetNum() = 0;
 	virtual const char* GetRuleSetName(int Index) const = 0;
@@ -78,6 +80,19 @@ class CTilesetMapper: public IAutoMapper
 		int m_Rotation;
 
 		array<CRuleCondition> m_aConditions;
+
+		// compiled from m_aConditions: empty and full tests near the tile are bits
+		// of the rule set's window, the others get checked one by one
+		uint64 m_FullMask;
+		uint64 m_EmptyMask;
+		array<CRuleCondition> m_aSlowConditions;
+	};
+
+	struct CWindowCell
+	{
+		int m_X;
+		int m_Y;
+		uint64 m_Bit;
 	};
 
 	struct CRuleSet
@@ -86,15 +101,32 @@ class CTilesetMapper: public IAutoMapper
 		int m_BaseTile;
 
 		array<CRule> m_aRules;
+
+		// the cells any rule tests for empty or full, and how far the conditions reach
+		array<CWindowCell> m_aWindow;
+		int m_Radius;
+	};
+
+	enum
+	{
+		WINDOW_RADIUS=3,
+		WINDOW_SIZE=WINDOW_RADIUS*2+1,
 	};
 
 	array<CRuleSet> m_aRuleSets;
 
+	static uint64 WindowBit(int x, int y) { return (uint64)1 << ((y+WINDOW_RADIUS)*WINDOW_SIZE+x+WINDOW_RADIUS); }
+	static void CompileRuleSet(CRuleSet *pRuleSet);
+
+	struct CRun;
+	static void ProceedRows(int Begin, int End, void *pUser);
+
 public:
 	CTilesetMapper(class CEditor *pEditor) : IAutoMapper(pEditor, TYPE_TILESET) { m_aRuleSets.clear(); }
 
 	virtual void Load(const json_value &rElement);
 	virtual void Proceed(class CLayerTiles *pLayer, int ConfigID, RECTi Area);
+	virtual void ProceedChanged(class CLayerTiles *pLayer, int ConfigID, RECTi Changed);
 
 	virtual int RuleSetNum() { return m_aRuleSets.size(); }
 	virtual const char* GetRuleSetName(int Index) const;
@@ -8,6 +8,7 @@
 #include <engine/shared/config.h>
 #include <engine/client.h>
 #include <engine/console.h>
+#include <engine/engine.h>
 #include <engine/graphics.h>
 #include <engine/input.h>
 #include <engine/keys.h>
@@ -217,7 +218,7 @@ void CEditorImage::LoadAutoMapper()
 	if(!File)
 		return;
 	int FileSize = (int)io_length(File);
-	char *pFileData = (char *)mem_alloc(FileSize, 1);
+	char *pFileData = (char *)mem_alloc_tag(FileSize, 1, MEMTAG_EDITOR);
 	io_read(File, pFileData, FileSize);
 	io_close(File);
 
@@ -665,24 +666,30 @@ void CEditor::RenderGrid(CLayerGroup *pGroup)
 	int XGridOffset = XOffset % m_GridFactor;
 	int YGridOffset = YOffset % m_GridFactor;
 
+	// only the lines within the view
+	int NumLines = (int)(max(aGroupPoints[2]-aGroupPoints[0], aGroupPoints[3]-aGroupPoints[1])/LineDistance)+2;
+	NumLines = min(NumLines, (int)w);
+	vec4 OuterColor = HexToRgba(Config()->m_EdColorGridOuter);
+	vec4 InnerColor = HexToRgba(Config()->m_EdColorGridInner);
+
 	Graphics()->TextureClear();
 	Graphics()->LinesBegin();
 
-	for(int i = 0; i < (int)w; i++)
+	for(int i = 0; i < NumLines; i++)
 	{
 		if((i+YGridOffset) % m_GridFactor == 0)
-			GridColor = HexToRgba(Config()->m_EdColorGridOuter);
+			GridColor = OuterColor;
 		else
-			GridColor = HexToRgba(Config()->m_EdColorGridInner);
+			GridColor = InnerColor;
 
 		Graphics()->SetColor(GridColor.r, GridColor.g, GridColor.b, GridColor.a);
 		IGraphics::CLineItem Line = IGraphics::CLineItem(LineDistance*XOffset, LineDistance*i+LineDistance*YOffset, w+aGroupPoints[2], LineDistance*i+LineDistance*YOffset);
 		Graphics()->LinesDraw(&Line, 1);
 
 		if((i+XGridOffset) % m_GridFactor == 0)
-			GridColor = HexToRgba(Config()->m_EdColorGridOuter);
+			GridColor = OuterColor;
 		else
-			GridColor = HexToRgba(Config()->m_EdColorGridInner);
+			GridColor = InnerColor;
 
 		Graphics()->SetColor(GridColor.r, GridColor.g, GridColor.b, GridColor.a);
 		Line = IGraphics::CLineItem(LineDistance*i+LineDistance*XOffset, LineDistance*YOffset, LineDistance*i+LineDistance*XOffset, h+aGroupPoints[3]);
@@ -3463,6 +3470,8 @@ void CEditor::RenderStatusbar(CUIRect View)
 		else
 			UI()->DoLabel(&View, m_pTooltip, 10.0f, CUI::ALIGN_LEFT);
 	}
+	else if(m_aStatus[0] && time_get() < m_StatusTime+time_freq()*5)
+		UI()->DoLabel(&View, m_aStatus, 10.0f, CUI::ALIGN_LEFT);
 }
 
 void CEditor::RenderEnvelopeEditor(CUIRect View)
@@ -4459,6 +4468,8 @@ void CEditorMap::MakeGameGroup(CLayerGroup *pGroup)
 
 void CEditorMap::Clean()
 {
+	if(m_pEditor)
+		m_pEditor->m_History.Clear();
 	m_lGroups.delete_all();
 	m_lEnvelopes.delete_all();
 	m_lImages.delete_all();
@@ -4510,9 +4521,11 @@ void CEditor::Init()
 	m_pGraphics = Kernel()->RequestInterface<IGraphics>();
 	m_pTextRender = Kernel()->RequestInterface<ITextRender>();
 	m_pStorage = Kernel()->RequestInterface<IStorage>();
+	m_pEngine = Kernel()->RequestInterface<IEngine>();
 	m_RenderTools.Init(m_pConfig, m_pGraphics, &m_UI);
 	m_UI.Init(m_pConfig, m_pGraphics, m_pInput, m_pTextRender);
 	m_Map.m_pEditor = this;
+	m_History.Init(this);
 
 	m_CheckerTexture = Graphics()->LoadTexture("editor/checker.png", IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, 0);
 	m_BackgroundTexture = Graphics()->LoadTexture("editor/background.png", IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, 0);
@@ -4592,6 +4605,7 @@ void CEditor::DoMapMagic(int ImageID, int SrcIndex)
 				CLayerTiles *pLayer = static_cast<CLayerTiles *>(m_Map.m_lGroups[g]->m_lLayers[i]);
 				if(pLayer->m_Image == ImageID)
 				{
+					m_History.RecordTiles(pLayer);
 					for(int Count = 0; Count < pLayer->m_Height*pLayer->m_Width; ++Count)
 					{
 						if(SrcIndex == 0)	// grass_doodads
@@ -4617,6 +4631,7 @@ void CEditor::DoMapMagic(int ImageID, int SrcIndex)
 							}
 						}
 					}
+					pLayer->TilesChanged();
 				}
 			}
 		}
@@ -4627,6 +4642,7 @@ void CEditor::DoMapBorder()
 {
 	CLayerTiles *pT = (CLayerTiles *)GetSelectedLayerType(0, LAYERTYPE_TILES);
 
+	m_History.RecordTiles(pT);
 	for(int i = 0; i < pT->m_Width*2; ++i)
 		pT->m_pTiles[i].m_Index = 1;
 
@@ -4638,6 +4654,7 @@ void CEditor::DoMapBorder()
 
 	for(int i = (pT->m_Width*(pT->m_Height-2)); i < pT->m_Width*pT->m_Height; ++i)
 		pT->m_pTiles[i].m_Index = 1;
+	pT->TilesChanged();
 }
 
 void CEditor::UpdateAndRender()
@@ -4645,6 +4662,8 @@ void CEditor::UpdateAndRender()
 	static float s_MouseX = 0.0f;
 	static float s_MouseY = 0.0f;
 
+	UpdateSave(false);
+
 	if(m_Animate)
 		m_AnimateTime = (time_get()-m_AnimateStart)/(float)time_freq();
 	else
@@ -4701,6 +4720,20 @@ void CEditor::UpdateAndRender()
 	if(Input()->KeyPress(KEY_TAB))
 		m_GuiActive = !m_GuiActive;
 
+	// a step lasts while a mouse button is held, a brush stroke is undone at once
+	if(!UI()->MouseButton(0) && !UI()->MouseButton(1))
+		m_History.EndStep();
+
+	// ctrl+z to undo, ctrl+y or ctrl+shift+z to redo
+	if((Input()->KeyIsPressed(KEY_LCTRL) || Input()->KeyIsPressed(KEY_RCTRL)) && m_Dialog == DIALOG_NONE && !m_EditBoxActive)
+	{
+		bool Shift = Input()->KeyIsPressed(KEY_LSHIFT) || Input()->KeyIsPressed(KEY_RSHIFT);
+		if(Input()->KeyPress(KEY_Z) && !Shift)
+			SetStatus(m_History.Undo() ? "Undone" : "Nothing to undo");
+		else if(Input()->KeyPress(KEY_Y) || (Input()->KeyPress(KEY_Z) && Shift))
+			SetStatus(m_History.Redo() ? "Redone" : "Nothing to redo");
+	}
+
 	if(Input()->KeyPress(KEY_F10))
 		m_ShowMousePointer = false;
 
@@ -24,6 +24,7 @@
 #include <engine/graphics.h>
 
 #include "auto_map.h"
+#include "history.h"
 
 typedef void (*INDEX_MODIFY_FUNC)(int *pIndex);
 
@@ -444,6 +445,11 @@ public:
 	void PrepareForSave();
 	void ExtractTiles(CTile *pSavedTiles);
 
+	// has to be called after changing m_pTiles, the whole layer without a rect
+	void TilesChanged();
+	void TilesChanged(RECTi Rect);
+	bool UpdateIndices();
+
 	void GetSize(float *w, float *h) const { *w = m_Width*32.0f; *h = m_Height*32.0f; }
 
 	IGraphics::CTextureHandle m_Texture;
@@ -460,6 +466,17 @@ public:
 	int m_SelectedRuleSet;
 	bool m_LiveAutoMap;
 	int m_SelectedAmount;
+
+	// the tiles uploaded for the tilemap shader, the dirty rect is
+	// updated before the layer is drawn again
+	IGraphics::CTextureHandle m_Indices;
+	int m_IndicesWidth;
+	int m_IndicesHeight;
+	bool m_IndicesFailed;
+	RECTi m_DirtyIndices;
+
+	// the history step that saved each chunk last
+	array<int> m_lHistoryMarks;
 };
 
 class CLayerQuads : public CLayer
@@ -487,6 +504,7 @@ public:
 
 	int m_Image;
 	array<CQuad> m_lQuads;
+	array<CQuadBounds> m_lBounds;
 };
 
 class CLayerGame : public CLayerTiles
@@ -507,6 +525,7 @@ class CEditor : public IEditor
 	class IGraphics *m_pGraphics;
 	class ITextRender *m_pTextRender;
 	class IStorage *m_pStorage;
+	class IEngine *m_pEngine;
 	CRenderTools m_RenderTools;
 	CUI m_UI;
 public:
@@ -517,6 +536,7 @@ public:
 	class IGraphics *Graphics() { return m_pGraphics; }
 	class ITextRender *TextRender() { return m_pTextRender; }
 	class IStorage *Storage() { return m_pStorage; }
+	class IEngine *Engine() { return m_pEngine; }
 	CUI *UI() { return &m_UI; }
 	CRenderTools *RenderTools() { return &m_RenderTools; }
 
@@ -531,6 +551,9 @@ public:
 		m_Dialog = 0;
 		m_EditBoxActive = 0;
 		m_pTooltip = 0;
+		m_aStatus[0] = 0;
+		m_StatusTime = 0;
+		m_pSaveJob = 0;
 
 		m_GridActive = false;
 		m_GridFactor = 1;
@@ -599,6 +622,7 @@ public:
 	virtual void Init();
 	virtual void UpdateAndRender();
 	virtual bool HasUnsavedData() const { return m_Map.m_Modified; }
+	~CEditor();
 
 	void FilelistPopulate(int StorageType);
 	void InvokeFileDialog(int StorageType, int FileType, const char *pTitle, const char *pButtonText,
@@ -607,6 +631,12 @@ public:
 
 	void Reset(bool CreateDefault=true);
 	int Save(const char *pFilename);
+
+	// the map is copied into the writer on the ui thread, compressing and writing it runs on a job
+	struct CSaveJob *m_pSaveJob;
+	static int SaveJob(void *pData);
+	void StartSave(class CDataFileWriter *pWriter, const char *pFilename);
+	void UpdateSave(bool Wait);
 	int Load(const char *pFilename, int StorageType);
 	void LoadCurrentMap();
 	int Append(const char *pFilename, int StorageType);
@@ -624,6 +654,11 @@ public:
 	int m_EditBoxActive;
 	const char *m_pTooltip;
 
+	// shown in the status bar for a few seconds when there is no tooltip
+	char m_aStatus[128];
+	int64 m_StatusTime;
+	void SetStatus(const char *pText) { str_copy(m_aStatus, pText, sizeof(m_aStatus)); m_StatusTime = time_get(); }
+
 	bool m_GridActive;
 	int m_GridFactor;
 
@@ -754,6 +789,7 @@ public:
 
 	static const void *ms_pUiGotContext;
 
+	CEditorHistory m_History;
 	CEditorMap m_Map;
 
 	static void EnvelopeEval(float TimeOffset, int Env, float *pChannels, void *pUser);
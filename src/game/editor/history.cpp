@@ -0,0 +1,202 @@
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/console.h>
+
+#include "editor.h"
+#include "history.h"
+
+CEditorHistory::CEditorHistory()
+{
+	m_pEditor = 0;
+	m_NumDone = 0;
+	m_pCurrent = 0;
+	m_CurrentId = 0;
+	m_MemSize = 0;
+}
+
+CEditorHistory::~CEditorHistory()
+{
+	Clear();
+}
+
+void CEditorHistory::FreeChunks(CStep *pStep)
+{
+	for(int i = 0; i < pStep->m_lChunks.size(); i++)
+		delete [] pStep->m_lChunks[i].m_pTiles;
+	pStep->m_lChunks.clear();
+	pStep->m_MemSize = 0;
+}
+
+void CEditorHistory::Clear()
+{
+	for(int i = 0; i < m_lSteps.size(); i++)
+	{
+		FreeChunks(m_lSteps[i]);
+		delete m_lSteps[i];
+	}
+	m_lSteps.clear();
+	if(m_pCurrent)
+	{
+		FreeChunks(m_pCurrent);
+		delete m_pCurrent;
+		m_pCurrent = 0;
+	}
+	m_NumDone = 0;
+	m_MemSize = 0;
+}
+
+bool CEditorHistory::LayerExists(const CLayerTiles *pLayer) const
+{
+	const CEditorMap *pMap = &m_pEditor->m_Map;
+	for(int g = 0; g < pMap->m_lGroups.size(); g++)
+		for(int i = 0; i < pMap->m_lGroups[g]->m_lLayers.size(); i++)
+			if(pMap->m_lGroups[g]->m_lLayers[i] == pLayer)
+				return true;
+	return false;
+}
+
+void CEditorHistory::RecordTiles(CLayerTiles *pLayer, RECTi Rect)
+{
+	pLayer->Clamp(&Rect);
+	if(Rect.w <= 0 || Rect.h <= 0)
+		return;
+
+	if(!m_pCurrent)
+	{
+		// a new change can't be redone over
+		while(m_lSteps.size() > m_NumDone)
+		{
+			CStep *pStep = m_lSteps[m_lSteps.size()-1];
+			m_MemSize -= pStep->m_MemSize;
+			FreeChunks(pStep);
+			delete pStep;
+			m_lSteps.remove_index(m_lSteps.size()-1);
+		}
+
+		m_pCurrent = new CStep;
+		m_pCurrent->m_MemSize = 0;
+		m_pCurrent->m_Overflow = false;
+		m_CurrentId++;
+	}
+	if(m_pCurrent->m_Overflow)
+		return;
+
+	// chunks the step saved already have the id of the step
+	const int NumChunksX = (pLayer->m_Width+CHUNK_SIZE-1)/CHUNK_SIZE;
+	const int NumChunksY = (pLayer->m_Height+CHUNK_SIZE-1)/CHUNK_SIZE;
+	if(pLayer->m_lHistoryMarks.size() != NumChunksX*NumChunksY)
+	{
+		pLayer->m_lHistoryMarks.set_size(NumChunksX*NumChunksY);
+		for(int i = 0; i < NumChunksX*NumChunksY; i++)
+			pLayer->m_lHistoryMarks[i] = 0;
+	}
+
+	for(int cy = Rect.y/CHUNK_SIZE; cy <= (Rect.y+Rect.h-1)/CHUNK_SIZE; cy++)
+		for(int cx = Rect.x/CHUNK_SIZE; cx <= (Rect.x+Rect.w-1)/CHUNK_SIZE; cx++)
+		{
+			int *pMark = &pLayer->m_lHistoryMarks[cy*NumChunksX+cx];
+			if(*pMark == m_CurrentId)
+				continue;
+			*pMark = m_CurrentId;
+
+			CChunk Chunk;
+			Chunk.m_pLayer = pLayer;
+			Chunk.m_LayerWidth = pLayer->m_Width;
+			Chunk.m_LayerHeight = pLayer->m_Height;
+			Chunk.m_Rect.x = cx*CHUNK_SIZE;
+			Chunk.m_Rect.y = cy*CHUNK_SIZE;
+			Chunk.m_Rect.w = min((int)CHUNK_SIZE, pLayer->m_Width-Chunk.m_Rect.x);
+			Chunk.m_Rect.h = min((int)CHUNK_SIZE, pLayer->m_Height-Chunk.m_Rect.y);
+			Chunk.m_pTiles = new CTile[Chunk.m_Rect.w*Chunk.m_Rect.h];
+			for(int y = 0; y < Chunk.m_Rect.h; y++)
+				mem_copy(&Chunk.m_pTiles[y*Chunk.m_Rect.w], &pLayer->m_pTiles[(Chunk.m_Rect.y+y)*pLayer->m_Width+Chunk.m_Rect.x],
+					Chunk.m_Rect.w*sizeof(CTile));
+			m_pCurrent->m_lChunks.add(Chunk);
+			m_pCurrent->m_MemSize += Chunk.m_Rect.w*Chunk.m_Rect.h*sizeof(CTile);
+		}
+
+	// make room by forgetting the oldest steps
+	const int MaxMemSize = m_pEditor->Config()->m_EdUndoMemory*1024*1024;
+	while(m_NumDone > 0 && m_MemSize+m_pCurrent->m_MemSize > MaxMemSize)
+	{
+		m_MemSize -= m_lSteps[0]->m_MemSize;
+		FreeChunks(m_lSteps[0]);
+		delete m_lSteps[0];
+		m_lSteps.remove_index(0);
+		m_NumDone--;
+	}
+	if(m_pCurrent->m_MemSize > MaxMemSize)
+	{
+		FreeChunks(m_pCurrent);
+		m_pCurrent->m_Overflow = true;
+	}
+}
+
+void CEditorHistory::RecordTiles(CLayerTiles *pLayer)
+{
+	RECTi Rect = {0, 0, pLayer->m_Width, pLayer->m_Height};
+	RecordTiles(pLayer, Rect);
+}
+
+void CEditorHistory::EndStep()
+{
+	if(!m_pCurrent)
+		return;
+
+	if(m_pCurrent->m_Overflow || !m_pCurrent->m_lChunks.size())
+	{
+		FreeChunks(m_pCurrent);
+		delete m_pCurrent;
+	}
+	else
+	{
+		m_lSteps.add(m_pCurrent);
+		m_NumDone = m_lSteps.size();
+		m_MemSize += m_pCurrent->m_MemSize;
+	}
+	m_pCurrent = 0;
+}
+
+void CEditorHistory::SwapStep(CStep *pStep, bool Reverse)
+{
+	for(int n = 0; n < pStep->m_lChunks.size(); n++)
+	{
+		CChunk *pChunk = &pStep->m_lChunks[Reverse ? pStep->m_lChunks.size()-1-n : n];
+		CLayerTiles *pLayer = pChunk->m_pLayer;
+		if(!LayerExists(pLayer) || pLayer->m_Width != pChunk->m_LayerWidth || pLayer->m_Height != pChunk->m_LayerHeight)
+			continue;
+
+		for(int y = 0; y < pChunk->m_Rect.h; y++)
+		{
+			CTile *pSaved = &pChunk->m_pTiles[y*pChunk->m_Rect.w];
+			CTile *pTiles = &pLayer->m_pTiles[(pChunk->m_Rect.y+y)*pLayer->m_Width+pChunk->m_Rect.x];
+			for(int x = 0; x < pChunk->m_Rect.w; x++)
+			{
+				CTile Tmp = pSaved[x];
+				pSaved[x] = pTiles[x];
+				pTiles[x] = Tmp;
+			}
+		}
+		pLayer->TilesChanged(pChunk->m_Rect);
+	}
+	m_pEditor->m_Map.m_Modified = true;
+}
+
+bool CEditorHistory::Undo()
+{
+	EndStep();
+	if(m_NumDone <= 0)
+		return false;
+	SwapStep(m_lSteps[--m_NumDone], true);
+	return true;
+}
+
+bool CEditorHistory::Redo()
+{
+	EndStep();
+	if(m_NumDone >= m_lSteps.size())
+		return false;
+	SwapStep(m_lSteps[m_NumDone++], false);
+	return true;
+}
@@ -0,0 +1,68 @@
+#ifndef GAME_EDITOR_HISTORY_H
+#define GAME_EDITOR_HISTORY_H
+
+#include <base/tl/array.h>
+
+#include <game/mapitems.h>
+
+#include "auto_map.h"
+
+/*
+	Undo history of the tile layers. Layers are split into chunks and a
+	step keeps the chunks it changed, saved right before the first change.
+	Undoing swaps them with the chunks of the layer, so the step then holds
+	what redoing needs and neither copies a whole layer.
+*/
+class CEditorHistory
+{
+	enum
+	{
+		CHUNK_SIZE=32,
+	};
+
+	struct CChunk
+	{
+		class CLayerTiles *m_pLayer;
+		int m_LayerWidth;
+		int m_LayerHeight;
+		RECTi m_Rect;
+		CTile *m_pTiles;
+	};
+
+	struct CStep
+	{
+		array<CChunk> m_lChunks;
+		int m_MemSize;
+		bool m_Overflow; // too big for the history, it is dropped at its end
+	};
+
+	class CEditor *m_pEditor;
+	array<CStep *> m_lSteps;
+	int m_NumDone; // steps before this can be undone, the others redone
+	CStep *m_pCurrent;
+	int m_CurrentId;
+	int m_MemSize;
+
+	static void FreeChunks(CStep *pStep);
+	bool LayerExists(const class CLayerTiles *pLayer) const;
+	void SwapStep(CStep *pStep, bool Reverse);
+
+public:
+	CEditorHistory();
+	~CEditorHistory();
+	void Init(class CEditor *pEditor) { m_pEditor = pEditor; }
+
+	// call before changing the tiles in the rect of a map layer
+	void RecordTiles(class CLayerTiles *pLayer, RECTi Rect);
+	void RecordTiles(class CLayerTiles *pLayer);
+	// finishes the current step, the next change starts a new one
+	void EndStep();
+	void Clear();
+
+	bool CanUndo() const { return m_pCurrent || m_NumDone > 0; }
+	bool CanRedo() const { return !m_pCurrent && m_NumDone < m_lSteps.size(); }
+	bool Undo();
+	bool Redo();
+};
+
+#endif
@@ -2,8 +2,10 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <engine/client.h>
 #include <engine/console.h>
+#include <engine/engine.h>
 #include <engine/serverbrowser.h>
 #include <engine/storage.h>
+#include <engine/shared/jobs.h>
 #include <game/gamecore.h> // StrToInts, IntsToStr
 #include "editor.h"
 
@@ -11,21 +13,101 @@ template<typename T>
 static int MakeVersion(int i, const T &v)
 { return (i<<16)+sizeof(T); }
 
+struct CSaveJob
+{
+	CJob m_Job;
+	CJobGroup m_Group;
+	CDataFileWriter *m_pWriter;
+	char m_aFilename[IO_MAX_PATH_LENGTH];
+	int64 m_StartTime;
+};
+
+CEditor::~CEditor()
+{
+	UpdateSave(true);
+}
+
 int CEditor::Save(const char *pFilename)
 {
+	// the previous save could still be writing the same file
+	UpdateSave(true);
 	return m_Map.Save(Kernel()->RequestInterface<IStorage>(), pFilename);
 }
 
+int CEditor::SaveJob(void *pData)
+{
+	CSaveJob *pJob = (CSaveJob *)pData;
+	return pJob->m_pWriter->Finish();
+}
+
+void CEditor::StartSave(CDataFileWriter *pWriter, const char *pFilename)
+{
+	CSaveJob *pJob = new CSaveJob;
+	pJob->m_pWriter = pWriter;
+	str_copy(pJob->m_aFilename, pFilename, sizeof(pJob->m_aFilename));
+	pJob->m_StartTime = time_get();
+	m_pSaveJob = pJob;
+
+	if(Engine())
+		Engine()->JobPool()->Add(&pJob->m_Job, SaveJob, pJob, CJobPool::PRIORITY_BACKGROUND, &pJob->m_Group);
+	else
+		SaveJob(pJob);
+	UpdateSave(!Engine());
+}
+
+void CEditor::UpdateSave(bool Wait)
+{
+	CSaveJob *pJob = m_pSaveJob;
+	if(!pJob)
+		return;
+
+	char aBuf[256];
+	if(Engine())
+	{
+		if(Wait)
+			Engine()->JobPool()->Wait(&pJob->m_Group);
+		else if(!pJob->m_Group.Done())
+		{
+			str_format(aBuf, sizeof(aBuf), "Saving '%s'... %.1f s", pJob->m_aFilename, (time_get()-pJob->m_StartTime)/(float)time_freq());
+			SetStatus(aBuf);
+			return;
+		}
+	}
+
+	m_pSaveJob = 0;
+	delete pJob->m_pWriter;
+
+	str_format(aBuf, sizeof(aBuf), "Saved '%s' in %.1f s", pJob->m_aFilename, (time_get()-pJob->m_StartTime)/(float)time_freq());
+	SetStatus(aBuf);
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "editor", "saving done");
+
+	// send rcon.. if we can
+	if(Client()->RconAuthed())
+	{
+		CServerInfo CurrentServerInfo;
+		Client()->GetServerInfo(&CurrentServerInfo);
+		char aMapName[128];
+		ExtractName(pJob->m_aFilename, aMapName, sizeof(aMapName));
+		if(!str_comp(aMapName, CurrentServerInfo.m_aMap))
+			Client()->Rcon("reload");
+	}
+
+	delete pJob;
+}
+
 int CEditorMap::Save(class IStorage *pStorage, const char *pFileName)
 {
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "saving to '%s'...", pFileName);
 	m_pEditor->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "editor", aBuf);
-	CDataFileWriter df;
-	if(!df.Open(pStorage, pFileName))
+	// with a pool the writer keeps copies of the data, so the map can change while it is written
+	CDataFileWriter *pWriter = new CDataFileWriter;
+	CDataFileWriter &df = *pWriter;
+	if(!df.Open(pStorage, pFileName, m_pEditor->Engine() ? m_pEditor->Engine()->JobPool() : 0))
 	{
 		str_format(aBuf, sizeof(aBuf), "failed to open file '%s'...", pFileName);
 		m_pEditor->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "editor", aBuf);
+		delete pWriter;
 		return 0;
 	}
 
@@ -215,7 +297,7 @@ int CEditorMap::Save(class IStorage *pStorage, const char *pFileName)
 
 	// save points
 	int TotalSize = Size * PointCount;
-	unsigned char *pPoints = (unsigned char *)mem_alloc(TotalSize, 1);
+	unsigned char *pPoints = (unsigned char *)mem_alloc_tag(TotalSize, 1, MEMTAG_EDITOR);
 	int Offset = 0;
 	for(int e = 0; e < m_lEnvelopes.size(); e++)
 	{
@@ -230,25 +312,14 @@ int CEditorMap::Save(class IStorage *pStorage, const char *pFileName)
 	mem_free(pPoints);
 
 	// finish the data file
-	df.Finish();
-	m_pEditor->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "editor", "saving done");
-
-	// send rcon.. if we can
-	if(m_pEditor->Client()->RconAuthed())
-	{
-		CServerInfo CurrentServerInfo;
-		m_pEditor->Client()->GetServerInfo(&CurrentServerInfo);
-		char aMapName[128];
-		m_pEditor->ExtractName(pFileName, aMapName, sizeof(aMapName));
-		if(!str_comp(aMapName, CurrentServerInfo.m_aMap))
-			m_pEditor->Client()->Rcon("reload");
-	}
+	m_pEditor->StartSave(pWriter, pFileName);
 
 	return 1;
 }
 
 int CEditor::Load(const char *pFileName, int StorageType)
 {
+	UpdateSave(true);
 	Reset();
 	return m_Map.Load(Kernel()->RequestInterface<IStorage>(), pFileName, StorageType);
 }
@@ -258,6 +329,30 @@ void CEditor::LoadCurrentMap()
 	CallbackOpenMap(m_pClient->GetCurrentMapPath(), IStorage::TYPE_ALL, this);
 }
 
+struct CExternalImage
+{
+	char m_aFilename[IO_MAX_PATH_LENGTH];
+	int m_Loaded;
+	CImageInfo m_Info;
+};
+
+struct CExternalImages
+{
+	IGraphics *m_pGraphics;
+	CExternalImage *m_paImages;
+};
+
+static void LoadExternalImages(int Begin, int End, void *pUser)
+{
+	CExternalImages *pImages = (CExternalImages *)pUser;
+	for(int i = Begin; i < End; i++)
+	{
+		CExternalImage *pImage = &pImages->m_paImages[i];
+		if(pImage->m_aFilename[0])
+			pImage->m_Loaded = pImages->m_pGraphics->LoadPNG(&pImage->m_Info, pImage->m_aFilename, IStorage::TYPE_ALL);
+	}
+}
+
 int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int StorageType)
 {
 	CDataFileReader DataFile;
@@ -266,6 +361,31 @@ int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int Storag
 
 	Clean();
 
+	// decompress the tiles and embedded images at once on the pool, the code below only copies
+	// them. quads get swapped and stay loaded on first use
+	CJobPool *pPool = m_pEditor->Engine() ? m_pEditor->Engine()->JobPool() : 0;
+	if(pPool)
+	{
+		array<int> lIndices;
+		int Start, Num;
+		DataFile.GetType(MAPITEMTYPE_IMAGE, &Start, &Num);
+		for(int i = 0; i < Num; i++)
+		{
+			CMapItemImage *pItem = (CMapItemImage *)DataFile.GetItem(Start+i, 0, 0);
+			if(!pItem->m_External && pItem->m_ImageData >= 0)
+				lIndices.add(pItem->m_ImageData);
+		}
+		DataFile.GetType(MAPITEMTYPE_LAYER, &Start, &Num);
+		for(int i = 0; i < Num; i++)
+		{
+			CMapItemLayer *pItem = (CMapItemLayer *)DataFile.GetItem(Start+i, 0, 0);
+			if(pItem->m_Type == LAYERTYPE_TILES && ((CMapItemLayerTilemap *)pItem)->m_Data >= 0)
+				lIndices.add(((CMapItemLayerTilemap *)pItem)->m_Data);
+		}
+		if(lIndices.size())
+			DataFile.Prefetch(pPool, lIndices.base_ptr(), lIndices.size(), 0);
+	}
+
 	// check version
 	CMapItemVersion *pItem = (CMapItemVersion *)DataFile.FindItem(MAPITEMTYPE_VERSION, 0);
 	if(!pItem)
@@ -294,6 +414,26 @@ int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int Storag
 		{
 			int Start, Num;
 			DataFile.GetType( MAPITEMTYPE_IMAGE, &Start, &Num);
+
+			// decode the external images on the pool, only the textures have to be made here
+			CExternalImages External;
+			External.m_pGraphics = m_pEditor->Graphics();
+			External.m_paImages = new CExternalImage[max(Num, 1)];
+			for(int i = 0; i < Num; i++)
+			{
+				CMapItemImage *pItem = (CMapItemImage *)DataFile.GetItem(Start+i, 0, 0);
+				CExternalImage *pExternal = &External.m_paImages[i];
+				pExternal->m_aFilename[0] = 0;
+				pExternal->m_Loaded = 0;
+				pExternal->m_Info.m_pData = 0;
+				if(pItem->m_External || (pItem->m_Version > 1 && pItem->m_Format != CImageInfo::FORMAT_RGB && pItem->m_Format != CImageInfo::FORMAT_RGBA))
+					str_format(pExternal->m_aFilename, sizeof(pExternal->m_aFilename), "mapres/%s.png", (char *)DataFile.GetData(pItem->m_ImageName));
+			}
+			if(pPool)
+				pPool->ParallelFor(0, Num, 1, LoadExternalImages, &External);
+			else
+				LoadExternalImages(0, Num, &External);
+
 			for(int i = 0; i < Num; i++)
 			{
 				CMapItemImage *pItem = (CMapItemImage *)DataFile.GetItem(Start+i, 0, 0);
@@ -303,18 +443,18 @@ int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int Storag
 				CEditorImage *pImg = new CEditorImage(m_pEditor);
 				pImg->m_External = pItem->m_External;
 
-				if(pItem->m_External || (pItem->m_Version > 1 && pItem->m_Format != CImageInfo::FORMAT_RGB && pItem->m_Format != CImageInfo::FORMAT_RGBA))
+				if(External.m_paImages[i].m_aFilename[0])
 				{
-					char aBuf[IO_MAX_PATH_LENGTH];
-					str_format(aBuf, sizeof(aBuf),"mapres/%s.png", pName);
-
 					// load external
-					CEditorImage ImgInfo(m_pEditor);
-					if(m_pEditor->Graphics()->LoadPNG(&ImgInfo, aBuf, IStorage::TYPE_ALL))
+					CImageInfo *pInfo = &External.m_paImages[i].m_Info;
+					if(External.m_paImages[i].m_Loaded)
 					{
-						*pImg = ImgInfo;
-						pImg->m_Texture = m_pEditor->Graphics()->LoadTextureRaw(ImgInfo.m_Width, ImgInfo.m_Height, ImgInfo.m_Format, ImgInfo.m_pData, CImageInfo::FORMAT_AUTO, IGraphics::TEXLOAD_MULTI_DIMENSION);
-						ImgInfo.m_pData = 0;
+						pImg->m_Width = pInfo->m_Width;
+						pImg->m_Height = pInfo->m_Height;
+						pImg->m_Format = pInfo->m_Format;
+						pImg->m_pData = pInfo->m_pData;
+						pImg->m_Texture = m_pEditor->Graphics()->LoadTextureRaw(pInfo->m_Width, pInfo->m_Height, pInfo->m_Format, pInfo->m_pData, CImageInfo::FORMAT_AUTO, IGraphics::TEXLOAD_MULTI_DIMENSION);
+						pInfo->m_pData = 0;
 						pImg->m_External = 1;
 					}
 				}
@@ -327,7 +467,7 @@ int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int Storag
 
 					// copy image data
 					void *pData = DataFile.GetData(pItem->m_ImageData);
-					pImg->m_pData = mem_alloc(pImg->m_Width*pImg->m_Height*PixelSize, 1);
+					pImg->m_pData = mem_alloc_tag(pImg->m_Width*pImg->m_Height*PixelSize, 1, MEMTAG_EDITOR);
 					mem_copy(pImg->m_pData, pData, pImg->m_Width*pImg->m_Height*PixelSize);
 					pImg->m_Texture = m_pEditor->Graphics()->LoadTextureRaw(pImg->m_Width, pImg->m_Height, pImg->m_Format, pImg->m_pData, CImageInfo::FORMAT_AUTO, IGraphics::TEXLOAD_MULTI_DIMENSION);
 				}
@@ -345,6 +485,8 @@ int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int Storag
 				DataFile.UnloadData(pItem->m_ImageData);
 				DataFile.UnloadData(pItem->m_ImageName);
 			}
+
+			delete[] External.m_paImages;
 		}
 
 		// load groups
@@ -29,10 +29,24 @@ void CLayerQuads::Render()
 	if(m_Image >= 0 && m_Image < m_pEditor->m_Map.m_lImages.size())
 		Graphics()->TextureSet(m_pEditor->m_Map.m_lImages[m_Image]->m_Texture);
 
-	//Graphics()->BlendNone();
-	//m_pEditor->RenderTools()->RenderQuads(m_lQuads.base_ptr(), m_lQuads.size(), LAYERRENDERFLAG_OPAQUE, m_pEditor->EnvelopeEval, m_pEditor);
+	// the quads can change any frame, their bounds are cheap compared to drawing them
+	const array<CEnvelope *> &lEnvelopes = m_pEditor->m_Map.m_lEnvelopes;
+	m_lBounds.set_size(m_lQuads.size());
+	for(int i = 0; i < m_lQuads.size(); i++)
+	{
+		const CQuad *pQuad = &m_lQuads[i];
+		if(pQuad->m_PosEnv >= 0 && pQuad->m_PosEnv < lEnvelopes.size())
+		{
+			float aMin[3], aMax[3];
+			CRenderTools::EnvelopeRange(lEnvelopes[pQuad->m_PosEnv]->m_lPoints.base_ptr(), lEnvelopes[pQuad->m_PosEnv]->m_lPoints.size(), aMin, aMax);
+			CRenderTools::QuadBounds(pQuad, aMin, aMax, &m_lBounds[i]);
+		}
+		else
+			CRenderTools::QuadBounds(pQuad, 0, 0, &m_lBounds[i]);
+	}
+
 	Graphics()->BlendNormal();
-	m_pEditor->RenderTools()->RenderQuads(m_lQuads.base_ptr(), m_lQuads.size(), LAYERRENDERFLAG_TRANSPARENT, m_pEditor->EnvelopeEval, m_pEditor);
+	m_pEditor->RenderTools()->RenderQuads(m_lQuads.base_ptr(), m_lQuads.size(), LAYERRENDERFLAG_TRANSPARENT, m_pEditor->EnvelopeEval, m_pEditor, m_lBounds.base_ptr());
 }
 
 CQuad *CLayerQuads::NewQuad()
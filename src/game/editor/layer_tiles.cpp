@@ -39,11 +39,19 @@ CLayerTiles::CLayerTiles(int w, int h)
 
 	m_SelectedRuleSet = 0;
 	m_LiveAutoMap = false;
+
+	m_Indices.Invalidate();
+	m_IndicesWidth = 0;
+	m_IndicesHeight = 0;
+	m_IndicesFailed = false;
+	TilesChanged();
 	m_SelectedAmount = 50;
 }
 
 CLayerTiles::~CLayerTiles()
 {
+	if(m_Indices.IsValid())
+		Graphics()->UnloadTexture(&m_Indices);
 	delete [] m_pTiles;
 	m_pTiles = 0;
 	delete [] m_pSaveTiles;
@@ -146,6 +154,7 @@ void CLayerTiles::ExtractTiles(CTile *pSavedTiles)
 
 		pSavedTiles++;
 	}
+	TilesChanged();
 }
 
 void CLayerTiles::MakePalette()
@@ -153,6 +162,80 @@ void CLayerTiles::MakePalette()
 	for(int y = 0; y < m_Height; y++)
 		for(int x = 0; x < m_Width; x++)
 			m_pTiles[y*m_Width+x].m_Index = y*16+x;
+	TilesChanged();
+}
+
+void CLayerTiles::TilesChanged()
+{
+	RECTi Rect = {0, 0, m_Width, m_Height};
+	m_DirtyIndices = Rect;
+	m_IndicesFailed = false;
+}
+
+void CLayerTiles::TilesChanged(RECTi Rect)
+{
+	Clamp(&Rect);
+	if(Rect.w <= 0 || Rect.h <= 0)
+		return;
+	if(m_DirtyIndices.w <= 0 || m_DirtyIndices.h <= 0)
+	{
+		m_DirtyIndices = Rect;
+		return;
+	}
+	int x1 = max(m_DirtyIndices.x+m_DirtyIndices.w, Rect.x+Rect.w);
+	int y1 = max(m_DirtyIndices.y+m_DirtyIndices.h, Rect.y+Rect.h);
+	m_DirtyIndices.x = min(m_DirtyIndices.x, Rect.x);
+	m_DirtyIndices.y = min(m_DirtyIndices.y, Rect.y);
+	m_DirtyIndices.w = x1-m_DirtyIndices.x;
+	m_DirtyIndices.h = y1-m_DirtyIndices.y;
+}
+
+bool CLayerTiles::UpdateIndices()
+{
+	if(m_Indices.IsValid() && (m_IndicesWidth != m_Width || m_IndicesHeight != m_Height))
+	{
+		Graphics()->UnloadTexture(&m_Indices);
+		TilesChanged();
+	}
+	if(m_IndicesFailed)
+		return false;
+
+	// only the changed tiles are uploaded again
+	RECTi Rect = m_DirtyIndices;
+	if(!m_Indices.IsValid())
+	{
+		Rect.x = 0;
+		Rect.y = 0;
+		Rect.w = m_Width;
+		Rect.h = m_Height;
+	}
+	else if(Rect.w <= 0 || Rect.h <= 0)
+		return true;
+
+	unsigned char *pIndices = (unsigned char *)mem_alloc(Rect.w*Rect.h*4, 1);
+	for(int y = 0; y < Rect.h; y++)
+		for(int x = 0; x < Rect.w; x++)
+		{
+			const CTile *pTile = &m_pTiles[(Rect.y+y)*m_Width+Rect.x+x];
+			unsigned char *pOut = &pIndices[(y*Rect.w+x)*4];
+			pOut[0] = pTile->m_Index;
+			pOut[1] = pTile->m_Flags&TILEFLAG_VFLIP ? 255 : 0;
+			pOut[2] = pTile->m_Flags&TILEFLAG_HFLIP ? 255 : 0;
+			pOut[3] = pTile->m_Flags&TILEFLAG_ROTATE ? 255 : 0;
+		}
+	if(m_Indices.IsValid())
+		Graphics()->LoadTextureRawSub(m_Indices, Rect.x, Rect.y, Rect.w, Rect.h, CImageInfo::FORMAT_RGBA, pIndices);
+	else
+	{
+		m_Indices = Graphics()->LoadTileIndices(m_Width, m_Height, pIndices);
+		m_IndicesWidth = m_Width;
+		m_IndicesHeight = m_Height;
+		m_IndicesFailed = !m_Indices.IsValid();
+	}
+	mem_free(pIndices);
+	m_DirtyIndices.w = 0;
+	m_DirtyIndices.h = 0;
+	return m_Indices.IsValid();
 }
 
 void CLayerTiles::Render()
@@ -161,6 +244,20 @@ void CLayerTiles::Render()
 		m_Texture = m_pEditor->m_Map.m_lImages[m_Image]->m_Texture;
 	Graphics()->TextureSet(m_Texture);
 	vec4 Color = vec4(m_Color.r/255.0f, m_Color.g/255.0f, m_Color.b/255.0f, m_Color.a/255.0f);
+
+	// the tilemap shader draws the layer in one quad at any zoom level
+	if(UpdateIndices())
+	{
+		float aChannels[4] = {1, 1, 1, 1};
+		if(m_ColorEnv >= 0)
+			m_pEditor->EnvelopeEval(m_ColorEnvOffset/1000.0f, m_ColorEnv, aChannels, m_pEditor);
+		const float Alpha = Color.a*aChannels[3];
+		Graphics()->BlendNormal();
+		Graphics()->RenderTileIndices(m_Indices, m_Width, m_Height, 32.0f,
+			vec4(Color.r*aChannels[0]*Alpha, Color.g*aChannels[1]*Alpha, Color.b*aChannels[2]*Alpha, Alpha), false);
+		return;
+	}
+
 	Graphics()->BlendNone();
 	m_pEditor->RenderTools()->RenderTilemap(m_pTiles, m_Width, m_Height, 32.0f, Color, LAYERRENDERFLAG_OPAQUE,
 												m_pEditor->EnvelopeEval, m_pEditor, m_ColorEnv, m_ColorEnvOffset);
@@ -277,6 +374,8 @@ void CLayerTiles::FillSelection(bool Empty, CLayer *pBrush, CUIRect Rect)
 	int h = ConvertY(Rect.h);
 
 	CLayerTiles *pLt = static_cast<CLayerTiles*>(pBrush);
+	RECTi Changed = {sx, sy, w, h};
+	m_pEditor->m_History.RecordTiles(this, Changed);
 
 	for(int y = 0; y < h; y++)
 	{
@@ -294,11 +393,12 @@ void CLayerTiles::FillSelection(bool Empty, CLayer *pBrush, CUIRect Rect)
 				m_pTiles[fy*m_Width+fx] = pLt->m_pTiles[(y*pLt->m_Width + x%pLt->m_Width) % (pLt->m_Width*pLt->m_Height)];
 		}
 	}
+	TilesChanged(Changed);
 
 	if(m_LiveAutoMap)
 	{
-		RECTi r = {sx - 1, sy - 1, w + 2, h + 2};	
-		m_pEditor->m_Map.m_lImages[m_Image]->m_pAutoMapper->Proceed(this, m_SelectedRuleSet, r);
+		RECTi r = {sx, sy, w, h};
+		m_pEditor->m_Map.m_lImages[m_Image]->m_pAutoMapper->ProceedChanged(this, m_SelectedRuleSet, r);
 	}
 
 	m_pEditor->m_Map.m_Modified = true;
@@ -317,6 +417,9 @@ void CLayerTiles::BrushDraw(CLayer *pBrush, float wx, float wy)
 	if(sx == s_lastBrushX && sy == s_lastBrushY)
 		return;
 
+	RECTi Changed = {sx, sy, l->m_Width, l->m_Height};
+	m_pEditor->m_History.RecordTiles(this, Changed);
+
 	for(int y = 0; y < l->m_Height; y++)
 		for(int x = 0; x < l->m_Width; x++)
 		{
@@ -327,11 +430,12 @@ void CLayerTiles::BrushDraw(CLayer *pBrush, float wx, float wy)
 
 			m_pTiles[fy*m_Width+fx] = l->m_pTiles[y*l->m_Width+x];
 		}
+	TilesChanged(Changed);
 
 	if(m_LiveAutoMap)
 	{
-		RECTi r = {sx - 1, sy - 1, l->m_Width + 2, l->m_Height + 2};
-		m_pEditor->m_Map.m_lImages[m_Image]->m_pAutoMapper->Proceed(this, m_SelectedRuleSet, r);
+		RECTi r = {sx, sy, l->m_Width, l->m_Height};
+		m_pEditor->m_Map.m_lImages[m_Image]->m_pAutoMapper->ProceedChanged(this, m_SelectedRuleSet, r);
 	}
 
 	m_pEditor->m_Map.m_Modified = true;
@@ -354,6 +458,7 @@ void CLayerTiles::BrushFlipX()
 		for(int y = 0; y < m_Height; y++)
 			for(int x = 0; x < m_Width; x++)
 				m_pTiles[y*m_Width+x].m_Flags ^= m_pTiles[y*m_Width+x].m_Flags&TILEFLAG_ROTATE ? TILEFLAG_HFLIP : TILEFLAG_VFLIP;
+	TilesChanged();
 
 	s_lastBrushX = -1;
 	s_lastBrushY = -1;
@@ -373,6 +478,7 @@ void CLayerTiles::BrushFlipY()
 		for(int y = 0; y < m_Height; y++)
 			for(int x = 0; x < m_Width; x++)
 				m_pTiles[y*m_Width+x].m_Flags ^= m_pTiles[y*m_Width+x].m_Flags&TILEFLAG_ROTATE ? TILEFLAG_VFLIP : TILEFLAG_HFLIP;
+	TilesChanged();
 
 	s_lastBrushX = -1;
 	s_lastBrushY = -1;
@@ -413,6 +519,7 @@ void CLayerTiles::BrushRotate(float Amount)
 		BrushFlipX();
 		BrushFlipY();
 	}
+	TilesChanged();
 
 	s_lastBrushX = -1;
 	s_lastBrushY = -1;
@@ -432,10 +539,13 @@ void CLayerTiles::Resize(int NewW, int NewH)
 	m_pTiles = pNewData;
 	m_Width = NewW;
 	m_Height = NewH;
+	TilesChanged();
 }
 
 void CLayerTiles::Shift(int Direction)
 {
+	m_pEditor->m_History.RecordTiles(this);
+
 	switch(Direction)
 	{
 	case 1:
@@ -466,6 +576,7 @@ void CLayerTiles::Shift(int Direction)
 				mem_copy(&m_pTiles[y*m_Width], &m_pTiles[(y-1)*m_Width], m_Width*sizeof(CTile));
 		}
 	}
+	TilesChanged();
 
 	s_lastBrushX = -1;
 	s_lastBrushY = -1;
@@ -475,6 +586,11 @@ void CLayerTiles::ShowInfo()
 {
 	float ScreenX0, ScreenY0, ScreenX1, ScreenY1;
 	Graphics()->GetScreen(&ScreenX0, &ScreenY0, &ScreenX1, &ScreenY1);
+
+	// nothing is readable when zoomed out that far
+	if(32.0f*Graphics()->ScreenWidth()/(ScreenX1-ScreenX0) < 16.0f)
+		return;
+
 	static IGraphics::CTextureHandle s_Font = Graphics()->LoadTexture("ui/debug_font.png", IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, IGraphics::TEXLOAD_NORESAMPLE);
 	Graphics()->TextureSet(s_Font);
 	Graphics()->QuadsBegin();
@@ -536,7 +652,11 @@ int CLayerTiles::RenderProperties(CUIRect *pToolBox)
 				if(m_pEditor->m_Map.m_lImages[m_Image]->m_pAutoMapper->GetType() == IAutoMapper::TYPE_TILESET)
 				{
 					RECTi r = {0, 0, m_Width, m_Height};
+					int64 StartTime = time_get();
 					m_pEditor->m_Map.m_lImages[m_Image]->m_pAutoMapper->Proceed(this, m_SelectedRuleSet, r);
+					char aBuf[128];
+					str_format(aBuf, sizeof(aBuf), "Auto mapped %dx%d tiles in %.1f ms", m_Width, m_Height, (time_get()-StartTime)*1000.0f/time_freq());
+					m_pEditor->SetStatus(aBuf);
 					return 1; // only close the popup when it's a tileset
 				}
 				else if(m_pEditor->m_Map.m_lImages[m_Image]->m_pAutoMapper->GetType() == IAutoMapper::TYPE_DOODADS)
@@ -561,10 +681,13 @@ int CLayerTiles::RenderProperties(CUIRect *pToolBox)
 			CLayerTiles *gl = m_pEditor->m_Map.m_pGameLayer;
 			int w = min(gl->m_Width, m_Width);
 			int h = min(gl->m_Height, m_Height);
+			RECTi Changed = {0, 0, w, h};
+			m_pEditor->m_History.RecordTiles(gl, Changed);
 			for(int y = 0; y < h; y++)
 				for(int x = 0; x < w; x++)
 					if(m_pTiles[y*m_Width+x].m_Index)
 						gl->m_pTiles[y*gl->m_Width+x].m_Index = TILE_AIR+Result;
+			gl->TilesChanged();
 
 			return 1;
 		}
@@ -121,6 +121,7 @@ int CEditor::PopupGroup(CEditor *pEditor, CUIRect View)
 
 			// search for unneeded game tiles
 			CLayerTiles *gl = pEditor->m_Map.m_pGameLayer;
+			pEditor->m_History.RecordTiles(gl);
 			for(int y = 0; y < gl->m_Height; ++y)
 				for(int x = 0; x < gl->m_Width; ++x)
 				{
@@ -143,6 +144,7 @@ int CEditor::PopupGroup(CEditor *pEditor, CUIRect View)
 						pEditor->m_Map.m_Modified = true;
 					}
 				}
+			gl->TilesChanged();
 
 			return 1;
 		}
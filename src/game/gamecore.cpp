@@ -305,6 +305,13 @@ void CCharacterCore::Tick(bool UseInput)
 			if(pCharCore == this) // || !(p->flags&FLAG_ALIVE)
 				continue; // make sure that we don't nudge our self
 
+			// only the hooked player is affected from further away, skip the
+			// others before paying for the square roots
+			vec2 Diff = m_Pos - pCharCore->m_Pos;
+			const float CollisionRange = PHYS_SIZE*1.25f+1.0f;
+			if(m_HookedPlayer != i && dot(Diff, Diff) > CollisionRange*CollisionRange)
+				continue;
+
 			// handle player <-> player collision
 			float Distance = distance(m_Pos, pCharCore->m_Pos);
 			vec2 Dir = normalize(m_Pos - pCharCore->m_Pos);
@@ -374,25 +381,56 @@ void CCharacterCore::Move()
 
 	if(m_pWorld->m_Tuning.m_PlayerCollision)
 	{
+		// pack the positions of the others and drop the ones that are too far
+		// from the move to be touched, in one pass. the test below is exact,
+		// this only saves running it for every player at every step
+		float aX[MAX_CLIENTS], aY[MAX_CLIENTS];
+		int NumOthers = 0;
+		for(int p = 0; p < MAX_CLIENTS; p++)
+		{
+			CCharacterCore *pCharCore = m_pWorld->m_apCharacters[p];
+			if(!pCharCore || pCharCore == this)
+				continue;
+			aX[NumOthers] = pCharCore->m_Pos.x;
+			aY[NumOthers] = pCharCore->m_Pos.y;
+			NumOthers++;
+		}
+
+		const vec2 Move = NewPos - m_Pos;
+		const float MoveLengthSq = dot(Move, Move);
+		const float InvMoveLengthSq = MoveLengthSq > 0.0f ? 1.0f/MoveLengthSq : 0.0f;
+		const float Range = PHYS_SIZE+1.0f;
+		int NumClose = 0;
+		for(int p = 0; p < NumOthers; p++)
+		{
+			float Dx = aX[p]-m_Pos.x;
+			float Dy = aY[p]-m_Pos.y;
+			float t = clamp((Dx*Move.x+Dy*Move.y)*InvMoveLengthSq, 0.0f, 1.0f);
+			float Cx = Dx-Move.x*t;
+			float Cy = Dy-Move.y*t;
+			// keeps the order, so the first hit stays the same
+			aX[NumClose] = aX[p];
+			aY[NumClose] = aY[p];
+			NumClose += Cx*Cx+Cy*Cy < Range*Range;
+		}
+
 		// check player collision
 		float Distance = distance(m_Pos, NewPos);
-		int End = Distance+1;
+		int End = NumClose ? Distance+1 : 0;
 		vec2 LastPos = m_Pos;
 		for(int i = 0; i < End; i++)
 		{
 			float a = i/Distance;
 			vec2 Pos = mix(m_Pos, NewPos, a);
-			for(int p = 0; p < MAX_CLIENTS; p++)
+			for(int p = 0; p < NumClose; p++)
 			{
-				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[p];
-				if(!pCharCore || pCharCore == this)
-					continue;
-				float D = distance(Pos, pCharCore->m_Pos);
+				vec2 OtherPos = vec2(aX[p], aY[p]);
+				float D = distance(Pos, OtherPos);
 				if(D < PHYS_SIZE && D >= 0.0f)
 				{
 					if(a > 0.0f)
 						m_Pos = LastPos;
-					else if(distance(NewPos, pCharCore->m_Pos) > D)
+					else if(distance(NewPos, OtherPos) > D)
 						m_Pos = NewPos;
 					return;
 				}
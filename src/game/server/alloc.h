@@ -30,33 +30,180 @@
 	void operator delete(void *p); \
 	private:
 
+// several game instances can share the slots, an id that is taken goes to the heap
 #define MACRO_ALLOC_POOL_ID_IMPL(POOLTYPE, PoolSize) \
 	static char ms_PoolData##POOLTYPE[PoolSize][sizeof(POOLTYPE)] = {{0}}; \
-	static int ms_PoolUsed##POOLTYPE[PoolSize] = {0}; \
+	static volatile int ms_PoolUsed##POOLTYPE[PoolSize] = {0}; \
 	void *POOLTYPE::operator new(size_t Size, int id) \
 	{ \
 		dbg_assert(sizeof(POOLTYPE) == Size, "size error"); \
-		dbg_assert(!ms_PoolUsed##POOLTYPE[id], "already used"); \
 		/*dbg_msg("pool", "++ %s %d", #POOLTYPE, id);*/ \
-		ms_PoolUsed##POOLTYPE[id] = 1; \
-		mem_zero(ms_PoolData##POOLTYPE[id], Size); \
-		return ms_PoolData##POOLTYPE[id]; \
+		void *p; \
+		if(atomic_int_compswap(&ms_PoolUsed##POOLTYPE[id], 0, 1) == 0) \
+			p = ms_PoolData##POOLTYPE[id]; \
+		else \
+			p = mem_alloc(Size, 1); \
+		mem_zero(p, Size); \
+		return p; \
 	} \
 	void POOLTYPE::operator delete(void *p, int id) \
 	{ \
-		dbg_assert(ms_PoolUsed##POOLTYPE[id], "not used"); \
-		dbg_assert(id == (POOLTYPE*)p - (POOLTYPE*)ms_PoolData##POOLTYPE, "invalid id"); \
-		/*dbg_msg("pool", "-- %s %d", #POOLTYPE, id);*/ \
-		ms_PoolUsed##POOLTYPE[id] = 0; \
-		mem_zero(ms_PoolData##POOLTYPE[id], sizeof(POOLTYPE)); \
+		POOLTYPE::operator delete(p); \
 	} \
 	void POOLTYPE::operator delete(void *p) \
 	{ \
+		if((char *)p < ms_PoolData##POOLTYPE[0] || (char *)p >= ms_PoolData##POOLTYPE[PoolSize]) \
+		{ \
+			mem_free(p); \
+			return; \
+		} \
 		int id = (POOLTYPE*)p - (POOLTYPE*)ms_PoolData##POOLTYPE; \
 		dbg_assert(ms_PoolUsed##POOLTYPE[id], "not used"); \
 		/*dbg_msg("pool", "-- %s %d", #POOLTYPE, id);*/ \
-		ms_PoolUsed##POOLTYPE[id] = 0; \
 		mem_zero(ms_PoolData##POOLTYPE[id], sizeof(POOLTYPE)); \
+		atomic_int_store(&ms_PoolUsed##POOLTYPE[id], 0); \
 	}
 
+/*
+	Class: CPoolBase
+		Usage counters shared by all entity pools. Every pool links itself
+		into a global list, so the console can report on them.
+*/
+class CPoolBase
+{
+	CPoolBase *m_pNext;
+
+protected:
+	const char *m_pName;
+	int m_Capacity;
+	int m_Used;
+	int m_Peak;
+	int m_NumHeap;
+
+	static CPoolBase *&FirstLink()
+	{
+		static CPoolBase *s_pFirst = 0;
+		return s_pFirst;
+	}
+
+	CPoolBase(const char *pName) : m_pName(pName), m_Capacity(0), m_Used(0), m_Peak(0), m_NumHeap(0)
+	{
+		m_pNext = FirstLink();
+		FirstLink() = this;
+	}
+
+public:
+	static CPoolBase *First() { return FirstLink(); }
+	CPoolBase *Next() const { return m_pNext; }
+
+	const char *Name() const { return m_pName; }
+	int Capacity() const { return m_Capacity; }
+	int Used() const { return m_Used; }
+	int Peak() const { return m_Peak; }
+
+	/*
+		Function: NumHeap
+			Returns the number of allocations that did not fit into the
+			pool and went to the heap instead.
+	*/
+	int NumHeap() const { return m_NumHeap; }
+};
+
+/*
+	Class: CPool
+		Fixed capacity free list of objects of one type, stored in a single
+		block. Allocations beyond the capacity fall back to the heap, so a
+		too small pool costs speed but never fails. Game instances on
+		other threads share it, so it is locked.
+*/
+template<class T>
+class CPool : public CPoolBase
+{
+	char *m_pData;
+	void *m_pFirstFree;
+	LOCK m_Lock;
+
+public:
+	CPool(const char *pName) : CPoolBase(pName), m_pData(0), m_pFirstFree(0) { m_Lock = lock_create(); }
+	~CPool() { mem_free(m_pData); lock_destroy(m_Lock); }
+
+	/*
+		Function: Init
+			Sets the number of preallocated objects. Only possible while no
+			object is allocated from the pool.
+
+		Returns:
+			Returns false if the pool is in use and was left unchanged.
+	*/
+	bool Init(int Capacity)
+	{
+		lock_wait(m_Lock);
+		if(m_Used || Capacity == m_Capacity)
+		{
+			bool Unchanged = Capacity == m_Capacity;
+			lock_unlock(m_Lock);
+			return Unchanged;
+		}
+
+		mem_free(m_pData);
+		m_pData = Capacity ? (char *)mem_alloc(Capacity*sizeof(T), 1) : 0;
+		m_Capacity = Capacity;
+		m_Peak = 0;
+		m_pFirstFree = 0;
+		for(int i = Capacity-1; i >= 0; i--)
+		{
+			void *pSlot = m_pData + i*sizeof(T);
+			*(void **)pSlot = m_pFirstFree;
+			m_pFirstFree = pSlot;
+		}
+		lock_unlock(m_Lock);
+		return true;
+	}
+
+	void *Alloc(size_t Size)
+	{
+		dbg_assert(Size == sizeof(T), "size error");
+		lock_wait(m_Lock);
+		void *p = m_pFirstFree;
+		if(p)
+		{
+			m_pFirstFree = *(void **)p;
+			if(++m_Used > m_Peak)
+				m_Peak = m_Used;
+		}
+		else
+			m_NumHeap++;
+		lock_unlock(m_Lock);
+
+		if(!p)
+			p = mem_alloc(Size, 1);
+		mem_zero(p, Size);
+		return p;
+	}
+
+	void Free(void *p)
+	{
+		if(m_pData && (char *)p >= m_pData && (char *)p < m_pData + m_Capacity*sizeof(T))
+		{
+			lock_wait(m_Lock);
+			*(void **)p = m_pFirstFree;
+			m_pFirstFree = p;
+			m_Used--;
+			lock_unlock(m_Lock);
+		}
+		else
+			mem_free(p);
+	}
+};
+
+#define MACRO_ALLOC_POOL(POOLTYPE) \
+	public: \
+	static CPool<POOLTYPE> ms_Pool; \
+	void *operator new(size_t Size) { return ms_Pool.Alloc(Size); } \
+	void operator delete(void *p) { ms_Pool.Free(p); } \
+	private:
+
+#define MACRO_ALLOC_POOL_IMPL(POOLTYPE, Name) \
+	CPool<POOLTYPE> POOLTYPE::ms_Pool(Name);
+
 #endif
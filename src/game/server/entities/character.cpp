@@ -64,7 +64,7 @@ bool CCharacter::Spawn(CPlayer *pPlayer, vec2 Pos)
 	m_QueuedWeapon = -1;
 
 	m_pPlayer = pPlayer;
-	m_Pos = Pos;
+	SetPos(Pos);
 
 	m_Core.Reset();
 	m_Core.Init(&GameWorld()->m_Core, GameServer()->Collision());
@@ -573,7 +573,7 @@ void CCharacter::TickDefered()
 	bool StuckAfterMove = GameServer()->Collision()->TestBox(m_Core.m_Pos, ColBox);
 	m_Core.Quantize();
 	bool StuckAfterQuant = GameServer()->Collision()->TestBox(m_Core.m_Pos, ColBox);
-	m_Pos = m_Core.m_Pos;
+	SetPos(m_Core.m_Pos);
 
 	if(!StuckBefore && (StuckAfterMove || StuckAfterQuant))
 	{
@@ -605,8 +605,7 @@ void CCharacter::TickDefered()
 
 	if(m_pPlayer->GetTeam() == TEAM_SPECTATORS)
 	{
-		m_Pos.x = m_Input.m_TargetX;
-		m_Pos.y = m_Input.m_TargetY;
+		SetPos(vec2(m_Input.m_TargetX, m_Input.m_TargetY));
 	}
 	else if(m_Core.m_Death)
 	{
@@ -686,22 +685,25 @@ void CCharacter::Die(int Killer, int Weapon)
 	CNetMsg_Sv_KillMsg Msg;
 	Msg.m_Victim = m_pPlayer->GetCID();
 	Msg.m_ModeSpecial = ModeSpecial;
+	CClientMask Mask, MaskOld;
 	for(int i = 0 ; i < MAX_CLIENTS; i++)
 	{
 		if(!Server()->ClientIngame(i))
 			continue;
 
 		if(Killer < 0 && Server()->GetClientVersion(i) < MIN_KILLMESSAGE_CLIENTVERSION)
-		{
-			Msg.m_Killer = 0;
-			Msg.m_Weapon = WEAPON_WORLD;
-		}
+			MaskOld |= CmaskOne(i);
 		else
-		{
-			Msg.m_Killer = Killer;
-			Msg.m_Weapon = Weapon;
-		}
-		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, i);
+			Mask |= CmaskOne(i);
+	}
+	Msg.m_Killer = Killer;
+	Msg.m_Weapon = Weapon;
+	Server()->SendPackMsgMask(&Msg, MSGFLAG_VITAL, Mask);
+	if(MaskOld.any())
+	{
+		Msg.m_Killer = 0;
+		Msg.m_Weapon = WEAPON_WORLD;
+		Server()->SendPackMsgMask(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, MaskOld);
 	}
 
 	// a nice sound
@@ -769,7 +771,7 @@ bool CCharacter::TakeDamage(vec2 Force, vec2 Source, int Dmg, int From, int Weap
 	// do damage Hit sound
 	if(From >= 0 && From != m_pPlayer->GetCID() && GameServer()->m_apPlayers[From])
 	{
-		int64 Mask = CmaskOne(From);
+		CClientMask Mask = CmaskOne(From);
 		for(int i = 0; i < MAX_CLIENTS; i++)
 		{
 			if(GameServer()->m_apPlayers[i] && (GameServer()->m_apPlayers[i]->GetTeam() == TEAM_SPECTATORS ||  GameServer()->m_apPlayers[i]->m_DeadSpecMode) &&
@@ -807,15 +809,14 @@ bool CCharacter::TakeDamage(vec2 Force, vec2 Source, int Dmg, int From, int Weap
 	return true;
 }
 
-void CCharacter::Snap(int SnappingClient)
+bool CCharacter::SnapPrivateInfo(int SnappingClient)
 {
-	if(NetworkClipped(SnappingClient))
-		return;
-
-	CNetObj_Character *pCharacter = static_cast<CNetObj_Character *>(Server()->SnapNewItem(NETOBJTYPE_CHARACTER, m_pPlayer->GetCID(), sizeof(CNetObj_Character)));
-	if(!pCharacter)
-		return;
+	return m_pPlayer->GetCID() == SnappingClient || SnappingClient == -1 ||
+		(!Config()->m_SvStrictSpectateMode && m_pPlayer->GetCID() == GameServer()->m_apPlayers[SnappingClient]->GetSpectatorID());
+}
 
+void CCharacter::FillInfo(CNetObj_Character *pCharacter, bool PrivateInfo)
+{
 	// write down the m_Core
 	if(!m_ReckoningTick || GameWorld()->m_Paused)
 	{
@@ -830,13 +831,8 @@ void CCharacter::Snap(int SnappingClient)
 		m_SendCore.Write(pCharacter);
 	}
 
-	// set emote
-	if (m_EmoteStop < Server()->Tick())
-	{
-		SetEmote(EMOTE_NORMAL, -1);
-	}
-
-	pCharacter->m_Emote = m_EmoteType;
+	// set emote, expired emotes are reset in PostSnap
+	pCharacter->m_Emote = m_EmoteStop < Server()->Tick() ? EMOTE_NORMAL : m_EmoteType;
 
 	pCharacter->m_AmmoCount = 0;
 	pCharacter->m_Health = 0;
@@ -848,8 +844,7 @@ void CCharacter::Snap(int SnappingClient)
 
 	pCharacter->m_Direction = m_Input.m_Direction;
 
-	if(m_pPlayer->GetCID() == SnappingClient || SnappingClient == -1 ||
-		(!Config()->m_SvStrictSpectateMode && m_pPlayer->GetCID() == GameServer()->m_apPlayers[SnappingClient]->GetSpectatorID()))
+	if(PrivateInfo)
 	{
 		pCharacter->m_Health = m_Health;
 		pCharacter->m_Armor = m_Armor;
@@ -866,7 +861,34 @@ void CCharacter::Snap(int SnappingClient)
 	}
 }
 
+void CCharacter::SnapShared()
+{
+	// clients that see health and ammo get their own version in Snap
+	CClientMask Mask = NetworkVisibleMask(m_Pos);
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(CmaskIsSet(Mask, i) && SnapPrivateInfo(i))
+			Mask ^= CmaskOne(i);
+	}
+
+	CNetObj_Character *pCharacter = static_cast<CNetObj_Character *>(Server()->SnapNewSharedItem(NETOBJTYPE_CHARACTER, m_pPlayer->GetCID(), sizeof(CNetObj_Character), Mask));
+	if(pCharacter)
+		FillInfo(pCharacter, false);
+}
+
+void CCharacter::Snap(int SnappingClient)
+{
+	if(!SnapPrivateInfo(SnappingClient) || NetworkClipped(SnappingClient))
+		return;
+
+	CNetObj_Character *pCharacter = static_cast<CNetObj_Character *>(Server()->SnapNewItem(NETOBJTYPE_CHARACTER, m_pPlayer->GetCID(), sizeof(CNetObj_Character)));
+	if(pCharacter)
+		FillInfo(pCharacter, true);
+}
+
 void CCharacter::PostSnap()
 {
+	if(m_EmoteStop < Server()->Tick())
+		SetEmote(EMOTE_NORMAL, -1);
 	m_TriggeredEvents = 0;
 }
@@ -30,6 +30,7 @@ public:
 	virtual void TickDefered();
 	virtual void TickPaused();
 	virtual void Snap(int SnappingClient);
+	virtual void SnapShared();
 	virtual void PostSnap();
 
 	bool IsGrounded();
@@ -64,6 +65,10 @@ public:
 	class CPlayer *GetPlayer() { return m_pPlayer; }
 
 private:
+	// whether SnappingClient gets health, armor and ammo of this character
+	bool SnapPrivateInfo(int SnappingClient);
+	void FillInfo(CNetObj_Character *pCharacter, bool PrivateInfo);
+
 	// player controlling this character
 	class CPlayer *m_pPlayer;
 
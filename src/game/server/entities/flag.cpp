@@ -21,7 +21,7 @@ void CFlag::Reset()
 {
 	m_pCarrier = 0;
 	m_AtStand = true;
-	m_Pos = m_StandPos;
+	SetPos(m_StandPos);
 	m_Vel = vec2(0, 0);
 	m_GrabTick = 0;
 }
@@ -46,7 +46,7 @@ void CFlag::TickDefered()
 	if(m_pCarrier)
 	{
 		// update flag position
-		m_Pos = m_pCarrier->GetPos();
+		SetPos(m_pCarrier->GetPos());
 	}
 	else
 	{
@@ -81,12 +81,10 @@ void CFlag::TickPaused()
 		m_GrabTick++;
 }
 
-void CFlag::Snap(int SnappingClient)
+void CFlag::SnapShared()
 {
-	if(NetworkClipped(SnappingClient))
-		return;
-
-	CNetObj_Flag *pFlag = (CNetObj_Flag *)Server()->SnapNewItem(NETOBJTYPE_FLAG, m_Team, sizeof(CNetObj_Flag));
+	CClientMask Mask = NetworkVisibleMask(m_Pos);
+	CNetObj_Flag *pFlag = (CNetObj_Flag *)Server()->SnapNewSharedItem(NETOBJTYPE_FLAG, m_Team, sizeof(CNetObj_Flag), Mask);
 	if(!pFlag)
 		return;
 
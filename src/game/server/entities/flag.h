@@ -36,7 +36,7 @@ public:
 	/* CEntity functions */
 	virtual void Reset();
 	virtual void TickPaused();
-	virtual void Snap(int SnappingClient);
+	virtual void SnapShared();
 	virtual void TickDefered();
 
 	/* Functions */
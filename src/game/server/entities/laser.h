@@ -7,13 +7,15 @@
 
 class CLaser : public CEntity
 {
+	MACRO_ALLOC_POOL(CLaser)
+
 public:
 	CLaser(CGameWorld *pGameWorld, vec2 Pos, vec2 Direction, float StartEnergy, int Owner);
 
 	virtual void Reset();
 	virtual void Tick();
 	virtual void TickPaused();
-	virtual void Snap(int SnappingClient);
+	virtual void SnapShared();
 
 protected:
 	bool HitCharacter(vec2 From, vec2 To);
@@ -7,6 +7,8 @@
 #include "character.h"
 #include "pickup.h"
 
+MACRO_ALLOC_POOL_IMPL(CPickup, "pickup")
+
 CPickup::CPickup(CGameWorld *pGameWorld, int Type, vec2 Pos)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_PICKUP, Pos, PickupPhysSize)
 {
@@ -134,12 +136,13 @@ void CPickup::TickPaused()
 		++m_SpawnTick;
 }
 
-void CPickup::Snap(int SnappingClient)
+void CPickup::SnapShared()
 {
-	if(m_SpawnTick != -1 || NetworkClipped(SnappingClient))
+	if(m_SpawnTick != -1)
 		return;
 
-	CNetObj_Pickup *pP = static_cast<CNetObj_Pickup *>(Server()->SnapNewItem(NETOBJTYPE_PICKUP, GetID(), sizeof(CNetObj_Pickup)));
+	CClientMask Mask = NetworkVisibleMask(m_Pos);
+	CNetObj_Pickup *pP = static_cast<CNetObj_Pickup *>(Server()->SnapNewSharedItem(NETOBJTYPE_PICKUP, GetID(), sizeof(CNetObj_Pickup), Mask));
 	if(!pP)
 		return;
 
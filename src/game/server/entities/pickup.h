@@ -9,13 +9,15 @@ const int PickupPhysSize = 14;
 
 class CPickup : public CEntity
 {
+	MACRO_ALLOC_POOL(CPickup)
+
 public:
 	CPickup(CGameWorld *pGameWorld, int Type, vec2 Pos);
 
 	virtual void Reset();
 	virtual void Tick();
 	virtual void TickPaused();
-	virtual void Snap(int SnappingClient);
+	virtual void SnapShared();
 
 private:
 	int m_Type;
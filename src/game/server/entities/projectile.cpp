@@ -6,6 +6,8 @@
 #include "character.h"
 #include "projectile.h"
 
+MACRO_ALLOC_POOL_IMPL(CProjectile, "projectile")
+
 CProjectile::CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir, int Span,
 		int Damage, bool Explosive, float Force, int SoundImpact, int Weapon)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_PROJECTILE, vec2(round_to_int(Pos.x), round_to_int(Pos.y)))
@@ -22,6 +24,7 @@ CProjectile::CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos,
 	m_Weapon = Weapon;
 	m_StartTick = Server()->Tick();
 	m_Explosive = Explosive;
+	m_CachedTicks = -1;
 
 	GameWorld()->InsertEntity(this);
 }
@@ -39,39 +42,57 @@ void CProjectile::LoseOwner()
 		m_Owner = PLAYER_TEAM_RED;
 }
 
-vec2 CProjectile::GetPos(float Time)
+void CProjectile::GetTrajectory(float *pCurvature, float *pSpeed)
 {
-	float Curvature = 0;
-	float Speed = 0;
+	*pCurvature = 0;
+	*pSpeed = 0;
 
 	switch(m_Type)
 	{
 		case WEAPON_GRENADE:
-			Curvature = GameServer()->Tuning()->m_GrenadeCurvature;
-			Speed = GameServer()->Tuning()->m_GrenadeSpeed;
+			*pCurvature = GameServer()->Tuning()->m_GrenadeCurvature;
+			*pSpeed = GameServer()->Tuning()->m_GrenadeSpeed;
 			break;
 
 		case WEAPON_SHOTGUN:
-			Curvature = GameServer()->Tuning()->m_ShotgunCurvature;
-			Speed = GameServer()->Tuning()->m_ShotgunSpeed;
+			*pCurvature = GameServer()->Tuning()->m_ShotgunCurvature;
+			*pSpeed = GameServer()->Tuning()->m_ShotgunSpeed;
 			break;
 
 		case WEAPON_GUN:
-			Curvature = GameServer()->Tuning()->m_GunCurvature;
-			Speed = GameServer()->Tuning()->m_GunSpeed;
+			*pCurvature = GameServer()->Tuning()->m_GunCurvature;
+			*pSpeed = GameServer()->Tuning()->m_GunSpeed;
 			break;
 	}
+}
 
+vec2 CProjectile::GetPos(float Time)
+{
+	float Curvature, Speed;
+	GetTrajectory(&Curvature, &Speed);
 	return CalcPos(m_Pos, m_Direction, Curvature, Speed, Time);
 }
 
+vec2 CProjectile::GetTickPos(int Ticks)
+{
+	// the end of one tick is the start of the next and gets snapped in between, so that is evaluated once
+	float Curvature, Speed;
+	GetTrajectory(&Curvature, &Speed);
+	if(Ticks != m_CachedTicks || Curvature != m_CachedCurvature || Speed != m_CachedSpeed)
+	{
+		m_CachedPos = CalcPos(m_Pos, m_Direction, Curvature, Speed, Ticks/(float)Server()->TickSpeed());
+		m_CachedTicks = Ticks;
+		m_CachedCurvature = Curvature;
+		m_CachedSpeed = Speed;
+	}
+	return m_CachedPos;
+}
 
 void CProjectile::Tick()
 {
-	float Pt = (Server()->Tick()-m_StartTick-1)/(float)Server()->TickSpeed();
-	float Ct = (Server()->Tick()-m_StartTick)/(float)Server()->TickSpeed();
-	vec2 PrevPos = GetPos(Pt);
-	vec2 CurPos = GetPos(Ct);
+	const int Ticks = Server()->Tick()-m_StartTick;
+	vec2 PrevPos = GetTickPos(Ticks-1);
+	vec2 CurPos = GetTickPos(Ticks);
 	int Collide = GameServer()->Collision()->IntersectLine(PrevPos, CurPos, &CurPos, 0);
 	CCharacter *OwnerChar = GameServer()->GetPlayerChar(m_Owner);
 	CCharacter *TargetChr = GameWorld()->IntersectCharacter(PrevPos, CurPos, 6.0f, CurPos, OwnerChar);
@@ -108,14 +129,10 @@ void CProjectile::FillInfo(CNetObj_Projectile *pProj)
 	pProj->m_Type = m_Type;
 }
 
-void CProjectile::Snap(int SnappingClient)
+void CProjectile::SnapShared()
 {
-	float Ct = (Server()->Tick()-m_StartTick)/(float)Server()->TickSpeed();
-
-	if(NetworkClipped(SnappingClient, GetPos(Ct)))
-		return;
-
-	CNetObj_Projectile *pProj = static_cast<CNetObj_Projectile *>(Server()->SnapNewItem(NETOBJTYPE_PROJECTILE, GetID(), sizeof(CNetObj_Projectile)));
+	CClientMask Mask = NetworkVisibleMask(GetTickPos(Server()->Tick()-m_StartTick));
+	CNetObj_Projectile *pProj = static_cast<CNetObj_Projectile *>(Server()->SnapNewSharedItem(NETOBJTYPE_PROJECTILE, GetID(), sizeof(CNetObj_Projectile), Mask));
 	if(pProj)
 		FillInfo(pProj);
 }
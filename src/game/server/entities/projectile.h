@@ -13,6 +13,8 @@ enum
 
 class CProjectile : public CEntity
 {
+	MACRO_ALLOC_POOL(CProjectile)
+
 public:
 	CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir, int Span,
 		int Damage, bool Explosive, float Force, int SoundImpact, int Weapon);
@@ -26,9 +28,12 @@ public:
 	virtual void Reset();
 	virtual void Tick();
 	virtual void TickPaused();
-	virtual void Snap(int SnappingClient);
+	virtual void SnapShared();
 
 private:
+	void GetTrajectory(float *pCurvature, float *pSpeed);
+	vec2 GetTickPos(int Ticks);
+
 	vec2 m_Direction;
 	int m_LifeSpan;
 	int m_Owner;
@@ -40,6 +45,12 @@ private:
 	float m_Force;
 	int m_StartTick;
 	bool m_Explosive;
+
+	// the last evaluated position, ticks since the start
+	vec2 m_CachedPos;
+	int m_CachedTicks;
+	float m_CachedCurvature;
+	float m_CachedSpeed;
 };
 
 #endif
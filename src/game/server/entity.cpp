@@ -12,6 +12,12 @@ CEntity::CEntity(CGameWorld *pGameWorld, int ObjType, vec2 Pos, int ProximityRad
 	m_pPrevTypeEntity = 0;
 	m_pNextTypeEntity = 0;
 
+	m_pPrevCellEntity = 0;
+	m_pNextCellEntity = 0;
+	m_CellX = 0;
+	m_CellY = 0;
+	m_InGrid = false;
+
 	m_ID = Server()->SnapNewID();
 	m_ObjType = ObjType;
 
@@ -27,6 +33,13 @@ CEntity::~CEntity()
 	Server()->SnapFreeID(m_ID);
 }
 
+void CEntity::SetPos(vec2 Pos)
+{
+	m_Pos = Pos;
+	if(m_InGrid)
+		GameWorld()->UpdateGridCell(this);
+}
+
 int CEntity::NetworkClipped(int SnappingClient)
 {
 	return NetworkClipped(SnappingClient, m_Pos);
@@ -48,6 +61,19 @@ int CEntity::NetworkClipped(int SnappingClient, vec2 CheckPos)
 	return 0;
 }
 
+CClientMask CEntity::NetworkVisibleMask(vec2 CheckPos)
+{
+	// the clients further away than the candidates are clipped anyway
+	CClientMask Candidates = GameWorld()->ViewCandidates(CheckPos);
+	CClientMask Mask;
+	for(int i = Candidates.first(); i >= 0; i = Candidates.next(i))
+	{
+		if(GameServer()->m_apPlayers[i] && !NetworkClipped(i, CheckPos))
+			Mask.set(i);
+	}
+	return Mask;
+}
+
 bool CEntity::GameLayerClipped(vec2 CheckPos)
 {
 	int rx = round_to_int(CheckPos.x) / 32;
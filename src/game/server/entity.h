@@ -26,6 +26,13 @@ private:
 	CEntity *m_pPrevTypeEntity;
 	CEntity *m_pNextTypeEntity;
 
+	/* Spatial grid */
+	CEntity *m_pPrevCellEntity;
+	CEntity *m_pNextCellEntity;
+	int m_CellX;
+	int m_CellY;
+	bool m_InGrid;
+
 	int m_ID;
 	int m_ObjType;
 
@@ -50,6 +57,15 @@ protected:
 	/* Getters */
 	int GetID() const					{ return m_ID; }
 
+	/* Setters */
+
+	/*
+		Function: SetPos
+			Moves the entity. Use this instead of writing m_Pos,
+			so the world can keep its spatial grid up to date.
+	*/
+	void SetPos(vec2 Pos);
+
 public:
 	/* Constructor */
 	CEntity(CGameWorld *pGameWorld, int Objtype, vec2 Pos, int ProximityRadius=0);
@@ -117,9 +133,25 @@ public:
 				being generated. Could be -1 to create a complete
 				snapshot of everything in the game for demo
 				recording.
+
+		Remarks:
+			Snapshots for different clients can be generated
+			in parallel, so this must not modify any game state.
+			Use PostSnap for that.
 	*/
 	virtual void Snap(int SnappingClient) {}
 
+	/*
+		Function: SnapShared
+			Called once per tick to add the items that look the
+			same for every client that can see them to the shared
+			snapshot. They also end up in demo snapshots.
+
+		Remarks:
+			Same rules as for Snap apply.
+	*/
+	virtual void SnapShared() {}
+
 	virtual void PostSnap() {}
 
 	/*
@@ -139,6 +171,16 @@ public:
 	int NetworkClipped(int SnappingClient);
 	int NetworkClipped(int SnappingClient, vec2 CheckPos);
 
+	/*
+		Function: NetworkVisibleMask(vec2 CheckPos)
+			Performs the NetworkClipped test for all clients.
+			Only valid while snapping, see CGameWorld::ViewCandidates.
+
+		Returns:
+			Mask of the clients that can see the position.
+	*/
+	CClientMask NetworkVisibleMask(vec2 CheckPos);
+
 	bool GameLayerClipped(vec2 CheckPos);
 };
 
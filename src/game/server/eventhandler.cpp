@@ -14,47 +14,68 @@ CEventHandler::CEventHandler()
 	Clear();
 }
 
+CEventHandler::~CEventHandler()
+{
+	for(int i = 0; i < m_apChunks.size(); i++)
+		mem_free(m_apChunks[i]);
+}
+
 void CEventHandler::SetGameServer(CGameContext *pGameServer)
 {
 	m_pGameServer = pGameServer;
 }
 
-void *CEventHandler::Create(int Type, int Size, int64 Mask)
+void *CEventHandler::Create(int Type, int Size, const CClientMask &Mask)
 {
-	if(m_NumEvents == MAX_EVENTS)
-		return 0;
-	if(m_CurrentOffset+Size >= MAX_DATASIZE)
+	if(m_NumEvents == MAX_EVENTS || Size > CHUNK_SIZE)
 		return 0;
 
-	void *p = &m_aData[m_CurrentOffset];
-	m_aOffsets[m_NumEvents] = m_CurrentOffset;
-	m_aTypes[m_NumEvents] = Type;
-	m_aSizes[m_NumEvents] = Size;
-	m_aClientMasks[m_NumEvents] = Mask;
-	m_CurrentOffset += Size;
-	m_NumEvents++;
-	return p;
+	// continue in the next chunk when the event doesn't fit
+	if(m_ChunkOffset+Size > CHUNK_SIZE)
+	{
+		m_CurrentChunk++;
+		m_ChunkOffset = 0;
+	}
+	if(m_CurrentChunk == m_apChunks.size())
+		m_apChunks.add((char *)mem_alloc(CHUNK_SIZE, 1));
+
+	if(m_NumEvents == m_aEvents.size())
+		m_aEvents.add(CEvent());
+
+	CEvent *pEvent = &m_aEvents[m_NumEvents++];
+	pEvent->m_Type = Type;
+	pEvent->m_Size = Size;
+	pEvent->m_pData = m_apChunks[m_CurrentChunk]+m_ChunkOffset;
+	pEvent->m_ClientMask = Mask;
+	m_ChunkOffset += Size;
+	return pEvent->m_pData;
 }
 
 void CEventHandler::Clear()
 {
 	m_NumEvents = 0;
-	m_CurrentOffset = 0;
+	m_CurrentChunk = 0;
+	m_ChunkOffset = 0;
 }
 
-void CEventHandler::Snap(int SnappingClient)
+void CEventHandler::SnapShared()
 {
 	for(int i = 0; i < m_NumEvents; i++)
 	{
-		if(SnappingClient == -1 || CmaskIsSet(m_aClientMasks[i], SnappingClient))
+		// clients in the mask that are close enough to the event
+		const CEvent &Event = m_aEvents[i];
+		const CNetEvent_Common *ev = (const CNetEvent_Common *)Event.m_pData;
+		vec2 Pos = vec2(ev->m_X, ev->m_Y);
+		CClientMask Candidates = GameServer()->m_World.ViewCandidates(Pos) & Event.m_ClientMask;
+		CClientMask Mask;
+		for(int c = Candidates.first(); c >= 0; c = Candidates.next(c))
 		{
-			CNetEvent_Common *ev = (CNetEvent_Common *)&m_aData[m_aOffsets[i]];
-			if(SnappingClient == -1 || distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, vec2(ev->m_X, ev->m_Y)) < 1500.0f)
-			{
-				void *d = GameServer()->Server()->SnapNewItem(m_aTypes[i], i, m_aSizes[i]);
-				if(d)
-					mem_copy(d, &m_aData[m_aOffsets[i]], m_aSizes[i]);
-			}
+			if(distance(GameServer()->m_apPlayers[c]->m_ViewPos, Pos) < 1500.0f)
+				Mask.set(c);
 		}
+
+		void *d = GameServer()->Server()->SnapNewSharedItem(Event.m_Type, i, Event.m_Size, Mask);
+		if(d)
+			mem_copy(d, Event.m_pData, Event.m_Size);
 	}
 }
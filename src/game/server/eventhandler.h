@@ -3,30 +3,44 @@
 #ifndef GAME_SERVER_EVENTHANDLER_H
 #define GAME_SERVER_EVENTHANDLER_H
 
+#include <base/tl/array.h>
+#include <engine/shared/protocol.h>
+
 //
 class CEventHandler
 {
-	static const int MAX_EVENTS = 128;
-	static const int MAX_DATASIZE = 128*64;
+	// one shared snapshot item per event
+	static const int MAX_EVENTS = 1024;
+	static const int CHUNK_SIZE = 8*1024;
+
+	struct CEvent
+	{
+		int m_Type;
+		int m_Size;
+		char *m_pData;
+		CClientMask m_ClientMask;
+	};
 
-	int m_aTypes[MAX_EVENTS]; // TODO: remove some of these arrays
-	int m_aOffsets[MAX_EVENTS];
-	int m_aSizes[MAX_EVENTS];
-	int64 m_aClientMasks[MAX_EVENTS];
-	char m_aData[MAX_DATASIZE];
+	// the records are reused between ticks as well
+	array<CEvent> m_aEvents;
+	int m_NumEvents;
+
+	// event data lives in chunks that are kept between ticks and never move
+	array<char *> m_apChunks;
+	int m_CurrentChunk;
+	int m_ChunkOffset;
 
 	class CGameContext *m_pGameServer;
 
-	int m_CurrentOffset;
-	int m_NumEvents;
 public:
 	CGameContext *GameServer() const { return m_pGameServer; }
 	void SetGameServer(CGameContext *pGameServer);
 
 	CEventHandler();
-	void *Create(int Type, int Size, int64 Mask = -1);
+	~CEventHandler();
+	void *Create(int Type, int Size, const CClientMask &Mask = CClientMask::all());
 	void Clear();
-	void Snap(int SnappingClient);
+	void SnapShared();
 };
 
 #endif
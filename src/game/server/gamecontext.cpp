@@ -4,6 +4,8 @@
 
 #include <engine/shared/config.h>
 #include <engine/shared/memheap.h>
+#include <engine/shared/profiler.h>
+#include <engine/shared/snapshot.h>
 #include <engine/map.h>
 
 #include <generated/server_data.h>
@@ -12,6 +14,8 @@
 #include <game/version.h>
 
 #include "entities/character.h"
+#include "entities/laser.h"
+#include "entities/pickup.h"
 #include "entities/projectile.h"
 #include "gamemodes/ctf.h"
 #include "gamemodes/dm.h"
@@ -32,6 +36,7 @@ void CGameContext::Construct(int Resetting)
 {
 	m_Resetting = 0;
 	m_pServer = 0;
+	m_pProfiler = 0;
 
 	for(int i = 0; i < MAX_CLIENTS; i++)
 		m_apPlayers[i] = 0;
@@ -84,6 +89,39 @@ void CGameContext::Clear()
 	m_pVoteOptionLast = pVoteOptionLast;
 	m_NumVoteOptions = NumVoteOptions;
 	m_Tuning = Tuning;
+	IndexVoteOptions();
+}
+
+void CGameContext::IndexVoteOptions()
+{
+	m_VoteOptionIndex.clear();
+	m_VoteOptionIndex.reserve(m_NumVoteOptions);
+	for(CVoteOptionServer *pOption = m_pVoteOptionFirst; pOption; pOption = pOption->m_pNext)
+		m_VoteOptionIndex.set(pOption->m_aDescription, pOption);
+}
+
+void CGameContext::SendVoteOptions(int ClientID)
+{
+	// a long list sent at once would fill the resend buffer of the connection
+	CPlayer *pPlayer = m_apPlayers[ClientID];
+	for(int b = 0; b < VOTE_OPTION_BATCHES_PER_TICK && pPlayer->m_pSendVoteOption; b++)
+	{
+		// count options for actual packet
+		int NumOptions = 0;
+		for(CVoteOptionServer *p = pPlayer->m_pSendVoteOption; p && NumOptions < MAX_VOTE_OPTION_ADD; p = p->m_pNext, ++NumOptions);
+
+		// pack and send vote list packet
+		CMsgPacker Msg(NETMSGTYPE_SV_VOTEOPTIONLISTADD);
+		Msg.AddInt(NumOptions);
+		while(pPlayer->m_pSendVoteOption && NumOptions--)
+		{
+			Msg.AddString(pPlayer->m_pSendVoteOption->m_aDescription, VOTE_DESC_LENGTH);
+			pPlayer->m_pSendVoteOption = pPlayer->m_pSendVoteOption->m_pNext;
+		}
+		Server()->SendMsg(&Msg, MSGFLAG_VITAL, ClientID);
+	}
+	if(!pPlayer->m_pSendVoteOption)
+		pPlayer->m_SendingVoteOptions = false;
 }
 
 
@@ -174,7 +212,7 @@ void CGameContext::CreateDeath(vec2 Pos, int ClientID)
 	}
 }
 
-void CGameContext::CreateSound(vec2 Pos, int Sound, int64 Mask)
+void CGameContext::CreateSound(vec2 Pos, int Sound, const CClientMask &Mask)
 {
 	if (Sound < 0)
 		return;
@@ -229,24 +267,22 @@ void CGameContext::SendChat(int ChatterClientID, int Mode, int To, const char *p
 		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, -1);
 	else if(Mode == CHAT_TEAM)
 	{
-		// pack one for the recording only
-		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NOSEND, -1);
-
 		To = m_apPlayers[ChatterClientID]->GetTeam();
 
 		// send to the clients
+		CClientMask Mask;
 		for(int i = 0; i < MAX_CLIENTS; i++)
 		{
 			if(m_apPlayers[i] && m_apPlayers[i]->GetTeam() == To)
-				Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+				Mask |= CmaskOne(i);
 		}
+		Server()->SendPackMsgMask(&Msg, MSGFLAG_VITAL, Mask);
 	}
 	else // Mode == CHAT_WHISPER
 	{
 		// send to the clients
 		Msg.m_TargetID = To;
-		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, ChatterClientID);
-		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, To);
+		Server()->SendPackMsgMask(&Msg, MSGFLAG_VITAL, CmaskOne(ChatterClientID)|CmaskOne(To));
 	}
 }
 
@@ -381,6 +417,16 @@ void CGameContext::StartVote(const char *pDesc, const char *pCommand, const char
 	str_copy(m_aVoteReason, pReason, sizeof(m_aVoteReason));
 	SendVoteSet(m_VoteType, -1);
 	m_VoteUpdate = true;
+
+	// get the map of a map vote ready while the players vote
+	if(str_comp_num(pCommand, "change_map ", 11) == 0)
+	{
+		char aMap[128];
+		str_copy(aMap, str_skip_whitespaces_const(pCommand+11), sizeof(aMap));
+		char *pEnd = str_skip_to_whitespace(aMap);
+		*pEnd = 0;
+		Server()->PreloadMap(aMap);
+	}
 }
 
 
@@ -507,23 +553,36 @@ void CGameContext::OnTick()
 
 	// copy tuning
 	m_World.m_Core.m_Tuning = m_Tuning;
-	m_World.Tick();
+	{
+		CProfileScope WorldScope(m_pProfiler, m_aProfilePhases[PROFILE_WORLD]);
+		m_World.Tick();
+	}
 
 	//if(world.paused) // make sure that the game object always updates
-	m_pController->Tick();
+	{
+		CProfileScope ControllerScope(m_pProfiler, m_aProfilePhases[PROFILE_CONTROLLER]);
+		m_pController->Tick();
+	}
 
-	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
-		if(m_apPlayers[i])
+		CProfileScope PlayersScope(m_pProfiler, m_aProfilePhases[PROFILE_PLAYERS]);
+		for(int i = 0; i < MAX_CLIENTS; i++)
 		{
-			m_apPlayers[i]->Tick();
-			m_apPlayers[i]->PostTick();
+			if(m_apPlayers[i])
+			{
+				m_apPlayers[i]->Tick();
+				m_apPlayers[i]->PostTick();
+				if(m_apPlayers[i]->m_SendingVoteOptions)
+					SendVoteOptions(i);
+			}
 		}
 	}
 
 	// update voting
 	if(m_VoteCloseTime)
 	{
+		CProfileScope VotesScope(m_pProfiler, m_aProfilePhases[PROFILE_VOTES]);
+
 		// abort the kick-vote on player-leave
 		if(m_VoteCloseTime == -1)
 			EndVote(VOTE_END_ABORT, false);
@@ -668,6 +727,7 @@ void CGameContext::OnClientEnter(int ClientID)
 	}
 
 
+	CClientMask OthersMask;
 	for(int i = 0; i < MAX_CLIENTS; ++i)
 	{
 		if(i == ClientID || !m_apPlayers[i] || (!Server()->ClientIngame(i) && !m_apPlayers[i]->IsDummy()))
@@ -675,7 +735,7 @@ void CGameContext::OnClientEnter(int ClientID)
 
 		// new info for others
 		if(Server()->ClientIngame(i))
-			Server()->SendPackMsg(&NewClientInfoMsg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+			OthersMask |= CmaskOne(i);
 
 		// existing infos for new player
 		CNetMsg_Sv_ClientInfo ClientInfoMsg;
@@ -694,6 +754,7 @@ void CGameContext::OnClientEnter(int ClientID)
 		}
 		Server()->SendPackMsg(&ClientInfoMsg, MSGFLAG_VITAL|MSGFLAG_NORECORD, ClientID);
 	}
+	Server()->SendPackMsgMask(&NewClientInfoMsg, MSGFLAG_VITAL|MSGFLAG_NORECORD, OthersMask);
 
 	// local info
 	NewClientInfoMsg.m_Local = 1;
@@ -714,6 +775,7 @@ void CGameContext::OnClientConnected(int ClientID, bool Dummy, bool AsSpec)
 	dbg_assert(!m_apPlayers[ClientID], "non-free player slot");
 
 	m_apPlayers[ClientID] = new(ClientID) CPlayer(this, ClientID, Dummy, AsSpec);
+	Server()->ExpireServerInfo();
 
 	if(Dummy)
 		return;
@@ -731,6 +793,8 @@ void CGameContext::OnClientConnected(int ClientID, bool Dummy, bool AsSpec)
 
 void CGameContext::OnClientTeamChange(int ClientID)
 {
+	Server()->ExpireServerInfo();
+
 	if(m_apPlayers[ClientID]->GetTeam() == TEAM_SPECTATORS)
 		AbortVoteOnTeamChange(ClientID);
 
@@ -778,6 +842,7 @@ void CGameContext::OnClientDrop(int ClientID, const char *pReason)
 
 	delete m_apPlayers[ClientID];
 	m_apPlayers[ClientID] = 0;
+	Server()->ExpireServerInfo();
 
 	m_VoteUpdate = true;
 }
@@ -882,37 +947,28 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 
 			if(str_comp_nocase(pMsg->m_Type, "option") == 0)
 			{
-				CVoteOptionServer *pOption = m_pVoteOptionFirst;
-				while(pOption)
+				CVoteOptionServer **ppOption = m_VoteOptionIndex.find(pMsg->m_Value);
+				if(!ppOption)
+					return;
+				CVoteOptionServer *pOption = *ppOption;
+				str_format(aDesc, sizeof(aDesc), "%s", pOption->m_aDescription);
+				str_format(aCmd, sizeof(aCmd), "%s", pOption->m_aCommand);
+				char aBuf[128];
+				str_format(aBuf, sizeof(aBuf),
+					"'%d:%s' voted %s '%s' reason='%s' cmd='%s' force=%d",
+					ClientID, Server()->ClientName(ClientID), pMsg->m_Type,
+					aDesc, pReason, aCmd, pMsg->m_Force
+				);
+				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+				if(pMsg->m_Force)
 				{
-					if(str_comp_nocase(pMsg->m_Value, pOption->m_aDescription) == 0)
-					{
-						str_format(aDesc, sizeof(aDesc), "%s", pOption->m_aDescription);
-						str_format(aCmd, sizeof(aCmd), "%s", pOption->m_aCommand);
-						char aBuf[128];
-						str_format(aBuf, sizeof(aBuf),
-							"'%d:%s' voted %s '%s' reason='%s' cmd='%s' force=%d",
-							ClientID, Server()->ClientName(ClientID), pMsg->m_Type,
-							aDesc, pReason, aCmd, pMsg->m_Force
-						);
-						Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-						if(pMsg->m_Force)
-						{
-							Server()->SetRconCID(ClientID);
-							Console()->ExecuteLine(aCmd);
-							Server()->SetRconCID(IServer::RCON_CID_SERV);
-							ForceVote(VOTE_START_OP, aDesc, pReason);
-							return;
-						}
-						m_VoteType = VOTE_START_OP;
-						break;
-					}
-
-					pOption = pOption->m_pNext;
-				}
-
-				if(!pOption)
+					Server()->SetRconCID(ClientID);
+					Console()->ExecuteLine(aCmd);
+					Server()->SetRconCID(IServer::RCON_CID_SERV);
+					ForceVote(VOTE_START_OP, aDesc, pReason);
 					return;
+				}
+				m_VoteType = VOTE_START_OP;
 			}
 			else if(str_comp_nocase(pMsg->m_Type, "kick") == 0)
 			{
@@ -1126,27 +1182,13 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 
 			m_pController->OnPlayerInfoChange(pPlayer);
 
-			// send vote options
+			// send vote options, the rest of the list follows in the next ticks
 			CNetMsg_Sv_VoteClearOptions ClearMsg;
 			Server()->SendPackMsg(&ClearMsg, MSGFLAG_VITAL, ClientID);
-
-			CVoteOptionServer *pCurrent = m_pVoteOptionFirst;
-			while(pCurrent)
-			{
-				// count options for actual packet
-				int NumOptions = 0;
-				for(CVoteOptionServer *p = pCurrent; p && NumOptions < MAX_VOTE_OPTION_ADD; p = p->m_pNext, ++NumOptions);
-
-				// pack and send vote list packet
-				CMsgPacker Msg(NETMSGTYPE_SV_VOTEOPTIONLISTADD);
-				Msg.AddInt(NumOptions);
-				while(pCurrent && NumOptions--)
-				{
-					Msg.AddString(pCurrent->m_aDescription, VOTE_DESC_LENGTH);
-					pCurrent = pCurrent->m_pNext;
-				}
-				Server()->SendMsg(&Msg, MSGFLAG_VITAL, ClientID);
-			}
+			pPlayer->m_pSendVoteOption = m_pVoteOptionFirst;
+			pPlayer->m_SendingVoteOptions = m_pVoteOptionFirst != 0;
+			if(pPlayer->m_SendingVoteOptions)
+				SendVoteOptions(ClientID);
 
 			// send tuning parameters to client
 			SendTuningParams(ClientID);
@@ -1198,6 +1240,17 @@ void CGameContext::ConTunes(IConsole::IResult *pResult, void *pUserData)
 	}
 }
 
+void CGameContext::ConPools(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	char aBuf[256];
+	for(CPoolBase *pPool = CPoolBase::First(); pPool; pPool = pPool->Next())
+	{
+		str_format(aBuf, sizeof(aBuf), "%s: used=%d/%d peak=%d heap=%d", pPool->Name(), pPool->Used(), pPool->Capacity(), pPool->Peak(), pPool->NumHeap());
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "pool", aBuf);
+	}
+}
+
 void CGameContext::ConPause(IConsole::IResult *pResult, void *pUserData)
 {
 	CGameContext *pSelf = (CGameContext *)pUserData;
@@ -1346,15 +1399,12 @@ void CGameContext::ConAddVote(IConsole::IResult *pResult, void *pUserData)
 	}
 
 	// check for duplicate entry
-	for(CVoteOptionServer *pOption = pSelf->m_pVoteOptionFirst; pOption; pOption = pOption->m_pNext)
+	if(pSelf->m_VoteOptionIndex.find(pDescription))
 	{
-		if(str_comp_nocase(pDescription, pOption->m_aDescription) == 0)
-		{
-			char aBuf[256];
-			str_format(aBuf, sizeof(aBuf), "option '%s' already exists", pDescription);
-			pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-			return;
-		}
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "option '%s' already exists", pDescription);
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+		return;
 	}
 
 	// add the option
@@ -1372,14 +1422,19 @@ void CGameContext::ConAddVote(IConsole::IResult *pResult, void *pUserData)
 
 	str_copy(pOption->m_aDescription, pDescription, sizeof(pOption->m_aDescription));
 	mem_copy(pOption->m_aCommand, pCommand, Len+1);
+	pSelf->m_VoteOptionIndex.set(pOption->m_aDescription, pOption);
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "added option '%s' '%s'", pOption->m_aDescription, pOption->m_aCommand);
 	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 
-	// inform clients about added option
+	// inform clients about added option, the ones still getting the list get it with the list
 	CNetMsg_Sv_VoteOptionAdd OptionMsg;
 	OptionMsg.m_pDescription = pOption->m_aDescription;
-	pSelf->Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, -1);
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(pSelf->m_apPlayers[i] && !pSelf->m_apPlayers[i]->m_SendingVoteOptions)
+			pSelf->Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, i);
+	}
 }
 
 void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
@@ -1388,13 +1443,8 @@ void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
 	const char *pDescription = pResult->GetString(0);
 
 	// check for valid option
-	CVoteOptionServer *pOption = pSelf->m_pVoteOptionFirst;
-	while(pOption)
-	{
-		if(str_comp_nocase(pDescription, pOption->m_aDescription) == 0)
-			break;
-		pOption = pOption->m_pNext;
-	}
+	CVoteOptionServer **ppOption = pSelf->m_VoteOptionIndex.find(pDescription);
+	CVoteOptionServer *pOption = ppOption ? *ppOption : 0;
 	if(!pOption)
 	{
 		char aBuf[256];
@@ -1419,6 +1469,23 @@ void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
 	CVoteOptionServer *pVoteOptionFirst = 0;
 	CVoteOptionServer *pVoteOptionLast = 0;
 	int NumVoteOptions = pSelf->m_NumVoteOptions;
+
+	// the players still getting the list continue in the copy
+	CPlayer *apSending[MAX_CLIENTS];
+	int NumSending = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		CPlayer *pPlayer = pSelf->m_apPlayers[i];
+		if(!pPlayer || !pPlayer->m_SendingVoteOptions)
+			continue;
+		if(pPlayer->m_pSendVoteOption == pOption)
+			pPlayer->m_pSendVoteOption = pOption->m_pNext;
+		if(pPlayer->m_pSendVoteOption)
+			apSending[NumSending++] = pPlayer;
+		else
+			pPlayer->m_SendingVoteOptions = false;
+	}
+
 	for(CVoteOptionServer *pSrc = pSelf->m_pVoteOptionFirst; pSrc; pSrc = pSrc->m_pNext)
 	{
 		if(pSrc == pOption)
@@ -1437,6 +1504,11 @@ void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
 
 		str_copy(pDst->m_aDescription, pSrc->m_aDescription, sizeof(pDst->m_aDescription));
 		mem_copy(pDst->m_aCommand, pSrc->m_aCommand, Len+1);
+		for(int i = 0; i < NumSending; i++)
+		{
+			if(apSending[i]->m_pSendVoteOption == pSrc)
+				apSending[i]->m_pSendVoteOption = pDst;
+		}
 	}
 
 	// clean up
@@ -1445,6 +1517,7 @@ void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
 	pSelf->m_pVoteOptionFirst = pVoteOptionFirst;
 	pSelf->m_pVoteOptionLast = pVoteOptionLast;
 	pSelf->m_NumVoteOptions = NumVoteOptions;
+	pSelf->IndexVoteOptions();
 }
 
 void CGameContext::ConClearVotes(IConsole::IResult *pResult, void *pUserData)
@@ -1458,6 +1531,15 @@ void CGameContext::ConClearVotes(IConsole::IResult *pResult, void *pUserData)
 	pSelf->m_pVoteOptionFirst = 0;
 	pSelf->m_pVoteOptionLast = 0;
 	pSelf->m_NumVoteOptions = 0;
+	pSelf->m_VoteOptionIndex.clear();
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(pSelf->m_apPlayers[i])
+		{
+			pSelf->m_apPlayers[i]->m_pSendVoteOption = 0;
+			pSelf->m_apPlayers[i]->m_SendingVoteOptions = false;
+		}
+	}
 }
 
 void CGameContext::ConVote(IConsole::IResult *pResult, void *pUserData)
@@ -1517,6 +1599,7 @@ void CGameContext::OnConsoleInit()
 	Console()->Register("tune", "s[tuning] i[value]", CFGFLAG_SERVER, ConTuneParam, this, "Tune variable to value");
 	Console()->Register("tune_reset", "", CFGFLAG_SERVER, ConTuneReset, this, "Reset all tuning variables to defaults");
 	Console()->Register("tunes", "", CFGFLAG_SERVER, ConTunes, this, "List all tuning variables and their values");
+	Console()->Register("pools", "", CFGFLAG_SERVER, ConPools, this, "List the entity pools and their usage");
 
 	Console()->Register("pause", "?i[seconds]", CFGFLAG_SERVER|CFGFLAG_STORE, ConPause, this, "Pause/unpause game");
 	Console()->Register("change_map", "?r[map]", CFGFLAG_SERVER|CFGFLAG_STORE, ConChangeMap, this, "Change map");
@@ -1554,8 +1637,16 @@ void CGameContext::OnInit()
 	m_pServer = Kernel()->RequestInterface<IServer>();
 	m_pConfig = Kernel()->RequestInterface<IConfigManager>()->Values();
 	m_pConsole = Kernel()->RequestInterface<IConsole>();
+	m_pProfiler = m_pServer->Profiler();
+	m_aProfilePhases[PROFILE_WORLD] = m_pProfiler->AddPhase("game.world");
+	m_aProfilePhases[PROFILE_CONTROLLER] = m_pProfiler->AddPhase("game.controller");
+	m_aProfilePhases[PROFILE_PLAYERS] = m_pProfiler->AddPhase("game.players");
+	m_aProfilePhases[PROFILE_VOTES] = m_pProfiler->AddPhase("game.votes");
 	m_World.SetGameServer(this);
 	m_Events.SetGameServer(this);
+
+	// the game type and players changed
+	m_pServer->ExpireServerInfo();
 	m_CommandManager.Init(m_pConsole, this, NewCommandHook, RemoveCommandHook);
 
 	// HACK: only set static size for items, which were available in the first 0.7 release
@@ -1563,10 +1654,20 @@ void CGameContext::OnInit()
 	static const int OLD_NUM_NETOBJTYPES = 23;
 	for(int i = 0; i < OLD_NUM_NETOBJTYPES; i++)
 		Server()->SnapSetStaticsize(i, m_NetObjHandler.GetObjSize(i));
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+	{
+		unsigned char aBits[CSnapshotDelta::MAX_FIELDS];
+		Server()->SnapSetFieldBits(i, aBits, CNetObjHandler::GetObjFieldBits(i, aBits, CSnapshotDelta::MAX_FIELDS));
+	}
 
 	m_Layers.Init(Kernel());
 	m_Collision.Init(&m_Layers);
 
+	// the world of the last map is gone, the pools can be resized
+	CProjectile::ms_Pool.Init(Config()->m_SvPoolProjectiles);
+	CLaser::ms_Pool.Init(Config()->m_SvPoolLasers);
+	CPickup::ms_Pool.Init(Config()->m_SvPoolPickups);
+
 	// select gametype
 	if(str_comp_nocase(Config()->m_SvGametype, "mod") == 0)
 		m_pController = new CGameControllerMOD(this);
@@ -1651,7 +1752,6 @@ void CGameContext::OnSnap(int ClientID)
 
 	m_World.Snap(ClientID);
 	m_pController->Snap(ClientID);
-	m_Events.Snap(ClientID);
 
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
@@ -1659,7 +1759,62 @@ void CGameContext::OnSnap(int ClientID)
 			m_apPlayers[i]->Snap(ClientID);
 	}
 }
+
+int CGameContext::OnSnapItemPriority(int ClientID, int Type, int ID, const void *pData, int Size) const
+{
+	// the own character and everything that isn't an entity in the world has to be up to date
+	int Priority;
+	if(Type == NETOBJTYPE_CHARACTER && ID != ClientID)
+		Priority = 1000;
+	else if(Type == NETOBJTYPE_FLAG)
+		Priority = 900;
+	else if(Type == NETOBJTYPE_PROJECTILE || Type == NETOBJTYPE_LASER)
+		Priority = 600;
+	else if(Type == NETOBJTYPE_PICKUP)
+		Priority = 200;
+	else
+		return SNAP_PRIORITY_ALWAYS;
+
+	// closer is more important, all these items start with their position
+	const CPlayer *pPlayer = m_apPlayers[ClientID];
+	if(!pPlayer)
+		return Priority;
+	int X, Y;
+	if(Type == NETOBJTYPE_CHARACTER)
+	{
+		const CNetObj_Character *pCharacter = (const CNetObj_Character *)pData;
+		X = pCharacter->m_X;
+		Y = pCharacter->m_Y;
+	}
+	else
+	{
+		X = ((const int *)pData)[0];
+		Y = ((const int *)pData)[1];
+	}
+	float Distance = distance(pPlayer->m_ViewPos, vec2(X, Y));
+	return Priority - min((int)(Distance/32.0f), 199);
+}
+
+void CGameContext::OnSnapValidate(int ClientID, const CSnapshot *pSnap) const
+{
+	// the client drops these items, so they are bugs on our side
+	CScratch Scratch;
+	int *pInvalid = (int *)Scratch.Allocate(pSnap->NumItems()*sizeof(int));
+	int NumInvalid = CNetObjHandler::ValidateSnap(pSnap, pInvalid);
+	for(int i = 0; i < NumInvalid; i++)
+	{
+		const CSnapshotItem *pItem = pSnap->GetItem(pInvalid[i]);
+		dbg_msg("game", "invalid snapshot item for cid=%d type=%d (%s) id=%d size=%d", ClientID,
+			pItem->Type(), m_NetObjHandler.GetObjName(pItem->Type()), pItem->ID(), pSnap->GetItemSize(pInvalid[i]));
+	}
+}
 void CGameContext::OnPreSnap() {}
+void CGameContext::OnSnapShared()
+{
+	m_World.SnapShared();
+	m_pController->SnapShared();
+	m_Events.SnapShared();
+}
 void CGameContext::OnPostSnap()
 {
 	m_World.PostSnap();
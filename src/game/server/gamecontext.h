@@ -3,6 +3,8 @@
 #ifndef GAME_SERVER_GAMECONTEXT_H
 #define GAME_SERVER_GAMECONTEXT_H
 
+#include <base/tl/hash_map.h>
+
 #include <engine/console.h>
 #include <engine/server.h>
 
@@ -44,9 +46,21 @@ class CGameContext : public IGameServer
 	CNetObjHandler m_NetObjHandler;
 	CTuningParams m_Tuning;
 
+	enum
+	{
+		PROFILE_WORLD=0,
+		PROFILE_CONTROLLER,
+		PROFILE_PLAYERS,
+		PROFILE_VOTES,
+		NUM_PROFILE_PHASES
+	};
+	class CProfiler *m_pProfiler;
+	int m_aProfilePhases[NUM_PROFILE_PHASES];
+
 	static void ConTuneParam(IConsole::IResult *pResult, void *pUserData);
 	static void ConTuneReset(IConsole::IResult *pResult, void *pUserData);
 	static void ConTunes(IConsole::IResult *pResult, void *pUserData);
+	static void ConPools(IConsole::IResult *pResult, void *pUserData);
 	static void ConPause(IConsole::IResult *pResult, void *pUserData);
 	static void ConChangeMap(IConsole::IResult *pResult, void *pUserData);
 	static void ConRestart(IConsole::IResult *pResult, void *pUserData);
@@ -124,6 +138,7 @@ public:
 	{
 		VOTE_TIME=25,
 		VOTE_CANCEL_TIME = 10,
+		VOTE_OPTION_BATCHES_PER_TICK=2,
 
 		MIN_SKINCHANGE_CLIENTVERSION = 0x0703,
 		MIN_RACE_CLIENTVERSION = 0x0704,
@@ -132,13 +147,34 @@ public:
 	CVoteOptionServer *m_pVoteOptionFirst;
 	CVoteOptionServer *m_pVoteOptionLast;
 
+	// the options by their description, which is compared without case like in the console
+	struct CVoteDescriptionTraits
+	{
+		static unsigned hash(const char *pKey)
+		{
+			unsigned Value = 2166136261u;
+			for(; *pKey; pKey++)
+			{
+				unsigned char c = *pKey;
+				if(c >= 'A' && c <= 'Z')
+					c += 'a'-'A';
+				Value = (Value^c)*16777619u;
+			}
+			return Value;
+		}
+		static bool equal(const char *pA, const char *pB) { return str_comp_nocase(pA, pB) == 0; }
+	};
+	hash_map<const char *, CVoteOptionServer *, CVoteDescriptionTraits> m_VoteOptionIndex;
+	void IndexVoteOptions();
+	void SendVoteOptions(int ClientID);
+
 	// helper functions
 	void CreateDamage(vec2 Pos, int Id, vec2 Source, int HealthAmount, int ArmorAmount, bool Self);
 	void CreateExplosion(vec2 Pos, int Owner, int Weapon, int MaxDamage);
 	void CreateHammerHit(vec2 Pos);
 	void CreatePlayerSpawn(vec2 Pos);
 	void CreateDeath(vec2 Pos, int Who);
-	void CreateSound(vec2 Pos, int Sound, int64 Mask=-1);
+	void CreateSound(vec2 Pos, int Sound, const CClientMask &Mask=CClientMask::all());
 
 	// network
 	void SendChat(int ChatterClientID, int Mode, int To, const char *pText);
@@ -171,7 +207,10 @@ public:
 
 	virtual void OnTick();
 	virtual void OnPreSnap();
+	virtual void OnSnapShared();
 	virtual void OnSnap(int ClientID);
+	virtual int OnSnapItemPriority(int ClientID, int Type, int ID, const void *pData, int Size) const;
+	virtual void OnSnapValidate(int ClientID, const class CSnapshot *pSnap) const;
 	virtual void OnPostSnap();
 
 	virtual void OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID);
@@ -196,8 +235,8 @@ public:
 	virtual const char *NetVersionHashReal() const;
 };
 
-inline int64 CmaskAll() { return -1; }
-inline int64 CmaskOne(int ClientID) { return (int64)1<<ClientID; }
-inline int64 CmaskAllExceptOne(int ClientID) { return CmaskAll()^CmaskOne(ClientID); }
-inline bool CmaskIsSet(int64 Mask, int ClientID) { return (Mask&CmaskOne(ClientID)) != 0; }
+inline CClientMask CmaskAll() { return CClientMask::all(); }
+inline CClientMask CmaskOne(int ClientID) { return CClientMask::one(ClientID); }
+inline CClientMask CmaskAllExceptOne(int ClientID) { CClientMask Mask = CmaskAll(); Mask.reset(ClientID); return Mask; }
+inline bool CmaskIsSet(const CClientMask &Mask, int ClientID) { return Mask.test(ClientID); }
 #endif
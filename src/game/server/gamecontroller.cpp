@@ -46,11 +46,6 @@ IGameController::IGameController(CGameContext *pGameServer)
 
 	// map
 	m_aMapWish[0] = 0;
-
-	// spawn
-	m_aNumSpawnPoints[0] = 0;
-	m_aNumSpawnPoints[1] = 0;
-	m_aNumSpawnPoints[2] = 0;
 }
 
 //activity
@@ -272,13 +267,13 @@ bool IGameController::OnEntity(int Index, vec2 Pos)
 	switch(Index)
 	{
 	case ENTITY_SPAWN:
-		m_aaSpawnPoints[0][m_aNumSpawnPoints[0]++] = Pos;
+		AddSpawnPoint(0, Pos);
 		break;
 	case ENTITY_SPAWN_RED:
-		m_aaSpawnPoints[1][m_aNumSpawnPoints[1]++] = Pos;
+		AddSpawnPoint(1, Pos);
 		break;
 	case ENTITY_SPAWN_BLUE:
-		m_aaSpawnPoints[2][m_aNumSpawnPoints[2]++] = Pos;
+		AddSpawnPoint(2, Pos);
 		break;
 	case ENTITY_ARMOR_1:
 		Type = PICKUP_ARMOR;
@@ -670,9 +665,9 @@ void IGameController::SwapTeamscore()
 }
 
 // general
-void IGameController::Snap(int SnappingClient)
+void IGameController::SnapShared()
 {
-	CNetObj_GameData *pGameData = static_cast<CNetObj_GameData *>(Server()->SnapNewItem(NETOBJTYPE_GAMEDATA, 0, sizeof(CNetObj_GameData)));
+	CNetObj_GameData *pGameData = static_cast<CNetObj_GameData *>(Server()->SnapNewSharedItem(NETOBJTYPE_GAMEDATA, 0, sizeof(CNetObj_GameData), CmaskAll()));
 	if(!pGameData)
 		return;
 
@@ -714,14 +709,17 @@ void IGameController::Snap(int SnappingClient)
 
 	if(IsTeamplay())
 	{
-		CNetObj_GameDataTeam *pGameDataTeam = static_cast<CNetObj_GameDataTeam *>(Server()->SnapNewItem(NETOBJTYPE_GAMEDATATEAM, 0, sizeof(CNetObj_GameDataTeam)));
+		CNetObj_GameDataTeam *pGameDataTeam = static_cast<CNetObj_GameDataTeam *>(Server()->SnapNewSharedItem(NETOBJTYPE_GAMEDATATEAM, 0, sizeof(CNetObj_GameDataTeam), CmaskAll()));
 		if(!pGameDataTeam)
 			return;
 
 		pGameDataTeam->m_TeamscoreRed = m_aTeamscore[TEAM_RED];
 		pGameDataTeam->m_TeamscoreBlue = m_aTeamscore[TEAM_BLUE];
 	}
+}
 
+void IGameController::Snap(int SnappingClient)
+{
 	// demo recording
 	if(SnappingClient == -1)
 	{
@@ -897,14 +895,21 @@ void IGameController::UpdateGameInfo(int ClientID)
 
 	if(ClientID == -1)
 	{
+		CClientMask Mask, MaskNoRace;
 		for(int i = 0; i < MAX_CLIENTS; ++i)
 		{
 			if(!GameServer()->m_apPlayers[i] || !Server()->ClientIngame(i))
 				continue;
 
-			CNetMsg_Sv_GameInfo *pInfoMsg = (Server()->GetClientVersion(i) < CGameContext::MIN_RACE_CLIENTVERSION) ? &GameInfoMsgNoRace : &GameInfoMsg;
-			Server()->SendPackMsg(pInfoMsg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+			if(Server()->GetClientVersion(i) < CGameContext::MIN_RACE_CLIENTVERSION)
+				MaskNoRace |= CmaskOne(i);
+			else
+				Mask |= CmaskOne(i);
 		}
+		if(Mask.any())
+			Server()->SendPackMsgMask(&GameInfoMsg, MSGFLAG_VITAL|MSGFLAG_NORECORD, Mask);
+		if(MaskNoRace.any())
+			Server()->SendPackMsgMask(&GameInfoMsgNoRace, MSGFLAG_VITAL|MSGFLAG_NORECORD, MaskNoRace);
 	}
 	else
 	{
@@ -916,6 +921,16 @@ void IGameController::UpdateGameInfo(int ClientID)
 // map
 static bool IsSeparator(char c) { return c == ';' || c == ' ' || c == ',' || c == '\t'; }
 
+void IGameController::EndMatch()
+{
+	SetGameState(IGS_END_MATCH, TIMER_END);
+
+	// the map changes once the end of the match is over, get it ready meanwhile
+	char aMap[128];
+	if(m_GameState == IGS_END_MATCH && m_MatchCount >= m_GameInfo.m_MatchNum-1 && GetNextMap(aMap, sizeof(aMap)))
+		Server()->PreloadMap(aMap);
+}
+
 void IGameController::ChangeMap(const char *pToMap)
 {
 	str_copy(m_aMapWish, pToMap, sizeof(m_aMapWish));
@@ -925,21 +940,15 @@ void IGameController::ChangeMap(const char *pToMap)
 	EndMatch();
 }
 
-void IGameController::CycleMap()
+bool IGameController::GetNextMap(char *pMap, int MapSize) const
 {
 	if(m_aMapWish[0] != 0)
 	{
-		char aBuf[256];
-		str_format(aBuf, sizeof(aBuf), "rotating map to %s", m_aMapWish);
-		GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
-		Server()->ChangeMap(m_aMapWish);
-
-		m_aMapWish[0] = 0;
-		m_MatchCount = 0;
-		return;
+		str_copy(pMap, m_aMapWish, MapSize);
+		return true;
 	}
 	if(!str_length(Config()->m_SvMaprotation))
-		return;
+		return false;
 
 	// handle maprotation
 	const char *pMapRotation = Config()->m_SvMaprotation;
@@ -987,15 +996,43 @@ void IGameController::CycleMap()
 	while(IsSeparator(aBuf[i]))
 		i++;
 
+	str_copy(pMap, &aBuf[i], MapSize);
+	return true;
+}
+
+void IGameController::CycleMap()
+{
+	char aMap[128];
+	if(!GetNextMap(aMap, sizeof(aMap)))
+		return;
+
+	m_aMapWish[0] = 0;
 	m_MatchCount = 0;
 
 	char aBufMsg[256];
-	str_format(aBufMsg, sizeof(aBufMsg), "rotating map to %s", &aBuf[i]);
-	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
-	Server()->ChangeMap(&aBuf[i]);
+	str_format(aBufMsg, sizeof(aBufMsg), "rotating map to %s", aMap);
+	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBufMsg);
+	Server()->ChangeMap(aMap);
 }
 
 // spawn
+static const int NUM_SPAWN_OFFSETS = 5;
+static const vec2 s_aSpawnOffsets[NUM_SPAWN_OFFSETS] = { vec2(0.0f, 0.0f), vec2(-32.0f, 0.0f), vec2(0.0f, -32.0f), vec2(32.0f, 0.0f), vec2(0.0f, 32.0f) };	// start, left, up, right, down
+
+void IGameController::AddSpawnPoint(int Type, vec2 Pos)
+{
+	// the map doesn't change, so check the tiles only once
+	CSpawnPoint Spawn;
+	Spawn.m_Pos = Pos;
+	Spawn.m_FreeOffsets = 0;
+	for(int i = 0; i < NUM_SPAWN_OFFSETS; i++)
+	{
+		if(!GameServer()->Collision()->CheckPoint(Pos+s_aSpawnOffsets[i]))
+			Spawn.m_FreeOffsets |= 1<<i;
+	}
+	m_aSpawnPoints[Type].add(Spawn);
+}
+
 bool IGameController::CanSpawn(int Team, vec2 *pOutPos) const
 {
 	// spectators can't spawn
@@ -1004,10 +1041,23 @@ bool IGameController::CanSpawn(int Team, vec2 *pOutPos) const
 
 	CSpawnEval Eval;
 	Eval.m_RandomSpawn = IsSurvival();
+	if(IsTeamplay())
+		Eval.m_FriendlyTeam = Team;
+
+	if(!Eval.m_RandomSpawn)
+	{
+		CCharacter *pC = static_cast<CCharacter *>(GameServer()->m_World.FindFirst(CGameWorld::ENTTYPE_CHARACTER));
+		for(; pC && Eval.m_NumChars < MAX_CLIENTS; pC = (CCharacter *)pC->TypeNext())
+		{
+			// team mates are not as dangerous as enemies
+			Eval.m_aCharPos[Eval.m_NumChars] = pC->GetPos();
+			Eval.m_aCharScoremod[Eval.m_NumChars] = Eval.m_FriendlyTeam != -1 && pC->GetPlayer()->GetTeam() == Eval.m_FriendlyTeam ? 0.5f : 1.0f;
+			Eval.m_NumChars++;
+		}
+	}
 
 	if(IsTeamplay())
 	{
-		Eval.m_FriendlyTeam = Team;
 
 		// first try own team spawn, then normal spawn and then enemy
 		EvaluateSpawnType(&Eval, 1+(Team&1));
@@ -1029,19 +1079,17 @@ bool IGameController::CanSpawn(int Team, vec2 *pOutPos) const
 	return Eval.m_Got;
 }
 
-float IGameController::EvaluateSpawnPos(CSpawnEval *pEval, vec2 Pos) const
+float IGameController::EvaluateSpawnPos(const CSpawnEval *pEval, vec2 Pos) const
 {
 	float Score = 0.0f;
-	CCharacter *pC = static_cast<CCharacter *>(GameServer()->m_World.FindFirst(CGameWorld::ENTTYPE_CHARACTER));
-	for(; pC; pC = (CCharacter *)pC->TypeNext())
+	for(int i = 0; i < pEval->m_NumChars; i++)
 	{
-		// team mates are not as dangerous as enemies
-		float Scoremod = 1.0f;
-		if(pEval->m_FriendlyTeam != -1 && pC->GetPlayer()->GetTeam() == pEval->m_FriendlyTeam)
-			Scoremod = 0.5f;
+		float d = distance(Pos, pEval->m_aCharPos[i]);
+		Score += pEval->m_aCharScoremod[i] * (d == 0 ? 1000000000.0f : 1.0f/d);
 
-		float d = distance(Pos, pC->GetPos());
-		Score += Scoremod * (d == 0 ? 1000000000.0f : 1.0f/d);
+		// the score only grows, stop once it can't beat the best one
+		if(pEval->m_Got && Score > pEval->m_Score)
+			break;
 	}
 
 	return Score;
@@ -1050,19 +1098,23 @@ float IGameController::EvaluateSpawnPos(CSpawnEval *pEval, vec2 Pos) const
 void IGameController::EvaluateSpawnType(CSpawnEval *pEval, int Type) const
 {
 	// get spawn point
-	for(int i = 0; i < m_aNumSpawnPoints[Type]; i++)
+	for(int i = 0; i < m_aSpawnPoints[Type].size(); i++)
 	{
+		const CSpawnPoint &Spawn = m_aSpawnPoints[Type][i];
+		if(!Spawn.m_FreeOffsets)
+			continue;
+
 		// check if the position is occupado
 		CCharacter *aEnts[MAX_CLIENTS];
-		int Num = GameServer()->m_World.FindEntities(m_aaSpawnPoints[Type][i], 64, (CEntity**)aEnts, MAX_CLIENTS, CGameWorld::ENTTYPE_CHARACTER);
-		vec2 Positions[5] = { vec2(0.0f, 0.0f), vec2(-32.0f, 0.0f), vec2(0.0f, -32.0f), vec2(32.0f, 0.0f), vec2(0.0f, 32.0f) };	// start, left, up, right, down
+		int Num = GameServer()->m_World.FindEntities(Spawn.m_Pos, 64, (CEntity**)aEnts, MAX_CLIENTS, CGameWorld::ENTTYPE_CHARACTER);
 		int Result = -1;
-		for(int Index = 0; Index < 5 && Result == -1; ++Index)
+		for(int Index = 0; Index < NUM_SPAWN_OFFSETS && Result == -1; ++Index)
 		{
+			if(!(Spawn.m_FreeOffsets&(1<<Index)))
+				continue;
 			Result = Index;
 			for(int c = 0; c < Num; ++c)
-				if(GameServer()->Collision()->CheckPoint(m_aaSpawnPoints[Type][i]+Positions[Index]) ||
-					distance(aEnts[c]->GetPos(), m_aaSpawnPoints[Type][i]+Positions[Index]) <= aEnts[c]->GetProximityRadius())
+				if(distance(aEnts[c]->GetPos(), Spawn.m_Pos+s_aSpawnOffsets[Index]) <= aEnts[c]->GetProximityRadius())
 				{
 					Result = -1;
 					break;
@@ -1071,7 +1123,7 @@ void IGameController::EvaluateSpawnType(CSpawnEval *pEval, int Type) const
 		if(Result == -1)
 			continue;	// try next spawn point
 
-		vec2 P = m_aaSpawnPoints[Type][i]+Positions[Result];
+		vec2 P = Spawn.m_Pos+s_aSpawnOffsets[Result];
 		float S = pEval->m_RandomSpawn ? (Result + random_float()) : EvaluateSpawnPos(pEval, P);
 		if(!pEval->m_Got || pEval->m_Score > S)
 		{
@@ -6,6 +6,8 @@
 #include <base/vmath.h>
 #include <base/tl/array.h>
 
+#include <engine/shared/protocol.h>
+
 #include <game/commands.h>
 
 #include <generated/protocol.h>
@@ -69,9 +71,17 @@ class IGameController
 	// map
 	char m_aMapWish[128];
 
+	// the map the rotation or a map wish goes to next, false if it stays
+	bool GetNextMap(char *pMap, int MapSize) const;
 	void CycleMap();
 
 	// spawn
+	struct CSpawnPoint
+	{
+		vec2 m_Pos;
+		int m_FreeOffsets; // the spawn offsets that aren't inside a solid tile
+	};
+
 	struct CSpawnEval
 	{
 		CSpawnEval()
@@ -79,6 +89,7 @@ class IGameController
 			m_Got = false;
 			m_FriendlyTeam = -1;
 			m_Pos = vec2(100,100);
+			m_NumChars = 0;
 		}
 
 		vec2 m_Pos;
@@ -86,11 +97,16 @@ class IGameController
 		bool m_RandomSpawn;
 		int m_FriendlyTeam;
 		float m_Score;
+
+		// the characters to keep away from, gathered once per evaluation
+		vec2 m_aCharPos[MAX_CLIENTS];
+		float m_aCharScoremod[MAX_CLIENTS];
+		int m_NumChars;
 	};
-	vec2 m_aaSpawnPoints[3][64];
-	int m_aNumSpawnPoints[3];
+	array<CSpawnPoint> m_aSpawnPoints[3];
 
-	float EvaluateSpawnPos(CSpawnEval *pEval, vec2 Pos) const;
+	void AddSpawnPoint(int Type, vec2 Pos);
+	float EvaluateSpawnPos(const CSpawnEval *pEval, vec2 Pos) const;
 	void EvaluateSpawnType(CSpawnEval *pEval, int Type) const;
 
 	// team
@@ -108,7 +124,7 @@ protected:
 	int m_SuddenDeath;
 	int m_aTeamscore[NUM_TEAMS];
 
-	void EndMatch() { SetGameState(IGS_END_MATCH, TIMER_END); }
+	void EndMatch();
 	void EndRound() { SetGameState(IGS_END_ROUND, TIMER_END/2); }
 
 	// info
@@ -197,6 +213,7 @@ public:
 
 	// general
 	virtual void Snap(int SnappingClient);
+	virtual void SnapShared();
 	virtual void Tick();
 
 	// info
@@ -115,11 +115,11 @@ bool CGameControllerCTF::DoWincheckMatch()
 }
 
 // general
-void CGameControllerCTF::Snap(int SnappingClient)
+void CGameControllerCTF::SnapShared()
 {
-	IGameController::Snap(SnappingClient);
+	IGameController::SnapShared();
 
-	CNetObj_GameDataFlag *pGameDataFlag = static_cast<CNetObj_GameDataFlag *>(Server()->SnapNewItem(NETOBJTYPE_GAMEDATAFLAG, 0, sizeof(CNetObj_GameDataFlag)));
+	CNetObj_GameDataFlag *pGameDataFlag = static_cast<CNetObj_GameDataFlag *>(Server()->SnapNewSharedItem(NETOBJTYPE_GAMEDATAFLAG, 0, sizeof(CNetObj_GameDataFlag), CmaskAll()));
 	if(!pGameDataFlag)
 		return;
 
@@ -6,6 +6,7 @@
 #include "gamecontext.h"
 #include "gamecontroller.h"
 #include "gameworld.h"
+#include "player.h"
 
 
 //////////////////////////////////////////////////
@@ -20,7 +21,15 @@ CGameWorld::CGameWorld()
 	m_Paused = false;
 	m_ResetRequested = false;
 	for(int i = 0; i < NUM_ENTTYPES; i++)
+	{
 		m_apFirstEntityTypes[i] = 0;
+		m_aMaxProximityRadius[i] = 0.0f;
+		m_aNumEntities[i] = 0;
+		for(int b = 0; b < GRID_NUM_BUCKETS; b++)
+			m_aapGridBuckets[i][b] = 0;
+	}
+	for(int i = 0; i < NUM_VIEW_SLOTS; i++)
+		m_aViewCells[i].m_Used = false;
 }
 
 CGameWorld::~CGameWorld()
@@ -43,13 +52,109 @@ CEntity *CGameWorld::FindFirst(int Type)
 	return Type < 0 || Type >= NUM_ENTTYPES ? 0 : m_apFirstEntityTypes[Type];
 }
 
+int CGameWorld::GridCoord(float Pos)
+{
+	// keep far away positions from overflowing
+	return (int)floorf(clamp(Pos, -1e7f, 1e7f)/GRID_CELL_SIZE);
+}
+
+int CGameWorld::GridBucket(int CellX, int CellY)
+{
+	return (((unsigned)CellX*73856093u) ^ ((unsigned)CellY*19349663u)) & (GRID_NUM_BUCKETS-1);
+}
+
+void CGameWorld::GridInsert(CEntity *pEnt)
+{
+	pEnt->m_CellX = GridCoord(pEnt->m_Pos.x);
+	pEnt->m_CellY = GridCoord(pEnt->m_Pos.y);
+
+	CEntity **ppBucket = &m_aapGridBuckets[pEnt->m_ObjType][GridBucket(pEnt->m_CellX, pEnt->m_CellY)];
+	if(*ppBucket)
+		(*ppBucket)->m_pPrevCellEntity = pEnt;
+	pEnt->m_pNextCellEntity = *ppBucket;
+	pEnt->m_pPrevCellEntity = 0;
+	*ppBucket = pEnt;
+	pEnt->m_InGrid = true;
+}
+
+void CGameWorld::GridRemove(CEntity *pEnt)
+{
+	if(pEnt->m_pPrevCellEntity)
+		pEnt->m_pPrevCellEntity->m_pNextCellEntity = pEnt->m_pNextCellEntity;
+	else
+		m_aapGridBuckets[pEnt->m_ObjType][GridBucket(pEnt->m_CellX, pEnt->m_CellY)] = pEnt->m_pNextCellEntity;
+	if(pEnt->m_pNextCellEntity)
+		pEnt->m_pNextCellEntity->m_pPrevCellEntity = pEnt->m_pPrevCellEntity;
+
+	pEnt->m_pNextCellEntity = 0;
+	pEnt->m_pPrevCellEntity = 0;
+	pEnt->m_InGrid = false;
+}
+
+void CGameWorld::UpdateGridCell(CEntity *pEnt)
+{
+	if(pEnt->m_CellX == GridCoord(pEnt->m_Pos.x) && pEnt->m_CellY == GridCoord(pEnt->m_Pos.y))
+		return;
+	GridRemove(pEnt);
+	GridInsert(pEnt);
+}
+
+CEntity *CGameWorld::GridFirst(CGridQuery *pQuery, int Type, vec2 Min, vec2 Max)
+{
+	// entities are sorted in by their center, so widen the box by their size
+	float Border = m_aMaxProximityRadius[Type];
+	pQuery->m_Type = Type;
+	pQuery->m_MinX = GridCoord(Min.x-Border);
+	pQuery->m_MaxX = GridCoord(Max.x+Border);
+	pQuery->m_MinY = GridCoord(Min.y-Border);
+	pQuery->m_MaxY = GridCoord(Max.y+Border);
+	// walking a short list is cheaper than visiting many empty cells
+	float NumCells = (float)(pQuery->m_MaxX-pQuery->m_MinX+1)*(pQuery->m_MaxY-pQuery->m_MinY+1);
+	pQuery->m_WholeList = NumCells > GRID_MAX_QUERY_CELLS || NumCells > m_aNumEntities[Type];
+	if(pQuery->m_WholeList)
+		return pQuery->m_pCur = m_apFirstEntityTypes[Type];
+
+	pQuery->m_CellX = pQuery->m_MinX;
+	pQuery->m_CellY = pQuery->m_MinY;
+	return GridSkip(pQuery, m_aapGridBuckets[Type][GridBucket(pQuery->m_CellX, pQuery->m_CellY)]);
+}
+
+CEntity *CGameWorld::GridNext(CGridQuery *pQuery)
+{
+	if(pQuery->m_WholeList)
+		return pQuery->m_pCur = pQuery->m_pCur->m_pNextTypeEntity;
+	return GridSkip(pQuery, pQuery->m_pCur->m_pNextCellEntity);
+}
+
+CEntity *CGameWorld::GridSkip(CGridQuery *pQuery, CEntity *pEnt)
+{
+	while(1)
+	{
+		// buckets are shared by several cells, skip entities of other ones
+		while(pEnt && (pEnt->m_CellX != pQuery->m_CellX || pEnt->m_CellY != pQuery->m_CellY))
+			pEnt = pEnt->m_pNextCellEntity;
+		if(pEnt)
+			return pQuery->m_pCur = pEnt;
+
+		// next cell
+		if(++pQuery->m_CellX > pQuery->m_MaxX)
+		{
+			pQuery->m_CellX = pQuery->m_MinX;
+			if(++pQuery->m_CellY > pQuery->m_MaxY)
+				return 0;
+		}
+		pEnt = m_aapGridBuckets[pQuery->m_Type][GridBucket(pQuery->m_CellX, pQuery->m_CellY)];
+	}
+}
+
 int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max, int Type)
 {
 	if(Type < 0 || Type >= NUM_ENTTYPES)
 		return 0;
 
 	int Num = 0;
-	for(CEntity *pEnt = m_apFirstEntityTypes[Type];	pEnt; pEnt = pEnt->m_pNextTypeEntity)
+	CGridQuery Query;
+	for(CEntity *pEnt = GridFirst(&Query, Type, Pos-vec2(Radius, Radius), Pos+vec2(Radius, Radius)); pEnt; pEnt = GridNext(&Query))
 	{
 		if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
 		{
@@ -77,6 +182,11 @@ void CGameWorld::InsertEntity(CEntity *pEnt)
 	pEnt->m_pNextTypeEntity = m_apFirstEntityTypes[pEnt->m_ObjType];
 	pEnt->m_pPrevTypeEntity = 0x0;
 	m_apFirstEntityTypes[pEnt->m_ObjType] = pEnt;
+
+	GridInsert(pEnt);
+	m_aNumEntities[pEnt->m_ObjType]++;
+	if(pEnt->m_ProximityRadius > m_aMaxProximityRadius[pEnt->m_ObjType])
+		m_aMaxProximityRadius[pEnt->m_ObjType] = pEnt->m_ProximityRadius;
 }
 
 void CGameWorld::DestroyEntity(CEntity *pEnt)
@@ -104,18 +214,100 @@ void CGameWorld::RemoveEntity(CEntity *pEnt)
 
 	pEnt->m_pNextTypeEntity = 0;
 	pEnt->m_pPrevTypeEntity = 0;
+	m_aNumEntities[pEnt->m_ObjType]--;
+
+	if(pEnt->m_InGrid)
+		GridRemove(pEnt);
 }
 
 //
+int CGameWorld::ViewCoord(float Pos)
+{
+	return (int)floorf(clamp(Pos, -1e7f, 1e7f)/VIEW_CELL_SIZE);
+}
+
+// the slot of the cell or the empty slot where it belongs
+int CGameWorld::FindViewSlot(int CellX, int CellY) const
+{
+	unsigned Hash = ((unsigned)CellX*73856093u) ^ ((unsigned)CellY*19349663u);
+	for(int i = 0; ; i++)
+	{
+		int Slot = (Hash+i)%NUM_VIEW_SLOTS;
+		const CViewCell *pCell = &m_aViewCells[Slot];
+		if(!pCell->m_Used || (pCell->m_X == CellX && pCell->m_Y == CellY))
+			return Slot;
+	}
+}
+
+void CGameWorld::UpdateViewCells()
+{
+	for(int i = 0; i < NUM_VIEW_SLOTS; i++)
+		m_aViewCells[i].m_Used = false;
+
+	// there are more slots than clients, so there is always an empty one
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		const CPlayer *pPlayer = GameServer()->m_apPlayers[i];
+		if(!pPlayer)
+			continue;
+		int CellX = ViewCoord(pPlayer->m_ViewPos.x);
+		int CellY = ViewCoord(pPlayer->m_ViewPos.y);
+		CViewCell *pCell = &m_aViewCells[FindViewSlot(CellX, CellY)];
+		if(!pCell->m_Used)
+		{
+			pCell->m_X = CellX;
+			pCell->m_Y = CellY;
+			pCell->m_Used = true;
+			pCell->m_Clients.clear();
+		}
+		pCell->m_Clients.set(i);
+	}
+}
+
+CClientMask CGameWorld::ViewCandidates(vec2 Pos) const
+{
+	int CellX = ViewCoord(Pos.x);
+	int CellY = ViewCoord(Pos.y);
+	CClientMask Mask;
+	for(int y = CellY-1; y <= CellY+1; y++)
+		for(int x = CellX-1; x <= CellX+1; x++)
+		{
+			const CViewCell *pCell = &m_aViewCells[FindViewSlot(x, y)];
+			if(pCell->m_Used)
+				Mask |= pCell->m_Clients;
+		}
+	return Mask;
+}
+
 void CGameWorld::Snap(int SnappingClient)
 {
+	// snapping must not modify the world, it can run on several threads at once
+	if(SnappingClient == -1)
+	{
+		for(int i = 0; i < NUM_ENTTYPES; i++)
+			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+				pEnt->Snap(SnappingClient);
+		return;
+	}
+
+	// only visit the cells around the view, the box is the one of CEntity::NetworkClipped
+	vec2 ViewPos = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos;
+	vec2 ViewRange = vec2(1000.0f, 800.0f);
 	for(int i = 0; i < NUM_ENTTYPES; i++)
-		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
-		{
-			m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+	{
+		CGridQuery Query;
+		for(CEntity *pEnt = GridFirst(&Query, i, ViewPos-ViewRange, ViewPos+ViewRange); pEnt; pEnt = GridNext(&Query))
 			pEnt->Snap(SnappingClient);
-			pEnt = m_pNextTraverseEntity;
-		}
+	}
+}
+
+void CGameWorld::SnapShared()
+{
+	UpdateViewCells();
+
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+			pEnt->SnapShared();
 }
 
 void CGameWorld::PostSnap()
@@ -210,8 +402,11 @@ CCharacter *CGameWorld::IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, v
 	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
 	CCharacter *pClosest = 0;
 
-	CCharacter *p = (CCharacter *)FindFirst(ENTTYPE_CHARACTER);
-	for(; p; p = (CCharacter *)p->TypeNext())
+	CGridQuery Query;
+	vec2 Min = vec2(min(Pos0.x, Pos1.x)-Radius, min(Pos0.y, Pos1.y)-Radius);
+	vec2 Max = vec2(max(Pos0.x, Pos1.x)+Radius, max(Pos0.y, Pos1.y)+Radius);
+	CCharacter *p = (CCharacter *)GridFirst(&Query, ENTTYPE_CHARACTER, Min, Max);
+	for(; p; p = (CCharacter *)GridNext(&Query))
  	{
 		if(p == pNotThis)
 			continue;
@@ -240,8 +435,12 @@ CEntity *CGameWorld::ClosestEntity(vec2 Pos, float Radius, int Type, CEntity *pN
 	float ClosestRange = Radius*2;
 	CEntity *pClosest = 0;
 
-	CEntity *p = FindFirst(Type);
-	for(; p; p = p->TypeNext())
+	if(Type < 0 || Type >= NUM_ENTTYPES)
+		return 0;
+
+	CGridQuery Query;
+	CEntity *p = GridFirst(&Query, Type, Pos-vec2(Radius, Radius), Pos+vec2(Radius, Radius));
+	for(; p; p = GridNext(&Query))
  	{
 		if(p == pNotThis)
 			continue;
@@ -33,6 +33,59 @@ private:
 	CEntity *m_pNextTraverseEntity;
 	CEntity *m_apFirstEntityTypes[NUM_ENTTYPES];
 
+	// spatial hash grid, so queries only visit entities close to them
+	enum
+	{
+		GRID_CELL_SIZE = 128, // 4x4 tiles
+		GRID_NUM_BUCKETS = 1024,
+		GRID_MAX_QUERY_CELLS = 256, // bigger queries walk the type list instead
+	};
+
+	CEntity *m_aapGridBuckets[NUM_ENTTYPES][GRID_NUM_BUCKETS];
+	float m_aMaxProximityRadius[NUM_ENTTYPES];
+	int m_aNumEntities[NUM_ENTTYPES];
+
+	static int GridCoord(float Pos);
+	static int GridBucket(int CellX, int CellY);
+	void GridInsert(CEntity *pEnt);
+	void GridRemove(CEntity *pEnt);
+
+	// walks the entities of a type whose cell touches a box
+	class CGridQuery
+	{
+	public:
+		int m_Type;
+		bool m_WholeList;
+		int m_MinX, m_MaxX, m_MinY, m_MaxY;
+		int m_CellX, m_CellY;
+		CEntity *m_pCur;
+	};
+
+	CEntity *GridFirst(CGridQuery *pQuery, int Type, vec2 Min, vec2 Max);
+	CEntity *GridNext(CGridQuery *pQuery);
+	CEntity *GridSkip(CGridQuery *pQuery, CEntity *pEnt);
+
+	// clients by a coarse cell of their view position, rebuilt for every snapshot
+	enum
+	{
+		VIEW_CELL_SIZE = 1500,
+		NUM_VIEW_SLOTS = MAX_CLIENTS*2+1,
+	};
+
+	struct CViewCell
+	{
+		int m_X;
+		int m_Y;
+		bool m_Used;
+		CClientMask m_Clients;
+	};
+
+	CViewCell m_aViewCells[NUM_VIEW_SLOTS];
+
+	static int ViewCoord(float Pos);
+	int FindViewSlot(int CellX, int CellY) const;
+	void UpdateViewCells();
+
 	class CGameContext *m_pGameServer;
 	class CConfig *m_pConfig;
 	class IServer *m_pServer;
@@ -85,6 +138,21 @@ public:
 	*/
 	CEntity *ClosestEntity(vec2 Pos, float Radius, int Type, CEntity *pNotThis);
 
+	/*
+		Function: ViewCandidates
+			Finds the clients that might see a position. Only valid
+			while snapping.
+
+		Arguments:
+			pos - Position.
+
+		Returns:
+			Mask of the clients whose view position is in the cells
+			around the position, which contains all the clients within
+			1500 units of it.
+	*/
+	CClientMask ViewCandidates(vec2 Pos) const;
+
 	/*
 		Function: interserct_CCharacter
 			Finds the closest CCharacter that intersects the line.
@@ -119,6 +187,16 @@ public:
 	*/
 	void RemoveEntity(CEntity *pEntity);
 
+	/*
+		Function: UpdateGridCell
+			Moves an entity to the grid cell of its current position.
+			Called by CEntity::SetPos.
+
+		Arguments:
+			entity - Entity that moved
+	*/
+	void UpdateGridCell(CEntity *pEntity);
+
 	/*
 		Function: destroy_entity
 			Destroys an entity in the world.
@@ -130,15 +208,24 @@ public:
 
 	/*
 		Function: snap
-			Calls snap on all the entities in the world to create
-			the snapshot.
+			Calls snap on the entities in the view range of the
+			client to create the snapshot, or on all of them for
+			the demo.
 
 		Arguments:
 			snapping_client - ID of the client which snapshot
 			is being created.
 	*/
 	void Snap(int SnappingClient);
-	
+
+	/*
+		Function: SnapShared
+			Calls SnapShared on all the entities in the world to
+			create the items shared between all clients. Updates
+			the clients used by ViewCandidates first.
+	*/
+	void SnapShared();
+
 	void PostSnap();
 
 	/*
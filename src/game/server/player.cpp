@@ -33,6 +33,8 @@ CPlayer::CPlayer(CGameContext *pGameServer, int ClientID, bool Dummy, bool AsSpe
 	m_RespawnDisabled = GameServer()->m_pController->GetStartRespawnState();
 	m_DeadSpecMode = false;
 	m_Spawning = 0;
+	m_pSendVoteOption = 0;
+	m_SendingVoteOptions = false;
 }
 
 CPlayer::~CPlayer()
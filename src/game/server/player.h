@@ -67,6 +67,9 @@ public:
 	//
 	int m_Vote;
 	int m_VotePos;
+	// the vote options still to send, a few packets a tick
+	struct CVoteOptionServer *m_pSendVoteOption;
+	bool m_SendingVoteOptions;
 	//
 	int m_LastVoteCallTick;
 	int m_LastVoteTryTick;
@@ -36,9 +36,12 @@ MACRO_CONFIG_INT(ClCameraStabilizing, cl_camera_stabilizing, 0, 0, 100, CFGFLAG_
 
 MACRO_CONFIG_INT(ClCustomizeSkin, cl_customize_skin, 0, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Use a customized skin")
 
+MACRO_CONFIG_INT(ClMapTextureCache, cl_map_texture_cache, 128, 0, 4096, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Megabytes of textures of earlier maps to keep loaded for the next map")
+
 MACRO_CONFIG_INT(ClShowUserId, cl_show_user_id, 0, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Show the ID for every user")
 
 MACRO_CONFIG_INT(EdZoomTarget, ed_zoom_target, 1, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Zoom to the current mouse target")
+MACRO_CONFIG_INT(EdUndoMemory, ed_undo_memory, 64, 1, 1024, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Memory in megabytes the undo history of the editor can use")
 MACRO_CONFIG_INT(EdShowkeys, ed_showkeys, 0, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Editor shows which keys are pressed")
 MACRO_CONFIG_INT(EdColorGridInner, ed_color_grid_inner, 0xFFFFFF26, 0, 0, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Color inner grid")
 MACRO_CONFIG_INT(EdColorGridOuter, ed_color_grid_outer, 0xFF4C4C4C, 0, 0, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Color outer grid")
@@ -95,6 +98,7 @@ MACRO_CONFIG_INT(GfxNoclip, gfx_noclip, 0, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SAVE, "D
 
 MACRO_CONFIG_STR(ClMenuMap, cl_menu_map, 64, "auto", CFGFLAG_CLIENT|CFGFLAG_SAVE, "Background map in the menu, auto = automatic based on season")
 MACRO_CONFIG_INT(ClShowMenuMap, cl_show_menu_map, 1, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Display background map in the menu")
+MACRO_CONFIG_INT(ClMenuBackgroundFps, cl_menu_background_fps, 30, 0, 1000, CFGFLAG_CLIENT|CFGFLAG_SAVE, "How often per second the menu background map is redrawn (0 = every frame)")
 MACRO_CONFIG_INT(ClMenuAlpha, cl_menu_alpha, 25, 0, 75, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Transparency of the menu background")
 MACRO_CONFIG_INT(ClRotationRadius, cl_rotation_radius, 30, 1, 500, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Menu camera rotation radius")
 MACRO_CONFIG_INT(ClRotationSpeed, cl_rotation_speed, 40, 1, 120, CFGFLAG_CLIENT|CFGFLAG_SAVE, "Menu camera rotations in seconds")
@@ -142,6 +146,10 @@ MACRO_CONFIG_INT(SvVoteKick, sv_vote_kick, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_SERVER,
 MACRO_CONFIG_INT(SvVoteKickMin, sv_vote_kick_min, 0, 0, MAX_CLIENTS, CFGFLAG_SAVE|CFGFLAG_SERVER, "Minimum number of players required to start a kick vote")
 MACRO_CONFIG_INT(SvVoteKickBantime, sv_vote_kick_bantime, 5, 0, 1440, CFGFLAG_SAVE|CFGFLAG_SERVER, "The time to ban a player if kicked by vote. 0 makes it just use kick")
 
+MACRO_CONFIG_INT(SvPoolProjectiles, sv_pool_projectiles, 1024, 0, 65536, CFGFLAG_SAVE|CFGFLAG_SERVER, "Number of projectiles preallocated at map load")
+MACRO_CONFIG_INT(SvPoolLasers, sv_pool_lasers, 256, 0, 65536, CFGFLAG_SAVE|CFGFLAG_SERVER, "Number of lasers preallocated at map load")
+MACRO_CONFIG_INT(SvPoolPickups, sv_pool_pickups, 256, 0, 65536, CFGFLAG_SAVE|CFGFLAG_SERVER, "Number of pickups preallocated at map load")
+
 // debug
 #ifdef CONF_DEBUG // this one can crash the server if not used correctly
 	MACRO_CONFIG_INT(DbgDummies, dbg_dummies, 0, 0, MAX_CLIENTS, CFGFLAG_SERVER, "")
@@ -149,4 +157,6 @@ MACRO_CONFIG_INT(SvVoteKickBantime, sv_vote_kick_bantime, 5, 0, 1440, CFGFLAG_SA
 
 MACRO_CONFIG_INT(DbgFocus, dbg_focus, 0, 0, 1, CFGFLAG_CLIENT, "")
 MACRO_CONFIG_INT(DbgTuning, dbg_tuning, 0, 0, 1, CFGFLAG_CLIENT, "")
+MACRO_CONFIG_INT(DbgNetTiming, dbg_net_timing, 0, 0, 1, CFGFLAG_CLIENT, "Graph the interpolation buffer and prediction margin the client adapted to the connection")
+MACRO_CONFIG_INT(DbgProfileHud, dbg_profile_hud, 0, 0, 1, CFGFLAG_CLIENT, "Show what the frames spend their time on")
 #endif
@@ -10,7 +10,7 @@ enum
 	VOTE_SEARCH_LENGTH=64,
 	VOTE_REASON_LENGTH=16,
 
-	MAX_VOTE_OPTIONS=128,
+	MAX_VOTE_OPTIONS=1024,
 	MAX_VOTE_OPTION_ADD=21,
 
 	VOTE_COOLDOWN=60,
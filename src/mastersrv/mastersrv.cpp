@@ -1,6 +1,8 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
+#include <base/tl/threading.h>
 
 #include <engine/config.h>
 #include <engine/console.h>
@@ -17,9 +19,9 @@
 enum {
 	MTU = 1400,
 	MAX_SERVERS_PER_PACKET=75,
-	MAX_PACKETS=16,
-	MAX_SERVERS=MAX_SERVERS_PER_PACKET*MAX_PACKETS,
-	EXPIRE_TIME = 90
+	EXPIRE_TIME = 90,
+	MAX_LIST_REQUESTS = 4096,
+	MAX_LIST_CHANGES = 16384
 };
 
 struct CCheckServer
@@ -32,30 +34,50 @@ struct CCheckServer
 	TOKEN m_Token;
 };
 
-static CCheckServer m_aCheckServers[MAX_SERVERS];
+static CCheckServer *m_pCheckServers = 0;
 static int m_NumCheckServers = 0;
 
+// entries don't move, they are found through the address hash and expire through a heap
 struct CServerEntry
 {
 	enum ServerType m_Type;
 	NETADDR m_Address;
 	int64 m_Expire;
+	int m_Slot; // position in the list packets, -1 when unused
+	int m_HeapIndex;
+	int m_HashNext; // next entry in the hash chain or the free list
 };
 
-static CServerEntry m_aServers[MAX_SERVERS];
+static CServerEntry *m_pServers = 0;
+static int m_MaxServers = 0;
 static int m_NumServers = 0;
+static int m_FirstFreeServer = -1;
+
+static int *m_pServerHash = 0; // first entry per bucket
+static unsigned m_ServerHashSize = 0;
+static int *m_pSlots = 0; // entry per list slot, the first m_NumServers are used
+static int *m_pExpireHeap = 0; // entries by expiry, the first m_NumServers are used
+
+// every add and remove is a generation, the last ones are kept to answer delta requests
+struct CListChange
+{
+	NETADDR m_Address;
+	bool m_Added;
+};
+
+static unsigned m_Epoch = 0;
+static unsigned m_Generation = 0;
+static CListChange m_aChanges[MAX_LIST_CHANGES]; // generation g is at g%MAX_LIST_CHANGES
+static int m_NumChanges = 0;
 
 struct CPacketData
 {
-	int m_Size;
-	struct {
-		unsigned char m_aHeader[sizeof(SERVERBROWSE_LIST)];
-		CMastersrvAddr m_aServers[MAX_SERVERS_PER_PACKET];
-	} m_Data;
+	unsigned char m_aHeader[sizeof(SERVERBROWSE_LIST)];
+	CMastersrvAddr m_aServers[MAX_SERVERS_PER_PACKET];
 };
 
-CPacketData m_aPackets[MAX_PACKETS];
-static int m_NumPackets = 0;
+// slot i is m_pPackets[i/MAX_SERVERS_PER_PACKET].m_aServers[i%MAX_SERVERS_PER_PACKET]
+static CPacketData *m_pPackets = 0;
 
 
 struct CCountPacketData
@@ -65,7 +87,31 @@ struct CCountPacketData
 	unsigned char m_Low;
 };
 
-static CCountPacketData m_CountData;
+// a copy of the list packets that doesn't change anymore, shared with the list threads
+struct CListSnapshot
+{
+	volatile unsigned m_RefCount;
+	unsigned m_Generation;
+	int m_NumServers;
+	CPacketData *m_pPackets;
+};
+
+static LOCK m_SnapshotLock;
+static CListSnapshot *m_pSnapshot = 0;
+static bool m_SnapshotDirty = true;
+
+// list and count requests, answered by the list threads from the snapshot
+struct CListRequest
+{
+	NETADDR m_Address;
+	TOKEN m_Token;
+	TOKEN m_ResponseToken;
+	bool m_Count;
+};
+
+static mpmc_queue<CListRequest, MAX_LIST_REQUESTS> m_ListRequests;
+static SEMAPHORE m_ListSemaphore;
+static int m_NumListThreads = 0;
 
 
 CNetBan m_NetBan;
@@ -75,58 +121,351 @@ static CNetClient m_NetOp; // main
 
 IConsole *m_pConsole;
 
-void BuildPackets()
+void InitServers(int MaxServers)
+{
+	m_MaxServers = MaxServers;
+	m_pCheckServers = new CCheckServer[MaxServers];
+	m_pServers = new CServerEntry[MaxServers];
+	for(int i = MaxServers-1; i >= 0; i--)
+	{
+		m_pServers[i].m_Slot = -1;
+		m_pServers[i].m_HashNext = m_FirstFreeServer;
+		m_FirstFreeServer = i;
+	}
+
+	m_ServerHashSize = 1;
+	while(m_ServerHashSize < (unsigned)MaxServers*2)
+		m_ServerHashSize <<= 1;
+	m_pServerHash = new int[m_ServerHashSize];
+	for(unsigned i = 0; i < m_ServerHashSize; i++)
+		m_pServerHash[i] = -1;
+
+	m_pSlots = new int[MaxServers];
+	m_pExpireHeap = new int[MaxServers];
+
+	int NumPackets = (MaxServers+MAX_SERVERS_PER_PACKET-1)/MAX_SERVERS_PER_PACKET;
+	m_pPackets = new CPacketData[NumPackets];
+	for(int i = 0; i < NumPackets; i++)
+		mem_copy(m_pPackets[i].m_aHeader, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST));
+}
+
+static unsigned AddrHash(const NETADDR *pAddr)
+{
+	int Size = pAddr->type == NETTYPE_IPV4 ? NETADDR_SIZE_IPV4 : NETADDR_SIZE_IPV6;
+	unsigned Hash = (2166136261u^pAddr->type)*16777619u;
+	for(int i = 0; i < Size; i++)
+		Hash = (Hash^pAddr->ip[i])*16777619u;
+	Hash = (Hash^(pAddr->port&0xff))*16777619u;
+	Hash = (Hash^(pAddr->port>>8))*16777619u;
+	return Hash;
+}
+
+static unsigned ServerHash(const NETADDR *pAddr)
+{
+	return AddrHash(pAddr)&(m_ServerHashSize-1);
+}
+
+static int FindServer(const NETADDR *pAddr)
+{
+	for(int i = m_pServerHash[ServerHash(pAddr)]; i != -1; i = m_pServers[i].m_HashNext)
+		if(net_addr_comp(&m_pServers[i].m_Address, pAddr, true) == 0)
+			return i;
+	return -1;
+}
+
+static void PackAddr(const NETADDR *pAddr, CMastersrvAddr *pOut)
+{
+	if(pAddr->type == NETTYPE_IPV6)
+		mem_copy(pOut->m_aIp, pAddr->ip, sizeof(pOut->m_aIp));
+	else
+	{
+		static unsigned char s_aIPV4Mapping[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
+
+		mem_copy(pOut->m_aIp, s_aIPV4Mapping, sizeof(s_aIPV4Mapping));
+		pOut->m_aIp[12] = pAddr->ip[0];
+		pOut->m_aIp[13] = pAddr->ip[1];
+		pOut->m_aIp[14] = pAddr->ip[2];
+		pOut->m_aIp[15] = pAddr->ip[3];
+	}
+
+	pOut->m_aPort[0] = (pAddr->port>>8)&0xff;
+	pOut->m_aPort[1] = pAddr->port&0xff;
+}
+
+static void WriteSlot(int Slot)
+{
+	PackAddr(&m_pServers[m_pSlots[Slot]].m_Address, &m_pPackets[Slot/MAX_SERVERS_PER_PACKET].m_aServers[Slot%MAX_SERVERS_PER_PACKET]);
+}
+
+static void LogChange(const NETADDR *pAddr, bool Added)
+{
+	m_Generation++;
+	m_aChanges[m_Generation%MAX_LIST_CHANGES].m_Address = *pAddr;
+	m_aChanges[m_Generation%MAX_LIST_CHANGES].m_Added = Added;
+	m_NumChanges = min(m_NumChanges+1, (int)MAX_LIST_CHANGES);
+}
+
+static void HeapSet(int Index, int Server)
+{
+	m_pExpireHeap[Index] = Server;
+	m_pServers[Server].m_HeapIndex = Index;
+}
+
+// moves the entry at Index to its place in the expiry heap
+static void HeapFix(int Index)
+{
+	int Server = m_pExpireHeap[Index];
+	int64 Expire = m_pServers[Server].m_Expire;
+	while(Index > 0 && m_pServers[m_pExpireHeap[(Index-1)/2]].m_Expire > Expire)
+	{
+		HeapSet(Index, m_pExpireHeap[(Index-1)/2]);
+		Index = (Index-1)/2;
+	}
+	while(1)
+	{
+		int Child = Index*2+1;
+		if(Child >= m_NumServers)
+			break;
+		if(Child+1 < m_NumServers && m_pServers[m_pExpireHeap[Child+1]].m_Expire < m_pServers[m_pExpireHeap[Child]].m_Expire)
+			Child++;
+		if(m_pServers[m_pExpireHeap[Child]].m_Expire >= Expire)
+			break;
+		HeapSet(Index, m_pExpireHeap[Child]);
+		Index = Child;
+	}
+	HeapSet(Index, Server);
+}
+
+static CListSnapshot *AcquireSnapshot()
+{
+	lock_wait(m_SnapshotLock);
+	CListSnapshot *pSnapshot = m_pSnapshot;
+	atomic_inc(&pSnapshot->m_RefCount);
+	lock_unlock(m_SnapshotLock);
+	return pSnapshot;
+}
+
+static void ReleaseSnapshot(CListSnapshot *pSnapshot)
+{
+	if(atomic_dec(&pSnapshot->m_RefCount) == 0)
+	{
+		delete[] pSnapshot->m_pPackets;
+		delete pSnapshot;
+	}
+}
+
+static void PublishSnapshot()
+{
+	CListSnapshot *pSnapshot = new CListSnapshot;
+	int NumPackets = (m_NumServers+MAX_SERVERS_PER_PACKET-1)/MAX_SERVERS_PER_PACKET;
+	pSnapshot->m_RefCount = 1;
+	pSnapshot->m_Generation = m_Generation;
+	pSnapshot->m_NumServers = m_NumServers;
+	pSnapshot->m_pPackets = new CPacketData[max(NumPackets, 1)];
+	mem_copy(pSnapshot->m_pPackets, m_pPackets, sizeof(CPacketData)*NumPackets);
+
+	// requests still being answered keep the old one alive
+	lock_wait(m_SnapshotLock);
+	CListSnapshot *pOld = m_pSnapshot;
+	m_pSnapshot = pSnapshot;
+	lock_unlock(m_SnapshotLock);
+	if(pOld)
+		ReleaseSnapshot(pOld);
+	m_SnapshotDirty = false;
+}
+
+static void SendListPacket(const CListRequest *pRequest, const void *pData, int Size)
+{
+	// without a token the packet has to wait in the token cache, that only happens on the main thread
+	if(pRequest->m_Token == NET_TOKEN_NONE)
+	{
+		CNetChunk p;
+		p.m_ClientID = -1;
+		p.m_Address = pRequest->m_Address;
+		p.m_Flags = NETSENDFLAG_CONNLESS;
+		p.m_DataSize = Size;
+		p.m_pData = pData;
+		m_NetOp.Send(&p, NET_TOKEN_NONE);
+	}
+	else
+		m_NetOp.SendPacketConnless(&pRequest->m_Address, pRequest->m_Token, pRequest->m_ResponseToken, pData, Size);
+}
+
+static void SendListResponse(const CListRequest *pRequest)
 {
-	CServerEntry *pCurrent = &m_aServers[0];
-	int ServersLeft = m_NumServers;
-	m_NumPackets = 0;
-	int PacketIndex = 0;
-	while(ServersLeft-- && m_NumPackets < MAX_PACKETS)
+	CListSnapshot *pSnapshot = AcquireSnapshot();
+	if(pRequest->m_Count)
 	{
-		if(pCurrent->m_Type == SERVERTYPE_NORMAL)
+		CCountPacketData CountData;
+		mem_copy(CountData.m_Header, SERVERBROWSE_COUNT, sizeof(SERVERBROWSE_COUNT));
+		CountData.m_High = (pSnapshot->m_NumServers>>8)&0xff;
+		CountData.m_Low = pSnapshot->m_NumServers&0xff;
+		SendListPacket(pRequest, &CountData, sizeof(CountData));
+	}
+	else
+	{
+		for(int i = 0; i < pSnapshot->m_NumServers; i += MAX_SERVERS_PER_PACKET)
 		{
-			if(PacketIndex % MAX_SERVERS_PER_PACKET == 0)
-			{
-				PacketIndex = 0;
-				m_NumPackets++;
-			}
+			int Size = sizeof(SERVERBROWSE_LIST) + sizeof(CMastersrvAddr)*min(pSnapshot->m_NumServers-i, (int)MAX_SERVERS_PER_PACKET);
+			SendListPacket(pRequest, &pSnapshot->m_pPackets[i/MAX_SERVERS_PER_PACKET], Size);
+		}
 
-			// copy header
-			mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aHeader, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST));
+		// lets browsers that got every packet ask for deltas next time
+		unsigned char aInfo[sizeof(SERVERBROWSE_LISTINFO)+sizeof(CMastersrvListInfo)];
+		CMastersrvListInfo *pInfo = (CMastersrvListInfo *)(aInfo+sizeof(SERVERBROWSE_LISTINFO));
+		mem_copy(aInfo, SERVERBROWSE_LISTINFO, sizeof(SERVERBROWSE_LISTINFO));
+		MastersrvPackInt(pInfo->m_aEpoch, m_Epoch, 4);
+		MastersrvPackInt(pInfo->m_aGeneration, pSnapshot->m_Generation, 4);
+		MastersrvPackInt(pInfo->m_aNumPackets, (pSnapshot->m_NumServers+MAX_SERVERS_PER_PACKET-1)/MAX_SERVERS_PER_PACKET, 2);
+		SendListPacket(pRequest, aInfo, sizeof(aInfo));
+	}
+	ReleaseSnapshot(pSnapshot);
+}
 
-			// copy server addresses
-			if(pCurrent->m_Address.type == NETTYPE_IPV6)
-			{
-				mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp, pCurrent->m_Address.ip,
-					sizeof(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp));
-			}
-			else
-			{
-				static unsigned char s_aIPV4Mapping[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
+static void ListThread(void *pUser)
+{
+	while(1)
+	{
+		semaphore_wait(&m_ListSemaphore);
+		CListRequest Request;
+		if(m_ListRequests.pop(&Request))
+			SendListResponse(&Request);
+	}
+}
 
-				mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp, s_aIPV4Mapping, sizeof(s_aIPV4Mapping));
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[12] = pCurrent->m_Address.ip[0];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[13] = pCurrent->m_Address.ip[1];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[14] = pCurrent->m_Address.ip[2];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[15] = pCurrent->m_Address.ip[3];
-			}
+void InitListThreads(int NumThreads)
+{
+	secure_random_fill(&m_Epoch, sizeof(m_Epoch));
+	m_SnapshotLock = lock_create();
+	PublishSnapshot();
+	semaphore_init(&m_ListSemaphore);
+	for(m_NumListThreads = 0; m_NumListThreads < NumThreads; m_NumListThreads++)
+		thread_detach(thread_init(ListThread, 0));
+}
+
+void QueueListRequest(const NETADDR *pAddr, TOKEN Token, bool Count)
+{
+	CListRequest Request;
+	Request.m_Address = *pAddr;
+	Request.m_Token = Token;
+	Request.m_ResponseToken = m_NetOp.ResponseToken(pAddr);
+	Request.m_Count = Count;
+
+	// the main thread answers when there are no list threads or they fall behind
+	if(m_NumListThreads && Token != NET_TOKEN_NONE && m_ListRequests.push(Request))
+		semaphore_signal(&m_ListSemaphore);
+	else
+		SendListResponse(&Request);
+}
 
-			m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aPort[0] = (pCurrent->m_Address.port>>8)&0xff;
-			m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aPort[1] = pCurrent->m_Address.port&0xff;
+// the servers that were added or removed since BaseGeneration, -1 if that is too long ago
+int BuildListDelta(unsigned BaseGeneration, CMastersrvDeltaAddr **ppDelta)
+{
+	unsigned NumChanges = m_Generation-BaseGeneration;
+	if(BaseGeneration > m_Generation || NumChanges > (unsigned)m_NumChanges)
+		return -1;
 
-			PacketIndex++;
+	// the first change of every address tells whether the browser has it
+	unsigned HashSize = 1;
+	while(HashSize < NumChanges*2)
+		HashSize <<= 1;
+	unsigned *pFirstChange = new unsigned[HashSize];
+	mem_zero(pFirstChange, sizeof(unsigned)*HashSize);
+	CMastersrvDeltaAddr *pDelta = new CMastersrvDeltaAddr[max(NumChanges, 1u)];
+	int NumDelta = 0;
+	for(unsigned g = BaseGeneration+1; g <= m_Generation; g++)
+	{
+		const CListChange *pChange = &m_aChanges[g%MAX_LIST_CHANGES];
+		unsigned h = AddrHash(&pChange->m_Address)&(HashSize-1);
+		while(pFirstChange[h] && net_addr_comp(&m_aChanges[pFirstChange[h]%MAX_LIST_CHANGES].m_Address, &pChange->m_Address, true) != 0)
+			h = (h+1)&(HashSize-1);
+		if(pFirstChange[h])
+			continue;
+		pFirstChange[h] = g;
+
+		bool Listed = FindServer(&pChange->m_Address) != -1;
+		if(Listed == pChange->m_Added)
+		{
+			PackAddr(&pChange->m_Address, &pDelta[NumDelta].m_Addr);
+			pDelta[NumDelta++].m_Added = Listed;
+		}
+	}
+	delete[] pFirstChange;
+	*ppDelta = pDelta;
+	return NumDelta;
+}
 
-			m_aPackets[m_NumPackets-1].m_Size = sizeof(SERVERBROWSE_LIST) + sizeof(CMastersrvAddr)*PacketIndex;
+// answers with the servers that changed since BaseGeneration, false if the full list is better
+bool SendListDelta(const NETADDR *pAddr, TOKEN Token, unsigned BaseGeneration)
+{
+	CMastersrvDeltaAddr *pDelta;
+	int NumDelta = BuildListDelta(BaseGeneration, &pDelta);
+	if(NumDelta == -1)
+		return false;
 
-			pCurrent++;
+	bool Sent = NumDelta <= m_NumServers/2;
+	if(Sent)
+	{
+		CNetChunk p;
+		p.m_ClientID = -1;
+		p.m_Address = *pAddr;
+		p.m_Flags = NETSENDFLAG_CONNLESS;
+
+		// an empty delta still tells the browser the new generation
+		int NumPackets = max((NumDelta+MASTERSRV_DELTA_PER_PACKET-1)/MASTERSRV_DELTA_PER_PACKET, 1);
+		unsigned char aData[sizeof(SERVERBROWSE_LISTDELTA)+sizeof(CMastersrvListDelta)];
+		CMastersrvListDelta *pOut = (CMastersrvListDelta *)(aData+sizeof(SERVERBROWSE_LISTDELTA));
+		mem_copy(aData, SERVERBROWSE_LISTDELTA, sizeof(SERVERBROWSE_LISTDELTA));
+		MastersrvPackInt(pOut->m_aEpoch, m_Epoch, 4);
+		MastersrvPackInt(pOut->m_aBaseGeneration, BaseGeneration, 4);
+		MastersrvPackInt(pOut->m_aGeneration, m_Generation, 4);
+		MastersrvPackInt(pOut->m_aNumPackets, NumPackets, 2);
+		for(int i = 0; i < NumPackets; i++)
+		{
+			int Num = min(NumDelta-i*MASTERSRV_DELTA_PER_PACKET, (int)MASTERSRV_DELTA_PER_PACKET);
+			mem_copy(pOut->m_aServers, &pDelta[i*MASTERSRV_DELTA_PER_PACKET], sizeof(CMastersrvDeltaAddr)*Num);
+			p.m_DataSize = sizeof(aData) - sizeof(CMastersrvDeltaAddr)*(MASTERSRV_DELTA_PER_PACKET-Num);
+			p.m_pData = aData;
+			m_NetOp.Send(&p, Token);
 		}
-		else
+	}
+	delete[] pDelta;
+	return Sent;
+}
+
+static void RemoveServer(int Server)
+{
+	CServerEntry *pEntry = &m_pServers[Server];
+
+	// unlink from the hash
+	for(int *pLink = &m_pServerHash[ServerHash(&pEntry->m_Address)]; *pLink != -1; pLink = &m_pServers[*pLink].m_HashNext)
+	{
+		if(*pLink == Server)
 		{
-			*pCurrent = m_aServers[m_NumServers-1];
-			m_NumServers--;
-			dbg_msg("mastersrv", "error: server of invalid type, dropping it");
+			*pLink = pEntry->m_HashNext;
+			break;
 		}
 	}
+
+	// the last slot and heap entry fill the gap
+	int Last = --m_NumServers;
+	if(pEntry->m_Slot != Last)
+	{
+		m_pSlots[pEntry->m_Slot] = m_pSlots[Last];
+		m_pServers[m_pSlots[Last]].m_Slot = pEntry->m_Slot;
+		WriteSlot(pEntry->m_Slot);
+	}
+	if(pEntry->m_HeapIndex != Last)
+	{
+		HeapSet(pEntry->m_HeapIndex, m_pExpireHeap[Last]);
+		HeapFix(pEntry->m_HeapIndex);
+	}
+
+	LogChange(&pEntry->m_Address, false);
+	pEntry->m_Slot = -1;
+	pEntry->m_HashNext = m_FirstFreeServer;
+	m_FirstFreeServer = Server;
+	m_SnapshotDirty = true;
 }
 
 void SendOk(NETADDR *pAddr, TOKEN Token)
@@ -168,7 +507,7 @@ void SendCheck(NETADDR *pAddr, TOKEN Token)
 void AddCheckserver(NETADDR *pInfo, NETADDR *pAlt, ServerType Type, TOKEN Token)
 {
 	// add server
-	if(m_NumCheckServers == MAX_SERVERS)
+	if(m_NumCheckServers == m_MaxServers)
 	{
 		dbg_msg("mastersrv", "error: mastersrv is full");
 		return;
@@ -179,44 +518,62 @@ void AddCheckserver(NETADDR *pInfo, NETADDR *pAlt, ServerType Type, TOKEN Token)
 	char aAltAddrStr[NETADDR_MAXSTRSIZE];
 	net_addr_str(pAlt, aAltAddrStr, sizeof(aAltAddrStr), true);
 	dbg_msg("mastersrv", "checking: %s (%s)", aAddrStr, aAltAddrStr);
-	m_aCheckServers[m_NumCheckServers].m_Address = *pInfo;
-	m_aCheckServers[m_NumCheckServers].m_AltAddress = *pAlt;
-	m_aCheckServers[m_NumCheckServers].m_TryCount = 0;
-	m_aCheckServers[m_NumCheckServers].m_TryTime = 0;
-	m_aCheckServers[m_NumCheckServers].m_Type = Type;
-	m_aCheckServers[m_NumCheckServers].m_Token = Token;
+	m_pCheckServers[m_NumCheckServers].m_Address = *pInfo;
+	m_pCheckServers[m_NumCheckServers].m_AltAddress = *pAlt;
+	m_pCheckServers[m_NumCheckServers].m_TryCount = 0;
+	m_pCheckServers[m_NumCheckServers].m_TryTime = 0;
+	m_pCheckServers[m_NumCheckServers].m_Type = Type;
+	m_pCheckServers[m_NumCheckServers].m_Token = Token;
 	m_NumCheckServers++;
 }
 
 void AddServer(NETADDR *pInfo, ServerType Type)
 {
+	if(Type != SERVERTYPE_NORMAL)
+	{
+		dbg_msg("mastersrv", "error: server of invalid type, dropping it");
+		return;
+	}
+
 	// see if server already exists in list
-	for(int i = 0; i < m_NumServers; i++)
+	char aAddrStr[NETADDR_MAXSTRSIZE];
+	net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr), true);
+	int Server = FindServer(pInfo);
+	if(Server != -1)
 	{
-		if(net_addr_comp(&m_aServers[i].m_Address, pInfo, true) == 0)
-		{
-			char aAddrStr[NETADDR_MAXSTRSIZE];
-			net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr), true);
-			dbg_msg("mastersrv", "updated: %s", aAddrStr);
-			m_aServers[i].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
-			return;
-		}
+		dbg_msg("mastersrv", "updated: %s", aAddrStr);
+		m_pServers[Server].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
+		HeapFix(m_pServers[Server].m_HeapIndex);
+		return;
 	}
 
 	// add server
-	if(m_NumServers == MAX_SERVERS)
+	if(m_FirstFreeServer == -1)
 	{
 		dbg_msg("mastersrv", "error: mastersrv is full");
 		return;
 	}
 
-	char aAddrStr[NETADDR_MAXSTRSIZE];
-	net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr), true);
 	dbg_msg("mastersrv", "added: %s", aAddrStr);
-	m_aServers[m_NumServers].m_Address = *pInfo;
-	m_aServers[m_NumServers].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
-	m_aServers[m_NumServers].m_Type = Type;
-	m_NumServers++;
+	Server = m_FirstFreeServer;
+	CServerEntry *pEntry = &m_pServers[Server];
+	m_FirstFreeServer = pEntry->m_HashNext;
+	pEntry->m_Address = *pInfo;
+	pEntry->m_Expire = time_get()+time_freq()*EXPIRE_TIME;
+	pEntry->m_Type = Type;
+
+	unsigned Hash = ServerHash(pInfo);
+	pEntry->m_HashNext = m_pServerHash[Hash];
+	m_pServerHash[Hash] = Server;
+
+	int Index = m_NumServers++;
+	pEntry->m_Slot = Index;
+	m_pSlots[Index] = Server;
+	WriteSlot(Index);
+	HeapSet(Index, Server);
+	HeapFix(Index);
+	LogChange(pInfo, true);
+	m_SnapshotDirty = true;
 }
 
 void UpdateServers()
@@ -225,30 +582,30 @@ void UpdateServers()
 	int64 Freq = time_freq();
 	for(int i = 0; i < m_NumCheckServers; i++)
 	{
-		if(Now > m_aCheckServers[i].m_TryTime+Freq)
+		if(Now > m_pCheckServers[i].m_TryTime+Freq)
 		{
-			if(m_aCheckServers[i].m_TryCount == 10)
+			if(m_pCheckServers[i].m_TryCount == 10)
 			{
 				char aAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&m_aCheckServers[i].m_Address, aAddrStr, sizeof(aAddrStr), true);
+				net_addr_str(&m_pCheckServers[i].m_Address, aAddrStr, sizeof(aAddrStr), true);
 				char aAltAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&m_aCheckServers[i].m_AltAddress, aAltAddrStr, sizeof(aAltAddrStr), true);
+				net_addr_str(&m_pCheckServers[i].m_AltAddress, aAltAddrStr, sizeof(aAltAddrStr), true);
 				dbg_msg("mastersrv", "check failed: %s (%s)", aAddrStr, aAltAddrStr);
 
 				// FAIL!!
-				SendError(&m_aCheckServers[i].m_Address, m_aCheckServers[i].m_Token);
-				m_aCheckServers[i] = m_aCheckServers[m_NumCheckServers-1];
+				SendError(&m_pCheckServers[i].m_Address, m_pCheckServers[i].m_Token);
+				m_pCheckServers[i] = m_pCheckServers[m_NumCheckServers-1];
 				m_NumCheckServers--;
 				i--;
 			}
 			else
 			{
-				m_aCheckServers[i].m_TryCount++;
-				m_aCheckServers[i].m_TryTime = Now;
-				if(m_aCheckServers[i].m_TryCount&1)
-					SendCheck(&m_aCheckServers[i].m_Address, m_aCheckServers[i].m_Token);
+				m_pCheckServers[i].m_TryCount++;
+				m_pCheckServers[i].m_TryTime = Now;
+				if(m_pCheckServers[i].m_TryCount&1)
+					SendCheck(&m_pCheckServers[i].m_Address, m_pCheckServers[i].m_Token);
 				else
-					SendCheck(&m_aCheckServers[i].m_AltAddress, m_aCheckServers[i].m_Token);
+					SendCheck(&m_pCheckServers[i].m_AltAddress, m_pCheckServers[i].m_Token);
 			}
 		}
 	}
@@ -257,20 +614,13 @@ void UpdateServers()
 void PurgeServers()
 {
 	int64 Now = time_get();
-	int i = 0;
-	while(i < m_NumServers)
+	while(m_NumServers && m_pServers[m_pExpireHeap[0]].m_Expire < Now)
 	{
-		if(m_aServers[i].m_Expire < Now)
-		{
-			// remove server
-			char aAddrStr[NETADDR_MAXSTRSIZE];
-			net_addr_str(&m_aServers[i].m_Address, aAddrStr, sizeof(aAddrStr), true);
-			dbg_msg("mastersrv", "expired: %s", aAddrStr);
-			m_aServers[i] = m_aServers[m_NumServers-1];
-			m_NumServers--;
-		}
-		else
-			i++;
+		// remove server
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&m_pServers[m_pExpireHeap[0]].m_Address, aAddrStr, sizeof(aAddrStr), true);
+		dbg_msg("mastersrv", "expired: %s", aAddrStr);
+		RemoveServer(m_pExpireHeap[0]);
 	}
 }
 
@@ -282,13 +632,11 @@ void ReloadBans()
 
 int main(int argc, const char **argv) // ignore_convention
 {
-	int64 LastBuild = 0, LastBanReload = 0;
+	int64 LastUpdate = 0, LastPublish = 0, LastBanReload = 0;
 	ServerType Type = SERVERTYPE_INVALID;
 	NETADDR BindAddr;
 
 	dbg_logger_stdout();
-	
-	mem_copy(m_CountData.m_Header, SERVERBROWSE_COUNT, sizeof(SERVERBROWSE_COUNT));
 
 	int FlagMask = CFGFLAG_MASTER;
 	IKernel *pKernel = IKernel::Create();
@@ -309,6 +657,7 @@ int main(int argc, const char **argv) // ignore_convention
 	m_NetBan.Init(m_pConsole, pStorage);
 	if(argc > 1) // ignore_convention
 		m_pConsole->ParseArguments(argc-1, &argv[1]); // ignore_convention
+	InitServers(pConfig->m_MsMaxServers);
 
 	if(pConfig->m_Bindaddr[0] && net_host_lookup(pConfig->m_Bindaddr, &BindAddr, NETTYPE_ALL) == 0)
 	{
@@ -328,7 +677,7 @@ int main(int argc, const char **argv) // ignore_convention
 		dbg_msg("mastersrv", "could not initialize secure RNG");
 		return -1;
 	}
-	if(!m_NetOp.Open(BindAddr, pConfig, m_pConsole, 0, 0))
+	if(!m_NetOp.Open(BindAddr, pConfig, m_pConsole, 0, 0, pConfig->m_MsNetSockets))
 	{
 		dbg_msg("mastersrv", "couldn't start network (op)");
 		return -1;
@@ -340,6 +689,8 @@ int main(int argc, const char **argv) // ignore_convention
 		return -1;
 	}
 
+	InitListThreads(pConfig->m_MsListThreads);
+
 	// process pending commands
 	m_pConsole->StoreCommands(false);
 
@@ -376,33 +727,25 @@ int main(int argc, const char **argv) // ignore_convention
 				mem_comp(Packet.m_pData, SERVERBROWSE_GETCOUNT, sizeof(SERVERBROWSE_GETCOUNT)) == 0)
 			{
 				dbg_msg("mastersrv", "count requested, responding with %d", m_NumServers);
-
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-				p.m_DataSize = sizeof(m_CountData);
-				p.m_pData = &m_CountData;
-				m_CountData.m_High = (m_NumServers>>8)&0xff;
-				m_CountData.m_Low = m_NumServers&0xff;
-				m_NetOp.Send(&p, Token);
+				QueueListRequest(&Packet.m_Address, Token, true);
 			}
 			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETLIST) &&
 				mem_comp(Packet.m_pData, SERVERBROWSE_GETLIST, sizeof(SERVERBROWSE_GETLIST)) == 0)
 			{
 				// someone requested the list
 				dbg_msg("mastersrv", "requested, responding with %d servers", m_NumServers);
-
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-
-				for(int i = 0; i < m_NumPackets; i++)
+				QueueListRequest(&Packet.m_Address, Token, false);
+			}
+			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETLISTDELTA)+(int)sizeof(CMastersrvListRequest) &&
+				mem_comp(Packet.m_pData, SERVERBROWSE_GETLISTDELTA, sizeof(SERVERBROWSE_GETLISTDELTA)) == 0)
+			{
+				// the changes since the browser's last list, they are small and answered right away
+				const CMastersrvListRequest *pRequest = (const CMastersrvListRequest *)((const unsigned char *)Packet.m_pData+sizeof(SERVERBROWSE_GETLISTDELTA));
+				if(MastersrvUnpackInt(pRequest->m_aEpoch, 4) != m_Epoch ||
+					!SendListDelta(&Packet.m_Address, Token, MastersrvUnpackInt(pRequest->m_aGeneration, 4)))
 				{
-					p.m_DataSize = m_aPackets[i].m_Size;
-					p.m_pData = &m_aPackets[i].m_Data;
-					m_NetOp.Send(&p, Token);
+					dbg_msg("mastersrv", "delta requested, responding with %d servers", m_NumServers);
+					QueueListRequest(&Packet.m_Address, Token, false);
 				}
 			}
 		}
@@ -421,12 +764,12 @@ int main(int argc, const char **argv) // ignore_convention
 				// remove it from checking
 				for(int i = 0; i < m_NumCheckServers; i++)
 				{
-					if(net_addr_comp(&m_aCheckServers[i].m_Address, &Packet.m_Address, true) == 0 ||
-						net_addr_comp(&m_aCheckServers[i].m_AltAddress, &Packet.m_Address, true) == 0)
+					if(net_addr_comp(&m_pCheckServers[i].m_Address, &Packet.m_Address, true) == 0 ||
+						net_addr_comp(&m_pCheckServers[i].m_AltAddress, &Packet.m_Address, true) == 0)
 					{
-						Type = m_aCheckServers[i].m_Type;
+						Type = m_pCheckServers[i].m_Type;
 						m_NumCheckServers--;
-						m_aCheckServers[i] = m_aCheckServers[m_NumCheckServers];
+						m_pCheckServers[i] = m_pCheckServers[m_NumCheckServers];
 						break;
 					}
 				}
@@ -447,13 +790,19 @@ int main(int argc, const char **argv) // ignore_convention
 			ReloadBans();
 		}
 
-		if(time_get()-LastBuild > time_freq()*5)
+		// the list threads see changes once per second at most
+		if(m_SnapshotDirty && time_get()-LastPublish > time_freq())
+		{
+			LastPublish = time_get();
+			PublishSnapshot();
+		}
+
+		if(time_get()-LastUpdate > time_freq()*5)
 		{
-			LastBuild = time_get();
+			LastUpdate = time_get();
 
 			PurgeServers();
 			UpdateServers();
-			BuildPackets();
 		}
 
 		// be nice to the CPU
@@ -16,11 +16,71 @@ struct CMastersrvAddr
 	unsigned char m_aPort[2];
 };
 
+/*
+	List deltas: the master numbers the states of its list with a
+	generation and answers SERVERBROWSE_GETLIST with the list packets
+	followed by SERVERBROWSE_LISTINFO. A browser that got all packets
+	of a generation can send SERVERBROWSE_GETLISTDELTA with it, the
+	master answers with the servers added and removed since then in
+	SERVERBROWSE_LISTDELTA packets, or with the full list if it doesn't
+	remember that far back. All numbers are big endian.
+*/
+enum
+{
+	MASTERSRV_DELTA_PER_PACKET=70,
+};
+
+struct CMastersrvListInfo // SERVERBROWSE_LISTINFO
+{
+	unsigned char m_aEpoch[4]; // changes when the master restarts
+	unsigned char m_aGeneration[4];
+	unsigned char m_aNumPackets[2]; // SERVERBROWSE_LIST packets of this generation
+};
+
+struct CMastersrvListRequest // SERVERBROWSE_GETLISTDELTA
+{
+	unsigned char m_aEpoch[4];
+	unsigned char m_aGeneration[4];
+};
+
+struct CMastersrvDeltaAddr
+{
+	CMastersrvAddr m_Addr;
+	unsigned char m_Added; // 0 if removed
+};
+
+struct CMastersrvListDelta // SERVERBROWSE_LISTDELTA
+{
+	unsigned char m_aEpoch[4];
+	unsigned char m_aBaseGeneration[4];
+	unsigned char m_aGeneration[4];
+	unsigned char m_aNumPackets[2]; // of this delta
+	CMastersrvDeltaAddr m_aServers[MASTERSRV_DELTA_PER_PACKET]; // only the sent ones
+};
+
+inline void MastersrvPackInt(unsigned char *pOut, unsigned Value, int Size)
+{
+	for(int i = 0; i < Size; i++)
+		pOut[i] = (Value>>((Size-1-i)*8))&0xff;
+}
+
+inline unsigned MastersrvUnpackInt(const unsigned char *pIn, int Size)
+{
+	unsigned Value = 0;
+	for(int i = 0; i < Size; i++)
+		Value = (Value<<8)|pIn[i];
+	return Value;
+}
+
 static const unsigned char SERVERBROWSE_HEARTBEAT[] = {255, 255, 255, 255, 'b', 'e', 'a', '2'};
 
 static const unsigned char SERVERBROWSE_GETLIST[] = {255, 255, 255, 255, 'r', 'e', 'q', '2'};
 static const unsigned char SERVERBROWSE_LIST[] = {255, 255, 255, 255, 'l', 'i', 's', '2'};
 
+static const unsigned char SERVERBROWSE_LISTINFO[] = {255, 255, 255, 255, 'l', 'i', 'n', '2'};
+static const unsigned char SERVERBROWSE_GETLISTDELTA[] = {255, 255, 255, 255, 'r', 'e', 'd', '2'};
+static const unsigned char SERVERBROWSE_LISTDELTA[] = {255, 255, 255, 255, 'l', 'd', 'e', '2'};
+
 static const unsigned char SERVERBROWSE_GETCOUNT[] = {255, 255, 255, 255, 'c', 'o', 'u', '2'};
 static const unsigned char SERVERBROWSE_COUNT[] = {255, 255, 255, 255, 's', 'i', 'z', '2'};
 
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/adaptivemargin.h>
+
+// arrivals that are up to MaxLate ms later than the earliest, timed with the current margin
+static void AddWindow(CAdaptiveMargin *pMargin, int MaxLate)
+{
+	for(int i = 0; i < CAdaptiveMargin::WINDOW; i++)
+		pMargin->AddSample(pMargin->Margin() - i*MaxLate/(CAdaptiveMargin::WINDOW-1));
+}
+
+TEST(AdaptiveMargin, GrowsWithJitter)
+{
+	CAdaptiveMargin Margin;
+	Margin.Init(10, 0, 250, 20);
+	AddWindow(&Margin, 0);
+	EXPECT_EQ(Margin.Margin(), 8);
+
+	// covers all but the latest few arrivals at once
+	AddWindow(&Margin, 62);
+	EXPECT_GE(Margin.Margin(), 50);
+	EXPECT_LE(Margin.Margin(), 64);
+	EXPECT_GT(Margin.Jitter(), 20);
+
+	// the slow arrivals are in the past, now they still need the margin
+	const int Grown = Margin.Margin();
+	AddWindow(&Margin, 62);
+	EXPECT_EQ(Margin.Margin(), Grown);
+}
+
+TEST(AdaptiveMargin, ShrinksSlowly)
+{
+	CAdaptiveMargin Margin;
+	Margin.Init(100, 0, 250, 20);
+	AddWindow(&Margin, 0);
+	EXPECT_LT(Margin.Margin(), 100);
+	EXPECT_GT(Margin.Margin(), 50);
+
+	for(int i = 0; i < 40; i++)
+		AddWindow(&Margin, 0);
+	EXPECT_EQ(Margin.Margin(), CAdaptiveMargin::SAFETY);
+	EXPECT_EQ(Margin.Jitter(), 0);
+}
+
+TEST(AdaptiveMargin, LossAndLimits)
+{
+	CAdaptiveMargin Margin;
+	Margin.Init(0, 5, 40, 20);
+	Margin.AddLoss(4);
+	AddWindow(&Margin, 0);
+	EXPECT_GT(Margin.LossPercent(), (int)CAdaptiveMargin::LOSS_PERCENT);
+	EXPECT_EQ(Margin.Margin(), CAdaptiveMargin::SAFETY+20);
+
+	// the loss margin is only kept while there is loss
+	for(int i = 0; i < 40; i++)
+		AddWindow(&Margin, 0);
+	EXPECT_EQ(Margin.LossPercent(), 0);
+	EXPECT_EQ(Margin.Margin(), 5);
+
+	AddWindow(&Margin, 200);
+	EXPECT_EQ(Margin.Margin(), 40);
+}
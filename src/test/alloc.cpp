@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include <game/server/alloc.h>
+
+class CPooledItem
+{
+	MACRO_ALLOC_POOL(CPooledItem)
+
+public:
+	int m_aData[7];
+};
+
+MACRO_ALLOC_POOL_IMPL(CPooledItem, "test")
+
+TEST(Alloc, PoolReusesSlots)
+{
+	EXPECT_TRUE(CPooledItem::ms_Pool.Init(2));
+
+	CPooledItem *pA = new CPooledItem;
+	CPooledItem *pB = new CPooledItem;
+	EXPECT_EQ(pA->m_aData[3], 0);
+	pA->m_aData[3] = 5;
+	EXPECT_EQ(CPooledItem::ms_Pool.Used(), 2);
+	EXPECT_FALSE(CPooledItem::ms_Pool.Init(4));
+
+	// the third one does not fit and goes to the heap
+	CPooledItem *pC = new CPooledItem;
+	EXPECT_EQ(CPooledItem::ms_Pool.Used(), 2);
+	EXPECT_EQ(CPooledItem::ms_Pool.NumHeap(), 1);
+
+	delete pA;
+	CPooledItem *pD = new CPooledItem;
+	EXPECT_EQ(pD, pA);
+	EXPECT_EQ(pD->m_aData[3], 0);
+
+	delete pB;
+	delete pC;
+	delete pD;
+	EXPECT_EQ(CPooledItem::ms_Pool.Used(), 0);
+	EXPECT_EQ(CPooledItem::ms_Pool.Peak(), 2);
+	EXPECT_TRUE(CPooledItem::ms_Pool.Init(4));
+	EXPECT_EQ(CPooledItem::ms_Pool.Capacity(), 4);
+}
+
+TEST(Alloc, PoolIsListed)
+{
+	bool Found = false;
+	for(CPoolBase *pPool = CPoolBase::First(); pPool; pPool = pPool->Next())
+		Found |= pPool == &CPooledItem::ms_Pool;
+	EXPECT_TRUE(Found);
+}
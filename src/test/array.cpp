@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <base/tl/array.h>
+#include <base/tl/sorted_array.h>
+
+TEST(Array, AddInsertRemove)
+{
+	array<int> Array;
+	for(int i = 0; i < 10; i++)
+		Array.add(i);
+	Array.insert(-1, Array.all());
+	Array.remove_index(5);
+	Array.remove_index_fast(0);
+	ASSERT_EQ(Array.size(), 9);
+	const int aExpected[] = {9, 0, 1, 2, 3, 5, 6, 7, 8};
+	for(int i = 0; i < Array.size(); i++)
+		EXPECT_EQ(Array[i], aExpected[i]);
+	EXPECT_TRUE(Array.remove(9));
+	EXPECT_FALSE(Array.remove(9));
+	EXPECT_EQ(Array[0], 0);
+}
+
+TEST(Array, ReserveShrink)
+{
+	array<int> Array;
+	Array.reserve(100);
+	EXPECT_GE(Array.capacity(), 100);
+	for(int i = 0; i < 100; i++)
+		Array.add(i);
+	EXPECT_EQ(Array.capacity(), 100);
+	Array.reserve(10);
+	EXPECT_EQ(Array.capacity(), 100);
+	Array.set_size(10);
+	Array.shrink_to_fit();
+	EXPECT_EQ(Array.capacity(), 10);
+	for(int i = 0; i < 10; i++)
+		EXPECT_EQ(Array[i], i);
+}
+
+TEST(Array, NonTrivialElements)
+{
+	array<array<int> > Outer;
+	for(int i = 0; i < 20; i++)
+	{
+		array<int> Inner;
+		for(int j = 0; j <= i; j++)
+			Inner.add(j);
+		Outer.insert(Inner, Outer.all());
+	}
+	Outer.remove_index(3);
+	Outer.remove_index_fast(0);
+
+	array<array<int> > Copy = Outer;
+	Copy = Copy;
+	ASSERT_EQ(Copy.size(), 18);
+	EXPECT_EQ(Copy[0].size(), 1);
+	EXPECT_EQ(Copy[1].size(), 19);
+	EXPECT_EQ(Copy[2].size(), 18);
+	for(int i = 3; i < Copy.size(); i++)
+	{
+		ASSERT_EQ(Copy[i].size(), 19-i);
+		EXPECT_EQ(Copy[i][Copy[i].size()-1], 18-i);
+	}
+}
+
+#if defined(TL_CXX11)
+TEST(Array, Move)
+{
+	array<int> Array;
+	for(int i = 0; i < 5; i++)
+		Array.add(i);
+	const int *pData = Array.base_ptr();
+
+	array<int> Moved(tl_move(Array));
+	EXPECT_EQ(Moved.base_ptr(), pData);
+	EXPECT_EQ(Moved.size(), 5);
+	EXPECT_EQ(Array.size(), 0);
+
+	Array.add(7);
+	Array = tl_move(Moved);
+	EXPECT_EQ(Array.base_ptr(), pData);
+	EXPECT_EQ(Array.size(), 5);
+	EXPECT_EQ(Array[4], 4);
+}
+#endif
+
+TEST(Array, SortedAdd)
+{
+	sorted_array<int> Array;
+	for(int i = 0; i < 100; i++)
+		Array.add((i*37)%100);
+	ASSERT_EQ(Array.size(), 100);
+	for(int i = 0; i < Array.size(); i++)
+		EXPECT_EQ(Array[i], i);
+}
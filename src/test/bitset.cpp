@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include <base/tl/bitset.h>
+
+TEST(Bitset, SetTestReset)
+{
+	bitset<130> Set;
+	EXPECT_TRUE(Set.empty());
+	Set.set(0);
+	Set.set(64);
+	Set.set(129);
+	EXPECT_TRUE(Set.test(0));
+	EXPECT_TRUE(Set.test(64));
+	EXPECT_TRUE(Set.test(129));
+	EXPECT_FALSE(Set.test(63));
+	EXPECT_EQ(Set.count(), 3);
+	Set.reset(64);
+	EXPECT_FALSE(Set.test(64));
+	EXPECT_EQ(Set.count(), 2);
+}
+
+TEST(Bitset, Iterate)
+{
+	const int aBits[] = {1, 62, 63, 64, 127, 200, 255};
+	bitset<256> Set;
+	for(unsigned i = 0; i < sizeof(aBits)/sizeof(aBits[0]); i++)
+		Set.set(aBits[i]);
+
+	unsigned Found = 0;
+	for(int i = Set.first(); i >= 0; i = Set.next(i))
+	{
+		ASSERT_LT(Found, sizeof(aBits)/sizeof(aBits[0]));
+		EXPECT_EQ(i, aBits[Found]);
+		Found++;
+	}
+	EXPECT_EQ(Found, sizeof(aBits)/sizeof(aBits[0]));
+	EXPECT_EQ(bitset<256>().first(), -1);
+}
+
+TEST(Bitset, AllStaysInRange)
+{
+	bitset<70> All = bitset<70>::all();
+	EXPECT_EQ(All.count(), 70);
+	EXPECT_TRUE((~All).empty());
+
+	bitset<70> Others = ~bitset<70>::one(69);
+	EXPECT_EQ(Others.count(), 69);
+	EXPECT_FALSE(Others.test(69));
+	EXPECT_EQ((Others|bitset<70>::one(69)), All);
+	EXPECT_EQ((Others&bitset<70>::one(3)), bitset<70>::one(3));
+	EXPECT_EQ((All^Others), bitset<70>::one(69));
+}
+
+TEST(Bitset, SingleWord)
+{
+	bitset<64> Set = bitset<64>::all();
+	EXPECT_EQ(Set.count(), 64);
+	EXPECT_EQ(Set.next(63), -1);
+	Set.reset(0);
+	EXPECT_EQ(Set.first(), 1);
+}
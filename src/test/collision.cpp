@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+
+#include <base/math.h>
+#include <base/system.h>
+#include <game/collision.h>
+#include <game/mapitems.h>
+
+// the line test as it was before walking the tiles, to compare against
+static int IntersectLineSampled(const CCollision *pCollision, vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision)
+{
+	const int End = distance(Pos0, Pos1)+1;
+	const float InverseEnd = 1.0f/End;
+	vec2 Last = Pos0;
+
+	for(int i = 0; i <= End; i++)
+	{
+		vec2 Pos = mix(Pos0, Pos1, i*InverseEnd);
+		if(pCollision->CheckPoint(Pos.x, Pos.y))
+		{
+			*pOutCollision = Pos;
+			*pOutBeforeCollision = Last;
+			return pCollision->GetCollisionAt(Pos.x, Pos.y);
+		}
+		Last = Pos;
+	}
+	*pOutCollision = Pos1;
+	*pOutBeforeCollision = Pos1;
+	return 0;
+}
+
+// the box move without skipping empty regions, to compare against
+static void MoveBoxStepped(const CCollision *pCollision, vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity, bool *pDeath)
+{
+	vec2 Pos = *pInoutPos;
+	vec2 Vel = *pInoutVel;
+
+	const float Distance = length(Vel);
+	const int Max = (int)Distance;
+
+	if(pDeath)
+		*pDeath = false;
+
+	if(Distance > 0.00001f)
+	{
+		const float Fraction = 1.0f/(Max+1);
+		for(int i = 0; i <= Max; i++)
+		{
+			vec2 NewPos = Pos + Vel*Fraction;
+			if(pDeath && pCollision->TestBox(vec2(NewPos.x, NewPos.y), Size*(2.0f/3.0f), CCollision::COLFLAG_DEATH))
+				*pDeath = true;
+
+			if(pCollision->TestBox(vec2(NewPos.x, NewPos.y), Size))
+			{
+				int Hits = 0;
+				if(pCollision->TestBox(vec2(Pos.x, NewPos.y), Size))
+				{
+					NewPos.y = Pos.y;
+					Vel.y *= -Elasticity;
+					Hits++;
+				}
+				if(pCollision->TestBox(vec2(NewPos.x, Pos.y), Size))
+				{
+					NewPos.x = Pos.x;
+					Vel.x *= -Elasticity;
+					Hits++;
+				}
+				if(Hits == 0)
+				{
+					NewPos.y = Pos.y;
+					Vel.y *= -Elasticity;
+					NewPos.x = Pos.x;
+					Vel.x *= -Elasticity;
+				}
+			}
+			Pos = NewPos;
+		}
+	}
+
+	*pInoutPos = Pos;
+	*pInoutVel = Vel;
+}
+
+class CTestMap
+{
+public:
+	enum { WIDTH=500, HEIGHT=500 };
+
+	CTile m_aTiles[WIDTH*HEIGHT];
+	CCollision m_Collision;
+	unsigned m_Seed;
+
+	CTestMap(int SolidPercent) : m_Seed(1)
+	{
+		mem_zero(m_aTiles, sizeof(m_aTiles));
+		for(int y = 0; y < HEIGHT; y++)
+			for(int x = 0; x < WIDTH; x++)
+			{
+				bool Border = x == 0 || y == 0 || x == WIDTH-1 || y == HEIGHT-1;
+				if(Border || (int)(Random()%100) < SolidPercent)
+				{
+					static const int s_aTypes[] = {TILE_SOLID, TILE_SOLID, TILE_NOHOOK, TILE_DEATH};
+					m_aTiles[y*WIDTH+x].m_Index = s_aTypes[Random()%4];
+				}
+			}
+		m_Collision.Init(m_aTiles, WIDTH, HEIGHT);
+	}
+
+	unsigned Random()
+	{
+		m_Seed = m_Seed*1103515245u+12345u;
+		return m_Seed>>8;
+	}
+
+	float RandomFloat(float Min, float Max)
+	{
+		return Min + (Random()%65536)/65536.0f*(Max-Min);
+	}
+
+	vec2 RandomPos()
+	{
+		return vec2(RandomFloat(-100.0f, WIDTH*32.0f+100.0f), RandomFloat(-100.0f, HEIGHT*32.0f+100.0f));
+	}
+};
+
+TEST(Collision, IntersectLineMatchesSampling)
+{
+	CTestMap *pMap = new CTestMap(10);
+	for(int i = 0; i < 100000; i++)
+	{
+		vec2 Pos0 = pMap->RandomPos();
+		vec2 Pos1;
+		switch(i%4)
+		{
+		case 0: Pos1 = Pos0 + vec2(pMap->RandomFloat(-40.0f, 40.0f), pMap->RandomFloat(-40.0f, 40.0f)); break;
+		case 1: Pos1 = Pos0 + vec2(pMap->RandomFloat(-800.0f, 800.0f), pMap->RandomFloat(-800.0f, 800.0f)); break;
+		case 2: Pos1 = Pos0 + vec2(pMap->RandomFloat(-800.0f, 800.0f), 0.0f); break; // straight lines along the tile edges
+		default: Pos1 = pMap->RandomPos();
+		}
+		if(i%8 == 2)
+			Pos0.y = Pos1.y = (int)Pos0.y/32*32-0.5f;
+
+		vec2 Collision, BeforeCollision, ExpectedCollision, ExpectedBeforeCollision;
+		int Expected = IntersectLineSampled(&pMap->m_Collision, Pos0, Pos1, &ExpectedCollision, &ExpectedBeforeCollision);
+		int Result = pMap->m_Collision.IntersectLine(Pos0, Pos1, &Collision, &BeforeCollision);
+		ASSERT_EQ(Result, Expected);
+		ASSERT_EQ(Collision.x, ExpectedCollision.x);
+		ASSERT_EQ(Collision.y, ExpectedCollision.y);
+		ASSERT_EQ(BeforeCollision.x, ExpectedBeforeCollision.x);
+		ASSERT_EQ(BeforeCollision.y, ExpectedBeforeCollision.y);
+	}
+	delete pMap;
+}
+
+TEST(Collision, TileFlags)
+{
+	CTestMap *pMap = new CTestMap(10);
+
+	// Init maps the tile indices to flags in place
+	for(int y = -2; y < CTestMap::HEIGHT+2; y++)
+		for(int x = -2; x < CTestMap::WIDTH+2; x++)
+		{
+			int Index = pMap->m_aTiles[clamp(y, 0, (int)CTestMap::HEIGHT-1)*CTestMap::WIDTH+clamp(x, 0, (int)CTestMap::WIDTH-1)].m_Index;
+			vec2 Pos = vec2(x*32.0f+16.0f, y*32.0f+16.0f);
+			ASSERT_EQ(pMap->m_Collision.GetCollisionAt(Pos.x, Pos.y), Index);
+			ASSERT_EQ(pMap->m_Collision.CheckPoint(Pos), (Index&CCollision::COLFLAG_SOLID) != 0);
+			ASSERT_EQ(pMap->m_Collision.CheckPoint(Pos, CCollision::COLFLAG_DEATH), (Index&CCollision::COLFLAG_DEATH) != 0);
+			ASSERT_EQ(pMap->m_Collision.CheckPoint(Pos, CCollision::COLFLAG_NOHOOK), (Index&CCollision::COLFLAG_NOHOOK) != 0);
+		}
+	delete pMap;
+}
+
+TEST(Collision, MoveBoxMatchesStepping)
+{
+	CTestMap *pMap = new CTestMap(2);
+	for(int i = 0; i < 200000; i++)
+	{
+		vec2 Pos = pMap->RandomPos();
+		vec2 Vel = vec2(pMap->RandomFloat(-40.0f, 40.0f), pMap->RandomFloat(-40.0f, 40.0f));
+		vec2 ExpectedPos = Pos, ExpectedVel = Vel;
+		bool Death, ExpectedDeath;
+
+		MoveBoxStepped(&pMap->m_Collision, &ExpectedPos, &ExpectedVel, vec2(28.0f, 28.0f), 0.0f, &ExpectedDeath);
+		pMap->m_Collision.MoveBox(&Pos, &Vel, vec2(28.0f, 28.0f), 0.0f, &Death);
+
+		ASSERT_EQ(Pos.x, ExpectedPos.x);
+		ASSERT_EQ(Pos.y, ExpectedPos.y);
+		ASSERT_EQ(Vel.x, ExpectedVel.x);
+		ASSERT_EQ(Vel.y, ExpectedVel.y);
+		ASSERT_EQ(Death, ExpectedDeath);
+	}
+	delete pMap;
+}
+
+TEST(Collision, MoveBoxTrajectories)
+{
+	// boxes falling and bouncing through a map for a few seconds, with
+	// velocities up to what high tuning values give
+	enum { NUM_BOXES=500, NUM_TICKS=250 };
+	static const float s_aElasticity[] = {0.0f, 0.5f, 1.0f};
+	CTestMap *pMap = new CTestMap(8);
+	vec2 *pStart = new vec2[NUM_BOXES*2];
+	vec2 *pRecorded = new vec2[NUM_BOXES*NUM_TICKS*2];
+	bool *pRecordedDeath = new bool[NUM_BOXES*NUM_TICKS];
+	for(int b = 0; b < NUM_BOXES; b++)
+	{
+		pStart[b*2] = pMap->RandomPos();
+		pStart[b*2+1] = vec2(pMap->RandomFloat(-150.0f, 150.0f), pMap->RandomFloat(-150.0f, 150.0f));
+	}
+
+	// record the trajectories with the stepped move
+	for(int b = 0; b < NUM_BOXES; b++)
+	{
+		vec2 Pos = pStart[b*2], Vel = pStart[b*2+1];
+		for(int t = 0; t < NUM_TICKS; t++)
+		{
+			Vel.y += 0.5f;
+			MoveBoxStepped(&pMap->m_Collision, &Pos, &Vel, vec2(28.0f, 28.0f), s_aElasticity[b%3], &pRecordedDeath[b*NUM_TICKS+t]);
+			pRecorded[(b*NUM_TICKS+t)*2] = Pos;
+			pRecorded[(b*NUM_TICKS+t)*2+1] = Vel;
+		}
+	}
+
+	int Mismatches = 0;
+	for(int b = 0; b < NUM_BOXES; b++)
+	{
+		vec2 Pos = pStart[b*2], Vel = pStart[b*2+1];
+		for(int t = 0; t < NUM_TICKS; t++)
+		{
+			bool Death;
+			Vel.y += 0.5f;
+			pMap->m_Collision.MoveBox(&Pos, &Vel, vec2(28.0f, 28.0f), s_aElasticity[b%3], &Death);
+			const vec2 *pExpected = &pRecorded[(b*NUM_TICKS+t)*2];
+			if(Pos.x != pExpected[0].x || Pos.y != pExpected[0].y || Vel.x != pExpected[1].x || Vel.y != pExpected[1].y || Death != pRecordedDeath[b*NUM_TICKS+t])
+				Mismatches++;
+		}
+	}
+	EXPECT_EQ(Mismatches, 0);
+
+	delete[] pStart;
+	delete[] pRecorded;
+	delete[] pRecordedDeath;
+	delete pMap;
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/console.h>
+#include <engine/shared/config.h>
+#include <game/commands.h>
+
+static void ConNothing(IConsole::IResult *pResult, void *pUser)
+{
+}
+
+class CommandManager : public ::testing::Test
+{
+protected:
+	IConsole *m_pConsole;
+	CCommandManager m_Manager;
+
+	CommandManager()
+	{
+		m_pConsole = CreateConsole(CFGFLAG_SERVER);
+		m_Manager.Init(m_pConsole);
+	}
+
+	~CommandManager()
+	{
+		delete m_pConsole;
+	}
+
+	void Add(const char *pName)
+	{
+		EXPECT_EQ(m_Manager.AddCommand(pName, "", "", ConNothing, 0), 0);
+	}
+
+	int Filter(const char *pStr, bool Exact, array<bool> *paFilter)
+	{
+		paFilter->set_size(m_Manager.CommandCount());
+		return m_Manager.Filter(*paFilter, pStr, Exact);
+	}
+};
+
+TEST_F(CommandManager, Lookup)
+{
+	char aName[16];
+	for(int i = 0; i < 500; i++)
+	{
+		str_format(aName, sizeof(aName), "cmd%d", i);
+		Add(aName);
+	}
+	EXPECT_EQ(m_Manager.CommandCount(), 500);
+	EXPECT_EQ(m_Manager.AddCommand("cmd7", "", "", ConNothing, 0), 1);
+	ASSERT_TRUE(m_Manager.GetCommand("cmd123"));
+	EXPECT_STREQ(m_Manager.GetCommand("cmd123")->m_aName, "cmd123");
+	EXPECT_FALSE(m_Manager.GetCommand("CMD123"));
+	EXPECT_FALSE(m_Manager.GetCommand("cmd500"));
+
+	EXPECT_EQ(m_Manager.RemoveCommand("cmd0"), 0);
+	EXPECT_EQ(m_Manager.RemoveCommand("cmd0"), 1);
+	EXPECT_FALSE(m_Manager.GetCommand("cmd0"));
+	for(int i = 1; i < 500; i++)
+	{
+		str_format(aName, sizeof(aName), "cmd%d", i);
+		ASSERT_TRUE(m_Manager.GetCommand(aName));
+		EXPECT_STREQ(m_Manager.GetCommand(aName)->m_aName, aName);
+		EXPECT_EQ(m_Manager.GetCommand(aName), m_Manager.GetCommand(i-1));
+	}
+}
+
+TEST_F(CommandManager, Filter)
+{
+	Add("whisper");
+	Add("all");
+	Add("w");
+	Add("Team");
+	Add("mute");
+	Add("m");
+
+	array<bool> aFilter;
+	EXPECT_EQ(Filter("w", false, &aFilter), 4);
+	EXPECT_FALSE(aFilter[0]);
+	EXPECT_FALSE(aFilter[2]);
+	EXPECT_EQ(Filter("TE", false, &aFilter), 5);
+	EXPECT_FALSE(aFilter[3]);
+	EXPECT_EQ(Filter("x", false, &aFilter), 6);
+	EXPECT_EQ(Filter("", false, &aFilter), 0);
+	EXPECT_EQ(Filter("m", true, &aFilter), 5);
+	EXPECT_FALSE(aFilter[5]);
+	EXPECT_TRUE(aFilter[4]);
+
+	m_Manager.RemoveCommand("all");
+	EXPECT_EQ(Filter("mu", false, &aFilter), 4);
+	EXPECT_FALSE(aFilter[3]);
+
+	int First;
+	EXPECT_EQ(m_Manager.FindPrefix("M", &First), 2);
+	EXPECT_STREQ(m_Manager.GetCommand(m_Manager.SortedCommand(First))->m_aName, "m");
+	EXPECT_STREQ(m_Manager.GetCommand(m_Manager.SortedCommand(First+1))->m_aName, "mute");
+
+	m_Manager.ClearCommands();
+	EXPECT_FALSE(m_Manager.GetCommand("m"));
+	EXPECT_EQ(m_Manager.FindPrefix("", &First), 0);
+}
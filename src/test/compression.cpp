@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/compression.h>
+
+static const int s_aValues[] = {
+	0, 1, -1, 63, 64, -64, -65, 8191, 8192, -8193,
+	(1<<20)-1, 1<<20, -(1<<20)-1, (1<<27)-1, 1<<27, -(1<<27)-1, 0x7fffffff, (int)0x80000000,
+};
+
+// mostly zeros with runs of small values, like a snapshot delta
+static void FillInts(int *pInts, int Num, unsigned Seed)
+{
+	for(int i = 0; i < Num; i++)
+	{
+		Seed = Seed*1103515245u+12345u;
+		unsigned Kind = (Seed>>16)%8;
+		pInts[i] = Kind < 4 ? 0 : Kind < 7 ? (int)((Seed>>8)%128)-64 : s_aValues[(Seed>>4)%(sizeof(s_aValues)/sizeof(s_aValues[0]))];
+	}
+}
+
+static int PackSimple(const int *pInts, int Num, unsigned char *pDst)
+{
+	unsigned char *pCur = pDst;
+	for(int i = 0; i < Num; i++)
+		pCur = CVariableInt::Pack(pCur, pInts[i]);
+	return (int)(pCur - pDst);
+}
+
+TEST(VariableInt, SameAsPack)
+{
+	int aInts[300], aOut[300];
+	unsigned char aPacked[300*5+8], aSimple[300*5+8];
+	for(int Num = 0; Num <= 300; Num += Num < 40 ? 1 : 37)
+	{
+		FillInts(aInts, Num, Num);
+		int Size = PackSimple(aInts, Num, aSimple);
+		EXPECT_EQ(CVariableInt::Compress(aInts, Num*sizeof(int), aPacked, sizeof(aPacked)), Size);
+		EXPECT_TRUE(mem_comp(aPacked, aSimple, Size) == 0);
+		EXPECT_EQ(CVariableInt::Decompress(aPacked, Size, aOut, sizeof(aOut)), (long)(Num*sizeof(int)));
+		EXPECT_TRUE(mem_comp(aOut, aInts, Num*sizeof(int)) == 0);
+
+		// the output buffers run out at the same place as before
+		if(Num > 0)
+		{
+			EXPECT_EQ(CVariableInt::Decompress(aPacked, Size, aOut, (Num-1)*sizeof(int)), -1);
+		}
+		const unsigned char *pCur = aSimple;
+		for(int i = 0; i < Num; i++)
+		{
+			EXPECT_EQ(CVariableInt::Compress(aInts, Num*sizeof(int), aPacked, (int)(pCur-aSimple)+5), -1);
+			pCur = CVariableInt::Pack((unsigned char *)pCur, aInts[i]);
+		}
+	}
+
+	// every value on its own
+	for(unsigned i = 0; i < sizeof(s_aValues)/sizeof(s_aValues[0]); i++)
+	{
+		int Size = PackSimple(&s_aValues[i], 1, aSimple);
+		EXPECT_EQ(CVariableInt::Compress(&s_aValues[i], sizeof(int), aPacked, sizeof(aPacked)), Size);
+		EXPECT_TRUE(mem_comp(aPacked, aSimple, Size) == 0);
+		EXPECT_EQ(CVariableInt::Decompress(aPacked, Size, aOut, sizeof(aOut)), (long)sizeof(int));
+		EXPECT_EQ(aOut[0], s_aValues[i]);
+	}
+}
+
+TEST(VariableInt, SameAsUnpack)
+{
+	// any bytes unpack like Unpack does it, extend bits on the 5th byte included
+	unsigned char aData[256+8] = {0};
+	int aOut[256], aSimple[256];
+	for(unsigned Seed = 0; Seed < 64; Seed++)
+	{
+		unsigned Value = Seed;
+		for(int i = 0; i < 256; i++)
+		{
+			Value = Value*1103515245u+12345u;
+			aData[i] = Seed%2 ? (unsigned char)(Value>>16) : (unsigned char)((Value>>16)&((Value>>8)%4 ? 0x7f : 0xff));
+		}
+
+		int Num = 0;
+		const unsigned char *pCur = aData;
+		while(pCur < aData+256)
+			pCur = CVariableInt::Unpack(pCur, &aSimple[Num++]);
+		EXPECT_EQ(CVariableInt::Decompress(aData, 256, aOut, sizeof(aOut)), (long)(Num*sizeof(int)));
+		EXPECT_TRUE(mem_comp(aOut, aSimple, Num*sizeof(int)) == 0);
+	}
+}
+
+TEST(Lz4Block, Roundtrip)
+{
+	static unsigned char s_aSrc[70000];
+	static unsigned char s_aCompressed[sizeof(s_aSrc)*2];
+	static unsigned char s_aOut[sizeof(s_aSrc)];
+
+	// repeated runs, long matches, a match further back than the window and random bytes
+	unsigned Seed = 1;
+	for(unsigned i = 0; i < sizeof(s_aSrc); i++)
+	{
+		Seed = Seed*1103515245u+12345u;
+		if(i < 1000)
+			s_aSrc[i] = (unsigned char)(i%7);
+		else if(i < 20000)
+			s_aSrc[i] = s_aSrc[i-1000+(i%3)];
+		else if(i < 68000)
+			s_aSrc[i] = (unsigned char)(Seed>>16);
+		else
+			s_aSrc[i] = s_aSrc[i-67000];
+	}
+
+	const int aSizes[] = {0, 1, 12, 13, 100, 20000, sizeof(s_aSrc)};
+	for(unsigned k = 0; k < sizeof(aSizes)/sizeof(aSizes[0]); k++)
+	{
+		int Size = CLz4Block::Compress(s_aSrc, aSizes[k], s_aCompressed, sizeof(s_aCompressed));
+		ASSERT_GE(Size, 1);
+		EXPECT_EQ(CLz4Block::Decompress(s_aCompressed, Size, s_aOut, sizeof(s_aOut)), aSizes[k]);
+		EXPECT_TRUE(mem_comp(s_aOut, s_aSrc, aSizes[k]) == 0);
+		if(aSizes[k] == 20000)
+		{
+			EXPECT_LT(Size, 1000);
+		}
+
+		// the output must fit exactly and corrupt input is rejected
+		if(aSizes[k] > 0)
+		{
+			EXPECT_EQ(CLz4Block::Decompress(s_aCompressed, Size, s_aOut, aSizes[k]-1), -1);
+			EXPECT_EQ(CLz4Block::Compress(s_aSrc, aSizes[k], s_aCompressed, Size-1), -1);
+		}
+	}
+	EXPECT_EQ(CLz4Block::Decompress("\x00\x01\x00", 3, s_aOut, sizeof(s_aOut)), -1);
+	EXPECT_EQ(CLz4Block::Decompress("\xf0", 1, s_aOut, sizeof(s_aOut)), -1);
+}
@@ -0,0 +1,156 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/config.h>
+#include <engine/console.h>
+#include <engine/kernel.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+
+static void ConCount(IConsole::IResult *pResult, void *pUser)
+{
+	(*(int *)pUser)++;
+}
+
+TEST(Console, FindCommandIgnoresCase)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	int Count = 0;
+	pConsole->Register("count_calls", "", CFGFLAG_SERVER, ConCount, &Count, "");
+	pConsole->ExecuteLine("count_calls");
+	pConsole->ExecuteLine("COUNT_Calls");
+	pConsole->ExecuteLine("count_call");
+	EXPECT_EQ(Count, 2);
+	EXPECT_TRUE(pConsole->GetCommandInfo("Count_Calls", CFGFLAG_SERVER, false));
+	EXPECT_FALSE(pConsole->GetCommandInfo("count_calls", CFGFLAG_CLIENT, false));
+	delete pConsole;
+}
+
+TEST(Console, TempCommands)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_CLIENT);
+	pConsole->RegisterTemp("rcon_a", "", CFGFLAG_SERVER, "");
+	pConsole->RegisterTemp("rcon_b", "", CFGFLAG_SERVER, "");
+	EXPECT_TRUE(pConsole->GetCommandInfo("RCON_A", CFGFLAG_SERVER, true));
+	EXPECT_FALSE(pConsole->GetCommandInfo("rcon_a", CFGFLAG_SERVER, false));
+
+	pConsole->DeregisterTemp("rcon_a");
+	EXPECT_FALSE(pConsole->GetCommandInfo("rcon_a", CFGFLAG_SERVER, true));
+	EXPECT_TRUE(pConsole->GetCommandInfo("rcon_b", CFGFLAG_SERVER, true));
+
+	// recycled with a different name
+	pConsole->RegisterTemp("rcon_c", "", CFGFLAG_SERVER, "");
+	EXPECT_TRUE(pConsole->GetCommandInfo("rcon_c", CFGFLAG_SERVER, true));
+
+	pConsole->DeregisterTempAll();
+	EXPECT_FALSE(pConsole->GetCommandInfo("rcon_b", CFGFLAG_SERVER, true));
+	EXPECT_FALSE(pConsole->GetCommandInfo("rcon_c", CFGFLAG_SERVER, true));
+	EXPECT_TRUE(pConsole->GetCommandInfo("echo", CFGFLAG_CLIENT, false));
+	delete pConsole;
+}
+
+struct CArgsLog
+{
+	int m_Calls;
+	char m_aArgs[256];
+};
+
+static void ConLogArgs(IConsole::IResult *pResult, void *pUser)
+{
+	CArgsLog *pLog = (CArgsLog *)pUser;
+	pLog->m_Calls++;
+	pLog->m_aArgs[0] = 0;
+	for(int i = 0; i < pResult->NumArguments(); i++)
+	{
+		str_append(pLog->m_aArgs, pResult->GetString(i), sizeof(pLog->m_aArgs));
+		str_append(pLog->m_aArgs, "|", sizeof(pLog->m_aArgs));
+	}
+}
+
+TEST(Console, RepeatedLinesSameAsParsed)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_CLIENT);
+	CArgsLog Log = {0, ""};
+	CArgsLog StrokeLog = {0, ""};
+	pConsole->Register("log", "s[a] ?i[b] ?r[rest]", CFGFLAG_CLIENT, ConLogArgs, &Log, "");
+	pConsole->Register("+log", "", CFGFLAG_CLIENT, ConLogArgs, &StrokeLog, "");
+
+	for(int i = 0; i < 3; i++)
+	{
+		pConsole->ExecuteLine("log \"a b\" 2 rest of it; log x");
+		EXPECT_STREQ(Log.m_aArgs, "x|");
+		pConsole->ExecuteLine("log \"a b\" 2 rest of it");
+		EXPECT_STREQ(Log.m_aArgs, "a b|2|rest of it|");
+		pConsole->ExecuteLineStroked(1, "+log");
+		EXPECT_STREQ(StrokeLog.m_aArgs, "1|");
+		pConsole->ExecuteLineStroked(0, "+log");
+		EXPECT_STREQ(StrokeLog.m_aArgs, "0|");
+	}
+	EXPECT_EQ(Log.m_Calls, 9);
+	EXPECT_EQ(StrokeLog.m_Calls, 6);
+
+	// re-registering drops the parsed lines
+	int Count = 0;
+	pConsole->Register("log", "", CFGFLAG_CLIENT, ConCount, &Count, "");
+	pConsole->ExecuteLine("log x");
+	EXPECT_EQ(Count, 1);
+	EXPECT_EQ(Log.m_Calls, 9);
+	delete pConsole;
+}
+
+TEST(Console, BindStroked)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_CLIENT);
+	CArgsLog Log = {0, ""};
+	pConsole->Register("+log", "", CFGFLAG_CLIENT, ConLogArgs, &Log, "");
+	pConsole->Register("log", "s[a] ?i[b] ?r[rest]", CFGFLAG_CLIENT, ConLogArgs, &Log, "");
+
+	// the plain command only runs on the press, the + command on both
+	enum { ROUNDS=100 };
+	for(int i = 0; i < ROUNDS; i++)
+		pConsole->ExecuteLineStroked(i&1, "+log; log \"some vote\" 3 reason text");
+	EXPECT_EQ(Log.m_Calls, ROUNDS+ROUNDS/2);
+	delete pConsole;
+}
+
+TEST(Console, ExecuteFile)
+{
+	CTestInfo Info;
+	IKernel *pKernel = IKernel::Create();
+	IStorage *pStorage = CreateTestStorage();
+	IConfigManager *pConfigManager = CreateConfigManager();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	pKernel->RegisterInterface(pStorage);
+	pKernel->RegisterInterface(pConfigManager);
+	pKernel->RegisterInterface(pConsole);
+	pConfigManager->Init(CFGFLAG_SERVER);
+	pConsole->Init();
+
+	// a generated config setting the variables over and over, like vote lists at map change
+	enum { NUM_LINES=10000 };
+	int Count = 0;
+	pConsole->Register("count_calls", "", CFGFLAG_SERVER, ConCount, &Count, "");
+	static const char *s_apLines[] = {"sv_name \"bench\"", "sv_max_clients 16", "sv_rcon_max_tries 3", "count_calls", "sv_spamprotection 1"};
+	char aCfg[64];
+	Info.Filename(aCfg, sizeof(aCfg), ".cfg");
+	IOHANDLE File = pStorage->OpenFile(aCfg, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	for(int i = 0; i < NUM_LINES; i++)
+	{
+		io_write(File, s_apLines[i%5], str_length(s_apLines[i%5]));
+		io_write_newline(File);
+	}
+	io_close(File);
+
+	EXPECT_TRUE(pConsole->ExecuteFile(aCfg));
+	EXPECT_EQ(pConfigManager->Values()->m_SvMaxClients, 16);
+	EXPECT_EQ(Count, NUM_LINES/5);
+
+	EXPECT_TRUE(pStorage->RemoveFile(aCfg, IStorage::TYPE_SAVE));
+	delete pKernel;
+	delete pConsole;
+	delete pConfigManager;
+	delete pStorage;
+}
@@ -3,6 +3,7 @@
 #include <gtest/gtest.h>
 
 #include <engine/shared/datafile.h>
+#include <engine/shared/jobs.h>
 #include <engine/storage.h>
 
 TEST(Datafile, RoundtripItemDataAndSize)
@@ -63,3 +64,222 @@ TEST(Datafile, RoundtripItemDataAndSize)
 
 	EXPECT_TRUE(pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE));
 }
+
+TEST(Datafile, MappedReadAndReplace)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".datafile");
+	IStorage *pStorage = CreateTestStorage();
+	CDataFileWriter Writer;
+	ASSERT_TRUE(Writer.Open(pStorage, aFilename));
+
+	static const char TEST_DATA[] = "Hello World!";
+	int Index = Writer.AddData(sizeof(TEST_DATA), TEST_DATA);
+	int Empty = Writer.AddData(0, TEST_DATA);
+	int aItem[2] = {Index, Empty};
+	Writer.AddItem(12, 34, sizeof(aItem), aItem);
+	EXPECT_TRUE(Writer.Finish());
+
+	CDataFileReader Reader;
+	ASSERT_TRUE(Reader.Open(pStorage, aFilename, IStorage::TYPE_ALL));
+	SHA256_DIGEST Sha256 = Reader.Sha256();
+	unsigned Crc = Reader.Crc();
+	EXPECT_TRUE(Reader.Close());
+
+	ASSERT_TRUE(Reader.Open(pStorage, aFilename, IStorage::TYPE_ALL, true));
+	EXPECT_FALSE(sha256_comp(Reader.Sha256(), Sha256));
+	EXPECT_EQ(Reader.Crc(), Crc);
+
+	int Type;
+	int ID;
+	void *pItem = Reader.GetItem(0, &Type, &ID);
+	ASSERT_EQ(Reader.GetItemSize(0), sizeof(aItem));
+	EXPECT_TRUE(mem_comp(pItem, aItem, sizeof(aItem)) == 0);
+	EXPECT_EQ(Type, 12);
+	EXPECT_EQ(ID, 34);
+
+	ASSERT_EQ(Reader.GetDataSize(Index), sizeof(TEST_DATA));
+	EXPECT_TRUE(mem_comp(Reader.GetData(Index), TEST_DATA, sizeof(TEST_DATA)) == 0);
+	EXPECT_EQ(Reader.GetDataSize(Empty), 0);
+	Reader.GetData(Empty);
+
+	static const char REPL_DATA[] = "Replacement";
+	char *pReplace = (char *)mem_alloc(sizeof(REPL_DATA), 1);
+	mem_copy(pReplace, REPL_DATA, sizeof(REPL_DATA));
+	Reader.ReplaceData(Index, pReplace, sizeof(REPL_DATA));
+	ASSERT_EQ(Reader.GetDataSize(Index), sizeof(REPL_DATA));
+	EXPECT_TRUE(mem_comp(Reader.GetData(Index), REPL_DATA, sizeof(REPL_DATA)) == 0);
+	Reader.UnloadData(Index);
+
+	EXPECT_TRUE(Reader.Close());
+
+	EXPECT_TRUE(pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE));
+}
+
+TEST(Datafile, Prefetch)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".datafile");
+	IStorage *pStorage = CreateTestStorage();
+	CDataFileWriter Writer;
+	ASSERT_TRUE(Writer.Open(pStorage, aFilename));
+
+	static int s_aaData[16][256];
+	for(int i = 0; i < 16; i++)
+	{
+		for(int k = 0; k < 256; k++)
+			s_aaData[i][k] = i*k;
+		Writer.AddData(sizeof(s_aaData[i]), s_aaData[i]);
+	}
+	EXPECT_TRUE(Writer.Finish());
+
+	CJobPool Pool;
+	Pool.Init(3);
+	for(int Mapped = 0; Mapped < 2; Mapped++)
+	{
+		CDataFileReader Reader;
+		ASSERT_TRUE(Reader.Open(pStorage, aFilename, IStorage::TYPE_ALL, Mapped));
+		int aIndices[] = {3, 5, 3, 100, -1};
+		Reader.Prefetch(&Pool, aIndices, sizeof(aIndices)/sizeof(aIndices[0]), 0);
+		Reader.Prefetch(&Pool, 0, 0, 0);
+		for(int i = 0; i < Reader.NumData(); i++)
+		{
+			ASSERT_EQ(Reader.GetDataSize(i), sizeof(s_aaData[i]));
+			EXPECT_TRUE(mem_comp(Reader.GetData(i), s_aaData[i], sizeof(s_aaData[i])) == 0);
+		}
+		EXPECT_TRUE(Reader.Close());
+	}
+
+	EXPECT_TRUE(pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE));
+}
+
+TEST(Datafile, ParallelCompressionIsIdentical)
+{
+	IStorage *pStorage = CreateTestStorage();
+	static int s_aaData[16][1024];
+	for(int i = 0; i < 16; i++)
+		for(int k = 0; k < 1024; k++)
+			s_aaData[i][k] = (k*i)%(i+3);
+
+	CJobPool Pool;
+	Pool.Init(3);
+	CTestInfo Info;
+	char aaFilenames[2][64];
+	for(int Parallel = 0; Parallel < 2; Parallel++)
+	{
+		Info.Filename(aaFilenames[Parallel], sizeof(aaFilenames[Parallel]), Parallel ? ".parallel.datafile" : ".datafile");
+		CDataFileWriter Writer;
+		ASSERT_TRUE(Writer.Open(pStorage, aaFilenames[Parallel], Parallel ? &Pool : 0));
+		for(int i = 0; i < 16; i++)
+			Writer.AddData(sizeof(s_aaData[i])/(i+1), s_aaData[i]);
+		int aItem[2] = {1, 2};
+		Writer.AddItem(12, 34, sizeof(aItem), aItem);
+		EXPECT_TRUE(Writer.Finish());
+	}
+
+	void *apFiles[2];
+	unsigned aSizes[2];
+	for(int i = 0; i < 2; i++)
+	{
+		IOHANDLE File = pStorage->OpenFile(aaFilenames[i], IOFLAG_READ, IStorage::TYPE_SAVE);
+		ASSERT_TRUE(File);
+		io_read_all(File, &apFiles[i], &aSizes[i]);
+		io_close(File);
+	}
+	ASSERT_EQ(aSizes[0], aSizes[1]);
+	EXPECT_TRUE(mem_comp(apFiles[0], apFiles[1], aSizes[0]) == 0);
+
+	for(int i = 0; i < 2; i++)
+	{
+		mem_free(apFiles[i]);
+		EXPECT_TRUE(pStorage->RemoveFile(aaFilenames[i], IStorage::TYPE_SAVE));
+	}
+}
+
+TEST(Datafile, FastFormatAndResave)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	char aResaved[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".datafile");
+	Info.Filename(aResaved, sizeof(aResaved), ".resaved.datafile");
+	IStorage *pStorage = CreateTestStorage();
+
+	static int s_aCompressible[4096];
+	static unsigned char s_aRandom[1024];
+	for(int i = 0; i < 4096; i++)
+		s_aCompressible[i] = i%13;
+	unsigned Seed = 7;
+	for(int i = 0; i < 1024; i++)
+	{
+		Seed = Seed*1103515245u+12345u;
+		s_aRandom[i] = (unsigned char)(Seed>>16);
+	}
+
+	CDataFileWriter Writer;
+	ASSERT_TRUE(Writer.Open(pStorage, aFilename, 0, CDataFileWriter::FORMAT_FAST));
+	int Compressible = Writer.AddData(sizeof(s_aCompressible), s_aCompressible);
+	int Random = Writer.AddData(sizeof(s_aRandom), s_aRandom);
+	int aItem[2] = {Compressible, Random};
+	Writer.AddItem(12, 34, sizeof(aItem), aItem);
+	EXPECT_TRUE(Writer.Finish());
+
+	for(int Mapped = 0; Mapped < 2; Mapped++)
+	{
+		CDataFileReader Reader;
+		ASSERT_TRUE(Reader.Open(pStorage, aFilename, IStorage::TYPE_ALL, Mapped));
+		EXPECT_EQ(Reader.Version(), 5);
+		EXPECT_TRUE(mem_comp(Reader.GetItem(0, 0, 0), aItem, sizeof(aItem)) == 0);
+		ASSERT_EQ(Reader.GetDataSize(Compressible), sizeof(s_aCompressible));
+		EXPECT_TRUE(mem_comp(Reader.GetData(Compressible), s_aCompressible, sizeof(s_aCompressible)) == 0);
+		ASSERT_EQ(Reader.GetDataSize(Random), sizeof(s_aRandom));
+		EXPECT_TRUE(mem_comp(Reader.GetData(Random), s_aRandom, sizeof(s_aRandom)) == 0);
+	}
+
+	ASSERT_TRUE(CDataFileWriter::Resave(pStorage, aFilename, IStorage::TYPE_ALL, aResaved, CDataFileWriter::FORMAT_ZLIB));
+	CDataFileReader Reader;
+	ASSERT_TRUE(Reader.Open(pStorage, aResaved, IStorage::TYPE_ALL));
+	EXPECT_EQ(Reader.Version(), 4);
+	EXPECT_TRUE(mem_comp(Reader.GetItem(0, 0, 0), aItem, sizeof(aItem)) == 0);
+	EXPECT_TRUE(mem_comp(Reader.GetData(Compressible), s_aCompressible, sizeof(s_aCompressible)) == 0);
+	EXPECT_TRUE(mem_comp(Reader.GetData(Random), s_aRandom, sizeof(s_aRandom)) == 0);
+	Reader.Close();
+
+	EXPECT_TRUE(pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aResaved, IStorage::TYPE_SAVE));
+}
+
+TEST(Datafile, FindItem)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".datafile");
+	IStorage *pStorage = CreateTestStorage();
+	CDataFileWriter Writer;
+	ASSERT_TRUE(Writer.Open(pStorage, aFilename));
+	for(int i = 0; i < 1000; i++)
+	{
+		int Value = i;
+		Writer.AddItem(1+i%5, i/5, sizeof(Value), &Value);
+	}
+	EXPECT_TRUE(Writer.Finish());
+
+	CDataFileReader Reader;
+	ASSERT_TRUE(Reader.Open(pStorage, aFilename, IStorage::TYPE_ALL));
+	for(int i = 0; i < 1000; i++)
+	{
+		int *pValue = (int *)Reader.FindItem(1+i%5, i/5);
+		ASSERT_TRUE(pValue);
+		EXPECT_EQ(*pValue, i);
+	}
+	EXPECT_FALSE(Reader.FindItem(1, 200));
+	EXPECT_FALSE(Reader.FindItem(6, 0));
+	EXPECT_FALSE(Reader.FindItem(1, 0x10000));
+	EXPECT_TRUE(Reader.Close());
+	EXPECT_FALSE(Reader.FindItem(1, 0));
+
+	EXPECT_TRUE(pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE));
+	delete pStorage;
+}
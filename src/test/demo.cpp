@@ -0,0 +1,610 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/demostream.h>
+#include <engine/shared/snapshot.h>
+
+static void RecordDemo(CDemoRecorder *pRecorder, IStorage *pStorage, IConsole *pConsole, const char *pFilename, const char *pMap, SHA256_DIGEST Sha256)
+{
+	ASSERT_TRUE(pRecorder->Start(pStorage, pConsole, pFilename, "0.7 test", pMap, Sha256, 0, "server") == 0);
+
+	// big snapshots that change every tick, so that the smallest queue fills up
+	static char s_aData[CSnapshot::MAX_SIZE];
+	CSnapshotBuilder Builder;
+	for(int Tick = 1; Tick <= 600; Tick++)
+	{
+		Builder.Init();
+		for(int i = 0; i < 200; i++)
+		{
+			int *pItem = (int *)Builder.NewItem(i%8+1, i, 20*sizeof(int));
+			for(int f = 0; f < 20; f++)
+				pItem[f] = (f+i)%3 ? i*f : Tick*(i+f);
+		}
+		int Size = Builder.Finish(s_aData);
+		pRecorder->RecordSnapshot(Tick, s_aData, Size);
+
+		int aMsg[4] = {Tick, 1, 2, 3};
+		pRecorder->RecordMessage(aMsg, sizeof(aMsg));
+		if(Tick%100 == 0)
+			pRecorder->AddDemoMarker();
+	}
+	EXPECT_TRUE(pRecorder->Stop() == 0);
+}
+
+TEST(Demo, WriterThreadSameAsDirect)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+
+	// the recorder copies the map into the demo
+	char aMap[64], aMapFilename[128];
+	str_format(aMap, sizeof(aMap), "%s", Info.m_aFilenamePrefix);
+	str_format(aMapFilename, sizeof(aMapFilename), "maps/%s.map", aMap);
+	pStorage->CreateFolder("maps", IStorage::TYPE_SAVE);
+	IOHANDLE File = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, "not really a map", 16);
+	io_close(File);
+	SHA256_DIGEST Sha256;
+	unsigned Crc, MapSize;
+	ASSERT_TRUE(pStorage->GetHashAndSize(aMapFilename, IStorage::TYPE_SAVE, &Sha256, &Crc, &MapSize));
+
+	char aDirect[64], aThreaded[64];
+	Info.Filename(aDirect, sizeof(aDirect), "-direct.demo");
+	Info.Filename(aThreaded, sizeof(aThreaded), "-threaded.demo");
+
+	CSnapshotDelta Delta;
+	CDemoRecorder Recorder(&Delta);
+	RecordDemo(&Recorder, pStorage, pConsole, aDirect, aMap, Sha256);
+	Recorder.SetWriterQueue(1);
+	RecordDemo(&Recorder, pStorage, pConsole, aThreaded, aMap, Sha256);
+
+	void *pDirect, *pThreaded;
+	unsigned DirectSize, ThreadedSize;
+	File = pStorage->OpenFile(aDirect, IOFLAG_READ, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_read_all(File, &pDirect, &DirectSize);
+	io_close(File);
+	File = pStorage->OpenFile(aThreaded, IOFLAG_READ, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_read_all(File, &pThreaded, &ThreadedSize);
+	io_close(File);
+
+	// the headers only differ in the timestamp
+	EXPECT_EQ(DirectSize, ThreadedSize);
+	if(DirectSize == ThreadedSize && DirectSize >= sizeof(CDemoHeader))
+	{
+		mem_zero(((CDemoHeader *)pDirect)->m_aTimestamp, sizeof(((CDemoHeader *)pDirect)->m_aTimestamp));
+		mem_zero(((CDemoHeader *)pThreaded)->m_aTimestamp, sizeof(((CDemoHeader *)pThreaded)->m_aTimestamp));
+		EXPECT_EQ(mem_comp(pDirect, pThreaded, DirectSize), 0);
+	}
+	mem_free(pDirect);
+	mem_free(pThreaded);
+
+	EXPECT_TRUE(pStorage->RemoveFile(aDirect, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aThreaded, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aMapFilename, IStorage::TYPE_SAVE));
+	pStorage->RemoveFile("maps", IStorage::TYPE_SAVE);
+	delete pConsole;
+	delete pStorage;
+}
+
+TEST(Demo, IndexSameAsScan)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+
+	char aMap[64], aMapFilename[128];
+	str_format(aMap, sizeof(aMap), "%s", Info.m_aFilenamePrefix);
+	str_format(aMapFilename, sizeof(aMapFilename), "maps/%s.map", aMap);
+	pStorage->CreateFolder("maps", IStorage::TYPE_SAVE);
+	pStorage->CreateFolder("downloadedmaps", IStorage::TYPE_SAVE);
+	IOHANDLE File = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, "not really a map", 16);
+	io_close(File);
+	SHA256_DIGEST Sha256;
+	unsigned Crc, MapSize;
+	ASSERT_TRUE(pStorage->GetHashAndSize(aMapFilename, IStorage::TYPE_SAVE, &Sha256, &Crc, &MapSize));
+
+	char aIndexed[64], aScanned[64];
+	Info.Filename(aIndexed, sizeof(aIndexed), "-indexed.demo");
+	Info.Filename(aScanned, sizeof(aScanned), "-scanned.demo");
+
+	CSnapshotDelta Delta;
+	CDemoRecorder Recorder(&Delta);
+	RecordDemo(&Recorder, pStorage, pConsole, aIndexed, aMap, Sha256);
+
+	// cut off the index like it happens when the recording doesn't stop
+	void *pData;
+	unsigned Size;
+	File = pStorage->OpenFile(aIndexed, IOFLAG_READ, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_read_all(File, &pData, &Size);
+	io_close(File);
+	ASSERT_GT(Size, 16u);
+	unsigned EndPos = bytes_be_to_uint((unsigned char *)pData+Size-16);
+	ASSERT_LT(EndPos, Size);
+	EXPECT_EQ(((unsigned char *)pData)[EndPos], 0);
+	File = pStorage->OpenFile(aScanned, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, pData, EndPos);
+	io_close(File);
+	mem_free(pData);
+
+	CDemoPlayer Indexed(&Delta);
+	CDemoPlayer Scanned(&Delta);
+	Indexed.SetListener(0);
+	Scanned.SetListener(0);
+	ASSERT_TRUE(Indexed.Load(pStorage, pConsole, aIndexed, IStorage::TYPE_SAVE, "0.7 test") == 0);
+	ASSERT_TRUE(Scanned.Load(pStorage, pConsole, aScanned, IStorage::TYPE_SAVE, "0.7 test") == 0);
+
+	EXPECT_EQ(Indexed.Info()->m_SeekablePoints, 3);
+	EXPECT_EQ(Indexed.Info()->m_SeekablePoints, Scanned.Info()->m_SeekablePoints);
+	EXPECT_EQ(Indexed.Info()->m_Info.m_FirstTick, 1);
+	EXPECT_EQ(Indexed.Info()->m_Info.m_FirstTick, Scanned.Info()->m_Info.m_FirstTick);
+	EXPECT_EQ(Indexed.Info()->m_Info.m_LastTick, 600);
+	EXPECT_EQ(Indexed.Info()->m_Info.m_LastTick, Scanned.Info()->m_Info.m_LastTick);
+
+	// seeking ends on the same tick and playback stops before the index
+	Indexed.SetPos(0.5f);
+	Scanned.SetPos(0.5f);
+	EXPECT_EQ(Indexed.BaseInfo()->m_CurrentTick, Scanned.BaseInfo()->m_CurrentTick);
+	Indexed.SetPos(1.0f);
+	Scanned.SetPos(1.0f);
+	EXPECT_TRUE(Indexed.IsPlaying());
+	EXPECT_EQ(Indexed.BaseInfo()->m_CurrentTick, Scanned.BaseInfo()->m_CurrentTick);
+	Indexed.Stop();
+	Scanned.Stop();
+
+	char aDownloadedMap[128];
+	str_format(aDownloadedMap, sizeof(aDownloadedMap), "downloadedmaps/%s_%08x.map", aMap, 0);
+	EXPECT_TRUE(pStorage->RemoveFile(aIndexed, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aScanned, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aMapFilename, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aDownloadedMap, IStorage::TYPE_SAVE));
+	pStorage->RemoveFile("maps", IStorage::TYPE_SAVE);
+	pStorage->RemoveFile("downloadedmaps", IStorage::TYPE_SAVE);
+	delete pConsole;
+	delete pStorage;
+}
+
+class CChecksumListener : public CDemoPlayer::IListener
+{
+public:
+	unsigned m_Checksum;
+	int m_NumSnapshots;
+	int m_NumMessages;
+
+	CChecksumListener() : m_Checksum(0), m_NumSnapshots(0), m_NumMessages(0) {}
+
+	void Add(const void *pData, int Size)
+	{
+		for(int i = 0; i < Size; i++)
+			m_Checksum = m_Checksum*31 + ((const unsigned char *)pData)[i];
+	}
+	void OnDemoPlayerSnapshot(void *pData, int Size) { Add(pData, Size); m_NumSnapshots++; }
+	void OnDemoPlayerMessage(void *pData, int Size) { Add(pData, Size); m_NumMessages++; }
+};
+
+TEST(Demo, DecoderThreadSameAsDirect)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+
+	char aMap[64], aMapFilename[128];
+	str_format(aMap, sizeof(aMap), "%s", Info.m_aFilenamePrefix);
+	str_format(aMapFilename, sizeof(aMapFilename), "maps/%s.map", aMap);
+	pStorage->CreateFolder("maps", IStorage::TYPE_SAVE);
+	pStorage->CreateFolder("downloadedmaps", IStorage::TYPE_SAVE);
+	IOHANDLE File = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, "not really a map", 16);
+	io_close(File);
+	SHA256_DIGEST Sha256;
+	unsigned Crc, MapSize;
+	ASSERT_TRUE(pStorage->GetHashAndSize(aMapFilename, IStorage::TYPE_SAVE, &Sha256, &Crc, &MapSize));
+
+	char aDemo[64];
+	Info.Filename(aDemo, sizeof(aDemo), ".demo");
+
+	CSnapshotDelta Delta;
+	CDemoRecorder Recorder(&Delta);
+	RecordDemo(&Recorder, pStorage, pConsole, aDemo, aMap, Sha256);
+
+	// the smallest queue makes the decoder wait for the playback
+	CChecksumListener DirectListener, ThreadedListener;
+	CDemoPlayer Direct(&Delta);
+	CDemoPlayer Threaded(&Delta);
+	Direct.SetListener(&DirectListener);
+	Threaded.SetListener(&ThreadedListener);
+	Threaded.SetDecodeQueue(1);
+	ASSERT_TRUE(Direct.Load(pStorage, pConsole, aDemo, IStorage::TYPE_SAVE, "0.7 test") == 0);
+	ASSERT_TRUE(Threaded.Load(pStorage, pConsole, aDemo, IStorage::TYPE_SAVE, "0.7 test") == 0);
+
+	// seeking plays everything from the keyframe before the position
+	static const float s_aPositions[] = {0.0f, 0.7f, 0.2f, 0.45f, 1.0f, 0.9f};
+	for(unsigned i = 0; i < sizeof(s_aPositions)/sizeof(s_aPositions[0]); i++)
+	{
+		Direct.SetPos(s_aPositions[i]);
+		Threaded.SetPos(s_aPositions[i]);
+		EXPECT_EQ(Direct.BaseInfo()->m_CurrentTick, Threaded.BaseInfo()->m_CurrentTick);
+	}
+	EXPECT_GT(DirectListener.m_NumSnapshots, 0);
+	EXPECT_EQ(DirectListener.m_NumSnapshots, ThreadedListener.m_NumSnapshots);
+	EXPECT_EQ(DirectListener.m_NumMessages, ThreadedListener.m_NumMessages);
+	EXPECT_EQ(DirectListener.m_Checksum, ThreadedListener.m_Checksum);
+	Direct.Stop();
+	Threaded.Stop();
+
+	char aDownloadedMap[128];
+	str_format(aDownloadedMap, sizeof(aDownloadedMap), "downloadedmaps/%s_%08x.map", aMap, 0);
+	EXPECT_TRUE(pStorage->RemoveFile(aDemo, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aMapFilename, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aDownloadedMap, IStorage::TYPE_SAVE));
+	pStorage->RemoveFile("maps", IStorage::TYPE_SAVE);
+	pStorage->RemoveFile("downloadedmaps", IStorage::TYPE_SAVE);
+	delete pConsole;
+	delete pStorage;
+}
+
+class CTickListener : public CDemoPlayer::IListener
+{
+public:
+	CDemoPlayer *m_pPlayer;
+	unsigned m_aSnapshotChecksums[1024];
+	int m_aMessages[1024];
+
+	CTickListener() { mem_zero(m_aSnapshotChecksums, sizeof(m_aSnapshotChecksums)); mem_zero(m_aMessages, sizeof(m_aMessages)); }
+
+	void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		unsigned Checksum = 0;
+		for(int i = 0; i < Size; i++)
+			Checksum = Checksum*31 + ((const unsigned char *)pData)[i];
+		m_aSnapshotChecksums[m_pPlayer->BaseInfo()->m_CurrentTick] = Checksum;
+	}
+	void OnDemoPlayerMessage(void *pData, int Size) { m_aMessages[m_pPlayer->BaseInfo()->m_CurrentTick]++; }
+
+	void PlayAll(CDemoPlayer *pPlayer)
+	{
+		m_pPlayer = pPlayer;
+		pPlayer->SetListener(this);
+		pPlayer->Play();
+		while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused)
+			pPlayer->NextFrame();
+	}
+};
+
+TEST(Demo, CutSameAsOriginal)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+
+	char aMap[64], aMapFilename[128];
+	str_format(aMap, sizeof(aMap), "%s", Info.m_aFilenamePrefix);
+	str_format(aMapFilename, sizeof(aMapFilename), "maps/%s.map", aMap);
+	pStorage->CreateFolder("maps", IStorage::TYPE_SAVE);
+	IOHANDLE File = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, "not really a map", 16);
+	io_close(File);
+	SHA256_DIGEST Sha256;
+	unsigned Crc, MapSize;
+	ASSERT_TRUE(pStorage->GetHashAndSize(aMapFilename, IStorage::TYPE_SAVE, &Sha256, &Crc, &MapSize));
+
+	char aDemo[64], aCut[64];
+	Info.Filename(aDemo, sizeof(aDemo), ".demo");
+	Info.Filename(aCut, sizeof(aCut), "-cut.demo");
+
+	CSnapshotDelta Delta;
+	CDemoRecorder Recorder(&Delta);
+	RecordDemo(&Recorder, pStorage, pConsole, aDemo, aMap, Sha256);
+
+	// the cut starts between two keyframes
+	CDemoPlayer Player(&Delta);
+	Player.SetSaveMaps(false);
+	ASSERT_TRUE(Player.Load(pStorage, pConsole, aDemo, IStorage::TYPE_SAVE, "0.7 test") == 0);
+	EXPECT_TRUE(Player.Cut(pStorage, aCut, 310, 450) == 0);
+	CTickListener Original;
+	Original.PlayAll(&Player);
+	Player.Stop();
+
+	CDemoPlayer CutPlayer(&Delta);
+	CutPlayer.SetSaveMaps(false);
+	ASSERT_TRUE(CutPlayer.Load(pStorage, pConsole, aCut, IStorage::TYPE_SAVE, "0.7 test") == 0);
+	EXPECT_EQ(CutPlayer.Info()->m_Info.m_FirstTick, 310);
+	EXPECT_EQ(CutPlayer.Info()->m_Info.m_LastTick, 450);
+	EXPECT_EQ(CutPlayer.Info()->m_SeekablePoints, 1);
+	EXPECT_EQ(CutPlayer.Info()->m_Info.m_NumTimelineMarkers, 1);
+	EXPECT_EQ(CutPlayer.Info()->m_Info.m_aTimelineMarkers[0], 400);
+	CTickListener Cut;
+	Cut.PlayAll(&CutPlayer);
+	CutPlayer.Stop();
+
+	EXPECT_NE(Original.m_aSnapshotChecksums[310], 0u);
+	EXPECT_EQ(Original.m_aMessages[310], 1);
+	for(int Tick = 0; Tick < 1024; Tick++)
+	{
+		if(Tick >= 310 && Tick <= 450)
+		{
+			EXPECT_EQ(Cut.m_aSnapshotChecksums[Tick], Original.m_aSnapshotChecksums[Tick]);
+			EXPECT_EQ(Cut.m_aMessages[Tick], Original.m_aMessages[Tick]);
+		}
+		else
+		{
+			EXPECT_EQ(Cut.m_aSnapshotChecksums[Tick], 0u);
+			EXPECT_EQ(Cut.m_aMessages[Tick], 0);
+		}
+	}
+
+	EXPECT_TRUE(pStorage->RemoveFile(aDemo, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aCut, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aMapFilename, IStorage::TYPE_SAVE));
+	pStorage->RemoveFile("maps", IStorage::TYPE_SAVE);
+	delete pConsole;
+	delete pStorage;
+}
+
+static char *StreamRequest(NETSOCKET Socket, int *pSize)
+{
+	// the whole response, the stream closes after the recording
+	int Size = 0, Capacity = 64*1024;
+	char *pData = (char *)mem_alloc(Capacity, 1);
+	while(1)
+	{
+		if(Size == Capacity)
+		{
+			char *pGrown = (char *)mem_alloc(Capacity*2, 1);
+			mem_copy(pGrown, pData, Size);
+			mem_free(pData);
+			pData = pGrown;
+			Capacity *= 2;
+		}
+		int Bytes = net_tcp_recv(Socket, pData+Size, Capacity-Size);
+		if(Bytes <= 0)
+			break;
+		Size += Bytes;
+	}
+
+	// undo the chunked transfer encoding in place
+	*pSize = -1;
+	const char *pBody = Size < Capacity ? (pData[Size] = 0, str_find(pData, "\r\n\r\n")) : 0;
+	if(!pBody || !str_startswith(pData, "HTTP/1.1 200 "))
+		return pData;
+	int Pos = pBody+4-pData;
+	int BodySize = 0;
+	while(Pos < Size)
+	{
+		int ChunkSize = (int)strtol(pData+Pos, 0, 16);
+		const char *pLineEnd = str_find(pData+Pos, "\r\n");
+		if(!pLineEnd)
+			return pData;
+		Pos = pLineEnd+2-pData;
+		if(!ChunkSize)
+		{
+			*pSize = BodySize;
+			break;
+		}
+		if(Pos+ChunkSize+2 > Size)
+			return pData;
+		mem_move(pData+BodySize, pData+Pos, ChunkSize);
+		BodySize += ChunkSize;
+		Pos += ChunkSize+2;
+	}
+	return pData;
+}
+
+static NETSOCKET StreamConnect(int Port, const char *pPath)
+{
+	NETADDR Addr;
+	net_addr_from_str(&Addr, "127.0.0.1");
+	Addr.port = Port;
+	NETADDR BindAddr;
+	mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = NETTYPE_IPV4;
+	NETSOCKET Socket = net_tcp_create(BindAddr);
+	if(net_tcp_connect(Socket, &Addr) != 0)
+		return Socket;
+	char aRequest[128];
+	str_format(aRequest, sizeof(aRequest), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", pPath);
+	net_tcp_send(Socket, aRequest, str_length(aRequest));
+	return Socket;
+}
+
+TEST(Demo, StreamSameAsFile)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+
+	char aMap[64], aMapFilename[128];
+	str_format(aMap, sizeof(aMap), "%s", Info.m_aFilenamePrefix);
+	str_format(aMapFilename, sizeof(aMapFilename), "maps/%s.map", aMap);
+	pStorage->CreateFolder("maps", IStorage::TYPE_SAVE);
+	IOHANDLE File = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, "not really a map", 16);
+	io_close(File);
+	SHA256_DIGEST Sha256;
+	unsigned Crc, MapSize;
+	ASSERT_TRUE(pStorage->GetHashAndSize(aMapFilename, IStorage::TYPE_SAVE, &Sha256, &Crc, &MapSize));
+
+	char aDemo[64], aLive[64];
+	Info.Filename(aDemo, sizeof(aDemo), ".demo");
+	Info.Filename(aLive, sizeof(aLive), "-live.demo");
+
+	// any free port
+	CDemoStream Stream;
+	NETADDR BindAddr;
+	net_addr_from_str(&BindAddr, "127.0.0.1");
+	int Port;
+	for(Port = 27900; Port < 27950; Port++)
+	{
+		BindAddr.port = Port;
+		if(Stream.Open(BindAddr))
+			break;
+	}
+	ASSERT_TRUE(Stream.IsOpen());
+
+	CSnapshotDelta Delta;
+	CDemoRecorder Recorder(&Delta);
+	Recorder.SetStream(&Stream);
+	ASSERT_TRUE(Recorder.Start(pStorage, pConsole, aDemo, "0.7 test", aMap, Sha256, 0, "server") == 0);
+
+	// viewers join after the second keyframe
+	static char s_aData[CSnapshot::MAX_SIZE];
+	CSnapshotBuilder Builder;
+	for(int Tick = 1; Tick <= 400; Tick++)
+	{
+		Builder.Init();
+		for(int i = 0; i < 10; i++)
+		{
+			int *pItem = (int *)Builder.NewItem(i%8+1, i, 4*sizeof(int));
+			for(int f = 0; f < 4; f++)
+				pItem[f] = Tick*(i+f);
+		}
+		Recorder.RecordSnapshot(Tick, s_aData, Builder.Finish(s_aData));
+		int aMsg[4] = {Tick, 1, 2, 3};
+		Recorder.RecordMessage(aMsg, sizeof(aMsg));
+		if(Tick == 300)
+		{
+			NETSOCKET Full = StreamConnect(Port, "/");
+			NETSOCKET Live = StreamConnect(Port, "/live");
+			NETSOCKET Missing = StreamConnect(Port, "/nothing");
+			// once they are answered they get the rest of the recording, even after it stopped
+			EXPECT_GT(net_socket_read_wait(Full, 5000), 0);
+			EXPECT_GT(net_socket_read_wait(Live, 5000), 0);
+			Recorder.Stop();
+
+			int FullSize, LiveSize, MissingSize;
+			char *pFull = StreamRequest(Full, &FullSize);
+			char *pLive = StreamRequest(Live, &LiveSize);
+			char *pMissing = StreamRequest(Missing, &MissingSize);
+			net_tcp_close(Full);
+			net_tcp_close(Live);
+			net_tcp_close(Missing);
+			EXPECT_TRUE(str_startswith(pMissing, "HTTP/1.1 404 "));
+			EXPECT_EQ(MissingSize, -1);
+
+			void *pDemo;
+			unsigned DemoSize;
+			File = pStorage->OpenFile(aDemo, IOFLAG_READ, IStorage::TYPE_SAVE);
+			ASSERT_TRUE(File);
+			io_read_all(File, &pDemo, &DemoSize);
+			io_close(File);
+
+			// the stream ends before the index, the header of the file got its length afterwards
+			const unsigned char *pFooter = (const unsigned char *)pDemo+DemoSize-16;
+			int EndPos = bytes_be_to_uint(pFooter)+1;
+			ASSERT_EQ(bytes_be_to_uint(pFooter+4), 2u);
+			int KeyFramePos = bytes_be_to_uint((const unsigned char *)pDemo+EndPos+8+4);
+			int HeaderSize = sizeof(CDemoHeader)+MapSize;
+			ASSERT_EQ(FullSize, EndPos);
+			EXPECT_EQ(mem_comp(pFull+HeaderSize, (char *)pDemo+HeaderSize, EndPos-HeaderSize), 0);
+			ASSERT_EQ(LiveSize, HeaderSize+EndPos-KeyFramePos);
+			EXPECT_EQ(mem_comp(pLive, pFull, HeaderSize), 0);
+			EXPECT_EQ(mem_comp(pLive+HeaderSize, (char *)pDemo+KeyFramePos, EndPos-KeyFramePos), 0);
+
+			File = pStorage->OpenFile(aLive, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+			ASSERT_TRUE(File);
+			io_write(File, pLive, LiveSize);
+			io_close(File);
+			mem_free(pFull);
+			mem_free(pLive);
+			mem_free(pMissing);
+			mem_free(pDemo);
+			break;
+		}
+	}
+	Stream.Close();
+
+	// the live part plays like the same ticks of the demo, and ends where it does
+	CDemoPlayer Player(&Delta);
+	Player.SetSaveMaps(false);
+	ASSERT_TRUE(Player.Load(pStorage, pConsole, aDemo, IStorage::TYPE_SAVE, "0.7 test") == 0);
+	CTickListener Original;
+	Original.PlayAll(&Player);
+	Player.Stop();
+
+	CDemoPlayer LivePlayer(&Delta);
+	LivePlayer.SetSaveMaps(false);
+	LivePlayer.SetLive(true);
+	ASSERT_TRUE(LivePlayer.Load(pStorage, pConsole, aLive, IStorage::TYPE_SAVE, "0.7 test") == 0);
+	CTickListener Live;
+	Live.PlayAll(&LivePlayer);
+	EXPECT_EQ(LivePlayer.BaseInfo()->m_CurrentTick, 300);
+	LivePlayer.Stop();
+
+	for(int Tick = 0; Tick < 1024; Tick++)
+	{
+		if(Tick >= 252 && Tick <= 300)
+		{
+			EXPECT_NE(Live.m_aSnapshotChecksums[Tick], 0u);
+			EXPECT_EQ(Live.m_aSnapshotChecksums[Tick], Original.m_aSnapshotChecksums[Tick]);
+		}
+		else
+		{
+			EXPECT_EQ(Live.m_aSnapshotChecksums[Tick], 0u);
+		}
+	}
+
+	EXPECT_TRUE(pStorage->RemoveFile(aDemo, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aLive, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aMapFilename, IStorage::TYPE_SAVE));
+	pStorage->RemoveFile("maps", IStorage::TYPE_SAVE);
+	delete pConsole;
+	delete pStorage;
+}
+
+TEST(Demo, StreamCloseWithStalledViewer)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".demo");
+
+	// more than the socket buffers take
+	const int Size = 32*1024*1024;
+	IOHANDLE File = io_open(aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	char *pData = (char *)mem_alloc(Size, 1);
+	mem_zero(pData, Size);
+	io_write(File, pData, Size);
+	io_close(File);
+	mem_free(pData);
+
+	CDemoStream Stream;
+	NETADDR BindAddr;
+	net_addr_from_str(&BindAddr, "127.0.0.1");
+	int Port;
+	for(Port = 27950; Port < 28000; Port++)
+	{
+		BindAddr.port = Port;
+		if(Stream.Open(BindAddr))
+			break;
+	}
+	ASSERT_TRUE(Stream.IsOpen());
+	Stream.Begin(aFilename, Size);
+
+	// the viewer is answered but never reads
+	NETSOCKET Viewer = StreamConnect(Port, "/");
+	EXPECT_GT(net_socket_read_wait(Viewer, 5000), 0);
+	thread_sleep(200);
+
+	int64 Start = time_get();
+	Stream.Close();
+	EXPECT_LT(time_get()-Start, time_freq());
+
+	net_tcp_close(Viewer);
+	fs_remove(aFilename);
+}
@@ -12,3 +12,52 @@ TEST(Filesystem, CreateCloseDelete)
 	EXPECT_FALSE(io_close(File));
 	EXPECT_FALSE(fs_remove(Info.m_aFilename));
 }
+
+TEST(Filesystem, BufferedReadWrite)
+{
+	CTestInfo Info;
+	static char s_aBuffer[8*1024];
+	static char s_aData[3*1024];
+	for(unsigned i = 0; i < sizeof(s_aData); i++)
+		s_aData[i] = i*7;
+
+	IOHANDLE File = io_open(Info.m_aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	EXPECT_FALSE(io_buffer(File, s_aBuffer, sizeof(s_aBuffer)));
+	for(unsigned i = 0; i < sizeof(s_aData); i += 3)
+		EXPECT_EQ(io_write(File, s_aData + i, 3), 3u);
+	EXPECT_FALSE(io_close(File));
+
+	char aRead[sizeof(s_aData)];
+	File = io_open(Info.m_aFilename, IOFLAG_READ);
+	ASSERT_TRUE(File);
+	EXPECT_FALSE(io_buffer(File, s_aBuffer, sizeof(s_aBuffer)));
+	io_sequential(File);
+	EXPECT_EQ(io_read(File, aRead, 5), 5u);
+	EXPECT_EQ(io_read(File, aRead + 5, sizeof(aRead) - 5), sizeof(aRead) - 5);
+	EXPECT_EQ(mem_comp(aRead, s_aData, sizeof(aRead)), 0);
+	EXPECT_FALSE(io_close(File));
+	EXPECT_FALSE(fs_remove(Info.m_aFilename));
+}
+
+TEST(Filesystem, Append)
+{
+	CTestInfo Info;
+
+	IOHANDLE File = io_open(Info.m_aFilename, IOFLAG_APPEND);
+	ASSERT_TRUE(File);
+	EXPECT_EQ(io_write(File, "abc", 3), 3u);
+	EXPECT_FALSE(io_close(File));
+	File = io_open(Info.m_aFilename, IOFLAG_APPEND);
+	ASSERT_TRUE(File);
+	EXPECT_EQ(io_write(File, "de", 2), 2u);
+	EXPECT_FALSE(io_close(File));
+
+	char aRead[8];
+	File = io_open(Info.m_aFilename, IOFLAG_READ);
+	ASSERT_TRUE(File);
+	EXPECT_EQ(io_read(File, aRead, sizeof(aRead)), 5u);
+	EXPECT_EQ(mem_comp(aRead, "abcde", 5), 0);
+	EXPECT_FALSE(io_close(File));
+	EXPECT_FALSE(fs_remove(Info.m_aFilename));
+}
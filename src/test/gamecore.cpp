@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <game/collision.h>
+#include <game/gamecore.h>
+#include <game/mapitems.h>
+
+// a crowd of characters in a box with platforms, running and hooking each
+// other. the checksum was recorded with the code before the character pass
+// was packed, the physics have to stay exactly the same for the prediction
+TEST(GameCore, CrowdDeterminism)
+{
+	enum { WIDTH=60, HEIGHT=40, NUM_TICKS=1000 };
+	static CTile s_aTiles[WIDTH*HEIGHT];
+	mem_zero(s_aTiles, sizeof(s_aTiles));
+	for(int y = 0; y < HEIGHT; y++)
+		for(int x = 0; x < WIDTH; x++)
+			if(x == 0 || y == 0 || x == WIDTH-1 || y == HEIGHT-1 || (y%8 == 0 && x%12 < 6))
+				s_aTiles[y*WIDTH+x].m_Index = TILE_SOLID;
+	CCollision Collision;
+	Collision.Init(s_aTiles, WIDTH, HEIGHT);
+
+	CWorldCore World;
+	static CCharacterCore s_aCores[MAX_CLIENTS];
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		s_aCores[i].Init(&World, &Collision);
+		s_aCores[i].Reset();
+		s_aCores[i].m_Pos = vec2(100.0f + (i%16)*100.0f, 100.0f + (i/16)*250.0f);
+		World.m_apCharacters[i] = &s_aCores[i];
+	}
+
+	unsigned Seed = 1;
+	unsigned Checksum = 0;
+	for(int t = 0; t < NUM_TICKS; t++)
+	{
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			Seed = Seed*1103515245u+12345u;
+			CNetObj_PlayerInput *pInput = &s_aCores[i].m_Input;
+			if((Seed>>16)%16 == 0)
+			{
+				pInput->m_Direction = (int)((Seed>>8)%3)-1;
+				pInput->m_Jump = (Seed>>12)%4 == 0;
+				pInput->m_Hook = (Seed>>20)%3 != 0;
+				pInput->m_TargetX = (int)((Seed>>4)%400)-200;
+				pInput->m_TargetY = (int)((Seed>>14)%400)-200;
+			}
+			s_aCores[i].Tick(true);
+		}
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			s_aCores[i].AddDragVelocity();
+			s_aCores[i].ResetDragVelocity();
+			s_aCores[i].Move();
+			s_aCores[i].Quantize();
+		}
+
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			CNetObj_CharacterCore Core;
+			mem_zero(&Core, sizeof(Core));
+			s_aCores[i].Write(&Core);
+			const int *pData = (const int *)&Core;
+			for(unsigned k = 0; k < sizeof(Core)/sizeof(int); k++)
+				Checksum = (Checksum^(unsigned)pData[k])*16777619u;
+		}
+	}
+
+	EXPECT_EQ(Checksum, 1711576966u);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <base/hash_ctxt.h>
+#include <base/math.h>
 #include <base/system.h>
 
 static void Expect(SHA256_DIGEST Actual, const char *pWanted)
@@ -40,3 +41,34 @@ TEST(Hash, Sha256Eq)
 {
 	EXPECT_EQ(sha256("", 0), sha256("", 0));
 }
+
+TEST(Hash, Sha256FromStr)
+{
+	SHA256_DIGEST Sha256;
+	ASSERT_EQ(sha256_from_str(&Sha256, "ef537f25c895bfa782526529a9b63d97aa631564d5d789c2b765448c8635fb6c"), 0);
+	Expect(Sha256, "ef537f25c895bfa782526529a9b63d97aa631564d5d789c2b765448c8635fb6c");
+	EXPECT_NE(sha256_from_str(&Sha256, "ef537f25"), 0);
+	EXPECT_NE(sha256_from_str(&Sha256, "xf537f25c895bfa782526529a9b63d97aa631564d5d789c2b765448c8635fb6c"), 0);
+}
+
+TEST(Hash, Sha256LongAndSplit)
+{
+	// the accelerated implementations work on many blocks at once
+	static char s_aMillion[1000000];
+	for(int i = 0; i < (int)sizeof(s_aMillion); i++)
+		s_aMillion[i] = 'a'; // NIST test vector
+	Expect(sha256(s_aMillion, sizeof(s_aMillion)), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+	unsigned char aData[1000];
+	for(int i = 0; i < (int)sizeof(aData); i++)
+		aData[i] = i*7+i/13;
+	for(int Length = 0; Length <= (int)sizeof(aData); Length += 37)
+	{
+		SHA256_DIGEST Whole = sha256(aData, Length);
+		SHA256_CTX ctxt;
+		sha256_init(&ctxt);
+		for(int Offset = 0; Offset < Length; Offset += 100)
+			sha256_update(&ctxt, aData+Offset, min(100, Length-Offset));
+		EXPECT_EQ(sha256_finish(&ctxt), Whole);
+	}
+}
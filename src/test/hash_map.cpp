@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <base/tl/array.h>
+#include <base/tl/hash_map.h>
+
+TEST(HashMap, SetFindRemove)
+{
+	hash_map<int, int> Map;
+	EXPECT_EQ(Map.find(1), (int *)0);
+	for(int i = 0; i < 1000; i++)
+		Map.set(i*7, i);
+	EXPECT_EQ(Map.size(), 1000);
+	Map.set(7, -1);
+	EXPECT_EQ(Map.size(), 1000);
+	ASSERT_TRUE(Map.find(7));
+	EXPECT_EQ(*Map.find(7), -1);
+
+	for(int i = 0; i < 1000; i += 2)
+		EXPECT_TRUE(Map.remove(i*7));
+	EXPECT_FALSE(Map.remove(0));
+	EXPECT_EQ(Map.size(), 500);
+	for(int i = 0; i < 1000; i++)
+	{
+		const int *pValue = Map.find(i*7);
+		if(i%2 == 0)
+		{
+			EXPECT_EQ(pValue, (int *)0);
+		}
+		else if(i != 1)
+		{
+			ASSERT_TRUE(pValue);
+			EXPECT_EQ(*pValue, i);
+		}
+	}
+}
+
+TEST(HashMap, Collisions)
+{
+	// keys that all want the same few slots, removals have to keep the chains intact
+	hash_map<unsigned, unsigned> Map;
+	Map.reserve(64);
+	bool aPresent[256] = {false};
+	unsigned Seed = 1;
+	for(int Round = 0; Round < 20000; Round++)
+	{
+		Seed = Seed*1103515245u+12345u;
+		unsigned Key = (Seed>>16)%256;
+		if(Seed&0x100)
+		{
+			Map.set(Key<<20, Key);
+			aPresent[Key] = true;
+		}
+		else
+		{
+			EXPECT_EQ(Map.remove(Key<<20), aPresent[Key]);
+			aPresent[Key] = false;
+		}
+	}
+
+	int Num = 0;
+	for(int i = 0; i < 256; i++)
+	{
+		const unsigned *pValue = Map.find((unsigned)i<<20);
+		EXPECT_EQ(pValue != 0, aPresent[i]);
+		if(pValue)
+		{
+			EXPECT_EQ(*pValue, (unsigned)i);
+		}
+		Num += aPresent[i];
+	}
+	EXPECT_EQ(Map.size(), Num);
+
+	int Iterated = 0;
+	for(int i = Map.first(); i >= 0; i = Map.next(i))
+	{
+		EXPECT_TRUE(aPresent[Map.value(i)]);
+		EXPECT_EQ(Map.key(i), Map.value(i)<<20);
+		Iterated++;
+	}
+	EXPECT_EQ(Iterated, Num);
+}
+
+TEST(HashMap, StringKeys)
+{
+	string_hash_map<array<int> > Map;
+	char aKey[32];
+	for(int i = 0; i < 100; i++)
+	{
+		str_format(aKey, sizeof(aKey), "key%d", i);
+		array<int> Value;
+		Value.add(i);
+		Map.set(aKey, Value);
+	}
+	// the map keeps its own copy of the keys
+	str_copy(aKey, "key5", sizeof(aKey));
+	ASSERT_TRUE(Map.find(aKey));
+	EXPECT_EQ((*Map.find(aKey))[0], 5);
+	EXPECT_TRUE(Map.remove("key5"));
+	EXPECT_FALSE(Map.find("key5"));
+	ASSERT_TRUE(Map.find("key99"));
+	EXPECT_EQ((*Map.find("key99"))[0], 99);
+	EXPECT_EQ(Map.size(), 99);
+
+	Map.clear();
+	EXPECT_EQ(Map.size(), 0);
+	EXPECT_FALSE(Map.find("key1"));
+	Map.set("key1", array<int>());
+	EXPECT_TRUE(Map.find("key1"));
+}
@@ -0,0 +1,71 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <engine/shared/hostcache.h>
+#include <engine/storage.h>
+
+TEST(HostCache, FreshUntilTtl)
+{
+	CTestInfo Info;
+	char aFile[64];
+	Info.Filename(aFile, sizeof(aFile), ".cfg");
+	IStorage *pStorage = CreateTestStorage();
+
+	NETADDR Addr, Found;
+	net_addr_from_str(&Addr, "192.0.2.1:8300");
+	CHostCache *pCache = new CHostCache();
+	pCache->Init(pStorage, aFile);
+	pCache->Add("master1.example.com", NETTYPE_IPV4, &Addr, time_timestamp());
+	pCache->Add("master2.example.com", NETTYPE_IPV4, &Addr, time_timestamp()-CHostCache::TTL-1);
+	EXPECT_TRUE(pCache->Save());
+
+	CHostCache *pLoaded = new CHostCache();
+	pLoaded->Init(pStorage, aFile);
+	ASSERT_TRUE(pLoaded->Load());
+	ASSERT_EQ(pLoaded->NumEntries(), 2);
+	bool Fresh;
+	ASSERT_TRUE(pLoaded->Find("master1.example.com", NETTYPE_IPV4, &Found, &Fresh));
+	EXPECT_TRUE(Fresh);
+	EXPECT_EQ(net_addr_comp(&Found, &Addr, true), 0);
+	ASSERT_TRUE(pLoaded->Find("master2.example.com", NETTYPE_IPV4, &Found, &Fresh));
+	EXPECT_FALSE(Fresh);
+	EXPECT_FALSE(pLoaded->Find("master1.example.com", NETTYPE_ALL, &Found, &Fresh));
+	EXPECT_FALSE(pLoaded->Find("master3.example.com", NETTYPE_IPV4, &Found, &Fresh));
+
+	// a fresh address is used without resolving
+	EXPECT_EQ(pLoaded->Lookup("master1.example.com", &Found, NETTYPE_IPV4), 0);
+	EXPECT_EQ(net_addr_comp(&Found, &Addr, true), 0);
+
+	pStorage->RemoveFile(aFile, IStorage::TYPE_SAVE);
+	delete pCache;
+	delete pLoaded;
+	delete pStorage;
+}
+
+TEST(HostCache, LastKnownAddressWhenResolvingFails)
+{
+	CTestInfo Info;
+	char aFile[64];
+	Info.Filename(aFile, sizeof(aFile), ".cfg");
+	IStorage *pStorage = CreateTestStorage();
+
+	// the reserved .invalid domain never resolves
+	NETADDR Addr, Found;
+	net_addr_from_str(&Addr, "192.0.2.2:8300");
+	CHostCache Cache;
+	Cache.Init(pStorage, aFile);
+	EXPECT_NE(Cache.Lookup("master.teeworlds.invalid", &Found, NETTYPE_IPV4), 0);
+	Cache.Add("master.teeworlds.invalid", NETTYPE_IPV4, &Addr, 0);
+	EXPECT_EQ(Cache.Lookup("master.teeworlds.invalid", &Found, NETTYPE_IPV4), 0);
+	EXPECT_EQ(net_addr_comp(&Found, &Addr, true), 0);
+
+	// resolving refreshes the entry
+	EXPECT_EQ(Cache.Lookup("127.0.0.1", &Found, NETTYPE_IPV4), 0);
+	bool Fresh;
+	ASSERT_TRUE(Cache.Find("127.0.0.1", NETTYPE_IPV4, &Found, &Fresh));
+	EXPECT_TRUE(Fresh);
+
+	pStorage->RemoveFile(aFile, IStorage::TYPE_SAVE);
+	delete pStorage;
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/huffman.h>
+#include <engine/shared/network.h>
+
+static void SkewedTable(unsigned *pFrequencies)
+{
+	for(int i = 0; i < 256; i++)
+		pFrequencies[i] = 1 + (i < 16 ? 4096 >> (i/2) : 0);
+}
+
+// looks like a snapshot delta packet: int packed fields, most of them unchanged
+static int PacketLike(unsigned Seed, unsigned char *pPacket, int MaxSize)
+{
+	int aFields[512];
+	int NumFields = 16 + Seed%(sizeof(aFields)/sizeof(aFields[0])-16);
+	for(int i = 0; i < NumFields; i++)
+	{
+		Seed = Seed*1103515245u+12345u;
+		unsigned Kind = (Seed>>16)%16;
+		aFields[i] = Kind < 10 ? 0 : Kind < 14 ? (int)((Seed>>8)%64)-32 : (int)(Seed>>4)-(1<<27);
+	}
+	return CVariableInt::Compress(aFields, NumFields*sizeof(int), pPacket, MaxSize);
+}
+
+static void ExpectSameAsSimple(CHuffman *pHuffman, const unsigned char *pData, int Size)
+{
+	unsigned char aCompressed[4096], aSimple[4096];
+	int CompressedSize = pHuffman->Compress(pData, Size, aCompressed, sizeof(aCompressed));
+	ASSERT_TRUE(CompressedSize > 0);
+	EXPECT_EQ(pHuffman->CompressSimple(pData, Size, aSimple, sizeof(aSimple)), CompressedSize);
+	EXPECT_TRUE(mem_comp(aCompressed, aSimple, CompressedSize) == 0);
+
+	// both fail at the same output size
+	EXPECT_EQ(pHuffman->Compress(pData, Size, aSimple, CompressedSize), CompressedSize);
+	EXPECT_EQ(pHuffman->Compress(pData, Size, aSimple, CompressedSize-1), -1);
+	EXPECT_EQ(pHuffman->CompressSimple(pData, Size, aSimple, CompressedSize-1), -1);
+
+	unsigned char aOut[2048], aOutSimple[2048];
+	EXPECT_EQ(pHuffman->Decompress(aCompressed, CompressedSize, aOut, sizeof(aOut)), Size);
+	EXPECT_EQ(pHuffman->DecompressSimple(aCompressed, CompressedSize, aOutSimple, sizeof(aOutSimple)), Size);
+	EXPECT_TRUE(mem_comp(aOut, pData, Size) == 0);
+	EXPECT_TRUE(mem_comp(aOutSimple, pData, Size) == 0);
+	EXPECT_EQ(pHuffman->Decompress(aCompressed, CompressedSize, aOut, Size), Size);
+	if(Size > 0)
+	{
+		EXPECT_EQ(pHuffman->Decompress(aCompressed, CompressedSize, aOut, Size-1), -1);
+	}
+}
+
+TEST(Huffman, SameAsSimple)
+{
+	unsigned aFrequencies[256];
+	SkewedTable(aFrequencies);
+	CHuffman Default, Trained;
+	Default.Init();
+	Trained.Init(aFrequencies);
+
+	unsigned char aData[2048];
+	for(unsigned Seed = 0; Seed < 300; Seed++)
+	{
+		int Size = PacketLike(Seed, aData, sizeof(aData));
+		ExpectSameAsSimple(&Default, aData, Size);
+		ExpectSameAsSimple(&Trained, aData, Size);
+	}
+
+	// every input size up to a few words, including empty input
+	for(int Size = 0; Size < 64; Size++)
+	{
+		for(int i = 0; i < Size; i++)
+			aData[i] = (i*97+Size)%7 == 0 ? 0xff-i : 0;
+		ExpectSameAsSimple(&Default, aData, Size);
+		ExpectSameAsSimple(&Trained, aData, Size);
+	}
+	for(int i = 0; i < 1024; i++)
+		aData[i] = i*131;
+	ExpectSameAsSimple(&Default, aData, 1024);
+	ExpectSameAsSimple(&Trained, aData, 1024);
+}
+
+TEST(Huffman, CorruptInput)
+{
+	CHuffman Huffman;
+	Huffman.Init();
+	unsigned char aData[2048], aCompressed[4096];
+	unsigned char aOut[2048], aOutSimple[2048];
+	for(unsigned Seed = 0; Seed < 200; Seed++)
+	{
+		int Size = Huffman.Compress(aData, PacketLike(Seed, aData, sizeof(aData)), aCompressed, sizeof(aCompressed));
+		ASSERT_TRUE(Size > 0);
+
+		// flipped bits and cut off data decode the same, or fail the same
+		aCompressed[Seed%Size] ^= 1<<(Seed%8);
+		int Cut = Seed%3 == 0 ? Size/2 : Size;
+		int Result = Huffman.Decompress(aCompressed, Cut, aOut, sizeof(aOut));
+		EXPECT_EQ(Huffman.DecompressSimple(aCompressed, Cut, aOutSimple, sizeof(aOutSimple)), Result);
+		if(Result > 0)
+		{
+			EXPECT_TRUE(mem_comp(aOut, aOutSimple, Result) == 0);
+		}
+	}
+}
+
+TEST(Huffman, ParseTable)
+{
+	unsigned aFrequencies[256];
+	char aText[4096] = "# comment, 1 2 3\n";
+	for(int i = 0; i < 256; i++)
+	{
+		char aNum[16];
+		str_format(aNum, sizeof(aNum), i%16 == 15 ? "%d,\n" : "%d, ", i*3);
+		str_append(aText, aNum, sizeof(aText));
+	}
+	ASSERT_TRUE(CHuffman::ParseTable(aText, aFrequencies));
+	EXPECT_EQ(aFrequencies[0], 0u);
+	EXPECT_EQ(aFrequencies[255], 765u);
+
+	EXPECT_FALSE(CHuffman::ParseTable("1 2 3", aFrequencies));
+	str_append(aText, " 7", sizeof(aText));
+	EXPECT_FALSE(CHuffman::ParseTable(aText, aFrequencies));
+	EXPECT_FALSE(CHuffman::ParseTable("99999999", aFrequencies));
+}
+
+TEST(Huffman, TrainedTable)
+{
+	unsigned aFrequencies[256];
+	SkewedTable(aFrequencies);
+	CHuffman Huffman;
+	Huffman.Init(aFrequencies);
+	ASSERT_TRUE(Huffman.Usable());
+
+	unsigned char aData[512];
+	for(unsigned i = 0; i < sizeof(aData); i++)
+		aData[i] = i%61 == 0 ? 200+i%50 : i%7;
+	unsigned char aCompressed[1024];
+	unsigned char aOut[512];
+	int Size = Huffman.Compress(aData, sizeof(aData), aCompressed, sizeof(aCompressed));
+	ASSERT_TRUE(Size > 0);
+	EXPECT_TRUE(Size < (int)sizeof(aData)/2);
+	EXPECT_EQ(Huffman.Decompress(aCompressed, Size, aOut, sizeof(aOut)), (int)sizeof(aData));
+	EXPECT_TRUE(mem_comp(aData, aOut, sizeof(aData)) == 0);
+
+	// codes that don't fit the bit buffer
+	for(int i = 0; i < 256; i++)
+		aFrequencies[i] = i < 40 ? 1<<(i/2) : 0;
+	Huffman.Init(aFrequencies);
+	EXPECT_FALSE(Huffman.Usable());
+}
+
+TEST(Huffman, Negotiation)
+{
+	unsigned aFrequencies[256];
+	SkewedTable(aFrequencies);
+	CNetBase Net;
+	unsigned char aOffer[64];
+	EXPECT_EQ(Net.PackHuffmanOffer(aOffer, sizeof(aOffer)), 0);
+	unsigned ID = Net.AddHuffmanTable(aFrequencies);
+	EXPECT_EQ(ID, CHuffman::TableID(aFrequencies));
+	EXPECT_FALSE(ID == 0u);
+
+	int Size = Net.PackHuffmanOffer(aOffer, sizeof(aOffer));
+	EXPECT_TRUE(CNetBase::HuffmanTableOffered(aOffer, Size, ID));
+	EXPECT_FALSE(CNetBase::HuffmanTableOffered(aOffer, Size, ID+1));
+	unsigned char aPadding[64] = {0};
+	EXPECT_FALSE(CNetBase::HuffmanTableOffered(aPadding, sizeof(aPadding), ID));
+
+	unsigned char aChoice[16];
+	Size = CNetBase::PackHuffmanChoice(aChoice, ID);
+	EXPECT_EQ(CNetBase::UnpackHuffmanChoice(aChoice, Size), ID);
+	EXPECT_EQ(CNetBase::UnpackHuffmanChoice(aChoice, 0), 0u);
+
+	EXPECT_EQ(Net.HuffmanTableID(), 0u);
+	EXPECT_FALSE(Net.UseHuffmanTable(ID+1));
+	EXPECT_TRUE(Net.UseHuffmanTable(ID));
+	EXPECT_EQ(Net.HuffmanTableID(), ID);
+}
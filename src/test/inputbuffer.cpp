@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/inputbuffer.h>
+
+TEST(InputBuffer, AppliesOnIntendedTick)
+{
+	CInputBuffer Buffer;
+	int aData[2] = {1, 2};
+	EXPECT_EQ(Buffer.Add(10, 12, 40, aData, 2), (int)CInputBuffer::ADD_ONTIME);
+	EXPECT_FALSE(Buffer.Get(11));
+	ASSERT_TRUE(Buffer.Get(12));
+	EXPECT_EQ(Buffer.Get(12)[1], 2);
+	EXPECT_EQ(Buffer.Get(12)[2], 0);
+	EXPECT_FALSE(Buffer.Get(12+CInputBuffer::SIZE));
+
+	// too far ahead to keep
+	EXPECT_EQ(Buffer.Add(10, 10+CInputBuffer::SIZE, 40, aData, 2), (int)CInputBuffer::ADD_DROPPED);
+	EXPECT_EQ(Buffer.NumDropped(), 1);
+}
+
+TEST(InputBuffer, LateInputs)
+{
+	CInputBuffer Buffer;
+	int aData[1] = {5};
+	EXPECT_EQ(Buffer.Add(20, 19, -30, aData, 1), (int)CInputBuffer::ADD_LATE);
+	ASSERT_TRUE(Buffer.Get(21));
+	EXPECT_EQ(Buffer.Get(21)[0], 5);
+
+	// the next tick is taken now
+	aData[0] = 6;
+	EXPECT_EQ(Buffer.Add(20, 20, -10, aData, 1), (int)CInputBuffer::ADD_DROPPED);
+	EXPECT_EQ(Buffer.Get(21)[0], 5);
+	EXPECT_EQ(Buffer.NumLate(), 2);
+	EXPECT_EQ(Buffer.NumDropped(), 1);
+
+	// the input sent for the tick replaces the late one
+	aData[0] = 7;
+	EXPECT_EQ(Buffer.Add(20, 21, 10, aData, 1), (int)CInputBuffer::ADD_ONTIME);
+	EXPECT_EQ(Buffer.Get(21)[0], 7);
+}
+
+TEST(InputBuffer, DepthFollowsJitter)
+{
+	CInputBuffer Buffer;
+	int aData[1] = {0};
+	for(int i = 0; i < 100; i++)
+		Buffer.Add(i, i+2, 30, aData, 1);
+	EXPECT_EQ(Buffer.Depth(), 0);
+
+	// arrival times alternating by 60ms
+	for(int i = 100; i < 200; i++)
+		Buffer.Add(i, i+2, i%2 ? 60 : 0, aData, 1);
+	EXPECT_GE(Buffer.Depth(), 2);
+	EXPECT_LE(Buffer.Depth(), (int)CInputBuffer::MAX_DEPTH);
+
+	for(int i = 200; i < 300; i++)
+		Buffer.Add(i, i+2, 30, aData, 1);
+	EXPECT_EQ(Buffer.Depth(), 0);
+
+	Buffer.Reset();
+	EXPECT_EQ(Buffer.NumLate(), 0);
+	EXPECT_FALSE(Buffer.Get(250));
+}
+
+TEST(InputBuffer, FillsGaps)
+{
+	CInputBuffer Buffer;
+	int aData[1] = {1};
+	Buffer.Add(10, 13, 40, aData, 1);
+	aData[0] = 2;
+	EXPECT_FALSE(Buffer.Fill(10, 13, aData, 1));
+	EXPECT_TRUE(Buffer.Fill(10, 12, aData, 1));
+	EXPECT_FALSE(Buffer.Fill(10, 10, aData, 1));
+	EXPECT_EQ(Buffer.Get(13)[0], 1);
+	EXPECT_EQ(Buffer.Get(12)[0], 2);
+	EXPECT_EQ(Buffer.NumRecovered(), 1);
+}
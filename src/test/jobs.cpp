@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <base/tl/threading.h>
+#include <engine/shared/jobs.h>
+
+static int Increment(void *pUser)
+{
+	atomic_inc((volatile unsigned *)pUser);
+	return 7;
+}
+
+TEST(Jobs, Group)
+{
+	enum { NUM_JOBS=1000 };
+	static CJob s_aJobs[NUM_JOBS];
+	volatile unsigned Counter = 0;
+	CJobPool Pool;
+	Pool.Init(3);
+	CJobGroup Group;
+	for(int i = 0; i < NUM_JOBS; i++)
+		Pool.Add(&s_aJobs[i], Increment, (void *)&Counter, i%CJobPool::NUM_PRIORITIES, &Group);
+	Pool.Wait(&Group);
+	EXPECT_TRUE(Group.Done());
+	EXPECT_EQ(Counter, (unsigned)NUM_JOBS);
+	for(int i = 0; i < NUM_JOBS; i++)
+	{
+		EXPECT_EQ(s_aJobs[i].Status(), (int)CJob::STATE_DONE);
+		EXPECT_EQ(s_aJobs[i].Result(), 7);
+	}
+
+	// an empty group doesn't block, a group can be used again
+	Pool.Wait(&Group);
+	Pool.Add(&s_aJobs[0], Increment, (void *)&Counter, CJobPool::PRIORITY_NORMAL, &Group);
+	Pool.Wait(&Group);
+	EXPECT_EQ(Counter, (unsigned)NUM_JOBS+1);
+}
+
+struct COrder
+{
+	int m_aIDs[3];
+	int m_Num;
+};
+
+struct COrderJob
+{
+	CJob m_Job;
+	COrder *m_pOrder;
+	int m_ID;
+};
+
+static int RecordOrder(void *pUser)
+{
+	COrderJob *pJob = (COrderJob *)pUser;
+	pJob->m_pOrder->m_aIDs[pJob->m_pOrder->m_Num++] = pJob->m_ID;
+	return 0;
+}
+
+TEST(Jobs, Priorities)
+{
+	// without workers Wait runs the jobs itself, higher priorities first and
+	// jobs of the same priority in the order they were added
+	CJobPool Pool;
+	Pool.Init(0);
+	CJobGroup Group;
+	COrder Order = {{0}, 0};
+	COrderJob aJobs[3];
+	int aPriorities[3] = {CJobPool::PRIORITY_NORMAL, CJobPool::PRIORITY_HIGH, CJobPool::PRIORITY_NORMAL};
+	for(int i = 0; i < 3; i++)
+	{
+		aJobs[i].m_pOrder = &Order;
+		aJobs[i].m_ID = i;
+		Pool.Add(&aJobs[i].m_Job, RecordOrder, &aJobs[i], aPriorities[i], &Group);
+	}
+	EXPECT_FALSE(Group.Done());
+	Pool.Wait(&Group);
+	EXPECT_TRUE(Group.Done());
+	EXPECT_EQ(Order.m_Num, 3);
+	EXPECT_EQ(Order.m_aIDs[0], 1);
+	EXPECT_EQ(Order.m_aIDs[1], 0);
+	EXPECT_EQ(Order.m_aIDs[2], 2);
+}
+
+struct CSumJob
+{
+	CJob m_Job;
+	CJobPool *m_pPool;
+	int m_Begin;
+	int m_End;
+	int m_Sum;
+};
+
+// splits the range in two jobs and waits for them, from inside a job
+static int SumJob(void *pUser)
+{
+	CSumJob *pSum = (CSumJob *)pUser;
+	if(pSum->m_End-pSum->m_Begin <= 4)
+	{
+		pSum->m_Sum = 0;
+		for(int i = pSum->m_Begin; i < pSum->m_End; i++)
+			pSum->m_Sum += i;
+		return 0;
+	}
+
+	int Middle = (pSum->m_Begin+pSum->m_End)/2;
+	CSumJob aHalves[2] = {
+		{CJob(), pSum->m_pPool, pSum->m_Begin, Middle, 0},
+		{CJob(), pSum->m_pPool, Middle, pSum->m_End, 0},
+	};
+	CJobGroup Group;
+	for(int i = 0; i < 2; i++)
+		pSum->m_pPool->Add(&aHalves[i].m_Job, SumJob, &aHalves[i], CJobPool::PRIORITY_NORMAL, &Group);
+	pSum->m_pPool->Wait(&Group);
+	pSum->m_Sum = aHalves[0].m_Sum + aHalves[1].m_Sum;
+	return 0;
+}
+
+TEST(Jobs, Nested)
+{
+	CJobPool Pool;
+	Pool.Init(2);
+	CSumJob Sum = {CJob(), &Pool, 0, 1000, 0};
+	CJobGroup Group;
+	Pool.Add(&Sum.m_Job, SumJob, &Sum, CJobPool::PRIORITY_NORMAL, &Group);
+	Pool.Wait(&Group);
+	EXPECT_EQ(Sum.m_Sum, 999*1000/2);
+}
+
+static void MarkRange(int Begin, int End, void *pUser)
+{
+	int *pMarks = (int *)pUser;
+	for(int i = Begin; i < End; i++)
+		pMarks[i]++;
+}
+
+TEST(Jobs, ParallelFor)
+{
+	static int s_aMarks[10000];
+	for(int Threads = 0; Threads <= 4; Threads += 2)
+	{
+		CJobPool Pool;
+		Pool.Init(Threads);
+		mem_zero(s_aMarks, sizeof(s_aMarks));
+		Pool.ParallelFor(0, 10000, 16, MarkRange, s_aMarks);
+		Pool.ParallelFor(100, 103, 16, MarkRange, s_aMarks);
+		Pool.ParallelFor(5, 5, 1, MarkRange, s_aMarks);
+		int NumWrong = 0;
+		for(int i = 0; i < 10000; i++)
+			NumWrong += s_aMarks[i] != (i >= 100 && i < 103 ? 2 : 1);
+		EXPECT_EQ(NumWrong, 0);
+	}
+}
@@ -108,3 +108,56 @@ TEST_F(JsonWriter, One) { m_pJson->WriteIntValue(1); Expect("1" LINE_ENDING); }
 TEST_F(JsonWriter, MinusOne) { m_pJson->WriteIntValue(-1); Expect("-1" LINE_ENDING); }
 TEST_F(JsonWriter, Large) { m_pJson->WriteIntValue(INT_MAX); Expect("2147483647" LINE_ENDING); }
 TEST_F(JsonWriter, Small) { m_pJson->WriteIntValue(INT_MIN); Expect("-2147483648" LINE_ENDING); }
+
+static void WriteLargeDocument(CJsonWriter *pJson)
+{
+	pJson->BeginArray();
+	for(int i = 0; i < 20000; i++)
+	{
+		pJson->BeginObject();
+		pJson->WriteAttribute("index");
+		pJson->WriteIntValue(i);
+		pJson->WriteAttribute("name");
+		pJson->WriteStrValue(i%3 ? "value" : "line\nbreak");
+		pJson->EndObject();
+	}
+	pJson->EndArray();
+}
+
+TEST(JsonWriterMemory, Object)
+{
+	CJsonWriter Json;
+	Json.BeginObject();
+	Json.WriteAttribute("a");
+	Json.WriteIntValue(1);
+	Json.EndObject();
+	const char *pExpected = "{" LINE_ENDING "\t\"a\": 1" LINE_ENDING "}";
+	ASSERT_EQ(Json.OutputSize(), str_length(pExpected));
+	EXPECT_EQ(mem_comp(Json.Output(), pExpected, Json.OutputSize()), 0);
+}
+
+TEST(JsonWriterMemory, SameAsFile)
+{
+	// more than the file buffer, so that it gets written in between
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), "-large.json");
+	IOHANDLE File = io_open(aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	CJsonWriter *pFileJson = new CJsonWriter(File);
+	WriteLargeDocument(pFileJson);
+	pFileJson->Flush();
+	delete pFileJson;
+
+	CJsonWriter MemoryJson;
+	WriteLargeDocument(&MemoryJson);
+	EXPECT_GT(MemoryJson.OutputSize(), 64*1024);
+
+	char *pOutput = fs_read_str(aFilename);
+	ASSERT_TRUE(pOutput);
+	ASSERT_EQ(str_length(pOutput), MemoryJson.OutputSize()+str_length(LINE_ENDING));
+	EXPECT_EQ(mem_comp(pOutput, MemoryJson.Output(), MemoryJson.OutputSize()), 0);
+	EXPECT_STREQ(pOutput+MemoryJson.OutputSize(), LINE_ENDING);
+	mem_free(pOutput);
+	fs_remove(aFilename);
+}
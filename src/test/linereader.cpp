@@ -0,0 +1,146 @@
+#include "test.h"
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <base/tl/array.h>
+#include <engine/shared/linereader.h>
+
+static void WriteFile(const char *pFilename, const char *pData, int Size)
+{
+	IOHANDLE File = io_open(pFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	EXPECT_EQ(io_write(File, pData, Size), (unsigned)Size);
+	io_close(File);
+}
+
+// lines of growing length with all kinds of breaks, the last one optionally without
+static int BuildLines(char *pData, int NumLines, bool TrailingBreak, array<int> *pLengths)
+{
+	static const char *s_apBreaks[] = {"\n", "\r\n", "\r"};
+	int Size = 0;
+	for(int i = 0; i < NumLines; i++)
+	{
+		int Length = 1+(i*37)%300;
+		for(int c = 0; c < Length; c++)
+			pData[Size++] = 'a'+(i+c)%26;
+		pLengths->add(Length);
+		if(i < NumLines-1 || TrailingBreak)
+		{
+			const char *pBreak = s_apBreaks[i%3];
+			for(; *pBreak; pBreak++)
+				pData[Size++] = *pBreak;
+		}
+	}
+	return Size;
+}
+
+static void CheckLines(const char *pFilename, const array<int> &Lengths)
+{
+	IOHANDLE File = io_open(pFilename, IOFLAG_READ);
+	ASSERT_TRUE(File);
+	CLineReader Reader;
+	Reader.Init(File);
+
+	for(int i = 0; i < Lengths.size(); i++)
+	{
+		const char *pLine = Reader.Get();
+		ASSERT_TRUE(pLine) << "line " << i;
+		ASSERT_EQ(str_length(pLine), Lengths[i]) << "line " << i;
+		for(int c = 0; c < Lengths[i]; c++)
+			ASSERT_EQ(pLine[c], 'a'+(i+c)%26) << "line " << i;
+	}
+	EXPECT_FALSE(Reader.Get());
+	EXPECT_FALSE(Reader.Get());
+	io_close(File);
+}
+
+TEST(LineReader, SmallAndLargeFiles)
+{
+	CTestInfo Info;
+	static char s_aData[256*1024];
+	static const int s_aNumLines[] = {1, 2, 3, 10, 100, 1000};
+	for(unsigned n = 0; n < sizeof(s_aNumLines)/sizeof(s_aNumLines[0]); n++)
+		for(int Trailing = 0; Trailing < 2; Trailing++)
+		{
+			array<int> Lengths;
+			int Size = BuildLines(s_aData, s_aNumLines[n], Trailing, &Lengths);
+			WriteFile(Info.m_aFilename, s_aData, Size);
+			CheckLines(Info.m_aFilename, Lengths);
+		}
+	fs_remove(Info.m_aFilename);
+}
+
+TEST(LineReader, EmptyFile)
+{
+	CTestInfo Info;
+	WriteFile(Info.m_aFilename, "", 0);
+	IOHANDLE File = io_open(Info.m_aFilename, IOFLAG_READ);
+	ASSERT_TRUE(File);
+	CLineReader Reader;
+	Reader.Init(File);
+	EXPECT_FALSE(Reader.Get());
+	io_close(File);
+	fs_remove(Info.m_aFilename);
+}
+
+TEST(LineReader, Reinit)
+{
+	CTestInfo Info;
+	static char s_aData[64*1024];
+	array<int> Lengths;
+	int Size = BuildLines(s_aData, 500, true, &Lengths);
+	WriteFile(Info.m_aFilename, s_aData, Size);
+
+	// a reader used for a second file drops the first one
+	CLineReader Reader;
+	for(int Round = 0; Round < 2; Round++)
+	{
+		IOHANDLE File = io_open(Info.m_aFilename, IOFLAG_READ);
+		ASSERT_TRUE(File);
+		Reader.Init(File);
+		for(int i = 0; i < Lengths.size(); i++)
+		{
+			const char *pLine = Reader.Get();
+			ASSERT_TRUE(pLine);
+			EXPECT_EQ(str_length(pLine), Lengths[i]);
+		}
+		EXPECT_FALSE(Reader.Get());
+		io_close(File);
+	}
+	fs_remove(Info.m_aFilename);
+}
+
+TEST(LineReader, ChunksAndMapped)
+{
+	// a ban list sized file
+	enum { NUM_LINES=50000 };
+	CTestInfo Info;
+	IOHANDLE File = io_open(Info.m_aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	char aLine[64];
+	for(int i = 0; i < NUM_LINES; i++)
+	{
+		str_format(aLine, sizeof(aLine), "ban 10.%d.%d.%d 60 spamming\n", (i>>16)&255, (i>>8)&255, i&255);
+		io_write(File, aLine, str_length(aLine));
+	}
+	io_close(File);
+
+	for(int Mapped = 0; Mapped < 2; Mapped++)
+	{
+		File = io_open(Info.m_aFilename, IOFLAG_READ);
+		ASSERT_TRUE(File);
+		// a handle that was read from already is read in chunks
+		if(!Mapped)
+		{
+			EXPECT_EQ(io_read(File, aLine, 1), 1u);
+		}
+		CLineReader Reader;
+		Reader.Init(File);
+		int NumLines = 0;
+		while(Reader.Get())
+			NumLines++;
+		io_close(File);
+		EXPECT_EQ(NumLines, (int)NUM_LINES);
+	}
+	fs_remove(Info.m_aFilename);
+}
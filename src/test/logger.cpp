@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+
+static volatile int s_NumLines = 0;
+static volatile int s_NumOutOfOrder = 0;
+static int s_LastIndex = -1;
+
+static void CountLogger(const char *pLine)
+{
+	const char *pIndex = str_find(pLine, "async test line ");
+	if(!pIndex)
+		return;
+	int Index = str_toint(pIndex+str_length("async test line "));
+	s_NumOutOfOrder += Index <= s_LastIndex;
+	s_LastIndex = Index;
+	s_NumLines++;
+}
+
+TEST(Logger, Async)
+{
+	dbg_logger(CountLogger);
+	dbg_logger_async(64);
+
+	// the lines come out in order, the ones that didn't fit are counted
+	int DroppedBefore = dbg_logger_dropped();
+	for(int i = 0; i < 1000; i++)
+		dbg_msg("test", "async test line %d", i);
+	dbg_logger_flush();
+	EXPECT_EQ(s_NumLines + dbg_logger_dropped()-DroppedBefore, 1000);
+	EXPECT_EQ(s_NumOutOfOrder, 0);
+
+	int NumLines = s_NumLines;
+	dbg_msg("test", "async test line %d", 1000);
+	dbg_logger_flush();
+	EXPECT_EQ(s_NumLines, NumLines+1);
+}
@@ -0,0 +1,89 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <engine/shared/mapcache.h>
+#include <engine/storage.h>
+
+static void WriteFile(IStorage *pStorage, const char *pFilename, const char *pData)
+{
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, pData, str_length(pData));
+	io_close(File);
+}
+
+TEST(MapCache, FindSavedEntryUntilFileChanges)
+{
+	CTestInfo Info;
+	char aMap[64];
+	char aIndex[64];
+	Info.Filename(aMap, sizeof(aMap), ".map");
+	Info.Filename(aIndex, sizeof(aIndex), ".index");
+	IStorage *pStorage = CreateTestStorage();
+	WriteFile(pStorage, aMap, "map data");
+
+	SHA256_DIGEST Sha256 = sha256("map data", 8);
+	CMapCache *pCache = new CMapCache();
+	pCache->Init(pStorage, aIndex);
+	pCache->Add(aMap, &Sha256, 0x1234);
+	EXPECT_TRUE(pCache->Save());
+
+	CMapCache *pLoaded = new CMapCache();
+	pLoaded->Init(pStorage, aIndex);
+	ASSERT_TRUE(pLoaded->Load());
+	ASSERT_EQ(pLoaded->NumEntries(), 1);
+	const CMapCache::CEntry *pEntry = pLoaded->Find(&Sha256, 0x1234);
+	ASSERT_TRUE(pEntry);
+	EXPECT_STREQ(pEntry->m_aPath, aMap);
+	EXPECT_EQ(pEntry->m_Size, 8u);
+	EXPECT_TRUE(pLoaded->FindPath(aMap));
+	EXPECT_FALSE(pLoaded->Find(&Sha256, 0x4321));
+
+	WriteFile(pStorage, aMap, "other map data");
+	EXPECT_FALSE(pLoaded->Find(&Sha256, 0x1234));
+	EXPECT_EQ(pLoaded->NumEntries(), 0);
+
+	EXPECT_TRUE(pStorage->RemoveFile(aMap, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aIndex, IStorage::TYPE_SAVE));
+	delete pCache;
+	delete pLoaded;
+	delete pStorage;
+}
+
+TEST(MapCache, EvictLeastRecentlyUsed)
+{
+	CTestInfo Info;
+	char aOld[64];
+	char aNew[64];
+	char aKeep[64];
+	Info.Filename(aOld, sizeof(aOld), ".old.map");
+	Info.Filename(aNew, sizeof(aNew), ".new.map");
+	Info.Filename(aKeep, sizeof(aKeep), ".keep.map");
+	IStorage *pStorage = CreateTestStorage();
+	WriteFile(pStorage, aOld, "0123456789");
+	WriteFile(pStorage, aNew, "0123456789");
+	WriteFile(pStorage, aKeep, "0123456789");
+
+	SHA256_DIGEST Sha256 = SHA256_ZEROED;
+	CMapCache *pCache = new CMapCache();
+	pCache->Init(pStorage, Info.m_aFilename);
+	pCache->Add(aKeep, &Sha256, 0);
+	pCache->Add(aOld, &Sha256, 1);
+	pCache->Add(aNew, &Sha256, 2);
+	EXPECT_EQ(pCache->TotalSize(Info.m_aFilenamePrefix), 30);
+
+	// the kept file is the oldest but must stay
+	pCache->Evict(Info.m_aFilenamePrefix, 20, aKeep);
+	EXPECT_EQ(pCache->TotalSize(Info.m_aFilenamePrefix), 20);
+	EXPECT_TRUE(pCache->FindPath(aKeep));
+	EXPECT_TRUE(pCache->FindPath(aNew) || pCache->FindPath(aOld));
+
+	pCache->Evict(Info.m_aFilenamePrefix, 0, aKeep);
+	EXPECT_EQ(pCache->NumEntries(), 1);
+	EXPECT_FALSE(pStorage->RemoveFile(aOld, IStorage::TYPE_SAVE));
+	EXPECT_FALSE(pStorage->RemoveFile(aNew, IStorage::TYPE_SAVE));
+	EXPECT_TRUE(pStorage->RemoveFile(aKeep, IStorage::TYPE_SAVE));
+	delete pCache;
+	delete pStorage;
+}
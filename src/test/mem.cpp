@@ -0,0 +1,29 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+
+TEST(Mem, TagStats)
+{
+	int64 BytesBefore;
+	int BlocksBefore;
+	mem_tag_stats(MEMTAG_EDITOR, &BytesBefore, &BlocksBefore);
+
+	void *pFirst = mem_alloc_tag(100, 1, MEMTAG_EDITOR);
+	void *pSecond = mem_alloc_tag(1000, 1, MEMTAG_EDITOR);
+	EXPECT_EQ((size_t)pFirst%16, 0u);
+	mem_zero(pSecond, 1000);
+
+	int64 Bytes;
+	int Blocks;
+	mem_tag_stats(MEMTAG_EDITOR, &Bytes, &Blocks);
+	EXPECT_EQ(Bytes, BytesBefore+1100);
+	EXPECT_EQ(Blocks, BlocksBefore+2);
+
+	mem_free(pFirst);
+	mem_free(pSecond);
+	mem_free(0);
+	mem_tag_stats(MEMTAG_EDITOR, &Bytes, &Blocks);
+	EXPECT_EQ(Bytes, BytesBefore);
+	EXPECT_EQ(Blocks, BlocksBefore);
+	EXPECT_STREQ(mem_tag_name(MEMTAG_EDITOR), "editor");
+}
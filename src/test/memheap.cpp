@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/memheap.h>
+
+TEST(Heap, AlignedAndLarge)
+{
+	CHeap Heap;
+	char *pFirst = (char *)Heap.Allocate(3);
+	char *pSecond = (char *)Heap.Allocate(5);
+	EXPECT_EQ((size_t)pFirst%16, 0u);
+	EXPECT_EQ((size_t)pSecond%16, 0u);
+	EXPECT_NE(pFirst, pSecond);
+
+	// more than a chunk
+	char *pLarge = (char *)Heap.Allocate(256*1024);
+	ASSERT_TRUE(pLarge);
+	mem_zero(pLarge, 256*1024);
+}
+
+TEST(Heap, RewindReusesMemory)
+{
+	CHeap Heap;
+	Heap.Allocate(100);
+	CHeap::CMark Mark = Heap.Mark();
+	void *pAfterMark = Heap.Allocate(1000);
+	for(int i = 0; i < 10; i++)
+		Heap.Allocate(60*1024);
+	Heap.Allocate(200*1024);
+	Heap.Rewind(Mark);
+
+	EXPECT_EQ(Heap.Allocate(1000), pAfterMark);
+	for(int i = 0; i < 10; i++)
+		EXPECT_TRUE(Heap.Allocate(60*1024));
+}
+
+TEST(Heap, ScratchScopes)
+{
+	void *pOuter;
+	void *pInner;
+	{
+		CScratch Outer;
+		pOuter = Outer.Allocate(64);
+		{
+			CScratch Inner;
+			pInner = Inner.Allocate(64);
+			EXPECT_NE(pInner, pOuter);
+		}
+		// the inner scope gave its memory back
+		CScratch Inner;
+		EXPECT_EQ(Inner.Allocate(64), pInner);
+	}
+	CScratch Scope;
+	EXPECT_EQ(Scope.Allocate(64), pOuter);
+}
+
+static void ScratchThread(void *pUser)
+{
+	{
+		CScratch Scratch;
+		*(void **)pUser = Scratch.Allocate(64);
+	}
+	CScratch::ReleaseThread();
+}
+
+TEST(Heap, ScratchPerThread)
+{
+	CScratch Scratch;
+	void *pMain = Scratch.Allocate(64);
+	void *pOther = 0;
+	void *pThread = thread_init(ScratchThread, &pOther);
+	thread_wait(pThread);
+	EXPECT_TRUE(pOther);
+	EXPECT_NE(pOther, pMain);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/metrics.h>
+
+TEST(Metrics, TextFormat)
+{
+	CMetrics Metrics;
+	static const double s_aBounds[] = {0.01, 0.1};
+	int Ticks = Metrics.Add("ticks_seconds", "Tick time", CMetrics::TYPE_HISTOGRAM, s_aBounds, 2);
+	int Players = Metrics.Add("players", "Players", CMetrics::TYPE_GAUGE);
+	int Bytes = Metrics.Add("bytes_total", "Bytes", CMetrics::TYPE_COUNTER);
+	Metrics.Observe(Ticks, 0.005);
+	Metrics.Observe(Ticks, 0.05);
+	Metrics.Observe(Ticks, 1.0);
+	Metrics.Set(Players, 12);
+	Metrics.Inc(Bytes, 1400);
+	Metrics.Inc(Bytes, 600);
+
+	// nothing is visible before publishing
+	char aBuf[2048];
+	EXPECT_EQ(Metrics.Format(aBuf, sizeof(aBuf)), 0);
+
+	Metrics.Publish();
+	Metrics.Inc(Bytes, 1);
+	Metrics.Format(aBuf, sizeof(aBuf));
+	EXPECT_STREQ(aBuf,
+		"# HELP ticks_seconds Tick time\n"
+		"# TYPE ticks_seconds histogram\n"
+		"ticks_seconds_bucket{le=\"0.01\"} 1\n"
+		"ticks_seconds_bucket{le=\"0.1\"} 2\n"
+		"ticks_seconds_bucket{le=\"+Inf\"} 3\n"
+		"ticks_seconds_sum 1.055\n"
+		"ticks_seconds_count 3\n"
+		"# HELP players Players\n"
+		"# TYPE players gauge\n"
+		"players 12\n"
+		"# HELP bytes_total Bytes\n"
+		"# TYPE bytes_total counter\n"
+		"bytes_total 2000\n");
+
+	// a short buffer is cut off cleanly
+	char aShort[40];
+	int Length = Metrics.Format(aShort, sizeof(aShort));
+	EXPECT_EQ(Length, str_length(aShort));
+	EXPECT_EQ(Length, (int)sizeof(aShort)-1);
+}
+
+TEST(Metrics, Series)
+{
+	CMetrics Metrics;
+	int Bytes = Metrics.AddSeries("client_bytes_total", "Bytes per client", CMetrics::TYPE_COUNTER, "client_id");
+	EXPECT_EQ(Metrics.AddSeries("bad", "Histograms have no series", CMetrics::TYPE_HISTOGRAM, "client_id"), -1);
+	Metrics.SetSeries(Bytes, 3, 120);
+	Metrics.SetSeries(Bytes, 0, 5);
+	Metrics.SetSeries(Bytes, 5, 7);
+	Metrics.RemoveSeries(Bytes, 5);
+	Metrics.SetSeries(Bytes, CMetrics::MAX_SERIES-1, 9);
+	Metrics.Publish();
+
+	char aBuf[512], aExpected[512];
+	Metrics.Format(aBuf, sizeof(aBuf));
+	str_format(aExpected, sizeof(aExpected),
+		"# HELP client_bytes_total Bytes per client\n"
+		"# TYPE client_bytes_total counter\n"
+		"client_bytes_total{client_id=\"0\"} 5\n"
+		"client_bytes_total{client_id=\"3\"} 120\n"
+		"client_bytes_total{client_id=\"%d\"} 9\n", CMetrics::MAX_SERIES-1);
+	EXPECT_STREQ(aBuf, aExpected);
+}
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/console.h>
+#include <engine/shared/netban.h>
+
+static NETADDR Addr(const char *pStr)
+{
+	NETADDR Addr;
+	net_addr_from_str(&Addr, pStr);
+	return Addr;
+}
+
+static unsigned ToInt(const NETADDR *pAddr)
+{
+	return (pAddr->ip[0]<<24)|(pAddr->ip[1]<<16)|(pAddr->ip[2]<<8)|pAddr->ip[3];
+}
+
+static NETADDR FromInt(unsigned Value)
+{
+	NETADDR Addr = {0};
+	Addr.type = NETTYPE_IPV4;
+	for(int i = 0; i < 4; i++)
+		Addr.ip[i] = (Value>>(24-i*8))&0xff;
+	return Addr;
+}
+
+TEST(NetPrefixTrie, RangeToPrefixes)
+{
+	NETADDR aPrefixes[CNetPrefixTrie::MAX_RANGE_PREFIXES];
+	int aLengths[CNetPrefixTrie::MAX_RANGE_PREFIXES];
+
+	CNetRange Range;
+	Range.m_LB = Addr("10.0.0.0");
+	Range.m_UB = Addr("10.0.255.255");
+	EXPECT_EQ(CNetPrefixTrie::RangeToPrefixes(&Range, aPrefixes, aLengths, CNetPrefixTrie::MAX_RANGE_PREFIXES), 1);
+	EXPECT_EQ(aLengths[0], 16);
+
+	// 10.0.0.1 - 10.0.0.6 is /32 /31 /31 /32
+	Range.m_UB = Addr("10.0.0.6");
+	Range.m_LB = Addr("10.0.0.1");
+	EXPECT_EQ(CNetPrefixTrie::RangeToPrefixes(&Range, aPrefixes, aLengths, CNetPrefixTrie::MAX_RANGE_PREFIXES), 4);
+	EXPECT_EQ(aLengths[0], 32);
+	EXPECT_EQ(aLengths[1], 31);
+	EXPECT_EQ(aLengths[2], 31);
+	EXPECT_EQ(aLengths[3], 32);
+	EXPECT_EQ(aPrefixes[3].ip[3], 6);
+
+	// the whole address space
+	Range.m_LB = Addr("0.0.0.0");
+	Range.m_UB = Addr("255.255.255.255");
+	EXPECT_EQ(CNetPrefixTrie::RangeToPrefixes(&Range, aPrefixes, aLengths, CNetPrefixTrie::MAX_RANGE_PREFIXES), 1);
+	EXPECT_EQ(aLengths[0], 0);
+
+	// worst case for ipv6
+	Range.m_LB = Addr("[::1]");
+	Range.m_UB = Addr("[ffff:ffff:ffff:ffff:ffff:ffff:ffff:fffe]");
+	EXPECT_EQ(CNetPrefixTrie::RangeToPrefixes(&Range, aPrefixes, aLengths, CNetPrefixTrie::MAX_RANGE_PREFIXES), 2*128-2);
+}
+
+TEST(NetPrefixTrie, LongestMatch)
+{
+	CNetPrefixTrie Trie;
+	int aData[4];
+	NETADDR A = Addr("10.0.0.0");
+	NETADDR B = Addr("10.1.2.3");
+	NETADDR C = Addr("[2001:db8::]");
+	Trie.Insert(&A, 8, &aData[0], 0);
+	Trie.Insert(&B, 32, &aData[1], 1);
+	Trie.Insert(&C, 32, &aData[2], 2);
+
+	int Tag = -1;
+	NETADDR Test = Addr("10.1.2.3");
+	EXPECT_TRUE(Trie.Lookup(&Test, &Tag) == &aData[1]);
+	EXPECT_EQ(Tag, 1);
+	Test = Addr("10.1.2.4");
+	EXPECT_TRUE(Trie.Lookup(&Test, &Tag) == &aData[0]);
+	EXPECT_EQ(Tag, 0);
+	Test = Addr("11.1.2.3");
+	EXPECT_TRUE(Trie.Lookup(&Test) == 0);
+
+	// ipv4 and ipv6 don't mix
+	Test = Addr("[2001:db8:1::1]");
+	EXPECT_TRUE(Trie.Lookup(&Test) == &aData[2]);
+	Test = Addr("[::a00:1]");
+	EXPECT_TRUE(Trie.Lookup(&Test) == 0);
+
+	EXPECT_TRUE(Trie.Remove(&A, 8, &aData[0]));
+	EXPECT_FALSE(Trie.Remove(&A, 8, &aData[0]));
+	Test = Addr("10.1.2.4");
+	EXPECT_TRUE(Trie.Lookup(&Test) == 0);
+	Test = Addr("10.1.2.3");
+	EXPECT_TRUE(Trie.Lookup(&Test) == &aData[1]);
+
+	Trie.Remove(&B, 32, &aData[1]);
+	Trie.Remove(&C, 32, &aData[2]);
+	EXPECT_EQ(Trie.NumNodes(), 0);
+}
+
+TEST(NetPrefixTrie, RandomRanges)
+{
+	enum
+	{
+		NUM_RANGES=200,
+		NUM_TESTS=20000,
+	};
+
+	// ranges in a small space so they overlap, checked against a linear search
+	CNetPrefixTrie Trie;
+	unsigned aLB[NUM_RANGES], aUB[NUM_RANGES];
+	unsigned Seed = 1;
+	for(int i = 0; i < NUM_RANGES; i++)
+	{
+		Seed = Seed*1103515245+12345;
+		aLB[i] = 0x0a000000|((Seed>>8)&0xffff);
+		Seed = Seed*1103515245+12345;
+		aUB[i] = aLB[i]+1+((Seed>>8)&0x1ff);
+
+		CNetRange Range;
+		Range.m_LB = FromInt(aLB[i]);
+		Range.m_UB = FromInt(aUB[i]);
+		Trie.InsertRange(&Range, &aLB[i], 0);
+	}
+
+	int Mismatches = 0;
+	for(int t = 0; t < NUM_TESTS; t++)
+	{
+		Seed = Seed*1103515245+12345;
+		NETADDR Test = FromInt(0x0a000000|((Seed>>8)&0x1ffff));
+		unsigned Value = ToInt(&Test);
+		bool Expected = false;
+		for(int i = 0; i < NUM_RANGES && !Expected; i++)
+			Expected = aLB[i] <= Value && Value <= aUB[i];
+		unsigned *pFound = (unsigned *)Trie.Lookup(&Test);
+		bool Found = pFound && *pFound <= Value && Value <= aUB[pFound-aLB];
+		if(Expected != Found || (!Expected && pFound))
+			Mismatches++;
+	}
+	EXPECT_EQ(Mismatches, 0);
+
+	for(int i = 0; i < NUM_RANGES; i++)
+	{
+		CNetRange Range;
+		Range.m_LB = FromInt(aLB[i]);
+		Range.m_UB = FromInt(aUB[i]);
+		Trie.RemoveRange(&Range, &aLB[i]);
+	}
+	EXPECT_EQ(Trie.NumNodes(), 0);
+}
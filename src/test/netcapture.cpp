@@ -0,0 +1,135 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/storage.h>
+#include <engine/shared/netcapture.h>
+
+static SHA256_DIGEST TestSha256()
+{
+	SHA256_DIGEST Sha256;
+	for(unsigned i = 0; i < sizeof(Sha256.data); i++)
+		Sha256.data[i] = i*7;
+	return Sha256;
+}
+
+static void WriteCapture(IStorage *pStorage, const char *pFilename, int NumDatagrams)
+{
+	CNetCaptureWriter Writer;
+	ASSERT_TRUE(Writer.Open(pStorage, pFilename, "dm1", TestSha256(), "sv_name \"test\"\nsv_max_clients 16\n"));
+	Writer.WriteSeed(0x123456789abcdefll);
+	NETADDR Addr4, Addr6;
+	net_addr_from_str(&Addr4, "127.0.0.1:8303");
+	net_addr_from_str(&Addr6, "[::1]:40000");
+	unsigned char aData[NET_MAX_PACKETSIZE];
+	for(int i = 0; i < NumDatagrams; i++)
+	{
+		int Size = 1+(i*97)%NET_MAX_PACKETSIZE;
+		for(int b = 0; b < Size; b++)
+			aData[b] = i+b;
+		Writer.WriteDatagram(i%2 ? &Addr6 : &Addr4, aData, Size);
+		if(i == NumDatagrams/2)
+			Writer.WriteSeed(-5);
+	}
+}
+
+TEST(NetCapture, Roundtrip)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".cap");
+	WriteCapture(pStorage, aFilename, 100);
+
+	CNetCaptureReader Reader;
+	ASSERT_TRUE(Reader.Open(pStorage, aFilename));
+	EXPECT_STREQ(Reader.Map(), "dm1");
+	EXPECT_TRUE(Reader.MapSha256() == TestSha256());
+	EXPECT_STREQ(Reader.Config(), "sv_name \"test\"\nsv_max_clients 16\n");
+
+	const CNetCapture::CRecord *pRecord = Reader.Peek();
+	ASSERT_TRUE(pRecord);
+	EXPECT_EQ(pRecord->m_Type, (int)CNetCapture::RECORD_SEED);
+	EXPECT_EQ(pRecord->m_Seed, 0x123456789abcdefll);
+	// peeking again doesn't read on
+	EXPECT_EQ(Reader.Peek(), pRecord);
+	Reader.Pop();
+
+	int64 LastTime = 0;
+	for(int i = 0; i < 100; i++)
+	{
+		pRecord = Reader.Peek();
+		ASSERT_TRUE(pRecord);
+		ASSERT_EQ(pRecord->m_Type, (int)CNetCapture::RECORD_DATAGRAM);
+		EXPECT_GE(pRecord->m_Time, LastTime);
+		LastTime = pRecord->m_Time;
+
+		char aAddr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&pRecord->m_Addr, aAddr, sizeof(aAddr), true);
+		EXPECT_STREQ(aAddr, i%2 ? "[0:0:0:0:0:0:0:1]:40000" : "127.0.0.1:8303");
+		int Size = 1+(i*97)%NET_MAX_PACKETSIZE;
+		ASSERT_EQ(pRecord->m_Size, Size);
+		for(int b = 0; b < Size; b++)
+			ASSERT_EQ(pRecord->m_aData[b], (unsigned char)(i+b));
+		Reader.Pop();
+
+		if(i == 50)
+		{
+			pRecord = Reader.Peek();
+			ASSERT_TRUE(pRecord);
+			EXPECT_EQ(pRecord->m_Type, (int)CNetCapture::RECORD_SEED);
+			EXPECT_EQ(pRecord->m_Seed, -5);
+			Reader.Pop();
+		}
+	}
+	EXPECT_FALSE(Reader.Peek());
+	Reader.Close();
+
+	pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE);
+	delete pStorage;
+}
+
+TEST(NetCapture, CutOff)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	char aFilename[64], aCutFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".cap");
+	Info.Filename(aCutFilename, sizeof(aCutFilename), "-cut.cap");
+	WriteCapture(pStorage, aFilename, 3);
+
+	// a server that got killed leaves half a record at the end
+	IOHANDLE File = pStorage->OpenFile(aFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	int Size = (int)io_length(File);
+	char *pData = (char *)mem_alloc(Size, 1);
+	ASSERT_EQ(io_read(File, pData, Size), (unsigned)Size);
+	io_close(File);
+	File = pStorage->OpenFile(aCutFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, pData, Size-10);
+	io_close(File);
+
+	CNetCaptureReader Reader;
+	ASSERT_TRUE(Reader.Open(pStorage, aCutFilename));
+	int NumRecords = 0;
+	for(; Reader.Peek(); Reader.Pop())
+		NumRecords++;
+	EXPECT_EQ(NumRecords, 4); // all but the last datagram
+	Reader.Close();
+
+	// anything else isn't a capture
+	File = pStorage->OpenFile(aCutFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	pData[0] = 'X';
+	io_write(File, pData, Size);
+	io_close(File);
+	EXPECT_FALSE(Reader.Open(pStorage, aCutFilename));
+	EXPECT_FALSE(Reader.IsOpen());
+
+	mem_free(pData);
+	pStorage->RemoveFile(aFilename, IStorage::TYPE_SAVE);
+	pStorage->RemoveFile(aCutFilename, IStorage::TYPE_SAVE);
+	delete pStorage;
+}
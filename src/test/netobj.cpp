@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/snapshot.h>
+#include <generated/protocol.h>
+
+static int BuildSnap(CSnapshot *pSnap, int NumCharacters, bool Broken)
+{
+	CSnapshotBuilder Builder;
+	Builder.Init();
+	for(int i = 0; i < NumCharacters; i++)
+	{
+		CNetObj_Character *pCharacter = (CNetObj_Character *)Builder.NewItem(NETOBJTYPE_CHARACTER, i, sizeof(CNetObj_Character));
+		mem_zero(pCharacter, sizeof(*pCharacter));
+		pCharacter->m_Health = 10;
+		pCharacter->m_Direction = -1;
+		pCharacter->m_HookedPlayer = -1;
+		if(Broken && i == 1)
+			pCharacter->m_Weapon = NUM_WEAPONS;
+	}
+	CNetObj_Pickup *pPickup = (CNetObj_Pickup *)Builder.NewItem(NETOBJTYPE_PICKUP, 0, sizeof(CNetObj_Pickup));
+	mem_zero(pPickup, sizeof(*pPickup));
+	if(Broken)
+	{
+		Builder.NewItem(NETOBJTYPE_FLAG, 0, sizeof(CNetObj_Flag)-4);
+		Builder.NewItem(0x7000, 0, 4);
+	}
+	return Builder.Finish(pSnap);
+}
+
+TEST(NetObj, ValidateSnapMatchesValidateObj)
+{
+	static char s_aData[CSnapshot::MAX_SIZE];
+	CSnapshot *pSnap = (CSnapshot *)s_aData;
+	BuildSnap(pSnap, 4, true);
+
+	int aInvalid[16];
+	int NumInvalid = CNetObjHandler::ValidateSnap(pSnap, aInvalid);
+	EXPECT_EQ(NumInvalid, 3);
+
+	CNetObjHandler Handler;
+	int Found = 0;
+	for(int i = 0; i < pSnap->NumItems(); i++)
+	{
+		const CSnapshotItem *pItem = pSnap->GetItem(i);
+		bool Invalid = Handler.ValidateObj(pItem->Type(), pItem->Data(), pSnap->GetItemSize(i)) != 0;
+		bool Listed = Found < NumInvalid && aInvalid[Found] == i;
+		EXPECT_EQ(Invalid, Listed) << "index " << i << " type " << pItem->Type();
+		Found += Listed;
+	}
+	EXPECT_EQ(Found, NumInvalid);
+
+	// the slow path still tells what failed
+	const CNetObj_Character *pCharacter = (const CNetObj_Character *)pSnap->GetItem(pSnap->GetItemIndex((NETOBJTYPE_CHARACTER<<16)|1))->Data();
+	EXPECT_FALSE(CNetObjHandler::GetValidObj<CNetObj_Character>(pCharacter, sizeof(*pCharacter)));
+	EXPECT_EQ(Handler.ValidateObj(NETOBJTYPE_CHARACTER, pCharacter, sizeof(*pCharacter)), -1);
+	EXPECT_STREQ(Handler.FailedObjOn(), "m_Weapon");
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/network.h>
+
+static bool ConnectPair(NETSOCKET *pListen, NETSOCKET *pClient, NETSOCKET *pAccepted, NETADDR *pAddr)
+{
+	NETADDR BindAddr;
+	net_addr_from_str(&BindAddr, "127.0.0.1");
+	BindAddr.type = NETTYPE_IPV4;
+	for(int Port = 17303+pid()%1000; Port < 18400; Port++)
+	{
+		BindAddr.port = Port;
+		*pListen = net_tcp_create(BindAddr);
+		if(pListen->type && net_tcp_listen(*pListen, 1) == 0)
+			break;
+		if(pListen->type)
+			net_tcp_close(*pListen);
+		pListen->type = NETTYPE_INVALID;
+	}
+	if(!pListen->type)
+		return false;
+
+	NETADDR ClientAddr = BindAddr;
+	ClientAddr.port = 0;
+	*pClient = net_tcp_create(ClientAddr);
+	if(net_tcp_connect(*pClient, &BindAddr) != 0)
+		return false;
+	return net_tcp_accept(*pListen, pAccepted, pAddr) > 0;
+}
+
+TEST(ConsoleNetConnection, DropLinesOverBacklog)
+{
+	NETSOCKET Listen, Client, Accepted;
+	NETADDR Addr;
+	ASSERT_TRUE(ConnectPair(&Listen, &Client, &Accepted, &Addr));
+
+	CConsoleNetConnection Conn;
+	mem_zero(&Conn, sizeof(Conn));
+	Conn.Init(Accepted, &Addr, 256, CConsoleNetConnection::OVERFLOW_DROP_LINES);
+
+	// lines of 50 characters, only 5 fit into the backlog
+	char aLine[51];
+	for(int i = 0; i < 50; i++)
+		aLine[i] = 'a'+i%26;
+	aLine[50] = 0;
+	for(int i = 0; i < 10; i++)
+		EXPECT_EQ(Conn.Send(aLine), 0);
+	EXPECT_EQ(Conn.Flush(), 5*51);
+	EXPECT_EQ(Conn.Send("after"), 0);
+	EXPECT_GT(Conn.Flush(), 0);
+	EXPECT_EQ(Conn.State(), NET_CONNSTATE_ONLINE);
+
+	char aBuf[1024];
+	int Received = 0;
+	while(Received < 5*51+(int)sizeof("[5 lines dropped]\nafter\n")-1)
+	{
+		int Bytes = net_tcp_recv(Client, aBuf+Received, sizeof(aBuf)-1-Received);
+		ASSERT_GT(Bytes, 0);
+		Received += Bytes;
+	}
+	aBuf[Received] = 0;
+	EXPECT_STREQ(aBuf+5*51, "[5 lines dropped]\nafter\n");
+
+	// the other policy gives up on the client
+	Conn.SetBacklog(64, CConsoleNetConnection::OVERFLOW_DISCONNECT);
+	EXPECT_EQ(Conn.Send(aLine), 0);
+	EXPECT_EQ(Conn.Send(aLine), -1);
+	EXPECT_EQ(Conn.State(), NET_CONNSTATE_ERROR);
+
+	Conn.Disconnect("");
+	net_tcp_close(Client);
+	net_tcp_close(Listen);
+}
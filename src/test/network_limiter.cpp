@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/network.h>
+
+static NETADDR Addr(const char *pStr)
+{
+	NETADDR Addr;
+	net_addr_from_str(&Addr, pStr);
+	return Addr;
+}
+
+TEST(ConnlessLimiter, SourceBurstAndRate)
+{
+	CNetConnlessLimiter Limiter;
+	Limiter.Init();
+	Limiter.SetLimits(10, 5, 0, 1);
+
+	NETADDR A = Addr("1.2.3.4:8303");
+	NETADDR B = Addr("1.2.3.5:8303");
+	int64 Now = time_freq()*100;
+	for(int i = 0; i < 5; i++)
+		EXPECT_TRUE(Limiter.Allow(&A, Now));
+	EXPECT_FALSE(Limiter.Allow(&A, Now));
+
+	// the port doesn't make a new source, another host does
+	NETADDR OtherPort = Addr("1.2.3.4:9000");
+	EXPECT_FALSE(Limiter.Allow(&OtherPort, Now));
+	EXPECT_TRUE(Limiter.Allow(&B, Now));
+
+	// one packet per interval refills
+	EXPECT_TRUE(Limiter.Allow(&A, Now+time_freq()/10));
+	EXPECT_FALSE(Limiter.Allow(&A, Now+time_freq()/10));
+
+	EXPECT_EQ(Limiter.NumAccepted(), 7u);
+	EXPECT_EQ(Limiter.NumDroppedSource(), 3u);
+	EXPECT_EQ(Limiter.NumDroppedGlobal(), 0u);
+}
+
+TEST(ConnlessLimiter, Global)
+{
+	CNetConnlessLimiter Limiter;
+	Limiter.Init();
+	Limiter.SetLimits(0, 1, 100, 10);
+
+	int64 Now = time_freq()*100;
+	char aBuf[32];
+	int Accepted = 0;
+	for(int i = 0; i < 50; i++)
+	{
+		str_format(aBuf, sizeof(aBuf), "10.0.%d.%d:8303", i/256, i%256);
+		NETADDR A = Addr(aBuf);
+		Accepted += Limiter.Allow(&A, Now);
+	}
+	EXPECT_EQ(Accepted, 10);
+	EXPECT_EQ(Limiter.NumDroppedGlobal(), 40u);
+
+	// a second later the bucket is full again
+	NETADDR A = Addr("10.1.0.0:8303");
+	EXPECT_TRUE(Limiter.Allow(&A, Now+time_freq()));
+}
+
+TEST(ConnlessLimiter, ManySources)
+{
+	CNetConnlessLimiter Limiter;
+	Limiter.Init();
+	Limiter.SetLimits(1, 2, 0, 1);
+
+	// more hosts than slots, each one still gets its burst
+	int64 Now = time_freq()*100;
+	char aBuf[32];
+	int Accepted = 0;
+	for(int i = 0; i < 4096; i++)
+	{
+		str_format(aBuf, sizeof(aBuf), "[2001:db8::%x]:8303", i);
+		NETADDR A = Addr(aBuf);
+		Accepted += Limiter.Allow(&A, Now);
+		Accepted += Limiter.Allow(&A, Now);
+		Accepted += Limiter.Allow(&A, Now);
+	}
+	EXPECT_EQ(Accepted, 4096*2);
+}
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/network.h>
+
+static unsigned char *PackChunk(unsigned char *pData, int Flags, int Sequence, const char *pStr)
+{
+	CNetChunkHeader Header;
+	Header.m_Flags = Flags;
+	Header.m_Size = str_length(pStr)+1;
+	Header.m_Sequence = Sequence;
+	pData = Header.Pack(pData);
+	mem_copy(pData, pStr, Header.m_Size);
+	return pData+Header.m_Size;
+}
+
+TEST(NetRecvUnpacker, ChunksInPlace)
+{
+	unsigned char aPayload[64];
+	unsigned char *pData = aPayload;
+	pData = PackChunk(pData, 0, 0, "first");
+	pData = PackChunk(pData, NET_CHUNKFLAG_VITAL, 1, "second");
+	pData = PackChunk(pData, 0, 0, "third");
+
+	NETADDR Addr;
+	net_addr_from_str(&Addr, "127.0.0.1:8303");
+	CNetRecvUnpacker Unpacker;
+	Unpacker.m_Data.m_NumChunks = 3;
+	Unpacker.m_Data.m_DataSize = (int)(pData-aPayload);
+	Unpacker.m_Data.m_pChunkData = aPayload;
+	Unpacker.Start(&Addr, 0, 2);
+
+	// the chunks point into the received payload
+	CNetChunk Chunk;
+	ASSERT_TRUE(Unpacker.FetchChunk(&Chunk));
+	EXPECT_EQ(Chunk.m_ClientID, 2);
+	EXPECT_EQ(Chunk.m_Flags, 0);
+	EXPECT_TRUE(Chunk.m_pData == aPayload+2);
+	EXPECT_STREQ((const char *)Chunk.m_pData, "first");
+	ASSERT_TRUE(Unpacker.FetchChunk(&Chunk));
+	EXPECT_EQ(Chunk.m_Flags, (int)NETSENDFLAG_VITAL);
+	EXPECT_STREQ((const char *)Chunk.m_pData, "second");
+	ASSERT_TRUE(Unpacker.FetchChunk(&Chunk));
+	EXPECT_STREQ((const char *)Chunk.m_pData, "third");
+	EXPECT_FALSE(Unpacker.FetchChunk(&Chunk));
+	EXPECT_FALSE(Unpacker.IsActive());
+}
+
+TEST(NetRecvUnpacker, Truncated)
+{
+	unsigned char aPayload[64];
+	unsigned char *pData = aPayload;
+	pData = PackChunk(pData, 0, 0, "complete");
+	pData = PackChunk(pData, 0, 0, "cut off");
+
+	NETADDR Addr = {0};
+	CNetRecvUnpacker Unpacker;
+	Unpacker.m_Data.m_NumChunks = 2;
+	Unpacker.m_Data.m_DataSize = (int)(pData-aPayload)-3;
+	Unpacker.m_Data.m_pChunkData = aPayload;
+	Unpacker.Start(&Addr, 0, 0);
+
+	CNetChunk Chunk;
+	ASSERT_TRUE(Unpacker.FetchChunk(&Chunk));
+	EXPECT_STREQ((const char *)Chunk.m_pData, "complete");
+	EXPECT_FALSE(Unpacker.FetchChunk(&Chunk));
+}
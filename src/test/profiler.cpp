@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/profiler.h>
+
+TEST(Profiler, BucketsAreOrdered)
+{
+	int LastBucket = 0;
+	for(int64 Value = 0; Value < 10000000; Value += Value/16+1)
+	{
+		int Bucket = CProfiler::Bucket(Value);
+		EXPECT_TRUE(Bucket >= LastBucket);
+		EXPECT_TRUE(CProfiler::BucketValue(Bucket) <= Value);
+		// eight buckets per power of two
+		EXPECT_TRUE(CProfiler::BucketValue(Bucket)*9/8+1 > Value);
+		LastBucket = Bucket;
+	}
+	EXPECT_EQ(CProfiler::Bucket(-1), 0);
+	EXPECT_EQ(CProfiler::Bucket((int64)1<<50), CProfiler::NUM_BUCKETS-1);
+}
+
+TEST(Profiler, Percentiles)
+{
+	CProfiler Profiler;
+	int Phase = Profiler.AddPhase("test");
+	EXPECT_EQ(Profiler.AddPhase("test"), Phase);
+	Profiler.SetEnabled(true);
+
+	// 1..1000 microseconds
+	for(int i = 1; i <= 1000; i++)
+		Profiler.Add(Phase, i*time_freq()/1000000);
+
+	CProfiler::CStats Stats;
+	Profiler.GetStats(Phase, &Stats);
+	EXPECT_EQ(Stats.m_NumSamples, 1000);
+	EXPECT_TRUE(Stats.m_Max >= 999);
+	EXPECT_TRUE(Stats.m_Max <= 1000);
+	EXPECT_TRUE(Stats.m_P50 > 500*7/8);
+	EXPECT_TRUE(Stats.m_P50 <= 500);
+	EXPECT_TRUE(Stats.m_P99 > 990*7/8);
+	EXPECT_TRUE(Stats.m_P99 <= 990);
+
+	// the histogram holds every sample in the bucket of its value
+	unsigned aCounts[CProfiler::NUM_BUCKETS];
+	Profiler.GetHistogram(Phase, aCounts);
+	unsigned Total = 0;
+	for(int b = 0; b < CProfiler::NUM_BUCKETS; b++)
+		Total += aCounts[b];
+	EXPECT_EQ(Total, 1000u);
+	EXPECT_EQ(aCounts[CProfiler::Bucket(1)], 1u);
+	EXPECT_TRUE(aCounts[CProfiler::Bucket(1000)] > 0);
+
+	Profiler.Reset();
+	Profiler.GetStats(Phase, &Stats);
+	EXPECT_EQ(Stats.m_NumSamples, 0);
+	EXPECT_EQ(Stats.m_Max, 0);
+}
@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/qualitygovernor.h>
+
+static void AddWindow(CQualityGovernor *pGovernor, float FrameTime, float TargetTime)
+{
+	for(int i = 0; i < CQualityGovernor::WINDOW_FRAMES; i++)
+		pGovernor->AddFrame(FrameTime, TargetTime);
+}
+
+TEST(QualityGovernor, StepsDownWhenSlow)
+{
+	CQualityGovernor Governor;
+	EXPECT_EQ(Governor.Level(), 1.0f);
+	AddWindow(&Governor, 1/30.0f, 1/60.0f);
+	EXPECT_EQ(Governor.Level(), 1.0f-CQualityGovernor::ms_LevelStep);
+	for(int i = 0; i < 20; i++)
+		AddWindow(&Governor, 1/30.0f, 1/60.0f);
+	EXPECT_EQ(Governor.Level(), CQualityGovernor::ms_MinLevel);
+}
+
+TEST(QualityGovernor, Percentile)
+{
+	CQualityGovernor Governor;
+	// a few slow frames don't count, the slowest tenth does
+	for(int i = 0; i < CQualityGovernor::WINDOW_FRAMES; i++)
+		Governor.AddFrame(i < 4 ? 0.1f : 0.01f, 1/60.0f);
+	EXPECT_EQ(Governor.Percentile(), 0.01f);
+	EXPECT_EQ(Governor.Level(), 1.0f);
+
+	for(int i = 0; i < CQualityGovernor::WINDOW_FRAMES; i++)
+		Governor.AddFrame(i < 10 ? 0.1f : 0.01f, 1/60.0f);
+	EXPECT_EQ(Governor.Percentile(), 0.1f);
+	EXPECT_LT(Governor.Level(), 1.0f);
+}
+
+TEST(QualityGovernor, Hysteresis)
+{
+	CQualityGovernor Governor;
+	AddWindow(&Governor, 1/30.0f, 1/60.0f);
+	const float Lowered = Governor.Level();
+
+	// close to the target keeps the level
+	for(int i = 0; i < 10; i++)
+		AddWindow(&Governor, 1/62.0f, 1/60.0f);
+	EXPECT_EQ(Governor.Level(), Lowered);
+
+	// well below it raises the level after a few windows only
+	for(int i = 0; i < CQualityGovernor::RAISE_WINDOWS-1; i++)
+		AddWindow(&Governor, 1/120.0f, 1/60.0f);
+	EXPECT_EQ(Governor.Level(), Lowered);
+	AddWindow(&Governor, 1/120.0f, 1/60.0f);
+	EXPECT_EQ(Governor.Level(), 1.0f);
+}
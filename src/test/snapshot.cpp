@@ -0,0 +1,287 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/snapshot.h>
+
+static const int s_aValues[] = {
+	0, 1, -1, 63, 64, -64, -65, 8191, 8192, -8193,
+	(1<<20)-1, 1<<20, -(1<<20)-1, (1<<27)-1, 1<<27, -(1<<27)-1, 0x7fffffff, (int)0x80000000,
+};
+
+static int TestValue(int Seed)
+{
+	return s_aValues[(unsigned)(Seed*2654435761u)%(sizeof(s_aValues)/sizeof(s_aValues[0]))];
+}
+
+TEST(Snapshot, DiffItemMatchesScalar)
+{
+	int aPast[64], aCurrent[64], aOut[64], aOutScalar[64];
+	for(int Size = 0; Size <= 64; Size++)
+	{
+		for(int i = 0; i < Size; i++)
+		{
+			aPast[i] = TestValue(i*3+Size);
+			aCurrent[i] = (int)((unsigned)aPast[i] + (unsigned)TestValue(i*7+Size));
+		}
+		EXPECT_EQ(CSnapshotDelta::DiffItem(aPast, aCurrent, aOut, Size) != 0, CSnapshotDelta::DiffItemScalar(aPast, aCurrent, aOutScalar, Size) != 0);
+		EXPECT_EQ(mem_comp(aOut, aOutScalar, Size*sizeof(int)), 0);
+
+		// unchanged item
+		EXPECT_EQ(CSnapshotDelta::DiffItem(aPast, aPast, aOut, Size), 0);
+	}
+}
+
+TEST(Snapshot, UndiffItemMatchesScalar)
+{
+	int aPast[64], aDiff[64], aOut[64], aOutScalar[64];
+	for(int Size = 0; Size <= 64; Size++)
+	{
+		for(int i = 0; i < Size; i++)
+		{
+			aPast[i] = TestValue(i*5+Size);
+			aDiff[i] = TestValue(i*11+Size);
+		}
+		EXPECT_EQ(CSnapshotDelta::UndiffItem(aPast, aDiff, aOut, Size), CSnapshotDelta::UndiffItemScalar(aPast, aDiff, aOutScalar, Size));
+		EXPECT_EQ(mem_comp(aOut, aOutScalar, Size*sizeof(int)), 0);
+	}
+}
+
+static int BuildMovingSnap(CSnapshotBuilder *pBuilder, CSnapshot *pSnap, int Tick)
+{
+	// characters with small ranged fields and positions that move, plus one dynamic sized item
+	pBuilder->Init();
+	for(int i = 0; i < 16; i++)
+	{
+		if(i == Tick%16)
+			continue;
+		int *pData = (int *)pBuilder->NewItem(1, i, 8*sizeof(int));
+		pData[0] = Tick;
+		pData[1] = 1000+i*32+Tick*(i%3);
+		pData[2] = 500-Tick*(i%5);
+		pData[3] = (i+Tick/7)%6;
+		pData[4] = i%2 ? -1 : 1;
+		pData[5] = 100000*i;
+		pData[6] = (Tick/3)%10;
+		pData[7] = (int)0x80000000;
+	}
+	// an item keeps its size for as long as its key exists
+	int *pData = (int *)pBuilder->NewItem(2, Tick%4, (1+Tick%4)*sizeof(int));
+	for(int i = 0; i < 1+Tick%4; i++)
+		pData[i] = Tick*i;
+	return pBuilder->Finish(pSnap);
+}
+
+TEST(Snapshot, PackBitsRoundtrip)
+{
+	CSnapshotDelta Delta;
+	Delta.SetStaticsize(1, 8*sizeof(int));
+	const unsigned char aBits[] = {0, 0, 0, 4, 2, 0, 5, 3};
+	Delta.SetFieldBits(1, aBits, sizeof(aBits));
+
+	static char s_aPrev[CSnapshot::MAX_SIZE], s_aCur[CSnapshot::MAX_SIZE], s_aOut[CSnapshot::MAX_SIZE];
+	static char s_aDelta[CSnapshot::MAX_SIZE], s_aUnpacked[CSnapshot::MAX_SIZE];
+	static unsigned char s_aVarint[CSnapshot::MAX_SIZE], s_aBitpacked[CSnapshot::MAX_SIZE];
+	CSnapshotBuilder Builder;
+	CSnapshot *pPrev = (CSnapshot *)s_aPrev;
+	CSnapshot *pCur = (CSnapshot *)s_aCur;
+	pPrev->Clear();
+
+	int VarintSize = 0, BitpackedSize = 0;
+	for(int Tick = 1; Tick < 200; Tick++)
+	{
+		int SnapSize = BuildMovingSnap(&Builder, pCur, Tick);
+		int DeltaSize = Delta.CreateDelta(pPrev, pCur, s_aDelta);
+		ASSERT_GT(DeltaSize, 0);
+
+		int PackedSize = Delta.PackBits(s_aDelta, DeltaSize, s_aBitpacked, sizeof(s_aBitpacked));
+		ASSERT_GT(PackedSize, 0);
+		EXPECT_EQ(s_aBitpacked[0], (unsigned char)CSnapshotDelta::PACKING_BITS);
+		EXPECT_EQ(Delta.UnpackBits(s_aBitpacked, PackedSize, s_aUnpacked, sizeof(s_aUnpacked)), DeltaSize);
+		EXPECT_EQ(mem_comp(s_aUnpacked, s_aDelta, DeltaSize), 0);
+
+		EXPECT_EQ(Delta.UnpackDelta(pPrev, (CSnapshot *)s_aOut, s_aUnpacked, DeltaSize), SnapSize);
+		EXPECT_EQ(mem_comp(s_aOut, pCur, SnapSize), 0);
+
+		BitpackedSize += PackedSize;
+		VarintSize += CVariableInt::Compress(s_aDelta, DeltaSize, s_aVarint, sizeof(s_aVarint));
+		mem_copy(s_aPrev, s_aCur, SnapSize);
+	}
+	EXPECT_LT(BitpackedSize, VarintSize);
+}
+
+TEST(Snapshot, PackBitsFallback)
+{
+	CSnapshotDelta Delta;
+	Delta.SetStaticsize(1, 8*sizeof(int));
+	// widths far too small for the values, so every field takes the escape
+	const unsigned char aBits[] = {1, 1, 1, 1, 1, 1, 1, 1};
+	Delta.SetFieldBits(1, aBits, sizeof(aBits));
+
+	static char s_aEmpty[CSnapshot::MAX_SIZE], s_aCur[CSnapshot::MAX_SIZE], s_aDelta[CSnapshot::MAX_SIZE], s_aUnpacked[CSnapshot::MAX_SIZE];
+	static unsigned char s_aPacked[CSnapshot::MAX_SIZE];
+	CSnapshotBuilder Builder;
+	((CSnapshot *)s_aEmpty)->Clear();
+	// values a variable int stores in one byte
+	Builder.Init();
+	for(int i = 0; i < 64; i++)
+	{
+		int *pData = (int *)Builder.NewItem(1, i, 8*sizeof(int));
+		for(int f = 0; f < 8; f++)
+			pData[f] = 40+(i+f)%20;
+	}
+	Builder.Finish(s_aCur);
+	int DeltaSize = Delta.CreateDelta((CSnapshot *)s_aEmpty, (CSnapshot *)s_aCur, s_aDelta);
+	ASSERT_GT(DeltaSize, 0);
+	int FullSize = Delta.PackBits(s_aDelta, DeltaSize, s_aPacked, sizeof(s_aPacked));
+	ASSERT_GT(FullSize, 0);
+
+	// no room for the bits, but enough for the variable ints
+	int VarintSize = CVariableInt::Compress(s_aDelta, DeltaSize, s_aPacked, sizeof(s_aPacked));
+	ASSERT_GT(VarintSize, 0);
+	// Compress wants some slack at the end
+	const int DstSize = VarintSize+1+64;
+	ASSERT_LT(DstSize, FullSize);
+	int PackedSize = Delta.PackBits(s_aDelta, DeltaSize, s_aPacked, DstSize);
+	ASSERT_EQ(PackedSize, VarintSize+1);
+	EXPECT_EQ(s_aPacked[0], (unsigned char)CSnapshotDelta::PACKING_VARINT);
+	EXPECT_EQ(Delta.UnpackBits(s_aPacked, PackedSize, s_aUnpacked, sizeof(s_aUnpacked)), DeltaSize);
+	EXPECT_EQ(mem_comp(s_aUnpacked, s_aDelta, DeltaSize), 0);
+
+	// truncated input must fail instead of reading past it
+	for(int Size = 1; Size < FullSize; Size += 7)
+	{
+		Delta.PackBits(s_aDelta, DeltaSize, s_aPacked, sizeof(s_aPacked));
+		EXPECT_LE(Delta.UnpackBits(s_aPacked, Size, s_aUnpacked, sizeof(s_aUnpacked)), DeltaSize);
+	}
+	EXPECT_LT(Delta.PackBits(s_aDelta, DeltaSize, s_aPacked, 4), 0);
+}
+
+TEST(Snapshot, BuilderFindsItems)
+{
+	static char s_aSnap[CSnapshot::MAX_SIZE];
+	static CSnapshotBuilder s_Builder;
+	s_Builder.Init();
+	// added out of key order, so finishing moves them around
+	for(int i = CSnapshotBuilder::MAX_ITEMS-2; i >= 0; i--)
+	{
+		int *pData = (int *)s_Builder.NewItem(1+i%3, i, sizeof(int));
+		ASSERT_TRUE(pData);
+		pData[0] = i;
+	}
+	EXPECT_FALSE(s_Builder.GetItemData((4<<16)|5));
+	for(int i = 0; i < CSnapshotBuilder::MAX_ITEMS-1; i++)
+	{
+		int *pData = s_Builder.GetItemData(((1+i%3)<<16)|i);
+		ASSERT_TRUE(pData);
+		EXPECT_EQ(pData[0], i);
+	}
+
+	s_Builder.Finish(s_aSnap);
+	for(int i = 0; i < CSnapshotBuilder::MAX_ITEMS-1; i++)
+		EXPECT_EQ(s_Builder.GetItemData(((1+i%3)<<16)|i)[0], i);
+
+	s_Builder.Init((CSnapshot *)s_aSnap);
+	EXPECT_EQ(s_Builder.GetItemData((2<<16)|1)[0], 1);
+	s_Builder.Init();
+	EXPECT_FALSE(s_Builder.GetItemData((2<<16)|1));
+}
+
+static int BuildTestSnap(CSnapshotBuilder *pBuilder, void *pSnap, int Value)
+{
+	pBuilder->Init();
+	for(int i = 0; i < 8; i++)
+		((int *)pBuilder->NewItem(1, i, sizeof(int)))[0] = Value+i;
+	return pBuilder->Finish(pSnap);
+}
+
+TEST(Snapshot, PoolSharesIdenticalSnapshots)
+{
+	static char s_aSnap[CSnapshot::MAX_SIZE];
+	static CSnapshotBuilder s_Builder;
+	CSnapshotPool Pool;
+	CSnapshotStorage aStorages[3];
+	for(int i = 0; i < 3; i++)
+		aStorages[i].Init(&Pool);
+
+	int Size = BuildTestSnap(&s_Builder, s_aSnap, 10);
+	for(int i = 0; i < 3; i++)
+		aStorages[i].Add(1, 0, Size, s_aSnap, 0);
+	EXPECT_EQ(Pool.NumEntries(), 1);
+	EXPECT_EQ(aStorages[0].m_pLast->m_pSnap, aStorages[2].m_pLast->m_pSnap);
+
+	Size = BuildTestSnap(&s_Builder, s_aSnap, 20);
+	aStorages[0].Add(2, 0, Size, s_aSnap, 0);
+	EXPECT_EQ(Pool.NumEntries(), 2);
+
+	CSnapshot *pSnap;
+	const CSnapshotHash *pHash;
+	ASSERT_EQ(aStorages[0].Get(2, 0, &pSnap, 0, &pHash), Size);
+	EXPECT_EQ(mem_comp(pSnap, s_aSnap, Size), 0);
+	EXPECT_EQ(pSnap->GetItemIndex((1<<16)|3), pHash->Find((1<<16)|3));
+
+	aStorages[0].PurgeUntil(2);
+	aStorages[1].PurgeAll();
+	EXPECT_EQ(Pool.NumEntries(), 2);
+	aStorages[2].PurgeAll();
+	EXPECT_EQ(Pool.NumEntries(), 1);
+	aStorages[0].PurgeAll();
+	EXPECT_EQ(Pool.NumEntries(), 0);
+	EXPECT_EQ(Pool.AllocatedSize(), 0);
+}
+
+static void AddTestItem(CSnapshotBuilder *pBuilder, int Type, int ID, int Value)
+{
+	// the sizes differ so misplaced offsets show
+	int *pData = (int *)pBuilder->NewItem(Type, ID, (ID%3+1)*sizeof(int));
+	for(int i = 0; i <= ID%3; i++)
+		pData[i] = Value+i;
+}
+
+TEST(Snapshot, MergeKeepsKeysSorted)
+{
+	static char s_aFirst[CSnapshot::MAX_SIZE];
+	static char s_aSecond[CSnapshot::MAX_SIZE];
+	static char s_aMerged[CSnapshot::MAX_SIZE];
+	static char s_aExpected[CSnapshot::MAX_SIZE];
+	static CSnapshotBuilder s_Builder;
+
+	s_Builder.Init();
+	for(int i = 0; i < 5; i++)
+	{
+		AddTestItem(&s_Builder, 1, i, 100+i);
+		AddTestItem(&s_Builder, 3, i, 300+i);
+	}
+	int FirstSize = s_Builder.Finish(s_aFirst);
+
+	// (3, 0) is in both, the first one's stays
+	s_Builder.Init();
+	for(int i = 0; i < 3; i++)
+		AddTestItem(&s_Builder, 2, i, 200+i);
+	AddTestItem(&s_Builder, 3, 0, 999);
+	AddTestItem(&s_Builder, 4, 7, 400);
+	s_Builder.Finish(s_aSecond);
+
+	s_Builder.Init();
+	for(int i = 0; i < 5; i++)
+	{
+		AddTestItem(&s_Builder, 1, i, 100+i);
+		AddTestItem(&s_Builder, 3, i, 300+i);
+	}
+	for(int i = 0; i < 3; i++)
+		AddTestItem(&s_Builder, 2, i, 200+i);
+	AddTestItem(&s_Builder, 4, 7, 400);
+	int ExpectedSize = s_Builder.Finish(s_aExpected);
+
+	int Size = CSnapshot::Merge((CSnapshot *)s_aFirst, (CSnapshot *)s_aSecond, s_aMerged);
+	ASSERT_EQ(Size, ExpectedSize);
+	EXPECT_EQ(mem_comp(s_aMerged, s_aExpected, Size), 0);
+	const CSnapshot *pMerged = (CSnapshot *)s_aMerged;
+	EXPECT_EQ(pMerged->GetItem(pMerged->GetItemIndex(3<<16))->Data()[0], 300);
+
+	// nothing to merge in
+	s_Builder.Init();
+	s_Builder.Finish(s_aSecond);
+	ASSERT_EQ(CSnapshot::Merge((CSnapshot *)s_aFirst, (CSnapshot *)s_aSecond, s_aMerged), FirstSize);
+	EXPECT_EQ(mem_comp(s_aMerged, s_aFirst, FirstSize), 0);
+}
@@ -39,3 +39,50 @@ TEST(Storage, FindFile)
 	EXPECT_FALSE(pStorage->FindFile(Info.m_aFilename, ".", IStorage::TYPE_ALL, aFound, sizeof(aFound), &WrongSha256, 0x3bb935c6, 5));
 	EXPECT_FALSE(pStorage->FindFile(Info.m_aFilename, ".", IStorage::TYPE_ALL, aFound, sizeof(aFound), &SHA256_ZEROED, 0x3bb935c6, 5));
 }
+
+static int CountCallback(const char *pName, int IsDir, int Type, void *pUser)
+{
+	const char *pWanted = static_cast<const char *>(pUser);
+	if(!str_comp(pName, pWanted))
+		++*(int *)(pWanted+str_length(pWanted)+1);
+	return 0;
+}
+
+TEST(Storage, IndexedListing)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	pStorage->SetIndexed(true);
+
+	// the data is followed by the counter for the callback
+	char aWanted[128+sizeof(int)];
+	str_copy(aWanted, Info.m_aFilename, 128);
+	int *pCount = (int *)(aWanted+str_length(aWanted)+1);
+	*pCount = 0;
+	pStorage->ListDirectory(IStorage::TYPE_ALL, ".", CountCallback, aWanted);
+	EXPECT_EQ(*pCount, 0);
+
+	// writing through the storage updates the index
+	IOHANDLE File = pStorage->OpenFile(Info.m_aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	EXPECT_FALSE(io_close(File));
+	pStorage->ListDirectory(IStorage::TYPE_ALL, "", CountCallback, aWanted);
+	EXPECT_EQ(*pCount, 1);
+	File = pStorage->OpenFile(Info.m_aFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	ASSERT_TRUE(File);
+	EXPECT_FALSE(io_close(File));
+
+	// changes from outside are only seen after a rescan
+	char aPath[IO_MAX_PATH_LENGTH];
+	pStorage->GetCompletePath(IStorage::TYPE_SAVE, Info.m_aFilename, aPath, sizeof(aPath));
+	EXPECT_FALSE(fs_remove(aPath));
+	*pCount = 0;
+	pStorage->ListDirectory(IStorage::TYPE_ALL, ".", CountCallback, aWanted);
+	EXPECT_EQ(*pCount, 1);
+	pStorage->Rescan();
+	*pCount = 0;
+	pStorage->ListDirectory(IStorage::TYPE_ALL, ".", CountCallback, aWanted);
+	EXPECT_EQ(*pCount, 0);
+	EXPECT_FALSE(pStorage->OpenFile(Info.m_aFilename, IOFLAG_READ, IStorage::TYPE_ALL));
+	delete pStorage;
+}
@@ -2,6 +2,8 @@
 
 #include <base/system.h>
 
+#include <ctype.h>
+
 TEST(Str, Startswith)
 {
 	EXPECT_TRUE(str_startswith("abcdef", "abc"));
@@ -157,3 +159,166 @@ TEST(Str, Utf8Stats)
 	EXPECT_EQ(Size, 3);
 	EXPECT_EQ(Count, 3);
 }
+
+static char *AlignBlock(char *pStorage)
+{
+	return (char *)(((size_t)pStorage+15)&~(size_t)15);
+}
+
+// the byte by byte versions the block scans have to match
+static void RefSanitize(char *pStr, int Mode)
+{
+	for(unsigned char *p = (unsigned char *)pStr; *p; p++)
+	{
+		if(Mode == 2)
+		{
+			*p &= 0x7f;
+			if(*p < 32)
+				*p = 32;
+		}
+		else if(*p < 32 && (Mode == 1 || (*p != '\r' && *p != '\n' && *p != '\t')))
+			*p = ' ';
+	}
+}
+
+static int RefUtf8Check(const char *pStr)
+{
+	while(*pStr)
+	{
+		if((*pStr&0x80) == 0x0)
+			pStr++;
+		else if((*pStr&0xE0) == 0xC0 && (*(pStr+1)&0xC0) == 0x80)
+			pStr += 2;
+		else if((*pStr&0xF0) == 0xE0 && (*(pStr+1)&0xC0) == 0x80 && (*(pStr+2)&0xC0) == 0x80)
+			pStr += 3;
+		else if((*pStr&0xF8) == 0xF0 && (*(pStr+1)&0xC0) == 0x80 && (*(pStr+2)&0xC0) == 0x80 && (*(pStr+3)&0xC0) == 0x80)
+			pStr += 4;
+		else
+			return 0;
+	}
+	return 1;
+}
+
+static const char *RefFindNocase(const char *pHaystack, const char *pNeedle)
+{
+	for(; *pHaystack; pHaystack++)
+	{
+		const char *a = pHaystack;
+		const char *b = pNeedle;
+		while(*a && *b && tolower((unsigned char)*a) == tolower((unsigned char)*b))
+		{
+			a++;
+			b++;
+		}
+		if(!*b)
+			return pHaystack;
+	}
+	return 0;
+}
+
+// strings at every alignment and length around the block size, with each byte value at each position
+TEST(Str, SanitizeBlocks)
+{
+	static const int s_aOffsets[] = {0, 1, 7, 15};
+	char aStorage[64+32], aRefStorage[64+32];
+	char *aBuf = AlignBlock(aStorage), *aRef = AlignBlock(aRefStorage);
+	for(unsigned o = 0; o < sizeof(s_aOffsets)/sizeof(s_aOffsets[0]); o++)
+	{
+		char *pStr = aBuf+s_aOffsets[o];
+		char *pRef = aRef+s_aOffsets[o];
+		for(int Length = 1; Length <= 40; Length++)
+			for(int Pos = 0; Pos < Length; Pos++)
+				for(int Value = 1; Value < 256; Value++)
+				{
+					for(int i = 0; i < Length; i++)
+						pStr[i] = (char)('a'+i%26);
+					pStr[Pos] = (char)Value;
+					pStr[Length] = 0;
+					for(int Mode = 0; Mode < 3; Mode++)
+					{
+						mem_copy(pRef, pStr, Length+1);
+						char aSaved[64];
+						mem_copy(aSaved, pStr, Length+1);
+						if(Mode == 0)
+							str_sanitize(pStr);
+						else if(Mode == 1)
+							str_sanitize_cc(pStr);
+						else
+							str_sanitize_strong(pStr);
+						RefSanitize(pRef, Mode);
+						ASSERT_EQ(mem_comp(pStr, pRef, Length+1), 0) << "mode " << Mode << " length " << Length << " pos " << Pos << " value " << Value;
+						mem_copy(pStr, aSaved, Length+1);
+					}
+				}
+	}
+}
+
+TEST(Str, Utf8CheckBlocks)
+{
+	static const char *s_apSequences[] = {
+		"\xc3\xa4", "\xe6\x84\x9b", "\xf0\x9f\x98\x80", // valid
+		"\xc3", "\xe6\x84", "\xf0\x9f\x98", "\x80", "\xff", "\xc3\x41", "\xf8\x80\x80\x80\x80", // invalid
+	};
+	static const int s_aOffsets[] = {0, 1, 7, 15};
+	char aStorage[64+32];
+	char *aBuf = AlignBlock(aStorage);
+	for(unsigned o = 0; o < sizeof(s_aOffsets)/sizeof(s_aOffsets[0]); o++)
+	{
+		char *pStr = aBuf+s_aOffsets[o];
+		for(int Length = 1; Length <= 40; Length++)
+			for(int Pos = 0; Pos < Length; Pos++)
+			{
+				for(int Value = 1; Value < 256; Value++)
+				{
+					for(int i = 0; i < Length; i++)
+						pStr[i] = (char)('A'+i%26);
+					pStr[Pos] = (char)Value;
+					pStr[Length] = 0;
+					ASSERT_EQ(str_utf8_check(pStr), RefUtf8Check(pStr)) << "length " << Length << " pos " << Pos << " value " << Value;
+				}
+				for(unsigned s = 0; s < sizeof(s_apSequences)/sizeof(s_apSequences[0]); s++)
+				{
+					int SeqLength = str_length(s_apSequences[s]);
+					if(Pos+SeqLength > Length)
+						continue;
+					for(int i = 0; i < Length; i++)
+						pStr[i] = (char)('A'+i%26);
+					mem_copy(pStr+Pos, s_apSequences[s], SeqLength);
+					pStr[Length] = 0;
+					ASSERT_EQ(str_utf8_check(pStr), RefUtf8Check(pStr)) << "length " << Length << " pos " << Pos << " sequence " << s;
+				}
+			}
+	}
+	EXPECT_TRUE(str_utf8_check(""));
+	EXPECT_TRUE(str_utf8_check("abc愛любовь"));
+	EXPECT_FALSE(str_utf8_check("abcdefghijklmnopqrstuvwxyz\xe6\x84"));
+}
+
+TEST(Str, FindNocaseBlocks)
+{
+	static const char *s_apNeedles[] = {"", "a", "Z", "xyz", "XyZ", "[", "@", "\xc3\xa4", "name_2"};
+	char aStorage[64+32];
+	char *aBuf = AlignBlock(aStorage);
+	for(int Offset = 0; Offset < 16; Offset++)
+	{
+		char *pStr = aBuf+Offset;
+		for(int Length = 0; Length <= 40; Length++)
+			for(unsigned n = 0; n < sizeof(s_apNeedles)/sizeof(s_apNeedles[0]); n++)
+			{
+				const char *pNeedle = s_apNeedles[n];
+				int NeedleLength = str_length(pNeedle);
+				for(int Pos = -1; Pos+NeedleLength <= Length; Pos++)
+				{
+					for(int i = 0; i < Length; i++)
+						pStr[i] = "bcdefghijklmnop{"[i%16];
+					pStr[Length] = 0;
+					// the needle in alternating case, or nowhere
+					for(int i = 0; Pos >= 0 && i < NeedleLength; i++)
+						pStr[Pos+i] = i%2 ? (char)toupper((unsigned char)pNeedle[i]) : pNeedle[i];
+					ASSERT_EQ(str_find_nocase(pStr, pNeedle), RefFindNocase(pStr, pNeedle)) << "offset " << Offset << " length " << Length << " needle " << n << " pos " << Pos;
+				}
+			}
+	}
+	EXPECT_STREQ(str_find_nocase("Some Player Name", "pLaYeR"), "Player Name");
+	EXPECT_EQ(str_find_nocase("Some Player Name", "players"), (const char *)0);
+}
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/textsearch.h>
+
+TEST(TextSearch, MatchesLikeFindNocase)
+{
+	CSearchText<64> Text;
+	Text.Add("Hello World");
+	EXPECT_STREQ(Text.Text(), "hello world");
+
+	const char *apQueries[] = {"", "hello", "WORLD", "lo Wo", "o w", "worlds", "xyz", "dlrow"};
+	for(unsigned i = 0; i < sizeof(apQueries)/sizeof(apQueries[0]); i++)
+	{
+		CSearchQuery Query;
+		Query.Set(apQueries[i]);
+		EXPECT_EQ(Text.Find(Query), str_find_nocase("Hello World", apQueries[i]) != 0) << apQueries[i];
+	}
+}
+
+TEST(TextSearch, NoMatchAcrossStrings)
+{
+	CSearchText<64> Text;
+	Text.Add("nameless");
+	Text.Add("Tee");
+	Text.Add("");
+	Text.Add("Clan");
+
+	CSearchQuery Query;
+	Query.Set("tee");
+	EXPECT_TRUE(Text.Find(Query));
+	Query.Set("clan");
+	EXPECT_TRUE(Text.Find(Query));
+	Query.Set("sstee");
+	EXPECT_FALSE(Text.Find(Query));
+	Query.Set("teec");
+	EXPECT_FALSE(Text.Find(Query));
+}
+
+TEST(TextSearch, Truncate)
+{
+	CSearchText<8> Text;
+	Text.Add("abc");
+	Text.Add("defgh");
+	Text.Add("ijk");
+	EXPECT_STREQ(Text.Text(), "abc\ndef");
+
+	CSearchQuery Query;
+	Query.Set("def");
+	EXPECT_TRUE(Text.Find(Query));
+	Query.Set("ijk");
+	EXPECT_FALSE(Text.Find(Query));
+
+	Text.Clear();
+	EXPECT_FALSE(Text.Find(Query));
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <base/system.h>
+#include <base/tl/threading.h>
 
 static void Nothing(void *pUser)
 {
@@ -46,3 +47,191 @@ TEST(Thread, Lock)
 	lock_unlock(Lock);
 	thread_wait(pThread);
 }
+
+static void AddThread(void *pUser)
+{
+	volatile int *pValue = (volatile int *)pUser;
+	for(int i = 0; i < 100000; i++)
+		atomic_int_add(pValue, 1);
+}
+
+TEST(Thread, Atomics)
+{
+	volatile int Value = 0;
+	void *apThreads[4];
+	for(int i = 0; i < 4; i++)
+		apThreads[i] = thread_init(AddThread, (void *)&Value);
+	for(int i = 0; i < 4; i++)
+		thread_wait(apThreads[i]);
+	EXPECT_EQ(atomic_int_load(&Value), 400000);
+
+	EXPECT_EQ(atomic_int_compswap(&Value, 1, 5), 400000);
+	EXPECT_EQ(atomic_int_compswap(&Value, 400000, 5), 400000);
+	atomic_int_store(&Value, atomic_int_load(&Value)+1);
+	EXPECT_EQ(atomic_int_add(&Value, -6), 0);
+
+	int a, b;
+	void *volatile pPtr = &a;
+	EXPECT_TRUE(atomic_ptr_compswap(&pPtr, &b, 0) == &a);
+	EXPECT_TRUE(atomic_ptr_compswap(&pPtr, &a, &b) == &a);
+	EXPECT_TRUE(atomic_ptr_load(&pPtr) == &b);
+	atomic_ptr_store(&pPtr, 0);
+	EXPECT_TRUE(atomic_ptr_load(&pPtr) == 0);
+}
+
+enum
+{
+	QUEUE_ITEMS=200000,
+	QUEUE_THREADS=3,
+};
+
+typedef spsc_queue<unsigned, 64> CTestSpscQueue;
+typedef mpmc_queue<unsigned, 64> CTestMpmcQueue;
+
+static void SpscProducer(void *pUser)
+{
+	CTestSpscQueue *pQueue = (CTestSpscQueue *)pUser;
+	for(unsigned i = 0; i < QUEUE_ITEMS; i++)
+	{
+		unsigned *pItem;
+		while(!(pItem = pQueue->begin_push()))
+			thread_yield();
+		*pItem = i;
+		pQueue->end_push();
+	}
+}
+
+TEST(Thread, SpscQueue)
+{
+	static CTestSpscQueue s_Queue;
+	void *pThread = thread_init(SpscProducer, &s_Queue);
+	int NumWrong = 0;
+	for(unsigned i = 0; i < QUEUE_ITEMS; i++)
+	{
+		unsigned *pItem;
+		while(!(pItem = s_Queue.front()))
+			thread_yield();
+		NumWrong += *pItem != i;
+		s_Queue.pop();
+	}
+	thread_wait(pThread);
+	EXPECT_EQ(NumWrong, 0);
+	EXPECT_TRUE(s_Queue.empty());
+}
+
+TEST(Thread, MpmcQueueSingle)
+{
+	mpmc_queue<int, 4> Queue;
+	int Item = 0;
+	EXPECT_FALSE(Queue.pop(&Item));
+	for(int i = 0; i < 4; i++)
+		EXPECT_TRUE(Queue.push(i));
+	EXPECT_FALSE(Queue.push(4));
+	EXPECT_EQ(Queue.size(), 4u);
+	for(int Round = 0; Round < 10; Round++)
+	{
+		ASSERT_TRUE(Queue.pop(&Item));
+		EXPECT_EQ(Item, Round);
+		EXPECT_TRUE(Queue.push(Round+4));
+	}
+}
+
+struct CMpmcTest
+{
+	CTestMpmcQueue m_Queue;
+	volatile int m_Producer;
+	volatile int m_Consumed;
+	volatile int m_Sum;
+	volatile int m_NumWrong;
+};
+
+static void MpmcProducer(void *pUser)
+{
+	CMpmcTest *pTest = (CMpmcTest *)pUser;
+	unsigned Producer = atomic_int_add(&pTest->m_Producer, 1)-1;
+	for(unsigned i = 0; i < QUEUE_ITEMS; i++)
+	{
+		while(!pTest->m_Queue.push(Producer<<24 | i))
+			thread_yield();
+	}
+}
+
+static void MpmcConsumer(void *pUser)
+{
+	CMpmcTest *pTest = (CMpmcTest *)pUser;
+
+	// the items of one producer come out in the order they went in
+	int aLast[QUEUE_THREADS] = {-1, -1, -1};
+	unsigned Sum = 0;
+	int NumWrong = 0;
+	while(atomic_int_load(&pTest->m_Consumed) < QUEUE_ITEMS*QUEUE_THREADS)
+	{
+		unsigned Item;
+		if(!pTest->m_Queue.pop(&Item))
+		{
+			thread_yield();
+			continue;
+		}
+		int Producer = Item>>24;
+		int Index = Item&0xffffff;
+		NumWrong += Producer >= QUEUE_THREADS || Index <= aLast[Producer];
+		if(Producer < QUEUE_THREADS)
+			aLast[Producer] = Index;
+		Sum += Index;
+		atomic_int_add(&pTest->m_Consumed, 1);
+	}
+	atomic_int_add(&pTest->m_Sum, (int)Sum);
+	atomic_int_add(&pTest->m_NumWrong, NumWrong);
+}
+
+TEST(Thread, MpmcQueue)
+{
+	static CMpmcTest s_Test;
+	s_Test.m_Producer = 0;
+	s_Test.m_Consumed = 0;
+	s_Test.m_Sum = 0;
+	s_Test.m_NumWrong = 0;
+
+	void *apThreads[QUEUE_THREADS*2];
+	for(int i = 0; i < QUEUE_THREADS; i++)
+	{
+		apThreads[i*2] = thread_init(MpmcProducer, &s_Test);
+		apThreads[i*2+1] = thread_init(MpmcConsumer, &s_Test);
+	}
+	for(int i = 0; i < QUEUE_THREADS*2; i++)
+		thread_wait(apThreads[i]);
+
+	EXPECT_EQ(s_Test.m_Consumed, QUEUE_ITEMS*QUEUE_THREADS);
+	EXPECT_EQ(s_Test.m_NumWrong, 0);
+	// wraps around, but the same way for the expected value
+	unsigned Sum = 0;
+	for(unsigned i = 0; i < QUEUE_ITEMS; i++)
+		Sum += i*QUEUE_THREADS;
+	EXPECT_EQ((unsigned)s_Test.m_Sum, Sum);
+	EXPECT_EQ(s_Test.m_Queue.size(), 0u);
+}
+
+TEST(Thread, CpuList)
+{
+	unsigned char aCpus[8];
+	EXPECT_EQ(cpu_list_parse("", aCpus, 8), 0);
+	EXPECT_EQ(cpu_list_parse("0-2,5,2", aCpus, 8), 4);
+	EXPECT_EQ(aCpus[0] + aCpus[1] + aCpus[2] + aCpus[5], 4);
+	EXPECT_EQ(aCpus[3] + aCpus[4] + aCpus[6] + aCpus[7], 0);
+	EXPECT_EQ(cpu_list_parse("8", aCpus, 8), -1);
+	EXPECT_EQ(cpu_list_parse("3-1", aCpus, 8), -1);
+	EXPECT_EQ(cpu_list_parse("1,,2", aCpus, 8), -1);
+	EXPECT_EQ(cpu_list_parse("a", aCpus, 8), -1);
+}
+
+#if defined(CONF_PLATFORM_LINUX)
+TEST(Thread, Affinity)
+{
+	thread_set_name("test affinity");
+	int ID = thread_current_id();
+	EXPECT_EQ(thread_set_affinity(ID, "0"), 0);
+	EXPECT_EQ(thread_set_affinity(ID, "x"), -1);
+	EXPECT_EQ(thread_set_affinity(ID, ""), 0);
+	EXPECT_EQ(thread_set_priority(ID, 0), 0);
+}
+#endif
@@ -0,0 +1,26 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+
+TEST(Time, Monotonic)
+{
+	int64 Last = time_get();
+	for(int i = 0; i < 100000; i++)
+	{
+		int64 Now = time_get();
+		ASSERT_GE(Now, Last);
+		Last = Now;
+	}
+}
+
+TEST(Time, CoarseFollowsPrecise)
+{
+	// the coarse timer may lag behind by a few milliseconds, but never runs ahead
+	int64 Coarse = time_get_coarse();
+	int64 Precise = time_get();
+	EXPECT_LE(Coarse, Precise);
+	EXPECT_LT(Precise-Coarse, time_freq()/10);
+
+	thread_sleep(20);
+	EXPECT_GT(time_get_coarse(), Coarse);
+}
@@ -0,0 +1,83 @@
+#include "test.h"
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/tracer.h>
+
+static void TraceThread(void *pUser)
+{
+	CTracer::SetThreadName("test worker");
+	for(int i = 0; i < 10; i++)
+	{
+		CTraceScope Scope("WorkerScope");
+	}
+}
+
+TEST(Tracer, WritesEvents)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".json");
+
+	// not recorded
+	CTracer::Begin("Ignored");
+	CTracer::End("Ignored");
+
+	CTracer::Start();
+	EXPECT_TRUE(CTracer::IsRecording());
+	{
+		CTraceScope Scope("MainScope");
+		void *pThread = thread_init(TraceThread, 0);
+		thread_wait(pThread);
+		thread_destroy(pThread);
+	}
+	EXPECT_TRUE(CTracer::Stop(io_open(aFilename, IOFLAG_WRITE)));
+	EXPECT_FALSE(CTracer::IsRecording());
+
+	char *pOutput = fs_read_str(aFilename);
+	ASSERT_TRUE(pOutput);
+	EXPECT_TRUE(str_find(pOutput, "\"traceEvents\""));
+	EXPECT_TRUE(str_find(pOutput, "\"MainScope\""));
+	EXPECT_TRUE(str_find(pOutput, "\"WorkerScope\""));
+	EXPECT_TRUE(str_find(pOutput, "\"test worker\""));
+	EXPECT_FALSE(str_find(pOutput, "\"Ignored\""));
+
+	// ten scopes on the worker, one on the test thread
+	int NumBegin = 0;
+	for(const char *p = pOutput; (p = str_find(p, "\"B\"")); p++)
+		NumBegin++;
+	EXPECT_EQ(NumBegin, 11);
+	mem_free(pOutput);
+	fs_remove(aFilename);
+}
+
+TEST(Tracer, Tracks)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".json");
+
+	CTracer::Start();
+	CTracer::CThreadBuffer *pTrack = CTracer::Track("test track");
+	ASSERT_TRUE(pTrack);
+	// events with times of the past, added by a thread that has its own buffer
+	int64 Now = time_get();
+	CTracer::BeginAt(pTrack, "TrackFrame", Now-time_freq()/100);
+	CTracer::BeginAt(pTrack, "TrackGroup", Now-time_freq()/200);
+	CTracer::EndAt(pTrack, "TrackGroup", Now-time_freq()/400);
+	CTracer::EndAt(pTrack, "TrackFrame", Now);
+	{
+		CTraceScope Scope("ThreadScope");
+	}
+	EXPECT_TRUE(CTracer::Stop(io_open(aFilename, IOFLAG_WRITE)));
+	EXPECT_EQ(pTrack->m_NumEvents, 4);
+
+	char *pOutput = fs_read_str(aFilename);
+	ASSERT_TRUE(pOutput);
+	EXPECT_TRUE(str_find(pOutput, "\"test track\""));
+	EXPECT_TRUE(str_find(pOutput, "\"TrackFrame\""));
+	EXPECT_TRUE(str_find(pOutput, "\"TrackGroup\""));
+	EXPECT_TRUE(str_find(pOutput, "\"ThreadScope\""));
+	mem_free(pOutput);
+	fs_remove(aFilename);
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+
+static NETSOCKET BindLocal(NETADDR *pAddr)
+{
+	net_addr_from_str(pAddr, "127.0.0.1");
+	for(int Port = 27950; Port < 28000; Port++)
+	{
+		pAddr->port = Port;
+		NETSOCKET Socket = net_udp_create(*pAddr, 0);
+		if(Socket.type)
+			return Socket;
+	}
+	NETSOCKET Invalid = {NETTYPE_INVALID, -1, -1};
+	return Invalid;
+}
+
+static void SendAndReceive(NETSOCKET Sender, const NETADDR *pSenderAddr, NETSOCKET Receiver, const NETADDR *pReceiverAddr, int Burst)
+{
+	static char s_aaData[16][64];
+	NETDATAGRAM aDatagrams[16];
+	for(int i = 0; i < 16; i++)
+		aDatagrams[i].data = s_aaData[i];
+
+	// the bursts have to fit into the socket buffer
+	const int Num = 600;
+	int Sent = 0;
+	int Received = 0;
+	int64 Deadline = time_get()+time_freq()*5;
+	while(Received < Num && time_get() < Deadline)
+	{
+		for(; Sent < Received+Burst && Sent < Num; Sent++)
+		{
+			char aBuf[64];
+			str_format(aBuf, sizeof(aBuf), "datagram %d", Sent);
+			ASSERT_GE(net_udp_send(Sender, pReceiverAddr, aBuf, str_length(aBuf)+1), 0);
+		}
+		if(!net_socket_read_wait_us(Receiver, 100000))
+			continue;
+		int n = net_udp_recv_batch(Receiver, aDatagrams, 16, sizeof(s_aaData[0]));
+		for(int i = 0; i < n; i++)
+		{
+			char aExpected[64];
+			str_format(aExpected, sizeof(aExpected), "datagram %d", Received);
+			EXPECT_EQ(aDatagrams[i].size, str_length(aExpected)+1);
+			EXPECT_STREQ((const char *)aDatagrams[i].data, aExpected);
+			EXPECT_EQ(net_addr_comp(&aDatagrams[i].addr, pSenderAddr, true), 0);
+			Received++;
+		}
+	}
+	EXPECT_EQ(Received, Num);
+
+	// too long ones are cut like by recvmmsg
+	ASSERT_GE(net_udp_send(Sender, pReceiverAddr, "a longer datagram", 18), 0);
+	ASSERT_TRUE(net_socket_read_wait_us(Receiver, 1000000));
+	char aSmall[8];
+	NETADDR Addr;
+	int Size = -1;
+	for(int Tries = 0; Tries < 100 && Size < 0; Tries++)
+		Size = net_udp_recv(Receiver, &Addr, aSmall, sizeof(aSmall));
+	EXPECT_EQ(Size, (int)sizeof(aSmall));
+	EXPECT_EQ(mem_comp(aSmall, "a longer", sizeof(aSmall)), 0);
+	EXPECT_FALSE(net_socket_read_wait_us(Receiver, 0));
+}
+
+TEST(Udp, Receive)
+{
+	NETADDR ReceiverAddr, SenderAddr;
+	NETSOCKET Receiver = BindLocal(&ReceiverAddr);
+	ASSERT_TRUE(Receiver.type);
+	NETSOCKET Sender = BindLocal(&SenderAddr);
+	ASSERT_TRUE(Sender.type);
+	SendAndReceive(Sender, &SenderAddr, Receiver, &ReceiverAddr, 50);
+	net_udp_close(Sender);
+	net_udp_close(Receiver);
+}
+
+TEST(Udp, ReceiveUring)
+{
+	NETADDR ReceiverAddr, SenderAddr;
+	NETSOCKET Receiver = BindLocal(&ReceiverAddr);
+	ASSERT_TRUE(Receiver.type);
+	NETSOCKET Sender = BindLocal(&SenderAddr);
+	ASSERT_TRUE(Sender.type);
+
+	// without support the regular path is tested again. with it, bursts larger than
+	// the ring has buffers make its receive stop and get armed again
+	int Burst = 50;
+	if(net_udp_uring_enable(Receiver) == 0)
+		Burst = 300;
+	else
+		dbg_msg("test", "io_uring isn't available");
+	SendAndReceive(Sender, &SenderAddr, Receiver, &ReceiverAddr, Burst);
+	net_udp_close(Sender);
+	net_udp_close(Receiver);
+}
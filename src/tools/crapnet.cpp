@@ -1,204 +1,568 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <math.h>
+#include <stdlib.h>
+
 #include <base/math.h>
 #include <base/system.h>
 
+#include <engine/shared/jsonwriter.h>
+#include <engine/shared/linereader.h>
+
+/*
+	UDP proxy that makes the network worse in controlled ways. Every
+	client address gets its own flow with its own socket towards the
+	server, so several clients can share one crapnet. The conditions
+	come from a cycle of profiles, read from a file with one profile
+	per line:
+
+		name=wifi duration=30 latency=30 jitter=15 jitter_dist=normal burst_enter=2 burst_exit=25 burst_loss=60
+
+	latency, jitter, spike, reorder_delay and queue are in milliseconds,
+	loss, burst_*, reorder and corrupt in percent, bandwidth in kbit/s.
+	Profiles apply to both directions.
+
+	usage: crapnet [-p port] [-c profiles] [-j stats.json] [-i stats interval] [-l] [server address]
+*/
+
+enum
+{
+	JITTER_UNIFORM=0,
+	JITTER_NORMAL,
+	JITTER_PARETO,
+
+	DIR_TO_SERVER=0,
+	DIR_TO_CLIENT,
+	NUM_DIRS,
+
+	MAX_PROFILES=32,
+	MAX_FLOWS=64,
+	FLOW_TIMEOUT=30,
+};
+
+struct CProfile
+{
+	char m_aName[32];
+	int m_Duration;
+	int m_Latency;
+	int m_Jitter;
+	int m_JitterDist;
+	int m_Spike; // added to every 100th packet
+	int m_Loss;
+	int m_BurstEnter; // gilbert-elliott loss, chance to switch into and out of the bad state
+	int m_BurstExit;
+	int m_BurstLoss;
+	int m_Bandwidth;
+	int m_Queue; // how long packets may wait for the bandwidth before they are dropped
+	int m_Reorder;
+	int m_ReorderDelay;
+	int m_Corrupt;
+};
 
 struct CPacket
 {
 	CPacket *m_pPrev;
 	CPacket *m_pNext;
 
-	NETADDR m_SendTo;
-	int64 m_Timestamp;
+	int m_Flow;
+	int m_Dir;
+	int64 m_Received;
+	int64 m_SendTime;
 	int m_ID;
 	int m_DataSize;
 	char m_aData[1];
 };
 
-static CPacket *m_pFirst = (CPacket *)0;
-static CPacket *m_pLast = (CPacket *)0;
-static int m_CurrentLatency = 0;
-
-struct CPingConfig
+struct CLink
 {
-	int m_Base;
-	int m_Flux;
-	int m_Spike;
-	int m_Loss;
-	int m_Delay;
-	int m_DelayFreq;
+	// state
+	int64 m_LinkFree;
+	int64 m_LastSendTime;
+	bool m_Bad;
+
+	// statistics
+	int m_Packets;
+	int64 m_Bytes;
+	int m_Sent;
+	int m_DroppedLoss;
+	int m_DroppedQueue;
+	int m_Reordered;
+	int m_Corrupted;
+	int64 m_DelaySum;
+	int64 m_DelayMax;
 };
 
-static CPingConfig m_aConfigPings[] = {
-//		base	flux	spike	loss	delay	delayfreq
-		{0,		0,		0,		0,		0,		0},
-		{40,	20,		100,		0,		0,		0},
-		{140,	40,		200,		0,		0,		0},
+struct CFlow
+{
+	bool m_Used;
+	int m_ID;
+	NETADDR m_ClientAddr;
+	NETSOCKET m_Socket;
+	int64 m_Created;
+	int64 m_LastActive;
+	CLink m_aLinks[NUM_DIRS];
 };
 
-static int m_ConfigNumpingconfs = sizeof(m_aConfigPings)/sizeof(CPingConfig);
-static int m_ConfigInterval = 10; // seconds between different pingconfigs
+static CPacket *m_pFirst = (CPacket *)0;
+static CPacket *m_pLast = (CPacket *)0;
+
+static CProfile m_aProfiles[MAX_PROFILES];
+static int m_NumProfiles = 0;
+static int m_CycleLength = 0;
+
+static CFlow m_aFlows[MAX_FLOWS];
+static int m_NextFlowID = 0;
+
 static int m_ConfigLog = 0;
-static int m_ConfigReorder = 0;
+static int m_ConfigStatsInterval = 5;
+static const char *m_pConfigStatsFile = 0;
 
-void Run(unsigned short Port, NETADDR Dest)
+static void SetDefaultProfiles()
 {
-	NETADDR Src = {NETTYPE_IPV4, {0,0,0,0}, Port};
-	NETSOCKET Socket = net_udp_create(Src, 0);
+	// the old built in cycle, clean followed by two laggy ones with spikes
+	static const CProfile s_aDefaults[] = {
+		{"clean",	10,	0,		0,		JITTER_UNIFORM,	0,		0, 0, 0, 0, 0, 0, 0, 0, 0},
+		{"flux",	10,	40,		20,		JITTER_UNIFORM,	100,	0, 0, 0, 0, 0, 0, 0, 0, 0},
+		{"far",		10,	140,	40,		JITTER_UNIFORM,	200,	0, 0, 0, 0, 0, 0, 0, 0, 0},
+	};
+	m_NumProfiles = sizeof(s_aDefaults)/sizeof(s_aDefaults[0]);
+	mem_copy(m_aProfiles, s_aDefaults, sizeof(s_aDefaults));
+}
 
-	char aBuffer[1024*2];
-	int ID = 0;
-	int Delaycounter = 0;
+static bool ParseProfile(char *pLine, CProfile *pProfile)
+{
+	mem_zero(pProfile, sizeof(*pProfile));
+	str_copy(pProfile->m_aName, "unnamed", sizeof(pProfile->m_aName));
+	pProfile->m_Duration = 10;
+	pProfile->m_Queue = 200;
 
-	while(1)
+	while(*(pLine = str_skip_whitespaces(pLine)))
 	{
-		static int Lastcfg = 0;
-		int n = ((time_get()/time_freq())/m_ConfigInterval) % m_ConfigNumpingconfs;
-		CPingConfig Ping = m_aConfigPings[n];
+		// key=value, separated by whitespace
+		char *pToken = pLine;
+		pLine = str_skip_to_whitespace(pLine);
+		if(*pLine)
+			*pLine++ = 0;
+		char *pValue = (char *)str_find(pToken, "=");
+		if(!pValue)
+			return false;
+		*pValue++ = 0;
+
+		static const struct { const char *m_pKey; int CProfile::*m_pMember; } s_aKeys[] = {
+			{"duration", &CProfile::m_Duration}, {"latency", &CProfile::m_Latency}, {"jitter", &CProfile::m_Jitter},
+			{"spike", &CProfile::m_Spike}, {"loss", &CProfile::m_Loss}, {"burst_enter", &CProfile::m_BurstEnter},
+			{"burst_exit", &CProfile::m_BurstExit}, {"burst_loss", &CProfile::m_BurstLoss}, {"bandwidth", &CProfile::m_Bandwidth},
+			{"queue", &CProfile::m_Queue}, {"reorder", &CProfile::m_Reorder}, {"reorder_delay", &CProfile::m_ReorderDelay},
+			{"corrupt", &CProfile::m_Corrupt},
+		};
+
+		bool Found = false;
+		if(str_comp(pToken, "name") == 0)
+		{
+			str_copy(pProfile->m_aName, pValue, sizeof(pProfile->m_aName));
+			Found = true;
+		}
+		else if(str_comp(pToken, "jitter_dist") == 0)
+		{
+			if(str_comp(pValue, "uniform") == 0)
+				pProfile->m_JitterDist = JITTER_UNIFORM;
+			else if(str_comp(pValue, "normal") == 0)
+				pProfile->m_JitterDist = JITTER_NORMAL;
+			else if(str_comp(pValue, "pareto") == 0)
+				pProfile->m_JitterDist = JITTER_PARETO;
+			else
+				return false;
+			Found = true;
+		}
+		for(unsigned i = 0; !Found && i < sizeof(s_aKeys)/sizeof(s_aKeys[0]); i++)
+		{
+			if(str_comp(pToken, s_aKeys[i].m_pKey) == 0)
+			{
+				pProfile->*s_aKeys[i].m_pMember = max(0, str_toint(pValue));
+				Found = true;
+			}
+		}
+		if(!Found)
+			return false;
+	}
 
-		if(n != Lastcfg)
-			dbg_msg("crapnet", "cfg = %d", n);
-		Lastcfg = n;
+	pProfile->m_Duration = max(1, pProfile->m_Duration);
+	if(!pProfile->m_ReorderDelay)
+		pProfile->m_ReorderDelay = max(10, pProfile->m_Jitter);
+	return true;
+}
 
-		// handle incomming packets
-		while(1)
+static bool LoadProfiles(const char *pFilename)
+{
+	IOHANDLE File = io_open(pFilename, IOFLAG_READ);
+	if(!File)
+	{
+		dbg_msg("crapnet", "failed to open '%s'", pFilename);
+		return false;
+	}
+
+	CLineReader LineReader;
+	LineReader.Init(File);
+	m_NumProfiles = 0;
+	int LineNum = 0;
+	char *pLine;
+	while((pLine = LineReader.Get()) && m_NumProfiles < MAX_PROFILES)
+	{
+		LineNum++;
+		pLine = str_skip_whitespaces(pLine);
+		if(!pLine[0] || pLine[0] == '#')
+			continue;
+		if(!ParseProfile(pLine, &m_aProfiles[m_NumProfiles]))
 		{
-			// fetch data
-			int DataTrash = 0;
-			NETADDR From;
-			int Bytes = net_udp_recv(Socket, &From, aBuffer, 1024*2);
-			if(Bytes <= 0)
-				break;
+			dbg_msg("crapnet", "%s:%d: invalid profile", pFilename, LineNum);
+			io_close(File);
+			return false;
+		}
+		m_NumProfiles++;
+	}
+	io_close(File);
+	return m_NumProfiles > 0;
+}
 
-			if((random_int()%100) < Ping.m_Loss) // drop the packet
-			{
-				if(m_ConfigLog)
-					dbg_msg("crapnet", "dropped packet");
-				continue;
-			}
+static const CProfile *CurrentProfile(int64 Start)
+{
+	int Pos = (int)(((time_get()-Start)/time_freq()) % m_CycleLength);
+	for(int i = 0; i < m_NumProfiles; i++)
+	{
+		if(Pos < m_aProfiles[i].m_Duration)
+			return &m_aProfiles[i];
+		Pos -= m_aProfiles[i].m_Duration;
+	}
+	return &m_aProfiles[0];
+}
 
-			// create new packet
-			CPacket *p = (CPacket *)mem_alloc(sizeof(CPacket)+Bytes, 1);
+static int Percent(int Chance)
+{
+	return Chance > 0 && (random_int()%100) < Chance;
+}
 
-			if(net_addr_comp(&From, &Dest, true) == 0)
-				p->m_SendTo = Src; // from the server
-			else
-			{
-				Src = From; // from the client
-				p->m_SendTo = Dest;
-			}
+static int64 JitterDelay(const CProfile *pProfile)
+{
+	if(!pProfile->m_Jitter)
+		return 0;
 
-			// queue packet
-			p->m_pPrev = m_pLast;
-			p->m_pNext = 0;
-			if(m_pLast)
-				m_pLast->m_pNext = p;
-			else
-			{
-				m_pFirst = p;
-				m_pLast = p;
-			}
-			m_pLast = p;
+	double Ms;
+	if(pProfile->m_JitterDist == JITTER_NORMAL)
+	{
+		// box-muller, the jitter is the standard deviation
+		double U1 = max(random_float(), 1e-6f);
+		double U2 = random_float();
+		Ms = fabs(sqrt(-2.0*log(U1))*cos(2*pi*U2))*pProfile->m_Jitter;
+	}
+	else if(pProfile->m_JitterDist == JITTER_PARETO)
+	{
+		// mostly small, sometimes very late, capped at ten times the jitter
+		double U = max(random_float(), 1e-6f);
+		Ms = min((pow(U, -1.0/1.5)-1.0)*pProfile->m_Jitter/2, pProfile->m_Jitter*10.0);
+	}
+	else
+		Ms = random_float()*pProfile->m_Jitter;
+	return (int64)(Ms*time_freq()/1000);
+}
 
-			// set data in packet
-			p->m_Timestamp = time_get();
-			p->m_DataSize = Bytes;
-			p->m_ID = ID++;
-			mem_copy(p->m_aData, aBuffer, Bytes);
+static int FindFlow(const NETADDR *pClientAddr, int64 Now)
+{
+	int Free = -1;
+	for(int i = 0; i < MAX_FLOWS; i++)
+	{
+		if(!m_aFlows[i].m_Used)
+		{
+			if(Free < 0)
+				Free = i;
+			continue;
+		}
+		if(net_addr_comp(&m_aFlows[i].m_ClientAddr, pClientAddr, true) == 0)
+			return i;
+	}
+	if(Free < 0)
+		return -1;
+
+	NETADDR BindAddr;
+	mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = NETTYPE_ALL;
+	CFlow *pFlow = &m_aFlows[Free];
+	mem_zero(pFlow, sizeof(*pFlow));
+	pFlow->m_Socket = net_udp_create(BindAddr, 1);
+	if(!pFlow->m_Socket.type)
+		return -1;
+	pFlow->m_Used = true;
+	pFlow->m_ID = m_NextFlowID++;
+	pFlow->m_ClientAddr = *pClientAddr;
+	pFlow->m_Created = Now;
+	pFlow->m_LastActive = Now;
+
+	char aAddrStr[NETADDR_MAXSTRSIZE];
+	net_addr_str(pClientAddr, aAddrStr, sizeof(aAddrStr), true);
+	dbg_msg("crapnet", "flow %d: new client %s", pFlow->m_ID, aAddrStr);
+	return Free;
+}
 
-			if(ID > 20 && Bytes > 6 && DataTrash)
-			{
-				p->m_aData[6+(random_int()%(Bytes-6))] = random_int()&255; // modify a byte
-				if((random_int()%10) == 0)
-				{
-					p->m_DataSize -= random_int()%32;
-					if(p->m_DataSize < 6)
-						p->m_DataSize = 6;
-				}
-			}
+static void QueuePacket(int Flow, int Dir, const char *pData, int Bytes, const CProfile *pProfile, int64 Now)
+{
+	static int s_ID = 0;
+	CLink *pLink = &m_aFlows[Flow].m_aLinks[Dir];
+	pLink->m_Packets++;
+	pLink->m_Bytes += Bytes;
+	int ID = s_ID++;
+
+	// loss, bursty while the link is in the bad state
+	if(pLink->m_Bad ? Percent(pProfile->m_BurstExit) : Percent(pProfile->m_BurstEnter))
+		pLink->m_Bad = !pLink->m_Bad;
+	if(Percent(pLink->m_Bad ? pProfile->m_BurstLoss : pProfile->m_Loss))
+	{
+		pLink->m_DroppedLoss++;
+		if(m_ConfigLog)
+			dbg_msg("crapnet", "flow %d: dropped %08d", m_aFlows[Flow].m_ID, ID);
+		return;
+	}
 
-			if(Delaycounter <= 0)
-			{
-				if(Ping.m_Delay)
-					p->m_Timestamp += (time_freq()*1000)/Ping.m_Delay;
-				Delaycounter = Ping.m_DelayFreq;
-			}
-			Delaycounter--;
+	// bandwidth cap, packets wait for the link and are dropped once the queue is full
+	int64 SendTime = Now;
+	if(pProfile->m_Bandwidth)
+	{
+		int64 Start = max(Now, pLink->m_LinkFree);
+		if(Start-Now > (int64)pProfile->m_Queue*time_freq()/1000)
+		{
+			pLink->m_DroppedQueue++;
+			return;
+		}
+		pLink->m_LinkFree = Start + (int64)Bytes*8*time_freq()/((int64)pProfile->m_Bandwidth*1000);
+		SendTime = pLink->m_LinkFree;
+	}
+
+	SendTime += (int64)pProfile->m_Latency*time_freq()/1000 + JitterDelay(pProfile);
+	if(pProfile->m_Spike && (ID%100) == 0)
+		SendTime += (int64)pProfile->m_Spike*time_freq()/1000;
+
+	// jitter alone keeps the order, reordered packets are held back so later ones overtake them
+	if(Percent(pProfile->m_Reorder))
+	{
+		SendTime = max(SendTime, pLink->m_LastSendTime) + (int64)pProfile->m_ReorderDelay*time_freq()/1000;
+		pLink->m_Reordered++;
+	}
+	else
+	{
+		SendTime = max(SendTime, pLink->m_LastSendTime);
+		pLink->m_LastSendTime = SendTime;
+	}
+
+	CPacket *p = (CPacket *)mem_alloc(sizeof(CPacket)+Bytes, 1);
+	p->m_Flow = Flow;
+	p->m_Dir = Dir;
+	p->m_Received = Now;
+	p->m_SendTime = SendTime;
+	p->m_ID = ID;
+	p->m_DataSize = Bytes;
+	mem_copy(p->m_aData, pData, Bytes);
+
+	if(Bytes > 6 && Percent(pProfile->m_Corrupt))
+	{
+		p->m_aData[6+(random_int()%(Bytes-6))] = random_int()&255; // modify a byte
+		pLink->m_Corrupted++;
+	}
+
+	p->m_pPrev = m_pLast;
+	p->m_pNext = 0;
+	if(m_pLast)
+		m_pLast->m_pNext = p;
+	else
+		m_pFirst = p;
+	m_pLast = p;
+
+	if(m_ConfigLog)
+		dbg_msg("crapnet", "flow %d: << %08d %s (%d)", m_aFlows[Flow].m_ID, ID, Dir == DIR_TO_SERVER ? "client" : "server", Bytes);
+}
+
+static void SendPackets(NETSOCKET ListenSocket, const NETADDR *pDest, int64 Now)
+{
+	CPacket *pNext = m_pFirst;
+	while(pNext)
+	{
+		CPacket *p = pNext;
+		pNext = p->m_pNext;
+		if(p->m_SendTime > Now)
+			continue;
+
+		if(p->m_pNext)
+			p->m_pNext->m_pPrev = p->m_pPrev;
+		else
+			m_pLast = p->m_pPrev;
+		if(p->m_pPrev)
+			p->m_pPrev->m_pNext = p->m_pNext;
+		else
+			m_pFirst = p->m_pNext;
+
+		CFlow *pFlow = &m_aFlows[p->m_Flow];
+		if(pFlow->m_Used)
+		{
+			if(p->m_Dir == DIR_TO_SERVER)
+				net_udp_send(pFlow->m_Socket, pDest, p->m_aData, p->m_DataSize);
+			else
+				net_udp_send(ListenSocket, &pFlow->m_ClientAddr, p->m_aData, p->m_DataSize);
+
+			CLink *pLink = &pFlow->m_aLinks[p->m_Dir];
+			int64 Delay = Now-p->m_Received;
+			pLink->m_Sent++;
+			pLink->m_DelaySum += Delay;
+			pLink->m_DelayMax = max(pLink->m_DelayMax, Delay);
 
 			if(m_ConfigLog)
-			{
-				char aAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&From, aAddrStr, sizeof(aAddrStr), true);
-				dbg_msg("crapnet", "<< %08d %s (%d)", p->m_ID, aAddrStr, p->m_DataSize);
-			}
+				dbg_msg("crapnet", "flow %d: >> %08d %s (%d)", pFlow->m_ID, p->m_ID, p->m_Dir == DIR_TO_SERVER ? "server" : "client", p->m_DataSize);
 		}
+		mem_free(p);
+	}
+}
 
-		//
-		/*while(1)
-		{*/
-		CPacket *p = 0;
-		CPacket *pNext = m_pFirst;
+static void WriteLinkStats(CJsonWriter *pWriter, const CLink *pLink)
+{
+	pWriter->BeginObject();
+	pWriter->WriteAttribute("packets");
+	pWriter->WriteIntValue(pLink->m_Packets);
+	pWriter->WriteAttribute("kbytes");
+	pWriter->WriteIntValue((int)(pLink->m_Bytes/1024));
+	pWriter->WriteAttribute("sent");
+	pWriter->WriteIntValue(pLink->m_Sent);
+	pWriter->WriteAttribute("dropped_loss");
+	pWriter->WriteIntValue(pLink->m_DroppedLoss);
+	pWriter->WriteAttribute("dropped_queue");
+	pWriter->WriteIntValue(pLink->m_DroppedQueue);
+	pWriter->WriteAttribute("reordered");
+	pWriter->WriteIntValue(pLink->m_Reordered);
+	pWriter->WriteAttribute("corrupted");
+	pWriter->WriteIntValue(pLink->m_Corrupted);
+	pWriter->WriteAttribute("avg_delay_us");
+	pWriter->WriteIntValue(pLink->m_Sent ? (int)(pLink->m_DelaySum*1000000/time_freq()/pLink->m_Sent) : 0);
+	pWriter->WriteAttribute("max_delay_us");
+	pWriter->WriteIntValue((int)(pLink->m_DelayMax*1000000/time_freq()));
+	pWriter->EndObject();
+}
+
+static void WriteStats(const CProfile *pProfile, int64 Start, int64 Now)
+{
+	// write to a temporary file so readers never see half of it
+	char aTmpFile[IO_MAX_PATH_LENGTH];
+	str_format(aTmpFile, sizeof(aTmpFile), "%s.tmp", m_pConfigStatsFile);
+	IOHANDLE File = io_open(aTmpFile, IOFLAG_WRITE);
+	if(!File)
+	{
+		dbg_msg("crapnet", "failed to write '%s'", aTmpFile);
+		return;
+	}
+
+	{
+		CJsonWriter Writer(File);
+		Writer.BeginObject();
+		Writer.WriteAttribute("uptime");
+		Writer.WriteIntValue((int)((Now-Start)/time_freq()));
+		Writer.WriteAttribute("profile");
+		Writer.WriteStrValue(pProfile->m_aName);
+		Writer.WriteAttribute("flows");
+		Writer.BeginArray();
+		for(int i = 0; i < MAX_FLOWS; i++)
+		{
+			const CFlow *pFlow = &m_aFlows[i];
+			if(!pFlow->m_Used)
+				continue;
+			char aAddrStr[NETADDR_MAXSTRSIZE];
+			net_addr_str(&pFlow->m_ClientAddr, aAddrStr, sizeof(aAddrStr), true);
+			Writer.BeginObject();
+			Writer.WriteAttribute("id");
+			Writer.WriteIntValue(pFlow->m_ID);
+			Writer.WriteAttribute("client");
+			Writer.WriteStrValue(aAddrStr);
+			Writer.WriteAttribute("age");
+			Writer.WriteIntValue((int)((Now-pFlow->m_Created)/time_freq()));
+			Writer.WriteAttribute("to_server");
+			WriteLinkStats(&Writer, &pFlow->m_aLinks[DIR_TO_SERVER]);
+			Writer.WriteAttribute("to_client");
+			WriteLinkStats(&Writer, &pFlow->m_aLinks[DIR_TO_CLIENT]);
+			Writer.EndObject();
+		}
+		Writer.EndArray();
+		Writer.EndObject();
+	}
+	fs_remove(m_pConfigStatsFile);
+	fs_rename(aTmpFile, m_pConfigStatsFile);
+}
+
+void Run(unsigned short Port, NETADDR Dest)
+{
+	NETADDR Src;
+	mem_zero(&Src, sizeof(Src));
+	Src.type = NETTYPE_ALL;
+	Src.port = Port;
+	NETSOCKET Socket = net_udp_create(Src, 0);
+	if(!Socket.type)
+	{
+		dbg_msg("crapnet", "couldn't open port %d", Port);
+		return;
+	}
+
+	char aBuffer[1024*2];
+	int64 Start = time_get();
+	int64 NextStats = Start + m_ConfigStatsInterval*time_freq();
+	const CProfile *pLastProfile = 0;
+
+	while(1)
+	{
+		int64 Now = time_get();
+		const CProfile *pProfile = CurrentProfile(Start);
+		if(pProfile != pLastProfile)
+			dbg_msg("crapnet", "profile = %s", pProfile->m_aName);
+		pLastProfile = pProfile;
+
+		// packets from clients
 		while(1)
 		{
-			p = pNext;
-			if(!p)
+			NETADDR From;
+			int Bytes = net_udp_recv(Socket, &From, aBuffer, sizeof(aBuffer));
+			if(Bytes <= 0)
 				break;
-			pNext = p->m_pNext;
+			int Flow = FindFlow(&From, Now);
+			if(Flow < 0)
+				continue;
+			m_aFlows[Flow].m_LastActive = Now;
+			QueuePacket(Flow, DIR_TO_SERVER, aBuffer, Bytes, pProfile, Now);
+		}
 
-			if((time_get()-p->m_Timestamp) > m_CurrentLatency)
+		// packets from the server, each flow has its own socket
+		for(int i = 0; i < MAX_FLOWS; i++)
+		{
+			if(!m_aFlows[i].m_Used)
+				continue;
+			while(1)
 			{
-				char aFlags[] = "  ";
-
-				if(m_ConfigReorder && (random_int()%2) == 0 && p->m_pNext)
-				{
-					aFlags[0] = 'R';
-					p = m_pFirst->m_pNext;
-				}
-
-				if(p->m_pNext)
-					p->m_pNext->m_pPrev = p->m_pPrev;
-				else
-					m_pLast = p->m_pPrev;
+				NETADDR From;
+				int Bytes = net_udp_recv(m_aFlows[i].m_Socket, &From, aBuffer, sizeof(aBuffer));
+				if(Bytes <= 0)
+					break;
+				if(net_addr_comp(&From, &Dest, true) == 0)
+					QueuePacket(i, DIR_TO_CLIENT, aBuffer, Bytes, pProfile, Now);
+			}
+		}
 
-				if(p->m_pPrev)
-					p->m_pPrev->m_pNext = p->m_pNext;
-				else
-					m_pFirst = p->m_pNext;
+		SendPackets(Socket, &Dest, Now);
 
-				/*CPacket *cur = first;
-				while(cur)
-				{
-					dbg_assert(cur != p, "p still in list");
-					cur = cur->next;
-				}*/
-
-				// send and remove packet
-				//if((random_int()%20) != 0) // heavy packetloss
-				net_udp_send(Socket, &p->m_SendTo, p->m_aData, p->m_DataSize);
-
-				// update lag
-				double Flux = random_int()/(double)RAND_MAX;
-				int MsSpike = Ping.m_Spike;
-				int MsFlux = Ping.m_Flux;
-				int MsPing = Ping.m_Base;
-				m_CurrentLatency = ((time_freq()*MsPing)/1000) + (int64)(((time_freq()*MsFlux)/1000)*Flux); // 50ms
-
-				if(MsSpike && (p->m_ID%100) == 0)
-				{
-					m_CurrentLatency += (time_freq()*MsSpike)/1000;
-					aFlags[1] = 'S';
-				}
+		if(Now > NextStats)
+		{
+			if(m_pConfigStatsFile)
+				WriteStats(pProfile, Start, Now);
+			NextStats = Now + m_ConfigStatsInterval*time_freq();
 
-				if(m_ConfigLog)
+			// forget idle clients, their queued packets are dropped when they come due
+			for(int i = 0; i < MAX_FLOWS; i++)
+			{
+				if(m_aFlows[i].m_Used && Now-m_aFlows[i].m_LastActive > FLOW_TIMEOUT*time_freq())
 				{
-					char aAddrStr[NETADDR_MAXSTRSIZE];
-					net_addr_str(&p->m_SendTo, aAddrStr, sizeof(aAddrStr), true);
-					dbg_msg("crapnet", ">> %08d %s (%d) %s", p->m_ID, aAddrStr, p->m_DataSize, aFlags);
+					dbg_msg("crapnet", "flow %d: timed out", m_aFlows[i].m_ID);
+					net_udp_close(m_aFlows[i].m_Socket);
+					m_aFlows[i].m_Used = false;
 				}
-
-
-				mem_free(p);
 			}
 		}
 
@@ -209,7 +573,42 @@ void Run(unsigned short Port, NETADDR Dest)
 int main(int argc, char **argv) // ignore_convention
 {
 	NETADDR Addr = {NETTYPE_IPV4, {127,0,0,1},8303};
+	int Port = 8302;
+	const char *pProfiles = 0;
 	dbg_logger_stdout();
-	Run(8302, Addr);
+
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		if(str_comp(argv[i], "-p") == 0 && i+1 < argc) // ignore_convention
+			Port = str_toint(argv[++i]); // ignore_convention
+		else if(str_comp(argv[i], "-c") == 0 && i+1 < argc) // ignore_convention
+			pProfiles = argv[++i]; // ignore_convention
+		else if(str_comp(argv[i], "-j") == 0 && i+1 < argc) // ignore_convention
+			m_pConfigStatsFile = argv[++i]; // ignore_convention
+		else if(str_comp(argv[i], "-i") == 0 && i+1 < argc) // ignore_convention
+			m_ConfigStatsInterval = max(1, str_toint(argv[++i])); // ignore_convention
+		else if(str_comp(argv[i], "-l") == 0) // ignore_convention
+			m_ConfigLog = 1;
+		else if(net_host_lookup(argv[i], &Addr, NETTYPE_ALL) != 0) // ignore_convention
+		{
+			dbg_msg("crapnet", "usage: crapnet [-p port] [-c profiles] [-j stats.json] [-i stats interval] [-l] [server address]");
+			return -1;
+		}
+		else if(!Addr.port)
+			Addr.port = 8303;
+	}
+
+	if(pProfiles)
+	{
+		if(!LoadProfiles(pProfiles))
+			return -1;
+	}
+	else
+		SetDefaultProfiles();
+	for(int i = 0; i < m_NumProfiles; i++)
+		m_CycleLength += m_aProfiles[i].m_Duration;
+
+	net_init();
+	Run(Port, Addr);
 	return 0;
 }
@@ -0,0 +1,330 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <math.h>
+
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/jobs.h>
+#include <engine/shared/jsonwriter.h>
+#include <engine/shared/packer.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+#include <generated/protocol.h>
+#include <game/version.h>
+
+/*
+	Headless demo analyzer. Plays demos without graphics or sound as
+	fast as they decode, one demo per worker, and writes the kills,
+	flag captures and movement of the players to a JSON file. The
+	demos are looked up in the storage paths like in the client.
+
+	usage: demo_analyze [-j threads] <output file> <demo>...
+*/
+
+struct CPlayerStats
+{
+	bool m_Seen;
+	char m_aName[MAX_NAME_ARRAY_SIZE];
+	char m_aClan[MAX_CLAN_ARRAY_SIZE];
+	int m_Kills;
+	int m_Deaths;
+	int m_Suicides;
+	int m_Captures;
+	int m_Ticks; // with a character
+	double m_Distance;
+	int m_LastX;
+	int m_LastY;
+	int m_LastTick;
+};
+
+class CDemoAnalyzer : public CDemoPlayer::IListener
+{
+	CNetObjHandler m_NetObjHandler;
+	CDemoPlayer *m_pPlayer;
+	int m_LastSnapshotTick;
+
+public:
+	IConsole *m_pConsole;
+	const char *m_pFilename;
+	char m_aError[256];
+	CDemoHeader m_Header;
+	int m_FirstTick;
+	int m_LastTick;
+	int m_NumSnapshots;
+	int m_NumMessages;
+	int64 m_DecodeTime;
+	CPlayerStats m_aPlayers[MAX_CLIENTS];
+
+	void Run(IStorage *pStorage);
+	void Write(CJsonWriter *pWriter) const;
+
+	void OnDemoPlayerSnapshot(void *pData, int Size);
+	void OnDemoPlayerMessage(void *pData, int Size);
+};
+
+void CDemoAnalyzer::Run(IStorage *pStorage)
+{
+	m_aError[0] = 0;
+	m_FirstTick = -1;
+	m_LastTick = -1;
+	m_NumSnapshots = 0;
+	m_NumMessages = 0;
+	m_DecodeTime = 0;
+	m_LastSnapshotTick = -1;
+	mem_zero(&m_Header, sizeof(m_Header));
+	mem_zero(m_aPlayers, sizeof(m_aPlayers));
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		m_aPlayers[i].m_LastTick = -1;
+
+	CSnapshotDelta Delta;
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+		Delta.SetStaticsize(i, m_NetObjHandler.GetObjSize(i));
+
+	// the workers are busy with other demos, so no decoder thread
+	CDemoPlayer Player(&Delta);
+	Player.SetListener(this);
+	Player.SetSaveMaps(false);
+	m_pPlayer = &Player;
+
+	const char *pError = Player.Load(pStorage, m_pConsole, m_pFilename, IStorage::TYPE_ALL, GAME_NETVERSION);
+	if(pError)
+		str_copy(m_aError, pError, sizeof(m_aError));
+	else
+	{
+		m_Header = Player.Info()->m_Header;
+		m_FirstTick = Player.Info()->m_Info.m_FirstTick;
+		m_LastTick = Player.Info()->m_Info.m_LastTick;
+
+		int64 StartTime = time_get();
+		Player.Play();
+		while(Player.IsPlaying() && !Player.BaseInfo()->m_Paused)
+			Player.NextFrame();
+		m_DecodeTime = time_get()-StartTime;
+		if(!Player.IsPlaying())
+			str_copy(m_aError, "playback failed", sizeof(m_aError));
+		Player.Stop();
+	}
+
+	m_pPlayer = 0;
+}
+
+void CDemoAnalyzer::OnDemoPlayerSnapshot(void *pData, int Size)
+{
+	// ticks without a snapshot replay the last one
+	int Tick = m_pPlayer->BaseInfo()->m_CurrentTick;
+	const CSnapshot *pSnap = (const CSnapshot *)pData;
+	m_NumSnapshots++;
+
+	for(int i = 0; i < pSnap->NumItems(); i++)
+	{
+		const CSnapshotItem *pItem = pSnap->GetItem(i);
+		if(pItem->Type() != NETOBJTYPE_CHARACTER || pItem->ID() >= MAX_CLIENTS || pSnap->GetItemSize(i) < (int)sizeof(CNetObj_Character))
+			continue;
+
+		// only count the movement between snapshots in a row, characters jump when they spawn
+		const CNetObj_Character *pCharacter = (const CNetObj_Character *)pItem->Data();
+		CPlayerStats *pStats = &m_aPlayers[pItem->ID()];
+		if(pStats->m_LastTick != -1 && pStats->m_LastTick == m_LastSnapshotTick)
+		{
+			float dx = (float)(pCharacter->m_X - pStats->m_LastX);
+			float dy = (float)(pCharacter->m_Y - pStats->m_LastY);
+			pStats->m_Distance += sqrtf(dx*dx+dy*dy);
+		}
+		pStats->m_Seen = true;
+		pStats->m_Ticks++;
+		pStats->m_LastX = pCharacter->m_X;
+		pStats->m_LastY = pCharacter->m_Y;
+		pStats->m_LastTick = Tick;
+	}
+	m_LastSnapshotTick = Tick;
+}
+
+void CDemoAnalyzer::OnDemoPlayerMessage(void *pData, int Size)
+{
+	CUnpacker Unpacker;
+	Unpacker.Reset(pData, Size);
+
+	// unpack msgid and system flag
+	int Msg = Unpacker.GetInt();
+	int Sys = Msg&1;
+	Msg >>= 1;
+	if(Unpacker.Error() || Sys)
+		return;
+	m_NumMessages++;
+
+	void *pRawMsg = m_NetObjHandler.SecureUnpackMsg(Msg, &Unpacker);
+	if(!pRawMsg)
+		return;
+
+	if(Msg == NETMSGTYPE_SV_CLIENTINFO)
+	{
+		const CNetMsg_Sv_ClientInfo *pMsg = (const CNetMsg_Sv_ClientInfo *)pRawMsg;
+		CPlayerStats *pStats = &m_aPlayers[pMsg->m_ClientID];
+		pStats->m_Seen = true;
+		str_copy(pStats->m_aName, pMsg->m_pName, sizeof(pStats->m_aName));
+		str_copy(pStats->m_aClan, pMsg->m_pClan, sizeof(pStats->m_aClan));
+	}
+	else if(Msg == NETMSGTYPE_SV_KILLMSG)
+	{
+		const CNetMsg_Sv_KillMsg *pMsg = (const CNetMsg_Sv_KillMsg *)pRawMsg;
+		if(pMsg->m_Victim < 0 || pMsg->m_Victim >= MAX_CLIENTS)
+			return;
+		m_aPlayers[pMsg->m_Victim].m_Deaths++;
+		if(pMsg->m_Killer == pMsg->m_Victim)
+			m_aPlayers[pMsg->m_Victim].m_Suicides++;
+		else if(pMsg->m_Killer >= 0 && pMsg->m_Killer < MAX_CLIENTS)
+			m_aPlayers[pMsg->m_Killer].m_Kills++;
+	}
+	else if(Msg == NETMSGTYPE_SV_GAMEMSG)
+	{
+		// the parameters follow the game message id, a capture has the team, the carrier and the time
+		int GameMsgID = Unpacker.GetInt();
+		if(GameMsgID != GAMEMSG_CTF_CAPTURE)
+			return;
+		Unpacker.GetInt();
+		int ClientID = Unpacker.GetInt();
+		if(!Unpacker.Error() && ClientID >= 0 && ClientID < MAX_CLIENTS)
+			m_aPlayers[ClientID].m_Captures++;
+	}
+}
+
+void CDemoAnalyzer::Write(CJsonWriter *pWriter) const
+{
+	pWriter->BeginObject();
+	pWriter->WriteAttribute("file");
+	pWriter->WriteStrValue(m_pFilename);
+	if(m_aError[0])
+	{
+		pWriter->WriteAttribute("error");
+		pWriter->WriteStrValue(m_aError);
+	}
+	if(m_Header.m_Version)
+	{
+		pWriter->WriteAttribute("map");
+		pWriter->WriteStrValue(m_Header.m_aMapName);
+		pWriter->WriteAttribute("type");
+		pWriter->WriteStrValue(m_Header.m_aType);
+		pWriter->WriteAttribute("timestamp");
+		pWriter->WriteStrValue(m_Header.m_aTimestamp);
+		pWriter->WriteAttribute("first_tick");
+		pWriter->WriteIntValue(m_FirstTick);
+		pWriter->WriteAttribute("last_tick");
+		pWriter->WriteIntValue(m_LastTick);
+		pWriter->WriteAttribute("snapshots");
+		pWriter->WriteIntValue(m_NumSnapshots);
+		pWriter->WriteAttribute("messages");
+		pWriter->WriteIntValue(m_NumMessages);
+		pWriter->WriteAttribute("decode_ms");
+		pWriter->WriteIntValue((int)(m_DecodeTime*1000/time_freq()));
+
+		pWriter->WriteAttribute("players");
+		pWriter->BeginArray();
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			const CPlayerStats *pStats = &m_aPlayers[i];
+			if(!pStats->m_Seen && !pStats->m_Deaths && !pStats->m_Kills)
+				continue;
+			pWriter->BeginObject();
+			pWriter->WriteAttribute("id");
+			pWriter->WriteIntValue(i);
+			pWriter->WriteAttribute("name");
+			pWriter->WriteStrValue(pStats->m_aName);
+			pWriter->WriteAttribute("clan");
+			pWriter->WriteStrValue(pStats->m_aClan);
+			pWriter->WriteAttribute("kills");
+			pWriter->WriteIntValue(pStats->m_Kills);
+			pWriter->WriteAttribute("deaths");
+			pWriter->WriteIntValue(pStats->m_Deaths);
+			pWriter->WriteAttribute("suicides");
+			pWriter->WriteIntValue(pStats->m_Suicides);
+			pWriter->WriteAttribute("captures");
+			pWriter->WriteIntValue(pStats->m_Captures);
+			pWriter->WriteAttribute("ticks_alive");
+			pWriter->WriteIntValue(pStats->m_Ticks);
+			pWriter->WriteAttribute("distance");
+			pWriter->WriteIntValue((int)pStats->m_Distance);
+			pWriter->EndObject();
+		}
+		pWriter->EndArray();
+	}
+	pWriter->EndObject();
+}
+
+static IStorage *s_pStorage;
+
+static void AnalyzeDemos(int Begin, int End, void *pUser)
+{
+	CDemoAnalyzer *pAnalyzers = (CDemoAnalyzer *)pUser;
+	for(int i = Begin; i < End; i++)
+		pAnalyzers[i].Run(s_pStorage);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	int NumThreads = cpu_count();
+	if(argc >= 3 && str_comp(argv[1], "-j") == 0) // ignore_convention
+	{
+		NumThreads = max(str_toint(argv[2]), 1); // ignore_convention
+		argc -= 2;
+		argv += 2;
+	}
+
+	s_pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv); // ignore_convention
+	if(!s_pStorage || argc < 3)
+	{
+		dbg_msg("demo_analyze", "usage: demo_analyze [-j threads] <output file> <demo>...");
+		return -1;
+	}
+
+	IOHANDLE File = io_open(argv[1], IOFLAG_WRITE); // ignore_convention
+	if(!File)
+	{
+		dbg_msg("demo_analyze", "couldn't open '%s'", argv[1]); // ignore_convention
+		return -1;
+	}
+
+	int NumDemos = argc-2;
+	CDemoAnalyzer *pAnalyzers = new CDemoAnalyzer[NumDemos];
+	for(int i = 0; i < NumDemos; i++)
+	{
+		pAnalyzers[i].m_pConsole = CreateConsole(CFGFLAG_SERVER);
+		pAnalyzers[i].m_pFilename = argv[i+2]; // ignore_convention
+	}
+
+	// one demo per job, the main thread helps while it waits
+	CJobPool Pool;
+	Pool.Init(NumThreads-1);
+	int64 StartTime = time_get();
+	Pool.ParallelFor(0, NumDemos, 1, AnalyzeDemos, pAnalyzers);
+	int64 Duration = time_get()-StartTime;
+
+	int NumFailed = 0;
+	int64 NumTicks = 0;
+	CJsonWriter Writer(File);
+	Writer.BeginArray();
+	for(int i = 0; i < NumDemos; i++)
+	{
+		pAnalyzers[i].Write(&Writer);
+		if(pAnalyzers[i].m_aError[0])
+			NumFailed++;
+		else
+			NumTicks += pAnalyzers[i].m_LastTick-pAnalyzers[i].m_FirstTick;
+	}
+	Writer.EndArray();
+
+	double Seconds = max(Duration/(double)time_freq(), 0.001);
+	dbg_msg("demo_analyze", "analyzed %d demos (%d failed) in %.2fs, %.0fx real time", NumDemos, NumFailed, Seconds, NumTicks/(double)SERVER_TICK_SPEED/Seconds);
+
+	for(int i = 0; i < NumDemos; i++)
+		delete pAnalyzers[i].m_pConsole;
+	delete[] pAnalyzers;
+	return NumFailed ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+#include <generated/protocol.h>
+#include <game/version.h>
+
+/*
+	Cuts a part out of a demo without playing it back. The seconds count
+	from the start of the demo, the new demo is written to the save path.
+
+	usage: demo_cut <demo> <new demo> <start seconds> <end seconds>
+*/
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv); // ignore_convention
+	if(!pStorage || argc != 5)
+	{
+		dbg_msg("demo_cut", "usage: demo_cut <demo> <new demo> <start seconds> <end seconds>");
+		return -1;
+	}
+
+	CNetObjHandler NetObjHandler;
+	CSnapshotDelta Delta;
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+		Delta.SetStaticsize(i, NetObjHandler.GetObjSize(i));
+
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	CDemoPlayer Player(&Delta);
+	Player.SetSaveMaps(false);
+	const char *pError = Player.Load(pStorage, pConsole, argv[1], IStorage::TYPE_ALL, GAME_NETVERSION); // ignore_convention
+	if(!pError)
+	{
+		int FirstTick = Player.Info()->m_Info.m_FirstTick;
+		int StartTick = FirstTick + (int)(str_tofloat(argv[3])*SERVER_TICK_SPEED); // ignore_convention
+		int EndTick = FirstTick + (int)(str_tofloat(argv[4])*SERVER_TICK_SPEED); // ignore_convention
+		int64 StartTime = time_get();
+		pError = Player.Cut(pStorage, argv[2], StartTick, EndTick); // ignore_convention
+		if(!pError)
+			dbg_msg("demo_cut", "cut ticks %d to %d in %.2fms", StartTick, EndTick, (time_get()-StartTime)*1000.0/time_freq());
+		Player.Stop();
+	}
+	delete pConsole;
+
+	if(pError)
+	{
+		dbg_msg("demo_cut", "%s", pError);
+		return -1;
+	}
+	return 0;
+}
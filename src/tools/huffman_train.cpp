@@ -0,0 +1,201 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include <engine/demo.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/huffman.h>
+
+// trains a huffman table on the traffic recorded in demos. snapshot deltas are
+// stored the way they are sent, messages get their int packing undone
+
+enum
+{
+	CHUNKTYPEFLAG_TICKMARKER = 0x80,
+	CHUNKTICKFLAG_KEYFRAME = 0x40,
+	CHUNKMASK_TICK = 0x3f,
+	CHUNKMASK_TYPE = 0x60,
+	CHUNKMASK_SIZE = 0x1f,
+
+	CHUNKTYPE_MESSAGE = 2,
+
+	MAX_CHUNK_SIZE = 64*1024,
+};
+
+static const unsigned char gs_aHeaderMarker[7] = {'T', 'W', 'D', 'E', 'M', 'O', 0};
+static const unsigned char gs_ActVersion = 5;
+static const unsigned char gs_OldVersion = 4;
+
+typedef void (*FPayloadCallback)(const unsigned char *pData, int Size, void *pUser);
+
+static CHuffman s_DemoHuffman;
+
+static bool ProcessDemo(const char *pFilename, FPayloadCallback pfnCallback, void *pUser)
+{
+	IOHANDLE File = io_open(pFilename, IOFLAG_READ);
+	if(!File)
+	{
+		dbg_msg("huffman_train", "couldn't open '%s'", pFilename);
+		return false;
+	}
+
+	CDemoHeader Header;
+	if(io_read(File, &Header, sizeof(Header)) != sizeof(Header) || mem_comp(Header.m_aMarker, gs_aHeaderMarker, sizeof(gs_aHeaderMarker)) != 0 ||
+		Header.m_Version < gs_OldVersion || Header.m_Version > gs_ActVersion)
+	{
+		dbg_msg("huffman_train", "'%s' is not a demo of version %d to %d", pFilename, gs_OldVersion, gs_ActVersion);
+		io_close(File);
+		return false;
+	}
+	io_skip(File, bytes_be_to_uint(Header.m_aMapSize));
+
+	static unsigned char s_aCompressed[MAX_CHUNK_SIZE];
+	static unsigned char s_aData[MAX_CHUNK_SIZE];
+	static unsigned char s_aUnpacked[MAX_CHUNK_SIZE];
+	while(1)
+	{
+		unsigned char Chunk;
+		if(io_read(File, &Chunk, sizeof(Chunk)) != sizeof(Chunk))
+			break;
+
+		// the keyframe index of version 5 follows
+		if(Chunk == 0)
+			break;
+
+		if(Chunk&CHUNKTYPEFLAG_TICKMARKER)
+		{
+			if((Chunk&CHUNKMASK_TICK) == 0)
+				io_skip(File, 4);
+			continue;
+		}
+
+		int Type = (Chunk&CHUNKMASK_TYPE)>>5;
+		int Size = Chunk&CHUNKMASK_SIZE;
+		if(Size == 30)
+		{
+			unsigned char aSize[1];
+			if(io_read(File, aSize, sizeof(aSize)) != sizeof(aSize))
+				break;
+			Size = aSize[0];
+		}
+		else if(Size == 31)
+		{
+			unsigned char aSize[2];
+			if(io_read(File, aSize, sizeof(aSize)) != sizeof(aSize))
+				break;
+			Size = (aSize[1]<<8) | aSize[0];
+		}
+
+		if(io_read(File, s_aCompressed, Size) != (unsigned)Size)
+			break;
+		int DataSize = s_DemoHuffman.Decompress(s_aCompressed, Size, s_aData, sizeof(s_aData));
+		if(DataSize < 0)
+			continue;
+
+		if(Type == CHUNKTYPE_MESSAGE)
+		{
+			int UnpackedSize = CVariableInt::Decompress(s_aData, DataSize, s_aUnpacked, sizeof(s_aUnpacked));
+			if(UnpackedSize > 0)
+				pfnCallback(s_aUnpacked, UnpackedSize, pUser);
+		}
+		else if(DataSize > 0)
+			pfnCallback(s_aData, DataSize, pUser);
+	}
+
+	io_close(File);
+	return true;
+}
+
+static void CountCallback(const unsigned char *pData, int Size, void *pUser)
+{
+	int64 *pCounts = (int64 *)pUser;
+	for(int i = 0; i < Size; i++)
+		pCounts[pData[i]]++;
+}
+
+struct CCompareInfo
+{
+	CHuffman *m_pDefault;
+	CHuffman *m_pTrained;
+	int64 m_RawSize;
+	int64 m_DefaultSize;
+	int64 m_TrainedSize;
+};
+
+static void CompareCallback(const unsigned char *pData, int Size, void *pUser)
+{
+	CCompareInfo *pInfo = (CCompareInfo *)pUser;
+	static unsigned char s_aOut[MAX_CHUNK_SIZE*2];
+	pInfo->m_RawSize += Size;
+	pInfo->m_DefaultSize += pInfo->m_pDefault->Compress(pData, Size, s_aOut, sizeof(s_aOut));
+	pInfo->m_TrainedSize += pInfo->m_pTrained->Compress(pData, Size, s_aOut, sizeof(s_aOut));
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+	if(argc < 3) // ignore_convention
+	{
+		dbg_msg("usage", "%s <output table> <demo>...", argv[0]); // ignore_convention
+		return -1;
+	}
+
+	s_DemoHuffman.Init();
+	int64 aCounts[256] = {0};
+	int NumDemos = 0;
+	for(int i = 2; i < argc; i++) // ignore_convention
+		NumDemos += ProcessDemo(argv[i], CountCallback, aCounts); // ignore_convention
+
+	int64 Total = 0;
+	for(int i = 0; i < 256; i++)
+		Total += aCounts[i];
+	if(!Total)
+	{
+		dbg_msg("huffman_train", "no data to train on");
+		return -1;
+	}
+
+	// scale to a sum of about 2^16 and keep every byte possible, this bounds
+	// the depth of the tree well below the longest code the coder takes
+	unsigned aFrequencies[256];
+	for(int i = 0; i < 256; i++)
+		aFrequencies[i] = 1 + (unsigned)(aCounts[i]*65536/Total);
+
+	CHuffman *pTrained = new CHuffman;
+	CHuffman *pDefault = new CHuffman;
+	pTrained->Init(aFrequencies);
+	pDefault->Init();
+	if(!pTrained->Usable())
+	{
+		dbg_msg("huffman_train", "the trained table has codes that are too long");
+		return -1;
+	}
+
+	CCompareInfo Info = {pDefault, pTrained, 0, 0, 0};
+	for(int i = 2; i < argc; i++) // ignore_convention
+		ProcessDemo(argv[i], CompareCallback, &Info); // ignore_convention
+
+	IOHANDLE File = io_open(argv[1], IOFLAG_WRITE); // ignore_convention
+	if(!File)
+	{
+		dbg_msg("huffman_train", "couldn't open '%s' for writing", argv[1]); // ignore_convention
+		return -1;
+	}
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "# huffman table trained on %d demos, id %08x\n", NumDemos, CHuffman::TableID(aFrequencies));
+	io_write(File, aBuf, str_length(aBuf));
+	for(int i = 0; i < 256; i++)
+	{
+		str_format(aBuf, sizeof(aBuf), "%u%s", aFrequencies[i], i == 255 ? "\n" : (i%16 == 15 ? ",\n" : ","));
+		io_write(File, aBuf, str_length(aBuf));
+	}
+	io_close(File);
+
+	dbg_msg("huffman_train", "id=%08x raw=%lld default=%lld trained=%lld (%.1f%%)", CHuffman::TableID(aFrequencies),
+		Info.m_RawSize, Info.m_DefaultSize, Info.m_TrainedSize, Info.m_DefaultSize ? Info.m_TrainedSize*100.0f/Info.m_DefaultSize : 0.0f);
+
+	delete pTrained;
+	delete pDefault;
+	return 0;
+}
@@ -0,0 +1,586 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <math.h>
+
+#include <base/hash_ctxt.h>
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/algorithm.h>
+#include <base/tl/array.h>
+
+#include <engine/message.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/config.h>
+#include <engine/shared/network.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+#include <generated/protocol.h>
+#include <game/version.h>
+
+/*
+	Headless load generator. Every bot is a real client connection: it
+	goes through the handshake, downloads the map, enters the game, sends
+	inputs every tick and acks the snapshots it could decode, so the
+	server does the same work it does for players.
+
+	usage: loadgen [-n bots] [-r connects per second] [-d seconds] [-p password] [-b] address[:port]
+
+	-b asks the server for bit packed snapshots.
+*/
+
+class CDistribution
+{
+	array<int> m_lSamples;
+
+public:
+	void Add(int Value) { m_lSamples.add(Value); }
+
+	void Report(const char *pName, const char *pUnit)
+	{
+		if(!m_lSamples.size())
+		{
+			dbg_msg("loadgen", "%-18s no samples", pName);
+			return;
+		}
+
+		sort(m_lSamples.all());
+		int64 Sum = 0;
+		for(int i = 0; i < m_lSamples.size(); i++)
+			Sum += m_lSamples[i];
+		int Num = m_lSamples.size();
+		dbg_msg("loadgen", "%-18s n=%d min=%d avg=%d p50=%d p90=%d p99=%d max=%d %s", pName, Num,
+			m_lSamples[0], (int)(Sum/Num), m_lSamples[Num/2], m_lSamples[Num*9/10], m_lSamples[Num*99/100], m_lSamples[Num-1], pUnit);
+	}
+};
+
+static CConfig *s_pConfig;
+static CSnapshotDelta *s_pSnapshotDelta;
+static CNetObjHandler s_NetObjHandler;
+
+static CDistribution s_PingRtt;
+static CDistribution s_ServerLatency;
+static CDistribution s_InputTimeLeft;
+static CDistribution s_SnapshotSize;
+static int s_NumOnline = 0;
+static int s_NumDisconnects = 0;
+static int s_NumSnapshots = 0;
+static int s_NumSnapshotErrors = 0;
+static int64 s_MapBytes = 0;
+static bool s_Bitpack = false;
+
+class CBot
+{
+	enum
+	{
+		STATE_OFFLINE=0,
+		STATE_CONNECTING,
+		STATE_LOADING,
+		STATE_CONNECTED,
+		STATE_INGAME,
+	};
+
+	CNetClient m_Net;
+	int m_Index;
+	int m_State;
+	char m_aPassword[128];
+
+	// map download
+	int m_MapSize;
+	int m_MapChunkNum;
+	int m_MapChunkSize;
+	int m_MapChunk;
+	int m_MapAmount;
+	SHA256_CTX m_MapSha256Ctx;
+	SHA256_DIGEST m_MapSha256;
+
+	// snapshots
+	CSnapshotStorage m_Snapshots;
+	char m_aSnapshotIncomingData[CSnapshot::MAX_SIZE];
+	unsigned m_SnapshotParts;
+	int m_CurrentRecvTick;
+	int m_AckGameTick;
+	bool m_SnapBitpacked;
+	int64 m_RecvTickTime;
+	int m_LocalClientID;
+
+	// inputs
+	int m_PredOffset;
+	int m_LastInputTick;
+	CNetObj_PlayerInput m_Input;
+	int64 m_NextInputChange;
+	int64 m_NextPing;
+	int64 m_PingStartTime;
+	int64 m_NextLatencySample;
+
+	void SendMsg(CMsgPacker *pMsg, int Flags)
+	{
+		CNetChunk Packet;
+		mem_zero(&Packet, sizeof(Packet));
+		Packet.m_ClientID = 0;
+		Packet.m_pData = pMsg->Data();
+		Packet.m_DataSize = pMsg->Size();
+		if(Flags&MSGFLAG_VITAL)
+			Packet.m_Flags |= NETSENDFLAG_VITAL;
+		if(Flags&MSGFLAG_FLUSH)
+			Packet.m_Flags |= NETSENDFLAG_FLUSH;
+		m_Net.Send(&Packet);
+	}
+
+	void SendStartInfo()
+	{
+		static const char *s_apSkinParts[NUM_SKINPARTS] = {"standard", "", "", "standard", "standard", "standard"};
+		char aName[MAX_NAME_LENGTH];
+		str_format(aName, sizeof(aName), "bot%d", m_Index);
+
+		CNetMsg_Cl_StartInfo Msg;
+		Msg.m_pName = aName;
+		Msg.m_pClan = "loadgen";
+		Msg.m_Country = -1;
+		for(int p = 0; p < NUM_SKINPARTS; p++)
+		{
+			Msg.m_apSkinPartNames[p] = s_apSkinParts[p];
+			Msg.m_aUseCustomColors[p] = 0;
+			Msg.m_aSkinPartColors[p] = 0;
+		}
+		CMsgPacker Packer(Msg.MsgID(), false);
+		Msg.Pack(&Packer);
+		SendMsg(&Packer, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+	}
+
+	void SendInput(int64 Now)
+	{
+		// aim at the tick the server will run when the input arrives, corrected by the input timing it reports
+		int PredTick = m_CurrentRecvTick + (int)((Now-m_RecvTickTime)*SERVER_TICK_SPEED/time_freq()) + m_PredOffset;
+		if(PredTick <= m_LastInputTick)
+			return;
+		m_LastInputTick = PredTick;
+
+		// wander around, look around, jump and shoot now and then
+		if(Now > m_NextInputChange)
+		{
+			m_Input.m_Direction = random_int()%3-1;
+			m_Input.m_Jump = random_int()%4 == 0;
+			m_Input.m_Hook = random_int()%6 == 0;
+			m_NextInputChange = Now + time_freq()/4 + random_int()%time_freq();
+		}
+		float Angle = (Now%(time_freq()*4))/(float)(time_freq()*4)*2*pi;
+		m_Input.m_TargetX = (int)(cosf(Angle)*100);
+		m_Input.m_TargetY = (int)(sinf(Angle)*100);
+		m_Input.m_Fire += random_int()%10 == 0 ? 1 : 0;
+		m_Input.m_PlayerFlags = PLAYERFLAG_SCOREBOARD; // the server only fills in latencies for players looking at the scoreboard
+
+		CMsgPacker Msg(NETMSG_INPUT, true);
+		Msg.AddInt(m_AckGameTick);
+		Msg.AddInt(PredTick);
+		Msg.AddInt(sizeof(m_Input));
+		const int *pData = (const int *)&m_Input;
+		for(unsigned i = 0; i < sizeof(m_Input)/sizeof(int); i++)
+			Msg.AddInt(pData[i]);
+
+		int PingCorrection = 0;
+		int64 TagTime;
+		if(m_Snapshots.Get(m_AckGameTick, &TagTime, 0, 0) >= 0)
+			PingCorrection = (int)(((Now-TagTime)*1000)/time_freq());
+		Msg.AddInt(PingCorrection);
+		SendMsg(&Msg, MSGFLAG_FLUSH);
+	}
+
+	void OnSnapshot(int GameTick, int DeltaTick, int CompleteSize, int Crc, bool Empty, int64 Now)
+	{
+		static CSnapshot s_EmptySnap;
+		CSnapshot *pDeltaShot = &s_EmptySnap;
+		s_EmptySnap.Clear();
+		if(DeltaTick >= 0 && m_Snapshots.Get(DeltaTick, 0, &pDeltaShot, 0) < 0)
+		{
+			// the delta base is gone, make the server send a full snapshot
+			m_AckGameTick = -1;
+			s_NumSnapshotErrors++;
+			return;
+		}
+
+		unsigned char aDeltaData[CSnapshot::MAX_SIZE];
+		unsigned char aSnap[CSnapshot::MAX_SIZE];
+		const void *pDeltaData = s_pSnapshotDelta->EmptyDelta();
+		int DeltaSize = sizeof(int)*3;
+		if(CompleteSize)
+		{
+			if(m_SnapBitpacked)
+				DeltaSize = s_pSnapshotDelta->UnpackBits(m_aSnapshotIncomingData, CompleteSize, aDeltaData, sizeof(aDeltaData));
+			else
+				DeltaSize = CVariableInt::Decompress(m_aSnapshotIncomingData, CompleteSize, aDeltaData, sizeof(aDeltaData));
+			if(DeltaSize < 0)
+			{
+				s_NumSnapshotErrors++;
+				return;
+			}
+			pDeltaData = aDeltaData;
+		}
+
+		CSnapshot *pSnap = (CSnapshot *)aSnap;
+		int SnapSize = s_pSnapshotDelta->UnpackDelta(pDeltaShot, pSnap, pDeltaData, DeltaSize);
+		if(SnapSize < 0 || (!Empty && pSnap->Crc() != Crc))
+		{
+			m_AckGameTick = -1;
+			s_NumSnapshotErrors++;
+			return;
+		}
+
+		// the server deltas against the acked tick, nothing older is needed
+		m_Snapshots.PurgeUntil(DeltaTick >= 0 ? DeltaTick : GameTick);
+		m_Snapshots.Add(GameTick, Now, SnapSize, pSnap, 0);
+		m_AckGameTick = GameTick;
+		m_RecvTickTime = Now;
+		s_NumSnapshots++;
+		s_SnapshotSize.Add(CompleteSize);
+
+		// the latency the server measured for us, as shown on the scoreboard
+		if(m_LocalClientID >= 0 && Now > m_NextLatencySample)
+		{
+			int Index = pSnap->GetItemIndex((NETOBJTYPE_PLAYERINFO<<16)|m_LocalClientID);
+			if(Index >= 0)
+			{
+				const CNetObj_PlayerInfo *pInfo = (const CNetObj_PlayerInfo *)pSnap->GetItem(Index)->Data();
+				s_ServerLatency.Add(pInfo->m_Latency);
+				m_NextLatencySample = Now + time_freq();
+			}
+		}
+	}
+
+	void ProcessSystemMessage(int Msg, CUnpacker *pUnpacker, bool Vital, int64 Now)
+	{
+		if(Vital && Msg == NETMSG_MAP_CHANGE)
+		{
+			pUnpacker->GetString(CUnpacker::SANITIZE_CC|CUnpacker::SKIP_START_WHITESPACES);
+			pUnpacker->GetInt(); // crc
+			m_MapSize = pUnpacker->GetInt();
+			m_MapChunkNum = pUnpacker->GetInt();
+			m_MapChunkSize = pUnpacker->GetInt();
+			const SHA256_DIGEST *pSha256 = (const SHA256_DIGEST *)pUnpacker->GetRaw(sizeof(SHA256_DIGEST));
+			if(pUnpacker->Error() || m_MapSize <= 0 || m_MapChunkNum <= 0 || m_MapChunkSize <= 0)
+			{
+				Disconnect("bad map change");
+				return;
+			}
+
+			// always download, the transfer is part of the load
+			m_MapSha256 = *pSha256;
+			sha256_init(&m_MapSha256Ctx);
+			m_MapChunk = 0;
+			m_MapAmount = 0;
+			m_State = STATE_LOADING;
+			CMsgPacker Request(NETMSG_REQUEST_MAP_DATA, true);
+			SendMsg(&Request, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+		}
+		else if(Vital && Msg == NETMSG_MAP_DATA && m_State == STATE_LOADING)
+		{
+			int Size = min(m_MapChunkSize, m_MapSize-m_MapAmount);
+			const unsigned char *pData = pUnpacker->GetRaw(Size);
+			if(pUnpacker->Error())
+				return;
+
+			sha256_update(&m_MapSha256Ctx, pData, Size);
+			m_MapAmount += Size;
+			m_MapChunk++;
+			s_MapBytes += Size;
+			if(m_MapAmount == m_MapSize)
+			{
+				if(sha256_comp(sha256_finish(&m_MapSha256Ctx), m_MapSha256) != 0)
+				{
+					Disconnect("map sha256 mismatch");
+					return;
+				}
+				m_State = STATE_CONNECTED;
+				CMsgPacker Ready(NETMSG_READY, true);
+				SendMsg(&Ready, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+			}
+			else if(m_MapChunk%m_MapChunkNum == 0)
+			{
+				CMsgPacker Request(NETMSG_REQUEST_MAP_DATA, true);
+				SendMsg(&Request, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+			}
+		}
+		else if(Vital && Msg == NETMSG_CON_READY)
+			SendStartInfo();
+		else if(Vital && Msg == NETMSG_SNAP_BITPACKED)
+			m_SnapBitpacked = true;
+		else if(Msg == NETMSG_PING)
+		{
+			CMsgPacker Reply(NETMSG_PING_REPLY, true);
+			SendMsg(&Reply, 0);
+		}
+		else if(Msg == NETMSG_PING_REPLY && m_PingStartTime)
+		{
+			s_PingRtt.Add((int)((Now-m_PingStartTime)*1000/time_freq()));
+			m_PingStartTime = 0;
+		}
+		else if(Msg == NETMSG_INPUTTIMING)
+		{
+			pUnpacker->GetInt();
+			int TimeLeft = pUnpacker->GetInt();
+			if(pUnpacker->Error())
+				return;
+			s_InputTimeLeft.Add(TimeLeft);
+			if(TimeLeft < 10)
+				m_PredOffset++;
+			else if(TimeLeft > 60 && m_PredOffset > 1)
+				m_PredOffset--;
+		}
+		else if((Msg == NETMSG_SNAP || Msg == NETMSG_SNAPSINGLE || Msg == NETMSG_SNAPEMPTY) && m_State == STATE_INGAME)
+		{
+			int NumParts = 1;
+			int Part = 0;
+			int GameTick = pUnpacker->GetInt();
+			int DeltaTick = GameTick-pUnpacker->GetInt();
+			int Crc = 0;
+			int PartSize = 0;
+			if(Msg == NETMSG_SNAP)
+			{
+				NumParts = pUnpacker->GetInt();
+				Part = pUnpacker->GetInt();
+			}
+			if(Msg != NETMSG_SNAPEMPTY)
+			{
+				Crc = pUnpacker->GetInt();
+				PartSize = pUnpacker->GetInt();
+			}
+			const char *pData = (const char *)pUnpacker->GetRaw(PartSize);
+			if(pUnpacker->Error() || NumParts < 1 || NumParts > CSnapshot::MAX_PARTS || Part < 0 || Part >= NumParts || PartSize < 0 || PartSize > MAX_SNAPSHOT_PACKSIZE)
+				return;
+			if(GameTick < m_CurrentRecvTick)
+				return;
+
+			if(GameTick != m_CurrentRecvTick)
+			{
+				m_SnapshotParts = 0;
+				m_CurrentRecvTick = GameTick;
+			}
+			mem_copy(m_aSnapshotIncomingData + Part*MAX_SNAPSHOT_PACKSIZE, pData, PartSize);
+			m_SnapshotParts |= 1<<Part;
+			if(m_SnapshotParts == (unsigned)((1<<NumParts)-1))
+			{
+				m_SnapshotParts = 0;
+				OnSnapshot(GameTick, DeltaTick, (NumParts-1)*MAX_SNAPSHOT_PACKSIZE+PartSize, Crc, Msg == NETMSG_SNAPEMPTY, Now);
+			}
+		}
+	}
+
+	void ProcessGameMessage(int Msg, CUnpacker *pUnpacker)
+	{
+		if(Msg == NETMSGTYPE_SV_READYTOENTER && m_State == STATE_CONNECTED)
+		{
+			m_State = STATE_INGAME;
+			CMsgPacker EnterGame(NETMSG_ENTERGAME, true);
+			SendMsg(&EnterGame, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+		}
+		else if(Msg == NETMSGTYPE_SV_CLIENTINFO)
+		{
+			const CNetMsg_Sv_ClientInfo *pMsg = (const CNetMsg_Sv_ClientInfo *)s_NetObjHandler.SecureUnpackMsg(Msg, pUnpacker);
+			if(pMsg && pMsg->m_Local)
+				m_LocalClientID = pMsg->m_ClientID;
+		}
+	}
+
+	void Disconnect(const char *pReason)
+	{
+		dbg_msg("loadgen", "bot%d disconnected: %s", m_Index, pReason);
+		if(m_State >= STATE_LOADING)
+			s_NumOnline--;
+		s_NumDisconnects++;
+		m_Net.Disconnect(pReason);
+		m_State = STATE_OFFLINE;
+	}
+
+public:
+	bool Init(int Index)
+	{
+		NETADDR BindAddr;
+		mem_zero(&BindAddr, sizeof(BindAddr));
+		BindAddr.type = NETTYPE_ALL;
+		if(!m_Net.Open(BindAddr, s_pConfig, 0, 0, NETCREATE_FLAG_RANDOMPORT))
+			return false;
+		m_Index = Index;
+		m_State = STATE_OFFLINE;
+		m_Snapshots.Init();
+		return true;
+	}
+
+	void Connect(NETADDR *pAddr, const char *pPassword)
+	{
+		m_SnapshotParts = 0;
+		m_CurrentRecvTick = 0;
+		m_AckGameTick = -1;
+		m_SnapBitpacked = false;
+		m_RecvTickTime = 0;
+		m_LocalClientID = -1;
+		m_PredOffset = 2;
+		m_LastInputTick = 0;
+		mem_zero(&m_Input, sizeof(m_Input));
+		m_NextInputChange = 0;
+		m_NextPing = 0;
+		m_PingStartTime = 0;
+		m_NextLatencySample = 0;
+		m_Snapshots.PurgeAll();
+		str_copy(m_aPassword, pPassword, sizeof(m_aPassword));
+		m_Net.Connect(pAddr);
+		m_State = STATE_CONNECTING;
+	}
+
+	void Update(int64 Now)
+	{
+		if(m_State == STATE_OFFLINE)
+			return;
+
+		m_Net.Update();
+		if(m_Net.State() == NETSTATE_OFFLINE)
+		{
+			Disconnect(m_Net.ErrorString());
+			return;
+		}
+
+		if(m_State == STATE_CONNECTING && m_Net.State() == NETSTATE_ONLINE)
+		{
+			m_State = STATE_LOADING;
+			s_NumOnline++;
+			CMsgPacker Msg(NETMSG_INFO, true);
+			Msg.AddString(GAME_NETVERSION, 128);
+			Msg.AddString(m_aPassword, 128);
+			Msg.AddInt(CLIENT_VERSION);
+			if(s_Bitpack)
+			{
+				Msg.AddInt(CLIENTCAP_SNAP_BITPACKED);
+				Msg.AddInt(s_pSnapshotDelta->FieldBitsHash());
+			}
+			SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+		}
+
+		CNetChunk Packet;
+		while(m_State != STATE_OFFLINE && m_Net.Recv(&Packet))
+		{
+			if(Packet.m_ClientID == -1)
+				continue;
+
+			CUnpacker Unpacker;
+			Unpacker.Reset(Packet.m_pData, Packet.m_DataSize);
+			int Msg = Unpacker.GetInt();
+			if(Unpacker.Error())
+				continue;
+			if(Msg&1)
+				ProcessSystemMessage(Msg>>1, &Unpacker, (Packet.m_Flags&NET_CHUNKFLAG_VITAL) != 0, Now);
+			else
+				ProcessGameMessage(Msg>>1, &Unpacker);
+		}
+
+		if(m_State == STATE_INGAME && m_AckGameTick > 0)
+		{
+			SendInput(Now);
+			if(Now > m_NextPing)
+			{
+				CMsgPacker Ping(NETMSG_PING, true);
+				SendMsg(&Ping, 0);
+				m_PingStartTime = Now;
+				m_NextPing = Now + time_freq();
+			}
+		}
+	}
+
+	void Close() { m_Net.Close(); }
+};
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	int NumBots = 16;
+	int ConnectRate = 10;
+	int Duration = 60;
+	const char *pPassword = "";
+	const char *pAddress = 0;
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		if(str_comp(argv[i], "-n") == 0 && i+1 < argc) // ignore_convention
+			NumBots = max(1, str_toint(argv[++i])); // ignore_convention
+		else if(str_comp(argv[i], "-r") == 0 && i+1 < argc) // ignore_convention
+			ConnectRate = max(1, str_toint(argv[++i])); // ignore_convention
+		else if(str_comp(argv[i], "-d") == 0 && i+1 < argc) // ignore_convention
+			Duration = max(1, str_toint(argv[++i])); // ignore_convention
+		else if(str_comp(argv[i], "-p") == 0 && i+1 < argc) // ignore_convention
+			pPassword = argv[++i]; // ignore_convention
+		else if(str_comp(argv[i], "-b") == 0) // ignore_convention
+			s_Bitpack = true;
+		else
+			pAddress = argv[i]; // ignore_convention
+	}
+
+	NETADDR Addr;
+	if(!pAddress || net_host_lookup(pAddress, &Addr, NETTYPE_ALL) != 0)
+	{
+		dbg_msg("loadgen", "usage: loadgen [-n bots] [-r connects per second] [-d seconds] [-p password] [-b] address[:port]");
+		return -1;
+	}
+	if(!Addr.port)
+		Addr.port = 8303;
+	if(net_init() != 0 || secure_random_init() != 0)
+	{
+		dbg_msg("loadgen", "could not initialize network");
+		return -1;
+	}
+
+	CConfigManager *pConfigManager = new CConfigManager();
+	pConfigManager->Reset();
+	s_pConfig = pConfigManager->Values();
+	s_pSnapshotDelta = new CSnapshotDelta();
+	// the same sizes and field widths the game registers
+	static const int OLD_NUM_NETOBJTYPES = 23;
+	for(int i = 0; i < OLD_NUM_NETOBJTYPES; i++)
+		s_pSnapshotDelta->SetStaticsize(i, s_NetObjHandler.GetObjSize(i));
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+	{
+		unsigned char aBits[CSnapshotDelta::MAX_FIELDS];
+		s_pSnapshotDelta->SetFieldBits(i, aBits, CNetObjHandler::GetObjFieldBits(i, aBits, CSnapshotDelta::MAX_FIELDS));
+	}
+
+	CBot *pBots = new CBot[NumBots];
+	int NumOpen = 0;
+	while(NumOpen < NumBots && pBots[NumOpen].Init(NumOpen))
+		NumOpen++;
+	if(NumOpen < NumBots)
+		dbg_msg("loadgen", "could only open %d sockets", NumOpen);
+
+	int64 Start = time_get();
+	int64 End = Start + (int64)Duration*time_freq();
+	int64 NextReport = Start + 5*time_freq();
+	int NumStarted = 0;
+	int64 Now;
+	while((Now = time_get()) < End)
+	{
+		// stagger the connects so the handshakes don't arrive as one burst
+		while(NumStarted < NumOpen && NumStarted < (Now-Start)*ConnectRate/time_freq()+1)
+			pBots[NumStarted++].Connect(&Addr, pPassword);
+
+		for(int i = 0; i < NumStarted; i++)
+			pBots[i].Update(Now);
+
+		if(Now > NextReport)
+		{
+			dbg_msg("loadgen", "online=%d/%d snapshots=%d errors=%d disconnects=%d map=%lldKiB",
+				s_NumOnline, NumStarted, s_NumSnapshots, s_NumSnapshotErrors, s_NumDisconnects, s_MapBytes/1024);
+			NextReport = Now + 5*time_freq();
+		}
+		thread_sleep(1);
+	}
+
+	dbg_msg("loadgen", "ran %d bots for %d seconds, %d disconnects, %d snapshots, %d snapshot errors, %lld KiB of map data",
+		NumStarted, Duration, s_NumDisconnects, s_NumSnapshots, s_NumSnapshotErrors, s_MapBytes/1024);
+	s_PingRtt.Report("ping rtt", "ms");
+	s_ServerLatency.Report("server latency", "ms");
+	s_InputTimeLeft.Report("input time left", "ms");
+	s_SnapshotSize.Report("snapshot size", "bytes");
+
+	for(int i = 0; i < NumOpen; i++)
+		pBots[i].Close();
+	delete[] pBots;
+	delete s_pSnapshotDelta;
+	delete pConfigManager;
+	return 0;
+}
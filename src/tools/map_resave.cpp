@@ -1,45 +1,147 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include <engine/shared/datafile.h>
+#include <engine/shared/jobs.h>
+#include <engine/shared/mapbatch.h>
+#include <engine/shared/mapcache.h>
 #include <engine/storage.h>
 
-int main(int argc, const char **argv)
+enum
 {
-	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv);
-	int Index, ID = 0, Type = 0, Size;
-	void *pPtr;
-	char aFileName[1024];
-	CDataFileReader DataFile;
-	CDataFileWriter df;
+	MAX_INDEXED_MAPS=64*1024,
+};
 
-	if(!pStorage || argc != 3)
-		return -1;
+struct CResaveBatch
+{
+	IStorage *m_pStorage;
+	const char *m_pDstFolder;
+	int m_Format;
+
+	// maps resaved before whose source and output didn't change since, the
+	// entries are the outputs with the hash of their source
+	CMapCache m_Index;
+	LOCK m_IndexLock;
+};
+
+static bool ResaveMap(CMapBatch::CMap *pMap, void *pUser)
+{
+	CResaveBatch *pBatch = (CResaveBatch *)pUser;
+	if(!pBatch->m_pStorage->GetHashAndSize(pMap->m_aPath, pMap->m_StorageType, &pMap->m_Sha256, &pMap->m_Crc, &pMap->m_Size))
+		return false;
 
-	str_format(aFileName, sizeof(aFileName), "%s", argv[2]);
+	char aDstPath[IO_MAX_PATH_LENGTH];
+	str_format(aDstPath, sizeof(aDstPath), "%s/%s", pBatch->m_pDstFolder, pMap->m_aName);
 
-	if(!DataFile.Open(pStorage, argv[1], IStorage::TYPE_ALL))
+	lock_wait(pBatch->m_IndexLock);
+	const CMapCache::CEntry *pEntry = pBatch->m_Index.FindPath(aDstPath);
+	pMap->m_Skipped = pEntry && pEntry->m_Crc == pMap->m_Crc && !sha256_comp(pEntry->m_Sha256, pMap->m_Sha256);
+	if(pMap->m_Skipped)
+		pMap->m_OutputSize = pEntry->m_Size;
+	lock_unlock(pBatch->m_IndexLock);
+	if(pMap->m_Skipped)
+		return true;
+
+	// the maps are resaved in parallel already, each one on a single thread
+	if(!CDataFileWriter::Resave(pBatch->m_pStorage, pMap->m_aPath, pMap->m_StorageType, aDstPath, pBatch->m_Format, 0))
+		return false;
+
+	lock_wait(pBatch->m_IndexLock);
+	pBatch->m_Index.Add(aDstPath, &pMap->m_Sha256, pMap->m_Crc);
+	pEntry = pBatch->m_Index.FindPath(aDstPath);
+	if(pEntry)
+		pMap->m_OutputSize = pEntry->m_Size;
+	lock_unlock(pBatch->m_IndexLock);
+	return true;
+}
+
+static int ResaveFolder(IStorage *pStorage, CJobPool *pPool, const char *pSrcFolder, const char *pDstFolder, int Format, const char *pSummary)
+{
+	CResaveBatch Batch;
+	Batch.m_pStorage = pStorage;
+	Batch.m_pDstFolder = pDstFolder;
+	Batch.m_Format = Format;
+	Batch.m_IndexLock = lock_create();
+
+	// outputs of the other format don't count as unchanged
+	char aIndexFile[IO_MAX_PATH_LENGTH];
+	str_format(aIndexFile, sizeof(aIndexFile), "%s/map_resave_%s.txt", pDstFolder, Format == CDataFileWriter::FORMAT_FAST ? "fast" : "zlib");
+	char aPath[IO_MAX_PATH_LENGTH];
+	pStorage->GetCompletePath(IStorage::TYPE_SAVE, pDstFolder, aPath, sizeof(aPath));
+	if(fs_makedir_recursive(aPath))
+	{
+		dbg_msg("map_resave", "failed to create '%s'", aPath);
 		return -1;
-	if(!df.Open(pStorage, aFileName))
+	}
+	Batch.m_Index.Init(pStorage, aIndexFile, MAX_INDEXED_MAPS);
+	Batch.m_Index.Load();
+
+	CMapBatch MapBatch;
+	int Failed = MapBatch.Run(pStorage, pPool, pSrcFolder, IStorage::TYPE_ALL, ResaveMap, &Batch);
+	Batch.m_Index.Save();
+	lock_destroy(Batch.m_IndexLock);
+
+	int Skipped = 0;
+	for(int i = 0; i < MapBatch.NumMaps(); i++)
+		if(MapBatch.GetMap(i)->m_Skipped)
+			Skipped++;
+	dbg_msg("map_resave", "%d maps, %d unchanged, %d failed", MapBatch.NumMaps(), Skipped, Failed);
+
+	if(pSummary && !MapBatch.WriteSummary(pSummary, IStorage::TYPE_SAVE))
+	{
+		dbg_msg("map_resave", "failed to write '%s'", pSummary);
 		return -1;
+	}
+	return Failed ? -1 : 0;
+}
 
-	// add all items
-	for(Index = 0; Index < DataFile.NumItems(); Index++)
+int main(int argc, const char **argv)
+{
+	dbg_logger_stdout();
+	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv);
+	int Format = CDataFileWriter::FORMAT_ZLIB;
+	int NumThreads = cpu_count()-1;
+	const char *pSummary = 0;
+	bool Folder = false;
+	CJobPool Pool;
+
+	// -fast stores the data with the faster codec, old clients can't read those maps
+	while(argc > 3 && argv[1][0] == '-')
 	{
-		pPtr = DataFile.GetItem(Index, &Type, &ID);
-		Size = DataFile.GetItemSize(Index);
-		df.AddItem(Type, ID, Size, pPtr);
+		if(str_comp(argv[1], "-fast") == 0)
+			Format = CDataFileWriter::FORMAT_FAST;
+		else if(str_comp(argv[1], "-dir") == 0)
+			Folder = true;
+		else if(str_comp(argv[1], "-j") == 0 && argc > 4)
+		{
+			NumThreads = str_toint(argv[2])-1;
+			argc--;
+			argv++;
+		}
+		else if(str_comp(argv[1], "-summary") == 0 && argc > 4)
+		{
+			pSummary = argv[2];
+			argc--;
+			argv++;
+		}
+		else
+			break;
+		argc--;
+		argv++;
 	}
 
-	// add all data
-	for(Index = 0; Index < DataFile.NumData(); Index++)
+	if(!pStorage || argc != 3 || (pSummary && !Folder))
 	{
-		pPtr = DataFile.GetData(Index);
-		Size = DataFile.GetDataSize(Index);
-		df.AddData(Size, pPtr);
+		dbg_msg("map_resave", "usage: map_resave [-fast] <source map> <destination map>");
+		dbg_msg("map_resave", "       map_resave [-fast] [-j <threads>] [-summary <json file>] -dir <source folder> <destination folder>");
+		return -1;
 	}
 
-	DataFile.Close();
-	df.Finish();
+	Pool.Init(max(NumThreads, 0));
+	if(Folder)
+		return ResaveFolder(pStorage, &Pool, argv[1], argv[2], Format, pSummary);
+	if(!CDataFileWriter::Resave(pStorage, argv[1], IStorage::TYPE_ALL, argv[2], Format, &Pool))
+		return -1;
 	return 0;
 }
@@ -3,69 +3,108 @@
 #include <base/math.h>
 #include <base/system.h>
 
-#include <engine/kernel.h>
-#include <engine/map.h>
+#include <engine/shared/datafile.h>
+#include <engine/shared/jobs.h>
+#include <engine/shared/mapbatch.h>
 #include <engine/storage.h>
 
-
-static IOHANDLE s_File = 0;
-static IStorage *s_pStorage = 0;
-static IEngineMap *s_pEngineMap = 0;
-
-int MaplistCallback(const char *pName, int IsDir, int DirType, void *pUser)
+// opening the map validates it, the hashes come with it
+static bool CheckMap(CMapBatch::CMap *pMap, void *pUser)
 {
-	int l = str_length(pName);
-	if(l < 4 || IsDir || str_comp(pName+l-4, ".map") != 0)
-		return 0;
-
-	char aBuf[512];
-	str_format(aBuf, sizeof(aBuf), "maps/%s", pName);
-	if(!s_pEngineMap->Load(aBuf))
-		return 0;
-
-	unsigned MapCrc = s_pEngineMap->Crc();
-	SHA256_DIGEST MapSha256 = s_pEngineMap->Sha256();
-	s_pEngineMap->Unload();
+	IStorage *pStorage = (IStorage *)pUser;
+	CDataFileReader Reader;
+	if(!Reader.Open(pStorage, pMap->m_aPath, pMap->m_StorageType))
+		return false;
+	pMap->m_Sha256 = Reader.Sha256();
+	pMap->m_Crc = Reader.Crc();
+	Reader.Close();
 
-	IOHANDLE MapFile = s_pStorage->OpenFile(aBuf, IOFLAG_READ, DirType);
-	unsigned MapSize = io_length(MapFile);
-	io_close(MapFile);
+	IOHANDLE File = pStorage->OpenFile(pMap->m_aPath, IOFLAG_READ, pMap->m_StorageType);
+	if(!File)
+		return false;
+	pMap->m_Size = io_length(File);
+	io_close(File);
+	return true;
+}
 
-	char aMapName[8];
-	str_copy(aMapName, pName, min((int)sizeof(aMapName),l-3));
+static void WriteVersionList(IOHANDLE File, const CMapBatch *pBatch)
+{
+	io_write(File, "static CMapVersion s_aMapVersionList[] = {\n", str_length("static CMapVersion s_aMapVersionList[] = {\n"));
+	for(int i = 0; i < pBatch->NumMaps(); i++)
+	{
+		const CMapBatch::CMap *pMap = pBatch->GetMap(i);
+		if(!pMap->m_Success)
+			continue;
 
-	str_format(aBuf, sizeof(aBuf), "\t{\"%s\", {0x%02x, 0x%02x, 0x%02x, 0x%02x}, {0x%02x, 0x%02x, 0x%02x, 0x%02x}, {0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x}}, \n", aMapName,
-		(MapCrc>>24)&0xff, (MapCrc>>16)&0xff, (MapCrc>>8)&0xff, MapCrc&0xff,
-		(MapSize>>24)&0xff, (MapSize>>16)&0xff, (MapSize>>8)&0xff, MapSize&0xff,
-		MapSha256.data[0], MapSha256.data[1], MapSha256.data[2], MapSha256.data[3], MapSha256.data[4], MapSha256.data[5], MapSha256.data[6], MapSha256.data[7],
-		MapSha256.data[8], MapSha256.data[9], MapSha256.data[10], MapSha256.data[11], MapSha256.data[12], MapSha256.data[13], MapSha256.data[14], MapSha256.data[15],
-		MapSha256.data[16], MapSha256.data[17], MapSha256.data[18], MapSha256.data[19], MapSha256.data[20], MapSha256.data[21], MapSha256.data[22], MapSha256.data[23],
-		MapSha256.data[24], MapSha256.data[25], MapSha256.data[26], MapSha256.data[27], MapSha256.data[28], MapSha256.data[29], MapSha256.data[30], MapSha256.data[31]);
-io_write(s_File, aBuf, str_length(aBuf));
+		const unsigned MapCrc = pMap->m_Crc;
+		const unsigned MapSize = pMap->m_Size;
+		const SHA256_DIGEST MapSha256 = pMap->m_Sha256;
+		char aMapName[8];
+		str_copy(aMapName, pMap->m_aName, min((int)sizeof(aMapName), str_length(pMap->m_aName)-3));
 
-	return 0;
+		char aBuf[512];
+		str_format(aBuf, sizeof(aBuf), "\t{\"%s\", {0x%02x, 0x%02x, 0x%02x, 0x%02x}, {0x%02x, 0x%02x, 0x%02x, 0x%02x}, {0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x, 0x%02x}}, \n", aMapName,
+			(MapCrc>>24)&0xff, (MapCrc>>16)&0xff, (MapCrc>>8)&0xff, MapCrc&0xff,
+			(MapSize>>24)&0xff, (MapSize>>16)&0xff, (MapSize>>8)&0xff, MapSize&0xff,
+			MapSha256.data[0], MapSha256.data[1], MapSha256.data[2], MapSha256.data[3], MapSha256.data[4], MapSha256.data[5], MapSha256.data[6], MapSha256.data[7],
+			MapSha256.data[8], MapSha256.data[9], MapSha256.data[10], MapSha256.data[11], MapSha256.data[12], MapSha256.data[13], MapSha256.data[14], MapSha256.data[15],
+			MapSha256.data[16], MapSha256.data[17], MapSha256.data[18], MapSha256.data[19], MapSha256.data[20], MapSha256.data[21], MapSha256.data[22], MapSha256.data[23],
+			MapSha256.data[24], MapSha256.data[25], MapSha256.data[26], MapSha256.data[27], MapSha256.data[28], MapSha256.data[29], MapSha256.data[30], MapSha256.data[31]);
+		io_write(File, aBuf, str_length(aBuf));
+	}
+	io_write(File, "};\n", str_length("};\n"));
 }
 
 int main(int argc, const char **argv) // ignore_convention
 {
-	IKernel *pKernel = IKernel::Create();
-	s_pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv);
-	s_pEngineMap = CreateEngineMap();
+	dbg_logger_stdout();
+	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv);
+	int NumThreads = cpu_count()-1;
+	const char *pSummary = 0;
+	const char *pFolder = "maps";
+	int StorageType = 1;
 
-	bool RegisterFail = !pKernel->RegisterInterface(s_pStorage);
-	RegisterFail |= !pKernel->RegisterInterface(s_pEngineMap);
+	while(argc > 2 && argv[1][0] == '-')
+	{
+		if(str_comp(argv[1], "-j") == 0)
+			NumThreads = str_toint(argv[2])-1;
+		else if(str_comp(argv[1], "-summary") == 0)
+			pSummary = argv[2];
+		else if(str_comp(argv[1], "-dir") == 0)
+		{
+			// any folder of the storage, not only the maps of the data folder
+			pFolder = argv[2];
+			StorageType = IStorage::TYPE_ALL;
+		}
+		else
+			break;
+		argc -= 2;
+		argv += 2;
+	}
 
-	if(RegisterFail)
+	if(!pStorage || argc != 1)
+	{
+		dbg_msg("map_version", "usage: map_version [-j <threads>] [-summary <json file>] [-dir <folder>]");
 		return -1;
+	}
 
-	s_File = s_pStorage->OpenFile("map_version.txt", IOFLAG_WRITE, 1);
-	if(s_File)
+	CJobPool Pool;
+	Pool.Init(max(NumThreads, 0));
+	CMapBatch Batch;
+	int Failed = Batch.Run(pStorage, &Pool, pFolder, StorageType, CheckMap, pStorage);
+	dbg_msg("map_version", "%d maps, %d failed", Batch.NumMaps(), Failed);
+
+	IOHANDLE File = pStorage->OpenFile("map_version.txt", IOFLAG_WRITE, 1);
+	if(File)
 	{
-		io_write(s_File, "static CMapVersion s_aMapVersionList[] = {\n", str_length("static CMapVersion s_aMapVersionList[] = {\n"));
-		s_pStorage->ListDirectory(1, "maps", MaplistCallback, 0);
-		io_write(s_File, "};\n", str_length("};\n"));
-		io_close(s_File);
+		WriteVersionList(File, &Batch);
+		io_close(File);
 	}
 
-	return 0;
+	if(pSummary && !Batch.WriteSummary(pSummary, IStorage::TYPE_SAVE))
+	{
+		dbg_msg("map_version", "failed to write '%s'", pSummary);
+		return -1;
+	}
+	return Failed ? -1 : 0;
 }
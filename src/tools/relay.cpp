@@ -0,0 +1,1036 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/hash_ctxt.h>
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/message.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/config.h>
+#include <engine/shared/network.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+#include <generated/protocol.h>
+#include <game/version.h>
+
+/*
+	Spectator relay. It joins a game server as a relay (sv_relay_password
+	there), gets the snapshots of the whole world and serves them to
+	spectators of its own. They take neither slots nor snapshot building
+	time on the game server, a bigger audience just needs more relays.
+
+	The spectators see the game as the spectating player of the relay and
+	pick whom to follow themselves, anything else they send is dropped.
+
+	usage: relay [-p port] [-n max spectators] [-w relay password] [-name name] address[:port]
+*/
+
+static CConfig *s_pConfig;
+static CSnapshotDelta *s_pSnapshotDelta;
+static CNetObjHandler s_NetObjHandler;
+
+class CRelay
+{
+	enum
+	{
+		UPSTREAM_OFFLINE=0,
+		UPSTREAM_CONNECTING,
+		UPSTREAM_LOADING,
+		UPSTREAM_CONNECTED,
+		UPSTREAM_INGAME,
+
+		SPECTATOR_EMPTY=0,
+		SPECTATOR_AUTH,
+		SPECTATOR_LOADING,
+		SPECTATOR_READY,
+		SPECTATOR_INGAME,
+
+		MAP_CHUNK_SIZE=NET_MAX_PAYLOAD-NET_MAX_CHUNKHEADERSIZE-4, // msg type
+		MAP_CHUNKS_PER_REQUEST=8,
+		SNAP_HISTORY=SERVER_TICK_SPEED*3, // ticks the snapshots are kept to make deltas against
+		RECONNECT_DELAY=3, // seconds
+	};
+
+	// the messages everyone gets on joining, the latest of each type
+	enum
+	{
+		CACHED_MOTD=0,
+		CACHED_SERVERSETTINGS,
+		CACHED_TUNEPARAMS,
+		CACHED_GAMEINFO,
+		NUM_CACHED_MSGS
+	};
+
+	struct CCachedMsg
+	{
+		int m_Size;
+		unsigned char m_aData[NET_MAX_PAYLOAD];
+	};
+
+	struct CClientInfo
+	{
+		bool m_Active;
+		int m_Team;
+		char m_aName[MAX_NAME_ARRAY_SIZE];
+		char m_aClan[MAX_CLAN_ARRAY_SIZE];
+		int m_Country;
+		char m_aaSkinPartNames[NUM_SKINPARTS][MAX_SKIN_ARRAY_SIZE];
+		int m_aUseCustomColors[NUM_SKINPARTS];
+		int m_aSkinPartColors[NUM_SKINPARTS];
+	};
+
+	struct CSpectator
+	{
+		int m_State;
+		int m_MapChunk;
+		int m_MapChunksPerRequest;
+		int m_AckedTick;
+		int m_LastInputTick;
+		int m_SpecMode;
+		int m_SpectatorID;
+		int m_ViewX;
+		int m_ViewY;
+		// the spectator infos of the sent snapshots, a delta base is the world snapshot with it
+		CNetObj_SpectatorInfo m_aSentInfos[SNAP_HISTORY];
+		int m_aSentTicks[SNAP_HISTORY];
+	};
+
+	CNetServer m_Net;
+	CSpectator m_aSpectators[NET_MAX_CLIENTS];
+
+	// game server
+	CNetClient m_Upstream;
+	NETADDR m_UpstreamAddr;
+	char m_aPassword[128];
+	char m_aName[MAX_NAME_LENGTH];
+	int m_UpstreamState;
+	int64 m_NextConnect;
+
+	// the map, served from memory once it's complete
+	char m_aMapName[128];
+	int m_MapCrc;
+	int m_MapSize;
+	SHA256_DIGEST m_MapSha256;
+	unsigned char *m_pMapData;
+	int m_MapAmount;
+	int m_MapChunk;
+	int m_MapChunkNum;
+	int m_MapChunkSize;
+	bool m_MapReady;
+
+	// world snapshots
+	CSnapshotStorage m_Snapshots;
+	char m_aSnapshotIncomingData[CSnapshot::MAX_SIZE];
+	unsigned m_SnapshotParts;
+	int m_CurrentRecvTick;
+	int m_AckGameTick;
+	int m_LatestTick;
+	int64 m_LatestTickTime;
+	int m_PredOffset;
+	int m_LastInputTick;
+
+	CCachedMsg m_aCachedMsgs[NUM_CACHED_MSGS];
+	CClientInfo m_aClientInfos[MAX_CLIENTS];
+	int m_LocalClientID;
+
+	static int NewSpectatorCallback(int ClientID, void *pUser);
+	static int DelSpectatorCallback(int ClientID, const char *pReason, void *pUser);
+
+	void SendUpstream(CMsgPacker *pMsg, int Flags);
+	void SendSpectator(int ClientID, const void *pData, int Size, int Flags);
+	void SendSpectator(int ClientID, CMsgPacker *pMsg, int Flags) { SendSpectator(ClientID, pMsg->Data(), pMsg->Size(), Flags); }
+
+	void ResetUpstream();
+	void UpdateUpstream(int64 Now);
+	void SendUpstreamInput(int64 Now);
+	void OnUpstreamSystemMessage(int Msg, CUnpacker *pUnpacker, bool Vital, int64 Now);
+	void OnUpstreamGameMessage(int Msg, CUnpacker *pUnpacker, const CNetChunk *pPacket);
+	void OnUpstreamSnapshot(int GameTick, int DeltaTick, int CompleteSize, int Crc, bool Empty, int64 Now);
+
+	void UpdateSpectators(int64 Now);
+	void OnSpectatorMessage(int ClientID, const CNetChunk *pPacket, int64 Now);
+	void SendMap(int ClientID);
+	void SendMapData(int ClientID);
+	void SendClientInfos(int ClientID);
+	void UpdateView(CSpectator *pSpectator, const CSnapshot *pWorld);
+	int BuildSnapshot(const CSnapshot *pWorld, const CNetObj_SpectatorInfo *pInfo, CSnapshot *pOut);
+	void SendSnapshot(int ClientID, int Tick, const CSnapshot *pWorld);
+
+public:
+	CRelay();
+	~CRelay();
+	bool Init(int Port, int MaxSpectators, const NETADDR *pUpstreamAddr, const char *pPassword, const char *pName);
+	void Update();
+	void Close();
+};
+
+CRelay::CRelay()
+{
+	m_pMapData = 0;
+}
+
+CRelay::~CRelay()
+{
+	if(m_pMapData)
+		mem_free(m_pMapData);
+}
+
+bool CRelay::Init(int Port, int MaxSpectators, const NETADDR *pUpstreamAddr, const char *pPassword, const char *pName)
+{
+	NETADDR BindAddr;
+	mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = NETTYPE_ALL;
+	if(!m_Upstream.Open(BindAddr, s_pConfig, 0, 0, NETCREATE_FLAG_RANDOMPORT))
+		return false;
+	BindAddr.port = Port;
+	if(!m_Net.Open(BindAddr, s_pConfig, 0, 0, 0, MaxSpectators, MaxSpectators, NewSpectatorCallback, DelSpectatorCallback, this))
+		return false;
+
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+		m_aSpectators[i].m_State = SPECTATOR_EMPTY;
+	m_UpstreamAddr = *pUpstreamAddr;
+	str_copy(m_aPassword, pPassword, sizeof(m_aPassword));
+	str_copy(m_aName, pName, sizeof(m_aName));
+	m_UpstreamState = UPSTREAM_OFFLINE;
+	m_NextConnect = 0;
+	m_MapReady = false;
+	m_Snapshots.Init();
+	ResetUpstream();
+	return true;
+}
+
+void CRelay::Close()
+{
+	m_Upstream.Close();
+	m_Net.Close();
+}
+
+void CRelay::ResetUpstream()
+{
+	m_SnapshotParts = 0;
+	m_CurrentRecvTick = 0;
+	m_AckGameTick = -1;
+	m_LatestTick = -1;
+	m_LatestTickTime = 0;
+	m_PredOffset = 2;
+	m_LastInputTick = 0;
+	m_LocalClientID = -1;
+	m_Snapshots.PurgeAll();
+	for(int i = 0; i < NUM_CACHED_MSGS; i++)
+		m_aCachedMsgs[i].m_Size = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		m_aClientInfos[i].m_Active = false;
+}
+
+int CRelay::NewSpectatorCallback(int ClientID, void *pUser)
+{
+	CRelay *pThis = (CRelay *)pUser;
+	CSpectator *pSpectator = &pThis->m_aSpectators[ClientID];
+	pSpectator->m_State = SPECTATOR_AUTH;
+	pSpectator->m_MapChunk = 0;
+	pSpectator->m_MapChunksPerRequest = MAP_CHUNKS_PER_REQUEST;
+	pSpectator->m_AckedTick = -1;
+	pSpectator->m_LastInputTick = -1;
+	pSpectator->m_SpecMode = SPEC_FREEVIEW;
+	pSpectator->m_SpectatorID = -1;
+	pSpectator->m_ViewX = 0;
+	pSpectator->m_ViewY = 0;
+	for(int i = 0; i < SNAP_HISTORY; i++)
+		pSpectator->m_aSentTicks[i] = -1;
+	return 0;
+}
+
+int CRelay::DelSpectatorCallback(int ClientID, const char *pReason, void *pUser)
+{
+	CRelay *pThis = (CRelay *)pUser;
+	pThis->m_aSpectators[ClientID].m_State = SPECTATOR_EMPTY;
+	return 0;
+}
+
+void CRelay::SendUpstream(CMsgPacker *pMsg, int Flags)
+{
+	CNetChunk Packet;
+	mem_zero(&Packet, sizeof(Packet));
+	Packet.m_ClientID = 0;
+	Packet.m_pData = pMsg->Data();
+	Packet.m_DataSize = pMsg->Size();
+	if(Flags&MSGFLAG_VITAL)
+		Packet.m_Flags |= NETSENDFLAG_VITAL;
+	if(Flags&MSGFLAG_FLUSH)
+		Packet.m_Flags |= NETSENDFLAG_FLUSH;
+	m_Upstream.Send(&Packet);
+}
+
+void CRelay::SendSpectator(int ClientID, const void *pData, int Size, int Flags)
+{
+	CNetChunk Packet;
+	mem_zero(&Packet, sizeof(Packet));
+	Packet.m_ClientID = ClientID;
+	Packet.m_pData = pData;
+	Packet.m_DataSize = Size;
+	if(Flags&MSGFLAG_VITAL)
+		Packet.m_Flags |= NETSENDFLAG_VITAL;
+	if(Flags&MSGFLAG_FLUSH)
+		Packet.m_Flags |= NETSENDFLAG_FLUSH;
+	m_Net.Send(&Packet);
+}
+
+void CRelay::Update()
+{
+	int64 Now = time_get();
+	UpdateUpstream(Now);
+	UpdateSpectators(Now);
+}
+
+void CRelay::UpdateUpstream(int64 Now)
+{
+	if(m_UpstreamState == UPSTREAM_OFFLINE)
+	{
+		if(Now < m_NextConnect)
+			return;
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&m_UpstreamAddr, aAddrStr, sizeof(aAddrStr), true);
+		dbg_msg("relay", "connecting to %s", aAddrStr);
+		ResetUpstream();
+		m_Upstream.Connect(&m_UpstreamAddr);
+		m_UpstreamState = UPSTREAM_CONNECTING;
+	}
+
+	m_Upstream.Update();
+	if(m_Upstream.State() == NETSTATE_OFFLINE)
+	{
+		// the spectators can't follow the game without it
+		dbg_msg("relay", "lost the game server: %s", m_Upstream.ErrorString());
+		for(int i = 0; i < NET_MAX_CLIENTS; i++)
+			if(m_aSpectators[i].m_State != SPECTATOR_EMPTY)
+				m_Net.Drop(i, "Relay lost the game server");
+		m_Upstream.ResetErrorString();
+		m_UpstreamState = UPSTREAM_OFFLINE;
+		m_MapReady = false;
+		m_NextConnect = Now + RECONNECT_DELAY*time_freq();
+		return;
+	}
+
+	if(m_UpstreamState == UPSTREAM_CONNECTING && m_Upstream.State() == NETSTATE_ONLINE)
+	{
+		m_UpstreamState = UPSTREAM_LOADING;
+		CMsgPacker Msg(NETMSG_INFO, true);
+		Msg.AddString(GAME_NETVERSION, 128);
+		Msg.AddString(m_aPassword, 128);
+		Msg.AddInt(CLIENT_VERSION);
+		Msg.AddInt(CLIENTCAP_RELAY);
+		SendUpstream(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+	}
+
+	CNetChunk Packet;
+	while(m_UpstreamState != UPSTREAM_OFFLINE && m_Upstream.Recv(&Packet))
+	{
+		if(Packet.m_ClientID == -1)
+			continue;
+
+		CUnpacker Unpacker;
+		Unpacker.Reset(Packet.m_pData, Packet.m_DataSize);
+		int Msg = Unpacker.GetInt();
+		if(Unpacker.Error())
+			continue;
+		if(Msg&1)
+			OnUpstreamSystemMessage(Msg>>1, &Unpacker, (Packet.m_Flags&NET_CHUNKFLAG_VITAL) != 0, Now);
+		else
+			OnUpstreamGameMessage(Msg>>1, &Unpacker, &Packet);
+	}
+
+	if(m_UpstreamState == UPSTREAM_INGAME && m_AckGameTick > 0)
+		SendUpstreamInput(Now);
+}
+
+void CRelay::SendUpstreamInput(int64 Now)
+{
+	// the server wants an input now and then to take the acks, the relay's player doesn't move
+	int PredTick = m_LatestTick + (int)((Now-m_LatestTickTime)*SERVER_TICK_SPEED/time_freq()) + m_PredOffset;
+	if(PredTick <= m_LastInputTick)
+		return;
+	m_LastInputTick = PredTick;
+
+	CNetObj_PlayerInput Input;
+	mem_zero(&Input, sizeof(Input));
+	CMsgPacker Msg(NETMSG_INPUT, true);
+	Msg.AddInt(m_AckGameTick);
+	Msg.AddInt(PredTick);
+	Msg.AddInt(sizeof(Input));
+	const int *pData = (const int *)&Input;
+	for(unsigned i = 0; i < sizeof(Input)/sizeof(int); i++)
+		Msg.AddInt(pData[i]);
+	Msg.AddInt(0);
+	SendUpstream(&Msg, MSGFLAG_FLUSH);
+}
+
+void CRelay::OnUpstreamSystemMessage(int Msg, CUnpacker *pUnpacker, bool Vital, int64 Now)
+{
+	if(Vital && Msg == NETMSG_MAP_CHANGE)
+	{
+		const char *pMap = pUnpacker->GetString(CUnpacker::SANITIZE_CC|CUnpacker::SKIP_START_WHITESPACES);
+		int MapCrc = pUnpacker->GetInt();
+		int MapSize = pUnpacker->GetInt();
+		int MapChunkNum = pUnpacker->GetInt();
+		int MapChunkSize = pUnpacker->GetInt();
+		const SHA256_DIGEST *pSha256 = (const SHA256_DIGEST *)pUnpacker->GetRaw(sizeof(SHA256_DIGEST));
+		if(pUnpacker->Error() || MapSize <= 0 || MapChunkNum <= 0 || MapChunkSize <= 0)
+		{
+			m_Upstream.Disconnect("bad map change");
+			return;
+		}
+
+		// everyone loads the new map, the game starts over with it
+		dbg_msg("relay", "downloading map '%s' (%d bytes)", pMap, MapSize);
+		ResetUpstream();
+		str_copy(m_aMapName, pMap, sizeof(m_aMapName));
+		m_MapCrc = MapCrc;
+		m_MapSize = MapSize;
+		m_MapSha256 = *pSha256;
+		m_MapChunkNum = MapChunkNum;
+		m_MapChunkSize = MapChunkSize;
+		m_MapChunk = 0;
+		m_MapAmount = 0;
+		m_MapReady = false;
+		if(m_pMapData)
+			mem_free(m_pMapData);
+		m_pMapData = (unsigned char *)mem_alloc(MapSize, 1);
+		for(int i = 0; i < NET_MAX_CLIENTS; i++)
+			if(m_aSpectators[i].m_State > SPECTATOR_AUTH)
+				m_aSpectators[i].m_State = SPECTATOR_LOADING;
+
+		m_UpstreamState = UPSTREAM_LOADING;
+		CMsgPacker Request(NETMSG_REQUEST_MAP_DATA, true);
+		SendUpstream(&Request, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+	}
+	else if(Vital && Msg == NETMSG_MAP_DATA && m_UpstreamState == UPSTREAM_LOADING && m_pMapData)
+	{
+		int Size = min(m_MapChunkSize, m_MapSize-m_MapAmount);
+		const unsigned char *pData = pUnpacker->GetRaw(Size);
+		if(pUnpacker->Error())
+			return;
+
+		mem_copy(m_pMapData+m_MapAmount, pData, Size);
+		m_MapAmount += Size;
+		m_MapChunk++;
+		if(m_MapAmount == m_MapSize)
+		{
+			SHA256_CTX Sha256Ctx;
+			sha256_init(&Sha256Ctx);
+			sha256_update(&Sha256Ctx, m_pMapData, m_MapSize);
+			if(sha256_comp(sha256_finish(&Sha256Ctx), m_MapSha256) != 0)
+			{
+				m_Upstream.Disconnect("map sha256 mismatch");
+				return;
+			}
+
+			m_MapReady = true;
+			m_UpstreamState = UPSTREAM_CONNECTED;
+			CMsgPacker Ready(NETMSG_READY, true);
+			SendUpstream(&Ready, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+
+			// the spectators that waited for it get it now
+			for(int i = 0; i < NET_MAX_CLIENTS; i++)
+				if(m_aSpectators[i].m_State == SPECTATOR_LOADING)
+					SendMap(i);
+		}
+		else if(m_MapChunk%m_MapChunkNum == 0)
+		{
+			CMsgPacker Request(NETMSG_REQUEST_MAP_DATA, true);
+			SendUpstream(&Request, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+		}
+	}
+	else if(Vital && Msg == NETMSG_CON_READY)
+	{
+		static const char *s_apSkinParts[NUM_SKINPARTS] = {"standard", "", "", "standard", "standard", "standard"};
+		CNetMsg_Cl_StartInfo StartInfo;
+		StartInfo.m_pName = m_aName;
+		StartInfo.m_pClan = "";
+		StartInfo.m_Country = -1;
+		for(int p = 0; p < NUM_SKINPARTS; p++)
+		{
+			StartInfo.m_apSkinPartNames[p] = s_apSkinParts[p];
+			StartInfo.m_aUseCustomColors[p] = 0;
+			StartInfo.m_aSkinPartColors[p] = 0;
+		}
+		CMsgPacker Packer(StartInfo.MsgID(), false);
+		StartInfo.Pack(&Packer);
+		SendUpstream(&Packer, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+	}
+	else if(Msg == NETMSG_PING)
+	{
+		CMsgPacker Reply(NETMSG_PING_REPLY, true);
+		SendUpstream(&Reply, 0);
+	}
+	else if(Msg == NETMSG_INPUTTIMING)
+	{
+		pUnpacker->GetInt();
+		int TimeLeft = pUnpacker->GetInt();
+		if(pUnpacker->Error())
+			return;
+		if(TimeLeft < 10)
+			m_PredOffset++;
+		else if(TimeLeft > 60 && m_PredOffset > 1)
+			m_PredOffset--;
+	}
+	else if((Msg == NETMSG_SNAP || Msg == NETMSG_SNAPSINGLE || Msg == NETMSG_SNAPEMPTY) && m_UpstreamState == UPSTREAM_INGAME)
+	{
+		int NumParts = 1;
+		int Part = 0;
+		int GameTick = pUnpacker->GetInt();
+		int DeltaTick = GameTick-pUnpacker->GetInt();
+		int Crc = 0;
+		int PartSize = 0;
+		if(Msg == NETMSG_SNAP)
+		{
+			NumParts = pUnpacker->GetInt();
+			Part = pUnpacker->GetInt();
+		}
+		if(Msg != NETMSG_SNAPEMPTY)
+		{
+			Crc = pUnpacker->GetInt();
+			PartSize = pUnpacker->GetInt();
+		}
+		const char *pData = (const char *)pUnpacker->GetRaw(PartSize);
+		if(pUnpacker->Error() || NumParts < 1 || NumParts > CSnapshot::MAX_PARTS || Part < 0 || Part >= NumParts || PartSize < 0 || PartSize > MAX_SNAPSHOT_PACKSIZE)
+			return;
+		if(GameTick < m_CurrentRecvTick)
+			return;
+
+		if(GameTick != m_CurrentRecvTick)
+		{
+			m_SnapshotParts = 0;
+			m_CurrentRecvTick = GameTick;
+		}
+		mem_copy(m_aSnapshotIncomingData + Part*MAX_SNAPSHOT_PACKSIZE, pData, PartSize);
+		m_SnapshotParts |= 1<<Part;
+		if(m_SnapshotParts == (unsigned)((1<<NumParts)-1))
+		{
+			m_SnapshotParts = 0;
+			OnUpstreamSnapshot(GameTick, DeltaTick, (NumParts-1)*MAX_SNAPSHOT_PACKSIZE+PartSize, Crc, Msg == NETMSG_SNAPEMPTY, Now);
+		}
+	}
+}
+
+void CRelay::OnUpstreamGameMessage(int Msg, CUnpacker *pUnpacker, const CNetChunk *pPacket)
+{
+	if(Msg == NETMSGTYPE_SV_READYTOENTER)
+	{
+		if(m_UpstreamState == UPSTREAM_CONNECTED)
+		{
+			m_UpstreamState = UPSTREAM_INGAME;
+			CMsgPacker EnterGame(NETMSG_ENTERGAME, true);
+			SendUpstream(&EnterGame, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+			dbg_msg("relay", "entered the game");
+		}
+		return;
+	}
+	// vote options are for the relay's player alone, the spectators can't vote
+	if(Msg == NETMSGTYPE_SV_VOTECLEAROPTIONS || Msg == NETMSGTYPE_SV_VOTEOPTIONLISTADD ||
+		Msg == NETMSGTYPE_SV_VOTEOPTIONADD || Msg == NETMSGTYPE_SV_VOTEOPTIONREMOVE)
+		return;
+
+	// keep what a spectator needs on joining
+	int Cached = -1;
+	if(Msg == NETMSGTYPE_SV_MOTD)
+		Cached = CACHED_MOTD;
+	else if(Msg == NETMSGTYPE_SV_SERVERSETTINGS)
+		Cached = CACHED_SERVERSETTINGS;
+	else if(Msg == NETMSGTYPE_SV_TUNEPARAMS)
+		Cached = CACHED_TUNEPARAMS;
+	else if(Msg == NETMSGTYPE_SV_GAMEINFO)
+		Cached = CACHED_GAMEINFO;
+	if(Cached >= 0)
+	{
+		m_aCachedMsgs[Cached].m_Size = min(pPacket->m_DataSize, (int)sizeof(m_aCachedMsgs[Cached].m_aData));
+		mem_copy(m_aCachedMsgs[Cached].m_aData, pPacket->m_pData, m_aCachedMsgs[Cached].m_Size);
+	}
+	else if(Msg == NETMSGTYPE_SV_CLIENTINFO || Msg == NETMSGTYPE_SV_TEAM || Msg == NETMSGTYPE_SV_SKINCHANGE || Msg == NETMSGTYPE_SV_CLIENTDROP)
+	{
+		CUnpacker Unpacker = *pUnpacker;
+		void *pRawMsg = s_NetObjHandler.SecureUnpackMsg(Msg, &Unpacker);
+		if(!pRawMsg)
+			return;
+
+		if(Msg == NETMSGTYPE_SV_CLIENTINFO)
+		{
+			const CNetMsg_Sv_ClientInfo *pMsg = (const CNetMsg_Sv_ClientInfo *)pRawMsg;
+			CClientInfo *pInfo = &m_aClientInfos[pMsg->m_ClientID];
+			pInfo->m_Active = true;
+			pInfo->m_Team = pMsg->m_Team;
+			str_copy(pInfo->m_aName, pMsg->m_pName, sizeof(pInfo->m_aName));
+			str_copy(pInfo->m_aClan, pMsg->m_pClan, sizeof(pInfo->m_aClan));
+			pInfo->m_Country = pMsg->m_Country;
+			for(int p = 0; p < NUM_SKINPARTS; p++)
+			{
+				str_copy(pInfo->m_aaSkinPartNames[p], pMsg->m_apSkinPartNames[p], sizeof(pInfo->m_aaSkinPartNames[p]));
+				pInfo->m_aUseCustomColors[p] = pMsg->m_aUseCustomColors[p];
+				pInfo->m_aSkinPartColors[p] = pMsg->m_aSkinPartColors[p];
+			}
+			if(pMsg->m_Local)
+				m_LocalClientID = pMsg->m_ClientID;
+		}
+		else if(Msg == NETMSGTYPE_SV_TEAM)
+		{
+			const CNetMsg_Sv_Team *pMsg = (const CNetMsg_Sv_Team *)pRawMsg;
+			if(pMsg->m_ClientID >= 0)
+				m_aClientInfos[pMsg->m_ClientID].m_Team = pMsg->m_Team;
+		}
+		else if(Msg == NETMSGTYPE_SV_SKINCHANGE)
+		{
+			const CNetMsg_Sv_SkinChange *pMsg = (const CNetMsg_Sv_SkinChange *)pRawMsg;
+			CClientInfo *pInfo = &m_aClientInfos[pMsg->m_ClientID];
+			for(int p = 0; p < NUM_SKINPARTS; p++)
+			{
+				str_copy(pInfo->m_aaSkinPartNames[p], pMsg->m_apSkinPartNames[p], sizeof(pInfo->m_aaSkinPartNames[p]));
+				pInfo->m_aUseCustomColors[p] = pMsg->m_aUseCustomColors[p];
+				pInfo->m_aSkinPartColors[p] = pMsg->m_aSkinPartColors[p];
+			}
+		}
+		else
+			m_aClientInfos[((const CNetMsg_Sv_ClientDrop *)pRawMsg)->m_ClientID].m_Active = false;
+	}
+
+	// everything else goes to the spectators as it is
+	int Flags = (pPacket->m_Flags&NET_CHUNKFLAG_VITAL) ? MSGFLAG_VITAL : 0;
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+		if(m_aSpectators[i].m_State == SPECTATOR_INGAME)
+			SendSpectator(i, pPacket->m_pData, pPacket->m_DataSize, Flags);
+}
+
+void CRelay::OnUpstreamSnapshot(int GameTick, int DeltaTick, int CompleteSize, int Crc, bool Empty, int64 Now)
+{
+	static CSnapshot s_EmptySnap;
+	CSnapshot *pDeltaShot = &s_EmptySnap;
+	s_EmptySnap.Clear();
+	if(DeltaTick >= 0 && m_Snapshots.Get(DeltaTick, 0, &pDeltaShot, 0) < 0)
+	{
+		// the delta base is gone, make the server send a full snapshot
+		m_AckGameTick = -1;
+		return;
+	}
+
+	unsigned char aDeltaData[CSnapshot::MAX_SIZE];
+	unsigned char aSnap[CSnapshot::MAX_SIZE];
+	const void *pDeltaData = s_pSnapshotDelta->EmptyDelta();
+	int DeltaSize = sizeof(int)*3;
+	if(CompleteSize)
+	{
+		DeltaSize = CVariableInt::Decompress(m_aSnapshotIncomingData, CompleteSize, aDeltaData, sizeof(aDeltaData));
+		if(DeltaSize < 0)
+			return;
+		pDeltaData = aDeltaData;
+	}
+
+	CSnapshot *pSnap = (CSnapshot *)aSnap;
+	int SnapSize = s_pSnapshotDelta->UnpackDelta(pDeltaShot, pSnap, pDeltaData, DeltaSize);
+	if(SnapSize < 0 || (!Empty && pSnap->Crc() != Crc))
+	{
+		m_AckGameTick = -1;
+		return;
+	}
+
+	// keep the delta base of the server and the ones the spectators might have acked
+	int Oldest = GameTick-SNAP_HISTORY;
+	if(DeltaTick >= 0)
+		Oldest = min(Oldest, DeltaTick);
+	m_Snapshots.PurgeUntil(Oldest);
+	m_Snapshots.Add(GameTick, Now, SnapSize, pSnap, 0);
+	m_AckGameTick = GameTick;
+	m_LatestTick = GameTick;
+	m_LatestTickTime = Now;
+
+	CSnapshot *pWorld;
+	m_Snapshots.Get(GameTick, 0, &pWorld, 0);
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+		if(m_aSpectators[i].m_State == SPECTATOR_INGAME)
+			SendSnapshot(i, GameTick, pWorld);
+}
+
+void CRelay::UpdateSpectators(int64 Now)
+{
+	m_Net.Update();
+
+	CNetChunk Packet;
+	TOKEN ResponseToken;
+	while(m_Net.Recv(&Packet, &ResponseToken))
+	{
+		if(Packet.m_Flags&NETSENDFLAG_CONNLESS)
+			continue;
+		OnSpectatorMessage(Packet.m_ClientID, &Packet, Now);
+	}
+}
+
+void CRelay::OnSpectatorMessage(int ClientID, const CNetChunk *pPacket, int64 Now)
+{
+	CSpectator *pSpectator = &m_aSpectators[ClientID];
+	CUnpacker Unpacker;
+	Unpacker.Reset(pPacket->m_pData, pPacket->m_DataSize);
+	int Msg = Unpacker.GetInt();
+	bool Sys = Msg&1;
+	Msg >>= 1;
+	bool Vital = (pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0;
+	if(Unpacker.Error())
+		return;
+
+	if(Sys)
+	{
+		if(Vital && Msg == NETMSG_INFO && pSpectator->m_State == SPECTATOR_AUTH)
+		{
+			const char *pVersion = Unpacker.GetString(CUnpacker::SANITIZE_CC);
+			if(str_comp(pVersion, GAME_NETVERSION) != 0)
+			{
+				char aReason[256];
+				str_format(aReason, sizeof(aReason), "Wrong version. Relay is running '%s' and client '%s'", GAME_NETVERSION, pVersion);
+				m_Net.Drop(ClientID, aReason);
+				return;
+			}
+			pSpectator->m_State = SPECTATOR_LOADING;
+			if(m_MapReady)
+				SendMap(ClientID);
+		}
+		else if(Vital && Msg == NETMSG_REQUEST_MAP_DATA && pSpectator->m_State == SPECTATOR_LOADING && m_MapReady)
+		{
+			int Chunk = Unpacker.GetInt();
+			int NumChunks = Unpacker.GetInt();
+			if(!Unpacker.Error() && Chunk >= 0)
+			{
+				pSpectator->m_MapChunk = Chunk;
+				pSpectator->m_MapChunksPerRequest = clamp(NumChunks, 1, (int)MAX_MAP_CHUNKS_PER_REQUEST);
+			}
+			SendMapData(ClientID);
+		}
+		else if(Vital && Msg == NETMSG_READY && pSpectator->m_State == SPECTATOR_LOADING && m_MapReady)
+		{
+			pSpectator->m_State = SPECTATOR_READY;
+			CMsgPacker Ready(NETMSG_CON_READY, true);
+			SendSpectator(ClientID, &Ready, MSGFLAG_VITAL);
+			if(m_aCachedMsgs[CACHED_MOTD].m_Size)
+				SendSpectator(ClientID, m_aCachedMsgs[CACHED_MOTD].m_aData, m_aCachedMsgs[CACHED_MOTD].m_Size, MSGFLAG_VITAL);
+			if(m_aCachedMsgs[CACHED_SERVERSETTINGS].m_Size)
+				SendSpectator(ClientID, m_aCachedMsgs[CACHED_SERVERSETTINGS].m_aData, m_aCachedMsgs[CACHED_SERVERSETTINGS].m_Size, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+		}
+		else if(Vital && Msg == NETMSG_ENTERGAME && pSpectator->m_State == SPECTATOR_READY)
+		{
+			pSpectator->m_State = SPECTATOR_INGAME;
+			pSpectator->m_AckedTick = -1;
+			if(m_aCachedMsgs[CACHED_GAMEINFO].m_Size)
+				SendSpectator(ClientID, m_aCachedMsgs[CACHED_GAMEINFO].m_aData, m_aCachedMsgs[CACHED_GAMEINFO].m_Size, MSGFLAG_VITAL);
+			SendClientInfos(ClientID);
+		}
+		else if(Msg == NETMSG_INPUT && pSpectator->m_State == SPECTATOR_INGAME)
+		{
+			int AckedTick = Unpacker.GetInt();
+			int IntendedTick = Unpacker.GetInt();
+			int Size = Unpacker.GetInt();
+			if(Unpacker.Error() || Size/4 > MAX_INPUT_SIZE)
+				return;
+			int aData[MAX_INPUT_SIZE] = {0};
+			for(int i = 0; i < Size/4; i++)
+				aData[i] = Unpacker.GetInt();
+			if(Unpacker.Error())
+				return;
+
+			if(AckedTick > pSpectator->m_AckedTick)
+				pSpectator->m_AckedTick = AckedTick;
+
+			// the client sets its clock by how early its inputs arrive, time them against the ticks as they reach the relay
+			if(IntendedTick > pSpectator->m_LastInputTick && m_LatestTick >= 0)
+			{
+				int64 TickTime = m_LatestTickTime + (int64)(IntendedTick-m_LatestTick)*time_freq()/SERVER_TICK_SPEED;
+				CMsgPacker Timing(NETMSG_INPUTTIMING, true);
+				Timing.AddInt(IntendedTick);
+				Timing.AddInt((int)((TickTime-Now)*1000/time_freq()));
+				SendSpectator(ClientID, &Timing, 0);
+			}
+			pSpectator->m_LastInputTick = max(pSpectator->m_LastInputTick, IntendedTick);
+
+			// free view follows the cursor like it does on the server
+			if(pSpectator->m_SpecMode == SPEC_FREEVIEW && Size >= (int)sizeof(CNetObj_PlayerInput))
+			{
+				const CNetObj_PlayerInput *pInput = (const CNetObj_PlayerInput *)aData;
+				pSpectator->m_ViewX -= clamp(pSpectator->m_ViewX-pInput->m_TargetX, -500, 500);
+				pSpectator->m_ViewY -= clamp(pSpectator->m_ViewY-pInput->m_TargetY, -400, 400);
+			}
+		}
+		else if(Msg == NETMSG_PING)
+		{
+			CMsgPacker Reply(NETMSG_PING_REPLY, true);
+			SendSpectator(ClientID, &Reply, 0);
+		}
+		return;
+	}
+
+	void *pRawMsg = s_NetObjHandler.SecureUnpackMsg(Msg, &Unpacker);
+	if(!pRawMsg)
+		return;
+	if(Msg == NETMSGTYPE_CL_STARTINFO && pSpectator->m_State == SPECTATOR_READY)
+	{
+		if(m_aCachedMsgs[CACHED_TUNEPARAMS].m_Size)
+			SendSpectator(ClientID, m_aCachedMsgs[CACHED_TUNEPARAMS].m_aData, m_aCachedMsgs[CACHED_TUNEPARAMS].m_Size, MSGFLAG_VITAL);
+		CNetMsg_Sv_ReadyToEnter ReadyToEnter;
+		CMsgPacker Packer(ReadyToEnter.MsgID(), false);
+		ReadyToEnter.Pack(&Packer);
+		SendSpectator(ClientID, &Packer, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+	}
+	else if(Msg == NETMSGTYPE_CL_SETSPECTATORMODE)
+	{
+		const CNetMsg_Cl_SetSpectatorMode *pMsg = (const CNetMsg_Cl_SetSpectatorMode *)pRawMsg;
+		if(pMsg->m_SpecMode == SPEC_PLAYER && (pMsg->m_SpectatorID < 0 || pMsg->m_SpectatorID >= MAX_CLIENTS || !m_aClientInfos[pMsg->m_SpectatorID].m_Active))
+			return;
+		pSpectator->m_SpecMode = pMsg->m_SpecMode;
+		pSpectator->m_SpectatorID = pMsg->m_SpecMode == SPEC_PLAYER ? pMsg->m_SpectatorID : -1;
+	}
+}
+
+void CRelay::SendMap(int ClientID)
+{
+	CSpectator *pSpectator = &m_aSpectators[ClientID];
+	pSpectator->m_State = SPECTATOR_LOADING;
+	pSpectator->m_MapChunk = 0;
+	pSpectator->m_MapChunksPerRequest = MAP_CHUNKS_PER_REQUEST;
+	pSpectator->m_AckedTick = -1;
+
+	CMsgPacker Msg(NETMSG_MAP_CHANGE, true);
+	Msg.AddString(m_aMapName, 0);
+	Msg.AddInt(m_MapCrc);
+	Msg.AddInt(m_MapSize);
+	Msg.AddInt(MAP_CHUNKS_PER_REQUEST);
+	Msg.AddInt(MAP_CHUNK_SIZE);
+	Msg.AddRaw(&m_MapSha256, sizeof(m_MapSha256));
+	Msg.AddString("", 0); // no download url
+	Msg.AddInt(1); // requests can name the first chunk and the window
+	SendSpectator(ClientID, &Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+}
+
+void CRelay::SendMapData(int ClientID)
+{
+	CSpectator *pSpectator = &m_aSpectators[ClientID];
+	int NumChunks = (m_MapSize+MAP_CHUNK_SIZE-1)/MAP_CHUNK_SIZE;
+	for(int i = 0; i < pSpectator->m_MapChunksPerRequest && pSpectator->m_MapChunk < NumChunks; i++)
+	{
+		int Offset = pSpectator->m_MapChunk*MAP_CHUNK_SIZE;
+		CMsgPacker Msg(NETMSG_MAP_DATA, true);
+		Msg.AddRaw(m_pMapData+Offset, min((int)MAP_CHUNK_SIZE, m_MapSize-Offset));
+		SendSpectator(ClientID, &Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+		pSpectator->m_MapChunk++;
+	}
+}
+
+void CRelay::SendClientInfos(int ClientID)
+{
+	// others before the local one, like the server does it
+	for(int Pass = 0; Pass < 2; Pass++)
+	{
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			const CClientInfo *pInfo = &m_aClientInfos[i];
+			if(!pInfo->m_Active || (i == m_LocalClientID) != (Pass == 1))
+				continue;
+
+			CNetMsg_Sv_ClientInfo Msg;
+			Msg.m_ClientID = i;
+			Msg.m_Local = i == m_LocalClientID;
+			Msg.m_Team = pInfo->m_Team;
+			Msg.m_pName = pInfo->m_aName;
+			Msg.m_pClan = pInfo->m_aClan;
+			Msg.m_Country = pInfo->m_Country;
+			Msg.m_Silent = 1;
+			for(int p = 0; p < NUM_SKINPARTS; p++)
+			{
+				Msg.m_apSkinPartNames[p] = pInfo->m_aaSkinPartNames[p];
+				Msg.m_aUseCustomColors[p] = pInfo->m_aUseCustomColors[p];
+				Msg.m_aSkinPartColors[p] = pInfo->m_aSkinPartColors[p];
+			}
+			CMsgPacker Packer(Msg.MsgID(), false);
+			Msg.Pack(&Packer);
+			SendSpectator(ClientID, &Packer, MSGFLAG_VITAL);
+		}
+	}
+}
+
+void CRelay::UpdateView(CSpectator *pSpectator, const CSnapshot *pWorld)
+{
+	if(pSpectator->m_SpecMode == SPEC_PLAYER)
+	{
+		int Index = pWorld->GetItemIndex((NETOBJTYPE_CHARACTER<<16)|pSpectator->m_SpectatorID);
+		if(Index >= 0)
+		{
+			const CNetObj_Character *pChar = (const CNetObj_Character *)pWorld->GetItem(Index)->Data();
+			pSpectator->m_ViewX = pChar->m_X;
+			pSpectator->m_ViewY = pChar->m_Y;
+		}
+	}
+	else if(pSpectator->m_SpecMode == SPEC_FLAGRED || pSpectator->m_SpecMode == SPEC_FLAGBLUE)
+	{
+		int Team = pSpectator->m_SpecMode == SPEC_FLAGRED ? TEAM_RED : TEAM_BLUE;
+		for(int i = 0; i < pWorld->NumItems(); i++)
+		{
+			const CSnapshotItem *pItem = pWorld->GetItem(i);
+			if(pItem->Type() != NETOBJTYPE_FLAG || ((const CNetObj_Flag *)pItem->Data())->m_Team != Team)
+				continue;
+			pSpectator->m_ViewX = ((const CNetObj_Flag *)pItem->Data())->m_X;
+			pSpectator->m_ViewY = ((const CNetObj_Flag *)pItem->Data())->m_Y;
+			break;
+		}
+	}
+}
+
+int CRelay::BuildSnapshot(const CSnapshot *pWorld, const CNetObj_SpectatorInfo *pInfo, CSnapshot *pOut)
+{
+	// the world with the view of the spectator, which the server only sends to the player it belongs to
+	CSnapshotBuilder Builder;
+	Builder.Init(pWorld);
+	if(m_LocalClientID >= 0)
+	{
+		void *pItem = Builder.NewItem(NETOBJTYPE_SPECTATORINFO, m_LocalClientID, sizeof(*pInfo));
+		if(pItem)
+			mem_copy(pItem, pInfo, sizeof(*pInfo));
+	}
+	return Builder.Finish(pOut);
+}
+
+void CRelay::SendSnapshot(int ClientID, int Tick, const CSnapshot *pWorld)
+{
+	CSpectator *pSpectator = &m_aSpectators[ClientID];
+
+	// rebuild what the spectator acked to make the delta against
+	static CSnapshot s_EmptySnap;
+	s_EmptySnap.Clear();
+	unsigned char aBase[CSnapshot::MAX_SIZE];
+	const CSnapshot *pBase = &s_EmptySnap;
+	int DeltaTick = -1;
+	CSnapshot *pAckedWorld;
+	int Slot = pSpectator->m_AckedTick >= 0 ? pSpectator->m_AckedTick%SNAP_HISTORY : 0;
+	if(pSpectator->m_AckedTick >= 0 && pSpectator->m_aSentTicks[Slot] == pSpectator->m_AckedTick &&
+		m_Snapshots.Get(pSpectator->m_AckedTick, 0, &pAckedWorld, 0) >= 0)
+	{
+		BuildSnapshot(pAckedWorld, &pSpectator->m_aSentInfos[Slot], (CSnapshot *)aBase);
+		pBase = (const CSnapshot *)aBase;
+		DeltaTick = pSpectator->m_AckedTick;
+	}
+	else if(Tick%10 != 0)
+	{
+		// full snapshots only now and then until one got through
+		return;
+	}
+
+	UpdateView(pSpectator, pWorld);
+	CNetObj_SpectatorInfo Info;
+	Info.m_SpecMode = pSpectator->m_SpecMode;
+	Info.m_SpectatorID = pSpectator->m_SpectatorID;
+	Info.m_X = pSpectator->m_ViewX;
+	Info.m_Y = pSpectator->m_ViewY;
+	Slot = Tick%SNAP_HISTORY;
+	pSpectator->m_aSentTicks[Slot] = Tick;
+	pSpectator->m_aSentInfos[Slot] = Info;
+
+	unsigned char aSnap[CSnapshot::MAX_SIZE];
+	CSnapshot *pSnap = (CSnapshot *)aSnap;
+	BuildSnapshot(pWorld, &Info, pSnap);
+	int Crc = pSnap->Crc();
+
+	unsigned char aDeltaData[CSnapshot::MAX_SIZE];
+	unsigned char aData[CSnapshot::MAX_SIZE];
+	int DeltaSize = s_pSnapshotDelta->CreateDelta(pBase, pSnap, aDeltaData);
+	int Size = DeltaSize ? CVariableInt::Compress(aDeltaData, DeltaSize, aData, sizeof(aData)) : 0;
+	if(Size < 0)
+		return;
+
+	if(!Size)
+	{
+		CMsgPacker Msg(NETMSG_SNAPEMPTY, true);
+		Msg.AddInt(Tick);
+		Msg.AddInt(Tick-DeltaTick);
+		SendSpectator(ClientID, &Msg, MSGFLAG_FLUSH);
+		return;
+	}
+
+	int NumPackets = (Size+MAX_SNAPSHOT_PACKSIZE-1)/MAX_SNAPSHOT_PACKSIZE;
+	for(int n = 0, Left = Size; Left > 0; n++)
+	{
+		int Chunk = min(Left, (int)MAX_SNAPSHOT_PACKSIZE);
+		Left -= Chunk;
+		CMsgPacker Msg(NumPackets == 1 ? NETMSG_SNAPSINGLE : NETMSG_SNAP, true);
+		Msg.AddInt(Tick);
+		Msg.AddInt(Tick-DeltaTick);
+		if(NumPackets > 1)
+		{
+			Msg.AddInt(NumPackets);
+			Msg.AddInt(n);
+		}
+		Msg.AddInt(Crc);
+		Msg.AddInt(Chunk);
+		Msg.AddRaw(&aData[n*MAX_SNAPSHOT_PACKSIZE], Chunk);
+		SendSpectator(ClientID, &Msg, Left ? 0 : MSGFLAG_FLUSH);
+	}
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	int Port = 8303;
+	int MaxSpectators = NET_MAX_CLIENTS;
+	const char *pPassword = "";
+	const char *pName = "relay";
+	const char *pAddress = 0;
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		if(str_comp(argv[i], "-p") == 0 && i+1 < argc) // ignore_convention
+			Port = str_toint(argv[++i]); // ignore_convention
+		else if(str_comp(argv[i], "-n") == 0 && i+1 < argc) // ignore_convention
+			MaxSpectators = clamp(str_toint(argv[++i]), 1, (int)NET_MAX_CLIENTS); // ignore_convention
+		else if(str_comp(argv[i], "-w") == 0 && i+1 < argc) // ignore_convention
+			pPassword = argv[++i]; // ignore_convention
+		else if(str_comp(argv[i], "-name") == 0 && i+1 < argc) // ignore_convention
+			pName = argv[++i]; // ignore_convention
+		else
+			pAddress = argv[i]; // ignore_convention
+	}
+
+	NETADDR Addr;
+	if(!pAddress || net_host_lookup(pAddress, &Addr, NETTYPE_ALL) != 0)
+	{
+		dbg_msg("relay", "usage: relay [-p port] [-n max spectators] [-w relay password] [-name name] address[:port]");
+		return -1;
+	}
+	if(!Addr.port)
+		Addr.port = 8303;
+	if(net_init() != 0 || secure_random_init() != 0)
+	{
+		dbg_msg("relay", "could not initialize network");
+		return -1;
+	}
+
+	CConfigManager *pConfigManager = new CConfigManager();
+	pConfigManager->Reset();
+	s_pConfig = pConfigManager->Values();
+	s_pSnapshotDelta = new CSnapshotDelta();
+	// the same sizes the game registers
+	static const int OLD_NUM_NETOBJTYPES = 23;
+	for(int i = 0; i < OLD_NUM_NETOBJTYPES; i++)
+		s_pSnapshotDelta->SetStaticsize(i, s_NetObjHandler.GetObjSize(i));
+
+	CRelay *pRelay = new CRelay();
+	if(!pRelay->Init(Port, MaxSpectators, &Addr, pPassword, pName))
+	{
+		dbg_msg("relay", "could not open the sockets");
+		delete pRelay;
+		return -1;
+	}
+	dbg_msg("relay", "serving up to %d spectators on port %d", MaxSpectators, Port);
+
+	while(1)
+	{
+		pRelay->Update();
+		thread_sleep(1);
+	}
+
+	pRelay->Close();
+	delete pRelay;
+	delete s_pSnapshotDelta;
+	delete pConfigManager;
+	return 0;
+}
@@ -7,6 +7,7 @@
 #include <engine/kernel.h>
 #include <engine/storage.h>
 
+#include <engine/shared/config.h>
 #include <engine/shared/network.h>
 
 #include <game/version.h>
@@ -15,24 +16,25 @@
 #include "mapversions.h"
 
 enum {
-	MAX_MAPS_PER_PACKET=48,
+	// the whole list packet has to fit the payload, the connless header goes in front of it
+	MAX_MAPS_PER_PACKET=(NET_MAX_PAYLOAD-sizeof(VERSIONSRV_MAPLIST))/sizeof(CMapVersion),
 	MAX_PACKETS=16,
 	MAX_MAPS=MAX_MAPS_PER_PACKET*MAX_PACKETS,
 };
 
+// responses are packed once, answering only writes the tokens into the header
 struct CPacketData
 {
 	int m_Size;
-	struct {
-		unsigned char m_aHeader[sizeof(VERSIONSRV_MAPLIST)];
-		CMapVersion m_aMaplist[MAX_MAPS_PER_PACKET];
-	} m_Data;
+	unsigned char m_aData[NET_PACKETHEADERSIZE_CONNLESS+NET_MAX_PAYLOAD];
 };
 
 CPacketData m_aPackets[MAX_PACKETS];
 static int m_NumPackets = 0;
+static CPacketData m_VersionPacket;
 
 static CNetClient g_NetOp; // main
+static CNetConnlessLimiter g_Limiter;
 
 void BuildPackets()
 {
@@ -47,36 +49,51 @@ void BuildPackets()
 		ServersLeft -= Chunk;
 
 		// copy header
-		mem_copy(m_aPackets[m_NumPackets].m_Data.m_aHeader, VERSIONSRV_MAPLIST, sizeof(VERSIONSRV_MAPLIST));
+		unsigned char *pData = m_aPackets[m_NumPackets].m_aData+NET_PACKETHEADERSIZE_CONNLESS;
+		mem_copy(pData, VERSIONSRV_MAPLIST, sizeof(VERSIONSRV_MAPLIST));
 
 		// copy map versions
-		for(int i = 0; i < Chunk; i++)
-		{
-			m_aPackets[m_NumPackets].m_Data.m_aMaplist[i] = *pCurrent;
-			pCurrent++;
-		}
+		mem_copy(pData+sizeof(VERSIONSRV_MAPLIST), pCurrent, sizeof(CMapVersion)*Chunk);
+		pCurrent += Chunk;
 
-		m_aPackets[m_NumPackets].m_Size = sizeof(VERSIONSRV_MAPLIST) + sizeof(CMapVersion)*Chunk;
+		m_aPackets[m_NumPackets].m_Size = NET_PACKETHEADERSIZE_CONNLESS + sizeof(VERSIONSRV_MAPLIST) + sizeof(CMapVersion)*Chunk;
 
 		m_NumPackets++;
 	}
+
+	unsigned char *pData = m_VersionPacket.m_aData+NET_PACKETHEADERSIZE_CONNLESS;
+	mem_copy(pData, VERSIONSRV_VERSION, sizeof(VERSIONSRV_VERSION));
+	mem_copy(pData + sizeof(VERSIONSRV_VERSION), GAME_RELEASE_VERSION, sizeof(GAME_RELEASE_VERSION));
+	m_VersionPacket.m_Size = NET_PACKETHEADERSIZE_CONNLESS + sizeof(VERSIONSRV_VERSION) + sizeof(GAME_RELEASE_VERSION);
 }
 
-void SendVer(NETADDR *pAddr, TOKEN ResponseToken)
+void SendPacket(const NETADDR *pAddr, TOKEN Token, CPacketData *pPacket)
 {
-	CNetChunk p;
-	unsigned char aData[sizeof(VERSIONSRV_VERSION) + sizeof(GAME_RELEASE_VERSION)];
-
-	mem_copy(aData, VERSIONSRV_VERSION, sizeof(VERSIONSRV_VERSION));
-	mem_copy(aData + sizeof(VERSIONSRV_VERSION), GAME_RELEASE_VERSION, sizeof(GAME_RELEASE_VERSION));
+	if(Token != NET_TOKEN_NONE)
+	{
+		g_NetOp.SendPrepackedConnless(pAddr, Token, g_NetOp.ResponseToken(pAddr), pPacket->m_aData, pPacket->m_Size);
+		return;
+	}
 
+	// without a token the packet has to wait for one in the token cache
+	CNetChunk p;
 	p.m_ClientID = -1;
 	p.m_Address = *pAddr;
 	p.m_Flags = NETSENDFLAG_CONNLESS;
-	p.m_pData = aData;
-	p.m_DataSize = sizeof(aData);
+	p.m_pData = pPacket->m_aData+NET_PACKETHEADERSIZE_CONNLESS;
+	p.m_DataSize = pPacket->m_Size-NET_PACKETHEADERSIZE_CONNLESS;
+	g_NetOp.Send(&p, NET_TOKEN_NONE);
+}
+
+void SendVer(const NETADDR *pAddr, TOKEN ResponseToken)
+{
+	SendPacket(pAddr, ResponseToken, &m_VersionPacket);
+}
 
-	g_NetOp.Send(&p, ResponseToken);
+void SendMaplist(const NETADDR *pAddr, TOKEN ResponseToken)
+{
+	for(int i = 0; i < m_NumPackets; i++)
+		SendPacket(pAddr, ResponseToken, &m_aPackets[i]);
 }
 
 int main(int argc, const char **argv) // ignore_convention
@@ -85,7 +102,7 @@ int main(int argc, const char **argv) // ignore_convention
 
 	dbg_logger_stdout();
 
-	int FlagMask = 0;
+	int FlagMask = CFGFLAG_VERSION;
 	IKernel *pKernel = IKernel::Create();
 	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv);
 	IConfigManager *pConfigManager = CreateConfigManager();
@@ -99,6 +116,10 @@ int main(int argc, const char **argv) // ignore_convention
 		return -1;
 	pConfigManager->Init(FlagMask);
 	pConsole->Init();
+	CConfig *pConfig = pConfigManager->Values();
+
+	if(argc > 1) // ignore_convention
+		pConsole->ParseArguments(argc-1, &argv[1]); // ignore_convention
 
 	mem_zero(&BindAddr, sizeof(BindAddr));
 	BindAddr.type = NETTYPE_ALL;
@@ -108,12 +129,15 @@ int main(int argc, const char **argv) // ignore_convention
 		dbg_msg("versionsrv", "could not initialize secure RNG");
 		return -1;
 	}
-	if(!g_NetOp.Open(BindAddr, pConfigManager->Values(), pConsole, 0, 0))
+	if(!g_NetOp.Open(BindAddr, pConfig, pConsole, 0, 0, pConfig->m_VsNetSockets))
 	{
-		dbg_msg("mastersrv", "couldn't start network");
+		dbg_msg("versionsrv", "couldn't start network");
 		return -1;
 	}
 
+	g_Limiter.Init();
+	g_Limiter.SetLimits(pConfig->m_VsRate, pConfig->m_VsBurst, 0, 1);
+
 	BuildPackets();
 
 	dbg_msg("versionsrv", "started");
@@ -127,6 +151,10 @@ int main(int argc, const char **argv) // ignore_convention
 		TOKEN ResponseToken;
 		while(g_NetOp.Recv(&Packet, &ResponseToken))
 		{
+			// every request gets an answer at least as large, so spoofed ones are capped per address
+			if(!g_Limiter.Allow(&Packet.m_Address, time_get()))
+				continue;
+
 			if(Packet.m_DataSize == sizeof(VERSIONSRV_GETVERSION) &&
 				mem_comp(Packet.m_pData, VERSIONSRV_GETVERSION, sizeof(VERSIONSRV_GETVERSION)) == 0)
 			{
@@ -137,17 +165,7 @@ int main(int argc, const char **argv) // ignore_convention
 			/*if(Packet.m_DataSize == sizeof(VERSIONSRV_GETMAPLIST) &&
 				mem_comp(Packet.m_pData, VERSIONSRV_GETMAPLIST, sizeof(VERSIONSRV_GETMAPLIST)) == 0)
 			{
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-
-				for(int i = 0; i < m_NumPackets; i++)
-				{
-					p.m_DataSize = m_aPackets[i].m_Size;
-					p.m_pData = &m_aPackets[i].m_Data;
-					g_NetOp.Send(&p, ResponseToken);
-				}
+				SendMaplist(&Packet.m_Address, ResponseToken);
 			}*/
 		}
 